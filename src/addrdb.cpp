@@ -16,17 +16,16 @@
 
 namespace {
 
-template <typename Stream, typename Data>
-bool SerializeDB(Stream& stream, const Data& data)
+template <typename Data>
+bool SerializeDB(CDataStream& stream, const Data& data)
 {
-    // Write and commit header, data
+    // Header, data and the hash of both. The data is serialized only once,
+    // whatever lock it takes is held just as long as that takes.
     try {
-        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
         stream << FLATDATA(Params().MessageStart()) << data;
-        hasher << FLATDATA(Params().MessageStart()) << data;
-        stream << hasher.GetHash();
+        stream << Hash(stream.begin(), stream.end());
     } catch (const std::exception& e) {
-        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        return error("%s: Serialize error - %s", __func__, e.what());
     }
 
     return true;
@@ -35,6 +34,11 @@ bool SerializeDB(Stream& stream, const Data& data)
 template <typename Data>
 bool SerializeFileDB(const std::string& prefix, const fs::path& path, const Data& data)
 {
+    // Take a snapshot in memory first rather than serializing straight to
+    // the file, so that nobody waits for the disk
+    CDataStream ssData(SER_DISK, CLIENT_VERSION);
+    if (!SerializeDB(ssData, data)) return false;
+
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((unsigned char*)&randv, sizeof(randv));
@@ -47,8 +51,11 @@ bool SerializeFileDB(const std::string& prefix, const fs::path& path, const Data
     if (fileout.IsNull())
         return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
-    // Serialize
-    if (!SerializeDB(fileout, data)) return false;
+    try {
+        fileout.write(ssData.data(), ssData.size());
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
     FileCommit(fileout.Get());
     fileout.fclose();
 
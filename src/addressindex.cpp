@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addressindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <txdb.h>
+#include <undo.h>
+#include <validation.h>
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+AddressIndex::AddressIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : BaseIndex("addressindex", "address index"), pdb(new AddressIndexDB(nCacheSize, fMemory, fWipe))
+{
+}
+
+AddressIndex::~AddressIndex()
+{
+    Interrupt();
+    Stop();
+}
+
+void AddressIndex::GetHistory(const CScript& scriptPubKey, uint32_t nStart, uint32_t nCount, std::vector<AddressHistoryEntry>& vEntry) const
+{
+    pdb->ReadHistory(AddressIndexScript(scriptPubKey), nStart, nCount, vEntry);
+}
+
+void AddressIndex::GetUnspent(const CScript& scriptPubKey, uint32_t nStart, uint32_t nCount, std::vector<AddressUnspentEntry>& vEntry) const
+{
+    pdb->ReadUnspent(AddressIndexScript(scriptPubKey), nStart, nCount, vEntry);
+}
+
+bool AddressIndex::ReadLocator(CBlockLocator& locator)
+{
+    return pdb->ReadBestBlock(locator);
+}
+
+bool AddressIndex::WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex)
+{
+    return pdb->WriteBestBlock(locator);
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    return UpdateBlock(block, pindex, false);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo)
+{
+    for (const CBlockIndex* pindex = pindexFrom; pindex != pindexTo; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()) || !UpdateBlock(block, pindex, true))
+            return false;
+    }
+    return true;
+}
+
+bool AddressIndex::UpdateBlock(const CBlock& block, const CBlockIndex* pindex, bool fErase)
+{
+    // The outputs of the genesis block can't be spent
+    if (pindex->nHeight == 0)
+        return true;
+
+    // The scripts and amounts of the coins spent are in the undo data
+    CBlockUndo blockundo;
+    if (block.vtx.size() > 1 && !UndoReadFromDisk(blockundo, pindex))
+        return false;
+
+    if (fErase)
+        return pdb->EraseBlock(block, blockundo, pindex->nHeight);
+    return pdb->WriteBlock(block, blockundo, pindex->nHeight);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include <baseindex.h>
+
+#include <memory>
+#include <vector>
+
+class AddressIndexDB;
+class CBlock;
+class CBlockIndex;
+class CScript;
+struct AddressHistoryEntry;
+struct AddressUnspentEntry;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+
+/**
+ * Background indexer of the outputs paying to each scriptPubKey and of the
+ * inputs spending them (-addressindex), so that the history and unspent
+ * outputs of a script can be looked up without a wallet and a rescan.
+ *
+ * Sidechain escrow scripts are kept apart from other scripts, the history of
+ * the escrow of a sidechain being every CTIP it has had.
+ *
+ * Unlike the transaction index, entries of disconnected blocks are removed,
+ * so that the unspent outputs stay those of the active chain.
+ */
+class AddressIndex : public BaseIndex
+{
+public:
+    AddressIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~AddressIndex();
+
+    /** Append up to nCount history entries of scriptPubKey in height order,
+     * skipping the first nStart */
+    void GetHistory(const CScript& scriptPubKey, uint32_t nStart, uint32_t nCount, std::vector<AddressHistoryEntry>& vEntry) const;
+
+    /** Append up to nCount unspent outputs of scriptPubKey, skipping the
+     * first nStart */
+    void GetUnspent(const CScript& scriptPubKey, uint32_t nStart, uint32_t nCount, std::vector<AddressUnspentEntry>& vEntry) const;
+
+protected:
+    bool ReadLocator(CBlockLocator& locator) override;
+
+    bool WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo) override;
+
+private:
+    /** Add the entries of a block, or remove them if fErase */
+    bool UpdateBlock(const CBlock& block, const CBlockIndex* pindex, bool fErase);
+
+    std::unique_ptr<AddressIndexDB> pdb;
+};
+
+/** The global address index, null if -addressindex=0 */
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -212,6 +212,10 @@ private:
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
+    //! number of calls that may have changed the tables, to tell whether
+    //! they need to be written to disk again (memory only)
+    uint64_t nChanges;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -475,9 +479,10 @@ public:
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        nChanges++;
     }
 
-    CAddrMan()
+    CAddrMan() : nChanges(0)
     {
         Clear();
     }
@@ -494,6 +499,13 @@ public:
         return vRandom.size();
     }
 
+    //! Return a number that changes whenever the tables may have changed
+    uint64_t GetChanges() const
+    {
+        LOCK(cs);
+        return nChanges;
+    }
+
     //! Consistency check
     void Check()
     {
@@ -516,6 +528,7 @@ public:
         fRet |= Add_(addr, source, nTimePenalty);
         Check();
         if (fRet) {
+            nChanges++;
             LogPrint(BCLog::ADDRMAN, "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(), nTried, nNew);
         }
         return fRet;
@@ -531,6 +544,7 @@ public:
             nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
         Check();
         if (nAdd) {
+            nChanges++;
             LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
         }
         return nAdd > 0;
@@ -542,6 +556,7 @@ public:
         LOCK(cs);
         Check();
         Good_(addr, nTime);
+        nChanges++;
         Check();
     }
 
@@ -551,6 +566,7 @@ public:
         LOCK(cs);
         Check();
         Attempt_(addr, fCountFailure, nTime);
+        nChanges++;
         Check();
     }
 
@@ -588,6 +604,7 @@ public:
         LOCK(cs);
         Check();
         Connected_(addr, nTime);
+        nChanges++;
         Check();
     }
 
@@ -596,6 +613,7 @@ public:
         LOCK(cs);
         Check();
         SetServices_(addr, nServices);
+        nChanges++;
         Check();
     }
 
@@ -11,129 +11,348 @@
 #include <stdlib.h>
 #include <string>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
 
 using boost::asio::ip::tcp;
 
-APIClient::APIClient()
-{
+static const char* API_HOST = "blockchain.info";
+static const char* API_PORT = "443";
 
-}
+typedef boost::asio::ssl::stream<tcp::socket> SSLStream;
+typedef std::function<void(const boost::system::error_code&, size_t)> IOHandler;
 
-bool APIClient::IsTxReplayed(const uint256& txid)
+/** State of the keep-alive connection to the block explorer API */
+struct APIConnection
 {
-    // TODO use sendrequest instead of everything here
-    // TODO needs to return false if request failed and return replay status
-    // by reference
+    boost::asio::io_service io_service;
+    boost::asio::ssl::context sslContext;
+    std::unique_ptr<SSLStream> stream;
+    //! Received data that hasn't been parsed into a response yet
+    std::string strBuf;
+
+    APIConnection() : sslContext(boost::asio::ssl::context::method::sslv23_client) {}
+};
+
+/**
+ * Start an asynchronous operation on the stream and run the io_service until
+ * it completes. If it takes longer than API_TIMEOUT_SECONDS the socket is
+ * closed, which aborts the operation with an error.
+ */
+static size_t RunWithTimeout(boost::asio::io_service& io_service, SSLStream& stream, const std::function<void(const IOHandler&)>& start, boost::system::error_code& ec)
+{
+    bool fTimedOut = false;
+    boost::asio::deadline_timer deadline(io_service);
+    deadline.expires_from_now(boost::posix_time::seconds(API_TIMEOUT_SECONDS));
+    deadline.async_wait([&](const boost::system::error_code& e) {
+        if (e == boost::asio::error::operation_aborted)
+            return;
+        fTimedOut = true;
+        boost::system::error_code ignored;
+        stream.lowest_layer().close(ignored);
+    });
+
+    size_t nBytes = 0;
+    start([&](const boost::system::error_code& e, size_t n) {
+        ec = e;
+        nBytes = n;
+        deadline.cancel();
+    });
+
+    io_service.reset();
+    io_service.run();
+
+    if (fTimedOut)
+        ec = boost::asio::error::timed_out;
+    return nBytes;
+}
 
-    try {
-        // Setup BOOST ASIO for a synchronus call to the mainchain
-        boost::asio::io_service io_service;
-        boost::asio::ssl::context sslContext(boost::asio::ssl::context::method::sslv23_client);
-        boost::asio::ssl::stream<tcp::socket> sslSocket(io_service, sslContext);
-        tcp::resolver resolver(io_service);
+/** Did the API return this transaction, meaning it exists on the other chain? */
+static bool ResponseHasTx(const std::string& strBody, const uint256& txid)
+{
+    std::stringstream jss;
+    jss << strBody;
+    boost::property_tree::ptree ptree;
+    boost::property_tree::json_parser::read_json(jss, ptree);
+
+    // Did we find this transaction on the Bitcoin "Core" fork?
+    BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("")) {
+        if (value.first == "hash") {
+            std::string hash = value.second.data();
+            if (hash.empty())
+                continue;
+
+            // If we find the Tx on Bitcoin "Core", it is replayed
+            if (txid == uint256S(hash))
+                return true;
+        }
+    }
+    return false;
+}
 
-        tcp::resolver::query query("blockchain.info", "443");
-        auto endpoint_iterator = resolver.resolve(query);
+int ParseHTTPResponse(std::string& strBuf, bool fEOF, int& nStatus, std::string& strBody, bool& fKeepAlive)
+{
+    const size_t nHeaderEnd = strBuf.find("\r\n\r\n");
+    if (nHeaderEnd == std::string::npos)
+        return 0;
+
+    // Read the status line and headers
+    std::istringstream is(strBuf.substr(0, nHeaderEnd + 2));
+    std::string strVersion;
+    is >> strVersion >> nStatus;
+    if (!is || strVersion.compare(0, 5, "HTTP/") != 0)
+        return -1;
+
+    std::string strLine;
+    std::getline(is, strLine);
+
+    bool fChunked = false;
+    bool fHaveLength = false;
+    size_t nContentLength = 0;
+    fKeepAlive = true;
+    while (std::getline(is, strLine)) {
+        size_t nColon = strLine.find(':');
+        if (nColon == std::string::npos)
+            continue;
+        std::string strKey = strLine.substr(0, nColon);
+        std::string strValue = strLine.substr(nColon + 1);
+        boost::algorithm::to_lower(strKey);
+        boost::algorithm::to_lower(strValue);
+        boost::algorithm::trim(strValue);
+
+        if (strKey == "content-length") {
+            nContentLength = strtoul(strValue.c_str(), nullptr, 10);
+            fHaveLength = true;
+        } else if (strKey == "transfer-encoding" && strValue.find("chunked") != std::string::npos) {
+            fChunked = true;
+        } else if (strKey == "connection" && strValue == "close") {
+            fKeepAlive = false;
+        }
+    }
 
-        boost::asio::connect(sslSocket.lowest_layer(), endpoint_iterator);
+    size_t nPos = nHeaderEnd + 4;
+    strBody.clear();
+    if (fChunked) {
+        for (;;) {
+            const size_t nLineEnd = strBuf.find("\r\n", nPos);
+            if (nLineEnd == std::string::npos)
+                return 0;
+            const size_t nChunk = strtoul(strBuf.c_str() + nPos, nullptr, 16);
+            nPos = nLineEnd + 2;
+            if (nChunk == 0) {
+                // Skip (empty) trailers up to the empty line
+                for (;;) {
+                    const size_t nTrailerEnd = strBuf.find("\r\n", nPos);
+                    if (nTrailerEnd == std::string::npos)
+                        return 0;
+                    const bool fEnd = nTrailerEnd == nPos;
+                    nPos = nTrailerEnd + 2;
+                    if (fEnd)
+                        break;
+                }
+                break;
+            }
+            // Chunk data is followed by CRLF
+            if (strBuf.size() < nPos + nChunk + 2)
+                return 0;
+            strBody.append(strBuf, nPos, nChunk);
+            nPos += nChunk + 2;
+        }
+    } else if (fHaveLength) {
+        if (strBuf.size() < nPos + nContentLength)
+            return 0;
+        strBody.assign(strBuf, nPos, nContentLength);
+        nPos += nContentLength;
+    } else {
+        // No framing, the body runs until the server closes the connection
+        if (!fEOF)
+            return 0;
+        strBody.assign(strBuf, nPos, std::string::npos);
+        nPos = strBuf.size();
+        fKeepAlive = false;
+    }
 
-        sslSocket.handshake(boost::asio::ssl::stream_base::handshake_type::client);
+    strBuf.erase(0, nPos);
+    return 1;
+}
 
-        std::string strRequest = "/rawtx/";
-        strRequest += txid.ToString();
+APIReplayResult GetReplayResult(int nStatus, const std::string& strBody, const uint256& txid)
+{
+    if (nStatus == 404)
+        return API_REPLAY_FALSE;
+    if (nStatus != 200) {
+        LogPrintf("ERROR API client (CheckReplayStatus): HTTP status %d for %s\n", nStatus, txid.ToString());
+        return API_REPLAY_ERROR;
+    }
 
-        // HTTP request (package the json for sending)
-        boost::asio::streambuf output;
-        std::ostream os(&output);
-        os << "GET " << strRequest << " HTTP/1.1\n";
-        os << "Host: blockchain.info:443\n";
-        os << "Accept: application/json\n";
-        os << "Connection: close\n\n";
+    try {
+        return ResponseHasTx(strBody, txid) ? API_REPLAY_TRUE : API_REPLAY_FALSE;
+    } catch (std::exception &exception) {
+        LogPrintf("ERROR API client (CheckReplayStatus): %s\n", exception.what());
+    }
+    return API_REPLAY_ERROR;
+}
 
-        // Send the request
-        boost::asio::write(sslSocket, output);
+APIClient::APIClient() : conn(new APIConnection())
+{
 
-        // Read the reponse
-        std::string data;
-        for (;;)
-        {
-            boost::array<char, 4096> buf;
+}
 
-            // Read until end of file (socket closed)
-            boost::system::error_code e;
-            size_t sz = sslSocket.read_some(boost::asio::buffer(buf), e);
+APIClient::~APIClient()
+{
+    Disconnect();
+}
 
-            if (!sz)
-                break;
+bool APIClient::Connect()
+{
+    Disconnect();
 
-            data.insert(data.size(), buf.data(), sz);
+    try {
+        tcp::resolver resolver(conn->io_service);
+        tcp::resolver::query query(API_HOST, API_PORT);
+        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
 
-            if (e == boost::asio::error::eof)
-                break; // socket closed
-            else if (e)
-                throw boost::system::system_error(e);
+        conn->stream.reset(new SSLStream(conn->io_service, conn->sslContext));
+        SSLStream& stream = *conn->stream;
+
+        // Send the host name so servers behind shared TLS frontends present
+        // the right certificate
+        SSL_set_tlsext_host_name(stream.native_handle(), API_HOST);
+
+        // Try each resolved address in turn
+        boost::system::error_code ec = boost::asio::error::host_not_found;
+        for (tcp::resolver::iterator end; ec && endpoint_iterator != end; ++endpoint_iterator) {
+            tcp::endpoint endpoint = *endpoint_iterator;
+            stream.lowest_layer().close(ec);
+            RunWithTimeout(conn->io_service, stream, [&](const IOHandler& done) {
+                stream.lowest_layer().async_connect(endpoint,
+                        [done](const boost::system::error_code& e) { done(e, 0); });
+            }, ec);
         }
+        if (ec)
+            throw boost::system::system_error(ec);
+
+        RunWithTimeout(conn->io_service, stream, [&](const IOHandler& done) {
+            stream.async_handshake(boost::asio::ssl::stream_base::handshake_type::client,
+                    [done](const boost::system::error_code& e) { done(e, 0); });
+        }, ec);
+        if (ec)
+            throw boost::system::system_error(ec);
+    } catch (std::exception &exception) {
+        LogPrintf("ERROR API client (Connect): %s\n", exception.what());
+        Disconnect();
+        return false;
+    }
+    return true;
+}
 
-        std::stringstream ss;
-        ss << data;
+void APIClient::Disconnect()
+{
+    if (!conn->stream)
+        return;
 
-        // Get response code
-        ss.ignore(std::numeric_limits<std::streamsize>::max(), ' ');
-        int code;
-        ss >> code;
+    boost::system::error_code ignored;
+    conn->stream->lowest_layer().close(ignored);
+    conn->stream.reset();
+    conn->strBuf.clear();
+}
 
-        // Check response code
-        if (code != 200)
+bool APIClient::ReadResponse(int& nStatus, std::string& strBody, bool& fKeepAlive)
+{
+    bool fEOF = false;
+    while (true) {
+        const int nRet = ParseHTTPResponse(conn->strBuf, fEOF, nStatus, strBody, fKeepAlive);
+        if (nRet != 0)
+            return nRet > 0;
+        if (fEOF)
+            return false;
+
+        // Append whatever the server has sent so far
+        boost::system::error_code ec;
+        boost::array<char, 4096> buf;
+        const size_t nRead = RunWithTimeout(conn->io_service, *conn->stream, [&](const IOHandler& done) {
+            conn->stream->async_read_some(boost::asio::buffer(buf), done);
+        }, ec);
+        conn->strBuf.append(buf.data(), nRead);
+        if (ec == boost::asio::error::eof || ec == boost::asio::ssl::error::stream_truncated)
+            fEOF = true;
+        else if (ec)
             return false;
+    }
+}
 
-        // TODO just use find / rfind and get substring of {} ?
+bool APIClient::IsTxReplayed(const uint256& txid)
+{
+    bool fReplayed = false;
+    CheckReplayStatus(std::vector<uint256>(1, txid), [&](const uint256&, APIReplayResult result) {
+        fReplayed = result == API_REPLAY_TRUE;
+        return true;
+    });
+    return fReplayed;
+}
 
-        // Skip the rest of the header
-        for (size_t i = 0; i < 24; i++)
-            ss.ignore(std::numeric_limits<std::streamsize>::max(), '\r');
+bool APIClient::CheckReplayStatus(const std::vector<uint256>& vTxid, const std::function<bool(const uint256&, APIReplayResult)>& fn)
+{
+    size_t nNext = 0;
+    size_t nDepth = API_PIPELINE_DEPTH;
+    int nReconnects = 0;
 
-        for (size_t i = 0; i < 2; i++)
-            ss.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    while (nNext < vTxid.size()) {
+        if (!conn->stream && !Connect())
+            return false;
 
-        // Parse json response;
-        std::stringstream JSON;
-        JSON << ss.rdbuf();
+        // Write a batch of requests, then read the responses which the
+        // server must return in the same order
+        size_t nBatch = std::min(nDepth, vTxid.size() - nNext);
+        boost::asio::streambuf output;
+        std::ostream os(&output);
+        for (size_t i = 0; i < nBatch; i++) {
+            os << "GET /rawtx/" << vTxid[nNext + i].ToString() << " HTTP/1.1\r\n";
+            os << "Host: " << API_HOST << "\r\n";
+            os << "Accept: application/json\r\n";
+            os << "Connection: keep-alive\r\n\r\n";
+        }
 
-        data.clear();
-        data = JSON.str();
+        boost::system::error_code ec;
+        RunWithTimeout(conn->io_service, *conn->stream, [&](const IOHandler& done) {
+            boost::asio::async_write(*conn->stream, output, done);
+        }, ec);
+
+        size_t nDone = 0;
+        bool fKeepAlive = !ec;
+        while (nDone < nBatch && fKeepAlive) {
+            int nStatus = 0;
+            std::string strBody;
+            if (!ReadResponse(nStatus, strBody, fKeepAlive))
+                break;
 
-        // Create final JSON string with junk removed from the end
-        auto rpos = data.rfind("}");
-        std::string strJSON = data.substr(0, rpos + 3);
+            const uint256& txid = vTxid[nNext + nDone];
+            const APIReplayResult result = GetReplayResult(nStatus, strBody, txid);
 
-        std::stringstream jss;
-        jss << strJSON;
-        boost::property_tree::ptree ptree;
-        boost::property_tree::json_parser::read_json(jss, ptree);
+            nDone++;
+            if (!fn(txid, result))
+                return true;
+        }
+        nNext += nDone;
 
-        // Did we find this transaction on the Bitcoin "Core" fork?
-        BOOST_FOREACH(boost::property_tree::ptree::value_type &value, ptree.get_child("")) {
-            if (value.first == "hash") {
-                std::string hash = value.second.data();
-                if (hash.empty())
-                    continue;
+        if (!fKeepAlive || nDone < nBatch)
+            Disconnect();
 
-                // If we find the Tx on Bitcoin "Core", it is replayed
-                if (txid == uint256S(hash)) {
-                    return true;
-                }
+        // The connection dropped before all responses were read. Some servers
+        // don't handle pipelined requests, so retry one at a time.
+        if (nDone < nBatch) {
+            if (++nReconnects > API_MAX_RECONNECTS) {
+                LogPrintf("ERROR API client (CheckReplayStatus): connection lost\n");
+                return false;
             }
+            nDepth = 1;
         }
-    } catch (std::exception &exception) {
-        LogPrintf("ERROR API client (sendRequestToMainchain): %s\n", exception.what());
-        return false;
     }
-
-    return false;
+    return true;
 }
 
 bool APIClient::SendRequest(const std::string& json, boost::property_tree::ptree &ptree)
@@ -8,19 +8,67 @@
 #include <amount.h>
 #include <uint256.h>
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <boost/property_tree/json_parser.hpp>
 
+//! Number of requests written to the connection before reading responses
+static const size_t API_PIPELINE_DEPTH = 16;
+//! Seconds to wait on any single network operation before giving up
+static const int API_TIMEOUT_SECONDS = 15;
+//! Number of times a dropped connection is re-established per lookup batch
+static const int API_MAX_RECONNECTS = 3;
+
+enum APIReplayResult
+{
+    API_REPLAY_ERROR,
+    API_REPLAY_FALSE,
+    API_REPLAY_TRUE,
+};
+
+struct APIConnection;
+
+/**
+ * Parse one HTTP/1.1 response from the front of strBuf, with a body framed by
+ * Content-Length, chunked transfer encoding or, once fEOF is set, the end of
+ * the connection. Returns 1 and removes the response from strBuf once it is
+ * complete, 0 if more data is needed and -1 if it is malformed.
+ */
+int ParseHTTPResponse(std::string& strBuf, bool fEOF, int& nStatus, std::string& strBody, bool& fKeepAlive);
+
+/** The replay status of txid given the response to its /rawtx request */
+APIReplayResult GetReplayResult(int nStatus, const std::string& strBody, const uint256& txid);
+
 class APIClient
 {
 public:
     APIClient();
+    ~APIClient();
 
     bool IsTxReplayed(const uint256& txid);
 
+    /**
+     * Look up the replay status of each txid, reusing one keep-alive TLS
+     * connection and pipelining up to API_PIPELINE_DEPTH requests at a time.
+     * fn is called from the calling thread as each result arrives and may
+     * return false to stop early. Returns false if the API could not be
+     * reached; lookups that failed individually are reported as
+     * API_REPLAY_ERROR.
+     */
+    bool CheckReplayStatus(const std::vector<uint256>& vTxid, const std::function<bool(const uint256&, APIReplayResult)>& fn);
+
 private:
+    std::unique_ptr<APIConnection> conn;
+
+    bool Connect();
+    void Disconnect();
+
+    /** Read one HTTP/1.1 response from the connection */
+    bool ReadResponse(int& nStatus, std::string& strBody, bool& fKeepAlive);
+
     /*
      * Send json request
      */
@@ -20,94 +20,163 @@
 
 /** All alphanumeric characters except for "0", "I", "O", and "l" */
 static const char* pszBase58 = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+static const int8_t mapBase58[256] = {
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,0,1,2,3,4,5,6,7,8,-1,-1,-1,-1,-1,-1,
+    -1,9,10,11,12,13,14,15,16,-1,17,18,19,20,21,-1,
+    22,23,24,25,26,27,28,29,30,31,32,-1,-1,-1,-1,-1,
+    -1,33,34,35,36,37,38,39,40,41,42,43,-1,44,45,46,
+    47,48,49,50,51,52,53,54,55,56,57,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
 
-bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch)
+/**
+ * Numbers are converted between bases a limb at a time rather than a digit
+ * at a time: base58 goes through limbs of 58^5, which take 4 bytes of input
+ * per step, and base256 through limbs of 2^32, which take 5 characters of
+ * input per step. Both keep every product within 64 bits.
+ */
+static const uint32_t BASE58_LIMB = 656356768; // 58^5
+static const int BASE58_LIMB_DIGITS = 5;
+
+/** Apply "limbs = limbs * mul + add" in base 2^32, least significant limb first */
+static void MulAddBase256(std::vector<uint32_t>& limbs, uint32_t mul, uint32_t add)
+{
+    uint64_t carry = add;
+    for (uint32_t& limb : limbs) {
+        carry += (uint64_t)limb * mul;
+        limb = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry)
+        limbs.push_back((uint32_t)carry);
+}
+
+/** Apply "limbs = limbs * 2^(8 * bytes) + add" in base 58^5, least significant limb first */
+static void ShiftAddBase58(std::vector<uint32_t>& limbs, int bytes, uint32_t add)
+{
+    uint64_t carry = add;
+    for (uint32_t& limb : limbs) {
+        carry += (uint64_t)limb << (8 * bytes);
+        limb = carry % BASE58_LIMB;
+        carry /= BASE58_LIMB;
+    }
+    while (carry) {
+        limbs.push_back(carry % BASE58_LIMB);
+        carry /= BASE58_LIMB;
+    }
+}
+
+static bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch, std::vector<uint32_t>& limbs)
 {
     // Skip leading spaces.
     while (*psz && isspace(*psz))
         psz++;
     // Skip and count leading '1's.
     int zeroes = 0;
-    int length = 0;
     while (*psz == '1') {
         zeroes++;
         psz++;
     }
-    // Allocate enough space in big-endian base256 representation.
-    int size = strlen(psz) * 733 /1000 + 1; // log(58) / log(256), rounded up.
-    std::vector<unsigned char> b256(size);
-    // Process the characters.
+    // Process the characters, up to 5 at a time.
+    limbs.clear();
+    uint32_t group = 0;
+    uint32_t mul = 1;
     while (*psz && !isspace(*psz)) {
         // Decode base58 character
-        const char* ch = strchr(pszBase58, *psz);
-        if (ch == nullptr)
+        int digit = mapBase58[(uint8_t)*psz];
+        if (digit == -1)
             return false;
-        // Apply "b256 = b256 * 58 + ch".
-        int carry = ch - pszBase58;
-        int i = 0;
-        for (std::vector<unsigned char>::reverse_iterator it = b256.rbegin(); (carry != 0 || i < length) && (it != b256.rend()); ++it, ++i) {
-            carry += 58 * (*it);
-            *it = carry % 256;
-            carry /= 256;
+        group = group * 58 + digit;
+        mul *= 58;
+        if (mul == BASE58_LIMB) {
+            MulAddBase256(limbs, mul, group);
+            group = 0;
+            mul = 1;
         }
-        assert(carry == 0);
-        length = i;
         psz++;
     }
+    if (mul != 1)
+        MulAddBase256(limbs, mul, group);
     // Skip trailing spaces.
     while (isspace(*psz))
         psz++;
     if (*psz != 0)
         return false;
-    // Skip leading zeroes in b256.
-    std::vector<unsigned char>::iterator it = b256.begin() + (size - length);
-    while (it != b256.end() && *it == 0)
-        it++;
-    // Copy result into output vector.
-    vch.reserve(zeroes + (b256.end() - it));
+    // Copy result into output vector, without the leading zeroes of the top limb.
     vch.assign(zeroes, 0x00);
-    while (it != b256.end())
-        vch.push_back(*(it++));
+    vch.reserve(zeroes + 4 * limbs.size());
+    for (auto it = limbs.rbegin(); it != limbs.rend(); ++it) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            unsigned char byte = *it >> shift;
+            if (byte != 0 || vch.size() != (size_t)zeroes || it != limbs.rbegin())
+                vch.push_back(byte);
+        }
+    }
     return true;
 }
 
-std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
+bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch)
+{
+    std::vector<uint32_t> limbs;
+    return DecodeBase58(psz, vch, limbs);
+}
+
+static void EncodeBase58(const unsigned char* pbegin, const unsigned char* pend, std::string& str, std::vector<uint32_t>& limbs)
 {
     // Skip & count leading zeroes.
     int zeroes = 0;
-    int length = 0;
     while (pbegin != pend && *pbegin == 0) {
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    int size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
+    // Process the bytes, 4 at a time once the first group has taken what is
+    // left over.
+    limbs.clear();
+    limbs.reserve((pend - pbegin) * 138 / 100 / BASE58_LIMB_DIGITS + 1); // log(256) / log(58), rounded up.
+    int bytes = (pend - pbegin) % 4;
+    if (bytes == 0)
+        bytes = 4;
     while (pbegin != pend) {
-        int carry = *pbegin;
-        int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+        uint32_t add = 0;
+        for (int i = 0; i < bytes; i++)
+            add = (add << 8) | *(pbegin++);
+        ShiftAddBase58(limbs, bytes, add);
+        bytes = 4;
+    }
+    // Translate the result into a string, without the leading zeroes of the top limb.
+    str.assign(zeroes, '1');
+    str.reserve(zeroes + BASE58_LIMB_DIGITS * limbs.size());
+    for (auto it = limbs.rbegin(); it != limbs.rend(); ++it) {
+        char digits[BASE58_LIMB_DIGITS];
+        uint32_t limb = *it;
+        for (int i = BASE58_LIMB_DIGITS - 1; i >= 0; i--) {
+            digits[i] = pszBase58[limb % 58];
+            limb /= 58;
         }
-
-        assert(carry == 0);
-        length = i;
-        pbegin++;
+        int skip = 0;
+        if (it == limbs.rbegin()) {
+            while (skip < BASE58_LIMB_DIGITS - 1 && digits[skip] == '1')
+                skip++;
+        }
+        str.append(digits + skip, BASE58_LIMB_DIGITS - skip);
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
+}
+
+std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
+{
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
-    str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
+    std::vector<uint32_t> limbs;
+    EncodeBase58(pbegin, pend, str, limbs);
     return str;
 }
 
@@ -144,13 +213,33 @@ bool CBitcoinAddress::IsValid(const CChainParams& params) const
     return fCorrectSize && fKnownVersion;
 }
 
-std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn)
+static void EncodeBase58Check(const std::vector<unsigned char>& vchIn, std::string& str, std::vector<unsigned char>& vch, std::vector<uint32_t>& limbs)
 {
     // add 4-byte hash check to the end
-    std::vector<unsigned char> vch(vchIn);
+    vch.assign(vchIn.begin(), vchIn.end());
     uint256 hash = Hash(vch.begin(), vch.end());
     vch.insert(vch.end(), (unsigned char*)&hash, (unsigned char*)&hash + 4);
-    return EncodeBase58(vch);
+    EncodeBase58(vch.data(), vch.data() + vch.size(), str, limbs);
+}
+
+std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn)
+{
+    std::string str;
+    std::vector<unsigned char> vch;
+    std::vector<uint32_t> limbs;
+    EncodeBase58Check(vchIn, str, vch, limbs);
+    return str;
+}
+
+std::vector<std::string> EncodeBase58CheckBatch(const std::vector<std::vector<unsigned char>>& vvchIn)
+{
+    std::vector<std::string> vstr(vvchIn.size());
+    std::vector<unsigned char> vch;
+    std::vector<uint32_t> limbs;
+    for (size_t i = 0; i < vvchIn.size(); i++) {
+        EncodeBase58Check(vvchIn[i], vstr[i], vch, limbs);
+    }
+    return vstr;
 }
 
 bool DecodeBase58Check(const char* psz, std::vector<unsigned char>& vchRet)
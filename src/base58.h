@@ -52,6 +52,12 @@ bool DecodeBase58(const std::string& str, std::vector<unsigned char>& vchRet);
  */
 std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn);
 
+/**
+ * Encode byte vectors into base58-encoded strings, including checksums.
+ * Faster than encoding them one by one, as the buffers are reused.
+ */
+std::vector<std::string> EncodeBase58CheckBatch(const std::vector<std::vector<unsigned char>>& vvchIn);
+
 /**
  * Decode a base58-encoded string (psz) that includes a checksum into a byte
  * vector (vchRet), return true if decoding is successful
@@ -0,0 +1,251 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <baseindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+/** How often the sync thread saves its progress */
+static const int64_t INDEX_LOCATOR_INTERVAL = 30; // seconds
+
+BaseIndex::BaseIndex(const std::string& strIdIn, const std::string& strNameIn)
+    : strId(strIdIn), strName(strNameIn), pindexBest(nullptr), fSynced(false), fInterrupt(false)
+{
+}
+
+BaseIndex::~BaseIndex()
+{
+    // Derived indexes stop first, the sync thread uses their members
+    Interrupt();
+    Stop();
+}
+
+bool BaseIndex::Start()
+{
+    CBlockLocator locator;
+    if (!ReadLocator(locator))
+        locator.SetNull();
+
+    {
+        LOCK(cs_main);
+        // Unlike FindForkInGlobalIndex, keep a best block that has been
+        // disconnected since, the sync thread rewinds it to the fork
+        const CBlockIndex* pindex = nullptr;
+        for (const uint256& hash : locator.vHave) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hash);
+            if (it != mapBlockIndex.end()) {
+                pindex = it->second;
+                break;
+            }
+        }
+        if (!Init(pindex)) {
+            LogPrintf("%s: %s best block not found, indexing from genesis\n", __func__, strName);
+            pindex = nullptr;
+        }
+        pindexBest = pindex;
+        fSynced = pindex == chainActive.Tip();
+    }
+
+    // Register before starting the sync thread so that no block connected
+    // after it reaches the tip is missed
+    RegisterValidationInterface(this, strId);
+
+    threadSync = std::thread(&TraceThread<std::function<void()>>, strId.c_str(),
+            std::bind(&BaseIndex::ThreadSync, this));
+
+    return true;
+}
+
+void BaseIndex::Interrupt()
+{
+    fInterrupt = true;
+}
+
+void BaseIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+
+    if (threadSync.joinable())
+        threadSync.join();
+}
+
+void BaseIndex::ThreadSync()
+{
+    const CBlockIndex* pindex = pindexBest.load();
+    if (fSynced)
+        return;
+
+    // Blocks are read and indexed ahead of pindexBest, which is only moved
+    // once they have been committed
+    int64_t nLastLocatorWrite = GetTime();
+    while (!fInterrupt) {
+        const CBlockIndex* pindexNext = nullptr;
+        const CBlockIndex* pindexFork = nullptr;
+        {
+            LOCK(cs_main);
+            if (!pindex) {
+                pindexNext = chainActive.Genesis();
+            } else if (chainActive.Contains(pindex)) {
+                pindexNext = chainActive.Next(pindex);
+            } else {
+                // Our best block was disconnected, step back to the fork
+                pindexFork = chainActive.FindFork(pindex);
+            }
+
+            if (!pindexNext && !pindexFork) {
+                // Caught up, BlockConnected takes over from here. The last
+                // batch is written under cs_main so that no block is
+                // connected in between.
+                if (!Commit()) {
+                    LogPrintf("%s: Failed to write %s, index stopped\n", __func__, strName);
+                    return;
+                }
+                pindexBest = pindex;
+                fSynced = true;
+                break;
+            }
+        }
+
+        if (pindexFork) {
+            if (!Commit() || !Rewind(pindex, pindexFork)) {
+                LogPrintf("%s: Failed to rewind %s from block %s, index stopped\n",
+                        __func__, strName, pindex->GetBlockHash().ToString());
+                return;
+            }
+            pindex = pindexFork;
+            pindexBest = pindex;
+            continue;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindexNext, Params().GetConsensus())) {
+            LogPrintf("%s: Failed to read block %s from disk, %s stopped\n",
+                    __func__, pindexNext->GetBlockHash().ToString(), strName);
+            return;
+        }
+        if (!WriteBlock(block, pindexNext)) {
+            LogPrintf("%s: Failed to index block %s, %s stopped\n",
+                    __func__, pindexNext->GetBlockHash().ToString(), strName);
+            return;
+        }
+        pindex = pindexNext;
+
+        const bool fSaveLocator = GetTime() - nLastLocatorWrite >= INDEX_LOCATOR_INTERVAL;
+        if (fSaveLocator || IsBatchFull()) {
+            if (!Commit()) {
+                LogPrintf("%s: Failed to write %s, index stopped\n", __func__, strName);
+                return;
+            }
+            pindexBest = pindex;
+        }
+
+        if (fSaveLocator) {
+            WriteBestBlock(pindex);
+            nLastLocatorWrite = GetTime();
+            LogPrintf("Syncing %s with block chain from height %d\n", strName, pindex->nHeight);
+        }
+    }
+
+    if (fSynced) {
+        LogPrintf("%s: %s is synced to block %s\n", __func__, strName,
+                pindex ? pindex->GetBlockHash().ToString() : "null");
+    } else if (Commit()) {
+        pindexBest = pindex;
+        WriteBestBlock(pindex);
+    }
+}
+
+void BaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    if (!fSynced)
+        return;
+
+    const CBlockIndex* pindexPrev = pindexBest.load();
+    if (pindex->pprev != pindexPrev) {
+        // Blocks queued before the sync thread caught up may have been
+        // indexed by it already, don't move our best block back to them
+        if (pindexPrev && pindexPrev->GetAncestor(pindex->nHeight) == pindex)
+            return;
+
+        if (!pindexPrev || pindexPrev->GetAncestor(pindex->nHeight - 1) != pindex->pprev) {
+            // This can happen right after the sync thread caught up if there
+            // was a reorg and blocks of the stale branch are still queued
+            LogPrintf("%s: Block %s does not connect to the %s best block %s\n",
+                    __func__, pindex->GetBlockHash().ToString(), strName,
+                    pindexPrev ? pindexPrev->GetBlockHash().ToString() : "null");
+            return;
+        }
+
+        // A block forking off below our best block is only our new best
+        // block if the chain hasn't moved away from it again
+        {
+            LOCK(cs_main);
+            if (!chainActive.Contains(pindex))
+                return;
+        }
+        if (!Rewind(pindexPrev, pindex->pprev)) {
+            LogPrintf("%s: Failed to rewind %s from block %s\n",
+                    __func__, strName, pindexPrev->GetBlockHash().ToString());
+            return;
+        }
+        pindexBest = pindex->pprev;
+    }
+
+    if (!WriteBlock(*block, pindex) || !Commit()) {
+        LogPrintf("%s: Failed to index block %s in %s\n", __func__, pindex->GetBlockHash().ToString(), strName);
+        return;
+    }
+    pindexBest = pindex;
+}
+
+void BaseIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    if (!fSynced)
+        return;
+
+    // Step back so that the blocks of the new branch connect
+    const CBlockIndex* pindex = pindexBest.load();
+    if (!pindex || pindex->GetBlockHash() != block->GetHash())
+        return;
+
+    if (!Rewind(pindex, pindex->pprev)) {
+        LogPrintf("%s: Failed to remove block %s from %s\n", __func__, pindex->GetBlockHash().ToString(), strName);
+        return;
+    }
+    pindexBest = pindex->pprev;
+}
+
+void BaseIndex::SetBestChain(const CBlockLocator& locator)
+{
+    if (!fSynced)
+        return;
+
+    // Every block up to pindexBest has been written by now, save our
+    // progress along with the chainstate
+    WriteBestBlock(pindexBest.load());
+}
+
+bool BaseIndex::WriteBestBlock(const CBlockIndex* pindex)
+{
+    if (!pindex)
+        return true;
+
+    // The first entry is pindex itself even if it has been disconnected
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+
+    if (!WriteLocator(locator, pindex)) {
+        LogPrintf("%s: Failed to write %s best block\n", __func__, strName);
+        return false;
+    }
+    return true;
+}
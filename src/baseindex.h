@@ -0,0 +1,115 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BASEINDEX_H
+#define BITCOIN_BASEINDEX_H
+
+#include <validationinterface.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+struct CBlockLocator;
+
+/**
+ * Base of the indexes built in the background from the blocks of the active
+ * chain.
+ *
+ * Blocks are indexed on the validation callback thread of the index as
+ * BlockConnected callbacks arrive, outside of ConnectBlock and cs_main. On
+ * startup a sync thread first catches up from the best block saved by the
+ * index to the current chain tip, reading blocks from disk. The best block is
+ * saved whenever the chainstate is flushed, so an unclean shutdown only costs
+ * re-indexing the blocks connected since, and an index can be turned off and
+ * on again to continue where it stopped.
+ *
+ * Blocks that are disconnected are handed to Rewind, whether the index was
+ * running at the time or they were disconnected while it was off.
+ */
+class BaseIndex : public CValidationInterface
+{
+public:
+    /** strIdIn names the sync and callback threads, strNameIn is used in
+     * log messages */
+    BaseIndex(const std::string& strIdIn, const std::string& strNameIn);
+    virtual ~BaseIndex();
+
+    /** Load the best block, register for validation callbacks and start
+     * syncing to the chain tip */
+    bool Start();
+
+    /** Tell the sync thread to stop at the next block */
+    void Interrupt();
+
+    /** Unregister from validation callbacks and wait for the sync thread */
+    void Stop();
+
+    /** Return whether the index has caught up with the chain tip */
+    bool IsSynced() const { return fSynced; }
+
+    /** Return the last block that has been indexed */
+    const CBlockIndex* GetBestBlock() const { return pindexBest.load(); }
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+    void SetBestChain(const CBlockLocator& locator) override;
+
+    /** Read the locator of the best block saved by the index */
+    virtual bool ReadLocator(CBlockLocator& locator) = 0;
+
+    /** Save the locator of pindex, the best block of the index */
+    virtual bool WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex) = 0;
+
+    /** Load the state of the index at pindex, its saved best block, or the
+     * empty state if pindex is null. Called by Start under cs_main. If the
+     * state can't be loaded, leave the empty state and return false to
+     * index from genesis. */
+    virtual bool Init(const CBlockIndex* pindex) { return true; }
+
+    /** Index a block whose parent is the best block. The entries may be
+     * kept back until Commit. */
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+
+    /** Write the entries kept back by WriteBlock */
+    virtual bool Commit() { return true; }
+
+    /** Whether the sync thread should commit the blocks it indexed so far
+     * before reading the next one */
+    virtual bool IsBatchFull() const { return true; }
+
+    /** Undo the blocks from pindexFrom down to, but not including, its
+     * ancestor pindexTo, which becomes the best block. By default entries of
+     * disconnected blocks are left in place. */
+    virtual bool Rewind(const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo) { return true; }
+
+private:
+    /** Read blocks from disk and index them until we reach the chain tip */
+    void ThreadSync();
+
+    /** Save pindex as the best block of the index */
+    bool WriteBestBlock(const CBlockIndex* pindex);
+
+    const std::string strId;
+    const std::string strName;
+
+    /** Last block that has been indexed */
+    std::atomic<const CBlockIndex*> pindexBest;
+
+    /** Whether the sync thread is done and BlockConnected should index */
+    std::atomic<bool> fSynced;
+
+    std::atomic<bool> fInterrupt;
+
+    std::thread threadSync;
+};
+
+#endif // BITCOIN_BASEINDEX_H
@@ -53,7 +53,55 @@ static void Base58Decode(benchmark::State& state)
     }
 }
 
+static void Base58Encode_25b(benchmark::State& state)
+{
+    // A P2PKH address: version, hash160 and checksum
+    std::vector<unsigned char> vch(25);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = i * 37 + 11;
+    while (state.KeepRunning()) {
+        EncodeBase58(vch.data(), vch.data() + vch.size());
+    }
+}
+
+
+static void Base58Encode_78b(benchmark::State& state)
+{
+    // An extended public key, without its checksum
+    std::vector<unsigned char> vch(78);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = i * 37 + 11;
+    while (state.KeepRunning()) {
+        EncodeBase58(vch.data(), vch.data() + vch.size());
+    }
+}
+
+
+static void Base58Decode_78b(benchmark::State& state)
+{
+    const char* xpub = "xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8";
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning()) {
+        DecodeBase58(xpub, vch);
+    }
+}
+
+
+static void Base58CheckEncodeBatch(benchmark::State& state)
+{
+    std::vector<std::vector<unsigned char>> vvch(1000, std::vector<unsigned char>(21));
+    for (size_t i = 0; i < vvch.size(); i++)
+        vvch[i][1 + i % 20] = i;
+    while (state.KeepRunning()) {
+        EncodeBase58CheckBatch(vvch);
+    }
+}
+
 
 BENCHMARK(Base58Encode, 470 * 1000);
 BENCHMARK(Base58CheckEncode, 320 * 1000);
 BENCHMARK(Base58Decode, 800 * 1000);
+BENCHMARK(Base58Encode_25b, 1000 * 1000);
+BENCHMARK(Base58Encode_78b, 300 * 1000);
+BENCHMARK(Base58Decode_78b, 200 * 1000);
+BENCHMARK(Base58CheckEncodeBatch, 300);
@@ -5,13 +5,55 @@
 #include <bench/bench.h>
 #include <bench/perf.h>
 
+#include <clientversion.h>
+#include <utiltime.h>
+
+#include <univalue.h>
+
 #include <assert.h>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <regex>
+#include <sstream>
 #include <numeric>
 
+// Sorts values, returns the median
+static double Median(std::vector<double>& values)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    if (0 == values.size() % 2) {
+        return (values[mid - 1] + values[mid]) / 2;
+    }
+    return values[mid];
+}
+
+benchmark::Summary benchmark::Summarize(const State& state)
+{
+    Summary summary = {};
+
+    auto results = state.m_elapsed_results;
+    summary.median = Median(results);
+    summary.total = state.m_num_iters * std::accumulate(results.begin(), results.end(), 0.0);
+    if (!results.empty()) {
+        summary.min = results.front();
+        summary.max = results.back();
+    }
+
+    auto cycles = state.m_cycles_results;
+    summary.cycles_median = Median(cycles);
+    if (!cycles.empty()) {
+        summary.cycles_min = cycles.front();
+        summary.cycles_max = cycles.back();
+    }
+    return summary;
+}
+
 void benchmark::ConsolePrinter::header()
 {
     std::cout << "# Benchmark, evals, iterations, total, min, max, median" << std::endl;
@@ -19,31 +61,146 @@ void benchmark::ConsolePrinter::header()
 
 void benchmark::ConsolePrinter::result(const State& state)
 {
-    auto results = state.m_elapsed_results;
-    std::sort(results.begin(), results.end());
+    Summary summary = Summarize(state);
 
-    double total = state.m_num_iters * std::accumulate(results.begin(), results.end(), 0.0);
+    std::cout << std::setprecision(6);
+    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << summary.total << ", " << summary.min << ", " << summary.max << ", " << summary.median << std::endl;
+}
 
-    double front = 0;
-    double back = 0;
-    double median = 0;
+void benchmark::ConsolePrinter::footer() {}
 
-    if (!results.empty()) {
-        front = results.front();
-        back = results.back();
+void benchmark::JsonPrinter::header() {}
 
-        size_t mid = results.size() / 2;
-        median = results[mid];
-        if (0 == results.size() % 2) {
-            median = (results[mid] + results[mid + 1]) / 2;
-        }
+void benchmark::JsonPrinter::result(const State& state)
+{
+    m_results.push_back(Result{state.m_name, state.m_num_evals, state.m_num_iters, Summarize(state)});
+}
+
+void benchmark::JsonPrinter::footer()
+{
+    UniValue build(UniValue::VOBJ);
+    build.pushKV("version", FormatFullVersion());
+#ifdef __VERSION__
+    build.pushKV("compiler", __VERSION__);
+#endif
+#ifdef DEBUG
+    build.pushKV("debug", UniValue(true));
+#else
+    build.pushKV("debug", UniValue(false));
+#endif
+    build.pushKV("time", DateTimeStrFormat("%Y-%m-%dT%H:%M:%SZ", GetTime()));
+
+    UniValue benchmarks(UniValue::VARR);
+    for (const Result& result : m_results) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", result.name);
+        obj.pushKV("evals", result.evals);
+        obj.pushKV("iterations", result.iterations);
+        obj.pushKV("total", result.summary.total);
+        obj.pushKV("min", result.summary.min);
+        obj.pushKV("max", result.summary.max);
+        obj.pushKV("median", result.summary.median);
+        obj.pushKV("cycles_min", result.summary.cycles_min);
+        obj.pushKV("cycles_max", result.summary.cycles_max);
+        obj.pushKV("cycles_median", result.summary.cycles_median);
+        benchmarks.push_back(obj);
     }
 
+    UniValue out(UniValue::VOBJ);
+    out.pushKV("build", build);
+    out.pushKV("benchmarks", benchmarks);
+    std::cout << out.write(2) << std::endl;
+}
+
+void benchmark::CsvPrinter::header()
+{
+    std::cout << "name,evals,iterations,total,min,max,median,cycles_min,cycles_max,cycles_median" << std::endl;
+}
+
+void benchmark::CsvPrinter::result(const State& state)
+{
+    Summary summary = Summarize(state);
+
     std::cout << std::setprecision(6);
-    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << std::endl;
+    std::cout << state.m_name << "," << state.m_num_evals << "," << state.m_num_iters << "," << summary.total << ","
+              << summary.min << "," << summary.max << "," << summary.median << ","
+              << summary.cycles_min << "," << summary.cycles_max << "," << summary.cycles_median << std::endl;
 }
 
-void benchmark::ConsolePrinter::footer() {}
+void benchmark::CsvPrinter::footer() {}
+
+benchmark::ComparePrinter::ComparePrinter(Printer& printer, std::map<std::string, double> baseline, double threshold)
+    : m_printer(printer), m_baseline(std::move(baseline)), m_threshold(threshold), m_num_regressed(0)
+{
+}
+
+void benchmark::ComparePrinter::header()
+{
+    m_printer.header();
+}
+
+void benchmark::ComparePrinter::result(const State& state)
+{
+    m_printer.result(state);
+
+    std::ostringstream line;
+    line << std::setprecision(6) << state.m_name << ", ";
+
+    double median = Summarize(state).median;
+    auto it = m_baseline.find(state.m_name);
+    if (it == m_baseline.end() || it->second <= 0 || state.m_elapsed_results.empty()) {
+        line << "-, " << median << ", -, new";
+    } else {
+        double change = median / it->second - 1;
+        line << it->second << ", " << median << ", " << std::showpos << std::fixed << std::setprecision(1) << change * 100 << "%, ";
+        if (change > m_threshold) {
+            line << "REGRESSION";
+            m_num_regressed++;
+        } else if (change < -m_threshold) {
+            line << "improved";
+        } else {
+            line << "ok";
+        }
+    }
+    m_report.push_back(line.str());
+}
+
+void benchmark::ComparePrinter::footer()
+{
+    m_printer.footer();
+
+    std::cerr << "# Benchmark, baseline median, median, change, result" << std::endl;
+    for (const std::string& line : m_report) {
+        std::cerr << line << std::endl;
+    }
+    std::cerr << "# " << m_num_regressed << " of " << m_report.size() << " benchmarks slower than the baseline by more than "
+              << std::fixed << std::setprecision(1) << m_threshold * 100 << "%" << std::endl;
+}
+
+bool benchmark::ComparePrinter::ReadBaseline(const std::string& path, std::map<std::string, double>& baseline, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        error = "Cannot open " + path;
+        return false;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+
+    UniValue root;
+    if (!root.read(content.str()) || !root.isObject() || !root["benchmarks"].isArray()) {
+        error = path + " is not the output of -printer=json";
+        return false;
+    }
+    for (const UniValue& bench : root["benchmarks"].getValues()) {
+        if (!bench.isObject() || !bench["name"].isStr() || !bench["median"].isNum()) {
+            error = path + " has a benchmark without name or median";
+            return false;
+        }
+        baseline[bench["name"].get_str()] = bench["median"].get_real();
+    }
+    return true;
+}
 benchmark::PlotlyPrinter::PlotlyPrinter(std::string plotly_url, int64_t width, int64_t height)
     : m_plotly_url(plotly_url), m_width(width), m_height(height)
 {
@@ -130,11 +287,12 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
     perf_fini();
 }
 
-bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
+bool benchmark::State::UpdateTimer(const benchmark::time_point current_time, uint64_t current_cycles)
 {
     if (m_start_time != time_point()) {
         std::chrono::duration<double> diff = current_time - m_start_time;
         m_elapsed_results.push_back(diff.count() / m_num_iters);
+        m_cycles_results.push_back(static_cast<double>(current_cycles - m_start_cycles) / m_num_iters);
 
         if (m_elapsed_results.size() == m_num_evals) {
             return false;
@@ -15,6 +15,8 @@
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
 
+#include <bench/perf.h>
+
 // Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
 // framework (see https://github.com/google/benchmark)
 // Why not use the Google Benchmark framework? Because adding Yet Another Dependency
@@ -59,11 +61,14 @@ public:
     const uint64_t m_num_iters;
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
+    // CPU cycles per iteration of each evaluation, zero where perf_cpucycles isn't available
+    std::vector<double> m_cycles_results;
     time_point m_start_time;
+    uint64_t m_start_cycles;
 
-    bool UpdateTimer(time_point finish_time);
+    bool UpdateTimer(time_point finish_time, uint64_t finish_cycles);
 
-    State(std::string name, uint64_t num_evals, double num_iters, Printer& printer) : m_name(name), m_num_iters_left(0), m_num_iters(num_iters), m_num_evals(num_evals)
+    State(std::string name, uint64_t num_evals, double num_iters, Printer& printer) : m_name(name), m_num_iters_left(0), m_num_iters(num_iters), m_num_evals(num_evals), m_start_cycles(0)
     {
     }
 
@@ -73,15 +78,30 @@ public:
             return true;
         }
 
-        bool result = UpdateTimer(clock::now());
+        bool result = UpdateTimer(clock::now(), perf_cpucycles());
         // measure again so runtime of UpdateTimer is not included
         m_start_time = clock::now();
+        m_start_cycles = perf_cpucycles();
         return result;
     }
 };
 
 typedef std::function<void(State&)> BenchFunction;
 
+// Summary of the evaluations of a benchmark. Times are in seconds per
+// iteration except for the total, cycles are per iteration.
+struct Summary {
+    double total;
+    double min;
+    double max;
+    double median;
+    double cycles_min;
+    double cycles_max;
+    double cycles_median;
+};
+
+Summary Summarize(const State& state);
+
 class BenchRunner
 {
     struct Bench {
@@ -116,6 +136,60 @@ public:
     void footer();
 };
 
+// prints the summary of each benchmark and the build it was run with as JSON,
+// which -compare reads back as the baseline
+class JsonPrinter : public Printer
+{
+public:
+    void header();
+    void result(const State& state);
+    void footer();
+
+private:
+    struct Result {
+        std::string name;
+        uint64_t evals;
+        uint64_t iterations;
+        Summary summary;
+    };
+    std::vector<Result> m_results;
+};
+
+// prints the summary of each benchmark as comma separated values
+class CsvPrinter : public Printer
+{
+public:
+    void header();
+    void result(const State& state);
+    void footer();
+};
+
+// passes the results on to another printer and compares the median of each
+// benchmark to a baseline written by JsonPrinter, reporting to stderr
+class ComparePrinter : public Printer
+{
+public:
+    // threshold is the relative slowdown above which a benchmark counts as
+    // a regression, 0.1 for 10%
+    ComparePrinter(Printer& printer, std::map<std::string, double> baseline, double threshold);
+    void header();
+    void result(const State& state);
+    void footer();
+
+    // Read the medians of a JsonPrinter output into baseline
+    static bool ReadBaseline(const std::string& path, std::map<std::string, double>& baseline, std::string& error);
+
+    // Whether any benchmark regressed
+    bool Regressed() const { return m_num_regressed > 0; }
+
+private:
+    Printer& m_printer;
+    std::map<std::string, double> m_baseline;
+    double m_threshold;
+    std::vector<std::string> m_report;
+    int m_num_regressed;
+};
+
 // creates box plot with plotly.js
 class PlotlyPrinter : public Printer
 {
@@ -21,6 +21,7 @@ static const char* DEFAULT_BENCH_PRINTER = "console";
 static const char* DEFAULT_PLOT_PLOTLYURL = "https://cdn.plot.ly/plotly-latest.min.js";
 static const int64_t DEFAULT_PLOT_WIDTH = 1024;
 static const int64_t DEFAULT_PLOT_HEIGHT = 768;
+static const char* DEFAULT_COMPARE_THRESHOLD = "10";
 
 int
 main(int argc, char** argv)
@@ -34,7 +35,9 @@ main(int argc, char** argv)
                   << HelpMessageOpt("-evals=<n>", strprintf(_("Number of measurement evaluations to perform. (default: %u)"), DEFAULT_BENCH_EVALUATIONS))
                   << HelpMessageOpt("-filter=<regex>", strprintf(_("Regular expression filter to select benchmark by name (default: %s)"), DEFAULT_BENCH_FILTER))
                   << HelpMessageOpt("-scaling=<n>", strprintf(_("Scaling factor for benchmark's runtime (default: %u)"), DEFAULT_BENCH_SCALING))
-                  << HelpMessageOpt("-printer=(console|plot)", strprintf(_("Choose printer format. console: print data to console. plot: Print results as HTML graph (default: %s)"), DEFAULT_BENCH_PRINTER))
+                  << HelpMessageOpt("-printer=(console|plot|json|csv)", strprintf(_("Choose printer format. console: print data to console. plot: Print results as HTML graph. json: Print results with CPU cycles and build information as JSON. csv: Print results with CPU cycles as CSV (default: %s)"), DEFAULT_BENCH_PRINTER))
+                  << HelpMessageOpt("-compare=<file>", _("Compare the median of each benchmark to a baseline written with -printer=json, report to stderr and exit with status 1 if any is slower by more than -compare-threshold"))
+                  << HelpMessageOpt("-compare-threshold=<pct>", strprintf(_("Slowdown in percent above which a benchmark counts as a regression (default: %s)"), DEFAULT_COMPARE_THRESHOLD))
                   << HelpMessageOpt("-plot-plotlyurl=<uri>", strprintf(_("URL to use for plotly.js (default: %s)"), DEFAULT_PLOT_PLOTLYURL))
                   << HelpMessageOpt("-plot-width=<x>", strprintf(_("Plot width in pixel (default: %u)"), DEFAULT_PLOT_WIDTH))
                   << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT));
@@ -63,9 +66,27 @@ main(int argc, char** argv)
             gArgs.GetArg("-plot-plotlyurl", DEFAULT_PLOT_PLOTLYURL),
             gArgs.GetArg("-plot-width", DEFAULT_PLOT_WIDTH),
             gArgs.GetArg("-plot-height", DEFAULT_PLOT_HEIGHT)));
+    } else if ("json" == printer_arg) {
+        printer.reset(new benchmark::JsonPrinter());
+    } else if ("csv" == printer_arg) {
+        printer.reset(new benchmark::CsvPrinter());
     }
 
-    benchmark::BenchRunner::RunAll(*printer, evaluations, scaling_factor, regex_filter, is_list_only);
+    std::unique_ptr<benchmark::ComparePrinter> compare;
+    if (gArgs.IsArgSet("-compare")) {
+        std::map<std::string, double> baseline;
+        std::string error;
+        if (!benchmark::ComparePrinter::ReadBaseline(gArgs.GetArg("-compare", ""), baseline, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        double threshold = boost::lexical_cast<double>(gArgs.GetArg("-compare-threshold", DEFAULT_COMPARE_THRESHOLD)) / 100;
+        compare.reset(new benchmark::ComparePrinter(*printer, std::move(baseline), threshold));
+    }
+
+    benchmark::BenchRunner::RunAll(compare ? *compare : *printer, evaluations, scaling_factor, regex_filter, is_list_only);
 
     ECC_Stop();
+
+    return compare && compare->Regressed() ? 1 : 0;
 }
@@ -4,9 +4,12 @@
 
 #include <bench/bench.h>
 #include <coins.h>
+#include <flathashmap.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -85,3 +88,44 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Compare the containers the coins cache can be built with: add a batch of
+// coins, look each of them up along with a missing outpoint, then spend them
+// like BatchWrite does.
+template <typename Map>
+static void CoinsMapOps(benchmark::State& state)
+{
+    const int nCoins = 10000;
+    std::vector<COutPoint> vOutPoint;
+    FastRandomContext rng(true);
+    for (int i = 0; i < nCoins; i++)
+        vOutPoint.emplace_back(rng.rand256(), i % 4);
+    const CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    while (state.KeepRunning()) {
+        Map map;
+        for (const COutPoint& out : vOutPoint) {
+            Coin coin(CTxOut(1 * CENT, script), 1, false);
+            map.emplace(std::piecewise_construct, std::forward_as_tuple(out), std::forward_as_tuple(std::move(coin)));
+        }
+        for (const COutPoint& out : vOutPoint) {
+            assert(map.find(out) != map.end());
+            assert(map.find(COutPoint(out.hash, out.n + 4)) == map.end());
+        }
+        for (auto it = map.begin(); it != map.end(); it = map.erase(it)) {}
+        assert(map.size() == 0);
+    }
+}
+
+static void CoinsMapUnordered(benchmark::State& state)
+{
+    CoinsMapOps<std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>>(state);
+}
+
+static void CoinsMapFlat(benchmark::State& state)
+{
+    CoinsMapOps<flathashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>>(state);
+}
+
+BENCHMARK(CoinsMapUnordered, 20);
+BENCHMARK(CoinsMapFlat, 20);
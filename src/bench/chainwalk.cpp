@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <random.h>
+
+#include <memory>
+#include <vector>
+
+//! Length of the chains walked
+static const int CHAIN_WALK_LENGTH = 200000;
+
+static void BuildChain(std::vector<CBlockIndex*>& vpindex)
+{
+    for (size_t i = 0; i < vpindex.size(); i++) {
+        CBlockIndex* pindex = vpindex[i];
+        pindex->nHeight = i;
+        pindex->nTime = i * 150;
+        pindex->pprev = i ? vpindex[i - 1] : nullptr;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + arith_uint256(i + 1);
+        pindex->BuildSkip();
+    }
+}
+
+/** Walk back from the tip like GetNetworkHashPerSecond and the fee
+ * statistics do, then look up random ancestors */
+static void WalkChain(benchmark::State& state, const std::vector<CBlockIndex*>& vpindex)
+{
+    FastRandomContext rng(true);
+    const CBlockIndex* tip = vpindex.back();
+    uint64_t nSum = 0;
+    while (state.KeepRunning()) {
+        arith_uint256 nWork;
+        for (const CBlockIndex* pindex = tip; pindex; pindex = pindex->pprev) {
+            nSum += pindex->nTime;
+            nWork = pindex->nChainWork;
+        }
+        nSum += nWork.GetLow64();
+        for (int i = 0; i < 1000; i++)
+            nSum += tip->GetAncestor(rng.randrange(CHAIN_WALK_LENGTH))->nTime;
+    }
+}
+
+static void ChainWalkHeap(benchmark::State& state)
+{
+    // Entries allocated one by one, in between other allocations like the
+    // block index of a running node
+    std::vector<std::unique_ptr<CBlockIndex>> vHeap;
+    std::vector<std::unique_ptr<char[]>> vOther;
+    std::vector<CBlockIndex*> vpindex;
+    for (int i = 0; i < CHAIN_WALK_LENGTH; i++) {
+        vHeap.emplace_back(new CBlockIndex());
+        vOther.emplace_back(new char[200]);
+        vpindex.push_back(vHeap.back().get());
+    }
+    BuildChain(vpindex);
+    WalkChain(state, vpindex);
+}
+
+static void ChainWalkArena(benchmark::State& state)
+{
+    CBlockIndexArena arena;
+    std::vector<std::unique_ptr<char[]>> vOther;
+    std::vector<CBlockIndex*> vpindex;
+    for (int i = 0; i < CHAIN_WALK_LENGTH; i++) {
+        vpindex.push_back(arena.Allocate());
+        vOther.emplace_back(new char[200]);
+    }
+    BuildChain(vpindex);
+    WalkChain(state, vpindex);
+}
+
+BENCHMARK(ChainWalkHeap, 10);
+BENCHMARK(ChainWalkArena, 10);
@@ -7,7 +7,9 @@
 #include <chainparams.h>
 #include <validation.h>
 #include <streams.h>
+#include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 
 namespace block_bench {
 #include <bench/data/block413567.raw.h>
@@ -32,6 +34,21 @@ static void DeserializeBlockTest(benchmark::State& state)
     }
 }
 
+static void DeserializeBlockArenaTest(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK | SER_TX_ARENA, PROTOCOL_VERSION);
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        assert(stream.Rewind(sizeof(block_bench::block413567)));
+    }
+}
+
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
     CDataStream stream((const char*)block_bench::block413567,
@@ -52,5 +69,26 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// Duplicate input check of the transactions with the most inputs
+static void CheckTransactionManyInputs(benchmark::State& state)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = 9;
+    mtx.vout.emplace_back(1, CScript() << OP_TRUE);
+    for (uint32_t i = 0; i < 2000; i++) {
+        uint256 hash;
+        WriteLE32(hash.begin(), i * 2654435761U);
+        mtx.vin.emplace_back(COutPoint(hash, i % 3));
+    }
+    const CTransaction tx(mtx);
+
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        assert(CheckTransaction(tx, validationState));
+    }
+}
+
 BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(DeserializeBlockArenaTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
+BENCHMARK(CheckTransactionManyInputs, 500);
@@ -56,4 +56,58 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// Wallet that received many small sidechain withdrawal payouts. Coins are
+// added once, the benchmark measures selection only.
+static void addLargeWallet(const CWallet& wallet, std::vector<COutput>& vCoins)
+{
+    for (int i = 0; i < 100000; i++)
+        addCoin((1 + i % 1000) * CENT, wallet, vCoins);
+}
+
+static void CoinSelectionLargeWallet(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    addLargeWallet(wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(250 * COIN + 3 * CENT / 7, 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet >= 250 * COIN);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
+static void CoinSelectionLargeWalletBnB(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+    addLargeWallet(wallet, vCoins);
+
+    CoinSelectionParams params;
+    params.effective_fee = CFeeRate(1000);
+    params.not_input_fees = 50;
+    params.cost_of_change = 182;
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool fBnBUsed;
+        bool success = wallet.SelectCoinsMinConf(250 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params, &fBnBUsed);
+        assert(success);
+        assert(nValueRet >= 250 * COIN);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
 BENCHMARK(CoinSelection, 650);
+BENCHMARK(CoinSelectionLargeWallet, 5);
+BENCHMARK(CoinSelectionLargeWalletBnB, 5);
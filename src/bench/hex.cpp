@@ -0,0 +1,42 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <utilstrencodings.h>
+
+#include <assert.h>
+#include <string>
+#include <vector>
+
+// Hex of a 4 MB block, as returned by getblock <hash> 0
+static std::vector<unsigned char> BlockSizedData()
+{
+    std::vector<unsigned char> vch(4 * 1000 * 1000);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = i * 13 + (i >> 8);
+    return vch;
+}
+
+static void HexStrBlock(benchmark::State& state)
+{
+    const std::vector<unsigned char> vch = BlockSizedData();
+    while (state.KeepRunning()) {
+        std::string strHex = HexStr(vch.data(), vch.data() + vch.size());
+        assert(strHex.size() == vch.size() * 2);
+    }
+}
+
+static void ParseHexBlock(benchmark::State& state)
+{
+    const std::vector<unsigned char> vch = BlockSizedData();
+    const std::string strHex = HexStr(vch.data(), vch.data() + vch.size());
+    while (state.KeepRunning()) {
+        std::vector<unsigned char> vchParsed = ParseHex(strHex);
+        assert(vchParsed.size() == vch.size());
+    }
+}
+
+BENCHMARK(HexStrBlock, 100);
+BENCHMARK(ParseHexBlock, 100);
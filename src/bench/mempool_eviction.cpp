@@ -113,3 +113,41 @@ static void MempoolEviction(benchmark::State& state)
 }
 
 BENCHMARK(MempoolEviction, 41000);
+
+//! Transactions in the mempool for MempoolAddRemoveLarge
+static const size_t LARGE_MEMPOOL_ENTRIES = 300000;
+//! Transactions removed and added again per iteration
+static const size_t LARGE_MEMPOOL_BATCH = 1000;
+
+// Add and remove transactions in a mempool of LARGE_MEMPOOL_ENTRIES, which
+// mostly measures allocating and freeing the nodes of the mempool indexes
+static void MempoolAddRemoveLarge(benchmark::State& state)
+{
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(LARGE_MEMPOOL_ENTRIES);
+    for (size_t i = 0; i < LARGE_MEMPOOL_ENTRIES; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(uint256(), i);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    CTxMemPool pool;
+    for (size_t i = 0; i < vtx.size(); i++)
+        AddTx(*vtx[i], 1000 + i % 1000, pool);
+
+    size_t nNext = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < LARGE_MEMPOOL_BATCH; i++)
+            pool.removeRecursive(*vtx[(nNext + i) % vtx.size()]);
+        for (size_t i = 0; i < LARGE_MEMPOOL_BATCH; i++)
+            AddTx(*vtx[(nNext + i) % vtx.size()], 1000 + i, pool);
+        nNext += LARGE_MEMPOOL_BATCH;
+    }
+}
+
+BENCHMARK(MempoolAddRemoveLarge, 10);
@@ -0,0 +1,86 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <miner.h>
+#include <policy/policy.h>
+#include <random.h>
+#include <txmempool.h>
+
+#include <vector>
+
+//! Transactions in the mempool for the package ancestor benchmarks
+static const int PACKAGE_BENCH_TXS = 20000;
+
+//! Longest chain of unconfirmed transactions
+static const int PACKAGE_BENCH_CHAIN = 25;
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        MakeTransactionRef(tx), nFee, nTime,
+                                        nHeight, spendsCoinbase, false, 0,
+                                        sigOpCost, lp));
+}
+
+// Chains of transactions, each spending the one before it and sometimes a
+// transaction from the previous chain as well
+static void BuildPackages(CTxMemPool& pool)
+{
+    FastRandomContext rand(true);
+    uint256 hashPrev;
+    uint256 hashPrevChain;
+    for (int i = 0; i < PACKAGE_BENCH_TXS; i++) {
+        const bool fNewChain = i % PACKAGE_BENCH_CHAIN == 0;
+        if (fNewChain)
+            hashPrevChain = hashPrev;
+
+        CMutableTransaction tx;
+        tx.vin.resize(fNewChain || rand.randrange(4) ? 1 : 2);
+        tx.vin[0].prevout = fNewChain ? COutPoint(rand.rand256(), 0) : COutPoint(hashPrev, 0);
+        if (tx.vin.size() > 1)
+            tx.vin[1].prevout = hashPrevChain.IsNull() ? COutPoint(rand.rand256(), 0) : COutPoint(hashPrevChain, 1);
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_TRUE;
+            out.nValue = COIN;
+        }
+        AddTx(tx, 1000 + rand.randrange(10000), pool);
+        hashPrev = tx.GetHash();
+    }
+}
+
+static void PackageAncestors(benchmark::State& state, int nThreads)
+{
+    CTxMemPool pool;
+    BuildPackages(pool);
+
+    LOCK(pool.cs);
+    std::vector<CTxMemPool::txiter> vTx;
+    for (CTxMemPool::txiter it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it)
+        vTx.push_back(it);
+
+    std::vector<CTxMemPool::setEntries> vAncestors;
+    while (state.KeepRunning()) {
+        CalculatePackageAncestors(pool, vTx, vAncestors, nThreads);
+    }
+}
+
+static void PackageAncestors_1(benchmark::State& state)
+{
+    PackageAncestors(state, 1);
+}
+
+static void PackageAncestors_4(benchmark::State& state)
+{
+    PackageAncestors(state, 4);
+}
+
+BENCHMARK(PackageAncestors_1, 10);
+BENCHMARK(PackageAncestors_4, 10);
@@ -0,0 +1,419 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Replay the SCDB changes of recorded blocks, without networking or block
+ * validation, and report how long SCDB takes per block.
+ *
+ * Blocks are extracted from blk*.dat files, keeping only the coinbase and the
+ * transactions with sidechain outputs, and can be written to a recording that
+ * later runs replay without the block files.
+ */
+
+#include <chainparams.h>
+#include <chainparamsbase.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <protocol.h>
+#include <random.h>
+#include <serialize.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
+#include <streams.h>
+#include <uint256.h>
+#include <util.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <vector>
+
+static const int DEFAULT_REPLAY_UNDO = 10;
+static const int DEFAULT_REPLAY_EVALS = 1;
+
+/** The parts of a block that change SCDB */
+struct ReplayBlock
+{
+    int nHeight;
+    uint256 hash;
+    uint256 hashPrev;
+    //! The coinbase and the transactions with sidechain outputs
+    std::vector<CTransactionRef> vtx;
+    //! Position of each of vtx in the block
+    std::vector<int> vnTx;
+
+    ReplayBlock() : nHeight(-1) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(hash);
+        READWRITE(hashPrev);
+        READWRITE(vtx);
+        READWRITE(vnTx);
+    }
+};
+
+static bool HasSidechainOutput(const CTransaction& tx, uint8_t& nSidechain)
+{
+    for (const CTxOut& out : tx.vout) {
+        if (out.scriptPubKey.IsDrivechain(nSidechain))
+            return true;
+    }
+    return false;
+}
+
+/** Read the blocks of a blk*.dat file into mapBlock */
+static void ReadBlockFile(const fs::path& path, std::map<uint256, ReplayBlock>& mapBlock)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        throw std::runtime_error("cannot open " + path.string());
+
+    const CMessageHeader::MessageStartChars& messageStart = Params().MessageStart();
+    while (true) {
+        CMessageHeader::MessageStartChars blkStart;
+        unsigned int nSize;
+        CBlock block;
+        try {
+            file >> FLATDATA(blkStart) >> nSize;
+            // The rest of the file is preallocated space
+            if (memcmp(blkStart, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+                break;
+            if (nSize & RECORD_COMPRESSED_FLAG) {
+                std::vector<unsigned char> vCompressed(nSize & ~RECORD_COMPRESSED_FLAG);
+                file.read((char*)vCompressed.data(), vCompressed.size());
+                CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+                if (!UncompressRecord(vCompressed.data(), vCompressed.size(), ssBlock))
+                    throw std::runtime_error("bad compressed block in " + path.string());
+                ssBlock >> block;
+            } else {
+                file >> block;
+            }
+        } catch (const std::ios_base::failure&) {
+            break;
+        }
+
+        ReplayBlock& replay = mapBlock[block.GetHash()];
+        replay.hash = block.GetHash();
+        replay.hashPrev = block.hashPrevBlock;
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            uint8_t nSidechain;
+            if (i == 0 || HasSidechainOutput(*block.vtx[i], nSidechain)) {
+                replay.vtx.push_back(block.vtx[i]);
+                replay.vnTx.push_back(i);
+            }
+        }
+    }
+}
+
+/** Extract the active chain, the longest chain from genesis, from the block
+ * files in dir */
+static std::vector<ReplayBlock> ExtractChain(const fs::path& dir)
+{
+    std::vector<fs::path> vPath;
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+        const std::string strName = it->path().filename().string();
+        if (strName.compare(0, 3, "blk") == 0 && it->path().extension() == ".dat")
+            vPath.push_back(it->path());
+    }
+    std::sort(vPath.begin(), vPath.end());
+
+    std::map<uint256, ReplayBlock> mapBlock;
+    for (const fs::path& path : vPath) {
+        ReadBlockFile(path, mapBlock);
+        fprintf(stderr, "Read %s, %u blocks\n", path.filename().string().c_str(), (unsigned int)mapBlock.size());
+    }
+
+    // Blocks are stored in the order they arrived, work out their heights
+    // from genesis
+    std::multimap<uint256, uint256> mapChildren;
+    for (const auto& pair : mapBlock)
+        mapChildren.emplace(pair.second.hashPrev, pair.first);
+
+    const uint256 hashGenesis = Params().GetConsensus().hashGenesisBlock;
+    if (!mapBlock.count(hashGenesis))
+        throw std::runtime_error("genesis block not found in " + dir.string());
+    mapBlock[hashGenesis].nHeight = 0;
+
+    const ReplayBlock* pTip = &mapBlock[hashGenesis];
+    std::vector<uint256> vQueue(1, hashGenesis);
+    while (!vQueue.empty()) {
+        const uint256 hash = vQueue.back();
+        vQueue.pop_back();
+        const int nHeight = mapBlock[hash].nHeight;
+        auto range = mapChildren.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            ReplayBlock& child = mapBlock[it->second];
+            child.nHeight = nHeight + 1;
+            if (child.nHeight > pTip->nHeight)
+                pTip = &child;
+            vQueue.push_back(it->second);
+        }
+    }
+
+    std::vector<ReplayBlock> vChain(pTip->nHeight + 1);
+    for (int nHeight = pTip->nHeight; nHeight >= 0; nHeight--) {
+        vChain[nHeight] = std::move(mapBlock[pTip->hash]);
+        if (nHeight)
+            pTip = &mapBlock[vChain[nHeight].hashPrev];
+    }
+    return vChain;
+}
+
+/** The SCDB state of a block as ConnectBlock writes it to the sidechain
+ * tree database, for ResyncSCDB when the next block is disconnected */
+static SidechainBlockData GetBlockData(const SidechainDB& scdb, const uint256& hashBlock)
+{
+    SidechainBlockData data;
+    data.vWithdrawalStatus = scdb.GetState();
+    data.vActivationStatus = scdb.GetSidechainActivationStatus();
+    data.vSidechain = scdb.GetSidechains();
+    data.vSpent = scdb.GetSpentWithdrawalsForBlock(hashBlock);
+    if (data.vSidechain.empty()) {
+        data.vSidechain.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+        for (size_t i = 0; i < data.vSidechain.size(); i++)
+            data.vSidechain[i].nSidechain = i;
+    }
+    return data;
+}
+
+/** Apply a block to SCDB the way ConnectBlock does: deposits, then
+ * withdrawal bundle spends, then the coinbase commitments */
+static bool ConnectReplayBlock(SidechainDB& scdb, const ReplayBlock& block)
+{
+    // Without the UTXO set, withdrawal bundles are told apart from deposits
+    // by the CTIP they spend, which moves with each transaction of the block
+    std::map<uint8_t, SidechainCTIP> mapCTIP = scdb.GetCTIP();
+    std::vector<SidechainDeposit> vDeposit;
+    std::vector<std::pair<uint8_t, size_t>> vWithdrawal;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        uint8_t nSidechain;
+        if (!HasSidechainOutput(tx, nSidechain))
+            continue;
+
+        CAmount amountOut = 0;
+        uint32_t nOut = 0;
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            uint8_t nOutSidechain;
+            if (tx.vout[n].scriptPubKey.IsDrivechain(nOutSidechain)) {
+                amountOut = tx.vout[n].nValue;
+                nOut = n;
+                break;
+            }
+        }
+
+        auto it = mapCTIP.find(nSidechain);
+        bool fSpendsCTIP = false;
+        if (it != mapCTIP.end()) {
+            for (const CTxIn& in : tx.vin)
+                fSpendsCTIP = fSpendsCTIP || in.prevout == it->second.out;
+        }
+
+        if (fSpendsCTIP && it->second.amount > amountOut) {
+            vWithdrawal.emplace_back(nSidechain, i);
+        } else {
+            SidechainDeposit deposit;
+            if (!scdb.TxnToDeposit(block.vtx[i], block.vnTx[i], block.hash, deposit))
+                return false;
+            if (deposit.strDest != SIDECHAIN_WITHDRAWAL_RETURN_DEST)
+                vDeposit.push_back(deposit);
+        }
+
+        SidechainCTIP& ctip = mapCTIP[nSidechain];
+        ctip.out = COutPoint(tx.GetHash(), nOut);
+        ctip.amount = amountOut;
+    }
+
+    if (!vDeposit.empty())
+        scdb.AddDeposits(vDeposit);
+
+    for (const std::pair<uint8_t, size_t>& withdrawal : vWithdrawal) {
+        const size_t i = withdrawal.second;
+        if (!scdb.SpendWithdrawal(withdrawal.first, block.hash, *block.vtx[i], block.vnTx[i]))
+            return false;
+    }
+
+    return scdb.Update(block.nHeight, block.hash, block.hashPrev, block.vtx[0]->vout);
+}
+
+static void PrintLatency(const char* strName, std::vector<double> vMicros)
+{
+    if (vMicros.empty())
+        return;
+    std::sort(vMicros.begin(), vMicros.end());
+    double nTotal = 0;
+    for (double n : vMicros)
+        nTotal += n;
+    auto percentile = [&vMicros](double p) {
+        return vMicros[std::min(vMicros.size() - 1, (size_t)(p * vMicros.size()))];
+    };
+    fprintf(stdout, "%s: %u blocks, total %.3fms, mean %.2fus, p50 %.2fus, p90 %.2fus, p99 %.2fus, max %.2fus\n",
+            strName, (unsigned int)vMicros.size(), nTotal / 1000, nTotal / vMicros.size(),
+            percentile(0.5), percentile(0.9), percentile(0.99), vMicros.back());
+}
+
+static double MicrosSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Replay vChain into a fresh SCDB, then disconnect and reconnect the last
+ * nUndo blocks. Returns false if SCDB rejects a block. */
+static bool Replay(const std::vector<ReplayBlock>& vChain, int nStartHeight, int nUndo, uint256& hashTest)
+{
+    SidechainDB scdb;
+    std::vector<double> vConnect;
+    std::vector<double> vUndo;
+    size_t nPeakMemory = 0;
+
+    // SCDB state of the blocks that may be disconnected, and of their parent
+    std::map<int, SidechainBlockData> mapData;
+    const int nTipHeight = vChain.size() - 1;
+    const int nUndoFrom = std::max(nStartHeight + 1, nTipHeight - nUndo + 1);
+
+    for (int nHeight = nStartHeight; nHeight <= nTipHeight; nHeight++) {
+        const ReplayBlock& block = vChain[nHeight];
+        auto start = std::chrono::steady_clock::now();
+        if (!ConnectReplayBlock(scdb, block)) {
+            fprintf(stderr, "error: SCDB rejected block %s at height %d\n", block.hash.ToString().c_str(), nHeight);
+            return false;
+        }
+        vConnect.push_back(MicrosSince(start));
+        nPeakMemory = std::max(nPeakMemory, scdb.DynamicMemoryUsage());
+
+        if (nHeight >= nUndoFrom - 1)
+            mapData[nHeight] = GetBlockData(scdb, block.hash);
+    }
+    const uint256 hashTip = scdb.GetTestHash();
+
+    // Disconnect like DisconnectBlock, which resyncs SCDB to the parent from
+    // the sidechain tree database before the undo
+    for (int nHeight = nTipHeight; nHeight >= nUndoFrom; nHeight--) {
+        const ReplayBlock& block = vChain[nHeight];
+        auto start = std::chrono::steady_clock::now();
+        scdb.ApplyLDBData(block.hashPrev, mapData[nHeight - 1]);
+        if (!scdb.Undo(nHeight, block.hash, block.hashPrev, block.vtx)) {
+            fprintf(stderr, "error: SCDB failed to undo block %s at height %d\n", block.hash.ToString().c_str(), nHeight);
+            return false;
+        }
+        vUndo.push_back(MicrosSince(start));
+    }
+    for (int nHeight = nUndoFrom; nHeight <= nTipHeight; nHeight++) {
+        if (!ConnectReplayBlock(scdb, vChain[nHeight])) {
+            fprintf(stderr, "error: SCDB rejected reconnected block %s at height %d\n", vChain[nHeight].hash.ToString().c_str(), nHeight);
+            return false;
+        }
+    }
+
+    hashTest = scdb.GetTestHash();
+    if (hashTest != hashTip) {
+        fprintf(stderr, "error: SCDB hash %s after reconnecting does not match %s\n", hashTest.ToString().c_str(), hashTip.ToString().c_str());
+        return false;
+    }
+
+    PrintLatency("connect", vConnect);
+    PrintLatency("undo", vUndo);
+    fprintf(stdout, "memory: %u bytes at the tip, %u bytes peak\n",
+            (unsigned int)scdb.DynamicMemoryUsage(), (unsigned int)nPeakMemory);
+    fprintf(stdout, "hash: %s\n", hashTest.ToString().c_str());
+    return true;
+}
+
+static int AppInitReplay(int argc, char* argv[])
+{
+    gArgs.ParseParameters(argc, argv);
+
+    if (gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help")) {
+        std::string strUsage = _("Replay the sidechain database changes of recorded blocks and report the time per block") + "\n\n" +
+            _("Usage:") + "\n" +
+            "  bench_scdb_replay [options]\n";
+        strUsage += HelpMessageGroup(_("Options:"));
+        strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
+        strUsage += HelpMessageOpt("-blocksdir=<dir>", _("Extract the blocks from the blk*.dat files in <dir> (default: the blocks directory of -datadir)"));
+        strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
+        strUsage += HelpMessageOpt("-evals=<n>", strprintf(_("Number of times to replay the blocks (default: %d)"), DEFAULT_REPLAY_EVALS));
+        strUsage += HelpMessageOpt("-expecthash=<hex>", _("Exit with an error if the SCDB test hash after the last block is not <hex>"));
+        strUsage += HelpMessageOpt("-record=<file>", _("Write the extracted blocks to <file> for -replay"));
+        strUsage += HelpMessageOpt("-replay=<file>", _("Replay the blocks recorded in <file> instead of extracting them"));
+        strUsage += HelpMessageOpt("-startheight=<n>", _("Height of the first block to replay (default: the drivechain activation height)"));
+        strUsage += HelpMessageOpt("-undo=<n>", strprintf(_("Number of blocks to disconnect and reconnect at the end (default: %d)"), DEFAULT_REPLAY_UNDO));
+        AppendParamsHelpMessages(strUsage, false);
+        fprintf(stdout, "%s", strUsage.c_str());
+        return EXIT_SUCCESS;
+    }
+
+    try {
+        SelectParams(ChainNameFromCommandLine());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return -1;
+}
+
+int main(int argc, char* argv[])
+{
+    SetupEnvironment();
+    RandomInit();
+    fPrintToDebugLog = false;
+
+    int ret = AppInitReplay(argc, argv);
+    if (ret != -1)
+        return ret;
+
+    try {
+        std::vector<ReplayBlock> vChain;
+        if (gArgs.IsArgSet("-replay")) {
+            const fs::path path = gArgs.GetArg("-replay", "");
+            CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull())
+                throw std::runtime_error("cannot open " + path.string());
+            file >> vChain;
+        } else {
+            const fs::path dir = gArgs.IsArgSet("-blocksdir") ? fs::path(gArgs.GetArg("-blocksdir", "")) : GetDataDir() / "blocks";
+            vChain = ExtractChain(dir);
+        }
+        if (vChain.empty())
+            throw std::runtime_error("no blocks to replay");
+
+        if (gArgs.IsArgSet("-record")) {
+            const fs::path path = gArgs.GetArg("-record", "");
+            CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull())
+                throw std::runtime_error("cannot open " + path.string());
+            file << vChain;
+        }
+
+        const int nStartHeight = gArgs.GetArg("-startheight", Params().GetConsensus().DrivechainHeight);
+        if (nStartHeight < 0 || nStartHeight >= (int)vChain.size())
+            throw std::runtime_error(strprintf("-startheight=%d is not in the replayed chain of %u blocks", nStartHeight, vChain.size()));
+        const int nUndo = std::max((int)gArgs.GetArg("-undo", DEFAULT_REPLAY_UNDO), 0);
+        const int nEvals = std::max((int)gArgs.GetArg("-evals", DEFAULT_REPLAY_EVALS), 1);
+
+        fprintf(stdout, "Replaying blocks %d to %u\n", nStartHeight, (unsigned int)vChain.size() - 1);
+        uint256 hashTest;
+        for (int i = 0; i < nEvals; i++) {
+            if (!Replay(vChain, nStartHeight, nUndo, hashTest))
+                return EXIT_FAILURE;
+        }
+
+        if (gArgs.IsArgSet("-expecthash") && hashTest != uint256S(gArgs.GetArg("-expecthash", ""))) {
+            fprintf(stderr, "error: SCDB hash %s does not match -expecthash\n", hashTest.ToString().c_str());
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
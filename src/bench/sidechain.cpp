@@ -0,0 +1,340 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <amount.h>
+#include <miner.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+//! Pending withdrawals per sidechain for the SCDB benchmarks
+static const size_t BENCH_WITHDRAWALS_PER_SIDECHAIN = 64;
+//! Deposits per sidechain for the deposit undo benchmark
+static const size_t BENCH_DEPOSITS_PER_SIDECHAIN = 50;
+//! BMM requests per sidechain for the BMM auction benchmark
+static const size_t BENCH_BMM_PER_SIDECHAIN = 40;
+
+static std::vector<Sidechain> CreateActiveSidechains()
+{
+    std::vector<Sidechain> vSidechain(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    for (size_t i = 0; i < vSidechain.size(); i++) {
+        vSidechain[i].fActive = true;
+        vSidechain[i].nSidechain = i;
+        vSidechain[i].title = "bench" + std::to_string(i);
+        vSidechain[i].hashID1 = GetRandHash();
+    }
+    return vSidechain;
+}
+
+/** SCDB data for a block with every sidechain slot active and
+ * BENCH_WITHDRAWALS_PER_SIDECHAIN withdrawals pending for each of them */
+static SidechainBlockData CreateFullBlockData()
+{
+    SidechainBlockData data;
+    data.vSidechain = CreateActiveSidechains();
+    data.vWithdrawalStatus.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    for (size_t x = 0; x < data.vWithdrawalStatus.size(); x++) {
+        for (size_t y = 0; y < BENCH_WITHDRAWALS_PER_SIDECHAIN; y++) {
+            SidechainWithdrawalState state;
+            state.nSidechain = x;
+            state.nBlocksLeft = SIDECHAIN_WITHDRAWAL_VERIFICATION_PERIOD - 1;
+            state.nWorkScore = 1;
+            state.hash = GetRandHash();
+            data.vWithdrawalStatus[x].push_back(state);
+        }
+    }
+    return data;
+}
+
+/** Upvote the last withdrawal of every sidechain */
+static std::vector<std::string> CreateUpvotes(const std::vector<std::vector<SidechainWithdrawalState>>& vScores)
+{
+    std::vector<std::string> vVote(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    for (const std::vector<SidechainWithdrawalState>& v : vScores)
+        vVote[v.back().nSidechain] = v.back().hash.ToString();
+    return vVote;
+}
+
+static CBlock CreateCoinbaseOnlyBlock()
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    return block;
+}
+
+/** Deposits to nSidechain in CTIP spend order */
+static std::vector<SidechainDeposit> CreateDeposits(uint8_t nSidechain, size_t nDeposit)
+{
+    std::vector<SidechainDeposit> vDeposit;
+    vDeposit.reserve(nDeposit);
+
+    COutPoint ctip(GetRandHash(), 0);
+    for (size_t i = 0; i < nDeposit; i++) {
+        CMutableTransaction mtx;
+        mtx.nVersion = 2;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = ctip;
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        mtx.vout[0].nValue = (i + 1) * CENT;
+
+        SidechainDeposit deposit;
+        deposit.nSidechain = nSidechain;
+        deposit.strDest = "bench";
+        deposit.tx = MakeTransactionRef(std::move(mtx));
+        deposit.nBurnIndex = 0;
+        deposit.nTx = 1;
+        deposit.hashBlock = GetRandHash();
+        vDeposit.push_back(deposit);
+
+        ctip = COutPoint(deposit.tx->GetHash(), 0);
+    }
+    return vDeposit;
+}
+
+// Sort deposits that are in reverse CTIP spend order, which is how they would
+// come out of a database without the sort order
+static void SortDepositsBench(benchmark::State& state, size_t nDeposit)
+{
+    std::vector<SidechainDeposit> vDeposit = CreateDeposits(0, nDeposit);
+    std::reverse(vDeposit.begin(), vDeposit.end());
+
+    std::vector<SidechainDeposit> vSorted;
+    while (state.KeepRunning()) {
+        bool fSorted = SortDeposits(vDeposit, vSorted);
+        assert(fSorted);
+    }
+}
+
+static void SidechainSortDeposits_10(benchmark::State& state)
+{
+    SortDepositsBench(state, 10);
+}
+
+static void SidechainSortDeposits_1000(benchmark::State& state)
+{
+    SortDepositsBench(state, 1000);
+}
+
+static void SidechainSortDeposits_50000(benchmark::State& state)
+{
+    SortDepositsBench(state, 50000);
+}
+
+// Connect a block upvoting one withdrawal of every sidechain. Update checks
+// the block against its own copy of SCDB first, so starting each iteration
+// from a fresh copy (withdrawals age and expire otherwise) costs about as
+// much as one of the two passes that are measured.
+static void SidechainDBUpdate(benchmark::State& state)
+{
+    const SidechainBlockData data = CreateFullBlockData();
+    const uint256 hashPrevBlock = GetRandHash();
+    const uint256 hashBlock = GetRandHash();
+
+    SidechainDB scdbBase;
+    scdbBase.ApplyLDBData(hashPrevBlock, data);
+
+    CBlock block = CreateCoinbaseOnlyBlock();
+    CScript script;
+    GenerateSCDBByteCommitment(block, script, data.vWithdrawalStatus, CreateUpvotes(data.vWithdrawalStatus));
+    const std::vector<CTxOut> vout = block.vtx[0]->vout;
+
+    while (state.KeepRunning()) {
+        SidechainDB scdb = scdbBase;
+        bool fUpdated = scdb.Update(1, hashBlock, hashPrevBlock, vout);
+        assert(fUpdated);
+    }
+}
+
+// Disconnect a block with the latest deposit of every sidechain, and connect
+// the deposits again so that each iteration starts from the same state
+static void SidechainDBUndo(benchmark::State& state)
+{
+    const uint256 hashPrevBlock = GetRandHash();
+    const uint256 hashBlock = GetRandHash();
+
+    SidechainBlockData data;
+    data.vSidechain = CreateActiveSidechains();
+    data.vWithdrawalStatus.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+
+    SidechainDB scdb;
+    scdb.ApplyLDBData(hashBlock, data);
+
+    std::vector<SidechainDeposit> vLast;
+    std::vector<CTransactionRef> vtx;
+    for (size_t i = 0; i < SIDECHAIN_ACTIVATION_MAX_ACTIVE; i++) {
+        std::vector<SidechainDeposit> vDeposit = CreateDeposits(i, BENCH_DEPOSITS_PER_SIDECHAIN);
+        vLast.push_back(vDeposit.back());
+        vtx.push_back(vDeposit.back().tx);
+        vDeposit.pop_back();
+        scdb.AddDeposits(vDeposit);
+    }
+    scdb.AddDeposits(vLast);
+
+    while (state.KeepRunning()) {
+        bool fUndone = scdb.Undo(1, hashBlock, hashPrevBlock, vtx);
+        assert(fUndone);
+        scdb.AddDeposits(vLast);
+    }
+}
+
+static void SidechainGenerateSCDBBytes(benchmark::State& state)
+{
+    const SidechainBlockData data = CreateFullBlockData();
+    const std::vector<std::string> vVote = CreateUpvotes(data.vWithdrawalStatus);
+    const CBlock blockBase = CreateCoinbaseOnlyBlock();
+
+    CScript script;
+    while (state.KeepRunning()) {
+        CBlock block = blockBase;
+        bool fGenerated = GenerateSCDBByteCommitment(block, script, data.vWithdrawalStatus, vVote);
+        assert(fGenerated);
+    }
+}
+
+static void SidechainParseSCDBBytes(benchmark::State& state)
+{
+    const SidechainBlockData data = CreateFullBlockData();
+    CBlock block = CreateCoinbaseOnlyBlock();
+    CScript script;
+    GenerateSCDBByteCommitment(block, script, data.vWithdrawalStatus, CreateUpvotes(data.vWithdrawalStatus));
+
+    std::vector<std::string> vVote;
+    while (state.KeepRunning()) {
+        bool fParsed = ParseSCDBBytes(script, data.vWithdrawalStatus, vVote);
+        assert(fParsed);
+    }
+}
+
+static void SidechainDecodeSCDBBytes(benchmark::State& state)
+{
+    const SidechainBlockData data = CreateFullBlockData();
+    CBlock block = CreateCoinbaseOnlyBlock();
+    CScript script;
+    GenerateSCDBByteCommitment(block, script, data.vWithdrawalStatus, CreateUpvotes(data.vWithdrawalStatus));
+
+    SCDBVotes votes;
+    while (state.KeepRunning()) {
+        bool fDecoded = DecodeSCDBBytes(script, data.vWithdrawalStatus, votes);
+        assert(fDecoded);
+    }
+}
+
+// Run the BMM auction over a mempool with many competing BMM requests for
+// every sidechain
+static void SidechainBMMAuction(benchmark::State& state)
+{
+    CTxMemPool pool;
+    LockPoints lp;
+    for (size_t x = 0; x < SIDECHAIN_ACTIVATION_MAX_ACTIVE; x++) {
+        for (size_t y = 0; y < BENCH_BMM_PER_SIDECHAIN; y++) {
+            CMutableTransaction mtx;
+            mtx.nVersion = 3;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            mtx.vout.resize(1);
+            mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+            mtx.vout[0].nValue = (y + 1) * CENT;
+            mtx.criticalData.vBytes = std::vector<unsigned char>{0x00, 0xbf, 0x00, (unsigned char)x, 0x00, 0x00, 0x00, 0x00};
+            mtx.criticalData.hashCritical = GetRandHash();
+
+            CTransactionRef tx = MakeTransactionRef(std::move(mtx));
+            LOCK(pool.cs);
+            pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, false, 0, 4, lp));
+        }
+    }
+
+    std::vector<Sidechain> vActiveSidechain(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    for (size_t x = 0; x < vActiveSidechain.size(); x++)
+        vActiveSidechain[x].nSidechain = x;
+
+    std::vector<BMMAuctionResult> vResult;
+    CTxMemPool::setEntries setExcluded;
+    while (state.KeepRunning()) {
+        vResult.clear();
+        setExcluded.clear();
+        LOCK(pool.cs);
+        RunBMMAuction(pool, 1 /* nHeight */, vActiveSidechain, vResult, setExcluded);
+    }
+}
+
+// Write the SCDB data of consecutive blocks, which stores a checkpoint every
+// SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL blocks and deltas in between
+static void SidechainTreeDBWrite(benchmark::State& state)
+{
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    SidechainBlockData data = CreateFullBlockData();
+
+    int nHeight = 0;
+    uint256 hashPrevBlock;
+    while (state.KeepRunning()) {
+        // Each block changes the score of one withdrawal of every sidechain
+        for (std::vector<SidechainWithdrawalState>& v : data.vWithdrawalStatus)
+            v[nHeight % v.size()].nWorkScore++;
+
+        const uint256 hashBlock = GetRandHash();
+        bool fWritten = db.WriteSidechainBlockData(hashBlock, hashPrevBlock, nHeight, data);
+        assert(fWritten);
+
+        hashPrevBlock = hashBlock;
+        nHeight++;
+    }
+}
+
+// Read the SCDB data of two blocks half a checkpoint interval apart. Neither
+// read can use the data of the block read before it, so each one rebuilds
+// the data from a checkpoint or cached block half an interval back.
+static void SidechainTreeDBRead(benchmark::State& state)
+{
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    SidechainBlockData data = CreateFullBlockData();
+
+    std::vector<uint256> vHash;
+    uint256 hashPrevBlock;
+    for (int nHeight = 0; nHeight < SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL; nHeight++) {
+        for (std::vector<SidechainWithdrawalState>& v : data.vWithdrawalStatus)
+            v[nHeight % v.size()].nWorkScore++;
+
+        const uint256 hashBlock = GetRandHash();
+        bool fWritten = db.WriteSidechainBlockData(hashBlock, hashPrevBlock, nHeight, data);
+        assert(fWritten);
+
+        vHash.push_back(hashBlock);
+        hashPrevBlock = hashBlock;
+    }
+
+    const uint256& hashMiddle = vHash[vHash.size() / 2];
+    const uint256& hashLast = vHash.back();
+    SidechainBlockData dataRead;
+    while (state.KeepRunning()) {
+        bool fRead = db.GetBlockData(hashMiddle, dataRead);
+        fRead &= db.GetBlockData(hashLast, dataRead);
+        assert(fRead);
+    }
+}
+
+BENCHMARK(SidechainSortDeposits_10, 200 * 1000);
+BENCHMARK(SidechainSortDeposits_1000, 1500);
+BENCHMARK(SidechainSortDeposits_50000, 20);
+BENCHMARK(SidechainDBUpdate, 50);
+BENCHMARK(SidechainDBUndo, 100);
+BENCHMARK(SidechainGenerateSCDBBytes, 5000);
+BENCHMARK(SidechainParseSCDBBytes, 5000);
+BENCHMARK(SidechainDecodeSCDBBytes, 5000);
+BENCHMARK(SidechainBMMAuction, 2000);
+BENCHMARK(SidechainTreeDBWrite, 100);
+BENCHMARK(SidechainTreeDBRead, 20);
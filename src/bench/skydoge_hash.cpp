@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <hash.h>
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+// Every stage of skydoge_hash after the first hashes the 64 byte output of
+// the stage before it, so that is what each stage is measured with. The
+// stages are the ones the benchhash RPC profiles.
+static void RunSkydogeStage(benchmark::State& state, const std::string& strName)
+{
+    const SkydogeHashStage* pstage = nullptr;
+    for (const SkydogeHashStage& stage : GetSkydogeHashStages()) {
+        if (strName == stage.name)
+            pstage = &stage;
+    }
+    assert(pstage);
+
+    uint512 buf[2];
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        pstage->hash(&buf[i & 1], 64, &buf[!(i & 1)]);
+        i++;
+    }
+}
+
+#define BENCH_SKYDOGE_STAGE(name)                                           \
+    static void SkydogeStage_##name(benchmark::State& state)                \
+    {                                                                       \
+        RunSkydogeStage(state, #name);                                      \
+    }
+
+BENCH_SKYDOGE_STAGE(blake512)
+BENCH_SKYDOGE_STAGE(skein512)
+BENCH_SKYDOGE_STAGE(bmw512)
+BENCH_SKYDOGE_STAGE(groestl512)
+BENCH_SKYDOGE_STAGE(jh512)
+BENCH_SKYDOGE_STAGE(luffa512)
+BENCH_SKYDOGE_STAGE(keccak512)
+BENCH_SKYDOGE_STAGE(simd512)
+BENCH_SKYDOGE_STAGE(echo512)
+BENCH_SKYDOGE_STAGE(cubehash512)
+BENCH_SKYDOGE_STAGE(shavite512)
+BENCH_SKYDOGE_STAGE(hamsi512)
+BENCH_SKYDOGE_STAGE(fugue512)
+BENCH_SKYDOGE_STAGE(shabal512)
+BENCH_SKYDOGE_STAGE(whirlpool)
+BENCH_SKYDOGE_STAGE(sha512)
+BENCH_SKYDOGE_STAGE(sha256)
+BENCH_SKYDOGE_STAGE(haval256_5)
+
+// The whole hash of a block header
+static void SkydogeHash_Header(benchmark::State& state)
+{
+    CBlockHeader header;
+    while (state.KeepRunning()) {
+        header.GetHash();
+        header.nNonce++;
+    }
+}
+
+// Header hashes sharing a midstate, as when grinding the nonce
+static void SkydogeHash_HeaderMidstate(benchmark::State& state)
+{
+    std::vector<unsigned char> vHeader(80, 0);
+    CSkydogeHeaderHasher hasher(vHeader.data());
+    uint32_t nNonce = 0;
+    while (state.KeepRunning())
+        hasher.Hash(nNonce++);
+}
+
+BENCHMARK(SkydogeStage_blake512, 1500 * 1000);
+BENCHMARK(SkydogeStage_skein512, 1200 * 1000);
+BENCHMARK(SkydogeStage_bmw512, 1500 * 1000);
+BENCHMARK(SkydogeStage_groestl512, 250 * 1000);
+BENCHMARK(SkydogeStage_jh512, 400 * 1000);
+BENCHMARK(SkydogeStage_luffa512, 700 * 1000);
+BENCHMARK(SkydogeStage_keccak512, 1200 * 1000);
+BENCHMARK(SkydogeStage_simd512, 200 * 1000);
+BENCHMARK(SkydogeStage_echo512, 200 * 1000);
+BENCHMARK(SkydogeStage_cubehash512, 500 * 1000);
+BENCHMARK(SkydogeStage_shavite512, 400 * 1000);
+BENCHMARK(SkydogeStage_hamsi512, 500 * 1000);
+BENCHMARK(SkydogeStage_fugue512, 500 * 1000);
+BENCHMARK(SkydogeStage_shabal512, 1200 * 1000);
+BENCHMARK(SkydogeStage_whirlpool, 300 * 1000);
+BENCHMARK(SkydogeStage_sha512, 1500 * 1000);
+BENCHMARK(SkydogeStage_sha256, 2000 * 1000);
+BENCHMARK(SkydogeStage_haval256_5, 1000 * 1000);
+BENCHMARK(SkydogeHash_Header, 20 * 1000);
+BENCHMARK(SkydogeHash_HeaderMidstate, 20 * 1000);
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <tinyformat.h>
+#include <utilstrencodings.h>
+
+#include <univalue.h>
+
+#include <assert.h>
+#include <vector>
+
+// JSON-RPC request with a single large hex string parameter, like a
+// sendrawtransaction of a big withdrawal bundle
+static void UniValueReadLongHex(benchmark::State& state)
+{
+    std::vector<unsigned char> vch(400 * 1000);
+    for (size_t i = 0; i < vch.size(); i++)
+        vch[i] = i * 7;
+    const std::string strRequest = "{\"method\":\"sendrawtransaction\",\"params\":[\"" +
+        HexStr(vch) + "\"],\"id\":1}";
+
+    while (state.KeepRunning()) {
+        UniValue val;
+        assert(val.read(strRequest));
+    }
+}
+
+// JSON-RPC request with many small objects, like a createrawtransaction with
+// thousands of outputs
+static void UniValueReadManyOutputs(benchmark::State& state)
+{
+    std::string strRequest = "{\"method\":\"createrawtransaction\",\"params\":[[],{";
+    for (int i = 0; i < 5000; i++) {
+        if (i)
+            strRequest += ",";
+        strRequest += strprintf("\"2N%032x\":%d.%08d", i, i % 21, i);
+    }
+    strRequest += "}],\"id\":1}";
+
+    while (state.KeepRunning()) {
+        UniValue val;
+        assert(val.read(strRequest));
+    }
+}
+
+BENCHMARK(UniValueReadLongHex, 200);
+BENCHMARK(UniValueReadManyOutputs, 100);
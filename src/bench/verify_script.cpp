@@ -106,3 +106,23 @@ static void VerifyScriptBench(benchmark::State& state)
 }
 
 BENCHMARK(VerifyScriptBench, 6300);
+
+// Microbenchmark for the script interpreter itself: stack and numeric
+// operations with no signature checks, as much as fits in the opcode limit.
+static void EvalScriptBench(benchmark::State& state)
+{
+    CScript script = CScript() << std::vector<unsigned char>(33, 0x02) << CScriptNum(1);
+    for (int i = 0; i < 28; i++) {
+        script << OP_2DUP << OP_1ADD << OP_NIP << OP_NIP << OP_OVER << OP_HASH160 << OP_DROP;
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<std::vector<unsigned char>> stack;
+        ScriptError err;
+        bool success = EvalScript(stack, script, SCRIPT_VERIFY_MINIMALDATA, BaseSignatureChecker(), SIGVERSION_BASE, &err);
+        assert(success);
+        assert(stack.size() == 2);
+    }
+}
+
+BENCHMARK(EvalScriptBench, 20000);
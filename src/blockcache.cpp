@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <chain.h>
+#include <core_memusage.h>
+#include <primitives/block.h>
+#include <validation.h>
+
+CBlockCache g_blockcache;
+
+CBlockCache::CBlockCache(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nBytes(0), nHits(0), nMisses(0)
+{
+}
+
+void CBlockCache::SetMaxSize(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Evict(nMaxBytes);
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end()) {
+        nMisses++;
+        return nullptr;
+    }
+
+    nHits++;
+    listRecent.splice(listRecent.begin(), listRecent, it->second);
+    return it->second->block;
+}
+
+void CBlockCache::Insert(const std::shared_ptr<const CBlock>& block)
+{
+    const uint256 hash = block->GetHash();
+    const size_t nBlockBytes = RecursiveDynamicUsage(block);
+
+    LOCK(cs);
+    if (nBlockBytes > nMaxBytes || mapBlocks.count(hash))
+        return;
+
+    Evict(nMaxBytes - nBlockBytes);
+    listRecent.push_front(Entry{hash, block, nBlockBytes});
+    mapBlocks.emplace(hash, listRecent.begin());
+    nBytes += nBlockBytes;
+}
+
+void CBlockCache::Erase(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return;
+
+    nBytes -= it->second->nBytes;
+    listRecent.erase(it->second);
+    mapBlocks.erase(it);
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    listRecent.clear();
+    mapBlocks.clear();
+    nBytes = 0;
+}
+
+BlockCacheStats CBlockCache::GetStats() const
+{
+    LOCK(cs);
+    BlockCacheStats stats;
+    stats.nBlocks = mapBlocks.size();
+    stats.nBytes = nBytes;
+    stats.nMaxBytes = nMaxBytes;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    return stats;
+}
+
+void CBlockCache::Evict(size_t nMax)
+{
+    AssertLockHeld(cs);
+    while (nBytes > nMax && !listRecent.empty()) {
+        const Entry& entry = listRecent.back();
+        nBytes -= entry.nBytes;
+        mapBlocks.erase(entry.hash);
+        listRecent.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlock> ReadBlockCached(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    std::shared_ptr<const CBlock> cached = g_blockcache.Get(pindex->GetBlockHash());
+    if (cached)
+        return cached;
+
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*block, pindex, consensusParams))
+        return nullptr;
+
+    g_blockcache.Insert(block);
+    return block;
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+
+class CBlock;
+class CBlockIndex;
+
+namespace Consensus {
+struct Params;
+}
+
+/** Default for -blockcachesize, in MiB */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 16;
+
+struct BlockCacheStats
+{
+    uint64_t nBlocks = 0;
+    //! Memory used by the cached blocks, and the most it may use
+    uint64_t nBytes = 0;
+    uint64_t nMaxBytes = 0;
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+};
+
+/**
+ * Recently read blocks, decoded, for the RPC, REST and GUI lookups of
+ * historical blocks (-blockcachesize).
+ *
+ * Sidechain nodes keep asking about the same recent mainchain blocks
+ * (verifybmm, getblock, /rest/block/), so one disk read and deserialization
+ * is shared by all of them. Blocks are evicted least recently used first
+ * once the memory they use goes over the limit. A block larger than the
+ * whole limit is not cached.
+ */
+class CBlockCache
+{
+public:
+    explicit CBlockCache(size_t nMaxBytesIn = 0);
+
+    /** Set the memory limit, 0 disables the cache */
+    void SetMaxSize(size_t nMaxBytesIn);
+
+    /** The cached block with hash, nullptr if it isn't cached */
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+
+    void Insert(const std::shared_ptr<const CBlock>& block);
+    void Erase(const uint256& hash);
+    void Clear();
+
+    BlockCacheStats GetStats() const;
+
+private:
+    struct CacheHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+    struct Entry
+    {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        size_t nBytes;
+    };
+
+    void Evict(size_t nMax);
+
+    mutable CCriticalSection cs;
+    size_t nMaxBytes;
+    size_t nBytes;
+    // Most recently used first
+    std::list<Entry> listRecent;
+    std::unordered_map<uint256, std::list<Entry>::iterator, CacheHasher> mapBlocks;
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
+extern CBlockCache g_blockcache;
+
+/** Read the block of pindex through g_blockcache. Returns nullptr if it can't
+ * be read from disk. */
+std::shared_ptr<const CBlock> ReadBlockCached(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
+#endif // BITCOIN_BLOCKCACHE_H
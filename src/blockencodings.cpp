@@ -132,6 +132,9 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
+        // The extra pool has empty slots until it has filled up
+        if (!extra_txn[i].second)
+            continue;
         uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
@@ -140,6 +143,8 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 have_txn[idit->second]  = true;
                 mempool_count++;
                 extra_count++;
+                if (!extra_txn[i].second->criticalData.IsNull())
+                    critical_extra_count++;
             } else {
                 // If we find two mempool/extra txn that match the short id, just
                 // request it.
@@ -207,7 +212,13 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
         return READ_STATUS_CHECKBLOCK_FAILED;
     }
 
-    LogPrint(BCLog::CMPCTBLOCK, "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool (incl at least %lu from extra pool) and %lu txn requested\n", hash.ToString(), prefilled_count, mempool_count, extra_count, vtx_missing.size());
+    size_t critical_missing_count = 0;
+    for (const auto& tx : vtx_missing) {
+        if (!tx->criticalData.IsNull())
+            critical_missing_count++;
+    }
+
+    LogPrint(BCLog::CMPCTBLOCK, "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool (incl at least %lu from extra pool, %lu critical data) and %lu txn requested (incl %lu critical data)\n", hash.ToString(), prefilled_count, mempool_count, extra_count, critical_extra_count, vtx_missing.size(), critical_missing_count);
     if (vtx_missing.size() < 5) {
         for (const auto& tx : vtx_missing) {
             LogPrint(BCLog::CMPCTBLOCK, "Reconstructed block %s required tx %s\n", hash.ToString(), tx->GetHash().ToString());
@@ -15,14 +15,22 @@ class CTxMemPool;
 struct TransactionCompressor {
 private:
     CTransactionRef& tx;
+    const std::shared_ptr<MonotonicArena> arena;
 public:
-    explicit TransactionCompressor(CTransactionRef& txIn) : tx(txIn) {}
+    explicit TransactionCompressor(CTransactionRef& txIn, std::shared_ptr<MonotonicArena> arenaIn = nullptr) : tx(txIn), arena(std::move(arenaIn)) {}
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        s << tx; //TODO: Compress tx encoding
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(tx); //TODO: Compress tx encoding
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        if (arena) {
+            tx = MakeTransactionRef(deserialize, s, arena);
+        } else {
+            s >> tx;
+        }
     }
 };
 
@@ -86,11 +94,15 @@ public:
         uint64_t txn_size = (uint64_t)txn.size();
         READWRITE(COMPACTSIZE(txn_size));
         if (ser_action.ForRead()) {
+            // With SER_TX_ARENA, as in UnserializeTransactions
+            std::shared_ptr<MonotonicArena> arena;
+            if (s.GetType() & SER_TX_ARENA)
+                arena = std::make_shared<MonotonicArena>(std::min<uint64_t>(txn_size, MAX_TX_ARENA_RESERVE) * TX_ARENA_ENTRY_SIZE);
             size_t i = 0;
             while (txn.size() < txn_size) {
                 txn.resize(std::min((uint64_t)(1000 + txn.size()), txn_size));
                 for (; i < txn.size(); i++)
-                    READWRITE(REF(TransactionCompressor(txn[i])));
+                    READWRITE(REF(TransactionCompressor(txn[i], arena)));
             }
         } else {
             for (size_t i = 0; i < txn.size(); i++)
@@ -194,7 +206,7 @@ public:
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
-    size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
+    size_t prefilled_count = 0, mempool_count = 0, extra_count = 0, critical_extra_count = 0;
     CTxMemPool* pool;
 public:
     CBlockHeader header;
@@ -203,6 +215,8 @@ public:
     // extra_txn is a list of extra transactions to look at, in <witness hash, reference> form
     ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn);
     bool IsTxAvailable(size_t index) const;
+    size_t GetExtraCount() const { return extra_count; }
+    size_t GetCriticalExtraCount() const { return critical_extra_count; }
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
 };
 
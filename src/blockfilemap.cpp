@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <chain.h>
+#include <util.h>
+#include <validation.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::unique_ptr<CBlockFileMap> g_blockfilemap;
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(pchData), nSize);
+#endif
+}
+
+CBlockFileMap::CBlockFileMap(size_t nMaxFilesIn) : nMaxFiles(std::max<size_t>(nMaxFilesIn, 1)), nSequential(0)
+{
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMap::Get(int nFile)
+{
+    {
+        LOCK(cs);
+        auto it = mapFiles.find(nFile);
+        if (it != mapFiles.end()) {
+            listRecent.splice(listRecent.begin(), listRecent, it->second.second);
+            return it->second.first;
+        }
+    }
+
+    // Mapped without the lock, two threads may map the same file at once
+    std::shared_ptr<const CMappedBlockFile> file = Map(nFile);
+    if (!file)
+        return nullptr;
+
+    LOCK(cs);
+    auto it = mapFiles.find(nFile);
+    if (it != mapFiles.end())
+        return it->second.first;
+
+    listRecent.push_front(nFile);
+    mapFiles.emplace(nFile, std::make_pair(file, listRecent.begin()));
+    if (mapFiles.size() > nMaxFiles) {
+        mapFiles.erase(listRecent.back());
+        listRecent.pop_back();
+    }
+    return file;
+}
+
+void CBlockFileMap::Remove(int nFile)
+{
+    LOCK(cs);
+    auto it = mapFiles.find(nFile);
+    if (it == mapFiles.end())
+        return;
+
+    listRecent.erase(it->second.second);
+    mapFiles.erase(it);
+}
+
+void CBlockFileMap::BeginSequential()
+{
+    if (nSequential++ != 0)
+        return;
+
+    LOCK(cs);
+    for (const auto& item : mapFiles)
+        Advise(*item.second.first);
+}
+
+void CBlockFileMap::EndSequential()
+{
+    if (--nSequential != 0)
+        return;
+
+    LOCK(cs);
+    for (const auto& item : mapFiles)
+        Advise(*item.second.first);
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMap::Map(int nFile) const
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    const fs::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    // The mapping stays valid once the file is closed
+    const size_t nSize = st.st_size;
+    void* p = mmap(nullptr, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrintf("%s: Failed to map %s\n", __func__, path.string());
+        return nullptr;
+    }
+
+    std::shared_ptr<const CMappedBlockFile> file = std::make_shared<const CMappedBlockFile>(static_cast<const unsigned char*>(p), nSize);
+    Advise(*file);
+    return file;
+#endif
+}
+
+void CBlockFileMap::Advise(const CMappedBlockFile& file) const
+{
+#if !defined(WIN32) && defined(MADV_SEQUENTIAL)
+    madvise(const_cast<unsigned char*>(file.data()), file.size(), nSequential > 0 ? MADV_SEQUENTIAL : MADV_NORMAL);
+#endif
+}
+
+BlockFileMapScan::BlockFileMapScan() : blockfilemap(g_blockfilemap.get())
+{
+    if (blockfilemap)
+        blockfilemap->BeginSequential();
+}
+
+BlockFileMapScan::~BlockFileMapScan()
+{
+    if (blockfilemap)
+        blockfilemap->EndSequential();
+}
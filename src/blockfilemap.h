@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+
+/** Default for -blockmmap */
+static const bool DEFAULT_BLOCK_MMAP = false;
+/** Number of block files kept mapped with -blockmmap */
+static const int BLOCK_MMAP_FILES = 32;
+
+/** A block file mapped read only into memory, unmapped when the last
+ * reference to it goes away */
+class CMappedBlockFile
+{
+public:
+    CMappedBlockFile(const unsigned char* pchDataIn, size_t nSizeIn) : pchData(pchDataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+
+    const unsigned char* data() const { return pchData; }
+    size_t size() const { return nSize; }
+
+private:
+    const unsigned char* const pchData;
+    const size_t nSize;
+};
+
+/**
+ * Read only memory maps of the block files (blk?????.dat) that are no
+ * longer written to (-blockmmap).
+ *
+ * Reading a block from a mapped file doesn't take a syscall or a copy into
+ * a stdio buffer, and the page cache keeps the blocks that are read often.
+ * The most recently used nMaxFiles files are kept mapped. A reader holds a
+ * reference to the mapping it reads from, so a file can be dropped from the
+ * map while it is being read.
+ *
+ * The caller decides which files are finished: the file being written to
+ * must not be mapped, as it grows.
+ */
+class CBlockFileMap
+{
+public:
+    explicit CBlockFileMap(size_t nMaxFilesIn);
+
+    /** Map of block file nFile, nullptr if it can't be mapped */
+    std::shared_ptr<const CMappedBlockFile> Get(int nFile);
+
+    /** Drop the map of a file that is being deleted */
+    void Remove(int nFile);
+
+    /** Tell the kernel to read ahead, for the duration of a scan of the
+     * files in order */
+    void BeginSequential();
+    void EndSequential();
+
+private:
+    std::shared_ptr<const CMappedBlockFile> Map(int nFile) const;
+    void Advise(const CMappedBlockFile& file) const;
+
+    const size_t nMaxFiles;
+
+    CCriticalSection cs;
+    // Most recently used first
+    std::list<int> listRecent;
+    std::map<int, std::pair<std::shared_ptr<const CMappedBlockFile>, std::list<int>::iterator>> mapFiles;
+
+    std::atomic<int> nSequential;
+};
+
+/** Marks a scan of the block files in order while it is in scope */
+class BlockFileMapScan
+{
+public:
+    BlockFileMapScan();
+    ~BlockFileMapScan();
+
+private:
+    CBlockFileMap* const blockfilemap;
+};
+
+extern std::unique_ptr<CBlockFileMap> g_blockfilemap;
+
+#endif // BITCOIN_BLOCKFILEMAP_H
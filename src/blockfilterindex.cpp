@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilterindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_typeIn, size_t nCacheSize, bool fMemory, bool fWipe)
+    : BaseIndex("blockfilter", "block filter index"), filter_type(filter_typeIn),
+      pdb(new BlockFilterDB(BlockFilterTypeName(filter_typeIn), nCacheSize, fMemory, fWipe))
+{
+}
+
+BlockFilterIndex::~BlockFilterIndex()
+{
+    Interrupt();
+    Stop();
+}
+
+bool BlockFilterIndex::ReadLocator(CBlockLocator& locator)
+{
+    return pdb->ReadBestBlock(locator);
+}
+
+bool BlockFilterIndex::WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex)
+{
+    return pdb->WriteBestBlock(locator);
+}
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const
+{
+    std::vector<unsigned char> vFilter;
+    if (!pdb->ReadFilter(pindex->GetBlockHash(), vFilter))
+        return false;
+
+    try {
+        filter = BlockFilter(filter_type, pindex->GetBlockHash(), std::move(vFilter));
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Invalid filter of block %s: %s\n", __func__, pindex->GetBlockHash().ToString(), e.what());
+        return false;
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const
+{
+    uint256 hashFilter;
+    return pdb->ReadFilterHeader(pindex->GetBlockHash(), hashFilter, header);
+}
+
+bool BlockFilterIndex::LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& vFilter) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    vFilter.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    for (size_t i = vFilter.size(); i > 0; i--, pindex = pindex->pprev) {
+        if (!LookupFilter(pindex, vFilter[i - 1]))
+            return false;
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHash) const
+{
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight)
+        return false;
+
+    vHash.resize(pindexStop->nHeight - nStartHeight + 1);
+    const CBlockIndex* pindex = pindexStop;
+    uint256 header;
+    for (size_t i = vHash.size(); i > 0; i--, pindex = pindex->pprev) {
+        if (!pdb->ReadFilterHeader(pindex->GetBlockHash(), vHash[i - 1], header))
+            return false;
+    }
+    return true;
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The scripts of the coins spent are in the undo data
+    CBlockUndo blockundo;
+    if (block.vtx.size() > 1 && !UndoReadFromDisk(blockundo, pindex))
+        return false;
+
+    uint256 prev_header;
+    if (pindex->pprev) {
+        uint256 hashFilter;
+        if (!pdb->ReadFilterHeader(pindex->pprev->GetBlockHash(), hashFilter, prev_header)) {
+            LogPrintf("%s: Filter header of block %s not found\n", __func__, pindex->pprev->GetBlockHash().ToString());
+            return false;
+        }
+    }
+
+    BlockFilter filter(filter_type, block, blockundo);
+    return pdb->WriteFilter(filter, filter.ComputeHeader(prev_header));
+}
+
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type)
+{
+    if (g_blockfilterindex && g_blockfilterindex->GetFilterType() == filter_type)
+        return g_blockfilterindex.get();
+    return nullptr;
+}
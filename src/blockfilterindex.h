@@ -0,0 +1,74 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include <baseindex.h>
+#include <blockfilter.h>
+
+#include <memory>
+#include <vector>
+
+class BlockFilterDB;
+class CBlock;
+class CBlockIndex;
+class uint256;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Default for -peerblockfilters, serving compact block filters to peers */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+
+/**
+ * Background indexer of the BIP 158 compact filter of every block and of its
+ * BIP 157 filter header (-blockfilterindex), so that light clients can be
+ * served precomputed filters instead of running a bloom filter against every
+ * transaction for every peer.
+ *
+ * Filters are stored by block hash, so those of disconnected blocks stay
+ * valid and are kept.
+ */
+class BlockFilterIndex : public BaseIndex
+{
+public:
+    BlockFilterIndex(BlockFilterType filter_type, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~BlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return filter_type; }
+
+    /** Get the filter of a block, false if it hasn't been indexed */
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const;
+
+    /** Get the filter header of a block, false if it hasn't been indexed */
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& header) const;
+
+    /** Get the filters of the ancestors of pindexStop from nStartHeight up
+     * to pindexStop, false if any of them hasn't been indexed */
+    bool LookupFilterRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<BlockFilter>& vFilter) const;
+
+    /** Get the filter hashes of the ancestors of pindexStop from
+     * nStartHeight up to pindexStop */
+    bool LookupFilterHashRange(int nStartHeight, const CBlockIndex* pindexStop, std::vector<uint256>& vHash) const;
+
+protected:
+    bool ReadLocator(CBlockLocator& locator) override;
+
+    bool WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex) override;
+
+    /** Compute the filter and filter header of a block and write them */
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+private:
+    const BlockFilterType filter_type;
+
+    std::unique_ptr<BlockFilterDB> pdb;
+};
+
+/** Get the index of a filter type, null if it isn't enabled */
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type);
+
+/** The global basic block filter index, null if -blockfilterindex=0 */
+extern std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
@@ -0,0 +1,173 @@
+// Copyright (c) 2017-2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprefetch.h>
+
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <validation.h>
+
+#include <set>
+
+std::unique_ptr<CBlockPrefetcher> g_blockprefetcher;
+
+CBlockPrefetcher::CBlockPrefetcher(const Consensus::Params& consensusParamsIn, int nThreadsIn, size_t nMaxBlocksIn)
+    : consensusParams(consensusParamsIn), nThreads(nThreadsIn), nMaxBlocks(nMaxBlocksIn), fInterrupt(false)
+{
+}
+
+CBlockPrefetcher::~CBlockPrefetcher()
+{
+    Interrupt();
+    Stop();
+}
+
+void CBlockPrefetcher::Start()
+{
+    for (int i = 0; i < nThreads; i++) {
+        vThread.emplace_back(&TraceThread<std::function<void()>>, "blkprefetch",
+                std::bind(&CBlockPrefetcher::ThreadPrefetch, this));
+    }
+}
+
+void CBlockPrefetcher::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fInterrupt = true;
+    }
+    condQueue.notify_all();
+    condDone.notify_all();
+}
+
+void CBlockPrefetcher::Stop()
+{
+    for (std::thread& t : vThread) {
+        if (t.joinable())
+            t.join();
+    }
+    vThread.clear();
+}
+
+void CBlockPrefetcher::Prefetch(const std::vector<std::pair<uint256, CDiskBlockPos>>& vBlock)
+{
+    std::set<uint256> setWanted;
+    for (size_t i = 0; i < vBlock.size() && i < nMaxBlocks; i++)
+        setWanted.insert(vBlock[i].first);
+
+    bool fQueued = false;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+
+        // Drop the blocks of a branch we aren't connecting anymore
+        for (auto it = mapEntry.begin(); it != mapEntry.end(); ) {
+            if (setWanted.count(it->first)) {
+                it++;
+            } else if (it->second.state == PREFETCH_READING) {
+                it->second.fWanted = false;
+                it++;
+            } else {
+                it = mapEntry.erase(it);
+            }
+        }
+
+        for (size_t i = 0; i < vBlock.size() && i < nMaxBlocks; i++) {
+            auto it = mapEntry.find(vBlock[i].first);
+            if (it != mapEntry.end()) {
+                it->second.fWanted = true;
+                continue;
+            }
+
+            PrefetchEntry entry;
+            entry.pos = vBlock[i].second;
+            entry.state = PREFETCH_QUEUED;
+            entry.fWanted = true;
+            mapEntry.emplace(vBlock[i].first, std::move(entry));
+            queue.push_back(vBlock[i].first);
+            fQueued = true;
+        }
+    }
+    if (fQueued)
+        condQueue.notify_all();
+}
+
+std::shared_ptr<const CBlock> CBlockPrefetcher::Get(const uint256& hash)
+{
+    std::unique_lock<std::mutex> lock(cs);
+
+    auto it = mapEntry.find(hash);
+    if (it == mapEntry.end())
+        return nullptr;
+
+    // Reading it ourselves is no slower than waiting for a prefetch thread
+    // to pick it up
+    if (it->second.state == PREFETCH_QUEUED) {
+        mapEntry.erase(it);
+        return nullptr;
+    }
+
+    while (!fInterrupt && it->second.state == PREFETCH_READING) {
+        condDone.wait(lock);
+        it = mapEntry.find(hash);
+        if (it == mapEntry.end())
+            return nullptr;
+    }
+    if (it->second.state != PREFETCH_DONE)
+        return nullptr;
+
+    std::shared_ptr<const CBlock> block = std::move(it->second.block);
+    mapEntry.erase(it);
+    return block;
+}
+
+void CBlockPrefetcher::ThreadPrefetch()
+{
+    while (true) {
+        uint256 hash;
+        CDiskBlockPos pos;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (!fInterrupt && queue.empty())
+                condQueue.wait(lock);
+            if (fInterrupt)
+                return;
+
+            hash = queue.front();
+            queue.pop_front();
+
+            // Skip blocks that were dropped or taken by Get() since
+            auto it = mapEntry.find(hash);
+            if (it == mapEntry.end() || it->second.state != PREFETCH_QUEUED)
+                continue;
+
+            it->second.state = PREFETCH_READING;
+            pos = it->second.pos;
+        }
+
+        std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+        if (ReadBlockFromDisk(*block, pos, consensusParams) && block->GetHash() == hash) {
+            // Sets fChecked if the block passes, so that ConnectBlock can
+            // skip these checks
+            CValidationState state;
+            CheckBlock(*block, state, consensusParams);
+        } else {
+            block.reset();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            auto it = mapEntry.find(hash);
+            if (it != mapEntry.end()) {
+                if (!it->second.fWanted) {
+                    mapEntry.erase(it);
+                } else {
+                    it->second.block = std::move(block);
+                    it->second.state = PREFETCH_DONE;
+                }
+            }
+        }
+        condDone.notify_all();
+    }
+}
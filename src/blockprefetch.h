@@ -0,0 +1,106 @@
+// Copyright (c) 2017-2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPREFETCH_H
+#define BITCOIN_BLOCKPREFETCH_H
+
+#include <chain.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CBlock;
+
+namespace Consensus {
+struct Params;
+}
+
+/** Default for -prefetchblocks, the number of blocks read ahead of the tip */
+static const int DEFAULT_PREFETCH_BLOCKS = 16;
+/** Maximum number of block prefetch threads */
+static const int MAX_PREFETCH_THREADS = 4;
+
+/**
+ * Reads the blocks about to be connected from disk on background threads.
+ *
+ * While ConnectTip connects a block under cs_main, the next blocks of the
+ * chain being activated are read & deserialized and their context-free
+ * checks (CheckBlock: PoW, merkle root, size, transactions) are run on the
+ * prefetch threads. CheckBlock marks the blocks it has checked, so
+ * ConnectBlock doesn't repeat those checks and the header hash is memoized.
+ * A block that fails the checks is handed over like any other block and
+ * gets rejected by ConnectBlock.
+ *
+ * The prefetch threads never lock cs_main, so ConnectTip can wait for a
+ * block that is being read while holding it.
+ */
+class CBlockPrefetcher
+{
+public:
+    CBlockPrefetcher(const Consensus::Params& consensusParamsIn, int nThreadsIn, size_t nMaxBlocksIn);
+    ~CBlockPrefetcher();
+
+    /** Start the prefetch threads */
+    void Start();
+
+    /** Tell the prefetch threads to stop after their current block */
+    void Interrupt();
+
+    /** Wait for the prefetch threads to exit */
+    void Stop();
+
+    /** Set the blocks that are about to be connected, in the order they will
+     * be connected. Prefetched blocks which aren't in the list anymore are
+     * dropped. At most nMaxBlocks are read ahead. */
+    void Prefetch(const std::vector<std::pair<uint256, CDiskBlockPos>>& vBlock);
+
+    /** Take a prefetched block. Waits if the block is being read, returns
+     * nullptr if it wasn't requested, hasn't been started yet or couldn't be
+     * read, in which case the caller should read it itself. */
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+
+private:
+    enum PrefetchState {
+        PREFETCH_QUEUED,
+        PREFETCH_READING,
+        PREFETCH_DONE,
+    };
+
+    struct PrefetchEntry {
+        CDiskBlockPos pos;
+        PrefetchState state;
+        // Whether the block is still wanted, cleared when a block that is
+        // being read is dropped from the list
+        bool fWanted;
+        std::shared_ptr<const CBlock> block;
+    };
+
+    void ThreadPrefetch();
+
+    const Consensus::Params& consensusParams;
+    const int nThreads;
+    const size_t nMaxBlocks;
+
+    std::mutex cs;
+    std::condition_variable condQueue;
+    std::condition_variable condDone;
+    bool fInterrupt;
+
+    std::map<uint256, PrefetchEntry> mapEntry;
+    std::deque<uint256> queue;
+
+    std::vector<std::thread> vThread;
+};
+
+/** Prefetches blocks for ConnectTip, if enabled */
+extern std::unique_ptr<CBlockPrefetcher> g_blockprefetcher;
+
+#endif // BITCOIN_BLOCKPREFETCH_H
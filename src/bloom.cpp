@@ -5,14 +5,15 @@
 #include <bloom.h>
 
 #include <primitives/transaction.h>
+#include <crypto/common.h>
 #include <hash.h>
 #include <script/script.h>
 #include <script/standard.h>
 #include <random.h>
-#include <streams.h>
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
@@ -49,40 +50,87 @@ CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, c
 {
 }
 
-inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
+/** Size of a serialized COutPoint */
+static const size_t OUTPOINT_SIZE = 36;
+
+/** Serialize an outpoint into a fixed buffer, without a stream allocation */
+static void SerializeOutPoint(const COutPoint& outpoint, unsigned char* pch)
+{
+    memcpy(pch, outpoint.hash.begin(), 32);
+    WriteLE32(pch + 32, outpoint.n);
+}
+
+/**
+ * Append the non-empty data pushes of a script to vElements. The elements
+ * point into the script, so it is parsed once and no push is copied out.
+ */
+static void AppendScriptPushes(const CScript& script, std::vector<std::pair<const unsigned char*, size_t>>& vElements)
+{
+    CScript::const_iterator pc = script.begin();
+    while (pc < script.end())
+    {
+        CScript::const_iterator pcOp = pc;
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode))
+            break;
+        if (opcode > OP_PUSHDATA4)
+            continue;
+        // The push data ends at pc, after the opcode and its length prefix
+        size_t nPrefix = 1;
+        if (opcode == OP_PUSHDATA1)
+            nPrefix += 1;
+        else if (opcode == OP_PUSHDATA2)
+            nPrefix += 2;
+        else if (opcode == OP_PUSHDATA4)
+            nPrefix += 4;
+        const size_t nSize = (pc - pcOp) - nPrefix;
+        if (nSize != 0)
+            vElements.emplace_back(&pcOp[nPrefix], nSize);
+    }
+}
+
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const unsigned char* pDataToHash, size_t nSize) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pDataToHash, nSize) % (vData.size() * 8);
 }
 
-void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
+{
+    return Hash(nHashNum, vDataToHash.data(), vDataToHash.size());
+}
+
+void CBloomFilter::insert(const unsigned char* pKey, size_t nSize)
 {
     if (isFull)
         return;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nSize);
         // Sets bit nIndex of vData
         vData[nIndex >> 3] |= (1 << (7 & nIndex));
     }
     isEmpty = false;
 }
 
+void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    insert(vKey.data(), vKey.size());
+}
+
 void CBloomFilter::insert(const COutPoint& outpoint)
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
+    unsigned char data[OUTPOINT_SIZE];
+    SerializeOutPoint(outpoint, data);
+    insert(data, sizeof(data));
 }
 
 void CBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    insert(hash.begin(), hash.size());
 }
 
-bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+bool CBloomFilter::contains(const unsigned char* pKey, size_t nSize) const
 {
     if (isFull)
         return true;
@@ -90,7 +138,7 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
         return false;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nSize);
         // Checks bit nIndex of vData
         if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
             return false;
@@ -98,18 +146,48 @@ bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
     return true;
 }
 
+bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+{
+    return contains(vKey.data(), vKey.size());
+}
+
 bool CBloomFilter::contains(const COutPoint& outpoint) const
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
+    unsigned char data[OUTPOINT_SIZE];
+    SerializeOutPoint(outpoint, data);
+    return contains(data, sizeof(data));
 }
 
 bool CBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    return contains(hash.begin(), hash.size());
+}
+
+bool CBloomFilter::containsAny(std::vector<Element>& vElements) const
+{
+    if (vElements.empty())
+        return false;
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    const uint64_t nBits = vData.size() * 8;
+    size_t nCandidates = vElements.size();
+    for (unsigned int i = 0; i < nHashFuncs && nCandidates > 0; i++)
+    {
+        // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
+        const unsigned int nSeed = i * 0xFBA4C795 + nTweak;
+        size_t nKept = 0;
+        for (size_t j = 0; j < nCandidates; j++)
+        {
+            const unsigned int nIndex = MurmurHash3(nSeed, vElements[j].first, vElements[j].second) % nBits;
+            // Keep the elements whose bit nIndex of vData is set
+            if (vData[nIndex >> 3] & (1 << (7 & nIndex)))
+                vElements[nKept++] = vElements[j];
+        }
+        nCandidates = nKept;
+    }
+    return nCandidates > 0;
 }
 
 void CBloomFilter::clear()
@@ -143,6 +221,7 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (contains(hash))
         fFound = true;
 
+    std::vector<Element> vElements;
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
         const CTxOut& txout = tx.vout[i];
@@ -150,27 +229,22 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
         // If this matches, also add the specific output that was matched.
         // This means clients don't have to update the filter themselves when a new relevant tx 
         // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
-        std::vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end())
+        // Each scriptPubKey is checked on its own, as a match updates the
+        // filter that the following outputs are checked against.
+        vElements.clear();
+        AppendScriptPushes(txout.scriptPubKey, vElements);
+        if (containsAny(vElements))
         {
-            opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            fFound = true;
+            if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                insert(COutPoint(hash, i));
+            else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY)
             {
-                fFound = true;
-                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                txnouttype type;
+                std::vector<std::vector<unsigned char> > vSolutions;
+                if (Solver(txout.scriptPubKey, type, vSolutions) &&
+                        (type == TX_PUBKEY || type == TX_MULTISIG))
                     insert(COutPoint(hash, i));
-                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY)
-                {
-                    txnouttype type;
-                    std::vector<std::vector<unsigned char> > vSolutions;
-                    if (Solver(txout.scriptPubKey, type, vSolutions) &&
-                            (type == TX_PUBKEY || type == TX_MULTISIG))
-                        insert(COutPoint(hash, i));
-                }
-                break;
             }
         }
     }
@@ -178,26 +252,22 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (fFound)
         return true;
 
-    for (const CTxIn& txin : tx.vin)
+    // Nothing below updates the filter, so the outpoints the tx spends and
+    // the data elements of every scriptSig are checked in one batch
+    std::vector<unsigned char> vOutPoints(tx.vin.size() * OUTPOINT_SIZE);
+    vElements.clear();
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
+        const CTxIn& txin = tx.vin[i];
         // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
-            return true;
+        SerializeOutPoint(txin.prevout, &vOutPoints[i * OUTPOINT_SIZE]);
+        vElements.emplace_back(&vOutPoints[i * OUTPOINT_SIZE], OUTPOINT_SIZE);
 
         // Match if the filter contains any arbitrary script data element in any scriptSig in tx
-        CScript::const_iterator pc = txin.scriptSig.begin();
-        std::vector<unsigned char> data;
-        while (pc < txin.scriptSig.end())
-        {
-            opcodetype opcode;
-            if (!txin.scriptSig.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
-                return true;
-        }
+        AppendScriptPushes(txin.scriptSig, vElements);
     }
 
-    return false;
+    return containsAny(vElements);
 }
 
 void CBloomFilter::UpdateEmptyFull()
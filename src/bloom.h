@@ -7,6 +7,7 @@
 
 #include <serialize.h>
 
+#include <utility>
 #include <vector>
 
 class COutPoint;
@@ -51,8 +52,24 @@ private:
     unsigned int nTweak;
     unsigned char nFlags;
 
+    /** A data element of a transaction, pointing into the transaction */
+    typedef std::pair<const unsigned char*, size_t> Element;
+
+    unsigned int Hash(unsigned int nHashNum, const unsigned char* pDataToHash, size_t nSize) const;
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
 
+    void insert(const unsigned char* pKey, size_t nSize);
+    bool contains(const unsigned char* pKey, size_t nSize) const;
+
+    /**
+     * Check whether any of vElements is in the filter. The elements are
+     * hashed one hash function at a time and dropped at their first unset
+     * bit, so that each costs no more hashes than contains() would while the
+     * inner loop runs over many elements with the same seed. vElements is
+     * reordered.
+     */
+    bool containsAny(std::vector<Element>& vElements) const;
+
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweak);
     friend class CRollingBloomFilter;
@@ -0,0 +1,137 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bmmcache.h>
+
+#include <chain.h>
+#include <primitives/block.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+std::unique_ptr<CBMMCache> g_bmmcache;
+
+CBMMCache::CBMMCache(size_t nMaxBlocksIn) : nMaxBlocks(std::max<size_t>(nMaxBlocksIn, 1)), fInterrupt(false)
+{
+}
+
+void CBMMCache::Start()
+{
+    RegisterValidationInterface(this, "bmmcache");
+}
+
+void CBMMCache::Stop()
+{
+    UnregisterValidationInterface(this);
+    Interrupt();
+}
+
+void CBMMCache::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fInterrupt = true;
+    }
+    condBMM.notify_all();
+}
+
+bool CBMMCache::Lookup(const uint256& hashBlock, uint8_t nSidechain, const uint256& hashBMM, bool& fFound, uint256& txidCoinbase) const
+{
+    std::lock_guard<std::mutex> lock(cs);
+
+    std::map<uint256, Entry>::const_iterator it = mapBlock.find(hashBlock);
+    if (it == mapBlock.end())
+        return false;
+
+    fFound = false;
+    for (const std::pair<uint8_t, uint256>& commit : it->second.vCommit) {
+        if (commit.first == nSidechain && commit.second == hashBMM) {
+            fFound = true;
+            txidCoinbase = it->second.txidCoinbase;
+            break;
+        }
+    }
+    return true;
+}
+
+bool CBMMCache::WaitForBMM(const uint256& hashBMM, uint8_t nSidechain, int64_t nTimeout, BMMCacheResult& result)
+{
+    const std::pair<uint8_t, uint256> key = std::make_pair(nSidechain, hashBMM);
+    auto found = [this, &key] { return fInterrupt || mapCommit.count(key); };
+
+    std::unique_lock<std::mutex> lock(cs);
+    if (nTimeout > 0)
+        condBMM.wait_for(lock, std::chrono::milliseconds(nTimeout), found);
+    else
+        condBMM.wait(lock, found);
+
+    std::multimap<std::pair<uint8_t, uint256>, uint256>::const_iterator it = mapCommit.find(key);
+    if (it == mapCommit.end())
+        return false;
+
+    const Entry& entry = mapBlock.at(it->second);
+    result.hashBlock = it->second;
+    result.txidCoinbase = entry.txidCoinbase;
+    result.nHeight = entry.nHeight;
+    return true;
+}
+
+size_t CBMMCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return mapBlock.size();
+}
+
+void CBMMCache::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    if (block->vtx.empty())
+        return;
+
+    Entry entry;
+    entry.txidCoinbase = block->vtx[0]->GetHash();
+    entry.nHeight = pindex->nHeight;
+    GetBMMCommits(*block, entry.vCommit);
+
+    const uint256 hashBlock = pindex->GetBlockHash();
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (mapBlock.count(hashBlock))
+            return;
+
+        listOrder.push_back(hashBlock);
+        entry.itOrder = std::prev(listOrder.end());
+        for (const std::pair<uint8_t, uint256>& commit : entry.vCommit)
+            mapCommit.emplace(commit, hashBlock);
+        mapBlock.emplace(hashBlock, std::move(entry));
+
+        while (mapBlock.size() > nMaxBlocks)
+            EraseBlock(mapBlock.find(listOrder.front()));
+    }
+    condBMM.notify_all();
+}
+
+void CBMMCache::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    std::map<uint256, Entry>::iterator it = mapBlock.find(block->GetHash());
+    if (it != mapBlock.end())
+        EraseBlock(it);
+}
+
+void CBMMCache::EraseBlock(std::map<uint256, Entry>::iterator it)
+{
+    for (const std::pair<uint8_t, uint256>& commit : it->second.vCommit) {
+        auto range = mapCommit.equal_range(commit);
+        for (auto itCommit = range.first; itCommit != range.second; ++itCommit) {
+            if (itCommit->second == it->first) {
+                mapCommit.erase(itCommit);
+                break;
+            }
+        }
+    }
+    listOrder.erase(it->second.itOrder);
+    mapBlock.erase(it);
+}
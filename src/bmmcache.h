@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BMMCACHE_H
+#define BITCOIN_BMMCACHE_H
+
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -bmmcache, the number of recent blocks whose h* are cached */
+static const unsigned int DEFAULT_BMM_CACHE_BLOCKS = 288;
+
+/** A BMM commitment found in a block */
+struct BMMCacheResult
+{
+    uint256 hashBlock;
+    uint256 txidCoinbase;
+    int nHeight;
+};
+
+/**
+ * The BMM h* commitments of the most recently connected blocks.
+ *
+ * Sidechains check each of their blocks for BMM in the mainchain block that
+ * should commit to it, and check the same recent blocks again when they
+ * reorg. Without -bmmindex every check would read the block from disk, so
+ * the commitments of the last nMaxBlocks blocks connected are kept here,
+ * added as blocks are connected and dropped when they are disconnected.
+ *
+ * WaitForBMM lets RPC clients block until a commitment shows up, instead of
+ * polling verifybmm.
+ */
+class CBMMCache : public CValidationInterface
+{
+public:
+    explicit CBMMCache(size_t nMaxBlocksIn);
+
+    void Start();
+    void Stop();
+
+    /** Wake up and return from every WaitForBMM */
+    void Interrupt();
+
+    /**
+     * Look up the commitment of block hashBlock for nSidechain. Returns false
+     * if the block isn't cached, otherwise sets fFound and, if hashBMM is
+     * committed, txidCoinbase.
+     */
+    bool Lookup(const uint256& hashBlock, uint8_t nSidechain, const uint256& hashBMM, bool& fFound, uint256& txidCoinbase) const;
+
+    /**
+     * Wait until a connected block commits to hashBMM for nSidechain, at
+     * most nTimeout milliseconds, 0 to wait until interrupted. Commitments of
+     * cached blocks connected before the call are found right away.
+     */
+    bool WaitForBMM(const uint256& hashBMM, uint8_t nSidechain, int64_t nTimeout, BMMCacheResult& result);
+
+    /** Number of blocks cached */
+    size_t Size() const;
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+private:
+    struct Entry
+    {
+        uint256 txidCoinbase;
+        int nHeight;
+        std::vector<std::pair<uint8_t, uint256>> vCommit;
+        std::list<uint256>::iterator itOrder;
+    };
+
+    void EraseBlock(std::map<uint256, Entry>::iterator it);
+
+    const size_t nMaxBlocks;
+
+    mutable std::mutex cs;
+    std::condition_variable condBMM;
+    bool fInterrupt;
+
+    std::map<uint256, Entry> mapBlock;
+    // Blocks in the order they were connected, oldest first
+    std::list<uint256> listOrder;
+    // (nSidechain, h*) to the blocks that commit to it
+    std::multimap<std::pair<uint8_t, uint256>, uint256> mapCommit;
+};
+
+extern std::unique_ptr<CBMMCache> g_bmmcache;
+
+#endif // BITCOIN_BMMCACHE_H
@@ -5,6 +5,9 @@
 
 #include <chain.h>
 
+#include <stdint.h>
+#include <type_traits>
+
 /**
  * CChain implementation
  */
@@ -168,3 +171,34 @@ const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex*
     assert(pa == pb);
     return pa;
 }
+
+// Clear() drops the slabs without running destructors
+static_assert(std::is_trivially_destructible<CBlockIndex>::value, "CBlockIndex must be trivially destructible");
+
+void* CBlockIndexArena::NextEntry()
+{
+    if (nSlabUsed == SLAB_SIZE) {
+        std::unique_ptr<char[]> slab(new char[SLAB_SIZE * sizeof(CBlockIndex) + SLAB_ALIGN - 1]);
+        uintptr_t nAddr = reinterpret_cast<uintptr_t>(slab.get());
+        pSlab = reinterpret_cast<CBlockIndex*>((nAddr + SLAB_ALIGN - 1) & ~uintptr_t(SLAB_ALIGN - 1));
+        mapSlabs.emplace(pSlab, std::move(slab));
+        nSlabUsed = 0;
+    }
+    return &pSlab[nSlabUsed++];
+}
+
+bool CBlockIndexArena::Owns(const CBlockIndex* pindex) const
+{
+    auto it = mapSlabs.upper_bound(pindex);
+    if (it == mapSlabs.begin())
+        return false;
+    --it;
+    return std::less<const CBlockIndex*>()(pindex, it->first + SLAB_SIZE);
+}
+
+void CBlockIndexArena::Clear()
+{
+    mapSlabs.clear();
+    pSlab = nullptr;
+    nSlabUsed = SLAB_SIZE;
+}
@@ -14,6 +14,10 @@
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <map>
+#include <memory>
+#include <new>
+#include <utility>
 #include <vector>
 
 /**
@@ -172,8 +176,9 @@ enum BlockStatus: uint32_t {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
-    const uint256* phashBlock;
+    // The fields chain walks read (GetAncestor, FindFork, LastCommonAncestor,
+    // the chain work and hash rate computations) come first and fit in 64
+    // bytes, so a walk touches one cache line per entry.
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex* pprev;
@@ -184,6 +189,21 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! Verification status of this block. See enum BlockStatus
+    uint32_t nStatus;
+
+    //! block header time
+    uint32_t nTime;
+
+    //! (memory only) Maximum nTime in the chain up to and including this block.
+    unsigned int nTimeMax;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
+    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    const uint256* phashBlock;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -193,9 +213,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
@@ -205,22 +222,15 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    uint32_t nStatus;
-
-    //! block header
+    //! rest of the block header
     int32_t nVersion;
-    uint256 hashMerkleRoot;
-    uint32_t nTime;
     uint32_t nBits;
     uint32_t nNonce;
+    uint256 hashMerkleRoot;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
 
-    //! (memory only) Maximum nTime in the chain up to and including this block.
-    unsigned int nTimeMax;
-
     void SetNull()
     {
         phashBlock = nullptr;
@@ -376,6 +386,41 @@ int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& fr
 /** Find the forking point between two chain tips. */
 const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb);
 
+/**
+ * Allocates block index entries in cache line aligned slabs, so that
+ * the block index doesn't take one heap allocation (and its malloc
+ * overhead) per header and the entries of a chain end up next to each
+ * other in memory. Entries can't be freed one by one, only all together.
+ */
+class CBlockIndexArena
+{
+public:
+    CBlockIndexArena() : nSlabUsed(SLAB_SIZE) {}
+
+    template <typename... Args>
+    CBlockIndex* Allocate(Args&&... args)
+    {
+        return new (NextEntry()) CBlockIndex(std::forward<Args>(args)...);
+    }
+
+    /** Whether pindex was allocated by this arena */
+    bool Owns(const CBlockIndex* pindex) const;
+
+    /** Free every entry allocated so far */
+    void Clear();
+
+private:
+    static const size_t SLAB_SIZE = 4096;
+    static const size_t SLAB_ALIGN = 64;
+
+    void* NextEntry();
+
+    //! Slab memory by the first entry of the slab
+    std::map<const CBlockIndex*, std::unique_ptr<char[]>> mapSlabs;
+    CBlockIndex* pSlab = nullptr;
+    size_t nSlabUsed;
+};
+
 
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
@@ -8,14 +8,20 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
 
+/** Maximum number of per-worker queues, more workers than this share them */
+static const unsigned int CHECKQUEUE_MAX_WORKER_QUEUES = 64;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +31,25 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own queue and the master puts each batch on the
+  * next one in turn. Workers take from the back of their own queue and,
+  * when it runs dry, steal from the front of the other queues, so they only
+  * contend with each other at the end of a block. The shared mutex is only
+  * taken to sleep and to wake threads up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    /** The checks queued for one worker */
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> queue;
+    };
+
+    //! Mutex for sleeping and waking up the workers and the master
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +58,134 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The per-worker queues of elements to be processed.
+    //! As the order of booleans doesn't matter, the owner uses its queue as
+    //! a LIFO (stack) and thieves take from the other end.
+    WorkerQueue vWorkerQueue[CHECKQUEUE_MAX_WORKER_QUEUES];
+
+    //! The number of worker threads that have started. The master uses the
+    //! first queue, worker i the queue i % CHECKQUEUE_MAX_WORKER_QUEUES.
+    std::atomic<unsigned int> nWorkers;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The queue Add() puts the next batch on, only used by the master
+    unsigned int nNextQueue;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are waiting for elements or about to
+    std::atomic<unsigned int> nIdle;
+
+    //! The number of elements that are queued and haven't been taken by a
+    //! worker yet. Incremented before the elements are queued, so it is
+    //! never lower than the real count.
+    std::atomic<unsigned int> nQueued;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The number of worker queues that have been used so far
+    unsigned int QueuesInUse() const
+    {
+        return std::max(1U, std::min((unsigned int)nWorkers, CHECKQUEUE_MAX_WORKER_QUEUES));
+    }
+
+    /** Take a batch of elements from the back of our own queue, or steal one
+     * from the front of another queue. Returns false if all queues were
+     * empty. */
+    bool TakeBatch(unsigned int nOwnQueue, std::vector<T>& vChecks)
+    {
+        const unsigned int nQueues = QueuesInUse();
+        for (unsigned int i = 0; i < nQueues; i++) {
+            const bool fSteal = i > 0;
+            WorkerQueue& q = vWorkerQueue[(nOwnQueue + i) % nQueues];
+
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            if (q.queue.empty())
+                continue;
+
+            // Take half of the queue so that the rest can be stolen by idle
+            // workers, but at least 1 element and no more than nBatchSize.
+            unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)q.queue.size() / 2));
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                // queue to the local batch vector instead of copying.
+                if (fSteal) {
+                    vChecks[j].swap(q.queue.front());
+                    q.queue.pop_front();
+                } else {
+                    vChecks[j].swap(q.queue.back());
+                    q.queue.pop_back();
+                }
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const unsigned int nOwnQueue = fMaster ? 0 : nWorkers++ % CHECKQUEUE_MAX_WORKER_QUEUES;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (TakeBatch(nOwnQueue, vChecks)) {
+                // Check whether we need to do work at all
+                bool fOk = fAllOk;
+                // execute work
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                const unsigned int nNow = vChecks.size();
+                vChecks.clear();
+
+                if (!fOk)
+                    fAllOk = false;
+                if ((nTodo -= nNow) == 0 && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
+                continue;
+            }
+
+            // The master is still adding the elements we were counting on,
+            // or another worker has just taken them
+            if (nQueued != 0) {
+                boost::this_thread::yield();
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                while (nQueued == 0) {
+                    if (nTodo == 0) {
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
+                        fAllOk = true;
                         // return the current status
                         return fRet;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                    condMaster.wait(lock); // wait
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+            } else {
+                // Count ourselves as idle before checking for elements, so
+                // that Add() either sees us or we see its elements
+                nIdle++;
+                while (nQueued == 0)
+                    condWorker.wait(lock); // wait
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -128,7 +194,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nNextQueue(0), nIdle(0), nQueued(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -145,16 +211,33 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+        nQueued += vChecks.size();
+
+        // The master adds the checks of one transaction at a time, so put
+        // each batch on the next queue in turn. Idle workers steal from
+        // queues that end up with more than their share.
+        {
+            WorkerQueue& q = vWorkerQueue[nNextQueue++ % QueuesInUse()];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (T& check : vChecks) {
+                q.queue.push_back(T());
+                check.swap(q.queue.back());
+            }
+        }
+
+        // Only take the mutex if there are idle workers. They check nQueued
+        // while holding it, so they either see the new elements or are
+        // already waiting to be notified. Wake up no more of them than there
+        // are new elements.
+        if (nIdle == 0)
+            return;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (unsigned int i = 0; i < nIdle && i < vChecks.size(); i++)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
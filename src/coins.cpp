@@ -9,6 +9,9 @@
 #include <sidechain.h>
 #include <utilstrencodings.h>
 
+#include <algorithm>
+#include <thread>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
@@ -87,6 +90,31 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
+size_t CCoinsViewCache::RestoreCoins(std::vector<std::pair<COutPoint, Coin>>& vCoin) {
+    cacheCoins.reserve(cacheCoins.size() + vCoin.size());
+    size_t nOverwritten = 0;
+    for (auto& restore : vCoin) {
+        assert(!restore.second.IsSpent());
+        CCoinsMap::iterator it = FetchCoin(restore.first);
+        const bool fOverwrite = it != cacheCoins.end() && !it->second.coin.IsSpent();
+        if (fOverwrite)
+            nOverwritten++;
+        if (restore.second.out.scriptPubKey.IsUnspendable())
+            continue;
+        if (it == cacheCoins.end()) {
+            it = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(restore.first), std::tuple<>()).first;
+        } else {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        }
+        // Same as AddCoin with potential_overwrite set when the coin exists
+        const bool fresh = !fOverwrite && !(it->second.flags & CCoinsCacheEntry::DIRTY);
+        it->second.coin = std::move(restore.second);
+        it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+    return nOverwritten;
+}
+
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
     bool fCoinbase = tx.IsCoinBase();
     const uint256& txid = tx.GetHash();
@@ -131,6 +159,48 @@ bool CCoinsViewCache::HaveCoin(const COutPoint &outpoint) const {
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
+size_t CCoinsViewCache::Prefetch(const std::vector<COutPoint>& vOutPoint, int nThreads) {
+    std::vector<const COutPoint*> vMissing;
+    for (const COutPoint& outpoint : vOutPoint) {
+        if (cacheCoins.find(outpoint) == cacheCoins.end())
+            vMissing.push_back(&outpoint);
+    }
+
+    // Each thread looks up every nThreads'th outpoint, the cache itself is
+    // only touched once they are done
+    std::vector<Coin> vCoin(vMissing.size());
+    std::vector<char> vFound(vMissing.size(), 0);
+    nThreads = std::max(1, std::min<int>(nThreads, vMissing.size() / COINS_PREFETCH_MIN_PER_THREAD));
+    auto work = [this, &vMissing, &vCoin, &vFound, nThreads](int nThread) {
+        for (size_t i = nThread; i < vMissing.size(); i += nThreads)
+            vFound[i] = base->GetCoin(*vMissing[i], vCoin[i]);
+    };
+
+    std::vector<std::thread> vThread;
+    for (int i = 1; i < nThreads; i++) {
+        try {
+            vThread.emplace_back(work, i);
+        } catch (const std::system_error&) {
+            work(i);
+        }
+    }
+    work(0);
+    for (std::thread& thread : vThread)
+        thread.join();
+
+    size_t nFetched = 0;
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        if (!vFound[i])
+            continue;
+        auto ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(*vMissing[i]), std::forward_as_tuple(std::move(vCoin[i])));
+        if (!ret.second)
+            continue;
+        cachedCoinsUsage += ret.first->second.coin.DynamicMemoryUsage();
+        nFetched++;
+    }
+    return nFetched;
+}
+
 bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
@@ -224,6 +294,16 @@ unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
+std::vector<COutPoint> CCoinsViewCache::GetCachedOutPoints() const {
+    std::vector<COutPoint> vOutPoint;
+    vOutPoint.reserve(cacheCoins.size());
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        if (!it->second.coin.IsSpent())
+            vOutPoint.push_back(it->first);
+    }
+    return vOutPoint;
+}
+
 CAmount CCoinsViewCache::GetValueIn(const CTransaction& tx) const
 {
     if (tx.IsCoinBase())
@@ -6,12 +6,18 @@
 #ifndef BITCOIN_COINS_H
 #define BITCOIN_COINS_H
 
+#if defined(HAVE_CONFIG_H)
+#include <config/skydoge-config.h>
+#endif
+
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <flathashmap.h>
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/largepage.h>
 #include <uint256.h>
 
 #include <assert.h>
@@ -127,7 +133,13 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
+#ifdef USE_FLAT_COINSMAP
+//! The chunks and the index of large caches come from huge pages when they
+//! are enabled (-largepages)
+typedef flathashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, large_page_allocator<std::pair<const COutPoint, CCoinsCacheEntry>>> CCoinsMap;
+#else
 typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+#endif
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -204,6 +216,8 @@ public:
     size_t EstimateSize() const override;
 };
 
+//! Coins each CCoinsViewCache::Prefetch thread should look up at least
+static const unsigned int COINS_PREFETCH_MIN_PER_THREAD = 16;
 
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
@@ -262,6 +276,13 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Add the coins of a disconnected block back, overwriting unspent coins
+     * that already exist. Looks each outpoint up once and grows the cache
+     * once for all of them. Returns the number of coins overwritten.
+     */
+    size_t RestoreCoins(std::vector<std::pair<COutPoint, Coin>>& vCoin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -282,9 +303,20 @@ public:
      */
     void Uncache(const COutPoint &outpoint);
 
+    /**
+     * Look up the outpoints that aren't cached in the backing view, on up to
+     * nThreads threads at once, and cache the coins found. The backing
+     * view's GetCoin must be safe to call from several threads. Returns the
+     * number of coins added to the cache.
+     */
+    size_t Prefetch(const std::vector<COutPoint>& vOutPoint, int nThreads);
+
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
+    //! The outpoints of the unspent coins in the cache
+    std::vector<COutPoint> GetCachedOutPoints() const;
+
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
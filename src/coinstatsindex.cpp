@@ -0,0 +1,192 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstatsindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+static CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+    return ss;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = TxOutSer(outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss = TxOutSer(outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+/** Add a coin to or take it out of the totals of the stats */
+static void ApplyCoinStats(CoinStatsEntry& stats, const Coin& coin, bool fAdd)
+{
+    const CAmount nValue = fAdd ? coin.out.nValue : -coin.out.nValue;
+    const uint64_t nBogoSize = GetBogoSize(coin.out.scriptPubKey);
+    if (fAdd) {
+        stats.nTransactionOutputs++;
+        stats.nBogoSize += nBogoSize;
+    } else {
+        stats.nTransactionOutputs--;
+        stats.nBogoSize -= nBogoSize;
+    }
+    stats.nTotalAmount += nValue;
+
+    uint8_t nSidechain;
+    if (coin.out.scriptPubKey.IsDrivechain(nSidechain)) {
+        CAmount& nEscrow = stats.mapEscrow[nSidechain];
+        nEscrow += nValue;
+        if (nEscrow == 0)
+            stats.mapEscrow.erase(nSidechain);
+    }
+}
+
+/** Add the coins a block creates to muhash and take those it spends out, or
+ * the other way around to disconnect it */
+static void ApplyBlockHash(MuHash3072& muhash, CoinStatsEntry* pstats, const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect)
+{
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            // Like AddCoins, unspendable outputs never enter the UTXO set
+            if (tx.vout[j].scriptPubKey.IsUnspendable())
+                continue;
+            const COutPoint outpoint(tx.GetHash(), j);
+            const Coin coin(tx.vout[j], nHeight, tx.IsCoinBase());
+            if (fConnect) {
+                ApplyCoinHash(muhash, outpoint, coin);
+                ApplyCoinStats(*pstats, coin, true);
+            } else {
+                RemoveCoinHash(muhash, outpoint, coin);
+            }
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            if (fConnect) {
+                RemoveCoinHash(muhash, tx.vin[j].prevout, coin);
+                ApplyCoinStats(*pstats, coin, false);
+            } else {
+                ApplyCoinHash(muhash, tx.vin[j].prevout, coin);
+            }
+        }
+    }
+}
+
+/** Read the undo data of a block, the genesis block and blocks with only a
+ * coinbase have none */
+static bool ReadBlockUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& blockundo)
+{
+    if (!pindex->pprev || block.vtx.size() <= 1)
+        return true;
+    if (!UndoReadFromDisk(blockundo, pindex))
+        return false;
+    return blockundo.vtxundo.size() == block.vtx.size() - 1;
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : BaseIndex("coinstats", "coin stats index"), pdb(new CoinStatsDB(nCacheSize, fMemory, fWipe))
+{
+}
+
+CoinStatsIndex::~CoinStatsIndex()
+{
+    Interrupt();
+    Stop();
+}
+
+bool CoinStatsIndex::ReadLocator(CBlockLocator& locator)
+{
+    return pdb->ReadBestBlock(locator, hashMuHash, muhash);
+}
+
+bool CoinStatsIndex::WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex)
+{
+    return pdb->WriteBestBlock(locator, pindex->GetBlockHash(), muhash);
+}
+
+bool CoinStatsIndex::Init(const CBlockIndex* pindex)
+{
+    // The best block may have been disconnected since, it is stepped back
+    // out of the MuHash by the sync thread
+    if (pindex && pindex->GetBlockHash() == hashMuHash && pdb->ReadStats(pindex->GetBlockHash(), stats))
+        return true;
+
+    muhash = MuHash3072();
+    stats = CoinStatsEntry();
+    return !pindex;
+}
+
+bool CoinStatsIndex::LookupStats(const CBlockIndex* pindex, CoinStatsEntry& entry) const
+{
+    return pdb->ReadStats(pindex->GetBlockHash(), entry);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block doesn't add its coinbase to the UTXO set
+    if (pindex->pprev) {
+        CBlockUndo blockundo;
+        if (!ReadBlockUndo(block, pindex, blockundo))
+            return false;
+        ApplyBlockHash(muhash, &stats, block, blockundo, pindex->nHeight, true);
+    }
+
+    muhash.Finalize(stats.hashMuHash);
+    return pdb->WriteStats(pindex->GetBlockHash(), stats);
+}
+
+bool CoinStatsIndex::RevertBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (pindex->pprev) {
+        CBlockUndo blockundo;
+        if (!ReadBlockUndo(block, pindex, blockundo))
+            return false;
+        ApplyBlockHash(muhash, nullptr, block, blockundo, pindex->nHeight, false);
+    }
+
+    // The totals of the parent are stored already
+    if (!pindex->pprev) {
+        stats = CoinStatsEntry();
+        return true;
+    }
+    return pdb->ReadStats(pindex->pprev->GetBlockHash(), stats);
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo)
+{
+    for (const CBlockIndex* pindex = pindexFrom; pindex != pindexTo; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()) || !RevertBlock(block, pindex))
+            return false;
+    }
+    return true;
+}
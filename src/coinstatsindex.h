@@ -0,0 +1,115 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATSINDEX_H
+#define BITCOIN_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <baseindex.h>
+#include <crypto/muhash.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <map>
+#include <memory>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class CScript;
+class Coin;
+class CoinStatsDB;
+class COutPoint;
+
+static const bool DEFAULT_COINSTATSINDEX = false;
+
+/** The stats of the UTXO set after a block */
+struct CoinStatsEntry
+{
+    //! Finalized MuHash3072 of the serialized coins
+    uint256 hashMuHash;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    //! Amount held by the escrow outputs of each sidechain
+    std::map<uint8_t, CAmount> mapEscrow;
+
+    CoinStatsEntry() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashMuHash);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(mapEscrow);
+    }
+};
+
+/** A meaningless metric for the size of a coin in the UTXO set, see
+ * gettxoutsetinfo */
+uint64_t GetBogoSize(const CScript& scriptPubKey);
+
+/** Add a coin to or remove it from the MuHash of the UTXO set. The coin is
+ * serialized as its outpoint, height and coinbase flag, and output. */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/**
+ * Background index of the stats of the UTXO set after every block
+ * (-coinstatsindex), so that gettxoutsetinfo doesn't have to read the whole
+ * chainstate.
+ *
+ * The MuHash of the UTXO set is updated from the outputs of each block and
+ * the coins it spends, read from its undo data, and the totals are carried
+ * over from the stats of the parent block. Stats are stored by block hash
+ * and stay valid when their block is disconnected, only the running MuHash
+ * has to be stepped back.
+ */
+class CoinStatsIndex : public BaseIndex
+{
+public:
+    CoinStatsIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CoinStatsIndex();
+
+    /** Get the stats of the UTXO set after a block, false if it hasn't been
+     * indexed */
+    bool LookupStats(const CBlockIndex* pindex, CoinStatsEntry& entry) const;
+
+protected:
+    bool ReadLocator(CBlockLocator& locator) override;
+
+    /** Save the locator with the running MuHash */
+    bool WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex) override;
+
+    /** Load the stats of the best block, the running MuHash is saved with
+     * its locator */
+    bool Init(const CBlockIndex* pindex) override;
+
+    /** Apply a block to the running MuHash and stats and write its stats */
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo) override;
+
+private:
+    /** Take a block back out of the running MuHash and stats */
+    bool RevertBlock(const CBlock& block, const CBlockIndex* pindex);
+
+    std::unique_ptr<CoinStatsDB> pdb;
+
+    /** Block the saved MuHash is of */
+    uint256 hashMuHash;
+
+    /** MuHash and stats of the UTXO set at the best block, only used by the
+     * sync thread and then by the validation callbacks */
+    MuHash3072 muhash;
+    CoinStatsEntry stats;
+};
+
+/** The global coin stats index, null if -coinstatsindex=0 */
+extern std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+#endif // BITCOIN_COINSTATSINDEX_H
@@ -86,8 +86,10 @@ typedef int32_t ssize_t;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// Whether the socket can be waited on outside of the socket handler, which
+// uses poll() where it is available
 bool static inline IsSelectableSocket(const SOCKET& s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(HAVE_POLL_H)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -9,6 +9,9 @@
 #include <pubkey.h>
 #include <script/standard.h>
 
+#include <algorithm>
+#include <map>
+
 bool CScriptCompressor::IsToKeyID(CKeyID &hash) const
 {
     if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160
@@ -45,7 +48,67 @@ bool CScriptCompressor::IsToPubKey(CPubKey &pubkey) const
     return false;
 }
 
-bool CScriptCompressor::Compress(std::vector<unsigned char> &out) const
+namespace {
+
+/** The scripts with a dictionary index in the compact encoding. The index of
+ * a script is part of the chainstate format: entries may only be appended. */
+struct ScriptDictionary
+{
+    std::vector<CScript> vScript;
+    std::map<CScript, unsigned int> mapIndex;
+    size_t nMaxSize = 0;
+
+    ScriptDictionary()
+    {
+        // The escrow script of every sidechain, whose CTIP each deposit and
+        // withdrawal bundle creates again
+        for (unsigned int nSidechain = 0; nSidechain < 256; nSidechain++) {
+            CScript script;
+            script.resize(2);
+            script[0] = OP_DRIVECHAIN;
+            script[1] = nSidechain;
+            Add(script);
+        }
+    }
+
+    void Add(const CScript& script)
+    {
+        mapIndex.emplace(script, vScript.size());
+        vScript.push_back(script);
+        nMaxSize = std::max<size_t>(nMaxSize, script.size());
+    }
+};
+
+const ScriptDictionary& GetScriptDictionary()
+{
+    static const ScriptDictionary dictionary;
+    return dictionary;
+}
+
+} // namespace
+
+bool CScriptCompressor::IsInDictionary(unsigned int &nIndex) const
+{
+    const ScriptDictionary& dictionary = GetScriptDictionary();
+    if (script.size() > dictionary.nMaxSize)
+        return false;
+    auto it = dictionary.mapIndex.find(script);
+    if (it == dictionary.mapIndex.end())
+        return false;
+    nIndex = it->second;
+    return true;
+}
+
+bool CScriptCompressor::DecompressDictionary(unsigned int nIndex)
+{
+    const ScriptDictionary& dictionary = GetScriptDictionary();
+    if (nIndex >= dictionary.vScript.size())
+        return false;
+    script = dictionary.vScript[nIndex];
+    return true;
+}
+
+bool CScriptCompressor::Compress(std::vector<unsigned char> &out, bool fCompact) const
 {
     CKeyID keyID;
     if (IsToKeyID(keyID)) {
@@ -73,6 +136,20 @@ bool CScriptCompressor::Compress(std::vector<unsigned char> &out) const
             return true;
         }
     }
+    if (!fCompact)
+        return false;
+    if (script.size() == 22 && script[0] == OP_0 && script[1] == 20) {
+        out.resize(21);
+        out[0] = 0x06;
+        memcpy(&out[1], &script[2], 20);
+        return true;
+    }
+    if (script.size() == 34 && script[0] == OP_0 && script[1] == 32) {
+        out.resize(33);
+        out[0] = 0x07;
+        memcpy(&out[1], &script[2], 32);
+        return true;
+    }
     return false;
 }
 
@@ -82,6 +159,10 @@ unsigned int CScriptCompressor::GetSpecialSize(unsigned int nSize) const
         return 20;
     if (nSize == 2 || nSize == 3 || nSize == 4 || nSize == 5)
         return 32;
+    if (nSize == 6)
+        return 20;
+    if (nSize == 7)
+        return 32;
     return 0;
 }
 
@@ -112,6 +193,18 @@ bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigne
         memcpy(&script[2], in.data(), 32);
         script[34] = OP_CHECKSIG;
         return true;
+    case 0x06:
+        script.resize(22);
+        script[0] = OP_0;
+        script[1] = 20;
+        memcpy(&script[2], in.data(), 20);
+        return true;
+    case 0x07:
+        script.resize(34);
+        script[0] = OP_0;
+        script[1] = 32;
+        memcpy(&script[2], in.data(), 32);
+        return true;
     case 0x04:
     case 0x05:
         unsigned char vch[33] = {};
@@ -14,6 +14,10 @@ class CKeyID;
 class CPubKey;
 class CScriptID;
 
+/** Stream version flag for the compact script encoding, which the chainstate
+ *  uses from coin format 2 on */
+static const int SERIALIZE_SCRIPT_COMPACT = 0x10000000;
+
 /** Compact serializer for scripts.
  *
  *  It detects common cases and encodes them much more efficiently.
@@ -24,6 +28,14 @@ class CScriptID;
  *
  *  Other scripts up to 121 bytes require 1 byte + script length. Above
  *  that, scripts up to 16505 bytes require 2 bytes + script length.
+ *
+ *  With SERIALIZE_SCRIPT_COMPACT in the stream version there are 3 more:
+ *  * Witness v0 key hash (encoded as 21 bytes)
+ *  * Witness v0 script hash (encoded as 33 bytes)
+ *  * A script of the dictionary, which starts with the escrow script of
+ *    every sidechain (encoded as 1 byte + the VARINT of its index)
+ *
+ *  and other scripts up to 118 bytes require 1 byte + script length.
  */
 class CScriptCompressor
 {
@@ -35,6 +47,10 @@ private:
      * and nHeight of the enclosing transaction.
      */
     static const unsigned int nSpecialScripts = 6;
+    //! Special scripts of the compact encoding
+    static const unsigned int nSpecialScriptsCompact = 9;
+    //! Special script of the compact encoding followed by a dictionary index
+    static const unsigned int SCRIPT_DICTIONARY = 8;
 
     CScript &script;
 protected:
@@ -48,36 +64,56 @@ protected:
     bool IsToKeyID(CKeyID &hash) const;
     bool IsToScriptID(CScriptID &hash) const;
     bool IsToPubKey(CPubKey &pubkey) const;
+    //! The index of the script in the dictionary of the compact encoding
+    bool IsInDictionary(unsigned int &nIndex) const;
 
-    bool Compress(std::vector<unsigned char> &out) const;
+    bool Compress(std::vector<unsigned char> &out, bool fCompact) const;
     unsigned int GetSpecialSize(unsigned int nSize) const;
     bool Decompress(unsigned int nSize, const std::vector<unsigned char> &out);
+    bool DecompressDictionary(unsigned int nIndex);
 public:
     explicit CScriptCompressor(CScript &scriptIn) : script(scriptIn) { }
 
     template<typename Stream>
     void Serialize(Stream &s) const {
+        const bool fCompact = s.GetVersion() & SERIALIZE_SCRIPT_COMPACT;
         std::vector<unsigned char> compr;
-        if (Compress(compr)) {
+        if (Compress(compr, fCompact)) {
             s << CFlatData(compr);
             return;
         }
-        unsigned int nSize = script.size() + nSpecialScripts;
+        unsigned int nIndex;
+        if (fCompact && IsInDictionary(nIndex)) {
+            unsigned int nSize = SCRIPT_DICTIONARY;
+            s << VARINT(nSize);
+            s << VARINT(nIndex);
+            return;
+        }
+        unsigned int nSize = script.size() + (fCompact ? nSpecialScriptsCompact : nSpecialScripts);
         s << VARINT(nSize);
         s << CFlatData(script);
     }
 
     template<typename Stream>
     void Unserialize(Stream &s) {
+        const bool fCompact = s.GetVersion() & SERIALIZE_SCRIPT_COMPACT;
+        const unsigned int nSpecial = fCompact ? nSpecialScriptsCompact : nSpecialScripts;
         unsigned int nSize = 0;
         s >> VARINT(nSize);
-        if (nSize < nSpecialScripts) {
+        if (nSize == SCRIPT_DICTIONARY && fCompact) {
+            unsigned int nIndex = 0;
+            s >> VARINT(nIndex);
+            if (!DecompressDictionary(nIndex))
+                throw std::ios_base::failure("CScriptCompressor: unknown dictionary script");
+            return;
+        }
+        if (nSize < nSpecial) {
             std::vector<unsigned char> vch(GetSpecialSize(nSize), 0x00);
             s >> REF(CFlatData(vch));
             Decompress(nSize, vch);
             return;
         }
-        nSize -= nSpecialScripts;
+        nSize -= nSpecial;
         if (nSize > MAX_SCRIPT_SIZE) {
             // Overly long script, replace with a short invalid one
             script << OP_RETURN;
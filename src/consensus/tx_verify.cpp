@@ -11,6 +11,8 @@
 #include "validation.h"
 #include <arith_uint256.h>
 
+#include <algorithm>
+
 // TODO remove the following dependencies
 #include "chain.h"
 #include "coins.h"
@@ -158,6 +160,31 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
     return nSigOps;
 }
 
+/** Inputs up to which duplicates are found by comparing every pair of
+ * inputs, bigger transactions sort a copy of their outpoints */
+static const size_t DUPLICATE_INPUTS_PAIRWISE_MAX = 16;
+
+static bool HasDuplicateInputs(const CTransaction& tx)
+{
+    const size_t nInputs = tx.vin.size();
+    if (nInputs <= DUPLICATE_INPUTS_PAIRWISE_MAX) {
+        for (size_t i = 1; i < nInputs; i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (tx.vin[i].prevout == tx.vin[j].prevout)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<COutPoint> vOutPoint;
+    vOutPoint.reserve(nInputs);
+    for (const auto& txin : tx.vin)
+        vOutPoint.push_back(txin.prevout);
+    std::sort(vOutPoint.begin(), vOutPoint.end());
+    return std::adjacent_find(vOutPoint.begin(), vOutPoint.end()) != vOutPoint.end();
+}
+
 bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fCheckDuplicateInputs)
 {
     // Basic checks that don't depend on any context
@@ -196,13 +223,8 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
     }
 
     // Check for duplicate inputs - note that this check is slow so we skip it in CheckBlock
-    if (fCheckDuplicateInputs) {
-        std::set<COutPoint> vInOutPoints;
-        for (const auto& txin : tx.vin)
-        {
-            if (!vInOutPoints.insert(txin.prevout).second)
-                return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
-        }
+    if (fCheckDuplicateInputs && HasDuplicateInputs(tx)) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
     }
 
     if (tx.IsCoinBase())
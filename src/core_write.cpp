@@ -125,7 +125,7 @@ std::string EncodeHexTx(const CTransaction& tx, const int serializeFlags)
 {
     CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | serializeFlags);
     ssTx << tx;
-    return HexStr(ssTx.begin(), ssTx.end());
+    return HexStr(ssTx.data(), ssTx.data() + ssTx.size());
 }
 
 void ScriptPubKeyToUniv(const CScript& scriptPubKey,
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/common.h>
+
+#ifdef ENABLE_SHANI
+
+#include <crypto/sha256_d64.h>
+
+#include <immintrin.h>
+#include <stdint.h>
+
+namespace
+{
+alignas(16) const uint8_t MASK[16] = {0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x05, 0x04, 0x0b, 0x0a, 0x09, 0x08, 0x0f, 0x0e, 0x0d, 0x0c};
+
+/** Four rounds, msg is the round constants plus the message words. The state
+ * is kept as (a, b, e, f) in s0 and (c, d, g, h) in s1, as the instructions
+ * want it. */
+void inline QuadRound(__m128i& s0, __m128i& s1, __m128i msg)
+{
+    s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+__m128i inline KW(const uint32_t* k) { return _mm_loadu_si128((const __m128i*)k); }
+
+/** Message words 4 * J .. 4 * J + 3, from the previous 16 in m, in place. */
+template <int J>
+void inline ShiftMessage(__m128i* m)
+{
+    m[J & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m[J & 3], m[(J + 1) & 3]), _mm_alignr_epi8(m[(J + 3) & 3], m[(J + 2) & 3], 4)), m[(J + 3) & 3]);
+}
+
+/** Rounds 4 * J .. 4 * J + 3 of L interleaved states. */
+template <int J, int L>
+void inline Step(__m128i (&s)[L][2], __m128i (&m)[L][4])
+{
+    const __m128i k = KW(sha256d64::K + 4 * J);
+    for (int l = 0; l < L; ++l) {
+        if (J >= 4) ShiftMessage<J>(m[l]);
+        QuadRound(s[l][0], s[l][1], _mm_add_epi32(m[l][J & 3], k));
+    }
+}
+
+/** 64 rounds of L interleaved states, on the first 16 message words in m. */
+template <int L>
+void inline Compress(__m128i (&s)[L][2], __m128i (&m)[L][4])
+{
+    Step<0>(s, m);
+    Step<1>(s, m);
+    Step<2>(s, m);
+    Step<3>(s, m);
+    Step<4>(s, m);
+    Step<5>(s, m);
+    Step<6>(s, m);
+    Step<7>(s, m);
+    Step<8>(s, m);
+    Step<9>(s, m);
+    Step<10>(s, m);
+    Step<11>(s, m);
+    Step<12>(s, m);
+    Step<13>(s, m);
+    Step<14>(s, m);
+    Step<15>(s, m);
+}
+
+/** From (a, b, c, d), (e, f, g, h) to the layout QuadRound wants. */
+void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** Back to (a, b, c, d), (e, f, g, h). */
+void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+__m128i inline Load(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), _mm_load_si128((const __m128i*)MASK));
+}
+
+void inline Save(unsigned char* out, __m128i s)
+{
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, _mm_load_si128((const __m128i*)MASK)));
+}
+
+} // namespace
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i state[1][2], m[1][4];
+    state[0][0] = _mm_loadu_si128((const __m128i*)s);
+    state[0][1] = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(state[0][0], state[0][1]);
+
+    while (blocks--) {
+        const __m128i s0 = state[0][0], s1 = state[0][1];
+        for (int i = 0; i < 4; ++i) m[0][i] = Load(chunk + 16 * i);
+        Compress(state, m);
+        state[0][0] = _mm_add_epi32(state[0][0], s0);
+        state[0][1] = _mm_add_epi32(state[0][1], s1);
+        chunk += 64;
+    }
+
+    Unshuffle(state[0][0], state[0][1]);
+    _mm_storeu_si128((__m128i*)s, state[0][0]);
+    _mm_storeu_si128((__m128i*)(s + 4), state[0][1]);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i init0 = _mm_loadu_si128((const __m128i*)sha256d64::INIT);
+    __m128i init1 = _mm_loadu_si128((const __m128i*)(sha256d64::INIT + 4));
+    Shuffle(init0, init1);
+
+    __m128i s[2][2], so[2][2], m[2][4];
+
+    // The 64-byte inputs
+    for (int l = 0; l < 2; ++l) {
+        s[l][0] = init0;
+        s[l][1] = init1;
+        for (int i = 0; i < 4; ++i) m[l][i] = Load(in + 64 * l + 16 * i);
+    }
+    Compress(s, m);
+    for (int l = 0; l < 2; ++l) {
+        s[l][0] = so[l][0] = _mm_add_epi32(s[l][0], init0);
+        s[l][1] = so[l][1] = _mm_add_epi32(s[l][1], init1);
+    }
+
+    // Their padding, whose schedule is known in advance
+    for (int j = 0; j < 16; ++j) {
+        const __m128i k = KW(sha256d64::PADDING_KW + 4 * j);
+        QuadRound(s[0][0], s[0][1], k);
+        QuadRound(s[1][0], s[1][1], k);
+    }
+
+    // The second hash, of the 32-byte first hash and its padding
+    for (int l = 0; l < 2; ++l) {
+        m[l][0] = _mm_add_epi32(s[l][0], so[l][0]);
+        m[l][1] = _mm_add_epi32(s[l][1], so[l][1]);
+        Unshuffle(m[l][0], m[l][1]);
+        m[l][2] = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+        m[l][3] = _mm_set_epi32(256, 0, 0, 0);
+        s[l][0] = init0;
+        s[l][1] = init1;
+    }
+    Compress(s, m);
+    for (int l = 0; l < 2; ++l) {
+        s[l][0] = _mm_add_epi32(s[l][0], init0);
+        s[l][1] = _mm_add_epi32(s[l][1], init1);
+        Unshuffle(s[l][0], s[l][1]);
+        Save(out + 32 * l, s[l][0]);
+        Save(out + 32 * l + 16, s[l][1]);
+    }
+}
+} // namespace sha256d64_shani
+
+#endif // ENABLE_SHANI
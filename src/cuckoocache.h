@@ -285,12 +285,15 @@ private:
      * scan succeeds, the epochs are aged and old elements are allow_erased. The
      * cheap heuristic is reset to retrigger after the worst case growth of the
      * current epoch's elements would exceed the epoch_size.
+     *
+     * @returns the number of elements of the old epoch that were aged out
+     * without having been erased
      */
-    void epoch_check()
+    uint32_t epoch_check()
     {
         if (epoch_heuristic_counter != 0) {
             --epoch_heuristic_counter;
-            return;
+            return 0;
         }
         // count the number of elements from the latest epoch which
         // have not been erased.
@@ -302,12 +305,15 @@ private:
         // epoch size, then allow_erase on all elements in the old epoch (marked
         // false) and move all elements in the current epoch to the old epoch
         // but do not call allow_erase on their indices.
+        uint32_t aged_count = 0;
         if (epoch_unused_count >= epoch_size) {
             for (uint32_t i = 0; i < size; ++i)
-                if (epoch_flags[i])
+                if (epoch_flags[i]) {
                     epoch_flags[i] = false;
-                else
+                } else {
+                    aged_count += !collection_flags.bit_is_set(i);
                     allow_erase(i);
+                }
             epoch_heuristic_counter = epoch_size;
         } else
             // reset the epoch_heuristic_counter to next do a scan when worst
@@ -318,6 +324,7 @@ private:
             // < epoch_size` in this branch
             epoch_heuristic_counter = std::max(1u, std::max(epoch_size / 16,
                         epoch_size - epoch_unused_count));
+        return aged_count;
     }
 
 public:
@@ -388,10 +395,12 @@ public:
      * now in the table, one previously inserted element is evicted from the
      * table, the entry attempted to be inserted is evicted.
      *
+     * @returns the number of elements that had not been erased and were
+     * evicted or aged out of the oldest epoch by this insert
      */
-    inline void insert(Element e)
+    inline uint32_t insert(Element e)
     {
-        epoch_check();
+        uint32_t evicted_count = epoch_check();
         uint32_t last_loc = invalid();
         bool last_epoch = true;
         std::array<uint32_t, 8> locs = compute_hashes(e);
@@ -401,7 +410,7 @@ public:
             if (table[loc] == e) {
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return evicted_count;
             }
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
@@ -411,7 +420,7 @@ public:
                 table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return evicted_count;
             }
             /** Swap with the element at the location that was
             * not the last one looked at. Example:
@@ -437,6 +446,7 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        return evicted_count + 1;
     }
 
     /* contains iterates through the hash locations for a given element
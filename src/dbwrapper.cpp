@@ -12,6 +12,12 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <mutex>
+#include <set>
+
+//! Open databases, for ForEachDB
+static std::mutex g_dbs_mutex;
+static std::set<const CDBWrapper*> g_dbs;
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -71,12 +77,14 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile& profile)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = leveldb::NewLRUCache(nCacheSize * profile.nBlockCachePercent / 100);
+    options.write_buffer_size = nCacheSize * profile.nWriteBufferPercent / 100; // up to two write buffers may be held in memory simultaneously
+    options.block_size = profile.nBlockSize;
+    if (profile.nBloomBitsPerKey > 0)
+        options.filter_policy = leveldb::NewBloomFilterPolicy(profile.nBloomBitsPerKey);
     options.compression = leveldb::kNoCompression;
     options.max_open_files = 64;
     options.info_log = new CBitcoinLevelDBLogger();
@@ -88,14 +96,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSizeIn, bool fMemory, bool fWipe, bool obfuscate, const CDBProfile& profileIn)
+    : strName(path.filename().string()), profile(profileIn), nCacheSize(nCacheSizeIn)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -137,10 +146,18 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    std::lock_guard<std::mutex> lock(g_dbs_mutex);
+    g_dbs.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        std::lock_guard<std::mutex> lock(g_dbs_mutex);
+        g_dbs.erase(this);
+    }
+
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -153,6 +170,36 @@ CDBWrapper::~CDBWrapper()
     options.env = nullptr;
 }
 
+std::string CDBWrapper::GetProperty(const std::string& strProperty) const
+{
+    std::string strValue;
+    if (!pdb->GetProperty(strProperty, &strValue))
+        return std::string();
+    return strValue;
+}
+
+uint64_t CDBWrapper::EstimateTotalSize() const
+{
+    // Keys start with a type byte, none of them is 0xff
+    const std::string strLimit(DBWRAPPER_PREALLOC_KEY_SIZE, '\xff');
+    const leveldb::Range range{leveldb::Slice(), leveldb::Slice(strLimit)};
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CDBWrapper::CompactAll() const
+{
+    pdb->CompactRange(nullptr, nullptr);
+}
+
+void ForEachDB(const std::function<void(const CDBWrapper&)>& f)
+{
+    std::lock_guard<std::mutex> lock(g_dbs_mutex);
+    for (const CDBWrapper* db : g_dbs)
+        f(*db);
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
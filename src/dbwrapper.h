@@ -16,9 +16,39 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <functional>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+/** Default for -dbcompactinterval, in hours (0 = never) */
+static const int64_t DEFAULT_DB_COMPACT_INTERVAL = 0;
+
+/** LevelDB tuning for the way a database is used */
+struct CDBProfile
+{
+    const char* name;
+    //! Shares of the cache size given to the block cache and to each of the
+    //! (up to two) write buffers, in percent
+    int nBlockCachePercent;
+    int nWriteBufferPercent;
+    //! Approximate size of the data blocks the tables are read in
+    size_t nBlockSize;
+    //! Bits per key of the bloom filter, 0 for none
+    int nBloomBitsPerKey;
+};
+
+//! What every database used before the profiles
+static const CDBProfile DB_PROFILE_DEFAULT = {"default", 50, 25, 4 * 1024, 10};
+//! Random lookups of single keys (chainstate, sidechain block data): small
+//! blocks so that a lookup reads little, more of the cache for blocks
+static const CDBProfile DB_PROFILE_LOOKUP = {"lookup", 60, 20, 4 * 1024, 10};
+//! Iterated in key order (block index): larger blocks, fewer reads
+static const CDBProfile DB_PROFILE_SCAN = {"scan", 50, 25, 16 * 1024, 10};
+//! Written once per block and rarely read back (OP_RETURN data): larger
+//! write buffers, so that fewer small tables get flushed and compacted
+static const CDBProfile DB_PROFILE_APPEND = {"append", 20, 40, 16 * 1024, 10};
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -221,6 +251,12 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! last component of the path, to tell the databases apart
+    std::string strName;
+
+    const CDBProfile& profile;
+    size_t nCacheSize;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -229,10 +265,24 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     LevelDB tuning for the way the database is used.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBProfile& profile = DB_PROFILE_DEFAULT);
     ~CDBWrapper();
 
+    const std::string& GetName() const { return strName; }
+    const CDBProfile& GetProfile() const { return profile; }
+    size_t GetCacheSize() const { return nCacheSize; }
+
+    /** Value of a LevelDB property (leveldb.stats, ...), empty if unknown */
+    std::string GetProperty(const std::string& strProperty) const;
+
+    /** Approximate size of all the data on disk */
+    uint64_t EstimateTotalSize() const;
+
+    /** Compact the whole database */
+    void CompactAll() const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -285,6 +335,54 @@ public:
         return true;
     }
 
+    /**
+     * Read the values of many keys from a single snapshot of the database.
+     * vValue and vFound are resized to the number of keys, the values of
+     * keys that are missing or fail to deserialize are left default
+     * constructed. Returns the number of values found.
+     */
+    template <typename K, typename V>
+    size_t ReadMany(const std::vector<K>& vKey, std::vector<V>& vValue, std::vector<bool>& vFound) const
+    {
+        vValue.assign(vKey.size(), V());
+        vFound.assign(vKey.size(), false);
+
+        leveldb::ReadOptions snapshotoptions = readoptions;
+        snapshotoptions.snapshot = pdb->GetSnapshot();
+
+        size_t nFound = 0;
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        std::string strValue;
+        for (size_t i = 0; i < vKey.size(); i++) {
+            ssKey.clear();
+            ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+            ssKey << vKey[i];
+            leveldb::Slice slKey(ssKey.data(), ssKey.size());
+
+            leveldb::Status status = pdb->Get(snapshotoptions, slKey, &strValue);
+            if (!status.ok()) {
+                if (status.IsNotFound())
+                    continue;
+                pdb->ReleaseSnapshot(snapshotoptions.snapshot);
+                LogPrintf("LevelDB read failure: %s\n", status.ToString());
+                dbwrapper_private::HandleError(status);
+            }
+            try {
+                CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue.Xor(obfuscate_key);
+                ssValue >> vValue[i];
+            } catch (const std::exception&) {
+                vValue[i] = V();
+                continue;
+            }
+            vFound[i] = true;
+            nFound++;
+        }
+
+        pdb->ReleaseSnapshot(snapshotoptions.snapshot);
+        return nFound;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -378,4 +476,7 @@ public:
 
 };
 
+/** Call f on every open database. Databases can't be closed while f runs. */
+void ForEachDB(const std::function<void(const CDBWrapper&)>& f);
+
 #endif // BITCOIN_DBWRAPPER_H
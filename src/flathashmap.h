@@ -0,0 +1,446 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATHASHMAP_H
+#define BITCOIN_FLATHASHMAP_H
+
+#include <crypto/common.h>
+#include <memusage.h>
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map with open addressing, a drop-in replacement for the subset of
+ * std::unordered_map used by the coins cache.
+ *
+ * The entries are stored in chunks of up to a few thousand entries instead of
+ * one allocation per entry, and are looked up through a flat index of 8 byte
+ * slots with linear probing. Each slot holds the number of its entry and 32
+ * bits of the key's hash, which is both used to pick the slot and compared
+ * before the key is, so a lookup usually touches one cache line of the index
+ * and the entry itself.
+ *
+ * Entries never move: references and iterators stay valid until the entry
+ * is erased, also when the index grows. Erased entries are reused by later
+ * insertions. Iteration walks the chunks, so its order is unrelated to the
+ * keys.
+ *
+ * The chunks and the index come from Alloc, rebound to their types.
+ */
+template <typename K, typename V, typename Hash, typename Alloc = std::allocator<std::pair<const K, V>>>
+class flathashmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private:
+    //! Number of entries in the first chunk, each following chunk is twice
+    //! as large up to MAX_CHUNK_SIZE. Capping the size bounds the number of
+    //! entries allocated but not used yet in large maps.
+    static const uint32_t FIRST_CHUNK_SIZE = 16;
+    static const uint32_t MAX_CHUNK_SIZE = 4096;
+    //! Number of chunks smaller than MAX_CHUNK_SIZE and their total size
+    static const uint32_t DOUBLING_CHUNKS = 8;
+    static const uint32_t DOUBLING_NODES = FIRST_CHUNK_SIZE * ((1U << DOUBLING_CHUNKS) - 1);
+    //! nSlot of an entry that isn't in use
+    static const uint32_t NODE_FREE = 0xffffffff;
+    //! nNode of an index slot that has never been used
+    static const uint32_t SLOT_EMPTY = 0;
+    //! nNode of an index slot whose entry was erased
+    static const uint32_t SLOT_DELETED = 0xffffffff;
+
+    struct Node {
+        typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type data;
+        //! Position in the index, NODE_FREE if the entry isn't in use
+        uint32_t nSlot;
+
+        value_type& value() { return *reinterpret_cast<value_type*>(&data); }
+        const value_type& value() const { return *reinterpret_cast<const value_type*>(&data); }
+    };
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+
+    struct Slot {
+        //! Entry number + 1, or SLOT_EMPTY / SLOT_DELETED
+        uint32_t nNode;
+        //! Part of the key's hash, determines the preferred position
+        uint32_t nHash;
+    };
+    typedef std::vector<Slot, typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>> SlotVector;
+
+    template <bool fConst>
+    class iterator_base
+    {
+        friend class flathashmap;
+        template <bool> friend class iterator_base;
+        typedef typename std::conditional<fConst, const flathashmap, flathashmap>::type map_type;
+        typedef typename std::conditional<fConst, const Node, Node>::type node_type;
+
+        map_type* pmap;
+        uint32_t nNode;
+        node_type* pnode;
+
+        iterator_base(map_type* pmapIn, uint32_t nNodeIn) : pmap(pmapIn), nNode(nNodeIn)
+        {
+            pnode = nNode < pmap->nNodes ? &pmap->GetNode(nNode) : nullptr;
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flathashmap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<fConst, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<fConst, const value_type&, value_type&>::type reference;
+
+        iterator_base() : pmap(nullptr), nNode(0), pnode(nullptr) {}
+        // Allows converting an iterator to a const_iterator
+        iterator_base(const iterator_base<false>& it) : pmap(it.pmap), nNode(it.nNode), pnode(it.pnode) {}
+
+        reference operator*() const { return pnode->value(); }
+        pointer operator->() const { return &pnode->value(); }
+
+        iterator_base& operator++()
+        {
+            *this = iterator_base(pmap, pmap->NextNode(nNode + 1));
+            return *this;
+        }
+        iterator_base operator++(int)
+        {
+            iterator_base ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const iterator_base<true>& other) const { return nNode == other.nNode; }
+        bool operator!=(const iterator_base<true>& other) const { return nNode != other.nNode; }
+    };
+
+public:
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    flathashmap() : nNodes(0), nCapacity(0), nSize(0), nDeleted(0) {}
+    ~flathashmap() { clear(); }
+
+    //! Leaves other empty
+    flathashmap(flathashmap&& other) : nNodes(0), nCapacity(0), nSize(0), nDeleted(0), hasher(other.hasher)
+    {
+        vChunk.swap(other.vChunk);
+        vSlot.swap(other.vSlot);
+        vFree.swap(other.vFree);
+        std::swap(nNodes, other.nNodes);
+        std::swap(nCapacity, other.nCapacity);
+        std::swap(nSize, other.nSize);
+        std::swap(nDeleted, other.nDeleted);
+    }
+
+    flathashmap(const flathashmap&) = delete;
+    flathashmap& operator=(const flathashmap&) = delete;
+
+    iterator begin() { return iterator(this, NextNode(0)); }
+    const_iterator begin() const { return const_iterator(this, NextNode(0)); }
+    iterator end() { return iterator(this, nNodes); }
+    const_iterator end() const { return const_iterator(this, nNodes); }
+
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    size_type bucket_count() const { return vSlot.size(); }
+
+    /** Grow the index once so that n entries fit without rebuilding it */
+    void reserve(size_type n)
+    {
+        if (((uint64_t)n + nDeleted) * 8 <= (uint64_t)vSlot.size() * 7)
+            return;
+        size_t nSlots = std::max<size_t>(FIRST_CHUNK_SIZE, vSlot.size());
+        while ((uint64_t)n * 2 > nSlots)
+            nSlots *= 2;
+        Rehash(nSlots);
+    }
+
+    iterator find(const K& key)
+    {
+        uint32_t nSlot;
+        if (!FindSlot(key, HashKey(key), nSlot))
+            return end();
+        return iterator(this, vSlot[nSlot].nNode - 1);
+    }
+
+    const_iterator find(const K& key) const
+    {
+        uint32_t nSlot;
+        if (!FindSlot(key, HashKey(key), nSlot))
+            return end();
+        return const_iterator(this, vSlot[nSlot].nNode - 1);
+    }
+
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    /** Construct the key and the value from separate argument tuples, as
+     * std::unordered_map::emplace(std::piecewise_construct, ...) does. */
+    template <typename KArg, typename... VArgs>
+    std::pair<iterator, bool> emplace(std::piecewise_construct_t, std::tuple<KArg> keyArgs, std::tuple<VArgs...> valueArgs)
+    {
+        const K& key = std::get<0>(keyArgs);
+        return Insert(key, std::piecewise_construct, std::forward_as_tuple(key), std::move(valueArgs));
+    }
+
+    template <typename VArg>
+    std::pair<iterator, bool> emplace(const K& key, VArg&& value)
+    {
+        return Insert(key, key, std::forward<VArg>(value));
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        return Insert(value.first, value);
+    }
+
+    V& operator[](const K& key)
+    {
+        return Insert(key, std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
+    }
+
+    /** Erase an entry, returns the entry that follows it */
+    iterator erase(const_iterator it)
+    {
+        const uint32_t nNode = it.nNode;
+        Node& node = GetNode(nNode);
+        const uint32_t nSlot = node.nSlot;
+
+        // A slot followed by an empty one isn't part of any other key's
+        // probe sequence, so it doesn't need to be marked as deleted
+        if (vSlot[(nSlot + 1) & (vSlot.size() - 1)].nNode == SLOT_EMPTY) {
+            vSlot[nSlot].nNode = SLOT_EMPTY;
+        } else {
+            vSlot[nSlot].nNode = SLOT_DELETED;
+            nDeleted++;
+        }
+
+        node.value().~value_type();
+        node.nSlot = NODE_FREE;
+        vFree.push_back(nNode);
+        nSize--;
+
+        return iterator(this, NextNode(nNode + 1));
+    }
+
+    size_type erase(const K& key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    /** Remove all entries and release the memory */
+    void clear()
+    {
+        for (uint32_t n = 0; n < nNodes; n++) {
+            Node& node = GetNode(n);
+            if (node.nSlot != NODE_FREE)
+                node.value().~value_type();
+        }
+        for (size_t i = 0; i < vChunk.size(); i++)
+            nodeAlloc.deallocate(vChunk[i], ChunkSize(i));
+        std::vector<Node*>().swap(vChunk);
+        SlotVector().swap(vSlot);
+        std::vector<uint32_t>().swap(vFree);
+        nNodes = 0;
+        nCapacity = 0;
+        nSize = 0;
+        nDeleted = 0;
+    }
+
+    /** Memory allocated by the map, excluding the entries' own allocations */
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = memusage::MallocUsage(vChunk.capacity() * sizeof(Node*));
+        for (size_t i = 0; i < vChunk.size(); i++)
+            nUsage += memusage::MallocUsage(ChunkSize(i) * sizeof(Node));
+        nUsage += memusage::MallocUsage(vSlot.capacity() * sizeof(Slot));
+        nUsage += memusage::MallocUsage(vFree.capacity() * sizeof(uint32_t));
+        return nUsage;
+    }
+
+private:
+    std::vector<Node*> vChunk;
+    SlotVector vSlot;
+    std::vector<uint32_t> vFree;
+
+    //! Number of entries handed out from the chunks, including free ones
+    uint32_t nNodes;
+    //! Number of entries in the allocated chunks
+    uint32_t nCapacity;
+    //! Number of entries in use
+    uint32_t nSize;
+    //! Number of index slots marked SLOT_DELETED
+    uint32_t nDeleted;
+
+    Hash hasher;
+    NodeAlloc nodeAlloc;
+
+    uint32_t HashKey(const K& key) const
+    {
+        // Mix every bit of the hash into the upper half and use that. The
+        // upper bits of a weak hash alone differ too little, and where
+        // size_t is 32 bits they are all zero.
+        return ((uint64_t)hasher(key) * 0x9E3779B97F4A7C15ULL) >> 32;
+    }
+
+    //! Chunk number and offset of entry n
+    static std::pair<uint32_t, uint32_t> NodePos(uint32_t n)
+    {
+        if (n >= DOUBLING_NODES)
+            return std::make_pair(DOUBLING_CHUNKS + (n - DOUBLING_NODES) / MAX_CHUNK_SIZE, (n - DOUBLING_NODES) % MAX_CHUNK_SIZE);
+        // Chunk c starts at entry FIRST_CHUNK_SIZE * (2^c - 1)
+        const uint32_t c = CountBits(n / FIRST_CHUNK_SIZE + 1) - 1;
+        return std::make_pair(c, n - FIRST_CHUNK_SIZE * ((1U << c) - 1));
+    }
+
+    static uint32_t ChunkSize(size_t c)
+    {
+        return c < DOUBLING_CHUNKS ? FIRST_CHUNK_SIZE << c : MAX_CHUNK_SIZE;
+    }
+
+    Node& GetNode(uint32_t n)
+    {
+        const std::pair<uint32_t, uint32_t> pos = NodePos(n);
+        return vChunk[pos.first][pos.second];
+    }
+
+    const Node& GetNode(uint32_t n) const
+    {
+        const std::pair<uint32_t, uint32_t> pos = NodePos(n);
+        return vChunk[pos.first][pos.second];
+    }
+
+    /** Return the first entry in use starting at n, or nNodes */
+    uint32_t NextNode(uint32_t n) const
+    {
+        while (n < nNodes && GetNode(n).nSlot == NODE_FREE)
+            n++;
+        return n;
+    }
+
+    bool FindSlot(const K& key, uint32_t nHash, uint32_t& nSlotRet) const
+    {
+        if (vSlot.empty())
+            return false;
+
+        const uint32_t nMask = vSlot.size() - 1;
+        for (uint32_t nSlot = nHash & nMask; ; nSlot = (nSlot + 1) & nMask) {
+            const Slot& slot = vSlot[nSlot];
+            if (slot.nNode == SLOT_EMPTY)
+                return false;
+            if (slot.nNode != SLOT_DELETED && slot.nHash == nHash && GetNode(slot.nNode - 1).value().first == key) {
+                nSlotRet = nSlot;
+                return true;
+            }
+        }
+    }
+
+    /** Put an entry on the first unused slot of its probe sequence */
+    uint32_t PlaceNode(uint32_t nNode, uint32_t nHash)
+    {
+        const uint32_t nMask = vSlot.size() - 1;
+        uint32_t nSlot = nHash & nMask;
+        while (vSlot[nSlot].nNode != SLOT_EMPTY && vSlot[nSlot].nNode != SLOT_DELETED)
+            nSlot = (nSlot + 1) & nMask;
+
+        if (vSlot[nSlot].nNode == SLOT_DELETED)
+            nDeleted--;
+        vSlot[nSlot].nNode = nNode + 1;
+        vSlot[nSlot].nHash = nHash;
+        return nSlot;
+    }
+
+    /** Rebuild the index, dropping the deleted slots */
+    void Rehash(size_t nSlots)
+    {
+        SlotVector vOld(nSlots, Slot{SLOT_EMPTY, 0});
+        vOld.swap(vSlot);
+        nDeleted = 0;
+        for (const Slot& slot : vOld) {
+            if (slot.nNode != SLOT_EMPTY && slot.nNode != SLOT_DELETED)
+                GetNode(slot.nNode - 1).nSlot = PlaceNode(slot.nNode - 1, slot.nHash);
+        }
+    }
+
+    uint32_t AllocateNode()
+    {
+        if (!vFree.empty()) {
+            const uint32_t nNode = vFree.back();
+            vFree.pop_back();
+            return nNode;
+        }
+        if (nNodes == nCapacity) {
+            const uint32_t nChunkSize = ChunkSize(vChunk.size());
+            Node* pChunk = nodeAlloc.allocate(nChunkSize);
+            try {
+                vChunk.push_back(pChunk);
+            } catch (...) {
+                nodeAlloc.deallocate(pChunk, nChunkSize);
+                throw;
+            }
+            for (uint32_t i = 0; i < nChunkSize; i++)
+                new (&pChunk[i]) Node{{}, NODE_FREE};
+            nCapacity += nChunkSize;
+        }
+        return nNodes++;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> Insert(const K& key, Args&&... args)
+    {
+        const uint32_t nHash = HashKey(key);
+        uint32_t nSlot;
+        if (FindSlot(key, nHash, nSlot))
+            return std::make_pair(iterator(this, vSlot[nSlot].nNode - 1), false);
+
+        // Keep at least one in eight slots empty, so that probe sequences
+        // stay short. When the index is rebuilt it is at most half full.
+        if (((uint64_t)nSize + nDeleted + 1) * 8 > (uint64_t)vSlot.size() * 7) {
+            size_t nSlots = std::max<size_t>(FIRST_CHUNK_SIZE, vSlot.size());
+            while (((uint64_t)nSize + 1) * 2 > nSlots)
+                nSlots *= 2;
+            Rehash(nSlots);
+        }
+
+        const uint32_t nNode = AllocateNode();
+        Node& node = GetNode(nNode);
+        try {
+            new (&node.data) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            vFree.push_back(nNode);
+            throw;
+        }
+        node.nSlot = PlaceNode(nNode, nHash);
+        nSize++;
+        return std::make_pair(iterator(this, nNode), true);
+    }
+};
+
+namespace memusage {
+
+template <typename K, typename V, typename H, typename A>
+static inline size_t DynamicUsage(const flathashmap<K, V, H, A>& m)
+{
+    return m.DynamicMemoryUsage();
+}
+
+} // namespace memusage
+
+#endif // BITCOIN_FLATHASHMAP_H
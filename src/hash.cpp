@@ -6,24 +6,26 @@
 #include <crypto/common.h>
 #include <crypto/hmac_sha512.h>
 
+#include <chrono>
+
 
 inline uint32_t ROTL32(uint32_t x, int8_t r)
 {
     return (x << r) | (x >> (32 - r));
 }
 
-unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
+unsigned int MurmurHash3(unsigned int nHashSeed, const unsigned char* pDataToHash, size_t nSize)
 {
     // The following is MurmurHash3 (x86_32), see http://code.google.com/p/smhasher/source/browse/trunk/MurmurHash3.cpp
     uint32_t h1 = nHashSeed;
     const uint32_t c1 = 0xcc9e2d51;
     const uint32_t c2 = 0x1b873593;
 
-    const int nblocks = vDataToHash.size() / 4;
+    const int nblocks = nSize / 4;
 
     //----------
     // body
-    const uint8_t* blocks = vDataToHash.data();
+    const uint8_t* blocks = pDataToHash;
 
     for (int i = 0; i < nblocks; ++i) {
         uint32_t k1 = ReadLE32(blocks + i*4);
@@ -39,11 +41,11 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
     //----------
     // tail
-    const uint8_t* tail = vDataToHash.data() + nblocks * 4;
+    const uint8_t* tail = pDataToHash + nblocks * 4;
 
     uint32_t k1 = 0;
 
-    switch (vDataToHash.size() & 3) {
+    switch (nSize & 3) {
         case 3:
             k1 ^= tail[2] << 16;
         case 2:
@@ -58,7 +60,7 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
     //----------
     // finalization
-    h1 ^= vDataToHash.size();
+    h1 ^= nSize;
     h1 ^= h1 >> 16;
     h1 *= 0x85ebca6b;
     h1 ^= h1 >> 13;
@@ -68,6 +70,11 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
+{
+    return MurmurHash3(nHashSeed, vDataToHash.data(), vDataToHash.size());
+}
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
@@ -245,3 +252,218 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+uint256 skydoge_hash_finish(uint512 hash[20])
+{
+    sph_bmw512_context       ctx_bmw;
+    sph_groestl512_context   ctx_groestl;
+    sph_jh512_context        ctx_jh;
+    sph_keccak512_context    ctx_keccak;
+    sph_skein512_context     ctx_skein;
+    sph_luffa512_context     ctx_luffa;
+    sph_cubehash512_context  ctx_cubehash;
+    sph_shavite512_context   ctx_shavite;
+    sph_simd512_context      ctx_simd;
+    sph_echo512_context      ctx_echo;
+    sph_hamsi512_context     ctx_hamsi;
+    sph_fugue512_context     ctx_fugue;
+    sph_shabal512_context    ctx_shabal;
+    sph_whirlpool_context    ctx_whirlpool;
+    sph_sha512_context       ctx_sha512;
+    sph_haval256_5_context   ctx_haval;
+    sph_sha256_context       ctx_sha256;
+
+    sph_skein512_init(&ctx_skein);
+    sph_skein512 (&ctx_skein, static_cast<const void*>(&hash[0]), 64);
+    sph_skein512_close(&ctx_skein, static_cast<void*>(&hash[1]));
+
+    sph_bmw512_init(&ctx_bmw);
+    sph_bmw512 (&ctx_bmw, static_cast<const void*>(&hash[1]), 64);
+    sph_bmw512_close(&ctx_bmw, static_cast<void*>(&hash[2]));
+
+    sph_groestl512_init(&ctx_groestl);
+    sph_groestl512 (&ctx_groestl, static_cast<const void*>(&hash[2]), 64);
+    sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[3]));
+
+    sph_jh512_init(&ctx_jh);
+    sph_jh512 (&ctx_jh, static_cast<const void*>(&hash[3]), 64);
+    sph_jh512_close(&ctx_jh, static_cast<void*>(&hash[4]));
+
+    sph_luffa512_init(&ctx_luffa);
+    sph_luffa512 (&ctx_luffa, static_cast<void*>(&hash[4]), 64);
+    sph_luffa512_close(&ctx_luffa, static_cast<void*>(&hash[5]));
+
+    sph_keccak512_init(&ctx_keccak);
+    sph_keccak512 (&ctx_keccak, static_cast<const void*>(&hash[5]), 64);
+    sph_keccak512_close(&ctx_keccak, static_cast<void*>(&hash[6]));
+
+    sph_simd512_init(&ctx_simd);
+    sph_simd512 (&ctx_simd, static_cast<const void*>(&hash[6]), 64);
+    sph_simd512_close(&ctx_simd, static_cast<void*>(&hash[7]));
+
+    sph_echo512_init(&ctx_echo);
+    sph_echo512 (&ctx_echo, static_cast<const void*>(&hash[7]), 64);
+    sph_echo512_close(&ctx_echo, static_cast<void*>(&hash[8]));
+
+    sph_cubehash512_init(&ctx_cubehash);
+    sph_cubehash512 (&ctx_cubehash, static_cast<const void*>(&hash[8]), 64);
+    sph_cubehash512_close(&ctx_cubehash, static_cast<void*>(&hash[9]));
+
+    sph_shavite512_init(&ctx_shavite);
+    sph_shavite512(&ctx_shavite, static_cast<const void*>(&hash[9]), 64);
+    sph_shavite512_close(&ctx_shavite, static_cast<void*>(&hash[10]));
+
+    sph_hamsi512_init(&ctx_hamsi);
+    sph_hamsi512 (&ctx_hamsi, static_cast<const void*>(&hash[10]), 64);
+    sph_hamsi512_close(&ctx_hamsi, static_cast<void*>(&hash[11]));
+
+    sph_fugue512_init(&ctx_fugue);
+    sph_fugue512 (&ctx_fugue, static_cast<const void*>(&hash[11]), 64);
+    sph_fugue512_close(&ctx_fugue, static_cast<void*>(&hash[12]));
+
+    sph_shabal512_init(&ctx_shabal);
+    sph_shabal512 (&ctx_shabal, static_cast<const void*>(&hash[12]), 64);
+    sph_shabal512_close(&ctx_shabal, static_cast<void*>(&hash[13]));
+
+    sph_whirlpool_init(&ctx_whirlpool);
+    sph_whirlpool (&ctx_whirlpool, static_cast<const void*>(&hash[13]), 64);
+    sph_whirlpool_close(&ctx_whirlpool, static_cast<void*>(&hash[14]));
+
+    sph_sha512_init(&ctx_sha512);
+    sph_sha512 (&ctx_sha512, static_cast<const void*>(&hash[14]), 64);
+    sph_sha512_close(&ctx_sha512, static_cast<void*>(&hash[15]));
+
+    sph_simd512_init(&ctx_simd);
+    sph_simd512 (&ctx_simd, static_cast<const void*>(&hash[15]), 64);
+    sph_simd512_close(&ctx_simd, static_cast<void*>(&hash[16]));
+
+    sph_whirlpool_init(&ctx_whirlpool);
+    sph_whirlpool (&ctx_whirlpool, static_cast<const void*>(&hash[16]), 64);
+    sph_whirlpool_close(&ctx_whirlpool, static_cast<void*>(&hash[17]));
+
+
+
+//    sph_tiger_init(&ctx_tiger);
+//    sph_tiger(&ctx_tiger, static_cast<const void*>(&hash[17]), 64);
+//    sph_tiger_close(&ctx_tiger, static_cast<void*>(&hash[18]));
+
+    sph_sha256_init(&ctx_sha256);
+    sph_sha256 (&ctx_sha256, static_cast<const void*>(&hash[17]), 64);
+    sph_sha256_close(&ctx_sha256, static_cast<void*>(&hash[18]));
+
+
+    sph_haval256_5_init(&ctx_haval);
+    sph_haval256_5 (&ctx_haval, static_cast<const void*>(&hash[18]), 64);
+    sph_haval256_5_close(&ctx_haval, static_cast<void*>(&hash[19]));
+
+    return hash[19].trim256();
+}
+
+CSkydogeHeaderHasher::CSkydogeHeaderHasher(const unsigned char* pheader)
+{
+    sph_blake512_init(&ctx_blake);
+    sph_blake512(&ctx_blake, pheader, HEADER_PREFIX_SIZE);
+}
+
+uint256 CSkydogeHeaderHasher::Hash(uint32_t nNonce) const
+{
+    unsigned char vchNonce[4];
+    WriteLE32(vchNonce, nNonce);
+
+    uint512 hash[20];
+
+    sph_blake512_context ctx = ctx_blake;
+    sph_blake512(&ctx, vchNonce, sizeof(vchNonce));
+    sph_blake512_close(&ctx, static_cast<void*>(&hash[0]));
+
+    return skydoge_hash_finish(hash);
+}
+
+#define SKYDOGE_HASH_STAGE(name)                                            \
+    static void SkydogeStage_##name(const void* pdata, size_t nLen, void* pout) \
+    {                                                                       \
+        sph_##name##_context ctx;                                           \
+        sph_##name##_init(&ctx);                                            \
+        sph_##name(&ctx, pdata, nLen);                                      \
+        sph_##name##_close(&ctx, pout);                                     \
+    }
+
+SKYDOGE_HASH_STAGE(blake512)
+SKYDOGE_HASH_STAGE(skein512)
+SKYDOGE_HASH_STAGE(bmw512)
+SKYDOGE_HASH_STAGE(groestl512)
+SKYDOGE_HASH_STAGE(jh512)
+SKYDOGE_HASH_STAGE(luffa512)
+SKYDOGE_HASH_STAGE(keccak512)
+SKYDOGE_HASH_STAGE(simd512)
+SKYDOGE_HASH_STAGE(echo512)
+SKYDOGE_HASH_STAGE(cubehash512)
+SKYDOGE_HASH_STAGE(shavite512)
+SKYDOGE_HASH_STAGE(hamsi512)
+SKYDOGE_HASH_STAGE(fugue512)
+SKYDOGE_HASH_STAGE(shabal512)
+SKYDOGE_HASH_STAGE(whirlpool)
+SKYDOGE_HASH_STAGE(sha512)
+SKYDOGE_HASH_STAGE(sha256)
+SKYDOGE_HASH_STAGE(haval256_5)
+
+const std::vector<SkydogeHashStage>& GetSkydogeHashStages()
+{
+    // Keep in sync with skydoge_hash_finish
+    static const std::vector<SkydogeHashStage> vStage = {
+        {"blake512", 1, SkydogeStage_blake512},
+        {"skein512", 1, SkydogeStage_skein512},
+        {"bmw512", 1, SkydogeStage_bmw512},
+        {"groestl512", 1, SkydogeStage_groestl512},
+        {"jh512", 1, SkydogeStage_jh512},
+        {"luffa512", 1, SkydogeStage_luffa512},
+        {"keccak512", 1, SkydogeStage_keccak512},
+        {"simd512", 2, SkydogeStage_simd512},
+        {"echo512", 1, SkydogeStage_echo512},
+        {"cubehash512", 1, SkydogeStage_cubehash512},
+        {"shavite512", 1, SkydogeStage_shavite512},
+        {"hamsi512", 1, SkydogeStage_hamsi512},
+        {"fugue512", 1, SkydogeStage_fugue512},
+        {"shabal512", 1, SkydogeStage_shabal512},
+        {"whirlpool", 2, SkydogeStage_whirlpool},
+        {"sha512", 1, SkydogeStage_sha512},
+        {"sha256", 1, SkydogeStage_sha256},
+        {"haval256_5", 1, SkydogeStage_haval256_5},
+    };
+    return vStage;
+}
+
+static int64_t NanosSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<SkydogeHashStageTiming> ProfileSkydogeHash(int nIterations, int64_t& nTotalNanos)
+{
+    std::vector<SkydogeHashStageTiming> vTiming;
+
+    // Feed each output back in as the next input like skydoge_hash does, so
+    // that the work can't be skipped
+    uint512 buf[2];
+    for (const SkydogeHashStage& stage : GetSkydogeHashStages()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nIterations; i++)
+            stage.hash(&buf[i & 1], 64, &buf[!(i & 1)]);
+
+        SkydogeHashStageTiming timing;
+        timing.name = stage.name;
+        timing.nRuns = stage.nRuns;
+        timing.nNanos = NanosSince(start);
+        vTiming.push_back(timing);
+    }
+
+    unsigned char header[80] = {};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nIterations; i++) {
+        uint256 hash = skydoge_hash(header, header + sizeof(header));
+        memcpy(header, hash.begin(), hash.size());
+    }
+    nTotalNanos = NanosSince(start);
+
+    return vTiming;
+}
@@ -12,6 +12,7 @@
 #include <uint256.h>
 #include <version.h>
 
+#include <string>
 #include <vector>
 
 
@@ -217,6 +218,7 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
     return ss.GetHash();
 }
 
+unsigned int MurmurHash3(unsigned int nHashSeed, const unsigned char* pDataToHash, size_t nSize);
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
@@ -256,28 +258,40 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Run every skydoge_hash stage after the first (blake512) one. hash[0] must
+ * hold the blake512 output; hash[1..19] are used as scratch space. */
+uint256 skydoge_hash_finish(uint512 hash[20]);
+
+/** One of the hash functions skydoge_hash is built from */
+struct SkydogeHashStage
+{
+    const char* name;
+    //! Number of times the stage runs per skydoge_hash
+    int nRuns;
+    void (*hash)(const void* pdata, size_t nLen, void* pout);
+};
+
+/** The distinct skydoge_hash stages in the order they first run */
+const std::vector<SkydogeHashStage>& GetSkydogeHashStages();
+
+/** Time taken by one skydoge_hash stage, see ProfileSkydogeHash */
+struct SkydogeHashStageTiming
+{
+    std::string name;
+    int nRuns;
+    //! Total time for all iterations of one run of the stage
+    int64_t nNanos;
+};
+
+/** Time nIterations runs of each skydoge_hash stage on 64 bytes of input, the
+ * size every stage after the first hashes, and nIterations whole skydoge_hash
+ * calls of an 80 byte header (returned in nTotalNanos). */
+std::vector<SkydogeHashStageTiming> ProfileSkydogeHash(int nIterations, int64_t& nTotalNanos);
+
 template<typename T1>
 inline uint256 skydoge_hash(const T1 pbegin, const T1 pend)
 {
     sph_blake512_context     ctx_blake;
-    sph_bmw512_context       ctx_bmw;
-    sph_groestl512_context   ctx_groestl;
-    sph_jh512_context        ctx_jh;
-    sph_keccak512_context    ctx_keccak;
-    sph_skein512_context     ctx_skein;
-    sph_luffa512_context     ctx_luffa;
-    sph_cubehash512_context  ctx_cubehash;
-    sph_shavite512_context   ctx_shavite;
-    sph_simd512_context      ctx_simd;
-    sph_echo512_context      ctx_echo;
-//    sph_tiger_context        ctx_tiger;
-    sph_hamsi512_context     ctx_hamsi;
-    sph_fugue512_context     ctx_fugue;
-    sph_shabal512_context    ctx_shabal;
-    sph_whirlpool_context    ctx_whirlpool;
-    sph_sha512_context       ctx_sha512;
-    sph_haval256_5_context   ctx_haval;
-    sph_sha256_context       ctx_sha256;
 
     static unsigned char pblank[1];
 
@@ -287,89 +301,26 @@ inline uint256 skydoge_hash(const T1 pbegin, const T1 pend)
     sph_blake512 (&ctx_blake, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
     sph_blake512_close(&ctx_blake, static_cast<void*>(&hash[0]));
 
-    sph_skein512_init(&ctx_skein);
-    sph_skein512 (&ctx_skein, static_cast<const void*>(&hash[0]), 64);
-    sph_skein512_close(&ctx_skein, static_cast<void*>(&hash[1]));
-
-    sph_bmw512_init(&ctx_bmw);
-    sph_bmw512 (&ctx_bmw, static_cast<const void*>(&hash[1]), 64);
-    sph_bmw512_close(&ctx_bmw, static_cast<void*>(&hash[2]));
-
-    sph_groestl512_init(&ctx_groestl);
-    sph_groestl512 (&ctx_groestl, static_cast<const void*>(&hash[2]), 64);
-    sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[3]));
-
-    sph_jh512_init(&ctx_jh);
-    sph_jh512 (&ctx_jh, static_cast<const void*>(&hash[3]), 64);
-    sph_jh512_close(&ctx_jh, static_cast<void*>(&hash[4]));
-
-    sph_luffa512_init(&ctx_luffa);
-    sph_luffa512 (&ctx_luffa, static_cast<void*>(&hash[4]), 64);
-    sph_luffa512_close(&ctx_luffa, static_cast<void*>(&hash[5]));
-
-    sph_keccak512_init(&ctx_keccak);
-    sph_keccak512 (&ctx_keccak, static_cast<const void*>(&hash[5]), 64);
-    sph_keccak512_close(&ctx_keccak, static_cast<void*>(&hash[6]));
-
-    sph_simd512_init(&ctx_simd);
-    sph_simd512 (&ctx_simd, static_cast<const void*>(&hash[6]), 64);
-    sph_simd512_close(&ctx_simd, static_cast<void*>(&hash[7]));
-
-    sph_echo512_init(&ctx_echo);
-    sph_echo512 (&ctx_echo, static_cast<const void*>(&hash[7]), 64);
-    sph_echo512_close(&ctx_echo, static_cast<void*>(&hash[8]));
-
-    sph_cubehash512_init(&ctx_cubehash);
-    sph_cubehash512 (&ctx_cubehash, static_cast<const void*>(&hash[8]), 64);
-    sph_cubehash512_close(&ctx_cubehash, static_cast<void*>(&hash[9]));
-
-    sph_shavite512_init(&ctx_shavite);
-    sph_shavite512(&ctx_shavite, static_cast<const void*>(&hash[9]), 64);
-    sph_shavite512_close(&ctx_shavite, static_cast<void*>(&hash[10]));
-
-    sph_hamsi512_init(&ctx_hamsi);
-    sph_hamsi512 (&ctx_hamsi, static_cast<const void*>(&hash[10]), 64);
-    sph_hamsi512_close(&ctx_hamsi, static_cast<void*>(&hash[11]));
-
-    sph_fugue512_init(&ctx_fugue);
-    sph_fugue512 (&ctx_fugue, static_cast<const void*>(&hash[11]), 64);
-    sph_fugue512_close(&ctx_fugue, static_cast<void*>(&hash[12]));
-
-    sph_shabal512_init(&ctx_shabal);
-    sph_shabal512 (&ctx_shabal, static_cast<const void*>(&hash[12]), 64);
-    sph_shabal512_close(&ctx_shabal, static_cast<void*>(&hash[13]));
-
-    sph_whirlpool_init(&ctx_whirlpool);
-    sph_whirlpool (&ctx_whirlpool, static_cast<const void*>(&hash[13]), 64);
-    sph_whirlpool_close(&ctx_whirlpool, static_cast<void*>(&hash[14]));
-
-    sph_sha512_init(&ctx_sha512);
-    sph_sha512 (&ctx_sha512, static_cast<const void*>(&hash[14]), 64);
-    sph_sha512_close(&ctx_sha512, static_cast<void*>(&hash[15]));
-
-    sph_simd512_init(&ctx_simd);
-    sph_simd512 (&ctx_simd, static_cast<const void*>(&hash[15]), 64);
-    sph_simd512_close(&ctx_simd, static_cast<void*>(&hash[16]));
-
-    sph_whirlpool_init(&ctx_whirlpool);
-    sph_whirlpool (&ctx_whirlpool, static_cast<const void*>(&hash[16]), 64);
-    sph_whirlpool_close(&ctx_whirlpool, static_cast<void*>(&hash[17]));
-
-
-
-//    sph_tiger_init(&ctx_tiger);
-//    sph_tiger(&ctx_tiger, static_cast<const void*>(&hash[17]), 64);
-//    sph_tiger_close(&ctx_tiger, static_cast<void*>(&hash[18]));
+    return skydoge_hash_finish(hash);
+}
 
-    sph_sha256_init(&ctx_sha256);
-    sph_sha256 (&ctx_sha256, static_cast<const void*>(&hash[17]), 64);
-    sph_sha256_close(&ctx_sha256, static_cast<void*>(&hash[18]));
+/**
+ * skydoge_hash midstate for 80-byte block headers that only differ in their
+ * trailing 4-byte nonce. The first 76 bytes are absorbed into the blake512
+ * stage once, and each Hash() call only appends the nonce to a copy of that
+ * state before running the remaining stages.
+ */
+class CSkydogeHeaderHasher
+{
+private:
+    sph_blake512_context ctx_blake;
 
+public:
+    static const size_t HEADER_PREFIX_SIZE = 76;
 
-    sph_haval256_5_init(&ctx_haval);
-    sph_haval256_5 (&ctx_haval, static_cast<const void*>(&hash[18]), 64);
-    sph_haval256_5_close(&ctx_haval, static_cast<void*>(&hash[19]));
+    explicit CSkydogeHeaderHasher(const unsigned char* pheader);
 
-    return hash[19].trim256();
-}
+    /** Hash the header prefix followed by nNonce (little endian) */
+    uint256 Hash(uint32_t nNonce) const;
+};
 #endif // BITCOIN_HASH_H
@@ -17,10 +17,15 @@
 #include <crypto/hmac_sha256.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <set>
+
 #include <boost/algorithm/string.hpp> // boost::trim
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
+/** Replies larger than this are sent in chunks of about this size */
+static const size_t HTTP_REPLY_CHUNK_SIZE = 256 * 1024;
 
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
@@ -64,6 +69,36 @@ static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static std::unique_ptr<HTTPRPCTimerInterface> httpRPCTimerInterface;
 
+void HTTPWriteJSONReply(HTTPRequest* req, const UniValue& val, const std::string& strPrefix, const std::string& strSuffix)
+{
+    req->WriteHeader("Content-Type", "application/json");
+
+    std::string strReply = strPrefix;
+    bool fChunked = false;
+    bool fOpen = true;
+    val.write(strReply, [req, &fChunked, &fOpen](std::string& s) {
+        if (s.size() < HTTP_REPLY_CHUNK_SIZE)
+            return;
+        if (!fChunked) {
+            req->WriteReplyStart(HTTP_OK);
+            fChunked = true;
+        }
+        if (fOpen)
+            fOpen = req->WriteReplyChunk(s);
+        s.clear();
+    });
+    strReply += strSuffix;
+
+    // Small replies are sent at once, with a Content-Length
+    if (!fChunked) {
+        req->WriteReply(HTTP_OK, strReply);
+        return;
+    }
+    if (fOpen)
+        req->WriteReplyChunk(strReply);
+    req->WriteReplyEnd();
+}
+
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
     // Send error reply from json-rpc error object
@@ -149,16 +184,16 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         req->WriteReply(HTTP_BAD_METHOD, "JSONRPC server handles only POST requests");
         return false;
     }
-    // Check authorization
-    std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
+    JSONRPCRequest jreq;
+    // Check authorization, callers on the unix socket already passed the
+    // file permissions of the socket
+    std::pair<bool, std::string> authHeader = req->IsUnixSocket() ? std::make_pair(true, std::string()) : req->GetHeader("authorization");
     if (!authHeader.first) {
         req->WriteHeader("WWW-Authenticate", WWW_AUTH_HEADER_DATA);
         req->WriteReply(HTTP_UNAUTHORIZED);
         return false;
     }
-
-    JSONRPCRequest jreq;
-    if (!RPCAuthorized(authHeader.second, jreq.authUser)) {
+    if (!req->IsUnixSocket() && !RPCAuthorized(authHeader.second, jreq.authUser)) {
         LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", req->GetPeer().ToString());
 
         /* Deter brute-forcing
@@ -187,8 +222,11 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
             UniValue result = tableRPC.execute(jreq);
 
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            // Send reply, the same as JSONRPCReply but without copying the
+            // result into the reply object
+            HTTPWriteJSONReply(req, result, "{\"result\":",
+                    ",\"id\":" + jreq.id.write() + ",\"jsonrpc\":\"2.0\"}\n");
+            return true;
 
         // array of requests
         } else if (valRequest.isArray())
@@ -208,6 +246,70 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Methods which can scan the chain, UTXO set or wallet, or wait for blocks */
+static const std::set<std::string> setHeavyRPCMethods = {
+    "dumpwallet",
+    "getaveragefee",
+    "getchaintxstats",
+    "gettxoutproof",
+    "gettxoutsetinfo",
+    "importaddress",
+    "importmulti",
+    "importprivkey",
+    "importpubkey",
+    "importwallet",
+    "listaddressgroupings",
+    "listreceivedbyaccount",
+    "listreceivedbyaddress",
+    "listsidechaindeposits",
+    "listsinceblock",
+    "listtransactions",
+    "rescanblockchain",
+    "verifychain",
+    "waitforblock",
+    "waitforblockheight",
+    "waitfornewblock",
+};
+
+static HTTPWorkLane RPCMethodLane(const std::string& strMethod)
+{
+    if (setHeavyRPCMethods.count(strMethod))
+        return HTTP_LANE_HEAVY;
+    const CRPCCommand* pcmd = tableRPC[strMethod];
+    if (pcmd && pcmd->category == "Drivechain")
+        return HTTP_LANE_SIDECHAIN;
+    return HTTP_LANE_FAST;
+}
+
+/** Pick the lane from the method names in the request body. The body isn't
+ * parsed here, a simple scan for "method" keys is enough for scheduling. A
+ * batch goes to the slowest lane of its methods.
+ */
+static HTTPWorkLane HTTPReq_JSONRPCLane(HTTPRequest* req, const std::string &)
+{
+    static const std::string strKey = "\"method\"";
+
+    size_t nSize;
+    const char* pBody = req->PeekBody(nSize);
+    if (!pBody)
+        return HTTP_LANE_FAST;
+
+    HTTPWorkLane lane = HTTP_LANE_FAST;
+    const char* pEnd = pBody + nSize;
+    const char* p = pBody;
+    while ((p = std::search(p, pEnd, strKey.begin(), strKey.end())) != pEnd) {
+        p += strKey.size();
+        while (p != pEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == ':'))
+            p++;
+        if (p == pEnd || *p != '"')
+            continue;
+        const char* pName = ++p;
+        p = std::find(p, pEnd, '"');
+        lane = std::max(lane, RPCMethodLane(std::string(pName, p)));
+    }
+    return lane;
+}
+
 static bool InitRPCAuthentication()
 {
     if (gArgs.GetArg("-rpcpassword", "") == "")
@@ -232,10 +334,10 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPCLane);
 #ifdef ENABLE_WALLET
     // ifdef can be removed once we switch to better endpoint support and API versioning
-    RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC, HTTPReq_JSONRPCLane);
 #endif
     assert(EventBase());
     httpRPCTimerInterface = MakeUnique<HTTPRPCTimerInterface>(EventBase());
@@ -8,6 +8,9 @@
 #include <string>
 #include <map>
 
+class HTTPRequest;
+class UniValue;
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -32,4 +35,10 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Send val as a JSON reply, between strPrefix and strSuffix. Large replies
+ * are sent in chunks as they are written instead of being built as one
+ * string first.
+ */
+void HTTPWriteJSONReply(HTTPRequest* req, const UniValue& val, const std::string& strPrefix = "", const std::string& strSuffix = "\n");
+
 #endif
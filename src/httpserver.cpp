@@ -2,11 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/skydoge-config.h>
+#endif
+
 #include <httpserver.h>
 
 #include <chainparamsbase.h>
 #include <compat.h>
-#include <deque>
+#include <mpmcqueue.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <netbase.h>
@@ -21,7 +25,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <future>
+#include <iterator>
+#include <mutex>
 
 #include <event2/thread.h>
 #include <event2/buffer.h>
@@ -31,6 +41,14 @@
 
 #include <support/events.h>
 
+#ifndef WIN32
+#include <sys/un.h>
+#endif
+
+#if USE_ZLIB
+#include <zlib.h>
+#endif
+
 #ifdef EVENT__HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #ifdef _XOPEN_SOURCE_EXTENDED
@@ -61,56 +79,128 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
+/** Upper bounds in milliseconds of the latency histogram buckets */
+static const int64_t LATENCY_BUCKET_BOUNDS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+static const size_t LATENCY_BUCKETS = sizeof(LATENCY_BUCKET_BOUNDS) / sizeof(LATENCY_BUCKET_BOUNDS[0]) + 1;
+
+/** Latency histogram which worker threads update without locking */
+class LatencyHistogram
+{
+private:
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<int64_t> nTotal;
+
+public:
+    LatencyHistogram() : nTotal(0)
+    {
+        for (auto& bucket : buckets)
+            bucket = 0;
+    }
+    void Add(int64_t nMicros)
+    {
+        size_t i = 0;
+        while (i < LATENCY_BUCKETS - 1 && nMicros > LATENCY_BUCKET_BOUNDS[i] * 1000)
+            i++;
+        buckets[i]++;
+        nTotal += nMicros;
+    }
+    std::vector<uint64_t> Buckets() const
+    {
+        std::vector<uint64_t> v;
+        for (const auto& bucket : buckets)
+            v.push_back(bucket);
+        return v;
+    }
+    int64_t Total() const { return nTotal; }
+};
+
+/** Work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
+ *
+ * Items are passed through a lock-free queue. The mutex and condition
+ * variable are only used to put workers to sleep when there is no work.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
-    /** Mutex protects entire object */
+    struct Entry
+    {
+        WorkItem* item;
+        int64_t nTimeQueued;
+    };
+    mpmcqueue<Entry> queue;
+    /** Number of items queued or being queued, never more than maxDepth */
+    std::atomic<size_t> depth;
+    size_t maxDepth;
+    std::atomic<bool> running;
+
     std::mutex cs;
     std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
-    bool running;
-    size_t maxDepth;
+    std::atomic<int> nSleeping;
 
 public:
-    explicit WorkQueue(size_t _maxDepth) : running(true),
-                                 maxDepth(_maxDepth)
+    LatencyHistogram queueWait;
+    LatencyHistogram serviceTime;
+    std::atomic<uint64_t> nRejected;
+
+    explicit WorkQueue(size_t _maxDepth) : queue(_maxDepth),
+                                 depth(0),
+                                 maxDepth(_maxDepth),
+                                 running(true),
+                                 nSleeping(0),
+                                 nRejected(0)
     {
     }
     /** Precondition: worker threads have all stopped (they have been joined).
      */
     ~WorkQueue()
     {
+        Entry entry;
+        while (queue.Pop(entry))
+            delete entry.item;
     }
     /** Enqueue a work item */
     bool Enqueue(WorkItem* item)
     {
-        std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        if (depth.fetch_add(1) >= maxDepth || !queue.Push(Entry{item, GetTimeMicros()})) {
+            depth--;
+            nRejected++;
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
-        cond.notify_one();
+        // Workers announce they are going to sleep before checking the depth,
+        // so either they see this item or we see them
+        if (nSleeping > 0) {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.notify_one();
+        }
         return true;
     }
     /** Thread function */
     void Run()
     {
-        while (true) {
-            std::unique_ptr<WorkItem> i;
-            {
+        while (running) {
+            Entry entry;
+            if (!queue.Pop(entry)) {
                 std::unique_lock<std::mutex> lock(cs);
-                while (running && queue.empty())
+                nSleeping++;
+                if (running && depth == 0) {
                     cond.wait(lock);
-                if (!running)
-                    break;
-                i = std::move(queue.front());
-                queue.pop_front();
+                } else if (running) {
+                    // An item is being queued but isn't visible yet
+                    lock.unlock();
+                    std::this_thread::yield();
+                }
+                nSleeping--;
+                continue;
             }
+            depth--;
+
+            int64_t nTimeStart = GetTimeMicros();
+            queueWait.Add(nTimeStart - entry.nTimeQueued);
+            std::unique_ptr<WorkItem> i(entry.item);
             (*i)();
+            serviceTime.Add(GetTimeMicros() - nTimeStart);
         }
     }
     /** Interrupt and exit loops */
@@ -120,18 +210,21 @@ public:
         running = false;
         cond.notify_all();
     }
+    size_t Depth() const { return depth; }
+    size_t MaxDepth() const { return maxDepth; }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, HTTPLaneSelector _selector):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), selector(_selector)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPLaneSelector selector;
 };
 
 /** HTTP module state */
@@ -142,12 +235,93 @@ static struct event_base* eventBase = nullptr;
 struct evhttp* eventHTTP = nullptr;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Work queues for handling longer requests off the event loop thread, one per lane
+static WorkQueue<HTTPClosure>* workQueues[HTTP_LANE_COUNT] = {};
+//! Number of worker threads of each lane
+static int workLaneThreads[HTTP_LANE_COUNT] = {};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 std::vector<evhttp_bound_socket *> boundSockets;
+//! HTTP server for -rpcunixsocket, requests to it skip the address and
+//! password checks
+static struct evhttp* eventHTTPUnix = nullptr;
+//! Bound -rpcunixsocket listening socket
+static evhttp_bound_socket* unixBoundSocket = nullptr;
+//! Path of the bound -rpcunixsocket, removed again on shutdown
+static fs::path unixSocketPath;
+//! zlib level replies are compressed with, 0 if they aren't
+static int httpCompressLevel = 0;
+//! Replies smaller than this aren't worth compressing
+static size_t httpCompressMinSize = DEFAULT_HTTP_COMPRESS_MIN_SIZE;
+
+/** gzip stream for the body of one reply */
+class HTTPCompressor
+{
+#if USE_ZLIB
+private:
+    z_stream strm;
+    bool fInit;
+
+public:
+    explicit HTTPCompressor(int nLevel)
+    {
+        memset(&strm, 0, sizeof(strm));
+        // 16 added to the window bits asks for a gzip header and trailer
+        fInit = deflateInit2(&strm, nLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+    ~HTTPCompressor()
+    {
+        if (fInit)
+            deflateEnd(&strm);
+    }
+
+    bool IsValid() const { return fInit; }
+
+    /** Compress strIn and append what comes out to strOut, fFinish to end
+     * the stream */
+    void Write(const std::string& strIn, std::string& strOut, bool fFinish)
+    {
+        unsigned char buf[16384];
+        strm.next_in = (Bytef*)strIn.data();
+        strm.avail_in = strIn.size();
+        do {
+            strm.next_out = buf;
+            strm.avail_out = sizeof(buf);
+            int ret = deflate(&strm, fFinish ? Z_FINISH : Z_NO_FLUSH);
+            assert(ret != Z_STREAM_ERROR);
+            strOut.append((const char*)buf, sizeof(buf) - strm.avail_out);
+        } while (strm.avail_out == 0);
+    }
+#endif
+};
+
+bool AcceptEncodingHasGzip(const std::string& strAcceptEncoding)
+{
+    // Drop the whitespace, then look at each "coding;q=weight" in turn
+    std::string str;
+    for (char c : strAcceptEncoding) {
+        if (c != ' ' && c != '\t')
+            str += std::tolower((unsigned char)c);
+    }
+    size_t nPos = 0;
+    while (nPos <= str.size()) {
+        size_t nEnd = str.find(',', nPos);
+        if (nEnd == std::string::npos)
+            nEnd = str.size();
+        const std::string strCoding = str.substr(nPos, nEnd - nPos);
+        nPos = nEnd + 1;
+        const size_t nParams = strCoding.find(';');
+        if (strCoding.substr(0, nParams) != "gzip")
+            continue;
+        if (nParams == std::string::npos)
+            return true;
+        // A weight of zero means the client doesn't want it
+        const std::string strParams = strCoding.substr(nParams + 1);
+        return strParams.compare(0, 2, "q=") != 0 || strParams.find_first_not_of("0.", 2) != std::string::npos;
+    }
+    return false;
+}
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -209,9 +383,26 @@ static std::string RequestMethodString(HTTPRequest::RequestMethod m)
     }
 }
 
+static const char* HTTPWorkLaneName(HTTPWorkLane lane)
+{
+    switch (lane) {
+    case HTTP_LANE_FAST:
+        return "fast";
+    case HTTP_LANE_SIDECHAIN:
+        return "sidechain";
+    case HTTP_LANE_HEAVY:
+        return "heavy";
+    default:
+        return "unknown";
+    }
+}
+
 /** HTTP request callback */
 static void http_request_cb(struct evhttp_request* req, void* arg)
 {
+    // arg is only set for the -rpcunixsocket server
+    const bool fUnixSocket = arg != nullptr;
+
     // Disable reading to work around a libevent bug, fixed in 2.2.0.
     if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
         evhttp_connection* conn = evhttp_request_get_connection(req);
@@ -222,13 +413,13 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
             }
         }
     }
-    std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
+    std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req, fUnixSocket));
 
     LogPrint(BCLog::HTTP, "Received a %s request for %s from %s\n",
-             RequestMethodString(hreq->GetRequestMethod()), hreq->GetURI(), hreq->GetPeer().ToString());
+             RequestMethodString(hreq->GetRequestMethod()), hreq->GetURI(), fUnixSocket ? "unix socket" : hreq->GetPeer().ToString());
 
     // Early address-based allow check
-    if (!ClientAllowed(hreq->GetPeer())) {
+    if (!fUnixSocket && !ClientAllowed(hreq->GetPeer())) {
         hreq->WriteReply(HTTP_FORBIDDEN);
         return;
     }
@@ -258,12 +449,13 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkLane lane = i->selector ? i->selector(hreq.get(), path) : HTTP_LANE_FAST;
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
-        assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        assert(workQueues[lane]);
+        if (workQueues[lane]->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because http %s work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n", HTTPWorkLaneName(lane));
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -327,6 +519,48 @@ static bool HTTPBindAddresses(struct evhttp* http)
     return !boundSockets.empty();
 }
 
+#ifndef WIN32
+/** Listen for RPC on a unix socket that only our own user can connect to */
+static bool HTTPBindUnixSocket(struct evhttp* http, const fs::path& path)
+{
+    const std::string strPath = path.string();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    if (strPath.size() >= sizeof(addr.sun_path)) {
+        LogPrintf("RPC unix socket path %s is too long\n", strPath);
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, strPath.c_str(), strPath.size());
+
+    LogPrint(BCLog::HTTP, "Binding RPC on unix socket %s\n", strPath);
+    evutil_socket_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LogPrintf("Binding RPC on unix socket %s failed: %s\n", strPath, NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    // Remove the socket left behind by a node that didn't shut down cleanly.
+    // Connecting takes write permission on the socket file, so nobody else
+    // can connect between bind() and chmod(), and no connection is accepted
+    // before listen() anyway.
+    unlink(strPath.c_str());
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || chmod(strPath.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+        listen(fd, SOMAXCONN) != 0 || evutil_make_socket_nonblocking(fd) != 0) {
+        LogPrintf("Binding RPC on unix socket %s failed: %s\n", strPath, NetworkErrorString(WSAGetLastError()));
+        evutil_closesocket(fd);
+        return false;
+    }
+    unixBoundSocket = evhttp_accept_socket_with_handle(http, fd);
+    if (!unixBoundSocket) {
+        LogPrintf("Binding RPC on unix socket %s failed.\n", strPath);
+        evutil_closesocket(fd);
+        return false;
+    }
+    unixSocketPath = path;
+    return true;
+}
+#endif
+
 /** Simple wrapper to set thread name and run work queue */
 static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
 {
@@ -389,19 +623,48 @@ bool InitHTTPServer()
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, nullptr);
 
+#if USE_ZLIB
+    httpCompressLevel = std::max(0, std::min(9, (int)gArgs.GetArg("-rpccompresslevel", DEFAULT_HTTP_COMPRESS_LEVEL)));
+    httpCompressMinSize = std::max((int64_t)0, gArgs.GetArg("-rpccompressminsize", DEFAULT_HTTP_COMPRESS_MIN_SIZE));
+#endif
+
     if (!HTTPBindAddresses(http)) {
         LogPrintf("Unable to bind any endpoint for RPC server\n");
         return false;
     }
 
+    raii_evhttp http_unix_ctr;
+#ifndef WIN32
+    if (gArgs.IsArgSet("-rpcunixsocket")) {
+        // Connections are kept alive between requests by evhttp, so local
+        // callers don't pay for a connect or a password check per call
+        http_unix_ctr = obtain_evhttp(base_ctr.get());
+        struct evhttp* http_unix = http_unix_ctr.get();
+        if (!http_unix) {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            return false;
+        }
+        evhttp_set_timeout(http_unix, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+        evhttp_set_max_headers_size(http_unix, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(http_unix, MAX_SIZE);
+        evhttp_set_gencb(http_unix, http_request_cb, http_unix);
+        if (!HTTPBindUnixSocket(http_unix, AbsPathForConfigVal(fs::path(gArgs.GetArg("-rpcunixsocket", ""))))) {
+            LogPrintf("Unable to bind the RPC unix socket\n");
+            return false;
+        }
+    }
+#endif
+
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    LogPrintf("HTTP: creating work queues of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    for (int lane = 0; lane < HTTP_LANE_COUNT; lane++)
+        workQueues[lane] = new WorkQueue<HTTPClosure>(workQueueDepth);
     // transfer ownership to eventBase/HTTP via .release()
     eventBase = base_ctr.release();
     eventHTTP = http_ctr.release();
+    eventHTTPUnix = http_unix_ctr.release();
     return true;
 }
 
@@ -426,14 +689,19 @@ static std::vector<std::thread> g_thread_http_workers;
 bool StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
-    int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    workLaneThreads[HTTP_LANE_FAST] = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    workLaneThreads[HTTP_LANE_SIDECHAIN] = std::max((long)gArgs.GetArg("-rpcsidechainthreads", DEFAULT_HTTP_SIDECHAIN_THREADS), 1L);
+    workLaneThreads[HTTP_LANE_HEAVY] = std::max((long)gArgs.GetArg("-rpcheavythreads", DEFAULT_HTTP_HEAVY_THREADS), 1L);
+    LogPrintf("HTTP: starting %d fast, %d sidechain and %d heavy worker threads\n",
+              workLaneThreads[HTTP_LANE_FAST], workLaneThreads[HTTP_LANE_SIDECHAIN], workLaneThreads[HTTP_LANE_HEAVY]);
     std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
     threadResult = task.get_future();
     threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
 
-    for (int i = 0; i < rpcThreads; i++) {
-        g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue);
+    for (int lane = 0; lane < HTTP_LANE_COUNT; lane++) {
+        for (int i = 0; i < workLaneThreads[lane]; i++) {
+            g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueues[lane]);
+        }
     }
     return true;
 }
@@ -449,21 +717,30 @@ void InterruptHTTPServer()
         // Reject requests on current connections
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, nullptr);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    if (eventHTTPUnix) {
+        evhttp_del_accept_socket(eventHTTPUnix, unixBoundSocket);
+        unixBoundSocket = nullptr;
+        evhttp_set_gencb(eventHTTPUnix, http_reject_request_cb, nullptr);
+    }
+    for (WorkQueue<HTTPClosure>* workQueue : workQueues) {
+        if (workQueue)
+            workQueue->Interrupt();
+    }
 }
 
 void StopHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Stopping HTTP server\n");
-    if (workQueue) {
+    if (workQueues[HTTP_LANE_FAST]) {
         LogPrint(BCLog::HTTP, "Waiting for HTTP worker threads to exit\n");
         for (auto& thread: g_thread_http_workers) {
             thread.join();
         }
         g_thread_http_workers.clear();
-        delete workQueue;
-        workQueue = nullptr;
+        for (WorkQueue<HTTPClosure>*& workQueue : workQueues) {
+            delete workQueue;
+            workQueue = nullptr;
+        }
     }
     if (eventBase) {
         LogPrint(BCLog::HTTP, "Waiting for HTTP event thread to exit\n");
@@ -485,6 +762,14 @@ void StopHTTPServer()
         evhttp_free(eventHTTP);
         eventHTTP = nullptr;
     }
+    if (eventHTTPUnix) {
+        evhttp_free(eventHTTPUnix);
+        eventHTTPUnix = nullptr;
+    }
+    if (!unixSocketPath.empty()) {
+        fs::remove(unixSocketPath);
+        unixSocketPath.clear();
+    }
     if (eventBase) {
         event_base_free(eventBase);
         eventBase = nullptr;
@@ -497,6 +782,30 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+std::vector<HTTPWorkLaneStats> GetHTTPWorkLaneStats()
+{
+    std::vector<HTTPWorkLaneStats> vStats;
+    for (int lane = 0; lane < HTTP_LANE_COUNT; lane++) {
+        const WorkQueue<HTTPClosure>* workQueue = workQueues[lane];
+        if (!workQueue)
+            return std::vector<HTTPWorkLaneStats>();
+
+        HTTPWorkLaneStats stats;
+        stats.name = HTTPWorkLaneName((HTTPWorkLane)lane);
+        stats.nThreads = workLaneThreads[lane];
+        stats.nDepth = workQueue->Depth();
+        stats.nMaxDepth = workQueue->MaxDepth();
+        stats.nRejected = workQueue->nRejected;
+        stats.vBucketBounds.assign(std::begin(LATENCY_BUCKET_BOUNDS), std::end(LATENCY_BUCKET_BOUNDS));
+        stats.vQueueWait = workQueue->queueWait.Buckets();
+        stats.nQueueWaitTotal = workQueue->queueWait.Total();
+        stats.vServiceTime = workQueue->serviceTime.Buckets();
+        stats.nServiceTimeTotal = workQueue->serviceTime.Total();
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -523,13 +832,18 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
-HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+HTTPRequest::HTTPRequest(struct evhttp_request* _req, bool _fUnixSocket) : req(_req),
+                                                                          replySent(false),
+                                                                          fUnixSocket(_fUnixSocket)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && stream) {
+        // A chunked reply can't be turned into an error anymore
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -568,6 +882,20 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+const char* HTTPRequest::PeekBody(size_t& size)
+{
+    size = 0;
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return nullptr;
+    size = evbuffer_get_length(buf);
+    // Makes the buffer contiguous, which ReadBody would do anyway
+    const char* data = (const char*)evbuffer_pullup(buf, size);
+    if (!data)
+        size = 0;
+    return data;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -575,32 +903,217 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket once a reply has been sent. This is the
+ * second part of the libevent workaround in http_request_cb.
+ */
+static void EnableReadAfterReply(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+bool HTTPRequest::AcceptsGzip()
+{
+    if (httpCompressLevel == 0)
+        return false;
+    // Replies that already have an encoding are sent as they are
+    const struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
+    if (headers && evhttp_find_header(headers, "Content-Encoding"))
+        return false;
+    std::pair<bool, std::string> accept = GetHeader("Accept-Encoding");
+    return accept.first && AcceptEncodingHasGzip(accept.second);
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !stream && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
+#if USE_ZLIB
+    // Compressed here on the worker thread, not in the event loop
+    if (strReply.size() >= httpCompressMinSize && AcceptsGzip()) {
+        HTTPCompressor gzip(httpCompressLevel);
+        if (gzip.IsValid()) {
+            std::string strCompressed;
+            gzip.Write(strReply, strCompressed, true);
+            WriteHeader("Content-Encoding", "gzip");
+            WriteHeader("Vary", "Accept-Encoding");
+            evbuffer_add(evb, strCompressed.data(), strCompressed.size());
+            auto req_copy = req;
+            HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+                evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
+                EnableReadAfterReply(req_copy);
+            });
+            ev->trigger(nullptr);
+            replySent = true;
+            req = nullptr; // transferred back to main thread
+            return;
+        }
+    }
+#endif
     evbuffer_add(evb, strReply.data(), strReply.size());
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        EnableReadAfterReply(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+/** State of a chunked reply, shared by the worker writing it and the main
+ * http thread sending it.
+ */
+struct HTTPReplyStream
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    //! A chunk has been handed to libevent but not written to the socket yet
+    bool fInFlight = false;
+    //! The connection is gone or the client stopped reading
+    bool fClosed = false;
+
+    //! Wake up the worker, the chunk in flight is done with
+    void Notify(bool fClosedIn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fInFlight = false;
+            fClosed = fClosed || fClosedIn;
+        }
+        cond.notify_all();
+    }
+};
+
+/** Called by libevent once the last chunk sent has been written */
+static void http_reply_chunk_cb(struct evhttp_connection*, void* arg)
+{
+    static_cast<HTTPReplyStream*>(arg)->Notify(false);
+}
+
+/** Called by libevent when the connection of a chunked reply is freed */
+static void http_reply_close_cb(struct evhttp_connection*, void* arg)
+{
+    static_cast<HTTPReplyStream*>(arg)->Notify(true);
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !stream && req);
+#if USE_ZLIB
+    // Chunked replies are the big ones, compress them whatever their size
+    if (AcceptsGzip()) {
+        compressor.reset(new HTTPCompressor(httpCompressLevel));
+        if (compressor->IsValid()) {
+            WriteHeader("Content-Encoding", "gzip");
+            WriteHeader("Vary", "Accept-Encoding");
+        } else {
+            compressor.reset();
+        }
+    }
+#endif
+    stream = std::make_shared<HTTPReplyStream>();
+    auto req_copy = req;
+    auto stream_copy = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, stream_copy, nStatus]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (!conn) {
+            stream_copy->Notify(true);
+            return;
         }
+        // Cleared again by WriteReplyEnd, before stream_copy goes away
+        evhttp_connection_set_closecb(conn, http_reply_close_cb, stream_copy.get());
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && stream && req);
+#if USE_ZLIB
+    if (compressor) {
+        std::string strCompressed;
+        compressor->Write(strChunk, strCompressed, false);
+        return SendReplyChunk(strCompressed);
+    }
+#endif
+    return SendReplyChunk(strChunk);
+}
+
+bool HTTPRequest::SendReplyChunk(const std::string& strChunk)
+{
+    {
+        std::unique_lock<std::mutex> lock(stream->cs);
+        HTTPReplyStream* s = stream.get();
+        const int64_t nTimeout = gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+        if (!stream->cond.wait_for(lock, std::chrono::seconds(nTimeout), [s] { return !s->fInFlight || s->fClosed; }))
+            stream->fClosed = true;
+        if (stream->fClosed)
+            return false;
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        stream->fInFlight = !strChunk.empty();
+#endif
+    }
+    if (strChunk.empty())
+        return true;
+
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    auto req_copy = req;
+    auto stream_copy = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, stream_copy, evb]{
+        if (evhttp_request_get_connection(req_copy)) {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+            evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_chunk_cb, stream_copy.get());
+#else
+            evhttp_send_reply_chunk(req_copy, evb);
+#endif
+        } else {
+            stream_copy->Notify(true);
+        }
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(!replySent && stream && req);
+#if USE_ZLIB
+    if (compressor) {
+        std::string strCompressed;
+        compressor->Write(std::string(), strCompressed, true);
+        compressor.reset();
+        SendReplyChunk(strCompressed);
+    }
+#endif
+    auto req_copy = req;
+    auto stream_copy = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, stream_copy]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn)
+            evhttp_connection_set_closecb(conn, nullptr, nullptr);
+        // Also frees the request if the connection is gone
+        evhttp_send_reply_end(req_copy);
+        if (conn)
+            EnableReadAfterReply(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
@@ -647,10 +1160,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPLaneSelector &selector)
 {
     LogPrint(BCLog::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, selector));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
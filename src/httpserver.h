@@ -8,14 +8,23 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_SIDECHAIN_THREADS=2;
+static const int DEFAULT_HTTP_HEAVY_THREADS=1;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Default for -rpccompresslevel, 0 to never compress replies */
+static const int DEFAULT_HTTP_COMPRESS_LEVEL=6;
+/** Default for -rpccompressminsize, smaller replies are sent as they are */
+static const int DEFAULT_HTTP_COMPRESS_MIN_SIZE=16384;
 
 struct evhttp_request;
 struct event_base;
 class CService;
+class HTTPCompressor;
 class HTTPRequest;
 
 /** Initialize HTTP server.
@@ -36,13 +45,28 @@ void StopHTTPServer();
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
 
+/** Work queue lanes. Each lane has its own queue and worker threads, so slow
+ * requests can only hold up other requests in the same lane.
+ */
+enum HTTPWorkLane
+{
+    HTTP_LANE_FAST,      //!< Control calls and cheap queries
+    HTTP_LANE_SIDECHAIN, //!< Queries from sidechains
+    HTTP_LANE_HEAVY,     //!< Calls that scan the chain or wallet, or block
+    HTTP_LANE_COUNT
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the lane of a request. Called on the event thread before the
+ * request is queued, so it must be quick and must not consume the body.
+ */
+typedef std::function<HTTPWorkLane(HTTPRequest* req, const std::string &)> HTTPLaneSelector;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Requests go to the fast lane unless a lane selector is given.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPLaneSelector &selector = nullptr);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -51,6 +75,30 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Queue statistics of a work lane since startup */
+struct HTTPWorkLaneStats
+{
+    std::string name;
+    int nThreads;
+    size_t nDepth;
+    size_t nMaxDepth;
+    uint64_t nRejected;
+    //! Upper bounds in milliseconds of the histogram buckets. The last
+    //! bucket, which has no bound, counts everything slower.
+    std::vector<int64_t> vBucketBounds;
+    //! Time requests spent waiting in the queue
+    std::vector<uint64_t> vQueueWait;
+    int64_t nQueueWaitTotal; //!< microseconds
+    //! Time spent handling requests
+    std::vector<uint64_t> vServiceTime;
+    int64_t nServiceTimeTotal; //!< microseconds
+};
+
+/** Get the statistics of each work lane, empty if the server isn't running */
+std::vector<HTTPWorkLaneStats> GetHTTPWorkLaneStats();
+
+struct HTTPReplyStream;
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -59,9 +107,20 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! Set once a chunked reply has been started
+    std::shared_ptr<HTTPReplyStream> stream;
+    //! Whether the request came in on -rpcunixsocket
+    bool fUnixSocket;
+    //! Compresses a chunked reply, if the client takes gzip
+    std::unique_ptr<HTTPCompressor> compressor;
+
+    /** Whether the client takes gzip encoded replies */
+    bool AcceptsGzip();
+    /** Hand a chunk of the body, as it goes on the wire, to the main thread */
+    bool SendReplyChunk(const std::string& strChunk);
 
 public:
-    explicit HTTPRequest(struct evhttp_request* req);
+    explicit HTTPRequest(struct evhttp_request* req, bool fUnixSocket = false);
     ~HTTPRequest();
 
     enum RequestMethod {
@@ -84,6 +143,11 @@ public:
      */
     RequestMethod GetRequestMethod();
 
+    /** Whether the request came in on the RPC unix socket, which only the
+     * user running the node can connect to.
+     */
+    bool IsUnixSocket() const { return fUnixSocket; }
+
     /**
      * Get the request header specified by hdr, or an empty string.
      * Return a pair (isPresent,string).
@@ -98,6 +162,13 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Get the request body without consuming it.
+     *
+     * @note The returned data is valid until the body is read.
+     */
+    const char* PeekBody(size_t& size);
+
     /**
      * Write output header.
      *
@@ -114,6 +185,28 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked reply, for a body that is sent in pieces as it is
+     * produced instead of all at once by WriteReply. Headers must be written
+     * before this.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Send the next piece of a chunked reply. Waits until the previous piece
+     * has been written to the socket, so that at most one piece per request
+     * is buffered. Returns false once the connection is gone or the client
+     * has stopped reading, the rest of the body should then be dropped.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply.
+     *
+     * @note Like WriteReply, this gives the request back to the main thread.
+     */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
@@ -150,4 +243,7 @@ private:
 
 std::string urlDecode(const std::string &urlEncoded);
 
+/** Whether an Accept-Encoding header value allows gzip */
+bool AcceptEncodingHasGzip(const std::string& strAcceptEncoding);
+
 #endif // BITCOIN_HTTPSERVER_H
@@ -11,6 +11,10 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockcache.h"
+#include "blockfilemap.h"
+#include "blockprefetch.h"
+#include "bmmcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -21,10 +25,13 @@
 #include "httprpc.h"
 #include "key.h"
 #include "validation.h"
+#include "metrics.h"
+#include "stratum.h"
 #include "miner.h"
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
+#include "opreturnindex.h"
 #include "policy/feerate.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
@@ -36,10 +43,17 @@
 #include "scheduler.h"
 #include "sidechain.h"
 #include "sidechaindb.h"
+#include "sockevents.h"
+#include "support/largepages.h"
 #include "timedata.h"
 #include "txdb.h"
+#include "txprevalidate.h"
 #include "txmempool.h"
 #include "torcontrol.h"
+#include "txindex.h"
+#include "addressindex.h"
+#include "blockfilterindex.h"
+#include "coinstatsindex.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -53,6 +67,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <memory>
+#include <thread>
 
 #ifndef WIN32
 #include <signal.h>
@@ -75,6 +90,8 @@ static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 static const bool DEFAULT_DISABLE_SAFEMODE = false;
+static const int DEFAULT_LARGE_PAGES = 0;
+static const int DEFAULT_NUMA_NODE = -1;
 
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
@@ -121,6 +138,7 @@ static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
 
 std::atomic<bool> fRequestShutdown(false);
 std::atomic<bool> fDumpMempoolLater(false);
+std::atomic<bool> fDumpCoinCacheLater(false);
 
 void StartShutdown()
 {
@@ -162,13 +180,36 @@ static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
 
+CScheduler& GetScheduler()
+{
+    return scheduler;
+}
+
 void Interrupt()
 {
     InterruptHTTPServer();
     InterruptHTTPRPC();
     InterruptRPC();
     InterruptREST();
+    InterruptMetrics();
     InterruptTorControl();
+    InterruptStratum();
+    if (g_opreturnindex)
+        g_opreturnindex->Interrupt();
+    if (g_txindex)
+        g_txindex->Interrupt();
+    if (g_addressindex)
+        g_addressindex->Interrupt();
+    if (g_blockfilterindex)
+        g_blockfilterindex->Interrupt();
+    if (g_coinstatsindex)
+        g_coinstatsindex->Interrupt();
+    if (g_bmmcache)
+        g_bmmcache->Interrupt();
+    if (g_blockprefetcher)
+        g_blockprefetcher->Interrupt();
+    if (g_txprevalidator)
+        g_txprevalidator->Interrupt();
     if (g_connman)
         g_connman->Interrupt();
 }
@@ -190,6 +231,7 @@ void Shutdown()
 
     StopHTTPRPC();
     StopREST();
+    StopMetrics();
     StopRPC();
     StopHTTPServer();
 #ifdef ENABLE_WALLET
@@ -197,12 +239,20 @@ void Shutdown()
 #endif
     // Stop mining
     GenerateBitcoins(false, 0, Params());
+    StopStratum();
     MapPort(false);
 
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
     if (g_connman) g_connman->Stop();
+    // Nothing submits transactions anymore, and nothing is woken up after
+    // the connection manager is gone
+    if (g_txprevalidator) {
+        g_txprevalidator->Interrupt();
+        g_txprevalidator->Stop();
+        g_txprevalidator.reset();
+    }
     peerLogic.reset();
     g_connman.reset();
 
@@ -213,7 +263,18 @@ void Shutdown()
     threadGroup.interrupt_all();
     threadGroup.join_all();
 
-    DumpSCDBCache();
+    // Nothing is connecting blocks anymore
+    if (g_blockprefetcher) {
+        g_blockprefetcher->Interrupt();
+        g_blockprefetcher->Stop();
+        g_blockprefetcher.reset();
+    }
+    g_blockfilemap.reset();
+    g_blockcache.Clear();
+
+    // The SCDB caches are already on disk, apart from the last few changes
+    // still being written to the log
+    StopSCDBLog();
 
     DumpAddressBook();
 
@@ -221,6 +282,11 @@ void Shutdown()
         DumpMempool();
     }
 
+    // Has to come before FlushStateToDisk, which empties the coins cache
+    if (fDumpCoinCacheLater && gArgs.GetBoolArg("-persistcoincache", DEFAULT_PERSIST_COINCACHE)) {
+        DumpCoinCache();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         ::feeEstimator.FlushUnconfirmed();
@@ -242,6 +308,44 @@ void Shutdown()
     // CValidationInterface callbacks, flush them...
     GetMainSignals().FlushBackgroundCallbacks();
 
+    // Stop the OP_RETURN index after it has seen the last callbacks and
+    // before its database is closed
+    if (g_opreturnindex) {
+        g_opreturnindex->Interrupt();
+        g_opreturnindex->Stop();
+        g_opreturnindex.reset();
+    }
+
+    // Stop the transaction index before the block tree database is closed
+    if (g_txindex) {
+        g_txindex->Interrupt();
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+
+    if (g_addressindex) {
+        g_addressindex->Interrupt();
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+
+    if (g_blockfilterindex) {
+        g_blockfilterindex->Interrupt();
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
+    }
+
+    if (g_coinstatsindex) {
+        g_coinstatsindex->Interrupt();
+        g_coinstatsindex->Stop();
+        g_coinstatsindex.reset();
+    }
+
+    if (g_bmmcache) {
+        g_bmmcache->Stop();
+        g_bmmcache.reset();
+    }
+
     // Any future callbacks will be dropped. This should absolutely be safe - if
     // missing a callback results in an unrecoverable situation, unclean shutdown
     // would too. The only reason to do the above flushes is to let the wallet catch
@@ -254,9 +358,11 @@ void Shutdown()
             FlushStateToDisk();
         }
         pcoinsTip.reset();
+        pcoinsflush.reset();
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        scdb.SetDepositDB(nullptr);
         psidechaintree.reset();
         popreturndb.reset();
     }
@@ -326,6 +432,7 @@ void OnRPCStopped()
     uiInterface.NotifyBlockTip.disconnect(&RPCNotifyBlockChange);
     RPCNotifyBlockChange(false, nullptr);
     cvBlockChange.notify_all();
+    SidechainDB::NotifyViewWaiters();
     LogPrint(BCLog::RPC, "RPC stopped.\n");
 }
 
@@ -342,12 +449,23 @@ std::string HelpMessage(HelpMessageMode mode)
     std::string strUsage = HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the outputs and spends of every script in the background, used by the getaddresshistory and getaddressutxos rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)"), defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of the BIP 158 basic filter of every block in the background, used by the getblockfilter rpc call and -peerblockfilters (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(_("Keep up to <n> MiB of recently looked up blocks decoded in memory for RPC, REST and GUI lookups (default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
+#if USE_ZLIB
+    strUsage += HelpMessageOpt("-blockcompresslevel=<n>", strprintf(_("Compress new blocks in the blk*.dat files with zlib level <n>, 0 to disable, 1-9 (default: %d)"), DEFAULT_BLOCK_COMPRESS_LEVEL));
+#endif
+    strUsage += HelpMessageOpt("-blockmmap", strprintf(_("Read blocks from finished block files through read-only memory maps (default: %u)"), DEFAULT_BLOCK_MMAP));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
+    strUsage += HelpMessageOpt("-blockreconstructionbmmtxn=<n>", strprintf(_("Evicted BMM requests to keep in memory per sidechain for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_BMM_TXN));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-bmmcache=<n>", strprintf(_("Keep the BMM h* commitments of the last <n> blocks in memory, used by the verifybmm, verifybmmbatch and waitforbmm rpc calls, 0 to disable (default: %u)"), DEFAULT_BMM_CACHE_BLOCKS));
+    strUsage += HelpMessageOpt("-bmmindex", strprintf(_("Maintain an index of BMM h* commitments, used by the verifybmm and verifybmmbatch rpc calls (default: %u)"), DEFAULT_BMMINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain an index of the UTXO set stats and MuHash after every block in the background, used by the gettxoutsetinfo rpc call (default: %u)"), DEFAULT_COINSTATSINDEX));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -360,31 +478,44 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbcompactinterval=<n>", strprintf(_("Compact the databases every <n> hours, 0 to leave compaction to LevelDB (default: %u)"), DEFAULT_DB_COMPACT_INTERVAL));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), DEFAULT_DEBUGLOGFILE));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-largepages=<n>", strprintf(_("Back the coins cache and the mempool with huge pages on Linux: 0 = off, 1 = transparent huge pages, 2 = the reserved huge page pool (vm.nr_hugepages), falling back to transparent ones (default: %d)"), DEFAULT_LARGE_PAGES));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxscdbmemory=<n>", strprintf(_("Keep the sidechain database below <n> MiB of memory by keeping fewer recent deposits and less withdrawal history in memory, 0 for no limit (default: %u)"), DEFAULT_MAX_SCDB_MEMORY));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     if (showDebug) {
         strUsage += HelpMessageOpt("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()));
     }
+    strUsage += HelpMessageOpt("-numanode=<n>", strprintf(_("Place the huge pages of -largepages on NUMA node <n> and run block validation on its CPUs, -1 to leave placement to the system (default: %d)"), DEFAULT_NUMA_NODE));
+    strUsage += HelpMessageOpt("-prefetchblocks=<n>", strprintf(_("Read and check up to <n> blocks ahead of the chain tip on background threads while connecting blocks, 0 to disable (default: %d)"), DEFAULT_PREFETCH_BLOCKS));
+    strUsage += HelpMessageOpt("-prevalidatetxthreads=<n>", strprintf(_("Check the scripts of transactions from peers on <n> threads before accepting them to the mempool, 0 to check them while accepting (default: %d, maximum: %d)"), DEFAULT_PREVALIDATE_THREADS, MAX_PREVALIDATE_THREADS));
+    strUsage += HelpMessageOpt("-opreturnindex", strprintf(_("Maintain an index of OP_RETURN outputs in the background, used by the CoinNews and OP_RETURN pages (default: %u)"), DEFAULT_OPRETURNINDEX));
+    strUsage += HelpMessageOpt("-opreturnretention=<n>", strprintf(_("Erase OP_RETURN data older than <n> days, or the longest news type period if that is longer, 0 to keep everything (default: %u)"), DEFAULT_OPRETURN_RETENTION));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistcoincache", strprintf(_("Whether to save the outpoints of the cached coins on shutdown and look them up again on restart (default: %u)"), DEFAULT_PERSIST_COINCACHE));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-sidechaindbretention=<n>", strprintf(_("Erase sidechain block data older than <n> checkpoints of %u blocks beyond the last %u blocks, 0 to keep everything (default: %u)"), SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL, MIN_BLOCKS_TO_KEEP, DEFAULT_SIDECHAIN_DB_RETENTION));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index in the background, used by the getrawtransaction rpc call. Can be enabled at any time, the index catches up with the block chain (default: %u)"), DEFAULT_TXINDEX));
+#if USE_ZLIB
+    strUsage += HelpMessageOpt("-undocompresslevel=<n>", strprintf(_("Compress the undo data of new blocks in the rev*.dat files with zlib level <n>, 0 to disable, 1-9 (default: %d)"), DEFAULT_UNDO_COMPRESS_LEVEL));
+#endif
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
@@ -406,15 +537,18 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve compact block filters to peers per BIP 157, requires -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("How to wait for socket events: %s (default: %s)"), ListSocketEvents(), DefaultSocketEvents()));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf(_("Announce transactions by short id to peers which support it, and let them ask for the ones they are missing (default: %u)"), DEFAULT_TX_RECONCILIATION));
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage += HelpMessageOpt("-upnp", _("Use UPnP to map the listening port (default: 1 when listening and no -proxy)"));
@@ -433,9 +567,13 @@ std::string HelpMessage(HelpMessageMode mode)
 #if ENABLE_ZMQ
     strUsage += HelpMessageGroup(_("ZeroMQ notification options:"));
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashforktip=<address>", _("Enable publish hash of headers that start a new branch of the block tree in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubbmm=<address>", _("Enable publish BMM commitments of connected blocks in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdeposit=<address>", _("Enable publish sidechain deposits in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubwithdrawalstate=<address>", _("Enable publish withdrawal work score changes in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -444,6 +582,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkheaderhashes", strprintf("Recompute the hashes of the block headers loaded at startup in the background, and shut down if one doesn't match (default: %u)", DEFAULT_CHECK_HEADER_HASHES));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
@@ -464,6 +603,7 @@ std::string HelpMessage(HelpMessageMode mode)
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + ListLogCategories() + ".");
     strUsage += HelpMessageOpt("-debugexclude=<category>", strprintf(_("Exclude debugging information for a category. Can be used in conjunction with -debug=1 to output debug logs for all categories except one or more specified categories.")));
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-lockstats", strprintf(_("Record how often and how long each place in the code waits for and holds locks, see getlockstats (default: %u)"), DEFAULT_LOCK_STATS));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
@@ -504,24 +644,47 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockmaxsize=<n>", _("Set maximum BIP141 block weight to this * 4. Deprecated, use blockmaxweight"));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(_("Set maximum BIP141 block weight (default: %d)"), DEFAULT_BLOCK_MAX_WEIGHT));
     strUsage += HelpMessageOpt("-blockmintxfee=<amt>", strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
+    strUsage += HelpMessageOpt("-blockassemblythreads=<n>", strprintf(_("Number of threads used to find the ancestors of transaction packages when creating blocks, 0 for one per core (default: %d, max: %d)"), DEFAULT_BLOCK_ASSEMBLY_THREADS, MAX_BLOCK_ASSEMBLY_THREADS));
+    strUsage += HelpMessageOpt("-templatevalidation=<mode>", strprintf(_("How to check created blocks: full connects them, light only checks their header, limits, commitments and SCDB update, sampled is light with full for one in %u blocks (default: %s)"), TEMPLATE_VALIDATION_SAMPLE_RATE, DEFAULT_TEMPLATE_VALIDATION));
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Accept Stratum v1 connections from miners, mining to -stratumaddress (default: %u)"), DEFAULT_STRATUM_ENABLE));
+    strUsage += HelpMessageOpt("-stratumaddress=<addr>", _("Address the coinbase of blocks found by stratum miners pays to"));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", strprintf(_("Bind to given address to listen for stratum connections (default: %s)"), DEFAULT_STRATUM_BIND));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>", strprintf(_("Share difficulty for stratum miners, where difficulty 1 is the proof of work limit (default: %d)"), DEFAULT_STRATUM_DIFFICULTY));
+    strUsage += HelpMessageOpt("-stratumport=<port>", strprintf(_("Listen for stratum connections on <port> (default: %u)"), DEFAULT_STRATUM_PORT));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
     strUsage += HelpMessageGroup(_("RPC server options:"));
+    strUsage += HelpMessageOpt("-metrics", strprintf(_("Serve Prometheus metrics at /metrics on the RPC port, without authentication (default: %u)"), DEFAULT_METRICS_ENABLE));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcauth=<userpw>", _("Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcuser. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times"));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-rpcbatchparallel=<n>", strprintf("Maximum number of read-only calls of one batched RPC request to execute in parallel (default: %d)", DEFAULT_RPC_BATCH_PARALLEL));
+        strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf("Set the number of threads to execute read-only calls of batched RPC requests in parallel, 0 to execute them serially (default: %d)", DEFAULT_RPC_BATCH_THREADS));
+    }
     strUsage += HelpMessageOpt("-rpcbind=<addr>[:port]", _("Bind to given address to listen for JSON-RPC connections. This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost, or if -rpcallowip has been specified, 0.0.0.0 and :: i.e., all addresses)"));
+#if USE_ZLIB
+    strUsage += HelpMessageOpt("-rpccompresslevel=<n>", strprintf(_("Compress replies to clients that accept gzip with zlib level <n>, 0 to disable, 1-9 (default: %d)"), DEFAULT_HTTP_COMPRESS_LEVEL));
+    strUsage += HelpMessageOpt("-rpccompressminsize=<n>", strprintf(_("Only compress replies of at least <n> bytes (default: %d)"), DEFAULT_HTTP_COMPRESS_MIN_SIZE));
+#endif
     strUsage += HelpMessageOpt("-rpccookiefile=<loc>", _("Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort()));
     strUsage += HelpMessageOpt("-rpcserialversion", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-rpcheavythreads=<n>", strprintf("Set the number of threads to service RPC calls which scan the chain or wallet (default: %d)", DEFAULT_HTTP_HEAVY_THREADS));
     if (showDebug)
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-rpcsidechainthreads=<n>", strprintf("Set the number of threads to service Drivechain RPC calls (default: %d)", DEFAULT_HTTP_SIDECHAIN_THREADS));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+#ifndef WIN32
+    strUsage += HelpMessageOpt("-rpcunixsocket=<path>", _("Also listen for JSON-RPC connections on a unix domain socket at <path>, relative to the data directory. Only the user running the node can connect, no password is asked"));
+#endif
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     if (showDebug)
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of each work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
     strUsage += HelpMessageOpt("-server", _("Accept command line and JSON-RPC commands"));
 
     return strUsage;
@@ -549,6 +712,14 @@ std::string LicenseInfo()
            "\n";
 }
 
+static void CompactDatabases()
+{
+    ForEachDB([](const CDBWrapper& db) {
+        LogPrintf("Compacting the %s database\n", db.GetName());
+        db.CompactAll();
+    });
+}
+
 static void BlockNotifyCallback(bool initialSync, const CBlockIndex *pBlockIndex)
 {
     if (initialSync || !pBlockIndex)
@@ -635,6 +806,22 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     const CChainParams& chainparams = Params();
     RenameThread("skydoge-loadblk");
+    LargePageArena::Instance().BindThreadToNumaNode();
+
+    // Warm the coins cache up alongside the block import, which is already
+    // working on the chainstate of the saved coins. A -reindex rebuilds it.
+    const bool fPersistCoinCache = gArgs.GetBoolArg("-persistcoincache", DEFAULT_PERSIST_COINCACHE);
+    std::thread threadLoadCoins;
+    if (fPersistCoinCache && !fReindex) {
+        try {
+            threadLoadCoins = std::thread([] {
+                RenameThread("skydoge-loadcoins");
+                LoadCoinCache();
+            });
+        } catch (const std::system_error& e) {
+            LogPrintf("Failed to start coin cache loading thread: %s\n", e.what());
+        }
+    }
 
     {
     CImportingNow imp;
@@ -691,6 +878,9 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         LogPrintf("Failed to connect best block\n");
         StartShutdown();
     }
+    // Done with a -reindex-chainstate replay, even if it didn't get back to
+    // the previous tip
+    FinishReindexChainState();
 
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
@@ -701,6 +891,11 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         LoadMempool();
         fDumpMempoolLater = !fRequestShutdown;
     }
+    if (threadLoadCoins.joinable())
+        threadLoadCoins.join();
+    if (fPersistCoinCache) {
+        fDumpCoinCacheLater = !fRequestShutdown;
+    }
 }
 
 /** Sanity checks
@@ -737,6 +932,8 @@ bool AppInitServers()
         return false;
     if (gArgs.GetBoolArg("-rest", DEFAULT_REST_ENABLE) && !StartREST())
         return false;
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE) && !StartMetrics())
+        return false;
     if (!StartHTTPServer())
         return false;
     return true;
@@ -805,6 +1002,13 @@ void InitParameterInteraction()
             LogPrintf("%s: parameter interaction: -whitelistforcerelay=1 -> setting -whitelistrelay=1\n", __func__);
     }
 
+    // The OP_RETURN index can't sync past pruned blocks, only an explicit
+    // -opreturnindex=1 is refused in prune mode
+    if (gArgs.GetArg("-prune", 0)) {
+        if (gArgs.SoftSetBoolArg("-opreturnindex", false))
+            LogPrintf("%s: parameter interaction: -prune set -> setting -opreturnindex=0\n", __func__);
+    }
+
     if (gArgs.IsArgSet("-blockmaxsize")) {
         unsigned int max_size = gArgs.GetArg("-blockmaxsize", 0);
         if (gArgs.SoftSetArg("blockmaxweight", strprintf("%d", max_size * WITNESS_SCALE_FACTOR))) {
@@ -914,10 +1118,18 @@ bool AppInitParameterInteraction()
 
     // also see: InitParameterInteraction()
 
-    // if using block pruning, then disallow txindex
+    // if using block pruning, then disallow txindex and addressindex
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex."));
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -coinstatsindex."));
+        if (gArgs.GetBoolArg("-opreturnindex", DEFAULT_OPRETURNINDEX))
+            return InitError(_("Prune mode is incompatible with -opreturnindex."));
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -931,8 +1143,13 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    const std::string strSocketEvents = gArgs.GetArg("-socketevents", DefaultSocketEvents());
+    if (!MakeSocketEvents(strSocketEvents))
+        return InitError(strprintf(_("Unsupported -socketevents value '%s', supported: %s"), strSocketEvents, ListSocketEvents()));
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    if (strSocketEvents == "select")
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -969,6 +1186,9 @@ bool AppInitParameterInteraction()
         logCategories &= ~flag;
     }
 
+    if (gArgs.GetBoolArg("-lockstats", DEFAULT_LOCK_STATS))
+        EnableLockStats(true);
+
     // Check for -debugnet
     if (gArgs.GetBoolArg("-debugnet", false))
         InitWarning(_("Unsupported argument -debugnet ignored, use -debug=net."));
@@ -995,6 +1215,21 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+#if USE_ZLIB
+    nBlockCompressLevel = std::max(0, std::min(9, (int)gArgs.GetArg("-blockcompresslevel", DEFAULT_BLOCK_COMPRESS_LEVEL)));
+    nUndoCompressLevel = std::max(0, std::min(9, (int)gArgs.GetArg("-undocompresslevel", DEFAULT_UNDO_COMPRESS_LEVEL)));
+#endif
+
+    const int nLargePages = gArgs.GetArg("-largepages", DEFAULT_LARGE_PAGES);
+    const int nNumaNode = gArgs.GetArg("-numanode", DEFAULT_NUMA_NODE);
+    if (nLargePages < 0 || nLargePages > 2)
+        return InitError(strprintf(_("Invalid -largepages value %d"), nLargePages));
+    if (nLargePages || nNumaNode >= 0) {
+        if (!LargePageArena::Instance().Configure((LargePageMode)nLargePages, std::max(-1, nNumaNode)))
+            InitWarning(strprintf(_("Huge pages aren't supported on this platform or NUMA node %d doesn't exist, ignoring -largepages and -numanode."), nNumaNode));
+        else
+            LogPrintf("Using huge pages mode %d for the coins cache and the mempool, NUMA node %d\n", nLargePages, std::max(-1, nNumaNode));
+    }
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1058,6 +1293,15 @@ bool AppInitParameterInteraction()
         fPruneMode = true;
     }
 
+    // SCDB and OP_RETURN data have their own retention, independent of -prune
+    nSidechainDBRetention = gArgs.GetArg("-sidechaindbretention", DEFAULT_SIDECHAIN_DB_RETENTION);
+    if (nSidechainDBRetention < 0) {
+        return InitError(_("Sidechain database retention cannot be configured with a negative value."));
+    }
+    if (gArgs.GetArg("-opreturnretention", DEFAULT_OPRETURN_RETENTION) < 0) {
+        return InitError(_("OP_RETURN retention cannot be configured with a negative value."));
+    }
+
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0)
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1084,6 +1328,10 @@ bool AppInitParameterInteraction()
             return InitError(AmountErrMsg("blockmintxfee", gArgs.GetArg("-blockmintxfee", "")));
     }
 
+    TemplateValidation templateValidation;
+    if (!ParseTemplateValidation(gArgs.GetArg("-templatevalidation", DEFAULT_TEMPLATE_VALIDATION), templateValidation))
+        return InitError(strprintf(_("Invalid -templatevalidation value: '%s'"), gArgs.GetArg("-templatevalidation", "")));
+
     // Feerate used to define dust.  Shouldn't be changed lightly as old
     // implementations may inadvertently create non-standard transactions
     if (gArgs.IsArgSet("-dustrelayfee"))
@@ -1114,6 +1362,13 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    // Serving compact block filters requires the index
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     if (gArgs.GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) < 0)
         return InitError("rpcserialversion must be non-negative.");
 
@@ -1254,13 +1509,53 @@ bool AppInitMain()
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
-    // Start the lightweight task scheduler thread
-    CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
+    g_blockcache.SetMaxSize(std::max<int64_t>(gArgs.GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE), 0) << 20);
+    scdb.SetMaxMemoryUsage(std::max<int64_t>(gArgs.GetArg("-maxscdbmemory", DEFAULT_MAX_SCDB_MEMORY), 0) << 20);
+
+    if (gArgs.GetBoolArg("-blockmmap", DEFAULT_BLOCK_MMAP)) {
+        LogPrintf("Mapping up to %d finished block files\n", BLOCK_MMAP_FILES);
+        g_blockfilemap = MakeUnique<CBlockFileMap>(BLOCK_MMAP_FILES);
+    }
+
+    // Read blocks ahead of the tip while connecting them, using the cores
+    // left over by script verification
+    int nPrefetchBlocks = gArgs.GetArg("-prefetchblocks", DEFAULT_PREFETCH_BLOCKS);
+    if (nPrefetchBlocks > 0) {
+        int nPrefetchThreads = std::max(1, std::min(GetNumCores() - std::max(nScriptCheckThreads, 1), MAX_PREFETCH_THREADS));
+        LogPrintf("Using %u threads to prefetch up to %d blocks\n", nPrefetchThreads, nPrefetchBlocks);
+        g_blockprefetcher = MakeUnique<CBlockPrefetcher>(chainparams.GetConsensus(), nPrefetchThreads, nPrefetchBlocks);
+        g_blockprefetcher->Start();
+    }
+
+    // Check the scripts of transactions from peers before they're accepted
+    // to the mempool, without holding cs_main
+    int nPrevalidateThreads = gArgs.GetArg("-prevalidatetxthreads", DEFAULT_PREVALIDATE_THREADS);
+    if (nPrevalidateThreads > 0) {
+        nPrevalidateThreads = std::min(nPrevalidateThreads, MAX_PREVALIDATE_THREADS);
+        LogPrintf("Using %u threads to pre-validate transactions\n", nPrevalidateThreads);
+        g_txprevalidator = MakeUnique<CTxPrevalidator>(nPrevalidateThreads, MAX_PREVALIDATE_TXS, [] {
+            if (g_connman)
+                g_connman->WakeMessageHandler();
+        });
+        g_txprevalidator->Start();
+    }
+
+    // Start the lightweight task scheduler threads, one for short periodic
+    // tasks and one for those writing to disk
+    CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceLane, &scheduler, SCHEDULER_LANE_FAST);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    CScheduler::Function serviceLoopBulk = boost::bind(&CScheduler::serviceLane, &scheduler, SCHEDULER_LANE_BULK);
+    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "schedbulk", serviceLoopBulk));
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(mempool);
 
+    // Compacting at a quiet time of the operator's choosing avoids LevelDB
+    // compacting in the middle of a burst of writes
+    int64_t nCompactInterval = gArgs.GetArg("-dbcompactinterval", DEFAULT_DB_COMPACT_INTERVAL);
+    if (nCompactInterval > 0)
+        scheduler.scheduleEvery(CompactDatabases, nCompactInterval * 60 * 60 * 1000, SCHEDULER_LANE_BULK, "compactdb");
+
     /* Register RPC commands regardless of -server setting so they will be
      * available in the GUI RPC console even if external calls are disabled.
      */
@@ -1300,7 +1595,7 @@ bool AppInitMain()
     CConnman& connman = *g_connman;
 
     peerLogic.reset(new PeerLogicValidation(&connman, scheduler));
-    RegisterValidationInterface(peerLogic.get());
+    RegisterValidationInterface(peerLogic.get(), "net");
 
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
@@ -1392,7 +1687,7 @@ bool AppInitMain()
     pzmqNotificationInterface = CZMQNotificationInterface::Create();
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        RegisterValidationInterface(pzmqNotificationInterface, "zmq");
     }
 #endif
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
@@ -1427,6 +1722,23 @@ bool AppInitMain()
     nTotalCache -= nBlockTreeDBCache;
     int64_t nSidechainTreeDBCache = nTotalCache / 4;
     nTotalCache -= nSidechainTreeDBCache;
+    int64_t nOPReturnDBCache = std::min(nSidechainTreeDBCache / 2, nMaxOPReturnDBCache << 20);
+    nSidechainTreeDBCache -= nOPReturnDBCache;
+    int64_t nAddressIndexDBCache = 0;
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        nAddressIndexDBCache = std::min(nTotalCache / 8, nMaxAddressIndexDBCache << 20);
+        nTotalCache -= nAddressIndexDBCache;
+    }
+    int64_t nBlockFilterIndexDBCache = 0;
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        nBlockFilterIndexDBCache = std::min(nTotalCache / 8, nMaxBlockFilterIndexDBCache << 20);
+        nTotalCache -= nBlockFilterIndexDBCache;
+    }
+    int64_t nCoinStatsIndexDBCache = 0;
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        nCoinStatsIndexDBCache = std::min(nTotalCache / 8, nMaxCoinStatsIndexDBCache << 20);
+        nTotalCache -= nCoinStatsIndexDBCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1435,6 +1747,14 @@ bool AppInitMain()
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for sidechain database\n", nSidechainTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for OP_RETURN database\n", nOPReturnDBCache * (1.0 / 1024 / 1024));
+    if (nAddressIndexDBCache)
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexDBCache * (1.0 / 1024 / 1024));
+    if (nBlockFilterIndexDBCache)
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterIndexDBCache * (1.0 / 1024 / 1024));
+    if (nCoinStatsIndexDBCache)
+        LogPrintf("* Using %.1fMiB for coin stats index database\n", nCoinStatsIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
@@ -1450,14 +1770,16 @@ bool AppInitMain()
             try {
                 UnloadBlockIndex();
                 pcoinsTip.reset();
+                pcoinsflush.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
                 pblocktree.reset();
                 pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset));
+                scdb.SetDepositDB(nullptr);
                 psidechaintree.reset();
                 psidechaintree.reset(new CSidechainTreeDB(nSidechainTreeDBCache, false, fReset));
                 popreturndb.reset();
-                popreturndb.reset(new OPReturnDB(nOPReturnCache, false, fReset));
+                popreturndb.reset(new OPReturnDB(nOPReturnDBCache, false, fReset));
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1469,7 +1791,7 @@ bool AppInitMain()
 
                 if (fRequestShutdown) break;
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
+                // LoadBlockIndex will load fBMMIndex from the db, or set it if
                 // we're reindexing. It will also load fHavePruned if we've
                 // ever removed a block file from disk.
                 // Note that it also sets fReindex based on the disk flag!
@@ -1484,9 +1806,9 @@ bool AppInitMain()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
+                // Check for changed -bmmindex state
+                if (fBMMIndex != gArgs.GetBoolArg("-bmmindex", DEFAULT_BMMINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -bmmindex");
                     break;
                 }
 
@@ -1509,6 +1831,17 @@ bool AppInitMain()
                 // At this point we're either in reindex or we've loaded a useful
                 // block tree into mapBlockIndex!
 
+                // Remember the tip of the chainstate we are about to wipe, the
+                // replay reports its progress towards it
+                uint256 hashReindexTarget;
+                if (fReindexChainState && !fReset) {
+                    try {
+                        hashReindexTarget = CCoinsViewDB(nCoinDBCache, false, false).GetBestBlock();
+                    } catch (const std::exception& e) {
+                        LogPrintf("Failed to read the best block of the chainstate: %s\n", e.what());
+                    }
+                }
+
                 pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState));
                 pcoinscatcher.reset(new CCoinsViewErrorCatcher(pcoinsdbview.get()));
 
@@ -1526,7 +1859,8 @@ bool AppInitMain()
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinsflush.reset(new CCoinsViewBackgroundFlush(pcoinscatcher.get(), pcoinsdbview.get()));
+                pcoinsTip.reset(new CCoinsViewCache(pcoinsflush.get()));
 
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
@@ -1538,6 +1872,13 @@ bool AppInitMain()
                     assert(chainActive.Tip() != nullptr);
                 }
 
+                // Entries older versions wrote in ConnectBlock cover the
+                // chain up to the tip of the chainstate
+                if (!UpgradeLegacyTxIndex()) {
+                    strLoadError = _("Error upgrading block database");
+                    break;
+                }
+
     		    drivechainsEnabled = IsDrivechainEnabled(chainActive.Tip(), chainparams.GetConsensus());
 
                 // Synchronize SCDB
@@ -1554,7 +1895,10 @@ bool AppInitMain()
                     }
                 }
 
-                if (skydogesEnabled && !fReindex) {
+                if (fReindexChainState && !fReindex) {
+                    BlockMap::const_iterator it = mapBlockIndex.find(hashReindexTarget);
+                    StartReindexChainState(it != mapBlockIndex.end() ? it->second : nullptr, skydogesEnabled);
+                } else if (skydogesEnabled && !fReindex) {
                     if (!LoadDepositCache()) {
                         // Ask to reindex to fix issue loading DAT
                         bool fRet = uiInterface.ThreadSafeQuestion(
@@ -1573,6 +1917,10 @@ bool AppInitMain()
                             return InitError("Aborted reindex. Exiting.\n");
                         }
                     }
+                } else if (skydogesEnabled) {
+                    // Deposits will be written to the wiped sidechain tree
+                    // database as blocks are reindexed
+                    scdb.SetDepositDB(psidechaintree.get());
                 }
 
                 if (!fReset) {
@@ -1616,17 +1964,18 @@ bool AppInitMain()
                 if (skydogesEnabled) {
                     // We want to read the user's data even if reindexing - this data
                     // was created by the user and is not in any block
-                    if (!LoadSidechainProposalCache() ||
-                            !LoadSidechainActivationHashCache() ||
-                            !LoadCustomVoteCache() ||
-                            !LoadBMMCache() ||
-                            !LoadWithdrawalCache(fReindex))
+                    if (!LoadSCDBCache(fReindex || fReindexChainState))
                     {
                         std::string strError = "Error loading withdrawal vote & BMM settings!\n\n";
                         strError += "You may need to re-set any vote settings you have made.";
                         uiInterface.ThreadSafeMessageBox(_(strError.c_str()), "", CClientUIInterface::MSG_ERROR);
                         LogPrintf("Error reading custom vote cache.\n");
                     }
+                    else
+                    if (!StartSCDBLog())
+                    {
+                        LogPrintf("Failed to start the SCDB cache log, caches will only be written when flushing.\n");
+                    }
                 }
                 // Load address book
                 if (!LoadAddressBook())
@@ -1670,6 +2019,8 @@ bool AppInitMain()
     }
     if (fLoaded) {
         LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
+        if (gArgs.GetBoolArg("-checkheaderhashes", DEFAULT_CHECK_HEADER_HASHES))
+            threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "hdrcheck", &ThreadCheckHeaderHashes));
     }
 
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
@@ -1679,6 +2030,52 @@ bool AppInitMain()
         ::feeEstimator.Read(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // Cache the BMM commitments of the blocks connected from now on
+    if (gArgs.GetArg("-bmmcache", DEFAULT_BMM_CACHE_BLOCKS) > 0) {
+        g_bmmcache = MakeUnique<CBMMCache>(gArgs.GetArg("-bmmcache", DEFAULT_BMM_CACHE_BLOCKS));
+        g_bmmcache->Start();
+    }
+
+    // Index transactions in the background, catching up from wherever the
+    // index was when it was last enabled
+    if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        g_txindex = MakeUnique<TxIndex>();
+        if (!g_txindex->Start())
+            return false;
+    }
+
+    // Index the outputs and spends of every script in the background. A
+    // reindex rebuilds the chain from genesis, so the index starts over too
+    // rather than unwinding every block.
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_addressindex = MakeUnique<AddressIndex>(nAddressIndexDBCache, false, fReindex || fReindexChainState);
+        if (!g_addressindex->Start())
+            return false;
+    }
+
+    // Compute the basic filter of every block in the background. Filters
+    // are stored by block hash and stay valid, so only a reindex wipes them.
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        g_blockfilterindex = MakeUnique<BlockFilterIndex>(BlockFilterType::BASIC, nBlockFilterIndexDBCache, false, fReindex);
+        if (!g_blockfilterindex->Start())
+            return false;
+    }
+
+    // Keep the stats of the UTXO set after every block in the background,
+    // so that gettxoutsetinfo doesn't have to read the chainstate
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coinstatsindex = MakeUnique<CoinStatsIndex>(nCoinStatsIndexDBCache, false, fReindex);
+        if (!g_coinstatsindex->Start())
+            return false;
+    }
+
+    // Index OP_RETURN outputs in the background, off the block connection path
+    if (gArgs.GetBoolArg("-opreturnindex", DEFAULT_OPRETURNINDEX)) {
+        g_opreturnindex = MakeUnique<OPReturnIndex>(popreturndb.get(), gArgs.GetArg("-opreturnretention", DEFAULT_OPRETURN_RETENTION));
+        if (!g_opreturnindex->Start())
+            return false;
+    }
+
     // ********************************************************* Step 9: load wallet
 #ifdef ENABLE_WALLET
     if (!OpenWallets())
@@ -1843,6 +2240,12 @@ if (nHeight < DrivechainHeight) {
     if (gArgs.GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    if (gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE)) {
+        std::string strError;
+        if (!StartStratum(strError))
+            return InitError(strError);
+    }
+
     Discover(threadGroup);
 
     // Map ports with UPnP
@@ -1860,6 +2263,7 @@ if (nHeight < DrivechainHeight) {
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
+    connOptions.strSocketEvents = gArgs.GetArg("-socketevents", DefaultSocketEvents());
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
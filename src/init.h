@@ -16,6 +16,9 @@ namespace boost
 class thread_group;
 } // namespace boost
 
+/** The scheduler running the node's periodic tasks */
+CScheduler& GetScheduler();
+
 void StartShutdown();
 bool ShutdownRequested();
 /** Interrupt threads */
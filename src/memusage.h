@@ -9,8 +9,10 @@
 
 #include <stdlib.h>
 
+#include <deque>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -92,6 +94,22 @@ static inline size_t DynamicUsage(const prevector<N, X, S, D>& v)
     return MallocUsage(v.allocated_memory());
 }
 
+template<typename X>
+static inline size_t DynamicUsage(const std::deque<X>& d)
+{
+    // Elements are stored in chunks of 512 bytes (or one element if larger),
+    // found through a map of pointers to the chunks
+    const size_t nPerChunk = sizeof(X) < 512 ? 512 / sizeof(X) : 1;
+    const size_t nChunks = d.size() / nPerChunk + 1;
+    return MallocUsage(sizeof(X) * nPerChunk) * nChunks + MallocUsage(sizeof(void*) * (nChunks + 2 > 8 ? nChunks + 2 : 8));
+}
+
+static inline size_t DynamicUsage(const std::string& s)
+{
+    // Short strings are stored in the object itself
+    return s.capacity() > 15 ? MallocUsage(s.capacity() + 1) : 0;
+}
+
 template<typename X, typename Y>
 static inline size_t DynamicUsage(const std::set<X, Y>& s)
 {
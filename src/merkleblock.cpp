@@ -7,8 +7,11 @@
 
 #include <hash.h>
 #include <consensus/consensus.h>
+#include <crypto/sha256.h>
 #include <utilstrencodings.h>
 
+#include <algorithm>
+
 
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids)
 {
@@ -44,17 +47,20 @@ uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::ve
     if (height == 0) {
         // hash at height 0 is the txids themself
         return vTxid[pos];
-    } else {
-        // calculate left hash
-        uint256 left = CalcHash(height-1, pos*2, vTxid), right;
-        // calculate right hash if not beyond the end of the array - copy left hash otherwise
-        if (pos*2+1 < CalcTreeWidth(height-1))
-            right = CalcHash(height-1, pos*2+1, vTxid);
-        else
-            right = left;
-        // combine subhashes
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
     }
+    // hash the txids under this node one level at a time, so that each level
+    // is a single SHA256D64 call
+    const size_t nBegin = (size_t)pos << height;
+    const size_t nEnd = std::min((size_t)(pos + 1) << height, (size_t)nTransactions);
+    std::vector<uint256> vHash(vTxid.begin() + nBegin, vTxid.begin() + nEnd);
+    for (int h = 0; h < height; h++) {
+        // past the end of the level - copy the last hash
+        if (vHash.size() & 1)
+            vHash.push_back(vHash.back());
+        SHA256D64(vHash[0].begin(), vHash[0].begin(), vHash.size() / 2);
+        vHash.resize(vHash.size() / 2);
+    }
+    return vHash[0];
 }
 
 void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
@@ -109,7 +115,9 @@ uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, uns
             right = left;
         }
         // and combine them before returning
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+        uint256 pair[2] = {left, right};
+        SHA256D64(pair[0].begin(), pair[0].begin(), 1);
+        return pair[0];
     }
 }
 
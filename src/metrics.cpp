@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <metrics.h>
+
+#include <blockcache.h>
+#include <httpserver.h>
+#include <net.h>
+#include <rpc/protocol.h>
+#include <script/sigcache.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+NodeMetrics g_metrics;
+
+void UpdateSidechainMetrics(const SidechainDB& db)
+{
+    for (unsigned int i = 0; i < 256; i++) {
+        SidechainMetrics& m = g_metrics.sidechain[i];
+        const uint8_t nSidechain = i;
+
+        if (!db.IsSidechainActive(nSidechain)) {
+            m.fActive.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        SidechainCTIP ctip;
+        const CAmount nCTIPValue = db.GetCTIP(nSidechain, ctip) ? ctip.amount : 0;
+
+        const std::vector<SidechainWithdrawalState>& vState = db.GetState(nSidechain);
+        uint64_t nBestWorkScore = 0;
+        for (const SidechainWithdrawalState& state : vState)
+            nBestWorkScore = std::max<uint64_t>(nBestWorkScore, state.nWorkScore);
+
+        m.nDeposits.store(db.GetDepositCount(nSidechain), std::memory_order_relaxed);
+        m.nCTIPValue.store(nCTIPValue, std::memory_order_relaxed);
+        m.nPendingWithdrawals.store(vState.size(), std::memory_order_relaxed);
+        m.nBestWorkScore.store(nBestWorkScore, std::memory_order_relaxed);
+        m.fActive.store(true, std::memory_order_relaxed);
+    }
+}
+
+static void WriteMetric(std::string& str, const char* name, const char* type, const char* help)
+{
+    str += strprintf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+template <typename T>
+static void WriteMetric(std::string& str, const char* name, const char* type, const char* help, T value)
+{
+    WriteMetric(str, name, type, help);
+    str += strprintf("%s %d\n", name, value);
+}
+
+static void WriteSidechainMetric(std::string& str, const char* name, const char* help, std::atomic<uint64_t> SidechainMetrics::*field)
+{
+    WriteMetric(str, name, "gauge", help);
+    for (unsigned int i = 0; i < 256; i++) {
+        const SidechainMetrics& m = g_metrics.sidechain[i];
+        if (m.fActive.load(std::memory_order_relaxed))
+            str += strprintf("%s{sidechain=\"%u\"} %d\n", name, i, (m.*field).load(std::memory_order_relaxed));
+    }
+}
+
+static bool metrics_handler(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET is supported\r\n");
+        return false;
+    }
+
+    std::string str;
+
+    WriteMetric(str, "skydoge_chain_height", "gauge", "Height of the active chain tip.",
+            g_metrics.nChainHeight.load(std::memory_order_relaxed));
+
+    WriteMetric(str, "skydoge_mempool_transactions", "gauge", "Number of transactions in the mempool.",
+            mempool.GetCountRelaxed());
+    WriteMetric(str, "skydoge_mempool_bytes", "gauge", "Total virtual size of the mempool transactions.",
+            mempool.GetTotalTxSizeRelaxed());
+
+    WriteMetric(str, "skydoge_coins_cache_bytes", "gauge", "Memory used by the coins cache as of the last flush check.",
+            g_metrics.nCoinsCacheUsage.load(std::memory_order_relaxed));
+    WriteMetric(str, "skydoge_coins_cache_entries", "gauge", "Coins in the coins cache as of the last flush check.",
+            g_metrics.nCoinsCacheEntries.load(std::memory_order_relaxed));
+
+    // Counters rather than a hit rate, so that the rate can be taken over
+    // whatever window the scraper wants
+    SignatureCacheStats sigstats;
+    GetSignatureCacheStats(sigstats);
+    WriteMetric(str, "skydoge_sigcache_hits_total", "counter", "Signature cache lookups that found the signature.",
+            sigstats.nHits);
+    WriteMetric(str, "skydoge_sigcache_misses_total", "counter", "Signature cache lookups that had to verify the signature.",
+            sigstats.nMisses);
+
+    BlockCacheStats blockstats = g_blockcache.GetStats();
+    WriteMetric(str, "skydoge_blockcache_hits_total", "counter", "Block lookups answered from the decoded block cache.",
+            blockstats.nHits);
+    WriteMetric(str, "skydoge_blockcache_misses_total", "counter", "Block lookups that read the block from disk.",
+            blockstats.nMisses);
+
+    if (g_connman) {
+        WriteMetric(str, "skydoge_peers", "gauge", "Number of connected peers.");
+        str += strprintf("skydoge_peers{direction=\"inbound\"} %u\n", g_connman->GetNodeCountRelaxed(CConnman::CONNECTIONS_IN));
+        str += strprintf("skydoge_peers{direction=\"outbound\"} %u\n", g_connman->GetNodeCountRelaxed(CConnman::CONNECTIONS_OUT));
+    }
+
+    WriteSidechainMetric(str, "skydoge_sidechain_deposits", "Number of deposits to the sidechain.",
+            &SidechainMetrics::nDeposits);
+
+    WriteMetric(str, "skydoge_sidechain_ctip_value", "gauge", "Value of the sidechain CTIP output in satoshis.");
+    for (unsigned int i = 0; i < 256; i++) {
+        const SidechainMetrics& m = g_metrics.sidechain[i];
+        if (m.fActive.load(std::memory_order_relaxed))
+            str += strprintf("skydoge_sidechain_ctip_value{sidechain=\"%u\"} %d\n", i, m.nCTIPValue.load(std::memory_order_relaxed));
+    }
+
+    WriteSidechainMetric(str, "skydoge_sidechain_pending_withdrawals", "Number of withdrawal bundles being voted on.",
+            &SidechainMetrics::nPendingWithdrawals);
+    WriteSidechainMetric(str, "skydoge_sidechain_best_workscore", "Highest workscore of the withdrawal bundles being voted on.",
+            &SidechainMetrics::nBestWorkScore);
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, str);
+    return true;
+}
+
+bool StartMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, metrics_handler);
+    return true;
+}
+
+void InterruptMetrics()
+{
+}
+
+void StopMetrics()
+{
+    UnregisterHTTPHandler("/metrics", true);
+}
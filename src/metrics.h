@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_METRICS_H
+#define BITCOIN_METRICS_H
+
+#include <amount.h>
+
+#include <atomic>
+#include <stdint.h>
+
+class SidechainDB;
+
+/** Default for -metrics */
+static const bool DEFAULT_METRICS_ENABLE = false;
+
+/** Gauges of one sidechain, only exported while fActive is set */
+struct SidechainMetrics
+{
+    std::atomic<bool> fActive{false};
+    std::atomic<uint64_t> nDeposits{0};
+    std::atomic<CAmount> nCTIPValue{0};
+    std::atomic<uint64_t> nPendingWithdrawals{0};
+    std::atomic<uint64_t> nBestWorkScore{0};
+};
+
+/**
+ * Node state exported by the /metrics endpoint that isn't already kept in an
+ * atomic by its owner. The values are stored where they change (tip updates,
+ * coins cache flushes) so that a scrape only loads atomics and never waits on
+ * cs_main or the mempool lock.
+ */
+struct NodeMetrics
+{
+    std::atomic<int> nChainHeight{-1};
+    std::atomic<uint64_t> nCoinsCacheUsage{0};
+    std::atomic<uint64_t> nCoinsCacheEntries{0};
+    SidechainMetrics sidechain[256];
+};
+
+extern NodeMetrics g_metrics;
+
+/** Refresh the sidechain gauges after SCDB has changed, cs_main must be held */
+void UpdateSidechainMetrics(const SidechainDB& db);
+
+/** Start the /metrics HTTP handler.
+ * Precondition; HTTP has been initialized.
+ */
+bool StartMetrics();
+/** Interrupt the /metrics HTTP handler.
+ */
+void InterruptMetrics();
+/** Stop the /metrics HTTP handler.
+ * Precondition; HTTP has been stopped.
+ */
+void StopMetrics();
+
+#endif // BITCOIN_METRICS_H
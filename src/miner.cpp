@@ -21,10 +21,12 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
+#include "random.h"
 #include "script/standard.h"
 #include "sidechain.h"
 #include "sidechaindb.h"
 #include "timedata.h"
+#include "trace.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -36,14 +38,18 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <queue>
+#include <system_error>
+#include <thread>
 #include <utility>
 
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 
-static const bool fMiningReqiresPeer = false;
-
 //////////////////////////////////////////////////////////////////////////////
 //
 // BitcoinMiner
@@ -61,6 +67,22 @@ uint256 hashTarget = uint256();
 uint256 hashBest = uint256();
 uint32_t nMiningNonce = 0;
 
+#ifdef ENABLE_WALLET
+/** A withdrawal payout made by CreateWithdrawalPayout. The payout only
+ * depends on the withdrawal paid out, the CTIP it spends, and the coins at the
+ * tip, so it is reused by templates until one of those changes. */
+struct CachedWithdrawalPayout {
+    uint256 hashTip;
+    uint256 hashWithdrawal;
+    SidechainCTIP ctip;
+    CMutableTransaction tx;
+    CAmount nFees;
+};
+
+/** Withdrawal payouts by nSidechain, guarded by cs_main */
+static std::map<uint8_t, CachedWithdrawalPayout> mapWithdrawalPayoutCache;
+#endif
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -73,17 +95,78 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     if (consensusParams.fPowAllowMinDifficultyBlocks)
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, consensusParams);
 
+    pblock->InvalidateHash();
+
     return nNewTime - nOldTime;
 }
 
+bool ParseTemplateValidation(const std::string& str, TemplateValidation& validation)
+{
+    if (str == "full")
+        validation = TemplateValidation::FULL;
+    else if (str == "light")
+        validation = TemplateValidation::LIGHT;
+    else if (str == "sampled")
+        validation = TemplateValidation::SAMPLED;
+    else
+        return false;
+    return true;
+}
+
+/** Add the mempool ancestors of it to ancestors */
+static void CollectAncestors(const CTxMemPool& pool, CTxMemPool::txiter it, CTxMemPool::setEntries& ancestors)
+{
+    std::vector<CTxMemPool::txiter> vStack{it};
+    while (!vStack.empty()) {
+        CTxMemPool::txiter entry = vStack.back();
+        vStack.pop_back();
+        for (const CTxMemPool::txiter& parent : pool.GetMemPoolParents(entry)) {
+            if (ancestors.insert(parent).second)
+                vStack.push_back(parent);
+        }
+    }
+}
+
+void CalculatePackageAncestors(const CTxMemPool& pool, const std::vector<CTxMemPool::txiter>& vTx, std::vector<CTxMemPool::setEntries>& vAncestors, int nThreads)
+{
+    AssertLockHeld(pool.cs);
+
+    vAncestors.assign(vTx.size(), CTxMemPool::setEntries());
+    nThreads = std::max(1, std::min<int>(nThreads, vTx.size()));
+
+    // Each thread takes every nThreads'th transaction. CTxMemPool's own
+    // ancestor search marks the entries it visits in the mempool, so the
+    // threads use their results as the visited set instead.
+    auto work = [&pool, &vTx, &vAncestors, nThreads](int nThread) {
+        for (size_t i = nThread; i < vTx.size(); i += nThreads)
+            CollectAncestors(pool, vTx[i], vAncestors[i]);
+    };
+
+    std::vector<std::thread> vThread;
+    for (int i = 1; i < nThreads; i++) {
+        try {
+            vThread.emplace_back(work, i);
+        } catch (const std::system_error&) {
+            work(i);
+        }
+    }
+    work(0);
+    for (std::thread& thread : vThread)
+        thread.join();
+}
+
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    templateValidation = TemplateValidation::FULL;
+    nThreads = 1;
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
 {
     blockMinFeeRate = options.blockMinFeeRate;
+    templateValidation = options.templateValidation;
+    nThreads = std::max(1, std::min(MAX_BLOCK_ASSEMBLY_THREADS, options.nThreads));
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
 }
@@ -103,6 +186,11 @@ static BlockAssembler::Options DefaultOptions(const CChainParams& params)
     } else {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    // Checked at startup
+    ParseTemplateValidation(gArgs.GetArg("-templatevalidation", DEFAULT_TEMPLATE_VALIDATION), options.templateValidation);
+    options.nThreads = gArgs.GetArg("-blockassemblythreads", DEFAULT_BLOCK_ASSEMBLY_THREADS);
+    if (options.nThreads <= 0)
+        options.nThreads = GetNumCores();
     return options;
 }
 
@@ -111,6 +199,8 @@ BlockAssembler::BlockAssembler(const CChainParams& params) : BlockAssembler(para
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    setBMMExcluded.clear();
+    vCriticalDataTx.clear();
 
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
@@ -181,8 +271,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         // Remove expired BMM requests from our memory pool
         std::vector<uint256> vHashRemoved;
         mempool.RemoveExpiredCriticalRequests(vHashRemoved);
-        // Select which BMM requests (if any) to include
-        mempool.SelectBMMRequests(vHashRemoved);
+        // Remove BMM requests for sidechains that aren't active anymore
+        mempool.RemoveInactiveBMMRequests(vHashRemoved);
 
         // Track what was removed from the mempool so that we can abandon later
         for (const uint256& u : vHashRemoved)
@@ -220,11 +310,20 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         }
     }
 
+    // Select which BMM requests (if any) to include
+    if (fDrivechainEnabled)
+        SelectBMMRequests(vActiveSidechain);
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
     bool fNeedCriticalFeeTx = false;
     addPackageTxs(nPackagesSelected, nDescendantsUpdated, fDrivechainEnabled, fNeedCriticalFeeTx, setSidechainsWithWithdrawal);
 
+    for (BMMAuctionResult& result : pblocktemplate->vBMMAuction) {
+        CTxMemPool::txiter it = mempool.mapTx.find(result.txid);
+        result.fIncluded = it != mempool.mapTx.end() && inBlock.count(it);
+    }
+
     int64_t nTime1 = GetTimeMicros();
 
     nLastBlockTx = nBlockTx;
@@ -241,8 +340,9 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     coinbaseTx.vout[0].nValue = nWithdrawalFees + nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
 
-    // Add coinbase to block
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    // Commitments for the coinbase, added to it at once when they have all
+    // been collected
+    CoinbaseCommitments commitments;
 
     // Commit new withdrawals which we have received locally
     std::map<uint8_t /* nSidechain */, uint256 /* hash withdrawal */> mapNewWithdrawal;
@@ -262,7 +362,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
         // For now, if there are fresh (uncommitted, unknown to SCDB) Withdrawal(s)
         // we will commit the most recent in the block we are generating.
-        GenerateWithdrawalHashCommitment(*pblock, hash, s.nSidechain);
+        commitments.vWithdrawal.emplace_back(s.nSidechain, hash);
 
         // Keep track of new Withdrawal(s) by nSidechain for later
         mapNewWithdrawal[s.nSidechain] = hash;
@@ -272,36 +372,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     // Handle Withdrawal updates
     if (fDrivechainEnabled && scdb.HasState()) {
-        // Get withdrawal vote settings
-        std::vector<std::string> vVote = scdb.GetVotes();
-
-        std::vector<std::vector<SidechainWithdrawalState>> vOldScores;
-        for (const Sidechain& s : vActiveSidechain) {
-            std::vector<SidechainWithdrawalState> vWithdrawal = scdb.GetState(s.nSidechain);
-            if (vWithdrawal.size())
-                vOldScores.push_back(vWithdrawal);
-        }
-
-        LogPrintf("%s: Miner generating scdb bytes at height %u.\n", __func__, nHeight);
-        CScript script;
-        if (!GenerateSCDBByteCommitment(*pblock, script, vOldScores, vVote)) {
-            LogPrintf("%s: Miner failed to generate scdb bytes at height %u.\n", __func__, nHeight);
-            throw std::runtime_error(strprintf("%s: Miner failed to generate scdb bytes at height %u.\n",
-                                               __func__, nHeight));
-        }
-
-        // Make sure that we can read the update bytes
-        std::vector<std::string> vVoteParsed;
-        if (!ParseSCDBBytes(script, vOldScores, vVoteParsed)) {
-            LogPrintf("%s: Miner failed to parse its own scdb bytes at height %u.\n", __func__, nHeight);
-            throw std::runtime_error(strprintf("%s: Miner failed to parse its own update bytes at height %u.\n",
-                                               __func__, nHeight));
-        }
+        // SCDB keeps the update bytes for our withdrawal votes up to date, so
+        // we only have to add them to the coinbase
+        commitments.vSCDBBytes.push_back(scdb.GetSCDBByteCommitment());
     }
 
     if (fDrivechainEnabled) {
-        // Generate critical hash commitments (usually for BMM commitments)
-        GenerateCriticalHashCommitments(*pblock);
+        // Critical hash commitments (usually for BMM commitments) of the
+        // critical data transactions that were added to the block
+        for (const CTransactionRef& tx : vCriticalDataTx)
+            commitments.vCriticalData.push_back(tx->criticalData);
 
         // Scan through our sidechain proposals and commit the first one we find
         // that hasn't already been committed and is tracked by SCDB.
@@ -310,20 +390,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         uint256 hashProposal;
         std::vector<Sidechain> vProposal = scdb.GetSidechainProposals();
         if (!vProposal.empty()) {
-            std::vector<SidechainActivationStatus> vActivation = scdb.GetSidechainActivationStatus();
             for (const Sidechain& p : vProposal) {
                 // Check if this proposal is unique
-                bool fFound = false;
-                for (const SidechainActivationStatus& s : vActivation) {
-                    if (s.proposal == p) {
-                        fFound = true;
-                        break;
-                    }
-                }
-                if (fFound)
+                if (scdb.HaveActivationStatus(p.GetSerHash()))
                     continue;
 
-                GenerateSidechainProposalCommitment(*pblock, p);
+                commitments.vProposal.push_back(p);
                 hashProposal = p.GetSerHash();
                 LogPrintf("%s: Generated sidechain proposal commitment for:\n%s\n", __func__, p.ToString());
                 break;
@@ -336,20 +408,24 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
         // Commit sidechain activation for proposals in activation status cache
         // which we have configured to ACK
-        std::vector<SidechainActivationStatus> vActivationStatus;
-        vActivationStatus = scdb.GetSidechainActivationStatus();
+        const std::vector<SidechainActivationStatus>& vActivationStatus = scdb.GetSidechainActivationStatus();
         std::map<uint8_t, bool> mapCommit;
         for (const SidechainActivationStatus& s : vActivationStatus) {
-            if (fAnySidechain || scdb.GetAckSidechain(s.proposal.GetSerHash())) {
+            if (fAnySidechain || scdb.GetAckSidechain(s.hashProposal)) {
                 // Don't generate more than one commit for the same SC #
                 if (mapCommit.find(s.proposal.nSidechain) == mapCommit.end()) {
-                    GenerateSidechainActivationCommitment(*pblock, s.proposal.GetSerHash());
+                    commitments.vActivation.push_back(s.hashProposal);
                     mapCommit[s.proposal.nSidechain] = true;
                 }
             }
         }
     }
 
+    // Add coinbase with the commitments to block
+    std::vector<CTxOut> vCommitment = commitments.GetOutputs();
+    coinbaseTx.vout.insert(coinbaseTx.vout.end(), vCommitment.begin(), vCommitment.end());
+    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+
     // TODO reserve room when selecting txns so that there's always space for
     // the Withdrawal(s)
     // Add Withdrawal(s) that we created earlier to the block
@@ -367,16 +443,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         feeTx.vout[0].scriptPubKey = scriptPubKeyIn;
         feeTx.vout[0].nValue = CAmount(0);
 
-        // Find all of the critical data transactions included in the block
-        // and take their input and total amount
-        for (const CTransactionRef& tx : pblock->vtx) {
-            if (tx && !tx->criticalData.IsNull()) {
-                // Try to find the critical data fee output and take it
-                for (uint32_t i = 0; i < tx->vout.size(); i++) {
-                    if (tx->vout[i].scriptPubKey == CScript() << OP_TRUE) {
-                        feeTx.vin.push_back(CTxIn(tx->GetHash(), i));
-                        feeTx.vout[0].nValue += tx->vout[i].nValue;
-                    }
+        // Take the input and total amount of all of the critical data
+        // transactions included in the block
+        const CScript scriptFee = CScript() << OP_TRUE;
+        for (const CTransactionRef& tx : vCriticalDataTx) {
+            // Try to find the critical data fee output and take it
+            for (uint32_t i = 0; i < tx->vout.size(); i++) {
+                if (tx->vout[i].scriptPubKey == scriptFee) {
+                    feeTx.vin.push_back(CTxIn(tx->GetHash(), i));
+                    feeTx.vout[0].nValue += tx->vout[i].nValue;
                 }
             }
         }
@@ -409,9 +484,17 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
+    // Blocks made of mempool transactions only need to be connected to
+    // catch bugs, which -templatevalidation can trade for template latency
+    const bool fFullValidation = templateValidation == TemplateValidation::FULL ||
+        (templateValidation == TemplateValidation::SAMPLED && GetRand(TEMPLATE_VALIDATION_SAMPLE_RATE) == 0);
     CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
-        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+    if (fFullValidation) {
+        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        }
+    } else if (!TestBlockValidityLight(state, chainparams, *pblock, pindexPrev)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidityLight failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
 
@@ -459,10 +542,76 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
             if (nHeight != (int64_t)it->GetTx().nLockTime + 1)
                 return false;
         }
+        if (setBMMExcluded.count(it))
+            return false;
     }
     return true;
 }
 
+/** What a BMM request pays the miner: its fee and the critical data fee
+ * output that the critical fee tx collects */
+static CAmount GetBMMRequestAmount(const CTxMemPoolEntry& entry)
+{
+    CAmount amount = entry.GetModifiedFee();
+    for (const CTxOut& out : entry.GetTx().vout) {
+        if (out.scriptPubKey == CScript() << OP_TRUE)
+            amount += out.nValue;
+    }
+    return amount;
+}
+
+void RunBMMAuction(const CTxMemPool& pool, int nHeight, const std::vector<Sidechain>& vActiveSidechain, std::vector<BMMAuctionResult>& vResult, CTxMemPool::setEntries& setExcluded)
+{
+    AssertLockHeld(pool.cs);
+
+    std::vector<bool> vActive(std::numeric_limits<uint8_t>::max() + 1, false);
+    for (const Sidechain& s : vActiveSidechain)
+        vActive[s.nSidechain] = true;
+
+    // The mempool's critical data entries start with the BMM requests
+    // grouped by sidechain
+    CTxMemPool::txiter itBest;
+    for (const CTxMemPool::txiter& it : pool.GetCriticalData()) {
+        if (!it->IsBMMRequest())
+            break;
+
+        // Expired requests and requests for inactive sidechains are removed
+        // from the mempool by wallet builds only, skip them here
+        const uint8_t nSidechain = it->GetBMMSidechainNumber();
+        if (nHeight != (int64_t)it->GetTx().nLockTime + 1 || !vActive[nSidechain]) {
+            setExcluded.insert(it);
+            continue;
+        }
+
+        const CAmount amount = GetBMMRequestAmount(*it);
+        if (vResult.empty() || vResult.back().nSidechain != nSidechain) {
+            BMMAuctionResult result;
+            result.nSidechain = nSidechain;
+            result.nRequests = 0;
+            result.txid = it->GetTx().GetHash();
+            result.amount = amount;
+            result.fIncluded = false;
+            vResult.push_back(result);
+            itBest = it;
+        } else if (amount > vResult.back().amount) {
+            setExcluded.insert(itBest);
+            vResult.back().txid = it->GetTx().GetHash();
+            vResult.back().amount = amount;
+            itBest = it;
+        } else {
+            setExcluded.insert(it);
+        }
+        vResult.back().nRequests++;
+    }
+
+    TRACE2(miner, bmm_auction, vResult.size(), setExcluded.size());
+}
+
+void BlockAssembler::SelectBMMRequests(const std::vector<Sidechain>& vActiveSidechain)
+{
+    RunBMMAuction(mempool, nHeight, vActiveSidechain, pblocktemplate->vBMMAuction, setBMMExcluded);
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -473,6 +622,8 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nBlockSigOpsCost += iter->GetSigOpCost();
     nFees += iter->GetFee();
     inBlock.insert(iter);
+    if (!iter->GetTx().criticalData.IsNull())
+        vCriticalDataTx.push_back(iter->GetSharedTx());
 
     bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
@@ -486,8 +637,8 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
         indexed_modified_transaction_set &mapModifiedTx)
 {
     int nDescendantsUpdated = 0;
+    std::vector<CTxMemPool::txiter> descendants;
     for (const CTxMemPool::txiter it : alreadyAdded) {
-        CTxMemPool::setEntries descendants;
         mempool.CalculateDescendants(it, descendants);
         // Insert all descendants (not yet in block) into the modified set
         for (CTxMemPool::txiter desc : descendants) {
@@ -533,7 +684,7 @@ bool BlockAssembler::CreateWithdrawalPayout(uint8_t nSidechain, CMutableTransact
     // Select the highest scoring withdrawal for sidechain
     uint256 hashBest = uint256();
     uint16_t scoreBest = 0;
-    std::vector<SidechainWithdrawalState> vState = scdb.GetState(nSidechain);
+    const std::vector<SidechainWithdrawalState>& vState = scdb.GetState(nSidechain);
     for (const SidechainWithdrawalState& state : vState) {
         if (state.nWorkScore > scoreBest || scoreBest == 0) {
             hashBest = state.hash;
@@ -547,36 +698,49 @@ bool BlockAssembler::CreateWithdrawalPayout(uint8_t nSidechain, CMutableTransact
     if (scoreBest < SIDECHAIN_WITHDRAWAL_MIN_WORKSCORE)
         return false;
 
-    // Copy outputs from withdrawal tx
-    std::vector<std::pair<uint8_t, CMutableTransaction>> vTx = scdb.GetWithdrawalTxCache();
-    for (const std::pair<uint8_t, CMutableTransaction>& pair : vTx) {
-        if (pair.second.GetHash() == hashBest) {
-            for (const CTxOut& out : pair.second.vout)
-                mtx.vout.push_back(out);
-            break;
+    // Get sidechain's CTIP
+    SidechainCTIP ctip;
+    if (!scdb.GetCTIP(nSidechain, ctip))
+        return false;
+
+    // Reuse the payout of the last template if nothing it depends on changed
+    const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    std::map<uint8_t, CachedWithdrawalPayout>::const_iterator itCached = mapWithdrawalPayoutCache.find(nSidechain);
+    if (itCached != mapWithdrawalPayoutCache.end()) {
+        const CachedWithdrawalPayout& cached = itCached->second;
+        if (cached.hashTip == hashTip && cached.hashWithdrawal == hashBest &&
+                cached.ctip.out == ctip.out && cached.ctip.amount == ctip.amount) {
+            tx = cached.tx;
+            nFees = cached.nFees;
+            return true;
         }
     }
+    mapWithdrawalPayoutCache.erase(nSidechain);
+
+    // Copy outputs from withdrawal tx
+    CTransactionRef txWithdrawal;
+    if (scdb.GetCachedWithdrawalTx(hashBest, txWithdrawal))
+        mtx.vout = txWithdrawal->vout;
     // Withdrawal should have at least the encoded dest output, encoded fee output,
     // and change return output.
     if (mtx.vout.size() < 3)
         return false;
 
+    // The cached withdrawal was analyzed when it was received
+    std::shared_ptr<const WithdrawalBundleInfo> info = GetWithdrawalBundleInfo(*txWithdrawal);
+    if (!info)
+        return false;
+
     // Get the mainchain fee amount from the second Withdrawal output which encodes the
     // sum of withdrawal fees.
-    CAmount amountRead = 0;
-    if (!DecodeWithdrawalFees(mtx.vout[1].scriptPubKey, amountRead)) {
+    if (!info->fFees) {
         LogPrintf("%s: Failed to decode withdrawal fees!\n", __func__);
         return false;
     }
-    nFees = amountRead;
+    nFees = info->amountFees;
 
     // Calculate the amount to be withdrawn by Withdrawal
-    CAmount amountWithdrawn = CAmount(0);
-    for (const CTxOut& out : mtx.vout) {
-        uint8_t nSidechain;
-        if (!out.scriptPubKey.IsDrivechain(nSidechain))
-            amountWithdrawn += out.nValue;
-    }
+    CAmount amountWithdrawn = info->amountPayout;
 
     // Add mainchain fees from withdrawal
     amountWithdrawn += nFees;
@@ -593,11 +757,6 @@ bool BlockAssembler::CreateWithdrawalPayout(uint8_t nSidechain, CMutableTransact
     // Add placeholder change return as the final output.
     mtx.vout.push_back(CTxOut(0, sidechainScript));
 
-    // Get sidechain's CTIP
-    SidechainCTIP ctip;
-    if (!scdb.GetCTIP(nSidechain, ctip))
-        return false;
-
     mtx.vin.push_back(CTxIn(ctip.out));
 
     LogPrintf("%s: Withdrawal will spend CTIP: %s : %u.\n", __func__,
@@ -616,11 +775,19 @@ bool BlockAssembler::CreateWithdrawalPayout(uint8_t nSidechain, CMutableTransact
         return false;
 
     // Check to make sure that all of the outputs in this Withdrawal are unknown / new
+    const uint256 txid = mtx.GetHash();
     for (size_t o = 0; o < mtx.vout.size(); o++) {
-        if (pcoinsTip->HaveCoin(COutPoint(mtx.GetHash(), o))) {
+        if (pcoinsTip->HaveCoin(COutPoint(txid, o))) {
             return false;
         }
     }
+
+    CachedWithdrawalPayout& cached = mapWithdrawalPayoutCache[nSidechain];
+    cached.hashTip = hashTip;
+    cached.hashWithdrawal = hashBest;
+    cached.ctip = ctip;
+    cached.tx = mtx;
+    cached.nFees = nFees;
 #endif
 
     tx = mtx;
@@ -685,10 +852,35 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
+    // Find the ancestors of the packages that are likely to be considered
+    // ahead of time, on several threads. Packages are considered in about
+    // ancestor score order, and enough of them to fill the block twice are
+    // looked at. Packages without ancestors don't need a search at all.
+    std::vector<CTxMemPool::txiter> vPackage;
+    std::vector<CTxMemPool::setEntries> vPackageAncestors;
+    std::map<CTxMemPool::txiter, size_t, CompareCTxMemPoolIter> mapPackageAncestors;
+    if (nThreads > 1) {
+        uint64_t nSize = 0;
+        for (auto it = mi; it != mempool.mapTx.get<ancestor_score>().end() &&
+                nSize < 2 * nBlockMaxWeight / WITNESS_SCALE_FACTOR; ++it) {
+            if (it->GetModFeesWithAncestors() < blockMinFeeRate.GetFee(it->GetSizeWithAncestors()))
+                break;
+            nSize += it->GetTxSize();
+            if (it->GetCountWithAncestors() > 1)
+                vPackage.push_back(mempool.mapTx.project<0>(it));
+        }
+        if (vPackage.size() >= MIN_PARALLEL_PACKAGES) {
+            CalculatePackageAncestors(mempool, vPackage, vPackageAncestors, nThreads);
+            for (size_t i = 0; i < vPackage.size(); i++)
+                mapPackageAncestors.emplace(vPackage[i], i);
+        }
+    }
+
     while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
     {
         // Don't add deposits to the same block as a Withdrawal for this sidechain
-        if (mi->IsSidechainDeposit() &&
+        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
+                mi->IsSidechainDeposit() &&
                 setSidechainsWithWithdrawal.count(mi->GetSidechainNumber())) {
             ++mi;
             continue;
@@ -764,9 +956,16 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        if (iter->GetCountWithAncestors() > 1) {
+            auto itPackage = mapPackageAncestors.find(iter);
+            if (itPackage != mapPackageAncestors.end()) {
+                ancestors = vPackageAncestors[itPackage->second];
+            } else {
+                uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+                std::string dummy;
+                mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            }
+        }
 
         onlyUnconfirmed(ancestors);
         ancestors.insert(iter);
@@ -820,6 +1019,19 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    pblock->InvalidateHash();
+}
+
+void SetCoinbaseExtraNonce(CBlock& block, const CBlockIndex* pindexPrev, unsigned int nExtraNonce, const std::vector<uint256>& vMerkleBranch)
+{
+    // Only the coinbase changes, the rest of the merkle tree is in the
+    // merkle branch
+    CMutableTransaction txCoinbase(*block.vtx[0]);
+    txCoinbase.vin[0].scriptSig = (CScript() << pindexPrev->nHeight + 1 << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
+    assert(txCoinbase.vin[0].scriptSig.size() <= 100);
+    block.vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+    block.hashMerkleRoot = ComputeMerkleRootFromBranch(block.vtx[0]->GetHash(), vMerkleBranch, 0);
+    block.InvalidateHash();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -828,39 +1040,112 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 //
 
 //
-// ScanHash scans nonces looking for a hash with at least some zero bits.
-// The nonce is usually preserved between calls, but periodically or if the
-// nonce is 0xffff0000 or above, the block is rebuilt and nNonce starts over at
-// zero.
+// The internal miner runs one thread that builds block templates and shares
+// them with the hashing threads. Each hashing thread owns the extranonces
+// nThread + 1 + k * nThreads, and only has to rehash the coinbase and its
+// merkle branch when it moves to the next one.
 //
-bool static ScanHash(const CBlockHeader *pblock, uint32_t& nNonce, uint256 *phash)
+
+/** A block template shared by the mining threads */
+struct MinerTemplate
 {
-    // Write the first 76 bytes of the block header to a double-SHA256 state.
-    SHAndwich256 hasher;
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << *pblock;
-    assert(ss.size() == 80);
-    hasher.Write((unsigned char*)&ss[0], 76);
+    //! Number of the template, increases with every new template
+    uint64_t nSequence;
+    CBlock block;
+    const CBlockIndex* pindexPrev;
+    //! Merkle branch of the coinbase, see BlockMerkleBranch
+    std::vector<uint256> vMerkleBranch;
+    std::shared_ptr<CReserveScript> coinbaseScript;
+};
+
+/** Hashes done by a mining thread since it started */
+struct MinerThreadStats
+{
+    std::atomic<uint64_t> nHashes{0};
+    int64_t nTimeStart;
+};
+
+/** Nonces hashed between checks for a new template */
+static const uint32_t MINER_SCAN_BATCH = 0x1000;
+/** Milliseconds between checks whether the template has to be rebuilt */
+static const int MINER_TEMPLATE_POLL_INTERVAL = 100;
+
+static std::mutex cs_minertemplate;
+static std::shared_ptr<const MinerTemplate> g_minertemplate;
+static std::atomic<uint64_t> nMinerTemplateSequence{0};
+//! Set by a hashing thread that needs a new template, e.g. after a block
+static std::atomic<bool> fMinerTemplateRequested{false};
+
+static std::mutex cs_minerstats;
+static std::vector<std::shared_ptr<MinerThreadStats>> vMinerStats;
 
+static void PublishMinerTemplate(std::shared_ptr<const MinerTemplate> ptemplate)
+{
+    std::lock_guard<std::mutex> lock(cs_minertemplate);
+    g_minertemplate = std::move(ptemplate);
+    nMinerTemplateSequence = g_minertemplate ? g_minertemplate->nSequence : nMinerTemplateSequence + 1;
+}
+
+/** Wait for a template other than the one numbered nSequence */
+static std::shared_ptr<const MinerTemplate> WaitForMinerTemplate(uint64_t nSequence)
+{
     while (true) {
+        {
+            std::lock_guard<std::mutex> lock(cs_minertemplate);
+            if (g_minertemplate && g_minertemplate->nSequence != nSequence)
+                return g_minertemplate;
+        }
+        MilliSleep(MINER_TEMPLATE_POLL_INTERVAL);
+    }
+}
+
+std::vector<double> GetMinerHashRates()
+{
+    std::lock_guard<std::mutex> lock(cs_minerstats);
+    std::vector<double> vRate;
+    const int64_t nNow = GetTimeMillis();
+    for (const std::shared_ptr<MinerThreadStats>& pstats : vMinerStats) {
+        const int64_t nElapsed = nNow - pstats->nTimeStart;
+        vRate.push_back(nElapsed > 0 ? pstats->nHashes * 1000.0 / nElapsed : 0);
+    }
+    return vRate;
+}
+
+//
+// ScanHash scans up to MINER_SCAN_BATCH nonces after nNonce looking for a
+// hash that meets hashTarget, using a midstate of the first 76 bytes of the
+// header. Returns false after the batch (or at the last nonce) without a
+// solution, so the caller can check whether the template is still current.
+//
+bool static ScanHash(const CSkydogeHeaderHasher& hasher, uint32_t& nNonce, const arith_uint256& hashTarget, uint256 *phash)
+{
+    const uint32_t nNonceEnd = nNonce + std::min(MINER_SCAN_BATCH, std::numeric_limits<uint32_t>::max() - nNonce);
+    arith_uint256 hashBestBatch = UintToArith256(uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff"));
+    bool fFound = false;
+
+    while (nNonce < nNonceEnd) {
         nNonce++;
 
-        if (nNonce > nMiningNonce)
-            nMiningNonce = nNonce;
+        *phash = hasher.Hash(nNonce);
+        const arith_uint256 hash = UintToArith256(*phash);
 
-        // Write the last 4 bytes of the block header (the nonce) to a copy of
-        // the double-SHA256 state, and compute the result.
-        SHAndwich256(hasher).Write((unsigned char*)&nNonce, 4).Finalize((unsigned char*)phash);
+        if (hash <= hashBestBatch)
+            hashBestBatch = hash;
 
-        // Return the nonce if the hash has at least some zero bits,
-        // caller will check if it has enough to reach the target
-        if (((uint16_t*)phash)[15] == 0)
-            return true;
+        if (hash <= hashTarget) {
+            fFound = true;
+            break;
+        }
+    }
 
-        // If nothing found after trying for a while, return -1
-        if ((nNonce & 0xfff) == 0)
-            return false;
+    nMiningNonce = nNonce;
+    {
+        std::lock_guard<std::mutex> lock(cs_minerstats);
+        if (hashBestBatch <= UintToArith256(hashBest))
+            hashBest = ArithToUint256(hashBestBatch);
     }
+
+    return fFound;
 }
 
 static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainparams)
@@ -887,13 +1172,12 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-void static BitcoinMiner(const CChainParams& chainparams)
+/** Build templates for the hashing threads, and rebuild them when the tip
+ * or the mempool changes */
+void static BitcoinMinerTemplates(const CChainParams& chainparams)
 {
     LogPrintf("BitcoinMiner started\n");
-    //SetThreadPriority(THREAD_PRIORITY_LOWEST);
-    RenameThread("skydoge-miner");
-
-    unsigned int nExtraNonce = 0;
+    RenameThread("skydoge-mintmpl");
 
     if (vpwallets.empty())
         return; // TODO error message
@@ -912,24 +1196,6 @@ void static BitcoinMiner(const CChainParams& chainparams)
             throw std::runtime_error("No coinbase script available (mining requires a wallet)");
 
         while (true) {
-            if (fMiningReqiresPeer) {
-                // Busy-wait for the network to come online so we don't waste time mining
-                // on an obsolete chain. In regtest mode we expect to fly solo.
-                // TODO
-                /*
-                do {
-                    bool fvNodesEmpty;
-                    {
-                        LOCK(cs_vNodes);
-                        fvNodesEmpty = vNodes.empty();
-                    }
-                    if (!fvNodesEmpty && !IsInitialBlockDownload())
-                        break;
-                    MilliSleep(1000);
-                } while (true);
-                */
-            }
-
             //
             // Create new block
             //
@@ -946,87 +1212,44 @@ void static BitcoinMiner(const CChainParams& chainparams)
             if (!pblocktemplate.get())
             {
                 LogPrintf("Error in BitcoinMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
+                PublishMinerTemplate(nullptr);
                 return;
             }
-            CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
 
-            LogPrintf("Running BitcoinMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-                ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
+            std::shared_ptr<MinerTemplate> ptemplate = std::make_shared<MinerTemplate>();
+            ptemplate->nSequence = ++nMinerTemplateSequence;
+            ptemplate->block = pblocktemplate->block;
+            {
+                LOCK(cs_main);
+                BlockMap::const_iterator mi = mapBlockIndex.find(ptemplate->block.hashPrevBlock);
+                assert(mi != mapBlockIndex.end());
+                ptemplate->pindexPrev = mi->second;
+            }
+            ptemplate->vMerkleBranch = BlockMerkleBranch(ptemplate->block, 0);
+            ptemplate->coinbaseScript = coinbaseScript;
 
-            //
-            // Search
-            //
+            LogPrintf("Running BitcoinMiner with %u transactions in block (%u bytes)\n", ptemplate->block.vtx.size(),
+                ::GetSerializeSize(ptemplate->block, SER_NETWORK, PROTOCOL_VERSION));
+
+            {
+                std::lock_guard<std::mutex> lock(cs_minerstats);
+                hashTarget = ArithToUint256(arith_uint256().SetCompact(ptemplate->block.nBits));
+                hashBest = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+                nMiningNonce = 0;
+            }
+            PublishMinerTemplate(ptemplate);
+
+            // Wait until the template has to be rebuilt
             int64_t nStart = GetTime();
-            arith_uint256 hashArithTarget = arith_uint256().SetCompact(pblock->nBits);
-            hashTarget = ArithToUint256(hashArithTarget);
-            hashBest = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
-            nMiningNonce = 0;
-            uint256 hash;
-            uint32_t nNonce = 0;
             while (true) {
-                // Check if something found
-                // if (ScanHash(pblock, nNonce, &hash))
-                // {
-                //     if (UintToArith256(hash) <= UintToArith256(hashBest))
-                //     {
-                //         hashBest = hash;
-                //     }
-
-                //     if (UintToArith256(hash) <= hashArithTarget)
-                //     {
-                //         // Found a solution
-                //         pblock->nNonce = nNonce;
-                //         assert(hash == pblock->GetPoWHash());
-
-                //         LogPrintf("BitcoinMiner:\n");
-                //         LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex(), hashArithTarget.GetHex());
-                //         ProcessBlockFound(pblock, chainparams);
-                //         coinbaseScript->KeepScript();
-                //         nBMMBreakAttempts = 0;
-
-                //         break;
-                //     }
-                // }
-                while(true){
-                    hash = pblock->GetHash();
-                    if (UintToArith256(hash) <= UintToArith256(hashBest))
-                    {
-                        hashBest = hash;
-                    }
-                    if (UintToArith256(hash) <= hashArithTarget)
-                    {
-                        // Found a solution
-                        //pblock->nNonce = nNonce;
-                        //assert(hash == pblock->GetHash());
-
-                        LogPrintf("BitcoinMiner:\n");
-                        LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex(), hashArithTarget.GetHex());
-                        ProcessBlockFound(pblock, chainparams);
-                        coinbaseScript->KeepScript();
-                        nBMMBreakAttempts = 0;
-                        break;
-                    }
-
-                    pblock->nNonce += 1;
-                    if ((pblock->nNonce & 0xFF) == 0)
-                        break;      
-                }
-                
+                MilliSleep(MINER_TEMPLATE_POLL_INTERVAL);
 
-                if (nNonce >= 0xffff0000)
-                    break;
-                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
-                    break;
-                if (pindexPrev != chainActive.Tip()) {
+                if (pindexPrev != chainActive.Tip() || fMinerTemplateRequested.exchange(false)) {
                     nBMMBreakAttempts = 0;
                     break;
                 }
-
-                // Update nTime every few seconds
-                if (UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev) < 0)
-                    break; // Recreate the block if the clock has run backwards,
-                           // so that we can use the correct time.
+                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
+                    break;
 
                 // If the user has set --minerbreakforbmm, and BMM txns were not
                 // already added to this block but exist in the mempool, break
@@ -1036,12 +1259,6 @@ void static BitcoinMiner(const CChainParams& chainparams)
                     nBMMBreakAttempts++;
                     break;
                 }
-
-                if (chainparams.GetConsensus().fPowAllowMinDifficultyBlocks)
-                {
-                    // Changing pblock->nTime can change work required on testnet:
-                    hashArithTarget.SetCompact(pblock->nBits);
-                }
             }
         }
     }
@@ -1053,10 +1270,80 @@ void static BitcoinMiner(const CChainParams& chainparams)
     catch (const std::runtime_error &e)
     {
         LogPrintf("BitcoinMiner runtime error: %s\n", e.what());
+        PublishMinerTemplate(nullptr);
         return;
     }
 }
 
+/** Hash the shared templates with the extranonces of thread nThread */
+void static BitcoinMiner(const CChainParams& chainparams, int nThread, int nThreads, std::shared_ptr<MinerThreadStats> pstats)
+{
+    //SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread("skydoge-miner");
+
+    std::shared_ptr<const MinerTemplate> ptemplate;
+    while (true) {
+        ptemplate = WaitForMinerTemplate(ptemplate ? ptemplate->nSequence : 0);
+        CBlock block = ptemplate->block;
+
+        bool fStale = false;
+        for (unsigned int nExtraNonce = nThread + 1; !fStale; nExtraNonce += nThreads) {
+            SetCoinbaseExtraNonce(block, ptemplate->pindexPrev, nExtraNonce, ptemplate->vMerkleBranch);
+
+            uint32_t nNonce = 0;
+            while (true) {
+                boost::this_thread::interruption_point();
+
+                // Update nTime every batch
+                if (UpdateTime(&block, chainparams.GetConsensus(), ptemplate->pindexPrev) < 0) {
+                    // Recreate the block if the clock has run backwards,
+                    // so that we can use the correct time.
+                    fMinerTemplateRequested = true;
+                    fStale = true;
+                    break;
+                }
+                // Changing nTime can change work required on testnet
+                const arith_uint256 hashArithTarget = arith_uint256().SetCompact(block.nBits);
+
+                block.nNonce = 0;
+                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                ss << block.GetBlockHeader();
+                assert(ss.size() == 80);
+                CSkydogeHeaderHasher hasher((unsigned char*)&ss[0]);
+
+                uint256 hash;
+                const uint32_t nNonceStart = nNonce;
+                const bool fFound = ScanHash(hasher, nNonce, hashArithTarget, &hash);
+                pstats->nHashes += nNonce - nNonceStart;
+
+                if (fFound) {
+                    // Found a solution
+                    block.nNonce = nNonce;
+                    assert(hash == block.GetHash());
+
+                    LogPrintf("BitcoinMiner:\n");
+                    LogPrintf("proof-of-work found  \n  hash: %s  \ntarget: %s\n", hash.GetHex(), hashArithTarget.GetHex());
+                    if (ProcessBlockFound(&block, chainparams)) {
+                        std::lock_guard<std::mutex> lock(cs_minertemplate);
+                        ptemplate->coinbaseScript->KeepScript();
+                    }
+                    fMinerTemplateRequested = true;
+                    fStale = true;
+                    break;
+                }
+
+                // Move on to the next extranonce at the end of the nonces
+                if (nNonce == std::numeric_limits<uint32_t>::max())
+                    break;
+                if (nMinerTemplateSequence != ptemplate->nSequence) {
+                    fStale = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams)
 {
     static boost::thread_group* minerThreads = NULL;
@@ -1070,11 +1357,24 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
         delete minerThreads;
         minerThreads = NULL;
     }
+    PublishMinerTemplate(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(cs_minerstats);
+        vMinerStats.clear();
+    }
 
     if (nThreads == 0 || !fGenerate)
         return;
 
     minerThreads = new boost::thread_group();
-    for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams)));
+    minerThreads->create_thread(boost::bind(&BitcoinMinerTemplates, boost::cref(chainparams)));
+    for (int i = 0; i < nThreads; i++) {
+        std::shared_ptr<MinerThreadStats> pstats = std::make_shared<MinerThreadStats>();
+        pstats->nTimeStart = GetTimeMillis();
+        {
+            std::lock_guard<std::mutex> lock(cs_minerstats);
+            vMinerStats.push_back(pstats);
+        }
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), i, nThreads, pstats));
+    }
 }
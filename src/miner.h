@@ -22,12 +22,61 @@ namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
+/** How CreateNewBlock checks the blocks it makes (-templatevalidation) */
+enum class TemplateValidation {
+    //! Connect the block with TestBlockValidity
+    FULL,
+    //! Only check what TestBlockValidityLight checks, trusting the
+    //! transactions taken from the mempool
+    LIGHT,
+    //! LIGHT, and FULL for one in TEMPLATE_VALIDATION_SAMPLE_RATE blocks
+    SAMPLED,
+};
+static const char* const DEFAULT_TEMPLATE_VALIDATION = "full";
+static const unsigned int TEMPLATE_VALIDATION_SAMPLE_RATE = 10;
+
+/** Parse a -templatevalidation value, return false if it isn't one */
+bool ParseTemplateValidation(const std::string& str, TemplateValidation& validation);
+
+/** Threads used to find the ancestors of the packages that block assembly
+ * will consider (-blockassemblythreads), 0 for one per core */
+static const int DEFAULT_BLOCK_ASSEMBLY_THREADS = 0;
+static const int MAX_BLOCK_ASSEMBLY_THREADS = 8;
+/** Fewest packages with ancestors for which the ancestors are found on
+ * several threads. Below this starting the threads costs more than it saves. */
+static const size_t MIN_PARALLEL_PACKAGES = 256;
+
+/** Find the mempool ancestors of each of vTx, for nThreads threads, into
+ * vAncestors. pool.cs must be held, and pool must not change until this
+ * returns: the threads walk the mempool links without taking the lock. */
+void CalculatePackageAncestors(const CTxMemPool& pool, const std::vector<CTxMemPool::txiter>& vTx, std::vector<CTxMemPool::setEntries>& vAncestors, int nThreads);
+
+/** Outcome of the BMM request auction for a sidechain */
+struct BMMAuctionResult
+{
+    uint8_t nSidechain;
+    //! Number of BMM requests for the sidechain in the mempool
+    uint32_t nRequests;
+    //! The highest bid and what it pays the miner
+    uint256 txid;
+    CAmount amount;
+    //! Whether the highest bid made it into the block
+    bool fIncluded;
+};
+
+/** Pick the highest paying BMM request of each sidechain in pool and add the
+ * outbid requests to setExcluded. Requests that can't be included in a block
+ * at nHeight, or that are for a sidechain not in vActiveSidechain, don't take
+ * part and are excluded as well. pool.cs must be held. */
+void RunBMMAuction(const CTxMemPool& pool, int nHeight, const std::vector<Sidechain>& vActiveSidechain, std::vector<BMMAuctionResult>& vResult, CTxMemPool::setEntries& setExcluded);
+
 struct CBlockTemplate
 {
     CBlock block;
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+    std::vector<BMMAuctionResult> vBMMAuction;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -132,6 +181,8 @@ private:
     bool fIncludeWitness;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
+    TemplateValidation templateValidation;
+    int nThreads;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
@@ -139,6 +190,10 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // BMM requests that were outbid and must not be added to the block
+    CTxMemPool::setEntries setBMMExcluded;
+    // Transactions in the block with critical data, in block order
+    std::vector<CTransactionRef> vCriticalDataTx;
 
     // Chain context for the block
     int nHeight;
@@ -150,6 +205,8 @@ public:
         Options();
         size_t nBlockMaxWeight;
         CFeeRate blockMinFeeRate;
+        TemplateValidation templateValidation;
+        int nThreads;
     };
 
     explicit BlockAssembler(const CChainParams& params);
@@ -165,6 +222,9 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Pick the highest paying BMM request of each sidechain and exclude the
+      * others from the block. They remain in the mempool. */
+    void SelectBMMRequests(const std::vector<Sidechain>& vActiveSidechain);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
@@ -178,7 +238,7 @@ private:
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
     /** Perform checks on each transaction in a package:
-      * locktime, premature-witness, serialized size (if necessary)
+      * locktime, premature-witness, serialized size (if necessary), BMM auction
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
@@ -201,8 +261,13 @@ private:
 
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams);
+/** Hashes per second of each mining thread, averaged since it started */
+std::vector<double> GetMinerHashRates();
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
+/** Set the extranonce of a block on top of pindexPrev, updating the merkle
+ * root from vMerkleBranch, the merkle branch of its coinbase */
+void SetCoinbaseExtraNonce(CBlock& block, const CBlockIndex* pindexPrev, unsigned int nExtraNonce, const std::vector<uint256>& vMerkleBranch);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 #endif // BITCOIN_MINER_H
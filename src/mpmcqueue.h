@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MPMCQUEUE_H
+#define BITCOIN_MPMCQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+/**
+ * Bounded lock-free queue for any number of producers and consumers.
+ *
+ * The queue is a ring of cells, each with a sequence number telling whether
+ * it is ready to be written or read in the current lap around the ring.
+ * Producers and consumers claim a position with a compare-and-swap on their
+ * own counter and then only touch that cell, so neither side ever waits for
+ * a lock held by a preempted thread.
+ *
+ * The capacity is rounded up to a power of two. Push fails when the queue is
+ * full and Pop fails when it is empty; blocking is left to the caller.
+ */
+template <typename T>
+class mpmcqueue
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    // Keep the counters on separate cache lines, they are written by
+    // different threads
+    static const size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Cell[]> buffer;
+    size_t mask;
+    char pad0[CACHE_LINE];
+    std::atomic<size_t> enqueuePos;
+    char pad1[CACHE_LINE];
+    std::atomic<size_t> dequeuePos;
+
+public:
+    explicit mpmcqueue(size_t nCapacity) : enqueuePos(0), dequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < nCapacity)
+            size <<= 1;
+        buffer.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+            buffer[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    mpmcqueue(const mpmcqueue&) = delete;
+    mpmcqueue& operator=(const mpmcqueue&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    /** Add an item, returns false if the queue is full */
+    bool Push(T item)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &buffer[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Remove the oldest item, returns false if the queue is empty */
+    bool Pop(T& item)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &buffer[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->data);
+        cell->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif // BITCOIN_MPMCQUEUE_H
@@ -17,6 +17,7 @@
 #include <primitives/transaction.h>
 #include <netbase.h>
 #include <scheduler.h>
+#include <support/largepages.h>
 #include <ui_interface.h>
 #include <utilstrencodings.h>
 
@@ -24,6 +25,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -35,6 +37,7 @@
 
 
 #include <math.h>
+#include <unordered_map>
 
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
@@ -42,6 +45,28 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+/** Whether the message relays a block, which the message handler processes
+ * ahead of other peers' messages */
+static bool IsBlockRelayMessage(const CNetMessage& msg)
+{
+    const std::string strCommand = msg.hdr.GetCommand();
+    return strCommand == NetMsgType::HEADERS || strCommand == NetMsgType::CMPCTBLOCK ||
+           strCommand == NetMsgType::BLOCKTXN || strCommand == NetMsgType::BLOCK;
+}
+
+static bool NextMessageRelaysBlock(CNode* pnode)
+{
+    LOCK(pnode->cs_vProcessMsg);
+    return !pnode->vProcessMsg.empty() && IsBlockRelayMessage(pnode->vProcessMsg.front());
+}
+
+// Longest wait for socket events, which is how often pnode->vSend is polled
+static const int SOCKET_EVENTS_TIMEOUT_MS = 50;
+
+// Most buffers of the send queue handed to a single sendmsg() call, well
+// below IOV_MAX everywhere
+static const size_t MAX_SEND_IOVECS = 64;
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -465,16 +490,22 @@ void CConnman::DumpBanlist()
 {
     SweepBanned(); // clean unused entries (if bantime has expired)
 
-    if (!BannedSetIsDirty())
-        return;
+    // Clear the flag along with taking the copy, so that bans added while
+    // writing aren't marked as written
+    banmap_t banmap;
+    {
+        LOCK(cs_setBanned);
+        if (!setBannedIsDirty)
+            return;
+        banmap = setBanned;
+        setBannedIsDirty = false;
+    }
 
     int64_t nStart = GetTimeMillis();
 
     CBanDB bandb;
-    banmap_t banmap;
-    GetBanned(banmap);
-    if (bandb.Write(banmap)) {
-        SetBannedSetDirty(false);
+    if (!bandb.Write(banmap)) {
+        SetBannedSetDirty(true);
     }
 
     LogPrint(BCLog::NET, "Flushed %d banned node ips/subnets to banlist.dat  %dms\n",
@@ -856,7 +887,6 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
         vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
     }
 
-    hasher.Write((const unsigned char*)pch, nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
@@ -866,8 +896,10 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
+    // Hashed here on first use rather than as the bytes arrive, so that the
+    // socket handler thread doesn't stall on large payloads
     if (data_hash.IsNull())
-        hasher.Finalize(data_hash.begin());
+        CHash256().Write((const unsigned char*)vRecv.data(), vRecv.size()).Finalize(data_hash.begin());
     return data_hash;
 }
 
@@ -880,32 +912,56 @@ const uint256& CNetMessage::GetMessageHash() const
 
 
 // requires LOCK(cs_vSend)
+CSharedNetPayload::CSharedNetPayload(std::vector<unsigned char>&& dataIn)
+    : data(std::move(dataIn)), hash(Hash(data.data(), data.data() + data.size()))
+{
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+        assert(it->size() > pnode->nSendOffset);
+        ssize_t nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, it->size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand as much of the queue as fits to the kernel in one call,
+            // headers and payloads stay separate buffers
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            for (auto itBuf = it; itBuf != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itBuf, ++nIov) {
+                const size_t nOffset = nIov == 0 ? pnode->nSendOffset : 0;
+                iov[nIov].iov_base = const_cast<unsigned char*>(itBuf->data()) + nOffset;
+                iov[nIov].iov_len = itBuf->size() - nOffset;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the buffers that went out completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0 && nLeft >= it->size() - pnode->nSendOffset) {
+                nLeft -= it->size() - pnode->nSendOffset;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
+            }
+            pnode->nSendOffset += nLeft;
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if (nLeft > 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1105,7 +1161,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!IsSelectableSocket(hSocket) || !socketEvents->CanWait(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1147,11 +1203,17 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        UpdateNodeCounts();
     }
 }
 
 void CConnman::ThreadSocketHandler()
 {
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (!socketEvents->Set(hListenSocket.socket, SOCKET_EVENT_RECV))
+            LogPrintf("Failed to wait on listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+    }
+
     unsigned int nPrevNodeCount = 0;
     while (!interruptNet)
     {
@@ -1172,6 +1234,11 @@ void CConnman::ThreadSocketHandler()
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
 
+                    if (pnode->hSocketEvents != INVALID_SOCKET) {
+                        socketEvents->Remove(pnode->hSocketEvents);
+                        pnode->hSocketEvents = INVALID_SOCKET;
+                    }
+
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
 
@@ -1180,6 +1247,8 @@ void CConnman::ThreadSocketHandler()
                     vNodesDisconnected.push_back(pnode);
                 }
             }
+            if (vNodes.size() != vNodesCopy.size())
+                UpdateNodeCounts();
         }
         {
             // Delete disconnected nodes
@@ -1219,39 +1288,34 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
         {
             LOCK(cs_vNodes);
+            // The sockets closed since the last wait are removed first, as
+            // the sockets set below may have reused their descriptors
+            for (CNode* pnode : vNodes)
+            {
+                if (pnode->hSocketEvents == INVALID_SOCKET)
+                    continue;
+                LOCK(pnode->cs_hSocket);
+                if (pnode->hSocket != pnode->hSocketEvents) {
+                    socketEvents->Remove(pnode->hSocketEvents);
+                    pnode->hSocketEvents = INVALID_SOCKET;
+                }
+            }
+
             for (CNode* pnode : vNodes)
             {
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
+                // * Otherwise, if there is space left in the receive buffer, wait for
                 //   receiving data.
                 // * Hand off all complete messages to the processor, to be handled without
                 //   blocking here.
+                // Only the sockets whose events changed are updated.
 
                 bool select_recv = !pnode->fPauseRecv;
                 bool select_send;
@@ -1264,46 +1328,43 @@ void CConnman::ThreadSocketHandler()
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
+                int nEvents = select_send ? SOCKET_EVENT_SEND : (select_recv ? SOCKET_EVENT_RECV : 0);
+                if (!socketEvents->Set(pnode->hSocket, nEvents)) {
+                    LogPrintf("%s can't wait on socket of peer=%d, disconnecting\n", socketEvents->GetName(), pnode->GetId());
+                    pnode->CloseSocketDisconnect();
                     continue;
                 }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+                pnode->hSocketEvents = pnode->hSocket;
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::vector<std::pair<SOCKET, int>> vReady;
+        bool fWaited = socketEvents->Wait(SOCKET_EVENTS_TIMEOUT_MS, vReady);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
+        if (!fWaited)
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+            int nErr = WSAGetLastError();
+            LogPrintf("socket %s error %s\n", socketEvents->GetName(), NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS)))
                 return;
         }
 
+        std::unordered_map<SOCKET, int> mapReady;
+        for (const std::pair<SOCKET, int>& ready : vReady)
+            mapReady[ready.first] |= ready.second;
+        auto ReadyEvents = [&mapReady](SOCKET hSocket) {
+            auto it = mapReady.find(hSocket);
+            return it == mapReady.end() ? 0 : it->second;
+        };
+
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && (ReadyEvents(hListenSocket.socket) & SOCKET_EVENT_RECV))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1334,9 +1395,10 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                const int nEvents = ReadyEvents(pnode->hSocket);
+                recvSet = nEvents & SOCKET_EVENT_RECV;
+                sendSet = nEvents & SOCKET_EVENT_SEND;
+                errorSet = nEvents & SOCKET_EVENT_ERR;
             }
             if (recvSet || errorSet)
             {
@@ -1357,12 +1419,16 @@ void CConnman::ThreadSocketHandler()
                     RecordBytesRecv(nBytes);
                     if (notify) {
                         size_t nSizeAdded = 0;
+                        bool fBlockRelay = false;
                         auto it(pnode->vRecvMsg.begin());
                         for (; it != pnode->vRecvMsg.end(); ++it) {
                             if (!it->complete())
                                 break;
                             nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                            fBlockRelay |= IsBlockRelayMessage(*it);
                         }
+                        if (fBlockRelay)
+                            fMsgProcBlockRelay = true;
                         {
                             LOCK(pnode->cs_vProcessMsg);
                             pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
@@ -1656,10 +1722,17 @@ void CConnman::ThreadDNSAddressSeed()
 
 void CConnman::DumpAddresses()
 {
+    // Nothing to do if no address was added or updated since the last time
+    const uint64_t nChanges = addrman.GetChanges();
+    if (nChanges == nAddrmanChangesDumped)
+        return;
+
     int64_t nStart = GetTimeMillis();
 
+    // Anything changed while writing is written next time
     CAddrDB adb;
-    adb.Write(addrman);
+    if (adb.Write(addrman))
+        nAddrmanChangesDumped = nChanges;
 
     LogPrint(BCLog::NET, "Flushed %d addresses to peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
@@ -1990,11 +2063,37 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        UpdateNodeCounts();
     }
 }
 
 void CConnman::ThreadMessageHandler()
 {
+    // Blocks from peers are connected on this thread, keep it next to the
+    // memory of the coins cache and the mempool (-numanode)
+    LargePageArena::Instance().BindThreadToNumaNode();
+
+    // Process a message for pnode and send it what is due, returns false
+    // if interrupted
+    bool fMoreWork = false;
+    auto ProcessNode = [this, &fMoreWork](CNode* pnode) {
+        if (pnode->fDisconnect)
+            return true;
+
+        // Receive messages
+        bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
+        fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
+        if (flagInterruptMsgProc)
+            return false;
+        // Send messages
+        {
+            LOCK(pnode->cs_sendProcessing);
+            m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
+        }
+
+        return !flagInterruptMsgProc;
+    };
+
     while (!flagInterruptMsgProc)
     {
         std::vector<CNode*> vNodesCopy;
@@ -2006,26 +2105,31 @@ void CConnman::ThreadMessageHandler()
             }
         }
 
-        bool fMoreWork = false;
+        fMoreWork = false;
 
+        // Each pass processes a message from every peer. The peers with a
+        // block relay message next go first, and when one arrives during
+        // the pass those peers are served before the pass continues, so
+        // that blocks don't wait for a transaction from every other peer.
+        // That is done once per pass, so a peer can't take over the pass by
+        // sending headers. A peer's own messages are still processed in
+        // order.
+        fMsgProcBlockRelay = false;
+        std::stable_partition(vNodesCopy.begin(), vNodesCopy.end(), NextMessageRelaysBlock);
+
+        bool fServedBlockRelay = false;
         for (CNode* pnode : vNodesCopy)
         {
-            if (pnode->fDisconnect)
-                continue;
-
-            // Receive messages
-            bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc)
+            if (!ProcessNode(pnode))
                 return;
-            // Send messages
-            {
-                LOCK(pnode->cs_sendProcessing);
-                m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
-            }
 
-            if (flagInterruptMsgProc)
-                return;
+            if (!fServedBlockRelay && fMsgProcBlockRelay.exchange(false)) {
+                fServedBlockRelay = true;
+                for (CNode* pnodeBlock : vNodesCopy) {
+                    if (NextMessageRelaysBlock(pnodeBlock) && !ProcessNode(pnodeBlock))
+                        return;
+                }
+            }
         }
 
         {
@@ -2200,12 +2304,20 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     fNetworkActive = true;
     setBannedIsDirty = false;
     fAddressesInitialized = false;
+    nAddrmanChangesDumped = 0;
     nLastNodeId = 0;
+    nInboundCount = 0;
+    nOutboundCount = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
     flagInterruptMsgProc = false;
+    fMsgProcBlockRelay = false;
     SetTryNewOutboundPeer(false);
 
+    for (const std::string &msg : getAllNetMessageTypes())
+        mapMsgStats[msg];
+    mapMsgStats[NET_MESSAGE_COMMAND_OTHER];
+
     Options connOptions;
     Init(connOptions);
 }
@@ -2281,9 +2393,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     int64_t nStart = GetTimeMillis();
     {
         CAddrDB adb;
-        if (adb.Read(addrman))
+        if (adb.Read(addrman)) {
+            nAddrmanChangesDumped = addrman.GetChanges();
             LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
-        else {
+        } else {
             addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
             LogPrintf("Invalid or missing peers.dat; recreating\n");
             DumpAddresses();
@@ -2334,6 +2447,13 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         fMsgProcWake = false;
     }
 
+    socketEvents = MakeSocketEvents(strSocketEvents);
+    if (!socketEvents) {
+        LogPrintf("Socket events %s unavailable, using select\n", strSocketEvents);
+        socketEvents = MakeSocketEvents("select");
+    }
+    LogPrintf("Using %s for socket events\n", socketEvents->GetName());
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2360,7 +2480,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
 
     // Dump network addresses
-    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
+    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000, SCHEDULER_LANE_BULK, "dumpaddresses");
 
     return true;
 }
@@ -2439,8 +2559,10 @@ void CConnman::Stop()
         DeleteNode(pnode);
     }
     vNodes.clear();
+    UpdateNodeCounts();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    socketEvents.reset();
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2526,6 +2648,27 @@ size_t CConnman::GetNodeCount(NumConnections flags)
     return nNum;
 }
 
+size_t CConnman::GetNodeCountRelaxed(NumConnections flags) const
+{
+    size_t nNum = 0;
+    if (flags & CONNECTIONS_IN)
+        nNum += nInboundCount.load(std::memory_order_relaxed);
+    if (flags & CONNECTIONS_OUT)
+        nNum += nOutboundCount.load(std::memory_order_relaxed);
+    return nNum;
+}
+
+void CConnman::UpdateNodeCounts()
+{
+    size_t nInbound = 0;
+    for (const CNode* pnode : vNodes) {
+        if (pnode->fInbound)
+            nInbound++;
+    }
+    nInboundCount.store(nInbound, std::memory_order_relaxed);
+    nOutboundCount.store(vNodes.size() - nInbound, std::memory_order_relaxed);
+}
+
 void CConnman::GetNodeStats(std::vector<CNodeStats>& vstats)
 {
     vstats.clear();
@@ -2666,6 +2809,34 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+CNetMsgStats& CConnman::GetNetMsgStatsEntry(const std::string& command)
+{
+    AssertLockHeld(cs_netMsgStats);
+    mapNetMsgStats::iterator it = mapMsgStats.find(command);
+    if (it == mapMsgStats.end())
+        it = mapMsgStats.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(it != mapMsgStats.end());
+    return it->second;
+}
+
+void CConnman::RecordMessageProcessed(const std::string& command, uint64_t nBytes, int64_t nMicros, int64_t nMainWaitMicros, bool fNewMessage)
+{
+    LOCK(cs_netMsgStats);
+    CNetMsgStats& stats = GetNetMsgStatsEntry(command);
+    if (fNewMessage)
+        stats.nRecvCount++;
+    stats.nRecvBytes += nBytes;
+    stats.nProcessMicros += nMicros;
+    stats.nProcessMaxMicros = std::max(stats.nProcessMaxMicros, nMicros);
+    stats.nMainWaitMicros += nMainWaitMicros;
+}
+
+mapNetMsgStats CConnman::GetNetMsgStats()
+{
+    LOCK(cs_netMsgStats);
+    return mapMsgStats;
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2699,6 +2870,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
 {
     nServices = NODE_NONE;
     hSocket = hSocketIn;
+    hSocketEvents = INVALID_SOCKET;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2722,6 +2894,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nStartingHeight = -1;
     filterInventoryKnown.reset();
     fSendMempool = false;
+    fTxReconciliation = false;
+    nReconK0 = 0;
+    nReconK1 = 0;
     fGetAddr = false;
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
@@ -2801,13 +2976,13 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.shared ? msg.shared->data.size() : msg.data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    uint256 hash = msg.shared ? msg.shared->hash : Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
@@ -2824,9 +2999,13 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.emplace_back(std::move(serializedHeader));
+        if (msg.shared) {
+            if (nMessageSize)
+                pnode->vSendMsg.emplace_back(std::move(msg.shared));
+        } else if (nMessageSize) {
+            pnode->vSendMsg.emplace_back(std::move(msg.data));
+        }
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -2834,6 +3013,11 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+
+    LOCK(cs_netMsgStats);
+    CNetMsgStats& stats = GetNetMsgStatsEntry(msg.command);
+    stats.nSendCount++;
+    stats.nSendBytes += nTotalSize;
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
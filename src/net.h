@@ -17,6 +17,7 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <sockevents.h>
 #include <streams.h>
 #include <sync.h>
 #include <uint256.h>
@@ -102,6 +103,17 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/** A message payload serialized once and queued for several peers, such as
+ * a block many peers ask for at once */
+struct CSharedNetPayload
+{
+    explicit CSharedNetPayload(std::vector<unsigned char>&& dataIn);
+
+    const std::vector<unsigned char> data;
+    //! Hash of data, the message header checksum is taken from it
+    const uint256 hash;
+};
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -112,9 +124,39 @@ struct CSerializedNetMsg
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
     std::vector<unsigned char> data;
+    //! Payload shared with other peers, sent instead of data if set
+    std::shared_ptr<const CSharedNetPayload> shared;
     std::string command;
 };
 
+/** A buffer in the send queue of a peer, either a message header or payload
+ * of its own or a payload shared with other peers */
+class CSendBuffer
+{
+public:
+    explicit CSendBuffer(std::vector<unsigned char>&& vchIn) : vch(std::move(vchIn)) {}
+    explicit CSendBuffer(std::shared_ptr<const CSharedNetPayload> sharedIn) : shared(std::move(sharedIn)) {}
+
+    const unsigned char* data() const { return shared ? shared->data.data() : vch.data(); }
+    size_t size() const { return shared ? shared->data.size() : vch.size(); }
+
+private:
+    std::vector<unsigned char> vch;
+    std::shared_ptr<const CSharedNetPayload> shared;
+};
+
+/** Totals for one message type over all peers */
+struct CNetMsgStats {
+    uint64_t nRecvCount = 0;
+    uint64_t nRecvBytes = 0;
+    uint64_t nSendCount = 0;
+    uint64_t nSendBytes = 0;
+    int64_t nProcessMicros = 0;     //! Time spent processing received messages
+    int64_t nProcessMaxMicros = 0;  //! Longest time spent processing one message
+    int64_t nMainWaitMicros = 0;    //! Time spent blocked on cs_main while processing
+};
+typedef std::map<std::string, CNetMsgStats> mapNetMsgStats; //command, totals
+
 class NetEventsInterface;
 class CConnman
 {
@@ -147,6 +189,7 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        std::string strSocketEvents = DefaultSocketEvents();
     };
 
     void Init(const Options& connOptions) {
@@ -166,6 +209,7 @@ public:
             nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
         }
         vWhitelistedRange = connOptions.vWhitelistedRange;
+        strSocketEvents = connOptions.strSocketEvents;
         {
             LOCK(cs_vAddedNodes);
             vAddedNodes = connOptions.m_added_nodes;
@@ -277,6 +321,8 @@ public:
     std::vector<AddedNodeInfo> GetAddedNodeInfo();
 
     size_t GetNodeCount(NumConnections num);
+    //! Same as GetNodeCount but without taking cs_vNodes, may lag slightly
+    size_t GetNodeCountRelaxed(NumConnections num) const;
     void GetNodeStats(std::vector<CNodeStats>& vstats);
     bool DisconnectNode(const std::string& node);
     bool DisconnectNode(NodeId id);
@@ -307,6 +353,12 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    /** Account for the processing of a received message. fNewMessage is
+     * false when continuing work on a message processed before, such as the
+     * rest of a getdata request. */
+    void RecordMessageProcessed(const std::string& command, uint64_t nBytes, int64_t nMicros, int64_t nMainWaitMicros, bool fNewMessage = true);
+    mapNetMsgStats GetNetMsgStats();
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -348,6 +400,8 @@ private:
     bool IsWhitelistedRange(const CNetAddr &addr);
 
     void DeleteNode(CNode* pnode);
+    //! Refresh nInboundCount and nOutboundCount, cs_vNodes must be held
+    void UpdateNodeCounts();
 
     NodeId GetNewNodeId();
 
@@ -365,6 +419,7 @@ private:
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
     void RecordBytesSent(uint64_t bytes);
+    CNetMsgStats& GetNetMsgStatsEntry(const std::string& command);
 
     // Whether the node should be passed out in ForEach* callbacks
     static bool NodeFullyConnected(const CNode* pnode);
@@ -375,6 +430,11 @@ private:
     uint64_t nTotalBytesRecv GUARDED_BY(cs_totalBytesRecv);
     uint64_t nTotalBytesSent GUARDED_BY(cs_totalBytesSent);
 
+    // Per message type totals, has an entry for every known message type
+    // and NET_MESSAGE_COMMAND_OTHER for the rest
+    CCriticalSection cs_netMsgStats;
+    mapNetMsgStats mapMsgStats GUARDED_BY(cs_netMsgStats);
+
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle GUARDED_BY(cs_totalBytesSent);
     uint64_t nMaxOutboundCycleStartTime GUARDED_BY(cs_totalBytesSent);
@@ -389,12 +449,18 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    // Waits for the sockets of vhListenSocket and vNodes, only used by the
+    // socket handler thread once it has started
+    std::string strSocketEvents;
+    std::unique_ptr<CSocketEvents> socketEvents;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
     CAddrMan addrman;
+    // CAddrMan::GetChanges() when peers.dat was last written or read
+    std::atomic<uint64_t> nAddrmanChangesDumped;
     std::deque<std::string> vOneShots;
     CCriticalSection cs_vOneShots;
     std::vector<std::string> vAddedNodes GUARDED_BY(cs_vAddedNodes);
@@ -402,6 +468,9 @@ private:
     std::vector<CNode*> vNodes;
     std::list<CNode*> vNodesDisconnected;
     std::atomic<NodeId> nLastNodeId;
+    // Counts of vNodes kept by UpdateNodeCounts for lock free readers
+    std::atomic<size_t> nInboundCount;
+    std::atomic<size_t> nOutboundCount;
 
     /** Services this instance offers */
     ServiceFlags nLocalServices;
@@ -421,6 +490,8 @@ private:
 
     /** flag for waking the message processor. */
     bool fMsgProcWake;
+    /** set when a block relay message has been queued for a peer */
+    std::atomic<bool> fMsgProcBlockRelay;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -556,7 +627,7 @@ public:
 
 class CNetMessage {
 private:
-    mutable CHash256 hasher;
+    //! Checksum hash of the payload, computed by GetMessageHash()
     mutable uint256 data_hash;
 public:
     bool in_data;                   // parsing header (false) or data (true)
@@ -606,10 +677,13 @@ public:
     // socket
     std::atomic<ServiceFlags> nServices;
     SOCKET hSocket;
+    // hSocket as registered with the socket events, only used by the socket
+    // handler thread
+    SOCKET hSocketEvents;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CSendBuffer> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -696,6 +770,16 @@ public:
     std::vector<uint256> vBlockHashesToAnnounce;
     // Used for BIP35 mempool sending, also protected by cs_inventory
     bool fSendMempool;
+    // Transaction reconciliation, set once both sides sent "sendrecon".
+    // Transactions are then announced by short id, see NetMsgType::RECONCIL,
+    // keyed with the SipHash key the peer sent.
+    std::atomic<bool> fTxReconciliation;
+    std::atomic<uint64_t> nReconK0;
+    std::atomic<uint64_t> nReconK1;
+    // Short ids of the last two "reconcil" messages sent, to answer
+    // "reconcildiff" with. Also protected by cs_inventory
+    std::map<uint64_t, uint256> mapReconShortIds;
+    std::map<uint64_t, uint256> mapReconShortIdsPrev;
 
     // Last time a "MEMPOOL" request was serviced.
     std::atomic<int64_t> timeLastMempoolReq;
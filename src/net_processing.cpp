@@ -8,7 +8,9 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockfilterindex.h>
 #include <chainparams.h>
+#include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <hash.h>
 #include <init.h>
@@ -23,13 +25,21 @@
 #include <random.h>
 #include <reverse_iterator.h>
 #include <scheduler.h>
+#include <script/sigcache.h>
+#include <sidechain.h>
 #include <tinyformat.h>
+#include <trace.h>
 #include <txmempool.h>
+#include <txprevalidate.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
 
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
 #if defined(NDEBUG)
 # error "Bitcoin cannot be compiled without assertions."
 #endif
@@ -56,9 +66,20 @@ std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
 void EraseOrphansFor(NodeId peer);
 
+/** Extra transactions for compact block reconstruction. The first
+ * nExtraTxnForCompact entries are a ring of orphan and replaced transactions,
+ * followed by a ring of nExtraBMMTxnForCompact BMM requests for every
+ * sidechain number and one for other critical data transactions, so that
+ * neither busy sidechains nor ordinary transactions push the BMM requests of
+ * other sidechains out before the block including them arrives. */
 static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
+static std::vector<size_t> vExtraCriticalTxnForCompactIt GUARDED_BY(g_cs_orphans);
+static size_t nExtraTxnForCompact GUARDED_BY(g_cs_orphans) = 0;
+static size_t nExtraBMMTxnForCompact GUARDED_BY(g_cs_orphans) = 0;
 static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
 
+static CompactBlockStats compactBlockStats GUARDED_BY(cs_main);
+
 static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
 
 /// Age after which a stale block will no longer be served if requested as
@@ -69,6 +90,68 @@ static const int STALE_RELAY_AGE_LIMIT = 30 * 24 * 60 * 60;
 /// limiting block relay. Set to one week, denominated in seconds.
 static const int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static const uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static const uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** Interval between compact filter checkpoints. See BIP 157. */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/** Whether -txreconciliation is on, and the SipHash key peers hash the
+ * transactions they announce to us with. Set at startup. */
+static bool g_tx_reconciliation = false;
+static uint64_t g_recon_k0 = 0;
+static uint64_t g_recon_k1 = 0;
+static CCriticalSection g_cs_recon;
+/** The mempool by the short ids of its transactions under our key, kept up
+ * to date from the validation callbacks, to tell which transactions in a
+ * "reconcil" message we are missing */
+static std::unordered_map<uint64_t, uint256> g_recon_mempool GUARDED_BY(g_cs_recon);
+
+/** Size of a header in a "headers" message, the 80 byte header and the 0x00
+ * transaction count */
+static const size_t HEADERS_ENTRY_SIZE = 81;
+/** Number of heights in the headers cache */
+static const size_t HEADERS_CACHE_SIZE = 1 << 16;
+
+// Serialized "headers" entries in a ring by height, with the hash of the
+// block each slot holds. Serving a header from a different branch at that
+// height replaces the slot, so a reorg leaves nothing stale behind. Slots are
+// keyed by hash rather than CBlockIndex* because block index entries are
+// freed and their memory reused when the block index is unloaded.
+// Protected by cs_main.
+static std::vector<unsigned char> g_headers_cache;
+static std::vector<uint256> g_headers_cache_hash;
+
+CSerializedNetMsg MakeHeadersMsg(const std::vector<const CBlockIndex*>& vIndex)
+{
+    AssertLockHeld(cs_main);
+    if (g_headers_cache.empty()) {
+        g_headers_cache.resize(HEADERS_CACHE_SIZE * HEADERS_ENTRY_SIZE);
+        g_headers_cache_hash.assign(HEADERS_CACHE_SIZE, uint256());
+    }
+
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::HEADERS;
+    msg.data.reserve(GetSizeOfCompactSize(vIndex.size()) + vIndex.size() * HEADERS_ENTRY_SIZE);
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, msg.data, 0);
+    WriteCompactSize(writer, vIndex.size());
+    for (const CBlockIndex* pindex : vIndex) {
+        const size_t nSlot = pindex->nHeight % HEADERS_CACHE_SIZE;
+        unsigned char* pentry = g_headers_cache.data() + nSlot * HEADERS_ENTRY_SIZE;
+        if (g_headers_cache_hash[nSlot] != pindex->GetBlockHash()) {
+            // We must use a CBlock, a CBlockHeader won't include the 0x00 nTx count
+            std::vector<unsigned char> vEntry;
+            CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, vEntry, 0, CBlock(pindex->GetBlockHeader())};
+            assert(vEntry.size() == HEADERS_ENTRY_SIZE);
+            memcpy(pentry, vEntry.data(), HEADERS_ENTRY_SIZE);
+            g_headers_cache_hash[nSlot] = pindex->GetBlockHash();
+        }
+        msg.data.insert(msg.data.end(), pentry, pentry + HEADERS_ENTRY_SIZE);
+    }
+    return msg;
+}
+
 // Internal stuff
 namespace {
     /** Number of nodes with fSyncStarted. */
@@ -112,18 +195,29 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When we requested the block (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
     /** Stack of nodes which we have set to announce using compact blocks */
     std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
 
+    /** Propagation of the most recent blocks announced to us, see
+     * GetBlockPropagation. Protected by cs_main. */
+    std::map<uint256, BlockPropagation> mapBlockPropagation;
+
+    /** The blocks of mapBlockPropagation in the order they were announced */
+    std::deque<uint256> queueBlockPropagation;
+
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads = 0;
 
+    /** How far ahead of the last block in common with a peer we fetch, see BLOCK_DOWNLOAD_WINDOW. Protected by cs_main. */
+    unsigned int nBlockDownloadWindow = BLOCK_DOWNLOAD_WINDOW;
+
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect = 0;
 
@@ -185,6 +279,12 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How many blocks we request from this peer at most
+    int nBlocksInTransitMax;
+    //! Moving average of how many microseconds it took this peer to deliver a block we requested, -1 until it delivered one
+    int64_t nBlockDownloadTime;
+    //! When the last block we requested from this peer arrived (in microseconds)
+    int64_t nLastBlockDownload;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -239,6 +339,14 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Blocks in mapBlockPropagation this peer announced
+    uint64_t nBlocksAnnounced;
+    //! How many of them this peer announced before any other peer
+    uint64_t nBlocksAnnouncedFirst;
+    //! Moving average of how many microseconds after the first announcement
+    //! this peer announced blocks, -1 until it announced one
+    int64_t nBlockAnnounceDelay;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -254,6 +362,9 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlocksInTransitMax = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        nBlockDownloadTime = -1;
+        nLastBlockDownload = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -264,6 +375,9 @@ struct CNodeState {
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
+        nBlocksAnnounced = 0;
+        nBlocksAnnouncedFirst = 0;
+        nBlockAnnounceDelay = -1;
     }
 };
 
@@ -355,7 +469,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -404,6 +518,151 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256 &hash) {
     }
 }
 
+/** Weight of a new delay in a peer's nBlockAnnounceDelay, as 1/n */
+static const int BLOCK_ANNOUNCE_DELAY_WEIGHT = 8;
+
+void UpdateBlockAnnounceDelay(CNodeState* state, int64_t nDelay)
+{
+    if (state->nBlockAnnounceDelay < 0)
+        state->nBlockAnnounceDelay = nDelay;
+    else
+        state->nBlockAnnounceDelay += (nDelay - state->nBlockAnnounceDelay) / BLOCK_ANNOUNCE_DELAY_WEIGHT;
+}
+
+/** Weight of a new time in a peer's nBlockDownloadTime, as 1/n */
+static const int BLOCK_DOWNLOAD_TIME_WEIGHT = 8;
+
+/**
+ * Record that a block we requested from a peer arrived at nTimeReceived.
+ * Blocks are delivered one after the other, so a block's download time is
+ * counted from when the previous one arrived, unless it was requested later.
+ * Must be called before the block is marked as received.
+ */
+void RecordBlockDownload(NodeId nodeid, const uint256& hash, int64_t nTimeReceived)
+{
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::const_iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState* state = State(nodeid);
+    assert(state != nullptr);
+
+    const int64_t nStart = std::max(itInFlight->second.second->nTimeRequested, state->nLastBlockDownload);
+    const int64_t nTime = std::max<int64_t>(nTimeReceived - nStart, 1);
+    state->nLastBlockDownload = nTimeReceived;
+    if (state->nBlockDownloadTime < 0)
+        state->nBlockDownloadTime = nTime;
+    else
+        state->nBlockDownloadTime += (nTime - state->nBlockDownloadTime) / BLOCK_DOWNLOAD_TIME_WEIGHT;
+}
+
+/**
+ * How many blocks to request from a peer at most during initial block
+ * download: enough to cover its round trip and BLOCK_DOWNLOAD_QUEUE_TIME at
+ * the rate it has been delivering them. A window that is too small leaves the
+ * peer idle for part of each round trip, which shows up as a longer download
+ * time and so makes the window grow until the peer is kept busy.
+ */
+int GetBlocksInTransitMax(const CNodeState* state, int64_t nPingUsec)
+{
+    if (state->nBlockDownloadTime <= 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    if (nPingUsec == std::numeric_limits<int64_t>::max())
+        nPingUsec = 0;
+    const int64_t nBlocks = (nPingUsec + BLOCK_DOWNLOAD_QUEUE_TIME) / state->nBlockDownloadTime + 1;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER_IBD, std::min<int64_t>(nBlocks, MAX_BLOCKS_IN_TRANSIT_PER_PEER_IBD));
+}
+
+/**
+ * Record that a peer told us about a block in a message received at nTime.
+ * pindex is the block's header if we have it. Blocks are only tracked from
+ * their first announcement if we don't have them yet and aren't in initial
+ * block download.
+ */
+void RecordBlockAnnouncement(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex, BlockAnnounceType type, int64_t nTime)
+{
+    AssertLockHeld(cs_main);
+    std::map<uint256, BlockPropagation>::iterator it = mapBlockPropagation.find(hash);
+    if (it == mapBlockPropagation.end()) {
+        if (IsInitialBlockDownload() || (pindex && (pindex->nStatus & BLOCK_HAVE_DATA)))
+            return;
+
+        it = mapBlockPropagation.emplace(hash, BlockPropagation()).first;
+        it->second.hash = hash;
+        it->second.nFirstSeen = nTime;
+        it->second.nodeFirst = nodeid;
+        queueBlockPropagation.push_back(hash);
+        if (queueBlockPropagation.size() > MAX_BLOCK_PROPAGATION_RECORDS) {
+            mapBlockPropagation.erase(queueBlockPropagation.front());
+            queueBlockPropagation.pop_front();
+        }
+    }
+    BlockPropagation& block = it->second;
+    if (pindex)
+        block.nHeight = pindex->nHeight;
+
+    std::vector<BlockPeerPropagation>::iterator itPeer = std::find_if(block.vPeer.begin(), block.vPeer.end(),
+        [nodeid](const BlockPeerPropagation& peer) { return peer.nodeid == nodeid; });
+    if (itPeer == block.vPeer.end()) {
+        // Messages of different peers aren't processed in the order they
+        // were received, so a peer processed later may have been first
+        if (nTime < block.nFirstSeen) {
+            CNodeState* stateFirst = State(block.nodeFirst);
+            if (stateFirst && stateFirst->nBlocksAnnouncedFirst > 0)
+                stateFirst->nBlocksAnnouncedFirst--;
+            block.nFirstSeen = nTime;
+            block.nodeFirst = nodeid;
+        }
+
+        CNodeState* state = State(nodeid);
+        if (state) {
+            state->nBlocksAnnounced++;
+            if (block.nodeFirst == nodeid)
+                state->nBlocksAnnouncedFirst++;
+            UpdateBlockAnnounceDelay(state, nTime - block.nFirstSeen);
+        }
+
+        BlockPeerPropagation peer;
+        peer.nodeid = nodeid;
+        peer.type = type;
+        peer.nAnnounced = nTime;
+        itPeer = block.vPeer.insert(std::upper_bound(block.vPeer.begin(), block.vPeer.end(), peer,
+            [](const BlockPeerPropagation& a, const BlockPeerPropagation& b) { return a.nAnnounced < b.nAnnounced; }), peer);
+    }
+    if (type != BLOCK_ANNOUNCE_INV && !itPeer->nHeader)
+        itPeer->nHeader = nTime;
+}
+
+/** Record that we downloaded or reconstructed a block at nTime */
+void RecordBlockReceived(NodeId nodeid, const uint256& hash, bool fReconstructed, int64_t nTime)
+{
+    AssertLockHeld(cs_main);
+    std::map<uint256, BlockPropagation>::iterator it = mapBlockPropagation.find(hash);
+    if (it == mapBlockPropagation.end() || it->second.nReceived)
+        return;
+    it->second.nReceived = nTime;
+    it->second.nodeReceived = nodeid;
+    it->second.fReconstructed = fReconstructed;
+}
+
+/** Return the peer announcing blocks with compact blocks that has been the
+ * slowest to announce them, the one that has done so longest if none is
+ * slower than the others */
+std::list<NodeId>::iterator SlowestHeaderAndIDsAnnouncer()
+{
+    AssertLockHeld(cs_main);
+    std::list<NodeId>::iterator itSlowest = lNodesAnnouncingHeaderAndIDs.begin();
+    int64_t nSlowest = -1;
+    for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        CNodeState* state = State(*it);
+        const int64_t nDelay = state ? state->nBlockAnnounceDelay : std::numeric_limits<int64_t>::max();
+        if (nDelay > nSlowest) {
+            itSlowest = it;
+            nSlowest = nDelay;
+        }
+    }
+    return itSlowest;
+}
+
 void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman) {
     AssertLockHeld(cs_main);
     CNodeState* nodestate = State(nodeid);
@@ -433,12 +692,14 @@ if (nHeight < DrivechainHeight) {
             uint64_t nCMPCTBLOCKVersion = (pfrom->GetLocalServices() & NODE_WITNESS) ? 2 : 1;
             if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
                 // As per BIP152, we only get 3 of our peers to announce
-                // blocks using compact encodings.
-                connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman, nCMPCTBLOCKVersion](CNode* pnodeStop){
+                // blocks using compact encodings. Replace the one that has
+                // been the slowest to announce blocks.
+                std::list<NodeId>::iterator itStop = SlowestHeaderAndIDsAnnouncer();
+                connman->ForNode(*itStop, [connman, nCMPCTBLOCKVersion](CNode* pnodeStop){
                     connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, /*fAnnounceUsingCMPCTBLOCK=*/false, nCMPCTBLOCKVersion));
                     return true;
                 });
-                lNodesAnnouncingHeaderAndIDs.pop_front();
+                lNodesAnnouncingHeaderAndIDs.erase(itStop);
             }
             connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SENDCMPCT, /*fAnnounceUsingCMPCTBLOCK=*/true, nCMPCTBLOCKVersion));
             lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
@@ -474,7 +735,7 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams, const CBlockIndex** ppindexWaitingFor = nullptr) {
     if (count == 0)
         return;
 
@@ -504,12 +765,13 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than nBlockDownloadWindow + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + nBlockDownloadWindow;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -550,6 +812,8 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        if (ppindexWaitingFor)
+                            *ppindexWaitingFor = pindexWaitingFor;
                     }
                     return;
                 }
@@ -560,6 +824,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -612,6 +877,8 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    if (g_txprevalidator)
+        g_txprevalidator->RemovePeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -642,9 +909,39 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksAnnounced = state->nBlocksAnnounced;
+    stats.nBlocksAnnouncedFirst = state->nBlocksAnnouncedFirst;
+    stats.nBlockAnnounceDelay = state->nBlockAnnounceDelay;
+    stats.nBlocksInTransitMax = state->nBlocksInTransitMax;
+    stats.nBlockDownloadTime = state->nBlockDownloadTime;
+    stats.fHighBandwidth = std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), nodeid) != lNodesAnnouncingHeaderAndIDs.end();
     return true;
 }
 
+void GetCompactBlockStats(CompactBlockStats& stats)
+{
+    LOCK(cs_main);
+    stats = compactBlockStats;
+}
+
+std::string BlockAnnounceTypeName(BlockAnnounceType type)
+{
+    switch (type) {
+    case BLOCK_ANNOUNCE_INV: return NetMsgType::INV;
+    case BLOCK_ANNOUNCE_HEADERS: return NetMsgType::HEADERS;
+    case BLOCK_ANNOUNCE_CMPCTBLOCK: return NetMsgType::CMPCTBLOCK;
+    }
+    assert(false);
+}
+
+void GetBlockPropagation(std::vector<BlockPropagation>& vBlock)
+{
+    LOCK(cs_main);
+    vBlock.clear();
+    for (const uint256& hash : queueBlockPropagation)
+        vBlock.push_back(mapBlockPropagation.at(hash));
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -652,13 +949,27 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
-    size_t max_extra_txn = gArgs.GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
-    if (max_extra_txn <= 0)
+    if (!vExtraTxnForCompact.size()) {
+        nExtraTxnForCompact = std::max((int64_t)0, gArgs.GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
+        nExtraBMMTxnForCompact = std::max((int64_t)0, gArgs.GetArg("-blockreconstructionbmmtxn", DEFAULT_BLOCK_RECONSTRUCTION_BMM_TXN));
+        vExtraTxnForCompact.resize(nExtraTxnForCompact + (SIDECHAIN_ACTIVATION_MAX_ACTIVE + 1) * nExtraBMMTxnForCompact);
+        vExtraCriticalTxnForCompactIt.assign(SIDECHAIN_ACTIVATION_MAX_ACTIVE + 1, 0);
+    }
+
+    if (!tx->criticalData.IsNull() && nExtraBMMTxnForCompact > 0) {
+        uint8_t nSidechain;
+        std::string strPrevBlock;
+        const size_t nRing = tx->criticalData.IsBMMRequest(nSidechain, strPrevBlock) ? nSidechain : SIDECHAIN_ACTIVATION_MAX_ACTIVE;
+        size_t& it = vExtraCriticalTxnForCompactIt[nRing];
+        vExtraTxnForCompact[nExtraTxnForCompact + nRing * nExtraBMMTxnForCompact + it] = std::make_pair(tx->GetWitnessHash(), tx);
+        it = (it + 1) % nExtraBMMTxnForCompact;
+        return;
+    }
+
+    if (nExtraTxnForCompact == 0)
         return;
-    if (!vExtraTxnForCompact.size())
-        vExtraTxnForCompact.resize(max_extra_txn);
     vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
-    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
+    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % nExtraTxnForCompact;
 }
 
 bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
@@ -817,13 +1128,19 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 
+    g_tx_reconciliation = gArgs.GetBoolArg("-txreconciliation", DEFAULT_TX_RECONCILIATION);
+    if (g_tx_reconciliation) {
+        g_recon_k0 = GetRand(std::numeric_limits<uint64_t>::max());
+        g_recon_k1 = GetRand(std::numeric_limits<uint64_t>::max());
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
     // combine them in one function and schedule at the quicker (peer-eviction)
     // timer.
     static_assert(EXTRA_PEER_CHECK_INTERVAL < STALE_CHECK_INTERVAL, "peer eviction timer should be less than stale tip check timer");
-    scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000);
+    scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000, SCHEDULER_LANE_FAST, "checkstaletip");
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
@@ -855,15 +1172,77 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
         LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
     }
 
+    if (g_tx_reconciliation) {
+        LOCK(g_cs_recon);
+        for (const CTransactionRef& ptx : pblock->vtx)
+            g_recon_mempool.erase(SipHashUint256(g_recon_k0, g_recon_k1, ptx->GetHash()));
+        for (const CTransactionRef& ptx : vtxConflicted)
+            g_recon_mempool.erase(SipHashUint256(g_recon_k0, g_recon_k1, ptx->GetHash()));
+    }
+
+    // Critical data transactions conflicted by this block may still be in a
+    // competing block
+    for (const CTransactionRef& ptx : vtxConflicted) {
+        if (!ptx->criticalData.IsNull())
+            AddToCompactExtraTransactions(ptx);
+    }
+
     g_last_tip_update = GetTime();
 }
 
+void PeerLogicValidation::TransactionAddedToMempool(const CTransactionRef& ptx) {
+    if (g_tx_reconciliation) {
+        LOCK(g_cs_recon);
+        g_recon_mempool.emplace(SipHashUint256(g_recon_k0, g_recon_k1, ptx->GetHash()), ptx->GetHash());
+    }
+}
+
+void PeerLogicValidation::TransactionRemovedFromMempool(const CTransactionRef& ptx) {
+    if (g_tx_reconciliation) {
+        LOCK(g_cs_recon);
+        g_recon_mempool.erase(SipHashUint256(g_recon_k0, g_recon_k1, ptx->GetHash()));
+    }
+
+    // Expired and evicted BMM requests may still be in a block that is being
+    // relayed, keep them for compact block reconstruction
+    if (ptx->criticalData.IsNull() || RecursiveDynamicUsage(*ptx) >= 100000)
+        return;
+    LOCK(g_cs_orphans);
+    AddToCompactExtraTransactions(ptx);
+}
+
 // All of the following cache a recent block, and are protected by cs_most_recent_block
 static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
+// "block" message payloads of most_recent_block by serialization version, so
+// peers fetching it at the same time share one copy in their send queues
+static std::map<int, std::shared_ptr<const CSharedNetPayload>> most_recent_block_payloads;
+
+/** Return the "block" message for the most recent block, serialized with
+ * nVersion only the first time it is asked for */
+static CSerializedNetMsg MakeRecentBlockMsg(const std::shared_ptr<const CBlock>& pblock, int nVersion)
+{
+    CSerializedNetMsg msg;
+    msg.command = NetMsgType::BLOCK;
+    {
+        LOCK(cs_most_recent_block);
+        if (pblock == most_recent_block) {
+            std::shared_ptr<const CSharedNetPayload>& payload = most_recent_block_payloads[nVersion];
+            if (!payload) {
+                std::vector<unsigned char> data;
+                CVectorWriter{SER_NETWORK, nVersion, data, 0, *pblock};
+                payload = std::make_shared<const CSharedNetPayload>(std::move(data));
+            }
+            msg.shared = payload;
+            return msg;
+        }
+    }
+    CVectorWriter{SER_NETWORK, nVersion, msg.data, 0, *pblock};
+    return msg;
+}
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
@@ -885,6 +1264,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_block_payloads.clear();
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
@@ -970,10 +1350,31 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
     else if (state.IsValid() &&
              !IsInitialBlockDownload() &&
              mapBlocksInFlight.count(hash) == mapBlocksInFlight.size()) {
-        if (it != mapBlockSource.end()) {
+        // Ask the peer that announced the block first to announce blocks
+        // with compact blocks, rather than the one we happened to get it from
+        std::map<uint256, BlockPropagation>::const_iterator itProp = mapBlockPropagation.find(hash);
+        if (itProp != mapBlockPropagation.end() && State(itProp->second.nodeFirst)) {
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(itProp->second.nodeFirst, connman);
+        } else if (it != mapBlockSource.end()) {
             MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second.first, connman);
         }
     }
+
+    std::map<uint256, BlockPropagation>::iterator itProp = mapBlockPropagation.find(hash);
+    if (state.IsValid() && itProp != mapBlockPropagation.end() && !itProp->second.nConnected) {
+        BlockPropagation& block = itProp->second;
+        block.nConnected = GetTimeMicros();
+
+        // Peers announcing with compact blocks that didn't announce this one
+        // are as slow as it took to connect it
+        for (NodeId nodeid : lNodesAnnouncingHeaderAndIDs) {
+            CNodeState* nodestate = State(nodeid);
+            const bool fAnnounced = std::any_of(block.vPeer.begin(), block.vPeer.end(),
+                [nodeid](const BlockPeerPropagation& peer) { return peer.nodeid == nodeid; });
+            if (nodestate && !fAnnounced)
+                UpdateBlockAnnounceDelay(nodestate, block.nConnected - block.nFirstSeen);
+        }
+    }
     if (it != mapBlockSource.end())
         mapBlockSource.erase(it);
 }
@@ -1138,6 +1539,14 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
+        } else if (inv.type == MSG_DRIVECHAIN_BLOCK) {
+            // Blocks are stored with the serialization drivechain peers ask
+            // for, so send the bytes on disk without parsing the block
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            if (!ReadRawBlockFromDisk(msg.data, (*mi).second, Params().MessageStart()))
+                assert(!"cannot load block from disk");
+            connman->PushMessage(pfrom, std::move(msg));
         } else {
             // Send block from disk
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
@@ -1146,13 +1555,15 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
             pblock = pblockRead;
         }
         if (inv.type == MSG_BLOCK) {
-            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_TRANSACTION_NO_DRIVECHAIN, NetMsgType::BLOCK, *pblock));
+            connman->PushMessage(pfrom, MakeRecentBlockMsg(pblock, SERIALIZE_TRANSACTION_NO_WITNESS | SERIALIZE_TRANSACTION_NO_DRIVECHAIN | pfrom->GetSendVersion()));
         }
         else if (inv.type == MSG_WITNESS_BLOCK) {
-            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_DRIVECHAIN, NetMsgType::BLOCK, *pblock));
+            connman->PushMessage(pfrom, MakeRecentBlockMsg(pblock, SERIALIZE_TRANSACTION_NO_DRIVECHAIN | pfrom->GetSendVersion()));
         }
         else if (inv.type == MSG_DRIVECHAIN_BLOCK) {
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            // Sent above unless it is a recent block
+            if (pblock)
+                connman->PushMessage(pfrom, MakeRecentBlockMsg(pblock, pfrom->GetSendVersion()));
         }
         else if (inv.type == MSG_FILTERED_BLOCK)
         {
@@ -1314,7 +1725,7 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
-bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, bool punish_duplicate_invalid)
+bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::vector<CBlockHeader>& headers, int64_t nTimeReceived, const CChainParams& chainparams, bool punish_duplicate_invalid)
 {
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     size_t nCount = headers.size();
@@ -1324,6 +1735,10 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
         return true;
     }
 
+    // Hash the whole message up front (possibly on several threads) so the
+    // continuity check below and ProcessNewBlockHeaders hit memoized hashes
+    CacheBlockHeaderHashes(headers);
+
     bool received_new_header = false;
     const CBlockIndex *pindexLast = nullptr;
     {
@@ -1433,6 +1848,13 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
         assert(pindexLast);
         UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
+        // Small headers messages are block announcements
+        if (nCount <= MAX_BLOCKS_TO_ANNOUNCE) {
+            const CBlockIndex* pindex = pindexLast;
+            for (size_t i = 0; i < nCount && pindex; i++, pindex = pindex->pprev)
+                RecordBlockAnnouncement(pfrom->GetId(), pindex->GetBlockHash(), pindex, BLOCK_ANNOUNCE_HEADERS, nTimeReceived);
+        }
+
         // From here, pindexBestKnownBlock should be guaranteed to be non-null,
         // because it is set in UpdateBlockAvailability. Some nullptr checks
         // are still present, however, as belt-and-suspenders.
@@ -1535,6 +1957,429 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
+/** Try to accept a transaction received from a peer to the mempool, relay
+ * it and the orphans it resolves, or keep it as an orphan */
+static void AcceptTransactionFromPeer(CNode* pfrom, const CTransactionRef& ptx, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const CTransaction& tx = *ptx;
+    const CInv inv(MSG_TX, tx.GetHash());
+
+    std::deque<COutPoint> vWorkQueue;
+    std::vector<uint256> vEraseQueue;
+
+    LOCK2(cs_main, g_cs_orphans);
+
+    bool fMissingInputs = false;
+    CValidationState state;
+
+    pfrom->setAskFor.erase(inv.hash);
+    mapAlreadyAskedFor.erase(inv.hash);
+
+    std::list<CTransactionRef> lRemovedTxn;
+
+    if (!AlreadyHave(inv) &&
+        AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+        mempool.check(pcoinsTip.get());
+        RelayTransaction(tx, connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            vWorkQueue.emplace_back(inv.hash, i);
+        }
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom->GetId(),
+            tx.GetHash().ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        std::set<NodeId> setMisbehaving;
+        while (!vWorkQueue.empty()) {
+            auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+            vWorkQueue.pop_front();
+            if (itByPrev == mapOrphanTransactionsByPrev.end())
+                continue;
+            for (auto mi = itByPrev->second.begin();
+                 mi != itByPrev->second.end();
+                 ++mi)
+            {
+                const CTransactionRef& porphanTx = (*mi)->second.tx;
+                const CTransaction& orphanTx = *porphanTx;
+                const uint256& orphanHash = orphanTx.GetHash();
+                NodeId fromPeer = (*mi)->second.fromPeer;
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if (setMisbehaving.count(fromPeer))
+                    continue;
+                if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, &fMissingInputs2, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+                    LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(orphanTx, connman);
+                    for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
+                        vWorkQueue.emplace_back(orphanHash, i);
+                    }
+                    vEraseQueue.push_back(orphanHash);
+                }
+                else if (!fMissingInputs2)
+                {
+                    int nDos = 0;
+                    if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                    {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee
+                    LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+                    vEraseQueue.push_back(orphanHash);
+                    if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
+                        // Do not use rejection cache for witness transactions or
+                        // witness-stripped transactions, as they can have been malleated.
+                        // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+                        assert(recentRejects);
+                        recentRejects->insert(orphanHash);
+                    }
+                }
+                mempool.check(pcoinsTip.get());
+            }
+        }
+
+        for (uint256 hash : vEraseQueue)
+            EraseOrphanTx(hash);
+    }
+    else if (fMissingInputs)
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+        for (const CTxIn& txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.hash)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            uint32_t nFetchFlags = GetFetchFlags(pfrom);
+            for (const CTxIn& txin : tx.vin) {
+                CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+            }
+            AddOrphanTx(ptx, pfrom->GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetHash());
+        }
+    } else {
+        if (!tx.HasWitness() && !state.CorruptionPossible()) {
+            // Do not use rejection cache for witness transactions or
+            // witness-stripped transactions, as they can have been malleated.
+            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+            assert(recentRejects);
+            recentRejects->insert(tx.GetHash());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
+        } else if (!tx.criticalData.IsNull() && RecursiveDynamicUsage(*ptx) < 100000) {
+            // BMM requests committing to a block we don't have yet are
+            // rejected, but will be in the block built on top of it
+            AddToCompactExtraTransactions(ptx);
+        }
+
+        if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+                RelayTransaction(tx, connman);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
+            }
+        }
+    }
+
+    for (const CTransactionRef& removedTx : lRemovedTxn)
+        AddToCompactExtraTransactions(removedTx);
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+            pfrom->GetId(),
+            FormatStateMessage(state));
+        if (state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, std::string(NetMsgType::TX), (unsigned char)state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+        if (nDoS > 0) {
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
+/** Whether a transaction passes the policy checks AcceptToMemoryPool runs
+ * before the scripts, which are only worth checking ahead if it does */
+static bool PassesPolicyBeforeScripts(const CTransaction& tx, const CCoinsViewCache& view, CAmount nValueIn)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    if (tx.IsCoinBase())
+        return false;
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason, IsWitnessEnabled(chainActive.Tip(), consensusParams), IsDrivechainEnabled(chainActive.Tip(), consensusParams)))
+        return false;
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return false;
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
+        return false;
+
+    const int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return false;
+
+    const CAmount nValueOut = tx.GetValueOut();
+    if (nValueIn < nValueOut)
+        return false;
+    CAmount nModifiedFees = nValueIn - nValueOut;
+    mempool.ApplyDelta(tx.GetHash(), nModifiedFees);
+    const int64_t nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+    if (nModifiedFees < mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize))
+        return false;
+    if (nModifiedFees < ::minRelayTxFee.GetFee(nSize))
+        return false;
+
+    return true;
+}
+
+/** Hand a transaction received from a peer to the pre-validation threads,
+ * along with the outputs it spends. Returns false if it should be accepted
+ * right away. */
+static bool PrevalidateTransactionFromPeer(CNode* pfrom, const CTransactionRef& ptx)
+{
+    std::vector<CTxOut> vSpent;
+    {
+        LOCK(cs_main);
+        if (!AlreadyHave(CInv(MSG_TX, ptx->GetHash()))) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+            CCoinsViewCache view(&viewMemPool);
+            CAmount nValueIn = 0;
+            for (const CTxIn& txin : ptx->vin) {
+                const Coin& coin = view.AccessCoin(txin.prevout);
+                if (coin.IsSpent()) {
+                    // Missing inputs, nothing to check ahead
+                    vSpent.clear();
+                    break;
+                }
+                vSpent.push_back(coin.out);
+                nValueIn += coin.out.nValue;
+            }
+            // Don't check the scripts of transactions that will be rejected
+            // anyway, AcceptToMemoryPool rejects them before its script checks
+            if (!vSpent.empty() && !PassesPolicyBeforeScripts(*ptx, view, nValueIn))
+                vSpent.clear();
+        }
+    }
+    return g_txprevalidator->Submit(pfrom->GetId(), ptx, std::move(vSpent), GetMempoolScriptVerifyFlags(Params()));
+}
+
+/**
+ * Validate that a getcfilters, getcfheaders or getcfcheckpt request is for a
+ * filter type we serve and a known stop block at most max_height_diff blocks
+ * after start_height. Otherwise the peer is disconnected and false returned.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chainparams,
+                                      BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(stop_hash);
+        stop_index = it != mapBlockIndex.end() ? it->second : nullptr;
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index, chainparams.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with "
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/** Answer a getcfilters request with a cfilter message per block */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, const CChainParams& chainparams,
+                               CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chainparams, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const BlockFilter& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/** Answer a getcfheaders request with the filter header of the block before
+ * the range and the filter hashes of the blocks in it */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, const CChainParams& chainparams,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chainparams, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFHEADERS,
+                         filter_type_ser, stop_index->GetBlockHash(), prev_header, filter_hashes));
+}
+
+/** Answer a getcfcheckpt request with the filter headers of every
+ * CFCHECKPT_INTERVAL-th ancestor of the stop block */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, const CChainParams& chainparams,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chainparams, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFCHECKPT,
+                         filter_type_ser, stop_index->GetBlockHash(), headers));
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1811,6 +2656,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             nCMPCTBLOCKVersion = 1;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
         }
+        if (g_tx_reconciliation && fRelayTxes) {
+            // Offer to take transaction announcements by short id
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDRECON, TX_RECONCILIATION_VERSION, g_recon_k0, g_recon_k1));
+        }
         pfrom->fSuccessfullyConnected = true;
     }
 
@@ -1927,6 +2776,80 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    else if (strCommand == NetMsgType::SENDRECON)
+    {
+        uint32_t nReconVersion = 0;
+        uint64_t nK0 = 0, nK1 = 0;
+        vRecv >> nReconVersion >> nK0 >> nK1;
+        // Ours went out on verack, which came before this
+        if (g_tx_reconciliation && fRelayTxes && nReconVersion >= TX_RECONCILIATION_VERSION) {
+            pfrom->nReconK0 = nK0;
+            pfrom->nReconK1 = nK1;
+            pfrom->fTxReconciliation = true;
+            LogPrint(BCLog::NET, "transaction reconciliation with peer=%d\n", pfrom->GetId());
+        }
+    }
+
+    else if (strCommand == NetMsgType::RECONCIL)
+    {
+        std::vector<uint64_t> vShortId;
+        vRecv >> vShortId;
+        if (!pfrom->fTxReconciliation || vShortId.size() > MAX_INV_SZ)
+        {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20, strprintf("unexpected reconcil message, size = %u", vShortId.size()));
+            return false;
+        }
+
+        // Transactions would be ignored anyway, see INV
+        if (fImporting || fReindex || IsInitialBlockDownload())
+            return true;
+
+        std::vector<uint64_t> vWanted;
+        {
+            LOCK(g_cs_recon);
+            for (uint64_t nShortId : vShortId) {
+                auto it = g_recon_mempool.find(nShortId);
+                if (it == g_recon_mempool.end()) {
+                    vWanted.push_back(nShortId);
+                } else {
+                    pfrom->AddInventoryKnown(CInv(MSG_TX, it->second));
+                }
+            }
+        }
+        if (!vWanted.empty())
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, vWanted));
+    }
+
+    else if (strCommand == NetMsgType::RECONCILDIFF)
+    {
+        std::vector<uint64_t> vShortId;
+        vRecv >> vShortId;
+        if (vShortId.size() > MAX_INV_SZ)
+        {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20, strprintf("reconcildiff message size = %u", vShortId.size()));
+            return false;
+        }
+
+        // Announce the transactions the peer is missing in full
+        std::vector<CInv> vInv;
+        {
+            LOCK(pfrom->cs_inventory);
+            for (uint64_t nShortId : vShortId) {
+                auto it = pfrom->mapReconShortIds.find(nShortId);
+                if (it == pfrom->mapReconShortIds.end()) {
+                    it = pfrom->mapReconShortIdsPrev.find(nShortId);
+                    if (it == pfrom->mapReconShortIdsPrev.end())
+                        continue;
+                }
+                vInv.emplace_back(MSG_TX, it->second);
+            }
+        }
+        if (!vInv.empty())
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+    }
+
     else if (strCommand == NetMsgType::INV)
     {
         std::vector<CInv> vInv;
@@ -1962,6 +2885,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
+                BlockMap::const_iterator itIndex = mapBlockIndex.find(inv.hash);
+                RecordBlockAnnouncement(pfrom->GetId(), inv.hash, itIndex != mapBlockIndex.end() ? itIndex->second : nullptr, BLOCK_ANNOUNCE_INV, nTimeReceived);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // We used to request the full block here, but since headers-announcements are now the
                     // primary method of announcement on the network, and since, in the case that a node
@@ -2153,13 +3078,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 pindex = chainActive.Next(pindex);
         }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
+        std::vector<const CBlockIndex*> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
         LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
         for (; pindex; pindex = chainActive.Next(pindex))
         {
-            vHeaders.push_back(pindex->GetBlockHeader());
+            vHeaders.push_back(pindex);
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
@@ -2176,7 +3100,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        connman->PushMessage(pfrom, MakeHeadersMsg(vHeaders));
     }
 
 
@@ -2190,180 +3114,16 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
-        std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
         vRecv >> ptx;
-        const CTransaction& tx = *ptx;
-
-        CInv inv(MSG_TX, tx.GetHash());
-        pfrom->AddInventoryKnown(inv);
-
-        LOCK2(cs_main, g_cs_orphans);
-
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
-
-        std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv) &&
-            AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            mempool.check(pcoinsTip.get());
-            RelayTransaction(tx, connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
-
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->GetId(),
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-                vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const CTransactionRef& porphanTx = (*mi)->second.tx;
-                    const CTransaction& orphanTx = *porphanTx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, &fMissingInputs2, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-                        LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx, connman);
-                        for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee
-                        LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
-                            // Do not use rejection cache for witness transactions or
-                            // witness-stripped transactions, as they can have been malleated.
-                            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                            assert(recentRejects);
-                            recentRejects->insert(orphanHash);
-                        }
-                    }
-                    mempool.check(pcoinsTip.get());
-                }
-            }
-
-            for (uint256 hash : vEraseQueue)
-                EraseOrphanTx(hash);
-        }
-        else if (fMissingInputs)
-        {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom);
-                for (const CTxIn& txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetHash());
-            }
-        } else {
-            if (!tx.HasWitness() && !state.CorruptionPossible()) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
-            }
 
-            if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                    RelayTransaction(tx, connman);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
-                }
-            }
-        }
+        pfrom->AddInventoryKnown(CInv(MSG_TX, ptx->GetHash()));
 
-        for (const CTransactionRef& removedTx : lRemovedTxn)
-            AddToCompactExtraTransactions(removedTx);
+        // The transaction is accepted once its scripts have been checked
+        if (g_txprevalidator && PrevalidateTransactionFromPeer(pfrom, ptx))
+            return true;
 
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
-        {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(),
-                FormatStateMessage(state));
-            if (state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
-                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-            if (nDoS > 0) {
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
-        }
+        AcceptTransactionFromPeer(pfrom, ptx, connman);
     }
 
 
@@ -2425,6 +3185,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // If AcceptBlockHeader returned true, it set pindex
         assert(pindex);
         UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+        RecordBlockAnnouncement(pfrom->GetId(), pindex->GetBlockHash(), pindex, BLOCK_ANNOUNCE_CMPCTBLOCK, nTimeReceived);
 
         CNodeState *nodestate = State(pfrom->GetId());
 
@@ -2484,13 +3245,18 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
                     Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block\n", pfrom->GetId()));
                     return true;
-                } else if (status == READ_STATUS_FAILED) {
+                }
+                compactBlockStats.nBlocks++;
+                if (status == READ_STATUS_FAILED) {
                     // Duplicate txindexes, the block is now in-flight, so just request it
+                    compactBlockStats.nFailed++;
                     std::vector<CInv> vInv(1);
                     vInv[0] = CInv(MSG_BLOCK | GetFetchFlags(pfrom), cmpctblock.header.GetHash());
                     connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
                     return true;
                 }
+                compactBlockStats.nExtraTxUsed += partialBlock.GetExtraCount();
+                compactBlockStats.nCriticalExtraTxUsed += partialBlock.GetCriticalExtraCount();
 
                 BlockTransactionsRequest req;
                 for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
@@ -2549,7 +3315,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // the peer if the header turns out to be for an invalid block.
             // Note that if a peer tries to build on an invalid chain, that
             // will be detected and the peer will be banned.
-            return ProcessHeadersMessage(pfrom, connman, {cmpctblock.header}, chainparams, /*punish_duplicate_invalid=*/false);
+            return ProcessHeadersMessage(pfrom, connman, {cmpctblock.header}, nTimeReceived, chainparams, /*punish_duplicate_invalid=*/false);
         }
 
         if (fBlockReconstructed) {
@@ -2558,6 +3324,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             {
                 LOCK(cs_main);
                 mapBlockSource.emplace(pblock->GetHash(), std::make_pair(pfrom->GetId(), false));
+                RecordBlockReceived(pfrom->GetId(), pblock->GetHash(), true, GetTimeMicros());
             }
             bool fNewBlock = false;
             // Setting fForceProcessing to true means that we bypass some of
@@ -2591,7 +3358,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         BlockTransactions resp;
-        vRecv >> resp;
+        OverrideStream<CDataStream> stream(&vRecv, vRecv.GetType() | SER_TX_ARENA, vRecv.GetVersion());
+        stream >> resp;
 
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         bool fBlockRead = false;
@@ -2611,7 +3379,23 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
                 Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->GetId()));
                 return true;
-            } else if (status == READ_STATUS_FAILED) {
+            }
+
+            // An empty resp is our own, sent when nothing was missing
+            if (status == READ_STATUS_FAILED) {
+                compactBlockStats.nFailed++;
+            } else if (resp.txn.empty()) {
+                compactBlockStats.nReconstructed++;
+            } else {
+                compactBlockStats.nRoundTrip++;
+                compactBlockStats.nTxRequested += resp.txn.size();
+                for (const CTransactionRef& tx : resp.txn) {
+                    if (!tx->criticalData.IsNull())
+                        compactBlockStats.nCriticalTxRequested++;
+                }
+            }
+
+            if (status == READ_STATUS_FAILED) {
                 // Might have collided, fall back to getdata now :(
                 std::vector<CInv> invs;
                 invs.push_back(CInv(MSG_BLOCK | GetFetchFlags(pfrom), resp.blockhash));
@@ -2642,6 +3426,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 // the header only; we should not punish peers if the block turns
                 // out to be invalid.
                 mapBlockSource.emplace(resp.blockhash, std::make_pair(pfrom->GetId(), false));
+                RecordBlockReceived(pfrom->GetId(), resp.blockhash, true, GetTimeMicros());
             }
         } // Don't hold cs_main when we call into ProcessNewBlock
         if (fBlockRead) {
@@ -2685,7 +3470,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // disconnect the peer if it is using one of our outbound connection
         // slots.
         bool should_punish = !pfrom->fInbound && !pfrom->m_manual_connection;
-        return ProcessHeadersMessage(pfrom, connman, headers, chainparams, should_punish);
+        return ProcessHeadersMessage(pfrom, connman, headers, nTimeReceived, chainparams, should_punish);
     }
 
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
@@ -2701,10 +3486,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            RecordBlockDownload(pfrom->GetId(), hash, nTimeReceived);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
+            RecordBlockReceived(pfrom->GetId(), hash, false, nTimeReceived);
         }
         bool fNewBlock = false;
         ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
@@ -2912,6 +3699,18 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+    }
+
     else if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
         // message would be undesirable as we transmit it ourselves.
@@ -2970,8 +3769,13 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     //
     bool fMoreWork = false;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        // Continue serving an earlier getdata, account for it as such
+        LockWaitTimer mainWait(&cs_main);
+        const int64_t nTimeStart = GetTimeMicros();
         ProcessGetData(pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
+        connman->RecordMessageProcessed(NetMsgType::GETDATA, 0, GetTimeMicros() - nTimeStart, mainWait.GetWaitMicros(), false);
+    }
 
     if (pfrom->fDisconnect)
         return false;
@@ -2979,6 +3783,34 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return true;
 
+    // Accept the transactions whose scripts have been checked before reading
+    // more messages, so they aren't overtaken by the peer's next transactions
+    CTransactionRef ptx;
+    std::vector<uint256> vSigCacheEntry;
+    if (g_txprevalidator && g_txprevalidator->Take(pfrom->GetId(), ptx, vSigCacheEntry)) {
+        LockWaitTimer mainWait(&cs_main);
+        const int64_t nTimeStart = GetTimeMicros();
+        // The signatures checked ahead only stay cached if the transaction
+        // makes it into the mempool
+        AddSignatureCacheEntries(vSigCacheEntry);
+        try {
+            AcceptTransactionFromPeer(pfrom, ptx, connman);
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+        if (!vSigCacheEntry.empty() && !mempool.exists(ptx->GetHash()))
+            EraseSignatureCacheEntries(vSigCacheEntry);
+        connman->RecordMessageProcessed(NetMsgType::TX, 0, GetTimeMicros() - nTimeStart, mainWait.GetWaitMicros(), false);
+        LOCK(cs_main);
+        SendRejectsAndCheckIfBanned(pfrom, connman);
+        return true;
+    }
+
+    // The peer's next transaction couldn't be queued behind its pending ones,
+    // wait for them. We're woken up when one is done.
+    if (g_txprevalidator && g_txprevalidator->MustWait(pfrom->GetId()))
+        return false;
+
     // Don't bother if send buffer is too full to respond anyway
     if (pfrom->fPauseSend)
         return false;
@@ -3028,8 +3860,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return fMoreWork;
     }
 
+    TRACE4(net, inbound_message, pfrom->GetId(), strCommand.c_str(), nMessageSize, msg.nTime);
+
     // Process message
     bool fRet = false;
+    LockWaitTimer mainWait(&cs_main);
+    const int64_t nTimeStart = GetTimeMicros();
     try
     {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
@@ -3066,6 +3902,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     } catch (...) {
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
+    connman->RecordMessageProcessed(strCommand, nMessageSize + CMessageHeader::HEADER_SIZE, GetTimeMicros() - nTimeStart, mainWait.GetWaitMicros());
 
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->GetId());
@@ -3207,20 +4044,15 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
     }
 }
 
+/** Orders inventory by its rank from CTxMemPool::GetDepthAndScoreRanks */
 class CompareInvMempoolOrder
 {
-    CTxMemPool *mp;
 public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(const std::pair<uint64_t, std::set<uint256>::iterator>& a, const std::pair<uint64_t, std::set<uint256>::iterator>& b) const
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+         * fewest ancestors/highest fee, the lowest rank, to sort later. */
+        return a.first > b.first;
     }
 };
 
@@ -3353,7 +4185,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             // blocks, or if the peer doesn't want headers, just
             // add all to the inv queue.
             LOCK(pto->cs_inventory);
-            std::vector<CBlock> vHeaders;
+            std::vector<const CBlockIndex*> vHeaders;
             bool fRevertToInv = ((!state.fPreferHeaders &&
                                  (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
                                 pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
@@ -3392,14 +4224,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     pBestIndex = pindex;
                     if (fFoundStartingHeader) {
                         // add this to the headers message
-                        vHeaders.push_back(pindex->GetBlockHeader());
+                        vHeaders.push_back(pindex);
                     } else if (PeerHasHeader(&state, pindex)) {
                         continue; // keep looking for the first new block
                     } else if (pindex->pprev == nullptr || PeerHasHeader(&state, pindex->pprev)) {
                         // Peer doesn't have this header but they do have the prior one.
                         // Start sending headers.
                         fFoundStartingHeader = true;
-                        vHeaders.push_back(pindex->GetBlockHeader());
+                        vHeaders.push_back(pindex);
                     } else {
                         // Peer doesn't have this header or the prior one -- nothing will
                         // connect, so bail out.
@@ -3413,7 +4245,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     // We only send up to 1 block as header-and-ids, as otherwise
                     // probably means we're doing an initial-ish-sync or they're slow
                     LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", __func__,
-                            vHeaders.front().GetHash().ToString(), pto->GetId());
+                            vHeaders.front()->GetBlockHash().ToString(), pto->GetId());
 
                     int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
                     if (!state.fHaveDrivechain) {
@@ -3445,13 +4277,13 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     if (vHeaders.size() > 1) {
                         LogPrint(BCLog::NET, "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
                                 vHeaders.size(),
-                                vHeaders.front().GetHash().ToString(),
-                                vHeaders.back().GetHash().ToString(), pto->GetId());
+                                vHeaders.front()->GetBlockHash().ToString(),
+                                vHeaders.back()->GetBlockHash().ToString(), pto->GetId());
                     } else {
                         LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
-                                vHeaders.front().GetHash().ToString(), pto->GetId());
+                                vHeaders.front()->GetBlockHash().ToString(), pto->GetId());
                     }
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    connman->PushMessage(pto, MakeHeadersMsg(vHeaders));
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -3553,10 +4385,17 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             // Determine transactions to relay
             if (fSendTrickle) {
                 // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
+                std::vector<std::pair<uint64_t, std::set<uint256>::iterator>> vInvTx;
                 vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
+                {
+                    // Rank the candidates once, so that sorting them doesn't
+                    // take the mempool lock for every comparison
+                    const std::vector<uint256> vHash(pto->setInventoryTxToSend.begin(), pto->setInventoryTxToSend.end());
+                    const std::vector<uint64_t> vRank = mempool.GetDepthAndScoreRanks(vHash);
+                    size_t i = 0;
+                    for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
+                        vInvTx.emplace_back(vRank[i++], it);
+                    }
                 }
                 CAmount filterrate = 0;
                 {
@@ -3565,16 +4404,25 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 }
                 // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                 // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
+                CompareInvMempoolOrder compareInvMempoolOrder;
                 std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
+                // Peers doing reconciliation get short ids instead of inv's.
+                // Keep the previous set around for a "reconcildiff" to it
+                // still on its way.
+                const bool fReconcile = pto->fTxReconciliation;
+                std::vector<uint64_t> vShortId;
+                if (fReconcile && !vInvTx.empty()) {
+                    pto->mapReconShortIdsPrev = std::move(pto->mapReconShortIds);
+                    pto->mapReconShortIds.clear();
+                }
                 LOCK(pto->cs_filter);
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
                     std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
+                    std::set<uint256>::iterator it = vInvTx.back().second;
                     vInvTx.pop_back();
                     uint256 hash = *it;
                     // Remove it from the to-be-sent set
@@ -3593,7 +4441,13 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     // Send
-                    vInv.push_back(CInv(MSG_TX, hash));
+                    if (fReconcile) {
+                        const uint64_t nShortId = SipHashUint256(pto->nReconK0, pto->nReconK1, hash);
+                        pto->mapReconShortIds[nShortId] = hash;
+                        vShortId.push_back(nShortId);
+                    } else {
+                        vInv.push_back(CInv(MSG_TX, hash));
+                    }
                     nRelayedTransactions++;
                     {
                         // Expire old relay messages
@@ -3614,6 +4468,8 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     }
                     pto->filterInventoryKnown.insert(hash);
                 }
+                if (!vShortId.empty())
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::RECONCIL, vShortId));
             }
         }
         if (!vInv.empty())
@@ -3684,10 +4540,41 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const bool fIBD = IsInitialBlockDownload();
+        if (fIBD) {
+            state.nBlocksInTransitMax = GetBlocksInTransitMax(&state, pto->nMinPingUsecTime);
+        } else {
+            state.nBlocksInTransitMax = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+            nBlockDownloadWindow = BLOCK_DOWNLOAD_WINDOW;
+        }
+        if (!pto->fClient && (fFetch || !fIBD) && state.nBlocksInFlight < state.nBlocksInTransitMax) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexWaitingFor = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInTransitMax - state.nBlocksInFlight, vToDownload, staller, consensusParams, &pindexWaitingFor);
+            if (fIBD && staller != -1 && pindexWaitingFor) {
+                // The window can't move until pindexWaitingFor arrives. If everything before it has been
+                // connected, validation is idle as well, so let the window reach further for the next round.
+                if (!fPruneMode && nBlockDownloadWindow < MAX_BLOCK_DOWNLOAD_WINDOW && chainActive.Height() >= pindexWaitingFor->nHeight - 1) {
+                    nBlockDownloadWindow = std::min(2 * nBlockDownloadWindow, MAX_BLOCK_DOWNLOAD_WINDOW);
+                    LogPrint(BCLog::NET, "Block download window widened to %u blocks\n", nBlockDownloadWindow);
+                }
+                // Rather than waiting for the staller to time out, take the block over if this peer is much
+                // faster and it has been in flight for much longer than this peer would need to deliver it.
+                const CNodeState* stateStaller = State(staller);
+                const int64_t nTimeRequested = mapBlocksInFlight[pindexWaitingFor->GetBlockHash()].second->nTimeRequested;
+                int64_t nPingUsec = pto->nMinPingUsecTime;
+                if (nPingUsec == std::numeric_limits<int64_t>::max())
+                    nPingUsec = 0;
+                if (state.nBlockDownloadTime > 0 &&
+                        (stateStaller->nBlockDownloadTime < 0 || stateStaller->nBlockDownloadTime > BLOCK_REREQUEST_FACTOR * state.nBlockDownloadTime) &&
+                        nNow - nTimeRequested > BLOCK_REREQUEST_FACTOR * (nPingUsec + (state.nBlocksInFlight + 1) * state.nBlockDownloadTime)) {
+                    LogPrint(BCLog::NET, "Block %s (%d) is late from peer=%d, requesting it from peer=%d\n", pindexWaitingFor->GetBlockHash().ToString(),
+                        pindexWaitingFor->nHeight, staller, pto->GetId());
+                    vToDownload.push_back(pindexWaitingFor);
+                    staller = -1;
+                }
+            }
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -18,6 +18,8 @@ static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Default number of evicted or rejected BMM requests to keep around per sidechain for block reconstruction */
+static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_BMM_TXN = 4;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -34,6 +36,10 @@ static constexpr int64_t STALE_CHECK_INTERVAL = 10 * 60; // 10 minutes
 static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 /** Minimum time an outbound-peer-eviction candidate must be connected for, in order to evict, in seconds */
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
+/** Default for -txreconciliation */
+static const bool DEFAULT_TX_RECONCILIATION = false;
+/** Version of transaction reconciliation sent in "sendrecon" */
+static const uint32_t TX_RECONCILIATION_VERSION = 1;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -46,6 +52,8 @@ public:
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
     void BlockChecked(const CBlock& block, const CValidationState& state) override;
     void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) override;
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx) override;
 
 
     void InitializeNode(CNode* pnode) override;
@@ -74,10 +82,74 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    uint64_t nBlocksAnnounced;
+    uint64_t nBlocksAnnouncedFirst;
+    int64_t nBlockAnnounceDelay;
+    int nBlocksInTransitMax;
+    int64_t nBlockDownloadTime;
+    bool fHighBandwidth;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+
+/** Return the "headers" message for vIndex, copying the headers out of a
+ * cache and serializing only the ones that aren't in it yet. Requires
+ * cs_main. */
+CSerializedNetMsg MakeHeadersMsg(const std::vector<const CBlockIndex*>& vIndex);
+
+/** Compact block reconstruction statistics since startup */
+struct CompactBlockStats {
+    uint64_t nBlocks = 0;               //! Compact blocks we started reconstructing
+    uint64_t nReconstructed = 0;        //! Reconstructed without a round trip
+    uint64_t nRoundTrip = 0;            //! Reconstructed after a getblocktxn round trip
+    uint64_t nFailed = 0;               //! Fell back to downloading the full block
+    uint64_t nTxRequested = 0;          //! Transactions requested with getblocktxn
+    uint64_t nCriticalTxRequested = 0;  //! Critical data transactions requested with getblocktxn
+    uint64_t nExtraTxUsed = 0;          //! Transactions found in the extra transaction pool
+    uint64_t nCriticalExtraTxUsed = 0;  //! Critical data transactions found in the extra transaction pool
+};
+
+/** Get compact block reconstruction statistics */
+void GetCompactBlockStats(CompactBlockStats& stats);
+
+/** Number of recent blocks whose propagation is kept for getblockpropagation */
+static const unsigned int MAX_BLOCK_PROPAGATION_RECORDS = 64;
+
+/** How a peer first told us about a block */
+enum BlockAnnounceType {
+    BLOCK_ANNOUNCE_INV,
+    BLOCK_ANNOUNCE_HEADERS,
+    BLOCK_ANNOUNCE_CMPCTBLOCK,
+};
+
+/** Name of the message of a BlockAnnounceType */
+std::string BlockAnnounceTypeName(BlockAnnounceType type);
+
+/** When a peer told us about a block. Times are in microseconds. */
+struct BlockPeerPropagation {
+    NodeId nodeid;
+    BlockAnnounceType type;
+    int64_t nAnnounced = 0;     //! First announcement, of any type
+    int64_t nHeader = 0;        //! Header received with HEADERS or CMPCTBLOCK, 0 if not (yet)
+};
+
+/** How a block reached us. Times are in microseconds. */
+struct BlockPropagation {
+    uint256 hash;
+    int nHeight = -1;               //! -1 while the header is unknown
+    int64_t nFirstSeen = 0;         //! First announcement by any peer
+    NodeId nodeFirst = -1;          //! Peer that announced it first
+    int64_t nReceived = 0;          //! Block downloaded or reconstructed, 0 if not (yet)
+    NodeId nodeReceived = -1;       //! Peer we got the block from
+    bool fReconstructed = false;    //! Whether it was reconstructed from a compact block
+    int64_t nConnected = 0;         //! ConnectBlock completed, 0 if not (yet)
+    std::vector<BlockPeerPropagation> vPeer;    //! In the order the peers announced the block
+};
+
+/** Get the propagation of the last MAX_BLOCK_PROPAGATION_RECORDS blocks
+ * announced to us, oldest first */
+void GetBlockPropagation(std::vector<BlockPropagation>& vBlock);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
 
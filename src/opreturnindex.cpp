@@ -0,0 +1,232 @@
+// Copyright (c) 2017-2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <opreturnindex.h>
+
+#include <bloom.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+/** How often old data is pruned with -opreturnretention */
+static const int OPRETURN_PRUNE_INTERVAL = 144; // blocks
+
+std::unique_ptr<OPReturnIndex> g_opreturnindex;
+
+OPReturnIndex::OPReturnIndex(OPReturnDB* pdbIn, int nRetentionDaysIn)
+    : BaseIndex("opreturnidx", "OP_RETURN index"), pdb(pdbIn), nRetentionDays(nRetentionDaysIn)
+{
+}
+
+OPReturnIndex::~OPReturnIndex()
+{
+    Interrupt();
+    Stop();
+}
+
+bool OPReturnIndex::ReadLocator(CBlockLocator& locator)
+{
+    return pdb->ReadBestBlock(locator);
+}
+
+bool OPReturnIndex::WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex)
+{
+    return pdb->WriteBestBlock(locator);
+}
+
+bool OPReturnIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (!WriteBlockData(block, pindex))
+        return false;
+
+    // Old data is pruned once the index follows the chain tip
+    if (IsSynced() && nRetentionDays > 0 && pindex->nHeight % OPRETURN_PRUNE_INTERVAL == 0)
+        Prune(pindex);
+    return true;
+}
+
+bool OPReturnIndex::WriteBlockData(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::vector<OPReturnData> vOPReturnData;
+    CBlockUndo blockundo;
+    bool fHaveUndo = false;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+
+        unsigned int nTxSize = 0;
+        CAmount txfee = 0;
+        for (const CTxOut& o : tx.vout) {
+            const CScript& scriptPubKey = o.scriptPubKey;
+            if (scriptPubKey.empty() || scriptPubKey[0] != OP_RETURN)
+                continue;
+
+            // The coins spent by the block are gone from the UTXO set, so
+            // calculate the fee from the undo data
+            if (!nTxSize) {
+                nTxSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+
+                if (!tx.IsCoinBase()) {
+                    if (!fHaveUndo) {
+                        if (!UndoReadFromDisk(blockundo, pindex))
+                            return false;
+                        if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+                            return error("%s: undo data mismatch", __func__);
+                        fHaveUndo = true;
+                    }
+
+                    const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+                    if (txundo.vprevout.size() != tx.vin.size())
+                        return error("%s: undo data mismatch", __func__);
+
+                    CAmount nValueIn = 0;
+                    for (const Coin& coin : txundo.vprevout)
+                        nValueIn += coin.out.nValue;
+                    txfee = nValueIn - tx.GetValueOut();
+                }
+            }
+
+            OPReturnData data;
+            data.txid = tx.GetHash();
+            data.script = scriptPubKey;
+            data.nSize = nTxSize;
+            data.fees = txfee;
+
+            vOPReturnData.push_back(data);
+        }
+    }
+
+    if (vOPReturnData.empty())
+        return true;
+
+    // Blocks are rewritten rather than skipped if we already have them so
+    // that data from before the news index was added gets indexed as well
+    return pdb->WriteBlockData(std::make_pair(pindex->GetBlockHash(), vOPReturnData), pindex->nTime);
+}
+
+void OPReturnIndex::Prune(const CBlockIndex* pindex)
+{
+    // Keep the news of the longest news type period
+    int nDays = nRetentionDays;
+    std::vector<NewsType> vType;
+    pdb->GetNewsTypes(vType);
+    for (const NewsType& type : vType)
+        nDays = std::max(nDays, type.nDays);
+
+    const int64_t nTimeCutoff = pindex->GetBlockTime() - (int64_t)nDays * 24 * 60 * 60;
+    if (nTimeCutoff <= 0)
+        return;
+
+    // Blocks of the active chain are pruned in height order, up to the
+    // first one whose time could be within the period. The ancestors of
+    // pindex don't change, so this doesn't need cs_main.
+    const int nPruneStart = pdb->ReadPruneHeight();
+    const int nPruneMax = std::min(pindex->nHeight, nPruneStart + DB_PRUNE_MAX_BLOCKS);
+    std::vector<uint256> vHash;
+    int nPruneHeight = nPruneStart;
+    for (; nPruneHeight < nPruneMax; nPruneHeight++) {
+        const CBlockIndex* pindexPrune = pindex->GetAncestor(nPruneHeight);
+        if (pindexPrune->GetBlockTimeMax() >= nTimeCutoff)
+            break;
+        vHash.push_back(pindexPrune->GetBlockHash());
+    }
+
+    if (!pdb->Prune(vHash, nPruneHeight, (uint32_t)nTimeCutoff)) {
+        LogPrintf("%s: Failed to prune the OP_RETURN index\n", __func__);
+        return;
+    }
+    LogPrint(BCLog::PRUNE, "Pruned OP_RETURN data of %u blocks, now kept from height %d\n", vHash.size(), nPruneHeight);
+}
+
+void FindNews(const CScript& header, uint32_t nTimeStart, std::vector<OPReturnNews>& vNews)
+{
+    std::vector<OPReturnNews> vFound;
+    popreturndb->GetNews(header, nTimeStart, vFound);
+
+    LOCK(cs_main);
+    for (const OPReturnNews& news : vFound) {
+        BlockMap::const_iterator it = mapBlockIndex.find(news.hashBlock);
+        if (it == mapBlockIndex.end() || !chainActive.Contains(it->second))
+            continue;
+        vNews.push_back(news);
+    }
+}
+
+void FindNewsBlocks(const std::vector<CScript>& vHeader, int nStartHeight, int nEndHeight, std::vector<const CBlockIndex*>& vBlock)
+{
+    std::vector<std::vector<unsigned char>> vKey;
+    for (const CScript& header : vHeader) {
+        if (header.size() >= 4)
+            vKey.emplace_back(header.begin(), header.begin() + 4);
+    }
+    if (vKey.empty())
+        return;
+
+    std::vector<const CBlockIndex*> vIndex;
+    std::vector<uint256> vHash;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexTip = GetOPReturnIndexTip();
+        if (!pindexTip)
+            return;
+        nEndHeight = std::min(nEndHeight, pindexTip->nHeight);
+        for (int nHeight = std::max(nStartHeight, 0); nHeight <= nEndHeight; nHeight++) {
+            vIndex.push_back(chainActive[nHeight]);
+            vHash.push_back(vIndex.back()->GetBlockHash());
+        }
+    }
+
+    // Skip the blocks whose filter matches none of the headers. Blocks
+    // indexed before there were filters have to be checked in full.
+    std::vector<CBloomFilter> vFilter;
+    std::vector<bool> vFound;
+    popreturndb->GetHeaderFilters(vHash, vFilter, vFound);
+
+    std::vector<const CBlockIndex*> vCandidate;
+    std::vector<uint256> vCandidateHash;
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        bool fMatch = !vFound[i];
+        for (size_t j = 0; j < vKey.size() && !fMatch; j++)
+            fMatch = vFilter[i].contains(vKey[j]);
+        if (!fMatch)
+            continue;
+        vCandidate.push_back(vIndex[i]);
+        vCandidateHash.push_back(vHash[i]);
+    }
+
+    // The filters have false positives, check the data of the candidates
+    std::vector<std::vector<OPReturnData>> vData;
+    popreturndb->GetBlockData(vCandidateHash, vData, vFound);
+    for (size_t i = 0; i < vCandidate.size(); i++) {
+        if (!vFound[i])
+            continue;
+        bool fMatch = false;
+        for (const OPReturnData& d : vData[i]) {
+            if (d.script.size() < 5 || d.script[0] != OP_RETURN)
+                continue;
+            for (size_t j = 0; j < vKey.size() && !fMatch; j++)
+                fMatch = std::equal(vKey[j].begin(), vKey[j].end(), d.script.begin() + 1);
+            if (fMatch)
+                break;
+        }
+        if (fMatch)
+            vBlock.push_back(vCandidate[i]);
+    }
+}
+
+const CBlockIndex* GetOPReturnIndexTip()
+{
+    AssertLockHeld(cs_main);
+
+    if (!g_opreturnindex)
+        return chainActive.Tip();
+
+    const CBlockIndex* pindex = g_opreturnindex->GetBestBlock();
+    return pindex ? chainActive.FindFork(pindex) : nullptr;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2017-2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_OPRETURNINDEX_H
+#define BITCOIN_OPRETURNINDEX_H
+
+#include <baseindex.h>
+
+#include <memory>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CScript;
+class OPReturnDB;
+struct OPReturnNews;
+
+static const bool DEFAULT_OPRETURNINDEX = true;
+/** Most blocks a single FindNewsBlocks query from RPC or REST scans */
+static const int MAX_NEWS_BLOCKS_SCAN = 52560;
+
+/**
+ * Background indexer that fills the OP_RETURN / CoinNews database, reading
+ * the fees of the transactions from the undo data of their block.
+ *
+ * News of disconnected blocks is left in place, lookups skip the blocks
+ * that aren't in the active chain.
+ */
+class OPReturnIndex : public BaseIndex
+{
+public:
+    /** Keep OP_RETURN data for at least nRetentionDaysIn days, or the
+     * longest news type period if that is longer. 0 keeps everything. */
+    OPReturnIndex(OPReturnDB* pdbIn, int nRetentionDaysIn = 0);
+    ~OPReturnIndex();
+
+protected:
+    bool ReadLocator(CBlockLocator& locator) override;
+
+    bool WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex) override;
+
+    /** Write the OP_RETURN data of a block to the database */
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+private:
+    /** Write the OP_RETURN outputs of a block with their fees */
+    bool WriteBlockData(const CBlock& block, const CBlockIndex* pindex);
+
+    /** Erase the data that is older than the retention period */
+    void Prune(const CBlockIndex* pindex);
+
+    OPReturnDB* pdb;
+
+    const int nRetentionDays;
+};
+
+/** Find the news starting with the 4 byte header in blocks of the active
+ * chain with a time of at least nTimeStart */
+void FindNews(const CScript& header, uint32_t nTimeStart, std::vector<OPReturnNews>& vNews);
+
+/** Find the blocks of the active chain from nStartHeight to nEndHeight with
+ * OP_RETURN data starting with any of the 4 byte headers. Blocks are skipped
+ * by their header filters without reading their data. */
+void FindNewsBlocks(const std::vector<CScript>& vHeader, int nStartHeight, int nEndHeight, std::vector<const CBlockIndex*>& vBlock);
+
+/** Return the last block of the active chain whose OP_RETURN data has been
+ * written. Block notifications can arrive before the index has seen the
+ * block, so GUI models only read up to here. Requires cs_main. */
+const CBlockIndex* GetOPReturnIndexTip();
+
+/** The global OP_RETURN index, null if -opreturnindex=0 */
+extern std::unique_ptr<OPReturnIndex> g_opreturnindex;
+
+#endif // BITCOIN_OPRETURNINDEX_H
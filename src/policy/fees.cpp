@@ -12,6 +12,8 @@
 #include <txmempool.h>
 #include <util.h>
 
+#include <cmath>
+
 static constexpr double INF_FEERATE = 1e99;
 
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
@@ -98,6 +100,14 @@ private:
 
     double decay;
 
+    // The averages are decayed lazily. nDecayCount counts the blocks that
+    // decayed the averages and bucketDecayCount[X] how many of those have
+    // been applied to bucket X. The rest is applied by GetDecay when a bucket
+    // is read and by DecayBucket before it is written, so a block doesn't
+    // have to touch every bucket of every period.
+    unsigned int nDecayCount;
+    std::vector<unsigned int> bucketDecayCount;
+
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
@@ -110,6 +120,15 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Decay not yet applied to the stored averages of a bucket */
+    double GetDecay(unsigned int bucket) const
+    {
+        return std::pow(decay, nDecayCount - bucketDecayCount[bucket]);
+    }
+
+    /** Apply the pending decay to the stored averages of a bucket */
+    void DecayBucket(unsigned int bucket);
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -178,6 +197,7 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     : buckets(defaultBuckets), bucketMap(defaultBucketMap)
 {
     decay = _decay;
+    nDecayCount = 0;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
     confAvg.resize(maxPeriods);
@@ -191,10 +211,26 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
 
     txCtAvg.resize(buckets.size());
     avg.resize(buckets.size());
+    bucketDecayCount.resize(buckets.size());
 
     resizeInMemoryCounters(buckets.size());
 }
 
+void TxConfirmStats::DecayBucket(unsigned int bucket)
+{
+    if (bucketDecayCount[bucket] == nDecayCount)
+        return;
+
+    const double factor = GetDecay(bucket);
+    for (unsigned int i = 0; i < confAvg.size(); i++)
+        confAvg[i][bucket] *= factor;
+    for (unsigned int i = 0; i < failAvg.size(); i++)
+        failAvg[i][bucket] *= factor;
+    avg[bucket] *= factor;
+    txCtAvg[bucket] *= factor;
+    bucketDecayCount[bucket] = nDecayCount;
+}
+
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
     unconfTxs.resize(GetMaxConfirms());
@@ -221,6 +257,7 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    DecayBucket(bucketindex);
     for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
         confAvg[i - 1][bucketindex]++;
     }
@@ -230,14 +267,7 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 
 void TxConfirmStats::UpdateMovingAverages()
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
-    }
+    nDecayCount++;
 }
 
 // returns -1 on error conditions
@@ -285,9 +315,10 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        const double factor = GetDecay(bucket);
+        nConf += confAvg[periodTarget - 1][bucket] * factor;
+        totalNum += txCtAvg[bucket] * factor;
+        failNum += failAvg[periodTarget - 1][bucket] * factor;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -345,13 +376,14 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
-        txSum += txCtAvg[j];
+        txSum += txCtAvg[j] * GetDecay(j);
     }
     if (foundAnswer && txSum != 0) {
         txSum = txSum / 2;
         for (unsigned int j = minBucket; j <= maxBucket; j++) {
-            if (txCtAvg[j] < txSum)
-                txSum -= txCtAvg[j];
+            const double txCt = txCtAvg[j] * GetDecay(j);
+            if (txCt < txSum)
+                txSum -= txCt;
             else { // we're in the right bucket
                 median = avg[j] / txCtAvg[j];
                 break;
@@ -395,12 +427,27 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    // Write the averages with all decay applied
+    std::vector<double> avgOut(avg);
+    std::vector<double> txCtAvgOut(txCtAvg);
+    std::vector<std::vector<double>> confAvgOut(confAvg);
+    std::vector<std::vector<double>> failAvgOut(failAvg);
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        const double factor = GetDecay(j);
+        for (unsigned int i = 0; i < confAvgOut.size(); i++)
+            confAvgOut[i][j] *= factor;
+        for (unsigned int i = 0; i < failAvgOut.size(); i++)
+            failAvgOut[i][j] *= factor;
+        avgOut[j] *= factor;
+        txCtAvgOut[j] *= factor;
+    }
+
     fileout << decay;
     fileout << scale;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << avgOut;
+    fileout << txCtAvgOut;
+    fileout << confAvgOut;
+    fileout << failAvgOut;
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -455,6 +502,10 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
 
+    // The file has all decay applied
+    nDecayCount = 0;
+    bucketDecayCount.assign(numBuckets, 0);
+
     LogPrint(BCLog::ESTIMATEFEE, "Reading estimates: %u buckets counting confirms up to %u blocks\n",
              numBuckets, maxConfirms);
 }
@@ -498,6 +549,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
+        DecayBucket(bucketindex);
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
             failAvg[i][bucketindex]++;
         }
@@ -518,6 +570,7 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         mapMemPoolTxs.erase(hash);
+        mapSmartFeeCache.clear();
         return true;
     } else {
         return false;
@@ -629,6 +682,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    mapSmartFeeCache.clear();
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -821,6 +875,27 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 {
     LOCK(cs_feeEstimator);
 
+    // Only cache targets that can be tracked so the cache stays bounded
+    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms())
+        return estimateSmartFeeUncached(confTarget, feeCalc, conservative);
+
+    const std::pair<int, bool> key(confTarget, conservative);
+    auto it = mapSmartFeeCache.find(key);
+    if (it == mapSmartFeeCache.end()) {
+        FeeCalculation calc;
+        CFeeRate feeRate = estimateSmartFeeUncached(confTarget, &calc, conservative);
+        it = mapSmartFeeCache.emplace(key, std::make_pair(feeRate, calc)).first;
+    }
+
+    if (feeCalc)
+        *feeCalc = it->second.second;
+    return it->second.first;
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
+    AssertLockHeld(cs_feeEstimator);
+
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -972,6 +1047,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            mapSmartFeeCache.clear();
         }
     }
     catch (const std::exception& e) {
@@ -257,6 +257,13 @@ private:
 
     mutable CCriticalSection cs_feeEstimator;
 
+    /** Results of estimateSmartFee by target and conservative flag. Cleared
+     *  whenever the tracked stats change, which is mostly once per block */
+    mutable std::map<std::pair<int, bool>, std::pair<CFeeRate, FeeCalculation>> mapSmartFeeCache;
+
+    /** estimateSmartFee without the cache, cs_feeEstimator must be held */
+    CFeeRate estimateSmartFeeUncached(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
@@ -12,14 +12,28 @@
 
 uint256 CBlockHeader::GetHash() const
 {
-    //return SerializeHash(*this);
-	return skydoge_hash(BEGIN(nVersion), END(nNonce));
+    if (!fImmutable)
+        return skydoge_hash(BEGIN(nVersion), END(nNonce));
+
+    // skydoge_hash never returns a null hash in practice, so a null
+    // hashCached means it has not been computed yet
+    if (hashCached.IsNull())
+        hashCached = skydoge_hash(BEGIN(nVersion), END(nNonce));
+
+    return hashCached;
 }
 
 uint256 CBlockHeader::GetPoWHash() const
 {
-//    return SerializeSHAndwichHash(*this);
-    return skydoge_hash(BEGIN(nVersion), END(nNonce));
+    // The PoW hash and the block hash are both skydoge_hash over the header,
+    // so they share the memoized value
+    return GetHash();
+}
+
+void skydoge_hash_multi(const CBlockHeader* pheaders, size_t n, uint256* out)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = pheaders[i].GetHash();
 }
 
 std::string CBlock::ToString() const
@@ -10,6 +10,10 @@
 #include <serialize.h>
 #include <uint256.h>
 
+#include <memory>
+
+struct CoinbaseCommitments;
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -28,6 +32,17 @@ public:
     uint32_t nBits;
     uint32_t nNonce;
 
+    // memory only
+    //
+    // skydoge_hash is expensive, so once a header is known not to change
+    // (it was deserialized, or handed to ProcessNewBlock) the hash is computed
+    // at most once and then served from hashCached. Headers that are still
+    // being built (e.g. by the miner) are never memoized unless MarkImmutable()
+    // is called, and anything that modifies an immutable header must call
+    // InvalidateHash() afterwards.
+    mutable uint256 hashCached;
+    mutable bool fImmutable;
+
     CBlockHeader()
     {
         SetNull();
@@ -43,6 +58,10 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+        if (ser_action.ForRead()) {
+            hashCached.SetNull();
+            fImmutable = true;
+        }
     }
 
     void SetNull()
@@ -53,6 +72,8 @@ public:
         nTime = 0;
         nBits = 0;
         nNonce = 0;
+        hashCached.SetNull();
+        fImmutable = false;
     }
 
     bool IsNull() const
@@ -62,6 +83,33 @@ public:
 
     uint256 GetHash() const;
 
+    uint256 GetPoWHash() const;
+
+    /** Allow GetHash() to memoize its result. The header must not be modified
+     * afterwards without calling InvalidateHash(). */
+    void MarkImmutable() const
+    {
+        fImmutable = true;
+    }
+
+    /** Memoize hash as the hash of this header without computing it. Only
+     * for hashes that are already known to belong to this header, such as
+     * the hash of a header read back from disk that matches its block index
+     * entry. */
+    void SetCachedHash(const uint256& hash) const
+    {
+        hashCached = hash;
+        fImmutable = true;
+    }
+
+    /** Drop the memoized hash and stop memoizing. Must be called after
+     * modifying a header that was marked immutable. */
+    void InvalidateHash()
+    {
+        hashCached.SetNull();
+        fImmutable = false;
+    }
+
     uint256 GetPrevHash() const
     {
         return hashPrevBlock;
@@ -82,6 +130,9 @@ public:
 
     // memory only
     mutable bool fChecked;
+    // The drivechain commitments of the coinbase, read at most once if the
+    // block is immutable (see GetCoinbaseCommitments in sidechain.h)
+    mutable std::shared_ptr<const CoinbaseCommitments> commitmentsCached;
 
     CBlock()
     {
@@ -99,7 +150,7 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(*static_cast<CBlockHeader*>(this));
-        READWRITE(vtx);
+        SerReadWriteTransactions(s, vtx, ser_action);
     }
 
     void SetNull()
@@ -107,6 +158,15 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        commitmentsCached.reset();
+    }
+
+    /** Drop the memoized hash and coinbase commitments, after modifying a
+     * block that was marked immutable */
+    void InvalidateHash()
+    {
+        CBlockHeader::InvalidateHash();
+        commitmentsCached.reset();
     }
 
     CBlockHeader GetBlockHeader() const
@@ -118,12 +178,23 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
+        block.hashCached     = hashCached;
+        block.fImmutable     = fImmutable;
         return block;
     }
 
     std::string ToString() const;
 };
 
+/**
+ * Compute the hashes of n independent block headers into out[0..n-1].
+ * Headers that are immutable (e.g. deserialized from a HEADERS message) keep
+ * the result memoized, so later GetHash() calls on them are free. This is the
+ * single entry point for bulk header hashing; callers that want to spread a
+ * large batch over several threads can call it on disjoint ranges.
+ */
+void skydoge_hash_multi(const CBlockHeader* pheaders, size_t n, uint256* out);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
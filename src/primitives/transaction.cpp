@@ -6,6 +6,7 @@
 #include <primitives/transaction.h>
 
 #include <hash.h>
+#include <script/scriptpattern.h>
 #include <sidechain.h>
 #include <tinyformat.h>
 #include <utilstrencodings.h>
@@ -81,23 +82,48 @@ uint256 CTransaction::GetWitnessHash() const
     }
 }
 
-bool CTransaction::GetBlindHash(uint256& hashRet) const
+/** Hash of a withdrawal without its inputs and sidechain change, which is
+ * what the sidechain committed to */
+template <typename TxType>
+static uint256 ComputeBlindHash(const TxType& tx)
 {
-    CMutableTransaction mtx(*this);
-    if (!mtx.vin.size() || !mtx.vout.size())
-        return false;
+    CMutableTransaction mtx;
+    mtx.nVersion = tx.nVersion;
+    mtx.nLockTime = tx.nLockTime;
+    mtx.criticalData = tx.criticalData;
 
     // Remove the CTIP scriptSig (set to OP_0 as the sidechain must orignally)
-    mtx.vin.clear();
     mtx.vin.resize(1);
     mtx.vin[0].scriptSig = CScript() << OP_0;
 
     // Remove the sidechain change return
-    mtx.vout.pop_back();
+    mtx.vout.assign(tx.vout.begin(), tx.vout.end() - 1);
+
+    return mtx.GetHash();
+}
 
-    // We now have the blind withdrawal hash
-    hashRet = mtx.GetHash();
+bool CMutableTransaction::GetBlindHash(uint256& hashRet) const
+{
+    if (!vin.size() || !vout.size())
+        return false;
 
+    hashRet = ComputeBlindHash(*this);
+    return true;
+}
+
+bool CTransaction::GetBlindHash(uint256& hashRet) const
+{
+    if (!vin.size() || !vout.size())
+        return false;
+
+    // Withdrawal bundles can have thousands of outputs, only hash them once
+    std::shared_ptr<const uint256> pHash = std::atomic_load(&pBlindHash);
+    if (!pHash) {
+        pHash = std::make_shared<const uint256>(ComputeBlindHash(*this));
+        std::atomic_store(&pBlindHash, pHash);
+    }
+
+    hashRet = *pHash;
     return true;
 }
 
@@ -122,6 +148,7 @@ CAmount CTransaction::GetBlindValueOut() const
 CTransaction::CTransaction() : vin(), vout(), criticalData(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash() {}
 CTransaction::CTransaction(const CMutableTransaction &tx) : vin(tx.vin), vout(tx.vout), criticalData(tx.criticalData), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
 CTransaction::CTransaction(CMutableTransaction &&tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), criticalData(tx.criticalData), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
+CTransaction::CTransaction(const CTransaction &tx) : vin(tx.vin), vout(tx.vout), criticalData(tx.criticalData), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash(tx.hash), pBlindHash(std::atomic_load(&tx.pBlindHash)), pWithdrawalInfo(std::atomic_load(&tx.pWithdrawalInfo)) {}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -164,35 +191,21 @@ std::string CTransaction::ToString() const
 
 bool CCriticalData::IsBMMRequest() const
 {
-    uint8_t nSidechain;
-    std::string strPrevBytes = "";
+    if (IsNull() || hashCritical.IsNull())
+        return false;
 
-    return IsBMMRequest(nSidechain, strPrevBytes);
+    return BMM_REQUEST_PATTERN.Match(vBytes);
 }
 
 bool CCriticalData::IsBMMRequest(uint8_t& nSidechain, std::string& strPrevBlock) const
 {
-    if (IsNull())
-        return false;
-    if (hashCritical.IsNull())
-        return false;
-    if (vBytes.size() != 8)
-        return false;
-
-    if (vBytes[0] != 0x00 || vBytes[1] != 0xbf || vBytes[2] != 0x00)
+    if (!IsBMMRequest())
         return false;
 
     nSidechain = vBytes[3];
 
-    // Read prev block bytes
-    std::vector<unsigned char> vPrevBytes;
-    vPrevBytes = std::vector<unsigned char>(vBytes.begin() + 4, vBytes.end());
-    if (vPrevBytes.size() != 4)
-        return false;
-
-    strPrevBlock = HexStr(vPrevBytes);
-    if (strPrevBlock.size() != 8)
-        return false;
+    // Prev block bytes
+    strPrevBlock = HexStr(vBytes.begin() + 4, vBytes.end());
 
     return true;
 }
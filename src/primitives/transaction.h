@@ -10,8 +10,11 @@
 #include <amount.h>
 #include <script/script.h>
 #include <serialize.h>
+#include <support/allocators/monotonic.h>
 #include <uint256.h>
 
+#include <memory>
+
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 static const int SERIALIZE_TRANSACTION_NO_DRIVECHAIN = 0x20000000;
 
@@ -336,6 +339,8 @@ inline void SerializeTransaction(const TxType& tx, Stream& s) {
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
+struct WithdrawalBundleInfo;
+
 class CTransaction
 {
 public:
@@ -363,6 +368,14 @@ private:
     /** Memory only. */
     const uint256 hash;
 
+    /** Memory only. The blind hash, computed by the first GetBlindHash call.
+     * Only accessed with std::atomic_load / std::atomic_store. */
+    mutable std::shared_ptr<const uint256> pBlindHash;
+
+    /** Memory only. The withdrawal bundle analysis of GetWithdrawalBundleInfo
+     * (sidechaindb.h). Only accessed with std::atomic_load / std::atomic_store. */
+    mutable std::shared_ptr<const WithdrawalBundleInfo> pWithdrawalInfo;
+
     uint256 ComputeHash() const;
 
 public:
@@ -373,6 +386,8 @@ public:
     CTransaction(const CMutableTransaction &tx);
     CTransaction(CMutableTransaction &&tx);
 
+    CTransaction(const CTransaction &tx);
+
     template <typename Stream>
     inline void Serialize(Stream& s) const {
         SerializeTransaction(*this, s);
@@ -394,11 +409,16 @@ public:
     // Compute a hash that includes both transaction and witness data
     uint256 GetWitnessHash() const;
 
-    // Compute blind hash of withdrawal tx (remove inputs and sidechain change)
+    // Blind hash of withdrawal tx (remove inputs and sidechain change),
+    // computed once and cached
     bool GetBlindHash(uint256& hashRet) const;
 
     CAmount GetBlindValueOut() const;
 
+    // Cached withdrawal bundle analysis, see GetWithdrawalBundleInfo
+    std::shared_ptr<const WithdrawalBundleInfo> GetWithdrawalInfoCache() const { return std::atomic_load(&pWithdrawalInfo); }
+    void SetWithdrawalInfoCache(const std::shared_ptr<const WithdrawalBundleInfo>& pInfo) const { std::atomic_store(&pWithdrawalInfo, pInfo); }
+
     // Return sum of txouts.
     CAmount GetValueOut() const;
     // GetValueIn() is a method on CCoinsViewCache, because
@@ -472,6 +492,10 @@ struct CMutableTransaction
      */
     uint256 GetHash() const;
 
+    /** Compute the blind hash of this CMutableTransaction, see
+     * CTransaction::GetBlindHash. Computed on the fly as well. */
+    bool GetBlindHash(uint256& hashRet) const;
+
     friend bool operator==(const CMutableTransaction& a, const CMutableTransaction& b)
     {
         return a.GetHash() == b.GetHash();
@@ -492,4 +516,51 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** Most transactions made room for in advance by UnserializeTransactions */
+static const uint64_t MAX_TX_ARENA_RESERVE = 4096;
+/** Arena memory a transaction takes, with its shared_ptr control block */
+static const size_t TX_ARENA_ENTRY_SIZE = sizeof(CTransaction) + 32;
+
+/** Unserialize a transaction into memory from arena, which it keeps alive */
+template <typename Stream>
+static inline CTransactionRef MakeTransactionRef(deserialize_type, Stream& s, const std::shared_ptr<MonotonicArena>& arena)
+{
+    return std::allocate_shared<const CTransaction>(monotonic_allocator<CTransaction>(arena), deserialize, s);
+}
+
+/**
+ * Unserialize the transactions of a block or of a blocktxn message. With
+ * SER_TX_ARENA the transaction objects and their reference counts all come
+ * from one arena, which is freed once the last of them is gone.
+ */
+template <typename Stream>
+void UnserializeTransactions(Stream& s, std::vector<CTransactionRef>& vtx)
+{
+    if (!(s.GetType() & SER_TX_ARENA)) {
+        ::Unserialize(s, vtx);
+        return;
+    }
+
+    const uint64_t nSize = ReadCompactSize(s);
+    vtx.clear();
+    vtx.reserve(std::min<uint64_t>(nSize, MAX_TX_ARENA_RESERVE));
+    // Room for the first transactions, the arena grows by the same again
+    auto arena = std::make_shared<MonotonicArena>(std::min<uint64_t>(nSize, MAX_TX_ARENA_RESERVE) * TX_ARENA_ENTRY_SIZE);
+    for (uint64_t i = 0; i < nSize; i++) {
+        vtx.push_back(MakeTransactionRef(deserialize, s, arena));
+    }
+}
+
+template <typename Stream>
+inline void SerReadWriteTransactions(Stream& s, const std::vector<CTransactionRef>& vtx, CSerActionSerialize ser_action)
+{
+    ::Serialize(s, vtx);
+}
+
+template <typename Stream>
+inline void SerReadWriteTransactions(Stream& s, std::vector<CTransactionRef>& vtx, CSerActionUnserialize ser_action)
+{
+    UnserializeTransactions(s, vtx);
+}
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
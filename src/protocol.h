@@ -219,6 +219,23 @@ extern const char *FEEFILTER;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *SENDCMPCT;
+/**
+ * Contains a 4-byte version and a 16-byte SipHash key. Sent after verack by
+ * nodes running with -txreconciliation, which announce transactions to
+ * peers that sent it too with "reconcil" instead of "inv".
+ */
+extern const char *SENDRECON;
+/**
+ * Contains a vector of 8-byte short ids of transactions, their txids hashed
+ * with the SipHash key from the receiver's "sendrecon". Peer should respond
+ * with a "reconcildiff" for the ones it doesn't have.
+ */
+extern const char *RECONCIL;
+/**
+ * Contains the short ids from a "reconcil" message which the sender doesn't
+ * have. Peer should respond with an "inv" of their txids.
+ */
+extern const char *RECONCILDIFF;
 /**
  * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
  * list of SERIALIZE_TRANSACTION_NO_WITNESS "short txids"
@@ -243,6 +260,43 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * getcfilters requests compact filters of a particular type for a particular
+ * range of blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char *GETCFILTERS;
+/**
+ * cfilter is a response to a getcfilters request containing a single compact
+ * filter.
+ */
+extern const char *CFILTER;
+/**
+ * getcfheaders requests a compact filter header and the filter hashes for a
+ * range of blocks, which can then be used to reconstruct the filter headers
+ * for those blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * cfheaders is a response to a getcfheaders request containing a filter header
+ * and a vector of filter hashes for each subsequent block in the requested range.
+ */
+extern const char *CFHEADERS;
+/**
+ * getcfcheckpt requests evenly spaced compact filter headers, enabling
+ * parallelized download and validation of the headers between them.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * cfcheckpt is a response to a getcfcheckpt request containing a vector of
+ * evenly spaced filter headers for blocks on the requested chain.
+ */
+extern const char *CFCHECKPT;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -271,6 +325,9 @@ enum ServiceFlags : uint64_t {
     NODE_XTHIN = (1 << 4),
     // NODE_DRIVECHAIN means that this node supports Drivechain
     NODE_DRIVECHAIN = (1 << 5),
+    // NODE_COMPACT_FILTERS means the node will service basic block filter requests.
+    // See BIP157 and BIP158 for details on how this is implemented.
+    NODE_COMPACT_FILTERS = (1 << 6),
     // NODE_NETWORK_LIMITED means the same as NODE_NETWORK with the limitation of only
     // serving the last 288 (2 day) blocks
     // See BIP159 for details on how this is implemented.
@@ -17,6 +17,9 @@
 
 #include <chain.h>
 
+// Number of older blocks loaded at a time when scrolled to the left end
+static const int BLOCK_EXPLORER_FETCH = 10;
+
 BlockExplorer::BlockExplorer(const PlatformStyle *_platformStyle, QWidget *parent) :
     QDialog(parent),
     ui(new Ui::BlockExplorer),
@@ -58,7 +61,11 @@ BlockExplorer::BlockExplorer(const PlatformStyle *_platformStyle, QWidget *paren
     ui->tableViewBlocks->setStyleSheet(style);
 
     connect(this, SIGNAL(UpdateTable()), blockExplorerModel, SLOT(UpdateModel()));
-    connect(blockExplorerModel, SIGNAL(columnsInserted(QModelIndex, int, int)), this, SLOT(scrollRight()));
+    connect(blockExplorerModel, SIGNAL(columnsInserted(QModelIndex, int, int)), this, SLOT(columnsInserted(QModelIndex, int, int)));
+    connect(blockExplorerModel, SIGNAL(modelReset()), this, SLOT(scrollRight()));
+
+    // Older blocks are loaded when scrolled to the left end
+    connect(ui->tableViewBlocks->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(horizontalScrolled(int)));
 }
 
 BlockExplorer::~BlockExplorer()
@@ -84,6 +91,7 @@ void BlockExplorer::numBlocksChanged(int nHeight, const QDateTime& time)
 void BlockExplorer::setClientModel(ClientModel *model)
 {
     this->clientModel = model;
+    blockIndexDialog->setClientModel(model);
     if(model)
     {
         connect(model, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
@@ -138,6 +146,26 @@ void BlockExplorer::scrollRight()
     ui->tableViewBlocks->horizontalScrollBar()->setValue(nMax);
 }
 
+void BlockExplorer::columnsInserted(const QModelIndex& /*parent*/, int first, int /*last*/)
+{
+    // Follow new blocks, but not older ones loaded on the left
+    if (first > 0)
+        scrollRight();
+}
+
+void BlockExplorer::horizontalScrolled(int nValue)
+{
+    if (nValue != ui->tableViewBlocks->horizontalScrollBar()->minimum())
+        return;
+    if (!blockExplorerModel->CanFetchOlder())
+        return;
+
+    // Keep the block that was first in view
+    int nFetched = blockExplorerModel->FetchOlder(BLOCK_EXPLORER_FETCH);
+    if (nFetched > 0)
+        ui->tableViewBlocks->scrollTo(blockExplorerModel->index(0, nFetched));
+}
+
 void BlockExplorer::updateOnShow()
 {
     Q_EMIT(UpdateTable());
@@ -14,6 +14,7 @@ class PlatformStyle;
 
 QT_BEGIN_NAMESPACE
 class QDateTime;
+class QModelIndex;
 QT_END_NAMESPACE
 
 namespace Ui {
@@ -39,6 +40,8 @@ private Q_SLOTS:
     void numBlocksChanged(int nHeight, const QDateTime& time);
     void on_tableViewBlocks_doubleClicked(const QModelIndex& index);
     void on_lineEditSearch_returnPressed();
+    void columnsInserted(const QModelIndex& parent, int first, int last);
+    void horizontalScrolled(int nValue);
 
 private:
     Ui::BlockExplorer *ui;
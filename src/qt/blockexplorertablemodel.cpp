@@ -7,15 +7,30 @@
 #include <chain.h>
 #include <validation.h>
 
+#include <algorithm>
+
 #include <QDateTime>
 #include <QIcon>
-#include <QMetaType>
 #include <QVariant>
 
-Q_DECLARE_METATYPE(BlockExplorerTableObject)
+// Number of the latest blocks displayed when the model is first loaded
+static const int BLOCK_EXPLORER_DISPLAY = 10;
+
+static BlockExplorerTableObject MakeTableObject(const CBlockIndex* index)
+{
+    BlockExplorerTableObject object;
+    object.nHeight = index->nHeight;
+    object.hash = index->GetBlockHash();
+    object.hashPrev = index->pprev ? index->pprev->GetBlockHash() : uint256();
+    object.hashMerkleRoot = index->hashMerkleRoot;
+    object.nTime = index->nTime;
+    object.nBits = index->nBits;
+    return object;
+}
 
 BlockExplorerTableModel::BlockExplorerTableModel(QObject *parent) :
-    QAbstractTableModel(parent)
+    QAbstractTableModel(parent),
+    nBlocksToDisplay(BLOCK_EXPLORER_DISPLAY)
 {
 }
 
@@ -38,10 +53,10 @@ QVariant BlockExplorerTableModel::data(const QModelIndex &index, int role) const
     int row = index.row();
     int col = index.column();
 
-    if (!model.at(col).canConvert<BlockExplorerTableObject>())
+    if (col >= model.size())
         return QVariant();
 
-    BlockExplorerTableObject object = model.at(col).value<BlockExplorerTableObject>();
+    const BlockExplorerTableObject& object = model.at(col);
 
     switch (role) {
     case Qt::DisplayRole:
@@ -135,41 +150,92 @@ QVariant BlockExplorerTableModel::headerData(int section, Qt::Orientation orient
 
 void BlockExplorerTableModel::UpdateModel()
 {
-    // Clear old data
-    beginResetModel();
-    model.clear();
-    endResetModel();
-
-    int nHeight = chainActive.Height() + 1;
-    int nBlocksToDisplay = 10;
-    if (nHeight < nBlocksToDisplay)
-        nBlocksToDisplay = nHeight;
-
-    beginInsertColumns(QModelIndex(), model.size(), model.size() + nBlocksToDisplay - 1);
-    for (int i = nBlocksToDisplay; i; i--) {
-        CBlockIndex *index = chainActive[nHeight - i];
-
-        // TODO add error message or something to table?
-        if (!index) {
-            continue;
-        }
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (!pindexTip) {
+        beginResetModel();
+        model.clear();
+        endResetModel();
+        return;
+    }
+
+    // Remove the blocks disconnected by a reorg. The columns are a chain, so
+    // once a block is in the active chain so are all of the older ones.
+    int nKeep = model.size();
+    while (nKeep > 0) {
+        const CBlockIndex* index = chainActive[model.at(nKeep - 1).nHeight];
+        if (index && index->GetBlockHash() == model.at(nKeep - 1).hash)
+            break;
+        nKeep--;
+    }
+    if (nKeep < model.size()) {
+        beginRemoveColumns(QModelIndex(), nKeep, model.size() - 1);
+        model.erase(model.begin() + nKeep, model.end());
+        endRemoveColumns();
+    }
 
-        BlockExplorerTableObject object;
-        object.nHeight = nHeight - i;
-        object.hash = index->GetBlockHash();
-        object.hashMerkleRoot = index->hashMerkleRoot;
+    const int nFirst = std::max(0, pindexTip->nHeight - nBlocksToDisplay + 1);
 
-        uint256 hashPrev = uint256();
-        if (index->pprev)
-            hashPrev = index->pprev->GetBlockHash();
+    // Too far behind the tip to keep any of the old columns
+    if (model.isEmpty() || model.back().nHeight + 1 < nFirst) {
+        beginResetModel();
+        model.clear();
+        for (int nHeight = nFirst; nHeight <= pindexTip->nHeight; nHeight++)
+            model.append(MakeTableObject(chainActive[nHeight]));
+        endResetModel();
+        return;
+    }
 
-        object.hashPrev = hashPrev;
-        object.nTime = index->nTime;
-        object.nBits = index->nBits;
+    // Add the new blocks on the right
+    const int nNext = model.back().nHeight + 1;
+    if (nNext <= pindexTip->nHeight) {
+        beginInsertColumns(QModelIndex(), model.size(), model.size() + pindexTip->nHeight - nNext);
+        for (int nHeight = nNext; nHeight <= pindexTip->nHeight; nHeight++)
+            model.append(MakeTableObject(chainActive[nHeight]));
+        endInsertColumns();
+    }
 
-        model.append(QVariant::fromValue(object));
+    // And drop as many of the oldest ones
+    const int nDrop = nFirst - model.front().nHeight;
+    if (nDrop > 0) {
+        beginRemoveColumns(QModelIndex(), 0, nDrop - 1);
+        model.erase(model.begin(), model.begin() + nDrop);
+        endRemoveColumns();
     }
+}
+
+bool BlockExplorerTableModel::CanFetchOlder() const
+{
+    return !model.isEmpty() && model.front().nHeight > 0;
+}
+
+int BlockExplorerTableModel::FetchOlder(int nCount)
+{
+    if (!CanFetchOlder() || nCount <= 0)
+        return 0;
+
+    LOCK(cs_main);
+
+    const int nFirst = std::max(0, model.front().nHeight - nCount);
+    const int nFetch = model.front().nHeight - nFirst;
+
+    // The first column must still be in the active chain, or UpdateModel
+    // will catch up with the reorg first
+    const CBlockIndex* index = chainActive[model.front().nHeight];
+    if (!index || index->GetBlockHash() != model.front().hash)
+        return 0;
+
+    QList<BlockExplorerTableObject> older;
+    for (index = index->pprev; index && index->nHeight >= nFirst; index = index->pprev)
+        older.prepend(MakeTableObject(index));
+
+    beginInsertColumns(QModelIndex(), 0, nFetch - 1);
+    model = older + model;
     endInsertColumns();
+
+    nBlocksToDisplay += nFetch;
+    return nFetch;
 }
 
 CBlockIndex* BlockExplorerTableModel::GetBlockIndex(const uint256& hash) const
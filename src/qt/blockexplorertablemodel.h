@@ -37,6 +37,13 @@ public:
     CBlockIndex* GetBlockIndex(int nHeight) const;
     CBlockIndex* GetTip() const;
 
+    /** Return true if there are blocks older than the first column */
+    bool CanFetchOlder() const;
+
+    /** Load up to nCount blocks older than the first column, return the
+     * number of columns inserted at the left */
+    int FetchOlder(int nCount);
+
     enum RoleIndex {
         HeightRole = Qt::UserRole,
         HashRole
@@ -46,7 +53,12 @@ public Q_SLOTS:
     void UpdateModel();
 
 private:
-    QList<QVariant> model;
+    // Blocks of the active chain at consecutive heights, oldest first. Only
+    // the columns that change are inserted or removed on a new tip.
+    QList<BlockExplorerTableObject> model;
+
+    // Number of the latest blocks kept, grows as older blocks are fetched
+    int nBlocksToDisplay;
 };
 
 #endif // BLOCKEXPLORERTABLEMODEL_H
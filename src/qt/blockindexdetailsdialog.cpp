@@ -12,7 +12,6 @@
 #include <QMessageBox>
 
 #include <chain.h>
-#include <chainparams.h>
 #include <streams.h>
 #include <utilstrencodings.h>
 #include <validation.h>
@@ -51,6 +50,15 @@ BlockIndexDetailsDialog::~BlockIndexDetailsDialog()
     delete ui;
 }
 
+void BlockIndexDetailsDialog::setClientModel(ClientModel *model)
+{
+    if (clientModel)
+        disconnect(clientModel, SIGNAL(blockDetailsLoaded(BlockDetailsRef)), this, SLOT(blockDetailsLoaded(BlockDetailsRef)));
+    clientModel = model;
+    if (clientModel)
+        connect(clientModel, SIGNAL(blockDetailsLoaded(BlockDetailsRef)), this, SLOT(blockDetailsLoaded(BlockDetailsRef)));
+}
+
 void BlockIndexDetailsDialog::SetBlockIndex(const CBlockIndex* index)
 {
     if (!index)
@@ -59,8 +67,8 @@ void BlockIndexDetailsDialog::SetBlockIndex(const CBlockIndex* index)
     nHeight = index->nHeight;
     hashBlock = index->GetBlockHash();
     cachedBlock.SetNull();
-    ui->labelBlockInfo->setText("#Tx: ?    Block Size: ? (click \"Load Transactions\")");
     ui->pushButtonMerkleTree->setEnabled(false);
+    ui->labelWitnessHash->setText("?");
 
     // Show details on dialog
 
@@ -125,33 +133,41 @@ void BlockIndexDetailsDialog::SetBlockIndex(const CBlockIndex* index)
     vtx.clear();
 
     merkleTreeDialog->close();
+
+    LoadTransactions();
 }
 
 void BlockIndexDetailsDialog::on_pushButtonLoadTransactions_clicked()
 {
-    if (!pBlockIndex) {
-        // TODO error message
-        return;
-    }
+    LoadTransactions();
+}
 
-    if (fHavePruned) {
-        // TODO display error
+void BlockIndexDetailsDialog::LoadTransactions()
+{
+    if (!pBlockIndex || !clientModel) {
+        ui->labelBlockInfo->setText("#Tx: ?    Block Size: ? (click \"Load Transactions\")");
         return;
     }
 
-    // Double check that the block is in the chain and should be on disk
-    if (!mapBlockIndex.count(pBlockIndex->GetBlockHash())) {
-        // TODO display error
-        return;
-    }
+    // The block is read and decoded on the block loader thread of the
+    // client model, blockDetailsLoaded fills in the rest
+    ui->labelBlockInfo->setText(tr("Loading transactions..."));
+    ui->pushButtonLoadTransactions->setEnabled(false);
+    clientModel->requestBlockDetails(hashBlock);
+}
 
-    // Load block from disk
+void BlockIndexDetailsDialog::blockDetailsLoaded(BlockDetailsRef details)
+{
+    // Ignore blocks that were requested before another one was shown
+    if (!details || details->hash != hashBlock || !cachedBlock.IsNull())
+        return;
 
-    CBlock block;
-    if (!ReadBlockFromDisk(block, pBlockIndex, Params().GetConsensus())) {
-        // TODO display error
+    ui->pushButtonLoadTransactions->setEnabled(true);
+    if (!details->block) {
+        ui->labelBlockInfo->setText(details->strError + " (click \"Load Transactions\" to retry)");
         return;
     }
+    const CBlock& block = *details->block;
 
     vtx = block.vtx;
 
@@ -182,7 +198,7 @@ void BlockIndexDetailsDialog::on_pushButtonLoadTransactions_clicked()
     cachedBlock = block;
 
     size_t nTx = cachedBlock.vtx.size();
-    size_t nSize = GetSerializeSize(cachedBlock, SER_NETWORK, PROTOCOL_VERSION);
+    size_t nSize = details->nSize;
 
     QString strSize = "";
     if (nSize < 1000000)
@@ -196,16 +212,11 @@ void BlockIndexDetailsDialog::on_pushButtonLoadTransactions_clicked()
 
     ui->pushButtonMerkleTree->setEnabled(true);
 
-    // Extract and display witness commit hash
-    int commitpos = GetWitnessCommitmentIndex(block);
-    if (commitpos != -1) {
-        // Get the commitment hash (witness merkle root + nonce) and reverse it
-        std::vector<unsigned char> vch(&block.vtx[0]->vout[commitpos].scriptPubKey[6], &block.vtx[0]->vout[commitpos].scriptPubKey[38]);
-        std::reverse(vch.begin(), vch.end());
-        uint256 hash(vch);
-
-        ui->labelWitnessHash->setText(QString::fromStdString(hash.ToString()));
-    }
+    // Display witness commit hash
+    if (!details->hashWitnessCommit.IsNull())
+        ui->labelWitnessHash->setText(QString::fromStdString(details->hashWitnessCommit.ToString()));
+    else
+        ui->labelWitnessHash->setText(tr("None"));
 }
 
 void BlockIndexDetailsDialog::on_tableWidgetTransactions_doubleClicked(const QModelIndex& i)
@@ -7,6 +7,8 @@
 
 #include <QDialog>
 
+#include <qt/clientmodel.h>
+
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <uint256.h>
@@ -28,9 +30,13 @@ public:
     explicit BlockIndexDetailsDialog(QWidget *parent = nullptr);
     ~BlockIndexDetailsDialog();
 
+    void setClientModel(ClientModel *model);
+
+    /** Show the header of index and start loading its transactions */
     void SetBlockIndex(const CBlockIndex* index);
 
 private Q_SLOTS:
+    void blockDetailsLoaded(BlockDetailsRef details);
     void on_pushButtonLoadTransactions_clicked();
     void on_tableWidgetTransactions_doubleClicked(const QModelIndex& i);
     void on_pushButtonMerkleTree_clicked();
@@ -39,6 +45,8 @@ private Q_SLOTS:
 private:
     Ui::BlockIndexDetailsDialog *ui;
 
+    ClientModel *clientModel = nullptr;
+
     uint256 hashBlock;
     int nHeight;
 
@@ -48,6 +56,8 @@ private:
     std::vector<CTransactionRef> vtx;
 
     MerkleTreeDialog* merkleTreeDialog = nullptr;
+
+    void LoadTransactions();
 };
 
 #endif // BLOCKINDEXDETAILSDIALOG_H
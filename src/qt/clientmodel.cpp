@@ -9,21 +9,27 @@
 #include <qt/guiutil.h>
 #include <qt/peertablemodel.h>
 
+#include <blockcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <clientversion.h>
 #include <validation.h>
 #include <net.h>
+#include <primitives/block.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <warnings.h>
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <QDebug>
+#include <QEvent>
 #include <QTimer>
+#include <QWidget>
 
 #include <boost/bind/placeholders.hpp>
 
@@ -40,7 +46,8 @@ ClientModel::ClientModel(OptionsModel *_optionsModel, QObject *parent) :
     peerTableModel(0),
     banTableModel(0),
     pollTimer(0),
-    ignoredBlockChangeTimer(0)
+    ignoredBlockChangeTimer(0),
+    chainChangedTimer(0)
 {
     cachedBestHeaderHeight = -1;
     cachedBestHeaderTime = -1;
@@ -59,12 +66,32 @@ ClientModel::ClientModel(OptionsModel *_optionsModel, QObject *parent) :
     connect(ignoredBlockChangeTimer, SIGNAL(timeout()), this, SLOT(updateIgnoredBlockChanges()));
     ignoredBlockChangeTimer->start(MODEL_UPDATE_DELAY * 2);
 
+    // Chain changes are coalesced for the subscribers of chainChanged
+    nChainChangedInterval = std::max<int64_t>(0, gArgs.GetArg("-guichainupdateinterval", DEFAULT_GUI_CHAIN_UPDATE_INTERVAL));
+    chainChangedTimer = new QTimer(this);
+    chainChangedTimer->setSingleShot(true);
+    connect(chainChangedTimer, SIGNAL(timeout()), this, SLOT(dispatchChainChanged()));
+    connect(this, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
+            this, SLOT(chainChanged(int,QDateTime,double,bool)));
+
+    // Blocks for the block details dialog are loaded on their own thread
+    qRegisterMetaType<BlockDetailsRef>("BlockDetailsRef");
+    BlockDetailsLoader *loader = new BlockDetailsLoader();
+    loader->moveToThread(&blockLoaderThread);
+    connect(this, SIGNAL(loadBlockDetails(QString)), loader, SLOT(load(QString)));
+    connect(loader, SIGNAL(loaded(BlockDetailsRef)), this, SLOT(blockDetailsReady(BlockDetailsRef)));
+    connect(&blockLoaderThread, SIGNAL(finished()), loader, SLOT(deleteLater()), Qt::DirectConnection);
+    blockLoaderThread.start();
+
     subscribeToCoreSignals();
 }
 
 ClientModel::~ClientModel()
 {
     unsubscribeFromCoreSignals();
+
+    blockLoaderThread.quit();
+    blockLoaderThread.wait();
 }
 
 int ClientModel::getNumConnections(unsigned int flags) const
@@ -129,6 +156,13 @@ quint64 ClientModel::getTotalBytesSent() const
     return g_connman->GetTotalBytesSent();
 }
 
+std::map<std::string, CNetMsgStats> ClientModel::getNetMsgStats() const
+{
+    if(!g_connman)
+        return std::map<std::string, CNetMsgStats>();
+    return g_connman->GetNetMsgStats();
+}
+
 QDateTime ClientModel::getLastBlockDate() const
 {
     LOCK(cs_main);
@@ -295,6 +329,76 @@ void ClientModel::updateIgnoredBlockChanges()
     lastIgnoredBlockChange.clear();
 }
 
+void ClientModel::subscribeChainChanged(QObject *receiver, const char *member, QWidget *widget)
+{
+    ChainSubscriber subscriber;
+    subscriber.receiver = receiver;
+    subscriber.member = member;
+    subscriber.widget = widget;
+    subscriber.fPending = false;
+    vChainSubscriber.push_back(subscriber);
+
+    if (widget)
+        widget->installEventFilter(this);
+}
+
+void ClientModel::chainChanged(int count, const QDateTime& blockDate, double nVerificationProgress, bool fHeader)
+{
+    // Only the active chain matters to the subscribers
+    if (fHeader)
+        return;
+
+    for (ChainSubscriber& subscriber : vChainSubscriber)
+        subscriber.fPending = true;
+
+    // Deliver right away if the last delivery is older than the interval,
+    // else once it is
+    if (chainChangedTimer->isActive())
+        return;
+
+    int64_t nWait = 0;
+    if (lastChainChanged.isValid())
+        nWait = std::max<int64_t>(0, nChainChangedInterval - lastChainChanged.elapsed());
+    chainChangedTimer->start(nWait);
+}
+
+void ClientModel::dispatchChainChanged()
+{
+    lastChainChanged.start();
+    deliverChainChanged(nullptr);
+}
+
+void ClientModel::deliverChainChanged(QWidget *widget)
+{
+    // Copied, a subscriber may subscribe from its slot
+    std::vector<ChainSubscriber> vDeliver;
+    for (auto it = vChainSubscriber.begin(); it != vChainSubscriber.end(); ) {
+        if (!it->receiver) {
+            it = vChainSubscriber.erase(it);
+            continue;
+        }
+        if (it->fPending && (!widget || it->widget == widget) && (!it->widget || it->widget->isVisible())) {
+            it->fPending = false;
+            vDeliver.push_back(*it);
+        }
+        ++it;
+    }
+
+    for (const ChainSubscriber& subscriber : vDeliver) {
+        if (subscriber.receiver)
+            QMetaObject::invokeMethod(subscriber.receiver, subscriber.member.constData(), Qt::DirectConnection);
+    }
+}
+
+bool ClientModel::eventFilter(QObject *object, QEvent *event)
+{
+    // Catch up hidden subscribers when they are shown
+    if (event->type() == QEvent::Show && object->isWidgetType())
+        deliverChainChanged(static_cast<QWidget*>(object));
+
+    return QObject::eventFilter(object, event);
+}
+
 void ClientModel::updateBanlist()
 {
     banTableModel->refresh();
@@ -397,3 +501,73 @@ void ClientModel::unsubscribeFromCoreSignals()
     uiInterface.NotifyBlockTip.disconnect(boost::bind(BlockTipChanged, this, _1, _2, false));
     uiInterface.NotifyHeaderTip.disconnect(boost::bind(BlockTipChanged, this, _1, _2, true));
 }
+
+void BlockDetailsLoader::load(const QString& strHash)
+{
+    std::shared_ptr<BlockDetails> details = std::make_shared<BlockDetails>();
+    details->hash = uint256S(strHash.toStdString());
+
+    const CBlockIndex* pindex = nullptr;
+    bool fHaveData = false;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(details->hash);
+        if (mi != mapBlockIndex.end()) {
+            pindex = mi->second;
+            fHaveData = pindex->nStatus & BLOCK_HAVE_DATA;
+        }
+    }
+
+    if (!pindex) {
+        details->strError = tr("Block not found");
+    } else if (!fHaveData) {
+        details->strError = fHavePruned ? tr("Block data has been pruned") : tr("Block data is not available");
+    } else {
+        details->block = ReadBlockCached(pindex, Params().GetConsensus());
+        if (!details->block) {
+            details->strError = tr("Failed to read block from disk");
+        } else {
+            const CBlock& block = *details->block;
+            details->nSize = GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+
+            int commitpos = GetWitnessCommitmentIndex(block);
+            if (commitpos != -1) {
+                // Get the commitment hash (witness merkle root + nonce) and reverse it
+                std::vector<unsigned char> vch(&block.vtx[0]->vout[commitpos].scriptPubKey[6], &block.vtx[0]->vout[commitpos].scriptPubKey[38]);
+                std::reverse(vch.begin(), vch.end());
+                details->hashWitnessCommit = uint256(vch);
+            }
+        }
+    }
+
+    Q_EMIT loaded(details);
+}
+
+void ClientModel::requestBlockDetails(const uint256& hash)
+{
+    for (std::list<BlockDetailsRef>::iterator it = listBlockDetails.begin(); it != listBlockDetails.end(); ++it) {
+        if ((*it)->hash == hash) {
+            BlockDetailsRef details = *it;
+            listBlockDetails.splice(listBlockDetails.begin(), listBlockDetails, it);
+            Q_EMIT blockDetailsLoaded(details);
+            return;
+        }
+    }
+
+    if (setBlockDetailsPending.insert(hash).second)
+        Q_EMIT loadBlockDetails(QString::fromStdString(hash.ToString()));
+}
+
+void ClientModel::blockDetailsReady(BlockDetailsRef details)
+{
+    setBlockDetailsPending.erase(details->hash);
+
+    // Failures aren't cached, the block may be there on the next try
+    if (details->block) {
+        listBlockDetails.push_front(details);
+        if (listBlockDetails.size() > BLOCK_DETAILS_CACHE_SIZE)
+            listBlockDetails.pop_back();
+    }
+
+    Q_EMIT blockDetailsLoaded(details);
+}
@@ -7,20 +7,68 @@
 
 #include <QObject>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QPointer>
+#include <QThread>
+
+#include <uint256.h>
 
 #include <atomic>
+#include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 class BanTableModel;
 class OptionsModel;
 class PeerTableModel;
 
+class CBlock;
 class CBlockIndex;
+struct CNetMsgStats;
 
 QT_BEGIN_NAMESPACE
 class QTimer;
+class QWidget;
 QT_END_NAMESPACE
 
+/** Default for -guichainupdateinterval, in milliseconds */
+static const int DEFAULT_GUI_CHAIN_UPDATE_INTERVAL = 1000;
+
+/** Number of loaded blocks ClientModel keeps the details of */
+static const size_t BLOCK_DETAILS_CACHE_SIZE = 8;
+
+/** A block and what the block details dialog shows of it */
+struct BlockDetails {
+    uint256 hash;
+    //! Null if the block couldn't be loaded, see strError
+    std::shared_ptr<const CBlock> block;
+    QString strError;
+    //! Serialized size
+    size_t nSize = 0;
+    //! Witness commitment hash (witness merkle root and nonce), null if
+    //! the block has none
+    uint256 hashWitnessCommit;
+};
+typedef std::shared_ptr<const BlockDetails> BlockDetailsRef;
+Q_DECLARE_METATYPE(BlockDetailsRef)
+
+/** Loads block details on the block loader thread of ClientModel */
+class BlockDetailsLoader : public QObject
+{
+    Q_OBJECT
+
+public Q_SLOTS:
+    void load(const QString& hash);
+
+Q_SIGNALS:
+    void loaded(BlockDetailsRef details);
+};
+
 enum BlockSource {
     BLOCK_SOURCE_NONE,
     BLOCK_SOURCE_REINDEX,
@@ -60,6 +108,8 @@ public:
 
     quint64 getTotalBytesRecv() const;
     quint64 getTotalBytesSent() const;
+    //! Return per message type totals over all peers
+    std::map<std::string, CNetMsgStats> getNetMsgStats() const;
 
     double getVerificationProgress(const CBlockIndex *tip) const;
     QDateTime getLastBlockDate() const;
@@ -86,6 +136,23 @@ public:
 
     void StopIgnoredBlockChangeTimer();
 
+    /**
+     * Call the slot named member of receiver when the chain changes, at most
+     * once per -guichainupdateinterval however many blocks arrive. While
+     * widget is hidden nothing is delivered, a change seen in the meantime
+     * is delivered when it is shown. The subscription ends when receiver is
+     * destroyed.
+     */
+    void subscribeChainChanged(QObject *receiver, const char *member, QWidget *widget = nullptr);
+
+    /**
+     * Load, decode and summarize a block on the block loader thread, so that
+     * large blocks don't hold up the GUI. blockDetailsLoaded is emitted with
+     * the result, right away if the block is one of the last
+     * BLOCK_DETAILS_CACHE_SIZE loaded.
+     */
+    void requestBlockDetails(const uint256& hash);
+
     // caches for the best header
     mutable std::atomic<int> cachedBestHeaderHeight;
     mutable std::atomic<int64_t> cachedBestHeaderTime;
@@ -120,6 +187,29 @@ private:
 
     std::mutex blockChangeMutex;
 
+    struct ChainSubscriber {
+        QPointer<QObject> receiver;
+        QByteArray member;
+        QPointer<QWidget> widget;
+        bool fPending;
+    };
+
+    std::vector<ChainSubscriber> vChainSubscriber;
+    QTimer *chainChangedTimer;
+    QElapsedTimer lastChainChanged;
+    int nChainChangedInterval;
+
+    void deliverChainChanged(QWidget *widget);
+
+    QThread blockLoaderThread;
+    //! Recently loaded blocks, most recent first
+    std::list<BlockDetailsRef> listBlockDetails;
+    //! Blocks requested from the loader and not delivered yet
+    std::set<uint256> setBlockDetailsPending;
+
+protected:
+    bool eventFilter(QObject *object, QEvent *event);
+
 Q_SIGNALS:
     void numConnectionsChanged(int count);
     void numBlocksChanged(int count, const QDateTime& blockDate, double nVerificationProgress, bool header);
@@ -134,6 +224,11 @@ Q_SIGNALS:
     // Show progress dialog e.g. for verifychain
     void showProgress(const QString &title, int nProgress);
 
+    //! Result of requestBlockDetails
+    void blockDetailsLoaded(BlockDetailsRef details);
+    //! Request to the block loader
+    void loadBlockDetails(const QString& hash);
+
 public Q_SLOTS:
     void updateTimer();
     void updateNumConnections(int numConnections);
@@ -141,6 +236,11 @@ public Q_SLOTS:
     void updateAlert();
     void updateBanlist();
     void updateIgnoredBlockChanges();
+
+private Q_SLOTS:
+    void chainChanged(int count, const QDateTime& blockDate, double nVerificationProgress, bool fHeader);
+    void dispatchChainChanged();
+    void blockDetailsReady(BlockDetailsRef details);
 };
 
 #endif // BITCOIN_QT_CLIENTMODEL_H
@@ -931,6 +931,9 @@ QString formatServicesStr(quint64 mask)
             case NODE_WITNESS:
                 strList.append("WITNESS");
                 break;
+            case NODE_COMPACT_FILTERS:
+                strList.append("COMPACT_FILTERS");
+                break;
             case NODE_DRIVECHAIN:
                 strList.append("SKYDOGE");
             case NODE_XTHIN:
@@ -18,9 +18,22 @@
 #include <uint256.h>
 #include <utilstrencodings.h>
 
+#include <algorithm>
+
 #include <QApplication>
 #include <QClipboard>
 #include <QScrollBar>
+#include <QTableWidgetItem>
+
+enum ThroughputColumns
+{
+    COLUMN_ALGORITHM = 0,
+    COLUMN_RUNS,
+    COLUMN_NS_PER_RUN,
+    COLUMN_MB_PER_SEC,
+    COLUMN_SHARE,
+    COLUMN_COUNT,
+};
 
 std::string HexToBinStr(const std::string strHex)
 {
@@ -140,6 +153,11 @@ HashCalcDialog::HashCalcDialog(const PlatformStyle *_platformStyle, QWidget *par
     ui->textBrowserOutputHMAC->setStyleSheet("background: rgb(0,0,0,0)");
 
     ui->pushButtonFlip->setEnabled(false);
+
+    // Throughput
+    ui->tableWidgetThroughput->setColumnCount(COLUMN_COUNT);
+    ui->tableWidgetThroughput->setHorizontalHeaderLabels(
+            QStringList() << tr("Algorithm") << tr("Runs per hash") << tr("ns per run") << tr("MB/s") << tr("Share"));
 }
 
 HashCalcDialog::~HashCalcDialog()
@@ -512,3 +530,47 @@ void HashCalcDialog::UpdateOutputHMAC()
     ui->textBrowserOutputHMAC->append(QString::fromStdString(strHex512) + "\n");
     ui->textBrowserOutputHMAC->append("<font color=\"gray\" size=2px>" + QString::fromStdString(HexToBinStr(strHex512)) + "<br>");
 }
+
+void HashCalcDialog::on_pushButtonBenchmark_clicked()
+{
+    const int nIterations = ui->spinBoxBenchIterations->value();
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    int64_t nTotalNanos = 0;
+    std::vector<SkydogeHashStageTiming> vTiming = ProfileSkydogeHash(nIterations, nTotalNanos);
+    QApplication::restoreOverrideCursor();
+
+    int64_t nStageNanos = 0;
+    for (const SkydogeHashStageTiming& timing : vTiming)
+        nStageNanos += timing.nNanos * timing.nRuns;
+
+    ui->tableWidgetThroughput->setRowCount(vTiming.size());
+    for (size_t i = 0; i < vTiming.size(); i++) {
+        const SkydogeHashStageTiming& timing = vTiming[i];
+        const double dMBPerSec = 64.0 * nIterations * 1000 / std::max<int64_t>(timing.nNanos, 1);
+        const double dShare = nStageNanos ? 100.0 * timing.nNanos * timing.nRuns / nStageNanos : 0.0;
+
+        QTableWidgetItem* itemName = new QTableWidgetItem(QString::fromStdString(timing.name));
+        QTableWidgetItem* itemRuns = new QTableWidgetItem(QString::number(timing.nRuns));
+        QTableWidgetItem* itemNanos = new QTableWidgetItem(QString::number((double)timing.nNanos / nIterations, 'f', 1));
+        QTableWidgetItem* itemMB = new QTableWidgetItem(QString::number(dMBPerSec, 'f', 1));
+        QTableWidgetItem* itemShare = new QTableWidgetItem(QString::number(dShare, 'f', 1) + "%");
+
+        itemRuns->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        itemNanos->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        itemMB->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        itemShare->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+
+        ui->tableWidgetThroughput->setItem(i, COLUMN_ALGORITHM, itemName);
+        ui->tableWidgetThroughput->setItem(i, COLUMN_RUNS, itemRuns);
+        ui->tableWidgetThroughput->setItem(i, COLUMN_NS_PER_RUN, itemNanos);
+        ui->tableWidgetThroughput->setItem(i, COLUMN_MB_PER_SEC, itemMB);
+        ui->tableWidgetThroughput->setItem(i, COLUMN_SHARE, itemShare);
+    }
+    ui->tableWidgetThroughput->resizeColumnsToContents();
+
+    const double dHashesPerSec = 1e9 * nIterations / std::max<int64_t>(nTotalNanos, 1);
+    ui->labelBenchTotal->setText(tr("skydoge_hash: %1 ns per hash, %2 hashes per second")
+            .arg(QString::number((double)nTotalNanos / nIterations, 'f', 1))
+            .arg(QString::number(dHashesPerSec, 'f', 0)));
+}
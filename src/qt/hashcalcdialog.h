@@ -43,6 +43,10 @@ public Q_SLOTS:
     void on_pushButtonHelpInvalidHexHMAC_clicked();
     void on_radioButtonHexHMAC_toggled(bool fChecked);
 
+    // Throughput
+
+    void on_pushButtonBenchmark_clicked();
+
 private:
     Ui::HashCalcDialog *ui;
 
@@ -9,16 +9,30 @@
 
 #include <qt/clientmodel.h>
 
+#include <algorithm>
+
 #include <QDateTime>
 #include <QIcon>
-#include <QMetaType>
 #include <QTimer>
 #include <QVariant>
 
-Q_DECLARE_METATYPE(BlockTableObject)
+// Number of the latest blocks displayed when the model is first loaded
+static const int LATEST_BLOCK_DISPLAY = 10;
+// Number of older blocks loaded at a time by fetchMore
+static const int LATEST_BLOCK_FETCH = 10;
+
+static BlockTableObject MakeTableObject(const CBlockIndex* index)
+{
+    BlockTableObject object;
+    object.nHeight = index->nHeight;
+    object.hash = index->GetBlockHash();
+    object.nTime = index->nTime;
+    return object;
+}
 
 LatestBlockTableModel::LatestBlockTableModel(QObject *parent) :
-    QAbstractTableModel(parent)
+    QAbstractTableModel(parent),
+    nBlocksToDisplay(LATEST_BLOCK_DISPLAY)
 {
 }
 
@@ -41,10 +55,10 @@ QVariant LatestBlockTableModel::data(const QModelIndex &index, int role) const
     int row = index.row();
     int col = index.column();
 
-    if (!model.at(row).canConvert<BlockTableObject>())
+    if (row >= model.size())
         return QVariant();
 
-    BlockTableObject object = model.at(row).value<BlockTableObject>();
+    const BlockTableObject& object = model.at(row);
 
     switch (role) {
     case Qt::DisplayRole:
@@ -109,8 +123,7 @@ void LatestBlockTableModel::setClientModel(ClientModel *model)
     {
         numBlocksChanged();
 
-        connect(model, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
-                this, SLOT(numBlocksChanged()));
+        model->subscribeChainChanged(this, "numBlocksChanged");
     }
 }
 
@@ -127,33 +140,91 @@ void LatestBlockTableModel::UpdateModel()
     if (clientModel->inInitialBlockDownload())
         return;
 
-    // Clear old data
-    beginResetModel();
-    model.clear();
-    endResetModel();
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (!pindexTip) {
+        beginResetModel();
+        model.clear();
+        endResetModel();
+        return;
+    }
 
-    int nHeight = chainActive.Height() + 1;
-    int nBlocksToDisplay = 10;
-    if (nHeight < nBlocksToDisplay)
-        nBlocksToDisplay = nHeight;
+    // Remove the blocks disconnected by a reorg. The rows are a chain, so
+    // once a block is in the active chain so are all of the older ones.
+    int nRemove = 0;
+    while (nRemove < model.size()) {
+        const CBlockIndex* index = chainActive[model.at(nRemove).nHeight];
+        if (index && index->GetBlockHash() == model.at(nRemove).hash)
+            break;
+        nRemove++;
+    }
+    if (nRemove > 0) {
+        beginRemoveRows(QModelIndex(), 0, nRemove - 1);
+        model.erase(model.begin(), model.begin() + nRemove);
+        endRemoveRows();
+    }
 
-    beginInsertRows(QModelIndex(), model.size(), model.size() + nBlocksToDisplay - 1);
-    for (int i = 0; i < nBlocksToDisplay; i++) {
-        CBlockIndex *index = chainActive[nHeight - i];
+    const int nLast = std::max(0, pindexTip->nHeight - nBlocksToDisplay + 1);
 
-        // TODO add error message or something to table?
-        if (!index) {
-            continue;
-        }
+    // Too far behind the tip to keep any of the old rows
+    if (model.isEmpty() || model.front().nHeight + 1 < nLast) {
+        beginResetModel();
+        model.clear();
+        for (int nHeight = pindexTip->nHeight; nHeight >= nLast; nHeight--)
+            model.append(MakeTableObject(chainActive[nHeight]));
+        endResetModel();
+        return;
+    }
 
-        BlockTableObject object;
-        object.nHeight = nHeight - i;
-        object.hash = index->GetBlockHash();
-        object.nTime = index->nTime;
+    // Add the new blocks at the top
+    const int nNext = model.front().nHeight + 1;
+    if (nNext <= pindexTip->nHeight) {
+        beginInsertRows(QModelIndex(), 0, pindexTip->nHeight - nNext);
+        for (int nHeight = nNext; nHeight <= pindexTip->nHeight; nHeight++)
+            model.prepend(MakeTableObject(chainActive[nHeight]));
+        endInsertRows();
+    }
 
-        model.append(QVariant::fromValue(object));
+    // And drop as many of the oldest ones
+    const int nDrop = nLast - model.back().nHeight;
+    if (nDrop > 0) {
+        beginRemoveRows(QModelIndex(), model.size() - nDrop, model.size() - 1);
+        model.erase(model.end() - nDrop, model.end());
+        endRemoveRows();
     }
+}
+
+bool LatestBlockTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return false;
+
+    return !model.isEmpty() && model.back().nHeight > 0;
+}
+
+void LatestBlockTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+
+    LOCK(cs_main);
+
+    // The last row must still be in the active chain, or UpdateModel will
+    // catch up with the reorg first
+    const CBlockIndex* index = chainActive[model.back().nHeight];
+    if (!index || index->GetBlockHash() != model.back().hash)
+        return;
+
+    const int nLast = std::max(0, model.back().nHeight - LATEST_BLOCK_FETCH);
+    const int nFetch = model.back().nHeight - nLast;
+
+    beginInsertRows(QModelIndex(), model.size(), model.size() + nFetch - 1);
+    for (index = index->pprev; index && index->nHeight >= nLast; index = index->pprev)
+        model.append(MakeTableObject(index));
     endInsertRows();
+
+    nBlocksToDisplay += nFetch;
 }
 
 CBlockIndex* LatestBlockTableModel::GetBlockIndex(const uint256& hash) const
@@ -35,6 +35,10 @@ public:
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
 
+    // Older blocks are loaded as the view scrolls down to them
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
     void setClientModel(ClientModel *model);
 
     CBlockIndex* GetBlockIndex(const uint256& hash) const;
@@ -49,7 +53,12 @@ public Q_SLOTS:
     void numBlocksChanged();
 
 private:
-    QList<QVariant> model;
+    // Blocks of the active chain at consecutive heights, newest first. Only
+    // the rows that change are inserted or removed on a new tip.
+    QList<BlockTableObject> model;
+
+    // Number of the latest blocks kept, grows as older blocks are fetched
+    int nBlocksToDisplay;
 
     ClientModel *clientModel = nullptr;
 
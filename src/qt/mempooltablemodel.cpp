@@ -9,6 +9,7 @@
 #include <qt/optionsmodel.h>
 #include <qt/guiutil.h>
 
+#include <consensus/consensus.h>
 #include <primitives/transaction.h>
 #include <txmempool.h>
 #include <utilmoneystr.h>
@@ -162,6 +163,8 @@ void MemPoolTableModel::updateModel()
     if (clientModel->inInitialBlockDownload())
         return;
 
+    updateFeeHistogram();
+
     // Get recent mempool entries
     std::vector<TxMempoolInfo> vInfo = mempool.InfoRecent(10);
 
@@ -211,6 +214,26 @@ void MemPoolTableModel::updateModel()
     }
 }
 
+void MemPoolTableModel::updateFeeHistogram()
+{
+    // The mempool keeps the histogram up to date, so this is a copy of a few
+    // dozen buckets rather than a walk over the mempool
+    std::vector<MempoolFeeHistogramBucket> vBucket = mempool.GetFeeHistogram();
+
+    const uint64_t nBlockVSize = MAX_BLOCK_WEIGHT / WITNESS_SCALE_FACTOR;
+    uint64_t nVSize = 0;
+    CAmount nFeeRate = 0;
+    for (auto it = vBucket.rbegin(); it != vBucket.rend(); it++) {
+        nVSize += it->nVSize;
+        if (!nFeeRate && nVSize >= nBlockVSize)
+            nFeeRate = it->nMinFeeRate;
+    }
+
+    nNextBlockFeeRate = nFeeRate;
+    dBlocksBacklog = (double)nVSize / nBlockVSize;
+    Q_EMIT feeHistogramChanged();
+}
+
 void MemPoolTableModel::memPoolSizeChanged(long nTxIn, size_t nBytesIn)
 {
     if (nTxIn != nTx || nBytesIn != nBytes) {
@@ -226,6 +249,16 @@ void MemPoolTableModel::setUSDBTC(int nUSDBTCIn)
     updateModel();
 }
 
+CAmount MemPoolTableModel::GetNextBlockFeeRate() const
+{
+    return nNextBlockFeeRate;
+}
+
+double MemPoolTableModel::GetBlocksBacklog() const
+{
+    return dBlocksBacklog;
+}
+
 bool MemPoolTableModel::GetTx(const uint256& txid, CTransactionRef& tx) const
 {
     if (!mempool.exists(txid))
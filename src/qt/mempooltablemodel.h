@@ -41,6 +41,12 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     bool GetTx(const uint256& txid, CTransactionRef& tx) const;
 
+    /** Lowest fee rate in sat/vB of the transactions that would fill the
+     *  next block, 0 if the whole mempool fits in one block */
+    CAmount GetNextBlockFeeRate() const;
+    /** Number of blocks it would take to mine the whole mempool */
+    double GetBlocksBacklog() const;
+
     void setClientModel(ClientModel *model);
 
     enum RoleIndex {
@@ -51,8 +57,12 @@ public Q_SLOTS:
     void memPoolSizeChanged(long nTx, size_t nBytes);
     void setUSDBTC(int nUSDBTC);
 
+Q_SIGNALS:
+    void feeHistogramChanged();
+
 private:
     void updateModel();
+    void updateFeeHistogram();
 
     QList<QVariant> model;
 
@@ -61,6 +71,9 @@ private:
     long nTx;
     size_t nBytes;
     int64_t nUSDBTC;
+
+    CAmount nNextBlockFeeRate = 0;
+    double dBlocksBacklog = 0;
 };
 
 #endif // MEMPOOLTABLEMODEL_H
@@ -5,8 +5,9 @@
 #include <qt/merkletreedialog.h>
 #include <qt/forms/ui_merkletreedialog.h>
 
-#include <hash.h>
 #include <consensus/merkle.h>
+#include <crypto/sha256.h>
+#include <hash.h>
 #include <streams.h>
 
 #include <sstream>
@@ -112,54 +113,20 @@ std::vector<std::vector<uint256>> MerkleTree(const std::vector<uint256>& vLeaf)
     // x = level in tree, y = hash
     // Level 0 is the leaves, and the last level is merkle root
     std::vector<std::vector<uint256>> vTree;
-
-    // Generate a merkle tree
-
-    // Copy leaves (TxIds) and add first non-leaf level
-    vTree.resize(2);
-    vTree[0] = vLeaf;
-
-    // Index in the current level
-    size_t i = 0;
-
-    // Current level of the tree
-    size_t nLevel = 0;
-
-    // Loop through each level of the tree combining every 2 hashes (starting
-    // with txids on level 0) until the merkle root is alone on the last level.
-    while (true && vLeaf.size() > 1) {
-        // Check if we reached the end of this level
-        if (i >= vTree[nLevel].size()) {
-            // Does the next level have anything for us to work on?
-            if (vTree[nLevel + 1].size() <= 1)
-                break;
-
-            i = 0;
-            nLevel++;
-
-            // Add a new level to the tree
-            vTree.push_back(std::vector<uint256>());
-        }
-
-        // Collect next 2 hashes which will be combined
-        uint256 hash1 = vTree[nLevel][i];
-        uint256 hash2 = i + 1 < vTree[nLevel].size() ? vTree[nLevel][i + 1] : hash1;
-
-        // Write hash1 and hash2 to buffer and finalize SHA256D product
-        uint256 product;
-        CHash256().Write(hash1.begin(), 32).Write(hash2.begin(), 32).Finalize(product.begin());
-
-        vTree[nLevel + 1].push_back(product);
-
-        // Move on to the next pair
-        i+= 2;
-    }
-
-    // Special case for block with only coinbase transaction
-    if (vLeaf.size() == 1) {
-        vTree.clear();
-        vTree.resize(1);
-        vTree.front().push_back(vLeaf.front());
+    vTree.push_back(vLeaf);
+
+    // Combine every 2 hashes of a level into the next level until the merkle
+    // root is alone on the last level. If a level has an odd number of hashes
+    // the last one is combined with itself.
+    while (vTree.back().size() > 1) {
+        std::vector<uint256> vLevel = vTree.back();
+        if (vLevel.size() & 1)
+            vLevel.push_back(vLevel.back());
+
+        // SHA256D of every pair of the level at once
+        std::vector<uint256> vNext(vLevel.size() / 2);
+        SHA256D64(vNext[0].begin(), vLevel[0].begin(), vNext.size());
+        vTree.push_back(std::move(vNext));
     }
 
     return vTree;
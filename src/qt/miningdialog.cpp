@@ -74,42 +74,23 @@ void MiningDialog::AbandonFailedBMM()
         return; // TODO error message
 
     std::vector<uint256> vHashRemoved;
-    mempool.SelectBMMRequests(vHashRemoved);
+    mempool.RemoveInactiveBMMRequests(vHashRemoved);
     mempool.RemoveExpiredCriticalRequests(vHashRemoved);
 
-    for (const uint256& u : vHashRemoved)
-        scdb.AddRemovedBMM(u);
-
-    // Also try to abandon cached BMM txid previously removed from our mempool
-    std::set<uint256> setRemoved = scdb.GetRemovedBMM();
-
     // Make sure the results are valid at least up to the most recent block
     // the user could have gotten from another RPC command prior to now
     vpwallets[0]->BlockUntilSyncedToCurrentChain();
 
-    LOCK2(cs_main, vpwallets[0]->cs_wallet);
-
     // TODO display results in a popup message?
     // Maybe they should just be written somewhere to be displayed
     // on a table or in a file later?
+    std::vector<std::pair<uint256, std::string>> vResult;
+    vpwallets[0]->AbandonSidechainTransactions(true /* fCriticalData */, vResult);
 
-    for (const uint256& u : setRemoved) {
-
-        if (!vpwallets[0]->mapWallet.count(u)) {
-//            entry.push_back(Pair("not-in-wallet", u.ToString()));
-//            results.push_back(entry);
-            continue;
-        }
-        std::string strReason = "";
-        if (!vpwallets[0]->AbandonTransaction(u, &strReason)) {
-//            entry.push_back(Pair(strprintf("cannot-abandon: %s", strReason), u.ToString()));
-//            results.push_back(entry);
-            continue;
-        }
-//        entry.push_back(Pair("abandoned", u.ToString()));
-//        results.push_back(entry);
+    for (const auto& result : vResult) {
         // Remove from cache after abandonment
-        scdb.BMMAbandoned(u);
+        if (result.second.empty())
+            scdb.BMMAbandoned(result.first);
     }
 }
 
@@ -152,8 +133,18 @@ void MiningDialog::on_pushButtonStopMining_clicked()
     ui->spinBoxThreads->setEnabled(true);
 }
 
+void MiningDialog::showEvent(QShowEvent* event)
+{
+    QDialog::showEvent(event);
+    Update();
+}
+
 void MiningDialog::Update()
 {
+    // Nothing to show, updated again when shown
+    if (!isVisible())
+        return;
+
     // Update things that don't change quickly while mining
 
     QString height = "Current block height: ";
@@ -204,6 +195,16 @@ void MiningDialog::UpdateMiningOutput()
     QString nonce = "Nonce: ";
     nonce += QString::number(nMiningNonce);
     ui->labelNonce->setText(nonce);
+
+    std::vector<double> vRate = GetMinerHashRates();
+    double dRate = 0;
+    for (double d : vRate)
+        dRate += d;
+    QString hashrate = "Hash rate: ";
+    hashrate += QString::number(dRate, 'f', 0) + " H/s";
+    if (!vRate.empty())
+        hashrate += " (" + QString::number(vRate.size()) + " threads)";
+    ui->labelHashRate->setText(hashrate);
 }
 
 void MiningDialog::on_pushButtonAddRemove_clicked()
@@ -10,6 +10,7 @@
 class PlatformStyle;
 
 QT_BEGIN_NAMESPACE
+class QShowEvent;
 class QTimer;
 QT_END_NAMESPACE
 
@@ -49,6 +50,8 @@ private:
     QTimer* abandonBMMTimer;
 
     const PlatformStyle *platformStyle;
+
+    void showEvent(QShowEvent* event);
 };
 
 #endif // MININGDIALOG_H
@@ -5,7 +5,10 @@
 #include <qt/newstablemodel.h>
 
 #include <chain.h>
+#include <opreturnindex.h>
+#include <script/scriptpattern.h>
 #include <txdb.h>
+#include <txmempool.h>
 #include <utilmoneystr.h>
 #include <validation.h>
 
@@ -17,6 +20,8 @@
 #include <QTimer>
 #include <QVariant>
 
+#include <set>
+
 Q_DECLARE_METATYPE(NewsTableObject)
 
 NewsTableModel::NewsTableModel(QObject *parent) :
@@ -58,7 +63,10 @@ QVariant NewsTableModel::data(const QModelIndex &index, int role) const
         }
         // Time
         if (col == 1) {
-            return QDateTime::fromTime_t((int64_t)object.nTime).toString("hh:mm MMM dd");
+            QString strTime = QDateTime::fromTime_t((int64_t)object.nTime).toString("hh:mm MMM dd");
+            if (object.hashBlock.IsNull())
+                return tr("%1 (unconfirmed)").arg(strTime);
+            return strTime;
         }
         // Decode
         if (col == 2) {
@@ -149,8 +157,8 @@ void NewsTableModel::setClientModel(ClientModel *model)
     {
         numBlocksChanged();
 
-        connect(model, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
-                this, SLOT(numBlocksChanged()));
+        model->subscribeChainChanged(this, "numBlocksChanged");
+        connect(model, SIGNAL(mempoolSizeChanged(long,size_t)), this, SLOT(mempoolChanged()));
     }
 }
 
@@ -164,7 +172,44 @@ void NewsTableModel::numBlocksChanged()
     UpdateModel();
 }
 
-// TODO append new data to the model instead of loading all every time
+void NewsTableModel::mempoolChanged()
+{
+    UpdateModel();
+}
+
+/** Pattern of news scripts: OP_RETURN and the 4 byte header of the type */
+static ScriptPattern<5> NewsPattern(const CScript& header)
+{
+    // A header too short never matches: the size limits are inverted
+    ScriptPattern<5> pattern = {{OP_RETURN, 0, 0, 0, 0}, 5, SCRIPT_PATTERN_ANY_SIZE};
+    if (header.size() < 4) {
+        pattern.nMinSize = SCRIPT_PATTERN_ANY_SIZE;
+        pattern.nMaxSize = 0;
+        return pattern;
+    }
+    std::copy(header.begin(), header.begin() + 4, pattern.prefix + 1);
+    return pattern;
+}
+
+static NewsTableObject MakeNewsObject(const uint256& hashBlock, uint32_t nTime, const OPReturnData& d)
+{
+    NewsTableObject object;
+    object.hashBlock = hashBlock;
+    object.nTime = nTime;
+
+    // Copy chars from script, skipping non-message bytes
+    std::string strDecode;
+    for (size_t i = 5; i < d.script.size(); i++)
+        strDecode += d.script[i];
+
+    object.decode = strDecode;
+    object.fees = FormatMoney(d.fees);
+    object.feeAmount = d.fees;
+    object.hex = HexStr(d.script.begin(), d.script.end(), false);
+
+    return object;
+}
+
 void NewsTableModel::UpdateModel()
 {
     if (!newsTypesModel || !clientModel)
@@ -173,71 +218,122 @@ void NewsTableModel::UpdateModel()
     if (clientModel->inInitialBlockDownload())
         return;
 
-    // Clear old data
-    beginResetModel();
-    model.clear();
-    endResetModel();
+    NewsType type;
+    if (!newsTypesModel->GetType(nFilter, type)) {
+        beginResetModel();
+        model.clear();
+        endResetModel();
+        pindexLast = nullptr;
+        nMempoolUpdated = -1;
+        return;
+    }
 
-    int nHeight = chainActive.Height();
+    // Reload everything if the news type has been edited
+    if (type.GetHash() != hashType) {
+        hashType = type.GetHash();
+        pindexLast = nullptr;
+    }
 
-    NewsType type;
-    if (!newsTypesModel->GetType(nFilter, type))
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexTip = GetOPReturnIndexTip();
+    if (!pindexTip)
         return;
+    if (pindexTip == pindexLast) {
+        UpdatePendingNews(type);
+        return;
+    }
+
+    QDateTime tipTime = QDateTime::fromTime_t(pindexTip->GetBlockTime());
+    const int64_t nTimeTarget = tipTime.addDays(-type.nDays).toTime_t();
 
-    QDateTime tipTime = QDateTime::fromMSecsSinceEpoch(chainActive.Tip()->GetBlockTime() * 1000);
-    QDateTime targetTime = tipTime.addDays(-type.nDays);
+    const ScriptPattern<5> pattern = NewsPattern(type.header);
 
-    // Loop backwards from chainTip until we reach target time or genesis block.
     std::vector<NewsTableObject> vNews;
-    for (int i = nHeight; i > 1; i--) {
-        CBlockIndex *index = chainActive[i];
-        if (!index)
-            break;
+    if (!pindexLast) {
+        // Load everything newer than the target time
+        beginResetModel();
+        model.clear();
+        endResetModel();
+        nMempoolUpdated = -1;
+
+        std::vector<OPReturnNews> vFound;
+        FindNews(type.header, nTimeTarget + 1, vFound);
+        for (const OPReturnNews& news : vFound) {
+            // Leave news the index wrote after we looked up its tip to the
+            // next update
+            BlockMap::const_iterator it = mapBlockIndex.find(news.hashBlock);
+            if (it == mapBlockIndex.end() || it->second->nHeight > pindexTip->nHeight)
+                continue;
 
-        // Have we gone back in time far enough?
-        QDateTime indexTime = QDateTime::fromTime_t(index->GetBlockTime());
+            vNews.push_back(MakeNewsObject(news.hashBlock, news.nTime, news.data));
+        }
+    } else {
+        const CBlockIndex* pindexFork = LastCommonAncestor(pindexLast, pindexTip);
 
-        if (indexTime <= targetTime)
-            break;
+        // Remove news from disconnected blocks and news that is too old
+        std::set<uint256> setDisconnected;
+        for (const CBlockIndex* pindex = pindexLast; pindex && pindex != pindexFork; pindex = pindex->pprev)
+            setDisconnected.insert(pindex->GetBlockHash());
 
-        // For each block load our cached OP_RETURN data
-        std::vector<OPReturnData> vData;
-        if (!popreturndb->GetBlockData(index->GetBlockHash(), vData))
-            continue;
+        RemoveNews([&setDisconnected, nTimeTarget](const NewsTableObject& object) {
+            return !object.hashBlock.IsNull() && (object.nTime <= nTimeTarget || setDisconnected.count(object.hashBlock));
+        });
 
-        // Find the data we want to display
-        for (const OPReturnData& d : vData) {
-            bool fFound = false;
-            if (d.script.size() >= 5 && type.header.size() >= 4) {
-                if (d.script[0] ==  OP_RETURN &&
-                        d.script[1] == type.header[0] &&
-                        d.script[2] == type.header[1] &&
-                        d.script[3] == type.header[2] &&
-                        d.script[4] == type.header[3])
-                {
-                            fFound = true;
-                }
-            }
-            if (!fFound)
+        // Add news from the blocks connected since the last update
+        for (const CBlockIndex* pindex = pindexTip; pindex && pindex != pindexFork; pindex = pindex->pprev) {
+            if (pindex->GetBlockTime() <= nTimeTarget)
+                break;
+
+            std::vector<OPReturnData> vData;
+            if (!popreturndb->GetBlockData(pindex->GetBlockHash(), vData))
                 continue;
 
-            NewsTableObject object;
-            object.nTime = index->nTime;
+            for (const OPReturnData& d : vData) {
+                if (pattern.Match(d.script))
+                    vNews.push_back(MakeNewsObject(pindex->GetBlockHash(), pindex->nTime, d));
+            }
+        }
+    }
+    pindexLast = pindexTip;
+
+    AppendNews(vNews);
 
-            // Copy chars from script, skipping non-message bytes
-            std::string strDecode;
-            for (size_t i = 5; i < d.script.size(); i++)
-                strDecode += d.script[i];
+    UpdatePendingNews(type);
+}
 
-            object.decode = strDecode;
-            object.fees = FormatMoney(d.fees);
-            object.feeAmount = d.fees;
-            object.hex = HexStr(d.script.begin(), d.script.end(), false);
+void NewsTableModel::UpdatePendingNews(const NewsType& type)
+{
+    const int64_t nUpdated = mempool.GetTransactionsUpdated();
+    if (nUpdated == nMempoolUpdated)
+        return;
+    nMempoolUpdated = nUpdated;
 
-            vNews.push_back(object);
-        }
+    RemoveNews([](const NewsTableObject& object) {
+        return object.hashBlock.IsNull();
+    });
+
+    std::vector<MempoolNews> vFound;
+    mempool.GetNews(type.header, vFound);
+
+    std::vector<NewsTableObject> vNews;
+    for (const MempoolNews& news : vFound) {
+        OPReturnData d;
+        d.txid = news.txid;
+        d.script = news.script;
+        d.nSize = news.nSize;
+        d.fees = news.nFee;
+        vNews.push_back(MakeNewsObject(uint256(), news.nTime, d));
     }
 
+    AppendNews(vNews);
+}
+
+void NewsTableModel::AppendNews(std::vector<NewsTableObject>& vNews)
+{
+    if (vNews.empty())
+        return;
+
     // Sort by fees
     SortByFees(vNews);
 
@@ -247,9 +343,29 @@ void NewsTableModel::UpdateModel()
     endInsertRows();
 }
 
+void NewsTableModel::RemoveNews(std::function<bool(const NewsTableObject&)> fRemove)
+{
+    // Remove contiguous runs of rows starting from the end
+    for (int i = model.size() - 1; i >= 0; i--) {
+        if (!fRemove(model.at(i).value<NewsTableObject>()))
+            continue;
+
+        int nLast = i;
+        while (i > 0 && fRemove(model.at(i - 1).value<NewsTableObject>()))
+            i--;
+
+        beginRemoveRows(QModelIndex(), i, nLast);
+        model.erase(model.begin() + i, model.begin() + nLast + 1);
+        endRemoveRows();
+    }
+}
+
 void NewsTableModel::setFilter(size_t nFilterIn)
 {
     nFilter = nFilterIn;
+
+    // Reload the model for the new news type
+    pindexLast = nullptr;
     UpdateModel();
 }
 
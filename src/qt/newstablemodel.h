@@ -10,10 +10,13 @@
 #include <QAbstractTableModel>
 #include <QList>
 
+#include <functional>
+
 class CBlockIndex;
 class ClientModel;
 class NewsTypesTableModel;
 class OPReturnData;
+struct NewsType;
 
 QT_BEGIN_NAMESPACE
 class QTimer;
@@ -21,6 +24,8 @@ QT_END_NAMESPACE
 
 struct NewsTableObject
 {
+    //! Null for unconfirmed news from the mempool
+    uint256 hashBlock;
     int nTime;
     std::string decode;
     std::string fees;
@@ -52,6 +57,7 @@ public:
 
 public Q_SLOTS:
     void numBlocksChanged();
+    void mempoolChanged();
 
 private:
     QList<QVariant> model;
@@ -59,7 +65,23 @@ private:
     ClientModel *clientModel = nullptr;
     NewsTypesTableModel *newsTypesModel = nullptr;
 
+    /** The block the model is up to date with, null to reload everything */
+    const CBlockIndex* pindexLast = nullptr;
+
+    /** Hash of the news type the model was loaded for */
+    uint256 hashType;
+
+    /** Mempool update count the unconfirmed news was loaded at, -1 to
+     * reload it */
+    int64_t nMempoolUpdated = -1;
+
+    /** Add news from blocks connected since the last update and remove
+     * news from disconnected blocks or outside of the news type's days */
     void UpdateModel();
+    /** Replace the unconfirmed news if the mempool has changed */
+    void UpdatePendingNews(const NewsType& type);
+    void AppendNews(std::vector<NewsTableObject>& vNews);
+    void RemoveNews(std::function<bool(const NewsTableObject&)> fRemove);
     void SortByFees(std::vector<NewsTableObject>& vNews);
 
     size_t nFilter;
@@ -95,10 +95,11 @@ OPReturnDialog::~OPReturnDialog()
 
 void OPReturnDialog::setClientModel(ClientModel *model)
 {
+    this->clientModel = model;
     if (model)
     {
-        connect(model, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
-                this, SLOT(numBlocksChanged(int, QDateTime)));
+        // Updated while the dialog is shown, and when it is shown again
+        model->subscribeChainChanged(this, "numBlocksChanged", this);
     }
 }
 
@@ -187,7 +188,7 @@ void OPReturnDialog::updateOnShow()
     Q_EMIT(UpdateTable());
 }
 
-void OPReturnDialog::numBlocksChanged(int nHeight, const QDateTime& time)
+void OPReturnDialog::numBlocksChanged()
 {
     if (!clientModel)
         return;
@@ -53,7 +53,7 @@ private Q_SLOTS:
     void copyHex();
     void on_pushButtonCreate_clicked();
     void on_spinBoxDays_editingFinished();
-    void numBlocksChanged(int nHeight, const QDateTime& time);
+    void numBlocksChanged();
 
 Q_SIGNALS:
     void UpdateTable();
@@ -5,6 +5,7 @@
 #include <qt/opreturntablemodel.h>
 
 #include <chain.h>
+#include <opreturnindex.h>
 #include <txdb.h>
 #include <utilmoneystr.h>
 #include <validation.h>
@@ -13,6 +14,8 @@
 #include <QMetaType>
 #include <QVariant>
 
+#include <set>
+
 Q_DECLARE_METATYPE(OPReturnTableObject)
 
 OPReturnTableModel::OPReturnTableModel(QObject *parent) :
@@ -123,44 +126,75 @@ QVariant OPReturnTableModel::headerData(int section, Qt::Orientation orientation
 void OPReturnTableModel::setDays(int nDaysIn)
 {
     nDays = nDaysIn;
+
+    // Reload the model for the new number of days
+    pindexLast = nullptr;
     UpdateModel();
 }
 
-// TODO append new data to the model instead of loading all every time
 void OPReturnTableModel::UpdateModel()
 {
-    // Clear old data
-    beginResetModel();
-    model.clear();
-    endResetModel();
-
-    int nHeight = chainActive.Height();
+    LOCK(cs_main);
 
-    QDateTime tipTime = QDateTime::fromTime_t(chainActive.Tip()->GetBlockTime());
-    QDateTime targetTime = tipTime.addDays(-nDays);
+    const CBlockIndex* pindexTip = GetOPReturnIndexTip();
+    if (!pindexTip || pindexTip == pindexLast)
+        return;
 
-    // Loop backwards from chainTip until we reach target time or genesis block.
-    std::vector<OPReturnTableObject> vObj;
-    int nBatchSize = 300;
-    for (int i = nHeight; i > 1; i--) {
-        CBlockIndex *index = chainActive[i];
-        if (!index)
+    QDateTime tipTime = QDateTime::fromTime_t(pindexTip->GetBlockTime());
+    const int64_t nTimeTarget = tipTime.addDays(-nDays).toTime_t();
+
+    // Find the blocks we have to remove and add data for. On the first
+    // update pindexFork is null and we load everything back to the target
+    // time.
+    const CBlockIndex* pindexFork = nullptr;
+    if (!pindexLast) {
+        beginResetModel();
+        model.clear();
+        endResetModel();
+    } else {
+        pindexFork = LastCommonAncestor(pindexLast, pindexTip);
+
+        // Remove data from disconnected blocks and data that is too old
+        std::set<uint256> setDisconnected;
+        for (const CBlockIndex* pindex = pindexLast; pindex && pindex != pindexFork; pindex = pindex->pprev)
+            setDisconnected.insert(pindex->GetBlockHash());
+
+        RemoveRows([&setDisconnected, nTimeTarget](const OPReturnTableObject& object) {
+            return object.nTime <= nTimeTarget || setDisconnected.count(object.hashBlock);
+        });
+    }
+    pindexLast = pindexTip;
+
+    // Loop backwards from the tip until we reach the target time, the fork
+    // point or the genesis block.
+    std::vector<const CBlockIndex*> vIndex;
+    std::vector<uint256> vHash;
+    for (const CBlockIndex* pindex = pindexTip; pindex && pindex != pindexFork; pindex = pindex->pprev) {
+        if (pindex->nHeight <= 1)
             break;
 
         // Have we gone back in time far enough?
-        QDateTime indexTime = QDateTime::fromTime_t(index->GetBlockTime());
-
-        if (indexTime <= targetTime)
+        if (pindex->GetBlockTime() <= nTimeTarget)
             break;
 
-        // For each block load our cached OP_RETURN data
-        std::vector<OPReturnData> vData;
-        if (!popreturndb->GetBlockData(index->GetBlockHash(), vData))
+        vIndex.push_back(pindex);
+        vHash.push_back(pindex->GetBlockHash());
+    }
+
+    // Load our cached OP_RETURN data for all of the blocks at once
+    std::vector<std::vector<OPReturnData>> vBlockData;
+    std::vector<bool> vFound;
+    popreturndb->GetBlockData(vHash, vBlockData, vFound);
+
+    std::vector<OPReturnTableObject> vObj;
+    for (size_t x = 0; x < vIndex.size(); x++) {
+        if (!vFound[x])
             continue;
 
-        for (const OPReturnData& d : vData) {
+        for (const OPReturnData& d : vBlockData[x]) {
             OPReturnTableObject object;
-            object.nTime = index->nTime;
+            object.hashBlock = vIndex[x]->GetBlockHash();
+            object.nTime = vIndex[x]->nTime;
 
             // Copy chars from script, skipping OP_RETURN
             std::string strDecode;
@@ -174,26 +208,30 @@ void OPReturnTableModel::UpdateModel()
 
             vObj.push_back(object);
         }
-
-        // Write batch
-        if (i % nBatchSize == 0 && vObj.size()) {
-            int offset = model.size() ? 2 : 1;
-            beginInsertRows(QModelIndex(), model.size(), model.size() + vObj.size() - offset);
-            for (const OPReturnTableObject& o : vObj)
-                model.append(QVariant::fromValue(o));
-            endInsertRows();
-
-            vObj.clear();
-        }
     }
 
-    if (!vObj.size())
+    if (vObj.empty())
         return;
 
-    // Write final batch
-    int offset = model.size() ? 2 : 1;
-    beginInsertRows(QModelIndex(), model.size(), model.size() + vObj.size() - offset);
+    beginInsertRows(QModelIndex(), model.size(), model.size() + vObj.size() - 1);
     for (const OPReturnTableObject& o : vObj)
         model.append(QVariant::fromValue(o));
     endInsertRows();
 }
+
+void OPReturnTableModel::RemoveRows(std::function<bool(const OPReturnTableObject&)> fRemove)
+{
+    // Remove contiguous runs of rows starting from the end
+    for (int i = model.size() - 1; i >= 0; i--) {
+        if (!fRemove(model.at(i).value<OPReturnTableObject>()))
+            continue;
+
+        int nLast = i;
+        while (i > 0 && fRemove(model.at(i - 1).value<OPReturnTableObject>()))
+            i--;
+
+        beginRemoveRows(QModelIndex(), i, nLast);
+        model.erase(model.begin() + i, model.begin() + nLast + 1);
+        endRemoveRows();
+    }
+}
@@ -10,6 +10,8 @@
 #include <QAbstractTableModel>
 #include <QList>
 
+#include <functional>
+
 class CBlockIndex;
 class OPReturnData;
 
@@ -19,6 +21,7 @@ QT_END_NAMESPACE
 
 struct OPReturnTableObject
 {
+    uint256 hashBlock;
     int nTime;
     std::string decode;
     std::string fees;
@@ -45,11 +48,18 @@ public:
     };
 
 public Q_SLOTS:
+    /** Add data from blocks connected since the last update and remove data
+     * from disconnected blocks or older than nDays */
     void UpdateModel();
 
 private:
     QList<QVariant> model;
     int nDays;
+
+    /** The block the model is up to date with, null to reload everything */
+    const CBlockIndex* pindexLast = nullptr;
+
+    void RemoveRows(std::function<bool(const OPReturnTableObject&)> fRemove);
 };
 
 #endif // OPRETURNTABLEMODEL_H
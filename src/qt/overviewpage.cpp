@@ -318,6 +318,7 @@ void OverviewPage::updateWatchOnlyLabels(bool showWatchOnly)
 void OverviewPage::setClientModel(ClientModel *model)
 {
     this->clientModel = model;
+    blockIndexDialog->setClientModel(model);
     if(model)
     {
         // Show warning if this is a prerelease version
@@ -359,8 +360,28 @@ void OverviewPage::setMemPoolModel(MemPoolTableModel *model)
 {
     this->memPoolModel = model;
 
-    if (model)
+    if (model) {
         ui->tableViewMempool->setModel(memPoolModel);
+
+        connect(model, SIGNAL(feeHistogramChanged()),
+                this, SLOT(updateMempoolFees()));
+    }
+}
+
+void OverviewPage::updateMempoolFees()
+{
+    if (!memPoolModel)
+        return;
+
+    QString strFeeRate;
+    if (memPoolModel->GetNextBlockFeeRate())
+        strFeeRate = tr("Next block: %1+ sat/vB").arg(memPoolModel->GetNextBlockFeeRate());
+    else
+        strFeeRate = tr("Next block: any fee");
+
+    ui->labelMempoolFees->setText(tr("%1, backlog %2 blocks")
+            .arg(strFeeRate)
+            .arg(memPoolModel->GetBlocksBacklog(), 0, 'f', 1));
 }
 
 void OverviewPage::updateDisplayUnit()
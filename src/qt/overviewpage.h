@@ -108,6 +108,7 @@ private Q_SLOTS:
     void contextualMenuBlocks(const QPoint &);
     void updateNewsTypes();
     void updateUSDTotal();
+    void updateMempoolFees();
 
     void showDetailsNews1();
     void showDetailsNews2();
@@ -7,6 +7,7 @@
 
 #include <qt/clientmodel.h>
 #include <qt/platformstyle.h>
+#include <qt/scdbhistorymodel.h>
 
 #include <chain.h>
 #include <chainparams.h>
@@ -21,6 +22,9 @@ SCDBDialog::SCDBDialog(const PlatformStyle *_platformStyle, QWidget *parent) :
     platformStyle(_platformStyle)
 {
     ui->setupUi(this);
+
+    historyModel = new SCDBHistoryModel(this);
+    ui->treeViewHistory->setModel(historyModel);
 }
 
 SCDBDialog::~SCDBDialog()
@@ -194,110 +198,8 @@ void SCDBDialog::UpdateSCDBText()
 
 void SCDBDialog::UpdateHistoryTree()
 {
-    // Update history tree
-
-    ui->treeWidgetHistory->setUpdatesEnabled(false);
-    ui->treeWidgetHistory->clear();
-
-    int nHeight = chainActive.Height();
-    int nBlocksToDisplay = 6;
-    if (nHeight < nBlocksToDisplay)
-        nBlocksToDisplay = nHeight;
-
-    for (int i = 0; i < nBlocksToDisplay; i++) {
-        CBlockIndex *pindex = chainActive[nHeight - i];
-
-        if (pindex->GetBlockHash() == Params().GetConsensus().hashGenesisBlock) {
-            QTreeWidgetItem *subItem = new QTreeWidgetItem();
-            subItem->setText(0, "Genesis block has no score data");
-            AddHistoryTreeItem(i, nHeight - i, subItem);
-            continue;
-        }
-
-        SidechainBlockData data;
-        if (!psidechaintree->GetBlockData(pindex->GetBlockHash(), data)) {
-            QTreeWidgetItem *subItem = new QTreeWidgetItem();
-            subItem->setText(0, "No score data for this block");
-            AddHistoryTreeItem(i, nHeight - i, subItem);
-            continue;
-        }
-
-        // Loop through state here and add sub items for sc# & score change
-        int nSidechain = 0;
-        for (const std::vector<SidechainWithdrawalState>& vScore : data.vWithdrawalStatus) {
-            if (vScore.empty()) {
-                nSidechain++;
-                continue;
-            }
-
-            // Create sidechain item
-            QTreeWidgetItem *subItemSC = new QTreeWidgetItem();
-
-            // Load prev block data to check old score
-            SidechainBlockData prevData;
-            if (pindex->pprev)
-                psidechaintree->GetBlockData(pindex->pprev->GetBlockHash(), prevData);
-
-            // Create sidechain children items
-            for (const SidechainWithdrawalState& s : vScore) {
-                // Look up old work score
-                uint16_t nPrevScore = 0;
-                if (prevData.vWithdrawalStatus.size() > s.nSidechain) {
-                    for (const SidechainWithdrawalState& prevState : prevData.vWithdrawalStatus[s.nSidechain]) {
-                        if (prevState.hash == s.hash)
-                            nPrevScore = prevState.nWorkScore;
-                    }
-                }
-
-                QTreeWidgetItem *subItemScore = new QTreeWidgetItem();
-                QString strScore = " (Abstain)";
-                if (nPrevScore < s.nWorkScore)
-                    strScore = " (Upvote / ACK)";
-                else
-                if (nPrevScore > s.nWorkScore)
-                    strScore = " (Downvote / NACK)";
-
-                subItemScore->setText(0, "Work score: " + QString::number(nPrevScore) + " -> " + QString::number(s.nWorkScore) + strScore);
-                subItemSC->addChild(subItemScore);
-
-                QTreeWidgetItem *subItemBlocks = new QTreeWidgetItem();
-                subItemBlocks->setText(0, "Blocks remaining: " + QString::number(s.nBlocksLeft + 1) + " -> " + QString::number(s.nBlocksLeft));
-                subItemSC->addChild(subItemBlocks);
-
-                QTreeWidgetItem *subItemHash = new QTreeWidgetItem();
-                subItemHash->setText(0, "Withdrawal bundle hash:\n" + QString::fromStdString(s.hash.ToString()));
-                subItemSC->addChild(subItemHash);
-            }
-
-            // Add SC item parent to tree
-            subItemSC->setText(0, "Sidechain #" + QString::number(nSidechain) + " scores");
-            AddHistoryTreeItem(i, nHeight - i, subItemSC);
-
-            nSidechain++;
-        }
-    }
-
-    ui->treeWidgetHistory->collapseAll();
-    ui->treeWidgetHistory->resizeColumnToContents(0);
-    ui->treeWidgetHistory->setUpdatesEnabled(true);
-}
-
-void SCDBDialog::AddHistoryTreeItem(int index, const int nHeight, QTreeWidgetItem *item)
-{
-    if (!item || index < 0)
-        return;
-
-    QTreeWidgetItem *topItem = ui->treeWidgetHistory->topLevelItem(index);
-    if (!topItem) {
-        topItem = new QTreeWidgetItem(ui->treeWidgetHistory);
-        topItem->setText(0, "Block #" + QString::number(nHeight));
-        ui->treeWidgetHistory->insertTopLevelItem(index, topItem);
-    }
-
-    if (!topItem)
-        return;
-
-    topItem->addChild(item);
+    historyModel->UpdateModel();
+    ui->treeViewHistory->resizeColumnToContents(0);
 }
 
 void SCDBDialog::numBlocksChanged()
@@ -373,7 +275,6 @@ void SCDBDialog::setClientModel(ClientModel *model)
     this->clientModel = model;
     if(model)
     {
-        connect(model, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
-                this, SLOT(numBlocksChanged()));
+        model->subscribeChainChanged(this, "numBlocksChanged", this);
     }
 }
@@ -9,6 +9,7 @@
 
 class ClientModel;
 class PlatformStyle;
+class SCDBHistoryModel;
 
 QT_BEGIN_NAMESPACE
 class QTreeWidgetItem;
@@ -40,8 +41,7 @@ private:
 
     const PlatformStyle *platformStyle;
     ClientModel *clientModel = nullptr;
-
-    void AddHistoryTreeItem(int index, const int nHeight, QTreeWidgetItem *item);
+    SCDBHistoryModel *historyModel = nullptr;
 
     void UpdateVoteTree();
     void UpdateSCDBText();
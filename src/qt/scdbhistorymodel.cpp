@@ -0,0 +1,217 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <qt/scdbhistorymodel.h>
+
+#include <chain.h>
+#include <sync.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <algorithm>
+
+SCDBHistoryItem* SCDBHistoryItem::AddChild(const QString& textIn)
+{
+    std::unique_ptr<SCDBHistoryItem> item(new SCDBHistoryItem());
+    item->text = textIn;
+    item->parent = this;
+    vChild.push_back(std::move(item));
+    return vChild.back().get();
+}
+
+int SCDBHistoryItem::Row() const
+{
+    if (!parent)
+        return 0;
+
+    for (size_t i = 0; i < parent->vChild.size(); i++) {
+        if (parent->vChild[i].get() == this)
+            return i;
+    }
+    return 0;
+}
+
+SCDBHistoryModel::SCDBHistoryModel(QObject *parent) :
+    QAbstractItemModel(parent)
+{
+}
+
+SCDBHistoryModel::~SCDBHistoryModel()
+{
+}
+
+QModelIndex SCDBHistoryModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (column != 0 || row < 0)
+        return QModelIndex();
+
+    const SCDBHistoryItem* item = parent.isValid() ?
+        static_cast<const SCDBHistoryItem*>(parent.internalPointer()) : &root;
+
+    if ((size_t)row >= item->vChild.size())
+        return QModelIndex();
+
+    return createIndex(row, column, item->vChild[row].get());
+}
+
+QModelIndex SCDBHistoryModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return QModelIndex();
+
+    const SCDBHistoryItem* item = static_cast<const SCDBHistoryItem*>(index.internalPointer());
+    SCDBHistoryItem* parentItem = item->parent;
+    if (!parentItem || parentItem == &root)
+        return QModelIndex();
+
+    return createIndex(parentItem->Row(), 0, parentItem);
+}
+
+int SCDBHistoryModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+
+    const SCDBHistoryItem* item = parent.isValid() ?
+        static_cast<const SCDBHistoryItem*>(parent.internalPointer()) : &root;
+
+    return item->vChild.size();
+}
+
+int SCDBHistoryModel::columnCount(const QModelIndex &parent) const
+{
+    return 1;
+}
+
+QVariant SCDBHistoryModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole)
+        return QVariant();
+
+    return static_cast<const SCDBHistoryItem*>(index.internalPointer())->text;
+}
+
+void SCDBHistoryModel::UpdateModel()
+{
+    // Find the blocks to display (newest first) and the parent of the oldest
+    // one, which we need to work out its score changes
+    std::vector<uint256> vHash;
+    int nHeightTop = 0;
+    int nHeightBottom = 0;
+    {
+        LOCK(cs_main);
+        nHeightTop = chainActive.Height();
+        if (nHeightTop < 1)
+            return;
+
+        nHeightBottom = std::max(1, nHeightTop - SCDB_HISTORY_BLOCKS + 1);
+        for (int h = nHeightTop; h >= nHeightBottom - 1; h--)
+            vHash.push_back(chainActive[h]->GetBlockHash());
+    }
+
+    // Drop the data of blocks that left the window or were disconnected
+    for (auto it = mapBlockData.begin(); it != mapBlockData.end(); ) {
+        const int nHeight = it->first;
+        if (nHeight < nHeightBottom - 1 || nHeight > nHeightTop || it->second.first != vHash[nHeightTop - nHeight])
+            it = mapBlockData.erase(it);
+        else
+            it++;
+    }
+
+    // Load the data we don't have yet, oldest first so that consecutive
+    // blocks are built on each other
+    std::vector<int> vLoadHeight;
+    std::vector<uint256> vLoadHash;
+    for (int h = nHeightBottom - 1; h <= nHeightTop; h++) {
+        if (!mapBlockData.count(h)) {
+            vLoadHeight.push_back(h);
+            vLoadHash.push_back(vHash[nHeightTop - h]);
+        }
+    }
+    if (!vLoadHash.empty()) {
+        std::vector<SidechainBlockData> vData;
+        std::vector<bool> vFound;
+        psidechaintree->GetBlockData(vLoadHash, vData, vFound);
+        for (size_t i = 0; i < vLoadHash.size(); i++) {
+            if (vFound[i])
+                mapBlockData[vLoadHeight[i]] = std::make_pair(vLoadHash[i], std::move(vData[i]));
+        }
+    }
+
+    // Remove the rows of blocks that are no longer displayed
+    for (int row = root.vChild.size() - 1; row >= 0; row--) {
+        const uint256& hashBlock = root.vChild[row]->hashBlock;
+        if (std::find(vHash.begin(), vHash.end() - 1, hashBlock) != vHash.end() - 1)
+            continue;
+
+        beginRemoveRows(QModelIndex(), row, row);
+        root.vChild.erase(root.vChild.begin() + row);
+        endRemoveRows();
+    }
+
+    // The remaining rows are a run of consecutive displayed blocks, fill in
+    // the blocks above and below them
+    for (int h = nHeightTop; h >= nHeightBottom; h--) {
+        const size_t row = nHeightTop - h;
+        const uint256& hashBlock = vHash[row];
+        if (row < root.vChild.size() && root.vChild[row]->hashBlock == hashBlock)
+            continue;
+
+        auto it = mapBlockData.find(h);
+        auto itPrev = mapBlockData.find(h - 1);
+
+        std::unique_ptr<SCDBHistoryItem> item = MakeBlockItem(h, hashBlock,
+                it != mapBlockData.end() ? &it->second.second : nullptr,
+                itPrev != mapBlockData.end() ? &itPrev->second.second : nullptr);
+        item->parent = &root;
+
+        beginInsertRows(QModelIndex(), row, row);
+        root.vChild.insert(root.vChild.begin() + row, std::move(item));
+        endInsertRows();
+    }
+}
+
+std::unique_ptr<SCDBHistoryItem> SCDBHistoryModel::MakeBlockItem(int nHeight, const uint256& hashBlock, const SidechainBlockData* data, const SidechainBlockData* prevData) const
+{
+    std::unique_ptr<SCDBHistoryItem> item(new SCDBHistoryItem());
+    item->text = "Block #" + QString::number(nHeight);
+    item->hashBlock = hashBlock;
+
+    if (!data) {
+        item->AddChild("No score data for this block");
+        return item;
+    }
+
+    // Add an item for each sidechain with sub items for the score changes
+    for (size_t nSidechain = 0; nSidechain < data->vWithdrawalStatus.size(); nSidechain++) {
+        const std::vector<SidechainWithdrawalState>& vScore = data->vWithdrawalStatus[nSidechain];
+        if (vScore.empty())
+            continue;
+
+        SCDBHistoryItem* itemSC = item->AddChild("Sidechain #" + QString::number(nSidechain) + " scores");
+
+        for (const SidechainWithdrawalState& s : vScore) {
+            // Look up old work score
+            uint16_t nPrevScore = 0;
+            if (prevData && prevData->vWithdrawalStatus.size() > s.nSidechain) {
+                for (const SidechainWithdrawalState& prevState : prevData->vWithdrawalStatus[s.nSidechain]) {
+                    if (prevState.hash == s.hash)
+                        nPrevScore = prevState.nWorkScore;
+                }
+            }
+
+            QString strScore = " (Abstain)";
+            if (nPrevScore < s.nWorkScore)
+                strScore = " (Upvote / ACK)";
+            else if (nPrevScore > s.nWorkScore)
+                strScore = " (Downvote / NACK)";
+
+            itemSC->AddChild("Work score: " + QString::number(nPrevScore) + " -> " + QString::number(s.nWorkScore) + strScore);
+            itemSC->AddChild("Blocks remaining: " + QString::number(s.nBlocksLeft + 1) + " -> " + QString::number(s.nBlocksLeft));
+            itemSC->AddChild("Withdrawal bundle hash:\n" + QString::fromStdString(s.hash.ToString()));
+        }
+    }
+
+    return item;
+}
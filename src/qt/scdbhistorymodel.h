@@ -0,0 +1,77 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SCDBHISTORYMODEL_H
+#define SCDBHISTORYMODEL_H
+
+#include <sidechain.h>
+#include <uint256.h>
+
+#include <QAbstractItemModel>
+#include <QString>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+/** The number of recent blocks shown by the SCDB history */
+static const int SCDB_HISTORY_BLOCKS = 6;
+
+/** A row of the SCDB history tree. Block rows are at the top level, their
+ * children are the sidechains which have withdrawal scores and the children
+ * of those describe each withdrawal's score change. */
+struct SCDBHistoryItem
+{
+    QString text;
+
+    // Only set for block rows
+    uint256 hashBlock;
+
+    SCDBHistoryItem* parent = nullptr;
+    std::vector<std::unique_ptr<SCDBHistoryItem>> vChild;
+
+    SCDBHistoryItem* AddChild(const QString& textIn);
+    int Row() const;
+};
+
+/**
+ * Work score changes of the sidechain withdrawals in the most recent blocks.
+ *
+ * The score changes of a block are worked out once when the block enters
+ * the window. The decoded SCDB data of the window is kept by height, so that
+ * only newly connected blocks (and blocks of a new branch after a reorg) are
+ * read from the sidechain database.
+ */
+class SCDBHistoryModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    explicit SCDBHistoryModel(QObject *parent = 0);
+    ~SCDBHistoryModel();
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &index) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+public Q_SLOTS:
+    /** Add rows for blocks connected since the last update and remove rows
+     * of blocks that were disconnected or left the window */
+    void UpdateModel();
+
+private:
+    /** Top level item, its children are the block rows, newest first */
+    SCDBHistoryItem root;
+
+    /** Decoded SCDB data of the blocks in the window and the parent of the
+     * oldest one, by height */
+    std::map<int, std::pair<uint256, SidechainBlockData>> mapBlockData;
+
+    /** Create the row of a block from its data and its parent's data */
+    std::unique_ptr<SCDBHistoryItem> MakeBlockItem(int nHeight, const uint256& hashBlock, const SidechainBlockData* data, const SidechainBlockData* prevData) const;
+};
+
+#endif // SCDBHISTORYMODEL_H
@@ -119,8 +119,9 @@ void SidechainPage::setClientModel(ClientModel *model)
     {
         numBlocksChanged();
 
-        connect(model, SIGNAL(numBlocksChanged(int,QDateTime,double,bool)),
-                this, SLOT(numBlocksChanged()));
+        model->subscribeChainChanged(this, "numBlocksChanged", this);
+        if (withdrawalModel)
+            model->subscribeChainChanged(withdrawalModel, "numBlocksChanged", this);
 
         scdbDialog->setClientModel(model);
     }
@@ -141,6 +142,9 @@ void SidechainPage::setWithdrawalModel(SidechainWithdrawalTableModel *model)
     this->withdrawalModel = model;
 
     if (model) {
+        if (clientModel)
+            clientModel->subscribeChainChanged(model, "numBlocksChanged", this);
+
         // Add model to table view
         ui->tableViewWT->setModel(withdrawalModel);
 
@@ -437,8 +441,8 @@ void SidechainPage::on_tableViewWT_doubleClicked(const QModelIndex& index)
         return;
     }
 
-    CMutableTransaction mtx;
-    if (!scdb.GetCachedWithdrawalTx(hash, mtx)) {
+    CTransactionRef tx;
+    if (!scdb.GetCachedWithdrawalTx(hash, tx)) {
         QString error;
         error += "Withdrawal not in cache!\n\n";
         error += "Try using the 'rebroadcastwithdrawaltx' RPC command on the sidechain.\n";
@@ -448,7 +452,7 @@ void SidechainPage::on_tableViewWT_doubleClicked(const QModelIndex& index)
     }
 
     TxDetails detailsDialog;
-    detailsDialog.SetTransaction(mtx);
+    detailsDialog.SetTransaction(CMutableTransaction(*tx));
 
     detailsDialog.exec();
 }
@@ -4,15 +4,18 @@
 
 #include <qt/trafficgraphwidget.h>
 #include <qt/clientmodel.h>
+#include <qt/guiutil.h>
 
 #include <QPainterPath>
 #include <QPainter>
 #include <QColor>
 #include <QTimer>
 
+#include <algorithm>
 #include <cmath>
 
 #define DESIRED_SAMPLES         800
+#define MSG_STATS_ROWS          8
 
 #define XMARGIN                 10
 #define YMARGIN                 10
@@ -38,6 +41,7 @@ void TrafficGraphWidget::setClientModel(ClientModel *model)
     if(model) {
         nLastBytesIn = model->getTotalBytesRecv();
         nLastBytesOut = model->getTotalBytesSent();
+        mapMsgStatsStart = model->getNetMsgStats();
     }
 }
 
@@ -148,9 +152,51 @@ void TrafficGraphWidget::updateRates()
         if(f > tmax) tmax = f;
     }
     fMax = tmax;
+    updateMsgStats();
     update();
 }
 
+// Show the message types that took the most processing time since the graph
+// was last cleared as tooltip
+void TrafficGraphWidget::updateMsgStats()
+{
+    std::vector<std::pair<std::string, CNetMsgStats>> vDelta;
+    for (const auto& i : clientModel->getNetMsgStats()) {
+        CNetMsgStats delta = i.second;
+        mapNetMsgStats::const_iterator it = mapMsgStatsStart.find(i.first);
+        if (it != mapMsgStatsStart.end()) {
+            delta.nRecvCount -= it->second.nRecvCount;
+            delta.nRecvBytes -= it->second.nRecvBytes;
+            delta.nSendCount -= it->second.nSendCount;
+            delta.nSendBytes -= it->second.nSendBytes;
+            delta.nProcessMicros -= it->second.nProcessMicros;
+            delta.nMainWaitMicros -= it->second.nMainWaitMicros;
+        }
+        if (delta.nRecvCount || delta.nSendCount || delta.nProcessMicros)
+            vDelta.emplace_back(i.first, delta);
+    }
+    std::sort(vDelta.begin(), vDelta.end(), [](const std::pair<std::string, CNetMsgStats>& a, const std::pair<std::string, CNetMsgStats>& b) {
+        return a.second.nProcessMicros > b.second.nProcessMicros;
+    });
+    if (vDelta.size() > MSG_STATS_ROWS)
+        vDelta.resize(MSG_STATS_ROWS);
+
+    QString strRows;
+    for (const auto& i : vDelta) {
+        const CNetMsgStats& stats = i.second;
+        strRows += QString("<tr><td>%1</td><td align=\"right\">%2</td><td align=\"right\">%3</td><td align=\"right\">%4</td><td align=\"right\">%5</td><td align=\"right\">%6</td></tr>")
+            .arg(QString::fromStdString(i.first))
+            .arg(stats.nRecvCount)
+            .arg(GUIUtil::formatBytes(stats.nRecvBytes))
+            .arg(GUIUtil::formatBytes(stats.nSendBytes))
+            .arg(QString::number(stats.nProcessMicros / 1000.0, 'f', 1))
+            .arg(QString::number(stats.nMainWaitMicros / 1000.0, 'f', 1));
+    }
+    setToolTip(QString("<table><tr><th>%1</th><th>%2</th><th>%3</th><th>%4</th><th>%5</th><th>%6</th></tr>%7</table>")
+        .arg(tr("Message"), tr("Received"), tr("In"), tr("Out"), tr("Processing (ms)"), tr("cs_main wait (ms)"))
+        .arg(strRows));
+}
+
 void TrafficGraphWidget::setGraphRangeMins(int mins)
 {
     nMins = mins;
@@ -172,6 +218,7 @@ void TrafficGraphWidget::clear()
     if(clientModel) {
         nLastBytesIn = clientModel->getTotalBytesRecv();
         nLastBytesOut = clientModel->getTotalBytesSent();
+        mapMsgStatsStart = clientModel->getNetMsgStats();
     }
     timer->start();
 }
@@ -5,6 +5,8 @@
 #ifndef BITCOIN_QT_TRAFFICGRAPHWIDGET_H
 #define BITCOIN_QT_TRAFFICGRAPHWIDGET_H
 
+#include <net.h>
+
 #include <QWidget>
 #include <QQueue>
 
@@ -34,6 +36,7 @@ public Q_SLOTS:
 
 private:
     void paintPath(QPainterPath &path, QQueue<float> &samples);
+    void updateMsgStats();
 
     QTimer *timer;
     float fMax;
@@ -42,6 +45,7 @@ private:
     QQueue<float> vSamplesOut;
     quint64 nLastBytesIn;
     quint64 nLastBytesOut;
+    mapNetMsgStats mapMsgStatsStart;
     ClientModel *clientModel;
 };
 
@@ -10,6 +10,7 @@
 #include <timedata.h>
 #include <wallet/wallet.h>
 
+#include <algorithm>
 #include <stdint.h>
 
 
@@ -180,6 +181,7 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
         idx);
     status.countsForBalance = wtx.IsTrusted() && !(wtx.GetBlocksToMaturity() > 0);
     status.depth = wtx.GetDepthInMainChain();
+    status.block_height = (pindex && status.depth > 0) ? pindex->nHeight : -1;
     status.cur_num_blocks = chainActive.Height();
 
     if (!CheckFinalTx(*wtx.tx))
@@ -240,6 +242,29 @@ void TransactionRecord::updateStatus(const CWalletTx &wtx)
     status.needsUpdate = false;
 }
 
+bool TransactionRecord::updateDepth(int nNumBlocks)
+{
+    // A reorg that disconnects the block notifies the wallet transaction,
+    // which sets needsUpdate, so until then the depth follows the tip
+    if (status.needsUpdate || status.block_height < 0 || nNumBlocks < status.block_height)
+        return false;
+
+    status.depth = nNumBlocks - status.block_height + 1;
+    status.cur_num_blocks = nNumBlocks;
+
+    if (type == TransactionRecord::Generated)
+    {
+        status.matures_in = std::max<int>(0, (COINBASE_MATURITY + 1) - status.depth);
+        status.status = status.matures_in > 0 ? TransactionStatus::Immature : TransactionStatus::Confirmed;
+        status.countsForBalance = status.matures_in == 0;
+    }
+    else
+    {
+        status.status = status.depth < RecommendedNumConfirmations ? TransactionStatus::Confirming : TransactionStatus::Confirmed;
+    }
+    return true;
+}
+
 void TransactionRecord::updateReplayStatus(TransactionStatus::ReplayStatus replayStatus)
 {
     status.replay_status = replayStatus;
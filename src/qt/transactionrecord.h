@@ -23,7 +23,8 @@ class TransactionStatus
 public:
     TransactionStatus():
         countsForBalance(false), sortKey(""),
-        matures_in(0), status(Unconfirmed), replay_status(ReplayUnknown), depth(0), open_for(0), cur_num_blocks(-1)
+        matures_in(0), status(Unconfirmed), replay_status(ReplayUnknown), depth(0), open_for(0), block_height(-1),
+        cur_num_blocks(-1), needsUpdate(true)
     { }
 
     enum Status {
@@ -69,6 +70,10 @@ public:
                       finalization */
     /**@}*/
 
+    /** Height of the block the transaction is in, -1 if it isn't in the
+        active chain */
+    int block_height;
+
     /** Current number of blocks (to know whether cached status is still valid) */
     int cur_num_blocks;
 
@@ -148,6 +153,12 @@ public:
      */
     void updateStatus(const CWalletTx &wtx);
 
+    /** Update the confirmations of a transaction in the active chain from
+        the height of the tip alone, without cs_main or the wallet. Return
+        false if the status needs updateStatus.
+     */
+    bool updateDepth(int nNumBlocks);
+
     /** Update replay status of record */
     void updateReplayStatus(TransactionStatus::ReplayStatus replayStatus);
 
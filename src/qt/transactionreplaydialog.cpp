@@ -23,9 +23,14 @@
 #include <utilmoneystr.h>
 #include <wallet/wallet.h>
 
+#include <set>
+#include <vector>
+
 TransactionReplayDialog::TransactionReplayDialog(QWidget *parent) :
     QDialog(parent),
-    ui(new Ui::TransactionReplayDialog)
+    ui(new Ui::TransactionReplayDialog),
+    fAbortReplayCheck(false),
+    fAbortCoinSplit(false)
 {
     ui->setupUi(this);
 
@@ -50,6 +55,8 @@ TransactionReplayDialog::TransactionReplayDialog(QWidget *parent) :
 
 TransactionReplayDialog::~TransactionReplayDialog()
 {
+    StopReplayCheck();
+    StopCoinSplit();
     delete ui;
 }
 
@@ -202,6 +209,11 @@ void TransactionReplayDialog::on_pushButtonCheckReplay_clicked()
         return;
     }
 
+    // A check is already running
+    if (threadReplayCheck.joinable()) {
+        return;
+    }
+
     QMessageBox messageBox;
     QModelIndexList selection = ui->tableWidgetCoins->selectionModel()->selectedRows(COLUMN_TXHASH);
     if (!selection.size()) {
@@ -231,59 +243,146 @@ void TransactionReplayDialog::on_pushButtonCheckReplay_clicked()
         return;
     }
 
+    // Collect each transaction once. Replayed is a final answer which the
+    // wallet has already stored, so those are never looked up again.
+    std::vector<uint256> vTxid;
+    std::set<uint256> setTxid;
+    for (int i = 0; i < selection.size(); i++) {
+        QVariant data = selection[i].data();
+        uint256 txid = uint256S(data.toString().toStdString());
+
+        // Skip checking transactions that have replay protection enabled
+        int nReplayStatus = walletModel->GetReplayStatus(txid);
+        if (nReplayStatus == REPLAY_SPLIT || nReplayStatus == REPLAY_TRUE)
+            continue;
+
+        if (setTxid.insert(txid).second)
+            vTxid.push_back(txid);
+    }
+    if (vTxid.empty())
+        return;
+
     QString strProgress = "Checking transaction replay status...\n\n";
     strProgress += "Contacting block explorer API to check if selected ";
     strProgress += "transaction(s) have been replayed.\n\n";
 
     // Progress dialog with abort button. If user selects many transactions
-    // to check, the operation can take a while.
-    QProgressDialog progress(strProgress, "Abort", 0, selection.size(), this);
-    progress.setWindowModality(Qt::WindowModal);
-    progress.setWindowTitle("Replay status");
-    progress.setMinimumDuration(0);
-    progress.setMinimumSize(500, 100);
+    // to check, the operation can take a while. Results are filled into the
+    // table as they arrive.
+    progressReplayCheck = new QProgressDialog(strProgress, "Abort", 0, vTxid.size(), this);
+    progressReplayCheck->setWindowModality(Qt::WindowModal);
+    progressReplayCheck->setWindowTitle("Replay status");
+    progressReplayCheck->setMinimumDuration(0);
+    progressReplayCheck->setMinimumSize(500, 100);
+    progressReplayCheck->setAutoClose(false);
 
     QFont font;
     font.setStyleHint(QFont::Monospace);
     font.setFamily("noto");
-    progress.setFont(font);
-
-    progress.setValue(0);
-
-    // Check replay status & display progress
-    APIClient client;
-    for (int i = 0; i < selection.size(); i++) {
-        progress.setValue(i);
-        if (progress.wasCanceled())
-            break;
+    progressReplayCheck->setFont(font);
+
+    progressReplayCheck->setValue(0);
+    connect(progressReplayCheck, SIGNAL(canceled()), this, SLOT(AbortReplayCheck()));
+
+    ui->pushButtonCheckReplay->setEnabled(false);
+    nReplayChecked = 0;
+    fAbortReplayCheck = false;
+
+    // Check replay status on a background thread
+    threadReplayCheck = std::thread([this, vTxid]() {
+        APIClient client;
+        bool fConnected = client.CheckReplayStatus(vTxid, [this](const uint256& txid, APIReplayResult result) {
+            if (fAbortReplayCheck)
+                return false;
+
+            int nReplayStatus = REPLAY_UNKNOWN;
+            if (result == API_REPLAY_TRUE)
+                nReplayStatus = REPLAY_TRUE;
+            else if (result == API_REPLAY_FALSE)
+                nReplayStatus = REPLAY_FALSE;
+
+            QMetaObject::invokeMethod(this, "ReplayStatusReceived", Qt::QueuedConnection,
+                                      Q_ARG(QString, QString::fromStdString(txid.ToString())),
+                                      Q_ARG(int, nReplayStatus));
+            return !fAbortReplayCheck;
+        });
+        QMetaObject::invokeMethod(this, "ReplayCheckFinished", Qt::QueuedConnection,
+                                  Q_ARG(bool, fConnected));
+    });
+}
 
-        QVariant data = selection[i].data();
-        uint256 txid = uint256S(data.toString().toStdString());
+void TransactionReplayDialog::ReplayStatusReceived(QString txid, int nReplayStatus)
+{
+    if (!walletModel)
+        return;
 
-        QString strStatus = strProgress;
-        strStatus += "Checking: ";
-        strStatus += QString::fromStdString(txid.ToString());
+    nReplayChecked++;
+    if (progressReplayCheck) {
+        progressReplayCheck->setValue(nReplayChecked);
+        QString strStatus = "Checked: ";
+        strStatus += txid;
         strStatus += "\n";
+        progressReplayCheck->setLabelText(strStatus);
+    }
 
-        progress.setLabelText(strStatus);
+    // A failed lookup leaves the previous status in place
+    if (nReplayStatus == REPLAY_UNKNOWN)
+        return;
 
-        // Skip checking transactions that have replay protection enabled
-        if (walletModel->GetReplayStatus(txid) == REPLAY_SPLIT)
+    walletModel->UpdateReplayStatus(uint256S(txid.toStdString()), nReplayStatus);
+
+    // Update the rows of this transaction without rebuilding the table
+    for (int nRow = 0; nRow < ui->tableWidgetCoins->rowCount(); nRow++) {
+        QTableWidgetItem* itemTXID = ui->tableWidgetCoins->item(nRow, COLUMN_TXHASH);
+        QTableWidgetItem* itemReplay = ui->tableWidgetCoins->item(nRow, COLUMN_REPLAY);
+        if (!itemTXID || !itemReplay || itemTXID->text() != txid)
             continue;
 
-        // TODO handle request failure
-        if (client.IsTxReplayed(txid)) {
-            walletModel->UpdateReplayStatus(txid, REPLAY_TRUE);
-        } else {
-            walletModel->UpdateReplayStatus(txid, REPLAY_FALSE);
+        itemReplay->setText(FormatReplayStatus(nReplayStatus));
+        if (platformStyle) {
+            itemReplay->setIcon(GetReplayIcon(nReplayStatus));
         }
     }
-    progress.setValue(selection.size());
+}
+
+void TransactionReplayDialog::ReplayCheckFinished(bool fConnected)
+{
+    if (threadReplayCheck.joinable())
+        threadReplayCheck.join();
+
+    if (progressReplayCheck) {
+        progressReplayCheck->deleteLater();
+        progressReplayCheck = nullptr;
+    }
+    ui->pushButtonCheckReplay->setEnabled(true);
+
+    if (!fConnected && !fAbortReplayCheck) {
+        QMessageBox messageBox;
+        messageBox.setWindowTitle("Replay status check failed!");
+        messageBox.setText("Could not contact the block explorer API. Please try again later.");
+        messageBox.setIcon(QMessageBox::Warning);
+        messageBox.setStandardButtons(QMessageBox::Ok);
+        messageBox.exec();
+    }
 
     // Update the model - replay status may have changed
     Update();
 }
 
+void TransactionReplayDialog::AbortReplayCheck()
+{
+    fAbortReplayCheck = true;
+}
+
+void TransactionReplayDialog::StopReplayCheck()
+{
+    // Lookups check the flag between responses, so this waits at most for
+    // one network timeout
+    fAbortReplayCheck = true;
+    if (threadReplayCheck.joinable())
+        threadReplayCheck.join();
+}
+
 void TransactionReplayDialog::on_pushButtonSplitCoins_clicked()
 {
     if (!walletModel || !walletModel->getOptionsModel()) {
@@ -303,20 +402,10 @@ void TransactionReplayDialog::on_pushButtonSplitCoins_clicked()
     }
 
     if (selection.size() > 1) {
-        messageBox.setWindowTitle("Are you sure you want to split multiple coins?");
-        QString str = "If you select more than one output, multiple ";
-        str+= "confirmation dialogs will be shown.";
-        messageBox.setText(str);
-        messageBox.setIcon(QMessageBox::Warning);
-        messageBox.setStandardButtons(QMessageBox::Ok | QMessageBox::Cancel);
-        int nRes = messageBox.exec();
-        if (nRes == QMessageBox::Cancel)
-            return;
+        SplitCoinsBatched(selection);
+        return;
     }
 
-    QString strProgress = "Enabling replay protection...\n\n";
-    strProgress += "Moving coins to new replay protected output.\n";
-
     for (int i = 0; i < selection.size(); i++) {
         int nRow = selection[i].row();
 
@@ -352,6 +441,140 @@ void TransactionReplayDialog::on_pushButtonSplitCoins_clicked()
     Update();
 }
 
+void TransactionReplayDialog::SplitCoinsBatched(const QModelIndexList& selection)
+{
+    // A split is already running
+    if (threadCoinSplit.joinable())
+        return;
+
+    QMessageBox messageBox;
+    if (walletModel->getEncryptionStatus() == WalletModel::Locked) {
+        messageBox.setWindowTitle("Wallet locked!");
+        messageBox.setText("Wallet must be unlocked to split coins.");
+        messageBox.exec();
+        return;
+    }
+
+    std::vector<COutPoint> vOutPoint;
+    CAmount nTotal = 0;
+    int nDisplayUnit = walletModel->getOptionsModel()->getDisplayUnit();
+    for (int i = 0; i < selection.size(); i++) {
+        int nRow = selection[i].row();
+
+        QString txid = QVariant(selection[i].sibling(nRow, COLUMN_TXHASH).data()).toString();
+        int index = QVariant(selection[i].sibling(nRow, COLUMN_VOUT_INDEX).data()).toInt();
+
+        // Skip transactions that already have replay protection enabled
+        uint256 hash = uint256S(txid.toStdString());
+        if (walletModel->GetReplayStatus(hash) == REPLAY_SPLIT)
+            continue;
+
+        CAmount amount;
+        QString qAmount = QVariant(selection[i].sibling(nRow, COLUMN_AMOUNT).data()).toString();
+        if (BitcoinUnits::parse(nDisplayUnit, qAmount, &amount))
+            nTotal += amount;
+
+        vOutPoint.push_back(COutPoint(hash, index));
+    }
+    if (vOutPoint.empty())
+        return;
+
+    messageBox.setWindowTitle("Are you sure you want to split multiple coins?");
+    QString str = "The " + QString::number(vOutPoint.size()) + " selected coins, ";
+    str += BitcoinUnits::formatWithUnit(nDisplayUnit, nTotal) + " in total, ";
+    str += "will be moved to new replay protected outputs. The coins are ";
+    str += "combined into as few transactions as possible and the fee is ";
+    str += "paid from the coins.";
+    messageBox.setText(str);
+    messageBox.setIcon(QMessageBox::Warning);
+    messageBox.setStandardButtons(QMessageBox::Ok | QMessageBox::Cancel);
+    if (messageBox.exec() != QMessageBox::Ok)
+        return;
+
+    QString strProgress = "Enabling replay protection...\n\n";
+    strProgress += "Moving coins to new replay protected outputs.\n";
+
+    progressCoinSplit = new QProgressDialog(strProgress, "Abort", 0, vOutPoint.size(), this);
+    progressCoinSplit->setWindowModality(Qt::WindowModal);
+    progressCoinSplit->setWindowTitle("Coin split");
+    progressCoinSplit->setMinimumDuration(0);
+    progressCoinSplit->setMinimumSize(500, 100);
+    progressCoinSplit->setAutoClose(false);
+
+    QFont font;
+    font.setStyleHint(QFont::Monospace);
+    font.setFamily("noto");
+    progressCoinSplit->setFont(font);
+
+    progressCoinSplit->setValue(0);
+    connect(progressCoinSplit, SIGNAL(canceled()), this, SLOT(AbortCoinSplit()));
+
+    ui->pushButtonSplitCoins->setEnabled(false);
+    fAbortCoinSplit = false;
+
+    // Creating and signing the transactions of many coins takes a while, do
+    // it on a background thread. Nothing is broadcast if it is aborted.
+    threadCoinSplit = std::thread([this, vOutPoint]() {
+        std::vector<uint256> vTxid;
+        std::string strFail;
+        bool fSuccess = walletModel->SplitCoins(vOutPoint, vTxid, strFail, [this](size_t nSplit) {
+            QMetaObject::invokeMethod(this, "CoinSplitProgress", Qt::QueuedConnection,
+                                      Q_ARG(int, (int)nSplit));
+            return !fAbortCoinSplit;
+        });
+        QMetaObject::invokeMethod(this, "CoinSplitFinished", Qt::QueuedConnection,
+                                  Q_ARG(bool, fSuccess),
+                                  Q_ARG(QString, QString::fromStdString(strFail)),
+                                  Q_ARG(int, (int)vTxid.size()));
+    });
+}
+
+void TransactionReplayDialog::CoinSplitProgress(int nSplit)
+{
+    if (progressCoinSplit)
+        progressCoinSplit->setValue(nSplit);
+}
+
+void TransactionReplayDialog::CoinSplitFinished(bool fSuccess, QString strFail, int nTx)
+{
+    if (threadCoinSplit.joinable())
+        threadCoinSplit.join();
+
+    if (progressCoinSplit) {
+        progressCoinSplit->deleteLater();
+        progressCoinSplit = nullptr;
+    }
+    ui->pushButtonSplitCoins->setEnabled(true);
+
+    QMessageBox messageBox;
+    if (fSuccess) {
+        messageBox.setWindowTitle("Coins split!");
+        messageBox.setText("Created " + QString::number(nTx) + " replay protected transaction(s).");
+        messageBox.setIcon(QMessageBox::Information);
+    } else {
+        messageBox.setWindowTitle("Coin split failed!");
+        messageBox.setText(strFail);
+        messageBox.setIcon(QMessageBox::Critical);
+    }
+    messageBox.setStandardButtons(QMessageBox::Ok);
+    messageBox.exec();
+
+    // Update the model - replay status may have changed
+    Update();
+}
+
+void TransactionReplayDialog::AbortCoinSplit()
+{
+    fAbortCoinSplit = true;
+}
+
+void TransactionReplayDialog::StopCoinSplit()
+{
+    fAbortCoinSplit = true;
+    if (threadCoinSplit.joinable())
+        threadCoinSplit.join();
+}
+
 QIcon TransactionReplayDialog::GetReplayIcon(int nReplayStatus) const
 {
     switch (nReplayStatus) {
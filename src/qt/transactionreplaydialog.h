@@ -7,11 +7,18 @@
 
 #include <QDialog>
 
+#include <atomic>
+#include <thread>
+
 class ClientModel;
 class CoinSplitConfirmationDialog;
 class PlatformStyle;
 class WalletModel;
 
+QT_BEGIN_NAMESPACE
+class QProgressDialog;
+QT_END_NAMESPACE
+
 enum
 {
     COLUMN_REPLAY = 0,
@@ -44,6 +51,15 @@ private Q_SLOTS:
     void on_pushButtonSplitCoins_clicked();
     void Update();
 
+    /** Store a result from the replay check thread and show it */
+    void ReplayStatusReceived(QString txid, int nReplayStatus);
+    void ReplayCheckFinished(bool fConnected);
+    void AbortReplayCheck();
+
+    void CoinSplitProgress(int nSplit);
+    void CoinSplitFinished(bool fSuccess, QString strFail, int nTx);
+    void AbortCoinSplit();
+
 private:
     Ui::TransactionReplayDialog *ui;
 
@@ -54,6 +70,24 @@ private:
 
     CoinSplitConfirmationDialog* coinSplitConfirmationDialog;
 
+    // Replay status lookups run on this thread so the GUI stays responsive,
+    // results are passed back with queued ReplayStatusReceived calls
+    std::thread threadReplayCheck;
+    std::atomic<bool> fAbortReplayCheck;
+    QProgressDialog* progressReplayCheck = nullptr;
+    int nReplayChecked = 0;
+
+    // Splits of more than one coin are created and signed on this thread
+    std::thread threadCoinSplit;
+    std::atomic<bool> fAbortCoinSplit;
+    QProgressDialog* progressCoinSplit = nullptr;
+
+    void StopReplayCheck();
+    void StopCoinSplit();
+
+    /** Split all of the coins in a few large transactions */
+    void SplitCoinsBatched(const QModelIndexList& selection);
+
     QIcon GetReplayIcon(int nReplayStatus) const;
 
     void showEvent(QShowEvent* event);
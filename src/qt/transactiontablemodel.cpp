@@ -25,11 +25,23 @@
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QTimer>
+
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include <boost/bind/placeholders.hpp>
 
 using namespace boost::placeholders;
 
+// Number of wallet transactions decomposed per pass of the event loop while
+// the model is loading
+static const int TRANSACTION_LOAD_CHUNK = 1000;
+// Number of transactions added or removed in one batch of notifications
+// above which the model is reset instead of updated row by row
+static const int TRANSACTION_BATCH_RESET = 64;
+
 static int column_alignments[] = {
         Qt::AlignHCenter|Qt::AlignVCenter, /* # Confs */
         Qt::AlignLeft|Qt::AlignVCenter, /* date */
@@ -54,13 +66,34 @@ struct TxLessThan
     }
 };
 
+// A change of a wallet transaction, queued until the model processes it
+struct TransactionNotification
+{
+public:
+    TransactionNotification() {}
+    TransactionNotification(uint256 _hash, ChangeType _status, bool _showTransaction):
+        hash(_hash), status(_status), showTransaction(_showTransaction) {}
+
+    void invoke(TransactionTableModel *ttm)
+    {
+        qDebug() << "NotifyTransactionChanged: " + QString::fromStdString(hash.GetHex()) + " status= " + QString::number(status);
+        ttm->queueTransactionChanged(hash, status, showTransaction);
+    }
+
+    uint256 hash;
+    ChangeType status;
+    bool showTransaction;
+};
+
 // Private implementation
 class TransactionTablePriv
 {
 public:
     TransactionTablePriv(CWallet *_wallet, TransactionTableModel *_parent) :
         wallet(_wallet),
-        parent(_parent)
+        parent(_parent),
+        fLoading(false),
+        nNumBlocks(-1)
     {
     }
 
@@ -73,20 +106,124 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* While loading, only the transactions with a hash below hashLoadNext
+     * are in the cache. Notifications of the others are ignored, as they are
+     * read from the wallet when the load gets to them.
+     */
+    bool fLoading;
+    uint256 hashLoadNext;
+
+    /* Height of the tip the confirmations are shown for */
+    int nNumBlocks;
+
+    /* Notifications from the wallet, processed in one batch */
+    std::mutex cs_notifications;
+    std::vector<TransactionNotification> vNotifications;
+
+    /* Query entire wallet anew from core, a chunk at a time by loadChunk.
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        hashLoadNext.SetNull();
+        fLoading = true;
+        loadChunk(TRANSACTION_LOAD_CHUNK);
+    }
+
+    /* Decompose the next nCount wallet transactions into the cache. Return
+     * true if there are more to load.
+     */
+    bool loadChunk(int nCount)
+    {
+        if (!fLoading)
+            return false;
+
+        QList<TransactionRecord> toInsert;
+        bool fDone;
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            for (const auto& entry : wallet->mapWallet)
+            nNumBlocks = chainActive.Height();
+
+            auto it = wallet->mapWallet.lower_bound(hashLoadNext);
+            for (; it != wallet->mapWallet.end() && nCount > 0; ++it, --nCount)
             {
-                if (TransactionRecord::showTransaction(entry.second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, entry.second));
+                if (TransactionRecord::showTransaction(it->second))
+                    toInsert.append(TransactionRecord::decomposeTransaction(wallet, it->second));
             }
+            fDone = it == wallet->mapWallet.end();
+            if (!fDone)
+                hashLoadNext = it->first;
         }
+
+        // Still loading while the rows are inserted, they aren't new
+        // transactions to notify about
+        if (!toInsert.isEmpty())
+        {
+            parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size() + toInsert.size() - 1);
+            cachedWallet.append(toInsert);
+            parent->endInsertRows();
+        }
+        fLoading = !fDone;
+        return fLoading;
+    }
+
+    bool isLoaded(const uint256 &hash) const
+    {
+        return !fLoading || hash < hashLoadNext;
+    }
+
+    /* Queue a notification, return true if it is the first of a batch */
+    bool queueNotification(const TransactionNotification &notification)
+    {
+        std::lock_guard<std::mutex> lock(cs_notifications);
+        vNotifications.push_back(notification);
+        return vNotifications.size() == 1;
+    }
+
+    /* Apply the queued notifications as one update of the model */
+    void processNotifications()
+    {
+        std::vector<TransactionNotification> vBatch;
+        {
+            std::lock_guard<std::mutex> lock(cs_notifications);
+            vBatch.swap(vNotifications);
+        }
+
+        // The last notification of a transaction has its current state
+        std::map<uint256, TransactionNotification> mapLast;
+        for (const TransactionNotification &notification : vBatch)
+            mapLast[notification.hash] = notification;
+
+        int nAddRemove = 0;
+        for (const auto &item : mapLast)
+        {
+            if (item.second.status != CT_UPDATED || item.second.showTransaction != isInModel(item.first))
+                nAddRemove++;
+        }
+
+        const bool fReset = nAddRemove > TRANSACTION_BATCH_RESET;
+        if (fReset)
+            parent->beginResetModel();
+        for (const auto &item : mapLast)
+            updateWallet(item.first, item.second.status, item.second.showTransaction, !fReset);
+        if (fReset)
+        {
+            parent->endResetModel();
+        }
+        else if (!cachedWallet.isEmpty() && nAddRemove < (int)mapLast.size())
+        {
+            // The updated rows have needsUpdate set, one signal is enough
+            // for the view to ask for the visible ones again
+            Q_EMIT parent->dataChanged(parent->index(0, TransactionTableModel::Status), parent->index(cachedWallet.size() - 1, TransactionTableModel::Status));
+        }
+    }
+
+    bool isInModel(const uint256 &hash)
+    {
+        QList<TransactionRecord>::iterator lower = qLowerBound(
+            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
+        return lower != cachedWallet.end() && lower->hash == hash;
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -94,10 +231,13 @@ public:
 
        Call with transaction that was added, removed or changed.
      */
-    void updateWallet(const uint256 &hash, int status, bool showTransaction)
+    void updateWallet(const uint256 &hash, int status, bool showTransaction, bool fNotify = true)
     {
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
+        if (!isLoaded(hash))
+            return;
+
         // Find bounds of this transaction in model
         QList<TransactionRecord>::iterator lower = qLowerBound(
             cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
@@ -142,14 +282,16 @@ public:
                         TransactionRecord::decomposeTransaction(wallet, mi->second);
                 if(!toInsert.isEmpty()) /* only if something to insert */
                 {
-                    parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex+toInsert.size()-1);
+                    if (fNotify)
+                        parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex+toInsert.size()-1);
                     int insert_idx = lowerIndex;
                     for (const TransactionRecord &rec : toInsert)
                     {
                         cachedWallet.insert(insert_idx, rec);
                         insert_idx += 1;
                     }
-                    parent->endInsertRows();
+                    if (fNotify)
+                        parent->endInsertRows();
                 }
             }
             break;
@@ -160,9 +302,11 @@ public:
                 break;
             }
             // Removed -- remove entire transaction from table
-            parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
+            if (fNotify)
+                parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
             cachedWallet.erase(lower, upper);
-            parent->endRemoveRows();
+            if (fNotify)
+                parent->endRemoveRows();
             break;
         case CT_UPDATED:
             // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
@@ -206,6 +350,13 @@ public:
         {
             TransactionRecord *rec = &cachedWallet[idx];
 
+            // Nothing changed since the status was last updated, or only the
+            // height of the tip, which the depth follows without any lock
+            if (!rec->status.needsUpdate && rec->status.cur_num_blocks == nNumBlocks)
+                return rec;
+            if (rec->updateDepth(nNumBlocks))
+                return rec;
+
             // Get required locks upfront. This avoids the GUI from getting
             // stuck if the core is holding the locks for a longer time - for
             // example, during a wallet rescan.
@@ -268,6 +419,8 @@ TransactionTableModel::TransactionTableModel(const PlatformStyle *_platformStyle
 {
     columns << tr("Conf") << tr("Date") << tr("TxID") << BitcoinUnits::getAmountColumnTitle(walletModel->getOptionsModel()->getDisplayUnit()) << QString();
     priv->refreshWallet();
+    if (priv->fLoading)
+        QTimer::singleShot(0, this, SLOT(loadWalletChunk()));
 
     connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
 
@@ -295,6 +448,31 @@ void TransactionTableModel::updateTransaction(const QString &hash, int status, b
     priv->updateWallet(updated, status, showTransaction);
 }
 
+void TransactionTableModel::queueTransactionChanged(const uint256 &hash, int status, bool showTransaction)
+{
+    // The first notification of a batch schedules it, the ones that come
+    // before it is processed join it
+    if (priv->queueNotification(TransactionNotification(hash, (ChangeType)status, showTransaction)))
+        QMetaObject::invokeMethod(this, "processQueuedNotifications", Qt::QueuedConnection);
+}
+
+void TransactionTableModel::processQueuedNotifications()
+{
+    priv->processNotifications();
+}
+
+void TransactionTableModel::loadWalletChunk()
+{
+    if (priv->loadChunk(TRANSACTION_LOAD_CHUNK))
+        QTimer::singleShot(0, this, SLOT(loadWalletChunk()));
+}
+
+bool TransactionTableModel::processingQueuedTransactions() const
+{
+    // The rows of a wallet being loaded aren't new transactions either
+    return fProcessingQueuedTransactions || priv->fLoading;
+}
+
 void TransactionTableModel::updateReplayStatus(const QString &hash, int replayStatus)
 {
     if (replayStatus != TransactionStatus::ReplayUnknown &&
@@ -309,8 +487,10 @@ void TransactionTableModel::updateReplayStatus(const QString &hash, int replaySt
     priv->updateWalletReplayStatus(updated, replayStatus);
 }
 
-void TransactionTableModel::updateConfirmations()
+void TransactionTableModel::updateConfirmations(int nNumBlocks)
 {
+    priv->nNumBlocks = nNumBlocks;
+
     // Blocks came in since last poll.
     // Invalidate status (number of confirmations) and (possibly) description
     //  for all rows. Qt is smart enough to only actually request the data for the
@@ -793,29 +973,6 @@ void TransactionTableModel::updateDisplayUnit()
     Q_EMIT dataChanged(index(0, Amount), index(priv->size()-1, Amount));
 }
 
-// queue notifications to show a non freezing progress dialog e.g. for rescan
-struct TransactionNotification
-{
-public:
-    TransactionNotification() {}
-    TransactionNotification(uint256 _hash, ChangeType _status, bool _showTransaction):
-        hash(_hash), status(_status), showTransaction(_showTransaction) {}
-
-    void invoke(QObject *ttm)
-    {
-        QString strHash = QString::fromStdString(hash.GetHex());
-        qDebug() << "NotifyTransactionChanged: " + strHash + " status= " + QString::number(status);
-        QMetaObject::invokeMethod(ttm, "updateTransaction", Qt::QueuedConnection,
-                                  Q_ARG(QString, strHash),
-                                  Q_ARG(int, status),
-                                  Q_ARG(bool, showTransaction));
-    }
-private:
-    uint256 hash;
-    ChangeType status;
-    bool showTransaction;
-};
-
 static bool fQueueNotifications = false;
 static std::vector< TransactionNotification > vQueueNotifications;
 
@@ -15,6 +15,8 @@ class TransactionRecord;
 class TransactionTablePriv;
 class WalletModel;
 
+class uint256;
+
 class CWallet;
 
 /** UI model for the transaction table of a wallet.
@@ -86,7 +88,11 @@ public:
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     QModelIndex index(int row, int column, const QModelIndex & parent = QModelIndex()) const;
-    bool processingQueuedTransactions() const { return fProcessingQueuedTransactions; }
+    bool processingQueuedTransactions() const;
+
+    /** Queue a change of a wallet transaction, from any thread. The changes
+        queued until the model gets to them are applied as one update. */
+    void queueTransactionChanged(const uint256 &hash, int status, bool showTransaction);
 
 private:
     CWallet* wallet;
@@ -116,12 +122,14 @@ public Q_SLOTS:
     /* New transaction, or transaction changed status */
     void updateTransaction(const QString &hash, int status, bool showTransaction);
     void updateReplayStatus(const QString &hash, int replayStatus);
-    void updateConfirmations();
+    void updateConfirmations(int nNumBlocks);
     void updateDisplayUnit();
     /** Updates the column title to "Amount (DisplayUnit)" and emits headerDataChanged() signal for table headers to react. */
     void updateAmountColumnTitle();
     /* Needed to update fProcessingQueuedTransactions through a QueuedConnection */
     void setProcessingQueuedTransactions(bool value) { fProcessingQueuedTransactions = value; }
+    void processQueuedNotifications();
+    void loadWalletChunk();
 
     friend class TransactionTablePriv;
 };
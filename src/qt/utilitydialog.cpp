@@ -84,6 +84,7 @@ HelpMessageDialog::HelpMessageDialog(QWidget *parent, bool about) :
             strUsage += HelpMessageOpt("-allowselfsignedrootcertificates", strprintf("Allow self signed root certificates (default: %u)", DEFAULT_SELFSIGNED_ROOTCERTS));
         }
         strUsage += HelpMessageOpt("-choosedatadir", strprintf(tr("Choose data directory on startup (default: %u)").toStdString(), DEFAULT_CHOOSE_DATADIR));
+        strUsage += HelpMessageOpt("-guichainupdateinterval=<n>", strprintf(tr("Update the drivechain pages at most every <n> milliseconds when blocks arrive (default: %u)").toStdString(), DEFAULT_GUI_CHAIN_UPDATE_INTERVAL));
         strUsage += HelpMessageOpt("-lang=<lang>", tr("Set language, for example \"de_DE\" (default: system locale)").toStdString());
         strUsage += HelpMessageOpt("-min", tr("Start minimized").toStdString());
         strUsage += HelpMessageOpt("-resetguisettings", tr("Reset all settings changed in the GUI").toStdString());
@@ -137,7 +137,7 @@ void WalletModel::pollBalanceChanged()
 
         checkBalanceChanged();
         if(transactionTableModel)
-            transactionTableModel->updateConfirmations();
+            transactionTableModel->updateConfirmations(cachedNumBlocks);
     }
 }
 
@@ -755,3 +755,8 @@ void WalletModel::UpdateReplayStatus(const uint256& txid, const int nReplayStatu
     LOCK2(cs_main, wallet->cs_wallet);
     wallet->UpdateReplayStatus(txid, nReplayStatus);
 }
+
+bool WalletModel::SplitCoins(const std::vector<COutPoint>& vOutPoint, std::vector<uint256>& vTxidRet, std::string& strFail, const std::function<bool(size_t)>& fnProgress)
+{
+    return wallet->SplitCoins(vOutPoint, g_connman.get(), vTxidRet, strFail, fnProgress);
+}
@@ -10,7 +10,9 @@
 
 #include <support/allocators/secure.h>
 
+#include <functional>
 #include <map>
+#include <string>
 #include <vector>
 
 #include <QObject>
@@ -225,6 +227,10 @@ public:
 
     void UpdateReplayStatus(const uint256& txid, const int nReplayStatus);
 
+    /** Split coins to replay protected outputs, see CWallet::SplitCoins.
+     * Takes the wallet locks itself, may be called off the GUI thread. */
+    bool SplitCoins(const std::vector<COutPoint>& vOutPoint, std::vector<uint256>& vTxidRet, std::string& strFail, const std::function<bool(size_t)>& fnProgress);
+
 private:
     CWallet *wallet;
     bool fHaveWatchOnly;
@@ -3,26 +3,36 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <core_io.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <validation.h>
+#include <httprpc.h>
 #include <httpserver.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
 #include <streams.h>
 #include <sync.h>
+#include <opreturnindex.h>
+#include <txdb.h>
 #include <txmempool.h>
+#include <utilmoneystr.h>
 #include <utilstrencodings.h>
 #include <version.h>
 
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const uint32_t REST_DEPOSIT_PAGE_SIZE = 100; //deposits read from disk at a time
 
 enum RetFormat {
     RF_UNDEF,
@@ -121,6 +131,84 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+/** Remove the query string from strReq and return it */
+static std::string SplitQueryString(std::string& strReq)
+{
+    const std::string::size_type pos = strReq.find('?');
+    if (pos == std::string::npos)
+        return "";
+
+    const std::string strQuery = strReq.substr(pos + 1);
+    strReq.erase(pos);
+    return strQuery;
+}
+
+static bool GetQueryParameter(const std::string& strQuery, const std::string& key, std::string& value)
+{
+    std::vector<std::string> params;
+    boost::split(params, strQuery, boost::is_any_of("&"));
+    for (const std::string& param : params) {
+        const std::string::size_type pos = param.find('=');
+        if (param.substr(0, pos) != key)
+            continue;
+        value = pos == std::string::npos ? "" : urlDecode(param.substr(pos + 1));
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Set the ETag of a response that only depends on the block hashBlock, so
+ * that a cache in front of the node can revalidate it. Data of a specific
+ * block never changes and may be cached indefinitely, data of the chain tip
+ * has to be revalidated on every request. Returns true if the client already
+ * has the current version, in which case 304 has been sent.
+ */
+static bool CheckETag(HTTPRequest* req, const uint256& hashBlock, bool fImmutable)
+{
+    const std::string strETag = "\"" + hashBlock.GetHex() + "\"";
+    req->WriteHeader("ETag", strETag);
+    req->WriteHeader("Cache-Control", fImmutable ? "public, max-age=31536000, immutable" : "no-cache");
+
+    std::pair<bool, std::string> ifNoneMatch = req->GetHeader("if-none-match");
+    if (ifNoneMatch.first && (ifNoneMatch.second == "*" || ifNoneMatch.second.find(strETag) != std::string::npos)) {
+        req->WriteReply(HTTP_NOT_MODIFIED);
+        return true;
+    }
+    return false;
+}
+
+/** Reply with ssData in binary or hex, or with json */
+static bool WriteRESTData(HTTPRequest* req, RetFormat rf, const CDataStream& ssData, const UniValue& json)
+{
+    switch (rf) {
+    case RF_BINARY: {
+        std::string binaryData = ssData.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryData);
+        return true;
+    }
+
+    case RF_HEX: {
+        std::string strHex = HexStr(ssData.data(), ssData.data() + ssData.size()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        std::string strJSON = json.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -171,7 +259,7 @@ static bool rest_headers(HTTPRequest* req,
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        std::string strHex = HexStr(ssHeader.data(), ssHeader.data() + ssHeader.size()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -208,7 +296,7 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
+    std::shared_ptr<const CBlock> pblock;
     CBlockIndex* pblockindex = nullptr;
     {
         LOCK(cs_main);
@@ -219,9 +307,11 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        pblock = ReadBlockCached(pblockindex, Params().GetConsensus());
+        if (!pblock)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
+    const CBlock& block = *pblock;
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssBlock << block;
@@ -235,7 +325,7 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -247,9 +337,7 @@ static bool rest_block(HTTPRequest* req,
             LOCK(cs_main);
             objBlock = blockToJSON(block, pblockindex, showTxDetails);
         }
-        std::string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPWriteJSONReply(req, objBlock);
         return true;
     }
 
@@ -328,9 +416,7 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
     case RF_JSON: {
         UniValue mempoolObject = mempoolToJSON(true);
 
-        std::string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        HTTPWriteJSONReply(req, mempoolObject);
         return true;
     }
     default: {
@@ -367,7 +453,7 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssTx.begin(), ssTx.end()) + "\n";
+        std::string strHex = HexStr(ssTx.data(), ssTx.data() + ssTx.size()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -528,7 +614,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     case RF_HEX: {
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
         ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
-        std::string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
+        std::string strHex = HexStr(ssGetUTXOResponse.data(), ssGetUTXOResponse.data() + ssGetUTXOResponse.size()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
@@ -570,6 +656,367 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     }
 }
 
+static UniValue DepositToJSON(const SidechainDeposit& d)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("nsidechain", d.nSidechain));
+    obj.push_back(Pair("strdest", d.strDest));
+    obj.push_back(Pair("txhex", EncodeHexTx(*d.tx)));
+    obj.push_back(Pair("nburnindex", (int)d.nBurnIndex));
+    obj.push_back(Pair("ntx", (int)d.nTx));
+    obj.push_back(Pair("hashblock", d.hashBlock.ToString()));
+    return obj;
+}
+
+static UniValue WithdrawalStateToJSON(const std::vector<std::vector<SidechainWithdrawalState>>& vState)
+{
+    UniValue arr(UniValue::VARR);
+    for (const std::vector<SidechainWithdrawalState>& vSidechainState : vState) {
+        for (const SidechainWithdrawalState& s : vSidechainState) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("nsidechain", s.nSidechain));
+            obj.push_back(Pair("nblocksleft", s.nBlocksLeft));
+            obj.push_back(Pair("nworkscore", s.nWorkScore));
+            obj.push_back(Pair("withdrawalbundle", s.hash.ToString()));
+            arr.push_back(obj);
+        }
+    }
+    return arr;
+}
+
+static UniValue SidechainToJSON(const Sidechain& sidechain)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("title", sidechain.title));
+    obj.push_back(Pair("description", sidechain.description));
+    obj.push_back(Pair("nversion", sidechain.nVersion));
+    obj.push_back(Pair("hashid1", sidechain.hashID1.ToString()));
+    obj.push_back(Pair("hashid2", sidechain.hashID2.ToString()));
+    obj.push_back(Pair("nsidechain", sidechain.nSidechain));
+    obj.push_back(Pair("active", sidechain.fActive));
+    return obj;
+}
+
+static bool ParseSidechainNumber(const std::string& str, uint8_t& nSidechain)
+{
+    int32_t n;
+    if (!ParseInt32(str, &n) || n < 0 || n > 255)
+        return false;
+    nSidechain = n;
+    return true;
+}
+
+static bool rest_sidechain(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string strURI = strURIPart;
+    const std::string strQuery = SplitQueryString(strURI);
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURI);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/sidechain/<n>/ctip.<ext> or /rest/sidechain/<n>/deposits.<ext>?since=<height>&dest=<address>.");
+
+    uint8_t nSidechain;
+    if (!ParseSidechainNumber(path[0], nSidechain))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid sidechain number: " + path[0]);
+
+    if (path[1] == "ctip") {
+        SidechainCTIP ctip;
+        {
+            LOCK(cs_main);
+            if (!scdb.IsSidechainActive(nSidechain))
+                return RESTERR(req, HTTP_NOT_FOUND, "Sidechain " + path[0] + " not active");
+            if (!scdb.GetCTIP(nSidechain, ctip))
+                return RESTERR(req, HTTP_NOT_FOUND, "No CTIP found for sidechain " + path[0]);
+            if (CheckETag(req, chainActive.Tip()->GetBlockHash(), false))
+                return true;
+        }
+
+        CDataStream ssCTIP(SER_NETWORK, PROTOCOL_VERSION);
+        ssCTIP << ctip;
+
+        UniValue objCTIP(UniValue::VOBJ);
+        if (rf == RF_JSON) {
+            objCTIP.push_back(Pair("txid", ctip.out.hash.ToString()));
+            objCTIP.push_back(Pair("n", (int64_t)ctip.out.n));
+            objCTIP.push_back(Pair("amount", ctip.amount));
+            objCTIP.push_back(Pair("amountformatted", FormatMoney(ctip.amount)));
+        }
+        return WriteRESTData(req, rf, ssCTIP, objCTIP);
+    }
+
+    if (path[1] != "deposits")
+        return RESTERR(req, HTTP_NOT_FOUND, "Unknown sidechain resource: " + path[1]);
+
+    int32_t nSinceHeight = 0;
+    std::string strSince;
+    if (GetQueryParameter(strQuery, "since", strSince) && (!ParseInt32(strSince, &nSinceHeight) || nSinceHeight < 0))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid since height: " + strSince);
+
+    // Deposits to one destination only, matched by key
+    std::string strDest;
+    uint160 destKey;
+    const bool fDest = GetQueryParameter(strQuery, "dest", strDest);
+    if (fDest) {
+        unsigned int nSidechainFromAddress = nSidechain;
+        destKey = ParseDepositDestKey(strDest, nSidechainFromAddress);
+        if (nSidechainFromAddress != (unsigned int)nSidechain)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Deposit address is for another sidechain: " + strDest);
+    }
+
+    // Read deposits from newest to oldest one page at a time, so that we stop
+    // reading from disk once we reach a deposit older than nSinceHeight. The
+    // lock keeps the deposits consistent with the tip used as ETag.
+    std::vector<SidechainDeposit> vResult;
+    {
+        LOCK(cs_main);
+        if (!scdb.IsSidechainActive(nSidechain))
+            return RESTERR(req, HTTP_NOT_FOUND, "Sidechain " + path[0] + " not active");
+        if (CheckETag(req, chainActive.Tip()->GetBlockHash(), false))
+            return true;
+
+        bool fDone = false;
+        uint32_t nEnd = scdb.GetDepositCount(nSidechain);
+        while (nEnd > 0 && !fDone) {
+            const uint32_t nStart = nEnd > REST_DEPOSIT_PAGE_SIZE ? nEnd - REST_DEPOSIT_PAGE_SIZE : 0;
+            std::vector<SidechainDeposit> vDeposit = scdb.GetDeposits(nSidechain, nStart, nEnd - nStart);
+            if (vDeposit.size() != nEnd - nStart)
+                return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read deposits");
+            nEnd = nStart;
+
+            for (auto rit = vDeposit.rbegin(); rit != vDeposit.rend(); rit++) {
+                BlockMap::const_iterator it = mapBlockIndex.find(rit->hashBlock);
+                if (it == mapBlockIndex.end() || !chainActive.Contains(it->second))
+                    return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Deposit block not in active chain");
+
+                // Deposits are in chain order, the rest are older
+                if (it->second->nHeight < nSinceHeight) {
+                    fDone = true;
+                    break;
+                }
+                if (fDest && !rit->HasDest(destKey))
+                    continue;
+                vResult.push_back(std::move(*rit));
+            }
+        }
+    }
+    std::reverse(vResult.begin(), vResult.end());
+
+    CDataStream ssDeposits(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ssDeposits << vResult;
+
+    UniValue arrDeposits(UniValue::VARR);
+    if (rf == RF_JSON) {
+        for (const SidechainDeposit& d : vResult)
+            arrDeposits.push_back(DepositToJSON(d));
+    }
+    return WriteRESTData(req, rf, ssDeposits, arrDeposits);
+}
+
+static bool rest_scdb(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    if (param == "state") {
+        uint256 hashTip;
+        std::vector<Sidechain> vActive;
+        std::vector<std::vector<SidechainWithdrawalState>> vState;
+        {
+            LOCK(cs_main);
+            hashTip = chainActive.Tip()->GetBlockHash();
+            if (CheckETag(req, hashTip, false))
+                return true;
+            vActive = scdb.GetActiveSidechains();
+            vState = scdb.GetState();
+        }
+
+        CDataStream ssState(SER_NETWORK, PROTOCOL_VERSION);
+        ssState << hashTip << vActive << vState;
+
+        UniValue objState(UniValue::VOBJ);
+        if (rf == RF_JSON) {
+            UniValue arrActive(UniValue::VARR);
+            for (const Sidechain& s : vActive)
+                arrActive.push_back(SidechainToJSON(s));
+            objState.push_back(Pair("hashblock", hashTip.GetHex()));
+            objState.push_back(Pair("sidechains", arrActive));
+            objState.push_back(Pair("withdrawalstatus", WithdrawalStateToJSON(vState)));
+        }
+        return WriteRESTData(req, rf, ssState, objState);
+    }
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2 || path[0] != "block")
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/scdb/state.<ext> or /rest/scdb/block/<hash>.<ext>.");
+
+    uint256 hash;
+    if (!ParseHashStr(path[1], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[1]);
+
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            return RESTERR(req, HTTP_NOT_FOUND, path[1] + " not found");
+    }
+    SidechainBlockData data;
+    if (!psidechaintree->GetBlockData(hash, data))
+        return RESTERR(req, HTTP_NOT_FOUND, "No SCDB data for block " + path[1]);
+
+    if (CheckETag(req, hash, true))
+        return true;
+
+    CDataStream ssData(SER_DISK, CLIENT_VERSION);
+    ssData << data;
+
+    UniValue objData(UniValue::VOBJ);
+    if (rf == RF_JSON) {
+        UniValue arrSpent(UniValue::VARR);
+        for (const SidechainSpentWithdrawal& s : data.vSpent) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("nsidechain", s.nSidechain));
+            obj.push_back(Pair("hash", s.hash.ToString()));
+            obj.push_back(Pair("hashblock", s.hashBlock.ToString()));
+            arrSpent.push_back(obj);
+        }
+        UniValue arrActivation(UniValue::VARR);
+        for (const SidechainActivationStatus& s : data.vActivationStatus) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("nage", s.nAge));
+            obj.push_back(Pair("nfail", s.nFail));
+            obj.push_back(Pair("proposal", SidechainToJSON(s.proposal)));
+            arrActivation.push_back(obj);
+        }
+        UniValue arrSidechain(UniValue::VARR);
+        for (const Sidechain& s : data.vSidechain)
+            arrSidechain.push_back(SidechainToJSON(s));
+
+        objData.push_back(Pair("hashblock", hash.GetHex()));
+        objData.push_back(Pair("withdrawalstatus", WithdrawalStateToJSON(data.vWithdrawalStatus)));
+        objData.push_back(Pair("spentwithdrawals", arrSpent));
+        objData.push_back(Pair("activationstatus", arrActivation));
+        objData.push_back(Pair("sidechains", arrSidechain));
+    }
+    return WriteRESTData(req, rf, ssData, objData);
+}
+
+static bool rest_bmm(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
+        CBlockIndex* pblockindex = mapBlockIndex[hash];
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+
+        if (CheckETag(req, hash, true))
+            return true;
+
+        pblock = ReadBlockCached(pblockindex, Params().GetConsensus());
+        if (!pblock || pblock->vtx.empty())
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    }
+    const CBlock& block = *pblock;
+
+    const uint256 txidCoinbase = block.vtx[0]->GetHash();
+    std::vector<std::pair<uint8_t, uint256>> vCommit;
+    GetBMMCommits(block, vCommit);
+
+    CDataStream ssBMM(SER_NETWORK, PROTOCOL_VERSION);
+    ssBMM << txidCoinbase << vCommit;
+
+    UniValue objBMM(UniValue::VOBJ);
+    if (rf == RF_JSON) {
+        UniValue arrCommit(UniValue::VARR);
+        for (const std::pair<uint8_t, uint256>& commit : vCommit) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("nsidechain", commit.first));
+            obj.push_back(Pair("hashbmm", commit.second.ToString()));
+            arrCommit.push_back(obj);
+        }
+        objBMM.push_back(Pair("hashblock", hash.GetHex()));
+        objBMM.push_back(Pair("txidcoinbase", txidCoinbase.GetHex()));
+        objBMM.push_back(Pair("commits", arrCommit));
+    }
+    return WriteRESTData(req, rf, ssBMM, objBMM);
+}
+
+static bool rest_newsblocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/newsblocks/<startheight>/<endheight>/<header>[-<header>...].<ext>.");
+
+    int32_t nStartHeight, nEndHeight;
+    if (!ParseInt32(path[0], &nStartHeight) || !ParseInt32(path[1], &nEndHeight) ||
+            nStartHeight < 0 || nEndHeight < nStartHeight)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height range: " + path[0] + "/" + path[1]);
+    if (nEndHeight - nStartHeight >= MAX_NEWS_BLOCKS_SCAN)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Height range too large, at most %d blocks", MAX_NEWS_BLOCKS_SCAN));
+
+    std::vector<std::string> vStrHeader;
+    boost::split(vStrHeader, path[2], boost::is_any_of("-"));
+    std::vector<CScript> vHeader;
+    for (const std::string& strHeader : vStrHeader) {
+        std::vector<unsigned char> vch = ParseHex(strHeader);
+        if (!IsHex(strHeader) || vch.size() < 4)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid header: " + strHeader);
+        vHeader.push_back(CScript(vch.begin(), vch.end()));
+    }
+
+    std::vector<const CBlockIndex*> vBlock;
+    FindNewsBlocks(vHeader, nStartHeight, nEndHeight, vBlock);
+
+    std::vector<uint256> vHash;
+    UniValue arrBlock(UniValue::VARR);
+    for (const CBlockIndex* pindex : vBlock) {
+        vHash.push_back(pindex->GetBlockHash());
+        if (rf == RF_JSON) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("height", pindex->nHeight));
+            obj.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+            obj.push_back(Pair("time", pindex->GetBlockTime()));
+            arrBlock.push_back(obj);
+        }
+    }
+
+    CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlocks << vHash;
+
+    return WriteRESTData(req, rf, ssBlocks, arrBlock);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -582,6 +1029,10 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/sidechain/", rest_sidechain},
+      {"/rest/scdb/", rest_scdb},
+      {"/rest/bmm/", rest_bmm},
+      {"/rest/newsblocks/", rest_newsblocks},
 };
 
 bool StartREST()
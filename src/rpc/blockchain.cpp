@@ -5,14 +5,19 @@
 
 #include <rpc/blockchain.h>
 
+#include <addressindex.h>
 #include <amount.h>
+#include <blockcache.h>
+#include <blockfilterindex.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinstatsindex.h>
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
+#include <opreturnindex.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
@@ -20,6 +25,7 @@
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
+#include <txindex.h>
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
@@ -706,13 +712,77 @@ UniValue getblockheader(const JSONRPCRequest& request)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << pblockindex->GetBlockHeader();
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        std::string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size());
         return strHex;
     }
 
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block. Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\",  (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(block_hash);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = it->second;
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        std::string errmsg = "Filter not found.";
+        if (!index->IsSynced()) {
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+        throw JSONRPCError(RPC_MISC_ERROR, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", filter_header.GetHex()));
+    return ret;
+}
+
 UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -779,25 +849,26 @@ UniValue getblock(const JSONRPCRequest& request)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    std::shared_ptr<const CBlock> pblock = ReadBlockCached(pblockindex, Params().GetConsensus());
+    if (!pblock)
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
         // blocks, we add the headers to our index, but don't accept the
         // block).
         throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    const CBlock& block = *pblock;
 
     if (verbosity <= 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        std::string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size());
         return strHex;
     }
 
@@ -814,6 +885,7 @@ struct CCoinsStats
     uint256 hashSerialized;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
+    std::map<uint8_t, CAmount> mapEscrow;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
 };
@@ -830,19 +902,27 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
         ss << VARINT(output.second.out.nValue);
         stats.nTransactionOutputs++;
         stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
+        stats.nBogoSize += GetBogoSize(output.second.out.scriptPubKey);
     }
     ss << VARINT(0);
 }
 
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static void ApplyEscrowStats(CCoinsStats& stats, const Coin& coin)
+{
+    uint8_t nSidechain;
+    if (coin.out.scriptPubKey.IsDrivechain(nSidechain))
+        stats.mapEscrow[nSidechain] += coin.out.nValue;
+}
+
+//! Calculate statistics about the unspent transaction output set, hashing it
+//! with MuHash3072 instead of the serialized hash if fMuHash
+static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats, bool fMuHash)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
     assert(pcursor);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
@@ -860,6 +940,9 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
                 ApplyStats(stats, ss, prevkey, outputs);
                 outputs.clear();
             }
+            if (fMuHash)
+                ApplyCoinHash(muhash, key, coin);
+            ApplyEscrowStats(stats, coin);
             prevkey = key.hash;
             outputs[key.n] = std::move(coin);
         } else {
@@ -870,7 +953,10 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
     if (!outputs.empty()) {
         ApplyStats(stats, ss, prevkey, outputs);
     }
-    stats.hashSerialized = ss.GetHash();
+    if (fMuHash)
+        muhash.Finalize(stats.hashSerialized);
+    else
+        stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
@@ -926,43 +1012,89 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless the coin stats index is enabled (-coinstatsindex) and\n"
+            "hash_type is muhash or none.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=hash_serialized_2) Which UTXO set hash to compute:\n"
+            "                   hash_serialized_2, muhash or none\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, not given by the coin stats index\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, if hash_type is hash_serialized_2\n"
+            "  \"muhash\": \"hash\",     (string) The MuHash3072 of the coins, if hash_type is muhash\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount\n"
+            "  \"escrow_amounts\": [      (array) The amount held in the escrow of each sidechain\n"
+            "    {\n"
+            "      \"nsidechain\": n,     (numeric) The sidechain number\n"
+            "      \"amount\": x.xxx      (numeric) The amount in escrow\n"
+            "    }, ...\n"
+            "  ]\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    const std::string strHashType = request.params[0].isNull() ? "hash_serialized_2" : request.params[0].get_str();
+    if (strHashType != "hash_serialized_2" && strHashType != "muhash" && strHashType != "none")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("disk_size", stats.nDiskSize));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    // The index only has MuHash, and only the stats of whole blocks, so the
+    // transaction count is left out
+    const CBlockIndex* pindexStats = nullptr;
+    CoinStatsEntry entry;
+    if (strHashType != "hash_serialized_2" && g_coinstatsindex && g_coinstatsindex->IsSynced()) {
+        pindexStats = g_coinstatsindex->GetBestBlock();
+        if (pindexStats && !g_coinstatsindex->LookupStats(pindexStats, entry))
+            pindexStats = nullptr;
+    }
+
+    if (pindexStats) {
+        stats.nHeight = pindexStats->nHeight;
+        stats.hashBlock = pindexStats->GetBlockHash();
+        stats.nTransactionOutputs = entry.nTransactionOutputs;
+        stats.nBogoSize = entry.nBogoSize;
+        stats.hashSerialized = entry.hashMuHash;
+        stats.nDiskSize = pcoinsdbview->EstimateSize();
+        stats.nTotalAmount = entry.nTotalAmount;
+        stats.mapEscrow = entry.mapEscrow;
     } else {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        FlushStateToDisk();
+        if (!GetUTXOStats(pcoinsdbview.get(), stats, strHashType == "muhash"))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    }
+
+    ret.push_back(Pair("height", (int64_t)stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    if (!pindexStats)
+        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
+    if (strHashType != "none")
+        ret.push_back(Pair(strHashType, stats.hashSerialized.GetHex()));
+    ret.push_back(Pair("disk_size", stats.nDiskSize));
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    UniValue escrow(UniValue::VARR);
+    for (const auto& it : stats.mapEscrow) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("nsidechain", (int)it.first));
+        obj.push_back(Pair("amount", ValueFromAmount(it.second)));
+        escrow.push_back(obj);
     }
+    ret.push_back(Pair("escrow_amounts", escrow));
     return ret;
 }
 
@@ -1167,6 +1299,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"reindex_chainstate\": {       (object) progress of a -reindex-chainstate replay (only present while replaying)\n"
+            "     \"height\": xxxxxx,           (numeric) height replayed so far\n"
+            "     \"target_height\": xxxxxx,    (numeric) height of the tip before the chainstate was wiped\n"
+            "     \"progress\": xxxx,           (numeric) estimate of the replay progress [0..1]\n"
+            "     \"elapsed\": xxxx,            (numeric) seconds since the replay started\n"
+            "     \"eta\": xxxx,                (numeric) estimated seconds until the replay is done, -1 if unknown\n"
+            "     \"scdb_held\": xx,            (boolean) whether sidechain state is still served as of the target\n"
+            "  },\n"
             "  \"softforks\": [                (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",           (string) name of softfork\n"
@@ -1230,6 +1370,18 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
+    ReindexChainStateProgress reindex;
+    if (GetReindexChainStateProgress(reindex)) {
+        UniValue reindexObj(UniValue::VOBJ);
+        reindexObj.push_back(Pair("height",         reindex.nHeight));
+        reindexObj.push_back(Pair("target_height",  reindex.nTargetHeight));
+        reindexObj.push_back(Pair("progress",       reindex.dProgress));
+        reindexObj.push_back(Pair("elapsed",        GetTime() - reindex.nTimeStart));
+        reindexObj.push_back(Pair("eta",            reindex.nETA));
+        reindexObj.push_back(Pair("scdb_held",      reindex.fSCDBHeld));
+        obj.push_back(Pair("reindex_chainstate", reindexObj));
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CBlockIndex* tip = chainActive.Tip();
     UniValue softforks(UniValue::VARR);
@@ -1297,33 +1449,9 @@ UniValue getchaintips(const JSONRPCRequest& request)
 
     LOCK(cs_main);
 
-    /*
-     * Idea:  the set of chain tips is chainActive.tip, plus orphan blocks which do not have another orphan building off of them.
-     * Algorithm:
-     *  - Make one pass through mapBlockIndex, picking out the orphan blocks, and also storing a set of the orphan block's pprev pointers.
-     *  - Iterate through the orphan blocks. If the block isn't pointed to by another orphan, it is a chain tip.
-     *  - add chainActive.Tip()
-     */
-    std::set<const CBlockIndex*, CompareBlocksByHeight> setTips;
-    std::set<const CBlockIndex*> setOrphans;
-    std::set<const CBlockIndex*> setPrevs;
-
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
-    {
-        if (!chainActive.Contains(item.second)) {
-            setOrphans.insert(item.second);
-            setPrevs.insert(item.second->pprev);
-        }
-    }
-
-    for (std::set<const CBlockIndex*>::iterator it = setOrphans.begin(); it != setOrphans.end(); ++it)
-    {
-        if (setPrevs.erase(*it) == 0) {
-            setTips.insert(*it);
-        }
-    }
-
-    // Always report the currently active tip.
+    // The chain tips are the blocks without children, which validation keeps
+    // track of, and the active tip even if headers beyond it are known
+    std::set<const CBlockIndex*, CompareBlocksByHeight> setTips(setBlockIndexTips.begin(), setBlockIndexTips.end());
     setTips.insert(chainActive.Tip());
 
     /* Construct the output array.  */
@@ -1402,6 +1530,40 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getmempoolfeehistogram(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getmempoolfeehistogram\n"
+            "\nReturns the mempool transactions bucketed by fee rate, lowest rate first.\n"
+            "Fees set with prioritisetransaction are not counted.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"feerate\": n,        (numeric) The lowest fee rate of the bucket in satoshis per virtual byte\n"
+            "    \"count\": n,          (numeric) The number of transactions\n"
+            "    \"vsize\": n,          (numeric) Their total virtual size\n"
+            "    \"fees\": x.xxx,       (numeric) Their total fees in " + CURRENCY_UNIT + "\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmempoolfeehistogram", "")
+            + HelpExampleRpc("getmempoolfeehistogram", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const MempoolFeeHistogramBucket& bucket : mempool.GetFeeHistogram()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("feerate", bucket.nMinFeeRate);
+        obj.pushKV("count", bucket.nCount);
+        obj.pushKV("vsize", bucket.nVSize);
+        obj.pushKV("fees", ValueFromAmount(bucket.nFees));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1596,6 +1758,70 @@ UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
+/** Value at fraction dPercentile of the sorted vector v */
+static double GetPercentileMillis(const std::vector<int64_t>& v, double dPercentile)
+{
+    if (v.empty())
+        return 0;
+    size_t n = std::min(v.size() - 1, (size_t)(dPercentile * v.size()));
+    return v[n] * 0.001;
+}
+
+UniValue getconnectblockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getconnectblockstats\n"
+            "\nReturns the time spent on the drivechain stages of connecting blocks.\n"
+            "Percentiles are over the last " + std::to_string(CONNECT_BLOCK_STATS_WINDOW) + " blocks connected, totals are since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"stage\": {             (json object) For each of sidechain_scan, deposits, withdrawals, scdb_update,\n"
+            "                           mempool_ctip, sidechain_tree and total (all of ConnectBlock)\n"
+            "    \"blocks\": n,          (numeric) Number of blocks timed\n"
+            "    \"items\": n,           (numeric) Deposit transactions, deposits or withdrawals handled (0 for other stages)\n"
+            "    \"total_ms\": x.xxx,    (numeric) Total time in milliseconds\n"
+            "    \"mean_ms\": x.xxx,     (numeric) Mean time per block over the window\n"
+            "    \"p50_ms\": x.xxx,      (numeric) Median time per block over the window\n"
+            "    \"p90_ms\": x.xxx,      (numeric) 90th percentile\n"
+            "    \"p99_ms\": x.xxx,      (numeric) 99th percentile\n"
+            "    \"max_ms\": x.xxx       (numeric) Slowest block in the window\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getconnectblockstats", "")
+            + HelpExampleRpc("getconnectblockstats", "")
+        );
+
+    std::vector<ConnectBlockStageStats> vStats;
+    {
+        LOCK(cs_main);
+        vStats = GetConnectBlockStats();
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    for (ConnectBlockStageStats& stats : vStats) {
+        std::vector<int64_t>& v = stats.vRecentMicros;
+        int64_t nWindowMicros = 0;
+        for (int64_t n : v)
+            nWindowMicros += n;
+        std::sort(v.begin(), v.end());
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("blocks", stats.nBlocks));
+        obj.push_back(Pair("items", stats.nTotalItems));
+        obj.push_back(Pair("total_ms", stats.nTotalMicros * 0.001));
+        obj.push_back(Pair("mean_ms", v.empty() ? 0 : nWindowMicros * 0.001 / v.size()));
+        obj.push_back(Pair("p50_ms", GetPercentileMillis(v, 0.5)));
+        obj.push_back(Pair("p90_ms", GetPercentileMillis(v, 0.9)));
+        obj.push_back(Pair("p99_ms", GetPercentileMillis(v, 0.99)));
+        obj.push_back(Pair("max_ms", v.empty() ? 0 : v.back() * 0.001));
+        ret.push_back(Pair(stats.strName, obj));
+    }
+
+    return ret;
+}
+
 UniValue savemempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0) {
@@ -1615,27 +1841,158 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static fs::path UTXOSnapshotPath(const std::string& strPath)
+{
+    return fs::absolute(fs::path(strPath), GetDataDir());
+}
+
+static UniValue UTXOSnapshotInfoToJSON(const UTXOSnapshotInfo& info, const fs::path& path)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", info.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", info.nHeight));
+    ret.push_back(Pair("coins", info.nCoins));
+    ret.push_back(Pair("txoutset_hash", info.hashCoins.GetHex()));
+    ret.push_back(Pair("sidechains", info.fSidechains));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+static const char* UTXO_SNAPSHOT_RESULT =
+    "{\n"
+    "  \"base_hash\": \"hash\",     (string) The hash of the block of the snapshot\n"
+    "  \"base_height\": n,        (numeric) The height of the block of the snapshot\n"
+    "  \"coins\": n,              (numeric) The number of coins in the snapshot\n"
+    "  \"txoutset_hash\": \"hash\", (string) The hash of the coins of the snapshot\n"
+    "  \"sidechains\": true|false, (boolean) Whether the snapshot has the sidechain state of its block\n"
+    "  \"path\": \"path\"           (string) The absolute path of the snapshot\n"
+    "}\n";
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the coins of the chain tip, the headers leading to it and its sidechain state to a snapshot\n"
+            "file that loadtxoutset can load on a fresh node.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            + std::string(UTXO_SNAPSHOT_RESULT) +
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    const fs::path path = UTXOSnapshotPath(request.params[0].get_str());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    UTXOSnapshotInfo info;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    return UTXOSnapshotInfoToJSON(info, path);
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nLoad a snapshot written by dumptxoutset into a node that hasn't connected any block yet. The node\n"
+            "goes on syncing from the block of the snapshot, the blocks below it are never downloaded or validated.\n"
+            "Only the headers of the snapshot are checked, the coins are trusted, so only load snapshots of a\n"
+            "source you trust. The indexes must be disabled, and the wallet won't see transactions below the\n"
+            "block of the snapshot.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to load, relative to the data directory unless absolute\n"
+            "\nResult:\n"
+            + std::string(UTXO_SNAPSHOT_RESULT) +
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\"")
+        );
+
+    if (g_txindex || g_addressindex || g_opreturnindex || g_blockfilterindex || g_coinstatsindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Indexes can't be built from a UTXO snapshot, restart without -txindex, -addressindex, -opreturnindex, -blockfilterindex and -coinstatsindex");
+
+    const fs::path path = UTXOSnapshotPath(request.params[0].get_str());
+    UTXOSnapshotInfo info;
+    std::string strError;
+    if (!LoadUTXOSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    return UTXOSnapshotInfoToJSON(info, path);
+}
+
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getdbstats\n"
+            "\nReturns the LevelDB settings and statistics of the open databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {              (json object) For each database (chainstate, index, sidechain, opreturn, ...)\n"
+            "    \"profile\": \"...\",     (string) LevelDB tuning used (lookup, scan, append or default)\n"
+            "    \"cache_size\": n,      (numeric) Bytes of cache given to the database\n"
+            "    \"block_size\": n,      (numeric) Size of the table data blocks\n"
+            "    \"bloom_bits\": n,      (numeric) Bloom filter bits per key, 0 for none\n"
+            "    \"approximate_size\": n, (numeric) Approximate bytes used on disk\n"
+            "    \"memory_usage\": n,    (numeric) Approximate bytes of memory used by LevelDB\n"
+            "    \"stats\": \"...\"        (string) LevelDB's compaction statistics (leveldb.stats)\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    ForEachDB([&ret](const CDBWrapper& db) {
+        const CDBProfile& profile = db.GetProfile();
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("profile", profile.name));
+        obj.push_back(Pair("cache_size", (uint64_t)db.GetCacheSize()));
+        obj.push_back(Pair("block_size", (uint64_t)profile.nBlockSize));
+        obj.push_back(Pair("bloom_bits", profile.nBloomBitsPerKey));
+        obj.push_back(Pair("approximate_size", db.EstimateTotalSize()));
+        obj.push_back(Pair("memory_usage", atoi64(db.GetProperty("leveldb.approximate-memory-usage"))));
+        obj.push_back(Pair("stats", db.GetProperty("leveldb.stats")));
+        ret.push_back(Pair(db.GetName(), obj));
+    });
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {}, true },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
-    { "blockchain",         "getblockcount",          &getblockcount,          {} },
-    { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
-    { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
-    { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
-    { "blockchain",         "getchaintips",           &getchaintips,           {} },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
-    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
-    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
-    { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "getconnectblockstats",   &getconnectblockstats,   {} },
+    { "blockchain",         "getdbstats",             &getdbstats,             {} },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       {}, true },
+    { "blockchain",         "getblockcount",          &getblockcount,          {}, true },
+    { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"}, true },
+    { "blockchain",         "getblockhash",           &getblockhash,           {"height"}, true },
+    { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"}, true },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash","filtertype"}, true },
+    { "blockchain",         "getchaintips",           &getchaintips,           {}, true },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          {}, true },
+    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"}, true },
+    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"}, true },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"}, true },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {}, true },
+    { "blockchain",         "getmempoolfeehistogram", &getmempoolfeehistogram, {}, true },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"}, true },
+    { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"}, true },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
@@ -29,6 +29,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "setgenerate", 0, "generate" },
     { "setgenerate", 1, "genproclimit" },
     { "setmocktime", 0, "timestamp" },
+    { "benchhash", 0, "iterations" },
     { "generate", 0, "nblocks" },
     { "generate", 1, "maxtries" },
     { "generatetoaddress", 0, "nblocks" },
@@ -62,6 +63,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listtransactions", 1, "count" },
     { "listtransactions", 2, "skip" },
     { "listtransactions", 3, "include_watchonly" },
+    { "listtransactions", 4, "since_height" },
     { "listaccounts", 0, "minconf" },
     { "listaccounts", 1, "include_watchonly" },
     { "walletpassphrase", 1, "timeout" },
@@ -97,6 +99,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "signrawtransaction", 1, "prevtxs" },
     { "signrawtransaction", 2, "privkeys" },
     { "sendrawtransaction", 1, "allowhighfees" },
+    { "submitdepositpackage", 0, "hexstrings" },
+    { "submitdepositpackage", 1, "allowhighfees" },
     { "combinerawtransaction", 0, "txs" },
     { "fundrawtransaction", 1, "options" },
     { "fundrawtransaction", 2, "iswitness" },
@@ -129,6 +133,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "bumpfee", 1, "options" },
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
+    { "getlockstats", 1, "reset" },
     { "disconnectnode", 1, "nodeid" },
     { "addwitnessaddress", 1, "p2sh" },
     { "addwithdrawal", 0, "nsidechain" },
@@ -145,19 +150,58 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listsidechaindeposits", 0, "nsidechain" },
     { "listsidechaindeposits", 2, "n" },
     { "listsidechaindeposits", 3, "count" },
+    { "listsidechaindeposits", 4, "start" },
+    { "listsidechaindeposits", 5, "since_height" },
     { "countsidechaindeposits", 0, "nsidechain" },
     { "receivewithdrawalbundle", 0, "nsidechain" },
     { "createsidechaindeposit", 0, "nsidechain" },
     { "createsidechaindeposit", 2, "amount" },
     { "createsidechaindeposit", 3, "fee" },
+    { "createsidechaindeposits", 0, "nsidechain" },
+    { "createsidechaindeposits", 1, "deposits" },
+    { "createsidechaindeposits", 2, "fee" },
+    { "createbmmcriticaldatatx", 0, "amount" },
+    { "createbmmcriticaldatatx", 1, "height" },
+    { "createbmmcriticaldatatx", 3, "nsidechain" },
+    { "createbmmcriticaldatatx", 5, "maxamount" },
     { "getaveragefee", 0, "blockcount" },
     { "getaveragefee", 1, "startheight" },
     { "getworkscore", 0, "nsidechain" },
     { "setwithdrawalvote", 1, "nsidechain" },
     { "listwithdrawalstatus", 0, "nsidechain" },
+    { "listwithdrawalstatus", 1, "start" },
+    { "listwithdrawalstatus", 2, "count" },
+    { "listwithdrawalprojections", 0, "nsidechain" },
     { "listcachedwithdrawaltx", 0, "nsidechain" },
+    { "listcachedwithdrawaltx", 1, "start" },
+    { "listcachedwithdrawaltx", 2, "count" },
+    { "listspentwithdrawals", 0, "start" },
+    { "listspentwithdrawals", 1, "count" },
+    { "getaddresshistory", 1, "start" },
+    { "getaddresshistory", 2, "count" },
+    { "getaddressutxos", 1, "start" },
+    { "getaddressutxos", 2, "count" },
+    { "listfailedwithdrawals", 0, "start" },
+    { "listfailedwithdrawals", 1, "count" },
     { "verifydeposit", 2, "nTx" },
+    { "verifydepositbatch", 0, "requests" },
     { "verifybmm", 2, "nsidechain" },
+    { "verifybmmbatch", 0, "requests" },
+    { "waitforbmm", 1, "nsidechain" },
+    { "waitforbmm", 2, "timeout" },
+    { "waitforsidechainctip", 0, "nsidechain" },
+    { "waitforsidechainctip", 1, "sequence" },
+    { "waitforsidechainctip", 2, "timeout" },
+    { "waitforwithdrawalstatus", 0, "nsidechain" },
+    { "waitforwithdrawalstatus", 1, "sequence" },
+    { "waitforwithdrawalstatus", 2, "timeout" },
+    { "waitfordeposits", 0, "nsidechain" },
+    { "waitfordeposits", 1, "sequence" },
+    { "waitfordeposits", 2, "timeout" },
+    { "getnews", 1, "ndays" },
+    { "getnewsblocks", 0, "headers" },
+    { "getnewsblocks", 1, "startheight" },
+    { "getnewsblocks", 2, "endheight" },
     // Echo with conversion (For testing only)
     { "echojson", 0, "arg0" },
     { "echojson", 1, "arg1" },
@@ -11,6 +11,7 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <hash.h>
 #include <init.h>
 #include <validation.h>
 #include <miner.h>
@@ -94,9 +95,15 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
+        {
+            // Only the nonce changes below, so reuse the header midstate
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << pblock->GetBlockHeader();
+            CSkydogeHeaderHasher hasher((unsigned char*)&ss[0]);
+            while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(hasher.Hash(pblock->nNonce), pblock->nBits, Params().GetConsensus())) {
+                ++pblock->nNonce;
+                --nMaxTries;
+            }
         }
         if (nMaxTries == 0) {
             break;
@@ -206,6 +213,10 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
+            "  \"hashespersec\": nnn,       (numeric) The hashes per second of the internal miner\n"
+            "  \"threadhashespersec\": [    (array) The hashes per second of each mining thread\n"
+            "     nnn, ...\n"
+            "  ],\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
             "}\n"
@@ -224,6 +235,15 @@ UniValue getmininginfo(const JSONRPCRequest& request)
     obj.push_back(Pair("difficulty",       (double)GetDifficulty()));
     obj.push_back(Pair("networkhashps",    getnetworkhashps(request)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
+
+    double dHashesPerSec = 0;
+    UniValue threadhashespersec(UniValue::VARR);
+    for (double dRate : GetMinerHashRates()) {
+        dHashesPerSec += dRate;
+        threadhashespersec.push_back(dRate);
+    }
+    obj.push_back(Pair("hashespersec",     dHashesPerSec));
+    obj.push_back(Pair("threadhashespersec", threadhashespersec));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
     obj.push_back(Pair("warnings",         GetWarnings("statusbar")));
     return obj;
@@ -311,9 +331,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "     {\n"
             "       \"mode\":\"template\"    (string, optional) This must be set to \"template\", \"proposal\" (see BIP 23), or omitted\n"
             "       \"capabilities\":[     (array, optional) A list of strings\n"
-            "           \"support\"          (string) client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'\n"
+            "           \"support\"          (string) client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid', 'delta'\n"
             "           ,...\n"
             "       ],\n"
+            "       \"templateid\":\"id\"  (string, optional) With the 'delta' capability, the templateid of the last template the client has\n"
             "       \"rules\":[            (array, optional) A list of strings\n"
             "           \"support\"          (string) client side supported softfork deployment\n"
             "           ,...\n"
@@ -331,7 +352,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "  },\n"
             "  \"vbrequired\" : n,                 (numeric) bit mask of versionbits the server requires set in submissions\n"
             "  \"previousblockhash\" : \"xxxx\",     (string) The hash of current highest block\n"
-            "  \"transactions\" : [                (array) contents of non-coinbase transactions that should be included in the next block\n"
+            "  \"templateid\" : \"xxxx\",            (string) id of this template, to pass back with the 'delta' capability\n"
+            "  \"delta\" : true|false,             (boolean) true if this template only has the data of transactions that aren't in the client's template\n"
+            "  \"removed\" : [ \"txid\", ... ],      (array of strings) with delta, the transactions of the client's template that aren't in this one\n"
+            "  \"transactions\" : [                (array) contents of non-coinbase transactions that should be included in the next block. With delta, transactions of the client's template only have the txid\n"
             "      {\n"
             "         \"data\" : \"xxxx\",             (string) transaction data encoded in hexadecimal (byte-for-byte)\n"
             "         \"txid\" : \"xxxx\",             (string) transaction id encoded in little-endian hexadecimal\n"
@@ -364,7 +388,17 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "  \"weightlimit\" : n,                (numeric) limit of block weight\n"
             "  \"curtime\" : ttt,                  (numeric) current timestamp in seconds since epoch (Jan 1 1970 GMT)\n"
             "  \"bits\" : \"xxxxxxxx\",              (string) compressed target of next block\n"
-            "  \"height\" : n                      (numeric) The height of the next block\n"
+            "  \"height\" : n,                     (numeric) The height of the next block\n"
+            "  \"bmmauction\" : [                  (array) the BMM request auction of each sidechain with BMM requests in the mempool\n"
+            "      {\n"
+            "         \"nsidechain\" : n,            (numeric) sidechain number\n"
+            "         \"requests\" : n,              (numeric) number of BMM requests for the sidechain in the mempool\n"
+            "         \"txid\" : \"xxxx\",           (string) the highest paying BMM request\n"
+            "         \"amount\" : n,                (numeric) what the highest paying request pays the miner (in satoshis)\n"
+            "         \"included\" : true|false      (boolean) whether the highest paying request is in the block\n"
+            "      }\n"
+            "      ,...\n"
+            "  ]\n"
             "}\n"
 
             "\nExamples:\n"
@@ -378,6 +412,8 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     UniValue lpval = NullUniValue;
     std::set<std::string> setClientRules;
     int64_t nMaxVersionPreVB = -1;
+    bool fDelta = false;
+    std::string strClientTemplateId;
     if (!request.params[0].isNull())
     {
         const UniValue& oparam = request.params[0].get_obj();
@@ -422,6 +458,17 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             return BIP22ValidationResult(state);
         }
 
+        const UniValue& aClientCaps = find_value(oparam, "capabilities");
+        if (aClientCaps.isArray()) {
+            for (unsigned int i = 0; i < aClientCaps.size(); ++i) {
+                if (aClientCaps[i].isStr() && aClientCaps[i].get_str() == "delta")
+                    fDelta = true;
+            }
+        }
+        const UniValue& templateidval = find_value(oparam, "templateid");
+        if (templateidval.isStr())
+            strClientTemplateId = templateidval.get_str();
+
         const UniValue& aClientRules = find_value(oparam, "rules");
         if (aClientRules.isArray()) {
             for (unsigned int i = 0; i < aClientRules.size(); ++i) {
@@ -510,6 +557,15 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
+    // The transaction entries of pblocktemplate, made once per template
+    static std::vector<UniValue> vTxEntry;
+    // Ids and transactions of this template and the one before it, which
+    // clients with the delta capability may have
+    static uint64_t nTemplateSeq = 0;
+    static std::string strTemplateId;
+    static std::string strTemplateIdPrev;
+    static std::set<uint256> setTemplateTx;
+    static std::set<uint256> setTemplateTxPrev;
     if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
@@ -531,6 +587,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+        vTxEntry.clear();
     }
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -542,44 +599,91 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // NOTE: If at some point we support pre-segwit miners post-segwit-activation, this needs to take segwit support into consideration
     const bool fPreSegWit = (THRESHOLD_ACTIVE != VersionBitsState(pindexPrev, consensusParams, Consensus::DEPLOYMENT_SEGWIT, versionbitscache));
 
-    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
+    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal"); aCaps.push_back("delta");
 
-    UniValue transactions(UniValue::VARR);
-    std::map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    for (const auto& it : pblock->vtx) {
-        const CTransaction& tx = *it;
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
-
-        if (tx.IsCoinBase())
-            continue;
+    if (vTxEntry.empty()) {
+        // Encode the transactions of a new template. Later calls for the
+        // same template reuse the entries.
+        std::map<uint256, int64_t> setTxIndex;
+        int i = 0;
+        for (const auto& it : pblock->vtx) {
+            const CTransaction& tx = *it;
+            uint256 txHash = tx.GetHash();
+            setTxIndex[txHash] = i++;
 
-        UniValue entry(UniValue::VOBJ);
+            if (tx.IsCoinBase())
+                continue;
 
-        entry.push_back(Pair("data", EncodeHexTx(tx)));
-        entry.push_back(Pair("txid", txHash.GetHex()));
-        entry.push_back(Pair("hash", tx.GetWitnessHash().GetHex()));
+            UniValue entry(UniValue::VOBJ);
 
-        UniValue deps(UniValue::VARR);
-        for (const CTxIn &in : tx.vin)
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
+            entry.push_back(Pair("data", EncodeHexTx(tx)));
+            entry.push_back(Pair("txid", txHash.GetHex()));
+            entry.push_back(Pair("hash", tx.GetWitnessHash().GetHex()));
+
+            UniValue deps(UniValue::VARR);
+            for (const CTxIn &in : tx.vin)
+            {
+                if (setTxIndex.count(in.prevout.hash))
+                    deps.push_back(setTxIndex[in.prevout.hash]);
+            }
+            entry.push_back(Pair("depends", deps));
+
+            int index_in_template = i - 1;
+            entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
+            int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
+            if (fPreSegWit) {
+                assert(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
+                nTxSigOps /= WITNESS_SCALE_FACTOR;
+            }
+            entry.push_back(Pair("sigops", nTxSigOps));
+            entry.push_back(Pair("weight", GetTransactionWeight(tx)));
+
+            vTxEntry.push_back(entry);
         }
-        entry.push_back(Pair("depends", deps));
-
-        int index_in_template = i - 1;
-        entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
-        int64_t nTxSigOps = pblocktemplate->vTxSigOpsCost[index_in_template];
-        if (fPreSegWit) {
-            assert(nTxSigOps % WITNESS_SCALE_FACTOR == 0);
-            nTxSigOps /= WITNESS_SCALE_FACTOR;
+
+        strTemplateIdPrev = strTemplateId;
+        strTemplateId = strprintf("%s%u", pblock->hashPrevBlock.GetHex(), ++nTemplateSeq);
+        setTemplateTxPrev.swap(setTemplateTx);
+        setTemplateTx.clear();
+        for (const auto& it : pblock->vtx) {
+            if (!it->IsCoinBase())
+                setTemplateTx.insert(it->GetHash());
         }
-        entry.push_back(Pair("sigops", nTxSigOps));
-        entry.push_back(Pair("weight", GetTransactionWeight(tx)));
+    }
 
-        transactions.push_back(entry);
+    // With the delta capability, only send the data of transactions that
+    // aren't in the client's template
+    const std::set<uint256>* psetClientTx = nullptr;
+    if (fDelta && !strClientTemplateId.empty()) {
+        if (strClientTemplateId == strTemplateId)
+            psetClientTx = &setTemplateTx;
+        else if (strClientTemplateId == strTemplateIdPrev)
+            psetClientTx = &setTemplateTxPrev;
+    }
+
+    UniValue transactions(UniValue::VARR);
+    UniValue removed(UniValue::VARR);
+    if (psetClientTx) {
+        size_t nEntry = 0;
+        for (const auto& it : pblock->vtx) {
+            if (it->IsCoinBase())
+                continue;
+            if (psetClientTx->count(it->GetHash())) {
+                UniValue entry(UniValue::VOBJ);
+                entry.push_back(Pair("txid", it->GetHash().GetHex()));
+                transactions.push_back(entry);
+            } else {
+                transactions.push_back(vTxEntry[nEntry]);
+            }
+            nEntry++;
+        }
+        for (const uint256& txid : *psetClientTx) {
+            if (!setTemplateTx.count(txid))
+                removed.push_back(txid.GetHex());
+        }
+    } else {
+        for (const UniValue& entry : vTxEntry)
+            transactions.push_back(entry);
     }
 
     UniValue aux(UniValue::VOBJ);
@@ -651,6 +755,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
+    result.push_back(Pair("templateid", strTemplateId));
+    result.push_back(Pair("delta", psetClientTx != nullptr));
+    if (psetClientTx)
+        result.push_back(Pair("removed", removed));
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
@@ -676,6 +784,18 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     result.push_back(Pair("bits", strprintf("%08x", pblock->nBits)));
     result.push_back(Pair("height", (int64_t)(pindexPrev->nHeight+1)));
 
+    UniValue bmmAuction(UniValue::VARR);
+    for (const BMMAuctionResult& auction : pblocktemplate->vBMMAuction) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("nsidechain", auction.nSidechain));
+        obj.push_back(Pair("requests", (int64_t)auction.nRequests));
+        obj.push_back(Pair("txid", auction.txid.GetHex()));
+        obj.push_back(Pair("amount", auction.amount));
+        obj.push_back(Pair("included", auction.fIncluded));
+        bmmAuction.push_back(obj);
+    }
+    result.push_back(Pair("bmmauction", bmmAuction));
+
     if (!pblocktemplate->vchCoinbaseCommitment.empty() && fSupportsSegwit) {
         result.push_back(Pair("default_witness_commitment", HexStr(pblocktemplate->vchCoinbaseCommitment.begin(), pblocktemplate->vchCoinbaseCommitment.end())));
     }
@@ -757,7 +877,7 @@ UniValue submitblock(const JSONRPCRequest& request)
     }
 
     submitblock_StateCatcher sc(block.GetHash());
-    RegisterValidationInterface(&sc);
+    RegisterValidationInterface(&sc, "submitblock");
     bool fAccepted = ProcessNewBlock(Params(), blockptr, true, nullptr);
     UnregisterValidationInterface(&sc);
     if (fBlockPresent) {
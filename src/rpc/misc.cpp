@@ -4,6 +4,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <base58.h>
+#include <blockcache.h>
+#include <bmmcache.h>
 #include <chain.h>
 #include <clientversion.h>
 #include <consensus/validation.h>
@@ -15,17 +17,27 @@
 #include <merkleblock.h>
 #include <net.h>
 #include <netbase.h>
+#include <opreturnindex.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
+#include <scheduler.h>
+#include <script/sigcache.h>
 #include <sidechain.h>
 #include <sidechaindb.h>
+#include <support/largepages.h>
 #include <timedata.h>
 #include <txdb.h>
+#include <txindex.h>
+#include <txmempool.h>
+#include <addressindex.h>
+#include <blockfilterindex.h>
+#include <coinstatsindex.h>
 #include <util.h>
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
 #include <validation.h>
+#include <validationinterface.h>
 #ifdef ENABLE_WALLET
 #include <wallet/coincontrol.h>
 #include <wallet/rpcwallet.h>
@@ -456,6 +468,84 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCLargePageInfo()
+{
+    LargePageArena::Stats stats = LargePageArena::Instance().GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("mode", (int)LargePageArena::Instance().GetMode()));
+    obj.push_back(Pair("used", uint64_t(stats.used)));
+    obj.push_back(Pair("mapped", uint64_t(stats.mapped)));
+    obj.push_back(Pair("mapped_reserved", uint64_t(stats.explicit_mapped)));
+    obj.push_back(Pair("regions", uint64_t(stats.regions)));
+    return obj;
+}
+
+static UniValue RPCBlockCacheInfo()
+{
+    BlockCacheStats stats = g_blockcache.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", stats.nBlocks));
+    obj.push_back(Pair("usage", stats.nBytes));
+    obj.push_back(Pair("max_usage", stats.nMaxBytes));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    return obj;
+}
+
+static UniValue RPCSidechainMemoryInfo()
+{
+    LOCK(cs_main);
+
+    std::vector<SidechainMemoryUsage> vUsage;
+    size_t nShared = 0;
+    scdb.GetMemoryUsage(vUsage, nShared);
+
+    size_t nTotal = nShared;
+    UniValue arr(UniValue::VARR);
+    for (size_t x = 0; x < vUsage.size(); x++) {
+        const SidechainMemoryUsage& usage = vUsage[x];
+        nTotal += usage.Total();
+
+        const bool fActive = scdb.IsSidechainActive(x);
+        if (!fActive && !usage.Total())
+            continue;
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("nsidechain", (int)x));
+        obj.push_back(Pair("active", fActive));
+        obj.push_back(Pair("deposits", (uint64_t)usage.nDeposits));
+        obj.push_back(Pair("deposits_cached", (uint64_t)usage.nDepositsCached));
+        obj.push_back(Pair("withdrawals", (uint64_t)usage.nWithdrawals));
+        obj.push_back(Pair("withdrawal_txs", (uint64_t)usage.nWithdrawalTx));
+        obj.push_back(Pair("spent_withdrawals", (uint64_t)usage.nSpentWithdrawals));
+        obj.push_back(Pair("failed_withdrawals", (uint64_t)usage.nFailedWithdrawals));
+        obj.push_back(Pair("view", (uint64_t)usage.nView));
+        obj.push_back(Pair("usage", (uint64_t)usage.Total()));
+        arr.push_back(obj);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("usage", (uint64_t)nTotal));
+    obj.push_back(Pair("max_usage", (uint64_t)scdb.GetMaxMemoryUsage()));
+    obj.push_back(Pair("cache_size", (uint64_t)scdb.GetCacheSize()));
+    obj.push_back(Pair("shared", (uint64_t)nShared));
+    obj.push_back(Pair("sidechains", arr));
+    return obj;
+}
+
+static UniValue RPCSignatureCacheInfo()
+{
+    SignatureCacheStats stats;
+    GetSignatureCacheStats(stats);
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("elements", stats.nElements));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("inserts", stats.nInserts));
+    obj.push_back(Pair("evictions", stats.nEvictions));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -488,6 +578,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "1. \"mode\" determines what kind of information is returned. This argument is optional, the default mode is \"stats\".\n"
             "  - \"stats\" returns general statistics about memory usage in the daemon.\n"
             "  - \"mallocinfo\" returns an XML string describing low-level heap state (only available if compiled with glibc 2.10+).\n"
+            "  - \"sidechain\" returns the memory used by the sidechain database, by sidechain.\n"
             "\nResult (mode \"stats\"):\n"
             "{\n"
             "  \"locked\": {               (json object) Information about locked memory manager\n"
@@ -497,10 +588,52 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"sigcache\": {             (json object) Signature cache counters since startup\n"
+            "    \"elements\": xxxxx,      (numeric) Number of signatures the cache can hold\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups that found the signature\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that didn't find the signature\n"
+            "    \"inserts\": xxxxx,       (numeric) Number of signatures added\n"
+            "    \"evictions\": xxxxx,     (numeric) Number of signatures pushed out or aged out before they were used. If this keeps growing the cache may be too small (see -maxsigcachesize)\n"
+            "  },\n"
+            "  \"blockcache\": {           (json object) Decoded block cache used by block lookups (see -blockcachesize)\n"
+            "    \"blocks\": xxxxx,        (numeric) Number of blocks cached\n"
+            "    \"usage\": xxxxx,         (numeric) Memory used by the cached blocks\n"
+            "    \"max_usage\": xxxxx,     (numeric) Most memory the cached blocks may use\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups that found the block\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that read the block from disk\n"
+            "  },\n"
+            "  \"largepages\": {           (json object) Huge pages backing the coins cache and the mempool (see -largepages)\n"
+            "    \"mode\": n,              (numeric) The -largepages mode in use\n"
+            "    \"used\": xxxxx,          (numeric) Bytes handed out from the huge page mappings\n"
+            "    \"mapped\": xxxxx,        (numeric) Bytes mapped\n"
+            "    \"mapped_reserved\": xxxxx, (numeric) Bytes mapped from the reserved huge page pool\n"
+            "    \"regions\": xxxxx,       (numeric) Number of mappings\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
             "\"<malloc version=\"1\">...\"\n"
+            "\nResult (mode \"sidechain\"):\n"
+            "{\n"
+            "  \"usage\": xxxxx,            (numeric) Bytes used by the sidechain database\n"
+            "  \"max_usage\": xxxxx,        (numeric) Most bytes it may use before moving data out of memory, 0 for no limit (see -maxscdbmemory)\n"
+            "  \"cache_size\": xxxxx,       (numeric) Number of recent deposits per sidechain, and blocks of withdrawal history, kept in memory\n"
+            "  \"shared\": xxxxx,           (numeric) Bytes used for state that isn't of one sidechain (sidechain list, proposals, votes, ...)\n"
+            "  \"sidechains\": [            (json array) Bytes used for each active sidechain, or inactive one that still has state\n"
+            "    {\n"
+            "      \"nsidechain\": n,        (numeric) Sidechain number\n"
+            "      \"active\": true|false,  (boolean) Whether the sidechain is active\n"
+            "      \"deposits\": xxxxx,     (numeric) Deposits kept in memory, including their transactions\n"
+            "      \"deposits_cached\": n,  (numeric) Number of deposits kept in memory\n"
+            "      \"withdrawals\": xxxxx,  (numeric) Withdrawal states and their work score history\n"
+            "      \"withdrawal_txs\": xxxxx, (numeric) Cached withdrawal transactions\n"
+            "      \"spent_withdrawals\": xxxxx, (numeric) Withdrawal spends kept in memory\n"
+            "      \"failed_withdrawals\": xxxxx, (numeric) Failed withdrawals kept in memory\n"
+            "      \"view\": xxxxx,         (numeric) Copy of the state published for lock-free readers\n"
+            "      \"usage\": xxxxx,        (numeric) Total of the above\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmemoryinfo", "")
             + HelpExampleRpc("getmemoryinfo", "")
@@ -510,6 +643,9 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("sigcache", RPCSignatureCacheInfo()));
+        obj.push_back(Pair("blockcache", RPCBlockCacheInfo()));
+        obj.push_back(Pair("largepages", RPCLargePageInfo()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -517,11 +653,231 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
 #else
         throw JSONRPCError(RPC_INVALID_PARAMETER, "mallocinfo is only available when compiled with glibc 2.10+");
 #endif
+    } else if (mode == "sidechain") {
+        return RPCSidechainMemoryInfo();
     } else {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown mode " + mode);
     }
 }
 
+static UniValue LatencyHistogramToJSON(const std::vector<int64_t>& vBounds, const std::vector<uint64_t>& vCounts, int64_t nTotal)
+{
+    UniValue buckets(UniValue::VOBJ);
+    for (size_t i = 0; i < vCounts.size(); i++) {
+        std::string strKey = i < vBounds.size() ? strprintf("%d", vBounds[i]) : "more";
+        buckets.push_back(Pair(strKey, vCounts[i]));
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("total_ms", nTotal / 1000));
+    obj.push_back(Pair("buckets", buckets));
+    return obj;
+}
+
+UniValue getrpcworkqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getrpcworkqueueinfo\n"
+            "Returns statistics of the RPC work queue lanes since startup.\n"
+            "Calls are queued in the \"fast\", \"sidechain\" or \"heavy\" lane, each with its\n"
+            "own worker threads (see -rpcthreads, -rpcsidechainthreads and -rpcheavythreads).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"lane\": {                  (json object) Statistics of one lane\n"
+            "    \"threads\": n,             (numeric) Number of worker threads\n"
+            "    \"depth\": n,               (numeric) Number of queued calls\n"
+            "    \"maxdepth\": n,            (numeric) Queue depth above which calls are rejected (see -rpcworkqueue)\n"
+            "    \"rejected\": n,            (numeric) Number of calls rejected because the queue was full\n"
+            "    \"queuewait\": {            (json object) Time calls waited in the queue\n"
+            "      \"total_ms\": n,          (numeric) Sum of the waiting times in milliseconds\n"
+            "      \"buckets\": {            (json object) Number of calls by waiting time, keyed by upper bound in milliseconds\n"
+            "        \"1\": n,\n"
+            "        ...\n"
+            "        \"more\": n\n"
+            "      }\n"
+            "    },\n"
+            "    \"servicetime\": {          (json object) Time spent handling calls, same format as queuewait\n"
+            "      ...\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcworkqueueinfo", "")
+            + HelpExampleRpc("getrpcworkqueueinfo", "")
+        );
+
+    UniValue obj(UniValue::VOBJ);
+    for (const HTTPWorkLaneStats& stats : GetHTTPWorkLaneStats()) {
+        UniValue lane(UniValue::VOBJ);
+        lane.push_back(Pair("threads", stats.nThreads));
+        lane.push_back(Pair("depth", (uint64_t)stats.nDepth));
+        lane.push_back(Pair("maxdepth", (uint64_t)stats.nMaxDepth));
+        lane.push_back(Pair("rejected", stats.nRejected));
+        lane.push_back(Pair("queuewait", LatencyHistogramToJSON(stats.vBucketBounds, stats.vQueueWait, stats.nQueueWaitTotal)));
+        lane.push_back(Pair("servicetime", LatencyHistogramToJSON(stats.vBucketBounds, stats.vServiceTime, stats.nServiceTimeTotal)));
+        obj.push_back(Pair(stats.name, lane));
+    }
+    return obj;
+}
+
+UniValue getschedulerinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getschedulerinfo\n"
+            "Returns the periodic tasks of the node, like writing the address database\n"
+            "to disk, and how long they took since startup. Tasks run in the \"fast\" or\n"
+            "the \"bulk\" lane, each with its own thread.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"pending\": n,              (numeric) Number of tasks waiting to run\n"
+            "  \"tasks\": [\n"
+            "    {\n"
+            "      \"name\": \"name\",       (string) Name of the task\n"
+            "      \"lane\": \"lane\",       (string) \"fast\" or \"bulk\"\n"
+            "      \"runs\": n,            (numeric) Number of times it ran\n"
+            "      \"total_ms\": n,        (numeric) Time spent running it in milliseconds\n"
+            "      \"max_ms\": n           (numeric) Longest run in milliseconds\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getschedulerinfo", "")
+            + HelpExampleRpc("getschedulerinfo", "")
+        );
+
+    CScheduler& scheduler = GetScheduler();
+    boost::chrono::system_clock::time_point first, last;
+
+    UniValue tasks(UniValue::VARR);
+    for (const SchedulerTaskStats& stats : scheduler.getTaskStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.name));
+        obj.push_back(Pair("lane", stats.lane == SCHEDULER_LANE_BULK ? "bulk" : "fast"));
+        obj.push_back(Pair("runs", stats.nRuns));
+        obj.push_back(Pair("total_ms", stats.nTimeTotal / 1000));
+        obj.push_back(Pair("max_ms", stats.nTimeMax / 1000));
+        tasks.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("pending", (uint64_t)scheduler.getQueueInfo(first, last)));
+    ret.push_back(Pair("tasks", tasks));
+    return ret;
+}
+
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "getlockstats ( \"filter\" reset )\n"
+            "Returns how often and how long each place in the code that takes a lock\n"
+            "waited for it and held it, since startup or the last reset. Only collected\n"
+            "with -lockstats. Sites are sorted by the total time they held the lock.\n"
+            "\nArguments:\n"
+            "1. \"filter\"     (string, optional) Only return sites whose lock name contains this, like \"cs_main\"\n"
+            "2. reset        (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,    (boolean) Whether statistics are collected (see -lockstats)\n"
+            "  \"elapsed_ms\": n,          (numeric) Milliseconds since the statistics were last reset\n"
+            "  \"sites\": [\n"
+            "    {\n"
+            "      \"lock\": \"name\",       (string) The lock as written at the site\n"
+            "      \"site\": \"file:line\",  (string) Where it is taken\n"
+            "      \"acquired\": n,        (numeric) Number of times it was taken here\n"
+            "      \"contended\": n,       (numeric) Number of those it was held by another thread\n"
+            "      \"wait_us\": n,         (numeric) Total microseconds spent waiting for it\n"
+            "      \"max_wait_us\": n,     (numeric) Longest wait in microseconds\n"
+            "      \"hold_us\": n,         (numeric) Total microseconds it was held from here\n"
+            "      \"max_hold_us\": n      (numeric) Longest hold in microseconds\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "\"cs_main\"")
+            + HelpExampleCli("getlockstats", "\"\" true")
+            + HelpExampleRpc("getlockstats", "\"cs_main\"")
+        );
+
+    std::string strFilter;
+    if (!request.params[0].isNull())
+        strFilter = request.params[0].get_str();
+    bool fReset = !request.params[1].isNull() && request.params[1].get_bool();
+
+    int64_t nElapsed = 0;
+    std::vector<LockSiteStats> vStats = GetLockStats(nElapsed);
+    if (fReset)
+        ResetLockStats();
+
+    std::sort(vStats.begin(), vStats.end(), [](const LockSiteStats& a, const LockSiteStats& b) {
+        return a.nHoldTotal > b.nHoldTotal;
+    });
+
+    UniValue sites(UniValue::VARR);
+    for (const LockSiteStats& stats : vStats) {
+        if (!strFilter.empty() && stats.name.find(strFilter) == std::string::npos)
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lock", stats.name));
+        obj.push_back(Pair("site", strprintf("%s:%d", stats.file, stats.line)));
+        obj.push_back(Pair("acquired", stats.nAcquired));
+        obj.push_back(Pair("contended", stats.nContended));
+        obj.push_back(Pair("wait_us", stats.nWaitTotal));
+        obj.push_back(Pair("max_wait_us", stats.nWaitMax));
+        obj.push_back(Pair("hold_us", stats.nHoldTotal));
+        obj.push_back(Pair("max_hold_us", stats.nHoldMax));
+        sites.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", g_lock_stats.load()));
+    ret.push_back(Pair("elapsed_ms", nElapsed / 1000));
+    ret.push_back(Pair("sites", sites));
+    return ret;
+}
+
+UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationqueueinfo\n"
+            "Returns the queues of block and transaction notifications of the node's\n"
+            "components, such as the wallet, the indices and the ZMQ publishers. Each\n"
+            "has its own queue and thread, so one falling behind doesn't delay the others.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",         (string) Name of the component\n"
+            "    \"depth\": n,               (numeric) Number of notifications queued\n"
+            "    \"lag_ms\": n,              (numeric) Milliseconds since the notification being handled was queued, 0 if idle\n"
+            "    \"processed\": n,           (numeric) Number of notifications handled since startup\n"
+            "    \"overflowed\": n           (numeric) Number of notifications queued while it was far behind\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationqueueinfo", "")
+            + HelpExampleRpc("getvalidationqueueinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    for (const ValidationInterfaceQueueStats& stats : GetValidationInterfaceQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", stats.name));
+        obj.push_back(Pair("depth", (uint64_t)stats.nDepth));
+        obj.push_back(Pair("lag_ms", stats.nLag / 1000));
+        obj.push_back(Pair("processed", stats.nProcessed));
+        obj.push_back(Pair("overflowed", stats.nOverflowed));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 uint32_t getCategoryMask(UniValue cats) {
     cats = cats.get_array();
     uint32_t mask = 0;
@@ -539,6 +895,54 @@ uint32_t getCategoryMask(UniValue cats) {
     return mask;
 }
 
+static UniValue IndexInfoToJSON(bool fSynced, const CBlockIndex* pindexBest)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("synced", fSynced));
+    obj.push_back(Pair("best_block_height", pindexBest ? pindexBest->nHeight : -1));
+    return obj;
+}
+
+UniValue getindexinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getindexinfo ( \"index_name\" )\n"
+            "Returns the status of the optional indices, which are built in the\n"
+            "background, and how far they have caught up with the block chain.\n"
+            "\nArguments:\n"
+            "1. \"index_name\"   (string, optional) Only return the status of this index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                  (object) one entry per enabled index: txindex, opreturnindex, addressindex, basic block filter index, coinstatsindex\n"
+            "    \"synced\": true|false,    (boolean) whether the index has caught up with the chain tip\n"
+            "    \"best_block_height\": n,  (numeric) height of the last block indexed, -1 if none\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getindexinfo", "")
+            + HelpExampleCli("getindexinfo", "\"txindex\"")
+            + HelpExampleRpc("getindexinfo", "\"txindex\"")
+            );
+
+    const std::string strName = request.params[0].isNull() ? "" : request.params[0].get_str();
+
+    UniValue ret(UniValue::VOBJ);
+    if (g_txindex && (strName.empty() || strName == "txindex"))
+        ret.push_back(Pair("txindex", IndexInfoToJSON(g_txindex->IsSynced(), g_txindex->GetBestBlock())));
+    if (g_opreturnindex && (strName.empty() || strName == "opreturnindex"))
+        ret.push_back(Pair("opreturnindex", IndexInfoToJSON(g_opreturnindex->IsSynced(), g_opreturnindex->GetBestBlock())));
+    if (g_addressindex && (strName.empty() || strName == "addressindex"))
+        ret.push_back(Pair("addressindex", IndexInfoToJSON(g_addressindex->IsSynced(), g_addressindex->GetBestBlock())));
+    if (g_blockfilterindex && (strName.empty() || strName == "basic block filter index"))
+        ret.push_back(Pair("basic block filter index", IndexInfoToJSON(g_blockfilterindex->IsSynced(), g_blockfilterindex->GetBestBlock())));
+    if (g_coinstatsindex && (strName.empty() || strName == "coinstatsindex"))
+        ret.push_back(Pair("coinstatsindex", IndexInfoToJSON(g_coinstatsindex->IsSynced(), g_coinstatsindex->GetBestBlock())));
+
+    return ret;
+}
+
 UniValue logging(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2) {
@@ -695,12 +1099,15 @@ UniValue listsidechainctip(const JSONRPCRequest& request)
 
     // Is nSidechain valid?
     int nSidechain = request.params[0].get_int();
-    if (!scdb.IsSidechainActive(nSidechain))
+    std::shared_ptr<const SidechainView> view;
+    if (nSidechain >= 0 && nSidechain <= 255)
+        view = scdb.GetSidechainView(nSidechain);
+    if (!view)
         throw JSONRPCError(RPC_MISC_ERROR, "Invalid sidechain number!");
 
-    SidechainCTIP ctip;
-    if (!scdb.GetCTIP(nSidechain, ctip))
+    if (!view->fHaveCTIP)
         throw JSONRPCError(RPC_MISC_ERROR, "No CTIP found for sidechain!");
+    const SidechainCTIP& ctip = view->ctip;
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("txid", ctip.out.hash.ToString()));
@@ -711,19 +1118,165 @@ UniValue listsidechainctip(const JSONRPCRequest& request)
     return obj;
 }
 
+/** Read the optional start and count arguments of a list RPC from
+ * request.params[nIndex] and request.params[nIndex + 1] */
+static void ParseListRange(const JSONRPCRequest& request, size_t nIndex, uint32_t& nStart, uint32_t& nCount)
+{
+    nStart = 0;
+    nCount = std::numeric_limits<uint32_t>::max();
+
+    if (!request.params[nIndex].isNull()) {
+        int n = request.params[nIndex].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start, must be positive");
+        nStart = n;
+    }
+    if (!request.params[nIndex + 1].isNull()) {
+        int n = request.params[nIndex + 1].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must be positive");
+        nCount = n;
+    }
+}
+
+/** The scriptPubKey of an address, or a hex scriptPubKey */
+static CScript ParseAddressIndexScript(const UniValue& param)
+{
+    const std::string& str = param.get_str();
+    CTxDestination dest = DecodeDestination(str);
+    if (IsValidDestination(dest))
+        return GetScriptForDestination(dest);
+    if (!str.empty() && IsHex(str)) {
+        std::vector<unsigned char> vch = ParseHex(str);
+        return CScript(vch.begin(), vch.end());
+    }
+    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script");
+}
+
+static void EnsureAddressIndex()
+{
+    if (!g_addressindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, use -addressindex");
+}
+
+UniValue getaddresshistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddresshistory \"address\" ( start count )\n"
+            "List the outputs paying to an address or script and the inputs\n"
+            "spending them, in block height order. Requires -addressindex.\n"
+            "The history of the escrow script of a sidechain (b4 followed by\n"
+            "the sidechain number in hex) lists every CTIP it has had.\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The address or hex scriptPubKey\n"
+            "2. start          (numeric, optional) Number of entries to skip\n"
+            "3. count          (numeric, optional) Maximum number of entries to list\n"
+            "\nResult: (array)\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",      (string) the transaction\n"
+            "    \"height\" : n,         (numeric) height of the block of the transaction\n"
+            "    \"spending\" : true|false, (boolean) whether this is an input spending an output\n"
+            "    \"index\" : n,          (numeric) the output of the transaction, or its input if spending\n"
+            "    \"value\" : x.xxx,      (numeric) amount received, negative if spent\n"
+            "    \"prevtxid\" : \"hash\",  (string, if spending) the transaction of the output spent\n"
+            "    \"prevout\" : n,        (numeric, if spending) the output spent\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresshistory", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleCli("getaddresshistory", "\"b400\" 0 10")
+            + HelpExampleRpc("getaddresshistory", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 0, 10")
+            );
+
+    EnsureAddressIndex();
+
+    const CScript scriptPubKey = ParseAddressIndexScript(request.params[0]);
+    uint32_t nStart, nCount;
+    ParseListRange(request, 1, nStart, nCount);
+
+    std::vector<AddressHistoryEntry> vEntry;
+    g_addressindex->GetHistory(scriptPubKey, nStart, nCount, vEntry);
+
+    UniValue ret(UniValue::VARR);
+    for (const AddressHistoryEntry& entry : vEntry) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.txid.ToString()));
+        obj.push_back(Pair("height", entry.nHeight));
+        obj.push_back(Pair("spending", entry.fSpending));
+        obj.push_back(Pair("index", (int64_t)entry.nIndex));
+        obj.push_back(Pair("value", ValueFromAmount(entry.fSpending ? -entry.nValue : entry.nValue)));
+        if (entry.fSpending) {
+            obj.push_back(Pair("prevtxid", entry.prevout.hash.ToString()));
+            obj.push_back(Pair("prevout", (int64_t)entry.prevout.n));
+        }
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddressutxos \"address\" ( start count )\n"
+            "List the unspent outputs paying to an address or script.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The address or hex scriptPubKey\n"
+            "2. start          (numeric, optional) Number of outputs to skip\n"
+            "3. count          (numeric, optional) Maximum number of outputs to list\n"
+            "\nResult: (array)\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",      (string) the transaction\n"
+            "    \"vout\" : n,           (numeric) the output\n"
+            "    \"value\" : x.xxx,      (numeric) the amount\n"
+            "    \"height\" : n,         (numeric) height of the block of the transaction\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 0, 10")
+            );
+
+    EnsureAddressIndex();
+
+    const CScript scriptPubKey = ParseAddressIndexScript(request.params[0]);
+    uint32_t nStart, nCount;
+    ParseListRange(request, 1, nStart, nCount);
+
+    std::vector<AddressUnspentEntry> vEntry;
+    g_addressindex->GetUnspent(scriptPubKey, nStart, nCount, vEntry);
+
+    UniValue ret(UniValue::VARR);
+    for (const AddressUnspentEntry& entry : vEntry) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.out.hash.ToString()));
+        obj.push_back(Pair("vout", (int64_t)entry.out.n));
+        obj.push_back(Pair("value", ValueFromAmount(entry.nValue)));
+        obj.push_back(Pair("height", entry.nHeight));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue listsidechaindeposits(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() < 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 6)
         throw std::runtime_error(
             "listsidechaindeposits\n"
-            "List the most recent cached deposits for sidechain.\n"
-            "Optionally limited to count. Note that this only has access to "
-            "deposits which are currently cached.\n"
+            "List the most recent deposits for sidechain.\n"
+            "Optionally limited to count.\n"
             "\nArguments:\n"
-            "1. \"nsidechain\"  (numeric, required) The sidechain number\n"
-            "2. \"txid\"        (string, optional) Only return deposits after this deposit TXID\n"
-            "3. \"n\"           (numeric, optional, required if txid is set) The output index of the previous argument txn\n"
-            "4. \"count\"       (numeric, optional) The number of most recent deposits to list\n"
+            "1. \"nsidechain\"   (numeric, required) The sidechain number\n"
+            "2. \"txid\"         (string, optional) Only return deposits after this deposit TXID\n"
+            "3. \"n\"            (numeric, optional, required if txid is set) The output index of the previous argument txn\n"
+            "4. \"count\"        (numeric, optional) The number of most recent deposits to list\n"
+            "5. \"start\"        (numeric, optional) The number of most recent deposits to skip\n"
+            "6. \"since_height\" (numeric, optional) Only return deposits from blocks at or above this height\n"
+            "7. \"address\"      (string, optional) Only return deposits to this deposit address or destination\n"
             "\nExamples:\n"
             + HelpExampleCli("listsidechaindeposits", "\"sidechainkey\", \"count\"")
             + HelpExampleRpc("listsidechaindeposits", "\"sidechainkey\", \"count\"")
@@ -745,7 +1298,7 @@ UniValue listsidechaindeposits(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_MISC_ERROR, "Invalid sidechain number!");
 
     // If TXID was passed in, make sure we also received N
-    if (request.params.size() > 1 && request.params.size() < 3) {
+    if (!request.params[1].isNull() && request.params[2].isNull()) {
         std::string strError = "Output index 'n' is required if TXID is provided!";
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_MISC_ERROR, strError);
@@ -753,7 +1306,7 @@ UniValue listsidechaindeposits(const JSONRPCRequest& request)
 
     // Was a TXID passed in?
     uint256 txidKnown;
-    if (request.params.size() > 1) {
+    if (!request.params[1].isNull()) {
         std::string strTXID = request.params[1].get_str();
         txidKnown = uint256S(strTXID);
         if (txidKnown.IsNull()) {
@@ -765,81 +1318,134 @@ UniValue listsidechaindeposits(const JSONRPCRequest& request)
 
     // Was N passed in?
     uint32_t nKnown = 0;
-    if (request.params.size() > 2) {
+    if (!request.params[2].isNull()) {
         nKnown = request.params[2].get_int();
     }
 
-    // Get number of recent deposits to return (default is all cached deposits)
+    // Get number of recent deposits to return (default is all deposits)
     bool fLimit = false;
     int count = 0;
-    if (request.params.size() == 4) {
+    if (!request.params[3].isNull()) {
         fLimit = true;
         count = request.params[3].get_int();
     }
 
-    UniValue arr(UniValue::VARR);
+    // Get number of recent deposits to skip
+    uint32_t nSkip = 0;
+    if (!request.params[4].isNull()) {
+        int n = request.params[4].get_int();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start, must be positive");
+        nSkip = n;
+    }
 
-#ifdef ENABLE_WALLET
-    std::vector<SidechainDeposit> vDeposit = scdb.GetDeposits(nSidechain);
-
-    for (auto rit = vDeposit.crbegin(); rit != vDeposit.crend(); rit++) {
-        const SidechainDeposit d = *rit;
-
-        // Check if we have reached a deposit the sidechain already has. The
-        // sidechain can pass in a TXID & output index 'n' to let us know what
-        // the latest deposit they've already received is.
-        if (!txidKnown.IsNull() && d.tx.GetHash() == txidKnown && d.nBurnIndex == nKnown)
-        {
-            LogPrintf("%s: Reached known deposit. TXID: %s n: %u\n",
-                    __func__, txidKnown.ToString(), nKnown);
-            break;
-        }
+    // Get the lowest block height to return deposits from
+    int nSinceHeight = -1;
+    if (!request.params[5].isNull())
+        nSinceHeight = request.params[5].get_int();
 
-        // Add deposit txid to set
-        uint256 txid = d.tx.GetHash();
-        std::set<uint256> setTxids;
-        setTxids.insert(txid);
+    // Parse the destination filter once, deposits are matched by key
+    bool fDest = false;
+    uint160 destKey;
+    if (!request.params[6].isNull()) {
+        unsigned int nSidechainFromAddress = nSidechain;
+        destKey = ParseDepositDestKey(request.params[6].get_str(), nSidechainFromAddress);
+        if (nSidechainFromAddress != (unsigned int)nSidechain)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid sidechain deposit address - sidechain number mismatch");
+        fDest = true;
+    }
 
-        LOCK(cs_main);
+    UniValue arr(UniValue::VARR);
 
-        BlockMap::iterator it = mapBlockIndex.find(d.hashBlock);
-        if (it == mapBlockIndex.end()) {
-            std::string strError = "Block hash not found";
+#ifdef ENABLE_WALLET
+    // Read deposits from newest to oldest one page at a time, so that we stop
+    // reading from disk once we reach the known deposit or count
+    const uint32_t nPageSize = 100;
+    bool fDone = false;
+    uint32_t nEnd = scdb.GetDepositCount(nSidechain);
+    nEnd = nSkip < nEnd ? nEnd - nSkip : 0;
+    while (nEnd > 0 && !fDone) {
+        const uint32_t nStart = nEnd > nPageSize ? nEnd - nPageSize : 0;
+        std::vector<SidechainDeposit> vDeposit = scdb.GetDeposits(nSidechain, nStart, nEnd - nStart);
+        if (vDeposit.size() != nEnd - nStart) {
+            std::string strError = "Failed to read deposits";
             LogPrintf("%s: %s\n", __func__, strError);
             throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
         }
+        nEnd = nStart;
+
+        for (auto rit = vDeposit.crbegin(); rit != vDeposit.crend(); rit++) {
+            const SidechainDeposit& d = *rit;
+
+            // Check if we have reached a deposit the sidechain already has. The
+            // sidechain can pass in a TXID & output index 'n' to let us know what
+            // the latest deposit they've already received is.
+            if (!txidKnown.IsNull() && d.tx->GetHash() == txidKnown && d.nBurnIndex == nKnown)
+            {
+                LogPrintf("%s: Reached known deposit. TXID: %s n: %u\n",
+                        __func__, txidKnown.ToString(), nKnown);
+                fDone = true;
+                break;
+            }
 
-        CBlockIndex* pblockindex = it->second;
-        if (pblockindex == NULL) {
-            std::string strError = "Block index null";
-            LogPrintf("%s: %s\n", __func__, strError);
-            throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
-        }
+            // Add deposit txid to set
+            uint256 txid = d.tx->GetHash();
+            std::set<uint256> setTxids;
+            setTxids.insert(txid);
 
-        if (!chainActive.Contains(pblockindex)) {
-            std::string strError = "Block not in active chain";
-            LogPrintf("%s: %s\n", __func__, strError);
-            throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
-        }
+            LOCK(cs_main);
+
+            BlockMap::iterator it = mapBlockIndex.find(d.hashBlock);
+            if (it == mapBlockIndex.end()) {
+                std::string strError = "Block hash not found";
+                LogPrintf("%s: %s\n", __func__, strError);
+                throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+            }
+
+            CBlockIndex* pblockindex = it->second;
+            if (pblockindex == NULL) {
+                std::string strError = "Block index null";
+                LogPrintf("%s: %s\n", __func__, strError);
+                throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+            }
+
+            if (!chainActive.Contains(pblockindex)) {
+                std::string strError = "Block not in active chain";
+                LogPrintf("%s: %s\n", __func__, strError);
+                throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+            }
+
+            // Deposits are in chain order, the rest are older
+            if (pblockindex->nHeight < nSinceHeight) {
+                fDone = true;
+                break;
+            }
 #endif
 
 #ifdef ENABLE_WALLET
-        UniValue obj(UniValue::VOBJ);
-        obj.push_back(Pair("nsidechain", d.nSidechain));
-        obj.push_back(Pair("strdest", d.strDest));
-        obj.push_back(Pair("txhex", EncodeHexTx(d.tx)));
-        obj.push_back(Pair("nburnindex", (int)d.nBurnIndex));
-        obj.push_back(Pair("ntx", (int)d.nTx));
-        obj.push_back(Pair("hashblock", d.hashBlock.ToString()));
+            if (fDest && !d.HasDest(destKey))
+                continue;
 
-        arr.push_back(obj);
-#endif
-        if (fLimit) {
-            count--;
-            if (count <= 0)
-                break;
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("nsidechain", d.nSidechain));
+            obj.push_back(Pair("strdest", d.strDest));
+            obj.push_back(Pair("txhex", EncodeHexTx(*d.tx)));
+            obj.push_back(Pair("nburnindex", (int)d.nBurnIndex));
+            obj.push_back(Pair("ntx", (int)d.nTx));
+            obj.push_back(Pair("hashblock", d.hashBlock.ToString()));
+
+            arr.push_back(obj);
+
+            if (fLimit) {
+                count--;
+                if (count <= 0) {
+                    fDone = true;
+                    break;
+                }
+            }
         }
     }
+#endif
 
     return arr;
 }
@@ -849,9 +1455,7 @@ UniValue countsidechaindeposits(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size() != 1)
         throw std::runtime_error(
             "countsidechaindeposits\n"
-            "Returns the number of deposits (for nSidechain) currently cached. "
-            "Note that this doesn't count all sidechain deposits, just the "
-            "number currently cached by the node.\n"
+            "Returns the number of deposits for nSidechain.\n"
             "\nArguments:\n"
             "1. \"nsidechain\"      (numeric, required) The sidechain number\n"
             "\nExamples:\n"
@@ -873,13 +1477,7 @@ UniValue countsidechaindeposits(const JSONRPCRequest& request)
     if (!scdb.IsSidechainActive(nSidechain))
         throw JSONRPCError(RPC_MISC_ERROR, "Invalid sidechain number");
 
-    int count = 0;
-
-    // Get latest deposit from sidechain DB deposit cache
-    std::vector<SidechainDeposit> vDeposit = scdb.GetDeposits(nSidechain);
-    count = vDeposit.size();
-
-    return count;
+    return (int64_t)scdb.GetDepositCount(nSidechain);
 }
 
 UniValue addwithdrawal(const JSONRPCRequest& request)
@@ -968,9 +1566,17 @@ UniValue receivewithdrawalbundle(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_MISC_ERROR, strError);
     }
 
-    CTransaction withdrawal(mtx);
+    CTransactionRef withdrawal = MakeTransactionRef(std::move(mtx));
 
-    if (withdrawal.IsNull()) {
+    if (withdrawal->IsNull()) {
+        strError = "Invalid withdrawal hex";
+        LogPrintf("%s: %s\n", __func__, strError);
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    // Analyzed once here, SCDB keeps the result with the cached transaction
+    std::shared_ptr<const WithdrawalBundleInfo> info = GetWithdrawalBundleInfo(*withdrawal);
+    if (!info) {
         strError = "Invalid withdrawal hex";
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_MISC_ERROR, strError);
@@ -978,7 +1584,7 @@ UniValue receivewithdrawalbundle(const JSONRPCRequest& request)
 
     // Reject the withdrawal if it spends more than the sidechain's CTIP as it won't
     // be accepted anyway
-    CAmount amount = withdrawal.GetValueOut();
+    CAmount amount = info->amountOut;
     std::vector<COutput> vSidechainCoin;
     CScript scriptPubKey;
     if (!scdb.GetSidechainScript(nSidechain, scriptPubKey)) {
@@ -1001,34 +1607,10 @@ UniValue receivewithdrawalbundle(const JSONRPCRequest& request)
     }
 
     // Check for the required withdrawal change return destination OP_RETURN output
-    for (size_t i = 0; i < mtx.vout.size(); i++) {
-        const CScript& scriptPubKey = mtx.vout[i].scriptPubKey;
-        if (!scriptPubKey.size())
-            continue;
-        if (scriptPubKey.front() != OP_RETURN)
-            continue;
-
-        if (scriptPubKey.size() < 3) {
-            strError = "Rejecting Withdrawal: First OP_RETURN output invalid size (too small)!\n";
-            LogPrintf("%s: %s\n", __func__, strError);
-            throw JSONRPCError(RPC_MISC_ERROR, strError);
-        }
-
-        CScript::const_iterator pDest = scriptPubKey.begin() + 1;
-        opcodetype opcode;
-        std::vector<unsigned char> vch;
-        if (!scriptPubKey.GetOp(pDest, opcode, vch) || vch.empty()) {
-            strError = "Rejecting Withdrawal: First OP_RETURN output invalid. (Failed GetOp)!\n";
-            LogPrintf("%s: %s\n", __func__, strError);
-            throw JSONRPCError(RPC_MISC_ERROR, strError);
-        }
-        std::string strDest((const char*)vch.data(), vch.size());
-        if (strDest != SIDECHAIN_WITHDRAWAL_RETURN_DEST) {
-            strError = "Rejecting Withdrawal: First OP_RETURN output invalid. (incorrect dest)!\n";
-            LogPrintf("%s: %s\n", __func__, strError);
-            throw JSONRPCError(RPC_MISC_ERROR, strError);
-        }
-        break;
+    if (!info->strReturnDestError.empty()) {
+        strError = "Rejecting Withdrawal: " + info->strReturnDestError;
+        LogPrintf("%s: %s\n", __func__, strError);
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
     }
 
     // Add Withdrawal to our local cache so that we can create a Withdrawal hash commitment
@@ -1041,10 +1623,60 @@ UniValue receivewithdrawalbundle(const JSONRPCRequest& request)
 
     // Return Withdrawal hash to verify it has been received
     UniValue ret(UniValue::VOBJ);
-    ret.push_back(Pair("wtxid", withdrawal.GetHash().GetHex()));
+    ret.push_back(Pair("wtxid", withdrawal->GetHash().GetHex()));
     return ret;
 }
 
+/** Check whether the block at pindex commits to hashBMM for nSidechain.
+ * With -bmmindex every block in the active chain is answered from the index,
+ * recently connected blocks from the BMM cache, anything else is read from
+ * disk. Sets strError if h* is not found. */
+static bool LookupBMM(const CBlockIndex* pindex, const uint256& hashBMM, uint8_t nSidechain, uint256& txidCoinbase, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+
+    if (fBMMIndex && chainActive.Contains(pindex)) {
+        if (!pblocktree->ReadBMMIndex(pindex->GetBlockHash(), nSidechain, hashBMM, txidCoinbase)) {
+            strError = "h* not found in block";
+            return false;
+        }
+        return true;
+    }
+
+    // Sidechains mostly ask about recent blocks, and again on reorgs
+    bool fFound = false;
+    if (g_bmmcache && g_bmmcache->Lookup(pindex->GetBlockHash(), nSidechain, hashBMM, fFound, txidCoinbase)) {
+        if (!fFound)
+            strError = "h* not found in block";
+        return fFound;
+    }
+
+    // Several sidechains tend to ask about the same recent blocks
+    std::shared_ptr<const CBlock> pblock = ReadBlockCached(pindex, Params().GetConsensus());
+    if (!pblock) {
+        strError = "Failed to read block from disk";
+        return false;
+    }
+    const CBlock& block = *pblock;
+
+    if (!block.vtx.size()) {
+        strError = "No txns in block";
+        return false;
+    }
+
+    std::vector<std::pair<uint8_t, uint256>> vCommit;
+    GetBMMCommits(block, vCommit);
+    for (const std::pair<uint8_t, uint256>& commit : vCommit) {
+        if (commit.first == nSidechain && commit.second == hashBMM) {
+            txidCoinbase = block.vtx[0]->GetHash();
+            return true;
+        }
+    }
+
+    strError = "h* not found in block";
+    return false;
+}
+
 UniValue verifybmm(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 3)
@@ -1071,6 +1703,8 @@ UniValue verifybmm(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_MISC_ERROR, strError);
     }
 
+    LOCK(cs_main);
+
     if (!mapBlockIndex.count(hashBlock)) {
         std::string strError = "Block not found";
         LogPrintf("%s: %s\n", __func__, strError);
@@ -1085,65 +1719,154 @@ UniValue verifybmm(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_MISC_ERROR, strError);
     }
 
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-    {
-        std::string strError = "Failed to read block from disk";
+    uint256 txidCoinbase;
+    std::string strError = "";
+    if (!LookupBMM(pblockindex, hashBMM, nSidechain, txidCoinbase, strError)) {
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_MISC_ERROR, strError);
     }
 
-    if (!block.vtx.size()) {
-        std::string strError = "No txns in block";
-        LogPrintf("%s: %s\n", __func__, strError);
-        throw JSONRPCError(RPC_MISC_ERROR, strError);
-    }
+    UniValue ret(UniValue::VOBJ);
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", txidCoinbase.ToString()));
+    obj.push_back(Pair("time", itostr(pblockindex->nTime)));
+    ret.push_back(Pair("bmm", obj));
 
-    bool fBMMFound = false;
-    const CTransaction &txCoinbase = *(block.vtx[0]);
-    for (const CTxOut& out : txCoinbase.vout) {
-        const CScript& scriptPubKey = out.scriptPubKey;
+    return ret;
+}
 
-        uint256 hashCritical = uint256();
-        std::vector<unsigned char> vBytes;
-        if (!scriptPubKey.IsCriticalHashCommit(hashCritical, vBytes))
-            continue;
+UniValue verifybmmbatch(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "verifybmmbatch\n"
+            "Check a list of mainchain blocks for BMM of sidechain h*\n"
+            "\nArguments:\n"
+            "1. \"requests\"       (array, required) BMM to verify\n"
+            "     [\n"
+            "       {\n"
+            "         \"blockhash\": \"hash\", (string, required) mainchain blockhash with h*\n"
+            "         \"bmmhash\": \"hash\",   (string, required) h* to locate\n"
+            "         \"nsidechain\": n,       (number, required) sidechain number\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+            "\nResult: (array, one entry per request in the same order)\n"
+            "[\n"
+            "  {\n"
+            "    \"blockhash\": \"hash\", (string) mainchain blockhash\n"
+            "    \"bmmhash\": \"hash\",   (string) h*\n"
+            "    \"nsidechain\": n,       (number) sidechain number\n"
+            "    \"found\": true|false,   (boolean) whether the block includes h*\n"
+            "    \"txid\": \"hash\",      (string, if found) coinbase txid\n"
+            "    \"time\": \"n\",         (string, if found) block time\n"
+            "    \"error\": \"str\",      (string, if not found) reason\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("verifybmmbatch", "\"[{\\\"blockhash\\\":\\\"hash\\\",\\\"bmmhash\\\":\\\"hash\\\",\\\"nsidechain\\\":0}]\"")
+            + HelpExampleRpc("verifybmmbatch", "[{\"blockhash\":\"hash\",\"bmmhash\":\"hash\",\"nsidechain\":0}]")
+            );
 
-        // Create critical data object and validate BMM
-        CCriticalData data;
-        data.hashCritical = hashCritical;
-        data.vBytes = vBytes;
+    RPCTypeCheck(request.params, {UniValue::VARR});
 
-        uint8_t nSidechainBMM;
-        std::string strPrevBlock = "";
-        if (!data.IsBMMRequest(nSidechainBMM, strPrevBlock))
-            continue;
+    const UniValue& requests = request.params[0].get_array();
 
-        // Check sidechain number
-        if (nSidechain != nSidechainBMM)
-            continue;
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < requests.size(); i++) {
+        const UniValue& req = requests[i];
+        RPCTypeCheckObj(req,
+            {
+                {"blockhash", UniValueType(UniValue::VSTR)},
+                {"bmmhash", UniValueType(UniValue::VSTR)},
+                {"nsidechain", UniValueType(UniValue::VNUM)},
+            });
+
+        uint256 hashBlock = ParseHashO(req, "blockhash");
+        uint256 hashBMM = ParseHashO(req, "bmmhash");
+        int nSidechain = find_value(req, "nsidechain").get_int();
 
-        // Check prev block bytes
-        if (strPrevBlock != block.hashPrevBlock.ToString().substr(56, 63))
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("blockhash", hashBlock.ToString()));
+        obj.push_back(Pair("bmmhash", hashBMM.ToString()));
+        obj.push_back(Pair("nsidechain", nSidechain));
+
+        uint256 txidCoinbase;
+        std::string strError = "";
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (nSidechain < 0 || nSidechain > 255 || !scdb.IsSidechainActive(nSidechain)) {
+            strError = "Invalid sidechain number!";
+        } else if (it == mapBlockIndex.end() || it->second == nullptr) {
+            strError = "Block not found";
+        } else if (LookupBMM(it->second, hashBMM, nSidechain, txidCoinbase, strError)) {
+            obj.push_back(Pair("found", true));
+            obj.push_back(Pair("txid", txidCoinbase.ToString()));
+            obj.push_back(Pair("time", itostr(it->second->nTime)));
+            ret.push_back(obj);
             continue;
+        }
 
-        // Check h*
-        if (hashBMM == data.hashCritical)
-            fBMMFound = true;
+        obj.push_back(Pair("found", false));
+        obj.push_back(Pair("error", strError));
+        ret.push_back(obj);
     }
 
-    if (!fBMMFound) {
-        std::string strError = "h* not found in block";
+    return ret;
+}
+
+UniValue waitforbmm(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
+        throw std::runtime_error(
+            "waitforbmm \"bmmhash\" nsidechain (timeout)\n"
+            "Wait until a block connected to the active chain includes BMM of a\n"
+            "sidechain h*, or until the timeout. Blocks in the BMM cache\n"
+            "(-bmmcache) connected before the call are found right away.\n"
+            "\nArguments:\n"
+            "1. \"bmmhash\"        (string, required) h* to wait for\n"
+            "2. nsidechain       (numeric, required) sidechain number\n"
+            "3. timeout          (numeric, optional, default=0) time in milliseconds to wait, 0 to wait forever\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"found\": true|false,   (boolean) whether a block includes h*\n"
+            "  \"blockhash\": \"hash\", (string, if found) mainchain blockhash with h*\n"
+            "  \"height\": n,           (numeric, if found) block height\n"
+            "  \"txid\": \"hash\",      (string, if found) coinbase txid\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("waitforbmm", "\"bmmhash\" 0 1000")
+            + HelpExampleRpc("waitforbmm", "\"bmmhash\", 0, 1000")
+            );
+
+    uint256 hashBMM = ParseHashV(request.params[0], "bmmhash");
+    int nSidechain = request.params[1].get_int();
+    int64_t nTimeout = 0;
+    if (!request.params[2].isNull())
+        nTimeout = request.params[2].get_int64();
+
+    if (nSidechain < 0 || nSidechain > 255 || !scdb.IsSidechainActive(nSidechain)) {
+        std::string strError = "Invalid sidechain number!";
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_MISC_ERROR, strError);
     }
 
+    if (!g_bmmcache)
+        throw JSONRPCError(RPC_MISC_ERROR, "BMM cache disabled (-bmmcache=0)");
+
+    BMMCacheResult result;
     UniValue ret(UniValue::VOBJ);
-    UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("txid", txCoinbase.GetHash().ToString()));
-    obj.push_back(Pair("time", itostr(block.nTime)));
-    ret.push_back(Pair("bmm", obj));
+    if (!g_bmmcache->WaitForBMM(hashBMM, nSidechain, nTimeout, result)) {
+        ret.push_back(Pair("found", false));
+        return ret;
+    }
 
+    ret.push_back(Pair("found", true));
+    ret.push_back(Pair("blockhash", result.hashBlock.ToString()));
+    ret.push_back(Pair("height", result.nHeight));
+    ret.push_back(Pair("txid", result.txidCoinbase.ToString()));
     return ret;
 }
 
@@ -1158,14 +1881,16 @@ UniValue verifydeposit(const JSONRPCRequest& request)
             "2. \"txid\"           (string, required) deposit txid to locate\n"
             "3. \"nTx\"            (int, required) deposit tx number in block\n"
             "\nExamples:\n"
-            + HelpExampleCli("verifybmm", "\"blockhash\", \"txid\"")
-            + HelpExampleRpc("verifybmm", "\"blockhash\", \"txid\"")
+            + HelpExampleCli("verifydeposit", "\"blockhash\", \"txid\", nTx")
+            + HelpExampleRpc("verifydeposit", "\"blockhash\", \"txid\", nTx")
             );
 
     uint256 hashBlock = uint256S(request.params[0].get_str());
     uint256 txid = uint256S(request.params[1].get_str());
     int nTx = request.params[2].get_int();
 
+    LOCK(cs_main);
+
     if (!mapBlockIndex.count(hashBlock)) {
         std::string strError = "Block not found";
         LogPrintf("%s: %s\n", __func__, strError);
@@ -1180,47 +1905,105 @@ UniValue verifydeposit(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
     }
 
-    if (!scdb.HaveDepositCached(txid)) {
+    // SCDB only tracks deposits that passed TxnToDeposit in ConnectBlock, and
+    // records where they were found, so there is no need to read the block
+    SidechainDeposit deposit;
+    CAmount amount;
+    if (!scdb.GetDeposit(txid, deposit, amount)) {
         std::string strError = "SCDB does not know deposit";
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
     }
 
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-    {
-        std::string strError = "Failed to read block from disk";
+    if (deposit.hashBlock != hashBlock || (int)deposit.nTx != nTx) {
+        std::string strError = "Transaction at block index specified does not match txid";
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
     }
 
-    if (!block.vtx.size()) {
-        std::string strError = "No txns in block";
-        LogPrintf("%s: %s\n", __func__, strError);
-        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
-    }
+    return txid.ToString();
+}
 
-    if ((int)block.vtx.size() <= nTx) {
-        std::string strError = "nTx out of range for block";
-        LogPrintf("%s: %s\n", __func__, strError);
-        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
-    }
+UniValue verifydepositbatch(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "verifydepositbatch\n"
+            "Check a list of deposits against the mainchain blocks that include them.\n"
+            "\nArguments:\n"
+            "1. \"requests\"       (array, required) Deposits to verify\n"
+            "     [\n"
+            "       {\n"
+            "         \"blockhash\": \"hash\", (string, required) mainchain blockhash with deposit\n"
+            "         \"txid\": \"hash\",      (string, required) deposit txid to locate\n"
+            "         \"ntx\": n,              (number, required) deposit tx number in block\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+            "\nResult: (array, one entry per request in the same order)\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\": \"hash\",       (string) deposit txid\n"
+            "    \"valid\": true|false,    (boolean) whether the deposit is in the block at ntx\n"
+            "    \"nsidechain\": n,        (number, if valid) sidechain number\n"
+            "    \"nburnindex\": n,        (number, if valid) deposit output index\n"
+            "    \"amount\": x.xxx,        (numeric, if valid) amount deposited\n"
+            "    \"error\": \"str\",       (string, if not valid) reason\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("verifydepositbatch", "\"[{\\\"blockhash\\\":\\\"hash\\\",\\\"txid\\\":\\\"hash\\\",\\\"ntx\\\":1}]\"")
+            + HelpExampleRpc("verifydepositbatch", "[{\"blockhash\":\"hash\",\"txid\":\"hash\",\"ntx\":1}]")
+            );
 
-    const CTransaction &tx = *(block.vtx[nTx]);
-    if (tx.GetHash() != txid) {
-        std::string strError = "Transaction at block index specified does not match txid";
-        LogPrintf("%s: %s\n", __func__, strError);
-        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
-    }
+    RPCTypeCheck(request.params, {UniValue::VARR});
+
+    const UniValue& requests = request.params[0].get_array();
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < requests.size(); i++) {
+        const UniValue& req = requests[i];
+        RPCTypeCheckObj(req,
+            {
+                {"blockhash", UniValueType(UniValue::VSTR)},
+                {"txid", UniValueType(UniValue::VSTR)},
+                {"ntx", UniValueType(UniValue::VNUM)},
+            });
+
+        uint256 hashBlock = ParseHashO(req, "blockhash");
+        uint256 txid = ParseHashO(req, "txid");
+        int nTx = find_value(req, "ntx").get_int();
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", txid.ToString()));
+
+        SidechainDeposit deposit;
+        CAmount amount;
+        std::string strError = "";
+        if (!mapBlockIndex.count(hashBlock)) {
+            strError = "Block not found";
+        } else if (!scdb.GetDeposit(txid, deposit, amount)) {
+            strError = "SCDB does not know deposit";
+        } else if (deposit.hashBlock != hashBlock || (int)deposit.nTx != nTx) {
+            strError = "Transaction at block index specified does not match txid";
+        } else {
+            obj.push_back(Pair("valid", true));
+            obj.push_back(Pair("nsidechain", deposit.nSidechain));
+            obj.push_back(Pair("nburnindex", (int)deposit.nBurnIndex));
+            obj.push_back(Pair("amount", ValueFromAmount(amount)));
+            ret.push_back(obj);
+            continue;
+        }
 
-    SidechainDeposit deposit;
-    if (!scdb.TxnToDeposit(tx, nTx, hashBlock, deposit)) {
-        std::string strError = "Invalid deposit transaction format";
-        LogPrintf("%s: %s\n", __func__, strError);
-        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+        obj.push_back(Pair("valid", false));
+        obj.push_back(Pair("error", strError));
+        ret.push_back(obj);
     }
 
-    return tx.GetHash().ToString();
+    return ret;
 }
 
 UniValue listpreviousblockhashes(const JSONRPCRequest& request)
@@ -1269,9 +2052,9 @@ UniValue listactivesidechains(const JSONRPCRequest& request)
             + HelpExampleRpc("listactivesidechains", "")
             );
 
-    std::vector<Sidechain> vActive = scdb.GetActiveSidechains();
+    std::shared_ptr<const std::vector<Sidechain>> vActive = scdb.GetActiveSidechainsView();
     UniValue ret(UniValue::VARR);
-    for (const Sidechain& s : vActive) {
+    for (const Sidechain& s : *vActive) {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("title", s.title));
         obj.push_back(Pair("description", s.description));
@@ -1297,8 +2080,9 @@ UniValue listsidechainactivationstatus(const JSONRPCRequest& request)
             + HelpExampleRpc("listsidechainactivationstatus", "")
             );
 
-    std::vector<SidechainActivationStatus> vStatus;
-    vStatus = scdb.GetSidechainActivationStatus();
+    LOCK(cs_main);
+
+    const std::vector<SidechainActivationStatus>& vStatus = scdb.GetSidechainActivationStatus();
 
     UniValue ret(UniValue::VARR);
     for (const SidechainActivationStatus& s : vStatus) {
@@ -1354,8 +2138,9 @@ UniValue getsidechainactivationstatus(const JSONRPCRequest& request)
             + HelpExampleRpc("getsidechainactivationstatus", "")
             );
 
-    std::vector<SidechainActivationStatus> vStatus;
-    vStatus = scdb.GetSidechainActivationStatus();
+    LOCK(cs_main);
+
+    const std::vector<SidechainActivationStatus>& vStatus = scdb.GetSidechainActivationStatus();
 
     UniValue ret(UniValue::VARR);
     for (const SidechainActivationStatus& s : vStatus) {
@@ -1564,6 +2349,35 @@ UniValue listwithdrawalvotes(const JSONRPCRequest& request)
     return ret;
 }
 
+/** Get the fees and number of transactions of the active chain blocks from
+ * nHeightStart to nHeightEnd from the block fee stats */
+static bool ReadFeeStatsRange(int nHeightStart, int nHeightEnd, CAmount& nFees, uint64_t& nTx)
+{
+    AssertLockHeld(cs_main);
+
+    CDiskBlockFeeStats end;
+    if (!pblocktree->ReadBlockFeeStats(chainActive[nHeightEnd]->GetBlockHash(), end))
+        return false;
+    if (end.nHeightStart > nHeightStart)
+        return false;
+
+    nFees = end.nFeesTotal;
+    nTx = end.nTxTotal;
+    if (end.nHeightStart == nHeightStart)
+        return true;
+
+    // Subtract the running totals from before the range
+    CDiskBlockFeeStats before;
+    if (!pblocktree->ReadBlockFeeStats(chainActive[nHeightStart - 1]->GetBlockHash(), before))
+        return false;
+    if (before.nHeightStart != end.nHeightStart)
+        return false;
+
+    nFees -= before.nFeesTotal;
+    nTx -= before.nTxTotal;
+    return true;
+}
+
 UniValue getaveragefee(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2)
@@ -1585,6 +2399,8 @@ UniValue getaveragefee(const JSONRPCRequest& request)
     if (request.params.size() >= 1)
         nBlocks = request.params[0].get_int();
 
+    LOCK(cs_main);
+
     int nHeight = chainActive.Height();
     if (request.params.size() == 2) {
         int nHeightIn = request.params[1].get_int();
@@ -1594,40 +2410,41 @@ UniValue getaveragefee(const JSONRPCRequest& request)
         nHeight = nHeightIn;
     }
 
-    if (nBlocks > nHeight)
+    if (nBlocks < 0 || nBlocks > nHeight)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Invalid number of blocks!");
 
-    int nTx = 0;
+    uint64_t nTx = 0;
     CAmount nTotalFees = 0;
-    for (int i = nHeight; i >= (nHeight - nBlocks); i--) {
-        uint256 hashBlock = chainActive[i]->GetBlockHash();
-
-        if (mapBlockIndex.count(hashBlock) == 0)
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-
-        CBlock block;
-        CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
-
-        // We don't have the coins (they are spent) to look up the transaction
-        // input amounts for calculation of fees. Instead, get the block subsidy
-        // for the height and subtract it from the coinbase output amount to
-        // estimate fees paid in the block.
-        CAmount nSubsidy = GetBlockSubsidy(i, Params().GetConsensus());
-        CAmount nCoinbase = block.vtx[0]->GetValueOut();
-
-        // Record total fees in the block
-        nTotalFees += nCoinbase - nSubsidy;
-        // Record number of transactions
-        nTx += block.vtx.size();
+    if (!ReadFeeStatsRange(nHeight - nBlocks, nHeight, nTotalFees, nTx)) {
+        // Blocks connected before the fee stats were recorded, read them
+        nTx = 0;
+        nTotalFees = 0;
+        for (int i = nHeight; i >= (nHeight - nBlocks); i--) {
+            CBlockIndex* pblockindex = chainActive[i];
+
+            CBlock block;
+            if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+                throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+
+            // We don't have the coins (they are spent) to look up the transaction
+            // input amounts for calculation of fees. Instead, get the block subsidy
+            // for the height and subtract it from the coinbase output amount to
+            // estimate fees paid in the block.
+            CAmount nSubsidy = GetBlockSubsidy(i, Params().GetConsensus());
+            CAmount nCoinbase = block.vtx[0]->GetValueOut();
+
+            // Record total fees in the block
+            nTotalFees += nCoinbase - nSubsidy;
+            // Record number of transactions
+            nTx += block.vtx.size();
+        }
     }
 
     UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("feeaverage", ValueFromAmount(nTotalFees / nTx)));
+    result.push_back(Pair("feeaverage", ValueFromAmount(nTotalFees / (CAmount)nTx)));
     return result;
 }
 
@@ -1652,7 +2469,10 @@ UniValue getworkscore(const JSONRPCRequest& request)
     // nSidechain
     int nSidechain = request.params[0].get_int();
 
-    if (!scdb.IsSidechainActive(nSidechain))
+    std::shared_ptr<const SidechainView> view;
+    if (nSidechain >= 0 && nSidechain <= 255)
+        view = scdb.GetSidechainView(nSidechain);
+    if (!view)
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid Sidechain number");
 
     std::string strHash = request.params[1].get_str();
@@ -1663,7 +2483,7 @@ UniValue getworkscore(const JSONRPCRequest& request)
     if (hash.IsNull())
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid Withdrawal hash");
 
-    std::vector<SidechainWithdrawalState> vState = scdb.GetState(nSidechain);
+    const std::vector<SidechainWithdrawalState>& vState = view->vWithdrawalStatus;
     if (vState.empty())
         throw JSONRPCError(RPC_TYPE_ERROR, "No Withdrawal(s) in SCDB for sidechain");
 
@@ -1683,12 +2503,14 @@ UniValue getworkscore(const JSONRPCRequest& request)
 
 UniValue listwithdrawalstatus(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-            "listwithdrawalstatus \"nsidechain\")\n"
+            "listwithdrawalstatus \"nsidechain\" ( start count )\n"
             "Request the workscore of a Withdrawal\n"
             "\nArguments:\n"
             "1. nsidechain     (numeric, required) Sidechain number to look up Withdrawal(s) of\n"
+            "2. start          (numeric, optional) Number of Withdrawal(s) to skip\n"
+            "3. count          (numeric, optional) Maximum number of Withdrawal(s) to list\n"
             "\nResult:\n"
             "{\n"
             "  \"hash\" : (string) hash of Withdrawal\n"
@@ -1703,13 +2525,20 @@ UniValue listwithdrawalstatus(const JSONRPCRequest& request)
     // nSidechain
     int nSidechain = request.params[0].get_int();
 
-    if (!scdb.IsSidechainActive(nSidechain))
+    std::shared_ptr<const SidechainView> view;
+    if (nSidechain >= 0 && nSidechain <= 255)
+        view = scdb.GetSidechainView(nSidechain);
+    if (!view)
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid Sidechain number");
 
-    std::vector<SidechainWithdrawalState> vState = scdb.GetState(nSidechain);
+    uint32_t nStart, nCount;
+    ParseListRange(request, 1, nStart, nCount);
+
+    const std::vector<SidechainWithdrawalState>& vState = view->vWithdrawalStatus;
 
     UniValue ret(UniValue::VARR);
-    for (const SidechainWithdrawalState& s : vState) {
+    for (size_t i = nStart; i < vState.size() && ret.size() < nCount; i++) {
+        const SidechainWithdrawalState& s = vState[i];
         UniValue obj(UniValue::VOBJ);
 
         obj.push_back(Pair("hash", s.hash.ToString()));
@@ -1722,14 +2551,240 @@ UniValue listwithdrawalstatus(const JSONRPCRequest& request)
     return ret;
 }
 
+/**
+ * Wait for the change counted by pSequence to the state of the sidechain at
+ * request.params[0]. Waits for the sequence number to differ from the one
+ * at request.params[1], the current one if it isn't set, so that a client
+ * passing back the last sequence number it got doesn't miss a change.
+ * request.params[2] is the timeout in milliseconds, 0 to wait forever.
+ */
+static std::shared_ptr<const SidechainView> WaitForSidechainChange(const JSONRPCRequest& request, uint64_t SidechainViewSequence::*pSequence, bool& fChanged)
+{
+    int nSidechain = request.params[0].get_int();
+
+    std::shared_ptr<const SidechainView> view;
+    if (nSidechain >= 0 && nSidechain <= 255)
+        view = scdb.GetSidechainView(nSidechain);
+    if (!view)
+        throw JSONRPCError(RPC_MISC_ERROR, "Invalid sidechain number!");
+
+    uint64_t nSequence = view->sequence.*pSequence;
+    if (!request.params[1].isNull()) {
+        int64_t n = request.params[1].get_int64();
+        if (n < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sequence, must be positive");
+        nSequence = n;
+    }
+
+    int64_t nTimeout = 0;
+    if (!request.params[2].isNull())
+        nTimeout = request.params[2].get_int64();
+
+    view = scdb.WaitForView(nSidechain, [pSequence, nSequence](const std::shared_ptr<const SidechainView>& v) {
+        return !v || v->sequence.*pSequence != nSequence || !IsRPCRunning();
+    }, nTimeout);
+
+    if (!view)
+        throw JSONRPCError(RPC_MISC_ERROR, "Sidechain is no longer active!");
+
+    fChanged = view->sequence.*pSequence != nSequence;
+    return view;
+}
+
+UniValue waitforsidechainctip(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "waitforsidechainctip nsidechain ( sequence timeout )\n"
+            "Wait for the CTIP of a sidechain to change and return it.\n"
+            "\nArguments:\n"
+            "1. nsidechain     (numeric, required) The sidechain number\n"
+            "2. sequence       (numeric, optional) Sequence number of the last CTIP seen, returns right away if it has changed since. Default is the current CTIP.\n"
+            "3. timeout        (numeric, optional, default=0) Time in milliseconds to wait, 0 to wait forever\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"changed\": true|false,   (boolean) whether the CTIP changed, false on timeout\n"
+            "  \"sequence\": n,           (numeric) sequence number of the CTIP returned\n"
+            "  \"txid\": \"hash\",        (string) CTIP txid, if the sidechain has one\n"
+            "  \"n\": n,                  (numeric) CTIP output index\n"
+            "  \"amount\": n,             (numeric) CTIP amount\n"
+            "  \"amountformatted\": n,    (string) CTIP amount formatted\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("waitforsidechainctip", "0 12 1000")
+            + HelpExampleRpc("waitforsidechainctip", "0, 12, 1000")
+            );
+
+    bool fChanged = false;
+    std::shared_ptr<const SidechainView> view = WaitForSidechainChange(request, &SidechainViewSequence::nCTIP, fChanged);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("changed", fChanged));
+    obj.push_back(Pair("sequence", (int64_t)view->sequence.nCTIP));
+    if (view->fHaveCTIP) {
+        const SidechainCTIP& ctip = view->ctip;
+        obj.push_back(Pair("txid", ctip.out.hash.ToString()));
+        obj.push_back(Pair("n", (int64_t)ctip.out.n));
+        obj.push_back(Pair("amount", ctip.amount));
+        obj.push_back(Pair("amountformatted", FormatMoney(ctip.amount)));
+    }
+
+    return obj;
+}
+
+UniValue waitforwithdrawalstatus(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "waitforwithdrawalstatus nsidechain ( sequence timeout )\n"
+            "Wait for a withdrawal of a sidechain to be added, removed or to\n"
+            "have its workscore change, and return the withdrawals.\n"
+            "\nArguments:\n"
+            "1. nsidechain     (numeric, required) The sidechain number\n"
+            "2. sequence       (numeric, optional) Sequence number of the last withdrawal status seen, returns right away if it has changed since. Default is the current status.\n"
+            "3. timeout        (numeric, optional, default=0) Time in milliseconds to wait, 0 to wait forever\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"changed\": true|false,   (boolean) whether the withdrawals changed, false on timeout\n"
+            "  \"sequence\": n,           (numeric) sequence number of the status returned\n"
+            "  \"withdrawals\": [         (array) as returned by listwithdrawalstatus\n"
+            "    {\n"
+            "      \"hash\" : (string) hash of Withdrawal\n"
+            "      \"nblocksleft\" : x, (numeric) verification blocks remaining\n"
+            "      \"nworkscore\" : x, (numeric) workscore of Withdrawal\n"
+            "    }\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("waitforwithdrawalstatus", "0 12 1000")
+            + HelpExampleRpc("waitforwithdrawalstatus", "0, 12, 1000")
+            );
+
+    bool fChanged = false;
+    std::shared_ptr<const SidechainView> view = WaitForSidechainChange(request, &SidechainViewSequence::nWithdrawal, fChanged);
+
+    UniValue arr(UniValue::VARR);
+    for (const SidechainWithdrawalState& s : view->vWithdrawalStatus) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("hash", s.hash.ToString()));
+        obj.push_back(Pair("nblocksleft", s.nBlocksLeft));
+        obj.push_back(Pair("nworkscore", s.nWorkScore));
+        arr.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("changed", fChanged));
+    ret.push_back(Pair("sequence", (int64_t)view->sequence.nWithdrawal));
+    ret.push_back(Pair("withdrawals", arr));
+
+    return ret;
+}
+
+UniValue waitfordeposits(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "waitfordeposits nsidechain ( sequence timeout )\n"
+            "Wait for deposits to a sidechain to be connected or disconnected.\n"
+            "Use listsidechaindeposits to get the new deposits.\n"
+            "\nArguments:\n"
+            "1. nsidechain     (numeric, required) The sidechain number\n"
+            "2. sequence       (numeric, optional) Sequence number of the last deposits seen, returns right away if they have changed since. Default is the current deposits.\n"
+            "3. timeout        (numeric, optional, default=0) Time in milliseconds to wait, 0 to wait forever\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"changed\": true|false,   (boolean) whether the deposits changed, false on timeout\n"
+            "  \"sequence\": n,           (numeric) sequence number of the deposits\n"
+            "  \"count\": n,              (numeric) number of deposits, as countsidechaindeposits\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("waitfordeposits", "0 12 1000")
+            + HelpExampleRpc("waitfordeposits", "0, 12, 1000")
+            );
+
+    bool fChanged = false;
+    std::shared_ptr<const SidechainView> view = WaitForSidechainChange(request, &SidechainViewSequence::nDeposit, fChanged);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("changed", fChanged));
+    ret.push_back(Pair("sequence", (int64_t)view->sequence.nDeposit));
+    ret.push_back(Pair("count", (int64_t)view->nDeposits));
+
+    return ret;
+}
+
+UniValue listwithdrawalprojections(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "listwithdrawalprojections ( nsidechain )\n"
+            "Project the workscore of every Withdrawal forward at the rate it\n"
+            "changed over the last " + std::to_string(SIDECHAIN_WITHDRAWAL_RATE_WINDOW) + " blocks\n"
+            "\nArguments:\n"
+            "1. nsidechain     (numeric, optional) Only list the Withdrawal(s) of this sidechain\n"
+            "\nResult: (array)\n"
+            "{\n"
+            "  \"nsidechain\" : x,          (numeric) Sidechain number of Withdrawal\n"
+            "  \"hash\" : (string)          hash of Withdrawal\n"
+            "  \"nworkscore\" : x,          (numeric) workscore of Withdrawal\n"
+            "  \"nblocksleft\" : x,         (numeric) verification blocks remaining\n"
+            "  \"expireheight\" : x,        (numeric) height of the last block the Withdrawal can be approved by\n"
+            "  \"rateblocks\" : x,          (numeric) number of blocks the rate was measured over\n"
+            "  \"rate\" : x.xxx,            (numeric) average workscore change per block\n"
+            "  \"approved\" : true|false,   (boolean) whether the workscore is high enough\n"
+            "  \"blockstoapproval\" : x,    (numeric, optional) blocks until approval at this rate\n"
+            "  \"approvalheight\" : x,      (numeric, optional) height of approval at this rate\n"
+            "}\n"
+            "The approval fields are left out if the Withdrawal will expire first at this rate.\n"
+            "\nExample:\n"
+            + HelpExampleCli("listwithdrawalprojections", "")
+            + HelpExampleCli("listwithdrawalprojections", "0")
+            );
+
+    int nSidechain = -1;
+    if (!request.params[0].isNull()) {
+        nSidechain = request.params[0].get_int();
+        if (nSidechain < 0 || nSidechain > 255)
+            throw JSONRPCError(RPC_TYPE_ERROR, "Invalid Sidechain number");
+    }
+
+    LOCK(cs_main);
+
+    const int nHeight = chainActive.Height();
+
+    UniValue ret(UniValue::VARR);
+    for (const SidechainWithdrawalProjection& p : scdb.GetWithdrawalProjections(nSidechain)) {
+        UniValue obj(UniValue::VOBJ);
+
+        obj.push_back(Pair("nsidechain", p.state.nSidechain));
+        obj.push_back(Pair("hash", p.state.hash.ToString()));
+        obj.push_back(Pair("nworkscore", p.state.nWorkScore));
+        obj.push_back(Pair("nblocksleft", p.state.nBlocksLeft));
+        obj.push_back(Pair("expireheight", nHeight + p.state.nBlocksLeft));
+        obj.push_back(Pair("rateblocks", (int)p.nBlocks));
+        obj.push_back(Pair("rate", p.nBlocks ? (double)p.nChange / p.nBlocks : 0.0));
+        obj.push_back(Pair("approved", p.nBlocksToApproval == 0));
+        if (p.nBlocksToApproval >= 0) {
+            obj.push_back(Pair("blockstoapproval", p.nBlocksToApproval));
+            obj.push_back(Pair("approvalheight", nHeight + p.nBlocksToApproval));
+        }
+
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
 UniValue listcachedwithdrawaltx(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
         throw std::runtime_error(
-            "listcachedwithdrawaltx\n"
+            "listcachedwithdrawaltx \"nsidechain\" ( start count )\n"
             "List my cached Withdrawal(s) for nSidechain\n"
             "\nArguments:\n"
             "1. nsidechain     (numeric, required) Sidechain number to list Withdrawal(s) of\n"
+            "2. start          (numeric, optional) Number of Withdrawal(s) to skip\n"
+            "3. count          (numeric, optional) Maximum number of Withdrawal(s) to list\n"
             "\nResult: (array)\n"
             "{\n"
             "  \"hash\" : x (string) hash of Withdrawal\n"
@@ -1745,19 +2800,26 @@ UniValue listcachedwithdrawaltx(const JSONRPCRequest& request)
     if (!scdb.IsSidechainActive(nSidechain))
         throw JSONRPCError(RPC_TYPE_ERROR, "Invalid Sidechain number");
 
-    std::vector<std::pair<uint8_t, CMutableTransaction>> vWithdrawal;
-    vWithdrawal = scdb.GetWithdrawalTxCache();
+    uint32_t nStart, nCount;
+    ParseListRange(request, 1, nStart, nCount);
+
+    const std::vector<std::pair<uint8_t, CTransactionRef>>& vWithdrawal = scdb.GetWithdrawalTxCache();
 
     if (vWithdrawal.empty())
         throw JSONRPCError(RPC_TYPE_ERROR, "No withdrawal bundle txns cached for sidechain");
 
     UniValue ret(UniValue::VARR);
+    uint32_t n = 0;
     for (auto const& i : vWithdrawal) {
+        if (ret.size() >= nCount)
+            break;
         if (i.first != nSidechain)
             continue;
+        if (n++ < nStart)
+            continue;
 
         UniValue obj(UniValue::VOBJ);
-        obj.push_back(Pair("hash", i.second.GetHash().ToString()));
+        obj.push_back(Pair("hash", i.second->GetHash().ToString()));
 
         ret.push_back(obj);
     }
@@ -1825,10 +2887,13 @@ UniValue havefailedwithdrawal(const JSONRPCRequest& request)
 
 UniValue listspentwithdrawals(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size())
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "listspentwithdrawals\n"
+            "listspentwithdrawals ( start count )\n"
             "List Withdrawal(s) which have been approved by workscore and spent\n"
+            "\nArguments:\n"
+            "1. start          (numeric, optional) Number of Withdrawal(s) to skip\n"
+            "2. count          (numeric, optional) Maximum number of Withdrawal(s) to list\n"
             "\nResult: (array)\n"
             "{\n"
             "  \"nsidechain\" : (numeric) Sidechain number of Withdrawal\n"
@@ -1840,7 +2905,10 @@ UniValue listspentwithdrawals(const JSONRPCRequest& request)
             + HelpExampleCli("listspentwithdrawals", "")
             );
 
-    std::vector<SidechainSpentWithdrawal> vSpent = scdb.GetSpentWithdrawalCache();
+    uint32_t nStart, nCount;
+    ParseListRange(request, 0, nStart, nCount);
+
+    std::vector<SidechainSpentWithdrawal> vSpent = scdb.GetSpentWithdrawalCache(nStart, nCount);
 
     UniValue ret(UniValue::VARR);
     for (const SidechainSpentWithdrawal& s : vSpent) {
@@ -1858,10 +2926,13 @@ UniValue listspentwithdrawals(const JSONRPCRequest& request)
 
 UniValue listfailedwithdrawals(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size())
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "listfailedwithdrawals\n"
+            "listfailedwithdrawals ( start count )\n"
             "List Withdrawal(s) which have failed\n"
+            "\nArguments:\n"
+            "1. start          (numeric, optional) Number of Withdrawal(s) to skip\n"
+            "2. count          (numeric, optional) Maximum number of Withdrawal(s) to list\n"
             "\nResult: (array)\n"
             "{\n"
             "  \"nsidechain\" : (numeric) Sidechain number of Withdrawal\n"
@@ -1872,7 +2943,10 @@ UniValue listfailedwithdrawals(const JSONRPCRequest& request)
             + HelpExampleCli("listfailedwithdrawals", "")
             );
 
-    std::vector<SidechainFailedWithdrawal> vFailed = scdb.GetFailedWithdrawalCache();
+    uint32_t nStart, nCount;
+    ParseListRange(request, 0, nStart, nCount);
+
+    std::vector<SidechainFailedWithdrawal> vFailed = scdb.GetFailedWithdrawalCache(nStart, nCount);
 
     UniValue ret(UniValue::VARR);
     for (const SidechainFailedWithdrawal& f : vFailed) {
@@ -1892,11 +2966,22 @@ UniValue gettotalscdbhash(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size())
         throw std::runtime_error(
             "gettotalscdbhash\n"
-            "Get hash of every member of SCDB combined.\n"
+            "Get a hash of the consensus state of SCDB: the last block seen,\n"
+            "CTIPs, sidechains, activation status, withdrawal state and every\n"
+            "deposit. Nodes at the same block should return the same hash.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"hashscdbtotal\" : (string) The SCDB state hash\n"
+            "}\n"
+            "\nExample:\n"
+            + HelpExampleCli("gettotalscdbhash", "")
+            + HelpExampleRpc("gettotalscdbhash", "")
             );
 
+    LOCK(cs_main);
+
     UniValue ret(UniValue::VOBJ);
-    ret.push_back(Pair("hashscdbtotal", scdb.GetTestHash().ToString()));
+    ret.push_back(Pair("hashscdbtotal", scdb.GetStateHash().ToString()));
 
     return ret;
 }
@@ -2050,6 +3135,212 @@ UniValue getopreturndata(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getnews(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw std::runtime_error(
+            "getnews\n"
+            "List CoinNews of a news type from the last ndays, highest fees first.\n"
+            "\nArguments:\n"
+            "1. \"header\"       (string, required) hex of the news type header (4 bytes)\n"
+            "2. \"ndays\"        (numeric, required) number of days back from the chain tip\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\"      : (string) transaction id\n"
+            "    \"blockhash\" : (string) hash of the block including the news\n"
+            "    \"time\"      : (numeric) block time\n"
+            "    \"size\"      : (numeric) transaction size\n"
+            "    \"fees\"      : (numeric) transaction fees\n"
+            "    \"hex\"       : (string) hex from output\n"
+            "    \"decode\"    : (string) decoded news message\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExample:\n"
+            + HelpExampleCli("getnews", "\"a1b1c1d1\" 7")
+            + HelpExampleRpc("getnews", "\"a1b1c1d1\", 7")
+            );
+
+    std::string strHeader = request.params[0].get_str();
+    if (!IsHex(strHeader))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Header must be hex");
+
+    std::vector<unsigned char> vHeader = ParseHex(strHeader);
+    if (vHeader.size() < 4)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Header must be at least 4 bytes");
+
+    int nDays = request.params[1].get_int();
+    if (nDays < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of days");
+
+    int64_t nTimeStart = 0;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip())
+            nTimeStart = chainActive.Tip()->GetBlockTime() - (int64_t)nDays * 24 * 60 * 60 + 1;
+    }
+
+    std::vector<OPReturnNews> vNews;
+    FindNews(CScript(vHeader.begin(), vHeader.end()), std::max(nTimeStart, (int64_t)0), vNews);
+
+    std::sort(vNews.begin(), vNews.end(), [](const OPReturnNews& a, const OPReturnNews& b) {
+        return a.data.fees > b.data.fees;
+    });
+
+    UniValue ret(UniValue::VARR);
+    for (const OPReturnNews& news : vNews) {
+        const OPReturnData& d = news.data;
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", d.txid.ToString()));
+        obj.push_back(Pair("blockhash", news.hashBlock.ToString()));
+        obj.push_back(Pair("time", (uint64_t)news.nTime));
+        obj.push_back(Pair("size", (uint64_t)d.nSize));
+        obj.push_back(Pair("fees", FormatMoney(d.fees)));
+        obj.push_back(Pair("hex", HexStr(d.script.begin(), d.script.end(), false)));
+
+        // Skip OP_RETURN and the news header
+        std::string strDecode;
+        for (size_t i = 5; i < d.script.size(); i++)
+            strDecode += d.script[i];
+        obj.push_back(Pair("decode", strDecode));
+
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
+UniValue getmempoolnews(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getmempoolnews\n"
+            "List unconfirmed CoinNews of a news type from the mempool, highest fees first.\n"
+            "\nArguments:\n"
+            "1. \"header\"       (string, required) hex of the news type header (4 bytes)\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\"      : (string) transaction id\n"
+            "    \"time\"      : (numeric) time the transaction entered the mempool\n"
+            "    \"size\"      : (numeric) transaction size\n"
+            "    \"fees\"      : (numeric) transaction fees\n"
+            "    \"hex\"       : (string) hex from output\n"
+            "    \"decode\"    : (string) decoded news message\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExample:\n"
+            + HelpExampleCli("getmempoolnews", "\"a1b1c1d1\"")
+            + HelpExampleRpc("getmempoolnews", "\"a1b1c1d1\"")
+            );
+
+    std::string strHeader = request.params[0].get_str();
+    if (!IsHex(strHeader))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Header must be hex");
+
+    std::vector<unsigned char> vHeader = ParseHex(strHeader);
+    if (vHeader.size() < 4)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Header must be at least 4 bytes");
+
+    std::vector<MempoolNews> vNews;
+    mempool.GetNews(CScript(vHeader.begin(), vHeader.end()), vNews);
+
+    std::sort(vNews.begin(), vNews.end(), [](const MempoolNews& a, const MempoolNews& b) {
+        return a.nFee > b.nFee;
+    });
+
+    UniValue ret(UniValue::VARR);
+    for (const MempoolNews& news : vNews) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", news.txid.ToString()));
+        obj.push_back(Pair("time", news.nTime));
+        obj.push_back(Pair("size", (uint64_t)news.nSize));
+        obj.push_back(Pair("fees", FormatMoney(news.nFee)));
+        obj.push_back(Pair("hex", HexStr(news.script.begin(), news.script.end(), false)));
+
+        // Skip OP_RETURN and the news header
+        std::string strDecode;
+        for (size_t i = 5; i < news.script.size(); i++)
+            strDecode += news.script[i];
+        obj.push_back(Pair("decode", strDecode));
+
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
+UniValue getnewsblocks(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getnewsblocks\n"
+            "List the blocks of the active chain with OP_RETURN data starting with any of the news type headers.\n"
+            "Blocks are skipped by a filter of their headers, without reading their OP_RETURN data.\n"
+            "\nArguments:\n"
+            "1. \"headers\"      (array, required) hex of the news type headers (4 bytes each)\n"
+            "2. startheight    (numeric, required) first block height to scan\n"
+            "3. endheight      (numeric, optional, default=tip) last block height to scan\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\"    : (numeric) block height\n"
+            "    \"blockhash\" : (string) block hash\n"
+            "    \"time\"      : (numeric) block time\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExample:\n"
+            + HelpExampleCli("getnewsblocks", "\"[\\\"a1b1c1d1\\\"]\" 1000")
+            + HelpExampleRpc("getnewsblocks", "[\"a1b1c1d1\"], 1000, 5320")
+            );
+
+    std::vector<CScript> vHeader;
+    const UniValue& headers = request.params[0].get_array();
+    for (size_t i = 0; i < headers.size(); i++) {
+        std::string strHeader = headers[i].get_str();
+        if (!IsHex(strHeader))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Header must be hex");
+
+        std::vector<unsigned char> vch = ParseHex(strHeader);
+        if (vch.size() < 4)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Header must be at least 4 bytes");
+        vHeader.push_back(CScript(vch.begin(), vch.end()));
+    }
+    if (vHeader.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No headers");
+
+    int nStartHeight = request.params[1].get_int();
+    int nEndHeight = std::numeric_limits<int>::max();
+    if (!request.params[2].isNull())
+        nEndHeight = request.params[2].get_int();
+    if (nStartHeight < 0 || nEndHeight < nStartHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    {
+        LOCK(cs_main);
+        nEndHeight = std::min(nEndHeight, chainActive.Height());
+    }
+    if (nEndHeight - nStartHeight >= MAX_NEWS_BLOCKS_SCAN)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Height range too large, at most %d blocks", MAX_NEWS_BLOCKS_SCAN));
+
+    std::vector<const CBlockIndex*> vBlock;
+    FindNewsBlocks(vHeader, nStartHeight, nEndHeight, vBlock);
+
+    UniValue ret(UniValue::VARR);
+    for (const CBlockIndex* pindex : vBlock) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("height", pindex->nHeight));
+        obj.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+        obj.push_back(Pair("time", pindex->GetBlockTime()));
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
 UniValue getactivesidechaincount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size())
@@ -2065,11 +3356,76 @@ UniValue getactivesidechaincount(const JSONRPCRequest& request)
             + HelpExampleCli("getactivesidechaincount", "")
             );
 
-    int count = scdb.GetActiveSidechainCount();
+    int count = scdb.GetActiveSidechainsView()->size();
 
     return count;
 }
 
+static const int DEFAULT_BENCHHASH_ITERATIONS = 10000;
+static const int MAX_BENCHHASH_ITERATIONS = 10000000;
+
+UniValue benchhash(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "benchhash ( iterations )\n"
+            "\nTime each stage of skydoge_hash and the whole hash on this machine.\n"
+            "\nArguments:\n"
+            "1. iterations     (numeric, optional, default=" + std::to_string(DEFAULT_BENCHHASH_ITERATIONS) + ") Number of times to run each stage\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"iterations\": n,               (numeric) Number of times each stage was run\n"
+            "  \"stages\": [                    (array) The stages, in the order they first run\n"
+            "    {\n"
+            "      \"name\": \"name\",           (string) Hash function of the stage\n"
+            "      \"runs\": n,                 (numeric) Number of times the stage runs per skydoge_hash\n"
+            "      \"ns_per_run\": n,           (numeric) Nanoseconds per run on 64 bytes\n"
+            "      \"mb_per_sec\": n,           (numeric) Throughput in megabytes per second\n"
+            "      \"share\": n                 (numeric) Percentage of the time of all stages per skydoge_hash\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"ns_per_hash\": n,              (numeric) Nanoseconds per skydoge_hash of an 80 byte header\n"
+            "  \"hashes_per_sec\": n            (numeric) skydoge_hash calls per second\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("benchhash", "")
+            + HelpExampleRpc("benchhash", "100000")
+        );
+
+    int nIterations = DEFAULT_BENCHHASH_ITERATIONS;
+    if (!request.params[0].isNull())
+        nIterations = request.params[0].get_int();
+    if (nIterations < 1 || nIterations > MAX_BENCHHASH_ITERATIONS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("iterations must be between 1 and %d", MAX_BENCHHASH_ITERATIONS));
+
+    int64_t nTotalNanos = 0;
+    std::vector<SkydogeHashStageTiming> vTiming = ProfileSkydogeHash(nIterations, nTotalNanos);
+
+    int64_t nStageNanos = 0;
+    for (const SkydogeHashStageTiming& timing : vTiming)
+        nStageNanos += timing.nNanos * timing.nRuns;
+
+    UniValue stages(UniValue::VARR);
+    for (const SkydogeHashStageTiming& timing : vTiming) {
+        const int64_t nNanos = std::max<int64_t>(timing.nNanos, 1);
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", timing.name);
+        obj.pushKV("runs", timing.nRuns);
+        obj.pushKV("ns_per_run", (double)timing.nNanos / nIterations);
+        obj.pushKV("mb_per_sec", 64.0 * nIterations * 1000 / nNanos);
+        obj.pushKV("share", nStageNanos ? 100.0 * timing.nNanos * timing.nRuns / nStageNanos : 0.0);
+        stages.push_back(obj);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("iterations", nIterations);
+    result.pushKV("stages", stages);
+    result.pushKV("ns_per_hash", (double)nTotalNanos / nIterations);
+    result.pushKV("hashes_per_sec", 1e9 * nIterations / std::max<int64_t>(nTotalNanos, 1));
+
+    return result;
+}
+
 UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -2099,10 +3455,17 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getrpcworkqueueinfo",    &getrpcworkqueueinfo,    {} },
+    { "control",            "getvalidationqueueinfo", &getvalidationqueueinfo, {} },
+    { "control",            "getschedulerinfo",       &getschedulerinfo,       {} },
+    { "control",            "getlockstats",           &getlockstats,           {"filter", "reset"} },
+    { "control",            "getindexinfo",           &getindexinfo,           {"index_name"}, true },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} }, /* uses wallet if enabled */
+    { "util",               "getaddresshistory",      &getaddresshistory,      {"address","start","count"}, true },
+    { "util",               "getaddressutxos",        &getaddressutxos,        {"address","start","count"}, true },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
-    { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
+    { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"}, true },
     { "util",               "signmessagewithprivkey", &signmessagewithprivkey, {"privkey","message"} },
 
     /* Not shown in help */
@@ -2110,18 +3473,25 @@ static const CRPCCommand commands[] =
     { "hidden",             "echo",                   &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
     { "hidden",             "echojson",               &echo,                   {"arg0","arg1","arg2","arg3","arg4","arg5","arg6","arg7","arg8","arg9"}},
     { "hidden",             "getinfo",                &getinfo_deprecated,     {}},
+    { "hidden",             "benchhash",              &benchhash,              {"iterations"}},
 
     /* Drivechain rpc commands for the user and sidechains */
     { "Drivechain",  "addwithdrawal",                 &addwithdrawal,                   {"nsidechain", "hash"}},
     { "Drivechain",  "createcriticaldatatx",          &createcriticaldatatx,            {"amount", "height", "criticalhash"}},
-    { "Drivechain",  "listsidechainctip",             &listsidechainctip,               {"nsidechain"}},
-    { "Drivechain",  "listsidechaindeposits",         &listsidechaindeposits,           {"nsidechain"}},
-    { "Drivechain",  "countsidechaindeposits",        &countsidechaindeposits,          {"nsidechain"}},
+    { "Drivechain",  "listsidechainctip",             &listsidechainctip,               {"nsidechain"}, true},
+    { "Drivechain",  "listsidechaindeposits",         &listsidechaindeposits,           {"nsidechain", "txid", "n", "count", "start", "since_height", "address"}, true},
+    { "Drivechain",  "countsidechaindeposits",        &countsidechaindeposits,          {"nsidechain"}, true},
     { "Drivechain",  "receivewithdrawalbundle",       &receivewithdrawalbundle,         {"nsidechain","rawtx"}},
-    { "Drivechain",  "verifybmm",                     &verifybmm,                       {"blockhash", "bmmhash", "nsidechain"}},
-    { "Drivechain",  "verifydeposit",                 &verifydeposit,                   {"blockhash", "txid", "ntx"}},
-    { "Drivechain",  "listpreviousblockhashes",       &listpreviousblockhashes,         {}},
-    { "Drivechain",  "listactivesidechains",          &listactivesidechains,            {}},
+    { "Drivechain",  "verifybmm",                     &verifybmm,                       {"blockhash", "bmmhash", "nsidechain"}, true},
+    { "Drivechain",  "verifybmmbatch",                &verifybmmbatch,                  {"requests"}, true},
+    { "Drivechain",  "waitforbmm",                    &waitforbmm,                      {"bmmhash", "nsidechain", "timeout"}, true},
+    { "Drivechain",  "waitforsidechainctip",          &waitforsidechainctip,            {"nsidechain", "sequence", "timeout"}, true},
+    { "Drivechain",  "waitforwithdrawalstatus",       &waitforwithdrawalstatus,         {"nsidechain", "sequence", "timeout"}, true},
+    { "Drivechain",  "waitfordeposits",               &waitfordeposits,                 {"nsidechain", "sequence", "timeout"}, true},
+    { "Drivechain",  "verifydeposit",                 &verifydeposit,                   {"blockhash", "txid", "ntx"}, true},
+    { "Drivechain",  "verifydepositbatch",            &verifydepositbatch,              {"requests"}, true},
+    { "Drivechain",  "listpreviousblockhashes",       &listpreviousblockhashes,         {}, true},
+    { "Drivechain",  "listactivesidechains",          &listactivesidechains,            {}, true},
     { "Drivechain",  "listsidechainactivationstatus", &listsidechainactivationstatus,   {}},
     { "Drivechain",  "listsidechainproposals",        &listsidechainproposals,          {}},
     { "Drivechain",  "getsidechainactivationstatus",  &getsidechainactivationstatus,    {}},
@@ -2130,20 +3500,24 @@ static const CRPCCommand commands[] =
     { "Drivechain",  "setwithdrawalvote",             &setwithdrawalvote,               {"vote", "nsidechain", "hashwithdrawal"}},
     { "Drivechain",  "listwithdrawalvotes",           &listwithdrawalvotes,             {}},
     { "Drivechain",  "getaveragefee",                 &getaveragefee,                   {"numblocks", "startheight"}},
-    { "Drivechain",  "getworkscore",                  &getworkscore,                    {"nsidechain", "hashwithdrawal"}},
-    { "Drivechain",  "havespentwithdrawal",           &havespentwithdrawal,             {"hashwithdrawal", "nsidechain"}},
-    { "Drivechain",  "havefailedwithdrawal",          &havefailedwithdrawal,            {"hashwithdrawal", "nsidechain"}},
-    { "Drivechain",  "listcachedwithdrawaltx",        &listcachedwithdrawaltx,          {"nsidechain"}},
-    { "Drivechain",  "listwithdrawalstatus",          &listwithdrawalstatus,            {"nsidechain"}},
-    { "Drivechain",  "listspentwithdrawals",          &listspentwithdrawals,            {}},
-    { "Drivechain",  "listfailedwithdrawals",         &listfailedwithdrawals,           {}},
+    { "Drivechain",  "getworkscore",                  &getworkscore,                    {"nsidechain", "hashwithdrawal"}, true},
+    { "Drivechain",  "havespentwithdrawal",           &havespentwithdrawal,             {"hashwithdrawal", "nsidechain"}, true},
+    { "Drivechain",  "havefailedwithdrawal",          &havefailedwithdrawal,            {"hashwithdrawal", "nsidechain"}, true},
+    { "Drivechain",  "listcachedwithdrawaltx",        &listcachedwithdrawaltx,          {"nsidechain", "start", "count"}},
+    { "Drivechain",  "listwithdrawalstatus",          &listwithdrawalstatus,            {"nsidechain", "start", "count"}},
+    { "Drivechain",  "listwithdrawalprojections",     &listwithdrawalprojections,       {"nsidechain"}},
+    { "Drivechain",  "listspentwithdrawals",          &listspentwithdrawals,            {"start", "count"}},
+    { "Drivechain",  "listfailedwithdrawals",         &listfailedwithdrawals,           {"start", "count"}},
     { "Drivechain",  "gettotalscdbhash",              &gettotalscdbhash,                {}},
     { "Drivechain",  "getscdbdataforblock",           &getscdbdataforblock,             {"blockhash"}},
     { "Drivechain",  "listfailedbmm",                 &listfailedbmm,                   {}},
-    { "Drivechain",  "getactivesidechaincount",       &getactivesidechaincount,         {}},
+    { "Drivechain",  "getactivesidechaincount",       &getactivesidechaincount,         {}, true},
 
     /* Coin News RPC */
     { "CoinNews",    "getopreturndata",               &getopreturndata,                 {"blockhash"}},
+    { "CoinNews",    "getnews",                       &getnews,                         {"header", "ndays"}},
+    { "CoinNews",    "getmempoolnews",                &getmempoolnews,                  {"header"}},
+    { "CoinNews",    "getnewsblocks",                 &getnewsblocks,                   {"headers", "startheight", "endheight"}},
 
 };
 
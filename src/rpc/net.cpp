@@ -101,6 +101,12 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"inflight_max\": n,          (numeric) How many blocks we ask from this peer at most\n"
+            "    \"block_download_time\": n,   (numeric) Moving average of how many seconds the peer took to deliver a block we asked for (if any)\n"
+            "    \"blocks_announced\": n,      (numeric) Recent blocks the peer announced to us (see getblockpropagation)\n"
+            "    \"blocks_announced_first\": n, (numeric) How many of them the peer announced before any other peer\n"
+            "    \"block_announce_delay\": n,  (numeric) Moving average of how many seconds after the first announcement the peer announced blocks (if any)\n"
+            "    \"highbandwidth\": true|false, (boolean) Whether we asked the peer to announce blocks with compact blocks\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -167,6 +173,14 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_max", statestats.nBlocksInTransitMax));
+            if (statestats.nBlockDownloadTime >= 0)
+                obj.push_back(Pair("block_download_time", ((double)statestats.nBlockDownloadTime) / 1e6));
+            obj.push_back(Pair("blocks_announced", statestats.nBlocksAnnounced));
+            obj.push_back(Pair("blocks_announced_first", statestats.nBlocksAnnouncedFirst));
+            if (statestats.nBlockAnnounceDelay >= 0)
+                obj.push_back(Pair("block_announce_delay", ((double)statestats.nBlockAnnounceDelay) / 1e6));
+            obj.push_back(Pair("highbandwidth", statestats.fHighBandwidth));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -392,6 +406,172 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getnetmsgstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns totals over all peers for each P2P message type since startup,\n"
+            "including the time spent processing received messages.\n"
+            "Message types that were never sent or received are omitted.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"msg\": {                     (json object) The message type\n"
+            "    \"recvcount\": n,             (numeric) Messages received and processed\n"
+            "    \"recvbytes\": n,             (numeric) Bytes received, including headers\n"
+            "    \"sentcount\": n,             (numeric) Messages sent\n"
+            "    \"sentbytes\": n,             (numeric) Bytes sent, including headers\n"
+            "    \"processtime\": n,           (numeric) Total time spent processing in microseconds\n"
+            "    \"maxprocesstime\": n,        (numeric) Longest time spent processing one message in microseconds\n"
+            "    \"cs_main_wait\": n           (numeric) Time spent waiting for cs_main while processing in microseconds\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetmsgstats", "")
+            + HelpExampleRpc("getnetmsgstats", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue obj(UniValue::VOBJ);
+    for (const auto& i : g_connman->GetNetMsgStats()) {
+        const CNetMsgStats& stats = i.second;
+        if (stats.nRecvCount == 0 && stats.nSendCount == 0 && stats.nProcessMicros == 0)
+            continue;
+        UniValue msg(UniValue::VOBJ);
+        msg.push_back(Pair("recvcount", stats.nRecvCount));
+        msg.push_back(Pair("recvbytes", stats.nRecvBytes));
+        msg.push_back(Pair("sentcount", stats.nSendCount));
+        msg.push_back(Pair("sentbytes", stats.nSendBytes));
+        msg.push_back(Pair("processtime", stats.nProcessMicros));
+        msg.push_back(Pair("maxprocesstime", stats.nProcessMaxMicros));
+        msg.push_back(Pair("cs_main_wait", stats.nMainWaitMicros));
+        obj.push_back(Pair(i.first, msg));
+    }
+    return obj;
+}
+
+UniValue getcompactblockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getcompactblockstats\n"
+            "\nReturns statistics about compact blocks (BIP 152) reconstructed since startup.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,                 (numeric) Compact blocks we started reconstructing\n"
+            "  \"reconstructed\": n,          (numeric) Blocks reconstructed without requesting transactions\n"
+            "  \"roundtrip\": n,              (numeric) Blocks reconstructed after requesting missing transactions\n"
+            "  \"failed\": n,                 (numeric) Blocks that were downloaded in full instead\n"
+            "  \"txrequested\": n,            (numeric) Missing transactions requested\n"
+            "  \"criticaltxrequested\": n,    (numeric) Missing critical data (BMM) transactions requested\n"
+            "  \"extratxused\": n,            (numeric) Transactions found in the extra transaction pool\n"
+            "  \"criticalextratxused\": n     (numeric) Critical data (BMM) transactions found in the extra transaction pool\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcompactblockstats", "")
+            + HelpExampleRpc("getcompactblockstats", "")
+       );
+
+    CompactBlockStats stats;
+    GetCompactBlockStats(stats);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", stats.nBlocks));
+    obj.push_back(Pair("reconstructed", stats.nReconstructed));
+    obj.push_back(Pair("roundtrip", stats.nRoundTrip));
+    obj.push_back(Pair("failed", stats.nFailed));
+    obj.push_back(Pair("txrequested", stats.nTxRequested));
+    obj.push_back(Pair("criticaltxrequested", stats.nCriticalTxRequested));
+    obj.push_back(Pair("extratxused", stats.nExtraTxUsed));
+    obj.push_back(Pair("criticalextratxused", stats.nCriticalExtraTxUsed));
+    return obj;
+}
+
+/** Seconds from nFrom to nTime, both in microseconds, null if nTime is unset */
+static UniValue PropagationOffset(int64_t nTime, int64_t nFrom)
+{
+    if (!nTime)
+        return NullUniValue;
+    return ((double)(nTime - nFrom)) / 1e6;
+}
+
+UniValue getblockpropagation(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getblockpropagation ( \"blockhash\" )\n"
+            "\nReturns when the most recent blocks announced to us reached us, and from which peers.\n"
+            "Only the last " + std::to_string(MAX_BLOCK_PROPAGATION_RECORDS) + " blocks first announced after initial block download are kept.\n"
+            "Times other than first_seen are in seconds after first_seen, null if it hasn't happened (yet).\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"          (string, optional) Only return this block\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"hash\": \"hash\",          (string) The block hash\n"
+            "    \"height\": n,             (numeric) The block height, -1 if we don't have the header\n"
+            "    \"first_seen\": ttt,       (numeric) The time of the first announcement in seconds since epoch (Jan 1 1970 GMT)\n"
+            "    \"first_peer\": n,         (numeric) The id of the peer that announced the block first\n"
+            "    \"received\": n,           (numeric) When the block was downloaded or reconstructed\n"
+            "    \"received_peer\": n,      (numeric) The id of the peer we got the block from, if received\n"
+            "    \"reconstructed\": true|false, (boolean) Whether the block was reconstructed from a compact block\n"
+            "    \"connected\": n,          (numeric) When the block was connected\n"
+            "    \"peers\": [               (array) The peers that announced the block, in the order they did\n"
+            "      {\n"
+            "        \"id\": n,             (numeric) Peer id\n"
+            "        \"announcement\": \"xxx\", (string) The first message announcing the block: inv, headers or cmpctblock\n"
+            "        \"announced\": n,      (numeric) When the peer announced the block\n"
+            "        \"header\": n          (numeric) When the peer sent us the header\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockpropagation", "")
+            + HelpExampleCli("getblockpropagation", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+            + HelpExampleRpc("getblockpropagation", "")
+        );
+
+    uint256 hash;
+    if (!request.params[0].isNull())
+        hash = ParseHashV(request.params[0], "blockhash");
+
+    std::vector<BlockPropagation> vBlock;
+    GetBlockPropagation(vBlock);
+
+    UniValue ret(UniValue::VARR);
+    for (const BlockPropagation& block : vBlock) {
+        if (!hash.IsNull() && block.hash != hash)
+            continue;
+
+        UniValue peers(UniValue::VARR);
+        for (const BlockPeerPropagation& peer : block.vPeer) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("id", peer.nodeid));
+            obj.push_back(Pair("announcement", BlockAnnounceTypeName(peer.type)));
+            obj.push_back(Pair("announced", PropagationOffset(peer.nAnnounced, block.nFirstSeen)));
+            obj.push_back(Pair("header", PropagationOffset(peer.nHeader, block.nFirstSeen)));
+            peers.push_back(obj);
+        }
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("hash", block.hash.GetHex()));
+        obj.push_back(Pair("height", block.nHeight));
+        obj.push_back(Pair("first_seen", block.nFirstSeen / 1000000));
+        obj.push_back(Pair("first_peer", block.nodeFirst));
+        obj.push_back(Pair("received", PropagationOffset(block.nReceived, block.nFirstSeen)));
+        if (block.nReceived)
+            obj.push_back(Pair("received_peer", block.nodeReceived));
+        obj.push_back(Pair("reconstructed", block.fReconstructed));
+        obj.push_back(Pair("connected", PropagationOffset(block.nConnected, block.nFirstSeen)));
+        obj.push_back(Pair("peers", peers));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -634,6 +814,9 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getcompactblockstats",   &getcompactblockstats,   {} },
+    { "network",            "getblockpropagation",    &getblockpropagation,    {"blockhash"} },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
@@ -23,6 +23,7 @@
 #include <script/script_error.h>
 #include <script/sign.h>
 #include <script/standard.h>
+#include <txindex.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <utilstrencodings.h>
@@ -178,9 +179,12 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             }
             errmsg = "No such transaction found in the provided block";
         } else {
-            errmsg = fTxIndex
-              ? "No such mempool or blockchain transaction"
-              : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            if (!g_txindex)
+                errmsg = "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            else if (!g_txindex->IsSynced())
+                errmsg = "No such mempool or blockchain transaction. Blockchain transactions are still in the process of being indexed";
+            else
+                errmsg = "No such mempool or blockchain transaction";
         }
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, errmsg + ". Use gettransaction for wallet transactions.");
     }
@@ -276,7 +280,7 @@ UniValue gettxoutproof(const JSONRPCRequest& request)
     CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
     CMerkleBlock mb(block, setTxids);
     ssMB << mb;
-    std::string strHex = HexStr(ssMB.begin(), ssMB.end());
+    std::string strHex = HexStr(ssMB.data(), ssMB.data() + ssMB.size());
     return strHex;
 }
 
@@ -884,7 +888,18 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
     // Use CTransaction for the constant parts of the
     // transaction to avoid rehashing.
     const CTransaction txConst(mtx);
-    // Sign what we can:
+
+    // Sign what we can, all inputs at once. Spent inputs and, for
+    // SIGHASH_SINGLE, inputs without a corresponding output are skipped.
+    std::vector<CTxOut> vSpent(mtx.vin.size());
+    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+        const Coin& coin = view.AccessCoin(mtx.vin[i].prevout);
+        if (!coin.IsSpent() && (!fHashSingle || (i < mtx.vout.size())))
+            vSpent[i] = coin.out;
+    }
+    std::vector<SignatureData> vSigData;
+    ProduceSignatures(keystore, txConst, vSpent, nHashType, vSigData);
+
     for (unsigned int i = 0; i < mtx.vin.size(); i++) {
         CTxIn& txin = mtx.vin[i];
         const Coin& coin = view.AccessCoin(txin.prevout);
@@ -895,11 +910,7 @@ UniValue signrawtransaction(const JSONRPCRequest& request)
         const CScript& prevPubKey = coin.out.scriptPubKey;
         const CAmount& amount = coin.out.nValue;
 
-        SignatureData sigdata;
-        // Only sign SIGHASH_SINGLE if there's a corresponding output:
-        if (!fHashSingle || (i < mtx.vout.size()))
-            ProduceSignature(MutableTransactionSignatureCreator(&keystore, &mtx, i, amount, nHashType), prevPubKey, sigdata);
-        sigdata = CombineSignatures(prevPubKey, TransactionSignatureChecker(&txConst, i, amount), sigdata, DataFromTransaction(mtx, i));
+        SignatureData sigdata = CombineSignatures(prevPubKey, TransactionSignatureChecker(&txConst, i, amount), vSigData[i], DataFromTransaction(mtx, i));
 
         UpdateTransaction(mtx, i, sigdata);
 
@@ -1022,14 +1033,88 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue submitdepositpackage(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "submitdepositpackage [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a chain of raw sidechain deposits (serialized, hex-encoded) to local node and network.\n"
+            "Each deposit must spend the sidechain output (CTIP) of the one before it. Their scripts\n"
+            "are checked together and either all of them are accepted or none.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw deposits, parent first\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hex\"           (string) The transaction hash in hex of each deposit\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("submitdepositpackage", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"")
+            + HelpExampleRpc("submitdepositpackage", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    ObserveSafeMode();
+
+    std::promise<void> promise;
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& hexstrings = request.params[0].get_array();
+    if (hexstrings.empty() || hexstrings.size() > MAX_DEPOSIT_PACKAGE_COUNT)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Package must have between 1 and %u transactions", MAX_DEPOSIT_PACKAGE_COUNT));
+
+    std::vector<CTransactionRef> vtx;
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    CValidationState state;
+    if (!AcceptSidechainDepositPackage(mempool, state, vtx, nMaxRawTxFee)) {
+        if (state.IsInvalid())
+            throw JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
+        throw JSONRPCError(RPC_TRANSACTION_ERROR, state.GetRejectReason());
+    }
+
+    // Make sure the wallets have seen the deposits before returning, as
+    // sendrawtransaction does
+    CallFunctionInValidationInterfaceQueue([&promise] {
+        promise.set_value();
+    });
+    promise.get_future().wait();
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue result(UniValue::VARR);
+    for (const CTransactionRef& tx : vtx) {
+        CInv inv(MSG_TX, tx->GetHash());
+        g_connman->ForEachNode([&inv](CNode* pnode)
+        {
+            pnode->PushInventory(inv);
+        });
+        result.push_back(tx->GetHash().GetHex());
+    }
+
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      {"txid","verbose","blockhash"} },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      {"txid","verbose","blockhash"}, true },
     { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   {"inputs","outputs","locktime","replaceable"} },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"} },
-    { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"}, true },
+    { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"}, true },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "submitdepositpackage",   &submitdepositpackage,   {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
@@ -9,6 +9,7 @@
 #include <fs.h>
 #include <init.h>
 #include <random.h>
+#include <scheduler.h>
 #include <sync.h>
 #include <ui_interface.h>
 #include <util.h>
@@ -20,7 +21,10 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
 #include <unordered_map>
 
 static bool fRPCRunning = false;
@@ -31,6 +35,11 @@ static CCriticalSection cs_rpcWarmup;
 static RPCTimerInterface* timerInterface = nullptr;
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase> > deadlineTimers;
+/* Threads helping to execute batched requests, guarded by cs_rpcBatch */
+static std::mutex cs_rpcBatch;
+static std::unique_ptr<CScheduler> rpcBatchScheduler;
+static boost::thread_group rpcBatchThreads;
+static int nRPCBatchParallel = DEFAULT_RPC_BATCH_PARALLEL;
 
 static struct CRPCSignals
 {
@@ -306,6 +315,20 @@ bool StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
     fRPCRunning = true;
+
+    int nBatchThreads = std::max((int)gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 0);
+    nRPCBatchParallel = std::max((int)gArgs.GetArg("-rpcbatchparallel", DEFAULT_RPC_BATCH_PARALLEL), 1);
+    if (nBatchThreads > 0 && nRPCBatchParallel > 1) {
+        std::lock_guard<std::mutex> lock(cs_rpcBatch);
+        if (!rpcBatchScheduler) {
+            LogPrint(BCLog::RPC, "Starting %d RPC batch threads\n", nBatchThreads);
+            rpcBatchScheduler.reset(new CScheduler());
+            for (int i = 0; i < nBatchThreads; i++) {
+                rpcBatchThreads.create_thread(std::bind(&TraceThread<CScheduler::Function>, "rpcbatch",
+                                              CScheduler::Function(std::bind(&CScheduler::serviceQueue, rpcBatchScheduler.get()))));
+            }
+        }
+    }
     g_rpcSignals.Started();
     return true;
 }
@@ -320,6 +343,15 @@ void InterruptRPC()
 void StopRPC()
 {
     LogPrint(BCLog::RPC, "Stopping RPC\n");
+    {
+        // Batches still executing finish their calls on their own thread
+        std::lock_guard<std::mutex> lock(cs_rpcBatch);
+        if (rpcBatchScheduler) {
+            rpcBatchScheduler->stop(false);
+            rpcBatchThreads.join_all();
+            rpcBatchScheduler.reset();
+        }
+    }
     deadlineTimers.clear();
     DeleteAuthCookie();
     g_rpcSignals.Stopped();
@@ -410,11 +442,101 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
+/** Can this call of a batch execute in parallel with its neighbours? */
+static bool IsParallelRPC(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req, "method");
+    if (!method.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->fParallel;
+}
+
+/** State shared by a batch and the helper tasks it queued */
+struct RPCBatchState
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Helpers executing calls of the batch
+    int nActive = 0;
+    //! The batch no longer waits for helpers, ones starting now must return
+    bool fDone = false;
+    //! Next call to execute
+    std::atomic<size_t> nNext;
+};
+
+static void ExecBatchCalls(const JSONRPCRequest& jreq, const UniValue& vReq, size_t nEnd, std::vector<UniValue>& vResult, std::atomic<size_t>& nNext)
+{
+    size_t i;
+    while ((i = nNext++) < nEnd)
+        vResult[i] = JSONRPCExecOne(jreq, vReq[i]);
+}
+
+/**
+ * Execute calls [nBegin, nEnd) of a batch in parallel. The calling thread
+ * takes part and queues up to nRPCBatchParallel - 1 helpers, all of them
+ * taking the next call until none are left. If the helper threads are busy
+ * the calling thread ends up doing all the work, so a batch never waits for
+ * threads that haven't started on it yet.
+ */
+static void ExecBatchParallel(const JSONRPCRequest& jreq, const UniValue& vReq, size_t nBegin, size_t nEnd, std::vector<UniValue>& vResult)
+{
+    std::shared_ptr<RPCBatchState> state = std::make_shared<RPCBatchState>();
+    state->nNext = nBegin;
+
+    {
+        std::lock_guard<std::mutex> lock(cs_rpcBatch);
+        if (rpcBatchScheduler) {
+            size_t nHelpers = std::min((size_t)nRPCBatchParallel, nEnd - nBegin) - 1;
+            for (size_t i = 0; i < nHelpers; i++) {
+                rpcBatchScheduler->schedule([state, &jreq, &vReq, nEnd, &vResult]() {
+                    {
+                        std::lock_guard<std::mutex> stateLock(state->cs);
+                        if (state->fDone)
+                            return;
+                        state->nActive++;
+                    }
+                    ExecBatchCalls(jreq, vReq, nEnd, vResult, state->nNext);
+                    std::lock_guard<std::mutex> stateLock(state->cs);
+                    state->nActive--;
+                    state->cond.notify_all();
+                });
+            }
+        }
+    }
+
+    ExecBatchCalls(jreq, vReq, nEnd, vResult, state->nNext);
+
+    std::unique_lock<std::mutex> stateLock(state->cs);
+    state->fDone = true;
+    state->cond.wait(stateLock, [&state] { return state->nActive == 0; });
+}
+
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
+    std::vector<UniValue> vResult(vReq.size());
+    size_t nBegin = 0;
+    while (nBegin < vReq.size()) {
+        // Read-only calls next to each other execute in parallel, any other
+        // call executes on its own so the batch behaves as if executed in order
+        size_t nEnd = nBegin;
+        while (nEnd < vReq.size() && IsParallelRPC(vReq[nEnd]))
+            nEnd++;
+
+        if (nEnd - nBegin > 1) {
+            ExecBatchParallel(jreq, vReq, nBegin, nEnd, vResult);
+            nBegin = nEnd;
+        } else {
+            vResult[nBegin] = JSONRPCExecOne(jreq, vReq[nBegin]);
+            nBegin++;
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    for (const UniValue& result : vResult)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
@@ -14,10 +14,16 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+//! Threads which help execute batched requests, 0 runs batches serially
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+//! Maximum number of calls of one batch executing at the same time
+static const int DEFAULT_RPC_BATCH_PARALLEL = 4;
 
 class CRPCCommand;
 
@@ -130,10 +136,18 @@ typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
 class CRPCCommand
 {
 public:
+    CRPCCommand(std::string _category, std::string _name, rpcfn_type _actor, std::vector<std::string> _argNames, bool _fParallel = false) :
+        category(std::move(_category)), name(std::move(_name)), actor(_actor), argNames(std::move(_argNames)), fParallel(_fParallel)
+    {
+    }
+
     std::string category;
     std::string name;
     rpcfn_type actor;
     std::vector<std::string> argNames;
+    //! Read-only command. Calls of it in a batch may execute in parallel
+    //! with neighbouring calls which are also read-only.
+    bool fParallel;
 };
 
 /**
@@ -0,0 +1,234 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <scdblog.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <util.h>
+
+std::unique_ptr<CSCDBLog> g_scdblog;
+
+//! Largest record accepted when replaying, anything bigger is corruption
+static const uint32_t MAX_SCDB_LOG_RECORD_SIZE = 32 * 1000 * 1000;
+
+static uint32_t RecordChecksum(const unsigned char* pch, size_t nSize)
+{
+    const uint256 hash = Hash(pch, pch + nSize);
+    return ReadLE32(hash.begin());
+}
+
+CSCDBLog::CSCDBLog(const fs::path& pathSnapshotIn, const fs::path& pathLogIn)
+    : pathSnapshot(pathSnapshotIn), pathLog(pathLogIn), fStop(false), fWriting(false), file(nullptr)
+{
+}
+
+CSCDBLog::~CSCDBLog()
+{
+    Stop();
+}
+
+bool CSCDBLog::Start()
+{
+    file = fsbridge::fopen(pathLog, "wb");
+    if (!file)
+        return error("%s: Failed to open %s", __func__, pathLog.string());
+
+    thread = std::thread(&TraceThread<std::function<void()>>, "scdblog",
+            std::function<void()>(std::bind(&CSCDBLog::ThreadWrite, this)));
+    return true;
+}
+
+void CSCDBLog::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    condQueue.notify_all();
+    if (thread.joinable())
+        thread.join();
+
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void CSCDBLog::Append(std::vector<unsigned char>&& vchRecord)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        queue.push_back(LogJob{false, std::move(vchRecord)});
+    }
+    condQueue.notify_one();
+}
+
+void CSCDBLog::Compact(std::vector<unsigned char>&& vchSnapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        queue.push_back(LogJob{true, std::move(vchSnapshot)});
+    }
+    condQueue.notify_one();
+}
+
+void CSCDBLog::Flush()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    while (thread.joinable() && (fWriting || !queue.empty()))
+        condDone.wait(lock);
+}
+
+void CSCDBLog::ThreadWrite()
+{
+    while (true) {
+        std::deque<LogJob> jobs;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (!fStop && queue.empty())
+                condQueue.wait(lock);
+            if (queue.empty())
+                break;
+
+            jobs.swap(queue);
+            fWriting = true;
+        }
+
+        // Everything that was queued is written and then synced once
+        bool fAppended = false;
+        for (const LogJob& job : jobs) {
+            if (job.fSnapshot) {
+                if (fAppended && file) {
+                    fflush(file);
+                    FileCommit(file);
+                    fAppended = false;
+                }
+                if (!WriteSnapshot(job.vch))
+                    continue;
+
+                // The records so far are in the snapshot
+                if (file)
+                    fclose(file);
+                file = fsbridge::fopen(pathLog, "wb");
+                if (!file)
+                    LogPrintf("%s: Failed to open %s\n", __func__, pathLog.string());
+                continue;
+            }
+
+            if (!file)
+                continue;
+
+            unsigned char header[4];
+            unsigned char checksum[4];
+            WriteLE32(header, job.vch.size());
+            WriteLE32(checksum, RecordChecksum(job.vch.data(), job.vch.size()));
+            if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+                    fwrite(job.vch.data(), 1, job.vch.size(), file) != job.vch.size() ||
+                    fwrite(checksum, 1, sizeof(checksum), file) != sizeof(checksum)) {
+                LogPrintf("%s: Failed to write to %s\n", __func__, pathLog.string());
+            }
+            fAppended = true;
+        }
+        if (fAppended && file) {
+            fflush(file);
+            FileCommit(file);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fWriting = false;
+        }
+        condDone.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fWriting = false;
+    }
+    condDone.notify_all();
+}
+
+bool CSCDBLog::WriteSnapshot(const std::vector<unsigned char>& vchSnapshot)
+{
+    fs::path pathNew = pathSnapshot;
+    pathNew += ".new";
+
+    FILE* fileout = fsbridge::fopen(pathNew, "wb");
+    if (!fileout)
+        return error("%s: Failed to open %s", __func__, pathNew.string());
+
+    if (fwrite(vchSnapshot.data(), 1, vchSnapshot.size(), fileout) != vchSnapshot.size()) {
+        fclose(fileout);
+        return error("%s: Failed to write %s", __func__, pathNew.string());
+    }
+    fflush(fileout);
+    FileCommit(fileout);
+    fclose(fileout);
+
+    if (!RenameOver(pathNew, pathSnapshot))
+        return error("%s: Failed to rename %s", __func__, pathNew.string());
+
+    return true;
+}
+
+bool CSCDBLog::Replay(const fs::path& path, const std::function<bool(CDataStream&)>& fn, size_t& nRecords)
+{
+    nRecords = 0;
+
+    FILE* filein = fsbridge::fopen(path, "rb");
+    if (!filein)
+        return true;
+
+    bool fRet = true;
+    std::vector<unsigned char> vch;
+    while (true) {
+        unsigned char header[4];
+        unsigned char checksum[4];
+        if (fread(header, 1, sizeof(header), filein) != sizeof(header))
+            break;
+
+        const uint32_t nSize = ReadLE32(header);
+        if (nSize > MAX_SCDB_LOG_RECORD_SIZE) {
+            LogPrintf("%s: Invalid record size %u in %s\n", __func__, nSize, path.string());
+            fRet = false;
+            break;
+        }
+
+        vch.resize(nSize);
+        if (fread(vch.data(), 1, nSize, filein) != nSize ||
+                fread(checksum, 1, sizeof(checksum), filein) != sizeof(checksum)) {
+            LogPrintf("%s: Ignoring incomplete record at the end of %s\n", __func__, path.string());
+            break;
+        }
+
+        if (ReadLE32(checksum) != RecordChecksum(vch.data(), vch.size())) {
+            // Only the last record can have been cut short
+            if (fgetc(filein) == EOF) {
+                LogPrintf("%s: Ignoring incomplete record at the end of %s\n", __func__, path.string());
+            } else {
+                LogPrintf("%s: Invalid record checksum in %s\n", __func__, path.string());
+                fRet = false;
+            }
+            break;
+        }
+
+        try {
+            CDataStream ss(vch, SER_DISK, CLIENT_VERSION);
+            if (!fn(ss)) {
+                fRet = false;
+                break;
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Exception: %s\n", __func__, e.what());
+            fRet = false;
+            break;
+        }
+        nRecords++;
+    }
+
+    fclose(filein);
+    return fRet;
+}
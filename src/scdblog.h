@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SCDBLOG_H
+#define BITCOIN_SCDBLOG_H
+
+#include <fs.h>
+#include <streams.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Write-ahead log for the SCDB caches that aren't stored with the block
+ * data (user votes, proposals, cached withdrawal transactions, withdrawal
+ * spends...).
+ *
+ * SCDB appends a record for each change to its caches. The records are
+ * written and synced by a background thread, so the thread that changed
+ * SCDB only serializes them. Every so often the whole of the caches is
+ * handed over as a snapshot: once the snapshot file has been replaced, the
+ * log is emptied. At startup the snapshot is loaded and the log replayed on
+ * top of it, which gives back the caches as they were at the last record
+ * that made it to disk.
+ *
+ * If the node stops between writing a snapshot and emptying the log, the
+ * records are replayed on a snapshot that already has them. Records must
+ * therefore set state rather than adjust it.
+ *
+ * Each record is stored with its size and a checksum, so a record cut short
+ * by a crash ends the replay instead of being misread.
+ */
+class CSCDBLog
+{
+public:
+    CSCDBLog(const fs::path& pathSnapshotIn, const fs::path& pathLogIn);
+    ~CSCDBLog();
+
+    /** Empty the log and start the writer thread. Only call this once a
+     * snapshot with everything in the log has been written. */
+    bool Start();
+
+    /** Write everything queued and stop the writer thread */
+    void Stop();
+
+    /** Queue a record to be appended to the log */
+    void Append(std::vector<unsigned char>&& vchRecord);
+
+    /** Queue a snapshot to replace the snapshot file. The records queued
+     * before it are dropped from the log once it has been written. */
+    void Compact(std::vector<unsigned char>&& vchSnapshot);
+
+    /** Wait for everything queued so far to be written */
+    void Flush();
+
+    /** Call fn for each record in the log at path, in the order they were
+     * appended. Stops at a record that was cut short. Returns false if a
+     * record is corrupt or fn fails for one. */
+    static bool Replay(const fs::path& path, const std::function<bool(CDataStream&)>& fn, size_t& nRecords);
+
+private:
+    struct LogJob {
+        bool fSnapshot;
+        std::vector<unsigned char> vch;
+    };
+
+    void ThreadWrite();
+    bool WriteSnapshot(const std::vector<unsigned char>& vchSnapshot);
+
+    const fs::path pathSnapshot;
+    const fs::path pathLog;
+
+    std::mutex cs;
+    std::condition_variable condQueue;
+    std::condition_variable condDone;
+    std::deque<LogJob> queue;
+    bool fStop;
+    bool fWriting;
+
+    // Only used by the writer thread once it has started
+    FILE* file;
+
+    std::thread thread;
+};
+
+/** Logs changes to the SCDB caches, if started */
+extern std::unique_ptr<CSCDBLog> g_scdblog;
+
+#endif // BITCOIN_SCDBLOG_H
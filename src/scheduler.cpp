@@ -4,14 +4,201 @@
 
 #include <scheduler.h>
 
+#include <crypto/common.h>
 #include <random.h>
 #include <reverselock.h>
+#include <utiltime.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <boost/bind.hpp>
+#include <deque>
+#include <map>
 #include <utility>
 
-CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
+/** Number of bits of the time in milliseconds each level of the wheel covers */
+static const int WHEEL_LEVEL_BITS = 6;
+static const int WHEEL_SLOTS = 1 << WHEEL_LEVEL_BITS;
+/** Enough levels to cover any 64-bit time */
+static const int WHEEL_LEVELS = (64 + WHEEL_LEVEL_BITS - 1) / WHEEL_LEVEL_BITS;
+
+static uint64_t ToTick(const boost::chrono::system_clock::time_point& t, bool fRoundUp)
+{
+    int64_t nMicros = boost::chrono::duration_cast<boost::chrono::microseconds>(t.time_since_epoch()).count();
+    return nMicros <= 0 ? 0 : (nMicros + (fRoundUp ? 999 : 0)) / 1000;
+}
+
+static boost::chrono::system_clock::time_point FromTick(uint64_t nTick)
+{
+    return boost::chrono::system_clock::time_point(boost::chrono::milliseconds(nTick));
+}
+
+/**
+ * The pending tasks of a scheduler, in a hierarchical timer wheel, and the
+ * tasks that are due, in one queue per lane.
+ *
+ * A task due at tick t (in milliseconds) is kept at the level of the highest
+ * group of WHEEL_LEVEL_BITS bits in which t differs from the current tick,
+ * in the slot given by that group of t. So every slot but the first occupied
+ * one of the lowest occupied level is known to be due later, and finding the
+ * next task doesn't depend on the number of tasks. When the time of a slot
+ * above level 0 comes, its tasks are moved down to lower levels.
+ */
+class CScheduler::TaskQueue
+{
+public:
+    struct Task
+    {
+        Function f;
+        boost::chrono::system_clock::time_point time;
+        uint64_t nTick;
+        uint64_t nSequence;
+        SchedulerLane lane;
+        std::string strName;
+    };
+
+    std::deque<Task> vReady[SCHEDULER_LANE_COUNT];
+    std::map<std::string, SchedulerTaskStats> mapStats;
+
+    TaskQueue() : nCurrent(0), nWaiting(0), nSequence(0) {}
+
+    void Add(Function f, const boost::chrono::system_clock::time_point& t, SchedulerLane lane, const std::string& strName)
+    {
+        // Round up, so that tasks never run early
+        Insert(Task{std::move(f), t, ToTick(t, true), nSequence++, lane, strName});
+    }
+
+    /** Move the tasks due at nNow to their ready queues. Returns whether any were. */
+    bool Advance(uint64_t nNow)
+    {
+        // The clock went back, reinsert the tasks relative to the new time
+        // rather than running them all right away
+        if (nNow < nCurrent) {
+            std::vector<Task> vTasks;
+            for (Level& level : levels) {
+                for (int i = 0; i < WHEEL_SLOTS; i++) {
+                    for (Task& task : level.vSlot[i])
+                        vTasks.push_back(std::move(task));
+                    level.vSlot[i].clear();
+                }
+                level.nOccupied = 0;
+            }
+            nWaiting = 0;
+            nCurrent = nNow;
+            for (Task& task : vTasks)
+                Insert(std::move(task));
+        }
+
+        bool fReady = false;
+        uint64_t nTick;
+        int nLevel, nSlot;
+        while (NextEvent(nTick, nLevel, nSlot) && nTick <= nNow) {
+            std::vector<Task> vSlot;
+            vSlot.swap(levels[nLevel].vSlot[nSlot]);
+            levels[nLevel].nOccupied &= ~(uint64_t(1) << nSlot);
+            nWaiting -= vSlot.size();
+            nCurrent = nTick;
+
+            // Whatever is due now goes in the order it was scheduled, the
+            // rest moves down to lower levels
+            std::vector<Task> vDue;
+            for (Task& task : vSlot) {
+                if (task.nTick <= nCurrent)
+                    vDue.push_back(std::move(task));
+                else
+                    Insert(std::move(task));
+            }
+            std::sort(vDue.begin(), vDue.end(), [](const Task& a, const Task& b) { return a.nSequence < b.nSequence; });
+            for (Task& task : vDue)
+                vReady[task.lane].push_back(std::move(task));
+            fReady |= !vDue.empty();
+        }
+        // Nothing is due before the next event, so every task stays in its
+        // slot relative to nNow
+        nCurrent = std::max(nCurrent, nNow);
+        return fReady;
+    }
+
+    /** The time of the next task to become due or to be moved down a level */
+    bool NextEvent(boost::chrono::system_clock::time_point& t) const
+    {
+        uint64_t nTick;
+        int nLevel, nSlot;
+        if (!NextEvent(nTick, nLevel, nSlot))
+            return false;
+        t = FromTick(nTick);
+        return true;
+    }
+
+    size_t Size() const
+    {
+        size_t nSize = nWaiting;
+        for (const std::deque<Task>& ready : vReady)
+            nSize += ready.size();
+        return nSize;
+    }
+
+    template <typename Callable>
+    void ForEach(Callable func) const
+    {
+        for (const std::deque<Task>& ready : vReady) {
+            for (const Task& task : ready)
+                func(task);
+        }
+        for (const Level& level : levels) {
+            for (int i = 0; i < WHEEL_SLOTS; i++) {
+                for (const Task& task : level.vSlot[i])
+                    func(task);
+            }
+        }
+    }
+
+private:
+    struct Level
+    {
+        uint64_t nOccupied = 0;
+        std::vector<Task> vSlot[WHEEL_SLOTS];
+    };
+
+    Level levels[WHEEL_LEVELS];
+    //! The tick the wheel was last advanced to
+    uint64_t nCurrent;
+    //! Number of tasks in the wheel
+    size_t nWaiting;
+    uint64_t nSequence;
+
+    void Insert(Task&& task)
+    {
+        if (task.nTick <= nCurrent) {
+            vReady[task.lane].push_back(std::move(task));
+            return;
+        }
+        int nLevel = (CountBits(task.nTick ^ nCurrent) - 1) / WHEEL_LEVEL_BITS;
+        int nSlot = (task.nTick >> (nLevel * WHEEL_LEVEL_BITS)) & (WHEEL_SLOTS - 1);
+        levels[nLevel].vSlot[nSlot].push_back(std::move(task));
+        levels[nLevel].nOccupied |= uint64_t(1) << nSlot;
+        nWaiting++;
+    }
+
+    bool NextEvent(uint64_t& nTick, int& nLevel, int& nSlot) const
+    {
+        for (nLevel = 0; nLevel < WHEEL_LEVELS; nLevel++) {
+            uint64_t nOccupied = levels[nLevel].nOccupied;
+            if (!nOccupied)
+                continue;
+            // The slots of a level are all ahead of the current one, the
+            // lowest occupied is the next
+            nSlot = CountBits(nOccupied & (~nOccupied + 1)) - 1;
+            const int nShift = (nLevel + 1) * WHEEL_LEVEL_BITS;
+            const uint64_t nPrefix = nShift < 64 ? (nCurrent >> nShift) << nShift : 0;
+            nTick = nPrefix | (uint64_t(nSlot) << (nLevel * WHEEL_LEVEL_BITS));
+            return true;
+        }
+        return false;
+    }
+};
+
+CScheduler::CScheduler() : taskQueue(new TaskQueue()), nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
 
@@ -30,7 +217,22 @@ static boost::system_time toPosixTime(const boost::chrono::system_clock::time_po
 }
 #endif
 
+bool CScheduler::shouldStop() const
+{
+    return stopRequested || (stopWhenEmpty && taskQueue->Size() == 0);
+}
+
 void CScheduler::serviceQueue()
+{
+    service((1 << SCHEDULER_LANE_COUNT) - 1);
+}
+
+void CScheduler::serviceLane(SchedulerLane lane)
+{
+    service(1 << lane);
+}
+
+void CScheduler::service(int nLanes)
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     ++nThreadsServicingQueue;
@@ -40,47 +242,63 @@ void CScheduler::serviceQueue()
     // is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && taskQueue->Size() == 0) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get a tiny bit more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
-                // Wait until there is something to do.
-                newTaskScheduled.wait(lock);
-            }
 
-            // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
+            // Tasks that became due may be for threads of other lanes
+            if (taskQueue->Advance(ToTick(boost::chrono::system_clock::now(), false)))
+                newTaskScheduled.notify_all();
 
+            std::deque<TaskQueue::Task>* ready = nullptr;
+            for (int i = 0; i < SCHEDULER_LANE_COUNT && !ready; i++) {
+                if ((nLanes & (1 << i)) && !taskQueue->vReady[i].empty())
+                    ready = &taskQueue->vReady[i];
+            }
+
+            if (!ready) {
+                // Wait until either there is a new task, or until
+                // the time of the next event of the wheel:
+                boost::chrono::system_clock::time_point timeToWaitFor;
+                if (shouldStop()) {
+                    // Draining, and the rest is for threads of other lanes
+                } else if (!taskQueue->NextEvent(timeToWaitFor)) {
+                    newTaskScheduled.wait(lock);
+                } else {
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
-                // Keep waiting until timeout
-            }
+                    newTaskScheduled.timed_wait(lock, toPosixTime(timeToWaitFor));
 #else
-            // Some boost versions have a conflicting overload of wait_until that returns void.
-            // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
-                if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
-                    break; // Exit loop after timeout, it means we reached the time of the event
-            }
+                    // Some boost versions have a conflicting overload of wait_until that returns void.
+                    // Explicitly use a template here to avoid hitting that overload.
+                    newTaskScheduled.wait_until<>(lock, timeToWaitFor);
 #endif
-            // If there are multiple threads, the queue can empty while we're waiting (another
-            // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+                }
                 continue;
+            }
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            TaskQueue::Task task = std::move(ready->front());
+            ready->pop_front();
 
+            int64_t nTime;
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
-                f();
+                nTime = GetTimeMicros();
+                task.f();
+                nTime = GetTimeMicros() - nTime;
+            }
+
+            if (!task.strName.empty()) {
+                std::map<std::string, SchedulerTaskStats>::iterator it = taskQueue->mapStats.find(task.strName);
+                if (it == taskQueue->mapStats.end())
+                    it = taskQueue->mapStats.emplace(task.strName, SchedulerTaskStats{task.strName, task.lane, 0, 0, 0}).first;
+                it->second.nRuns++;
+                it->second.nTimeTotal += nTime;
+                it->second.nTimeMax = std::max(it->second.nTimeMax, nTime);
             }
         } catch (...) {
             --nThreadsServicingQueue;
@@ -88,7 +306,7 @@ void CScheduler::serviceQueue()
         }
     }
     --nThreadsServicingQueue;
-    newTaskScheduled.notify_one();
+    newTaskScheduled.notify_all();
 }
 
 void CScheduler::stop(bool drain)
@@ -103,40 +321,45 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, SchedulerLane lane, const std::string& strName)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue->Add(std::move(f), t, lane, strName);
     }
-    newTaskScheduled.notify_one();
+    // The threads of other lanes may be waiting for a later event
+    newTaskScheduled.notify_all();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds, SchedulerLane lane, const std::string& strName)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), lane, strName);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds, SchedulerLane lane, const std::string& strName)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds, lane, strName), deltaMilliSeconds, lane, strName);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds, SchedulerLane lane, const std::string& strName)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds, lane, strName), deltaMilliSeconds, lane, strName);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
-    }
+    size_t result = taskQueue->Size();
+    bool fFirst = true;
+    taskQueue->ForEach([&](const TaskQueue::Task& task) {
+        if (fFirst || task.time < first)
+            first = task.time;
+        if (fFirst || task.time > last)
+            last = task.time;
+        fFirst = false;
+    });
     return result;
 }
 
@@ -145,6 +368,15 @@ bool CScheduler::AreThreadsServicingQueue() const {
     return nThreadsServicingQueue;
 }
 
+std::vector<SchedulerTaskStats> CScheduler::getTaskStats() const
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    std::vector<SchedulerTaskStats> vStats;
+    for (const std::pair<const std::string, SchedulerTaskStats>& stats : taskQueue->mapStats)
+        vStats.push_back(stats.second);
+    return vStats;
+}
+
 
 void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
     {
@@ -12,10 +12,36 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
-#include <map>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <sync.h>
 
+/** Scheduler lanes. Tasks of different lanes can be serviced by different
+ * threads, so a slow maintenance task doesn't delay time-critical ones.
+ */
+enum SchedulerLane
+{
+    SCHEDULER_LANE_FAST, //!< Short tasks that should run on time
+    SCHEDULER_LANE_BULK, //!< Maintenance that may take a while, like writing files to disk
+    SCHEDULER_LANE_COUNT
+};
+
+/** Run time statistics of the tasks scheduled under one name */
+struct SchedulerTaskStats
+{
+    std::string name;
+    SchedulerLane lane;
+    //! Number of times a task of this name was run
+    uint64_t nRuns;
+    //! Time spent running them, in microseconds
+    int64_t nTimeTotal;
+    //! Longest run, in microseconds
+    int64_t nTimeMax;
+};
+
 //
 // Simple class for background tasks that should be run
 // periodically or once "after a while"
@@ -33,6 +59,11 @@
 // delete t;
 // delete s; // Must be done after thread is interrupted/joined.
 //
+// Pending tasks are kept in a hierarchical timer wheel with a resolution of
+// a millisecond, so scheduling and running a task takes constant time no
+// matter how many are pending. Tasks that are due wait in the queue of their
+// lane until a thread servicing that lane picks them up.
+//
 
 class CScheduler
 {
@@ -42,18 +73,20 @@ public:
 
     typedef std::function<void(void)> Function;
 
-    // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    // Call func at/after time t. Tasks with a name get run time statistics,
+    // see getTaskStats.
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(),
+                  SchedulerLane lane=SCHEDULER_LANE_FAST, const std::string& strName="");
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds, SchedulerLane lane=SCHEDULER_LANE_FAST, const std::string& strName="");
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    void scheduleEvery(Function f, int64_t deltaMilliSeconds, SchedulerLane lane=SCHEDULER_LANE_FAST, const std::string& strName="");
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -61,6 +94,10 @@ public:
     // and interrupted using boost::interrupt_thread
     void serviceQueue();
 
+    // Like serviceQueue, but only runs the tasks of one lane. Every lane
+    // needs a thread servicing it, or one running serviceQueue.
+    void serviceLane(SchedulerLane lane);
+
     // Tell any threads running serviceQueue to stop as soon as they're
     // done servicing whatever task they're currently servicing (drain=false)
     // or when there is no work left to be done (drain=true)
@@ -74,14 +111,21 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    // Returns the run time statistics of the named tasks, by name
+    std::vector<SchedulerTaskStats> getTaskStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    class TaskQueue;
+
+    void service(int nLanes);
+
+    std::unique_ptr<TaskQueue> taskQueue;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool shouldStop() const;
 };
 
 /**
@@ -10,6 +10,7 @@
 #include <crypto/sha256.h>
 #include <pubkey.h>
 #include <script/script.h>
+#include <streams.h>
 #include <uint256.h>
 
 typedef std::vector<unsigned char> valtype;
@@ -60,6 +61,30 @@ static inline void popstack(std::vector<valtype>& stack)
     stack.pop_back();
 }
 
+/** Pop the top of the stack, keeping its buffer in the arena */
+static inline void popstack(std::vector<valtype>& stack, ScriptStackArena& arena)
+{
+    if (stack.empty())
+        throw std::runtime_error("popstack(): stack empty");
+    arena.Release(std::move(stack.back()));
+    stack.pop_back();
+}
+
+/** Push a copy of vch, which may be an element of the stack */
+static inline void pushstack(std::vector<valtype>& stack, ScriptStackArena& arena, const valtype& vch)
+{
+    valtype vchNew = arena.Take();
+    vchNew.assign(vch.begin(), vch.end());
+    stack.push_back(std::move(vchNew));
+}
+
+static inline void pushstack(std::vector<valtype>& stack, ScriptStackArena& arena, const CScriptNum& bn)
+{
+    valtype vchNew = arena.Take();
+    bn.getvch(vchNew);
+    stack.push_back(std::move(vchNew));
+}
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
@@ -248,7 +273,7 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     return true;
 }
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror, ScriptStackArena* arena)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -265,6 +290,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     valtype vchPushValue;
     std::vector<bool> vfExec;
     std::vector<valtype> altstack;
+    ScriptStackArena arenaLocal;
+    ScriptStackArena& buffers = arena ? *arena : arenaLocal;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > MAX_SCRIPT_SIZE)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -310,7 +337,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, SCRIPT_ERR_MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                pushstack(stack, buffers, vchPushValue);
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -337,7 +364,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    pushstack(stack, buffers, bn);
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -450,7 +477,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         fValue = CastToBool(vch);
                         if (opcode == OP_NOTIF)
                             fValue = !fValue;
-                        popstack(stack);
+                        popstack(stack, buffers);
                     }
                     vfExec.push_back(fValue);
                 }
@@ -480,7 +507,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     bool fValue = CastToBool(stacktop(-1));
                     if (fValue)
-                        popstack(stack);
+                        popstack(stack, buffers);
                     else
                         return set_error(serror, SCRIPT_ERR_VERIFY);
                 }
@@ -500,8 +527,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    altstack.push_back(stacktop(-1));
-                    popstack(stack);
+                    altstack.push_back(std::move(stacktop(-1)));
+                    stack.pop_back();
                 }
                 break;
 
@@ -509,8 +536,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     if (altstack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_ALTSTACK_OPERATION);
-                    stack.push_back(altstacktop(-1));
-                    popstack(altstack);
+                    stack.push_back(std::move(altstacktop(-1)));
+                    altstack.pop_back();
                 }
                 break;
 
@@ -519,8 +546,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- )
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    popstack(stack);
-                    popstack(stack);
+                    popstack(stack, buffers);
+                    popstack(stack, buffers);
                 }
                 break;
 
@@ -529,10 +556,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    pushstack(stack, buffers, stacktop(-2));
+                    pushstack(stack, buffers, stacktop(-2));
                 }
                 break;
 
@@ -541,12 +566,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
-                    stack.push_back(vch3);
+                    pushstack(stack, buffers, stacktop(-3));
+                    pushstack(stack, buffers, stacktop(-3));
+                    pushstack(stack, buffers, stacktop(-3));
                 }
                 break;
 
@@ -555,10 +577,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    pushstack(stack, buffers, stacktop(-4));
+                    pushstack(stack, buffers, stacktop(-4));
                 }
                 break;
 
@@ -567,11 +587,11 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    valtype vch1 = std::move(stacktop(-6));
+                    valtype vch2 = std::move(stacktop(-5));
                     stack.erase(stack.end()-6, stack.end()-4);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -590,9 +610,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1)))
+                        pushstack(stack, buffers, stacktop(-1));
                 }
                 break;
 
@@ -600,7 +619,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    pushstack(stack, buffers, bn);
                 }
                 break;
 
@@ -609,7 +628,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x -- )
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    popstack(stack);
+                    popstack(stack, buffers);
                 }
                 break;
 
@@ -618,8 +637,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    pushstack(stack, buffers, stacktop(-1));
                 }
                 break;
 
@@ -628,6 +646,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
+                    buffers.Release(std::move(stacktop(-2)));
                     stack.erase(stack.end() - 2);
                 }
                 break;
@@ -637,8 +656,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-2);
-                    stack.push_back(vch);
+                    pushstack(stack, buffers, stacktop(-2));
                 }
                 break;
 
@@ -650,13 +668,16 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     int n = CScriptNum(stacktop(-1), fRequireMinimal).getint();
-                    popstack(stack);
+                    popstack(stack, buffers);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n-1);
-                    if (opcode == OP_ROLL)
+                    if (opcode == OP_ROLL) {
+                        valtype vch = std::move(stacktop(-n-1));
                         stack.erase(stack.end()-n-1);
-                    stack.push_back(vch);
+                        stack.push_back(std::move(vch));
+                    } else {
+                        pushstack(stack, buffers, stacktop(-n-1));
+                    }
                 }
                 break;
 
@@ -686,8 +707,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.insert(stack.end()-2, vch);
+                    valtype vch = buffers.Take();
+                    vch.assign(stacktop(-1).begin(), stacktop(-1).end());
+                    stack.insert(stack.end()-2, std::move(vch));
                 }
                 break;
 
@@ -698,7 +720,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    pushstack(stack, buffers, bn);
                 }
                 break;
 
@@ -721,13 +743,13 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // zero bytes after it (numerically, 0x01 == 0x0001 == 0x000001)
                     //if (opcode == OP_NOTEQUAL)
                     //    fEqual = !fEqual;
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fEqual ? vchTrue : vchFalse);
+                    popstack(stack, buffers);
+                    popstack(stack, buffers);
+                    pushstack(stack, buffers, fEqual ? vchTrue : vchFalse);
                     if (opcode == OP_EQUALVERIFY)
                     {
                         if (fEqual)
-                            popstack(stack);
+                            popstack(stack, buffers);
                         else
                             return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
                     }
@@ -759,8 +781,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     case OP_0NOTEQUAL:  bn = (bn != bnZero); break;
                     default:            assert(!"invalid opcode"); break;
                     }
-                    popstack(stack);
-                    stack.push_back(bn.getvch());
+                    popstack(stack, buffers);
+                    pushstack(stack, buffers, bn);
                 }
                 break;
 
@@ -807,14 +829,14 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     case OP_MAX:                 bn = (bn1 > bn2 ? bn1 : bn2); break;
                     default:                     assert(!"invalid opcode"); break;
                     }
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(bn.getvch());
+                    popstack(stack, buffers);
+                    popstack(stack, buffers);
+                    pushstack(stack, buffers, bn);
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
                         if (CastToBool(stacktop(-1)))
-                            popstack(stack);
+                            popstack(stack, buffers);
                         else
                             return set_error(serror, SCRIPT_ERR_NUMEQUALVERIFY);
                     }
@@ -830,10 +852,10 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     CScriptNum bn2(stacktop(-2), fRequireMinimal);
                     CScriptNum bn3(stacktop(-1), fRequireMinimal);
                     bool fValue = (bn2 <= bn1 && bn1 < bn3);
-                    popstack(stack);
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fValue ? vchTrue : vchFalse);
+                    popstack(stack, buffers);
+                    popstack(stack, buffers);
+                    popstack(stack, buffers);
+                    pushstack(stack, buffers, fValue ? vchTrue : vchFalse);
                 }
                 break;
 
@@ -851,7 +873,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    valtype vchHash = buffers.Take();
+                    vchHash.resize((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
                     if (opcode == OP_RIPEMD160)
                         CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_SHA1)
@@ -862,8 +885,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         CHash160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_HASH256)
                         CHash256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                    popstack(stack, buffers);
+                    stack.push_back(std::move(vchHash));
                 }
                 break;
 
@@ -901,13 +924,13 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
                         return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
 
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    popstack(stack, buffers);
+                    popstack(stack, buffers);
+                    pushstack(stack, buffers, fSuccess ? vchTrue : vchFalse);
                     if (opcode == OP_CHECKSIGVERIFY)
                     {
                         if (fSuccess)
-                            popstack(stack);
+                            popstack(stack, buffers);
                         else
                             return set_error(serror, SCRIPT_ERR_CHECKSIGVERIFY);
                     }
@@ -995,7 +1018,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                             return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
                         if (ikey2 > 0)
                             ikey2--;
-                        popstack(stack);
+                        popstack(stack, buffers);
                     }
 
                     // A bug causes CHECKMULTISIG to consume one extra argument
@@ -1008,14 +1031,14 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stacktop(-1).size())
                         return set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
-                    popstack(stack);
+                    popstack(stack, buffers);
 
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    pushstack(stack, buffers, fSuccess ? vchTrue : vchFalse);
 
                     if (opcode == OP_CHECKMULTISIGVERIFY)
                     {
                         if (fSuccess)
-                            popstack(stack);
+                            popstack(stack, buffers);
                         else
                             return set_error(serror, SCRIPT_ERR_CHECKMULTISIGVERIFY);
                     }
@@ -1177,16 +1200,57 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
     return ss.GetHash();
 }
 
+/** Serialized size of an input with its script blanked out, as in a legacy
+ * SIGHASH_ALL signature hash: prevout, empty script and nSequence */
+const size_t LEGACY_BLANK_INPUT_SIZE = 32 + 4 + 1 + 4;
+
 } // namespace
 
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
 {
     // Cache is calculated only for transactions with witness
     if (txTo.HasWitness()) {
-        hashPrevouts = GetPrevoutHash(txTo);
-        hashSequence = GetSequenceHash(txTo);
-        hashOutputs = GetOutputsHash(txTo);
-        ready = true;
+        Compute(txTo);
+    } else {
+        ComputeLegacy(txTo);
+    }
+}
+
+void PrecomputedTransactionData::Compute(const CTransaction& txTo)
+{
+    hashPrevouts = GetPrevoutHash(txTo);
+    hashSequence = GetSequenceHash(txTo);
+    hashOutputs = GetOutputsHash(txTo);
+    ready = true;
+    // Witness transactions can spend legacy outputs too
+    ComputeLegacy(txTo);
+}
+
+void PrecomputedTransactionData::ComputeLegacy(const CTransaction& txTo)
+{
+    vLegacyMidstate.clear();
+    vLegacyTail.clear();
+    if (txTo.vin.size() < LEGACY_SIGHASH_CACHE_MIN_INPUTS)
+        return;
+
+    CVectorWriter writer(SER_GETHASH, 0, vLegacyTail, 0);
+    for (const CTxIn& txin : txTo.vin) {
+        writer << txin.prevout << CScript() << txin.nSequence;
+    }
+    assert(vLegacyTail.size() == txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+    ::WriteCompactSize(writer, txTo.vout.size());
+    for (const CTxOut& txout : txTo.vout) {
+        writer << txout;
+    }
+    writer << txTo.nLockTime;
+
+    vLegacyMidstate.reserve(txTo.vin.size());
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.nVersion;
+    ::WriteCompactSize(ss, txTo.vin.size());
+    for (size_t i = 0; i < txTo.vin.size(); i++) {
+        vLegacyMidstate.push_back(ss);
+        ss.write((const char*)&vLegacyTail[i * LEGACY_BLANK_INPUT_SIZE], LEGACY_BLANK_INPUT_SIZE);
     }
 }
 
@@ -1253,6 +1317,18 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SIGHASH_ALL serializes the other inputs blanked out and all outputs,
+    // continue from the cached state instead
+    if (cache && cache->vLegacyMidstate.size() == txTo.vin.size() &&
+            !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CHashWriter ss(cache->vLegacyMidstate[nIn]);
+        txTmp.SerializeInput(ss, nIn);
+        const size_t nTail = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+        ss.write((const char*)cache->vLegacyTail.data() + nTail, cache->vLegacyTail.size() - nTail);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1367,7 +1443,7 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum& nSequence) con
     return true;
 }
 
-static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion, const std::vector<unsigned char>& program, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion, const std::vector<unsigned char>& program, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, ScriptStackArena& arena)
 {
     std::vector<std::vector<unsigned char> > stack;
     CScript scriptPubKey;
@@ -1408,7 +1484,7 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
             return set_error(serror, SCRIPT_ERR_PUSH_SIZE);
     }
 
-    if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_WITNESS_V0, serror)) {
+    if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_WITNESS_V0, serror, &arena)) {
         return false;
     }
 
@@ -1434,13 +1510,15 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    // Shared by all the scripts evaluated below
+    ScriptStackArena arena;
     std::vector<std::vector<unsigned char> > stack, stackCopy;
-    if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror))
+    if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror, &arena))
         // serror is set
         return false;
     if (flags & SCRIPT_VERIFY_P2SH)
         stackCopy = stack;
-    if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_BASE, serror))
+    if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_BASE, serror, &arena))
         // serror is set
         return false;
     if (stack.empty())
@@ -1458,7 +1536,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
                 // The scriptSig must be _exactly_ CScript(), otherwise we reintroduce malleability.
                 return set_error(serror, SCRIPT_ERR_WITNESS_MALLEATED);
             }
-            if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, serror)) {
+            if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, serror, arena)) {
                 return false;
             }
             // Bypass the cleanstack check at the end. The actual stack is obviously not clean
@@ -1484,9 +1562,9 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
 
         const valtype& pubKeySerialized = stack.back();
         CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
-        popstack(stack);
+        popstack(stack, arena);
 
-        if (!EvalScript(stack, pubKey2, flags, checker, SIGVERSION_BASE, serror))
+        if (!EvalScript(stack, pubKey2, flags, checker, SIGVERSION_BASE, serror, &arena))
             // serror is set
             return false;
         if (stack.empty())
@@ -1503,7 +1581,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
                     // reintroduce malleability.
                     return set_error(serror, SCRIPT_ERR_WITNESS_MALLEATED_P2SH);
                 }
-                if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, serror)) {
+                if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, serror, arena)) {
                     return false;
                 }
                 // Bypass the cleanstack check at the end. The actual stack is obviously not clean
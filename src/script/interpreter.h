@@ -6,9 +6,11 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include <hash.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
+#include <utility>
 #include <vector>
 #include <stdint.h>
 #include <string>
@@ -115,12 +117,34 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
 
+/** Inputs a transaction needs for the legacy sighash cache to be built */
+static const unsigned int LEGACY_SIGHASH_CACHE_MIN_INPUTS = 4;
+
 struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * Legacy SIGHASH_ALL signature hashes serialize every input of the
+     * transaction, which makes checking all of them quadratic. The parts
+     * that don't depend on the input being signed are cached: the hash state
+     * after the inputs before each input, with their scripts blanked out, and
+     * the serialization of all inputs blanked out followed by the outputs and
+     * the lock time. Empty for transactions with fewer than
+     * LEGACY_SIGHASH_CACHE_MIN_INPUTS inputs.
+     */
+    std::vector<CHashWriter> vLegacyMidstate;
+    std::vector<unsigned char> vLegacyTail;
+
     explicit PrecomputedTransactionData(const CTransaction& tx);
+
+    /** Compute the hashes whether or not tx has witness data yet, as when
+     * signing it. They don't commit to the witnesses. */
+    void Compute(const CTransaction& tx);
+
+private:
+    void ComputeLegacy(const CTransaction& tx);
 };
 
 enum SigVersion
@@ -185,7 +209,41 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : TransactionSignatureChecker(&txTo, nInIn, amountIn), txTo(*txToIn) {}
 };
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* error = nullptr);
+/** Most element buffers a ScriptStackArena keeps for reuse */
+static const size_t SCRIPT_ARENA_MAX_BUFFERS = 128;
+
+/**
+ * Buffers of the stack elements dropped while evaluating scripts, handed out
+ * again for the elements pushed later, so that a script check doesn't
+ * allocate for every push once its arena is warm. VerifyScript uses one
+ * arena for all the scripts it evaluates. Not thread safe.
+ */
+class ScriptStackArena
+{
+public:
+    /** Return an empty buffer, with the capacity of a released one if any */
+    std::vector<unsigned char> Take()
+    {
+        if (vFree.empty())
+            return std::vector<unsigned char>();
+        std::vector<unsigned char> vch = std::move(vFree.back());
+        vFree.pop_back();
+        vch.clear();
+        return vch;
+    }
+
+    /** Keep the buffer of a dropped stack element */
+    void Release(std::vector<unsigned char>&& vch)
+    {
+        if (vch.capacity() && vFree.size() < SCRIPT_ARENA_MAX_BUFFERS)
+            vFree.push_back(std::move(vch));
+    }
+
+private:
+    std::vector<std::vector<unsigned char>> vFree;
+};
+
+bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* error = nullptr, ScriptStackArena* arena = nullptr);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = nullptr);
 
 size_t CountWitnessSigOps(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags);
@@ -5,6 +5,7 @@
 
 #include <script/script.h>
 
+#include <script/scriptpattern.h>
 #include <tinyformat.h>
 #include <uint256.h>
 #include <utilstrencodings.h>
@@ -251,150 +252,73 @@ bool CScript::IsDrivechain(uint8_t& nSidechain) const
 
 bool CScript::IsCriticalHashCommit(uint256& hash, std::vector<unsigned char>& vBytes) const
 {
-    // Check script size
-    size_t size = this->size();
-    if (size < 37) // sha256 hash + optional data / flag bytes + opcodes
+    // sha256 hash + optional data / flag bytes + opcodes
+    if (!CRITICAL_HASH_COMMIT_PATTERN.Match(*this))
         return false;
 
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xD1 ||
-            (*this)[2] != 0x61 ||
-            (*this)[3] != 0x73 ||
-            (*this)[4] != 0x68)
+    const unsigned char* p = &(*this)[0];
+    if (IsNullScriptHash(p + 5))
         return false;
 
-    hash = uint256(std::vector<unsigned char>(this->begin() + 5, this->begin() + 37));
+    hash = ReadScriptHash(p + 5);
 
-    if (hash.IsNull())
-        return false;
-
-    if (size > 37)
-        vBytes = std::vector<unsigned char>(this->begin() + 37, this->end());
+    if (size() > 37)
+        vBytes.assign(p + 37, p + size());
 
     return true;
 }
 
 bool CScript::IsWithdrawalHashCommit(uint256& hash, uint8_t& nSidechain) const
 {
-    // Check script size
-    size_t size = this->size();
-    if (size != 38) // sha256 hash + nSidechain + opcodes
+    // sha256 hash + nSidechain + opcodes
+    if (!WITHDRAWAL_HASH_COMMIT_PATTERN.Match(*this))
         return false;
 
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xD4 ||
-            (*this)[2] != 0x5A ||
-            (*this)[3] != 0xA9 ||
-            (*this)[4] != 0x43)
+    const unsigned char* p = &(*this)[0];
+    if (IsNullScriptHash(p + 5))
         return false;
 
-    hash = uint256(std::vector<unsigned char>(this->begin() + 5, this->begin() + 37));
-    nSidechain = (*this)[37];
-
-    if (hash.IsNull())
-        return false;
+    hash = ReadScriptHash(p + 5);
+    nSidechain = p[37];
 
     return true;
 }
 
 bool CScript::IsSidechainProposalCommit() const
 {
-    // Check script size
-    // TODO should we have a max size? Probably not.
-    size_t size = this->size();
-    if (size < 10) // TODO put in exact minimum size of SidechainProposal serialization
-        return false;
-
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xD5 ||
-            (*this)[2] != 0xE0 ||
-            (*this)[3] != 0xC4 ||
-            (*this)[4] != 0xAF)
-        return false;
-
+    // TODO put in exact minimum size of SidechainProposal serialization
     // TODO deserialize sidechain
     // TODO check validity of sidechain
-
-    return true;
+    return SIDECHAIN_PROPOSAL_COMMIT_PATTERN.Match(*this);
 }
 
 bool CScript::IsSidechainActivationCommit(uint256& hashSidechain) const
 {
-    // Check script size
-    size_t size = this->size();
-    if (size < 37)
+    if (!SIDECHAIN_ACTIVATION_COMMIT_PATTERN.Match(*this))
         return false;
 
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xD6 ||
-            (*this)[2] != 0xE1 ||
-            (*this)[3] != 0xC5 ||
-            (*this)[4] != 0xBF)
+    const unsigned char* p = &(*this)[0];
+    if (IsNullScriptHash(p + 5))
         return false;
 
-    hashSidechain = uint256(std::vector<unsigned char>(this->begin() + 5, this->begin() + 37));
-    if (hashSidechain.IsNull())
-        return false;
+    hashSidechain = ReadScriptHash(p + 5);
 
     return true;
 }
 
 bool CScript::IsSCDBBytes() const
 {
-    // Check script size
-    size_t size = this->size();
-    if (size < 6)
-        return false;
-
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xD7 ||
-            (*this)[2] != 0x7D ||
-            (*this)[3] != 0x17 ||
-            (*this)[4] != 0x76)
-        return false;
-
-    return true;
+    return SCDB_BYTES_PATTERN.Match(*this);
 }
 
 bool CScript::IsNewsTokyoDay() const
 {
-    // Check script size
-    size_t size = this->size();
-    if (size < 5)
-        return false;
-
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xA1 ||
-            (*this)[2] != 0xB2 ||
-            (*this)[3] != 0xC3 ||
-            (*this)[4] != 0x01)
-        return false;
-
-    return true;
+    return NEWS_TOKYO_DAY_PATTERN.Match(*this);
 }
 
 bool CScript::IsNewsUSDay() const
 {
-    // Check script size
-    size_t size = this->size();
-    if (size < 5)
-        return false;
-
-    // Check script header
-    if ((*this)[0] != OP_RETURN ||
-            (*this)[1] != 0xA1 ||
-            (*this)[2] != 0xB2 ||
-            (*this)[3] != 0xC3 ||
-            (*this)[4] != 0x02)
-        return false;
-
-    return true;
+    return NEWS_US_DAY_PATTERN.Match(*this);
 }
 
 bool CScript::IsPushOnly(const_iterator pc) const
@@ -325,12 +325,25 @@ public:
         return serialize(m_value);
     }
 
+    /** Serialize into vch, reusing its buffer */
+    void getvch(std::vector<unsigned char>& vch) const
+    {
+        serialize(m_value, vch);
+    }
+
     static std::vector<unsigned char> serialize(const int64_t& value)
     {
+        std::vector<unsigned char> result;
+        serialize(value, result);
+        return result;
+    }
+
+    static void serialize(const int64_t& value, std::vector<unsigned char>& result)
+    {
+        result.clear();
         if(value == 0)
-            return std::vector<unsigned char>();
+            return;
 
-        std::vector<unsigned char> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -354,8 +367,6 @@ public:
             result.push_back(neg ? 0x80 : 0);
         else if (neg)
             result.back() |= 0x80;
-
-        return result;
     }
 
 private:
@@ -0,0 +1,84 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SCRIPT_SCRIPTPATTERN_H
+#define BITCOIN_SCRIPT_SCRIPTPATTERN_H
+
+#include <crypto/common.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <limits>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** No upper limit on the size of a script matching a ScriptPattern */
+static constexpr size_t SCRIPT_PATTERN_ANY_SIZE = std::numeric_limits<size_t>::max();
+
+/**
+ * The shape of a drivechain script: N fixed header bytes, followed by fields
+ * at fixed offsets, nMinSize to nMaxSize bytes in total.
+ *
+ * Matching compares the size and the header in place, and the fields are
+ * then read straight out of the script with the Read* helpers below, so
+ * recognizing a commitment doesn't copy the script or allocate. nMinSize
+ * must be at least N and cover the fixed fields that are read.
+ */
+template <size_t N>
+struct ScriptPattern
+{
+    unsigned char prefix[N];
+    size_t nMinSize;
+    size_t nMaxSize;
+
+    bool Match(const unsigned char* p, size_t nSize) const
+    {
+        return nSize >= nMinSize && nSize <= nMaxSize && memcmp(p, prefix, N) == 0;
+    }
+
+    /** Match a CScript, or any other contiguous container of bytes */
+    template <typename T>
+    bool Match(const T& script) const
+    {
+        return !script.empty() && Match(&script[0], script.size());
+    }
+};
+
+/** 32 byte hash at p */
+inline uint256 ReadScriptHash(const unsigned char* p)
+{
+    uint256 hash;
+    memcpy(hash.begin(), p, 32);
+    return hash;
+}
+
+/** Whether the 32 bytes at p are all zero, without reading them into a uint256 */
+inline bool IsNullScriptHash(const unsigned char* p)
+{
+    for (int i = 0; i < 32; i++)
+        if (p[i] != 0)
+            return false;
+    return true;
+}
+
+/** h* commitment: OP_RETURN, header, hash, optional critical data bytes */
+static constexpr ScriptPattern<5> CRITICAL_HASH_COMMIT_PATTERN = {{OP_RETURN, 0xD1, 0x61, 0x73, 0x68}, 37, SCRIPT_PATTERN_ANY_SIZE};
+/** Withdrawal bundle hash commitment: OP_RETURN, header, hash, nSidechain */
+static constexpr ScriptPattern<5> WITHDRAWAL_HASH_COMMIT_PATTERN = {{OP_RETURN, 0xD4, 0x5A, 0xA9, 0x43}, 38, 38};
+/** Sidechain proposal: OP_RETURN, header, serialized proposal */
+static constexpr ScriptPattern<5> SIDECHAIN_PROPOSAL_COMMIT_PATTERN = {{OP_RETURN, 0xD5, 0xE0, 0xC4, 0xAF}, 10, SCRIPT_PATTERN_ANY_SIZE};
+/** Sidechain activation ack: OP_RETURN, header, proposal hash */
+static constexpr ScriptPattern<5> SIDECHAIN_ACTIVATION_COMMIT_PATTERN = {{OP_RETURN, 0xD6, 0xE1, 0xC5, 0xBF}, 37, SCRIPT_PATTERN_ANY_SIZE};
+/** SCDB update bytes: OP_RETURN, header, version, votes */
+static constexpr ScriptPattern<5> SCDB_BYTES_PATTERN = {{OP_RETURN, 0xD7, 0x7D, 0x17, 0x76}, 6, SCRIPT_PATTERN_ANY_SIZE};
+/** Withdrawal fee output: OP_RETURN, push of the 8 byte amount */
+static constexpr ScriptPattern<2> WITHDRAWAL_FEES_PATTERN = {{OP_RETURN, 0x08}, 10, 10};
+/** Coin news of the Tokyo day and of the US day */
+static constexpr ScriptPattern<5> NEWS_TOKYO_DAY_PATTERN = {{OP_RETURN, 0xA1, 0xB2, 0xC3, 0x01}, 5, SCRIPT_PATTERN_ANY_SIZE};
+static constexpr ScriptPattern<5> NEWS_US_DAY_PATTERN = {{OP_RETURN, 0xA1, 0xB2, 0xC3, 0x02}, 5, SCRIPT_PATTERN_ANY_SIZE};
+/** BMM request critical data bytes: header, nSidechain, 4 prev block bytes */
+static constexpr ScriptPattern<3> BMM_REQUEST_PATTERN = {{0x00, 0xbf, 0x00}, 8, 8};
+
+#endif // BITCOIN_SCRIPT_SCRIPTPATTERN_H
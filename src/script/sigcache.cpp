@@ -14,23 +14,48 @@
 #include <cuckoocache.h>
 #include <boost/thread.hpp>
 
+#include <atomic>
+
 namespace {
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * The cache is split into SIGCACHE_SHARDS independently locked shards by the
+ * first byte of the entry, so that the script check threads and mempool
+ * acceptance rarely wait for each other.
  */
 class CSignatureCache
 {
 private:
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+
+    struct Shard
+    {
+        map_type setValid;
+        boost::shared_mutex cs_sigcache;
+        std::atomic<uint64_t> nHits{0};
+        std::atomic<uint64_t> nMisses{0};
+        std::atomic<uint64_t> nInserts{0};
+        std::atomic<uint64_t> nEvictions{0};
+    };
+
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    Shard vShard[SIGCACHE_SHARDS];
+    uint32_t nElements;
+
+    Shard& GetShard(const uint256& entry)
+    {
+        // The entries are hashes, any byte spreads them evenly. The cuckoo
+        // cache locates entries by the high bits of each 32 bit word, so the
+        // low bits of the first byte don't correlate with the location.
+        return vShard[*entry.begin() % SIGCACHE_SHARDS];
+    }
 
 public:
-    CSignatureCache()
+    CSignatureCache() : nElements(0)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -44,18 +69,57 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        Shard& shard = GetShard(entry);
+        bool fFound;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(shard.cs_sigcache);
+            fFound = shard.setValid.contains(entry, erase);
+        }
+        if (fFound)
+            shard.nHits.fetch_add(1, std::memory_order_relaxed);
+        else
+            shard.nMisses.fetch_add(1, std::memory_order_relaxed);
+        return fFound;
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        Shard& shard = GetShard(entry);
+        uint32_t nEvicted;
+        {
+            boost::unique_lock<boost::shared_mutex> lock(shard.cs_sigcache);
+            nEvicted = shard.setValid.insert(entry);
+        }
+        shard.nInserts.fetch_add(1, std::memory_order_relaxed);
+        if (nEvicted)
+            shard.nEvictions.fetch_add(nEvicted, std::memory_order_relaxed);
+    }
+
+    void Erase(const uint256& entry)
+    {
+        Shard& shard = GetShard(entry);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs_sigcache);
+        shard.setValid.contains(entry, true);
     }
+
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        nElements = 0;
+        for (Shard& shard : vShard)
+            nElements += shard.setValid.setup_bytes(n / SIGCACHE_SHARDS);
+        return nElements;
+    }
+
+    void GetStats(SignatureCacheStats& stats) const
+    {
+        stats = SignatureCacheStats();
+        stats.nElements = nElements;
+        for (const Shard& shard : vShard) {
+            stats.nHits += shard.nHits.load(std::memory_order_relaxed);
+            stats.nMisses += shard.nMisses.load(std::memory_order_relaxed);
+            stats.nInserts += shard.nInserts.load(std::memory_order_relaxed);
+            stats.nEvictions += shard.nEvictions.load(std::memory_order_relaxed);
+        }
     }
 };
 
@@ -80,6 +144,11 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void GetSignatureCacheStats(SignatureCacheStats& stats)
+{
+    signatureCache.GetStats(stats);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -90,5 +159,19 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         return false;
     if (store)
         signatureCache.Set(entry);
+    else if (pvEntryRet)
+        pvEntryRet->push_back(entry);
     return true;
 }
+
+void AddSignatureCacheEntries(const std::vector<uint256>& vEntry)
+{
+    for (uint256 entry : vEntry)
+        signatureCache.Set(entry);
+}
+
+void EraseSignatureCacheEntries(const std::vector<uint256>& vEntry)
+{
+    for (const uint256& entry : vEntry)
+        signatureCache.Erase(entry);
+}
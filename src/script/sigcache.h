@@ -18,6 +18,9 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
+/** Number of independently locked shards of the signature cache */
+static const unsigned int SIGCACHE_SHARDS = 16;
+
 class CPubKey;
 
 /**
@@ -45,13 +48,35 @@ class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    //! If not storing, where to collect the cache entries of the valid signatures
+    std::vector<uint256>* pvEntryRet;
     std::multimap<uint256, int> mapLD;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {};
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, std::vector<uint256>* pvEntryRetIn = nullptr) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), pvEntryRet(pvEntryRetIn) {};
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
 void InitSignatureCache();
 
+/** Store the entries collected by a CachingTransactionSignatureChecker once
+ * the transaction they belong to turns out to be worth caching */
+void AddSignatureCacheEntries(const std::vector<uint256>& vEntry);
+/** Remove entries added with AddSignatureCacheEntries */
+void EraseSignatureCacheEntries(const std::vector<uint256>& vEntry);
+
+/** Lookup and insert counters of the signature cache since startup */
+struct SignatureCacheStats
+{
+    //! The number of entries the cache can hold
+    uint64_t nElements = 0;
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nInserts = 0;
+    //! Entries that were pushed out or aged out before they were used
+    uint64_t nEvictions = 0;
+};
+
+void GetSignatureCacheStats(SignatureCacheStats& stats);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
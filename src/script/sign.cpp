@@ -11,11 +11,15 @@
 #include <primitives/transaction.h>
 #include <script/standard.h>
 #include <uint256.h>
+#include <util.h>
+
+#include <algorithm>
+#include <thread>
 
 
 typedef std::vector<unsigned char> valtype;
 
-TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), checker(txTo, nIn, amountIn) {}
+TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn, const PrecomputedTransactionData* txdataIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(txdataIn), checker(txdataIn ? TransactionSignatureChecker(txTo, nIn, amountIn, *txdataIn) : TransactionSignatureChecker(txTo, nIn, amountIn)) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode, SigVersion sigversion) const
 {
@@ -27,7 +31,7 @@ bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig,
     if (sigversion == SIGVERSION_WITNESS_V0 && !key.IsCompressed())
         return false;
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion);
+    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, txdata);
     if (!key.Sign(hash, vchSig))
         return false;
     vchSig.push_back((unsigned char)nHashType);
@@ -203,6 +207,55 @@ void UpdateTransaction(CMutableTransaction& tx, unsigned int nIn, const Signatur
     tx.vin[nIn].scriptWitness = data.scriptWitness;
 }
 
+bool ProduceSignatures(const CKeyStore& keystore, const CTransaction& txTo, const std::vector<CTxOut>& vSpent, int nHashType, std::vector<SignatureData>& vSigDataRet)
+{
+    assert(vSpent.size() == txTo.vin.size());
+    const size_t nInputs = txTo.vin.size();
+    vSigDataRet.assign(nInputs, SignatureData());
+
+    PrecomputedTransactionData txdata(txTo);
+    txdata.Compute(txTo);
+
+    // Each thread takes every nThreads'th input. The inputs only share the
+    // key store, which locks itself, and the precomputed data.
+    const int nThreads = std::max(1, std::min<int>({GetNumCores(), MAX_SIGNING_THREADS, (int)(nInputs / SIGNING_THREAD_MIN_INPUTS)}));
+    std::vector<char> vSigned(nInputs, 1);
+    auto work = [&keystore, &txTo, &vSpent, nHashType, &txdata, &vSigDataRet, &vSigned, nInputs, nThreads](int nThread) {
+        for (size_t i = nThread; i < nInputs; i += nThreads) {
+            if (vSpent[i].scriptPubKey.empty())
+                continue;
+            TransactionSignatureCreator creator(&keystore, &txTo, i, vSpent[i].nValue, nHashType, &txdata);
+            vSigned[i] = ProduceSignature(creator, vSpent[i].scriptPubKey, vSigDataRet[i]);
+        }
+    };
+
+    std::vector<std::thread> vThread;
+    for (int i = 1; i < nThreads; i++) {
+        try {
+            vThread.emplace_back(work, i);
+        } catch (const std::system_error&) {
+            work(i);
+        }
+    }
+    work(0);
+    for (std::thread& thread : vThread)
+        thread.join();
+
+    return std::find(vSigned.begin(), vSigned.end(), 0) == vSigned.end();
+}
+
+bool SignTransactionInputs(const CKeyStore& keystore, CMutableTransaction& txTo, const std::vector<CTxOut>& vSpent, int nHashType)
+{
+    std::vector<SignatureData> vSigData;
+    if (!ProduceSignatures(keystore, CTransaction(txTo), vSpent, nHashType, vSigData))
+        return false;
+    for (size_t i = 0; i < vSigData.size(); i++) {
+        if (!vSpent[i].scriptPubKey.empty())
+            UpdateTransaction(txTo, i, vSigData[i]);
+    }
+    return true;
+}
+
 bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, const CAmount& amount, int nHashType)
 {
     assert(nIn < txTo.vin.size());
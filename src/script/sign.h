@@ -12,9 +12,15 @@ class CKeyID;
 class CKeyStore;
 class CScript;
 class CTransaction;
+class CTxOut;
 
 struct CMutableTransaction;
 
+//! Maximum number of threads signing the inputs of one transaction
+static const int MAX_SIGNING_THREADS = 8;
+//! Inputs each signing thread should have at least
+static const unsigned int SIGNING_THREAD_MIN_INPUTS = 8;
+
 /** Virtual base class for signature creators. */
 class BaseSignatureCreator {
 protected:
@@ -36,10 +42,11 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     int nHashType;
     CAmount amount;
+    const PrecomputedTransactionData* txdata;
     const TransactionSignatureChecker checker;
 
 public:
-    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn=SIGHASH_ALL);
+    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn=SIGHASH_ALL, const PrecomputedTransactionData* txdataIn=nullptr);
     const BaseSignatureChecker& Checker() const override { return checker; }
     bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const override;
 };
@@ -70,6 +77,20 @@ struct SignatureData {
 /** Produce a script signature using a generic signature creator. */
 bool ProduceSignature(const BaseSignatureCreator& creator, const CScript& scriptPubKey, SignatureData& sigdata);
 
+/**
+ * Produce the script signatures for all inputs of txTo, input i spending
+ * vSpent[i]. The sighash data shared by the inputs is computed once, and the
+ * inputs are split over up to MAX_SIGNING_THREADS threads. An input whose
+ * vSpent scriptPubKey is empty is skipped. vSigDataRet holds what could be
+ * produced for every input, even if it is incomplete. Returns whether all
+ * inputs that weren't skipped were signed.
+ */
+bool ProduceSignatures(const CKeyStore& keystore, const CTransaction& txTo, const std::vector<CTxOut>& vSpent, int nHashType, std::vector<SignatureData>& vSigDataRet);
+
+/** Sign all inputs of txTo with ProduceSignatures. Returns false, leaving
+ * txTo unchanged, unless every input was signed. */
+bool SignTransactionInputs(const CKeyStore& keystore, CMutableTransaction& txTo, const std::vector<CTxOut>& vSpent, int nHashType);
+
 /** Produce a script signature for a transaction. */
 bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, const CAmount& amount, int nHashType);
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType);
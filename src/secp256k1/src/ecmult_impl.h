@@ -44,6 +44,15 @@
 /** The number of entries a table with precomputed multiples needs to have. */
 #define ECMULT_TABLE_SIZE(w) (1 << ((w)-2))
 
+#if defined(USE_ECMULT_STATIC_PRECOMPUTATION) && !defined(USE_ENDOMORPHISM) && !defined(EXHAUSTIVE_TEST_ORDER)
+/* The table of odd multiples of the generator is generated at build time by
+ * gen_context, without the endomorphism */
+#include "ecmult_static_pre_g.h"
+#if ECMULT_STATIC_PRE_G_WINDOW == WINDOW_G
+#define USE_ECMULT_STATIC_PRE_G 1
+#endif
+#endif
+
 /** Fill a table 'prej' with precomputed odd multiples of a. Prej will contain
  *  the values [1*a,3*a,...,(2*n-1)*a], so it space for n values. zr[0] will
  *  contain prej[0].z / a.z. The other zr[i] values = prej[i].z / prej[i-1].z.
@@ -168,6 +177,13 @@ static void secp256k1_ecmult_context_build(secp256k1_ecmult_context *ctx, const
         return;
     }
 
+#ifdef USE_ECMULT_STATIC_PRE_G
+    (void)gj;
+    (void)cb;
+    ctx->pre_g = (secp256k1_ge_storage (*)[])secp256k1_ecmult_static_pre_g;
+    return;
+#endif
+
     /* get the generator */
     secp256k1_gej_set_ge(&gj, &secp256k1_ge_const_g);
 
@@ -198,9 +214,14 @@ static void secp256k1_ecmult_context_clone(secp256k1_ecmult_context *dst,
     if (src->pre_g == NULL) {
         dst->pre_g = NULL;
     } else {
+#ifdef USE_ECMULT_STATIC_PRE_G
+        (void)cb;
+        dst->pre_g = src->pre_g;
+#else
         size_t size = sizeof((*dst->pre_g)[0]) * ECMULT_TABLE_SIZE(WINDOW_G);
         dst->pre_g = (secp256k1_ge_storage (*)[])checked_malloc(cb, size);
         memcpy(dst->pre_g, src->pre_g, size);
+#endif
     }
 #ifdef USE_ENDOMORPHISM
     if (src->pre_g_128 == NULL) {
@@ -218,7 +239,9 @@ static int secp256k1_ecmult_context_is_built(const secp256k1_ecmult_context *ctx
 }
 
 static void secp256k1_ecmult_context_clear(secp256k1_ecmult_context *ctx) {
+#ifndef USE_ECMULT_STATIC_PRE_G
     free(ctx->pre_g);
+#endif
 #ifdef USE_ENDOMORPHISM
     free(ctx->pre_g_128);
 #endif
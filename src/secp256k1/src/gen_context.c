@@ -12,6 +12,7 @@
 #include "scalar_impl.h"
 #include "group_impl.h"
 #include "ecmult_gen_impl.h"
+#include "ecmult_impl.h"
 
 static void default_error_callback_fn(const char* str, void* data) {
     (void)data;
@@ -24,6 +25,46 @@ static const secp256k1_callback default_error_callback = {
     NULL
 };
 
+/* Write the odd multiples of the generator used for verification, so that
+ * verification contexts don't compute them at runtime either */
+static int write_ecmult_pre_g(void) {
+    secp256k1_ecmult_context ctx;
+    int i;
+    FILE* fp;
+
+    fp = fopen("src/ecmult_static_pre_g.h","w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open src/ecmult_static_pre_g.h for writing!\n");
+        return -1;
+    }
+
+    fprintf(fp, "#ifndef _SECP256K1_ECMULT_STATIC_PRE_G_\n");
+    fprintf(fp, "#define _SECP256K1_ECMULT_STATIC_PRE_G_\n");
+    fprintf(fp, "#include \"group.h\"\n");
+    fprintf(fp, "#define ECMULT_STATIC_PRE_G_WINDOW %d\n", WINDOW_G);
+    fprintf(fp, "#define SC SECP256K1_GE_STORAGE_CONST\n");
+    fprintf(fp, "static const secp256k1_ge_storage secp256k1_ecmult_static_pre_g[%d] = {\n", ECMULT_TABLE_SIZE(WINDOW_G));
+
+    secp256k1_ecmult_context_init(&ctx);
+    secp256k1_ecmult_context_build(&ctx, &default_error_callback);
+    for(i = 0; i != ECMULT_TABLE_SIZE(WINDOW_G); i++) {
+        fprintf(fp,"    SC(%uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu)", SECP256K1_GE_STORAGE_CONST_GET((*ctx.pre_g)[i]));
+        if (i != ECMULT_TABLE_SIZE(WINDOW_G) - 1) {
+            fprintf(fp,",\n");
+        } else {
+            fprintf(fp,"\n");
+        }
+    }
+    fprintf(fp,"};\n");
+    secp256k1_ecmult_context_clear(&ctx);
+
+    fprintf(fp, "#undef SC\n");
+    fprintf(fp, "#endif\n");
+    fclose(fp);
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
     secp256k1_ecmult_gen_context ctx;
     int inner;
@@ -70,5 +111,5 @@ int main(int argc, char **argv) {
     fprintf(fp, "#endif\n");
     fclose(fp);
     
-    return 0;
+    return write_ecmult_pre_g();
 }
@@ -146,6 +146,9 @@ enum
     SER_NETWORK         = (1 << 0),
     SER_DISK            = (1 << 1),
     SER_GETHASH         = (1 << 2),
+
+    // modifiers
+    SER_TX_ARENA        = (1 << 3), //!< Unserialize the transactions of a block into one arena
 };
 
 #define READWRITE(obj)      (::SerReadWrite(s, (obj), ser_action))
@@ -7,9 +7,11 @@
 #include <base58.h>
 #include <clientversion.h>
 #include <core_io.h>
+#include <core_memusage.h>
 #include <crypto/sha256.h>
 #include <hash.h>
 #include <key.h>
+#include <primitives/block.h>
 #include <script/script.h>
 #include <streams.h>
 #include <utilstrencodings.h>
@@ -48,18 +50,24 @@ bool SidechainDeposit::operator==(const SidechainDeposit& a) const
 {
     return (a.nSidechain == nSidechain &&
             a.strDest == strDest &&
-            a.tx == tx &&
+            (a.tx && tx ? *a.tx == *tx : a.tx == tx) &&
             a.nBurnIndex == nBurnIndex &&
             a.nTx == nTx &&
             a.hashBlock == hashBlock);
 }
 
+void SidechainDeposit::SetDest(const std::string& strDestIn)
+{
+    strDest = strDestIn;
+    destKey = DepositDestKey(strDest);
+}
+
 std::string SidechainDeposit::ToString() const
 {
     std::stringstream ss;
     ss << "nsidechain=" << (unsigned int)nSidechain << std::endl;
     ss << "strDest=" << strDest << std::endl;
-    ss << "txid=" << tx.GetHash().ToString() << std::endl;
+    ss << "txid=" << (tx ? tx->GetHash().ToString() : "") << std::endl;
     ss << "nBurnIndex=" << nBurnIndex << std::endl;
     ss << "nTx=" << nTx << std::endl;
     ss << "hashblock=" << hashBlock.ToString() << std::endl;
@@ -139,6 +147,23 @@ uint256 Sidechain::GetSerHash() const
     return SerializeHash(*this);
 }
 
+uint256 Sidechain::GetProposalHash() const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << nSidechain << nVersion << title << description << hashID1 << hashID2;
+    return ss.GetHash();
+}
+
+size_t Sidechain::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(title) + memusage::DynamicUsage(description);
+}
+
+size_t SidechainDeposit::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(strDest) + RecursiveDynamicUsage(tx);
+}
+
 uint256 SidechainWithdrawalState::GetSerHash() const
 {
     return SerializeHash(*this);
@@ -177,6 +202,9 @@ uint256 SidechainObj::GetSerHash(void) const
     uint256 ret;
     if (sidechainop == DB_SIDECHAIN_BLOCK_OP)
         ret = SerializeHash(*(SidechainBlockData *) this);
+    else
+    if (sidechainop == DB_SIDECHAIN_BLOCK_DELTA_OP)
+        ret = SerializeHash(*(SidechainBlockDelta *) this);
 
     return ret;
 }
@@ -195,6 +223,245 @@ std::string SidechainBlockData::ToString() const
     return str.str();
 }
 
+void SidechainBlockDelta::SetNull()
+{
+    hashPrevBlock.SetNull();
+    nWithdrawalStatusSize = 0;
+    vWithdrawalStatusChange.clear();
+    fActivationStatusChanged = false;
+    vActivationStatus.clear();
+    nSidechainSize = 0;
+    vSidechainChange.clear();
+    vSpent.clear();
+}
+
+template <typename T>
+static bool SerHashesEqual(const std::vector<T>& a, const std::vector<T>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].GetSerHash() != b[i].GetSerHash())
+            return false;
+    }
+    return true;
+}
+
+void SidechainBlockDelta::Build(const uint256& hashPrevBlockIn, const SidechainBlockData& prev, const SidechainBlockData& data)
+{
+    SetNull();
+    hashPrevBlock = hashPrevBlockIn;
+
+    nWithdrawalStatusSize = data.vWithdrawalStatus.size();
+    for (size_t i = 0; i < data.vWithdrawalStatus.size(); i++) {
+        if (i < prev.vWithdrawalStatus.size() && SerHashesEqual(prev.vWithdrawalStatus[i], data.vWithdrawalStatus[i]))
+            continue;
+        vWithdrawalStatusChange.push_back(std::make_pair(i, data.vWithdrawalStatus[i]));
+    }
+
+    if (!SerHashesEqual(prev.vActivationStatus, data.vActivationStatus)) {
+        fActivationStatusChanged = true;
+        vActivationStatus = data.vActivationStatus;
+    }
+
+    nSidechainSize = data.vSidechain.size();
+    for (size_t i = 0; i < data.vSidechain.size(); i++) {
+        if (i < prev.vSidechain.size() && prev.vSidechain[i].GetSerHash() == data.vSidechain[i].GetSerHash())
+            continue;
+        vSidechainChange.push_back(std::make_pair(i, data.vSidechain[i]));
+    }
+
+    vSpent = data.vSpent;
+}
+
+void SidechainBlockDelta::Apply(SidechainBlockData& data) const
+{
+    data.vWithdrawalStatus.resize(nWithdrawalStatusSize);
+    for (const auto& change : vWithdrawalStatusChange) {
+        if (change.first < data.vWithdrawalStatus.size())
+            data.vWithdrawalStatus[change.first] = change.second;
+    }
+
+    if (fActivationStatusChanged)
+        data.vActivationStatus = vActivationStatus;
+
+    data.vSidechain.resize(nSidechainSize);
+    for (const auto& change : vSidechainChange) {
+        if (change.first < data.vSidechain.size())
+            data.vSidechain[change.first] = change.second;
+    }
+
+    data.vSpent = vSpent;
+}
+
+bool SidechainBlockDelta::IsEmpty() const
+{
+    return (vWithdrawalStatusChange.empty() &&
+            !fActivationStatusChanged &&
+            vSidechainChange.empty() &&
+            vSpent.empty());
+}
+
+std::string SidechainBlockDelta::ToString() const
+{
+    std::stringstream str;
+    str << "sidechainop=" << sidechainop << std::endl;
+    str << "hashPrevBlock=" << hashPrevBlock.ToString() << std::endl;
+    str << "withdrawalstatuschanges=" << vWithdrawalStatusChange.size() << std::endl;
+    str << "activationstatuschanged=" << fActivationStatusChanged << std::endl;
+    str << "sidechainchanges=" << vSidechainChange.size() << std::endl;
+    str << "spent=" << vSpent.size() << std::endl;
+    return str.str();
+}
+
+uint160 DepositDestKey(const std::string& strDest)
+{
+    return Hash160(strDest.begin(), strDest.end());
+}
+
+bool CoinbaseCommitments::empty() const
+{
+    return vWithdrawal.empty() && vSCDBBytes.empty() && vCriticalData.empty() && vProposal.empty() && vActivation.empty();
+}
+
+void CoinbaseCommitments::clear()
+{
+    vWithdrawal.clear();
+    vSCDBBytes.clear();
+    vCriticalData.clear();
+    vProposal.clear();
+    vActivation.clear();
+}
+
+void CoinbaseCommitments::Read(const std::vector<CTxOut>& vout)
+{
+    clear();
+    for (const CTxOut& out : vout) {
+        const CScript& scriptPubKey = out.scriptPubKey;
+
+        uint256 hash;
+        uint8_t nSidechain;
+        CCriticalData data;
+        if (scriptPubKey.IsWithdrawalHashCommit(hash, nSidechain)) {
+            vWithdrawal.emplace_back(nSidechain, hash);
+        }
+        else
+        if (scriptPubKey.IsSCDBBytes()) {
+            vSCDBBytes.push_back(scriptPubKey);
+        }
+        else
+        if (scriptPubKey.IsCriticalHashCommit(data.hashCritical, data.vBytes)) {
+            vCriticalData.push_back(std::move(data));
+        }
+        else
+        if (scriptPubKey.IsSidechainProposalCommit()) {
+            Sidechain proposal;
+            if (proposal.DeserializeFromProposalScript(scriptPubKey))
+                vProposal.push_back(proposal);
+        }
+        else
+        if (scriptPubKey.IsSidechainActivationCommit(hash)) {
+            vActivation.push_back(hash);
+        }
+    }
+}
+
+std::vector<CTxOut> CoinbaseCommitments::GetOutputs() const
+{
+    std::vector<CTxOut> vout;
+    vout.reserve(vWithdrawal.size() + vSCDBBytes.size() + vCriticalData.size() + vProposal.size() + vActivation.size());
+
+    /*
+     * M3
+     * Skydoge Withdrawal commit message "Propose Withdrawal".
+     */
+    for (const std::pair<uint8_t, uint256>& w : vWithdrawal) {
+        CTxOut out;
+        out.nValue = 0;
+        out.scriptPubKey.resize(38);
+        out.scriptPubKey[0] = OP_RETURN;
+        out.scriptPubKey[1] = 0xD4;
+        out.scriptPubKey[2] = 0x5A;
+        out.scriptPubKey[3] = 0xA9;
+        out.scriptPubKey[4] = 0x43;
+        memcpy(&out.scriptPubKey[5], w.second.begin(), 32);
+        out.scriptPubKey[37] = w.first;
+        vout.push_back(std::move(out));
+    }
+
+    // M4 SCDB update bytes
+    for (const CScript& script : vSCDBBytes)
+        vout.emplace_back(0, script);
+
+    /*
+     * M8 (v1)
+     * Critical data / Skydoge BMM commitment request.
+     */
+    for (const CCriticalData& d : vCriticalData) {
+        CTxOut out;
+        out.nValue = 0;
+        out.scriptPubKey.reserve(37 + d.vBytes.size());
+        out.scriptPubKey.resize(37);
+        out.scriptPubKey[0] = OP_RETURN;
+        out.scriptPubKey[1] = 0xD1;
+        out.scriptPubKey[2] = 0x61;
+        out.scriptPubKey[3] = 0x73;
+        out.scriptPubKey[4] = 0x68;
+        memcpy(&out.scriptPubKey[5], d.hashCritical.begin(), 32);
+
+        // Add bytes (optional)
+        out.scriptPubKey.insert(out.scriptPubKey.end(), d.vBytes.begin(), d.vBytes.end());
+        vout.push_back(std::move(out));
+    }
+
+    // M1 sidechain proposals, header 0xD5E0C4AF
+    for (const Sidechain& proposal : vProposal)
+        vout.emplace_back(0, proposal.GetProposalScript());
+
+    // M2 sidechain activation commitments
+    for (const uint256& hash : vActivation) {
+        CTxOut out;
+        out.nValue = 0;
+        out.scriptPubKey.resize(37);
+        out.scriptPubKey[0] = OP_RETURN;
+        out.scriptPubKey[1] = 0xD6;
+        out.scriptPubKey[2] = 0xE1;
+        out.scriptPubKey[3] = 0xC5;
+        out.scriptPubKey[4] = 0xBF;
+        memcpy(&out.scriptPubKey[5], hash.begin(), 32);
+        vout.push_back(std::move(out));
+    }
+
+    return vout;
+}
+
+void CoinbaseCommitments::AddToCoinbase(CBlock& block) const
+{
+    if (empty())
+        return;
+
+    std::vector<CTxOut> vout = GetOutputs();
+
+    CMutableTransaction mtx(*block.vtx[0]);
+    mtx.vout.insert(mtx.vout.end(), std::make_move_iterator(vout.begin()), std::make_move_iterator(vout.end()));
+    block.vtx[0] = MakeTransactionRef(std::move(mtx));
+}
+
+std::shared_ptr<const CoinbaseCommitments> GetCoinbaseCommitments(const CBlock& block)
+{
+    if (block.commitmentsCached)
+        return block.commitmentsCached;
+
+    std::shared_ptr<CoinbaseCommitments> commitments = std::make_shared<CoinbaseCommitments>();
+    if (!block.vtx.empty())
+        commitments->Read(block.vtx[0]->vout);
+
+    if (block.fImmutable)
+        block.commitmentsCached = commitments;
+
+    return commitments;
+}
+
 bool ParseDepositAddress(const std::string& strAddressIn, std::string& strAddressOut, unsigned int& nSidechainOut)
 {
     if (strAddressIn.empty())
@@ -258,3 +525,14 @@ bool ParseDepositAddress(const std::string& strAddressIn, std::string& strAddres
 
     return true;
 }
+
+uint160 ParseDepositDestKey(const std::string& strAddress, unsigned int& nSidechainOut)
+{
+    std::string strDest;
+    unsigned int nSidechain;
+    if (!ParseDepositAddress(strAddress, strDest, nSidechain))
+        return DepositDestKey(strAddress);
+
+    nSidechainOut = nSidechain;
+    return DepositDestKey(strDest);
+}
@@ -9,6 +9,9 @@
 #include <pubkey.h>
 
 #include <array>
+#include <memory>
+
+class CBlock;
 
 // These are the values that will be used in the final release
 //static const int SIDECHAIN_VERIFICATION_PERIOD = 26300;
@@ -48,6 +51,44 @@ static const int SIDECHAIN_VERSION_MAX = 0;
 //! The key for sidechain block data in ldb
 static const char DB_SIDECHAIN_BLOCK_OP = 'S';
 
+//! The key for sidechain block data deltas in ldb
+static const char DB_SIDECHAIN_BLOCK_DELTA_OP = 'D';
+
+//! The key for sidechain deposits by nSidechain and index in ldb
+static const char DB_SIDECHAIN_DEPOSIT_OP = 'd';
+
+//! The key for the number of deposits of a sidechain in ldb
+static const char DB_SIDECHAIN_DEPOSIT_COUNT_OP = 'n';
+
+//! The key for the nSidechain and index of a deposit by txid in ldb
+static const char DB_SIDECHAIN_DEPOSIT_TXID_OP = 't';
+
+//! The key for the rolling MuHash of all deposits in ldb
+static const char DB_SIDECHAIN_DEPOSIT_HASH_OP = 'H';
+
+//! The key for the chainstate best block the deposits in ldb were written with
+static const char DB_SIDECHAIN_DEPOSIT_BEST_BLOCK_OP = 'B';
+
+//! The key for the data to undo the last deposit write in ldb
+static const char DB_SIDECHAIN_DEPOSIT_UNDO_OP = 'u';
+
+//! The key for the blocks that spent an archived withdrawal by nSidechain and
+//! withdrawal hash in ldb
+static const char DB_SIDECHAIN_SPENT_WITHDRAWAL_OP = 'w';
+
+//! The key for the archived withdrawal spends of a block by block hash in ldb
+static const char DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP = 'W';
+
+//! The key for archived failed withdrawals by nSidechain and withdrawal hash
+//! in ldb
+static const char DB_SIDECHAIN_FAILED_WITHDRAWAL_OP = 'f';
+
+//! The key for the height below which block data has been pruned in ldb
+static const char DB_SIDECHAIN_PRUNE_HEIGHT_OP = 'P';
+
+//! Blocks at heights divisible by this store full SCDB data, others a delta
+static const int SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL = 100;
+
 //! The SidechainDB update script version
 static const uint8_t SCDB_BYTES_VERSION = 0;
 static const uint8_t SCDB_BYTES_MAX_VERSION = 0;
@@ -57,6 +98,49 @@ static const char SCDB_UPVOTE = 'u';
 static const char SCDB_DOWNVOTE = 'd';
 static const char SCDB_ABSTAIN = 'a';
 
+//! SCDB update bytes vote values which aren't a withdrawal upvote, as read
+//! little endian from the two vote bytes (0xFF 0xFE and 0xFF 0xFF)
+static const uint16_t SCDB_VOTE_INDEX_DOWNVOTE = 0xFEFF;
+static const uint16_t SCDB_VOTE_INDEX_ABSTAIN = 0xFFFF;
+
+/**
+ * The vote on the withdrawals of one sidechain in an SCDB update, in the
+ * form it takes in the SCDB update bytes: the upvoted withdrawal is referred
+ * to by its index in the sidechain's list of withdrawals.
+ */
+struct SCDBVote {
+    //! SCDB_UPVOTE, SCDB_DOWNVOTE or SCDB_ABSTAIN
+    char vote = SCDB_ABSTAIN;
+    //! Index of the upvoted withdrawal
+    uint16_t nIndex = 0;
+
+    /** The value of the two vote bytes. An upvote of an index that is out of
+     * range for nWithdrawal withdrawals is encoded as abstain. */
+    uint16_t GetEncoded(size_t nWithdrawal) const
+    {
+        if (vote == SCDB_UPVOTE && nIndex < nWithdrawal && nIndex < SCDB_VOTE_INDEX_DOWNVOTE)
+            return nIndex;
+        if (vote == SCDB_DOWNVOTE)
+            return SCDB_VOTE_INDEX_DOWNVOTE;
+        return SCDB_VOTE_INDEX_ABSTAIN;
+    }
+
+    static SCDBVote FromEncoded(uint16_t n)
+    {
+        SCDBVote v;
+        if (n == SCDB_VOTE_INDEX_DOWNVOTE) {
+            v.vote = SCDB_DOWNVOTE;
+        } else if (n != SCDB_VOTE_INDEX_ABSTAIN) {
+            v.vote = SCDB_UPVOTE;
+            v.nIndex = n;
+        }
+        return v;
+    }
+};
+
+//! The votes of an SCDB update, by nSidechain
+typedef std::array<SCDBVote, SIDECHAIN_ACTIVATION_MAX_ACTIVE> SCDBVotes;
+
 struct Sidechain {
     bool fActive;
     uint8_t nSidechain;
@@ -82,6 +166,12 @@ struct Sidechain {
     std::string ToString() const;
     uint256 GetSerHash() const;
 
+    /** Hash of the fields operator== compares, equal for equal sidechains */
+    uint256 GetProposalHash() const;
+
+    /** Memory allocated by the sidechain, not counting the object itself */
+    size_t DynamicMemoryUsage() const;
+
     // Sidechain proposal script functions
     bool DeserializeFromProposalScript(const CScript& script);
     CScript GetProposalScript() const;
@@ -128,6 +218,10 @@ struct SidechainActivationStatus
     int nFail;
     Sidechain proposal;
 
+    // Memory only: proposal.GetSerHash(), set by SCDB when it tracks the
+    // proposal
+    uint256 hashProposal;
+
     uint256 GetSerHash() const;
 
     ADD_SERIALIZE_METHODS
@@ -140,24 +234,42 @@ struct SidechainActivationStatus
     }
 };
 
+/** Compact key of a deposit destination string, compared instead of the
+ * string when matching deposits to a destination */
+uint160 DepositDestKey(const std::string& strDest);
+
 struct SidechainDeposit {
     uint8_t nSidechain;
     std::string strDest;
-    CMutableTransaction tx;
+    CTransactionRef tx;
     uint32_t nBurnIndex; // The deposit burn output in the deposit transaction
     uint32_t nTx; // The deposit's transaction number in the block
     uint256 hashBlock;
 
+    // Memory only: DepositDestKey(strDest), set by SetDest and when read
+    uint160 destKey;
+
     bool operator==(const SidechainDeposit& a) const;
     std::string ToString() const;
     uint256 GetSerHash() const;
 
+    void SetDest(const std::string& strDestIn);
+
+    /** Return true if the deposit pays to the destination with this key */
+    bool HasDest(const uint160& key) const { return destKey == key; }
+
+    /** Memory allocated by the deposit, including its transaction, not
+     * counting the object itself */
+    size_t DynamicMemoryUsage() const;
+
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(nSidechain);
         READWRITE(strDest);
+        if (ser_action.ForRead())
+            destKey = DepositDestKey(strDest);
         READWRITE(tx);
         READWRITE(nBurnIndex);
         READWRITE(nTx);
@@ -214,6 +326,37 @@ struct SidechainFailedWithdrawal {
     }
 };
 
+/**
+ * What validating a withdrawal bundle needs to know about its transaction,
+ * computed once by GetWithdrawalBundleInfo and shared by every copy of it.
+ * Only depends on the transaction, checks against SCDB are left to the
+ * caller. The fields are only meaningful for a transaction with inputs and
+ * at least the dest, fee and change return outputs.
+ */
+struct WithdrawalBundleInfo {
+    uint256 hashBlind;
+    //! Spent by vin[0]
+    COutPoint outCTIP;
+    size_t nOutputs = 0;
+    //! Whether vout[1] encodes the sum of withdrawal fees
+    bool fFees = false;
+    CAmount amountFees = 0;
+    //! Sum of all outputs
+    CAmount amountOut = 0;
+    //! Sum of all outputs but the last, which is the change return
+    CAmount amountBlindOut = 0;
+    //! Sum of the outputs not paying to a sidechain
+    CAmount amountPayout = 0;
+    //! Outputs paying to a sidechain and the first of them
+    size_t nSidechainOutputs = 0;
+    uint32_t nChangeIndex = 0;
+    uint8_t nChangeSidechain = 0;
+    CAmount amountChange = 0;
+    //! Why the first OP_RETURN output isn't SIDECHAIN_WITHDRAWAL_RETURN_DEST,
+    //! empty if it is or there is none
+    std::string strReturnDestError;
+};
+
 struct SidechainCTIP {
     COutPoint out;
     CAmount amount;
@@ -270,6 +413,100 @@ struct SidechainBlockData: public SidechainObj {
     uint256 GetSerHash() const;
 };
 
+/**
+ * Changes that a block made to SCDB relative to its parent - database object.
+ *
+ * Only the withdrawal status of sidechains that changed, the activation
+ * status if it changed, and the sidechain slots that changed are stored.
+ * Applying the delta to the parent's SidechainBlockData gives the
+ * SidechainBlockData of the block.
+ */
+struct SidechainBlockDelta: public SidechainObj {
+    uint256 hashPrevBlock;
+
+    uint32_t nWithdrawalStatusSize;
+    std::vector<std::pair<uint32_t, std::vector<SidechainWithdrawalState>>> vWithdrawalStatusChange;
+
+    bool fActivationStatusChanged;
+    std::vector<SidechainActivationStatus> vActivationStatus;
+
+    uint32_t nSidechainSize;
+    std::vector<std::pair<uint32_t, Sidechain>> vSidechainChange;
+
+    std::vector<SidechainSpentWithdrawal> vSpent;
+
+    SidechainBlockDelta(void) : SidechainObj() { sidechainop = DB_SIDECHAIN_BLOCK_DELTA_OP; SetNull(); }
+    virtual ~SidechainBlockDelta(void) { }
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(sidechainop);
+        READWRITE(hashPrevBlock);
+        READWRITE(nWithdrawalStatusSize);
+        READWRITE(vWithdrawalStatusChange);
+        READWRITE(fActivationStatusChanged);
+        READWRITE(vActivationStatus);
+        READWRITE(nSidechainSize);
+        READWRITE(vSidechainChange);
+        READWRITE(vSpent);
+    }
+
+    void SetNull();
+
+    /** Set this delta to the changes from prev to data */
+    void Build(const uint256& hashPrevBlockIn, const SidechainBlockData& prev, const SidechainBlockData& data);
+
+    /** Apply this delta to the data of the previous block */
+    void Apply(SidechainBlockData& data) const;
+
+    /** Return true if the delta doesn't change anything */
+    bool IsEmpty() const;
+
+    std::string ToString(void) const;
+};
+
+/**
+ * The drivechain commitments (BIP 300 & 301) of a coinbase. The miner
+ * collects them while it builds a block and adds them to the coinbase at once,
+ * validation reads them out of a coinbase in one pass (see
+ * GetCoinbaseCommitments).
+ */
+struct CoinbaseCommitments {
+    //! M3: new withdrawal bundle hashes and their sidechains
+    std::vector<std::pair<uint8_t, uint256>> vWithdrawal;
+    //! M4: SCDB update bytes scripts
+    std::vector<CScript> vSCDBBytes;
+    //! M8: critical data (BMM h*) commitments
+    std::vector<CCriticalData> vCriticalData;
+    //! M1: sidechain proposals
+    std::vector<Sidechain> vProposal;
+    //! M2: hashes of sidechain proposals to activate
+    std::vector<uint256> vActivation;
+
+    bool empty() const;
+    void clear();
+
+    /** Read the commitments out of the outputs of a coinbase */
+    void Read(const std::vector<CTxOut>& vout);
+
+    /** The commitment outputs, in the order above */
+    std::vector<CTxOut> GetOutputs() const;
+
+    /** Append the commitment outputs to the coinbase of block */
+    void AddToCoinbase(CBlock& block) const;
+};
+
+/** The commitments of the coinbase of block. They are read once and kept
+ * with the block if it is immutable (see CBlockHeader::MarkImmutable). */
+std::shared_ptr<const CoinbaseCommitments> GetCoinbaseCommitments(const CBlock& block);
+
 bool ParseDepositAddress(const std::string& strAddressIn, std::string& strAddressOut, unsigned int& nSidechainOut);
 
+/** Key of the destination of a deposit address, or of a bare destination
+ * string if strAddress isn't a deposit address. nSidechainOut is set to the
+ * sidechain number of a deposit address and left alone otherwise. */
+uint160 ParseDepositDestKey(const std::string& strAddress, unsigned int& nSidechainOut);
+
 #endif // BITCOIN_SIDECHAIN_H
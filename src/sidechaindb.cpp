@@ -7,31 +7,120 @@
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <clientversion.h>
+#include <coins.h>
+#include <core_memusage.h>
 #include <hash.h>
 #include <primitives/transaction.h>
+#include <random.h>
+#include <scdblog.h>
 #include <script/script.h>
+#include <script/scriptpattern.h>
 #include <sidechain.h>
 #include <streams.h>
+#include <trace.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <util.h>
 #include <utilstrencodings.h>
 
-SidechainDB::SidechainDB()
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iterator>
+#include <mutex>
+
+/** Signalled when a sidechain view is published with a new sequence number,
+ * shared by all SidechainDB instances so that SCDB stays copyable */
+static std::mutex cs_viewchange;
+static std::condition_variable cond_viewchange;
+
+SaltedDepositTxidHasher::SaltedDepositTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedDepositTxidHasher::operator()(const uint256& txid) const
+{
+    return SipHashUint256(k0, k1, txid);
+}
+
+/** Serialize a deposit for the deposit MuHash. The deposit is hashed with its
+ * nSidechain and index so that the order of deposits is committed to too. */
+static CDataStream DepositSer(uint8_t nSidechain, uint32_t nIndex, const SidechainDeposit& deposit)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << nSidechain << nIndex << deposit.GetSerHash();
+    return ss;
+}
+
+static void ApplyDepositHash(MuHash3072& muhash, uint8_t nSidechain, uint32_t nIndex, const SidechainDeposit& deposit)
+{
+    CDataStream ss = DepositSer(nSidechain, nIndex, deposit);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+}
+
+static void RemoveDepositHash(MuHash3072& muhash, uint8_t nSidechain, uint32_t nIndex, const SidechainDeposit& deposit)
+{
+    CDataStream ss = DepositSer(nSidechain, nIndex, deposit);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+/** Call fn for each nSidechain below nSidechains on up to one thread per
+ * core. The deposits of different sidechains don't depend on each other. */
+static void ForEachSidechainParallel(size_t nSidechains, const std::function<void(size_t)>& fn)
+{
+    const size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), nSidechains);
+    std::atomic<size_t> next(0);
+    std::vector<std::future<void>> vWorker;
+    for (size_t i = 0; i < nThreads; i++) {
+        vWorker.push_back(std::async(std::launch::async, [&next, nSidechains, &fn] {
+            size_t x;
+            while ((x = next++) < nSidechains)
+                fn(x);
+        }));
+    }
+    for (std::future<void>& worker : vWorker)
+        worker.get();
+}
+
+SidechainDB::SidechainDB() : nMaxMemoryUsage(0), nCacheSize(SIDECHAIN_DEPOSIT_CACHE_SIZE), pdepositdb(nullptr), plog(nullptr), fViewHeld(false), fReorg(false), fReorgCTIP(false)
 {
     Reset();
 }
 
-void SidechainDB::ApplyLDBData(const uint256& hashBlock, const SidechainBlockData& data)
+void SidechainDB::ApplyLDBData(const uint256& hashBlock, const SidechainBlockData& data, unsigned int nBlocksBack)
 {
     hashBlockLastSeen = hashBlock;
     vWithdrawalStatus = data.vWithdrawalStatus;
-    vActivationStatus = data.vActivationStatus;
+    SetActivationStatus(data.vActivationStatus);
+
+    // Going back a block, most often, or to the fork of a reorg. Drop the
+    // work score changes of those blocks, and the rates of the withdrawals
+    // that are gone.
+    std::map<uint256, SidechainWithdrawalRate> mapRate;
+    for (const std::vector<SidechainWithdrawalState>& vState : vWithdrawalStatus) {
+        for (const SidechainWithdrawalState& state : vState) {
+            auto it = mapWithdrawalRate.find(state.hash);
+            if (it == mapWithdrawalRate.end())
+                continue;
+            SidechainWithdrawalRate& rate = mapRate[state.hash];
+            rate = std::move(it->second);
+            for (unsigned int i = 0; i < nBlocksBack; i++)
+                rate.Undo();
+        }
+    }
+    mapWithdrawalRate.swap(mapRate);
+
     vSidechain = data.vSidechain;
+    UpdateActiveSidechains();
+
+    UpdateVoteCommitment();
+    PublishView();
 }
 
 void SidechainDB::AddRemovedBMM(const uint256& hashRemoved)
 {
     setRemovedBMM.insert(hashRemoved);
+    WriteLog(SCDB_LOG_REMOVED_BMM_ADD, hashRemoved);
 }
 
 void SidechainDB::AddRemovedDeposit(const uint256& hashRemoved)
@@ -50,25 +139,57 @@ void SidechainDB::AddDeposits(const std::vector<SidechainDeposit>& vDeposit)
     for (const SidechainDeposit& d : vDeposit) {
         if (!IsSidechainActive(d.nSidechain))
             continue;
-        if (HaveDepositCached(d.tx.GetHash()))
+        if (HaveDepositCached(d.tx->GetHash()))
             continue;
 
         // Put deposit into vector based on nSidechain
         vDepositSplit[d.nSidechain].push_back(d);
     }
 
-    // Add the deposits to SCDB
+    // Add the deposits to SCDB, keeping each sidechain's deposits sorted by
+    // CTIP UTXO spend order. New deposits normally extend the CTIP chain of
+    // the sidechain, so we only sort them together with the current last
+    // deposit and append the result. Only if that fails do we fall back to
+    // sorting all of the deposits for the sidechain.
     for (size_t x = 0; x < vDepositSplit.size(); x++) {
-        for (size_t y = 0; y < vDepositSplit[x].size(); y++) {
-            vDepositCache[x].push_back(vDepositSplit[x][y]);
-            setDepositTXID.insert(vDepositSplit[x][y].tx.GetHash());
+        if (vDepositSplit[x].empty())
+            continue;
+
+        const uint32_t nCount = vDepositCount[x];
+        const bool fHaveLast = !vDepositCache[x].empty();
+
+        // The last deposit spends a CTIP which isn't in this list, so if
+        // sorting succeeds it must come out first.
+        std::vector<SidechainDeposit> vNew;
+        vNew.reserve(vDepositSplit[x].size() + 1);
+        if (fHaveLast)
+            vNew.push_back(vDepositCache[x].back());
+        vNew.insert(vNew.end(), vDepositSplit[x].begin(), vDepositSplit[x].end());
+
+        std::vector<SidechainDeposit> vSorted;
+        if (SortDeposits(vNew, vSorted)) {
+            if (fHaveLast)
+                vSorted.erase(vSorted.begin());
+            if (!ReplaceDeposits(x, nCount, vSorted))
+                LogPrintf("SCDB %s: Failed to add SCDB deposits!", __func__);
+            continue;
         }
-    }
 
-    // Sort the deposits by CTIP UTXO spend order
-    // TODO check return value
-    if (!SortSCDBDeposits()) {
-        LogPrintf("SCDB %s: Failed to sort SCDB deposits!", __func__);
+        std::vector<SidechainDeposit> vAll = GetDeposits(x);
+        vAll.insert(vAll.end(), vDepositSplit[x].begin(), vDepositSplit[x].end());
+
+        vSorted.clear();
+        const bool fSorted = SortDeposits(vAll, vSorted);
+        if (!fSorted) {
+            // TODO check return value
+            LogPrintf("SCDB %s: Failed to sort SCDB deposits!", __func__);
+        }
+
+        // Rewrite all of the deposits in the new order, or just append the
+        // new deposits if they can't be sorted
+        bool fAdded = fSorted ? ReplaceDeposits(x, 0, vSorted) : ReplaceDeposits(x, nCount, vDepositSplit[x]);
+        if (!fAdded)
+            LogPrintf("SCDB %s: Failed to add SCDB deposits!", __func__);
     }
 
     // TODO check return value
@@ -76,6 +197,67 @@ void SidechainDB::AddDeposits(const std::vector<SidechainDeposit>& vDeposit)
     if (!UpdateCTIP()) {
         LogPrintf("SCDB %s: Failed to update CTIP!", __func__);
     }
+
+    for (size_t x = 0; x < vDepositSplit.size(); x++) {
+        if (!vDepositSplit[x].empty())
+            PublishView(x);
+    }
+
+    LimitMemoryUsage();
+
+    TRACE1(scdb, deposits_added, vDeposit.size());
+}
+
+void SidechainDB::ImportDeposits(const std::vector<SidechainDeposit>& vDeposit)
+{
+    if (vDeposit.empty())
+        return;
+
+    // Sidechains that already have deposits are merged by AddDeposits
+    std::vector<std::vector<SidechainDeposit>> vDepositSplit(vDepositCache.size());
+    std::vector<SidechainDeposit> vMerge;
+    for (const SidechainDeposit& d : vDeposit) {
+        if (!IsSidechainActive(d.nSidechain))
+            continue;
+        if (vDepositCount[d.nSidechain])
+            vMerge.push_back(d);
+        else
+            vDepositSplit[d.nSidechain].push_back(d);
+    }
+
+    struct SortResult {
+        bool fSorted = false;
+        std::vector<SidechainDeposit> vSorted;
+    };
+    std::vector<SortResult> vResult(vDepositSplit.size());
+    ForEachSidechainParallel(vDepositSplit.size(), [&vDepositSplit, &vResult](size_t x) {
+        if (!vDepositSplit[x].empty())
+            vResult[x].fSorted = SortDeposits(vDepositSplit[x], vResult[x].vSorted);
+    });
+
+    // Deposits are written to the database one sidechain at a time
+    for (size_t x = 0; x < vDepositSplit.size(); x++) {
+        if (vDepositSplit[x].empty())
+            continue;
+
+        // Deposits that can't be sorted are kept in the order they were
+        // read, like AddDeposits does
+        if (!vResult[x].fSorted)
+            LogPrintf("SCDB %s: Failed to sort SCDB deposits!", __func__);
+        if (!ReplaceDeposits(x, 0, vResult[x].fSorted ? vResult[x].vSorted : vDepositSplit[x]))
+            LogPrintf("SCDB %s: Failed to add SCDB deposits!", __func__);
+    }
+
+    if (!vMerge.empty())
+        AddDeposits(vMerge);
+
+    if (!UpdateCTIP())
+        LogPrintf("SCDB %s: Failed to update CTIP!", __func__);
+
+    PublishView();
+    LimitMemoryUsage();
+
+    TRACE1(scdb, deposits_added, vDeposit.size());
 }
 
 bool SidechainDB::AddWithdrawal(uint8_t nSidechain, const uint256& hash, bool fDebug)
@@ -114,6 +296,9 @@ bool SidechainDB::AddWithdrawal(uint8_t nSidechain, const uint256& hash, bool fD
 
     vWithdrawalStatus[nSidechain].push_back(state);
 
+    UpdateVoteCommitment(nSidechain);
+    PublishView(nSidechain);
+
     if (fDebug)
         LogPrintf("SCDB %s: Cached Withdrawal: %s\n", __func__, hash.ToString());
 
@@ -127,29 +312,83 @@ void SidechainDB::AddSpentWithdrawals(const std::vector<SidechainSpentWithdrawal
     for (const SidechainSpentWithdrawal& spent : vSpent) {
         it = mapSpentWithdrawal.find(spent.hashBlock);
         if (it != mapSpentWithdrawal.end()) {
+            // A block spends a withdrawal once, this is the same spend
+            bool fKnown = false;
+            for (const SidechainSpentWithdrawal& s : it->second)
+                fKnown |= s.nSidechain == spent.nSidechain && s.hash == spent.hash;
+            if (fKnown)
+                continue;
             it->second.push_back(spent);
         } else {
             mapSpentWithdrawal[spent.hashBlock] = std::vector<SidechainSpentWithdrawal>{ spent };
+            queueSpentWithdrawalBlock.push_back(spent.hashBlock);
         }
+        mapSpentWithdrawalCount[std::make_pair(spent.nSidechain, spent.hash)]++;
     }
+    WriteLog(SCDB_LOG_SPENT_ADD, vSpent);
+
+    ArchiveWithdrawalHistory();
+    LimitMemoryUsage();
 }
 
 void SidechainDB::AddFailedWithdrawals(const std::vector<SidechainFailedWithdrawal>& vFailed)
 {
-    std::map<uint256, SidechainFailedWithdrawal>::iterator it;
-
-    for (const SidechainFailedWithdrawal& failed : vFailed)
+    for (const SidechainFailedWithdrawal& failed : vFailed) {
+        if (mapFailedWithdrawal.count(failed.hash) == 0)
+            queueFailedWithdrawal.push_back(failed.hash);
         mapFailedWithdrawal[failed.hash] = failed;
+    }
+    WriteLog(SCDB_LOG_FAILED_ADD, vFailed);
+
+    ArchiveWithdrawalHistory();
+    LimitMemoryUsage();
+}
+
+size_t SidechainDB::RemoveStaleWithdrawalHistory(const std::function<bool(const uint256&)>& fInChain)
+{
+    size_t nRemoved = 0;
+
+    std::vector<uint256> vStale;
+    for (const auto& it : mapSpentWithdrawal) {
+        if (!fInChain(it.first)) {
+            vStale.push_back(it.first);
+            nRemoved += it.second.size();
+        }
+    }
+    for (const uint256& hashBlock : vStale)
+        UndoSpentWithdrawals(hashBlock);
+
+    // A withdrawal that is still in vWithdrawalStatus hasn't failed in the
+    // blocks SCDB was synced to
+    std::set<uint256> setPending;
+    for (const std::vector<SidechainWithdrawalState>& vState : vWithdrawalStatus) {
+        for (const SidechainWithdrawalState& state : vState)
+            setPending.insert(state.hash);
+    }
+    for (auto it = queueFailedWithdrawal.begin(); it != queueFailedWithdrawal.end(); ) {
+        if (setPending.count(*it)) {
+            mapFailedWithdrawal.erase(*it);
+            it = queueFailedWithdrawal.erase(it);
+            nRemoved++;
+        } else {
+            it++;
+        }
+    }
+
+    return nRemoved;
 }
 
 void SidechainDB::BMMAbandoned(const uint256& txid)
 {
     setRemovedBMM.erase(txid);
+    WriteLog(SCDB_LOG_REMOVED_BMM_ERASE, txid);
 }
 
 void SidechainDB::CacheSidechains(const std::vector<Sidechain>& vSidechainIn)
 {
     vSidechain = vSidechainIn;
+    UpdateActiveSidechains();
+    PublishView();
 }
 
 bool SidechainDB::CacheCustomVotes(const std::vector<std::string>& vVote)
@@ -172,48 +411,63 @@ bool SidechainDB::CacheCustomVotes(const std::vector<std::string>& vVote)
             return false;
     }
 
-    vVoteCache = vVote;
+    if (vVoteCache.size() != vVote.size()) {
+        vVoteCache = vVote;
+        UpdateVoteCommitment();
+        WriteLog(SCDB_LOG_VOTES, vVoteCache);
+        return true;
+    }
+
+    // Only look up the vote index of sidechains whose vote changed
+    for (size_t x = 0; x < vVote.size(); x++) {
+        if (vVoteCache[x] == vVote[x])
+            continue;
+        vVoteCache[x] = vVote[x];
+        UpdateVoteIndex(x);
+    }
+    BuildVoteCommitment();
+    WriteLog(SCDB_LOG_VOTES, vVoteCache);
 
     return true;
 }
 
 void SidechainDB::CacheSidechainActivationStatus(const std::vector<SidechainActivationStatus>& vActivationStatusIn)
 {
-    vActivationStatus = vActivationStatusIn;
+    SetActivationStatus(vActivationStatusIn);
 }
 
 void SidechainDB::CacheSidechainProposals(const std::vector<Sidechain>& vSidechainProposalIn)
 {
-    // TODO change container improve performance
     for (const Sidechain& s : vSidechainProposalIn) {
         // Make sure this proposal isn't already cached in our proposals
-        bool fFound = false;
-        for (const Sidechain& p : vSidechainProposal) {
-            if (p == s)
-            {
-                fFound = true;
-                break;
-            }
-        }
-        if (!fFound)
+        if (setSidechainProposal.insert(s.GetProposalHash()).second)
             vSidechainProposal.push_back(s);
     }
+    WriteLog(SCDB_LOG_PROPOSALS, vSidechainProposal);
 }
 
 void SidechainDB::CacheSidechainHashToAck(const uint256& u)
 {
-    vSidechainHashAck.push_back(u);
+    if (setSidechainHashAck.insert(u).second)
+        vSidechainHashAck.push_back(u);
+    WriteLog(SCDB_LOG_HASH_ACK, vSidechainHashAck);
 }
 
-bool SidechainDB::CacheWithdrawalTx(const CTransaction& tx, uint8_t nSidechain)
+bool SidechainDB::CacheWithdrawalTx(const CTransactionRef& tx, uint8_t nSidechain)
 {
-    if (HaveWithdrawalTxCached(tx.GetHash())) {
+    if (HaveWithdrawalTxCached(tx->GetHash())) {
         LogPrintf("%s: Rejecting Withdrawal: %s - Already cached!\n",
-                __func__, tx.GetHash().ToString());
+                __func__, tx->GetHash().ToString());
         return false;
     }
 
+    // Analyze the bundle now, so that creating payouts for block templates
+    // doesn't go through its outputs again
+    GetWithdrawalBundleInfo(*tx);
+
     vWithdrawalTxCache.push_back(std::make_pair(nSidechain, tx));
+    mapWithdrawalTxCache[tx->GetHash()] = tx;
+    WriteLog(SCDB_LOG_WITHDRAWAL_TX_ADD, vWithdrawalTxCache.back());
 
     return true;
 }
@@ -223,7 +477,7 @@ bool SidechainDB::CheckWorkScore(uint8_t nSidechain, const uint256& hash, bool f
     if (!IsSidechainActive(nSidechain))
         return false;
 
-    std::vector<SidechainWithdrawalState> vState = GetState(nSidechain);
+    const std::vector<SidechainWithdrawalState>& vState = GetState(nSidechain);
     for (const SidechainWithdrawalState& state : vState) {
         if (state.hash == hash) {
             if (state.nWorkScore >= SIDECHAIN_WITHDRAWAL_MIN_WORKSCORE) {
@@ -265,26 +519,33 @@ unsigned int SidechainDB::GetActiveSidechainCount() const
 
 bool SidechainDB::GetAckSidechain(const uint256& u) const
 {
-    for (const uint256& hash : vSidechainHashAck) {
-        if (u == hash) {
-            return true;
-        }
-    }
-    return false;
+    return setSidechainHashAck.count(u);
 }
 
-std::vector<Sidechain> SidechainDB::GetActiveSidechains() const
+bool SidechainDB::HaveActivationStatus(const uint256& hashProposal) const
 {
-    std::vector<Sidechain> vActive;
-    for (const Sidechain& s : vSidechain)  {
-        if (s.fActive)
-            vActive.push_back(s);
-    }
+    return mapActivationStatusIndex.count(hashProposal);
+}
+
+const std::vector<Sidechain>& SidechainDB::GetActiveSidechains() const
+{
+    return vActiveSidechain;
+}
 
-    return vActive;
+std::shared_ptr<const SidechainView> SidechainDB::GetSidechainView(uint8_t nSidechain) const
+{
+    if (nSidechain >= vView.size())
+        return nullptr;
+
+    return std::atomic_load(&vView[nSidechain]);
+}
+
+std::shared_ptr<const std::vector<Sidechain>> SidechainDB::GetActiveSidechainsView() const
+{
+    return std::atomic_load(&pActiveView);
 }
 
-std::vector<Sidechain> SidechainDB::GetSidechains() const
+const std::vector<Sidechain>& SidechainDB::GetSidechains() const
 {
     return vSidechain;
 }
@@ -313,19 +574,17 @@ bool SidechainDB::GetCTIP(uint8_t nSidechain, SidechainCTIP& out) const
     return false;
 }
 
-bool SidechainDB::GetCachedWithdrawalTx(const uint256& hash, CMutableTransaction& mtx) const
+bool SidechainDB::GetCachedWithdrawalTx(const uint256& hash, CTransactionRef& tx) const
 {
-    // Find the Withdrawal
-    for (const std::pair<uint8_t, CMutableTransaction>& pair : vWithdrawalTxCache) {
-        if (pair.second.GetHash() == hash) {
-            mtx = pair.second;
-            return true;
-        }
-    }
-    return false;
+    std::map<uint256, CTransactionRef>::const_iterator it = mapWithdrawalTxCache.find(hash);
+    if (it == mapWithdrawalTxCache.end())
+        return false;
+
+    tx = it->second;
+    return true;
 }
 
-std::map<uint8_t, SidechainCTIP> SidechainDB::GetCTIP() const
+const std::map<uint8_t, SidechainCTIP>& SidechainDB::GetCTIP() const
 {
     return mapCTIP;
 }
@@ -335,13 +594,71 @@ std::vector<std::string> SidechainDB::GetVotes() const
     return vVoteCache;
 }
 
+bool SidechainDB::GetDeposit(const uint256& txid, SidechainDeposit& deposit, CAmount& amount) const
+{
+    uint8_t nSidechain;
+    uint32_t nIndex;
+    if (!FindDeposit(txid, nSidechain, nIndex))
+        return false;
+
+    // Read the previous deposit as well to find the CTIP value it replaced
+    std::vector<SidechainDeposit> vDeposit;
+    const uint32_t nStart = nIndex ? nIndex - 1 : 0;
+    if (!ReadDeposits(nSidechain, nStart, nIndex - nStart + 1, vDeposit) || vDeposit.empty())
+        return false;
+
+    deposit = vDeposit.back();
+    if (!deposit.tx || deposit.nBurnIndex >= deposit.tx->vout.size())
+        return false;
+
+    amount = deposit.tx->vout[deposit.nBurnIndex].nValue;
+    if (vDeposit.size() > 1) {
+        const SidechainDeposit& prev = vDeposit.front();
+        if (!prev.tx || prev.nBurnIndex >= prev.tx->vout.size())
+            return false;
+        amount -= prev.tx->vout[prev.nBurnIndex].nValue;
+    }
+
+    return true;
+}
+
 std::vector<SidechainDeposit> SidechainDB::GetDeposits(uint8_t nSidechain) const
 {
     std::vector<SidechainDeposit> vDeposit;
     if (!IsSidechainActive(nSidechain))
         return vDeposit;
 
-    return vDepositCache[nSidechain];
+    if (vDepositCache[nSidechain].size() == vDepositCount[nSidechain])
+        return vDepositCache[nSidechain];
+
+    if (!ReadDeposits(nSidechain, 0, vDepositCount[nSidechain], vDeposit))
+        vDeposit.clear();
+
+    return vDeposit;
+}
+
+std::vector<SidechainDeposit> SidechainDB::GetDeposits(uint8_t nSidechain, uint32_t nStart, uint32_t nCount) const
+{
+    std::vector<SidechainDeposit> vDeposit;
+    if (!IsSidechainActive(nSidechain))
+        return vDeposit;
+
+    if (nStart >= vDepositCount[nSidechain])
+        return vDeposit;
+
+    nCount = std::min(nCount, vDepositCount[nSidechain] - nStart);
+    if (!ReadDeposits(nSidechain, nStart, nCount, vDeposit))
+        vDeposit.clear();
+
+    return vDeposit;
+}
+
+uint32_t SidechainDB::GetDepositCount(uint8_t nSidechain) const
+{
+    if (!IsSidechainActive(nSidechain))
+        return 0;
+
+    return vDepositCount[nSidechain];
 }
 
 uint256 SidechainDB::GetHashBlockLastSeen()
@@ -395,8 +712,8 @@ uint256 SidechainDB::GetTestHash() const
     LogPrintf("%s: Hash with vDepositCache data: %s\n", __func__, hash.ToString());
 
     // Add vWithdrawalTxCache
-    for (const std::pair<uint8_t, CMutableTransaction>& pair : vWithdrawalTxCache) {
-        vLeaf.push_back(pair.second.GetHash());
+    for (const std::pair<uint8_t, CTransactionRef>& pair : vWithdrawalTxCache) {
+        vLeaf.push_back(pair.second->GetHash());
     }
 
     hash = ComputeMerkleRoot(vLeaf);
@@ -404,7 +721,7 @@ uint256 SidechainDB::GetTestHash() const
 
     // Add vWithdrawalStatus
     for (size_t i = 0; i < SIDECHAIN_ACTIVATION_MAX_ACTIVE; i++) {
-        std::vector<SidechainWithdrawalState> vState = GetState(i);
+        const std::vector<SidechainWithdrawalState>& vState = GetState(i);
         for (const SidechainWithdrawalState& state : vState) {
             vLeaf.push_back(state.GetSerHash());
         }
@@ -416,6 +733,36 @@ uint256 SidechainDB::GetTestHash() const
     return ComputeMerkleRoot(vLeaf);
 }
 
+uint256 SidechainDB::GetStateHash() const
+{
+    if (fDepositHashDirty) {
+        MuHash3072 muhash = muhashDeposits;
+        muhash.Finalize(hashDeposits);
+        fDepositHashDirty = false;
+    }
+
+    std::vector<uint256> vLeaf;
+    vLeaf.push_back(hashBlockLastSeen);
+
+    for (const auto& it : mapCTIP)
+        vLeaf.push_back(it.second.GetSerHash());
+
+    for (const Sidechain& s : vSidechain)
+        vLeaf.push_back(s.GetSerHash());
+
+    for (const SidechainActivationStatus& s : vActivationStatus)
+        vLeaf.push_back(s.GetSerHash());
+
+    for (const std::vector<SidechainWithdrawalState>& vState : vWithdrawalStatus) {
+        for (const SidechainWithdrawalState& state : vState)
+            vLeaf.push_back(state.GetSerHash());
+    }
+
+    vLeaf.push_back(hashDeposits);
+
+    return ComputeMerkleRoot(vLeaf);
+}
+
 bool SidechainDB::GetSidechain(const uint8_t nSidechain, Sidechain& sidechain) const
 {
     if (!IsSidechainActive(nSidechain))
@@ -426,7 +773,7 @@ bool SidechainDB::GetSidechain(const uint8_t nSidechain, Sidechain& sidechain) c
     return true;
 }
 
-std::vector<SidechainActivationStatus> SidechainDB::GetSidechainActivationStatus() const
+const std::vector<SidechainActivationStatus>& SidechainDB::GetSidechainActivationStatus() const
 {
     return vActivationStatus;
 }
@@ -465,6 +812,11 @@ std::vector<uint256> SidechainDB::GetSidechainsToActivate() const
     return vSidechainHashAck;
 }
 
+CScript SidechainDB::GetSCDBByteCommitment() const
+{
+    return CScript(vchVoteCommitment.begin(), vchVoteCommitment.end());
+}
+
 std::vector<SidechainSpentWithdrawal> SidechainDB::GetSpentWithdrawalsForBlock(const uint256& hashBlock) const
 {
     std::map<uint256, std::vector<SidechainSpentWithdrawal>>::const_iterator it;
@@ -473,38 +825,78 @@ std::vector<SidechainSpentWithdrawal> SidechainDB::GetSpentWithdrawalsForBlock(c
     if (it != mapSpentWithdrawal.end())
         return it->second;
 
-    return std::vector<SidechainSpentWithdrawal>{};
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    if (pdepositdb)
+        pdepositdb->ReadSpentWithdrawals(hashBlock, vSpent);
+
+    return vSpent;
 }
 
-std::vector<SidechainWithdrawalState> SidechainDB::GetState(uint8_t nSidechain) const
+const std::vector<SidechainWithdrawalState>& SidechainDB::GetState(uint8_t nSidechain) const
 {
+    static const std::vector<SidechainWithdrawalState> vEmpty;
     if (!HasState() || !IsSidechainActive(nSidechain))
-        return std::vector<SidechainWithdrawalState>();
+        return vEmpty;
 
     return vWithdrawalStatus[nSidechain];
 }
 
-std::vector<std::vector<SidechainWithdrawalState>> SidechainDB::GetState() const
+const std::vector<std::vector<SidechainWithdrawalState>>& SidechainDB::GetState() const
 {
     return vWithdrawalStatus;
 }
 
+std::vector<SidechainWithdrawalProjection> SidechainDB::GetWithdrawalProjections(int nSidechain) const
+{
+    std::vector<SidechainWithdrawalProjection> vProjection;
+    for (size_t x = 0; x < vWithdrawalStatus.size(); x++) {
+        if (nSidechain >= 0 && (size_t)nSidechain != x)
+            continue;
+
+        for (const SidechainWithdrawalState& state : vWithdrawalStatus[x]) {
+            SidechainWithdrawalProjection projection;
+            projection.state = state;
+
+            auto it = mapWithdrawalRate.find(state.hash);
+            if (it != mapWithdrawalRate.end()) {
+                projection.nBlocks = it->second.vChange.size();
+                projection.nChange = it->second.nSum;
+            }
+
+            if (state.nWorkScore >= SIDECHAIN_WITHDRAWAL_MIN_WORKSCORE) {
+                projection.nBlocksToApproval = 0;
+            }
+            else
+            if (projection.nChange > 0) {
+                // Rounded up, the work score needed at nChange per nBlocks
+                const int nNeeded = SIDECHAIN_WITHDRAWAL_MIN_WORKSCORE - state.nWorkScore;
+                const int nBlocks = (nNeeded * (int)projection.nBlocks + projection.nChange - 1) / projection.nChange;
+                if (nBlocks <= state.nBlocksLeft)
+                    projection.nBlocksToApproval = nBlocks;
+            }
+
+            vProjection.push_back(projection);
+        }
+    }
+    return vProjection;
+}
+
 std::vector<uint256> SidechainDB::GetUncommittedWithdrawalCache(uint8_t nSidechain) const
 {
     std::vector<uint256> vHash;
-    for (const std::pair<uint8_t, CTransaction>& pair : vWithdrawalTxCache) {
+    for (const std::pair<uint8_t, CTransactionRef>& pair : vWithdrawalTxCache) {
         if (nSidechain != pair.first)
             continue;
 
-        uint256 txid = pair.second.GetHash();
+        const uint256& txid = pair.second->GetHash();
         if (!HaveWorkScore(txid, nSidechain)) {
-            vHash.push_back(pair.second.GetHash());
+            vHash.push_back(txid);
         }
     }
     return vHash;
 }
 
-std::vector<std::pair<uint8_t, CMutableTransaction>> SidechainDB::GetWithdrawalTxCache() const
+const std::vector<std::pair<uint8_t, CTransactionRef>>& SidechainDB::GetWithdrawalTxCache() const
 {
     return vWithdrawalTxCache;
 }
@@ -519,6 +911,26 @@ std::vector<SidechainSpentWithdrawal> SidechainDB::GetSpentWithdrawalCache() con
     return vSpent;
 }
 
+std::vector<SidechainSpentWithdrawal> SidechainDB::GetSpentWithdrawalCache(uint32_t nStart, uint32_t nCount) const
+{
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    if (pdepositdb) {
+        nStart -= pdepositdb->ReadSpentWithdrawals(nStart, nCount, vSpent);
+        nCount -= vSpent.size();
+    }
+
+    uint32_t n = 0;
+    for (auto const& it : mapSpentWithdrawal) {
+        for (const SidechainSpentWithdrawal& s : it.second) {
+            if (n >= nStart + nCount)
+                return vSpent;
+            if (n++ >= nStart)
+                vSpent.push_back(s);
+        }
+    }
+    return vSpent;
+}
+
 std::vector<SidechainFailedWithdrawal> SidechainDB::GetFailedWithdrawalCache() const
 {
     std::vector<SidechainFailedWithdrawal> vFailed;
@@ -528,6 +940,24 @@ std::vector<SidechainFailedWithdrawal> SidechainDB::GetFailedWithdrawalCache() c
     return vFailed;
 }
 
+std::vector<SidechainFailedWithdrawal> SidechainDB::GetFailedWithdrawalCache(uint32_t nStart, uint32_t nCount) const
+{
+    std::vector<SidechainFailedWithdrawal> vFailed;
+    if (pdepositdb) {
+        nStart -= pdepositdb->ReadFailedWithdrawals(nStart, nCount, vFailed);
+        nCount -= vFailed.size();
+    }
+
+    if (nStart >= mapFailedWithdrawal.size())
+        return vFailed;
+
+    auto it = mapFailedWithdrawal.begin();
+    std::advance(it, nStart);
+    for (; it != mapFailedWithdrawal.end() && nCount; it++, nCount--)
+        vFailed.push_back(it->second);
+    return vFailed;
+}
+
 bool SidechainDB::HasState() const
 {
     // Make sure that SCDB is actually initialized
@@ -545,21 +975,17 @@ bool SidechainDB::HasState() const
 
 bool SidechainDB::HaveDepositCached(const uint256& txid) const
 {
-    return (setDepositTXID.find(txid) != setDepositTXID.end());
+    uint8_t nSidechain;
+    uint32_t nIndex;
+    return FindDeposit(txid, nSidechain, nIndex);
 }
 
 bool SidechainDB::HaveSpentWithdrawal(const uint256& hash, const uint8_t nSidechain) const
 {
-    // TODO change / update container mapSpentWithdrawals so that we can look up
-    // Withdrawal(s) by Withdrawal hash instead of looping.
-    for (auto const& it : mapSpentWithdrawal) {
-        for (const SidechainSpentWithdrawal& s : it.second) {
-            if (s.hash == hash && s.nSidechain == nSidechain)
-                return true;
-        }
-    }
+    if (mapSpentWithdrawalCount.count(std::make_pair(nSidechain, hash)))
+        return true;
 
-    return false;
+    return pdepositdb && pdepositdb->HaveSpentWithdrawal(nSidechain, hash);
 }
 
 bool SidechainDB::HaveFailedWithdrawal(const uint256& hash, const uint8_t nSidechain) const
@@ -569,16 +995,12 @@ bool SidechainDB::HaveFailedWithdrawal(const uint256& hash, const uint8_t nSidec
     if (it != mapFailedWithdrawal.end() && it->second.nSidechain == nSidechain)
         return true;
 
-    return false;
+    return pdepositdb && pdepositdb->HaveFailedWithdrawal(nSidechain, hash);
 }
 
 bool SidechainDB::HaveWithdrawalTxCached(const uint256& hash) const
 {
-    for (const std::pair<uint8_t, CMutableTransaction>& pair : vWithdrawalTxCache) {
-        if (pair.second.GetHash() == hash)
-            return true;
-    }
-    return false;
+    return mapWithdrawalTxCache.count(hash);
 }
 
 bool SidechainDB::HaveWorkScore(const uint256& hash, uint8_t nSidechain) const
@@ -586,7 +1008,7 @@ bool SidechainDB::HaveWorkScore(const uint256& hash, uint8_t nSidechain) const
     if (!IsSidechainActive(nSidechain))
         return false;
 
-    std::vector<SidechainWithdrawalState> vState = GetState(nSidechain);
+    const std::vector<SidechainWithdrawalState>& vState = GetState(nSidechain);
     for (const SidechainWithdrawalState& state : vState) {
         if (state.hash == hash)
             return true;
@@ -637,13 +1059,7 @@ void SidechainDB::RemoveExpiredWithdrawals()
                             AddFailedWithdrawals(std::vector<SidechainFailedWithdrawal>{ failed });
 
                             // Remove the cached transaction for the failed Withdrawal
-                            for (size_t i = 0; i < vWithdrawalTxCache.size(); i++) {
-                                if (vWithdrawalTxCache[i].second.GetHash() == state.hash) {
-                                    vWithdrawalTxCache[i] = vWithdrawalTxCache.back();
-                                    vWithdrawalTxCache.pop_back();
-                                    break;
-                                }
-                            }
+                            EraseCachedWithdrawalTx(state.hash);
                             return true;
                         } else {
                             return false;
@@ -651,11 +1067,16 @@ void SidechainDB::RemoveExpiredWithdrawals()
                     }),
                     vWithdrawalStatus[x].end());
     }
+
+    UpdateVoteCommitment();
+    PublishView();
 }
 
 void SidechainDB::RemoveSidechainHashToAck(const uint256& u)
 {
-    // TODO change container to make this efficient
+    if (!setSidechainHashAck.erase(u))
+        return;
+
     for (size_t i = 0; i < vSidechainHashAck.size(); i++) {
         if (vSidechainHashAck[i] == u) {
             vSidechainHashAck[i] = vSidechainHashAck.back();
@@ -663,6 +1084,7 @@ void SidechainDB::RemoveSidechainHashToAck(const uint256& u)
             break;
         }
     }
+    WriteLog(SCDB_LOG_HASH_ACK, vSidechainHashAck);
 }
 
 void SidechainDB::ResetWithdrawalState()
@@ -670,12 +1092,19 @@ void SidechainDB::ResetWithdrawalState()
     // Clear out Withdrawal state
     vWithdrawalStatus.clear();
     vWithdrawalStatus.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    mapWithdrawalRate.clear();
+
+    UpdateVoteCommitment();
+    PublishView();
 }
 
 void SidechainDB::ResetWithdrawalVotes()
 {
     vVoteCache.clear();
     vVoteCache = std::vector<std::string>(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+
+    UpdateVoteCommitment();
+    WriteLog(SCDB_LOG_VOTES, vVoteCache);
 }
 
 void SidechainDB::Reset()
@@ -691,60 +1120,375 @@ void SidechainDB::Reset()
 
     // Clear out sidechain activation status
     vActivationStatus.clear();
+    mapActivationStatusIndex.clear();
+
+    // Drop the deposits from the deposit database at the next flush as well
+    mapDepositDirty.clear();
+    for (size_t x = 0; pdepositdb && x < vDepositCount.size(); x++) {
+        if (vDepositCount[x])
+            mapDepositDirty[x] = 0;
+    }
 
     // Clear out our cache of sidechain deposits
     vDepositCache.clear();
-
-    // Clear out list of sidechain (hashes) we want to ACK
-    vSidechainHashAck.clear();
-
-    // Clear out our cache of proposed sidechains
-    vSidechainProposal.clear();
-
-    // Clear out cached Withdrawal serializations
-    vWithdrawalTxCache.clear();
+    vDepositCount.clear();
+    vDepositCacheUsage.clear();
+    mapDepositIndex.clear();
+    muhashDeposits = MuHash3072();
+    fDepositHashDirty = true;
 
     // Clear out Withdrawal state
     ResetWithdrawalState();
 
-    // Clear out custom vote cache
-    ResetWithdrawalVotes();
-
-    // Clear out spent Withdrawal cache
-    mapSpentWithdrawal.clear();
-
-    // Clear out failed Withdrawal cache
-    mapFailedWithdrawal.clear();
+    // Clear out the caches that are saved to disk
+    ClearCaches();
+    WriteLog(SCDB_LOG_CLEAR, std::string());
 
     vRemovedDeposit.clear();
-    setRemovedBMM.clear();
 
     // Resize vWithdrawalStatus to keep track of Withdrawal(s)
     vWithdrawalStatus.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
 
     // Resize vDepositCache to keep track of deposit(s)
     vDepositCache.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    vDepositCount.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    vDepositCacheUsage.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
 
     // Initialize with blank inactive sidechains
     vSidechain.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
     for (size_t i = 0; i < vSidechain.size(); i++)
         vSidechain[i].nSidechain = i;
+    UpdateActiveSidechains();
+    PublishView();
 }
 
-bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock, const CTransaction& tx, const int nTx, bool fJustCheck, bool fDebug)
+bool SidechainDB::SetDepositDB(CSidechainTreeDB* pdb)
 {
-    fDebug = true;
-    if (!IsSidechainActive(nSidechain)) {
-        if (fDebug) {
-            LogPrintf("SCDB %s: Cannot spend Withdrawal (txid): %s for sidechain number: %u.\n Invalid sidechain number.\n",
-                __func__,
-                tx.GetHash().ToString(),
-                nSidechain);
+    pdepositdb = pdb;
+    mapDepositDirty.clear();
+    if (!pdepositdb)
+        return true;
+
+    // Replace the deposit cache with the most recent deposits from disk
+    mapDepositIndex.clear();
+    fDepositHashDirty = true;
+    const bool fHaveDepositHash = pdepositdb->ReadDepositHash(muhashDeposits);
+    if (!fHaveDepositHash)
+        muhashDeposits = MuHash3072();
+
+    // Each sidechain's deposits are read and, for deposit databases written
+    // before the deposit MuHash was saved, hashed on a thread of their own.
+    // The shared index and hash are filled in afterwards.
+    struct LoadResult {
+        std::string strError;
+        uint32_t nCount = 0;
+        std::vector<SidechainDeposit> vDeposit;
+        MuHash3072 muhash;
+    };
+    std::vector<LoadResult> vResult(vDepositCache.size());
+    const uint32_t nLoadMax = nCacheSize;
+    ForEachSidechainParallel(vResult.size(), [&vResult, pdb, nLoadMax, fHaveDepositHash](size_t x) {
+        LoadResult& result = vResult[x];
+        result.nCount = pdb->ReadDepositCount(x);
+        const uint32_t nLoad = std::min<uint32_t>(result.nCount, nLoadMax);
+        if (!pdb->ReadDeposits(x, result.nCount - nLoad, nLoad, result.vDeposit)) {
+            result.strError = "Failed to load deposits";
+            return;
+        }
+
+        // Hashed a page of deposits at a time
+        for (uint32_t nPage = 0; !fHaveDepositHash && nPage < result.nCount; nPage += SIDECHAIN_DEPOSIT_CACHE_SIZE) {
+            std::vector<SidechainDeposit> vPage;
+            const uint32_t nPageCount = std::min<uint32_t>(SIDECHAIN_DEPOSIT_CACHE_SIZE, result.nCount - nPage);
+            if (!pdb->ReadDeposits(x, nPage, nPageCount, vPage)) {
+                result.strError = "Failed to hash deposits";
+                return;
+            }
+            for (size_t i = 0; i < vPage.size(); i++)
+                ApplyDepositHash(result.muhash, x, nPage + i, vPage[i]);
         }
-        return false;
-    }
+    });
 
-    if (tx.vout.size() < 3) {
+    for (size_t x = 0; x < vDepositCache.size(); x++) {
+        vDepositCache[x].clear();
+        vDepositCount[x] = 0;
+        vDepositCacheUsage[x] = 0;
+    }
+    for (size_t x = 0; x < vDepositCache.size(); x++) {
+        LoadResult& result = vResult[x];
+        if (!result.strError.empty()) {
+            LogPrintf("SCDB %s: %s for nSidechain: %u\n", __func__, result.strError, x);
+            return false;
+        }
+
+        vDepositCache[x] = std::move(result.vDeposit);
+        vDepositCount[x] = result.nCount;
+
+        const uint32_t nFirst = result.nCount - vDepositCache[x].size();
+        for (size_t i = 0; i < vDepositCache[x].size(); i++) {
+            mapDepositIndex[vDepositCache[x][i].tx->GetHash()] = std::make_pair(x, nFirst + i);
+            vDepositCacheUsage[x] += vDepositCache[x][i].DynamicMemoryUsage();
+        }
+
+        if (!fHaveDepositHash)
+            muhashDeposits *= result.muhash;
+    }
+
+    const bool fUpdated = UpdateCTIP();
+    PublishView();
+    LimitMemoryUsage();
+    return fUpdated;
+}
+
+bool SidechainDB::FlushDeposits(const uint256& hashBestBlock, const uint256& hashChainstate)
+{
+    if (!pdepositdb)
+        return true;
+
+    // The changed deposits are all cached, see TrimDepositCache
+    std::map<uint8_t, std::pair<uint32_t, std::vector<SidechainDeposit>>> mapDeposit;
+    for (const auto& dirty : mapDepositDirty) {
+        std::pair<uint32_t, std::vector<SidechainDeposit>>& entry = mapDeposit[dirty.first];
+        entry.first = dirty.second;
+        if (!ReadDeposits(dirty.first, dirty.second, vDepositCount[dirty.first] - dirty.second, entry.second))
+            return false;
+    }
+
+    if (!pdepositdb->WriteDeposits(mapDeposit, muhashDeposits, hashBestBlock, hashChainstate))
+        return false;
+
+    mapDepositDirty.clear();
+    for (const auto& entry : mapDeposit)
+        TrimDepositCache(entry.first);
+
+    return true;
+}
+
+void SidechainDB::SetLog(CSCDBLog* plogIn)
+{
+    plog = plogIn;
+}
+
+size_t SidechainDB::DynamicMemoryUsage() const
+{
+    std::vector<SidechainMemoryUsage> vUsage;
+    size_t nShared = 0;
+    GetMemoryUsage(vUsage, nShared);
+
+    size_t nUsage = nShared;
+    for (const SidechainMemoryUsage& usage : vUsage)
+        nUsage += usage.Total();
+    return nUsage;
+}
+
+void SidechainDB::GetMemoryUsage(std::vector<SidechainMemoryUsage>& vUsage, size_t& nShared) const
+{
+    vUsage.assign(vDepositCache.size(), SidechainMemoryUsage());
+
+    // Index entries are spread over the sidechains by their share of the
+    // cached deposits
+    const size_t nIndexEntry = mapDepositIndex.empty() ? 0 :
+        memusage::DynamicUsage(mapDepositIndex) / mapDepositIndex.size();
+    for (size_t x = 0; x < vDepositCache.size(); x++) {
+        vUsage[x].nDepositsCached = vDepositCache[x].size();
+        vUsage[x].nDeposits = memusage::DynamicUsage(vDepositCache[x]) + vDepositCacheUsage[x] +
+            nIndexEntry * vDepositCache[x].size();
+    }
+
+    for (size_t x = 0; x < vWithdrawalStatus.size() && x < vUsage.size(); x++) {
+        vUsage[x].nWithdrawals += memusage::DynamicUsage(vWithdrawalStatus[x]);
+        for (const SidechainWithdrawalState& state : vWithdrawalStatus[x]) {
+            std::map<uint256, SidechainWithdrawalRate>::const_iterator it = mapWithdrawalRate.find(state.hash);
+            if (it != mapWithdrawalRate.end()) {
+                vUsage[x].nWithdrawals += memusage::IncrementalDynamicUsage(mapWithdrawalRate) +
+                    memusage::DynamicUsage(it->second.vChange);
+            }
+        }
+    }
+
+    // Each cached withdrawal transaction is in both the list and the map
+    for (const std::pair<uint8_t, CTransactionRef>& pair : vWithdrawalTxCache) {
+        if (pair.first < vUsage.size()) {
+            vUsage[pair.first].nWithdrawalTx += memusage::IncrementalDynamicUsage(mapWithdrawalTxCache) +
+                RecursiveDynamicUsage(pair.second);
+        }
+    }
+
+    nShared = memusage::DynamicUsage(mapSpentWithdrawal) + memusage::DynamicUsage(queueSpentWithdrawalBlock);
+    for (const std::pair<const uint256, std::vector<SidechainSpentWithdrawal>>& pair : mapSpentWithdrawal) {
+        nShared += memusage::DynamicUsage(pair.second) - sizeof(SidechainSpentWithdrawal) * pair.second.size();
+        for (const SidechainSpentWithdrawal& spent : pair.second) {
+            if (spent.nSidechain < vUsage.size())
+                vUsage[spent.nSidechain].nSpentWithdrawals += sizeof(SidechainSpentWithdrawal);
+        }
+    }
+    for (const std::pair<const std::pair<uint8_t, uint256>, unsigned int>& pair : mapSpentWithdrawalCount) {
+        if (pair.first.first < vUsage.size())
+            vUsage[pair.first.first].nSpentWithdrawals += memusage::IncrementalDynamicUsage(mapSpentWithdrawalCount);
+    }
+
+    for (const std::pair<const uint256, SidechainFailedWithdrawal>& pair : mapFailedWithdrawal) {
+        if (pair.second.nSidechain < vUsage.size()) {
+            vUsage[pair.second.nSidechain].nFailedWithdrawals += memusage::IncrementalDynamicUsage(mapFailedWithdrawal) +
+                sizeof(uint256);
+        }
+    }
+    nShared += memusage::DynamicUsage(queueFailedWithdrawal) - sizeof(uint256) * queueFailedWithdrawal.size();
+
+    // Views are copies, readers still holding older ones aren't counted
+    for (size_t x = 0; x < vView.size() && x < vUsage.size(); x++) {
+        std::shared_ptr<const SidechainView> view = std::atomic_load(&vView[x]);
+        if (view) {
+            vUsage[x].nView = memusage::DynamicUsage(view) + view->sidechain.DynamicMemoryUsage() +
+                memusage::DynamicUsage(view->vWithdrawalStatus);
+        }
+    }
+
+    for (const Sidechain& sidechain : vSidechain)
+        nShared += sidechain.DynamicMemoryUsage();
+    nShared += memusage::DynamicUsage(vSidechain);
+    for (const Sidechain& sidechain : vActiveSidechain)
+        nShared += sidechain.DynamicMemoryUsage();
+    nShared += memusage::DynamicUsage(vActiveSidechain);
+    for (const Sidechain& sidechain : vSidechainProposal)
+        nShared += sidechain.DynamicMemoryUsage();
+    nShared += memusage::DynamicUsage(vSidechainProposal) + memusage::DynamicUsage(setSidechainProposal);
+    for (const SidechainActivationStatus& status : vActivationStatus)
+        nShared += status.proposal.DynamicMemoryUsage();
+    nShared += memusage::DynamicUsage(vActivationStatus) + memusage::DynamicUsage(mapActivationStatusIndex);
+    for (const std::string& strVote : vVoteCache)
+        nShared += memusage::DynamicUsage(strVote);
+    nShared += memusage::DynamicUsage(vVoteCache) + memusage::DynamicUsage(vchVoteCommitment);
+    nShared += memusage::DynamicUsage(vSidechainHashAck) + memusage::DynamicUsage(setSidechainHashAck);
+    nShared += memusage::DynamicUsage(mapCTIP) + memusage::DynamicUsage(setRemovedBMM) + memusage::DynamicUsage(vRemovedDeposit);
+    nShared += memusage::DynamicUsage(vDepositCache) + memusage::DynamicUsage(vDepositCount) + memusage::DynamicUsage(vDepositCacheUsage);
+    nShared += memusage::DynamicUsage(vWithdrawalStatus) + memusage::DynamicUsage(vWithdrawalTxCache);
+}
+
+void SidechainDB::SetMaxMemoryUsage(size_t nMaxUsage)
+{
+    nMaxMemoryUsage = nMaxUsage;
+    LimitMemoryUsage();
+}
+
+void SidechainDB::LimitMemoryUsage()
+{
+    if (!pdepositdb || !nMaxMemoryUsage)
+        return;
+
+    size_t nUsage = DynamicMemoryUsage();
+    if (nUsage > nMaxMemoryUsage && nCacheSize > SIDECHAIN_MIN_CACHE_SIZE) {
+        // Halve the caches until we fit, moving the oldest deposits and
+        // withdrawal history out of memory (they are already on disk, except
+        // for deposits waiting for FlushDeposits)
+        while (nUsage > nMaxMemoryUsage && nCacheSize > SIDECHAIN_MIN_CACHE_SIZE) {
+            nCacheSize = std::max(nCacheSize / 2, SIDECHAIN_MIN_CACHE_SIZE);
+            for (size_t x = 0; x < vDepositCache.size(); x++)
+                TrimDepositCache(x, true /* fTrim */);
+            ArchiveWithdrawalHistory(true /* fTrim */);
+            nUsage = DynamicMemoryUsage();
+        }
+        LogPrintf("SCDB %s: Using %u bytes, over the limit of %u. Keeping %u recent deposits per sidechain in memory.\n",
+            __func__, nUsage, nMaxMemoryUsage, nCacheSize);
+    } else if (nUsage < nMaxMemoryUsage / 4 && nCacheSize < SIDECHAIN_DEPOSIT_CACHE_SIZE) {
+        // Let the caches grow back as deposits are added. Doubling them at
+        // most doubles the usage, which leaves room before the limit.
+        nCacheSize = std::min(nCacheSize * 2, SIDECHAIN_DEPOSIT_CACHE_SIZE);
+    }
+}
+
+bool SidechainDB::ApplyLogRecord(CDataStream& s, bool fReindex)
+{
+    uint8_t type;
+    s >> type;
+
+    switch (type) {
+    case SCDB_LOG_CLEAR:
+        ClearCaches();
+        return true;
+    case SCDB_LOG_VOTES: {
+        std::vector<std::string> vVote;
+        s >> vVote;
+        return CacheCustomVotes(vVote);
+    }
+    case SCDB_LOG_PROPOSALS:
+        s >> vSidechainProposal;
+        UpdateProposalIndex();
+        return true;
+    case SCDB_LOG_HASH_ACK:
+        s >> vSidechainHashAck;
+        UpdateProposalIndex();
+        return true;
+    case SCDB_LOG_REMOVED_BMM_ADD: {
+        uint256 txid;
+        s >> txid;
+        AddRemovedBMM(txid);
+        return true;
+    }
+    case SCDB_LOG_REMOVED_BMM_ERASE: {
+        uint256 txid;
+        s >> txid;
+        BMMAbandoned(txid);
+        return true;
+    }
+    case SCDB_LOG_WITHDRAWAL_TX_ADD: {
+        std::pair<uint8_t, CTransactionRef> pair;
+        s >> pair;
+        if (!HaveWithdrawalTxCached(pair.second->GetHash()))
+            CacheWithdrawalTx(pair.second, pair.first);
+        return true;
+    }
+    case SCDB_LOG_WITHDRAWAL_TX_ERASE: {
+        uint256 hash;
+        s >> hash;
+        EraseCachedWithdrawalTx(hash);
+        return true;
+    }
+    }
+
+    // Withdrawal spends & failures come from the chain, they are rebuilt
+    // when reindexing
+    if (fReindex && type <= SCDB_LOG_FAILED_ADD)
+        return true;
+
+    switch (type) {
+    case SCDB_LOG_SPENT_ADD: {
+        std::vector<SidechainSpentWithdrawal> vSpent;
+        s >> vSpent;
+        AddSpentWithdrawals(vSpent);
+        return true;
+    }
+    case SCDB_LOG_SPENT_UNDO: {
+        uint256 hashBlock;
+        s >> hashBlock;
+        return UndoSpentWithdrawals(hashBlock);
+    }
+    case SCDB_LOG_FAILED_ADD: {
+        std::vector<SidechainFailedWithdrawal> vFailed;
+        s >> vFailed;
+        AddFailedWithdrawals(vFailed);
+        return true;
+    }
+    }
+
+    LogPrintf("SCDB %s: Unknown cache log record type: %u\n", __func__, type);
+    return false;
+}
+
+bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock, const CTransaction& tx, const int nTx, bool fJustCheck, bool fDebug)
+{
+    fDebug = true;
+    if (!IsSidechainActive(nSidechain)) {
+        if (fDebug) {
+            LogPrintf("SCDB %s: Cannot spend Withdrawal (txid): %s for sidechain number: %u.\n Invalid sidechain number.\n",
+                __func__,
+                tx.GetHash().ToString(),
+                nSidechain);
+        }
+        return false;
+    }
+
+    if (tx.vout.size() < 3) {
         if (fDebug) {
             LogPrintf("SCDB %s: Cannot spend Withdrawal (txid): %s for sidechain number: %u. Missing outputs!.\n",
                 __func__,
@@ -775,89 +1519,32 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
         return false;
     }
 
-    // Find the required change output returning to the sidechain script as well
-    // as the required SIDECHAIN_WITHDRAWAL_RETURN_DEST OP_RETURN output.
-    bool fChangeOutputFound = false;
-    bool fReturnDestFound = false;
-    uint32_t nBurnIndex = 0;
-    uint8_t nSidechainScript;
-    CAmount amountChange = 0;
-    for (size_t i = 0; i < tx.vout.size(); i++) {
-        const CScript &scriptPubKey = tx.vout[i].scriptPubKey;
-
-        // This would be non-standard but still checking
-        if (!scriptPubKey.size())
-            continue;
-
-        // The first OP_RETURN output we find must be an encoding of the
-        // SIDECHAIN_WITHDRAWAL_RETURN_DEST char. So once we find an OP_RETURN in
-        // this loop it must have the correct data encoded. We will return false
-        // if it does not and skip this code if we've already found it.
-        // Is this the SIDECHAIN_WITHDRAWAL_RETURN_DEST OP_RETURN output?
-        if (!fReturnDestFound && scriptPubKey.front() == OP_RETURN) {
-            if (scriptPubKey.size() < 3) {
-                if (fDebug) {
-                    LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. First OP_RETURN output is invalid size for destination. (too small)\n",
-                        __func__,
-                        hashBlind.ToString(),
-                        nSidechain);
-                }
-                return false;
-            }
-
-            CScript::const_iterator pDest = scriptPubKey.begin() + 1;
-            opcodetype opcode;
-            std::vector<unsigned char> vch;
-            if (!scriptPubKey.GetOp(pDest, opcode, vch) || vch.empty()) {
-                if (fDebug) {
-                    LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. First OP_RETURN output is invalid. (GetOp failed)\n",
-                        __func__,
-                        hashBlind.ToString(),
-                        nSidechain);
-                }
-                return false;
-            }
-
-            std::string strDest((const char*)vch.data(), vch.size());
-
-            if (strDest != SIDECHAIN_WITHDRAWAL_RETURN_DEST) {
-                if (fDebug) {
-                    LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. Missing SIDECHAIN_WITHDRAWAL_RETURN_DEST output.\n",
-                        __func__,
-                        hashBlind.ToString(),
-                        nSidechain);
-                }
-                return false;
-            }
-            fReturnDestFound = true;
+    // The outputs were analyzed once for every copy of the bundle
+    std::shared_ptr<const WithdrawalBundleInfo> info = GetWithdrawalBundleInfo(tx);
+    if (!info->strReturnDestError.empty()) {
+        if (fDebug) {
+            LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. %s\n",
+                __func__,
+                hashBlind.ToString(),
+                nSidechain,
+                info->strReturnDestError);
         }
+        return false;
+    }
 
-        if (scriptPubKey.IsDrivechain(nSidechainScript)) {
-            if (fChangeOutputFound) {
-                // We already found a sidechain script output. This second
-                // sidechain output makes the Withdrawal invalid.
-                if (fDebug) {
-                    LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. Multiple sidechain return outputs in Withdrawal.\n",
-                        __func__,
-                        hashBlind.ToString(),
-                        nSidechain);
-                }
-                return false;
-            }
-
-            // Copy output index of sidechain change return deposit
-            nBurnIndex = i;
-            fChangeOutputFound = true;
-
-            // Copy amount of sidechain change
-            amountChange = tx.vout[i].nValue;
-
-            continue;
+    if (info->nSidechainOutputs > 1) {
+        // A second sidechain output makes the Withdrawal invalid
+        if (fDebug) {
+            LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. Multiple sidechain return outputs in Withdrawal.\n",
+                __func__,
+                hashBlind.ToString(),
+                nSidechain);
         }
+        return false;
     }
 
     // Make sure that the sidechain output was found
-    if (!fChangeOutputFound) {
+    if (!info->nSidechainOutputs) {
         if (fDebug) {
             LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. No sidechain return output in Withdrawal.\n",
                 __func__,
@@ -868,13 +1555,13 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
     }
 
     // Make sure that the sidechain output is to the correct sidechain
-    if (nSidechainScript != nSidechain) {
+    if (info->nChangeSidechain != nSidechain) {
         if (fDebug) {
             LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. Return output to incorrect nSidechain: %u in Withdrawal.\n",
                 __func__,
                 hashBlind.ToString(),
                 nSidechain,
-                nSidechainScript);
+                info->nChangeSidechain);
         }
         return false;
     }
@@ -902,7 +1589,7 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
     }
 
     // Check that Withdrawal input matches CTIP
-    if (ctip.out != tx.vin[0].prevout) {
+    if (ctip.out != info->outCTIP) {
         if (fDebug) {
             LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. CTIP does not match!\n",
                 __func__,
@@ -912,9 +1599,8 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
        return false;
     }
 
-    // Decode sum of withdrawal fees
-    CAmount amountFees = 0;
-    if (!DecodeWithdrawalFees(tx.vout[1].scriptPubKey, amountFees)) {
+    // Sum of withdrawal fees encoded in the second output
+    if (!info->fFees) {
         if (fDebug) {
             LogPrintf("SCDB %s: Cannot spend Withdrawal: %s for sidechain number: %u. failed to decode withdrawal fees!\n",
                 __func__,
@@ -925,10 +1611,12 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
     }
 
     // Get the total value out of the blind Withdrawal
-    CAmount amountBlind = tx.GetBlindValueOut();
+    CAmount amountBlind = info->amountBlindOut;
+    CAmount amountChange = info->amountChange;
+    CAmount amountFees = info->amountFees;
 
     CAmount amountInput = ctip.amount;
-    CAmount amountOutput = tx.GetValueOut();
+    CAmount amountOutput = info->amountOut;
 
     // Check output amount
     if (amountBlind != amountOutput - amountChange) {
@@ -959,8 +1647,8 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
     SidechainDeposit deposit;
     deposit.nSidechain = nSidechain;
     deposit.strDest = SIDECHAIN_WITHDRAWAL_RETURN_DEST;
-    deposit.tx = tx;
-    deposit.nBurnIndex = nBurnIndex;
+    deposit.tx = MakeTransactionRef(tx);
+    deposit.nBurnIndex = info->nChangeIndex;
     deposit.nTx = nTx;
     deposit.hashBlock = hashBlock;
 
@@ -976,13 +1664,7 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
     // until the miner manually clears them out with an RPC command or similar.
     //
     // Find the cached transaction for the Withdrawal we spent and remove it
-    for (size_t i = 0; i < vWithdrawalTxCache.size(); i++) {
-        if (vWithdrawalTxCache[i].second.GetHash() == hashBlind) {
-            vWithdrawalTxCache[i] = vWithdrawalTxCache.back();
-            vWithdrawalTxCache.pop_back();
-            break;
-        }
-    }
+    EraseCachedWithdrawalTx(hashBlind);
 
     SidechainSpentWithdrawal spent;
     spent.nSidechain = nSidechain;
@@ -1000,8 +1682,10 @@ bool SidechainDB::SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock,
     return true;
 }
 
-bool SidechainDB::TxnToDeposit(const CTransaction& tx, const int nTx, const uint256& hashBlock, SidechainDeposit& deposit)
+bool SidechainDB::TxnToDeposit(const CTransactionRef& ptx, const int nTx, const uint256& hashBlock, SidechainDeposit& deposit)
 {
+    const CTransaction& tx = *ptx;
+
     // Note that the first OP_RETURN output found in a deposit transaction will
     // be used as the destination. Others are ignored.
     bool fBurnFound = false;
@@ -1056,16 +1740,16 @@ bool SidechainDB::TxnToDeposit(const CTransaction& tx, const int nTx, const uint
             return false;
         }
 
-        deposit.strDest = strDest;
+        deposit.SetDest(strDest);
 
         fDestFound = true;
     }
 
-    deposit.tx = tx;
+    deposit.tx = ptx;
     deposit.hashBlock = hashBlock;
     deposit.nTx = nTx;
 
-    return (fBurnFound && fDestFound && CTransaction(deposit.tx) == tx);
+    return (fBurnFound && fDestFound);
 }
 
 std::string SidechainDB::ToString() const
@@ -1075,8 +1759,6 @@ std::string SidechainDB::ToString() const
 
     str += "Hash of block last seen: " + hashBlockLastSeen.ToString() + "\n";
 
-    std::vector<Sidechain> vActiveSidechain = GetActiveSidechains();
-
     str += "Sidechains: ";
     str += std::to_string(vSidechain.size());
     str += "\n";
@@ -1085,7 +1767,7 @@ std::string SidechainDB::ToString() const
         str += "Sidechain: " + s.GetSidechainName() + "\n";
 
         // Print sidechain Withdrawal workscore(s)
-        std::vector<SidechainWithdrawalState> vState = GetState(s.nSidechain);
+        const std::vector<SidechainWithdrawalState>& vState = GetState(s.nSidechain);
         str += "Withdrawal(s): ";
         str += std::to_string(vState.size());
         str += "\n";
@@ -1124,16 +1806,33 @@ std::string SidechainDB::ToString() const
 
 bool SidechainDB::Update(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const std::vector<CTxOut>& vout, bool fJustCheck, bool fDebug)
 {
-    // Make a copy of SCDB to test update
-    SidechainDB scdbCopy = (*this);
-    if (scdbCopy.ApplyUpdate(nHeight, hashBlock, hashPrevBlock, vout, fJustCheck, fDebug)) {
-        return ApplyUpdate(nHeight, hashBlock, hashPrevBlock, vout, fJustCheck, fDebug);
-    } else {
+    if (!vout.size())
+    {
+        if (fDebug)
+            LogPrintf("SCDB %s: Failed: empty coinbase transaction at height: %u\n",
+                    __func__,
+                    nHeight);
         return false;
     }
+
+    CoinbaseCommitments commitments;
+    commitments.Read(vout);
+    return Update(nHeight, hashBlock, hashPrevBlock, commitments, fJustCheck, fDebug);
+}
+
+bool SidechainDB::Update(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const CoinbaseCommitments& commitments, bool fJustCheck, bool fDebug)
+{
+    // Make a copy of SCDB to test update
+    SidechainDB scdbCopy = (*this);
+    bool fUpdated = scdbCopy.ApplyUpdate(nHeight, hashBlock, hashPrevBlock, commitments, fJustCheck, fDebug) &&
+        ApplyUpdate(nHeight, hashBlock, hashPrevBlock, commitments, fJustCheck, fDebug);
+
+    TRACE4(scdb, update, hashBlock.begin(), nHeight, fJustCheck, fUpdated);
+
+    return fUpdated;
 }
 
-bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const std::vector<CTxOut>& vout, bool fJustCheck, bool fDebug)
+bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const CoinbaseCommitments& commitments, bool fJustCheck, bool fDebug)
 {
     if (hashBlock.IsNull()) {
         if (fDebug)
@@ -1152,16 +1851,6 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
         return false;
     }
 
-    if (!vout.size())
-    {
-        if (fDebug)
-            LogPrintf("SCDB %s: Failed: empty coinbase transaction at height: %u\n",
-                    __func__,
-                    nHeight);
-        return false;
-    }
-
-
     if (!hashBlockLastSeen.IsNull() && hashPrevBlock != hashBlockLastSeen) {
         if (fDebug)
             LogPrintf("SCDB %s: Failed: previous block hash: %s does not match hashBlockLastSeen: %s at height: %u\n",
@@ -1184,20 +1873,8 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
      * Update hashBlockLastSeen.
      */
 
-    // Scan for sidechain proposal commitments
-    std::vector<Sidechain> vProposal;
-    for (const CTxOut& out : vout) {
-        const CScript& scriptPubKey = out.scriptPubKey;
-
-        if (!scriptPubKey.IsSidechainProposalCommit())
-            continue;
-
-        Sidechain proposal;
-        if (!proposal.DeserializeFromProposalScript(scriptPubKey))
-            continue;
-
-        vProposal.push_back(proposal);
-    }
+    // Sidechain proposal commitments
+    const std::vector<Sidechain>& vProposal = commitments.vProposal;
 
     // Maximum of 1 sidechain proposal per block
     if (vProposal.size() > 1) {
@@ -1214,9 +1891,11 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
         status.nFail = 0;
         status.nAge = 0;
         status.proposal = vProposal.front();
+        status.hashProposal = status.proposal.GetSerHash();
 
         // Start tracking the new sidechain proposal
         vActivationStatus.push_back(status);
+        mapActivationStatusIndex[status.hashProposal] = status.proposal.nSidechain;
 
         LogPrintf("SCDB %s: Tracking new sidechain proposal:\n%s\n",
                 __func__,
@@ -1226,31 +1905,20 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
     // Scan for sidechain activation commitments
     std::map<uint8_t, uint256> mapActivation;
     std::vector<uint256> vActivationHash;
-    for (const CTxOut& out : vout) {
-        const CScript& scriptPubKey = out.scriptPubKey;
-        uint256 hashSidechain;
-        if (!scriptPubKey.IsSidechainActivationCommit(hashSidechain))
-            continue;
+    for (const uint256& hashSidechain : commitments.vActivation) {
         if (hashSidechain.IsNull())
             continue;
 
         // Look up the sidechain number for this activation commitment
-        bool fFound = false;
-        uint8_t nSidechain = 0;
-        for (const SidechainActivationStatus& s : vActivationStatus) {
-            if (s.proposal.GetSerHash() == hashSidechain) {
-                fFound = true;
-                nSidechain = s.proposal.nSidechain;
-                break;
-            }
-        }
-        if (!fFound) {
+        std::map<uint256, uint8_t>::const_iterator itStatus = mapActivationStatusIndex.find(hashSidechain);
+        if (itStatus == mapActivationStatusIndex.end()) {
             if (fDebug)
                 LogPrintf("SCDB %s: Invalid: Sidechain activation commit for unknown proposal.\nProposal hash: %s\n",
                         __func__,
                         hashSidechain.ToString());
             return false;
         }
+        const uint8_t nSidechain = itStatus->second;
 
         // Check that there is only 1 sidechain activation commit per
         // sidechain slot number per block
@@ -1275,47 +1943,43 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
     // new withdrawal per sidechain per block. Keep track of new withdrawals and
     // add them to SCDB later.
     std::map<uint8_t, uint256> mapNewWithdrawal;
-    for (const CTxOut& out : vout) {
-        const CScript& scriptPubKey = out.scriptPubKey;
-        uint8_t nSidechain;
-        uint256 hash;
-        if (scriptPubKey.IsWithdrawalHashCommit(hash, nSidechain)) {
-            if (!IsSidechainActive(nSidechain)) {
-                if (fDebug)
-                    LogPrintf("SCDB %s: Skipping new Withdrawal: %s, invalid sidechain number: %u\n",
-                            __func__,
-                            hash.ToString(),
-                            nSidechain);
-                continue;
-            }
+    for (const std::pair<uint8_t, uint256>& w : commitments.vWithdrawal) {
+        const uint8_t nSidechain = w.first;
+        const uint256& hash = w.second;
 
-            // Check that there is only 1 new Withdrawal per sidechain per block
-            std::map<uint8_t, uint256>::const_iterator it = mapNewWithdrawal.find(nSidechain);
-            if (it == mapNewWithdrawal.end()) {
-                mapNewWithdrawal[nSidechain] = hash;
-            } else {
-                if (fDebug) {
-                    LogPrintf("SCDB %s: Multiple new withdrawals for sidechain number: %u at height: %u\n",
-                            __func__,
-                            nSidechain,
-                            nHeight);
-                }
-                return false;
+        if (!IsSidechainActive(nSidechain)) {
+            if (fDebug)
+                LogPrintf("SCDB %s: Skipping new Withdrawal: %s, invalid sidechain number: %u\n",
+                        __func__,
+                        hash.ToString(),
+                        nSidechain);
+            continue;
+        }
+
+        // Check that there is only 1 new Withdrawal per sidechain per block
+        std::map<uint8_t, uint256>::const_iterator it = mapNewWithdrawal.find(nSidechain);
+        if (it == mapNewWithdrawal.end()) {
+            mapNewWithdrawal[nSidechain] = hash;
+        } else {
+            if (fDebug) {
+                LogPrintf("SCDB %s: Multiple new withdrawals for sidechain number: %u at height: %u\n",
+                        __func__,
+                        nSidechain,
+                        nHeight);
             }
+            return false;
         }
     }
 
     // Update SCDB withdrawl vote scores and add new withdrawals
     if (!fJustCheck && (HasState() || mapNewWithdrawal.size())) {
         // Check if there are update bytes
-        std::vector<CScript> vUpdateBytes;
-        for (const CTxOut& out : vout) {
-            const CScript scriptPubKey = out.scriptPubKey;
-            if (scriptPubKey.IsSCDBBytes())
-                vUpdateBytes.push_back(scriptPubKey);
-        }
+        const CScript* pUpdateBytes = nullptr;
+        if (!commitments.vSCDBBytes.empty())
+            pUpdateBytes = &commitments.vSCDBBytes.front();
+
         // There is a maximum of 1 update bytes script
-        if (vUpdateBytes.size() > 1) {
+        if (commitments.vSCDBBytes.size() > 1) {
             if (fDebug)
                 LogPrintf("SCDB %s: Error: multiple update byte scripts at height: %u\n",
                        __func__,
@@ -1323,19 +1987,11 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
             return false;
         }
 
-        // Read SCDB m4 update bytes, or create default abstain votes
-        std::vector<std::string> vVote;
-        if (vUpdateBytes.size()) {
-            // Get old (current) state
-            std::vector<std::vector<SidechainWithdrawalState>> vOldState;
-            for (const Sidechain& s : vSidechain) {
-                std::vector<SidechainWithdrawalState> vWithdrawal = GetState(s.nSidechain);
-                if (vWithdrawal.size())
-                    vOldState.push_back(vWithdrawal);
-            }
-
-            // Parse SCDB update bytes for new withdrawal scores
-            if (!ParseSCDBBytes(vUpdateBytes.front(), vOldState, vVote)) {
+        // Read SCDB m4 update bytes, or use the default abstain votes
+        SCDBVotes votes;
+        if (pUpdateBytes) {
+            // Parse SCDB update bytes against the old (current) state
+            if (!DecodeSCDBBytes(*pUpdateBytes, vWithdrawalStatus, votes)) {
                 if (fDebug)
                     LogPrintf("SCDB %s: Error: Failed to parse update bytes at height: %u\n",
                             __func__,
@@ -1346,11 +2002,9 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
                 LogPrintf("SCDB %s: Parsed update bytes at height: %u\n",
                         __func__,
                         nHeight);
-        } else {
-            vVote = std::vector<std::string>(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
         }
 
-        bool fUpdated = UpdateSCDBIndex(vVote, true /* fDebug */, mapNewWithdrawal);
+        bool fUpdated = UpdateSCDBIndex(votes, true /* fDebug */, mapNewWithdrawal);
         if (!fUpdated) {
             if (fDebug)
                 LogPrintf("SCDB %s: Failed to update SCDB at height: %u\n",
@@ -1393,6 +2047,7 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
                 // Remove the spent Withdrawal
                 vWithdrawalStatus[s.nSidechain][i] = vWithdrawalStatus[s.nSidechain].back();
                 vWithdrawalStatus[s.nSidechain].pop_back();
+                UpdateVoteCommitment(s.nSidechain);
                 break;
             }
         }
@@ -1416,8 +2071,10 @@ bool SidechainDB::ApplyUpdate(int nHeight, const uint256& hashBlock, const uint2
     }
 
     // Update hashBLockLastSeen
-    if (!fJustCheck)
+    if (!fJustCheck) {
         hashBlockLastSeen = hashBlock;
+        PublishView();
+    }
 
     return true;
 }
@@ -1433,40 +2090,56 @@ bool SidechainDB::Undo(int nHeight, const uint256& hashBlock, const uint256& has
     }
 
     // Remove cached Withdrawal spends from the block that was disconnected
-    std::map<uint256, std::vector<SidechainSpentWithdrawal>>::const_iterator it;
-    it = mapSpentWithdrawal.find(hashBlock);
-    if (it != mapSpentWithdrawal.end())
-        mapSpentWithdrawal.erase(it);
+    if (!UndoSpentWithdrawals(hashBlock)) {
+        LogPrintf("%s: SCDB undo failed for block: %s - failed to erase archived withdrawal spends!\n", __func__, hashBlock.ToString());
+        return false;
+    }
 
-    // TODO lookup deposits in cache with setDepositTXID, then std::remove_if
-    //
     // Undo deposits
-    // Loop through the transactions in the block being disconnected, and if
-    // they match a transaction in our deposit cache remove it.
-    bool fDepositRemoved = false;
+    // Find the deposits from the block being disconnected. They should be the
+    // most recent deposits of their sidechain, so only the deposits after the
+    // first one removed from each sidechain have to be rewritten.
+    std::map<uint8_t, std::set<uint32_t>> mapRemoved;
     for (const CTransactionRef& tx : vtx) {
-        for (size_t x = 0; x < vDepositCache.size(); x++) {
-            std::vector<SidechainDeposit>::iterator it;
-            for (it = vDepositCache[x].begin(); it != vDepositCache[x].end();) {
-                if (*tx == CTransaction(it->tx)) {
-                    setDepositTXID.erase(tx->GetHash());
-                    fDepositRemoved = true;
-                    it = vDepositCache[x].erase(it);
-                } else {
-                    it++;
-                }
-            }
+        uint8_t nSidechain;
+        uint32_t nIndex;
+        if (FindDeposit(tx->GetHash(), nSidechain, nIndex))
+            mapRemoved[nSidechain].insert(nIndex);
+    }
+
+    // Remove the deposits by position so that the deposits we keep don't have
+    // to be hashed again. What is left is still in CTIP spend order.
+    for (const auto& pair : mapRemoved) {
+        const uint8_t nSidechain = pair.first;
+        const uint32_t nFirst = *pair.second.begin();
+
+        std::vector<SidechainDeposit> vDeposit;
+        if (!ReadDeposits(nSidechain, nFirst, vDepositCount[nSidechain] - nFirst, vDeposit)) {
+            LogPrintf("%s: SCDB undo failed for block: %s - failed to read deposits!\n", __func__, hashBlock.ToString());
+            return false;
+        }
+
+        std::vector<SidechainDeposit> vKeep;
+        vKeep.reserve(vDeposit.size() - pair.second.size());
+        for (size_t i = 0; i < vDeposit.size(); i++) {
+            if (!pair.second.count(nFirst + i))
+                vKeep.push_back(std::move(vDeposit[i]));
+        }
+
+        if (!ReplaceDeposits(nSidechain, nFirst, vKeep)) {
+            LogPrintf("%s: SCDB undo failed for block: %s - failed to remove deposits!\n", __func__, hashBlock.ToString());
+            return false;
         }
     }
 
-    // If any deposits were removed re-sort deposits and update CTIP
-    if (fDepositRemoved) {
-        // TODO check return value
-        if (!SortSCDBDeposits()) {
-            LogPrintf("SCDB %s: Failed to sort SCDB deposits!", __func__);
+    // If any deposits were removed update CTIP, once the reorg is done if
+    // this is one of its blocks
+    if (!mapRemoved.empty()) {
+        if (fReorg) {
+            fReorgCTIP = true;
         }
         // TODO check return value
-        if (!UpdateCTIP()) {
+        else if (!UpdateCTIP()) {
             LogPrintf("SCDB %s: Failed to update CTIP!", __func__);
         }
     }
@@ -1474,6 +2147,10 @@ bool SidechainDB::Undo(int nHeight, const uint256& hashBlock, const uint256& has
     // Undo hashBlockLastSeen
     hashBlockLastSeen = hashPrevBlock;
 
+    PublishView();
+
+    TRACE3(scdb, undo, hashBlock.begin(), nHeight, mapRemoved.size());
+
     LogPrintf("%s: SCDB undo for block: %s complete!\n", __func__, hashBlock.ToString());
 
     return true;
@@ -1481,13 +2158,58 @@ bool SidechainDB::Undo(int nHeight, const uint256& hashBlock, const uint256& has
 
 bool SidechainDB::UpdateSCDBIndex(const std::vector<std::string>& vVote, bool fDebug, const std::map<uint8_t, uint256>& mapNewWithdrawal)
 {
-    if (vWithdrawalStatus.empty()) {
+    if (vVote.size() != vWithdrawalStatus.size() || vVote.size() > SIDECHAIN_ACTIVATION_MAX_ACTIVE) {
+        if (fDebug)
+            LogPrintf("SCDB %s: Update failed: vVote size is invalid!\n",
+                    __func__);
+        return false;
+    }
+
+    SCDBVotes votes;
+    for (size_t x = 0; x < vVote.size(); x++) {
+        if (vVote[x].empty()) {
+            if (fDebug)
+                LogPrintf("SCDB %s: Update failed: vote characters invalid!\n",
+                        __func__);
+            return false;
+        }
+        if (vVote[x].size() == 64 && uint256S(vVote[x]).IsNull()) {
+            if (fDebug)
+                LogPrintf("SCDB %s: Update failed: upvote hash invalid!\n",
+                        __func__);
+            return false;
+        }
+        votes[x] = ParseSCDBVote(vVote[x], vWithdrawalStatus[x]);
+    }
+
+    return UpdateSCDBIndex(votes, fDebug, mapNewWithdrawal);
+}
+
+bool SidechainDB::UpdateSCDBIndex(const SCDBVotes& votes, bool fDebug, const std::map<uint8_t, uint256>& mapNewWithdrawal)
+{
+    if (vWithdrawalStatus.empty()) {
         if (fDebug)
             LogPrintf("SCDB %s: Update failed: vWithdrawalStatus is empty!\n",
                     __func__);
         return false;
     }
 
+    if (vWithdrawalStatus.size() != votes.size()) {
+        if (fDebug)
+            LogPrintf("SCDB %s: Update failed: vWithdrawalStatus size is invalid!\n",
+                    __func__);
+        return false;
+    }
+
+    // Look up the upvoted withdrawals before expired ones are removed and
+    // the indexes change. An upvote of an index that is out of range still
+    // counts against every withdrawal of the sidechain.
+    std::array<uint256, SIDECHAIN_ACTIVATION_MAX_ACTIVE> vUpvote;
+    for (size_t x = 0; x < votes.size(); x++) {
+        if (votes[x].vote == SCDB_UPVOTE && votes[x].nIndex < vWithdrawalStatus[x].size())
+            vUpvote[x] = vWithdrawalStatus[x][votes[x].nIndex].hash;
+    }
+
     // Remove expired withdrawals
     RemoveExpiredWithdrawals();
 
@@ -1499,47 +2221,19 @@ bool SidechainDB::UpdateSCDBIndex(const std::vector<std::string>& vVote, bool fD
         }
     }
 
-    if (vVote.size() != vWithdrawalStatus.size()) {
-        if (fDebug)
-            LogPrintf("SCDB %s: Update failed: vVote size is invalid!\n",
-                    __func__);
-        return false;
-    }
-
-    // Update withdrawal scores
+    // Update withdrawal scores, and the rates they change at. The rates of
+    // withdrawals that were removed are dropped.
+    std::map<uint256, SidechainWithdrawalRate> mapRate;
     for (size_t x = 0; x < vWithdrawalStatus.size(); x++) {
-        if (vVote[x].empty()) {
-            if (fDebug)
-                LogPrintf("SCDB %s: Update failed: vote characters invalid!\n",
-                        __func__);
-            return false;
-        }
-
-        // What type of vote do we have for this sidechain?
-        uint256 hash = uint256();
-        char vote = SCDB_ABSTAIN;
-        if (vVote[x].size() == 64) {
-            hash = uint256S(vVote[x]);
-            if (hash.IsNull()) {
-                if (fDebug)
-                    LogPrintf("SCDB %s: Update failed: upvote hash invalid!\n",
-                            __func__);
-                return false;
-            }
-            vote = SCDB_UPVOTE;
-        }
-        else
-        if (vVote[x].front() == SCDB_DOWNVOTE)
-            vote = SCDB_DOWNVOTE;
+        // Do not apply score changes to withdrawals for any sidechain that
+        // has added a new withdrawal
+        const bool fNewWithdrawal = mapNewWithdrawal.count(x);
 
-        // Apply score changes. Do not apply score changes to withdrawals for
-        // any sidechain that has added a new withdrawal
+        const char vote = fNewWithdrawal ? SCDB_ABSTAIN : votes[x].vote;
         for (size_t y = 0; y < vWithdrawalStatus[x].size(); y++) {
-            if (mapNewWithdrawal.find(x) != mapNewWithdrawal.end())
-                continue;
-
+            const uint16_t nOldScore = vWithdrawalStatus[x][y].nWorkScore;
             if (vote == SCDB_UPVOTE) {
-                if (vWithdrawalStatus[x][y].hash == hash) {
+                if (vWithdrawalStatus[x][y].hash == vUpvote[x]) {
                     if (vWithdrawalStatus[x][y].nWorkScore < 65535)
                         vWithdrawalStatus[x][y].nWorkScore++;
                 } else {
@@ -1552,8 +2246,18 @@ bool SidechainDB::UpdateSCDBIndex(const std::vector<std::string>& vVote, bool fD
                     if (vWithdrawalStatus[x][y].nWorkScore > 0)
                         vWithdrawalStatus[x][y].nWorkScore--;
             }
+
+            const uint256& hash = vWithdrawalStatus[x][y].hash;
+            SidechainWithdrawalRate& rate = mapRate[hash];
+            auto it = mapWithdrawalRate.find(hash);
+            if (it != mapWithdrawalRate.end())
+                rate = std::move(it->second);
+            rate.Add(vWithdrawalStatus[x][y].nWorkScore - nOldScore);
         }
+        if (vote != SCDB_ABSTAIN && !vWithdrawalStatus[x].empty())
+            PublishView(x);
     }
+    mapWithdrawalRate.swap(mapRate);
 
     // Add new withdrawals
     for (const std::pair<uint8_t, uint256>& p : mapNewWithdrawal) {
@@ -1586,65 +2290,48 @@ void SidechainDB::ApplyDefaultUpdate()
 
 void SidechainDB::UpdateActivationStatus(const std::vector<uint256>& vHash)
 {
-    // TODO change containers
-
-    // Increment the age of all sidechain proposals and remove expired.
-    std::vector<SidechainActivationStatus>::iterator it;
-    for (it = vActivationStatus.begin(); it != vActivationStatus.end();) {
-        it->nAge++;
-
-        int nPeriod = 0;
-        if (IsSidechainActive(it->proposal.nSidechain))
-            nPeriod = SIDECHAIN_REPLACEMENT_PERIOD;
-        else
-            nPeriod = SIDECHAIN_ACTIVATION_PERIOD;
-
-        if (it->nAge > nPeriod) {
-            LogPrintf("SCDB %s: Sidechain proposal expired:\n%s\n",
-                    __func__,
-                    it->proposal.ToString());
-
-            it = vActivationStatus.erase(it);
-        } else {
-            it++;
-        }
-    }
-
-    // Calculate failures. Sidechain proposals with activation status will have
-    // their activation failure count increased by 1 if a activation commitment
-    // for them is not found in the block. New sidechain proposals (age = 1)
-    // count as an activation commitment.
-    for (size_t i = 0; i < vActivationStatus.size(); i++) {
-        // Skip new sidechain proposals
-        if (vActivationStatus[i].nAge == 1)
-            continue;
-
-        // Search for sidechain activation commitments
-        bool fFound = false;
-        for (const uint256& u : vHash) {
-            if (u == vActivationStatus[i].proposal.GetSerHash()) {
-                fFound = true;
-                break;
-            }
-        }
-        if (!fFound)
-            vActivationStatus[i].nFail++;
-    }
-
-    // Remove sidechain proposals with too many failures to activate
-    for (it = vActivationStatus.begin(); it != vActivationStatus.end();) {
-        if (it->nFail >= SIDECHAIN_ACTIVATION_MAX_FAILURES) {
-            LogPrintf("SCDB %s: Sidechain proposal rejected:\n%s\n",
-                    __func__,
-                    it->proposal.ToString());
-
-            it = vActivationStatus.erase(it);
-        } else {
-            it++;
-        }
-    }
+    const std::set<uint256> setHash(vHash.begin(), vHash.end());
+
+    // Increment the age of all sidechain proposals and calculate failures.
+    // Sidechain proposals with activation status will have their activation
+    // failure count increased by 1 if a activation commitment for them is not
+    // found in the block. New sidechain proposals (age = 1) count as an
+    // activation commitment. Remove proposals that expired or have too many
+    // failures to activate.
+    vActivationStatus.erase(std::remove_if(
+                vActivationStatus.begin(), vActivationStatus.end(),
+                [this, &setHash](SidechainActivationStatus& status)
+                {
+                    status.nAge++;
+
+                    int nPeriod = 0;
+                    if (IsSidechainActive(status.proposal.nSidechain))
+                        nPeriod = SIDECHAIN_REPLACEMENT_PERIOD;
+                    else
+                        nPeriod = SIDECHAIN_ACTIVATION_PERIOD;
+
+                    if (status.nAge > nPeriod) {
+                        LogPrintf("SCDB %s: Sidechain proposal expired:\n%s\n",
+                                __func__,
+                                status.proposal.ToString());
+                        return true;
+                    }
+
+                    if (status.nAge != 1 && !setHash.count(status.hashProposal))
+                        status.nFail++;
+
+                    if (status.nFail >= SIDECHAIN_ACTIVATION_MAX_FAILURES) {
+                        LogPrintf("SCDB %s: Sidechain proposal rejected:\n%s\n",
+                                __func__,
+                                status.proposal.ToString());
+                        return true;
+                    }
+                    return false;
+                }),
+                vActivationStatus.end());
 
     // Search for sidechains that have passed the test and should be activated.
+    std::vector<SidechainActivationStatus>::iterator it;
     for (it = vActivationStatus.begin(); it != vActivationStatus.end();) {
         // The required period to be activated is either the normal sidechain
         // activation period for a new sidechain, or the same as the Withdrawal
@@ -1670,13 +2357,17 @@ void SidechainDB::UpdateActivationStatus(const std::vector<uint256>& vHash)
 
             // Update nSidechain slot with new sidechain params
             vSidechain[sidechain.nSidechain] = sidechain;
+            UpdateActiveSidechains();
 
             // Remove from cache of our own proposals
-            for (size_t j = 0; j < vSidechainProposal.size(); j++) {
-                if (it->proposal == vSidechainProposal[j]) {
-                    vSidechainProposal[j] = vSidechainProposal.back();
-                    vSidechainProposal.pop_back();
-                    break;
+            if (setSidechainProposal.erase(it->proposal.GetProposalHash())) {
+                for (size_t j = 0; j < vSidechainProposal.size(); j++) {
+                    if (it->proposal == vSidechainProposal[j]) {
+                        vSidechainProposal[j] = vSidechainProposal.back();
+                        vSidechainProposal.pop_back();
+                        WriteLog(SCDB_LOG_PROPOSALS, vSidechainProposal);
+                        break;
+                    }
                 }
             }
             // Remove SCDB proposal activation status
@@ -1684,9 +2375,13 @@ void SidechainDB::UpdateActivationStatus(const std::vector<uint256>& vHash)
 
             // Reset Withdrawal status for new sidechain
             vWithdrawalStatus[sidechain.nSidechain].clear();
+            UpdateVoteCommitment(sidechain.nSidechain);
 
             // Reset deposits for new sidechain
-            vDepositCache[sidechain.nSidechain].clear();
+            if (!ReplaceDeposits(sidechain.nSidechain, 0, std::vector<SidechainDeposit>())) {
+                LogPrintf("SCDB %s: Failed to reset deposits for nSidechain: %u\n",
+                        __func__, sidechain.nSidechain);
+            }
 
             // Reset CTIP for new sidechain
             mapCTIP.erase(sidechain.nSidechain);
@@ -1698,26 +2393,41 @@ void SidechainDB::UpdateActivationStatus(const std::vector<uint256>& vHash)
             it++;
         }
     }
+
+    UpdateActivationStatusIndex();
 }
 
-bool SidechainDB::SortSCDBDeposits()
+void SidechainDB::SetActivationStatus(const std::vector<SidechainActivationStatus>& vActivationStatusIn)
 {
-    std::vector<std::vector<SidechainDeposit>> vDepositSorted;
+    vActivationStatus = vActivationStatusIn;
+    for (SidechainActivationStatus& status : vActivationStatus)
+        status.hashProposal = status.proposal.GetSerHash();
+    UpdateActivationStatusIndex();
+}
 
-    // Loop through deposits and sort the vector for each sidechain
-    for (const std::vector<SidechainDeposit>& v : vDepositCache) {
-        std::vector<SidechainDeposit> vDeposit;
-        if (!SortDeposits(v, vDeposit)) {
-            LogPrintf("%s: Error: Failed to sort deposits!\n", __func__);
-            return false;
-        }
-        vDepositSorted.push_back(vDeposit);
-    }
+void SidechainDB::UpdateActivationStatusIndex()
+{
+    mapActivationStatusIndex.clear();
+    for (const SidechainActivationStatus& status : vActivationStatus)
+        mapActivationStatusIndex[status.hashProposal] = status.proposal.nSidechain;
+}
+
+void SidechainDB::UpdateProposalIndex()
+{
+    setSidechainProposal.clear();
+    for (const Sidechain& s : vSidechainProposal)
+        setSidechainProposal.insert(s.GetProposalHash());
 
-    // Update deposit cache with sorted list
-    vDepositCache = vDepositSorted;
+    setSidechainHashAck = std::set<uint256>(vSidechainHashAck.begin(), vSidechainHashAck.end());
+}
 
-    return true;
+void SidechainDB::UpdateActiveSidechains()
+{
+    vActiveSidechain.clear();
+    for (const Sidechain& s : vSidechain) {
+        if (s.fActive)
+            vActiveSidechain.push_back(s);
+    }
 }
 
 bool SidechainDB::UpdateCTIP()
@@ -1726,11 +2436,11 @@ bool SidechainDB::UpdateCTIP()
         if (vDepositCache[x].size()) {
             const SidechainDeposit& d = vDepositCache[x].back();
 
-            if (d.nBurnIndex >= d.tx.vout.size())
+            if (d.nBurnIndex >= d.tx->vout.size())
                 return false;
 
-            const COutPoint out(d.tx.GetHash(), d.nBurnIndex);
-            const CAmount amount = d.tx.vout[d.nBurnIndex].nValue;
+            const COutPoint out(d.tx->GetHash(), d.nBurnIndex);
+            const CAmount amount = d.tx->vout[d.nBurnIndex].nValue;
 
             SidechainCTIP ctip;
             ctip.out = out;
@@ -1760,43 +2470,509 @@ bool SidechainDB::UpdateCTIP()
     return true;
 }
 
-bool DecodeWithdrawalFees(const CScript& script, CAmount& amount)
+void SidechainDB::UpdateVoteIndex(uint8_t nSidechain)
 {
-    if (script[0] != OP_RETURN || script.size() != 10) {
-        LogPrintf("%s: Error: Invalid script!\n", __func__);
-        return false;
+    if (nSidechain >= vWithdrawalStatus.size())
+        return;
+
+    // Abstain unless we have a vote for a withdrawal that SCDB is tracking
+    SCDBVote vote;
+    if (nSidechain < vVoteCache.size()) {
+        vote = ParseSCDBVote(vVoteCache[nSidechain], vWithdrawalStatus[nSidechain]);
+        if (vote.vote == SCDB_UPVOTE && vote.nIndex >= vWithdrawalStatus[nSidechain].size())
+            vote = SCDBVote();
     }
 
-    CScript::const_iterator it = script.begin() + 1;
-    std::vector<unsigned char> vch;
-    opcodetype opcode;
+    ourVotes[nSidechain] = vote;
+}
 
-    if (!script.GetOp(it, opcode, vch)) {
-        LogPrintf("%s: Error: GetOp failed!\n", __func__);
-        return false;
+void SidechainDB::UpdateVoteCommitment(uint8_t nSidechain)
+{
+    UpdateVoteIndex(nSidechain);
+    BuildVoteCommitment();
+}
+
+void SidechainDB::UpdateVoteCommitment()
+{
+    for (size_t x = 0; x < vWithdrawalStatus.size(); x++)
+        UpdateVoteIndex(x);
+
+    BuildVoteCommitment();
+}
+
+void SidechainDB::BuildVoteCommitment()
+{
+    // Script header & version, see GenerateSCDBByteCommitment
+    vchVoteCommitment = {OP_RETURN, 0xD7, 0x7D, 0x17, 0x76, SCDB_BYTES_VERSION};
+
+    // Two bytes for each sidechain with withdrawals in SCDB
+    EncodeSCDBVotes(ourVotes, vWithdrawalStatus, vchVoteCommitment);
+}
+
+void SidechainDB::ArchiveWithdrawalHistory(bool fTrim)
+{
+    if (!pdepositdb)
+        return;
+
+    // Archive in batches so that we aren't writing to the database for
+    // every block
+    const size_t nKeep = std::min(nCacheSize, SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE);
+    const size_t nMax = fTrim ? nKeep : 2 * nKeep;
+    if (queueSpentWithdrawalBlock.size() > nMax) {
+        const size_t nArchive = queueSpentWithdrawalBlock.size() - nKeep;
+        std::vector<SidechainSpentWithdrawal> vArchive;
+        for (size_t i = 0; i < nArchive; i++) {
+            const std::vector<SidechainSpentWithdrawal>& vSpent = mapSpentWithdrawal[queueSpentWithdrawalBlock[i]];
+            vArchive.insert(vArchive.end(), vSpent.begin(), vSpent.end());
+        }
+
+        if (pdepositdb->WriteSpentWithdrawals(vArchive)) {
+            for (size_t i = 0; i < nArchive; i++) {
+                auto it = mapSpentWithdrawal.find(queueSpentWithdrawalBlock[i]);
+                for (const SidechainSpentWithdrawal& spent : it->second) {
+                    auto itCount = mapSpentWithdrawalCount.find(std::make_pair(spent.nSidechain, spent.hash));
+                    if (itCount != mapSpentWithdrawalCount.end() && --itCount->second == 0)
+                        mapSpentWithdrawalCount.erase(itCount);
+                }
+                mapSpentWithdrawal.erase(it);
+            }
+            queueSpentWithdrawalBlock.erase(queueSpentWithdrawalBlock.begin(), queueSpentWithdrawalBlock.begin() + nArchive);
+        } else {
+            LogPrintf("SCDB %s: Failed to archive withdrawal spends!\n", __func__);
+        }
+    }
+
+    if (queueFailedWithdrawal.size() > nMax) {
+        const size_t nArchive = queueFailedWithdrawal.size() - nKeep;
+        std::vector<SidechainFailedWithdrawal> vArchive;
+        for (size_t i = 0; i < nArchive; i++)
+            vArchive.push_back(mapFailedWithdrawal[queueFailedWithdrawal[i]]);
+
+        if (pdepositdb->WriteFailedWithdrawals(vArchive)) {
+            for (size_t i = 0; i < nArchive; i++)
+                mapFailedWithdrawal.erase(queueFailedWithdrawal[i]);
+            queueFailedWithdrawal.erase(queueFailedWithdrawal.begin(), queueFailedWithdrawal.begin() + nArchive);
+        } else {
+            LogPrintf("SCDB %s: Failed to archive failed withdrawals!\n", __func__);
+        }
+    }
+}
+
+/** Whether two lists of withdrawals differ in more than their blocks left */
+static bool WithdrawalScoresChanged(const std::vector<SidechainWithdrawalState>& vOld, const std::vector<SidechainWithdrawalState>& vNew)
+{
+    if (vOld.size() != vNew.size())
+        return true;
+    for (size_t i = 0; i < vOld.size(); i++) {
+        if (vOld[i].hash != vNew[i].hash || vOld[i].nWorkScore != vNew[i].nWorkScore)
+            return true;
+    }
+    return false;
+}
+
+void SidechainDB::PublishView(uint8_t nSidechain)
+{
+    if (fViewHeld || fReorg)
+        return;
+
+    std::shared_ptr<SidechainView> view;
+    if (IsSidechainActive(nSidechain)) {
+        view = std::make_shared<SidechainView>();
+        view->sidechain = vSidechain[nSidechain];
+        view->fHaveCTIP = GetCTIP(nSidechain, view->ctip);
+        view->nDeposits = vDepositCount[nSidechain];
+        view->vWithdrawalStatus = vWithdrawalStatus[nSidechain];
+    }
+
+    // Count the changes since the last view for WaitForView
+    const std::shared_ptr<const SidechainView> viewOld = std::atomic_load(&vView[nSidechain]);
+    SidechainViewSequence& sequence = vViewSequence[nSidechain];
+    bool fChanged = false;
+    if (!view || !viewOld) {
+        fChanged = view || viewOld;
+        if (fChanged) {
+            sequence.nCTIP++;
+            sequence.nDeposit++;
+            sequence.nWithdrawal++;
+        }
+    } else {
+        if (view->fHaveCTIP != viewOld->fHaveCTIP || view->ctip.out != viewOld->ctip.out || view->ctip.amount != viewOld->ctip.amount) {
+            sequence.nCTIP++;
+            fChanged = true;
+        }
+        if (view->nDeposits != viewOld->nDeposits) {
+            sequence.nDeposit++;
+            fChanged = true;
+        }
+        if (WithdrawalScoresChanged(viewOld->vWithdrawalStatus, view->vWithdrawalStatus)) {
+            sequence.nWithdrawal++;
+            fChanged = true;
+        }
+    }
+    if (view)
+        view->sequence = sequence;
+
+    std::atomic_store(&vView[nSidechain], std::shared_ptr<const SidechainView>(std::move(view)));
+
+    if (fChanged)
+        NotifyViewWaiters();
+}
+
+void SidechainDB::PublishView()
+{
+    if (fViewHeld || fReorg)
+        return;
+
+    std::atomic_store(&pActiveView, std::make_shared<const std::vector<Sidechain>>(vActiveSidechain));
+    for (size_t x = 0; x < vView.size(); x++)
+        PublishView(x);
+}
+
+void SidechainDB::HoldView(bool fHold)
+{
+    fViewHeld = fHold;
+    PublishView();
+}
+
+void SidechainDB::BeginReorg()
+{
+    fReorg = true;
+    fReorgCTIP = false;
+}
+
+void SidechainDB::EndReorg()
+{
+    fReorg = false;
+    if (fReorgCTIP && !UpdateCTIP())
+        LogPrintf("SCDB %s: Failed to update CTIP!", __func__);
+    fReorgCTIP = false;
+
+    PublishView();
+}
+
+std::shared_ptr<const SidechainView> SidechainDB::WaitForView(uint8_t nSidechain, const std::function<bool(const std::shared_ptr<const SidechainView>&)>& fDone, int64_t nTimeout) const
+{
+    std::shared_ptr<const SidechainView> view;
+    auto done = [this, nSidechain, &fDone, &view] {
+        view = GetSidechainView(nSidechain);
+        return fDone(view);
+    };
+
+    std::unique_lock<std::mutex> lock(cs_viewchange);
+    if (nTimeout > 0)
+        cond_viewchange.wait_for(lock, std::chrono::milliseconds(nTimeout), done);
+    else
+        cond_viewchange.wait(lock, done);
+
+    return view;
+}
+
+void SidechainDB::NotifyViewWaiters()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_viewchange);
+    }
+    cond_viewchange.notify_all();
+}
+
+void SidechainDB::ClearCaches()
+{
+    // Clear out list of sidechain (hashes) we want to ACK
+    vSidechainHashAck.clear();
+    setSidechainHashAck.clear();
+
+    // Clear out our cache of proposed sidechains
+    vSidechainProposal.clear();
+    setSidechainProposal.clear();
+
+    // Clear out cached Withdrawal serializations
+    vWithdrawalTxCache.clear();
+    mapWithdrawalTxCache.clear();
+
+    // Clear out custom vote cache
+    vVoteCache = std::vector<std::string>(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    UpdateVoteCommitment();
+
+    // Clear out spent Withdrawal cache
+    mapSpentWithdrawal.clear();
+    mapSpentWithdrawalCount.clear();
+    queueSpentWithdrawalBlock.clear();
+
+    // Clear out failed Withdrawal cache
+    mapFailedWithdrawal.clear();
+    queueFailedWithdrawal.clear();
+
+    setRemovedBMM.clear();
+}
+
+void SidechainDB::EraseCachedWithdrawalTx(const uint256& hash)
+{
+    if (!mapWithdrawalTxCache.erase(hash))
+        return;
+
+    WriteLog(SCDB_LOG_WITHDRAWAL_TX_ERASE, hash);
+
+    for (size_t i = 0; i < vWithdrawalTxCache.size(); i++) {
+        if (vWithdrawalTxCache[i].second->GetHash() == hash) {
+            vWithdrawalTxCache[i] = vWithdrawalTxCache.back();
+            vWithdrawalTxCache.pop_back();
+            break;
+        }
+    }
+}
+
+bool SidechainDB::UndoSpentWithdrawals(const uint256& hashBlock)
+{
+    WriteLog(SCDB_LOG_SPENT_UNDO, hashBlock);
+
+    std::map<uint256, std::vector<SidechainSpentWithdrawal>>::const_iterator it;
+    it = mapSpentWithdrawal.find(hashBlock);
+    if (it == mapSpentWithdrawal.end())
+        return !pdepositdb || pdepositdb->EraseSpentWithdrawals(hashBlock);
+
+    for (const SidechainSpentWithdrawal& spent : it->second) {
+        auto itCount = mapSpentWithdrawalCount.find(std::make_pair(spent.nSidechain, spent.hash));
+        if (itCount != mapSpentWithdrawalCount.end() && --itCount->second == 0)
+            mapSpentWithdrawalCount.erase(itCount);
+    }
+    mapSpentWithdrawal.erase(it);
+
+    // The disconnected block is one of the most recent ones
+    auto itQueue = std::find(queueSpentWithdrawalBlock.rbegin(), queueSpentWithdrawalBlock.rend(), hashBlock);
+    if (itQueue != queueSpentWithdrawalBlock.rend())
+        queueSpentWithdrawalBlock.erase(std::next(itQueue).base());
+
+    return true;
+}
+
+template <typename T>
+void SidechainDB::WriteLog(SCDBLogRecord type, const T& obj) const
+{
+    if (!plog)
+        return;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint8_t)type;
+    ss << obj;
+    plog->Append(std::vector<unsigned char>(ss.begin(), ss.end()));
+}
+
+bool SidechainDB::FindDeposit(const uint256& txid, uint8_t& nSidechain, uint32_t& nIndex) const
+{
+    std::unordered_map<uint256, std::pair<uint8_t, uint32_t>, SaltedDepositTxidHasher>::const_iterator it = mapDepositIndex.find(txid);
+    if (it != mapDepositIndex.end()) {
+        nSidechain = it->second.first;
+        nIndex = it->second.second;
+        return true;
     }
 
-    if (vch.empty()) {
-        LogPrintf("%s: Error: Amount bytes empty!\n", __func__);
+    if (!pdepositdb || !pdepositdb->ReadDepositIndex(txid, nSidechain, nIndex))
+        return false;
+
+    // The database might have deposits we have dropped after a reset, or
+    // replaced since the last flush
+    if (nSidechain >= vDepositCount.size() || nIndex >= vDepositCount[nSidechain])
         return false;
+    std::map<uint8_t, uint32_t>::const_iterator itDirty = mapDepositDirty.find(nSidechain);
+    return itDirty == mapDepositDirty.end() || nIndex < itDirty->second;
+}
+
+bool SidechainDB::ReadDeposits(uint8_t nSidechain, uint32_t nStart, uint32_t nCount, std::vector<SidechainDeposit>& vDeposit) const
+{
+    const std::vector<SidechainDeposit>& vCache = vDepositCache[nSidechain];
+    const uint32_t nCacheStart = vDepositCount[nSidechain] - vCache.size();
+
+    // Read whatever isn't cached in memory from the deposit database
+    if (nStart < nCacheStart) {
+        const uint32_t nRead = std::min(nCount, nCacheStart - nStart);
+        if (!pdepositdb || !pdepositdb->ReadDeposits(nSidechain, nStart, nRead, vDeposit))
+            return false;
+        nStart += nRead;
+        nCount -= nRead;
     }
 
-    if (vch.size() > 8) {
-        LogPrintf("%s: Error: Amount bytes too large!\n", __func__);
+    if (nStart + nCount > vDepositCount[nSidechain])
+        return false;
+
+    vDeposit.insert(vDeposit.end(), vCache.begin() + (nStart - nCacheStart),
+            vCache.begin() + (nStart - nCacheStart + nCount));
+
+    return true;
+}
+
+bool SidechainDB::ReplaceDeposits(uint8_t nSidechain, uint32_t nStart, const std::vector<SidechainDeposit>& vDeposit)
+{
+    if (nSidechain >= vDepositCache.size() || nStart > vDepositCount[nSidechain])
+        return false;
+
+    // Step the deposit MuHash past the replacement, it is saved in the same
+    // batch as the deposits
+    std::vector<SidechainDeposit> vReplaced;
+    if (!ReadDeposits(nSidechain, nStart, vDepositCount[nSidechain] - nStart, vReplaced))
         return false;
+
+    MuHash3072 muhash = muhashDeposits;
+    for (size_t i = 0; i < vReplaced.size(); i++)
+        RemoveDepositHash(muhash, nSidechain, nStart + i, vReplaced[i]);
+    for (size_t i = 0; i < vDeposit.size(); i++)
+        ApplyDepositHash(muhash, nSidechain, nStart + i, vDeposit[i]);
+
+    muhashDeposits = muhash;
+    fDepositHashDirty = true;
+
+    // Drop the replaced deposits from the cache. The cache always holds the
+    // last deposits of the sidechain, so if the replaced deposits start
+    // before the cache it is emptied and then holds only the new deposits.
+    std::vector<SidechainDeposit>& vCache = vDepositCache[nSidechain];
+    const uint32_t nCacheStart = vDepositCount[nSidechain] - vCache.size();
+    const size_t nKeep = nStart > nCacheStart ? nStart - nCacheStart : 0;
+    for (size_t i = nKeep; i < vCache.size(); i++) {
+        mapDepositIndex.erase(vCache[i].tx->GetHash());
+        vDepositCacheUsage[nSidechain] -= vCache[i].DynamicMemoryUsage();
+    }
+    vCache.erase(vCache.begin() + nKeep, vCache.end());
+
+    for (size_t i = 0; i < vDeposit.size(); i++) {
+        vCache.push_back(vDeposit[i]);
+        mapDepositIndex[vDeposit[i].tx->GetHash()] = std::make_pair(nSidechain, nStart + i);
+        vDepositCacheUsage[nSidechain] += vDeposit[i].DynamicMemoryUsage();
+    }
+    vDepositCount[nSidechain] = nStart + vDeposit.size();
+
+    if (!pdepositdb)
+        return true;
+
+    // The deposits from nStart on are written by the next FlushDeposits
+    std::map<uint8_t, uint32_t>::iterator itDirty = mapDepositDirty.find(nSidechain);
+    if (itDirty == mapDepositDirty.end())
+        mapDepositDirty[nSidechain] = nStart;
+    else
+        itDirty->second = std::min(itDirty->second, nStart);
+
+    // Only keep the most recent deposits in memory
+    TrimDepositCache(nSidechain);
+
+    // Reload older deposits from disk if the cache was cut short
+    const uint32_t nFirstCached = vDepositCount[nSidechain] - vCache.size();
+    if (vCache.size() < nCacheSize && nFirstCached > 0) {
+        const uint32_t nLoad = std::min<uint32_t>(nCacheSize - vCache.size(), nFirstCached);
+        std::vector<SidechainDeposit> vLoad;
+        if (!pdepositdb->ReadDeposits(nSidechain, nFirstCached - nLoad, nLoad, vLoad))
+            return false;
+
+        for (size_t i = 0; i < vLoad.size(); i++) {
+            mapDepositIndex[vLoad[i].tx->GetHash()] = std::make_pair(nSidechain, nFirstCached - nLoad + i);
+            vDepositCacheUsage[nSidechain] += vLoad[i].DynamicMemoryUsage();
+        }
+        vCache.insert(vCache.begin(), vLoad.begin(), vLoad.end());
     }
 
-    try {
-        CDataStream ds(vch, SER_NETWORK, PROTOCOL_VERSION);
-        ds >> amount;
-    } catch (const std::exception&) {
-        LogPrintf("%s: Error: Failed to deserialize amount!\n", __func__);
+    return true;
+}
+
+void SidechainDB::TrimDepositCache(uint8_t nSidechain, bool fTrim)
+{
+    // Trim the cache in batches so that we aren't moving the whole cache for
+    // every new deposit
+    std::vector<SidechainDeposit>& vCache = vDepositCache[nSidechain];
+    if (vCache.size() <= (fTrim ? nCacheSize : 2 * nCacheSize))
+        return;
+
+    // Deposits that haven't been flushed to the deposit database stay
+    size_t nErase = vCache.size() - nCacheSize;
+    std::map<uint8_t, uint32_t>::const_iterator itDirty = mapDepositDirty.find(nSidechain);
+    if (itDirty != mapDepositDirty.end())
+        nErase = std::min<size_t>(nErase, itDirty->second - (vDepositCount[nSidechain] - vCache.size()));
+    if (!nErase)
+        return;
+
+    for (size_t i = 0; i < nErase; i++) {
+        mapDepositIndex.erase(vCache[i].tx->GetHash());
+        vDepositCacheUsage[nSidechain] -= vCache[i].DynamicMemoryUsage();
+    }
+    vCache.erase(vCache.begin(), vCache.begin() + nErase);
+    if (fTrim)
+        vCache.shrink_to_fit();
+}
+
+bool DecodeWithdrawalFees(const CScript& script, CAmount& amount)
+{
+    // OP_RETURN followed by a push of the 8 byte amount
+    if (!WITHDRAWAL_FEES_PATTERN.Match(script)) {
+        LogPrintf("%s: Error: Invalid script!\n", __func__);
         return false;
     }
 
+    amount = (CAmount)ReadLE64(&script[2]);
+
     return true;
 }
 
+std::shared_ptr<const WithdrawalBundleInfo> GetWithdrawalBundleInfo(const CTransaction& tx)
+{
+    std::shared_ptr<const WithdrawalBundleInfo> pCached = tx.GetWithdrawalInfoCache();
+    if (pCached)
+        return pCached;
+
+    std::shared_ptr<WithdrawalBundleInfo> info = std::make_shared<WithdrawalBundleInfo>();
+    if (!tx.GetBlindHash(info->hashBlind))
+        return nullptr;
+
+    info->outCTIP = tx.vin[0].prevout;
+    info->nOutputs = tx.vout.size();
+
+    // Matched first so that transactions which aren't bundles don't log a
+    // decoding error, callers report a missing fee output
+    if (tx.vout.size() > 1 && WITHDRAWAL_FEES_PATTERN.Match(tx.vout[1].scriptPubKey))
+        info->fFees = DecodeWithdrawalFees(tx.vout[1].scriptPubKey, info->amountFees);
+
+    // Throws like GetValueOut for out of range amounts
+    info->amountOut = tx.GetValueOut();
+    info->amountBlindOut = info->amountOut - tx.vout.back().nValue;
+
+    bool fReturnDestFound = false;
+    for (size_t i = 0; i < tx.vout.size(); i++) {
+        const CScript& scriptPubKey = tx.vout[i].scriptPubKey;
+
+        uint8_t nSidechain;
+        if (scriptPubKey.IsDrivechain(nSidechain)) {
+            if (!info->nSidechainOutputs++) {
+                info->nChangeIndex = i;
+                info->nChangeSidechain = nSidechain;
+                info->amountChange = tx.vout[i].nValue;
+            }
+            continue;
+        }
+        info->amountPayout += tx.vout[i].nValue;
+
+        // The first OP_RETURN output must be an encoding of the
+        // SIDECHAIN_WITHDRAWAL_RETURN_DEST string
+        if (fReturnDestFound || !scriptPubKey.size() || scriptPubKey.front() != OP_RETURN)
+            continue;
+        fReturnDestFound = true;
+
+        if (scriptPubKey.size() < 3) {
+            info->strReturnDestError = "First OP_RETURN output is invalid size for destination. (too small)";
+            continue;
+        }
+
+        CScript::const_iterator pDest = scriptPubKey.begin() + 1;
+        opcodetype opcode;
+        std::vector<unsigned char> vch;
+        if (!scriptPubKey.GetOp(pDest, opcode, vch) || vch.empty()) {
+            info->strReturnDestError = "First OP_RETURN output is invalid. (GetOp failed)";
+            continue;
+        }
+
+        std::string strDest((const char*)vch.data(), vch.size());
+        if (strDest != SIDECHAIN_WITHDRAWAL_RETURN_DEST)
+            info->strReturnDestError = "Missing SIDECHAIN_WITHDRAWAL_RETURN_DEST output.";
+    }
+
+    tx.SetWithdrawalInfoCache(info);
+    return info;
+}
+
 bool SortDeposits(const std::vector<SidechainDeposit>& vDeposit, std::vector<SidechainDeposit>& vDepositSorted)
 {
     if (vDeposit.empty())
@@ -1807,162 +2983,179 @@ bool SortDeposits(const std::vector<SidechainDeposit>& vDeposit, std::vector<Sid
         return true;
     }
 
-    // Find the first deposit in the list by looking for the deposit which
-    // spends a CTIP not in the list. There can only be one. We are also going
-    // to check that there is only one missing CTIP input here.
-    int nMissingCTIP = 0;
+    // Index the CTIP output created by each deposit so that we can look up
+    // the deposit spent by an input in constant time. Each deposit txid is
+    // only hashed once here.
+    std::unordered_map<COutPoint, size_t, SaltedOutpointHasher> mapCTIPOutput;
+    mapCTIPOutput.reserve(vDeposit.size());
     for (size_t x = 0; x < vDeposit.size(); x++) {
-        const SidechainDeposit dx = vDeposit[x];
+        const COutPoint out(vDeposit[x].tx->GetHash(), vDeposit[x].nBurnIndex);
+        if (!mapCTIPOutput.emplace(out, x).second) {
+            LogPrintf("%s: Error: Duplicate deposit in list!\n", __func__);
+            return false;
+        }
+    }
 
-        // Look for the input of this deposit
+    // Link each deposit to the deposit which spends its CTIP output. The
+    // first deposit in the list is the deposit which spends a CTIP not in the
+    // list. There can only be one.
+    const size_t nNone = vDeposit.size();
+    std::vector<size_t> vNext(vDeposit.size(), nNone);
+    size_t nFirst = nNone;
+    for (size_t x = 0; x < vDeposit.size(); x++) {
         bool fFound = false;
-        for (size_t y = 0; y < vDeposit.size(); y++) {
-            const SidechainDeposit dy = vDeposit[y];
-
-            // The CTIP output of the deposit that might be the input
-            const COutPoint prevout(dy.tx.GetHash(), dy.nBurnIndex);
+        for (const CTxIn& in : vDeposit[x].tx->vin) {
+            std::unordered_map<COutPoint, size_t, SaltedOutpointHasher>::const_iterator it = mapCTIPOutput.find(in.prevout);
+            if (it == mapCTIPOutput.end())
+                continue;
 
-            // Look for the CTIP output
-            for (const CTxIn& in : dx.tx.vin) {
-                if (in.prevout == prevout) {
-                    fFound = true;
-                    break;
-                }
+            if (vNext[it->second] != nNone) {
+                LogPrintf("%s: Error: CTIP spent by multiple deposits!\n", __func__);
+                return false;
             }
-            if (fFound)
-                break;
+            vNext[it->second] = x;
+            fFound = true;
+            break;
         }
 
         // If we didn't find the CTIP input, this should be the first and only
         // deposit without one.
         if (!fFound) {
-            nMissingCTIP++;
-            if (nMissingCTIP > 1) {
+            if (nFirst != nNone) {
                 LogPrintf("%s: Error: Multiple missing CTIP!\n", __func__);
                 return false;
             }
-            // Add the first deposit to the result
-            vDepositSorted.push_back(dx);
-            // We found the first deposit but do not stop the loop here
-            // because we are also checking to make sure there aren't any
-            // other deposits missing a CTIP input from the list.
+            nFirst = x;
         }
     }
 
-    if (vDepositSorted.empty()) {
+    if (nFirst == nNone) {
         LogPrintf("%s: Error: Could not find first deposit in list!\n", __func__);
         return false;
     }
 
     // Now that we know which deposit is first in the list we can add the rest
-    // in CTIP spend order.
+    // in CTIP spend order by following the links.
+    std::vector<SidechainDeposit> vSorted;
+    vSorted.reserve(vDeposit.size());
+    for (size_t x = nFirst; x != nNone && vSorted.size() < vDeposit.size(); x = vNext[x])
+        vSorted.push_back(vDeposit[x]);
 
-    // Track the CTIP output of the latest deposit we have sorted
-    COutPoint prevout(vDepositSorted.back().tx.GetHash(), vDepositSorted.back().nBurnIndex);
-
-    // Look for the deposit that spends the last sorted CTIP output and sort it.
-    // If we cannot find a deposit spending the CTIP, that should mean we
-    // reached the end of sorting.
-    std::vector<SidechainDeposit>::const_iterator it = vDeposit.begin();
-    while (it != vDeposit.end()) {
-        bool fFound = false;
-        for (const CTxIn& in : it->tx.vin) {
-            if (in.prevout == prevout) {
-                // Add the sorted deposit to the list
-                vDepositSorted.push_back(*it);
+    if (vDeposit.size() != vSorted.size()) {
+        LogPrintf("%s: Error: Invalid result size! In: %u Out: %u\n", __func__,
+                vDeposit.size(), vSorted.size());
+        return false;
+    }
 
-                // Update the CTIP output we are looking for
-                const SidechainDeposit deposit = vDepositSorted.back();
-                prevout = COutPoint(deposit.tx.GetHash(), deposit.nBurnIndex);
+    vDepositSorted.insert(vDepositSorted.end(), vSorted.begin(), vSorted.end());
 
-                // Start from begin() again
-                fFound = true;
-                it = vDeposit.begin();
+    return true;
+}
 
-                break;
-            }
+bool ParseSCDBBytes(const CScript& script, const std::vector<std::vector<SidechainWithdrawalState>>& vOldScores, std::vector<std::string>& vVote)
+{
+    for (const std::vector<SidechainWithdrawalState>& v : vOldScores) {
+        if (v.empty()) {
+            LogPrintf("SCDB %s: Error: invalid (empty) old scores!\n", __func__);
+            return false;
         }
-        if (!fFound)
-            it++;
     }
 
-    if (vDeposit.size() != vDepositSorted.size()) {
-        LogPrintf("%s: Error: Invalid result size! In: %u Out: %u\n", __func__,
-                vDeposit.size(), vDepositSorted.size());
+    SCDBVotes votes;
+    if (!DecodeSCDBBytes(script, vOldScores, votes))
         return false;
+
+    vVote = std::vector<std::string>(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    for (const std::vector<SidechainWithdrawalState>& v : vOldScores) {
+        const uint8_t nSidechain = v.front().nSidechain;
+        const SCDBVote& vote = votes[nSidechain];
+        if (vote.vote == SCDB_UPVOTE)
+            vVote[nSidechain] = v[vote.nIndex].hash.ToString();
+        else
+            vVote[nSidechain] = vote.vote;
     }
 
     return true;
 }
 
-bool ParseSCDBBytes(const CScript& script, const std::vector<std::vector<SidechainWithdrawalState>>& vOldScores, std::vector<std::string>& vVote)
+bool DecodeSCDBBytes(const CScript& script, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, SCDBVotes& votes)
 {
     if (script.size() < 8 || !script.IsSCDBBytes()) {
         LogPrintf("SCDB %s: Error: script not SCDB update bytes!\n", __func__);
         return false;
     }
 
-    if (vOldScores.empty()) {
-        LogPrintf("SCDB %s: Error: no old scores!\n", __func__);
-        return false;
-    }
-
     uint8_t nVersion = script[5];
     if (nVersion > SCDB_BYTES_MAX_VERSION) {
         LogPrintf("SCDB %s: Error: Invalid version!\n", __func__);
         return false;
     }
 
-    for (const std::vector<SidechainWithdrawalState>& v : vOldScores) {
-        if (v.empty()) {
-            LogPrintf("SCDB %s: Error: invalid (empty) old scores!\n", __func__);
-            return false;
-        }
+    if (script.size() % 2) {
+        LogPrintf("SCDB %s: Error: Incomplete vote bytes!\n", __func__);
+        return false;
     }
 
-    vVote.clear();
-    vVote = std::vector<std::string>(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
-
-    CScript bytes = CScript(script.begin() + 6, script.end());
+    votes.fill(SCDBVote());
 
-    // The score index is the current vector of withdrawal bundle scores
-    // we are looping through. This is different than the sidechain number,
-    // because a vector of scores will only be passed in for sidechains
-    // with pending withdrawals and otherwise skipped.
-    size_t nScoreIndex = 0;
-    for (size_t i = 0; i < bytes.size(); i += 2) {
-        if (nScoreIndex >= vOldScores.size()) {
+    // Each two bytes after the header are the vote for the next sidechain
+    // that has withdrawals
+    auto it = vScores.begin();
+    bool fScores = false;
+    for (size_t i = 6; i < script.size(); i += 2) {
+        while (it != vScores.end() && it->empty())
+            it++;
+        if (it == vScores.end()) {
             LogPrintf("SCDB %s: Error: invalid upvote index - too large!\n", __func__);
             return false;
         }
+        fScores = true;
 
-        // Copy sidechain number from first withdrawal at score index
-        size_t nSidechain = vOldScores[nScoreIndex][0].nSidechain;
-
-        if (bytes[i] == 0xFF && bytes[i + 1] == 0xFF) {
-            // Abstain bytes
-            vVote[nSidechain] = SCDB_ABSTAIN;
-        }
-        else
-        if (bytes[i] == 0xFF && bytes[i + 1] == 0xFE) {
-            // Downvote bytes
-            vVote[nSidechain] = SCDB_DOWNVOTE;
+        const uint8_t nSidechain = it->front().nSidechain;
+        const SCDBVote vote = SCDBVote::FromEncoded(script[i] | script[i + 1] << 8);
+        if (vote.vote == SCDB_UPVOTE && vote.nIndex >= it->size()) {
+            LogPrintf("SCDB %s: Error: invalid upvote index - too large!\n", __func__);
+            return false;
         }
-        else {
-            // Upvote index
-            uint16_t n = bytes[i] | bytes[i + 1] << 8;
+        votes[nSidechain] = vote;
+        it++;
+    }
 
-            if (n >= vOldScores[nScoreIndex].size()) {
-                LogPrintf("SCDB %s: Error: invalid upvote index - too large!\n", __func__);
-                return false;
-            }
+    if (!fScores) {
+        LogPrintf("SCDB %s: Error: no old scores!\n", __func__);
+        return false;
+    }
 
-            // Lookup withdrawal bundle hash and add to votes
-            vVote[nSidechain] = vOldScores[nScoreIndex][n].hash.ToString();
-        }
+    return true;
+}
+
+void EncodeSCDBVotes(const SCDBVotes& votes, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, std::vector<unsigned char>& vch)
+{
+    for (const std::vector<SidechainWithdrawalState>& vWithdrawal : vScores) {
+        if (vWithdrawal.empty())
+            continue;
 
-        nScoreIndex++;
+        const uint16_t n = votes[vWithdrawal.front().nSidechain].GetEncoded(vWithdrawal.size());
+        vch.push_back(n & 0xff);
+        vch.push_back(n >> 8);
     }
+}
 
-    return true;
+SCDBVote ParseSCDBVote(const std::string& strVote, const std::vector<SidechainWithdrawalState>& vWithdrawal)
+{
+    SCDBVote vote;
+    if (strVote.size() == 64) {
+        const uint256 hash = uint256S(strVote);
+        vote.vote = SCDB_UPVOTE;
+        vote.nIndex = std::min<size_t>(vWithdrawal.size(), SCDB_VOTE_INDEX_DOWNVOTE);
+        for (size_t i = 0; i < vWithdrawal.size() && i < SCDB_VOTE_INDEX_DOWNVOTE; i++) {
+            if (vWithdrawal[i].hash == hash) {
+                vote.nIndex = i;
+                break;
+            }
+        }
+    } else if (strVote.size() == 1 && strVote.front() == SCDB_DOWNVOTE) {
+        vote.vote = SCDB_DOWNVOTE;
+    }
+    return vote;
 }
@@ -5,23 +5,32 @@
 #ifndef BITCOIN_SIDECHAINDB_H
 #define BITCOIN_SIDECHAINDB_H
 
+#include <array>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory> // Required for forward declaration of CTransactionRef typedef
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #include <amount.h>
+#include <crypto/muhash.h>
+#include <sidechain.h>
 #include <uint256.h>
 
 class CCriticalData;
+class CDataStream;
 class COutPoint;
 class CScript;
 class CTransaction;
 typedef std::shared_ptr<const CTransaction> CTransactionRef;
-class CMutableTransaction;
+class CSCDBLog;
+class CSidechainTreeDB;
 class CTxOut;
 class uint256;
 
+struct CoinbaseCommitments;
 struct Sidechain;
 struct SidechainActivationStatus;
 struct SidechainBlockData;
@@ -31,12 +40,163 @@ struct SidechainWithdrawalState;
 struct SidechainSpentWithdrawal;
 struct SidechainFailedWithdrawal;
 
+//! Number of recent deposits per sidechain kept in memory when SCDB has a
+//! deposit database
+static const unsigned int SIDECHAIN_DEPOSIT_CACHE_SIZE = 1000;
+
+/** Types of the records SCDB writes to its cache log. Each record sets
+ * state, so that replaying it twice is harmless (see CSCDBLog). */
+enum SCDBLogRecord : uint8_t {
+    //! The caches were cleared by a reset
+    SCDB_LOG_CLEAR = 0,
+    //! All of the custom votes
+    SCDB_LOG_VOTES = 1,
+    //! All of the sidechain proposals
+    SCDB_LOG_PROPOSALS = 2,
+    //! All of the hashes of sidechains to activate
+    SCDB_LOG_HASH_ACK = 3,
+    //! A BMM txid removed from the mempool by the miner
+    SCDB_LOG_REMOVED_BMM_ADD = 4,
+    //! A BMM txid that has been abandoned
+    SCDB_LOG_REMOVED_BMM_ERASE = 5,
+    //! A withdrawal transaction that was cached
+    SCDB_LOG_WITHDRAWAL_TX_ADD = 6,
+    //! The hash of a withdrawal transaction that was dropped from the cache
+    SCDB_LOG_WITHDRAWAL_TX_ERASE = 7,
+    //! Withdrawal spends of a connected block
+    SCDB_LOG_SPENT_ADD = 8,
+    //! The hash of a disconnected block whose withdrawal spends were removed
+    SCDB_LOG_SPENT_UNDO = 9,
+    //! Failed withdrawals
+    SCDB_LOG_FAILED_ADD = 10,
+};
+
+//! Number of recent blocks of withdrawal spends, and of recent failed
+//! withdrawals, kept in memory when SCDB has a database to archive older ones
+//! to. Spends are read back from memory when their block is disconnected, so
+//! this covers far deeper reorgs than are expected.
+static const unsigned int SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE = 1000;
+
+//! Default for -maxscdbmemory, in MiB
+static const int64_t DEFAULT_MAX_SCDB_MEMORY = 64;
+
+//! Fewest recent deposits per sidechain, and blocks of withdrawal spends and
+//! failed withdrawals, kept in memory however little memory SCDB may use
+static const unsigned int SIDECHAIN_MIN_CACHE_SIZE = 100;
+
+/** Memory used by SCDB for the state of one sidechain, in bytes (see
+ * SidechainDB::GetMemoryUsage) */
+struct SidechainMemoryUsage {
+    //! Deposits kept in memory, with their transactions and txid index
+    size_t nDeposits = 0;
+    //! Number of deposits kept in memory
+    size_t nDepositsCached = 0;
+    //! Withdrawal states and their recent work score changes
+    size_t nWithdrawals = 0;
+    //! Cached withdrawal transactions
+    size_t nWithdrawalTx = 0;
+    //! Withdrawal spends kept in memory
+    size_t nSpentWithdrawals = 0;
+    //! Failed withdrawals kept in memory
+    size_t nFailedWithdrawals = 0;
+    //! The published view, while it isn't shared with SCDB
+    size_t nView = 0;
+
+    size_t Total() const
+    {
+        return nDeposits + nWithdrawals + nWithdrawalTx + nSpentWithdrawals + nFailedWithdrawals + nView;
+    }
+};
+
+/** Counts of the changes to the state of a sidechain since startup. A
+ * client that remembers the numbers it has seen can wait for the next change
+ * without missing one (see SidechainDB::WaitForView). */
+struct SidechainViewSequence {
+    //! Changes to the CTIP
+    uint64_t nCTIP = 0;
+    //! Changes to the deposits: added, or removed by a disconnected block
+    uint64_t nDeposit = 0;
+    //! Changes to the withdrawals or to their work scores
+    uint64_t nWithdrawal = 0;
+};
+
+/** Copy of the state of one active sidechain, published by SCDB so that it
+ * can be read without cs_main (see SidechainDB::GetSidechainView) */
+struct SidechainView {
+    Sidechain sidechain;
+    bool fHaveCTIP = false;
+    SidechainCTIP ctip;
+    uint32_t nDeposits = 0;
+    std::vector<SidechainWithdrawalState> vWithdrawalStatus;
+    SidechainViewSequence sequence;
+};
+
+//! Number of recent blocks the rate of change of a withdrawal's work score is
+//! measured over
+static const unsigned int SIDECHAIN_WITHDRAWAL_RATE_WINDOW = 144;
+
+/** The work score changes of a withdrawal in its most recent blocks, kept up
+ * to date as blocks are connected */
+struct SidechainWithdrawalRate {
+    //! Work score change of each block, oldest first
+    std::deque<int8_t> vChange;
+    //! Sum of vChange
+    int nSum = 0;
+
+    void Add(int nChange)
+    {
+        vChange.push_back(nChange);
+        nSum += nChange;
+        if (vChange.size() > SIDECHAIN_WITHDRAWAL_RATE_WINDOW) {
+            nSum -= vChange.front();
+            vChange.pop_front();
+        }
+    }
+
+    void Undo()
+    {
+        if (vChange.empty())
+            return;
+        nSum -= vChange.back();
+        vChange.pop_back();
+    }
+};
+
+/** Where a withdrawal is headed if its work score keeps changing at its
+ * recent rate (see SidechainDB::GetWithdrawalProjections) */
+struct SidechainWithdrawalProjection {
+    SidechainWithdrawalState state;
+    //! Number of blocks the rate was measured over
+    unsigned int nBlocks = 0;
+    //! Work score change over those blocks
+    int nChange = 0;
+    //! Blocks until the work score reaches SIDECHAIN_WITHDRAWAL_MIN_WORKSCORE,
+    //! 0 if it has, -1 if it won't at this rate before the withdrawal expires
+    int nBlocksToApproval = -1;
+};
+
+/** Salted hasher for the deposit txid index. Deposit txids can be ground by
+ * anyone making deposits, so the hash must not be predictable. */
+class SaltedDepositTxidHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedDepositTxidHasher();
+
+    size_t operator()(const uint256& txid) const;
+};
+
 class SidechainDB
 {
 public:
     SidechainDB();
 
-    void ApplyLDBData(const uint256& hashBlockLastSeen, const SidechainBlockData& data);
+    /** Load the SCDB state of block hashBlockLastSeen from the sidechain
+     * tree database, nBlocksBack blocks before the current state */
+    void ApplyLDBData(const uint256& hashBlockLastSeen, const SidechainBlockData& data, unsigned int nBlocksBack = 1);
 
     /** Add txid of BMM transaction removed from mempool to cache */
     void AddRemovedBMM(const uint256& hashRemoved);
@@ -47,6 +207,12 @@ public:
     /** Add deposit(s) to cache */
     void AddDeposits(const std::vector<SidechainDeposit>& vDeposit);
 
+    /** Bulk load a complete list of deposits, like deposit.dat of older
+     * versions. The deposits of sidechains without any yet aren't checked
+     * against the cache one by one, they are sorted on a thread per
+     * sidechain and written at once. The CTIPs are updated at the end. */
+    void ImportDeposits(const std::vector<SidechainDeposit>& vDeposit);
+
     /** Add a new withdrawal bundle to SCDB */
     bool AddWithdrawal(uint8_t nSidechain, const uint256& hash, bool fDebug = false);
 
@@ -56,6 +222,13 @@ public:
     /** Add failed withdrawals to SCDB */
     void AddFailedWithdrawals(const std::vector<SidechainFailedWithdrawal>& vFailed);
 
+    /** Remove the withdrawal spends of the blocks fInChain returns false
+     * for, and the failed withdrawals that are still waiting for votes.
+     * For spent & failed withdrawals loaded from a cache that may have been
+     * written for other blocks than those SCDB was synced to. Returns the
+     * number of withdrawals removed. */
+    size_t RemoveStaleWithdrawalHistory(const std::function<bool(const uint256&)>& fInChain);
+
     /** Remove failed BMM request from cache once it has been abandoned */
     void BMMAbandoned(const uint256& txid);
 
@@ -75,7 +248,7 @@ public:
     void CacheSidechainHashToAck(const uint256& u);
 
     /** Add withdrawal transaction to the in-memory cache */
-    bool CacheWithdrawalTx(const CTransaction& tx, const uint8_t nSidechain);
+    bool CacheWithdrawalTx(const CTransactionRef& tx, const uint8_t nSidechain);
 
     /** Check SCDB withdrawal verification status */
     bool CheckWorkScore(uint8_t nSidechain, const uint256& hash, bool fDebug = false) const;
@@ -86,15 +259,66 @@ public:
     /** Return number of active sidechains */
     unsigned int GetActiveSidechainCount() const;
 
+    /** Check if SCDB is tracking the activation status of a proposal */
+    bool HaveActivationStatus(const uint256& hashProposal) const;
+
     /** Check if the hash of the sidechain is in our hashes of sidechains to
      * activate cache. Return true if it is, or false if not. */
     bool GetAckSidechain(const uint256& u) const;
 
+    /*
+     * The getters below that return a reference point into SCDB itself
+     * rather than copying its state. The reference stays valid until SCDB is
+     * next modified, so only use it while holding cs_main and copy anything
+     * that has to outlive the lock.
+     */
+
     /** Get list of currently active sidechains */
-    std::vector<Sidechain> GetActiveSidechains() const;
+    const std::vector<Sidechain>& GetActiveSidechains() const;
+
+    /*
+     * Unlike the rest of SCDB, the views below don't need cs_main. SCDB
+     * publishes a new copy of a sidechain's state whenever it changes, so a
+     * reader gets the state as of the last change and never holds up the
+     * thread updating SCDB. Each sidechain is published on its own: two views
+     * aren't guaranteed to be of the same block.
+     */
+
+    /** Get the state of nSidechain, or nullptr if it isn't active */
+    std::shared_ptr<const SidechainView> GetSidechainView(uint8_t nSidechain) const;
+
+    /** Get list of currently active sidechains */
+    std::shared_ptr<const std::vector<Sidechain>> GetActiveSidechainsView() const;
+
+    /** Keep the views as they are now while SCDB is rebuilt, publish the
+     * current state again once released */
+    void HoldView(bool fHold);
+
+    /**
+     * Wait until fDone returns true for the view of nSidechain, which is
+     * nullptr while the sidechain isn't active. fDone is checked again each
+     * time a view is published with a new sequence number, and on
+     * NotifyViewWaiters. Waits at most nTimeout milliseconds, 0 to wait
+     * until fDone returns true. Returns the last view checked.
+     */
+    std::shared_ptr<const SidechainView> WaitForView(uint8_t nSidechain, const std::function<bool(const std::shared_ptr<const SidechainView>&)>& fDone, int64_t nTimeout) const;
+
+    /** Wake up WaitForView callers, e.g. for their fDone to see shutdown */
+    static void NotifyViewWaiters();
+
+    /** Whether the views are held by HoldView */
+    bool IsViewHeld() const { return fViewHeld; }
+
+    /** Start disconnecting the blocks of a reorg. Undo only takes out their
+     * deposits and spent withdrawals, the CTIP update and the views are
+     * left to EndReorg, once SCDB has been resynced to the fork. */
+    void BeginReorg();
+
+    /** Update the CTIP if a deposit was undone and publish the views */
+    void EndReorg();
 
     /** Get list of all sidechains */
-    std::vector<Sidechain> GetSidechains() const;
+    const std::vector<Sidechain>& GetSidechains() const;
 
     /** Get list of BMM txid that miner removed from the mempool. */
     std::set<uint256> GetRemovedBMM() const;
@@ -106,16 +330,27 @@ public:
     bool GetCTIP(uint8_t nSidechain, SidechainCTIP& out) const;
 
     /** Return the CTIP (critical transaction index pair) for all sidechains */
-    std::map<uint8_t, SidechainCTIP> GetCTIP() const;
+    const std::map<uint8_t, SidechainCTIP>& GetCTIP() const;
 
-    bool GetCachedWithdrawalTx(const uint256& hash, CMutableTransaction& mtx) const;
+    bool GetCachedWithdrawalTx(const uint256& hash, CTransactionRef& tx) const;
 
     /** Return vector of cached custom withdrawal votes */
     std::vector<std::string> GetVotes() const;
 
-    /** Return vector of cached deposits for nSidechain. */
+    /** Return all deposits for nSidechain. */
     std::vector<SidechainDeposit> GetDeposits(uint8_t nSidechain) const;
 
+    /** Return up to nCount deposits for nSidechain in CTIP spend order,
+     * starting with deposit number nStart. */
+    std::vector<SidechainDeposit> GetDeposits(uint8_t nSidechain, uint32_t nStart, uint32_t nCount) const;
+
+    /** Return the number of deposits for nSidechain */
+    uint32_t GetDepositCount(uint8_t nSidechain) const;
+
+    /** Look up a deposit by txid. amount is set to how much the deposit
+     * grew the sidechain's CTIP by (negative for withdrawal payouts). */
+    bool GetDeposit(const uint256& txid, SidechainDeposit& deposit, CAmount& amount) const;
+
     /** Return the hash of the last block SCDB processed */
     uint256 GetHashBlockLastSeen();
 
@@ -125,11 +360,19 @@ public:
      * sidechain proposals. */
     uint256 GetTestHash() const;
 
+    /** Return a hash of the consensus state of SCDB: the last block seen,
+     * CTIPs, sidechains, activation status, withdrawal state and every
+     * deposit. Deposits are covered by a MuHash that is updated as they are
+     * added and undone, so this doesn't depend on the number of deposits.
+     * Unlike GetTestHash it leaves out user data, so it should match
+     * between nodes at the same block. */
+    uint256 GetStateHash() const;
+
     /** Get the sidechain that relates to nSidechain if it exists */
     bool GetSidechain(const uint8_t nSidechain, Sidechain& sidechain) const;
 
     /** Get sidechain activation status */
-    std::vector<SidechainActivationStatus> GetSidechainActivationStatus() const;
+    const std::vector<SidechainActivationStatus>& GetSidechainActivationStatus() const;
 
     /** Get the name of a sidechain */
     std::string GetSidechainName(uint8_t nSidechain) const;
@@ -143,30 +386,49 @@ public:
     /** Get list of sidechains that we have set to ACK */
     std::vector<uint256> GetSidechainsToActivate() const;
 
+    /** Return the SCDB update bytes script for our withdrawal votes. Kept up
+     * to date as the withdrawal state and our votes change. */
+    CScript GetSCDBByteCommitment() const;
+
     /** Get a list of withdrawals spent in a given block */
     std::vector<SidechainSpentWithdrawal> GetSpentWithdrawalsForBlock(const uint256& hashBlock) const;
 
     /** Get status of nSidechain's withdrawals (public for unit tests) */
-    std::vector<SidechainWithdrawalState> GetState(uint8_t nSidechain) const;
+    const std::vector<SidechainWithdrawalState>& GetState(uint8_t nSidechain) const;
 
-    std::vector<std::vector<SidechainWithdrawalState>> GetState() const;
+    const std::vector<std::vector<SidechainWithdrawalState>>& GetState() const;
+
+    /** Project every withdrawal's work score forward at the rate it changed
+     * over the last SIDECHAIN_WITHDRAWAL_RATE_WINDOW blocks, or nSidechain's
+     * withdrawals only if it is set */
+    std::vector<SidechainWithdrawalProjection> GetWithdrawalProjections(int nSidechain = -1) const;
 
     /** Return cached but uncommitted withdrawal transaction hash(s) for nSidechain */
     std::vector<uint256> GetUncommittedWithdrawalCache(uint8_t nSidechain) const;
 
     /** Return cached withdrawal transaction(s) */
-    std::vector<std::pair<uint8_t, CMutableTransaction>> GetWithdrawalTxCache() const;
+    const std::vector<std::pair<uint8_t, CTransactionRef>>& GetWithdrawalTxCache() const;
 
-    /** Return cached spent withdrawals as a vector for dumping to disk */
+    /** Return the spent withdrawals kept in memory as a vector for dumping
+     * to disk. Older spends are in the database. */
     std::vector<SidechainSpentWithdrawal> GetSpentWithdrawalCache() const;
 
-    /** Return cached failed withdrawals^ as a vector for dumping to disk */
+    /** Return up to nCount spent withdrawals, skipping the first nStart.
+     * Archived spends come first. */
+    std::vector<SidechainSpentWithdrawal> GetSpentWithdrawalCache(uint32_t nStart, uint32_t nCount) const;
+
+    /** Return the failed withdrawals kept in memory as a vector for dumping
+     * to disk. Older ones are in the database. */
     std::vector<SidechainFailedWithdrawal> GetFailedWithdrawalCache() const;
 
+    /** Return up to nCount failed withdrawals, skipping the first nStart.
+     * Archived failed withdrawals come first. */
+    std::vector<SidechainFailedWithdrawal> GetFailedWithdrawalCache(uint32_t nStart, uint32_t nCount) const;
+
     /** Is there anything being tracked by the SCDB? */
     bool HasState() const;
 
-    /** Return true if the deposit transaction is cached */
+    /** Return true if the deposit transaction is known */
     bool HaveDepositCached(const uint256& txid) const;
 
     /** Return true if the withdrawal has been spent */
@@ -202,15 +464,61 @@ public:
     /** Clear out the custom vote cache */
     void ResetWithdrawalVotes();
 
-    /** Reset everything */
+    /** Reset everything (except for the deposit database) */
     void Reset();
 
+    /** Store deposits in pdb instead of keeping all of them in memory and
+     * load the most recent deposits from it. Older withdrawal spends and
+     * failed withdrawals are archived to it as well. Pass nullptr before the
+     * database is closed. */
+    bool SetDepositDB(CSidechainTreeDB* pdb);
+
+    /** Write the deposits changed since the last flush to the deposit
+     * database, recording hashBestBlock as the chainstate best block they
+     * match. Called right before the chainstate flush with hashChainstate,
+     * the best block of the chainstate already on disk, which the deposits
+     * are rolled back to if we stop before the flush is written. */
+    bool FlushDeposits(const uint256& hashBestBlock, const uint256& hashChainstate);
+
+    /** Append a record for each change to the caches to plog. Pass nullptr
+     * to stop logging changes. */
+    void SetLog(CSCDBLog* plogIn);
+
+    /** Return the memory used by SCDB in bytes, see GetMemoryUsage */
+    size_t DynamicMemoryUsage() const;
+
+    /** Return the memory used for the state of each sidechain slot in
+     * vUsage, and in nShared the memory used for everything that doesn't
+     * belong to one sidechain: the sidechain list and proposals, votes, the
+     * removed BMM and deposit lists and the index of the spends by block. */
+    void GetMemoryUsage(std::vector<SidechainMemoryUsage>& vUsage, size_t& nShared) const;
+
+    /**
+     * Set the most memory in bytes SCDB should use, 0 for no limit. When
+     * SCDB uses more, fewer recent deposits and less withdrawal history are
+     * kept in memory, down to SIDECHAIN_MIN_CACHE_SIZE, and the rest is read
+     * from the deposit database. Only enforced with a deposit database.
+     */
+    void SetMaxMemoryUsage(size_t nMaxUsage);
+
+    /** Return the limit set by SetMaxMemoryUsage */
+    size_t GetMaxMemoryUsage() const { return nMaxMemoryUsage; }
+
+    /** Return the number of recent deposits per sidechain, and of blocks of
+     * withdrawal spends and failed withdrawals, currently kept in memory
+     * when there is a deposit database */
+    unsigned int GetCacheSize() const { return nCacheSize; }
+
+    /** Apply a record of the cache log when loading the caches. Withdrawal
+     * spends and failures are skipped when reindexing. */
+    bool ApplyLogRecord(CDataStream& s, bool fReindex);
+
     /** Spend a withdrawal bundle (if we can) */
     bool SpendWithdrawal(uint8_t nSidechain, const uint256& hashBlock, const CTransaction& tx, const int nTx, bool fJustCheck = false,  bool fDebug = false);
 
     /** Get SidechainDeposit from deposit CTransaction. Part of SCDB because
      * we need the list of active sidechains to find deposit outputs. */
-    bool TxnToDeposit(const CTransaction& tx, const int nTx, const uint256& hashBlock, SidechainDeposit& deposit);
+    bool TxnToDeposit(const CTransactionRef& tx, const int nTx, const uint256& hashBlock, SidechainDeposit& deposit);
 
     /** Print SCDB withdrawal verification status */
     std::string ToString() const;
@@ -218,12 +526,21 @@ public:
     /** Check the updates in a block and then apply them */
     bool Update(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const std::vector<CTxOut>& vout, bool fJustCheck = false, bool fDebug = false);
 
+    /** Check the updates in the coinbase commitments of a block and then
+     * apply them */
+    bool Update(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const CoinbaseCommitments& commitments, bool fJustCheck = false, bool fDebug = false);
+
     /** Undo the changes to SCDB of a block - for block is disconnection */
     bool Undo(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const std::vector<CTransactionRef>& vtx, bool fDebug = false);
 
-    /** Update / add multiple withdrawals to SCDB */
+    /** Update / add multiple withdrawals to SCDB, with votes in the string
+     * form of the vote cache */
     bool UpdateSCDBIndex(const std::vector<std::string>& vVote, bool fDebug = false, const std::map<uint8_t /* nSidechain */, uint256 /* withdrawal hash */>& mapNewWithdrawal = {});
 
+    /** Update / add multiple withdrawals to SCDB. Upvote indexes refer to the
+     * withdrawals before the update. */
+    bool UpdateSCDBIndex(const SCDBVotes& votes, bool fDebug = false, const std::map<uint8_t /* nSidechain */, uint256 /* withdrawal hash */>& mapNewWithdrawal = {});
+
 private:
     /**
      * Apply default abstain vote for all sidechain withdrawals. Used when a new
@@ -231,20 +548,90 @@ private:
     void ApplyDefaultUpdate();
 
     /** Apply the changes in a block to SCDB */
-    bool ApplyUpdate(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const std::vector<CTxOut>& vout, bool fJustCheck = false, bool fDebug = false);
+    bool ApplyUpdate(int nHeight, const uint256& hashBlock, const uint256& hashPrevBlock, const CoinbaseCommitments& commitments, bool fJustCheck = false, bool fDebug = false);
 
     /** Takes a list of sidechain hashes to upvote */
     void UpdateActivationStatus(const std::vector<uint256>& vHash);
 
+    /** Set the activation status of sidechain proposals, replacing all of it */
+    void SetActivationStatus(const std::vector<SidechainActivationStatus>& vActivationStatusIn);
+
+    /** Rebuild mapActivationStatusIndex from vActivationStatus */
+    void UpdateActivationStatusIndex();
+
+    /** Rebuild setSidechainProposal and setSidechainHashAck after their
+     * vectors were replaced */
+    void UpdateProposalIndex();
+
+    /** Rebuild vActiveSidechain after vSidechain changed */
+    void UpdateActiveSidechains();
+
     /** Update CTIP to match the deposit cache - called after sorting / undo */
     bool UpdateCTIP();
 
-    /** Calls SortDeposits for all of SCDB's deposit cache */
-    bool SortSCDBDeposits();
+    /** Update the vote index of nSidechain, after its withdrawals or our
+     * vote changed */
+    void UpdateVoteIndex(uint8_t nSidechain);
+
+    /** Update the vote index of nSidechain and the SCDB update bytes */
+    void UpdateVoteCommitment(uint8_t nSidechain);
+
+    /** Update the vote index of every sidechain and the SCDB update bytes */
+    void UpdateVoteCommitment();
+
+    /** Build the SCDB update bytes from the vote indexes */
+    void BuildVoteCommitment();
+
+    /** Remove a withdrawal transaction from the in-memory cache */
+    void EraseCachedWithdrawalTx(const uint256& hash);
+
+    /** Move the oldest withdrawal spends and failed withdrawals from memory
+     * to the database once there are twice as many as nCacheSize, or as
+     * soon as there are more than nCacheSize if fTrim is set */
+    void ArchiveWithdrawalHistory(bool fTrim = false);
+
+    /** Drop the oldest deposits of nSidechain from memory once there are
+     * twice as many as nCacheSize, or as soon as there are more than
+     * nCacheSize if fTrim is set */
+    void TrimDepositCache(uint8_t nSidechain, bool fTrim = false);
+
+    /** Shrink nCacheSize while SCDB uses more than nMaxMemoryUsage, or let
+     * it grow back once there is plenty of room */
+    void LimitMemoryUsage();
+
+    /** Publish the state of nSidechain for GetSidechainView */
+    void PublishView(uint8_t nSidechain);
+
+    /** Publish the state of every sidechain and the list of active
+     * sidechains */
+    void PublishView();
+
+    /** Clear the caches written to the cache log, see SCDB_LOG_CLEAR */
+    void ClearCaches();
+
+    /** Remove the withdrawal spends of a disconnected block */
+    bool UndoSpentWithdrawals(const uint256& hashBlock);
+
+    /** Append a record to the cache log, if there is one */
+    template <typename T>
+    void WriteLog(SCDBLogRecord type, const T& obj) const;
+
+    /** Look up the nSidechain and index of a deposit by txid */
+    bool FindDeposit(const uint256& txid, uint8_t& nSidechain, uint32_t& nIndex) const;
+
+    /** Append deposits of nSidechain from the cache and deposit database */
+    bool ReadDeposits(uint8_t nSidechain, uint32_t nStart, uint32_t nCount, std::vector<SidechainDeposit>& vDeposit) const;
+
+    /** Replace the deposits of nSidechain from index nStart onward in the
+     * cache, to be written to the deposit database by FlushDeposits */
+    bool ReplaceDeposits(uint8_t nSidechain, uint32_t nStart, const std::vector<SidechainDeposit>& vDeposit);
 
     /** All sidechain slots, their activation status, and params if active */
     std::vector<Sidechain> vSidechain;
 
+    /** The active sidechains of vSidechain, kept for GetActiveSidechains */
+    std::vector<Sidechain> vActiveSidechain;
+
     /**
      * The CTIP of nSidechain up to the latest connected block (does not include
      * mempool txns). */
@@ -256,43 +643,119 @@ private:
     /** Activation status of proposed sidechains */
     std::vector<SidechainActivationStatus> vActivationStatus;
 
+    /** The nSidechain of the proposals in vActivationStatus by proposal hash */
+    std::map<uint256, uint8_t> mapActivationStatusIndex;
+
     /** Cache of withdrawal vote settings created by the user */
     std::vector<std::string> vVoteCache;
 
-    /** Cache of deposits for each sidechain. TODO optimize with caching
-     * so that we don't have to keep all of these in memory.
+    /** Our vote for each sidechain, vVoteCache resolved against the
+     * withdrawals SCDB is tracking */
+    SCDBVotes ourVotes;
+
+    /** SCDB update bytes script for the current state and vVoteCache */
+    std::vector<unsigned char> vchVoteCommitment;
+
+    /** Cache of the most recent deposits for each sidechain. Without a
+     * deposit database this holds every deposit.
      * x = nSidechain
      * y = list of deposits for nSidechain */
     std::vector<std::vector<SidechainDeposit>> vDepositCache;
 
+    /** Number of deposits for each sidechain, including those not cached */
+    std::vector<uint32_t> vDepositCount;
+
+    /** Memory used by the deposits of vDepositCache of each sidechain, kept
+     * up to date as deposits are added and dropped */
+    std::vector<size_t> vDepositCacheUsage;
+
+    /** MuHash of every deposit of every sidechain, with its nSidechain and
+     * index, updated by ReplaceDeposits and saved with the deposits */
+    MuHash3072 muhashDeposits;
+
+    /** Finalized muhashDeposits, computed by GetStateHash when
+     * fDepositHashDirty is set */
+    mutable uint256 hashDeposits;
+    mutable bool fDepositHashDirty;
+
+    /** Most memory SCDB should use, 0 for no limit */
+    size_t nMaxMemoryUsage;
+
+    /** Number of recent deposits per sidechain and blocks of withdrawal
+     * history kept in memory, smaller than the default while SCDB is over
+     * nMaxMemoryUsage */
+    unsigned int nCacheSize;
+
+    /** Database which stores all deposits and archived withdrawal spends
+     * and failed withdrawals (optional) */
+    CSidechainTreeDB* pdepositdb;
+
+    /** The first deposit of each sidechain replaced since the last
+     * FlushDeposits. The deposits from there on aren't on disk yet and are
+     * kept in vDepositCache until they are. */
+    std::map<uint8_t, uint32_t> mapDepositDirty;
+
+    /** Log of changes to the caches (optional) */
+    CSCDBLog* plog;
+
+    /** Whether changes are kept from the published views, see HoldView */
+    bool fViewHeld;
+
+    /** Whether a reorg is disconnecting blocks, see BeginReorg, and whether
+     * one of them had deposits */
+    bool fReorg;
+    bool fReorgCTIP;
+
     /** Cache of sidechain hashes, for sidechains which this node has been
      * configured to activate by the user */
     std::vector<uint256> vSidechainHashAck;
 
+    /** The hashes of vSidechainHashAck */
+    std::set<uint256> setSidechainHashAck;
+
     /** Cache of proposals for new sidechains created by this node,
      * which should be included in the next block that this node mines. */
     std::vector<Sidechain> vSidechainProposal;
 
-    /** Cache of potential withdrawal transactions
-     * TODO consider refactoring to use CTransactionRef */
-    std::vector<std::pair<uint8_t, CMutableTransaction>> vWithdrawalTxCache;
+    /** Sidechain::GetProposalHash of the proposals in vSidechainProposal */
+    std::set<uint256> setSidechainProposal;
+
+    /** Cache of potential withdrawal transactions */
+    std::vector<std::pair<uint8_t, CTransactionRef>> vWithdrawalTxCache;
+
+    /** The transactions of vWithdrawalTxCache by txid */
+    std::map<uint256, CTransactionRef> mapWithdrawalTxCache;
 
     /** Tracks verification status of withdrawals
      * x = nSidechain
      * y = state of withdrawals for nSidechain */
     std::vector<std::vector<SidechainWithdrawalState>> vWithdrawalStatus;
 
+    /** Recent work score changes of the withdrawals in vWithdrawalStatus.
+     * Key: withdrawal hash */
+    std::map<uint256, SidechainWithdrawalRate> mapWithdrawalRate;
+
     /** Map of spent withdrawals. Key: block hash Value: Spent withdrawals from block */
     std::map<uint256, std::vector<SidechainSpentWithdrawal>> mapSpentWithdrawal;
 
+    /** The blocks of mapSpentWithdrawal in the order they were added */
+    std::deque<uint256> queueSpentWithdrawalBlock;
+
+    /** Number of blocks in mapSpentWithdrawal that spend each withdrawal.
+     * Key: (nSidechain, withdrawal hash) */
+    std::map<std::pair<uint8_t, uint256>, unsigned int> mapSpentWithdrawalCount;
+
     /** Map of failed withdrawals. Key: withdrawal hash Value: spent withdrawal */
     std::map<uint256, SidechainFailedWithdrawal> mapFailedWithdrawal;
 
+    /** The withdrawals of mapFailedWithdrawal in the order they were added */
+    std::deque<uint256> queueFailedWithdrawal;
+
     /** List of BMM request txid that the miner removed from the mempool. */
     std::set<uint256> setRemovedBMM;
 
-    /** List of deposit txids that are cached by SCDB */
-    std::set<uint256> setDepositTXID;
+    /** The nSidechain and index of deposits cached by SCDB by txid */
+    std::unordered_map<uint256, std::pair<uint8_t, uint32_t>, SaltedDepositTxidHasher> mapDepositIndex;
 
     /** List of sidechain deposits that were removed from the mempool for one
      * of a few reasons. The deposit could have been replaced by another deposit
@@ -300,14 +763,45 @@ private:
      * may have been in the mempool when a withdrawal payout was created,
      * spending the same CTIP as the deposit. */
     std::vector<uint256> vRemovedDeposit;
+
+    /** State published for GetSidechainView, by nSidechain. Only accessed
+     * with std::atomic_load / std::atomic_store. */
+    std::array<std::shared_ptr<const SidechainView>, SIDECHAIN_ACTIVATION_MAX_ACTIVE> vView;
+
+    /** List published for GetActiveSidechainsView. Only accessed with
+     * std::atomic_load / std::atomic_store. */
+    std::shared_ptr<const std::vector<Sidechain>> pActiveView;
+
+    /** Sequence numbers of the changes published to each sidechain's view,
+     * kept while a sidechain is inactive so that they never go back */
+    std::array<SidechainViewSequence, SIDECHAIN_ACTIVATION_MAX_ACTIVE> vViewSequence;
 };
 
 /** Read encoded sum of withdrawal fees output script */
 bool DecodeWithdrawalFees(const CScript& script, CAmount& amount);
 
+/** Analyze a withdrawal bundle, or return the analysis cached by tx. Null if
+ * tx has no inputs or outputs. */
+std::shared_ptr<const WithdrawalBundleInfo> GetWithdrawalBundleInfo(const CTransaction& tx);
+
 /** Sort deposits by CTIP UTXO spending order */
 bool SortDeposits(const std::vector<SidechainDeposit>& vDeposit, std::vector<SidechainDeposit>& vDepositSorted);
 
+/** Read the votes of SCDB update bytes in the string form of the vote cache */
 bool ParseSCDBBytes(const CScript& script, const std::vector<std::vector<SidechainWithdrawalState>>& vOldScores, std::vector<std::string>& vVote);
 
+/** Read the votes of SCDB update bytes without allocating. The update bytes
+ * have a vote for each list of withdrawals in vScores that isn't empty, the
+ * sidechain of a list is taken from its first withdrawal. */
+bool DecodeSCDBBytes(const CScript& script, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, SCDBVotes& votes);
+
+/** Append the vote bytes of an SCDB update to vch, a vote for each list of
+ * withdrawals in vScores that isn't empty */
+void EncodeSCDBVotes(const SCDBVotes& votes, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, std::vector<unsigned char>& vch);
+
+/** Convert a vote in the string form of the vote cache (withdrawal hash in
+ * hex, SCDB_DOWNVOTE or SCDB_ABSTAIN). An upvote of a withdrawal that isn't
+ * in vWithdrawal gets an index past its end. */
+SCDBVote ParseSCDBVote(const std::string& strVote, const std::vector<SidechainWithdrawalState>& vWithdrawal);
+
 #endif // BITCOIN_SIDECHAINDB_H
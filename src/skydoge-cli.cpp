@@ -26,6 +26,7 @@
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
 static const bool DEFAULT_NAMED=false;
+static const int DEFAULT_BATCH_SIZE=100;
 static const int CONTINUE_EXECUTION=-1;
 
 std::string HelpMessageCli()
@@ -35,6 +36,8 @@ std::string HelpMessageCli()
     std::string strUsage;
     strUsage += HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("This help message"));
+    strUsage += HelpMessageOpt("-batch", _("Read commands from standard input, one per line with whitespace separated arguments, and send them in JSON-RPC batches over one connection. Prints one line per command, with the result or the error"));
+    strUsage += HelpMessageOpt("-batchsize=<n>", strprintf(_("Number of commands sent per batch with -batch (default: %d)"), DEFAULT_BATCH_SIZE));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)"), BITCOIN_CONF_FILENAME));
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-getinfo", _("Get general information from the remote server. Note that unlike server-side RPC calls, the results of -getinfo is the result of multiple non-atomic requests. Some entries in the result may represent results from different states (e.g. wallet balance may be as of a different block from the chain state reported)"));
@@ -130,11 +133,13 @@ static int AppInitRPC(int argc, char* argv[])
 /** Reply structure for request_done to fill in */
 struct HTTPReply
 {
-    HTTPReply(): status(0), error(-1) {}
+    HTTPReply(): status(0), error(-1), done(false) {}
 
     int status;
     int error;
     std::string body;
+    //! Set once the request has finished or failed
+    bool done;
 };
 
 const char *http_errorstring(int code)
@@ -162,6 +167,7 @@ const char *http_errorstring(int code)
 static void http_request_done(struct evhttp_request *req, void *ctx)
 {
     HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+    reply->done = true;
 
     if (req == nullptr) {
         /* If req is nullptr, it means an error occurred while connecting: the
@@ -265,18 +271,21 @@ public:
     }
 };
 
+/** Convert the command line arguments of a call to its JSON-RPC params */
+static UniValue ConvertParams(const std::string& method, const std::vector<std::string>& args)
+{
+    if (gArgs.GetBoolArg("-named", DEFAULT_NAMED)) {
+        return RPCConvertNamedValues(method, args);
+    }
+    return RPCConvertValues(method, args);
+}
+
 /** Process default single requests */
 class DefaultRequestHandler: public BaseRequestHandler {
 public:
     UniValue PrepareRequest(const std::string& method, const std::vector<std::string>& args) override
     {
-        UniValue params;
-        if(gArgs.GetBoolArg("-named", DEFAULT_NAMED)) {
-            params = RPCConvertNamedValues(method, args);
-        } else {
-            params = RPCConvertValues(method, args);
-        }
-        return JSONRPCRequestObj(method, params, 1);
+        return JSONRPCRequestObj(method, ConvertParams(method, args), 1);
     }
 
     UniValue ProcessReply(const UniValue &reply) override
@@ -285,97 +294,251 @@ public:
     }
 };
 
-static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+/** HTTP connection to the RPC server, which requests can be sent over one
+ * after another */
+class RPCConnection
 {
-    std::string host;
-    // In preference order, we choose the following for the port:
-    //     1. -rpcport
-    //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
-    //     3. default port for chain
-    int port = BaseParams().RPCPort();
-    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
-    port = gArgs.GetArg("-rpcport", port);
-
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
-
-    // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
-
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == nullptr)
-        throw std::runtime_error("create http request failed");
+public:
+    /** Set up the connection, fKeepAlive to keep it open between requests */
+    explicit RPCConnection(bool fKeepAlive) : fKeepAlive(fKeepAlive)
+    {
+        // In preference order, we choose the following for the port:
+        //     1. -rpcport
+        //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
+        //     3. default port for chain
+        int port = BaseParams().RPCPort();
+        SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
+        port = gArgs.GetArg("-rpcport", port);
+
+        // Obtain event base
+        base = obtain_event_base();
+
+        // Synchronously look up hostname
+        evcon = obtain_evhttp_connection_base(base.get(), host, port);
+        evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+
+        // Get credentials
+        std::string strRPCUserColonPass;
+        if (gArgs.GetArg("-rpcpassword", "") == "") {
+            // Try fall back to cookie-based authentication if no password is provided
+            if (!GetAuthCookie(&strRPCUserColonPass)) {
+                throw std::runtime_error(strprintf(
+                    _("Could not locate RPC credentials. No authentication cookie could be found, and RPC password is not set.  See -rpcpassword and -stdinrpcpass.  Configuration file: (%s)"),
+                        GetConfigFile(gArgs.GetArg("-conf", BITCOIN_CONF_FILENAME)).string().c_str()));
+
+            }
+        } else {
+            strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+        }
+        strAuthorization = std::string("Basic ") + EncodeBase64(strRPCUserColonPass);
+
+        // check if we should use a special wallet endpoint
+        endpoint = "/";
+        std::string walletName = gArgs.GetArg("-rpcwallet", "");
+        if (!walletName.empty()) {
+            char *encodedURI = evhttp_uriencode(walletName.c_str(), walletName.size(), false);
+            if (encodedURI) {
+                endpoint = "/wallet/"+ std::string(encodedURI);
+                free(encodedURI);
+            }
+            else {
+                throw CConnectionFailed("uri-encode failed");
+            }
+        }
+    }
+
+    /** Send a JSON-RPC request or batch and return the parsed reply */
+    UniValue Send(const UniValue& request)
+    {
+        HTTPReply response;
+        raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
+        if (req == nullptr)
+            throw std::runtime_error("create http request failed");
 #if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
+        evhttp_request_set_error_cb(req.get(), http_error_cb);
 #endif
 
-    // Get credentials
-    std::string strRPCUserColonPass;
-    if (gArgs.GetArg("-rpcpassword", "") == "") {
-        // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
-            throw std::runtime_error(strprintf(
-                _("Could not locate RPC credentials. No authentication cookie could be found, and RPC password is not set.  See -rpcpassword and -stdinrpcpass.  Configuration file: (%s)"),
-                    GetConfigFile(gArgs.GetArg("-conf", BITCOIN_CONF_FILENAME)).string().c_str()));
+        struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+        assert(output_headers);
+        evhttp_add_header(output_headers, "Host", host.c_str());
+        evhttp_add_header(output_headers, "Connection", fKeepAlive ? "keep-alive" : "close");
+        evhttp_add_header(output_headers, "Authorization", strAuthorization.c_str());
+
+        // Attach request data
+        std::string strRequest = request.write() + "\n";
+        struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+        assert(output_buffer);
+        evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+        int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
+        req.release(); // ownership moved to evcon in above call
+        if (r != 0) {
+            throw CConnectionFailed("send http request failed");
+        }
 
+        // A kept alive connection keeps the event loop busy after the reply,
+        // so run it only until the request is done
+        while (!response.done) {
+            if (event_base_loop(base.get(), EVLOOP_ONCE) != 0)
+                break;
         }
-    } else {
-        strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+
+        if (response.status == 0)
+            throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
+        else if (response.status == HTTP_UNAUTHORIZED)
+            throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
+        else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
+            throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
+        else if (response.body.empty())
+            throw std::runtime_error("no response from server");
+
+        // Parse reply
+        UniValue valReply(UniValue::VSTR);
+        if (!valReply.read(response.body))
+            throw std::runtime_error("couldn't parse reply from server");
+        return valReply;
     }
 
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
-    // check if we should use a special wallet endpoint
-    std::string endpoint = "/";
-    std::string walletName = gArgs.GetArg("-rpcwallet", "");
-    if (!walletName.empty()) {
-        char *encodedURI = evhttp_uriencode(walletName.c_str(), walletName.size(), false);
-        if (encodedURI) {
-            endpoint = "/wallet/"+ std::string(encodedURI);
-            free(encodedURI);
+private:
+    const bool fKeepAlive;
+    std::string host;
+    std::string strAuthorization;
+    std::string endpoint;
+    raii_event_base base;
+    raii_evhttp_connection evcon;
+};
+
+static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+{
+    RPCConnection conn(false);
+    const UniValue reply = rh->ProcessReply(conn.Send(rh->PrepareRequest(strMethod, args)));
+    if (reply.empty())
+        throw std::runtime_error("expected reply to have result, error and id properties");
+
+    return reply;
+}
+
+/** Split a -batch line into the method and its arguments. Arguments are
+ * separated by whitespace, except inside quotes or JSON brackets. Quotes
+ * around a whole argument are dropped, like a shell would. */
+static std::vector<std::string> SplitBatchLine(const std::string& line)
+{
+    std::vector<std::string> args;
+    std::string arg;
+    bool fArg = false;
+    bool fQuoted = false;
+    int nDepth = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        const char c = line[i];
+        if (fQuoted) {
+            if (c == '\\' && i + 1 < line.size()) {
+                if (nDepth > 0)
+                    arg += c;
+                arg += line[++i];
+                continue;
+            }
+            if (c == '"') {
+                fQuoted = false;
+                if (nDepth == 0)
+                    continue;
+            }
+            arg += c;
+            continue;
         }
-        else {
-            throw CConnectionFailed("uri-encode failed");
+        if (nDepth == 0 && (c == ' ' || c == '\t' || c == '\r')) {
+            if (fArg)
+                args.push_back(arg);
+            arg.clear();
+            fArg = false;
+            continue;
         }
+        fArg = true;
+        if (c == '"') {
+            fQuoted = true;
+            if (nDepth == 0)
+                continue;
+        } else if (c == '[' || c == '{') {
+            nDepth++;
+        } else if ((c == ']' || c == '}') && nDepth > 0) {
+            nDepth--;
+        }
+        arg += c;
     }
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
-    req.release(); // ownership moved to evcon in above call
-    if (r != 0) {
-        throw CConnectionFailed("send http request failed");
+    if (fQuoted || nDepth > 0)
+        throw std::runtime_error("unterminated argument in: " + line);
+    if (fArg)
+        args.push_back(arg);
+    return args;
+}
+
+/** Send the commands of vLines as one JSON-RPC batch and print a line for
+ * each, in order. Returns the exit code of the last command that failed, or
+ * 0. */
+static int SendBatch(RPCConnection& conn, const std::vector<std::string>& vLines)
+{
+    UniValue request(UniValue::VARR);
+    for (size_t i = 0; i < vLines.size(); i++) {
+        std::vector<std::string> args = SplitBatchLine(vLines[i]);
+        const std::string method = args[0];
+        args.erase(args.begin());
+        request.push_back(JSONRPCRequestObj(method, ConvertParams(method, args), (int)i));
     }
 
-    event_base_dispatch(base.get());
-
-    if (response.status == 0)
-        throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
-    else if (response.status == HTTP_UNAUTHORIZED)
-        throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
-    else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
-        throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
-    else if (response.body.empty())
-        throw std::runtime_error("no response from server");
-
-    // Parse reply
-    UniValue valReply(UniValue::VSTR);
-    if (!valReply.read(response.body))
-        throw std::runtime_error("couldn't parse reply from server");
-    const UniValue reply = rh->ProcessReply(valReply);
-    if (reply.empty())
-        throw std::runtime_error("expected reply to have result, error and id properties");
+    const UniValue reply = conn.Send(request);
+    if (reply.isObject() && !find_value(reply, "error").isNull())
+        throw std::runtime_error("batch failed: " + find_value(reply, "error").write());
+    std::vector<UniValue> batch = JSONRPCProcessBatchReply(reply, vLines.size());
 
-    return reply;
+    int nRet = 0;
+    for (const UniValue& rec : batch) {
+        const UniValue& result = find_value(rec, "result");
+        const UniValue& error = find_value(rec, "error");
+        std::string strPrint;
+        if (!rec.isObject()) {
+            strPrint = "error: no reply from server";
+            nRet = EXIT_FAILURE;
+        } else if (!error.isNull()) {
+            strPrint = "error: " + error.write();
+            const UniValue& errCode = find_value(error, "code");
+            nRet = errCode.isNum() ? abs(errCode.get_int()) : EXIT_FAILURE;
+        } else if (result.isStr()) {
+            strPrint = result.get_str();
+        } else if (!result.isNull()) {
+            strPrint = result.write();
+        }
+        fprintf(stdout, "%s\n", strPrint.c_str());
+    }
+    fflush(stdout);
+    return nRet;
+}
+
+/** Run the commands on standard input, -batchsize at a time */
+static int BatchRPC()
+{
+    const size_t nBatchSize = std::max((int64_t)1, gArgs.GetArg("-batchsize", DEFAULT_BATCH_SIZE));
+    RPCConnection conn(true);
+    int nRet = 0;
+    std::vector<std::string> vLines;
+    std::string line;
+    while (true) {
+        const bool fLine = (bool)std::getline(std::cin, line);
+        if (fLine) {
+            // Skip blank lines and comments
+            const size_t nStart = line.find_first_not_of(" \t\r");
+            if (nStart == std::string::npos || line[nStart] == '#')
+                continue;
+            vLines.push_back(line);
+        }
+        if (!vLines.empty() && (!fLine || vLines.size() >= nBatchSize)) {
+            int nBatchRet = SendBatch(conn, vLines);
+            if (nBatchRet != 0)
+                nRet = nBatchRet;
+            vLines.clear();
+        }
+        if (!fLine)
+            break;
+    }
+    return nRet;
 }
 
 int CommandLineRPC(int argc, char *argv[])
@@ -403,6 +566,12 @@ int CommandLineRPC(int argc, char *argv[])
                 args.push_back(line);
             }
         }
+        if (gArgs.GetBoolArg("-batch", false)) {
+            if (args.size() > 0 || gArgs.GetBoolArg("-stdin", false) || gArgs.GetBoolArg("-getinfo", false)) {
+                throw std::runtime_error("-batch reads all commands from standard input");
+            }
+            return BatchRPC();
+        }
         std::unique_ptr<BaseRequestHandler> rh;
         std::string method;
         if (gArgs.GetBoolArg("-getinfo", false)) {
@@ -24,11 +24,21 @@
 
 #include <stdio.h>
 
+#include <mutex>
+#include <thread>
+
 #include <boost/algorithm/string.hpp>
 
 static bool fCreateBlank;
 static std::map<std::string,UniValue> registers;
 static const int CONTINUE_EXECUTION=-1;
+static const int DEFAULT_STREAM_THREADS=1;
+
+//! Keys of the privatekeys register with their public keys, so that signing
+//! many transactions doesn't derive the public keys again for each of them
+static std::vector<std::pair<CKey, CPubKey>> vPrivateKeys;
+static bool fPrivateKeysParsed = false;
+static std::mutex csPrivateKeys;
 
 //
 // This function returns either one of EXIT_ codes when it's expected to stop the process or
@@ -51,13 +61,14 @@ static int AppInitRawTx(int argc, char* argv[])
 
     fCreateBlank = gArgs.GetBoolArg("-create", false);
 
-    if (argc<2 || gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help"))
+    if ((argc<2 && !gArgs.GetBoolArg("-stream", false)) || gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help"))
     {
         // First part of help message is specific to this utility
         std::string strUsage = strprintf(_("%s skydoge-tx utility version"), _(PACKAGE_NAME)) + " " + FormatFullVersion() + "\n\n" +
             _("Usage:") + "\n" +
               "  skydoge-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded Skydoge transaction") + "\n" +
               "  skydoge-tx [options] -create [commands]   " + _("Create hex-encoded Skydoge transaction") + "\n" +
+              "  skydoge-tx [options] -stream              " + _("Update or create Skydoge transactions read from standard input") + "\n" +
               "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
@@ -66,6 +77,8 @@ static int AppInitRawTx(int argc, char* argv[])
         strUsage += HelpMessageOpt("-?", _("This help message"));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
+        strUsage += HelpMessageOpt("-stream", _("Read transactions from standard input, one per line as <hex-tx> [commands], or just [commands] with -create, and print one result line each. Lines of only register commands set the registers for the lines after them"));
+        strUsage += HelpMessageOpt("-streamthreads=<n>", strprintf(_("Number of threads processing -stream lines in parallel, 0 for one per core (default: %d)"), DEFAULT_STREAM_THREADS));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
         AppendParamsHelpMessages(strUsage);
 
@@ -119,6 +132,11 @@ static void RegisterSetJson(const std::string& key, const std::string& rawJson)
     }
 
     registers[key] = val;
+    if (key == "privatekeys") {
+        std::lock_guard<std::mutex> lock(csPrivateKeys);
+        vPrivateKeys.clear();
+        fPrivateKeysParsed = false;
+    }
 }
 
 static void RegisterSet(const std::string& strInput)
@@ -558,24 +576,34 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     if (!registers.count("privatekeys"))
         throw std::runtime_error("privatekeys register variable must be set.");
     CBasicKeyStore tempKeystore;
-    UniValue keysObj = registers["privatekeys"];
-
-    for (unsigned int kidx = 0; kidx < keysObj.size(); kidx++) {
-        if (!keysObj[kidx].isStr())
-            throw std::runtime_error("privatekey not a std::string");
-        CBitcoinSecret vchSecret;
-        bool fGood = vchSecret.SetString(keysObj[kidx].getValStr());
-        if (!fGood)
-            throw std::runtime_error("privatekey not valid");
-
-        CKey key = vchSecret.GetKey();
-        tempKeystore.AddKey(key);
+    {
+        std::lock_guard<std::mutex> lock(csPrivateKeys);
+        if (!fPrivateKeysParsed) {
+            const UniValue& keysObj = registers.at("privatekeys");
+
+            std::vector<std::pair<CKey, CPubKey>> vKeys;
+            for (unsigned int kidx = 0; kidx < keysObj.size(); kidx++) {
+                if (!keysObj[kidx].isStr())
+                    throw std::runtime_error("privatekey not a std::string");
+                CBitcoinSecret vchSecret;
+                bool fGood = vchSecret.SetString(keysObj[kidx].getValStr());
+                if (!fGood)
+                    throw std::runtime_error("privatekey not valid");
+
+                CKey key = vchSecret.GetKey();
+                vKeys.emplace_back(key, key.GetPubKey());
+            }
+            vPrivateKeys = std::move(vKeys);
+            fPrivateKeysParsed = true;
+        }
+        for (const auto& key : vPrivateKeys)
+            tempKeystore.AddKeyPubKey(key.first, key.second);
     }
 
     // Add previous txouts given in the RPC call:
     if (!registers.count("prevtxs"))
         throw std::runtime_error("prevtxs register variable must be set.");
-    UniValue prevtxsObj = registers["prevtxs"];
+    const UniValue& prevtxsObj = registers.at("prevtxs");
     {
         for (unsigned int previdx = 0; previdx < prevtxsObj.size(); previdx++) {
             UniValue prevOut = prevtxsObj[previdx];
@@ -680,6 +708,15 @@ public:
     }
 };
 
+//! Context for the whole of -stream, instead of one per command
+static std::unique_ptr<Secp256k1Init> streamEcc;
+
+static void StartECC(std::unique_ptr<Secp256k1Init>& ecc)
+{
+    if (!streamEcc)
+        ecc.reset(new Secp256k1Init());
+}
+
 static void MutateTx(CMutableTransaction& tx, const std::string& command,
                      const std::string& commandVal)
 {
@@ -703,10 +740,10 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
     else if (command == "outaddr")
         MutateTxAddOutAddr(tx, commandVal);
     else if (command == "outpubkey") {
-        ecc.reset(new Secp256k1Init());
+        StartECC(ecc);
         MutateTxAddOutPubKey(tx, commandVal);
     } else if (command == "outmultisig") {
-        ecc.reset(new Secp256k1Init());
+        StartECC(ecc);
         MutateTxAddOutMultiSig(tx, commandVal);
     } else if (command == "outscript")
         MutateTxAddOutScript(tx, commandVal);
@@ -714,7 +751,7 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
         MutateTxAddOutData(tx, commandVal);
 
     else if (command == "sign") {
-        ecc.reset(new Secp256k1Init());
+        StartECC(ecc);
         MutateTxSign(tx, commandVal);
     }
 
@@ -728,37 +765,164 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
         throw std::runtime_error("unknown command");
 }
 
-static void OutputTxJSON(const CTransaction& tx)
+static std::string FormatTxJSON(const CTransaction& tx, bool fIndent)
 {
     UniValue entry(UniValue::VOBJ);
     TxToUniv(tx, uint256(), entry);
 
-    std::string jsonOutput = entry.write(4);
-    fprintf(stdout, "%s\n", jsonOutput.c_str());
+    return entry.write(fIndent ? 4 : 0);
 }
 
-static void OutputTxHash(const CTransaction& tx)
+static std::string FormatTxHash(const CTransaction& tx)
 {
-    std::string strHexHash = tx.GetHash().GetHex(); // the hex-encoded transaction hash (aka the transaction id)
-
-    fprintf(stdout, "%s\n", strHexHash.c_str());
+    return tx.GetHash().GetHex(); // the hex-encoded transaction hash (aka the transaction id)
 }
 
-static void OutputTxHex(const CTransaction& tx)
+static std::string FormatTxHex(const CTransaction& tx)
 {
-    std::string strHex = EncodeHexTx(tx);
-
-    fprintf(stdout, "%s\n", strHex.c_str());
+    return EncodeHexTx(tx);
 }
 
-static void OutputTx(const CTransaction& tx)
+/** Format the resulting transaction as selected by -json and -txid, fIndent
+ * to spread JSON over several lines */
+static std::string FormatTx(const CTransaction& tx, bool fIndent)
 {
     if (gArgs.GetBoolArg("-json", false))
-        OutputTxJSON(tx);
+        return FormatTxJSON(tx, fIndent);
     else if (gArgs.GetBoolArg("-txid", false))
-        OutputTxHash(tx);
+        return FormatTxHash(tx);
     else
-        OutputTxHex(tx);
+        return FormatTxHex(tx);
+}
+
+static void OutputTx(const CTransaction& tx)
+{
+    fprintf(stdout, "%s\n", FormatTx(tx, true).c_str());
+}
+
+/** Split a command argument into its key and its value after the '=' */
+static void SplitCommand(const std::string& arg, std::string& key, std::string& value)
+{
+    size_t eqpos = arg.find('=');
+    if (eqpos == std::string::npos) {
+        key = arg;
+        value.clear();
+    } else {
+        key = arg.substr(0, eqpos);
+        value = arg.substr(eqpos + 1);
+    }
+}
+
+static bool IsRegisterCommand(const std::string& arg)
+{
+    return arg.compare(0, 4, "set=") == 0 || arg.compare(0, 5, "load=") == 0;
+}
+
+/** Build the transaction of one -stream line and format the result, or the
+ * error, into strOut. Returns false on error. */
+static bool RunStreamLine(const std::vector<std::string>& vArgs, std::string& strOut)
+{
+    try {
+        CMutableTransaction tx;
+        size_t nStart = 0;
+        if (!fCreateBlank) {
+            if (!DecodeHexTx(tx, vArgs[0], true, true, true))
+                throw std::runtime_error("invalid transaction encoding");
+            nStart = 1;
+        }
+        for (size_t i = nStart; i < vArgs.size(); i++) {
+            std::string key, value;
+            SplitCommand(vArgs[i], key, value);
+            MutateTx(tx, key, value);
+        }
+        strOut = FormatTx(tx, false);
+        return true;
+    } catch (const std::exception& e) {
+        strOut = std::string("error: ") + e.what();
+        return false;
+    }
+}
+
+/** Run -stream lines that don't touch the registers on nThreads threads and
+ * print their results in order. Returns whether all of them succeeded. */
+static bool RunStreamLines(const std::vector<std::vector<std::string>>& vLines, size_t nThreads)
+{
+    std::vector<std::string> vOut(vLines.size());
+    std::vector<char> vOk(vLines.size(), false);
+    auto worker = [&vLines, &vOut, &vOk, nThreads](size_t nThread) {
+        for (size_t i = nThread; i < vLines.size(); i += nThreads)
+            vOk[i] = RunStreamLine(vLines[i], vOut[i]);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    bool fOk = true;
+    for (size_t i = 0; i < vLines.size(); i++) {
+        fprintf(stdout, "%s\n", vOut[i].c_str());
+        fOk = fOk && vOk[i];
+    }
+    fflush(stdout);
+    return fOk;
+}
+
+/** Process the transactions on standard input for -stream */
+static int StreamRawTx()
+{
+    int nThreads = gArgs.GetArg("-streamthreads", DEFAULT_STREAM_THREADS);
+    if (nThreads <= 0)
+        nThreads = std::max(GetNumCores(), 1);
+    // Lines handed to the threads at once
+    const size_t nChunk = nThreads * 64;
+
+    streamEcc.reset(new Secp256k1Init());
+    bool fOk = true;
+    std::vector<std::vector<std::string>> vPending;
+    std::string line;
+    while (true) {
+        const bool fLine = (bool)std::getline(std::cin, line);
+        std::vector<std::string> vArgs;
+        if (fLine) {
+            boost::algorithm::trim(line);
+            if (line.empty() || line[0] == '#')
+                continue;
+            boost::split(vArgs, line, boost::is_any_of(" \t"), boost::token_compress_on);
+        }
+        // Registers may only change while no other line is being processed
+        const bool fRegisters = std::any_of(vArgs.begin(), vArgs.end(), IsRegisterCommand);
+        if (fLine && !fRegisters)
+            vPending.push_back(vArgs);
+        if (!vPending.empty() && (!fLine || fRegisters || vPending.size() >= nChunk)) {
+            fOk = RunStreamLines(vPending, std::min((size_t)nThreads, vPending.size())) && fOk;
+            vPending.clear();
+        }
+        if (!fLine)
+            break;
+        if (!fRegisters)
+            continue;
+
+        if (std::all_of(vArgs.begin(), vArgs.end(), IsRegisterCommand)) {
+            // Only sets registers, nothing to print
+            for (const std::string& arg : vArgs) {
+                std::string key, value;
+                SplitCommand(arg, key, value);
+                try {
+                    CMutableTransaction txDummy;
+                    MutateTx(txDummy, key, value);
+                } catch (const std::exception& e) {
+                    fprintf(stdout, "error: %s\n", e.what());
+                    fOk = false;
+                }
+            }
+        } else {
+            fOk = RunStreamLines({vArgs}, 1) && fOk;
+        }
+    }
+    streamEcc.reset();
+    return fOk ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static std::string readStdin()
@@ -793,6 +957,12 @@ static int CommandLineRawTx(int argc, char* argv[])
             argv++;
         }
 
+        if (gArgs.GetBoolArg("-stream", false)) {
+            if (argc > 1)
+                throw std::runtime_error("-stream reads the transactions and commands from standard input");
+            return StreamRawTx();
+        }
+
         CMutableTransaction tx;
         int startArg;
 
@@ -814,16 +984,8 @@ static int CommandLineRawTx(int argc, char* argv[])
             startArg = 1;
 
         for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
             std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos)
-                key = arg;
-            else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
-            }
-
+            SplitCommand(argv[i], key, value);
             MutateTx(tx, key, value);
         }
 
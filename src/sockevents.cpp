@@ -0,0 +1,295 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <sockevents.h>
+
+#include <netbase.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_EVENT_H
+#include <sys/event.h>
+#endif
+
+//! Most events returned by one wait, the rest are returned by the next one
+static const int MAX_SOCKET_EVENTS = 1024;
+
+bool CSocketEvents::Set(SOCKET hSocket, int nEvents)
+{
+    auto it = mapEvents.find(hSocket);
+    if (it != mapEvents.end() && it->second == nEvents)
+        return true;
+
+    const bool fNew = it == mapEvents.end();
+    if (!Update(hSocket, nEvents, fNew ? 0 : it->second, fNew))
+        return false;
+
+    mapEvents[hSocket] = nEvents;
+    return true;
+}
+
+void CSocketEvents::Remove(SOCKET hSocket)
+{
+    auto it = mapEvents.find(hSocket);
+    if (it == mapEvents.end())
+        return;
+
+    Delete(hSocket, it->second);
+    mapEvents.erase(it);
+}
+
+/** Rebuilds fd_sets from the registered sockets for each wait */
+class CSelectEvents : public CSocketEvents
+{
+public:
+    const char* GetName() const override { return "select"; }
+
+    bool CanWait(SOCKET hSocket) const override
+    {
+#ifndef WIN32
+        // fd_set can't hold it
+        return hSocket < FD_SETSIZE;
+#else
+        return true;
+#endif
+    }
+
+    bool Wait(int nTimeoutMs, std::vector<std::pair<SOCKET, int>>& vReady) override
+    {
+        vReady.clear();
+
+        // Some platforms don't sleep in a select() without sockets
+        if (mapEvents.empty()) {
+            MilliSleep(nTimeoutMs);
+            return true;
+        }
+
+        struct timeval timeout = MillisToTimeval(nTimeoutMs);
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        for (const auto& item : mapEvents) {
+            FD_SET(item.first, &fdsetError);
+            if (item.second & SOCKET_EVENT_RECV)
+                FD_SET(item.first, &fdsetRecv);
+            if (item.second & SOCKET_EVENT_SEND)
+                FD_SET(item.first, &fdsetSend);
+            hSocketMax = std::max(hSocketMax, item.first);
+        }
+
+        if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout) == SOCKET_ERROR)
+            return false;
+
+        for (const auto& item : mapEvents) {
+            int nEvents = 0;
+            if (FD_ISSET(item.first, &fdsetRecv))
+                nEvents |= SOCKET_EVENT_RECV;
+            if (FD_ISSET(item.first, &fdsetSend))
+                nEvents |= SOCKET_EVENT_SEND;
+            if (FD_ISSET(item.first, &fdsetError))
+                nEvents |= SOCKET_EVENT_ERR;
+            if (nEvents)
+                vReady.emplace_back(item.first, nEvents);
+        }
+        return true;
+    }
+
+protected:
+    bool Update(SOCKET hSocket, int nEvents, int nEventsPrev, bool fNew) override
+    {
+        return CanWait(hSocket);
+    }
+
+    void Delete(SOCKET hSocket, int nEventsPrev) override {}
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+/** Level triggered epoll */
+class CEpollEvents : public CSocketEvents
+{
+public:
+    explicit CEpollEvents(int fdIn) : fd(fdIn), vEvents(MAX_SOCKET_EVENTS) {}
+    ~CEpollEvents() { close(fd); }
+
+    const char* GetName() const override { return "epoll"; }
+
+    bool Wait(int nTimeoutMs, std::vector<std::pair<SOCKET, int>>& vReady) override
+    {
+        vReady.clear();
+
+        int nReady = epoll_wait(fd, vEvents.data(), vEvents.size(), nTimeoutMs);
+        if (nReady < 0)
+            return errno == EINTR;
+
+        for (int i = 0; i < nReady; i++) {
+            const struct epoll_event& ev = vEvents[i];
+            int nEvents = 0;
+            if (ev.events & EPOLLIN)
+                nEvents |= SOCKET_EVENT_RECV;
+            if (ev.events & EPOLLOUT)
+                nEvents |= SOCKET_EVENT_SEND;
+            if (ev.events & (EPOLLERR | EPOLLHUP))
+                nEvents |= SOCKET_EVENT_ERR;
+            vReady.emplace_back(ev.data.fd, nEvents);
+        }
+        return true;
+    }
+
+protected:
+    bool Update(SOCKET hSocket, int nEvents, int nEventsPrev, bool fNew) override
+    {
+        struct epoll_event ev;
+        ev.events = 0;
+        if (nEvents & SOCKET_EVENT_RECV)
+            ev.events |= EPOLLIN;
+        if (nEvents & SOCKET_EVENT_SEND)
+            ev.events |= EPOLLOUT;
+        ev.data.fd = hSocket;
+
+        if (epoll_ctl(fd, fNew ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, hSocket, &ev) == 0)
+            return true;
+
+        // The kernel and our registrations can only disagree if the
+        // descriptor was closed and reused in between
+        if (errno == EEXIST || errno == ENOENT)
+            return epoll_ctl(fd, fNew ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, hSocket, &ev) == 0;
+        return false;
+    }
+
+    void Delete(SOCKET hSocket, int nEventsPrev) override
+    {
+        // Fails harmlessly if the socket was closed already
+        epoll_ctl(fd, EPOLL_CTL_DEL, hSocket, nullptr);
+    }
+
+private:
+    const int fd;
+    std::vector<struct epoll_event> vEvents;
+};
+#endif
+
+#ifdef HAVE_SYS_EVENT_H
+/** kqueue, with a read and a write filter for each socket */
+class CKqueueEvents : public CSocketEvents
+{
+public:
+    explicit CKqueueEvents(int fdIn) : fd(fdIn), vEvents(MAX_SOCKET_EVENTS) {}
+    ~CKqueueEvents() { close(fd); }
+
+    const char* GetName() const override { return "kqueue"; }
+
+    bool Wait(int nTimeoutMs, std::vector<std::pair<SOCKET, int>>& vReady) override
+    {
+        vReady.clear();
+
+        struct timespec timeout;
+        timeout.tv_sec = nTimeoutMs / 1000;
+        timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000;
+        int nReady = kevent(fd, nullptr, 0, vEvents.data(), vEvents.size(), &timeout);
+        if (nReady < 0)
+            return errno == EINTR;
+
+        // A socket that is ready both ways comes back twice
+        for (int i = 0; i < nReady; i++) {
+            const struct kevent& ev = vEvents[i];
+            int nEvents = 0;
+            if (ev.flags & EV_ERROR)
+                nEvents |= SOCKET_EVENT_ERR;
+            else if (ev.filter == EVFILT_READ)
+                nEvents |= SOCKET_EVENT_RECV;
+            else if (ev.filter == EVFILT_WRITE)
+                nEvents |= SOCKET_EVENT_SEND;
+            vReady.emplace_back(ev.ident, nEvents);
+        }
+        return true;
+    }
+
+protected:
+    bool Update(SOCKET hSocket, int nEvents, int nEventsPrev, bool fNew) override
+    {
+        return Change(hSocket, EVFILT_READ, nEvents & SOCKET_EVENT_RECV, nEventsPrev & SOCKET_EVENT_RECV) &&
+               Change(hSocket, EVFILT_WRITE, nEvents & SOCKET_EVENT_SEND, nEventsPrev & SOCKET_EVENT_SEND);
+    }
+
+    void Delete(SOCKET hSocket, int nEventsPrev) override
+    {
+        // Fails harmlessly if the socket was closed already
+        Change(hSocket, EVFILT_READ, false, nEventsPrev & SOCKET_EVENT_RECV);
+        Change(hSocket, EVFILT_WRITE, false, nEventsPrev & SOCKET_EVENT_SEND);
+    }
+
+private:
+    bool Change(SOCKET hSocket, int16_t filter, bool fWant, bool fHad)
+    {
+        if (fWant == fHad)
+            return true;
+
+        struct kevent ev;
+        EV_SET(&ev, hSocket, filter, fWant ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        return kevent(fd, &ev, 1, nullptr, 0, nullptr) == 0 || !fWant;
+    }
+
+    const int fd;
+    std::vector<struct kevent> vEvents;
+};
+#endif
+
+std::string DefaultSocketEvents()
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    return "epoll";
+#elif defined(HAVE_SYS_EVENT_H)
+    return "kqueue";
+#else
+    return "select";
+#endif
+}
+
+std::string ListSocketEvents()
+{
+    std::string str;
+#ifdef HAVE_SYS_EPOLL_H
+    str += "epoll, ";
+#endif
+#ifdef HAVE_SYS_EVENT_H
+    str += "kqueue, ";
+#endif
+    return str + "select";
+}
+
+std::unique_ptr<CSocketEvents> MakeSocketEvents(const std::string& strName)
+{
+    if (strName == "select")
+        return std::unique_ptr<CSocketEvents>(new CSelectEvents());
+#ifdef HAVE_SYS_EPOLL_H
+    if (strName == "epoll") {
+        int fd = epoll_create1(EPOLL_CLOEXEC);
+        if (fd < 0) {
+            LogPrintf("%s: epoll_create1 failed: %s\n", __func__, NetworkErrorString(errno));
+            return nullptr;
+        }
+        return std::unique_ptr<CSocketEvents>(new CEpollEvents(fd));
+    }
+#endif
+#ifdef HAVE_SYS_EVENT_H
+    if (strName == "kqueue") {
+        int fd = kqueue();
+        if (fd < 0) {
+            LogPrintf("%s: kqueue failed: %s\n", __func__, NetworkErrorString(errno));
+            return nullptr;
+        }
+        return std::unique_ptr<CSocketEvents>(new CKqueueEvents(fd));
+    }
+#endif
+    return nullptr;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKEVENTS_H
+#define BITCOIN_SOCKEVENTS_H
+
+#include <compat.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Readiness of a socket */
+enum SocketEvent : int {
+    SOCKET_EVENT_RECV = (1 << 0),
+    SOCKET_EVENT_SEND = (1 << 1),
+    SOCKET_EVENT_ERR = (1 << 2),
+};
+
+/**
+ * Waits for readiness on a set of sockets (-socketevents).
+ *
+ * The sockets and the events wanted for them stay registered between waits,
+ * so a wait only costs something for the sockets that are ready, with epoll
+ * and kqueue. Errors are always reported, whatever the events wanted.
+ *
+ * Closing a socket removes it from epoll and kqueue, but Remove must still
+ * be called for it, before a new socket that might reuse its descriptor is
+ * registered. Only one thread may use an instance.
+ */
+class CSocketEvents
+{
+public:
+    virtual ~CSocketEvents() {}
+
+    virtual const char* GetName() const = 0;
+
+    /** Whether hSocket can be waited on at all */
+    virtual bool CanWait(SOCKET hSocket) const { return true; }
+
+    /** Wait for nEvents on hSocket. Returns false if the socket can't be
+     * waited on. */
+    bool Set(SOCKET hSocket, int nEvents);
+
+    /** Stop waiting on hSocket */
+    void Remove(SOCKET hSocket);
+
+    /** Wait up to nTimeoutMs for any of the sockets to be ready, and return
+     * the events of those that are. Returns false on error. */
+    virtual bool Wait(int nTimeoutMs, std::vector<std::pair<SOCKET, int>>& vReady) = 0;
+
+protected:
+    virtual bool Update(SOCKET hSocket, int nEvents, int nEventsPrev, bool fNew) = 0;
+    virtual void Delete(SOCKET hSocket, int nEventsPrev) = 0;
+
+    //! Events wanted for each registered socket
+    std::unordered_map<SOCKET, int> mapEvents;
+};
+
+/** Name of the best backend this platform has */
+std::string DefaultSocketEvents();
+
+/** Names of the backends this platform has, for the help text */
+std::string ListSocketEvents();
+
+/** Create a socket events backend, nullptr if it is unknown or can't be
+ * created */
+std::unique_ptr<CSocketEvents> MakeSocketEvents(const std::string& strName);
+
+#endif // BITCOIN_SOCKEVENTS_H
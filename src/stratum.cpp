@@ -0,0 +1,638 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <arith_uint256.h>
+#include <base58.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <miner.h>
+#include <netbase.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <timedata.h>
+#include <txmempool.h>
+#include <univalue.h>
+#include <util.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/** Longest request line accepted from a miner */
+static const size_t MAX_STRATUM_LINE_LENGTH = 16384;
+/** Most miners connected at once */
+static const size_t MAX_STRATUM_CLIENTS = 256;
+/** Bytes of the extranonce assigned to each connection */
+static const unsigned int STRATUM_EXTRANONCE1_SIZE = 4;
+/** Bytes of the extranonce rolled by the miner */
+static const unsigned int STRATUM_EXTRANONCE2_SIZE = 4;
+/** Jobs kept for shares that arrive after a newer job was sent */
+static const size_t MAX_STRATUM_JOBS = 8;
+/** Shares remembered per job to reject duplicates, shares past this are
+ * refused until the next job */
+static const size_t MAX_STRATUM_JOB_SHARES = 16384;
+/** Seconds between checks of the mempool for a new job */
+static const int STRATUM_MEMPOOL_POLL_INTERVAL = 5;
+
+/** Error codes of the stratum protocol */
+enum StratumErrorCode {
+    STRATUM_ERROR_OTHER = 20,
+    STRATUM_ERROR_JOB_NOT_FOUND = 21,
+    STRATUM_ERROR_DUPLICATE_SHARE = 22,
+    STRATUM_ERROR_LOW_DIFFICULTY = 23,
+    STRATUM_ERROR_UNAUTHORIZED = 24,
+    STRATUM_ERROR_NOT_SUBSCRIBED = 25,
+};
+
+/** A block template handed out to miners with mining.notify */
+struct StratumJob
+{
+    //! The template, with an empty extranonce in the coinbase
+    CBlock block;
+    //! The coinbase serialized without witness, before and after the
+    //! extranonces
+    std::vector<unsigned char> vchCoinb1;
+    std::vector<unsigned char> vchCoinb2;
+    //! Merkle branch of the coinbase
+    std::vector<uint256> vMerkleBranch;
+    //! Hashes of the headers submitted for the job, to reject duplicates
+    std::set<uint256> setShares;
+};
+
+/** A connected miner */
+struct StratumClient
+{
+    std::string strAddress;
+    uint32_t nExtraNonce1;
+    bool fSubscribed;
+    bool fAuthorized;
+
+    StratumClient() : nExtraNonce1(0), fSubscribed(false), fAuthorized(false) {}
+};
+
+/** Wakes the stratum thread up to send a new job when the tip changes */
+class StratumNotifier : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+};
+
+/****** State, only used by the stratum thread ********/
+
+static struct event_base* gBase;
+static struct evconnlistener* gListener;
+static struct event* gNewTipEvent;
+static struct event* gPollEvent;
+static boost::thread stratumThread;
+static std::unique_ptr<StratumNotifier> gNotifier;
+
+//! Script the coinbase of each job pays to (-stratumaddress)
+static CScript gScript;
+//! Hashes at most this count as shares (-stratumdifficulty)
+static arith_uint256 gShareTarget;
+static int64_t nDifficulty;
+
+static std::map<struct bufferevent*, StratumClient> gClients;
+//! Recent jobs by job id, the last one is the current job
+static std::map<uint32_t, StratumJob> gJobs;
+static uint32_t nNextJobId;
+static uint32_t nNextExtraNonce1;
+//! Mempool state and time of the current job
+static unsigned int nLastTransactionsUpdated;
+static int64_t nLastJobTime;
+
+/****** Messages ********/
+
+static std::string StratumHex(uint32_t n)
+{
+    return strprintf("%08x", n);
+}
+
+/** Stratum sends the previous block hash as eight 32-bit words in hash byte
+ * order, each with its bytes swapped */
+static std::string StratumPrevHash(const uint256& hash)
+{
+    std::vector<unsigned char> vch(hash.begin(), hash.end());
+    for (size_t i = 0; i < vch.size(); i += 4)
+        std::reverse(vch.begin() + i, vch.begin() + i + 4);
+    return HexStr(vch);
+}
+
+/** Parse a big endian 32-bit field of mining.submit */
+static bool ParseStratumHex32(const UniValue& value, uint32_t& n)
+{
+    if (!value.isStr() || value.get_str().size() != 8 || !IsHex(value.get_str()))
+        return false;
+    std::vector<unsigned char> vch = ParseHex(value.get_str());
+    n = ReadBE32(vch.data());
+    return true;
+}
+
+static void SendLine(struct bufferevent* bev, const UniValue& msg)
+{
+    const std::string str = msg.write() + "\n";
+    bufferevent_write(bev, str.data(), str.size());
+}
+
+static void SendResult(struct bufferevent* bev, const UniValue& id, const UniValue& result)
+{
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", id));
+    msg.push_back(Pair("result", result));
+    msg.push_back(Pair("error", NullUniValue));
+    SendLine(bev, msg);
+}
+
+static void SendError(struct bufferevent* bev, const UniValue& id, int nCode, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(nCode);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", id));
+    msg.push_back(Pair("result", NullUniValue));
+    msg.push_back(Pair("error", error));
+    SendLine(bev, msg);
+}
+
+static UniValue JobNotification(uint32_t nJobId, const StratumJob& job, bool fClean)
+{
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : job.vMerkleBranch)
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+
+    UniValue params(UniValue::VARR);
+    params.push_back(StratumHex(nJobId));
+    params.push_back(StratumPrevHash(job.block.hashPrevBlock));
+    params.push_back(HexStr(job.vchCoinb1));
+    params.push_back(HexStr(job.vchCoinb2));
+    params.push_back(branch);
+    params.push_back(StratumHex(job.block.nVersion));
+    params.push_back(StratumHex(job.block.nBits));
+    params.push_back(StratumHex(job.block.nTime));
+    params.push_back(fClean);
+
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", NullUniValue));
+    msg.push_back(Pair("method", "mining.notify"));
+    msg.push_back(Pair("params", params));
+    return msg;
+}
+
+static UniValue DifficultyNotification()
+{
+    UniValue params(UniValue::VARR);
+    params.push_back(nDifficulty);
+
+    UniValue msg(UniValue::VOBJ);
+    msg.push_back(Pair("id", NullUniValue));
+    msg.push_back(Pair("method", "mining.set_difficulty"));
+    msg.push_back(Pair("params", params));
+    return msg;
+}
+
+/****** Jobs ********/
+
+/** Make a job from a new block template. The coinbase script ends with one
+ * push of both extranonces, so the miner only has to put them between
+ * coinb1 and coinb2 to get the coinbase. */
+static bool CreateJob(StratumJob& job)
+{
+    std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(gScript));
+    if (!pblocktemplate)
+        return false;
+    job.block = pblocktemplate->block;
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(job.block.hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+            return false;
+        nHeight = mi->second->nHeight + 1;
+    }
+
+    CMutableTransaction txCoinbase(*job.block.vtx[0]);
+    txCoinbase.vin[0].scriptSig = CScript() << nHeight << std::vector<unsigned char>(STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE, 0);
+    const size_t nScriptSize = txCoinbase.vin[0].scriptSig.size();
+    job.block.vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+
+    // The script follows the version, the input count and the prevout
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss << *job.block.vtx[0];
+    const size_t nScriptEnd = 4 + 1 + 36 + GetSizeOfCompactSize(nScriptSize) + nScriptSize;
+    const size_t nExtraNonceStart = nScriptEnd - STRATUM_EXTRANONCE1_SIZE - STRATUM_EXTRANONCE2_SIZE;
+    job.vchCoinb1.assign(ss.begin(), ss.begin() + nExtraNonceStart);
+    job.vchCoinb2.assign(ss.begin() + nScriptEnd, ss.end());
+
+    job.vMerkleBranch = BlockMerkleBranch(job.block, 0);
+
+    return true;
+}
+
+/** Make a new job and send it to every authorized miner. A clean job makes
+ * the miners drop their current work, and the older jobs are forgotten. */
+static void NewJob(bool fClean)
+{
+    if (IsInitialBlockDownload())
+        return;
+
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    StratumJob job;
+    if (!CreateJob(job)) {
+        LogPrintf("stratum: Unable to create a block template\n");
+        return;
+    }
+    nLastTransactionsUpdated = nTransactionsUpdated;
+    nLastJobTime = GetTime();
+
+    if (fClean)
+        gJobs.clear();
+    while (gJobs.size() >= MAX_STRATUM_JOBS)
+        gJobs.erase(gJobs.begin());
+
+    const uint32_t nJobId = nNextJobId++;
+    const StratumJob& jobNew = gJobs.emplace(nJobId, std::move(job)).first->second;
+    LogPrint(BCLog::STRATUM, "stratum: New job %s on top of %s with %u transactions\n",
+            StratumHex(nJobId), jobNew.block.hashPrevBlock.ToString(), jobNew.block.vtx.size());
+
+    const UniValue msg = JobNotification(nJobId, jobNew, fClean);
+    for (const auto& entry : gClients) {
+        if (entry.second.fAuthorized)
+            SendLine(entry.first, msg);
+    }
+}
+
+static void NewTipCallback(evutil_socket_t fd, short what, void* arg)
+{
+    // Build the next job when a miner asks for one
+    if (gClients.empty()) {
+        gJobs.clear();
+        return;
+    }
+    NewJob(true);
+}
+
+static void PollCallback(evutil_socket_t fd, short what, void* arg)
+{
+    if (gClients.empty())
+        return;
+
+    if (gJobs.empty()) {
+        NewJob(true);
+    } else if (mempool.GetTransactionsUpdated() != nLastTransactionsUpdated &&
+            GetTime() - nLastJobTime >= STRATUM_JOB_REFRESH_INTERVAL) {
+        NewJob(false);
+    }
+}
+
+void StratumNotifier::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (!fInitialDownload)
+        event_active(gNewTipEvent, 0, 0);
+}
+
+/****** Requests ********/
+
+/** Check a share and submit the block if it has enough work. Sets nCode and
+ * strError for a rejected share. */
+static bool SubmitShare(const StratumClient& client, const UniValue& params, int& nCode, std::string& strError)
+{
+    nCode = STRATUM_ERROR_OTHER;
+    if (!params.isArray() || params.size() < 5 || !params[2].isStr()) {
+        strError = "Invalid parameters";
+        return false;
+    }
+
+    uint32_t nJobId, nTime, nNonce;
+    if (!ParseStratumHex32(params[1], nJobId)) {
+        nCode = STRATUM_ERROR_JOB_NOT_FOUND;
+        strError = "Job not found";
+        return false;
+    }
+    std::map<uint32_t, StratumJob>::iterator it = gJobs.find(nJobId);
+    if (it == gJobs.end()) {
+        nCode = STRATUM_ERROR_JOB_NOT_FOUND;
+        strError = "Job not found";
+        return false;
+    }
+    StratumJob& job = it->second;
+
+    const std::string& strExtraNonce2 = params[2].get_str();
+    if (strExtraNonce2.size() != 2 * STRATUM_EXTRANONCE2_SIZE || !IsHex(strExtraNonce2) ||
+            !ParseStratumHex32(params[3], nTime) || !ParseStratumHex32(params[4], nNonce)) {
+        strError = "Invalid parameters";
+        return false;
+    }
+    if (nTime > GetAdjustedTime() + MAX_FUTURE_BLOCK_TIME) {
+        strError = "Time too new";
+        return false;
+    }
+
+    // Rebuild the coinbase, keeping the witness of the template's
+    std::vector<unsigned char> vchCoinbase(job.vchCoinb1);
+    const std::vector<unsigned char> vchExtraNonce1 = ParseHex(StratumHex(client.nExtraNonce1));
+    const std::vector<unsigned char> vchExtraNonce2 = ParseHex(strExtraNonce2);
+    vchCoinbase.insert(vchCoinbase.end(), vchExtraNonce1.begin(), vchExtraNonce1.end());
+    vchCoinbase.insert(vchCoinbase.end(), vchExtraNonce2.begin(), vchExtraNonce2.end());
+    vchCoinbase.insert(vchCoinbase.end(), job.vchCoinb2.begin(), job.vchCoinb2.end());
+
+    CMutableTransaction txCoinbase;
+    CDataStream ss(vchCoinbase, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss >> txCoinbase;
+    txCoinbase.vin[0].scriptWitness = job.block.vtx[0]->vin[0].scriptWitness;
+    CTransactionRef tx = MakeTransactionRef(std::move(txCoinbase));
+
+    CBlockHeader header = job.block.GetBlockHeader();
+    header.hashMerkleRoot = ComputeMerkleRootFromBranch(tx->GetHash(), job.vMerkleBranch, 0);
+    header.nTime = nTime;
+    header.nNonce = nNonce;
+    const uint256 hash = header.GetHash();
+
+    if (job.setShares.count(hash)) {
+        nCode = STRATUM_ERROR_DUPLICATE_SHARE;
+        strError = "Duplicate share";
+        return false;
+    }
+
+    // A block is accepted whatever the share difficulty
+    const bool fBlock = CheckProofOfWork(hash, header.nBits, Params().GetConsensus());
+    if (!fBlock && UintToArith256(hash) > gShareTarget) {
+        nCode = STRATUM_ERROR_LOW_DIFFICULTY;
+        strError = "Low difficulty share";
+        return false;
+    }
+
+    // Only shares that passed are remembered, so that hashes anyone can
+    // make don't fill the set
+    if (job.setShares.size() < MAX_STRATUM_JOB_SHARES) {
+        job.setShares.insert(hash);
+    } else if (!fBlock) {
+        strError = "Too many shares for job";
+        return false;
+    }
+
+    if (fBlock) {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(job.block);
+        pblock->vtx[0] = tx;
+        pblock->hashMerkleRoot = header.hashMerkleRoot;
+        pblock->nTime = header.nTime;
+        pblock->nNonce = header.nNonce;
+        pblock->InvalidateHash();
+
+        LogPrintf("stratum: %s found block %s\n", client.strAddress, hash.ToString());
+        if (!ProcessNewBlock(Params(), pblock, true, nullptr))
+            LogPrintf("stratum: Block %s was not accepted\n", hash.ToString());
+    }
+
+    return true;
+}
+
+static void HandleRequest(struct bufferevent* bev, StratumClient& client, const UniValue& request)
+{
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+    if (!method.isStr()) {
+        SendError(bev, id, STRATUM_ERROR_OTHER, "Invalid request");
+        return;
+    }
+    const std::string& strMethod = method.get_str();
+
+    if (strMethod == "mining.subscribe") {
+        client.fSubscribed = true;
+
+        UniValue subscription(UniValue::VARR);
+        subscription.push_back("mining.notify");
+        subscription.push_back(StratumHex(client.nExtraNonce1));
+        UniValue subscriptions(UniValue::VARR);
+        subscriptions.push_back(subscription);
+
+        UniValue result(UniValue::VARR);
+        result.push_back(subscriptions);
+        result.push_back(StratumHex(client.nExtraNonce1));
+        result.push_back((int)STRATUM_EXTRANONCE2_SIZE);
+        SendResult(bev, id, result);
+    } else if (strMethod == "mining.authorize") {
+        // Every share pays -stratumaddress, so there is nothing to check
+        if (!client.fSubscribed) {
+            SendError(bev, id, STRATUM_ERROR_NOT_SUBSCRIBED, "Not subscribed");
+            return;
+        }
+        client.fAuthorized = true;
+        SendResult(bev, id, true);
+        SendLine(bev, DifficultyNotification());
+
+        if (gJobs.empty())
+            NewJob(true);
+        else
+            SendLine(bev, JobNotification(gJobs.rbegin()->first, gJobs.rbegin()->second, true));
+    } else if (strMethod == "mining.submit") {
+        if (!client.fAuthorized) {
+            SendError(bev, id, STRATUM_ERROR_UNAUTHORIZED, "Unauthorized worker");
+            return;
+        }
+        int nCode;
+        std::string strError;
+        if (SubmitShare(client, params, nCode, strError))
+            SendResult(bev, id, true);
+        else
+            SendError(bev, id, nCode, strError);
+    } else {
+        SendError(bev, id, STRATUM_ERROR_OTHER, "Method not found");
+    }
+}
+
+/****** Connections ********/
+
+static void DropClient(struct bufferevent* bev)
+{
+    std::map<struct bufferevent*, StratumClient>::iterator it = gClients.find(bev);
+    if (it != gClients.end()) {
+        LogPrint(BCLog::STRATUM, "stratum: Disconnected %s\n", it->second.strAddress);
+        gClients.erase(it);
+    }
+    bufferevent_free(bev);
+}
+
+static void ReadCallback(struct bufferevent* bev, void* ctx)
+{
+    std::map<struct bufferevent*, StratumClient>::iterator it = gClients.find(bev);
+    if (it == gClients.end())
+        return;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        const std::string str(line, n_read_out);
+        free(line);
+        if (str.empty())
+            continue;
+
+        UniValue request;
+        if (!request.read(str) || !request.isObject()) {
+            LogPrint(BCLog::STRATUM, "stratum: Invalid request from %s\n", it->second.strAddress);
+            DropClient(bev);
+            return;
+        }
+        HandleRequest(bev, it->second, request);
+    }
+
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE_LENGTH) {
+        LogPrint(BCLog::STRATUM, "stratum: Request too long from %s\n", it->second.strAddress);
+        DropClient(bev);
+    }
+}
+
+static void EventCallback(struct bufferevent* bev, short what, void* ctx)
+{
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+        DropClient(bev);
+}
+
+static void AcceptCallback(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* address, int socklen, void* ctx)
+{
+    CService addr;
+    addr.SetSockAddr(address);
+    if (gClients.size() >= MAX_STRATUM_CLIENTS) {
+        LogPrint(BCLog::STRATUM, "stratum: Too many connections, refusing %s\n", addr.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+
+    struct bufferevent* bev = bufferevent_socket_new(gBase, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+
+    StratumClient& client = gClients[bev];
+    client.strAddress = addr.ToString();
+    client.nExtraNonce1 = nNextExtraNonce1++;
+
+    bufferevent_setcb(bev, ReadCallback, nullptr, EventCallback, nullptr);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    LogPrint(BCLog::STRATUM, "stratum: Accepted connection from %s\n", client.strAddress);
+}
+
+/****** Thread ********/
+
+static void StratumThread()
+{
+    event_base_dispatch(gBase);
+}
+
+bool StartStratum(std::string& strError)
+{
+    assert(!gBase);
+
+    const CTxDestination dest = DecodeDestination(gArgs.GetArg("-stratumaddress", ""));
+    if (!IsValidDestination(dest)) {
+        strError = _("-stratum requires a valid -stratumaddress to mine to");
+        return false;
+    }
+    gScript = GetScriptForDestination(dest);
+
+    nDifficulty = gArgs.GetArg("-stratumdifficulty", DEFAULT_STRATUM_DIFFICULTY);
+    if (nDifficulty < 1) {
+        strError = strprintf(_("Invalid -stratumdifficulty: %d"), nDifficulty);
+        return false;
+    }
+    gShareTarget = UintToArith256(Params().GetConsensus().powLimit) / arith_uint256(nDifficulty);
+
+    const std::string strBind = gArgs.GetArg("-stratumbind", DEFAULT_STRATUM_BIND);
+    CService bind;
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!Lookup(strBind.c_str(), bind, gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT), false) ||
+            !bind.GetSockAddr((struct sockaddr*)&sockaddr, &len)) {
+        strError = strprintf(_("Invalid -stratumbind address: '%s'"), strBind);
+        return false;
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    gBase = event_base_new();
+    if (!gBase) {
+        strError = _("Unable to create the stratum event base");
+        return false;
+    }
+
+    gListener = evconnlistener_new_bind(gBase, AcceptCallback, nullptr, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+    if (!gListener) {
+        event_base_free(gBase);
+        gBase = nullptr;
+        strError = strprintf(_("Unable to bind the stratum server to %s"), bind.ToString());
+        return false;
+    }
+
+    gNewTipEvent = event_new(gBase, -1, 0, NewTipCallback, nullptr);
+    gPollEvent = event_new(gBase, -1, EV_PERSIST, PollCallback, nullptr);
+    struct timeval tv = {STRATUM_MEMPOOL_POLL_INTERVAL, 0};
+    event_add(gPollEvent, &tv);
+
+    nNextExtraNonce1 = GetRand(std::numeric_limits<uint32_t>::max());
+    gNotifier.reset(new StratumNotifier());
+    RegisterValidationInterface(gNotifier.get(), "stratum");
+
+    stratumThread = boost::thread(boost::bind(&TraceThread<void (*)()>, "stratum", &StratumThread));
+    LogPrintf("stratum: Listening on %s, mining to %s\n", bind.ToString(), EncodeDestination(dest));
+    return true;
+}
+
+void InterruptStratum()
+{
+    if (gBase) {
+        LogPrintf("stratum: Thread interrupt\n");
+        event_base_loopbreak(gBase);
+    }
+}
+
+void StopStratum()
+{
+    if (gNotifier) {
+        UnregisterValidationInterface(gNotifier.get());
+        gNotifier.reset();
+    }
+    if (gBase) {
+        stratumThread.join();
+        for (const auto& entry : gClients)
+            bufferevent_free(entry.first);
+        gClients.clear();
+        gJobs.clear();
+        event_free(gPollEvent);
+        event_free(gNewTipEvent);
+        evconnlistener_free(gListener);
+        event_base_free(gBase);
+        gBase = nullptr;
+    }
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Stratum v1 server for mining to this node without a pool or proxy.
+ */
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include <stdint.h>
+#include <string>
+
+/** Default for -stratum */
+static const bool DEFAULT_STRATUM_ENABLE = false;
+/** Default for -stratumbind */
+static const char* const DEFAULT_STRATUM_BIND = "127.0.0.1";
+/** Default for -stratumport */
+static const uint16_t DEFAULT_STRATUM_PORT = 3333;
+/** Default for -stratumdifficulty, relative to the proof of work limit */
+static const int64_t DEFAULT_STRATUM_DIFFICULTY = 1;
+/** Seconds between new jobs for mempool changes, new tips are sent at once */
+static const int64_t STRATUM_JOB_REFRESH_INTERVAL = 30;
+
+/** Start the stratum server on -stratumbind:-stratumport, mining to
+ * -stratumaddress. Sets strError and returns false if it can't. */
+bool StartStratum(std::string& strError);
+/** Stop the stratum event loop */
+void InterruptStratum();
+/** Wait for the stratum thread and close all connections */
+void StopStratum();
+
+#endif // BITCOIN_STRATUM_H
@@ -0,0 +1,41 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_LARGEPAGE_H
+#define BITCOIN_SUPPORT_ALLOCATORS_LARGEPAGE_H
+
+#include <support/largepages.h>
+
+#include <stddef.h>
+
+/**
+ * Allocator from LargePageArena. Only blocks of at least
+ * LargePageArena::MIN_BLOCK_SIZE bytes are backed by huge pages, so it suits
+ * containers that allocate in large chunks, not node based ones.
+ */
+template <typename T>
+struct large_page_allocator {
+    typedef T value_type;
+
+    large_page_allocator() noexcept {}
+    template <typename U>
+    large_page_allocator(const large_page_allocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(LargePageArena::Instance().Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        LargePageArena::Instance().Free(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const large_page_allocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const large_page_allocator<U>&) const noexcept { return false; }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_LARGEPAGE_H
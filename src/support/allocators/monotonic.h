@@ -0,0 +1,89 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_MONOTONIC_H
+#define BITCOIN_SUPPORT_ALLOCATORS_MONOTONIC_H
+
+#include <algorithm>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Hands out memory from large slabs and frees it all at once, when the
+ * arena is destroyed. Allocating only bumps a pointer and freeing does
+ * nothing, so objects that live and die together, like the transactions of
+ * one block, don't go through malloc one by one.
+ *
+ * Not thread safe: allocate from one thread at a time.
+ */
+class MonotonicArena
+{
+public:
+    explicit MonotonicArena(size_t nSlabSizeIn = 16384) : nSlabSize(std::max<size_t>(nSlabSizeIn, 64)) {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    void* Allocate(size_t nSize, size_t nAlign)
+    {
+        uintptr_t nPos = Align(pNext, nAlign);
+        if (!pNext || nPos + nSize > reinterpret_cast<uintptr_t>(pEnd)) {
+            const size_t nNewSlab = std::max(nSlabSize, nSize + nAlign);
+            vSlabs.emplace_back(new char[nNewSlab]);
+            pNext = vSlabs.back().get();
+            pEnd = pNext + nNewSlab;
+            nPos = Align(pNext, nAlign);
+            nAllocated += nNewSlab;
+        }
+        pNext = reinterpret_cast<char*>(nPos + nSize);
+        return reinterpret_cast<void*>(nPos);
+    }
+
+    /** Bytes of slab memory held */
+    size_t GetAllocated() const { return nAllocated; }
+
+private:
+    static uintptr_t Align(const char* p, size_t nAlign)
+    {
+        return (reinterpret_cast<uintptr_t>(p) + nAlign - 1) & ~(uintptr_t)(nAlign - 1);
+    }
+
+    const size_t nSlabSize;
+    std::vector<std::unique_ptr<char[]>> vSlabs;
+    char* pNext = nullptr;
+    char* pEnd = nullptr;
+    size_t nAllocated = 0;
+};
+
+/**
+ * Allocator from a MonotonicArena. Every copy keeps the arena alive, so
+ * memory handed to a container or to std::allocate_shared stays valid for as
+ * long as the object that was allocated from it.
+ */
+template <typename T>
+struct monotonic_allocator {
+    typedef T value_type;
+
+    explicit monotonic_allocator(std::shared_ptr<MonotonicArena> arenaIn) noexcept : arena(std::move(arenaIn)) {}
+    template <typename U>
+    monotonic_allocator(const monotonic_allocator<U>& a) noexcept : arena(a.arena) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {}
+
+    template <typename U>
+    bool operator==(const monotonic_allocator<U>& a) const noexcept { return arena == a.arena; }
+    template <typename U>
+    bool operator!=(const monotonic_allocator<U>& a) const noexcept { return arena != a.arena; }
+
+    std::shared_ptr<MonotonicArena> arena;
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_MONOTONIC_H
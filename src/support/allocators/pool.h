@@ -0,0 +1,194 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <support/largepages.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Hands out the small blocks of node based containers from large chunks.
+ * Freed blocks go on a free list for their size and are reused by the next
+ * allocation of that size, so containers that keep adding and removing nodes
+ * don't go through malloc for each of them and don't fragment the heap.
+ * Chunks are only returned when the resource is destroyed. Blocks larger
+ * than MAX_BLOCK_SIZE, like the bucket arrays of hash tables, come from
+ * operator new. With fLargePages the chunks come from LargePageArena, which
+ * backs them with huge pages when those are enabled.
+ *
+ * Not thread safe: allocate and free from one thread at a time.
+ */
+class PoolResource
+{
+public:
+    //! Block sizes are rounded up to this, which is also the alignment
+    static const size_t BLOCK_ALIGN = alignof(std::max_align_t);
+    //! Largest block served from the chunks
+    static const size_t MAX_BLOCK_SIZE = 512;
+
+    explicit PoolResource(size_t nChunkSizeIn = 256 * 1024, bool fLargePagesIn = false) : nChunkSize(std::max(nChunkSizeIn, size_t{MAX_BLOCK_SIZE}) / sizeof(Chunk) * sizeof(Chunk)), fLargePages(fLargePagesIn), vFree(MAX_BLOCK_SIZE / BLOCK_ALIGN + 1, nullptr) {}
+
+    ~PoolResource()
+    {
+        for (Chunk* pChunk : vChunks)
+            FreeChunk(pChunk);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(size_t nSize, size_t nAlign)
+    {
+        if (nSize > MAX_BLOCK_SIZE || nAlign > BLOCK_ALIGN) {
+            nUsage += nSize;
+            return ::operator new(nSize);
+        }
+
+        const size_t nBin = Bin(nSize);
+        nUsage += nBin * BLOCK_ALIGN;
+        if (FreeBlock* pBlock = vFree[nBin]) {
+            vFree[nBin] = pBlock->pNext;
+            return pBlock;
+        }
+
+        const size_t nBytes = nBin * BLOCK_ALIGN;
+        if (pNext + nBytes > pEnd) {
+            // Keep what is left of the chunk for smaller blocks
+            if (pEnd - pNext >= (ptrdiff_t)BLOCK_ALIGN)
+                Free(pNext, (pEnd - pNext) / BLOCK_ALIGN);
+            Chunk* pChunk = fLargePages ? static_cast<Chunk*>(LargePageArena::Instance().Allocate(nChunkSize)) : new Chunk[nChunkSize / sizeof(Chunk)];
+            try {
+                vChunks.push_back(pChunk);
+            } catch (...) {
+                FreeChunk(pChunk);
+                throw;
+            }
+            pNext = reinterpret_cast<char*>(pChunk);
+            pEnd = pNext + nChunkSize;
+            nAllocated += nChunkSize;
+        }
+        void* p = pNext;
+        pNext += nBytes;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nSize, size_t nAlign) noexcept
+    {
+        if (nSize > MAX_BLOCK_SIZE || nAlign > BLOCK_ALIGN) {
+            nUsage -= nSize;
+            ::operator delete(p);
+            return;
+        }
+        const size_t nBin = Bin(nSize);
+        nUsage -= nBin * BLOCK_ALIGN;
+        Free(p, nBin);
+    }
+
+    /** Bytes of the blocks in use, rounded up to their block size */
+    size_t GetUsage() const { return nUsage; }
+
+    /** Bytes of chunk memory held, in use or not */
+    size_t GetAllocated() const { return nAllocated; }
+
+private:
+    struct FreeBlock {
+        FreeBlock* pNext;
+    };
+    struct alignas(BLOCK_ALIGN) Chunk {
+        char data[BLOCK_ALIGN];
+    };
+
+    static size_t Bin(size_t nSize)
+    {
+        return std::max<size_t>((nSize + BLOCK_ALIGN - 1) / BLOCK_ALIGN, 1);
+    }
+
+    void FreeChunk(Chunk* pChunk) noexcept
+    {
+        if (fLargePages)
+            LargePageArena::Instance().Free(pChunk, nChunkSize);
+        else
+            delete[] pChunk;
+    }
+
+    void Free(void* p, size_t nBin)
+    {
+        FreeBlock* pBlock = new (p) FreeBlock;
+        pBlock->pNext = vFree[nBin];
+        vFree[nBin] = pBlock;
+    }
+
+    const size_t nChunkSize;
+    const bool fLargePages;
+    //! Free blocks by size in BLOCK_ALIGN units
+    std::vector<FreeBlock*> vFree;
+    std::vector<Chunk*> vChunks;
+    char* pNext = nullptr;
+    char* pEnd = nullptr;
+    size_t nAllocated = 0;
+    size_t nUsage = 0;
+};
+
+/**
+ * Allocator from a PoolResource, which has to outlive every container that
+ * uses it. Has the full pre-C++11 allocator interface for boost containers.
+ */
+template <typename T>
+class pool_allocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef pool_allocator<U> other;
+    };
+
+    explicit pool_allocator(PoolResource* resourceIn) noexcept : resource(resourceIn) {}
+    template <typename U>
+    pool_allocator(const pool_allocator<U>& a) noexcept : resource(a.resource) {}
+
+    T* allocate(size_t n, const void* hint = nullptr)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new ((void*)p) U(std::forward<Args>(args)...); }
+    template <typename U>
+    void destroy(U* p) { p->~U(); }
+
+    T* address(T& x) const noexcept { return std::addressof(x); }
+    const T* address(const T& x) const noexcept { return std::addressof(x); }
+    size_t max_size() const noexcept { return size_t(-1) / sizeof(T); }
+
+    template <typename U>
+    bool operator==(const pool_allocator<U>& a) const noexcept { return resource == a.resource; }
+    template <typename U>
+    bool operator!=(const pool_allocator<U>& a) const noexcept { return resource != a.resource; }
+
+    PoolResource* resource;
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -0,0 +1,259 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/largepages.h>
+
+#if defined(HAVE_CONFIG_H)
+#include <config/skydoge-config.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>        // for sched_setaffinity
+#include <sys/mman.h>     // for mmap, madvise
+#include <sys/syscall.h>  // for SYS_mbind
+#include <unistd.h>       // for access, syscall
+#endif
+
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <string>
+
+namespace {
+
+size_t align_up(size_t x, size_t align)
+{
+    return (x + align - 1) & ~(align - 1);
+}
+
+#ifdef __linux__
+std::string NumaNodePath(int nNode)
+{
+    return "/sys/devices/system/node/node" + std::to_string(nNode);
+}
+
+/** Prefer nNode for the pages of [p, p + nSize) that haven't been touched yet */
+void PlaceOnNumaNode(void* p, size_t nSize, int nNode)
+{
+#ifdef SYS_mbind
+    // MPOL_PREFERRED from <numaif.h>, which comes with libnuma
+    static const int MPOL_PREFERRED_NODE = 1;
+    const size_t nBits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> vMask(nNode / nBits + 1, 0);
+    vMask[nNode / nBits] |= 1UL << (nNode % nBits);
+    // Failing leaves the default first touch placement
+    syscall(SYS_mbind, p, nSize, MPOL_PREFERRED_NODE, vMask.data(), vMask.size() * nBits + 1, 0);
+#endif
+}
+#endif
+
+} // namespace
+
+LargePageArena& LargePageArena::Instance()
+{
+    static LargePageArena arena;
+    return arena;
+}
+
+bool LargePageArena::Configure(LargePageMode modeIn, int nNumaNodeIn)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+#ifdef __linux__
+    if (nNumaNodeIn >= 0 && access(NumaNodePath(nNumaNodeIn).c_str(), F_OK) != 0)
+        return false;
+    mode = modeIn;
+    nNumaNode = nNumaNodeIn;
+    return true;
+#else
+    return modeIn == LargePageMode::OFF && nNumaNodeIn < 0;
+#endif
+}
+
+LargePageMode LargePageArena::GetMode() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return mode;
+}
+
+void* LargePageArena::Allocate(size_t nSize)
+{
+    if (nSize < MIN_BLOCK_SIZE)
+        return ::operator new(nSize);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mode == LargePageMode::OFF)
+        return ::operator new(nSize);
+
+    if (nSize > MAX_REGION_BLOCK) {
+        const size_t nRegion = align_up(nSize, HUGE_PAGE_SIZE);
+        bool fExplicit;
+        char* p = MapRegion(nRegion, fExplicit);
+        if (!p)
+            throw std::bad_alloc();
+        mapRegions.emplace(p, Region{nRegion, fExplicit, true});
+        nUsed += nRegion;
+        return p;
+    }
+
+    nSize = align_up(nSize, BLOCK_ALIGN);
+    nUsed += nSize;
+    auto it = mapFree.find(nSize);
+    if (it != mapFree.end() && !it->second.empty()) {
+        char* p = it->second.back();
+        it->second.pop_back();
+        return p;
+    }
+
+    if (!pNext || pNext + nSize > pEnd) {
+        bool fExplicit;
+        char* p = MapRegion(REGION_SIZE, fExplicit);
+        if (!p) {
+            nUsed -= nSize;
+            throw std::bad_alloc();
+        }
+        mapRegions.emplace(p, Region{REGION_SIZE, fExplicit, false});
+        pNext = p;
+        pEnd = p + REGION_SIZE;
+    }
+    char* p = pNext;
+    pNext += nSize;
+    return p;
+}
+
+void LargePageArena::Free(void* p, size_t nSize) noexcept
+{
+    if (!p)
+        return;
+    if (nSize < MIN_BLOCK_SIZE) {
+        ::operator delete(p);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    char* pBlock = static_cast<char*>(p);
+    auto it = mapRegions.upper_bound(pBlock);
+    if (it == mapRegions.begin() || pBlock >= std::prev(it)->first + std::prev(it)->second.nSize) {
+        // Allocated while the arena was off
+        ::operator delete(p);
+        return;
+    }
+    --it;
+
+    if (it->second.fSingle) {
+        nUsed -= it->second.nSize;
+        UnmapRegion(it->first, it->second);
+        mapRegions.erase(it);
+        return;
+    }
+    nSize = align_up(nSize, BLOCK_ALIGN);
+    nUsed -= nSize;
+    try {
+        mapFree[nSize].push_back(pBlock);
+    } catch (const std::bad_alloc&) {
+        // Only the reuse of the block is lost
+    }
+}
+
+char* LargePageArena::MapRegion(size_t nSize, bool& fExplicit)
+{
+    fExplicit = false;
+#ifdef __linux__
+    char* p = nullptr;
+#ifdef MAP_HUGETLB
+    if (mode == LargePageMode::HUGETLB) {
+        void* addr = mmap(nullptr, nSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            p = static_cast<char*>(addr);
+            fExplicit = true;
+        }
+    }
+#endif
+    if (!p) {
+        // Map an extra huge page to align the region to one, so that all of
+        // it can be backed by huge pages
+        void* addr = mmap(nullptr, nSize + HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            return nullptr;
+        char* pBase = static_cast<char*>(addr);
+        p = reinterpret_cast<char*>(align_up(reinterpret_cast<uintptr_t>(pBase), HUGE_PAGE_SIZE));
+        if (p > pBase)
+            munmap(pBase, p - pBase);
+        if (pBase + HUGE_PAGE_SIZE > p)
+            munmap(p + nSize, pBase + HUGE_PAGE_SIZE - p);
+#ifdef MADV_HUGEPAGE
+        madvise(p, nSize, MADV_HUGEPAGE);
+#endif
+    }
+    if (nNumaNode >= 0)
+        PlaceOnNumaNode(p, nSize, nNumaNode);
+    nMapped += nSize;
+    if (fExplicit)
+        nExplicitMapped += nSize;
+    return p;
+#else
+    return nullptr;
+#endif
+}
+
+void LargePageArena::UnmapRegion(char* pBase, const Region& region)
+{
+#ifdef __linux__
+    munmap(pBase, region.nSize);
+    nMapped -= region.nSize;
+    if (region.fExplicit)
+        nExplicitMapped -= region.nSize;
+#endif
+}
+
+bool LargePageArena::BindThreadToNumaNode() const
+{
+#ifdef __linux__
+    int nNode;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nNode = nNumaNode;
+    }
+    if (nNode < 0)
+        return false;
+
+    // The list looks like "0-15,32-47"
+    std::ifstream file(NumaNodePath(nNode) + "/cpulist");
+    std::string strList;
+    if (!std::getline(file, strList))
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::istringstream ss(strList);
+    std::string strRange;
+    int nCPUs = 0;
+    while (std::getline(ss, strRange, ',')) {
+        int nFirst = 0, nLast = 0;
+        const size_t nDash = strRange.find('-');
+        try {
+            nFirst = std::stoi(strRange.substr(0, nDash));
+            nLast = nDash == std::string::npos ? nFirst : std::stoi(strRange.substr(nDash + 1));
+        } catch (const std::exception&) {
+            return false;
+        }
+        for (int n = nFirst; n <= nLast && n < CPU_SETSIZE; n++, nCPUs++)
+            CPU_SET(n, &set);
+    }
+    return nCPUs > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+LargePageArena::Stats LargePageArena::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.used = nUsed;
+    stats.mapped = nMapped;
+    stats.explicit_mapped = nExplicitMapped;
+    stats.regions = mapRegions.size();
+    return stats;
+}
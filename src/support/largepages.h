@@ -0,0 +1,117 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_LARGEPAGES_H
+#define BITCOIN_SUPPORT_LARGEPAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/** How LargePageArena backs its regions */
+enum class LargePageMode {
+    //! Regions aren't used, allocations go to operator new
+    OFF = 0,
+    //! Anonymous mappings the kernel is asked to back with transparent huge pages
+    THP = 1,
+    //! Mappings from the reserved huge page pool (vm.nr_hugepages), falling
+    //! back to transparent huge pages when it is exhausted
+    HUGETLB = 2,
+};
+
+/**
+ * Backs the large, long lived blocks of the coins cache and the mempool
+ * with huge pages, optionally placed on one NUMA node.
+ *
+ * Blocks of at least MIN_BLOCK_SIZE are cut from REGION_SIZE mappings.
+ * Freed blocks go on a free list for their size and are reused by the next
+ * block of that size; the users only allocate a few distinct sizes (the
+ * chunks of the coins cache and of the mempool node pool), so the regions
+ * are kept for the life of the process like the chunks of PoolResource.
+ * Blocks larger than MAX_REGION_BLOCK, like the index of a large coins
+ * cache, get a mapping of their own that is unmapped when they are freed.
+ * Smaller blocks, and all of them in LargePageMode::OFF, come from
+ * operator new.
+ *
+ * Thread safe. Only Linux supports huge pages and NUMA placement, elsewhere
+ * every mode behaves as LargePageMode::OFF.
+ */
+class LargePageArena
+{
+public:
+    //! Huge page size regions are aligned to and rounded up to
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    static const size_t REGION_SIZE = 16 * HUGE_PAGE_SIZE;
+    static const size_t MIN_BLOCK_SIZE = 64 * 1024;
+    static const size_t MAX_REGION_BLOCK = REGION_SIZE / 8;
+    //! Alignment of the blocks cut from a region
+    static const size_t BLOCK_ALIGN = 64;
+
+    struct Stats
+    {
+        //! Bytes of the blocks handed out and not freed
+        size_t used;
+        //! Bytes mapped
+        size_t mapped;
+        //! Bytes mapped from the reserved huge page pool
+        size_t explicit_mapped;
+        size_t regions;
+    };
+
+    static LargePageArena& Instance();
+
+    LargePageArena(const LargePageArena&) = delete;
+    LargePageArena& operator=(const LargePageArena&) = delete;
+
+    /** Set the mode and the NUMA node to place new regions on, -1 for none.
+     * Blocks already handed out are freed correctly after a change.
+     * Returns false if this platform supports neither.
+     */
+    bool Configure(LargePageMode mode, int nNumaNode);
+    LargePageMode GetMode() const;
+
+    void* Allocate(size_t nSize);
+    void Free(void* p, size_t nSize) noexcept;
+
+    /** Restrict the calling thread to the CPUs of the configured NUMA node,
+     * so that memory it touches first is local to it. Returns false if no
+     * node is configured or the thread couldn't be bound.
+     */
+    bool BindThreadToNumaNode() const;
+
+    Stats GetStats() const;
+
+private:
+    LargePageArena() {}
+
+    struct Region
+    {
+        size_t nSize;
+        bool fExplicit;
+        //! Whether the region holds a single block
+        bool fSingle;
+    };
+
+    //! Map a region of nSize bytes, a multiple of HUGE_PAGE_SIZE
+    char* MapRegion(size_t nSize, bool& fExplicit);
+    void UnmapRegion(char* pBase, const Region& region);
+
+    mutable std::mutex mutex;
+    LargePageMode mode = LargePageMode::OFF;
+    int nNumaNode = -1;
+    //! Mapped regions by base address
+    std::map<char*, Region> mapRegions;
+    //! Freed blocks by size
+    std::map<size_t, std::vector<char*>> mapFree;
+    //! Unused part of the region small blocks are cut from
+    char* pNext = nullptr;
+    char* pEnd = nullptr;
+    size_t nUsed = 0;
+    size_t nMapped = 0;
+    size_t nExplicitMapped = 0;
+};
+
+#endif // BITCOIN_SUPPORT_LARGEPAGES_H
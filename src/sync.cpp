@@ -4,10 +4,13 @@
 
 #include <sync.h>
 
+#include <map>
 #include <set>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <utiltime.h>
 
+#include <chrono>
 #include <stdio.h>
 
 #ifdef DEBUG_LOCKCONTENTION
@@ -21,6 +24,204 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#ifdef HAVE_THREAD_LOCAL
+static thread_local const void* lockWaitMutex = nullptr;
+static thread_local int64_t nLockWaitMicros = 0;
+#endif
+
+int64_t LockWaitBegin(const void* mutex)
+{
+#ifdef HAVE_THREAD_LOCAL
+    if (lockWaitMutex == mutex)
+        return GetTimeMicros();
+#endif
+    return 0;
+}
+
+void LockWaitEnd(int64_t nWaitStart)
+{
+#ifdef HAVE_THREAD_LOCAL
+    if (nWaitStart)
+        nLockWaitMicros += GetTimeMicros() - nWaitStart;
+#endif
+}
+
+LockWaitTimer::LockWaitTimer(const void* mutex)
+{
+#ifdef HAVE_THREAD_LOCAL
+    lockWaitMutex = mutex;
+    nLockWaitMicros = 0;
+#endif
+}
+
+LockWaitTimer::~LockWaitTimer()
+{
+#ifdef HAVE_THREAD_LOCAL
+    lockWaitMutex = nullptr;
+#endif
+}
+
+int64_t LockWaitTimer::GetWaitMicros() const
+{
+#ifdef HAVE_THREAD_LOCAL
+    return nLockWaitMicros;
+#else
+    return 0;
+#endif
+}
+
+std::atomic<bool> g_lock_stats(false);
+
+/** Number of LOCK call sites statistics are kept for, those beyond are ignored */
+static const size_t LOCK_STATS_SITES = 4096;
+/** Number of slots tried before giving up on finding a free one */
+static const size_t LOCK_STATS_PROBES = 64;
+
+struct LockStatsSite
+{
+    //! 0 while free, 1 while being claimed, 2 once the site is set
+    std::atomic<int> state{0};
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+
+    std::atomic<uint64_t> nAcquired{0};
+    std::atomic<uint64_t> nContended{0};
+    std::atomic<uint64_t> nWaitTotal{0};
+    std::atomic<uint64_t> nWaitMax{0};
+    std::atomic<uint64_t> nHoldTotal{0};
+    std::atomic<uint64_t> nHoldMax{0};
+};
+
+// Sites are found by the address of their __FILE__ string and their line, a
+// site in a header gets one slot per translation unit and they are merged
+// when reported
+static LockStatsSite lockStatsSites[LOCK_STATS_SITES];
+
+// When the statistics were last reset, to convert ticks to microseconds
+static std::atomic<uint64_t> nLockStatsStartTicks(0);
+static std::atomic<int64_t> nLockStatsStartMicros(0);
+
+static int64_t SteadyMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t LockStatsTicks()
+{
+#if defined(__x86_64__) || defined(__amd64__)
+    uint64_t r1 = 0, r2 = 0;
+    __asm__ volatile ("rdtsc" : "=a"(r1), "=d"(r2));
+    return (r2 << 32) | r1;
+#elif defined(__i386__)
+    uint64_t r = 0;
+    __asm__ volatile ("rdtsc" : "=A"(r));
+    return r;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static LockStatsSite* FindLockStatsSite(const char* pszName, const char* pszFile, int nLine)
+{
+    const size_t nHash = (reinterpret_cast<uintptr_t>(pszFile) >> 3) * 31 + nLine;
+    for (size_t i = 0; i < LOCK_STATS_PROBES; i++) {
+        LockStatsSite& site = lockStatsSites[(nHash + i) % LOCK_STATS_SITES];
+        int state = site.state.load(std::memory_order_acquire);
+        if (state == 0) {
+            if (site.state.compare_exchange_strong(state, 1, std::memory_order_acquire)) {
+                site.pszName = pszName;
+                site.pszFile = pszFile;
+                site.nLine = nLine;
+                site.state.store(2, std::memory_order_release);
+                return &site;
+            }
+        }
+        // Claimed by another thread just now
+        while (state == 1)
+            state = site.state.load(std::memory_order_acquire);
+        if (site.pszFile == pszFile && site.nLine == nLine)
+            return &site;
+    }
+    return nullptr;
+}
+
+static void UpdateMax(std::atomic<uint64_t>& nMax, uint64_t nValue)
+{
+    uint64_t nCurrent = nMax.load(std::memory_order_relaxed);
+    while (nValue > nCurrent && !nMax.compare_exchange_weak(nCurrent, nValue, std::memory_order_relaxed)) {}
+}
+
+LockStatsSite* LockStatsAcquired(const char* pszName, const char* pszFile, int nLine, bool fContended, uint64_t nWaitTicks)
+{
+    LockStatsSite* site = FindLockStatsSite(pszName, pszFile, nLine);
+    if (!site)
+        return nullptr;
+    site->nAcquired.fetch_add(1, std::memory_order_relaxed);
+    if (fContended) {
+        site->nContended.fetch_add(1, std::memory_order_relaxed);
+        site->nWaitTotal.fetch_add(nWaitTicks, std::memory_order_relaxed);
+        UpdateMax(site->nWaitMax, nWaitTicks);
+    }
+    return site;
+}
+
+void LockStatsReleased(LockStatsSite* site, uint64_t nHoldTicks)
+{
+    site->nHoldTotal.fetch_add(nHoldTicks, std::memory_order_relaxed);
+    UpdateMax(site->nHoldMax, nHoldTicks);
+}
+
+void EnableLockStats(bool fEnable)
+{
+    if (fEnable && !g_lock_stats)
+        ResetLockStats();
+    g_lock_stats = fEnable;
+}
+
+void ResetLockStats()
+{
+    for (LockStatsSite& site : lockStatsSites) {
+        site.nAcquired = 0;
+        site.nContended = 0;
+        site.nWaitTotal = 0;
+        site.nWaitMax = 0;
+        site.nHoldTotal = 0;
+        site.nHoldMax = 0;
+    }
+    nLockStatsStartTicks = LockStatsTicks();
+    nLockStatsStartMicros = SteadyMicros();
+}
+
+std::vector<LockSiteStats> GetLockStats(int64_t& nElapsed)
+{
+    nElapsed = SteadyMicros() - nLockStatsStartMicros;
+    const uint64_t nElapsedTicks = LockStatsTicks() - nLockStatsStartTicks;
+    const double dTicksPerMicro = nElapsed > 0 && nElapsedTicks > 0 ? (double)nElapsedTicks / nElapsed : 1;
+    auto micros = [dTicksPerMicro](uint64_t nTicks) { return (int64_t)(nTicks / dTicksPerMicro); };
+
+    std::map<std::pair<std::string, int>, LockSiteStats> mapStats;
+    for (const LockStatsSite& site : lockStatsSites) {
+        if (site.state.load(std::memory_order_acquire) != 2 || site.nAcquired == 0)
+            continue;
+        LockSiteStats& stats = mapStats[std::make_pair(std::string(site.pszFile), site.nLine)];
+        if (stats.name.empty()) {
+            stats = LockSiteStats{site.pszName, site.pszFile, site.nLine, 0, 0, 0, 0, 0, 0};
+        }
+        stats.nAcquired += site.nAcquired;
+        stats.nContended += site.nContended;
+        stats.nWaitTotal += micros(site.nWaitTotal);
+        stats.nWaitMax = std::max(stats.nWaitMax, micros(site.nWaitMax));
+        stats.nHoldTotal += micros(site.nHoldTotal);
+        stats.nHoldMax = std::max(stats.nHoldMax, micros(site.nHoldMax));
+    }
+
+    std::vector<LockSiteStats> vStats;
+    for (const auto& stats : mapStats)
+        vStats.push_back(stats.second);
+    return vStats;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -8,9 +8,13 @@
 
 #include <threadsafety.h>
 
+#include <atomic>
 #include <condition_variable>
+#include <stdint.h>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 ////////////////////////////////////////////////
@@ -112,23 +116,94 @@ typedef std::unique_lock<std::mutex> WaitableLock;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** Start timing a contended wait for mutex, returns 0 if it isn't watched by
+ * a LockWaitTimer on this thread */
+int64_t LockWaitBegin(const void* mutex);
+void LockWaitEnd(int64_t nWaitStart);
+
+/**
+ * Measure how long the current thread is blocked waiting for one mutex while
+ * this object is in scope. Only contended acquisitions through LOCK are
+ * timed, so an uncontended lock costs nothing extra. Timers don't nest.
+ */
+class LockWaitTimer
+{
+public:
+    explicit LockWaitTimer(const void* mutex);
+    ~LockWaitTimer();
+
+    /** Microseconds spent waiting so far */
+    int64_t GetWaitMicros() const;
+};
+
+/** Default for -lockstats */
+static const bool DEFAULT_LOCK_STATS = false;
+
+/** Whether LOCK records statistics per call site (-lockstats). Off, a LOCK
+ * costs a relaxed load more. */
+extern std::atomic<bool> g_lock_stats;
+
+struct LockStatsSite;
+
+/** Timestamp of lock statistics: the CPU time stamp counter where available */
+uint64_t LockStatsTicks();
+/** Record an acquisition at a call site, returns the site to pass to LockStatsReleased */
+LockStatsSite* LockStatsAcquired(const char* pszName, const char* pszFile, int nLine, bool fContended, uint64_t nWaitTicks);
+void LockStatsReleased(LockStatsSite* site, uint64_t nHoldTicks);
+
+/** Statistics of one LOCK call site since they were last reset */
+struct LockSiteStats
+{
+    std::string name;
+    std::string file;
+    int line;
+    //! Number of times the lock was taken here
+    uint64_t nAcquired;
+    //! Number of those the lock was held by another thread
+    uint64_t nContended;
+    //! Total and longest time waited for the lock, in microseconds
+    int64_t nWaitTotal;
+    int64_t nWaitMax;
+    //! Total and longest time the lock was held from here, in microseconds
+    int64_t nHoldTotal;
+    int64_t nHoldMax;
+};
+
+/** Start or stop collecting lock statistics */
+void EnableLockStats(bool fEnable);
+/** Clear the statistics collected so far */
+void ResetLockStats();
+/** Return the statistics of every call site that took a lock since the last
+ * reset, and the microseconds since then in nElapsed */
+std::vector<LockSiteStats> GetLockStats(int64_t& nElapsed);
+
 /** Wrapper around std::unique_lock<CCriticalSection> */
 class SCOPED_LOCKABLE CCriticalBlock
 {
 private:
     std::unique_lock<CCriticalSection> lock;
+    LockStatsSite* pstats = nullptr;
+    uint64_t nStatsAcquired = 0;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+        const bool fStats = g_lock_stats.load(std::memory_order_relaxed);
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            const uint64_t nStatsWaitStart = fStats ? LockStatsTicks() : 0;
+            const int64_t nWaitStart = LockWaitBegin(lock.mutex());
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            LockWaitEnd(nWaitStart);
+            if (fStats)
+                pstats = LockStatsAcquired(pszName, pszFile, nLine, true, LockStatsTicks() - nStatsWaitStart);
+        } else if (fStats) {
+            pstats = LockStatsAcquired(pszName, pszFile, nLine, false, 0);
         }
-#endif
+        if (pstats)
+            nStatsAcquired = LockStatsTicks();
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -162,6 +237,8 @@ public:
 
     ~CCriticalBlock() UNLOCK_FUNCTION()
     {
+        if (pstats)
+            LockStatsReleased(pstats, LockStatsTicks() - nStatsAcquired);
         if (lock.owns_lock())
             LeaveCritical();
     }
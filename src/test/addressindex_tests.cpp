@@ -0,0 +1,113 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/block.h>
+#include <random.h>
+#include <txdb.h>
+#include <undo.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_write_erase)
+{
+    AddressIndexDB db(1 << 20, true);
+
+    CScript scriptA = CScript() << OP_TRUE;
+    CScript scriptB = CScript() << OP_2;
+    CScript scriptEscrow;
+    scriptEscrow.resize(2);
+    scriptEscrow[0] = OP_DRIVECHAIN;
+    scriptEscrow[1] = 1;
+
+    BOOST_CHECK(AddressIndexScript(scriptEscrow).nType == ADDRESS_INDEX_ESCROW);
+    BOOST_CHECK(AddressIndexScript(scriptA).nType == ADDRESS_INDEX_SCRIPT);
+
+    // A coinbase paying to A, a transaction spending an older output of A to
+    // B and the escrow, and one spending the output to B within the block
+    CBlock block;
+    CBlockUndo blockundo;
+    const COutPoint prevoutOld(GetRandHash(), 3);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(50 * COIN, scriptA);
+    coinbase.vout.emplace_back(0, CScript() << OP_RETURN);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction tx1;
+    tx1.vin.emplace_back(prevoutOld);
+    tx1.vout.emplace_back(7 * COIN, scriptB);
+    tx1.vout.emplace_back(3 * COIN, scriptEscrow);
+    block.vtx.push_back(MakeTransactionRef(tx1));
+    blockundo.vtxundo.emplace_back();
+    blockundo.vtxundo.back().vprevout.emplace_back(CTxOut(10 * COIN, scriptA), 5, false);
+
+    CMutableTransaction tx2;
+    tx2.vin.emplace_back(COutPoint(tx1.GetHash(), 0));
+    tx2.vout.emplace_back(6 * COIN, scriptA);
+    block.vtx.push_back(MakeTransactionRef(tx2));
+    blockundo.vtxundo.emplace_back();
+    blockundo.vtxundo.back().vprevout.emplace_back(CTxOut(7 * COIN, scriptB), 100, false);
+
+    BOOST_CHECK(db.WriteBlock(block, blockundo, 100));
+
+    std::vector<AddressHistoryEntry> vHistory;
+    BOOST_CHECK_EQUAL(db.ReadHistory(AddressIndexScript(scriptA), 0, 10, vHistory), 0U);
+    BOOST_CHECK_EQUAL(vHistory.size(), 3U);
+    size_t nSpends = 0;
+    for (const AddressHistoryEntry& entry : vHistory) {
+        BOOST_CHECK_EQUAL(entry.nHeight, 100);
+        if (entry.fSpending) {
+            nSpends++;
+            BOOST_CHECK(entry.prevout == prevoutOld);
+            BOOST_CHECK_EQUAL(entry.nValue, 10 * COIN);
+        }
+    }
+    BOOST_CHECK_EQUAL(nSpends, 1U);
+
+    // Pagination
+    vHistory.clear();
+    BOOST_CHECK_EQUAL(db.ReadHistory(AddressIndexScript(scriptA), 1, 1, vHistory), 1U);
+    BOOST_CHECK_EQUAL(vHistory.size(), 1U);
+
+    // The output to B is spent within the block
+    std::vector<AddressUnspentEntry> vUnspent;
+    db.ReadUnspent(AddressIndexScript(scriptA), 0, 10, vUnspent);
+    BOOST_CHECK_EQUAL(vUnspent.size(), 2U);
+    vUnspent.clear();
+    db.ReadUnspent(AddressIndexScript(scriptB), 0, 10, vUnspent);
+    BOOST_CHECK(vUnspent.empty());
+    vHistory.clear();
+    db.ReadHistory(AddressIndexScript(scriptB), 0, 10, vHistory);
+    BOOST_CHECK_EQUAL(vHistory.size(), 2U);
+
+    // The CTIP of the escrow
+    vUnspent.clear();
+    db.ReadUnspent(AddressIndexScript(scriptEscrow), 0, 10, vUnspent);
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].out == COutPoint(tx1.GetHash(), 1));
+    BOOST_CHECK_EQUAL(vUnspent[0].nValue, 3 * COIN);
+    BOOST_CHECK_EQUAL(vUnspent[0].nHeight, 100);
+
+    // Disconnecting the block restores the old output of A
+    BOOST_CHECK(db.EraseBlock(block, blockundo, 100));
+    vHistory.clear();
+    db.ReadHistory(AddressIndexScript(scriptA), 0, 10, vHistory);
+    BOOST_CHECK(vHistory.empty());
+    vUnspent.clear();
+    db.ReadUnspent(AddressIndexScript(scriptA), 0, 10, vUnspent);
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].out == prevoutOld);
+    BOOST_CHECK_EQUAL(vUnspent[0].nHeight, 5);
+    vUnspent.clear();
+    db.ReadUnspent(AddressIndexScript(scriptB), 0, 10, vUnspent);
+    db.ReadUnspent(AddressIndexScript(scriptEscrow), 0, 10, vUnspent);
+    BOOST_CHECK(vUnspent.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
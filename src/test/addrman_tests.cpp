@@ -129,6 +129,36 @@ BOOST_AUTO_TEST_CASE(addrman_simple)
     BOOST_CHECK(addrman.size() >= 1);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_changes)
+{
+    CAddrManTest addrman;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    CService addr1 = ResolveService("250.1.1.1", 8333);
+
+    // Test: Only calls that may modify the tables count as a change, so
+    // that peers.dat isn't written again for nothing.
+    uint64_t nChanges = addrman.GetChanges();
+    addrman.Select();
+    addrman.GetAddr();
+    BOOST_CHECK_EQUAL(addrman.GetChanges(), nChanges);
+
+    BOOST_CHECK(addrman.Add(CAddress(addr1, NODE_NONE), source));
+    BOOST_CHECK(addrman.GetChanges() > nChanges);
+    nChanges = addrman.GetChanges();
+
+    // Duplicates aren't added
+    BOOST_CHECK(!addrman.Add(CAddress(addr1, NODE_NONE), source));
+    BOOST_CHECK_EQUAL(addrman.GetChanges(), nChanges);
+
+    addrman.Good(addr1);
+    BOOST_CHECK(addrman.GetChanges() > nChanges);
+    nChanges = addrman.GetChanges();
+
+    addrman.Clear();
+    BOOST_CHECK(addrman.GetChanges() > nChanges);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_ports)
 {
     CAddrManTest addrman;
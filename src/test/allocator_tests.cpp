@@ -4,7 +4,9 @@
 
 #include <util.h>
 
+#include <support/allocators/pool.h>
 #include <support/allocators/secure.h>
+#include <support/largepages.h>
 #include <test/test_skydoge.h>
 
 #include <boost/test/unit_test.hpp>
@@ -231,4 +233,95 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource resource(4096);
+    typedef std::map<int, int, std::less<int>, pool_allocator<std::pair<const int, int>>> PoolMap;
+    const pool_allocator<char> alloc(&resource);
+    PoolMap m((std::less<int>()), alloc);
+    for (int i = 0; i < 1000; i++)
+        m.emplace(i, i * 2);
+    const size_t nUsage = resource.GetUsage();
+    const size_t nAllocated = resource.GetAllocated();
+    BOOST_CHECK(nUsage >= 1000 * sizeof(std::pair<const int, int>));
+    BOOST_CHECK(nAllocated >= nUsage);
+
+    // Freed nodes are reused instead of allocating more chunks
+    for (int i = 0; i < 1000; i += 2)
+        m.erase(i);
+    BOOST_CHECK(resource.GetUsage() < nUsage);
+    for (int i = 0; i < 1000; i += 2)
+        m.emplace(i, i * 2);
+    BOOST_CHECK_EQUAL(resource.GetUsage(), nUsage);
+    BOOST_CHECK_EQUAL(resource.GetAllocated(), nAllocated);
+    for (int i = 0; i < 1000; i++)
+        BOOST_CHECK_EQUAL(m.at(i), i * 2);
+
+    // Blocks larger than MAX_BLOCK_SIZE don't come from the chunks
+    std::vector<char, pool_allocator<char>> v(alloc);
+    v.resize(PoolResource::MAX_BLOCK_SIZE * 4);
+    BOOST_CHECK_EQUAL(resource.GetUsage(), nUsage + v.capacity());
+    BOOST_CHECK_EQUAL(resource.GetAllocated(), nAllocated);
+    v = std::vector<char, pool_allocator<char>>(alloc);
+    m.clear();
+    BOOST_CHECK_EQUAL(resource.GetUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(large_page_arena_tests)
+{
+    LargePageArena& arena = LargePageArena::Instance();
+    if (!arena.Configure(LargePageMode::THP, -1))
+        return;
+    const LargePageArena::Stats initial = arena.GetStats();
+
+    // Small blocks don't come from the regions
+    void* pSmall = arena.Allocate(LargePageArena::MIN_BLOCK_SIZE - 1);
+    BOOST_CHECK_EQUAL(arena.GetStats().used, initial.used);
+
+    char* p1 = static_cast<char*>(arena.Allocate(LargePageArena::MIN_BLOCK_SIZE));
+    char* p2 = static_cast<char*>(arena.Allocate(LargePageArena::MIN_BLOCK_SIZE));
+    memset(p1, 0x11, LargePageArena::MIN_BLOCK_SIZE);
+    memset(p2, 0x22, LargePageArena::MIN_BLOCK_SIZE);
+    BOOST_CHECK_EQUAL(arena.GetStats().used, initial.used + 2 * LargePageArena::MIN_BLOCK_SIZE);
+    BOOST_CHECK(arena.GetStats().mapped >= initial.mapped);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p1) % LargePageArena::BLOCK_ALIGN, 0U);
+
+    // A freed block is reused by the next one of its size
+    arena.Free(p1, LargePageArena::MIN_BLOCK_SIZE);
+    BOOST_CHECK(arena.Allocate(LargePageArena::MIN_BLOCK_SIZE) == p1);
+    BOOST_CHECK_EQUAL(p2[LargePageArena::MIN_BLOCK_SIZE - 1], 0x22);
+
+    // Large blocks get a mapping of their own, which goes away with them
+    const size_t nRegions = arena.GetStats().regions;
+    char* pLarge = static_cast<char*>(arena.Allocate(LargePageArena::MAX_REGION_BLOCK + 1));
+    BOOST_CHECK_EQUAL(arena.GetStats().regions, nRegions + 1);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(pLarge) % LargePageArena::HUGE_PAGE_SIZE, 0U);
+    memset(pLarge, 0x33, LargePageArena::MAX_REGION_BLOCK + 1);
+    arena.Free(pLarge, LargePageArena::MAX_REGION_BLOCK + 1);
+    BOOST_CHECK_EQUAL(arena.GetStats().regions, nRegions);
+
+    // Blocks allocated while the arena was off are freed after it is turned
+    // on, and the other way around
+    BOOST_CHECK(arena.Configure(LargePageMode::OFF, -1));
+    void* pOff = arena.Allocate(LargePageArena::MIN_BLOCK_SIZE);
+    arena.Free(p1, LargePageArena::MIN_BLOCK_SIZE);
+    arena.Free(p2, LargePageArena::MIN_BLOCK_SIZE);
+    arena.Free(pSmall, LargePageArena::MIN_BLOCK_SIZE - 1);
+    BOOST_CHECK(arena.Configure(LargePageMode::THP, -1));
+    arena.Free(pOff, LargePageArena::MIN_BLOCK_SIZE);
+    BOOST_CHECK_EQUAL(arena.GetStats().used, initial.used);
+
+    // The chunks of a pool can come from the arena
+    {
+        PoolResource resource(LargePageArena::MIN_BLOCK_SIZE, true);
+        const pool_allocator<char> alloc(&resource);
+        std::map<int, int, std::less<int>, pool_allocator<std::pair<const int, int>>> m((std::less<int>()), alloc);
+        for (int i = 0; i < 10000; i++)
+            m.emplace(i, i);
+        BOOST_CHECK(arena.GetStats().used > initial.used);
+    }
+    BOOST_CHECK_EQUAL(arena.GetStats().used, initial.used);
+    BOOST_CHECK(arena.Configure(LargePageMode::OFF, -1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
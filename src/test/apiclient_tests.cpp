@@ -0,0 +1,119 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <apiclient.h>
+#include <uint256.h>
+
+#include <test/test_skydoge.h>
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(apiclient_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(apiclient_parse_pipelined)
+{
+    // Responses to pipelined requests arrive back to back
+    std::string strBuf =
+        "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nfirst"
+        "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nthir\r\n1\r\nd\r\n0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nfo";
+
+    int nStatus = 0;
+    std::string strBody;
+    bool fKeepAlive = false;
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(nStatus, 200);
+    BOOST_CHECK_EQUAL(strBody, "first");
+    BOOST_CHECK(fKeepAlive);
+
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(nStatus, 404);
+    BOOST_CHECK(strBody.empty());
+
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(nStatus, 200);
+    BOOST_CHECK_EQUAL(strBody, "third");
+
+    // The last response isn't complete yet and is left in the buffer
+    const std::string strPartial = strBuf;
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 0);
+    BOOST_CHECK_EQUAL(strBuf, strPartial);
+    strBuf += "ur";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(strBody, "four");
+    BOOST_CHECK(strBuf.empty());
+}
+
+BOOST_AUTO_TEST_CASE(apiclient_parse_partial)
+{
+    int nStatus = 0;
+    std::string strBody;
+    bool fKeepAlive = false;
+
+    // Incomplete headers
+    std::string strBuf = "HTTP/1.1 200 OK\r\nContent-Len";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 0);
+
+    // Chunked body without the last chunk or its trailer
+    strBuf = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 0);
+    strBuf += "0\r\n";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 0);
+    strBuf += "\r\n";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(strBody, "abc");
+}
+
+BOOST_AUTO_TEST_CASE(apiclient_parse_connection_close)
+{
+    int nStatus = 0;
+    std::string strBody;
+    bool fKeepAlive = true;
+
+    std::string strBuf = "HTTP/1.1 200 OK\r\nConnection: Close\r\nContent-Length: 2\r\n\r\nok";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(strBody, "ok");
+    BOOST_CHECK(!fKeepAlive);
+
+    // Without framing the body runs until the server closes the connection
+    strBuf = "HTTP/1.0 200 OK\r\n\r\nuntil close";
+    fKeepAlive = true;
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), 0);
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, true, nStatus, strBody, fKeepAlive), 1);
+    BOOST_CHECK_EQUAL(strBody, "until close");
+    BOOST_CHECK(!fKeepAlive);
+    BOOST_CHECK(strBuf.empty());
+}
+
+BOOST_AUTO_TEST_CASE(apiclient_parse_malformed)
+{
+    int nStatus = 0;
+    std::string strBody;
+    bool fKeepAlive = false;
+
+    std::string strBuf = "garbage\r\n\r\n";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), -1);
+
+    strBuf = "HTTP/1.1 OK\r\n\r\n";
+    BOOST_CHECK_EQUAL(ParseHTTPResponse(strBuf, false, nStatus, strBody, fKeepAlive), -1);
+}
+
+BOOST_AUTO_TEST_CASE(apiclient_replay_result)
+{
+    const uint256 txid = uint256S("0x8c14f0db3df150123e6f3dbbf30f8b955a8249b62ac1d1ff16284aefa3d06d87");
+    const std::string strFound = "{\"hash\":\"" + txid.GetHex() + "\",\"ver\":1}";
+    const std::string strOther = "{\"hash\":\"" + uint256().GetHex() + "\",\"ver\":1}";
+
+    BOOST_CHECK(GetReplayResult(200, strFound, txid) == API_REPLAY_TRUE);
+    BOOST_CHECK(GetReplayResult(200, strOther, txid) == API_REPLAY_FALSE);
+    BOOST_CHECK(GetReplayResult(404, "Transaction not found", txid) == API_REPLAY_FALSE);
+    BOOST_CHECK(GetReplayResult(200, "{not json", txid) == API_REPLAY_ERROR);
+    BOOST_CHECK(GetReplayResult(500, strFound, txid) == API_REPLAY_ERROR);
+    BOOST_CHECK(GetReplayResult(429, "", txid) == API_REPLAY_ERROR);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -203,5 +203,25 @@ BOOST_AUTO_TEST_CASE(base58_keys_invalid)
     }
 }
 
+BOOST_AUTO_TEST_CASE(base58_check_batch)
+{
+    std::vector<std::vector<unsigned char>> vvch;
+    for (int len = 0; len < 80; len++) {
+        std::vector<unsigned char> vch(len);
+        for (int i = 0; i < len; i++) {
+            // Some leading zeroes, to be encoded as '1's
+            vch[i] = i < len % 3 ? 0 : InsecureRandBits(8);
+        }
+        vvch.push_back(vch);
+    }
+    std::vector<std::string> vstr = EncodeBase58CheckBatch(vvch);
+    BOOST_REQUIRE_EQUAL(vstr.size(), vvch.size());
+    for (size_t i = 0; i < vvch.size(); i++) {
+        BOOST_CHECK_EQUAL(vstr[i], EncodeBase58Check(vvch[i]));
+        std::vector<unsigned char> vchRet;
+        BOOST_CHECK(DecodeBase58Check(vstr[i], vchRet));
+        BOOST_CHECK(vchRet == vvch[i]);
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <core_memusage.h>
+#include <primitives/block.h>
+#include <validation.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, TestChain100Setup)
+
+static std::shared_ptr<const CBlock> ReadBlock(int nHeight)
+{
+    LOCK(cs_main);
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    BOOST_REQUIRE(ReadBlockFromDisk(*block, chainActive[nHeight], Params().GetConsensus()));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_evict)
+{
+    std::shared_ptr<const CBlock> block1 = ReadBlock(1);
+    std::shared_ptr<const CBlock> block2 = ReadBlock(2);
+    std::shared_ptr<const CBlock> block3 = ReadBlock(3);
+
+    // Room for two blocks
+    const size_t nBlockBytes = RecursiveDynamicUsage(block1);
+    CBlockCache cache(nBlockBytes * 2 + nBlockBytes / 2);
+
+    cache.Insert(block1);
+    cache.Insert(block2);
+    BOOST_CHECK(cache.Get(block1->GetHash()) == block1);
+
+    // block2 is the least recently used
+    cache.Insert(block3);
+    BOOST_CHECK(cache.Get(block1->GetHash()) == block1);
+    BOOST_CHECK(!cache.Get(block2->GetHash()));
+    BOOST_CHECK(cache.Get(block3->GetHash()) == block3);
+
+    BlockCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 2U);
+    BOOST_CHECK(stats.nBytes <= stats.nMaxBytes);
+    BOOST_CHECK_EQUAL(stats.nHits, 3U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+
+    cache.Erase(block1->GetHash());
+    BOOST_CHECK(!cache.Get(block1->GetHash()));
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 1U);
+
+    // Disabled
+    cache.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 0U);
+    cache.Insert(block1);
+    BOOST_CHECK(!cache.Get(block1->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_read)
+{
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive[10];
+    }
+
+    g_blockcache.SetMaxSize(DEFAULT_BLOCK_CACHE_SIZE << 20);
+    g_blockcache.Clear();
+
+    BlockCacheStats before = g_blockcache.GetStats();
+    std::shared_ptr<const CBlock> block = ReadBlockCached(pindex, Params().GetConsensus());
+    BOOST_REQUIRE(block);
+    BOOST_CHECK(block->GetHash() == pindex->GetBlockHash());
+
+    // The second lookup is the same decoded block
+    BOOST_CHECK(ReadBlockCached(pindex, Params().GetConsensus()) == block);
+    BlockCacheStats after = g_blockcache.GetStats();
+    BOOST_CHECK_EQUAL(after.nMisses, before.nMisses + 1);
+    BOOST_CHECK_EQUAL(after.nHits, before.nHits + 1);
+
+    // Invalidating the block drops it
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), pindex));
+    }
+    BOOST_CHECK(!g_blockcache.Get(pindex->GetBlockHash()));
+
+    {
+        LOCK(cs_main);
+        ResetBlockFailureFlags(pindex);
+    }
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    g_blockcache.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
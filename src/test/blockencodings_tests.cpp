@@ -317,6 +317,45 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(CriticalDataExtraTxnTest)
+{
+    CTxMemPool pool;
+    CBlock block(BuildBlockTestCase());
+
+    // Replace the first transaction after the coinbase with one that has
+    // critical data, and only make it available through the extra pool
+    CMutableTransaction mtx(*block.vtx[1]);
+    mtx.nVersion = 3;
+    mtx.criticalData.hashCritical = InsecureRand256();
+    block.vtx[1] = MakeTransactionRef(std::move(mtx));
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())) ++block.nNonce;
+
+    // Unused slots of the extra pool are empty and must be skipped
+    std::vector<std::pair<uint256, CTransactionRef>> extra(3);
+    extra[1] = std::make_pair(block.vtx[1]->GetWitnessHash(), block.vtx[1]);
+    extra[2] = std::make_pair(block.vtx[2]->GetWitnessHash(), block.vtx[2]);
+
+    CBlockHeaderAndShortTxIDs shortIDs(block, true);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+    BOOST_CHECK_EQUAL(partialBlock.GetExtraCount(), 2U);
+    BOOST_CHECK_EQUAL(partialBlock.GetCriticalExtraCount(), 1U);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -0,0 +1,65 @@
+// Copyright (c) 2017-2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprefetch.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <uint256.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockprefetch_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockprefetch_get)
+{
+    CBlockPrefetcher prefetcher(Params().GetConsensus(), 2, 8);
+    prefetcher.Start();
+
+    std::vector<std::pair<uint256, CDiskBlockPos>> vBlock;
+    {
+        LOCK(cs_main);
+        for (int i = 1; i <= 10; i++)
+            vBlock.emplace_back(chainActive[i]->GetBlockHash(), chainActive[i]->GetBlockPos());
+    }
+
+    // Only the first 8 blocks are read ahead
+    prefetcher.Prefetch(vBlock);
+
+    // Blocks that weren't requested aren't returned
+    BOOST_CHECK(!prefetcher.Get(vBlock.back().first));
+    BOOST_CHECK(!prefetcher.Get(uint256()));
+
+    // Wait for the last block we asked for, the ones before it have been
+    // picked up by then
+    std::shared_ptr<const CBlock> block = nullptr;
+    while (!block) {
+        block = prefetcher.Get(vBlock[7].first);
+        if (!block) {
+            // Not started yet, ask again
+            prefetcher.Prefetch(std::vector<std::pair<uint256, CDiskBlockPos>>(vBlock.begin() + 1, vBlock.end()));
+            MilliSleep(10);
+        }
+    }
+    BOOST_CHECK(block->GetHash() == vBlock[7].first);
+    BOOST_CHECK(block->fChecked);
+
+    // A block is only handed out once
+    BOOST_CHECK(!prefetcher.Get(vBlock[7].first));
+
+    // Blocks of the old list are dropped
+    std::vector<std::pair<uint256, CDiskBlockPos>> vNew(vBlock.begin() + 9, vBlock.end());
+    prefetcher.Prefetch(vNew);
+    for (size_t i = 0; i < 8; i++)
+        BOOST_CHECK(!prefetcher.Get(vBlock[i].first));
+
+    prefetcher.Interrupt();
+    prefetcher.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,193 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/skydoge-config.h>
+#endif
+
+#include <blockfilemap.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <txdb.h>
+#include <txindex.h>
+#include <validation.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockread_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockread_raw)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+
+    // The raw block is the block as it is serialized
+    std::vector<uint8_t> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindex, Params().MessageStart()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK(std::vector<uint8_t>(ss.begin(), ss.end()) == vchBlock);
+
+    CBlock blockRaw;
+    CDataStream(vchBlock, SER_NETWORK, PROTOCOL_VERSION) >> blockRaw;
+    BOOST_CHECK(blockRaw.GetHash() == pindex->GetBlockHash());
+
+    // The magic in front of the block is checked
+    CMessageHeader::MessageStartChars wrong_start;
+    memcpy(wrong_start, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    wrong_start[0] ^= 0xff;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pindex, wrong_start));
+}
+
+BOOST_AUTO_TEST_CASE(blockread_trusted)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+        BOOST_CHECK(pindex->IsValid(BLOCK_VALID_SCRIPTS));
+    }
+
+    // A validated block is read without checking its proof of work, and
+    // comes back as the same block
+    CBlock block, blockChecked;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    BOOST_CHECK(ReadBlockFromDisk(blockChecked, pindex, Params().GetConsensus(), true /* fCheckPoW */));
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION), ssChecked(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    ssChecked << blockChecked;
+    BOOST_CHECK(ss.str() == ssChecked.str());
+
+    // Unless the header on disk isn't the one in the index
+    CBlockIndex index = *pindex;
+    index.nNonce ^= 1;
+    BOOST_CHECK(!ReadBlockFromDisk(block, &index, Params().GetConsensus()));
+}
+
+BOOST_AUTO_TEST_CASE(blockread_mapped)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    const CDiskBlockPos pos = pindex->GetBlockPos();
+
+    CBlockFileMap blockfilemap(1);
+    std::shared_ptr<const CMappedBlockFile> file = blockfilemap.Get(pos.nFile);
+    BOOST_REQUIRE(file);
+    BOOST_CHECK(blockfilemap.Get(pos.nFile) == file);
+    BOOST_REQUIRE(pos.nPos < file->size());
+
+    CBlock block;
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, file->data() + pos.nPos, file->size() - pos.nPos);
+    reader >> block;
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+
+    // The map stays valid for its readers once dropped
+    blockfilemap.Remove(pos.nFile);
+    CBlock blockAgain;
+    CSpanReader(SER_DISK, CLIENT_VERSION, file->data() + pos.nPos, file->size() - pos.nPos) >> blockAgain;
+    BOOST_CHECK(blockAgain.GetHash() == block.GetHash());
+    BOOST_CHECK(blockfilemap.Get(pos.nFile) != file);
+
+    // Reading past the end throws
+    CSpanReader readerShort(SER_DISK, CLIENT_VERSION, file->data() + pos.nPos, 80);
+    BOOST_CHECK_THROW(readerShort >> blockAgain, std::ios_base::failure);
+
+    // A file that doesn't exist isn't mapped
+    BOOST_CHECK(!blockfilemap.Get(pos.nFile + 1));
+}
+
+#if USE_ZLIB
+BOOST_AUTO_TEST_CASE(blockread_compressed)
+{
+    // A block paying to a long, repetitive script compresses well
+    nBlockCompressLevel = 9;
+    CScript scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(2000, 0x42);
+    CBlock block = CreateAndProcessBlock({}, scriptPubKey);
+    nBlockCompressLevel = DEFAULT_BLOCK_COMPRESS_LEVEL;
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    BOOST_REQUIRE(pindex->GetBlockHash() == block.GetHash());
+
+    // The record is flagged and smaller than the block
+    const CDiskBlockPos pos = pindex->GetBlockPos();
+    CAutoFile file(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    unsigned int nSize;
+    file >> nSize;
+    BOOST_CHECK(nSize & RECORD_COMPRESSED_FLAG);
+    BOOST_CHECK((nSize & ~RECORD_COMPRESSED_FLAG) < ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+
+    // It reads back as the block, also as a raw block
+    CBlock blockRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pindex, Params().GetConsensus(), true /* fCheckPoW */));
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+
+    std::vector<uint8_t> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindex, Params().MessageStart()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK(std::vector<uint8_t>(ss.begin(), ss.end()) == vchBlock);
+}
+
+BOOST_AUTO_TEST_CASE(blockread_txindex_compressed)
+{
+    // The -txindex offsets of a compressed block are into the inflated block
+    nBlockCompressLevel = 9;
+    CScript scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(2000, 0x42);
+    CBlock block = CreateAndProcessBlock({}, scriptPubKey);
+    nBlockCompressLevel = DEFAULT_BLOCK_COMPRESS_LEVEL;
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    BOOST_REQUIRE(pindex->GetBlockHash() == block.GetHash());
+
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    GetTxIndexPositions(block, pindex, vPos);
+    BOOST_REQUIRE_EQUAL(vPos.size(), block.vtx.size());
+    for (const std::pair<uint256, CDiskTxPos>& pos : vPos) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        BOOST_CHECK(ReadTxFromDisk(pos.second, tx, hashBlock));
+        BOOST_CHECK(tx && tx->GetHash() == pos.first);
+        BOOST_CHECK(hashBlock == block.GetHash());
+    }
+
+    // And the positions of an uncompressed block still read the same way
+    block = CreateAndProcessBlock({}, scriptPubKey);
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    GetTxIndexPositions(block, pindex, vPos);
+    CTransactionRef tx;
+    uint256 hashBlock;
+    BOOST_CHECK(ReadTxFromDisk(vPos.back().second, tx, hashBlock));
+    BOOST_CHECK(tx && tx->GetHash() == vPos.back().first);
+    BOOST_CHECK(hashBlock == block.GetHash());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
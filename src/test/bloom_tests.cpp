@@ -456,6 +456,51 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     BOOST_CHECK(!filter.contains(COutPoint(uint256S("0x02981fa052f0481dbc5868f4fc2166035a10f27a03cfd2de67326471df5bc041"), 0)));
 }
 
+BOOST_AUTO_TEST_CASE(bloom_match_pushdata)
+{
+    // Data elements are found whatever push opcode they were pushed with
+    std::vector<unsigned char> vData(80, 0x42);
+    for (opcodetype opcode : {OP_PUSHDATA1, OP_PUSHDATA2, OP_PUSHDATA4}) {
+        CScript scriptSig;
+        scriptSig << OP_0 << OP_CHECKSIG;
+        scriptSig.push_back(opcode);
+        if (opcode == OP_PUSHDATA1) {
+            scriptSig.push_back(vData.size());
+        } else if (opcode == OP_PUSHDATA2) {
+            scriptSig.push_back(vData.size());
+            scriptSig.push_back(0);
+        } else {
+            scriptSig.push_back(vData.size());
+            scriptSig.push_back(0);
+            scriptSig.push_back(0);
+            scriptSig.push_back(0);
+        }
+        scriptSig.insert(scriptSig.end(), vData.begin(), vData.end());
+
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        mtx.vin[1].scriptSig = scriptSig;
+        mtx.vout.emplace_back(0, CScript() << OP_TRUE);
+        CTransaction tx(mtx);
+
+        CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+        filter.insert(std::vector<unsigned char>(80, 0x43));
+        BOOST_CHECK(!filter.IsRelevantAndUpdate(tx));
+        filter.insert(vData);
+        BOOST_CHECK(filter.IsRelevantAndUpdate(tx));
+    }
+
+    // A truncated push ends the script, and is not an element
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].scriptSig.push_back(OP_PUSHDATA1);
+    mtx.vin[0].scriptSig.push_back(vData.size() + 1);
+    mtx.vin[0].scriptSig.insert(mtx.vin[0].scriptSig.end(), vData.begin(), vData.end());
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(vData);
+    BOOST_CHECK(!filter.IsRelevantAndUpdate(CTransaction(mtx)));
+}
+
 static std::vector<unsigned char> RandomData()
 {
     uint256 r = InsecureRand256();
@@ -5,9 +5,13 @@
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <keystore.h>
+#include <miner.h>
+#include <pow.h>
 #include <random.h>
+#include <rpc/server.h>
 #include <script/sign.h>
 #include <sidechain.h>
+#include <sidechaindb.h>
 #include <uint256.h>
 #include <utilstrencodings.h>
 #include <validation.h>
@@ -16,6 +20,59 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <univalue.h>
+
+/** Mine a block on the tip whose coinbase commits to each h* in vBMM for
+ * nSidechain, without any BMM request transactions */
+static CBlock CreateAndProcessBMMBlock(const std::vector<uint256>& vBMM, uint8_t nSidechain)
+{
+    const CChainParams& chainparams = Params();
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript() << OP_TRUE);
+    CBlock& block = pblocktemplate->block;
+    block.vtx.resize(1);
+
+    // BMM request bytes end with the last 4 bytes of the prev block hash
+    const unsigned char* pPrev = block.hashPrevBlock.begin();
+    CoinbaseCommitments commitments;
+    for (const uint256& hashBMM : vBMM) {
+        CCriticalData data;
+        data.hashCritical = hashBMM;
+        data.vBytes = {0x00, 0xbf, 0x00, nSidechain, pPrev[3], pPrev[2], pPrev[1], pPrev[0]};
+        commitments.vCriticalData.push_back(data);
+    }
+    commitments.AddToCoinbase(block);
+
+    unsigned int extraNonce = 0;
+    {
+        LOCK(cs_main);
+        IncrementExtraNonce(&block, chainActive.Tip(), extraNonce);
+    }
+
+    while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+
+    ProcessNewBlock(chainparams, std::make_shared<const CBlock>(block), true, nullptr);
+    return block;
+}
+
+static UniValue VerifyBMMBatch(const uint256& hashBlock, const std::vector<uint256>& vBMM, uint8_t nSidechain)
+{
+    UniValue requests(UniValue::VARR);
+    for (const uint256& hashBMM : vBMM) {
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("blockhash", hashBlock.GetHex()));
+        req.push_back(Pair("bmmhash", hashBMM.GetHex()));
+        req.push_back(Pair("nsidechain", nSidechain));
+        requests.push_back(req);
+    }
+
+    JSONRPCRequest request;
+    request.strMethod = "verifybmmbatch";
+    request.params = UniValue(UniValue::VARR);
+    request.params.push_back(requests);
+    request.fHelp = false;
+    return tableRPC["verifybmmbatch"]->actor(request);
+}
+
 BOOST_FIXTURE_TEST_SUITE(bmm_tests, TestChain100Setup)
 
 BOOST_AUTO_TEST_CASE(bmm_commit)
@@ -399,4 +456,48 @@ BOOST_AUTO_TEST_CASE(bmm_prevbytes_mempool)
     mempool.removeRecursive(CTransaction(mtx));
 }
 
+BOOST_AUTO_TEST_CASE(bmm_index_verifybmmbatch)
+{
+    const bool fBMMIndexOld = fBMMIndex;
+    fBMMIndex = true;
+
+    // A coinbase may commit to more than one h* for the same sidechain, the
+    // index has to find all of them, like reading the block does
+    const uint256 hashBMM1 = GetRandHash();
+    const uint256 hashBMM2 = GetRandHash();
+    const CBlock block = CreateAndProcessBMMBlock({hashBMM1, hashBMM2}, 0);
+    const uint256 hashBlock = block.GetHash();
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == hashBlock);
+    }
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "test";
+    proposal.description = "description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+    BOOST_REQUIRE(ActivateSidechain(scdb, proposal, 0));
+
+    const uint256 hashOther = GetRandHash();
+    const std::vector<uint256> vBMM = {hashBMM1, hashBMM2, hashOther};
+
+    // Answered from -bmmindex, then from the block on disk
+    for (bool fIndex : {true, false}) {
+        fBMMIndex = fIndex;
+        UniValue ret = VerifyBMMBatch(hashBlock, vBMM, 0);
+        BOOST_REQUIRE_EQUAL(ret.size(), 3U);
+        for (size_t i = 0; i < 2; i++) {
+            BOOST_CHECK(find_value(ret[i], "found").get_bool());
+            BOOST_CHECK_EQUAL(find_value(ret[i], "txid").get_str(), block.vtx[0]->GetHash().ToString());
+        }
+        BOOST_CHECK(!find_value(ret[2], "found").get_bool());
+        BOOST_CHECK_EQUAL(find_value(ret[2], "error").get_str(), "h* not found in block");
+    }
+
+    fBMMIndex = fBMMIndexOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
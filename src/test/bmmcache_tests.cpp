@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bmmcache.h>
+#include <chain.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <sidechain.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(bmmcache_tests, BasicTestingSetup)
+
+/** Feeds blocks to the cache directly, instead of through the scheduler */
+struct TestBMMCache : public CBMMCache
+{
+    using CBMMCache::CBMMCache;
+    using CBMMCache::BlockConnected;
+    using CBMMCache::BlockDisconnected;
+};
+
+/** A block with a BMM commitment of hashBMM for nSidechain in its coinbase */
+static std::shared_ptr<CBlock> MakeBMMBlock(const uint256& hashBMM, uint8_t nSidechain)
+{
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    block->hashPrevBlock = GetRandHash();
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(1);
+    block->vtx.push_back(MakeTransactionRef(std::move(mtx)));
+
+    // BMM request bytes end with the last 4 bytes of the prev block hash
+    const unsigned char* pPrev = block->hashPrevBlock.begin();
+    CCriticalData data;
+    data.hashCritical = hashBMM;
+    data.vBytes = {0x00, 0xbf, 0x00, nSidechain, pPrev[3], pPrev[2], pPrev[1], pPrev[0]};
+
+    CoinbaseCommitments commitments;
+    commitments.vCriticalData.push_back(data);
+    commitments.AddToCoinbase(*block);
+
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_connect_disconnect)
+{
+    TestBMMCache cache(2);
+
+    const uint256 hashBMM = GetRandHash();
+    std::shared_ptr<CBlock> block = MakeBMMBlock(hashBMM, 1);
+    const uint256 hashBlock = block->GetHash();
+    CBlockIndex index(*block);
+    index.phashBlock = &hashBlock;
+    index.nHeight = 10;
+
+    bool fFound = false;
+    uint256 txidCoinbase;
+    BOOST_CHECK(!cache.Lookup(hashBlock, 1, hashBMM, fFound, txidCoinbase));
+
+    cache.BlockConnected(block, &index, {});
+    BOOST_CHECK(cache.Lookup(hashBlock, 1, hashBMM, fFound, txidCoinbase));
+    BOOST_CHECK(fFound);
+    BOOST_CHECK(txidCoinbase == block->vtx[0]->GetHash());
+
+    // Cached, but no commitment for another sidechain or h*
+    BOOST_CHECK(cache.Lookup(hashBlock, 2, hashBMM, fFound, txidCoinbase));
+    BOOST_CHECK(!fFound);
+    BOOST_CHECK(cache.Lookup(hashBlock, 1, GetRandHash(), fFound, txidCoinbase));
+    BOOST_CHECK(!fFound);
+
+    // Already connected h* is found without waiting
+    BMMCacheResult result;
+    BOOST_CHECK(cache.WaitForBMM(hashBMM, 1, 1, result));
+    BOOST_CHECK(result.hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(result.nHeight, 10);
+    BOOST_CHECK(!cache.WaitForBMM(hashBMM, 2, 1, result));
+
+    cache.BlockDisconnected(block);
+    BOOST_CHECK(!cache.Lookup(hashBlock, 1, hashBMM, fFound, txidCoinbase));
+    BOOST_CHECK(!cache.WaitForBMM(hashBMM, 1, 1, result));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_eviction)
+{
+    TestBMMCache cache(2);
+
+    std::vector<std::shared_ptr<CBlock>> vBlock;
+    std::vector<uint256> vHash(3);
+    std::vector<uint256> vBMM;
+    for (size_t i = 0; i < 3; i++) {
+        vBMM.push_back(GetRandHash());
+        vBlock.push_back(MakeBMMBlock(vBMM.back(), 0));
+        vHash[i] = vBlock.back()->GetHash();
+
+        CBlockIndex index(*vBlock.back());
+        index.phashBlock = &vHash[i];
+        index.nHeight = i;
+        cache.BlockConnected(vBlock.back(), &index, {});
+    }
+
+    // The oldest block is dropped
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    bool fFound = false;
+    uint256 txidCoinbase;
+    BMMCacheResult result;
+    BOOST_CHECK(!cache.Lookup(vHash[0], 0, vBMM[0], fFound, txidCoinbase));
+    BOOST_CHECK(!cache.WaitForBMM(vBMM[0], 0, 1, result));
+    BOOST_CHECK(cache.Lookup(vHash[2], 0, vBMM[2], fFound, txidCoinbase));
+    BOOST_CHECK(fFound);
+}
+
+BOOST_AUTO_TEST_CASE(bmmcache_wait)
+{
+    TestBMMCache cache(10);
+
+    const uint256 hashBMM = GetRandHash();
+    std::shared_ptr<CBlock> block = MakeBMMBlock(hashBMM, 3);
+    const uint256 hashBlock = block->GetHash();
+
+    BMMCacheResult result;
+    bool fWaited = false;
+    std::thread waiter([&cache, &hashBMM, &result, &fWaited] {
+        fWaited = cache.WaitForBMM(hashBMM, 3, 0, result);
+    });
+
+    CBlockIndex index(*block);
+    index.phashBlock = &hashBlock;
+    cache.BlockConnected(block, &index, {});
+
+    waiter.join();
+    BOOST_CHECK(fWaited);
+    BOOST_CHECK(result.hashBlock == hashBlock);
+
+    // Interrupt wakes up waiters that would never return
+    std::thread waiterNever([&cache, &fWaited, &result] {
+        fWaited = cache.WaitForBMM(GetRandHash(), 3, 0, result);
+    });
+    cache.Interrupt();
+    waiterNever.join();
+    BOOST_CHECK(!fWaited);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <pow.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <mutex>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(chaintips_tests, TestChain100Setup)
+
+/** Records the hashes of the fork tips announced */
+struct ForkTipSubscriber : public CValidationInterface
+{
+    std::mutex cs;
+    std::vector<uint256> vHash;
+
+    void NewForkTip(const CBlockIndex* pindex) override
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        vHash.push_back(pindex->GetBlockHash());
+    }
+};
+
+/** A valid header on top of pindexPrev, nSalt tells apart siblings */
+static CBlockHeader MineHeader(const CBlockIndex* pindexPrev, uint32_t nSalt)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    CBlockHeader header;
+    header.nVersion = pindexPrev->nVersion;
+    header.hashPrevBlock = pindexPrev->GetBlockHash();
+    header.hashMerkleRoot = ArithToUint256(arith_uint256(nSalt));
+    header.nTime = pindexPrev->GetBlockTime() + 1;
+    header.nBits = GetNextWorkRequired(pindexPrev, &header, params);
+    while (!CheckProofOfWork(header.GetPoWHash(), header.nBits, params))
+        ++header.nNonce;
+    return header;
+}
+
+static const CBlockIndex* AcceptHeader(const CBlockHeader& header)
+{
+    CValidationState state;
+    const CBlockIndex* pindex = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders({header}, state, Params(), &pindex));
+    return pindex;
+}
+
+BOOST_AUTO_TEST_CASE(chaintips_tracked_incrementally)
+{
+    ForkTipSubscriber subscriber;
+    RegisterValidationInterface(&subscriber, "forktips");
+
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        BOOST_CHECK(setBlockIndexTips == std::set<CBlockIndex*>({chainActive.Tip()}));
+    }
+
+    // A header on the tip moves the tip without a notification
+    const CBlockIndex* pindexNext = AcceptHeader(MineHeader(pindexTip, 1));
+    BOOST_REQUIRE(pindexNext);
+    // Two headers forking off below the tip start two branches
+    const CBlockIndex* pindexFork1 = AcceptHeader(MineHeader(pindexTip->pprev, 2));
+    const CBlockIndex* pindexFork2 = AcceptHeader(MineHeader(pindexTip->pprev, 3));
+    BOOST_REQUIRE(pindexFork1 && pindexFork2);
+    // Extending a branch moves its tip
+    const CBlockIndex* pindexFork1Next = AcceptHeader(MineHeader(pindexFork1, 4));
+    BOOST_REQUIRE(pindexFork1Next);
+    // Accepting a known header again changes nothing
+    BOOST_CHECK(AcceptHeader(MineHeader(pindexFork2, 5)));
+    BOOST_CHECK(AcceptHeader(MineHeader(pindexFork2, 5)));
+
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(setBlockIndexTips.size(), 3U);
+        BOOST_CHECK(setBlockIndexTips.count(const_cast<CBlockIndex*>(pindexNext)));
+        BOOST_CHECK(setBlockIndexTips.count(const_cast<CBlockIndex*>(pindexFork1Next)));
+        BOOST_CHECK(!setBlockIndexTips.count(const_cast<CBlockIndex*>(pindexFork1)));
+        BOOST_CHECK(!setBlockIndexTips.count(const_cast<CBlockIndex*>(pindexTip)));
+    }
+
+    SyncWithValidationInterfaceQueue();
+    UnregisterValidationInterface(&subscriber);
+    BOOST_CHECK(subscriber.vHash == std::vector<uint256>({pindexFork1->GetBlockHash(), pindexFork2->GetBlockHash()}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -16,6 +16,7 @@
 #include <mutex>
 #include <condition_variable>
 
+#include <set>
 #include <unordered_set>
 #include <memory>
 #include <random.h>
@@ -125,6 +126,20 @@ struct FrozenCleanupCheck {
     void swap(FrozenCleanupCheck& x){std::swap(should_freeze, x.should_freeze);};
 };
 
+struct ThreadCheck {
+    static std::mutex m;
+    static std::set<std::thread::id> threads;
+    bool operator()()
+    {
+        // Long enough for idle workers to steal from the queue
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        std::lock_guard<std::mutex> l(m);
+        threads.insert(std::this_thread::get_id());
+        return true;
+    }
+    void swap(ThreadCheck& x){};
+};
+
 // Static Allocations
 std::mutex FrozenCleanupCheck::m{};
 std::atomic<uint64_t> FrozenCleanupCheck::nFrozen{0};
@@ -133,7 +148,8 @@ std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
-
+std::mutex ThreadCheck::m;
+std::set<std::thread::id> ThreadCheck::threads;
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
 typedef CCheckQueue<FakeCheck> Standard_Queue;
@@ -141,6 +157,7 @@ typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
+typedef CCheckQueue<ThreadCheck> Thread_Queue;
 
 
 /** This test case checks that the CCheckQueue works properly
@@ -209,6 +226,57 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
     Correct_Queue_range(range);
 }
 
+/** Test that the checks are all run with more workers than worker queues,
+ * which then share queues
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Shared_Queues)
+{
+    auto queue = std::unique_ptr<Correct_Queue>(new Correct_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (unsigned int x = 0; x < CHECKQUEUE_MAX_WORKER_QUEUES + 4; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    std::vector<FakeCheckCheckCompletion> vChecks;
+    for (size_t i : {1, 1000, 10000}) {
+        size_t total = i;
+        FakeCheckCheckCompletion::n_calls = 0;
+        CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+        while (total) {
+            vChecks.resize(std::min(total, (size_t) InsecureRandRange(10)));
+            total -= vChecks.size();
+            control.Add(vChecks);
+        }
+        BOOST_REQUIRE(control.Wait());
+        BOOST_REQUIRE_EQUAL(FakeCheckCheckCompletion::n_calls, i);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+/** Test that idle workers steal from the queue a single batch was put on
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Steal)
+{
+    auto queue = std::unique_ptr<Thread_Queue>(new Thread_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (auto x = 0; x < 3; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    // Let the workers start and wait for checks
+    MilliSleep(50);
+
+    ThreadCheck::threads.clear();
+    {
+        CCheckQueueControl<ThreadCheck> control(queue.get());
+        std::vector<ThreadCheck> vChecks(2000);
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait());
+    }
+    // All checks went to one queue, others than its owner ran some of them
+    BOOST_CHECK(ThreadCheck::threads.size() > 1);
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 /** Test that failing checks are caught */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
@@ -8,6 +8,7 @@
 #include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_skydoge.h>
+#include <txdb.h>
 #include <validation.h>
 #include <consensus/validation.h>
 
@@ -859,4 +860,153 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_FIXTURE_TEST_CASE(coins_background_flush, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewBackgroundFlush flush(&db, &db);
+    CCoinsViewCache cache(&flush);
+
+    std::vector<COutPoint> vOutPoint;
+    for (int i = 0; i < 100; i++) {
+        vOutPoint.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(vOutPoint.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+    }
+    const uint256 hashBlock1 = InsecureRand256();
+    cache.SetBestBlock(hashBlock1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // The coins can be looked up whether they have been written yet or not
+    for (size_t i = 0; i < vOutPoint.size(); i++)
+        BOOST_CHECK_EQUAL(cache.AccessCoin(vOutPoint[i]).out.nValue, (CAmount)i + 1);
+    BOOST_CHECK(flush.GetBestBlock() == hashBlock1);
+
+    // Spend half of them, the next flush waits for the first one
+    for (size_t i = 0; i < vOutPoint.size(); i += 2)
+        BOOST_CHECK(cache.SpendCoin(vOutPoint[i], false));
+    const uint256 hashBlock2 = InsecureRand256();
+    cache.SetBestBlock(hashBlock2);
+    BOOST_CHECK(cache.Flush());
+    for (size_t i = 0; i < vOutPoint.size(); i++)
+        BOOST_CHECK_EQUAL(flush.HaveCoin(vOutPoint[i]), i % 2 == 1);
+
+    BOOST_CHECK(flush.Sync());
+    BOOST_CHECK_EQUAL(flush.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetBestBlock() == hashBlock2);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (size_t i = 0; i < vOutPoint.size(); i++)
+        BOOST_CHECK_EQUAL(db.HaveCoin(vOutPoint[i]), i % 2 == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_prefetch, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::vector<COutPoint> vOutPoint;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 200; i++) {
+            vOutPoint.emplace_back(InsecureRand256(), 0);
+            cache.AddCoin(vOutPoint.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // One coin is cached already and some aren't in the database
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK(cache.HaveCoin(vOutPoint[0]));
+    std::vector<COutPoint> vPrefetch = vOutPoint;
+    for (int i = 0; i < 10; i++)
+        vPrefetch.emplace_back(InsecureRand256(), 0);
+
+    BOOST_CHECK_EQUAL(cache.Prefetch(vPrefetch, 4), vOutPoint.size() - 1);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), vOutPoint.size());
+    for (size_t i = 0; i < vOutPoint.size(); i++) {
+        BOOST_CHECK(cache.HaveCoinInCache(vOutPoint[i]));
+        BOOST_CHECK_EQUAL(cache.AccessCoin(vOutPoint[i]).out.nValue, (CAmount)i + 1);
+    }
+    BOOST_CHECK(!cache.HaveCoinInCache(vPrefetch.back()));
+
+    // Cached coins aren't looked up again
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK_EQUAL(cache.Prefetch(vPrefetch, 4), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nUsage);
+
+    // Spent coins aren't part of the saved coin cache
+    cache.SpendCoin(vOutPoint[1], false);
+    std::vector<COutPoint> vCached = cache.GetCachedOutPoints();
+    BOOST_CHECK_EQUAL(vCached.size(), vOutPoint.size() - 1);
+    BOOST_CHECK(std::find(vCached.begin(), vCached.end(), vOutPoint[0]) != vCached.end());
+    BOOST_CHECK(std::find(vCached.begin(), vCached.end(), vOutPoint[1]) == vCached.end());
+    BOOST_CHECK(cache.Flush());
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_format_guard, TestingSetup)
+{
+    // A new database is compact and carries a per-tx coins record that
+    // versions without the compact format fail to upgrade, so they refuse
+    // the database
+    const COutPoint outpoint(InsecureRand256(), 0);
+    {
+        CCoinsViewDB db(1 << 20, false, true /* fWipe */);
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(outpoint, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    {
+        CDBWrapper raw(GetDataDir() / "chainstate", 1 << 20, false, false, true /* obfuscate */);
+        unsigned char chGuard = 1;
+        BOOST_CHECK(raw.Read(std::make_pair('c', uint256()), chGuard));
+        BOOST_CHECK_EQUAL(chGuard, 0);
+    }
+
+    // Which doesn't get in the way of our own upgrade
+    CCoinsViewDB db(1 << 20);
+    BOOST_CHECK(db.Upgrade());
+    Coin coin;
+    BOOST_CHECK(db.GetCoin(outpoint, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 1);
+}
+
+BOOST_AUTO_TEST_CASE(coins_restore)
+{
+    CCoinsView base;
+    CCoinsViewCacheTest parent(&base);
+    COutPoint outExisting(InsecureRand256(), 0);
+    COutPoint outSpent(InsecureRand256(), 0);
+    parent.AddCoin(outExisting, Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+    parent.AddCoin(outSpent, Coin(CTxOut(2, CScript() << OP_TRUE), 1, false), false);
+    BOOST_CHECK(parent.SpendCoin(outSpent, false));
+
+    CCoinsViewCacheTest cache(&parent);
+    std::vector<std::pair<COutPoint, Coin>> vRestore;
+    vRestore.emplace_back(outExisting, Coin(CTxOut(3, CScript() << OP_TRUE), 2, false));
+    vRestore.emplace_back(outSpent, Coin(CTxOut(4, CScript() << OP_TRUE), 2, false));
+    vRestore.emplace_back(COutPoint(InsecureRand256(), 0), Coin(CTxOut(5, CScript() << OP_TRUE), 2, true));
+    vRestore.emplace_back(COutPoint(InsecureRand256(), 0), Coin(CTxOut(6, CScript() << OP_RETURN), 2, false));
+    const std::vector<std::pair<COutPoint, Coin>> vExpected = vRestore;
+
+    // Only the coin that is unspent in the parent is overwritten
+    BOOST_CHECK_EQUAL(cache.RestoreCoins(vRestore), 1U);
+    cache.SelfTest();
+    for (size_t i = 0; i < 3; i++) {
+        BOOST_CHECK(cache.HaveCoinInCache(vExpected[i].first));
+        BOOST_CHECK(cache.AccessCoin(vExpected[i].first).out == vExpected[i].second.out);
+        BOOST_CHECK_EQUAL(cache.AccessCoin(vExpected[i].first).nHeight, vExpected[i].second.nHeight);
+    }
+    BOOST_CHECK(!cache.HaveCoin(vExpected[3].first));
+
+    // Same result as restoring the coins one at a time
+    CCoinsViewCacheTest cacheSingle(&parent);
+    for (size_t i = 0; i < vExpected.size(); i++) {
+        Coin coin = vExpected[i].second;
+        cacheSingle.AddCoin(vExpected[i].first, std::move(coin), cacheSingle.HaveCoin(vExpected[i].first));
+    }
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), cacheSingle.GetCacheSize());
+    BOOST_CHECK_EQUAL(cache.usage(), cacheSingle.usage());
+    for (size_t i = 0; i < 3; i++)
+        BOOST_CHECK_EQUAL(cache.map().find(vExpected[i].first)->second.flags, cacheSingle.map().find(vExpected[i].first)->second.flags);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <clientversion.h>
 #include <compressor.h>
+#include <streams.h>
 #include <util.h>
 #include <test/test_skydoge.h>
 
@@ -24,6 +26,18 @@
 
 BOOST_FIXTURE_TEST_SUITE(compress_tests, BasicTestingSetup)
 
+static CScript RoundTripScript(const CScript& scriptIn, int nVersion, size_t& nSize)
+{
+    CDataStream ss(SER_DISK, nVersion);
+    CScript script(scriptIn);
+    ss << CScriptCompressor(script);
+    nSize = ss.size();
+    CScript scriptOut;
+    ss >> REF(CScriptCompressor(scriptOut));
+    BOOST_CHECK(ss.empty());
+    return scriptOut;
+}
+
 bool static TestEncode(uint64_t in) {
     return in == CTxOutCompressor::DecompressAmount(CTxOutCompressor::CompressAmount(in));
 }
@@ -62,4 +76,46 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+BOOST_AUTO_TEST_CASE(compress_scripts_compact)
+{
+    const int nLegacy = CLIENT_VERSION;
+    const int nCompact = CLIENT_VERSION | SERIALIZE_SCRIPT_COMPACT;
+    size_t nSize;
+
+    // P2WPKH and P2WSH get their own codes in the compact encoding only
+    CScript p2wpkh = CScript() << OP_0 << std::vector<unsigned char>(20, 0x11);
+    CScript p2wsh = CScript() << OP_0 << std::vector<unsigned char>(32, 0x22);
+    BOOST_CHECK(RoundTripScript(p2wpkh, nLegacy, nSize) == p2wpkh);
+    BOOST_CHECK_EQUAL(nSize, 1U + p2wpkh.size());
+    BOOST_CHECK(RoundTripScript(p2wpkh, nCompact, nSize) == p2wpkh);
+    BOOST_CHECK_EQUAL(nSize, 1U + 20U);
+    BOOST_CHECK(RoundTripScript(p2wsh, nLegacy, nSize) == p2wsh);
+    BOOST_CHECK_EQUAL(nSize, 1U + p2wsh.size());
+    BOOST_CHECK(RoundTripScript(p2wsh, nCompact, nSize) == p2wsh);
+    BOOST_CHECK_EQUAL(nSize, 1U + 32U);
+
+    // Sidechain escrow scripts come from the dictionary
+    for (int n = 0; n < 256; n += 17) {
+        CScript escrow;
+        escrow.resize(2);
+        escrow[0] = OP_DRIVECHAIN;
+        escrow[1] = n;
+        BOOST_CHECK(RoundTripScript(escrow, nLegacy, nSize) == escrow);
+        BOOST_CHECK_EQUAL(nSize, 1U + escrow.size());
+        BOOST_CHECK(RoundTripScript(escrow, nCompact, nSize) == escrow);
+        BOOST_CHECK(nSize <= 3U);
+    }
+
+    // Other scripts are stored raw in both, behind a larger size offset
+    CScript other = CScript() << OP_RETURN << std::vector<unsigned char>(40, 0x33);
+    BOOST_CHECK(RoundTripScript(other, nLegacy, nSize) == other);
+    BOOST_CHECK(RoundTripScript(other, nCompact, nSize) == other);
+
+    // Unknown dictionary entries are rejected
+    CDataStream ss(SER_DISK, nCompact);
+    ss << VARINT(8U) << VARINT(1000000U);
+    CScript script;
+    BOOST_CHECK_THROW(ss >> REF(CScriptCompressor(script)), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
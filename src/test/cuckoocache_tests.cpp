@@ -377,4 +377,38 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that insert reports the elements it evicts before they were used
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_eviction)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup(1 << 10);
+    std::vector<uint256> hashes(1 << 12);
+    for (uint256& h : hashes)
+        insecure_GetRandHash(h);
+
+    // Nothing is evicted while the cache is mostly empty
+    uint32_t nEvicted = 0;
+    for (size_t i = 0; i < 100; ++i)
+        nEvicted += cc.insert(hashes[i]);
+    BOOST_CHECK_EQUAL(nEvicted, 0);
+
+    // Overfilling the cache must evict about as many elements as don't fit
+    for (size_t i = 100; i < hashes.size(); ++i)
+        nEvicted += cc.insert(hashes[i]);
+    BOOST_CHECK(nEvicted >= hashes.size() - (1 << 10));
+    BOOST_CHECK(nEvicted <= hashes.size());
+
+    // Elements that were erased after use don't count as evicted
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc2{};
+    cc2.setup(1 << 10);
+    nEvicted = 0;
+    for (const uint256& h : hashes) {
+        nEvicted += cc2.insert(h);
+        cc2.contains(h, true);
+    }
+    BOOST_CHECK_EQUAL(nEvicted, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
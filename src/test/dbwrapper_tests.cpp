@@ -40,6 +40,32 @@ BOOST_AUTO_TEST_CASE(dbwrapper)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profile)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    const std::string strName = ph.filename().string();
+    {
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, DB_PROFILE_APPEND);
+        BOOST_CHECK_EQUAL(dbw.GetName(), strName);
+        BOOST_CHECK_EQUAL(std::string(dbw.GetProfile().name), "append");
+
+        for (int i = 0; i < 100; i++)
+            BOOST_CHECK(dbw.Write(std::make_pair('k', i), InsecureRand256()));
+        dbw.CompactAll();
+        BOOST_CHECK(!dbw.GetProperty("leveldb.stats").empty());
+        BOOST_CHECK(dbw.GetProperty("leveldb.no-such-property").empty());
+
+        // Listed while it is open
+        int nFound = 0;
+        ForEachDB([&](const CDBWrapper& db) { nFound += db.GetName() == strName; });
+        BOOST_CHECK_EQUAL(nFound, 1);
+    }
+
+    int nFound = 0;
+    ForEachDB([&](const CDBWrapper& db) { nFound += db.GetName() == strName; });
+    BOOST_CHECK_EQUAL(nFound, 0);
+}
+
 // Test batch operations
 BOOST_AUTO_TEST_CASE(dbwrapper_batch)
 {
@@ -77,6 +103,38 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_readmany)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (bool obfuscate : {false, true}) {
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        std::vector<uint256> vIn;
+        std::vector<std::pair<char, uint32_t>> vKey;
+        for (uint32_t i = 0; i < 10; i++) {
+            vIn.push_back(InsecureRand256());
+            vKey.push_back(std::make_pair('r', i));
+            // Leave every third key unwritten
+            if (i % 3 != 2)
+                BOOST_CHECK(dbw.Write(vKey.back(), vIn.back()));
+        }
+
+        std::vector<uint256> vRes;
+        std::vector<bool> vFound;
+        BOOST_CHECK_EQUAL(dbw.ReadMany(vKey, vRes, vFound), 7U);
+        BOOST_CHECK_EQUAL(vRes.size(), vKey.size());
+        BOOST_CHECK_EQUAL(vFound.size(), vKey.size());
+        for (size_t i = 0; i < vKey.size(); i++) {
+            BOOST_CHECK_EQUAL(vFound[i], i % 3 != 2);
+            if (vFound[i])
+                BOOST_CHECK_EQUAL(vRes[i].ToString(), vIn[i].ToString());
+            else
+                BOOST_CHECK(vRes[i].IsNull());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 {
     // Perform tests both obfuscated and non-obfuscated.
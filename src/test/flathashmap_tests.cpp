@@ -0,0 +1,167 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <flathashmap.h>
+#include <random.h>
+
+#include <test/test_skydoge.h>
+
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+//! Puts all keys into a few slots, to exercise probing and deleted slots
+struct CollidingHasher
+{
+    size_t operator()(int n) const { return (uint64_t)(n % 4) << 32; }
+};
+
+template <typename Map>
+void CheckEqual(const Map& map, const std::map<int, int>& expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    std::map<int, int> found;
+    for (const auto& entry : map)
+        BOOST_CHECK(found.emplace(entry.first, entry.second).second);
+    BOOST_CHECK(found == expected);
+    for (const auto& entry : expected) {
+        auto it = map.find(entry.first);
+        BOOST_CHECK(it != map.end() && it->second == entry.second);
+    }
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(flathashmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flathashmap_random_ops)
+{
+    flathashmap<int, int, CollidingHasher> map;
+    std::map<int, int> expected;
+
+    for (int i = 0; i < 20000; i++) {
+        const int nKey = InsecureRand32() % 500;
+        switch (InsecureRand32() % 4) {
+        case 0: {
+            auto ret = map.emplace(nKey, i);
+            BOOST_CHECK_EQUAL(ret.second, expected.emplace(nKey, i).second);
+            BOOST_CHECK_EQUAL(ret.first->second, expected[nKey]);
+            break;
+        }
+        case 1:
+            map[nKey] = i;
+            expected[nKey] = i;
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(nKey), expected.erase(nKey));
+            break;
+        case 3: {
+            auto it = map.find(nKey);
+            BOOST_CHECK_EQUAL(it != map.end(), expected.count(nKey) != 0);
+            break;
+        }
+        }
+        if (i % 1000 == 0)
+            CheckEqual(map, expected);
+    }
+    CheckEqual(map, expected);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_erase_while_iterating)
+{
+    flathashmap<int, int, std::hash<int>> map;
+    std::map<int, int> expected;
+    for (int i = 0; i < 1000; i++) {
+        map.emplace(i, i);
+        expected.emplace(i, i);
+    }
+
+    // Erase the odd keys, using both ways of advancing past erased entries
+    bool fPostIncrement = false;
+    for (auto it = map.begin(); it != map.end(); ) {
+        if (it->first % 2) {
+            expected.erase(it->first);
+            if (fPostIncrement) {
+                map.erase(it++);
+            } else {
+                it = map.erase(it);
+            }
+            fPostIncrement = !fPostIncrement;
+        } else {
+            it++;
+        }
+    }
+    CheckEqual(map, expected);
+
+    // Erased entries are reused
+    const size_t nUsage = map.DynamicMemoryUsage();
+    for (int i = 1; i < 1000; i += 2)
+        map.emplace(i, i);
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), nUsage);
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_stable_references)
+{
+    flathashmap<int, int, std::hash<int>> map;
+    std::vector<const int*> vValue;
+    for (int i = 0; i < 10000; i++)
+        vValue.push_back(&map.emplace(i, i).first->second);
+
+    // The index was rebuilt many times, the entries didn't move
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(&map.find(i)->second, vValue[i]);
+        BOOST_CHECK_EQUAL(*vValue[i], i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_coins)
+{
+    // The operations the coins cache uses
+    flathashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> map;
+    std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> expected;
+
+    std::vector<COutPoint> vOutPoint;
+    for (int i = 0; i < 1000; i++)
+        vOutPoint.emplace_back(InsecureRand256(), InsecureRand32() % 4);
+
+    for (const COutPoint& out : vOutPoint) {
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        Coin coinCopy = coin;
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(out), std::forward_as_tuple(std::move(coin)));
+        expected.emplace(std::piecewise_construct, std::forward_as_tuple(out), std::forward_as_tuple(std::move(coinCopy)));
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+
+    for (const COutPoint& out : vOutPoint) {
+        auto it = map.find(out);
+        BOOST_CHECK(it != map.end());
+        BOOST_CHECK_EQUAL(it->second.coin.out.nValue, expected.find(out)->second.coin.out.nValue);
+    }
+
+    // Spend half of them
+    for (size_t i = 0; i < vOutPoint.size(); i += 2) {
+        map.erase(vOutPoint[i]);
+        expected.erase(vOutPoint[i]);
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    for (const auto& entry : map)
+        BOOST_CHECK(expected.count(entry.first));
+
+    BOOST_CHECK(memusage::DynamicUsage(map) > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
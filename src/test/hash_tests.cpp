@@ -3,7 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <hash.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <streams.h>
 #include <utilstrencodings.h>
+#include <version.h>
 #include <test/test_skydoge.h>
 
 #include <vector>
@@ -147,4 +151,96 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockheader_hash_cache)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1600000000;
+    header.nBits = 0x207fffff;
+    header.nNonce = 7;
+
+    // Headers being built are never memoized
+    uint256 hash = header.GetHash();
+    BOOST_CHECK(header.hashCached.IsNull());
+    header.nNonce++;
+    BOOST_CHECK(header.GetHash() != hash);
+
+    // Deserialized headers memoize their hash on first use
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    CBlockHeader headerRead;
+    ss >> headerRead;
+    BOOST_CHECK(headerRead.hashCached.IsNull());
+    uint256 hashRead = headerRead.GetHash();
+    BOOST_CHECK(hashRead == header.GetHash());
+    BOOST_CHECK(headerRead.hashCached == hashRead);
+    BOOST_CHECK(headerRead.GetPoWHash() == hashRead);
+
+    // Copies share the cache
+    CBlock block(headerRead);
+    BOOST_CHECK(block.GetHash() == hashRead);
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == hashRead);
+
+    // Invalidation after modifying an immutable header
+    headerRead.nNonce++;
+    headerRead.InvalidateHash();
+    BOOST_CHECK(headerRead.GetHash() != hashRead);
+    BOOST_CHECK(headerRead.hashCached.IsNull());
+
+    headerRead.MarkImmutable();
+    BOOST_CHECK(headerRead.GetHash() == skydoge_hash(BEGIN(headerRead.nVersion), END(headerRead.nNonce)));
+    BOOST_CHECK(!headerRead.hashCached.IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(blockheader_hash_multi)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    std::vector<uint256> vExpected;
+    for (int i = 0; i < 10; i++) {
+        CBlockHeader header;
+        header.nVersion = 1;
+        header.hashPrevBlock = GetRandHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = 1600000000 + i;
+        header.nBits = 0x207fffff;
+        header.nNonce = i;
+        vExpected.push_back(header.GetHash());
+        ss << header;
+    }
+
+    std::vector<CBlockHeader> vHeader(vExpected.size());
+    for (CBlockHeader& header : vHeader)
+        ss >> header;
+
+    std::vector<uint256> vHash(vHeader.size());
+    skydoge_hash_multi(vHeader.data(), vHeader.size(), vHash.data());
+    BOOST_CHECK(vHash == vExpected);
+
+    // Results are memoized in the (deserialized) headers
+    for (size_t i = 0; i < vHeader.size(); i++)
+        BOOST_CHECK(vHeader[i].hashCached == vExpected[i]);
+}
+
+BOOST_AUTO_TEST_CASE(skydoge_header_midstate)
+{
+    CBlockHeader header;
+    header.nVersion = 0x20000000;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1600000000;
+    header.nBits = 0x207fffff;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    BOOST_CHECK_EQUAL(ss.size(), 80U);
+    CSkydogeHeaderHasher hasher((unsigned char*)&ss[0]);
+
+    for (uint32_t nNonce : {0U, 1U, 255U, 0x12345678U, 0xffffffffU}) {
+        header.nNonce = nNonce;
+        BOOST_CHECK(hasher.Hash(nNonce) == header.GetHash());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
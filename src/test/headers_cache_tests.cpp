@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <net_processing.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <validation.h>
+
+#include <test/test_skydoge.h>
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+/** The "headers" message as it was built before there was a cache */
+static std::vector<unsigned char> SerializeHeaders(const std::vector<const CBlockIndex*>& vIndex)
+{
+    std::vector<CBlock> vHeaders;
+    for (const CBlockIndex* pindex : vIndex)
+        vHeaders.push_back(pindex->GetBlockHeader());
+    std::vector<unsigned char> vData;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vData, 0, vHeaders);
+    return vData;
+}
+
+BOOST_FIXTURE_TEST_SUITE(headers_cache_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(headers_cache_serialization)
+{
+    LOCK(cs_main);
+
+    std::vector<const CBlockIndex*> vIndex;
+    for (int i = 50; i <= chainActive.Height(); i++)
+        vIndex.push_back(chainActive[i]);
+
+    // The same message when serialized and when copied out of the cache
+    const std::vector<unsigned char> vExpected = SerializeHeaders(vIndex);
+    BOOST_CHECK(MakeHeadersMsg(vIndex).data == vExpected);
+    BOOST_CHECK(MakeHeadersMsg(vIndex).data == vExpected);
+
+    // Including a message overlapping the cached range
+    std::vector<const CBlockIndex*> vOverlap(vIndex.begin() + 10, vIndex.end());
+    vOverlap.insert(vOverlap.begin(), chainActive[10]);
+    BOOST_CHECK(MakeHeadersMsg(vOverlap).data == SerializeHeaders(vOverlap));
+
+    BOOST_CHECK(MakeHeadersMsg({}).data == SerializeHeaders({}));
+}
+
+BOOST_AUTO_TEST_CASE(headers_cache_reused_index)
+{
+    LOCK(cs_main);
+
+    // A block index entry whose memory is reused for another block at the
+    // same height, as after the block index is unloaded, doesn't get the
+    // cached header of the first block
+    std::unique_ptr<CBlockIndex> pindex(new CBlockIndex(*chainActive.Tip()));
+    uint256 hash = pindex->GetBlockHeader().GetHash();
+    pindex->phashBlock = &hash;
+    BOOST_CHECK(MakeHeadersMsg({pindex.get()}).data == SerializeHeaders({pindex.get()}));
+
+    pindex->nNonce ^= 1;
+    hash = pindex->GetBlockHeader().GetHash();
+    BOOST_CHECK(MakeHeadersMsg({pindex.get()}).data == SerializeHeaders({pindex.get()}));
+    BOOST_CHECK(MakeHeadersMsg({chainActive.Tip()}).data == SerializeHeaders({chainActive.Tip()}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
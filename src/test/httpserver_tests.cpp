@@ -0,0 +1,26 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <httpserver.h>
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(httpserver_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(accept_encoding_gzip)
+{
+    BOOST_CHECK(AcceptEncodingHasGzip("gzip"));
+    BOOST_CHECK(AcceptEncodingHasGzip("deflate, gzip"));
+    BOOST_CHECK(AcceptEncodingHasGzip("GZIP;q=0.5"));
+    BOOST_CHECK(AcceptEncodingHasGzip("gzip ; q=1"));
+
+    BOOST_CHECK(!AcceptEncodingHasGzip(""));
+    BOOST_CHECK(!AcceptEncodingHasGzip("deflate, br"));
+    BOOST_CHECK(!AcceptEncodingHasGzip("x-gzip"));
+    BOOST_CHECK(!AcceptEncodingHasGzip("gzip;q=0"));
+    BOOST_CHECK(!AcceptEncodingHasGzip("deflate, gzip;q=0.000"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
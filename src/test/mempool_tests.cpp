@@ -3,12 +3,17 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <policy/policy.h>
+#include <random.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
 #include <txmempool.h>
 #include <util.h>
+#include <validation.h>
 
 #include <test/test_skydoge.h>
 
 #include <boost/test/unit_test.hpp>
+#include <limits>
 #include <list>
 #include <vector>
 
@@ -417,6 +422,44 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     CheckSort<ancestor_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolDepthAndScoreRanksTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // Two unrelated transactions and a parent with a high fee child
+    std::vector<uint256> vHash;
+    CAmount fees[] = {1000, 3000, 0};
+    for (CAmount fee : fees) {
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = (vHash.size() + 1) * COIN;
+        pool.addUnchecked(tx.GetHash(), entry.Fee(fee).FromTx(tx));
+        vHash.push_back(tx.GetHash());
+    }
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(vHash.back(), 0);
+    child.vin[0].scriptSig = CScript() << OP_11;
+    child.vout.resize(1);
+    child.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    child.vout[0].nValue = COIN;
+    pool.addUnchecked(child.GetHash(), entry.Fee(50000).FromTx(child));
+    vHash.insert(vHash.begin(), child.GetHash());
+    // Not in the mempool
+    vHash.insert(vHash.begin() + 2, InsecureRand256());
+
+    std::vector<uint64_t> vRank = pool.GetDepthAndScoreRanks(vHash);
+    BOOST_CHECK_EQUAL(vRank.size(), vHash.size());
+    BOOST_CHECK_EQUAL(vRank[2], std::numeric_limits<uint64_t>::max());
+    for (size_t i = 0; i < vHash.size(); i++) {
+        for (size_t j = 0; j < vHash.size(); j++) {
+            if (i != j)
+                BOOST_CHECK_EQUAL(vRank[i] < vRank[j], pool.CompareDepthAndScore(vHash[i], vHash[j]));
+        }
+    }
+}
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
@@ -571,4 +614,386 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolBMMRequestIndexTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // Activate sidechain 0, sidechain 1 stays inactive
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = GetRandHash();
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    BOOST_CHECK(ActivateSidechain(scdb, proposal, 0));
+
+    // Three BMM requests for sidechain 0 and one for sidechain 1
+    std::vector<CAmount> vFee = {1000, 3000, 2000, 4000};
+    std::vector<uint8_t> vSidechain = {0, 0, 0, 1};
+    std::vector<CMutableTransaction> vTx;
+    for (size_t i = 0; i < vFee.size(); i++) {
+        CScript bytes;
+        bytes.resize(8);
+        bytes[0] = 0x00;
+        bytes[1] = 0xbf;
+        bytes[2] = 0x00;
+        bytes[3] = vSidechain[i];
+
+        CMutableTransaction mtx;
+        mtx.nVersion = 3;
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        mtx.vout[0].nValue = i * COIN;
+        mtx.criticalData.vBytes = ToByteVector(bytes);
+        mtx.criticalData.hashCritical = GetRandHash();
+        BOOST_CHECK(mtx.criticalData.IsBMMRequest());
+
+        pool.addUnchecked(mtx.GetHash(), entry.Fee(vFee[i]).FromTx(mtx));
+        vTx.push_back(mtx);
+    }
+
+    // A transaction without critical data shouldn't be touched
+    CMutableTransaction txOther;
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txOther.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txOther.GetHash(), entry.Fee(10000LL).FromTx(txOther));
+
+    // The BMM requests of sidechain 0 are sorted by fee, highest first
+    {
+        LOCK(pool.cs);
+        std::vector<uint256> vOrder;
+        for (const CTxMemPool::txiter& it : pool.GetCriticalData())
+            vOrder.push_back(it->GetTx().GetHash());
+        BOOST_CHECK(vOrder == std::vector<uint256>({vTx[1].GetHash(), vTx[2].GetHash(), vTx[0].GetHash(), vTx[3].GetHash()}));
+    }
+
+    std::vector<uint256> vHashRemoved;
+    pool.RemoveInactiveBMMRequests(vHashRemoved);
+
+    // Only the request for the inactive sidechain is removed, outbid
+    // requests are left to the block assembler
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+    BOOST_CHECK(!pool.exists(vTx[3].GetHash()));
+    BOOST_CHECK(pool.exists(txOther.GetHash()));
+    BOOST_CHECK_EQUAL(vHashRemoved.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSidechainDepositChainTest)
+{
+    CTxMemPool pool;
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = GetRandHash();
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    BOOST_CHECK(ActivateSidechain(scdb, proposal, 0));
+
+    CScript sidechainScript;
+    BOOST_CHECK(scdb.GetSidechainScript(0, sidechainScript));
+
+    // The CTIP output of the latest deposit in the chain
+    SidechainCTIP ctipBlock;
+    ctipBlock.out = COutPoint(GetRandHash(), 0);
+    ctipBlock.amount = 1 * COIN;
+
+    // Three deposits, each spending the CTIP output of the previous one
+    std::vector<CTransactionRef> vDeposit;
+    COutPoint prevout = ctipBlock.out;
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = prevout;
+        mtx.vout.resize(2);
+        mtx.vout[0].scriptPubKey = sidechainScript;
+        mtx.vout[0].nValue = (i + 2) * COIN;
+        mtx.vout[1].scriptPubKey = CScript() << OP_RETURN << ToByteVector(std::string("dest"));
+        vDeposit.push_back(MakeTransactionRef(mtx));
+        prevout = COutPoint(mtx.GetHash(), 0);
+    }
+
+    // Add them out of order
+    for (int i : {2, 0, 1}) {
+        pool.addUnchecked(vDeposit[i]->GetHash(), CTxMemPoolEntry(vDeposit[i],
+                    1000LL, 0, 1, false, true, 0, 4, LockPoints()));
+    }
+
+    std::vector<CTxMemPool::txiter> vChain;
+    BOOST_CHECK(pool.GetSidechainDepositChain(0, vChain));
+    BOOST_CHECK_EQUAL(vChain.size(), 3U);
+    for (size_t i = 0; i < vChain.size() && i < vDeposit.size(); i++)
+        BOOST_CHECK(vChain[i]->GetTx().GetHash() == vDeposit[i]->GetHash());
+
+    // The chain continues from the block CTIP so the mempool CTIP is the
+    // output of the last deposit
+    std::map<uint8_t, SidechainCTIP> mapCTIP;
+    mapCTIP[0] = ctipBlock;
+    pool.UpdateCTIPFromBlock(mapCTIP, false);
+
+    SidechainCTIP ctip;
+    BOOST_CHECK(pool.GetMemPoolCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == COutPoint(vDeposit[2]->GetHash(), 0));
+    BOOST_CHECK_EQUAL(ctip.amount, 4 * COIN);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+
+    // A block CTIP that the chain doesn't continue from removes every deposit
+    mapCTIP[0].out = COutPoint(GetRandHash(), 0);
+    pool.UpdateCTIPFromBlock(mapCTIP, false);
+
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK(pool.GetSidechainDepositChain(0, vChain));
+    BOOST_CHECK(vChain.empty());
+    BOOST_CHECK(pool.GetMemPoolCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == mapCTIP[0].out);
+
+    // A sorted chain with a deposit that has no destination output is
+    // removed as well
+    for (const CTransactionRef& tx : vDeposit) {
+        pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx,
+                    1000LL, 0, 1, false, true, 0, 4, LockPoints()));
+    }
+    CMutableTransaction mtxNoDest;
+    mtxNoDest.vin.resize(1);
+    mtxNoDest.vin[0].prevout = COutPoint(vDeposit[2]->GetHash(), 0);
+    mtxNoDest.vout.resize(1);
+    mtxNoDest.vout[0].scriptPubKey = sidechainScript;
+    mtxNoDest.vout[0].nValue = 5 * COIN;
+    CTransactionRef txNoDest = MakeTransactionRef(mtxNoDest);
+    pool.addUnchecked(txNoDest->GetHash(), CTxMemPoolEntry(txNoDest,
+                1000LL, 0, 1, false, true, 0, 4, LockPoints()));
+
+    BOOST_CHECK(pool.GetSidechainDepositChain(0, vChain));
+    BOOST_CHECK_EQUAL(vChain.size(), 4U);
+
+    mapCTIP[0] = ctipBlock;
+    pool.UpdateCTIPFromBlock(mapCTIP, false);
+
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK(pool.GetMemPoolCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == ctipBlock.out);
+}
+
+static MempoolFeeHistogramBucket GetHistogramBucket(const CTxMemPool& pool, CAmount nFeeRate)
+{
+    for (const MempoolFeeHistogramBucket& bucket : pool.GetFeeHistogram()) {
+        if (bucket.nMinFeeRate == nFeeRate)
+            return bucket;
+    }
+    BOOST_ERROR("no histogram bucket for fee rate " << nFeeRate);
+    return MempoolFeeHistogramBucket();
+}
+
+BOOST_AUTO_TEST_CASE(MempoolFeeHistogramTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    std::vector<CMutableTransaction> vTx(3);
+    for (size_t i = 0; i < vTx.size(); i++) {
+        vTx[i].vin.resize(1);
+        vTx[i].vin[0].scriptSig = CScript() << OP_1 << (int)i;
+        vTx[i].vout.resize(1);
+        vTx[i].vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        vTx[i].vout[0].nValue = COIN;
+    }
+    const int64_t nSize = GetVirtualTransactionSize(vTx[0]);
+    for (const CMutableTransaction& tx : vTx)
+        BOOST_CHECK_EQUAL(GetVirtualTransactionSize(tx), nSize);
+
+    // Exactly 10 sat/vB starts the 10 sat/vB bucket, a satoshi less is in
+    // the one below it
+    pool.addUnchecked(vTx[0].GetHash(), entry.Fee(10 * nSize).FromTx(vTx[0]));
+    pool.addUnchecked(vTx[1].GetHash(), entry.Fee(10 * nSize - 1).FromTx(vTx[1]));
+    pool.addUnchecked(vTx[2].GetHash(), entry.Fee(0).FromTx(vTx[2]));
+
+    MempoolFeeHistogramBucket bucket = GetHistogramBucket(pool, 10);
+    BOOST_CHECK_EQUAL(bucket.nCount, 1U);
+    BOOST_CHECK_EQUAL(bucket.nVSize, (uint64_t)nSize);
+    BOOST_CHECK_EQUAL(bucket.nFees, 10 * nSize);
+
+    bucket = GetHistogramBucket(pool, 8);
+    BOOST_CHECK_EQUAL(bucket.nCount, 1U);
+    BOOST_CHECK_EQUAL(bucket.nFees, 10 * nSize - 1);
+
+    bucket = GetHistogramBucket(pool, 0);
+    BOOST_CHECK_EQUAL(bucket.nCount, 1U);
+    BOOST_CHECK_EQUAL(bucket.nFees, 0);
+
+    // The buckets add up to the mempool
+    uint64_t nCount = 0;
+    uint64_t nVSize = 0;
+    for (const MempoolFeeHistogramBucket& b : pool.GetFeeHistogram()) {
+        nCount += b.nCount;
+        nVSize += b.nVSize;
+    }
+    BOOST_CHECK_EQUAL(nCount, pool.size());
+    BOOST_CHECK_EQUAL(nVSize, pool.GetTotalTxSize());
+
+    // Removing a transaction takes it out of its bucket
+    pool.removeRecursive(vTx[0]);
+    bucket = GetHistogramBucket(pool, 10);
+    BOOST_CHECK_EQUAL(bucket.nCount, 0U);
+    BOOST_CHECK_EQUAL(bucket.nVSize, 0U);
+    BOOST_CHECK_EQUAL(bucket.nFees, 0);
+    BOOST_CHECK_EQUAL(GetHistogramBucket(pool, 8).nCount, 1U);
+
+    pool.clear();
+    for (const MempoolFeeHistogramBucket& b : pool.GetFeeHistogram())
+        BOOST_CHECK_EQUAL(b.nCount, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDiamondTraversalTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // A diamond: txB and txC both spend txA, txD spends both of them
+    CMutableTransaction txA;
+    txA.vin.resize(1);
+    txA.vin[0].scriptSig = CScript() << OP_1;
+    txA.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txA.vout[i].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        txA.vout[i].nValue = COIN;
+    }
+    CMutableTransaction txB, txC;
+    for (int i = 0; i < 2; i++) {
+        CMutableTransaction& tx = i ? txC : txB;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txA.GetHash(), i);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+    }
+    CMutableTransaction txD;
+    txD.vin.resize(2);
+    txD.vin[0].prevout = COutPoint(txB.GetHash(), 0);
+    txD.vin[1].prevout = COutPoint(txC.GetHash(), 0);
+    txD.vout.resize(1);
+    txD.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    txD.vout[0].nValue = COIN;
+
+    pool.addUnchecked(txA.GetHash(), entry.FromTx(txA));
+    pool.addUnchecked(txB.GetHash(), entry.FromTx(txB));
+    pool.addUnchecked(txC.GetHash(), entry.FromTx(txC));
+    pool.addUnchecked(txD.GetHash(), entry.FromTx(txD));
+
+    LOCK(pool.cs);
+    CTxMemPool::txiter itA = pool.mapTx.find(txA.GetHash());
+    CTxMemPool::txiter itD = pool.mapTx.find(txD.GetHash());
+
+    // txA is reached through both sides of the diamond but counted once
+    CTxMemPool::setEntries setAncestors;
+    std::string dummy;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*itD, setAncestors, 100, 1000000, 1000, 1000000, dummy, false));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3U);
+    BOOST_CHECK_EQUAL(itD->GetCountWithAncestors(), 4U);
+    BOOST_CHECK_EQUAL(itA->GetCountWithDescendants(), 4U);
+
+    // A limit of 3 ancestors is exceeded by txD but not by txB
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*itD, setAncestors, 3, 1000000, 1000, 1000000, dummy, false));
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*pool.mapTx.find(txB.GetHash()), setAncestors, 3, 1000000, 1000, 1000000, dummy, false));
+
+    // Both ways of collecting descendants agree, txD is listed once
+    CTxMemPool::setEntries setDescendants;
+    pool.CalculateDescendants(itA, setDescendants);
+    std::vector<CTxMemPool::txiter> vDescendants;
+    pool.CalculateDescendants(itA, vDescendants);
+    BOOST_CHECK_EQUAL(setDescendants.size(), 4U);
+    BOOST_CHECK_EQUAL(vDescendants.size(), 4U);
+    BOOST_CHECK(vDescendants.front() == itA);
+    for (const CTxMemPool::txiter& it : vDescendants)
+        BOOST_CHECK(setDescendants.count(it));
+
+    pool.CalculateDescendants(itD, vDescendants);
+    BOOST_CHECK_EQUAL(vDescendants.size(), 1U);
+}
+
+static CScript NewsScript(const std::string& strHeaderHex, const std::string& strMessage)
+{
+    std::vector<unsigned char> vHeader = ParseHex(strHeaderHex);
+    CScript script = CScript() << OP_RETURN;
+    script.insert(script.end(), vHeader.begin(), vHeader.end());
+    script.insert(script.end(), strMessage.begin(), strMessage.end());
+    return script;
+}
+
+static CScript NewsHeader(const std::string& strHex)
+{
+    std::vector<unsigned char> vHeader = ParseHex(strHex);
+    return CScript(vHeader.begin(), vHeader.end());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolNewsIndexTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    std::vector<CMutableTransaction> vTx(4);
+    for (size_t i = 0; i < vTx.size(); i++) {
+        vTx[i].vin.resize(1);
+        vTx[i].vin[0].scriptSig = CScript() << OP_1 << (int)i;
+        vTx[i].vout.resize(1);
+        vTx[i].vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        vTx[i].vout[0].nValue = COIN;
+    }
+    vTx[0].vout.emplace_back(0, NewsScript("a1b1c1d1", "hello"));
+    // Two headers, the second one twice
+    vTx[1].vout.emplace_back(0, NewsScript("a1b1c1d1", "world"));
+    vTx[1].vout.emplace_back(0, NewsScript("a1b1c1d2", "one"));
+    vTx[1].vout.emplace_back(0, NewsScript("a1b1c1d2", "two"));
+    // Too short to have a header
+    vTx[2].vout.emplace_back(0, CScript() << OP_RETURN);
+
+    pool.addUnchecked(vTx[0].GetHash(), entry.Fee(1000).Time(10).FromTx(vTx[0]));
+    pool.addUnchecked(vTx[1].GetHash(), entry.Fee(2000).Time(20).FromTx(vTx[1]));
+    pool.addUnchecked(vTx[2].GetHash(), entry.Fee(3000).FromTx(vTx[2]));
+    pool.addUnchecked(vTx[3].GetHash(), entry.Fee(4000).FromTx(vTx[3]));
+
+    std::vector<MempoolNews> vNews;
+    pool.GetNews(NewsHeader("a1b1c1d1"), vNews);
+    BOOST_CHECK_EQUAL(vNews.size(), 2U);
+    for (const MempoolNews& news : vNews) {
+        const bool fFirst = news.txid == vTx[0].GetHash();
+        BOOST_CHECK(fFirst || news.txid == vTx[1].GetHash());
+        BOOST_CHECK_EQUAL(news.nFee, fFirst ? 1000 : 2000);
+        BOOST_CHECK_EQUAL(news.nTime, fFirst ? 10 : 20);
+        BOOST_CHECK(news.script == NewsScript("a1b1c1d1", fFirst ? "hello" : "world"));
+    }
+
+    // Headers longer than the index key are matched in full
+    pool.GetNews(NewsHeader("a1b1c1d1" + HexStr(std::string("x"))), vNews);
+    BOOST_CHECK(vNews.empty());
+    pool.GetNews(NewsHeader("a1b1c1d1" + HexStr(std::string("w"))), vNews);
+    BOOST_CHECK_EQUAL(vNews.size(), 1U);
+
+    pool.GetNews(NewsHeader("a1b1c1d2"), vNews);
+    BOOST_CHECK_EQUAL(vNews.size(), 2U);
+    pool.GetNews(NewsHeader("a1b1c1d3"), vNews);
+    BOOST_CHECK(vNews.empty());
+    pool.GetNews(NewsHeader("a1b1c1"), vNews);
+    BOOST_CHECK(vNews.empty());
+
+    // Removing a transaction removes it from every header it was under
+    pool.removeRecursive(vTx[1]);
+    pool.GetNews(NewsHeader("a1b1c1d2"), vNews);
+    BOOST_CHECK(vNews.empty());
+    pool.GetNews(NewsHeader("a1b1c1d1"), vNews);
+    BOOST_CHECK_EQUAL(vNews.size(), 1U);
+
+    pool.clear();
+    pool.GetNews(NewsHeader("a1b1c1d1"), vNews);
+    BOOST_CHECK(vNews.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
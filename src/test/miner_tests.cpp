@@ -12,6 +12,7 @@
 #include <miner.h>
 #include <policy/policy.h>
 #include <pubkey.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -21,6 +22,7 @@
 #include <test/test_skydoge.h>
 
 #include <memory>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
@@ -524,4 +526,205 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     */
 }
 
+BOOST_AUTO_TEST_CASE(package_ancestors_parallel)
+{
+    // The ancestors found on several threads are the same as those found by
+    // the mempool
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    std::vector<CTransactionRef> vParent;
+    LOCK(pool.cs);
+    for (int i = 0; i < 40; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + i % 3);
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            if (vParent.empty() || (i + j) % 5 == 0) {
+                tx.vin[j].prevout = COutPoint(InsecureRand256(), 0);
+            } else {
+                tx.vin[j].prevout = COutPoint(vParent[(i * 7 + j) % vParent.size()]->GetHash(), j);
+            }
+        }
+        tx.vout.resize(3);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_TRUE;
+            out.nValue = 1000;
+        }
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        pool.addUnchecked(ptx->GetHash(), entry.Fee(1000 + i).FromTx(*ptx));
+        vParent.push_back(ptx);
+    }
+
+    std::vector<CTxMemPool::txiter> vTx;
+    for (CTxMemPool::txiter it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it)
+        vTx.push_back(it);
+
+    std::vector<CTxMemPool::setEntries> vAncestors;
+    CalculatePackageAncestors(pool, vTx, vAncestors, 3);
+    BOOST_CHECK_EQUAL(vAncestors.size(), vTx.size());
+
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    for (size_t i = 0; i < vTx.size(); i++) {
+        CTxMemPool::setEntries ancestors;
+        pool.CalculateMemPoolAncestors(*vTx[i], ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        BOOST_CHECK(ancestors == vAncestors[i]);
+        BOOST_CHECK_EQUAL(vAncestors[i].size() + 1, vTx[i]->GetCountWithAncestors());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(template_validation_modes)
+{
+    TemplateValidation validation;
+    BOOST_CHECK(ParseTemplateValidation(DEFAULT_TEMPLATE_VALIDATION, validation));
+    BOOST_CHECK(validation == TemplateValidation::FULL);
+    BOOST_CHECK(ParseTemplateValidation("light", validation));
+    BOOST_CHECK(validation == TemplateValidation::LIGHT);
+    BOOST_CHECK(ParseTemplateValidation("sampled", validation));
+    BOOST_CHECK(validation == TemplateValidation::SAMPLED);
+    BOOST_CHECK(!ParseTemplateValidation("", validation));
+    BOOST_CHECK(!ParseTemplateValidation("Full", validation));
+    BOOST_CHECK(validation == TemplateValidation::SAMPLED);
+
+    BOOST_CHECK(BlockAssembler::Options().templateValidation == TemplateValidation::FULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(template_validation_light_checks_miner_txs, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE(pblocktemplate);
+    CBlock block = pblocktemplate->block;
+
+    LOCK(cs_main);
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidityLight(state, Params(), block, chainActive.Tip()));
+
+    // A transaction that isn't from the mempool has its scripts checked
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(coinbaseTxns[0].GetHash(), 0);
+    mtx.vout.emplace_back(coinbaseTxns[0].vout[0].nValue - CENT, scriptPubKey);
+    block.vtx.push_back(MakeTransactionRef(mtx));
+    BOOST_CHECK(!TestBlockValidityLight(state, Params(), block, chainActive.Tip()));
+
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(coinbaseTxns[0].vout[0].scriptPubKey, mtx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    mtx.vin[0].scriptSig << vchSig;
+    block.vtx.back() = MakeTransactionRef(mtx);
+    state = CValidationState();
+    BOOST_CHECK(TestBlockValidityLight(state, Params(), block, chainActive.Tip()));
+
+    // And its inputs, spending more than the input fails
+    mtx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue + 1;
+    block.vtx.back() = MakeTransactionRef(mtx);
+    state = CValidationState();
+    BOOST_CHECK(!TestBlockValidityLight(state, Params(), block, chainActive.Tip()));
+}
+
+BOOST_AUTO_TEST_CASE(bmm_auction_skips_ineligible_requests)
+{
+    // Only requests for an active sidechain that can go in the next block
+    // take part in the auction
+    CTxMemPool pool;
+    LockPoints lp;
+    const int nHeight = 101;
+
+    // Sidechain 0: the best bid is expired. Sidechain 1: inactive.
+    std::vector<CTransactionRef> vTx;
+    const std::vector<std::pair<uint8_t, uint32_t>> vRequest = {{0, 100}, {0, 100}, {0, 99}, {1, 100}};
+    for (size_t i = 0; i < vRequest.size(); i++) {
+        CMutableTransaction mtx;
+        mtx.nVersion = 3;
+        mtx.nLockTime = vRequest[i].second;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        mtx.vout[0].nValue = (i + 1) * CENT;
+        mtx.criticalData.vBytes = std::vector<unsigned char>{0x00, 0xbf, 0x00, vRequest[i].first, 0x00, 0x00, 0x00, 0x00};
+        mtx.criticalData.hashCritical = InsecureRand256();
+        vTx.push_back(MakeTransactionRef(mtx));
+    }
+
+    LOCK(pool.cs);
+    for (const CTransactionRef& tx : vTx)
+        pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, false, 0, 4, lp));
+
+    std::vector<Sidechain> vActiveSidechain(1);
+    vActiveSidechain[0].nSidechain = 0;
+
+    std::vector<BMMAuctionResult> vResult;
+    CTxMemPool::setEntries setExcluded;
+    RunBMMAuction(pool, nHeight, vActiveSidechain, vResult, setExcluded);
+
+    BOOST_REQUIRE_EQUAL(vResult.size(), 1U);
+    BOOST_CHECK_EQUAL(vResult[0].nSidechain, 0);
+    BOOST_CHECK_EQUAL(vResult[0].nRequests, 2U);
+    BOOST_CHECK(vResult[0].txid == vTx[1]->GetHash());
+    BOOST_CHECK_EQUAL(setExcluded.size(), 3U);
+    BOOST_CHECK(!setExcluded.count(pool.mapTx.find(vTx[1]->GetHash())));
+}
+
+BOOST_FIXTURE_TEST_CASE(miner_coinbase_extranonce, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE(pblocktemplate);
+
+    LOCK(cs_main);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+
+    // A shared template with a single transaction is still valid with the
+    // extranonce of a hashing thread
+    CBlock block = pblocktemplate->block;
+    SetCoinbaseExtraNonce(block, pindexPrev, 1, BlockMerkleBranch(block, 0));
+    BOOST_CHECK(block.hashMerkleRoot == BlockMerkleRoot(block));
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidityLight(state, Params(), block, pindexPrev));
+
+    // With more transactions only the coinbase is rehashed, the merkle root
+    // follows from the branch
+    CBlock blockTemplate = pblocktemplate->block;
+    for (int i = 0; i < 6; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(InsecureRand256(), 0);
+        mtx.vout.emplace_back(CENT, scriptPubKey);
+        blockTemplate.vtx.push_back(MakeTransactionRef(mtx));
+    }
+    const std::vector<uint256> vMerkleBranch = BlockMerkleBranch(blockTemplate, 0);
+
+    // The hashing threads own the extranonces nThread + 1 + k * nThreads, so
+    // they never hash the same block
+    const int nThreads = 3;
+    std::set<uint256> setHash;
+    for (int nThread = 0; nThread < nThreads; nThread++) {
+        block = blockTemplate;
+        for (unsigned int nExtraNonce = nThread + 1; nExtraNonce <= 12; nExtraNonce += nThreads) {
+            SetCoinbaseExtraNonce(block, pindexPrev, nExtraNonce, vMerkleBranch);
+            BOOST_CHECK(block.hashMerkleRoot == BlockMerkleRoot(block));
+            BOOST_CHECK(block.vtx[0]->vin[0].scriptSig == (CScript() << pindexPrev->nHeight + 1 << CScriptNum(nExtraNonce)) + COINBASE_FLAGS);
+            BOOST_CHECK(block.vtx[0]->vout == blockTemplate.vtx[0]->vout);
+            for (size_t i = 1; i < block.vtx.size(); i++)
+                BOOST_CHECK(block.vtx[i] == blockTemplate.vtx[i]);
+            BOOST_CHECK(setHash.insert(block.GetHash()).second);
+        }
+    }
+    BOOST_CHECK_EQUAL(setHash.size(), 12U);
+}
+
+BOOST_AUTO_TEST_CASE(miner_thread_hash_rates)
+{
+    // One entry per hashing thread while the miner runs. Without a wallet
+    // there is no template, so nothing is hashed.
+    GenerateBitcoins(true, 2, Params());
+    std::vector<double> vRate = GetMinerHashRates();
+    BOOST_CHECK_EQUAL(vRate.size(), 2U);
+    for (double dRate : vRate)
+        BOOST_CHECK_EQUAL(dRate, 0);
+
+    GenerateBitcoins(false, 0, Params());
+    BOOST_CHECK(GetMinerHashRates().empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
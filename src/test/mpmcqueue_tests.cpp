@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mpmcqueue.h>
+
+#include <test/test_skydoge.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mpmcqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(mpmcqueue_fifo)
+{
+    mpmcqueue<int> queue(5);
+    BOOST_CHECK_EQUAL(queue.capacity(), 8U);
+
+    int n;
+    BOOST_CHECK(!queue.Pop(n));
+
+    // Go around the ring a few times, filling it up each time
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 8; i++)
+            BOOST_CHECK(queue.Push(round * 8 + i));
+        BOOST_CHECK(!queue.Push(-1));
+        for (int i = 0; i < 8; i++) {
+            BOOST_CHECK(queue.Pop(n));
+            BOOST_CHECK_EQUAL(n, round * 8 + i);
+        }
+        BOOST_CHECK(!queue.Pop(n));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mpmcqueue_threads)
+{
+    static const int PRODUCERS = 4;
+    static const int CONSUMERS = 4;
+    static const int ITEMS = 20000;
+
+    mpmcqueue<int> queue(64);
+    std::atomic<int> nConsumed(0);
+    std::atomic<int64_t> nSum(0);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < PRODUCERS; p++) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 1; i <= ITEMS; i++) {
+                while (!queue.Push(p * ITEMS + i))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int c = 0; c < CONSUMERS; c++) {
+        threads.emplace_back([&]() {
+            int n;
+            while (nConsumed < PRODUCERS * ITEMS) {
+                if (queue.Pop(n)) {
+                    nSum += n;
+                    nConsumed++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // Every item was taken exactly once
+    int64_t nTotal = (int64_t)PRODUCERS * ITEMS;
+    BOOST_CHECK_EQUAL(nConsumed.load(), nTotal);
+    BOOST_CHECK_EQUAL(nSum.load(), nTotal * (nTotal + 1) / 2);
+    int n;
+    BOOST_CHECK(!queue.Pop(n));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -185,4 +185,50 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(send_shared_payload)
+{
+    CConnman connman(0x1337, 0x1337);
+    std::vector<unsigned char> vPayload(1000);
+    for (unsigned char& c : vPayload)
+        c = InsecureRandBits(8);
+    std::shared_ptr<const CSharedNetPayload> shared = std::make_shared<const CSharedNetPayload>(std::vector<unsigned char>(vPayload));
+    BOOST_CHECK(shared->hash == Hash(vPayload.begin(), vPayload.end()));
+
+    // Both peers get the whole message from the one payload
+    for (NodeId id = 0; id < 2; id++) {
+        int fds[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        CNode node(id, NODE_NETWORK, 0, fds[0], CAddress(), 0, 0, CAddress(), "", false);
+
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::BLOCK;
+        msg.shared = shared;
+        connman.PushMessage(&node, std::move(msg));
+        {
+            LOCK(node.cs_vSend);
+            BOOST_CHECK(node.vSendMsg.empty());
+            BOOST_CHECK_EQUAL(node.nSendSize, 0U);
+        }
+
+        std::vector<unsigned char> vRecv(CMessageHeader::HEADER_SIZE + vPayload.size());
+        size_t nRead = 0;
+        while (nRead < vRecv.size()) {
+            ssize_t n = recv(fds[1], vRecv.data() + nRead, vRecv.size() - nRead, 0);
+            BOOST_REQUIRE(n > 0);
+            nRead += n;
+        }
+        close(fds[1]);
+
+        CDataStream ss(vRecv, SER_NETWORK, PROTOCOL_VERSION);
+        CMessageHeader hdr(Params().MessageStart());
+        ss >> hdr;
+        BOOST_CHECK_EQUAL(hdr.GetCommand(), NetMsgType::BLOCK);
+        BOOST_CHECK_EQUAL(hdr.nMessageSize, vPayload.size());
+        BOOST_CHECK(memcmp(hdr.pchChecksum, shared->hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+        BOOST_CHECK(std::equal(vPayload.begin(), vPayload.end(), vRecv.begin() + CMessageHeader::HEADER_SIZE));
+    }
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bloom.h>
+#include <script/script.h>
+#include <txdb.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(opreturndb_tests, BasicTestingSetup)
+
+static OPReturnData MakeData(const std::vector<unsigned char>& vch)
+{
+    OPReturnData data;
+    data.txid = GetRandHash();
+    data.script = CScript() << OP_RETURN << vch;
+    data.nSize = 100;
+    data.fees = 1000;
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(opreturndb_header_filters)
+{
+    OPReturnDB db(1 << 20, true /* fMemory */);
+
+    const std::vector<unsigned char> vchNews = ParseHex("a1b1c1d1e1f1");
+    const uint256 hashNews = GetRandHash();
+    const uint256 hashEmpty = GetRandHash();
+    const uint256 hashMissing = GetRandHash();
+
+    BOOST_CHECK(db.WriteBlockData(std::make_pair(hashNews, std::vector<OPReturnData>{MakeData(vchNews)}), 1000));
+    BOOST_CHECK(db.WriteBlockData(std::make_pair(hashEmpty, std::vector<OPReturnData>()), 1000));
+
+    std::vector<CBloomFilter> vFilter;
+    std::vector<bool> vFound;
+    db.GetHeaderFilters({hashNews, hashEmpty, hashMissing}, vFilter, vFound);
+    BOOST_CHECK_EQUAL(vFilter.size(), 3U);
+    BOOST_CHECK(vFound[0] && vFound[1] && !vFound[2]);
+
+    // The header is the 4 bytes following OP_RETURN, starting with the push
+    const CScript script = CScript() << OP_RETURN << vchNews;
+    const std::vector<unsigned char> vHeader(script.begin() + 1, script.begin() + 5);
+    const std::vector<unsigned char> vOther = {0x00, 0x01, 0x02, 0x03};
+    BOOST_CHECK(vFilter[0].contains(vHeader));
+    BOOST_CHECK(!vFilter[0].contains(vOther));
+    BOOST_CHECK(!vFilter[1].contains(vHeader));
+
+    // Filters go with the block data when it is pruned
+    BOOST_CHECK(db.Prune({hashNews}, 1, 0));
+    db.GetHeaderFilters({hashNews}, vFilter, vFound);
+    BOOST_CHECK(!vFound[0]);
+}
+
+BOOST_AUTO_TEST_CASE(opreturndb_compact_roundtrip)
+{
+    OPReturnDB db(1 << 20, true /* fMemory */);
+
+    std::vector<unsigned char> vchNews = ParseHex("a1b1c1d1");
+    vchNews.resize(200, 'x');
+
+    std::vector<OPReturnData> vData;
+    vData.push_back(MakeData(vchNews));
+    vData.push_back(MakeData(ParseHex("0102")));
+    vData.back().fees = 123456789;
+    OPReturnData empty;
+    empty.txid = GetRandHash();
+    empty.script = CScript() << OP_RETURN;
+    empty.nSize = 70000;
+    empty.fees = 0;
+    vData.push_back(empty);
+
+    const uint256 hashBlock = GetRandHash();
+    BOOST_CHECK(db.WriteBlockData(std::make_pair(hashBlock, vData), 5000));
+
+    std::vector<OPReturnData> vRead;
+    BOOST_CHECK(db.GetBlockData(hashBlock, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), vData.size());
+    for (size_t i = 0; i < vData.size() && i < vRead.size(); i++) {
+        BOOST_CHECK(vRead[i].txid == vData[i].txid);
+        BOOST_CHECK(vRead[i].script == vData[i].script);
+        BOOST_CHECK_EQUAL(vRead[i].nSize, vData[i].nSize);
+        BOOST_CHECK_EQUAL(vRead[i].fees, vData[i].fees);
+    }
+
+    // News get their OP_RETURN and header back from the key
+    std::vector<OPReturnNews> vNews;
+    db.GetNews(CScript(vData[0].script.begin() + 1, vData[0].script.begin() + 5), 0, vNews);
+    BOOST_CHECK_EQUAL(vNews.size(), 1U);
+    BOOST_CHECK(vNews[0].hashBlock == hashBlock);
+    BOOST_CHECK_EQUAL(vNews[0].nTime, 5000U);
+    BOOST_CHECK(vNews[0].data.script == vData[0].script);
+    BOOST_CHECK_EQUAL(vNews[0].data.fees, vData[0].fees);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,231 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <opreturnindex.h>
+#include <rpc/server.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <txdb.h>
+#include <utilmoneystr.h>
+#include <utilstrencodings.h>
+#include <utiltime.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/test_skydoge.h>
+
+#include <univalue.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+class TestOPReturnIndex : public OPReturnIndex
+{
+public:
+    using OPReturnIndex::OPReturnIndex;
+    using OPReturnIndex::BlockConnected;
+};
+
+bool WaitForSync(const OPReturnIndex& index)
+{
+    for (int i = 0; i < 1000 && !index.IsSynced(); i++)
+        MilliSleep(10);
+    return index.IsSynced();
+}
+
+UniValue CallGetNews(const std::string& strHeader, int nDays)
+{
+    JSONRPCRequest request;
+    request.strMethod = "getnews";
+    request.params = UniValue(UniValue::VARR);
+    request.params.push_back(strHeader);
+    request.params.push_back(nDays);
+    request.fHelp = false;
+    return tableRPC["getnews"]->actor(request);
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(opreturnindex_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(opreturnindex_sync)
+{
+    const CScript scriptNews = CScript() << OP_RETURN << ParseHex("a1b1c1d1e1f1");
+    const CBlock blockNews = CreateAndProcessBlock({}, scriptNews);
+
+    OPReturnDB db(1 << 20, true /* fMemory */);
+    TestOPReturnIndex index(&db);
+    BOOST_CHECK(!index.GetBestBlock());
+    BOOST_REQUIRE(index.Start());
+
+    // The sync thread indexes the chain from genesis
+    BOOST_REQUIRE(WaitForSync(index));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(index.GetBestBlock() == chainActive.Tip());
+    }
+    std::vector<OPReturnData> vData;
+    BOOST_CHECK(db.GetBlockData(blockNews.GetHash(), vData));
+    BOOST_REQUIRE_EQUAL(vData.size(), 1U);
+    BOOST_CHECK(vData[0].script == scriptNews);
+    BOOST_CHECK(vData[0].txid == blockNews.vtx[0]->GetHash());
+
+    // Blocks connected after that are indexed by the validation callbacks
+    const CBlock blockNext = CreateAndProcessBlock({}, scriptNews);
+    SyncWithValidationInterfaceQueue();
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+    BOOST_CHECK(pindexTip->GetBlockHash() == blockNext.GetHash());
+    BOOST_CHECK(index.GetBestBlock() == pindexTip);
+    BOOST_CHECK(db.HaveBlockData(blockNext.GetHash()));
+
+    index.Interrupt();
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(opreturnindex_stale_callback)
+{
+    const CScript scriptNews = CScript() << OP_RETURN << ParseHex("a1b1c1d1e1f1");
+    const CBlock blockNews = CreateAndProcessBlock({}, scriptNews);
+
+    OPReturnDB db(1 << 20, true /* fMemory */);
+    TestOPReturnIndex index(&db);
+    BOOST_REQUIRE(index.Start());
+    BOOST_REQUIRE(WaitForSync(index));
+
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+    BOOST_CHECK(pindexTip->GetBlockHash() == blockNews.GetHash());
+
+    // A callback for a block that was already indexed by the sync thread
+    // doesn't move the best block back
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    BOOST_REQUIRE(ReadBlockFromDisk(*pblock, pindexTip->pprev, Params().GetConsensus()));
+    index.BlockConnected(pblock, pindexTip->pprev, {});
+    BOOST_CHECK(index.GetBestBlock() == pindexTip);
+
+    // Neither does a block that doesn't connect to it
+    const uint256 hashOther = GetRandHash();
+    CBlockIndex indexOther;
+    indexOther.phashBlock = &hashOther;
+    indexOther.pprev = pindexTip->pprev->pprev;
+    indexOther.nHeight = pindexTip->nHeight + 1;
+    index.BlockConnected(pblock, &indexOther, {});
+    BOOST_CHECK(index.GetBestBlock() == pindexTip);
+
+    index.Interrupt();
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(opreturnindex_getnews)
+{
+    auto SignInput = [this](CMutableTransaction& mtx, const CScript& scriptPrev) {
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(scriptPrev, mtx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        mtx.vin[0].scriptSig << vchSig;
+    };
+
+    // Index into the global database that getnews reads from
+    TestOPReturnIndex index(popreturndb.get());
+    BOOST_REQUIRE(index.Start());
+    BOOST_REQUIRE(WaitForSync(index));
+
+    // OP_RETURN, the 4 byte header and the message
+    const std::vector<unsigned char> vNews = ParseHex("6aa1b1c1d16e657773");
+    const CScript scriptNews(vNews.begin(), vNews.end());
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Split the only mature coinbase output to pay for the news
+    CMutableTransaction mtxSplit;
+    mtxSplit.vin.emplace_back(coinbaseTxns[0].GetHash(), 0);
+    for (int i = 0; i < 3; i++)
+        mtxSplit.vout.emplace_back(coinbaseTxns[0].vout[0].nValue / 4, scriptPubKey);
+    SignInput(mtxSplit, coinbaseTxns[0].vout[0].scriptPubKey);
+    std::vector<CMutableTransaction> vtx = {mtxSplit};
+
+    // News paying different fees
+    const std::vector<CAmount> vFee = {CENT, 3 * CENT, 2 * CENT};
+    for (size_t i = 0; i < vFee.size(); i++) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(mtxSplit.GetHash(), i);
+        mtx.vout.emplace_back(mtxSplit.vout[i].nValue - vFee[i], scriptPubKey);
+        mtx.vout.emplace_back(0, scriptNews);
+        SignInput(mtx, scriptPubKey);
+        vtx.push_back(mtx);
+    }
+    const CBlock blockNews = CreateAndProcessBlock(vtx, scriptPubKey);
+    SyncWithValidationInterfaceQueue();
+
+    // Highest fees first
+    UniValue news = CallGetNews("a1b1c1d1", 1);
+    BOOST_REQUIRE_EQUAL(news.size(), 3U);
+    BOOST_CHECK_EQUAL(news[0]["txid"].get_str(), vtx[2].GetHash().ToString());
+    BOOST_CHECK_EQUAL(news[1]["txid"].get_str(), vtx[3].GetHash().ToString());
+    BOOST_CHECK_EQUAL(news[2]["txid"].get_str(), vtx[1].GetHash().ToString());
+    BOOST_CHECK_EQUAL(news[0]["fees"].get_str(), FormatMoney(3 * CENT));
+    BOOST_CHECK_EQUAL(news[0]["blockhash"].get_str(), blockNews.GetHash().ToString());
+    BOOST_CHECK_EQUAL(news[0]["decode"].get_str(), "news");
+
+    // Other news types aren't listed
+    BOOST_CHECK(CallGetNews("a2b2c2d2", 1).empty());
+
+    // News from a block ten days later
+    const int64_t nTimeLater = blockNews.GetBlockTime() + 10 * 24 * 60 * 60;
+    SetMockTime(nTimeLater);
+    const CBlock blockLater = CreateAndProcessBlock({}, scriptNews);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(blockLater.GetBlockTime(), nTimeLater);
+
+    // Only news from the last ndays before the tip is listed
+    news = CallGetNews("a1b1c1d1", 7);
+    BOOST_REQUIRE_EQUAL(news.size(), 1U);
+    BOOST_CHECK_EQUAL(news[0]["txid"].get_str(), blockLater.vtx[0]->GetHash().ToString());
+    BOOST_CHECK_EQUAL(news[0]["fees"].get_str(), FormatMoney(0));
+    BOOST_CHECK_EQUAL(CallGetNews("a1b1c1d1", 11).size(), 4U);
+
+    // News from a block that is disconnected is removed...
+    CBlockIndex* pindexLater;
+    {
+        LOCK(cs_main);
+        pindexLater = chainActive.Tip();
+        BOOST_REQUIRE(pindexLater->GetBlockHash() == blockLater.GetHash());
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pindexLater));
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    SyncWithValidationInterfaceQueue();
+
+    BOOST_CHECK(CallGetNews("a1b1c1d1", 7).empty());
+    news = CallGetNews("a1b1c1d1", 11);
+    BOOST_REQUIRE_EQUAL(news.size(), 3U);
+    for (size_t i = 0; i < news.size(); i++)
+        BOOST_CHECK_EQUAL(news[i]["blockhash"].get_str(), blockNews.GetHash().ToString());
+
+    // ...and listed again once the block is reconnected
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(ResetBlockFailureFlags(pindexLater));
+    }
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(CallGetNews("a1b1c1d1", 7).size(), 1U);
+    BOOST_CHECK_EQUAL(CallGetNews("a1b1c1d1", 11).size(), 4U);
+
+    SetMockTime(0);
+    index.Interrupt();
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,8 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <clientversion.h>
 #include <policy/policy.h>
 #include <policy/fees.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
@@ -177,6 +179,32 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     for (int i = 2; i < 9; i++) { // At 9, the original estimate was already at the bottom (b/c scale = 2)
         BOOST_CHECK(feeEst.estimateFee(i).GetFeePerK() < origFeeEst[i-1] - deltaFee);
     }
+
+    // Decay is applied to the buckets lazily, mine some empty blocks so that
+    // every bucket has decay pending. The estimates file has all of it
+    // applied, so reading it back must give the same estimates.
+    while (blocknum < 685)
+        mpool.removeForBlock(block, ++blocknum);
+
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(feeEst.Write(file));
+    fseek(file.Get(), 0, SEEK_SET);
+    CBlockPolicyEstimator feeEstRead;
+    BOOST_CHECK(feeEstRead.Read(file));
+
+    for (int i = 1; i <= 48; i++) {
+        FeeCalculation feeCalc;
+        CFeeRate smartFee = feeEst.estimateSmartFee(i, &feeCalc, true);
+        BOOST_CHECK(feeEstRead.estimateSmartFee(i, nullptr, true) == smartFee);
+        BOOST_CHECK(feeEst.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE) ==
+                    feeEstRead.estimateRawFee(i, 0.85, FeeEstimateHorizon::MED_HALFLIFE));
+
+        // A second call is answered from the cache
+        FeeCalculation feeCalcCached;
+        BOOST_CHECK(feeEst.estimateSmartFee(i, &feeCalcCached, true) == smartFee);
+        BOOST_CHECK(feeCalcCached.reason == feeCalc.reason);
+        BOOST_CHECK_EQUAL(feeCalcCached.returnedTarget, feeCalc.returnedTarget);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
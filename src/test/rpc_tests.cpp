@@ -6,6 +6,7 @@
 #include <rpc/client.h>
 
 #include <base58.h>
+#include <chainparams.h>
 #include <core_io.h>
 #include <netbase.h>
 
@@ -345,4 +346,61 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    std::string strStatus;
+    if (RPCIsInWarmup(&strStatus))
+        SetRPCWarmupFinished();
+    BOOST_CHECK(StartRPC());
+
+    // Runs of read-only calls execute in parallel, echo is not read-only and
+    // executes on its own. Results must come back in request order.
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 40; i++) {
+        UniValue req(UniValue::VOBJ);
+        UniValue params(UniValue::VARR);
+        req.push_back(Pair("id", i));
+        if (i % 10 == 9) {
+            params.push_back(strprintf("echo %d", i));
+            req.push_back(Pair("method", "echo"));
+        } else if (i % 5 == 3) {
+            params.push_back(1000000);
+            req.push_back(Pair("method", "getblockhash"));
+        } else if (i % 2) {
+            params.push_back(0);
+            req.push_back(Pair("method", "getblockhash"));
+        } else {
+            req.push_back(Pair("method", "getblockcount"));
+        }
+        req.push_back(Pair("params", params));
+        vReq.push_back(req);
+    }
+    BOOST_CHECK(tableRPC["getblockhash"]->fParallel);
+    BOOST_CHECK(!tableRPC["echo"]->fParallel);
+
+    JSONRPCRequest jreq;
+    UniValue vResult;
+    BOOST_CHECK(vResult.read(JSONRPCExecBatch(jreq, vReq)));
+    BOOST_CHECK_EQUAL(vResult.size(), vReq.size());
+
+    std::string strGenesis = Params().GenesisBlock().GetHash().GetHex();
+    for (int i = 0; i < (int)vResult.size(); i++) {
+        const UniValue& result = vResult[i];
+        BOOST_CHECK_EQUAL(find_value(result, "id").get_int(), i);
+        if (i % 10 == 9) {
+            BOOST_CHECK_EQUAL(find_value(result, "result")[0].get_str(), strprintf("echo %d", i));
+        } else if (i % 5 == 3) {
+            BOOST_CHECK(find_value(result, "result").isNull());
+            BOOST_CHECK_EQUAL(find_value(find_value(result, "error"), "code").get_int(), RPC_INVALID_PARAMETER);
+        } else if (i % 2) {
+            BOOST_CHECK_EQUAL(find_value(result, "result").get_str(), strGenesis);
+        } else {
+            BOOST_CHECK_EQUAL(find_value(result, "result").get_int(), 0);
+        }
+    }
+
+    InterruptRPC();
+    StopRPC();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
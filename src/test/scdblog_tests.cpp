@@ -0,0 +1,136 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <fs.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <scdblog.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
+#include <util.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(scdblog_tests, BasicTestingSetup)
+
+static size_t ReplayInto(const fs::path& path, SidechainDB& scdbReplay, bool& fRet)
+{
+    size_t nRecords = 0;
+    fRet = CSCDBLog::Replay(path, [&scdbReplay](CDataStream& s) {
+        return scdbReplay.ApplyLogRecord(s, false /* fReindex */);
+    }, nRecords);
+    return nRecords;
+}
+
+BOOST_AUTO_TEST_CASE(scdblog_replay)
+{
+    const fs::path pathSnapshot = GetDataDir() / "scdb.dat";
+    const fs::path pathLog = GetDataDir() / "scdb.log";
+
+    CSCDBLog log(pathSnapshot, pathLog);
+    BOOST_CHECK(log.Start());
+
+    SidechainDB scdbTest;
+    scdbTest.SetLog(&log);
+
+    std::vector<std::string> vVote(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    vVote[1] = std::string(1, SCDB_DOWNVOTE);
+    BOOST_CHECK(scdbTest.CacheCustomVotes(vVote));
+
+    const uint256 hashBMM = GetRandHash();
+    scdbTest.AddRemovedBMM(hashBMM);
+    scdbTest.AddRemovedBMM(GetRandHash());
+    scdbTest.BMMAbandoned(hashBMM);
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 50 * CENT;
+    CTransactionRef tx = MakeTransactionRef(mtx);
+    BOOST_CHECK(scdbTest.CacheWithdrawalTx(tx, 0));
+
+    SidechainSpentWithdrawal spent;
+    spent.nSidechain = 0;
+    spent.hash = GetRandHash();
+    spent.hashBlock = GetRandHash();
+    scdbTest.AddSpentWithdrawals(std::vector<SidechainSpentWithdrawal>{ spent });
+
+    scdbTest.CacheSidechainHashToAck(GetRandHash());
+
+    log.Flush();
+
+    // Replaying the log gives back the same caches
+    SidechainDB scdbReplay;
+    bool fRet = false;
+    BOOST_CHECK_EQUAL(ReplayInto(pathLog, scdbReplay, fRet), 7U);
+    BOOST_CHECK(fRet);
+    BOOST_CHECK(scdbReplay.GetVotes() == scdbTest.GetVotes());
+    BOOST_CHECK(scdbReplay.GetRemovedBMM() == scdbTest.GetRemovedBMM());
+    BOOST_CHECK(scdbReplay.HaveWithdrawalTxCached(tx->GetHash()));
+    BOOST_CHECK(scdbReplay.HaveSpentWithdrawal(spent.hash, 0));
+    BOOST_CHECK(scdbReplay.GetSidechainsToActivate() == scdbTest.GetSidechainsToActivate());
+
+    // Replaying it again on top of the result changes nothing
+    BOOST_CHECK_EQUAL(ReplayInto(pathLog, scdbReplay, fRet), 7U);
+    BOOST_CHECK(fRet);
+    BOOST_CHECK(scdbReplay.GetRemovedBMM() == scdbTest.GetRemovedBMM());
+    BOOST_CHECK_EQUAL(scdbReplay.GetSpentWithdrawalCache().size(), 1U);
+    BOOST_CHECK_EQUAL(scdbReplay.GetWithdrawalTxCache().size(), 1U);
+
+    scdbTest.SetLog(nullptr);
+    log.Stop();
+
+    // A record cut short by a crash is ignored
+    FILE* file = fsbridge::fopen(pathLog, "ab");
+    BOOST_CHECK(file);
+    const unsigned char partial[] = {0x40, 0x00, 0x00, 0x00, SCDB_LOG_CLEAR};
+    fwrite(partial, 1, sizeof(partial), file);
+    fclose(file);
+
+    SidechainDB scdbPartial;
+    BOOST_CHECK_EQUAL(ReplayInto(pathLog, scdbPartial, fRet), 7U);
+    BOOST_CHECK(fRet);
+    BOOST_CHECK(scdbPartial.GetVotes() == scdbTest.GetVotes());
+}
+
+BOOST_AUTO_TEST_CASE(scdblog_compact)
+{
+    const fs::path pathSnapshot = GetDataDir() / "scdb.dat";
+    const fs::path pathLog = GetDataDir() / "scdb.log";
+
+    CSCDBLog log(pathSnapshot, pathLog);
+    BOOST_CHECK(log.Start());
+
+    SidechainDB scdbTest;
+    scdbTest.SetLog(&log);
+    scdbTest.AddRemovedBMM(GetRandHash());
+
+    // The snapshot replaces the records before it
+    const std::vector<unsigned char> vchSnapshot{1, 2, 3, 4};
+    log.Compact(std::vector<unsigned char>(vchSnapshot));
+    const uint256 hashBMM = GetRandHash();
+    scdbTest.AddRemovedBMM(hashBMM);
+    log.Flush();
+
+    FILE* file = fsbridge::fopen(pathSnapshot, "rb");
+    BOOST_CHECK(file);
+    std::vector<unsigned char> vchRead(16);
+    vchRead.resize(fread(vchRead.data(), 1, vchRead.size(), file));
+    fclose(file);
+    BOOST_CHECK(vchRead == vchSnapshot);
+
+    SidechainDB scdbReplay;
+    bool fRet = false;
+    BOOST_CHECK_EQUAL(ReplayInto(pathLog, scdbReplay, fRet), 1U);
+    BOOST_CHECK(fRet);
+    BOOST_CHECK(scdbReplay.GetRemovedBMM() == std::set<uint256>{ hashBMM });
+
+    scdbTest.SetLog(nullptr);
+    log.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,9 @@
 #include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <future>
+
 BOOST_AUTO_TEST_SUITE(scheduler_tests)
 
 static void microTask(CScheduler& s, boost::mutex& mutex, int& counter, int delta, boost::chrono::system_clock::time_point rescheduleTime)
@@ -112,4 +115,69 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(wheel_order)
+{
+    // Tasks spread over several levels of the wheel run in time order
+    CScheduler scheduler;
+    FastRandomContext rng(42);
+    boost::mutex mutex;
+    std::vector<boost::chrono::system_clock::time_point> vRun;
+    int nEarly = 0;
+
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    for (int i = 0; i < 200; i++) {
+        boost::chrono::system_clock::time_point t = now + boost::chrono::microseconds(rng.randrange(300000));
+        scheduler.schedule([&mutex, &vRun, &nEarly, t] {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nEarly += boost::chrono::system_clock::now() < t;
+            vRun.push_back(t);
+        }, t);
+    }
+    boost::chrono::system_clock::time_point first, last;
+    BOOST_CHECK_EQUAL(scheduler.getQueueInfo(first, last), 200U);
+    BOOST_CHECK(first >= now);
+
+    boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    thread.join();
+
+    BOOST_CHECK_EQUAL(nEarly, 0);
+    BOOST_CHECK_EQUAL(vRun.size(), 200U);
+    for (size_t i = 1; i < vRun.size(); i++) {
+        // Tasks due in the same millisecond run in the order they were scheduled
+        BOOST_CHECK(vRun[i] + boost::chrono::milliseconds(1) > vRun[i - 1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lanes)
+{
+    // A slow task in the bulk lane doesn't hold up the fast lane
+    CScheduler scheduler;
+    boost::thread fast(boost::bind(&CScheduler::serviceLane, &scheduler, SCHEDULER_LANE_FAST));
+    boost::thread bulk(boost::bind(&CScheduler::serviceLane, &scheduler, SCHEDULER_LANE_BULK));
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> nFastRuns(0);
+    scheduler.schedule([released] { released.wait(); }, boost::chrono::system_clock::now(), SCHEDULER_LANE_BULK, "slow");
+    scheduler.scheduleEvery([&nFastRuns] { nFastRuns++; }, 1, SCHEDULER_LANE_FAST, "tick");
+
+    while (nFastRuns < 10)
+        MicroSleep(1000);
+    release.set_value();
+
+    scheduler.stop();
+    fast.join();
+    bulk.join();
+
+    std::vector<SchedulerTaskStats> vStats = scheduler.getTaskStats();
+    BOOST_CHECK_EQUAL(vStats.size(), 2U);
+    BOOST_CHECK_EQUAL(vStats[0].name, "slow");
+    BOOST_CHECK_EQUAL(vStats[0].lane, SCHEDULER_LANE_BULK);
+    BOOST_CHECK_EQUAL(vStats[0].nRuns, 1U);
+    BOOST_CHECK_EQUAL(vStats[1].name, "tick");
+    BOOST_CHECK(vStats[1].nRuns >= 10U);
+    BOOST_CHECK(vStats[1].nTimeMax <= vStats[1].nTimeTotal);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1440,5 +1440,71 @@ BOOST_AUTO_TEST_CASE(script_FindAndDelete)
     BOOST_CHECK(s == expect);
 }
 
+BOOST_AUTO_TEST_CASE(script_stack_arena)
+{
+    ScriptStackArena arena;
+
+    // A released buffer comes back empty, with its capacity
+    std::vector<unsigned char> vch(100, 0xab);
+    const unsigned char* pData = vch.data();
+    arena.Release(std::move(vch));
+    std::vector<unsigned char> vchTaken = arena.Take();
+    BOOST_CHECK(vchTaken.empty());
+    BOOST_CHECK(vchTaken.capacity() >= 100);
+    BOOST_CHECK(vchTaken.data() == pData);
+    BOOST_CHECK_EQUAL(arena.Take().capacity(), 0U);
+
+    // Buffers without capacity aren't kept, and only up to
+    // SCRIPT_ARENA_MAX_BUFFERS of the others
+    arena.Release(std::vector<unsigned char>());
+    BOOST_CHECK_EQUAL(arena.Take().capacity(), 0U);
+    for (size_t i = 0; i < SCRIPT_ARENA_MAX_BUFFERS + 10; i++)
+        arena.Release(std::vector<unsigned char>(1));
+    size_t nTaken = 0;
+    while (arena.Take().capacity())
+        nTaken++;
+    BOOST_CHECK_EQUAL(nTaken, SCRIPT_ARENA_MAX_BUFFERS);
+}
+
+BOOST_AUTO_TEST_CASE(script_eval_arena)
+{
+    const std::vector<unsigned char> vchA(33, 0x02);
+    const std::vector<unsigned char> vchB = ParseHex("0102030405");
+
+    const std::vector<CScript> vScript = {
+        CScript() << vchA << vchB << OP_TOALTSTACK << OP_DUP << OP_FROMALTSTACK,
+        CScript() << OP_1 << OP_2 << OP_3 << OP_4 << OP_5 << OP_6 << OP_2ROT << OP_2SWAP,
+        CScript() << OP_1 << vchA << OP_3 << vchB << OP_2OVER << OP_2DUP << OP_3DUP << OP_2DROP,
+        CScript() << vchA << vchB << OP_3 << OP_2 << OP_ROLL << OP_2 << OP_PICK,
+        CScript() << vchA << vchB << OP_1 << OP_NIP << OP_DUP << OP_TUCK << OP_OVER << OP_SWAP << OP_ROT << OP_DEPTH << OP_SIZE,
+        CScript() << vchB << OP_SHA256 << OP_HASH160 << OP_RIPEMD160 << OP_SHA1 << OP_HASH256 << OP_DUP << OP_HASH160,
+        CScript() << OP_5 << OP_7 << OP_ADD << OP_3 << OP_SUB << OP_1ADD << OP_NEGATE << OP_ABS << OP_12 << OP_MAX << OP_0 << OP_MIN << OP_DUP << OP_NUMEQUAL,
+        CScript() << vchA << vchA << OP_EQUAL << OP_IFDUP << OP_0 << OP_IFDUP << OP_0 << OP_10 << OP_16 << OP_WITHIN,
+        CScript() << OP_1 << OP_IF << vchA << OP_ELSE << vchB << OP_ENDIF << OP_0 << OP_NOTIF << vchB << OP_ENDIF,
+        CScript() << vchA << vchB << OP_EQUALVERIFY,
+        CScript() << OP_1 << OP_VERIFY << OP_DROP,
+    };
+
+    // A warm arena with dirty buffers gives the same results as a new one,
+    // also when it is shared by the scripts
+    ScriptStackArena arena;
+    for (int i = 0; i < 10; i++)
+        arena.Release(std::vector<unsigned char>(40, 0xff));
+
+    for (const CScript& script : vScript) {
+        std::vector<std::vector<unsigned char>> stack;
+        ScriptError err;
+        const bool fResult = EvalScript(stack, script, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), SIGVERSION_BASE, &err);
+
+        std::vector<std::vector<unsigned char>> stackArena;
+        ScriptError errArena;
+        const bool fResultArena = EvalScript(stackArena, script, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), SIGVERSION_BASE, &errArena, &arena);
+
+        BOOST_CHECK_MESSAGE(fResult == fResultArena, ScriptToAsmStr(script));
+        BOOST_CHECK_MESSAGE(err == errArena, ScriptToAsmStr(script));
+        BOOST_CHECK_MESSAGE(stack == stackArena, ScriptToAsmStr(script));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -197,4 +197,22 @@ BOOST_AUTO_TEST_CASE(operators)
     }
 }
 
+BOOST_AUTO_TEST_CASE(getvch_reuse)
+{
+    // Serializing into a used buffer gives the same bytes as into a new one
+    std::vector<unsigned char> vch(9, 0xff);
+    for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        for(size_t j = 0; j < sizeof(offsets) / sizeof(offsets[0]); ++j)
+        {
+            for (int64_t num : {values[i], values[i] + offsets[j], values[i] - offsets[j], -values[i]})
+            {
+                CScriptNum(num).getvch(vch);
+                BOOST_CHECK(vch == CScriptNum(num).getvch());
+                BOOST_CHECK(vch == CScriptNum::serialize(num));
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,8 @@
 #include <serialize.h>
 #include <streams.h>
 #include <hash.h>
+#include <primitives/block.h>
+#include <version.h>
 #include <test/test_skydoge.h>
 
 #include <stdint.h>
@@ -365,4 +367,36 @@ BOOST_AUTO_TEST_CASE(class_methods)
     BOOST_CHECK(methodtest3 == methodtest4);
 }
 
+BOOST_AUTO_TEST_CASE(block_tx_arena)
+{
+    CBlock block;
+    for (int i = 0; i < 100; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout.n = i;
+        mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i;
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    // Same transactions, from one arena
+    CDataStream ssArena(ss.begin(), ss.end(), SER_NETWORK | SER_TX_ARENA, PROTOCOL_VERSION);
+    CBlock blockArena;
+    ssArena >> blockArena;
+    BOOST_CHECK(ssArena.empty());
+    BOOST_REQUIRE_EQUAL(blockArena.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(*blockArena.vtx[i] == *block.vtx[i]);
+    }
+
+    // A transaction keeps the arena alive after the block is gone
+    CTransactionRef tx = blockArena.vtx[42];
+    blockArena.SetNull();
+    BOOST_CHECK(tx->GetHash() == block.vtx[42]->GetHash());
+    BOOST_CHECK(tx->vin[0].scriptSig == block.vtx[42]->vin[0].scriptSig);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
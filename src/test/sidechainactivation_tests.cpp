@@ -159,6 +159,37 @@ BOOST_AUTO_TEST_CASE(activate_single)
     BOOST_CHECK(scdbTest.GetActiveSidechainCount() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(activate_active_list)
+{
+    SidechainDB scdbTest;
+    BOOST_CHECK(scdbTest.GetActiveSidechains().empty());
+
+    Sidechain proposal;
+    proposal.nSidechain = 3;
+    proposal.nVersion = 0;
+    proposal.title = "test";
+    proposal.description = "description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+
+    // The list of active sidechains follows activation
+    const std::vector<Sidechain>& vActive = scdbTest.GetActiveSidechains();
+    BOOST_REQUIRE(vActive.size() == 1);
+    BOOST_CHECK(vActive.front().nSidechain == 3);
+    BOOST_CHECK(vActive.front().title == "test");
+
+    // Loading the sidechains from elsewhere replaces it
+    std::vector<Sidechain> vSidechain = scdbTest.GetSidechains();
+    SidechainDB scdbCopy;
+    scdbCopy.CacheSidechains(vSidechain);
+    BOOST_CHECK(scdbCopy.GetActiveSidechains().size() == 1);
+
+    // And a reset clears it
+    scdbTest.Reset();
+    BOOST_CHECK(scdbTest.GetActiveSidechains().empty());
+}
+
 BOOST_AUTO_TEST_CASE(activate_multiple)
 {
     SidechainDB scdbTest;
@@ -744,4 +775,48 @@ BOOST_AUTO_TEST_CASE(per_block_activation_limit_fail)
     BOOST_CHECK(!scdbTest.Update(2, GetRandHash(), scdbTest.GetHashBlockLastSeen(), block.vtx.front()->vout));
 }
 
+BOOST_AUTO_TEST_CASE(proposal_and_ack_cache)
+{
+    // Check that our proposals and acks are cached once and that the
+    // proposal index follows the activation status
+    SidechainDB scdbTest;
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.title = "test";
+    proposal.description = "description";
+
+    Sidechain proposalActive = proposal;
+    proposalActive.fActive = true;
+    BOOST_CHECK(proposalActive.GetProposalHash() == proposal.GetProposalHash());
+
+    Sidechain proposalOther = proposal;
+    proposalOther.title = "other";
+    BOOST_CHECK(proposalOther.GetProposalHash() != proposal.GetProposalHash());
+
+    scdbTest.CacheSidechainProposals(std::vector<Sidechain>{proposal, proposalActive});
+    scdbTest.CacheSidechainProposals(std::vector<Sidechain>{proposal, proposalOther});
+    BOOST_CHECK_EQUAL(scdbTest.GetSidechainProposals().size(), 2U);
+
+    scdbTest.CacheSidechainHashToAck(proposal.GetSerHash());
+    scdbTest.CacheSidechainHashToAck(proposal.GetSerHash());
+    BOOST_CHECK_EQUAL(scdbTest.GetSidechainsToActivate().size(), 1U);
+    BOOST_CHECK(scdbTest.GetAckSidechain(proposal.GetSerHash()));
+    BOOST_CHECK(!scdbTest.GetAckSidechain(proposalOther.GetSerHash()));
+    scdbTest.RemoveSidechainHashToAck(proposal.GetSerHash());
+    BOOST_CHECK(!scdbTest.GetAckSidechain(proposal.GetSerHash()));
+    BOOST_CHECK(scdbTest.GetSidechainsToActivate().empty());
+
+    CTxOut out;
+    out.scriptPubKey = proposal.GetProposalScript();
+    out.nValue = 50 * CENT;
+    BOOST_CHECK(!scdbTest.HaveActivationStatus(proposal.GetSerHash()));
+    BOOST_CHECK(scdbTest.Update(0, GetRandHash(), uint256(), std::vector<CTxOut>{out}));
+    BOOST_CHECK(scdbTest.HaveActivationStatus(proposal.GetSerHash()));
+
+    // The index is rebuilt when the activation status is replaced
+    scdbTest.CacheSidechainActivationStatus(std::vector<SidechainActivationStatus>());
+    BOOST_CHECK(!scdbTest.HaveActivationStatus(proposal.GetSerHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
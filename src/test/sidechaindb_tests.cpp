@@ -3,16 +3,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "clientversion.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "crypto/sha256.h"
+#include "fs.h"
 #include "miner.h"
 #include "random.h"
 #include "script/script.h"
+#include "script/scriptpattern.h"
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "sidechain.h"
 #include "sidechaindb.h"
+#include "streams.h"
+#include "txdb.h"
 #include "uint256.h"
+#include "util.h"
 #include "utilstrencodings.h"
 #include "validation.h"
 
@@ -20,6 +27,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <thread>
+
 CScript EncodeWithdrawalFees(const CAmount& amount)
 {
     CDataStream s(SER_NETWORK, PROTOCOL_VERSION);
@@ -152,7 +161,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_create)
     SidechainDeposit deposit;
     deposit.nSidechain = 0;
     deposit.strDest = "";
-    deposit.tx = mtx;
+    deposit.tx = MakeTransactionRef(mtx);
     deposit.nBurnIndex = 1;
     deposit.nTx = 1;
     deposit.hashBlock = GetRandHash();
@@ -166,7 +175,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_create)
     // Check if CTIP was updated
     SidechainCTIP ctip;
     BOOST_CHECK(scdbTest.GetCTIP(0, ctip));
-    BOOST_CHECK(ctip.out.hash == deposit.tx.GetHash());
+    BOOST_CHECK(ctip.out.hash == deposit.tx->GetHash());
     BOOST_CHECK(ctip.out.n == 1);
 }
 
@@ -216,7 +225,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_multi_deposits)
     SidechainDeposit deposit;
     deposit.nSidechain = 0;
     deposit.strDest = "";
-    deposit.tx = mtx;
+    deposit.tx = MakeTransactionRef(mtx);
     deposit.nBurnIndex = 1;
     deposit.nTx = 1;
 
@@ -224,7 +233,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_multi_deposits)
 
     // Check if we cached it
     std::vector<SidechainDeposit> vDeposit = scdbTest.GetDeposits(0);
-    BOOST_CHECK(vDeposit.size() == 1 && vDeposit.front().tx == mtx);
+    BOOST_CHECK(vDeposit.size() == 1 && *vDeposit.front().tx == CTransaction(mtx));
 
     // Compare with scdbTest CTIP
     SidechainCTIP ctip;
@@ -251,14 +260,14 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_multi_deposits)
     // Add deposit output
     mtx2.vout.push_back(CTxOut(25 * CENT, sidechainScript));
 
-    deposit.tx = mtx2;
+    deposit.tx = MakeTransactionRef(mtx2);
 
     scdbTest.AddDeposits(std::vector<SidechainDeposit>{ deposit });
 
     // Check if we cached it
     vDeposit.clear();
     vDeposit = scdbTest.GetDeposits(0);
-    BOOST_CHECK(vDeposit.size() == 2 && vDeposit.back().tx == mtx2);
+    BOOST_CHECK(vDeposit.size() == 2 && *vDeposit.back().tx == CTransaction(mtx2));
 
     // Compare with scdbTest CTIP
     SidechainCTIP ctip2;
@@ -305,7 +314,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_spend_withdrawal)
     SidechainDeposit deposit;
     deposit.nSidechain = 0;
     deposit.strDest = "";
-    deposit.tx = mtx;
+    deposit.tx = MakeTransactionRef(mtx);
     deposit.nBurnIndex = 1;
     deposit.nTx = 1;
 
@@ -313,7 +322,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_spend_withdrawal)
 
     // Check if we cached it
     std::vector<SidechainDeposit> vDeposit = scdbTest.GetDeposits(0);
-    BOOST_CHECK(vDeposit.size() == 1 && vDeposit.front().tx == mtx);
+    BOOST_CHECK(vDeposit.size() == 1 && *vDeposit.front().tx == CTransaction(mtx));
 
     // Compare with scdbTest CTIP
     SidechainCTIP ctip;
@@ -335,6 +344,35 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_spend_withdrawal)
     uint256 hashBlind;
     BOOST_CHECK(CTransaction(wmtx).GetBlindHash(hashBlind));
 
+    // The cached blind hash matches the one computed on the fly, and copies
+    // keep it
+    uint256 hashBlindMutable;
+    BOOST_CHECK(wmtx.GetBlindHash(hashBlindMutable));
+    BOOST_CHECK(hashBlindMutable == hashBlind);
+    CTransaction wtx(wmtx);
+    uint256 hashBlindCached;
+    BOOST_CHECK(wtx.GetBlindHash(hashBlindCached));
+    BOOST_CHECK(CTransaction(wtx).GetBlindHash(hashBlindCached));
+    BOOST_CHECK(hashBlindCached == hashBlind);
+
+    // The bundle is analyzed once and copies share the result
+    std::shared_ptr<const WithdrawalBundleInfo> info = GetWithdrawalBundleInfo(wtx);
+    BOOST_REQUIRE(info);
+    BOOST_CHECK(GetWithdrawalBundleInfo(CTransaction(wtx)) == info);
+    BOOST_CHECK(info->hashBlind == hashBlind);
+    BOOST_CHECK(info->outCTIP == ctip.out);
+    BOOST_CHECK_EQUAL(info->nOutputs, 4U);
+    BOOST_CHECK(info->fFees);
+    BOOST_CHECK_EQUAL(info->amountFees, 1 * CENT);
+    BOOST_CHECK_EQUAL(info->amountOut, 49 * CENT);
+    BOOST_CHECK_EQUAL(info->amountBlindOut, 25 * CENT);
+    BOOST_CHECK_EQUAL(info->amountPayout, 25 * CENT);
+    BOOST_CHECK_EQUAL(info->nSidechainOutputs, 1U);
+    BOOST_CHECK_EQUAL(info->nChangeIndex, 3U);
+    BOOST_CHECK_EQUAL(info->nChangeSidechain, 0);
+    BOOST_CHECK_EQUAL(info->amountChange, 24 * CENT);
+    BOOST_CHECK(info->strReturnDestError.empty());
+
     // Add withdrawal bundle
     scdbTest.AddWithdrawal(0, hashBlind, 0);
 
@@ -381,7 +419,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_spend_withdrawal)
     // Add deposit output
     mtx2.vout.push_back(CTxOut(25 * CENT, sidechainScript));
 
-    deposit.tx = mtx2;
+    deposit.tx = MakeTransactionRef(mtx2);
 
     scdbTest.AddDeposits(std::vector<SidechainDeposit>{ deposit });
 
@@ -390,7 +428,7 @@ BOOST_AUTO_TEST_CASE(sidechaindb_wallet_ctip_spend_withdrawal)
     vDeposit = scdbTest.GetDeposits(0);
     // Should now have 3 deposits cached (first deposit, withdrawal change,
     // this deposit)
-    BOOST_CHECK(vDeposit.size() == 3 && vDeposit.back().tx == mtx2);
+    BOOST_CHECK(vDeposit.size() == 3 && *vDeposit.back().tx == CTransaction(mtx2));
 
     // Compare with scdbTest CTIP
     SidechainCTIP ctip2;
@@ -472,6 +510,141 @@ BOOST_AUTO_TEST_CASE(IsSidechainActivationCommit)
     BOOST_CHECK(hashSidechain == proposal.GetSerHash());
 }
 
+BOOST_AUTO_TEST_CASE(script_patterns)
+{
+    const uint256 hash = GetRandHash();
+
+    // h* commitment, with and without critical data bytes
+    CScript script(CRITICAL_HASH_COMMIT_PATTERN.prefix, CRITICAL_HASH_COMMIT_PATTERN.prefix + 5);
+    script.insert(script.end(), hash.begin(), hash.end());
+
+    uint256 hashRead;
+    std::vector<unsigned char> vBytes;
+    BOOST_CHECK(script.IsCriticalHashCommit(hashRead, vBytes));
+    BOOST_CHECK(hashRead == hash);
+    BOOST_CHECK(vBytes.empty());
+
+    script.push_back(0x07);
+    BOOST_CHECK(script.IsCriticalHashCommit(hashRead, vBytes));
+    BOOST_CHECK(vBytes == std::vector<unsigned char>{0x07});
+
+    // Not a commitment: wrong header, too short, null hash
+    CScript scriptBad = script;
+    scriptBad[4] ^= 1;
+    BOOST_CHECK(!scriptBad.IsCriticalHashCommit(hashRead, vBytes));
+    scriptBad = CScript(script.begin(), script.begin() + 36);
+    BOOST_CHECK(!scriptBad.IsCriticalHashCommit(hashRead, vBytes));
+    scriptBad = CScript(CRITICAL_HASH_COMMIT_PATTERN.prefix, CRITICAL_HASH_COMMIT_PATTERN.prefix + 5);
+    scriptBad.insert(scriptBad.end(), (size_t)32, (unsigned char)0x00);
+    BOOST_CHECK(!scriptBad.IsCriticalHashCommit(hashRead, vBytes));
+    BOOST_CHECK(!CScript().IsCriticalHashCommit(hashRead, vBytes));
+
+    // Withdrawal hash commitment is exactly 38 bytes
+    script = CScript(WITHDRAWAL_HASH_COMMIT_PATTERN.prefix, WITHDRAWAL_HASH_COMMIT_PATTERN.prefix + 5);
+    script.insert(script.end(), hash.begin(), hash.end());
+    script.push_back(3);
+
+    uint8_t nSidechain = 0;
+    BOOST_CHECK(script.IsWithdrawalHashCommit(hashRead, nSidechain));
+    BOOST_CHECK(hashRead == hash);
+    BOOST_CHECK(nSidechain == 3);
+    script.push_back(0);
+    BOOST_CHECK(!script.IsWithdrawalHashCommit(hashRead, nSidechain));
+
+    // Withdrawal fees, an 8 byte push after OP_RETURN
+    const CAmount amount = 123456789;
+    CDataStream ds(SER_NETWORK, PROTOCOL_VERSION);
+    ds << amount;
+    script = CScript() << OP_RETURN << std::vector<unsigned char>(ds.begin(), ds.end());
+
+    CAmount amountRead = 0;
+    BOOST_CHECK(DecodeWithdrawalFees(script, amountRead));
+    BOOST_CHECK(amountRead == amount);
+    script = CScript() << OP_RETURN << std::vector<unsigned char>(ds.begin(), ds.begin() + 7);
+    BOOST_CHECK(!DecodeWithdrawalFees(script, amountRead));
+    BOOST_CHECK(!DecodeWithdrawalFees(CScript(), amountRead));
+
+    // BMM request bytes
+    CCriticalData data;
+    data.hashCritical = hash;
+    data.vBytes = {0x00, 0xbf, 0x00, 0x02, 0xde, 0xad, 0xbe, 0xef};
+
+    std::string strPrevBlock;
+    BOOST_CHECK(data.IsBMMRequest(nSidechain, strPrevBlock));
+    BOOST_CHECK(nSidechain == 2);
+    BOOST_CHECK(strPrevBlock == "deadbeef");
+    data.vBytes.pop_back();
+    BOOST_CHECK(!data.IsBMMRequest());
+}
+
+BOOST_AUTO_TEST_CASE(coinbase_commitments)
+{
+    // Add one of each commitment to a coinbase at once and read them back
+    Sidechain proposal;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+
+    CCriticalData data;
+    data.hashCritical = GetRandHash();
+    data.vBytes = std::vector<unsigned char>{0x00, 0xbf, 0x00};
+
+    CoinbaseCommitments commitments;
+    commitments.vWithdrawal.emplace_back(1, GetRandHash());
+    commitments.vCriticalData.push_back(CCriticalData());
+    commitments.vCriticalData.back().hashCritical = GetRandHash();
+    commitments.vCriticalData.push_back(data);
+    commitments.vProposal.push_back(proposal);
+    commitments.vActivation.push_back(proposal.GetSerHash());
+
+    CBlock block;
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    CScript script;
+    GenerateSCDBByteCommitment(block, script, std::vector<std::vector<SidechainWithdrawalState>>{}, std::vector<std::string>(256, std::string(1, SCDB_ABSTAIN)));
+    commitments.vSCDBBytes.push_back(script);
+    commitments.AddToCoinbase(block);
+
+    BOOST_CHECK_EQUAL(block.vtx[0]->vout.size(), 8U);
+
+    CoinbaseCommitments commitmentsRead;
+    commitmentsRead.Read(block.vtx[0]->vout);
+    BOOST_CHECK(commitmentsRead.vWithdrawal == commitments.vWithdrawal);
+    BOOST_CHECK_EQUAL(commitmentsRead.vSCDBBytes.size(), 2U);
+    BOOST_CHECK(commitmentsRead.vSCDBBytes.back() == script);
+    BOOST_CHECK_EQUAL(commitmentsRead.vCriticalData.size(), 2U);
+    BOOST_CHECK(commitmentsRead.vCriticalData.back().hashCritical == data.hashCritical);
+    BOOST_CHECK(commitmentsRead.vCriticalData.back().vBytes == data.vBytes);
+    BOOST_CHECK(commitmentsRead.vCriticalData.front().vBytes.empty());
+    BOOST_CHECK_EQUAL(commitmentsRead.vProposal.size(), 1U);
+    BOOST_CHECK(commitmentsRead.vProposal.front() == proposal);
+    BOOST_CHECK(commitmentsRead.vActivation == commitments.vActivation);
+
+    // The outputs are the same as the ones added one at a time
+    CBlock blockSingle;
+    mtx = CMutableTransaction();
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    blockSingle.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    GenerateWithdrawalHashCommitment(blockSingle, commitments.vWithdrawal.front().second, 1);
+    GenerateSidechainActivationCommitment(blockSingle, proposal.GetSerHash());
+    BOOST_CHECK(blockSingle.vtx[0]->vout.front() == block.vtx[0]->vout[2]);
+    BOOST_CHECK(blockSingle.vtx[0]->vout.back() == block.vtx[0]->vout.back());
+
+    // The commitments are only kept with a block that is immutable
+    std::shared_ptr<const CoinbaseCommitments> commitmentsBlock = GetCoinbaseCommitments(block);
+    BOOST_CHECK(commitmentsBlock->vActivation == commitments.vActivation);
+    BOOST_CHECK(GetCoinbaseCommitments(block) != commitmentsBlock);
+    block.MarkImmutable();
+    commitmentsBlock = GetCoinbaseCommitments(block);
+    BOOST_CHECK(GetCoinbaseCommitments(block) == commitmentsBlock);
+    block.InvalidateHash();
+    BOOST_CHECK(GetCoinbaseCommitments(block) != commitmentsBlock);
+}
+
 BOOST_AUTO_TEST_CASE(IsSidechainUpdateBytes)
 {
     CBlock block;
@@ -589,7 +762,738 @@ BOOST_AUTO_TEST_CASE(txn_to_deposit)
 
     // TxnToDeposit
     SidechainDeposit deposit;
-    BOOST_CHECK(scdbTest.TxnToDeposit(mtx, 0, {}, deposit));
+    BOOST_CHECK(scdbTest.TxnToDeposit(MakeTransactionRef(mtx), 0, {}, deposit));
+
+    // The destination key is set, and set again when the deposit is read
+    BOOST_CHECK(deposit.strDest == "patrick");
+    BOOST_CHECK(deposit.HasDest(DepositDestKey("patrick")));
+    BOOST_CHECK(!deposit.HasDest(DepositDestKey("patrick2")));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << deposit;
+    SidechainDeposit depositRead;
+    ss >> depositRead;
+    BOOST_CHECK(depositRead == deposit);
+    BOOST_CHECK(depositRead.destKey == deposit.destKey);
+
+    // A deposit address has the same key as its destination
+    std::string strNoCheck = "s0_patrick_";
+    std::vector<unsigned char> vchHash(CSHA256::OUTPUT_SIZE);
+    CSHA256().Write((unsigned char*)&strNoCheck[0], strNoCheck.size()).Finalize(&vchHash[0]);
+    std::string strAddress = strNoCheck + HexStr(vchHash.begin(), vchHash.end()).substr(0, 6);
+
+    unsigned int nSidechain = 255;
+    BOOST_CHECK(ParseDepositDestKey(strAddress, nSidechain) == deposit.destKey);
+    BOOST_CHECK(nSidechain == 0);
+
+    // Anything else is taken as a bare destination
+    nSidechain = 255;
+    BOOST_CHECK(ParseDepositDestKey("patrick", nSidechain) == deposit.destKey);
+    BOOST_CHECK(nSidechain == 255);
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_block_data_delta)
+{
+    // SCDB block data is written as deltas between checkpoints, check that
+    // reading it back always gives the full data that was written
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+
+    SidechainBlockData data;
+    data.vSidechain.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    for (size_t i = 0; i < data.vSidechain.size(); i++)
+        data.vSidechain[i].nSidechain = i;
+    data.vWithdrawalStatus.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+
+    std::vector<std::pair<uint256, uint256>> vBlock;
+    uint256 hashPrev = GetRandHash();
+    const int nBlocks = SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL * 2 + 10;
+    for (int i = 1; i <= nBlocks; i++) {
+        if (i == 5) {
+            data.vSidechain[3].fActive = true;
+            data.vSidechain[3].title = "test";
+        }
+        if (i % 7 == 0) {
+            SidechainWithdrawalState state;
+            state.nSidechain = 3;
+            state.nBlocksLeft = SIDECHAIN_WITHDRAWAL_VERIFICATION_PERIOD;
+            state.nWorkScore = i;
+            state.hash = GetRandHash();
+            data.vWithdrawalStatus[3].push_back(state);
+        }
+        if (i % 11 == 0) {
+            SidechainActivationStatus status;
+            status.nAge = i;
+            status.nFail = 0;
+            data.vActivationStatus.push_back(status);
+        }
+
+        uint256 hashBlock = GetRandHash();
+        BOOST_CHECK(db.WriteSidechainBlockData(hashBlock, hashPrev, i, data));
+        BOOST_CHECK(db.HaveBlockData(hashBlock));
+        vBlock.push_back(std::make_pair(hashBlock, data.GetSerHash()));
+        hashPrev = hashBlock;
+    }
+
+    // Read back in random order so that deltas are replayed from checkpoints
+    // and not only served from the cache
+    for (size_t i = 0; i < vBlock.size(); i++) {
+        const auto& block = vBlock[(i * 37) % vBlock.size()];
+        SidechainBlockData dataRead;
+        BOOST_CHECK(db.GetBlockData(block.first, dataRead));
+        BOOST_CHECK(dataRead.GetSerHash() == block.second);
+    }
+
+    BOOST_CHECK(!db.HaveBlockData(GetRandHash()));
+
+    // A block that doesn't change anything produces an empty delta
+    SidechainBlockDelta delta;
+    delta.Build(hashPrev, data, data);
+    BOOST_CHECK(delta.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_block_data_prune)
+{
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+
+    SidechainBlockData data;
+    data.vSidechain.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    data.vWithdrawalStatus.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+
+    std::vector<uint256> vHash;
+    uint256 hashPrev;
+    const int nBlocks = SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL * 2 + 10;
+    for (int i = 0; i < nBlocks; i++) {
+        data.vSidechain[0].nVersion = i;
+        uint256 hashBlock = GetRandHash();
+        BOOST_CHECK(db.WriteSidechainBlockData(hashBlock, hashPrev, i, data));
+        vHash.push_back(hashBlock);
+        hashPrev = hashBlock;
+    }
+    BOOST_CHECK_EQUAL(db.ReadPruneHeight(), 0);
+
+    // Prune up to the first checkpoint after genesis
+    const int nPruneHeight = SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL;
+    std::vector<uint256> vPrune(vHash.begin(), vHash.begin() + nPruneHeight);
+    BOOST_CHECK(db.PruneBlockData(vPrune, nPruneHeight));
+    BOOST_CHECK_EQUAL(db.ReadPruneHeight(), nPruneHeight);
+
+    for (int i = 0; i < nBlocks; i++)
+        BOOST_CHECK_EQUAL(db.HaveBlockData(vHash[i]), i >= nPruneHeight);
+
+    // The blocks after the prune height are still rebuilt from their
+    // checkpoint
+    for (int i = nBlocks - 1; i >= nPruneHeight; i -= 7) {
+        SidechainBlockData dataRead;
+        BOOST_CHECK(db.GetBlockData(vHash[i], dataRead));
+        BOOST_CHECK_EQUAL(dataRead.vSidechain[0].nVersion, i);
+    }
+    SidechainBlockData dataRead;
+    BOOST_CHECK(!db.GetBlockData(vHash[nPruneHeight - 1], dataRead));
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_cached_scdb_bytes)
+{
+    // Check that the SCDB update bytes SCDB keeps for our votes follow
+    // withdrawal and vote changes
+    SidechainDB scdbTest;
+
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+
+    uint256 hash1 = GetRandHash();
+    uint256 hash2 = GetRandHash();
+    BOOST_CHECK(scdbTest.AddWithdrawal(0, hash1));
+    BOOST_CHECK(scdbTest.AddWithdrawal(0, hash2));
+
+    std::vector<std::vector<SidechainWithdrawalState>> vScores;
+    vScores.push_back(scdbTest.GetState(0));
+
+    // Abstain by default
+    std::vector<std::string> vVote(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    std::vector<std::string> vParsedVote;
+    BOOST_CHECK(ParseSCDBBytes(scdbTest.GetSCDBByteCommitment(), vScores, vParsedVote));
+    BOOST_CHECK(vVote == vParsedVote);
+
+    // Upvote the second withdrawal
+    vVote[0] = hash2.ToString();
+    BOOST_CHECK(scdbTest.CacheCustomVotes(vVote));
+    BOOST_CHECK(ParseSCDBBytes(scdbTest.GetSCDBByteCommitment(), vScores, vParsedVote));
+    BOOST_CHECK(vVote == vParsedVote);
+
+    // Downvote
+    vVote[0] = std::string(1, SCDB_DOWNVOTE);
+    BOOST_CHECK(scdbTest.CacheCustomVotes(vVote));
+    BOOST_CHECK(ParseSCDBBytes(scdbTest.GetSCDBByteCommitment(), vScores, vParsedVote));
+    BOOST_CHECK(vVote == vParsedVote);
+
+    // Without withdrawals there is nothing to vote on
+    scdbTest.ResetWithdrawalState();
+    BOOST_CHECK(scdbTest.GetSCDBByteCommitment().size() == 6);
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_spent_withdrawal_index)
+{
+    // Check that spent withdrawals are found by hash until the blocks that
+    // spent them are all disconnected
+    SidechainDB scdbTest;
+
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+
+    uint256 hash = GetRandHash();
+    uint256 hashBlock1 = GetRandHash();
+    uint256 hashBlock2 = GetRandHash();
+
+    SidechainSpentWithdrawal spent;
+    spent.nSidechain = 0;
+    spent.hash = hash;
+    spent.hashBlock = hashBlock1;
+    scdbTest.AddSpentWithdrawals(std::vector<SidechainSpentWithdrawal>{ spent });
+
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(hash, 0));
+    BOOST_CHECK(!scdbTest.HaveSpentWithdrawal(hash, 1));
+    BOOST_CHECK(!scdbTest.HaveSpentWithdrawal(GetRandHash(), 0));
+
+    // Spent again by a block of another branch
+    spent.hashBlock = hashBlock2;
+    scdbTest.AddSpentWithdrawals(std::vector<SidechainSpentWithdrawal>{ spent });
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 50 * CENT;
+    std::vector<CTransactionRef> vtx{ MakeTransactionRef(mtx) };
+
+    BOOST_CHECK(scdbTest.Undo(1, hashBlock1, uint256(), vtx));
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(hash, 0));
+    BOOST_CHECK(scdbTest.Undo(1, hashBlock2, uint256(), vtx));
+    BOOST_CHECK(!scdbTest.HaveSpentWithdrawal(hash, 0));
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_withdrawal_history_archive)
+{
+    // Check that old withdrawal spends and failed withdrawals are moved to
+    // the database and still found there
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+    BOOST_CHECK(scdbTest.SetDepositDB(&db));
+
+    const size_t nBlocks = 2 * SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE + 1;
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    std::vector<SidechainFailedWithdrawal> vFailed;
+    for (size_t i = 0; i < nBlocks; i++) {
+        SidechainSpentWithdrawal spent;
+        spent.nSidechain = 0;
+        spent.hash = GetRandHash();
+        spent.hashBlock = GetRandHash();
+        scdbTest.AddSpentWithdrawals(std::vector<SidechainSpentWithdrawal>{ spent });
+        vSpent.push_back(spent);
+
+        SidechainFailedWithdrawal failed;
+        failed.nSidechain = 0;
+        failed.hash = GetRandHash();
+        scdbTest.AddFailedWithdrawals(std::vector<SidechainFailedWithdrawal>{ failed });
+        vFailed.push_back(failed);
+    }
+
+    // Only the most recent are kept in memory
+    BOOST_CHECK_EQUAL(scdbTest.GetSpentWithdrawalCache().size(), SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE);
+    BOOST_CHECK_EQUAL(scdbTest.GetFailedWithdrawalCache().size(), SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE);
+
+    // Lookups and listing include the archived ones
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(vSpent.front().hash, 0));
+    BOOST_CHECK(!scdbTest.HaveSpentWithdrawal(vSpent.front().hash, 1));
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(vSpent.back().hash, 0));
+    BOOST_CHECK(scdbTest.HaveFailedWithdrawal(vFailed.front().hash, 0));
+    BOOST_CHECK(!scdbTest.HaveFailedWithdrawal(vFailed.front().hash, 1));
+    BOOST_CHECK(scdbTest.HaveFailedWithdrawal(vFailed.back().hash, 0));
+    BOOST_CHECK_EQUAL(scdbTest.GetSpentWithdrawalsForBlock(vSpent.front().hashBlock).size(), 1U);
+    BOOST_CHECK_EQUAL(scdbTest.GetSpentWithdrawalCache(0, nBlocks + 1).size(), nBlocks);
+    BOOST_CHECK_EQUAL(scdbTest.GetSpentWithdrawalCache(nBlocks - 10, 100).size(), 10U);
+    BOOST_CHECK_EQUAL(scdbTest.GetFailedWithdrawalCache(0, nBlocks + 1).size(), nBlocks);
+    BOOST_CHECK_EQUAL(scdbTest.GetFailedWithdrawalCache(5, 10).size(), 10U);
+
+    // Disconnecting an archived block erases its spends from the database
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 50 * CENT;
+    std::vector<CTransactionRef> vtx{ MakeTransactionRef(mtx) };
+
+    BOOST_CHECK(scdbTest.Undo(1, vSpent.front().hashBlock, uint256(), vtx));
+    BOOST_CHECK(!scdbTest.HaveSpentWithdrawal(vSpent.front().hash, 0));
+    BOOST_CHECK(scdbTest.GetSpentWithdrawalsForBlock(vSpent.front().hashBlock).empty());
+
+    BOOST_CHECK(scdbTest.SetDepositDB(nullptr));
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_remove_stale_withdrawal_history)
+{
+    // Check that withdrawal history loaded for other blocks than SCDB is
+    // synced to is removed
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+
+    // A withdrawal waiting for votes, which failed on another branch
+    const uint256 hashPending = GetRandHash();
+    BOOST_CHECK(scdbTest.AddWithdrawal(0, hashPending));
+    SidechainFailedWithdrawal failed;
+    failed.nSidechain = 0;
+    failed.hash = hashPending;
+    scdbTest.AddFailedWithdrawals(std::vector<SidechainFailedWithdrawal>{ failed });
+
+    // A withdrawal that failed in our chain
+    failed.hash = GetRandHash();
+    scdbTest.AddFailedWithdrawals(std::vector<SidechainFailedWithdrawal>{ failed });
+
+    // Spends of a block in our chain and of one that isn't
+    const uint256 hashBlockChain = GetRandHash();
+    const uint256 hashBlockStale = GetRandHash();
+    SidechainSpentWithdrawal spentChain;
+    spentChain.nSidechain = 0;
+    spentChain.hash = GetRandHash();
+    spentChain.hashBlock = hashBlockChain;
+    SidechainSpentWithdrawal spentStale;
+    spentStale.nSidechain = 0;
+    spentStale.hash = GetRandHash();
+    spentStale.hashBlock = hashBlockStale;
+    scdbTest.AddSpentWithdrawals(std::vector<SidechainSpentWithdrawal>{ spentChain, spentStale });
+
+    const size_t nRemoved = scdbTest.RemoveStaleWithdrawalHistory([&hashBlockChain](const uint256& hash) {
+        return hash == hashBlockChain;
+    });
+    BOOST_CHECK_EQUAL(nRemoved, 2U);
+
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(spentChain.hash, 0));
+    BOOST_CHECK(!scdbTest.HaveSpentWithdrawal(spentStale.hash, 0));
+    BOOST_CHECK(scdbTest.GetSpentWithdrawalsForBlock(hashBlockStale).empty());
+    BOOST_CHECK(!scdbTest.HaveFailedWithdrawal(hashPending, 0));
+    BOOST_CHECK(scdbTest.HaveFailedWithdrawal(failed.hash, 0));
+    BOOST_CHECK_EQUAL(scdbTest.GetFailedWithdrawalCache().size(), 1U);
+
+    // Nothing left to remove
+    BOOST_CHECK_EQUAL(scdbTest.RemoveStaleWithdrawalHistory([&hashBlockChain](const uint256& hash) {
+        return hash == hashBlockChain;
+    }), 0U);
+}
+
+/** Write ss to the SCDB cache file strFile of older versions */
+static void WriteLegacyCacheFile(const std::string& strFile, const CDataStream& ss)
+{
+    TryCreateDirectories(GetDataDir() / "skydoge");
+    CAutoFile fileout(fsbridge::fopen(GetDataDir() / "skydoge" / strFile, "wb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    fileout.write(ss.data(), ss.size());
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_cache_file)
+{
+    // Check that the separate cache files of older versions are imported,
+    // replaced by the single snapshot file and loaded back from it
+    const uint64_t nVersion = 1;
+    const fs::path pathDir = GetDataDir() / "skydoge";
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+    CDataStream ssProposal(SER_DISK, CLIENT_VERSION);
+    ssProposal << nVersion << 1 << proposal;
+    WriteLegacyCacheFile("sidechainproposals.dat", ssProposal);
+
+    const uint256 hashActivate = GetRandHash();
+    CDataStream ssActivate(SER_DISK, CLIENT_VERSION);
+    ssActivate << nVersion << 1 << hashActivate;
+    WriteLegacyCacheFile("sidechainhashactivate.dat", ssActivate);
+
+    const uint256 txidBMM = GetRandHash();
+    CDataStream ssBMM(SER_DISK, CLIENT_VERSION);
+    ssBMM << nVersion << 1 << txidBMM;
+    WriteLegacyCacheFile("bmm.dat", ssBMM);
+
+    // Withdrawal history of the genesis block, our chain tip, and of a block
+    // that isn't in our chain
+    SidechainSpentWithdrawal spent;
+    spent.nSidechain = 0;
+    spent.hash = GetRandHash();
+    spent.hashBlock = chainActive.Tip()->GetBlockHash();
+    SidechainSpentWithdrawal spentStale;
+    spentStale.nSidechain = 0;
+    spentStale.hash = GetRandHash();
+    spentStale.hashBlock = GetRandHash();
+    SidechainFailedWithdrawal failed;
+    failed.nSidechain = 0;
+    failed.hash = GetRandHash();
+    CDataStream ssWithdrawal(SER_DISK, CLIENT_VERSION);
+    ssWithdrawal << nVersion << 0 << 2 << spent << spentStale << 1 << failed;
+    WriteLegacyCacheFile("withdrawal.dat", ssWithdrawal);
+
+    BOOST_CHECK(LoadSCDBCache());
+    BOOST_CHECK(scdb.GetSidechainProposals().size() == 1);
+    BOOST_CHECK(scdb.GetSidechainProposals()[0].title == proposal.title);
+    BOOST_CHECK(scdb.GetSidechainsToActivate() == std::vector<uint256>{hashActivate});
+    BOOST_CHECK(scdb.GetRemovedBMM() == std::set<uint256>{txidBMM});
+    BOOST_CHECK(scdb.HaveSpentWithdrawal(spent.hash, 0));
+    BOOST_CHECK(!scdb.HaveSpentWithdrawal(spentStale.hash, 0));
+    BOOST_CHECK(scdb.HaveFailedWithdrawal(failed.hash, 0));
+
+    // Dumping writes the snapshot file and removes the old files
+    DumpSCDBCache();
+    BOOST_CHECK(fs::exists(pathDir / "scdb.dat"));
+    for (const char* strFile : {"withdrawal.dat", "sidechainproposals.dat", "sidechainhashactivate.dat", "bmm.dat"})
+        BOOST_CHECK(!fs::exists(pathDir / strFile));
+
+    // The snapshot loads the same caches
+    scdb.Reset();
+    BOOST_CHECK(scdb.GetRemovedBMM().empty());
+    BOOST_CHECK(LoadSCDBCache());
+    BOOST_CHECK(scdb.GetSidechainProposals().size() == 1);
+    BOOST_CHECK(scdb.GetSidechainsToActivate() == std::vector<uint256>{hashActivate});
+    BOOST_CHECK(scdb.GetRemovedBMM() == std::set<uint256>{txidBMM});
+    BOOST_CHECK(scdb.HaveSpentWithdrawal(spent.hash, 0));
+    BOOST_CHECK(scdb.HaveFailedWithdrawal(failed.hash, 0));
+
+    // Spent & failed withdrawals are rebuilt from the chain when reindexing
+    scdb.Reset();
+    BOOST_CHECK(LoadSCDBCache(true /* fReindex */));
+    BOOST_CHECK(scdb.GetRemovedBMM() == std::set<uint256>{txidBMM});
+    BOOST_CHECK(!scdb.HaveSpentWithdrawal(spent.hash, 0));
+    BOOST_CHECK(!scdb.HaveFailedWithdrawal(failed.hash, 0));
+
+    // A snapshot of another version isn't loaded
+    CDataStream ssOther(SER_DISK, CLIENT_VERSION);
+    ssOther << nVersion + 1;
+    WriteLegacyCacheFile("scdb.dat", ssOther);
+    scdb.Reset();
+    BOOST_CHECK(!LoadSCDBCache());
+
+    fs::remove(pathDir / "scdb.dat");
+    scdb.Reset();
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_memory_limit)
+{
+    // Check that SCDB keeps less in memory when it uses more than it may
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+    BOOST_CHECK(scdbTest.SetDepositDB(&db));
+    BOOST_CHECK_EQUAL(scdbTest.GetCacheSize(), SIDECHAIN_DEPOSIT_CACHE_SIZE);
+
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    for (size_t i = 0; i < SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE; i++) {
+        SidechainSpentWithdrawal spent;
+        spent.nSidechain = 0;
+        spent.hash = GetRandHash();
+        spent.hashBlock = GetRandHash();
+        scdbTest.AddSpentWithdrawals(std::vector<SidechainSpentWithdrawal>{ spent });
+        vSpent.push_back(spent);
+    }
+
+    // The spends are accounted to their sidechain
+    std::vector<SidechainMemoryUsage> vUsage;
+    size_t nShared = 0;
+    scdbTest.GetMemoryUsage(vUsage, nShared);
+    BOOST_CHECK_EQUAL(vUsage.size(), SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    BOOST_CHECK(vUsage[0].nSpentWithdrawals >= SIDECHAIN_WITHDRAWAL_HISTORY_CACHE_SIZE * sizeof(SidechainSpentWithdrawal));
+    BOOST_CHECK_EQUAL(vUsage[1].nSpentWithdrawals, 0U);
+    BOOST_CHECK(vUsage[0].nView > 0);
+    BOOST_CHECK(nShared > 0);
+    const size_t nUsage = scdbTest.DynamicMemoryUsage();
+    BOOST_CHECK_EQUAL(nUsage, nShared + vUsage[0].Total());
+
+    // Over the limit the history is moved to the database down to the
+    // minimum, and still found there
+    scdbTest.SetMaxMemoryUsage(1);
+    BOOST_CHECK_EQUAL(scdbTest.GetCacheSize(), SIDECHAIN_MIN_CACHE_SIZE);
+    BOOST_CHECK_EQUAL(scdbTest.GetSpentWithdrawalCache().size(), SIDECHAIN_MIN_CACHE_SIZE);
+    BOOST_CHECK(scdbTest.DynamicMemoryUsage() < nUsage);
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(vSpent.front().hash, 0));
+    BOOST_CHECK(scdbTest.HaveSpentWithdrawal(vSpent.back().hash, 0));
+    BOOST_CHECK_EQUAL(scdbTest.GetSpentWithdrawalCache(0, vSpent.size() + 1).size(), vSpent.size());
+
+    // With plenty of room the cache grows back
+    scdbTest.SetMaxMemoryUsage(size_t(1) << 30);
+    BOOST_CHECK_EQUAL(scdbTest.GetCacheSize(), 2 * SIDECHAIN_MIN_CACHE_SIZE);
+    scdbTest.SetMaxMemoryUsage(0);
+
+    BOOST_CHECK(scdbTest.SetDepositDB(nullptr));
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_withdrawal_tx_cache)
+{
+    SidechainDB scdbTest;
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 50 * CENT;
+    CTransactionRef tx = MakeTransactionRef(mtx);
+
+    BOOST_CHECK(!scdbTest.HaveWithdrawalTxCached(tx->GetHash()));
+    BOOST_CHECK(scdbTest.CacheWithdrawalTx(tx, 0));
+    BOOST_CHECK(!scdbTest.CacheWithdrawalTx(tx, 0));
+    BOOST_CHECK(scdbTest.HaveWithdrawalTxCached(tx->GetHash()));
+
+    CTransactionRef txCached;
+    BOOST_CHECK(scdbTest.GetCachedWithdrawalTx(tx->GetHash(), txCached));
+    BOOST_CHECK(txCached == tx);
+    BOOST_CHECK(scdbTest.GetWithdrawalTxCache().size() == 1);
+
+    scdbTest.Reset();
+    BOOST_CHECK(!scdbTest.HaveWithdrawalTxCached(tx->GetHash()));
+    BOOST_CHECK(!scdbTest.GetCachedWithdrawalTx(tx->GetHash(), txCached));
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_decode_scdb_bytes)
+{
+    std::vector<std::vector<SidechainWithdrawalState>> vScores(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+    for (size_t x = 0; x < 3; x++) {
+        for (size_t y = 0; y < 5; y++) {
+            SidechainWithdrawalState wt;
+            wt.nSidechain = x;
+            wt.hash = GetRandHash();
+            wt.nBlocksLeft = 999;
+            wt.nWorkScore = 1;
+            vScores[x].push_back(wt);
+        }
+    }
+
+    SCDBVotes votes;
+    votes[0].vote = SCDB_UPVOTE;
+    votes[0].nIndex = 3;
+    votes[1].vote = SCDB_DOWNVOTE;
+
+    CBlock block;
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    CScript script;
+    BOOST_CHECK(GenerateSCDBByteCommitment(block, script, vScores, votes));
+
+    // Two bytes for each of the sidechains with withdrawals, the downvote
+    // bytes are the same as before
+    BOOST_CHECK_EQUAL(script.size(), 6U + 6U);
+    BOOST_CHECK(script[6] == 0x03 && script[7] == 0x00);
+    BOOST_CHECK(script[8] == 0xFF && script[9] == 0xFE);
+    BOOST_CHECK(script[10] == 0xFF && script[11] == 0xFF);
+
+    SCDBVotes votesDecoded;
+    BOOST_CHECK(DecodeSCDBBytes(script, vScores, votesDecoded));
+    for (size_t i = 0; i < SIDECHAIN_ACTIVATION_MAX_ACTIVE; i++) {
+        BOOST_CHECK(votesDecoded[i].vote == votes[i].vote);
+        if (votes[i].vote == SCDB_UPVOTE)
+            BOOST_CHECK_EQUAL(votesDecoded[i].nIndex, votes[i].nIndex);
+    }
+
+    // The string votes decode to the same thing
+    std::vector<std::string> vVote;
+    BOOST_CHECK(ParseSCDBBytes(script, std::vector<std::vector<SidechainWithdrawalState>>(vScores.begin(), vScores.begin() + 3), vVote));
+    BOOST_CHECK(vVote[0] == vScores[0][3].hash.ToString());
+    BOOST_CHECK(vVote[1] == std::string(1, SCDB_DOWNVOTE));
+    BOOST_CHECK(vVote[2] == std::string(1, SCDB_ABSTAIN));
+    BOOST_CHECK(ParseSCDBVote(vVote[0], vScores[0]).nIndex == 3);
+
+    // An upvote of an index that is out of range is invalid
+    CScript scriptBad = script;
+    scriptBad[6] = 0x05;
+    BOOST_CHECK(!DecodeSCDBBytes(scriptBad, vScores, votesDecoded));
+
+    // As are incomplete vote bytes and votes for more sidechains than have
+    // withdrawals
+    scriptBad = script;
+    scriptBad.pop_back();
+    BOOST_CHECK(!DecodeSCDBBytes(scriptBad, vScores, votesDecoded));
+    scriptBad = script;
+    scriptBad.push_back(0xFF);
+    scriptBad.push_back(0xFF);
+    BOOST_CHECK(!DecodeSCDBBytes(scriptBad, vScores, votesDecoded));
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_view)
+{
+    // Check that the published views follow SCDB and that a view that has
+    // been taken isn't changed by later updates
+    SidechainDB scdbTest;
+
+    BOOST_CHECK(!scdbTest.GetSidechainView(0));
+    BOOST_CHECK(scdbTest.GetActiveSidechainsView()->empty());
+
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+
+    std::shared_ptr<const SidechainView> view = scdbTest.GetSidechainView(0);
+    BOOST_CHECK(view);
+    BOOST_CHECK(!scdbTest.GetSidechainView(1));
+    BOOST_CHECK_EQUAL(scdbTest.GetActiveSidechainsView()->size(), 1U);
+    BOOST_CHECK(view->sidechain.title == "Test");
+    BOOST_CHECK(!view->fHaveCTIP);
+    BOOST_CHECK(view->vWithdrawalStatus.empty());
+
+    uint256 hash = GetRandHash();
+    std::vector<std::string> vVote(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    vVote[0] = hash.ToString();
+    std::map<uint8_t, uint256> mapNewWithdrawal;
+    mapNewWithdrawal[0] = hash;
+    BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote, false, mapNewWithdrawal));
+    BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote));
+
+    std::shared_ptr<const SidechainView> viewWithdrawal = scdbTest.GetSidechainView(0);
+    BOOST_CHECK_EQUAL(viewWithdrawal->vWithdrawalStatus.size(), 1U);
+    BOOST_CHECK(viewWithdrawal->vWithdrawalStatus == scdbTest.GetState(0));
+    BOOST_CHECK_EQUAL(viewWithdrawal->vWithdrawalStatus[0].nWorkScore, 2);
+    BOOST_CHECK(view->vWithdrawalStatus.empty());
+
+    // A reset clears the views
+    scdbTest.Reset();
+    BOOST_CHECK(!scdbTest.GetSidechainView(0));
+    BOOST_CHECK(scdbTest.GetActiveSidechainsView()->empty());
+    BOOST_CHECK_EQUAL(viewWithdrawal->vWithdrawalStatus.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_view_sequence)
+{
+    // Check that each kind of change is counted on its own and that waiters
+    // are woken up by it
+    SidechainDB scdbTest;
+
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+
+    std::shared_ptr<const SidechainView> view = scdbTest.GetSidechainView(0);
+    const SidechainViewSequence sequence = view->sequence;
+
+    uint256 hash = GetRandHash();
+    std::vector<std::string> vVote(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    std::map<uint8_t, uint256> mapNewWithdrawal;
+    mapNewWithdrawal[0] = hash;
+    BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote, false, mapNewWithdrawal));
+
+    view = scdbTest.GetSidechainView(0);
+    BOOST_CHECK_EQUAL(view->sequence.nWithdrawal, sequence.nWithdrawal + 1);
+    BOOST_CHECK_EQUAL(view->sequence.nCTIP, sequence.nCTIP);
+    BOOST_CHECK_EQUAL(view->sequence.nDeposit, sequence.nDeposit);
+
+    // Abstaining only changes the blocks left, which isn't counted
+    BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote));
+    BOOST_CHECK_EQUAL(scdbTest.GetSidechainView(0)->sequence.nWithdrawal, sequence.nWithdrawal + 1);
+
+    // Nothing changes before the timeout
+    view = scdbTest.WaitForView(0, [&sequence](const std::shared_ptr<const SidechainView>& v) {
+        return v->sequence.nCTIP != sequence.nCTIP;
+    }, 1);
+    BOOST_CHECK_EQUAL(view->sequence.nCTIP, sequence.nCTIP);
+
+    // A deposit wakes up a waiter for the CTIP
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout.SetNull();
+    mtx.vout.push_back(CTxOut(CAmount(0), CScript() << OP_RETURN << ToByteVector(GetRandHash())));
+    CScript sidechainScript;
+    BOOST_CHECK(scdbTest.GetSidechainScript(0, sidechainScript));
+    mtx.vout.push_back(CTxOut(50 * CENT, sidechainScript));
+
+    SidechainDeposit deposit;
+    deposit.nSidechain = 0;
+    deposit.tx = MakeTransactionRef(mtx);
+    deposit.nBurnIndex = 1;
+    deposit.nTx = 1;
+    deposit.hashBlock = GetRandHash();
+
+    std::shared_ptr<const SidechainView> viewWaited;
+    std::thread waiter([&scdbTest, &sequence, &viewWaited] {
+        viewWaited = scdbTest.WaitForView(0, [&sequence](const std::shared_ptr<const SidechainView>& v) {
+            return v->sequence.nCTIP != sequence.nCTIP;
+        }, 0);
+    });
+    scdbTest.AddDeposits(std::vector<SidechainDeposit>{ deposit });
+    waiter.join();
+
+    BOOST_CHECK(viewWaited->fHaveCTIP);
+    BOOST_CHECK(viewWaited->ctip.out.hash == deposit.tx->GetHash());
+    BOOST_CHECK_EQUAL(viewWaited->sequence.nCTIP, sequence.nCTIP + 1);
+    BOOST_CHECK_EQUAL(viewWaited->sequence.nDeposit, sequence.nDeposit + 1);
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_withdrawal_projection)
+{
+    // Check that the work score rates follow the votes and that the
+    // projections are made from them
+    SidechainDB scdbTest;
+
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+
+    uint256 hash = GetRandHash();
+    std::vector<std::string> vVote(SIDECHAIN_ACTIVATION_MAX_ACTIVE, std::string(1, SCDB_ABSTAIN));
+    vVote[0] = hash.ToString();
+    std::map<uint8_t, uint256> mapNewWithdrawal;
+    mapNewWithdrawal[0] = hash;
+    BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote, false, mapNewWithdrawal));
+
+    // No rate until the withdrawal has been voted on
+    std::vector<SidechainWithdrawalProjection> vProjection = scdbTest.GetWithdrawalProjections();
+    BOOST_CHECK_EQUAL(vProjection.size(), 1U);
+    BOOST_CHECK(vProjection[0].state.hash == hash);
+    BOOST_CHECK_EQUAL(vProjection[0].nBlocks, 0U);
+    BOOST_CHECK_EQUAL(vProjection[0].nBlocksToApproval, -1);
+
+    // Upvoted every block, it gains one a block
+    for (int i = 0; i < 9; i++)
+        BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote));
+
+    vProjection = scdbTest.GetWithdrawalProjections(0);
+    BOOST_CHECK_EQUAL(vProjection.size(), 1U);
+    BOOST_CHECK_EQUAL(vProjection[0].state.nWorkScore, 10);
+    BOOST_CHECK_EQUAL(vProjection[0].nBlocks, 9U);
+    BOOST_CHECK_EQUAL(vProjection[0].nChange, 9);
+    BOOST_CHECK_EQUAL(vProjection[0].nBlocksToApproval, SIDECHAIN_WITHDRAWAL_MIN_WORKSCORE - 10);
+    BOOST_CHECK(scdbTest.GetWithdrawalProjections(1).empty());
+
+    // Downvoted, it won't be approved
+    vVote[0] = std::string(1, SCDB_DOWNVOTE);
+    for (int i = 0; i < 20; i++)
+        BOOST_CHECK(scdbTest.UpdateSCDBIndex(vVote));
+
+    vProjection = scdbTest.GetWithdrawalProjections();
+    BOOST_CHECK_EQUAL(vProjection[0].state.nWorkScore, 0);
+    BOOST_CHECK_EQUAL(vProjection[0].nBlocks, 29U);
+    BOOST_CHECK_EQUAL(vProjection[0].nChange, -1);
+    BOOST_CHECK_EQUAL(vProjection[0].nBlocksToApproval, -1);
+
+    // Only the most recent blocks are counted
+    SidechainWithdrawalRate rate;
+    for (unsigned int i = 0; i < SIDECHAIN_WITHDRAWAL_RATE_WINDOW + 10; i++)
+        rate.Add(i < 10 ? -1 : 1);
+    BOOST_CHECK_EQUAL(rate.vChange.size(), SIDECHAIN_WITHDRAWAL_RATE_WINDOW);
+    BOOST_CHECK_EQUAL(rate.nSum, (int)SIDECHAIN_WITHDRAWAL_RATE_WINDOW);
+    rate.Undo();
+    BOOST_CHECK_EQUAL(rate.nSum, (int)SIDECHAIN_WITHDRAWAL_RATE_WINDOW - 1);
+}
+
+BOOST_AUTO_TEST_CASE(sidechaindb_view_held)
+{
+    // While held, the views keep the state from before SCDB was reset, as
+    // they do during a -reindex-chainstate replay
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateTestSidechain(scdbTest));
+    BOOST_CHECK(scdbTest.GetSidechainView(0));
+
+    scdbTest.HoldView(true);
+    BOOST_CHECK(scdbTest.IsViewHeld());
+    scdbTest.Reset();
+    BOOST_CHECK(scdbTest.GetSidechainView(0));
+    BOOST_CHECK_EQUAL(scdbTest.GetActiveSidechainsView()->size(), 1U);
+    BOOST_CHECK(scdbTest.GetActiveSidechains().empty());
+
+    // Released, they show the rebuilt state again
+    scdbTest.HoldView(false);
+    BOOST_CHECK(!scdbTest.IsViewHeld());
+    BOOST_CHECK(!scdbTest.GetSidechainView(0));
+    BOOST_CHECK(scdbTest.GetActiveSidechainsView()->empty());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
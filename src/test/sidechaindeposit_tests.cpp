@@ -5,6 +5,8 @@
 #include <core_io.h>
 #include <sidechain.h>
 #include <sidechaindb.h>
+#include <random.h>
+#include <txdb.h>
 #include <validation.h>
 
 #include <test/test_skydoge.h>
@@ -292,4 +294,376 @@ BOOST_AUTO_TEST_CASE(sidechain_sort_deposits_invalid)
     BOOST_CHECK(vDepositSorted != vD);
 }
 
+BOOST_AUTO_TEST_CASE(sidechain_add_deposits_incremental)
+{
+    // Check that adding deposits to SCDB in batches, in and out of CTIP spend
+    // order, leaves the deposit cache sorted
+
+    // Get deposits in valid CTIP spend order
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+
+    SidechainDB scdbTest;
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+
+    // Add the first 10 deposits in reverse order
+    std::vector<SidechainDeposit> vBatch(vD.begin(), vD.begin() + 10);
+    std::reverse(vBatch.begin(), vBatch.end());
+    scdbTest.AddDeposits(vBatch);
+    BOOST_CHECK(scdbTest.GetDeposits(0) == std::vector<SidechainDeposit>(vD.begin(), vD.begin() + 10));
+
+    // Add the next deposits one at a time, which extends the CTIP chain
+    for (size_t i = 10; i < 20; i++)
+        scdbTest.AddDeposits(std::vector<SidechainDeposit>{vD[i]});
+    BOOST_CHECK(scdbTest.GetDeposits(0) == std::vector<SidechainDeposit>(vD.begin(), vD.begin() + 20));
+
+    // Add the rest including some duplicates which should be ignored
+    std::vector<SidechainDeposit> vRest {vD[29], vD[5], vD[21], vD[20],
+        vD[25], vD[22], vD[28], vD[23], vD[19], vD[24], vD[27], vD[26]};
+    scdbTest.AddDeposits(vRest);
+    BOOST_CHECK(scdbTest.GetDeposits(0) == vD);
+
+    // The state hash should only depend on the deposits, not on how they
+    // were added
+    SidechainDB scdbBatch;
+    BOOST_CHECK(ActivateSidechain(scdbBatch, proposal, 0));
+    BOOST_CHECK(scdbBatch.GetStateHash() != scdbTest.GetStateHash());
+    scdbBatch.AddDeposits(vD);
+    BOOST_CHECK(scdbBatch.GetStateHash() == scdbTest.GetStateHash());
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_deposit_db)
+{
+    // Check that deposits written to the deposit database can be read back,
+    // paged through, undone and loaded by another SCDB
+
+    // Get deposits in valid CTIP spend order
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+    BOOST_CHECK(scdbTest.SetDepositDB(&db));
+
+    // Add the first 20 deposits in reverse order and the rest one at a time
+    std::vector<SidechainDeposit> vBatch(vD.begin(), vD.begin() + 20);
+    std::reverse(vBatch.begin(), vBatch.end());
+    scdbTest.AddDeposits(vBatch);
+    for (size_t i = 20; i < vD.size(); i++)
+        scdbTest.AddDeposits(std::vector<SidechainDeposit>{vD[i]});
+
+    BOOST_CHECK(scdbTest.GetDeposits(0) == vD);
+    BOOST_CHECK(scdbTest.GetDepositCount(0) == vD.size());
+
+    // Deposits are written to the database with the chainstate
+    BOOST_CHECK(db.ReadDepositCount(0) == 0);
+    const uint256 hashBest = GetRandHash();
+    BOOST_CHECK(scdbTest.FlushDeposits(hashBest, uint256()));
+    BOOST_CHECK(db.ReadDepositCount(0) == vD.size());
+    uint256 hashRead;
+    BOOST_CHECK(db.ReadDepositBestBlock(hashRead));
+    BOOST_CHECK(hashRead == hashBest);
+
+    // Check pagination, including a page past the last deposit
+    BOOST_CHECK(scdbTest.GetDeposits(0, 5, 10) == std::vector<SidechainDeposit>(vD.begin() + 5, vD.begin() + 15));
+    BOOST_CHECK(scdbTest.GetDeposits(0, 25, 10) == std::vector<SidechainDeposit>(vD.begin() + 25, vD.end()));
+    BOOST_CHECK(scdbTest.GetDeposits(0, 30, 10).empty());
+
+    // Undo a block with the last two deposits and a transaction that isn't a
+    // deposit
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 50 * CENT;
+    std::vector<CTransactionRef> vtx {MakeTransactionRef(mtx), vD[28].tx, vD[29].tx};
+    BOOST_CHECK(scdbTest.Undo(1, GetRandHash(), GetRandHash(), vtx));
+    BOOST_CHECK(scdbTest.GetDeposits(0) == std::vector<SidechainDeposit>(vD.begin(), vD.begin() + 28));
+    BOOST_CHECK(db.ReadDepositCount(0) == vD.size());
+    BOOST_CHECK(scdbTest.FlushDeposits(GetRandHash(), uint256()));
+    BOOST_CHECK(db.ReadDepositCount(0) == 28);
+    BOOST_CHECK(!scdbTest.HaveDepositCached(vD[29].tx->GetHash()));
+
+    // Load the deposits into a new SCDB from the database
+    SidechainDB scdbLoad;
+    BOOST_CHECK(ActivateSidechain(scdbLoad, proposal, 0));
+    BOOST_CHECK(scdbLoad.SetDepositDB(&db));
+    BOOST_CHECK(scdbLoad.GetDeposits(0) == std::vector<SidechainDeposit>(vD.begin(), vD.begin() + 28));
+    BOOST_CHECK(scdbLoad.HaveDepositCached(vD[0].tx->GetHash()));
+    BOOST_CHECK(!scdbLoad.HaveDepositCached(vD[28].tx->GetHash()));
+
+    SidechainCTIP ctip;
+    BOOST_CHECK(scdbLoad.GetCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == COutPoint(vD[27].tx->GetHash(), vD[27].nBurnIndex));
+
+    // Look up deposits by txid, both from the database and the cache
+    SidechainDeposit deposit;
+    CAmount amount;
+    BOOST_CHECK(scdbLoad.GetDeposit(vD[0].tx->GetHash(), deposit, amount));
+    BOOST_CHECK(deposit == vD[0]);
+    BOOST_CHECK(amount == vD[0].tx->vout[vD[0].nBurnIndex].nValue);
+    BOOST_CHECK(scdbLoad.GetDeposit(vD[27].tx->GetHash(), deposit, amount));
+    BOOST_CHECK(deposit == vD[27]);
+    BOOST_CHECK(amount == vD[27].tx->vout[vD[27].nBurnIndex].nValue - vD[26].tx->vout[vD[26].nBurnIndex].nValue);
+    BOOST_CHECK(!scdbLoad.GetDeposit(vD[28].tx->GetHash(), deposit, amount));
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_import_deposits)
+{
+    // Check that bulk importing deposits out of order gives the same SCDB as
+    // adding them, and that it can be loaded from the deposit database
+
+    // Get deposits in valid CTIP spend order
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    SidechainDB scdbAdd;
+    BOOST_CHECK(ActivateSidechain(scdbAdd, proposal, 0));
+    scdbAdd.AddDeposits(vD);
+
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+    BOOST_CHECK(scdbTest.SetDepositDB(&db));
+
+    std::vector<SidechainDeposit> vReverse(vD.rbegin(), vD.rend());
+    scdbTest.ImportDeposits(vReverse);
+    BOOST_CHECK(scdbTest.FlushDeposits(GetRandHash(), uint256()));
+    BOOST_CHECK(scdbTest.GetDeposits(0) == vD);
+    BOOST_CHECK(scdbTest.GetStateHash() == scdbAdd.GetStateHash());
+
+    SidechainCTIP ctip;
+    BOOST_CHECK(scdbTest.GetCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == COutPoint(vD.back().tx->GetHash(), vD.back().nBurnIndex));
+
+    // Importing into a sidechain that has deposits merges them
+    scdbTest.ImportDeposits(std::vector<SidechainDeposit>{vD[3], vD[7]});
+    BOOST_CHECK(scdbTest.GetDeposits(0) == vD);
+
+    // Loading the imported deposits gives the same state
+    SidechainDB scdbLoad;
+    BOOST_CHECK(ActivateSidechain(scdbLoad, proposal, 0));
+    BOOST_CHECK(scdbLoad.SetDepositDB(&db));
+    BOOST_CHECK(scdbLoad.GetDeposits(0) == vD);
+    BOOST_CHECK(scdbLoad.GetStateHash() == scdbAdd.GetStateHash());
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_deposit_db_flush)
+{
+    // Check that the deposit database only changes when the deposits are
+    // flushed, so that a node which stops before the chainstate is flushed
+    // loads the deposits of the last flush
+
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    const std::vector<SidechainDeposit> vFirst(vD.begin(), vD.begin() + 20);
+
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+    BOOST_CHECK(scdbTest.SetDepositDB(&db));
+    scdbTest.AddDeposits(vFirst);
+    const uint256 hashFlush = GetRandHash();
+    BOOST_CHECK(scdbTest.FlushDeposits(hashFlush, uint256()));
+    MuHash3072 muhash;
+    BOOST_CHECK(db.ReadDepositHash(muhash));
+    uint256 hashDeposits;
+    muhash.Finalize(hashDeposits);
+
+    // Undo a block with the last two flushed deposits and add the last one
+    // back, which can't be sorted after vD[17] so it takes the index of vD[18]
+    BOOST_CHECK(scdbTest.Undo(1, GetRandHash(), GetRandHash(), std::vector<CTransactionRef>{vD[18].tx, vD[19].tx}));
+    scdbTest.AddDeposits(std::vector<SidechainDeposit>{vD[19]});
+    std::vector<SidechainDeposit> vChanged(vD.begin(), vD.begin() + 18);
+    vChanged.push_back(vD[19]);
+    BOOST_CHECK(scdbTest.GetDeposits(0) == vChanged);
+    BOOST_CHECK(db.ReadDepositCount(0) == vFirst.size());
+
+    // The database still has vD[18] at that index, but it was replaced
+    SidechainDeposit deposit;
+    CAmount amount;
+    BOOST_CHECK(!scdbTest.GetDeposit(vD[18].tx->GetHash(), deposit, amount));
+    BOOST_CHECK(scdbTest.GetDeposit(vD[19].tx->GetHash(), deposit, amount));
+    BOOST_CHECK(deposit == vD[19]);
+
+    // Loading the database before the next flush gives the deposits, MuHash
+    // and best block of the last one
+    SidechainDB scdbLoad;
+    BOOST_CHECK(ActivateSidechain(scdbLoad, proposal, 0));
+    BOOST_CHECK(scdbLoad.SetDepositDB(&db));
+    BOOST_CHECK(scdbLoad.GetDeposits(0) == vFirst);
+    BOOST_CHECK(db.ReadDepositHash(muhash));
+    uint256 hashRead;
+    muhash.Finalize(hashRead);
+    BOOST_CHECK(hashRead == hashDeposits);
+    BOOST_CHECK(db.ReadDepositBestBlock(hashRead));
+    BOOST_CHECK(hashRead == hashFlush);
+
+    // After the next flush the changes are loaded
+    BOOST_CHECK(scdbTest.FlushDeposits(GetRandHash(), uint256()));
+    SidechainDB scdbLoadChanged;
+    BOOST_CHECK(ActivateSidechain(scdbLoadChanged, proposal, 0));
+    BOOST_CHECK(scdbLoadChanged.SetDepositDB(&db));
+    BOOST_CHECK(scdbLoadChanged.GetDeposits(0) == vChanged);
+    BOOST_CHECK(!scdbLoadChanged.GetDeposit(vD[18].tx->GetHash(), deposit, amount));
+
+    // A reset drops the deposits from the database at the next flush
+    scdbTest.Reset();
+    BOOST_CHECK(db.ReadDepositCount(0) == vChanged.size());
+    BOOST_CHECK(scdbTest.FlushDeposits(GetRandHash(), uint256()));
+    BOOST_CHECK(db.ReadDepositCount(0) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_deposit_db_rewind)
+{
+    // Check that deposits written ahead of the chainstate are rolled back to
+    // it, as after a crash before the chainstate flush was written
+
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    const std::vector<SidechainDeposit> vFirst(vD.begin(), vD.begin() + 20);
+
+    CSidechainTreeDB db(1 << 20, true /* fMemory */);
+
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+    BOOST_CHECK(scdbTest.SetDepositDB(&db));
+    scdbTest.AddDeposits(vFirst);
+    const uint256 hashFirst = GetRandHash();
+    BOOST_CHECK(scdbTest.FlushDeposits(hashFirst, uint256()));
+    MuHash3072 muhash;
+    BOOST_CHECK(db.ReadDepositHash(muhash));
+    uint256 hashDeposits;
+    muhash.Finalize(hashDeposits);
+
+    // Replace the last two flushed deposits and add more, then flush them
+    // ahead of the chainstate at hashFirst
+    BOOST_CHECK(scdbTest.Undo(1, GetRandHash(), GetRandHash(), std::vector<CTransactionRef>{vD[18].tx, vD[19].tx}));
+    scdbTest.AddDeposits(std::vector<SidechainDeposit>{vD[19]});
+    scdbTest.AddDeposits(std::vector<SidechainDeposit>(vD.begin() + 20, vD.begin() + 25));
+    const uint256 hashSecond = GetRandHash();
+    BOOST_CHECK(scdbTest.FlushDeposits(hashSecond, hashFirst));
+    BOOST_CHECK(db.ReadDepositCount(0) == 24);
+
+    // Nothing to do once the chainstate has been written, and the deposits
+    // can't be rolled back to any other block
+    BOOST_CHECK(db.RewindDeposits(hashSecond));
+    BOOST_CHECK(db.ReadDepositCount(0) == 24);
+    BOOST_CHECK(!db.RewindDeposits(GetRandHash()));
+    BOOST_CHECK(db.ReadDepositCount(0) == 24);
+
+    // Rolling back restores the deposits, txid index, MuHash and best block
+    // of the last flush
+    BOOST_CHECK(db.RewindDeposits(hashFirst));
+    SidechainDB scdbLoad;
+    BOOST_CHECK(ActivateSidechain(scdbLoad, proposal, 0));
+    BOOST_CHECK(scdbLoad.SetDepositDB(&db));
+    BOOST_CHECK(scdbLoad.GetDeposits(0) == vFirst);
+    uint8_t nSidechain;
+    uint32_t nIndex;
+    BOOST_CHECK(db.ReadDepositIndex(vD[18].tx->GetHash(), nSidechain, nIndex));
+    BOOST_CHECK(nIndex == 18);
+    BOOST_CHECK(db.ReadDepositIndex(vD[19].tx->GetHash(), nSidechain, nIndex));
+    BOOST_CHECK(nIndex == 19);
+    BOOST_CHECK(!db.ReadDepositIndex(vD[20].tx->GetHash(), nSidechain, nIndex));
+    BOOST_CHECK(db.ReadDepositHash(muhash));
+    uint256 hashRead;
+    muhash.Finalize(hashRead);
+    BOOST_CHECK(hashRead == hashDeposits);
+    BOOST_CHECK(db.ReadDepositBestBlock(hashRead));
+    BOOST_CHECK(hashRead == hashFirst);
+    BOOST_CHECK(db.RewindDeposits(hashFirst));
+
+    // Only the last write is kept to be rolled back
+    BOOST_CHECK(!db.RewindDeposits(uint256()));
+
+    // A flush with the chainstate already at its best block keeps nothing
+    scdbLoad.AddDeposits(std::vector<SidechainDeposit>{vD[20]});
+    const uint256 hashThird = GetRandHash();
+    BOOST_CHECK(scdbLoad.FlushDeposits(hashThird, hashThird));
+    BOOST_CHECK(!db.RewindDeposits(hashFirst));
+    BOOST_CHECK(db.ReadDepositCount(0) == 21);
+}
+
+BOOST_AUTO_TEST_CASE(sidechain_deposit_reorg)
+{
+    // Check that a reorg undoing several blocks leaves the CTIP and the
+    // views alone until it is done
+
+    std::vector<SidechainDeposit> vD = GetTestDeposits();
+
+    Sidechain proposal;
+    proposal.nSidechain = 0;
+    proposal.nVersion = 0;
+    proposal.title = "Test";
+    proposal.description = "Description";
+    proposal.hashID1 = uint256S("b55d224f1fda033d930c92b1b40871f209387355557dd5e0d2b5dd9bb813c33f");
+    proposal.hashID2 = uint160S("31d98584f3c570961359c308619f5cf2e9178482");
+
+    SidechainDB scdbTest;
+    BOOST_CHECK(ActivateSidechain(scdbTest, proposal, 0));
+    scdbTest.AddDeposits(vD);
+
+    SidechainCTIP ctip;
+    BOOST_CHECK(scdbTest.GetCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == COutPoint(vD[29].tx->GetHash(), vD[29].nBurnIndex));
+    BOOST_CHECK(scdbTest.GetSidechainView(0)->nDeposits == vD.size());
+
+    // Disconnect the blocks of the last two deposits, newest first
+    scdbTest.BeginReorg();
+    BOOST_CHECK(scdbTest.Undo(2, GetRandHash(), GetRandHash(), std::vector<CTransactionRef>{vD[29].tx}));
+    BOOST_CHECK(scdbTest.Undo(1, GetRandHash(), GetRandHash(), std::vector<CTransactionRef>{vD[28].tx}));
+    BOOST_CHECK(scdbTest.GetDeposits(0) == std::vector<SidechainDeposit>(vD.begin(), vD.begin() + 28));
+    BOOST_CHECK(scdbTest.GetCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == COutPoint(vD[29].tx->GetHash(), vD[29].nBurnIndex));
+    BOOST_CHECK(scdbTest.GetSidechainView(0)->nDeposits == vD.size());
+
+    scdbTest.EndReorg();
+    BOOST_CHECK(scdbTest.GetCTIP(0, ctip));
+    BOOST_CHECK(ctip.out == COutPoint(vD[27].tx->GetHash(), vD[27].nBurnIndex));
+    BOOST_CHECK(scdbTest.GetSidechainView(0)->nDeposits == 28);
+    BOOST_CHECK(scdbTest.GetSidechainView(0)->ctip.out == ctip.out);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
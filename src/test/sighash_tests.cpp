@@ -161,6 +161,34 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_legacy_cache)
+{
+    SeedInsecureRand(false);
+
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction mtx;
+        RandomTransaction(mtx, false);
+        while (mtx.vin.size() < LEGACY_SIGHASH_CACHE_MIN_INPUTS + InsecureRandBits(3))
+            mtx.vin.emplace_back(COutPoint(InsecureRand256(), InsecureRandBits(2)), CScript() << OP_1, InsecureRand32());
+        const CTransaction tx(mtx);
+        PrecomputedTransactionData txdata(tx);
+        BOOST_CHECK_EQUAL(txdata.vLegacyMidstate.size(), tx.vin.size());
+
+        // Hash types other than SIGHASH_ALL don't use the cache
+        const int nHashType = InsecureRandBool() ? InsecureRand32() : SIGHASH_ALL;
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) == SignatureHashOld(scriptCode, tx, nIn, nHashType));
+        }
+    }
+
+    // Too few inputs to cache
+    CMutableTransaction mtx;
+    mtx.vin.resize(LEGACY_SIGHASH_CACHE_MIN_INPUTS - 1);
+    BOOST_CHECK(PrecomputedTransactionData(mtx).vLegacyMidstate.empty());
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
@@ -177,4 +177,30 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     BOOST_CHECK(!chain.FindEarliestAtLeast(int64_t(std::numeric_limits<unsigned int>::max()) + 1));
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena)
+{
+    CBlockIndexArena arena;
+    CBlockIndex outside;
+    BOOST_CHECK(!arena.Owns(&outside));
+
+    // Enough entries for a few slabs
+    std::vector<CBlockIndex*> vpindex;
+    for (int i = 0; i < 10000; i++) {
+        CBlockIndex* pindex = arena.Allocate();
+        BOOST_CHECK(pindex->pprev == nullptr && pindex->nHeight == 0);
+        pindex->nHeight = i;
+        pindex->pprev = vpindex.empty() ? nullptr : vpindex.back();
+        vpindex.push_back(pindex);
+    }
+
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK(arena.Owns(vpindex[i]));
+        BOOST_CHECK_EQUAL(vpindex[i]->nHeight, i);
+    }
+    BOOST_CHECK(!arena.Owns(&outside));
+
+    arena.Clear();
+    BOOST_CHECK(!arena.Owns(vpindex[0]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
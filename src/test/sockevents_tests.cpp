@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <sockevents.h>
+#include <netbase.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sockevents_tests, BasicTestingSetup)
+
+#ifndef WIN32
+static int ReadyEvents(CSocketEvents& events, SOCKET hSocket)
+{
+    std::vector<std::pair<SOCKET, int>> vReady;
+    BOOST_CHECK(events.Wait(10, vReady));
+    int nEvents = 0;
+    for (const std::pair<SOCKET, int>& ready : vReady) {
+        if (ready.first == hSocket)
+            nEvents |= ready.second;
+    }
+    return nEvents;
+}
+
+BOOST_AUTO_TEST_CASE(sockevents_backends)
+{
+    std::vector<std::string> vName{"select", DefaultSocketEvents()};
+    BOOST_CHECK(!MakeSocketEvents("none"));
+
+    for (const std::string& strName : vName) {
+        std::unique_ptr<CSocketEvents> events = MakeSocketEvents(strName);
+        BOOST_REQUIRE(events);
+        BOOST_CHECK_EQUAL(events->GetName(), strName);
+
+        int sv[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        SOCKET hSocket = sv[0];
+        SOCKET hSocketOther = sv[1];
+
+        // Nothing to read yet, but there is room to write
+        BOOST_CHECK(events->Set(hSocket, SOCKET_EVENT_RECV));
+        BOOST_CHECK_EQUAL(ReadyEvents(*events, hSocket), 0);
+        BOOST_CHECK(events->Set(hSocket, SOCKET_EVENT_SEND));
+        BOOST_CHECK_EQUAL(ReadyEvents(*events, hSocket) & SOCKET_EVENT_SEND, SOCKET_EVENT_SEND);
+
+        // Readable once the other end has written
+        BOOST_CHECK(send(hSocketOther, "x", 1, 0) == 1);
+        BOOST_CHECK(events->Set(hSocket, SOCKET_EVENT_RECV));
+        BOOST_CHECK_EQUAL(ReadyEvents(*events, hSocket) & SOCKET_EVENT_RECV, SOCKET_EVENT_RECV);
+
+        // Not reported once removed
+        events->Remove(hSocket);
+        BOOST_CHECK_EQUAL(ReadyEvents(*events, hSocket), 0);
+
+        CloseSocket(hSocket);
+        CloseSocket(hSocketOther);
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <sync.h>
+#include <utiltime.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <future>
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+static bool FindStats(const std::string& strName, LockSiteStats& stats)
+{
+    int64_t nElapsed;
+    for (const LockSiteStats& s : GetLockStats(nElapsed)) {
+        if (s.name == strName) {
+            stats = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(lock_stats)
+{
+    CCriticalSection cs_stats_test;
+
+    // Nothing is recorded while disabled
+    {
+        LOCK(cs_stats_test);
+    }
+    LockSiteStats stats;
+    BOOST_CHECK(!FindStats("cs_stats_test", stats));
+
+    EnableLockStats(true);
+
+    for (int i = 0; i < 3; i++) {
+        LOCK(cs_stats_test);
+    }
+    BOOST_CHECK(FindStats("cs_stats_test", stats));
+    BOOST_CHECK_EQUAL(stats.nAcquired, 3U);
+    BOOST_CHECK_EQUAL(stats.nContended, 0U);
+    BOOST_CHECK_EQUAL(stats.nWaitTotal, 0);
+
+    // Another thread holds the lock for a while, we wait for it
+    std::promise<void> locked;
+    std::thread holder([&cs_stats_test, &locked] {
+        LOCK(cs_stats_test);
+        locked.set_value();
+        MilliSleep(50);
+    });
+    locked.get_future().wait();
+    {
+        LOCK(cs_stats_test);
+    }
+    holder.join();
+
+    int64_t nElapsed;
+    size_t nSites = 0;
+    uint64_t nAcquired = 0;
+    uint64_t nContended = 0;
+    int64_t nHoldMax = 0;
+    int64_t nWaitMax = 0;
+    for (const LockSiteStats& s : GetLockStats(nElapsed)) {
+        if (s.name != "cs_stats_test")
+            continue;
+        nSites++;
+        nAcquired += s.nAcquired;
+        nContended += s.nContended;
+        nHoldMax = std::max(nHoldMax, s.nHoldMax);
+        nWaitMax = std::max(nWaitMax, s.nWaitMax);
+    }
+    BOOST_CHECK_EQUAL(nSites, 3U);
+    BOOST_CHECK_EQUAL(nAcquired, 5U);
+    BOOST_CHECK_EQUAL(nContended, 1U);
+    // Loose bounds, the timestamps are calibrated against the clock
+    BOOST_CHECK(nHoldMax >= 25000);
+    BOOST_CHECK(nWaitMax >= 10000);
+    BOOST_CHECK(nElapsed >= nHoldMax);
+
+    ResetLockStats();
+    BOOST_CHECK(!FindStats("cs_stats_test", stats));
+
+    EnableLockStats(false);
+    {
+        LOCK(cs_stats_test);
+    }
+    BOOST_CHECK(!FindStats("cs_stats_test", stats));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -278,6 +278,30 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(duplicate_inputs)
+{
+    // Both the pairwise and the sorted check
+    for (unsigned int nInputs : {2, 16, 17, 500}) {
+        CMutableTransaction mtx;
+        mtx.nVersion = 9;
+        mtx.vout.emplace_back(1, CScript() << OP_TRUE);
+        const uint256 hash = InsecureRand256();
+        for (unsigned int i = 0; i < nInputs; i++) {
+            // Same hash, different index, and the other way around
+            mtx.vin.emplace_back(i % 2 ? COutPoint(hash, i) : COutPoint(InsecureRand256(), 0));
+        }
+        CValidationState state;
+        BOOST_CHECK(CheckTransaction(mtx, state));
+
+        mtx.vin.back().prevout = mtx.vin.front().prevout;
+        BOOST_CHECK(!CheckTransaction(mtx, state));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+        // Blocks skip the check
+        CValidationState stateBlock;
+        BOOST_CHECK(CheckTransaction(mtx, stateBlock, false));
+    }
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
@@ -492,6 +516,59 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_sign_transaction_inputs)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKeyPubKey(key, key.GetPubKey());
+    CKeyID hash = key.GetPubKey().GetID();
+    const CScript scriptLegacy = GetScriptForDestination(hash);
+    const CScript scriptWitness = CScript() << OP_0 << std::vector<unsigned char>(hash.begin(), hash.end());
+
+    // Enough legacy and witness inputs to be signed on several threads
+    CMutableTransaction mtx;
+    std::vector<CTxOut> vSpent;
+    for (uint32_t i = 0; i < 100; i++) {
+        uint256 prevId;
+        prevId.SetHex("0000000000000000000000000000000000000000000000000000000000000100");
+        mtx.vin.push_back(CTxIn(COutPoint(prevId, i)));
+        vSpent.push_back(CTxOut(1000 + i, i % 2 ? scriptWitness : scriptLegacy));
+    }
+    mtx.vout.push_back(CTxOut(1000, CScript() << OP_1));
+
+    // The signatures are those of signing one input at a time
+    CMutableTransaction mtxSerial = mtx;
+    for (uint32_t i = 0; i < mtxSerial.vin.size(); i++)
+        BOOST_CHECK(SignSignature(keystore, vSpent[i].scriptPubKey, mtxSerial, i, vSpent[i].nValue, SIGHASH_ALL));
+    CMutableTransaction mtxBatch = mtx;
+    BOOST_CHECK(SignTransactionInputs(keystore, mtxBatch, vSpent, SIGHASH_ALL));
+    BOOST_CHECK(CTransaction(mtxBatch).GetWitnessHash() == CTransaction(mtxSerial).GetWitnessHash());
+
+    // Inputs with an empty scriptPubKey are skipped
+    std::vector<CTxOut> vSkip = vSpent;
+    vSkip[3] = CTxOut();
+    mtxBatch = mtx;
+    BOOST_CHECK(SignTransactionInputs(keystore, mtxBatch, vSkip, SIGHASH_ALL));
+    BOOST_CHECK(mtxBatch.vin[3].scriptSig.empty());
+    BOOST_CHECK(mtxBatch.vin[4].scriptSig == mtxSerial.vin[4].scriptSig);
+
+    // An input we can't sign fails the whole transaction
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    std::vector<CTxOut> vUnknown = vSpent;
+    vUnknown[50].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    mtxBatch = mtx;
+    BOOST_CHECK(!SignTransactionInputs(keystore, mtxBatch, vUnknown, SIGHASH_ALL));
+    BOOST_CHECK(CTransaction(mtxBatch).GetWitnessHash() == CTransaction(mtx).GetWitnessHash());
+
+    std::vector<SignatureData> vSigData;
+    BOOST_CHECK(!ProduceSignatures(keystore, CTransaction(mtx), vUnknown, SIGHASH_ALL, vSigData));
+    BOOST_CHECK_EQUAL(vSigData.size(), mtx.vin.size());
+    BOOST_CHECK(vSigData[50].scriptSig.empty());
+    BOOST_CHECK(vSigData[49].scriptWitness.stack == mtxSerial.vin[49].scriptWitness.stack);
+}
+
 BOOST_AUTO_TEST_CASE(test_witness)
 {
     CBasicKeyStore keystore, keystore2;
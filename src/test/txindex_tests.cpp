@@ -0,0 +1,224 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <script/script.h>
+#include <txdb.h>
+#include <txindex.h>
+#include <utiltime.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+class TestTxIndex : public TxIndex
+{
+public:
+    using TxIndex::BlockConnected;
+};
+
+bool WaitForSync(const TxIndex& index)
+{
+    for (int i = 0; i < 1000 && !index.IsSynced(); i++)
+        MilliSleep(10);
+    return index.IsSynced();
+}
+
+/** Whether every transaction of the block is found at its position */
+bool HaveBlockTxs(const TxIndex& index, const CBlockIndex* pindex)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return false;
+
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    GetTxIndexPositions(block, pindex, vPos);
+    for (const std::pair<uint256, CDiskTxPos>& pos : vPos) {
+        CDiskTxPos posFound;
+        if (!index.FindTx(pos.first, posFound))
+            return false;
+        if (posFound.nFile != pos.second.nFile || posFound.nPos != pos.second.nPos || posFound.nTxOffset != pos.second.nTxOffset)
+            return false;
+    }
+    return true;
+}
+
+const CBlockIndex* GetTip()
+{
+    LOCK(cs_main);
+    return chainActive.Tip();
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(txindex_sync)
+{
+    TestTxIndex index;
+    BOOST_CHECK(!index.GetBestBlock());
+    BOOST_REQUIRE(index.Start());
+
+    // The sync thread indexes the chain from genesis
+    BOOST_REQUIRE(WaitForSync(index));
+    BOOST_CHECK(index.GetBestBlock() == GetTip());
+    for (int nHeight : {1, 50, 100}) {
+        LOCK(cs_main);
+        BOOST_CHECK(HaveBlockTxs(index, chainActive[nHeight]));
+    }
+
+    // Blocks connected after that are indexed by the validation callbacks
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(index.GetBestBlock() == GetTip());
+    BOOST_CHECK(HaveBlockTxs(index, GetTip()));
+
+    // The best block is saved with the chainstate
+    FlushStateToDisk();
+    SyncWithValidationInterfaceQueue();
+    index.Interrupt();
+    index.Stop();
+    CBlockLocator locator;
+    BOOST_REQUIRE(pblocktree->ReadTxIndexBestBlock(locator));
+    BOOST_CHECK(locator.vHave[0] == GetTip()->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_CASE(txindex_sync_from_height)
+{
+    const CBlockIndex* pindexStart;
+    {
+        LOCK(cs_main);
+        pindexStart = chainActive[50];
+        BOOST_REQUIRE(pblocktree->WriteTxIndexBestBlock(chainActive.GetLocator(pindexStart)));
+    }
+
+    // The index continues after its saved best block
+    TestTxIndex index;
+    BOOST_REQUIRE(index.Start());
+    BOOST_REQUIRE(WaitForSync(index));
+    BOOST_CHECK(index.GetBestBlock() == GetTip());
+    BOOST_CHECK(!HaveBlockTxs(index, pindexStart));
+    BOOST_CHECK(HaveBlockTxs(index, pindexStart->GetAncestor(51)));
+    BOOST_CHECK(HaveBlockTxs(index, GetTip()));
+
+    // A saved best block that was disconnected since is continued from the
+    // fork
+    FlushStateToDisk();
+    SyncWithValidationInterfaceQueue();
+    index.Interrupt();
+    index.Stop();
+    const CBlockIndex* pindexStale = GetTip();
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+
+    TestTxIndex indexNext;
+    BOOST_REQUIRE(indexNext.Start());
+    BOOST_CHECK(indexNext.GetBestBlock() == pindexStale);
+    BOOST_REQUIRE(WaitForSync(indexNext));
+    BOOST_CHECK(indexNext.GetBestBlock() == GetTip());
+    BOOST_CHECK(HaveBlockTxs(indexNext, GetTip()));
+    BOOST_CHECK(HaveBlockTxs(indexNext, GetTip()->pprev));
+
+    indexNext.Interrupt();
+    indexNext.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txindex_stale_callback)
+{
+    TestTxIndex index;
+    BOOST_REQUIRE(index.Start());
+    BOOST_REQUIRE(WaitForSync(index));
+
+    const CBlockIndex* pindexTip = GetTip();
+    BOOST_CHECK(index.GetBestBlock() == pindexTip);
+
+    // A callback for a block that was already indexed by the sync thread
+    // doesn't move the best block back
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    BOOST_REQUIRE(ReadBlockFromDisk(*pblock, pindexTip->pprev, Params().GetConsensus()));
+    index.BlockConnected(pblock, pindexTip->pprev, {});
+    BOOST_CHECK(index.GetBestBlock() == pindexTip);
+
+    // Neither does a block that doesn't connect to it
+    const uint256 hashOther = GetRandHash();
+    CBlockIndex indexOther;
+    indexOther.phashBlock = &hashOther;
+    indexOther.pprev = pindexTip->pprev->pprev;
+    indexOther.nHeight = pindexTip->nHeight + 1;
+    index.BlockConnected(pblock, &indexOther, {});
+    BOOST_CHECK(index.GetBestBlock() == pindexTip);
+
+    // A reorg steps the best block back to the fork and indexes the new
+    // branch
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(index.GetBestBlock() == pindexTip->pprev);
+
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    SyncWithValidationInterfaceQueue();
+    const CBlockIndex* pindexNew = GetTip();
+    BOOST_CHECK(pindexNew != pindexTip);
+    BOOST_CHECK(index.GetBestBlock() == pindexNew);
+    BOOST_CHECK(HaveBlockTxs(index, pindexNew));
+
+    // A queued callback for the block of the stale branch forks off below
+    // the best block, but isn't in the active chain any more
+    BOOST_REQUIRE(ReadBlockFromDisk(*pblock, pindexTip, Params().GetConsensus()));
+    index.BlockConnected(pblock, pindexTip, {});
+    BOOST_CHECK(index.GetBestBlock() == pindexNew);
+
+    index.Interrupt();
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txindex_upgrade_legacy)
+{
+    // Nothing to hand over without entries written by ConnectBlock
+    BOOST_CHECK(UpgradeLegacyTxIndex());
+    CBlockLocator locator;
+    BOOST_CHECK(!pblocktree->ReadTxIndexBestBlock(locator));
+
+    // Legacy entries cover the chain up to the tip, the index continues
+    // from there
+    BOOST_REQUIRE(pblocktree->WriteFlag("txindex", true));
+    BOOST_CHECK(UpgradeLegacyTxIndex());
+    bool fLegacy = true;
+    BOOST_CHECK(pblocktree->ReadFlag("txindex", fLegacy));
+    BOOST_CHECK(!fLegacy);
+    BOOST_REQUIRE(pblocktree->ReadTxIndexBestBlock(locator));
+    BOOST_CHECK(locator.vHave[0] == GetTip()->GetBlockHash());
+
+    TestTxIndex index;
+    BOOST_REQUIRE(index.Start());
+    BOOST_CHECK(index.IsSynced());
+    BOOST_CHECK(index.GetBestBlock() == GetTip());
+
+    // A best block the index saved itself is kept
+    index.Interrupt();
+    index.Stop();
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    BOOST_REQUIRE(pblocktree->WriteFlag("txindex", true));
+    BOOST_CHECK(UpgradeLegacyTxIndex());
+    BOOST_REQUIRE(pblocktree->ReadTxIndexBestBlock(locator));
+    BOOST_CHECK(locator.vHave[0] == GetTip()->pprev->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,159 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/sigcache.h>
+#include <script/standard.h>
+#include <txmempool.h>
+#include <txprevalidate.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txprevalidate_tests, TestChain100Setup)
+
+static CTransactionRef SpendCoinbase(const CTransaction& coinbase, const CKey& key)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = coinbase.vout[0].nValue - 10000;
+    tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(txprevalidate_order)
+{
+    CTxPrevalidator prevalidator(2, 3, nullptr);
+    prevalidator.Start();
+
+    const unsigned int flags = GetMempoolScriptVerifyFlags(Params());
+    CTransactionRef tx1 = SpendCoinbase(coinbaseTxns[0], coinbaseKey);
+    CTransactionRef tx2 = SpendCoinbase(coinbaseTxns[1], coinbaseKey);
+
+    // Nothing to check and nothing to wait for, accept it right away
+    BOOST_CHECK(!prevalidator.Submit(1, tx2, std::vector<CTxOut>(), flags));
+
+    // A transaction without inputs to check waits for the ones before it
+    BOOST_CHECK(prevalidator.Submit(1, tx1, std::vector<CTxOut>{coinbaseTxns[0].vout[0]}, flags));
+    BOOST_CHECK(prevalidator.Submit(1, tx2, std::vector<CTxOut>(), flags));
+    BOOST_CHECK(prevalidator.Submit(2, tx2, std::vector<CTxOut>{coinbaseTxns[1].vout[0]}, flags));
+    BOOST_CHECK_EQUAL(prevalidator.Size(), 3U);
+
+    // The queue is full, a peer with nothing pending accepts right away and
+    // the others queue behind their pending transactions unchecked
+    BOOST_CHECK(!prevalidator.Submit(3, tx1, std::vector<CTxOut>{coinbaseTxns[0].vout[0]}, flags));
+    BOOST_CHECK(!prevalidator.MustWait(3));
+    BOOST_CHECK(prevalidator.MustWait(1));
+    BOOST_CHECK(prevalidator.Submit(1, tx1, std::vector<CTxOut>{coinbaseTxns[0].vout[0]}, flags));
+    BOOST_CHECK_EQUAL(prevalidator.Size(), 4U);
+
+    CTransactionRef tx;
+    std::vector<uint256> vSigCacheEntry;
+    while (!prevalidator.Take(1, tx, vSigCacheEntry))
+        MilliSleep(10);
+    BOOST_CHECK(tx == tx1);
+    BOOST_CHECK_EQUAL(vSigCacheEntry.size(), 1U);
+    BOOST_CHECK(prevalidator.Take(1, tx, vSigCacheEntry));
+    BOOST_CHECK(tx == tx2);
+    BOOST_CHECK(vSigCacheEntry.empty());
+    BOOST_CHECK(prevalidator.Take(1, tx, vSigCacheEntry));
+    BOOST_CHECK(tx == tx1);
+    BOOST_CHECK(vSigCacheEntry.empty());
+    BOOST_CHECK(!prevalidator.Take(1, tx, vSigCacheEntry));
+    BOOST_CHECK(!prevalidator.MustWait(1));
+
+    // The transactions of a peer that has gone are dropped
+    prevalidator.RemovePeer(2);
+    BOOST_CHECK(!prevalidator.Take(2, tx, vSigCacheEntry));
+    BOOST_CHECK_EQUAL(prevalidator.Size(), 0U);
+
+    prevalidator.Interrupt();
+    prevalidator.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txprevalidate_sigcache)
+{
+    CTxPrevalidator prevalidator(1, MAX_PREVALIDATE_TXS, nullptr);
+    prevalidator.Start();
+
+    SignatureCacheStats before;
+    GetSignatureCacheStats(before);
+
+    CTransactionRef ptx = SpendCoinbase(coinbaseTxns[0], coinbaseKey);
+    BOOST_CHECK(prevalidator.Submit(1, ptx, std::vector<CTxOut>{coinbaseTxns[0].vout[0]}, GetMempoolScriptVerifyFlags(Params())));
+
+    CTransactionRef tx;
+    std::vector<uint256> vSigCacheEntry;
+    while (!prevalidator.Take(1, tx, vSigCacheEntry))
+        MilliSleep(10);
+    BOOST_CHECK(tx == ptx);
+
+    // Pre-validation doesn't store the signature, it hands back its entry
+    SignatureCacheStats after;
+    GetSignatureCacheStats(after);
+    BOOST_CHECK_EQUAL(after.nInserts, before.nInserts);
+    BOOST_CHECK_EQUAL(vSigCacheEntry.size(), 1U);
+
+    // Accepting the transaction with the entry added finds its signature in
+    // the cache
+    AddSignatureCacheEntries(vSigCacheEntry);
+    GetSignatureCacheStats(before);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, nullptr /* pfMissingInputs */,
+                                       nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */));
+    }
+    GetSignatureCacheStats(after);
+    BOOST_CHECK(after.nHits > before.nHits);
+    BOOST_CHECK_EQUAL(after.nMisses, before.nMisses);
+
+    prevalidator.Interrupt();
+    prevalidator.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(mempool_dump_load)
+{
+    CTransactionRef tx1 = SpendCoinbase(coinbaseTxns[0], coinbaseKey);
+    CTransactionRef tx2 = SpendCoinbase(coinbaseTxns[1], coinbaseKey);
+    {
+        LOCK(cs_main);
+        for (const CTransactionRef& tx : {tx1, tx2}) {
+            CValidationState state;
+            BOOST_CHECK(AcceptToMemoryPool(mempool, state, tx, nullptr /* pfMissingInputs */,
+                                           nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */));
+        }
+    }
+    mempool.PrioritiseTransaction(tx2->GetHash(), 1000);
+
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    mempool.ClearPrioritisation(tx2->GetHash());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // The transactions come back through the pre-validation threads
+    gArgs.ForceSetArg("-prevalidatetxthreads", "2");
+    BOOST_CHECK(LoadMempool());
+    gArgs.ForceSetArg("-prevalidatetxthreads", std::to_string(DEFAULT_PREVALIDATE_THREADS));
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    BOOST_CHECK(mempool.exists(tx1->GetHash()));
+    BOOST_CHECK(mempool.exists(tx2->GetHash()));
+    BOOST_CHECK_EQUAL(mempool.info(tx2->GetHash()).nFeeDelta, 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -58,4 +58,32 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+BOOST_FIXTURE_TEST_CASE(deposit_package_reject_malformed, TestChain100Setup)
+{
+    CValidationState state;
+
+    // Empty package
+    BOOST_CHECK(!AcceptSidechainDepositPackage(mempool, state, {}, 0 /* nAbsurdFee */));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "deposit-package-bad-size");
+
+    // A transaction without a sidechain output isn't a deposit
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    state = CValidationState();
+    BOOST_CHECK(!AcceptSidechainDepositPackage(mempool, state, {MakeTransactionRef(tx)}, 0 /* nAbsurdFee */));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "deposit-package-not-deposit");
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // Too many transactions
+    state = CValidationState();
+    std::vector<CTransactionRef> vtx(MAX_DEPOSIT_PACKAGE_COUNT + 1, MakeTransactionRef(tx));
+    BOOST_CHECK(!AcceptSidechainDepositPackage(mempool, state, vtx, 0 /* nAbsurdFee */));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "deposit-package-bad-size");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
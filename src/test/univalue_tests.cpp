@@ -0,0 +1,129 @@
+// Copyright (c) 2014 BitPay Inc.
+// Copyright (c) 2014-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_skydoge.h>
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(univalue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(univalue_read_strings)
+{
+    UniValue v;
+
+    // A long hex string is copied in runs of plain chars
+    std::string strHex;
+    for (int i = 0; i < 1001; i++)
+        strHex += "0123456789abcdef"[i % 16];
+    BOOST_CHECK(v.read("[\"" + strHex + "\"]"));
+    BOOST_CHECK_EQUAL(v[0].get_str(), strHex);
+
+    // Every length around the eight char scan, with the closing quote at
+    // each offset of the last word
+    for (size_t n = 0; n < 20; n++) {
+        const std::string str(strHex, 0, n);
+        BOOST_CHECK(v.read("[\"" + str + "\"]"));
+        BOOST_CHECK_EQUAL(v[0].get_str(), str);
+    }
+
+    // Escapes between runs of plain chars
+    BOOST_CHECK(v.read("[\"abcdefgh\\\"ijklmnop\\\\qrstuvwx\\nyz\\u0041\"]"));
+    BOOST_CHECK_EQUAL(v[0].get_str(), "abcdefgh\"ijklmnop\\qrstuvwx\nyzA");
+
+    // UTF-8 and escaped surrogate pairs between runs of plain chars
+    BOOST_CHECK(v.read("[\"abcdefgh\xc3\xa9ijklmnop\xe2\x82\xacqrstuvwx\\ud83d\\ude00yz\"]"));
+    BOOST_CHECK_EQUAL(v[0].get_str(), "abcdefgh\xc3\xa9ijklmnop\xe2\x82\xacqrstuvwx\xf0\x9f\x98\x80yz");
+
+    // A control char within a run is rejected
+    BOOST_CHECK(!v.read("[\"abcdefgh\tijklmnop\"]"));
+    BOOST_CHECK(!v.read(std::string("[\"abc\0defgh\"]", 12)));
+    BOOST_CHECK(!v.read("[\"abcdefgh\x1fijklmnop\"]"));
+    BOOST_CHECK(v.read("[\"abcdefgh\x7fijklmnop\"]"));
+
+    // A UTF-8 sequence cut short by a plain char or the end of the string
+    BOOST_CHECK(!v.read("[\"abcdefgh\xc3ijklmnop\"]"));
+    BOOST_CHECK(!v.read("[\"abcdefgh\xe2\x82\"]"));
+    BOOST_CHECK(!v.read("[\"abcdefgh\x80ijklmnop\"]"));
+
+    // Unterminated strings
+    BOOST_CHECK(!v.read("[\"abcdefghijklmnop"));
+    BOOST_CHECK(!v.read("\"abcdefghijklmnop"));
+
+    // A top level string
+    BOOST_CHECK(v.read("\"abcdefghijklmnop\""));
+    BOOST_CHECK(v.isStr());
+    BOOST_CHECK_EQUAL(v.get_str(), "abcdefghijklmnop");
+}
+
+BOOST_AUTO_TEST_CASE(univalue_read_numbers)
+{
+    UniValue v;
+    BOOST_CHECK(v.read("[0, -1, 12345678901234567890, 1.5, -0.25e-3, 3E+2, 7e10]"));
+    BOOST_CHECK_EQUAL(v.size(), 7U);
+    for (size_t i = 0; i < v.size(); i++)
+        BOOST_CHECK(v[i].isNum());
+    BOOST_CHECK_EQUAL(v[0].getValStr(), "0");
+    BOOST_CHECK_EQUAL(v[1].getValStr(), "-1");
+    BOOST_CHECK_EQUAL(v[2].getValStr(), "12345678901234567890");
+    BOOST_CHECK_EQUAL(v[3].getValStr(), "1.5");
+    BOOST_CHECK_EQUAL(v[4].getValStr(), "-0.25e-3");
+    BOOST_CHECK_EQUAL(v[5].getValStr(), "3E+2");
+    BOOST_CHECK_EQUAL(v[6].getValStr(), "7e10");
+    BOOST_CHECK_EQUAL(v[1].get_int(), -1);
+    BOOST_CHECK_EQUAL(v[3].get_real(), 1.5);
+
+    // A top level number
+    BOOST_CHECK(v.read("-42"));
+    BOOST_CHECK(v.isNum());
+    BOOST_CHECK_EQUAL(v.get_int(), -42);
+
+    // Malformed numbers
+    BOOST_CHECK(!v.read("[01]"));
+    BOOST_CHECK(!v.read("[-]"));
+    BOOST_CHECK(!v.read("[-a]"));
+    BOOST_CHECK(!v.read("[1.]"));
+    BOOST_CHECK(!v.read("[1.e5]"));
+    BOOST_CHECK(!v.read("[1e]"));
+    BOOST_CHECK(!v.read("[1e+]"));
+    BOOST_CHECK(!v.read("[1.5.5]"));
+}
+
+BOOST_AUTO_TEST_CASE(univalue_read_tree)
+{
+    // Keys and values are moved into the tree, later tokens don't clobber
+    // the ones read before them
+    UniValue v;
+    BOOST_CHECK(v.read("{\"txid\": \"00112233445566778899aabbccddeeff\", \"vout\": 1,"
+                       " \"amounts\": [1.25, \"2.5\", {\"key\": \"value\"}], \"\": \"\"}"));
+    BOOST_CHECK(v.isObject());
+    const std::vector<std::string>& vKeys = v.getKeys();
+    BOOST_REQUIRE_EQUAL(vKeys.size(), 4U);
+    BOOST_CHECK_EQUAL(vKeys[0], "txid");
+    BOOST_CHECK_EQUAL(vKeys[1], "vout");
+    BOOST_CHECK_EQUAL(vKeys[2], "amounts");
+    BOOST_CHECK_EQUAL(vKeys[3], "");
+    BOOST_CHECK_EQUAL(v["txid"].get_str(), "00112233445566778899aabbccddeeff");
+    BOOST_CHECK_EQUAL(v["vout"].get_int(), 1);
+    const UniValue& amounts = v["amounts"];
+    BOOST_REQUIRE_EQUAL(amounts.size(), 3U);
+    BOOST_CHECK(amounts[0].isNum());
+    BOOST_CHECK_EQUAL(amounts[0].getValStr(), "1.25");
+    BOOST_CHECK(amounts[1].isStr());
+    BOOST_CHECK_EQUAL(amounts[1].get_str(), "2.5");
+    BOOST_CHECK_EQUAL(amounts[2]["key"].get_str(), "value");
+    BOOST_CHECK(v[""].isStr());
+    BOOST_CHECK(v[""].get_str().empty());
+
+    // Writing the tree back gives the same document
+    const std::string strJSON = "{\"a\":[\"abcdefghijklmnopq\",-1.5e-7,true,null],\"b\":\"\\u001f\\\"\"}";
+    BOOST_CHECK(v.read(strJSON));
+    BOOST_CHECK_EQUAL(v.write(), strJSON);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
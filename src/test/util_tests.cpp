@@ -11,6 +11,7 @@
 #include <utilmoneystr.h>
 #include <test/test_skydoge.h>
 
+#include <algorithm>
 #include <stdint.h>
 #include <vector>
 
@@ -64,6 +65,24 @@ BOOST_AUTO_TEST_CASE(util_ParseHex)
     // Stop parsing at invalid value
     result = ParseHex("1234 invalid 1234");
     BOOST_CHECK(result.size() == 2 && result[0] == 0x12 && result[1] == 0x34);
+
+    // Long input goes through the vectorized path, a space or invalid digit
+    // anywhere in it must be handled as in short input
+    std::string strLong = HexStr(expected);
+    result = ParseHex(strLong);
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    std::string strUpper = strLong;
+    std::transform(strUpper.begin(), strUpper.end(), strUpper.begin(), ::toupper);
+    result = ParseHex(strUpper);
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    for (size_t i = 0; i < strLong.size(); i += 2) {
+        result = ParseHex(strLong.substr(0, i) + " " + strLong.substr(i));
+        BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+        result = ParseHex(strLong.substr(0, i) + "g" + strLong.substr(i));
+        BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.begin() + i / 2);
+        result = ParseHex(strLong.substr(0, i + 1) + "/" + strLong.substr(i + 1));
+        BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.begin() + i / 2);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(util_HexStr)
@@ -85,6 +104,13 @@ BOOST_AUTO_TEST_CASE(util_HexStr)
     BOOST_CHECK_EQUAL(
         HexStr(ParseHex_vec, true),
         "04 67 8a fd b0");
+
+    // Pointers and other iterators give the same result
+    std::vector<unsigned char> vch(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected));
+    for (size_t i = 0; i <= vch.size(); i++) {
+        BOOST_CHECK_EQUAL(HexStr(vch.data(), vch.data() + i), HexStr(vch.begin(), vch.begin() + i));
+        BOOST_CHECK(ParseHex(HexStr(vch.data() + i, vch.data() + vch.size())) == std::vector<unsigned char>(vch.begin() + i, vch.end()));
+    }
 }
 
 
@@ -0,0 +1,183 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <fs.h>
+#include <script/script.h>
+#include <sidechaindb.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <test/test_skydoge.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+/** Start over with an empty chainstate at genesis, like a fresh node */
+void ResetChainstate()
+{
+    SyncWithValidationInterfaceQueue();
+    UnloadBlockIndex();
+    scdb.SetDepositDB(nullptr);
+    scdb.Reset();
+    pcoinsTip.reset();
+    pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
+    pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+    pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+    psidechaintree.reset(new CSidechainTreeDB(1 << 20, true));
+
+    BOOST_REQUIRE(LoadGenesisBlock(Params()));
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+}
+
+std::string ReadFile(const fs::path& path)
+{
+    std::ifstream file(path.string(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const fs::path& path, const std::string& strData)
+{
+    std::ofstream file(path.string(), std::ios::binary | std::ios::trunc);
+    file << strData;
+}
+
+int GetHeight()
+{
+    LOCK(cs_main);
+    return chainActive.Height();
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_dump_load)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    const COutPoint outFirst(coinbaseTxns.front().GetHash(), 0);
+    const COutPoint outLast(coinbaseTxns.back().GetHash(), 0);
+
+    UTXOSnapshotInfo info;
+    std::string strError;
+    BOOST_REQUIRE(DumpUTXOSnapshot(path, info, strError));
+    BOOST_CHECK(fs::exists(path));
+    BOOST_CHECK(!fs::exists(fs::path(path.string() + ".incomplete")));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(info.nHeight, 100);
+        BOOST_CHECK(info.hashBlock == chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK_EQUAL(info.nChainTx, chainActive.Tip()->nChainTx);
+    }
+    BOOST_CHECK(info.nCoins >= 100);
+    BOOST_CHECK(!info.hashCoins.IsNull());
+
+    // Not on top of a chain that has been connected already
+    UTXOSnapshotInfo infoLoad;
+    BOOST_CHECK(!LoadUTXOSnapshot(path, infoLoad, strError));
+    BOOST_CHECK_EQUAL(strError, "A UTXO snapshot can only be loaded before any block has been connected");
+
+    // A fresh node continues from the snapshot block
+    ResetChainstate();
+    BOOST_CHECK(!pcoinsTip->HaveCoin(outFirst));
+    BOOST_REQUIRE(LoadUTXOSnapshot(path, infoLoad, strError));
+    BOOST_CHECK(infoLoad.hashBlock == info.hashBlock);
+    BOOST_CHECK_EQUAL(infoLoad.nHeight, info.nHeight);
+    BOOST_CHECK_EQUAL(infoLoad.nCoins, info.nCoins);
+    BOOST_CHECK(infoLoad.hashCoins == info.hashCoins);
+    BOOST_CHECK_EQUAL(infoLoad.fSidechains, info.fSidechains);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == info.hashBlock);
+        BOOST_CHECK_EQUAL(chainActive.Tip()->nChainTx, info.nChainTx);
+        BOOST_CHECK(pcoinsTip->GetBestBlock() == info.hashBlock);
+        BOOST_CHECK(pcoinsdbview->GetBestBlock() == info.hashBlock);
+
+        const Coin& coin = pcoinsTip->AccessCoin(outFirst);
+        BOOST_CHECK(!coin.IsSpent());
+        BOOST_CHECK(coin.IsCoinBase());
+        BOOST_CHECK_EQUAL(coin.nHeight, 1U);
+        BOOST_CHECK(coin.out == coinbaseTxns.front().vout[0]);
+        BOOST_CHECK(pcoinsTip->HaveCoin(outLast));
+    }
+    if (info.fSidechains)
+        BOOST_CHECK(scdb.GetHashBlockLastSeen() == info.hashBlock);
+
+    uint256 hashBase;
+    unsigned int nChainTxBase = 0;
+    BOOST_CHECK(pblocktree->ReadUTXOSnapshotBase(hashBase, nChainTxBase));
+    BOOST_CHECK(hashBase == info.hashBlock);
+    BOOST_CHECK_EQUAL(nChainTxBase, info.nChainTx);
+
+    // Blocks are connected on top of it
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    BOOST_CHECK_EQUAL(GetHeight(), 101);
+
+    // Only once
+    BOOST_CHECK(!LoadUTXOSnapshot(path, infoLoad, strError));
+
+    scdb.SetDepositDB(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(utxosnapshot_load_invalid)
+{
+    const fs::path path = GetDataDir() / "utxo.dat";
+    const fs::path pathBad = GetDataDir() / "utxo_bad.dat";
+
+    UTXOSnapshotInfo info;
+    std::string strError;
+    BOOST_REQUIRE(DumpUTXOSnapshot(path, info, strError));
+    const std::string strSnapshot = ReadFile(path);
+    BOOST_REQUIRE(!strSnapshot.empty());
+    const uint256 hashGenesis = Params().GenesisBlock().GetHash();
+
+    ResetChainstate();
+
+    UTXOSnapshotInfo infoLoad;
+    BOOST_CHECK(!LoadUTXOSnapshot(GetDataDir() / "missing.dat", infoLoad, strError));
+
+    std::string strBad = strSnapshot;
+    strBad[0] = 'x';
+    WriteFile(pathBad, strBad);
+    BOOST_CHECK(!LoadUTXOSnapshot(pathBad, infoLoad, strError));
+    BOOST_CHECK_EQUAL(strError, "Not a UTXO snapshot");
+
+    // Cut off within the headers
+    WriteFile(pathBad, strSnapshot.substr(0, 1000));
+    BOOST_CHECK(!LoadUTXOSnapshot(pathBad, infoLoad, strError));
+    BOOST_CHECK_EQUAL(GetHeight(), 0);
+
+    // Coins that don't match the hash at the end of the file are erased
+    // again, leaving the empty chainstate at genesis
+    strBad = strSnapshot;
+    strBad[strBad.size() - 1] ^= 1;
+    WriteFile(pathBad, strBad);
+    BOOST_CHECK(!LoadUTXOSnapshot(pathBad, infoLoad, strError));
+    BOOST_CHECK_EQUAL(strError, "The coins of the UTXO snapshot don't match its hash");
+    BOOST_CHECK_EQUAL(GetHeight(), 0);
+    BOOST_CHECK(pcoinsdbview->GetBestBlock() == hashGenesis);
+    BOOST_CHECK(!pcoinsTip->HaveCoin(COutPoint(coinbaseTxns.front().GetHash(), 0)));
+    uint256 hashBase;
+    unsigned int nChainTxBase = 0;
+    if (pblocktree->ReadUTXOSnapshotBase(hashBase, nChainTxBase))
+        BOOST_CHECK(hashBase.IsNull());
+
+    // The intact snapshot still loads after that
+    BOOST_CHECK(LoadUTXOSnapshot(path, infoLoad, strError));
+    BOOST_CHECK_EQUAL(GetHeight(), 100);
+    BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(coinbaseTxns.front().GetHash(), 0)));
+
+    scdb.SetDepositDB(nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
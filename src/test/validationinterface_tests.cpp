@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/transaction.h>
+#include <utiltime.h>
+#include <validationinterface.h>
+
+#include <test/test_skydoge.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
+
+/** Records the lock time of every transaction announced, optionally waiting
+ * for a future before handling the first one */
+struct TestSubscriber : public CValidationInterface
+{
+    std::shared_future<void> start;
+    std::mutex cs;
+    std::vector<uint32_t> vLockTime;
+
+    explicit TestSubscriber(std::shared_future<void> startIn = std::shared_future<void>()) : start(startIn) {}
+
+    void TransactionAddedToMempool(const CTransactionRef& tx) override
+    {
+        if (start.valid())
+            start.wait();
+        std::lock_guard<std::mutex> lock(cs);
+        vLockTime.push_back(tx->nLockTime);
+    }
+
+    size_t Count()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        return vLockTime.size();
+    }
+};
+
+static CTransactionRef MakeTx(uint32_t nLockTime)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = nLockTime;
+    return MakeTransactionRef(std::move(mtx));
+}
+
+static bool GetStats(const std::string& strName, ValidationInterfaceQueueStats& stats)
+{
+    for (const ValidationInterfaceQueueStats& s : GetValidationInterfaceQueueStats()) {
+        if (s.name == strName) {
+            stats = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(slow_subscriber_does_not_block_others)
+{
+    std::promise<void> release;
+    TestSubscriber slow(release.get_future().share());
+    TestSubscriber fast;
+    RegisterValidationInterface(&slow, "slow");
+    RegisterValidationInterface(&fast, "fast");
+
+    for (uint32_t i = 0; i < 10; i++)
+        GetMainSignals().TransactionAddedToMempool(MakeTx(i));
+
+    // The fast subscriber handles everything while the slow one is stuck on
+    // its first callback
+    while (fast.Count() < 10)
+        MilliSleep(1);
+    BOOST_CHECK_EQUAL(slow.Count(), 0U);
+
+    ValidationInterfaceQueueStats stats;
+    BOOST_CHECK(GetStats("slow", stats));
+    BOOST_CHECK_EQUAL(stats.nDepth, 10U);
+    BOOST_CHECK(GetStats("fast", stats));
+    BOOST_CHECK_EQUAL(stats.nDepth, 0U);
+    BOOST_CHECK_EQUAL(stats.nProcessed, 10U);
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(slow.Count(), 10U);
+    BOOST_CHECK(GetStats("slow", stats));
+    BOOST_CHECK_EQUAL(stats.nDepth, 0U);
+    BOOST_CHECK_EQUAL(stats.nLag, 0);
+
+    UnregisterValidationInterface(&slow);
+    UnregisterValidationInterface(&fast);
+    BOOST_CHECK(!GetStats("slow", stats));
+    BOOST_CHECK(!GetStats("fast", stats));
+}
+
+BOOST_AUTO_TEST_CASE(overflow_keeps_order)
+{
+    std::promise<void> release;
+    TestSubscriber sub(release.get_future().share());
+    RegisterValidationInterface(&sub, "overflow");
+
+    // More than fit in the ring while the subscriber is stuck
+    const uint32_t nTx = 5000;
+    for (uint32_t i = 0; i < nTx; i++)
+        GetMainSignals().TransactionAddedToMempool(MakeTx(i));
+
+    ValidationInterfaceQueueStats stats;
+    BOOST_CHECK(GetStats("overflow", stats));
+    BOOST_CHECK(stats.nOverflowed > 0);
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue();
+
+    BOOST_CHECK_EQUAL(sub.Count(), nTx);
+    for (uint32_t i = 0; i < nTx; i++)
+        BOOST_CHECK_EQUAL(sub.vLockTime[i], i);
+
+    UnregisterValidationInterface(&sub);
+}
+
+BOOST_AUTO_TEST_CASE(unregister_drops_queued)
+{
+    std::promise<void> release;
+    TestSubscriber sub(release.get_future().share());
+    RegisterValidationInterface(&sub, "dropped");
+
+    for (uint32_t i = 0; i < 10; i++)
+        GetMainSignals().TransactionAddedToMempool(MakeTx(i));
+
+    // Unregistering waits for the callback that is running, nothing queued
+    // behind it is handled
+    std::thread unregister([&sub] { UnregisterValidationInterface(&sub); });
+    MilliSleep(10);
+    release.set_value();
+    unregister.join();
+    BOOST_CHECK(sub.Count() <= 1);
+
+    // Nothing to wait for, returns right away
+    SyncWithValidationInterfaceQueue();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,7 +5,11 @@
 
 #include <txdb.h>
 
+#include <blockfilter.h>
+#include <bloom.h>
 #include <chainparams.h>
+#include <coinstatsindex.h>
+#include <compressor.h>
 #include <hash.h>
 #include <random.h>
 #include <pow.h>
@@ -14,19 +18,32 @@
 #include <utilstrencodings.h>
 #include <ui_interface.h>
 #include <init.h>
+#include <undo.h>
 #include <validation.h>
 
+#include <crypto/muhash.h>
+#include <crypto/sha256.h>
+#include <primitives/block.h>
+
 #include <script/standard.h>
 #include <base58.h>
 
 #include <stdint.h>
 
+#include <algorithm>
+
+#include <functional>
+#include <set>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_TXINDEX_BEST_BLOCK = 'T';
+static const char DB_BMMINDEX = 'h';
+static const char DB_BLOCK_FEE_STATS = 'e';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -34,9 +51,40 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_UTXO_SNAPSHOT_BASE = 'U';
+static const char DB_COIN_FORMAT = 'V';
+static const char DB_COIN_FORMAT_UPGRADE = 'v';
+
+/** Key of an unparseable per-tx coins record kept in compact databases.
+ * Versions that don't know the compact format find it when they look for
+ * per-tx records to upgrade on startup, fail to parse it and refuse to load
+ * the database, rather than misreading the compact script encodings. */
+static const std::pair<unsigned char, uint256> COIN_FORMAT_GUARD_KEY = {DB_COINS, uint256()};
 
+// Block data and news written before the compact format, still read
 static const char DB_OP_RETURN = 'x';
+static const char DB_OP_RETURN_NEWS = 'n';
+static const char DB_OP_RETURN_COMPACT = 'w';
+static const char DB_OP_RETURN_NEWS_COMPACT = 'm';
 static const char DB_OP_RETURN_TYPES = 'X';
+static const char DB_OP_RETURN_BEST_BLOCK = 'B';
+static const char DB_OP_RETURN_PRUNE_HEIGHT = 'P';
+static const char DB_OP_RETURN_FILTER = 'y';
+
+static const char DB_ADDRESS_HISTORY = 'a';
+static const char DB_ADDRESS_UNSPENT = 'u';
+static const char DB_ADDRESS_BEST_BLOCK = 'B';
+
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_BLOCK_FILTER_HEADER = 'h';
+static const char DB_BLOCK_FILTER_BEST_BLOCK = 'B';
+
+static const char DB_COIN_STATS = 's';
+static const char DB_COIN_STATS_MUHASH = 'M';
+static const char DB_COIN_STATS_BEST_BLOCK = 'B';
+
+/** False positive rate of the per block filters of OP_RETURN news headers */
+static const double OP_RETURN_FILTER_FP_RATE = 0.001;
 
 namespace {
 
@@ -60,14 +108,347 @@ struct CoinEntry {
     }
 };
 
+/** A coin as the chainstate stores it in nCoinFormat */
+struct CoinValue {
+    Coin* coin;
+    int nCoinFormat;
+    CoinValue(const Coin* ptr, int nCoinFormatIn) : coin(const_cast<Coin*>(ptr)), nCoinFormat(nCoinFormatIn) {}
+
+    int GetVersion(int nVersion) const { return nCoinFormat >= COIN_FORMAT_COMPACT ? nVersion | SERIALIZE_SCRIPT_COMPACT : nVersion; }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        OverrideStream<Stream> os(&s, s.GetType(), GetVersion(s.GetVersion()));
+        os << *coin;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        OverrideStream<Stream> os(&s, s.GetType(), GetVersion(s.GetVersion()));
+        os >> *coin;
+    }
+};
+
+/** Key of the CoinNews index. The news header and block time are written in
+ * big endian so that the entries of a news type are sorted by time. */
+struct NewsEntry {
+    char key;
+    unsigned char header[4];
+    uint32_t nTime;
+    uint256 hashBlock;
+    uint32_t nOutput;
+    NewsEntry() : key(DB_OP_RETURN_NEWS), header(), nTime(0), nOutput(0) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s.write((const char*)header, sizeof(header));
+        ser_writedata32(s, le32toh(htobe32(nTime)));
+        s << hashBlock;
+        s << VARINT(nOutput);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s.read((char*)header, sizeof(header));
+        nTime = be32toh(htole32(ser_readdata32(s)));
+        s >> hashBlock;
+        s >> VARINT(nOutput);
+    }
+};
+
+/** Write OPReturnData without the first nSkip bytes of its script, which
+ * the reader knows, and with its size and fee as varints */
+template<typename Stream>
+void SerializeCompactOPReturn(Stream& s, const OPReturnData& data, size_t nSkip)
+{
+    s << data.txid;
+    s << VARINT(data.nSize);
+    uint64_t nFees = CTxOutCompressor::CompressAmount(std::max<CAmount>(data.fees, 0));
+    s << VARINT(nFees);
+    nSkip = std::min<size_t>(nSkip, data.script.size());
+    WriteCompactSize(s, data.script.size() - nSkip);
+    if (data.script.size() > nSkip)
+        s.write((const char*)data.script.data() + nSkip, data.script.size() - nSkip);
+}
+
+/** Read OPReturnData written by SerializeCompactOPReturn, the skipped bytes
+ * of its script being vchPrefix */
+template<typename Stream>
+void UnserializeCompactOPReturn(Stream& s, OPReturnData& data, const std::vector<unsigned char>& vchPrefix)
+{
+    s >> data.txid;
+    s >> VARINT(data.nSize);
+    uint64_t nFees;
+    s >> VARINT(nFees);
+    data.fees = CTxOutCompressor::DecompressAmount(nFees);
+    std::vector<unsigned char> vchTail;
+    s >> vchTail;
+    data.script = CScript(vchPrefix.begin(), vchPrefix.end());
+    data.script.insert(data.script.end(), vchTail.begin(), vchTail.end());
+}
+
+/** The OP_RETURN data of a block in the compact format. The scripts are
+ * written without their leading OP_RETURN. */
+struct CompactBlockData {
+    std::vector<OPReturnData> vData;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        WriteCompactSize(s, vData.size());
+        for (const OPReturnData& data : vData)
+            SerializeCompactOPReturn(s, data, 1);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        const std::vector<unsigned char> vchPrefix(1, OP_RETURN);
+        vData.clear();
+        for (uint64_t n = ReadCompactSize(s); n > 0; n--) {
+            vData.emplace_back();
+            UnserializeCompactOPReturn(s, vData.back(), vchPrefix);
+        }
+    }
+};
+
+/** The value of a news entry in the compact format. The script is written
+ * without OP_RETURN and the news header, which is in the key. */
+struct CompactNewsData {
+    OPReturnData data;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        SerializeCompactOPReturn(s, data, 5);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        UnserializeCompactOPReturn(s, data, std::vector<unsigned char>());
+    }
+
+    /** Put back the OP_RETURN and the header of the key */
+    void SetHeader(const unsigned char* header) {
+        CScript script;
+        script.push_back(OP_RETURN);
+        script.insert(script.end(), header, header + 4);
+        data.script.insert(data.script.begin(), script.begin(), script.end());
+    }
+};
+
+/** Copy the 4 byte news header following OP_RETURN, the same bytes the
+ * news table compares to a NewsType header */
+bool GetNewsHeader(const CScript& script, unsigned char* header)
+{
+    if (script.size() < 5 || script[0] != OP_RETURN)
+        return false;
+    std::copy(script.begin() + 1, script.begin() + 5, header);
+    return true;
+}
+
+/** Key of an address history entry. The height and output index are written
+ * in big endian so that the history of a script is sorted by height. */
+struct AddressHistoryKey {
+    char key;
+    AddressIndexScript script;
+    int nHeight;
+    uint256 txid;
+    bool fSpending;
+    uint32_t nIndex;
+    AddressHistoryKey() : key(DB_ADDRESS_HISTORY), nHeight(0), fSpending(false), nIndex(0) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << script;
+        ser_writedata32(s, le32toh(htobe32(nHeight)));
+        s << txid;
+        s << fSpending;
+        ser_writedata32(s, le32toh(htobe32(nIndex)));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> script;
+        nHeight = be32toh(htole32(ser_readdata32(s)));
+        s >> txid;
+        s >> fSpending;
+        nIndex = be32toh(htole32(ser_readdata32(s)));
+    }
+};
+
+/** The value of an address history entry, the output spent is only written
+ * for spends */
+struct AddressHistoryValue {
+    CAmount nValue;
+    bool fSpending;
+    COutPoint prevout;
+    AddressHistoryValue() : nValue(0), fSpending(false) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        uint64_t nCompressed = CTxOutCompressor::CompressAmount(nValue);
+        s << VARINT(nCompressed);
+        s << fSpending;
+        if (fSpending)
+            s << prevout;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        uint64_t nCompressed;
+        s >> VARINT(nCompressed);
+        nValue = CTxOutCompressor::DecompressAmount(nCompressed);
+        s >> fSpending;
+        if (fSpending)
+            s >> prevout;
+    }
+};
+
+/** Key of an unspent output of a script */
+struct AddressUnspentKey {
+    char key;
+    AddressIndexScript script;
+    COutPoint out;
+    AddressUnspentKey() : key(DB_ADDRESS_UNSPENT) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << script;
+        s << out;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> script;
+        s >> out;
+    }
+};
+
+struct AddressUnspentValue {
+    CAmount nValue;
+    int nHeight;
+    AddressUnspentValue() : nValue(0), nHeight(0) {}
+    AddressUnspentValue(CAmount nValueIn, int nHeightIn) : nValue(nValueIn), nHeight(nHeightIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        uint64_t nCompressed = CTxOutCompressor::CompressAmount(nValue);
+        s << VARINT(nCompressed);
+        s << VARINT(nHeight);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        uint64_t nCompressed;
+        s >> VARINT(nCompressed);
+        nValue = CTxOutCompressor::DecompressAmount(nCompressed);
+        s >> VARINT(nHeight);
+    }
+};
+
+/** What the last write of the deposits replaced, to roll them back to the
+ * chainstate if it wasn't flushed up to the same block */
+struct DepositUndo {
+    uint256 hashBestBlock;
+    bool fHash;
+    MuHash3072 muhashDeposits;
+    //! The start index and the replaced deposits of each sidechain written
+    std::map<uint8_t, std::pair<uint32_t, std::vector<SidechainDeposit>>> mapReplaced;
+
+    DepositUndo() : fHash(false) {}
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBestBlock);
+        READWRITE(fHash);
+        READWRITE(muhashDeposits);
+        READWRITE(mapReplaced);
+    }
+};
+
+/** Call fn(key, value, coin) for every output and spend of a block that the
+ * address index keeps, coin being the coin spent or null for outputs */
+template<typename Fn>
+bool ForEachAddressEntry(const CBlock& block, const CBlockUndo& blockundo, int nHeight, Fn fn)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: undo data mismatch", __func__);
+
+    AddressHistoryKey key;
+    key.nHeight = nHeight;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        key.txid = tx.GetHash();
+
+        key.fSpending = false;
+        for (size_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (out.scriptPubKey.IsUnspendable())
+                continue;
+            key.script = AddressIndexScript(out.scriptPubKey);
+            key.nIndex = j;
+            AddressHistoryValue value;
+            value.nValue = out.nValue;
+            fn(key, value, nullptr);
+        }
+
+        if (tx.IsCoinBase())
+            continue;
+
+        key.fSpending = true;
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size())
+            return error("%s: undo data mismatch", __func__);
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txundo.vprevout[j];
+            key.script = AddressIndexScript(coin.out.scriptPubKey);
+            key.nIndex = j;
+            AddressHistoryValue value;
+            value.nValue = coin.out.nValue;
+            value.fSpending = true;
+            value.prevout = tx.vin[j].prevout;
+            fn(key, value, &coin);
+        }
+    }
+    return true;
+}
+
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize / 2, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize / 2, fMemory, fWipe, true, DB_PROFILE_LOOKUP)
 {
+    if (db.Read(DB_COIN_FORMAT, nCoinFormat)) {
+        // Compact databases written before there was a guard record
+        if (nCoinFormat >= COIN_FORMAT_COMPACT && !db.Exists(COIN_FORMAT_GUARD_KEY))
+            db.Write(COIN_FORMAT_GUARD_KEY, (unsigned char)0, true);
+        return;
+    }
+
+    // A database without coins or a best block is new
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+    std::pair<char, COutPoint> key;
+    const bool fHaveCoins = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_COIN;
+    if (fHaveCoins || !GetBestBlock().IsNull() || !GetHeadBlocks().empty()) {
+        nCoinFormat = COIN_FORMAT_LEGACY;
+    } else {
+        nCoinFormat = COIN_FORMAT_COMPACT;
+        CDBBatch batch(db);
+        batch.Write(COIN_FORMAT_GUARD_KEY, (unsigned char)0);
+        batch.Write(DB_COIN_FORMAT, nCoinFormat);
+        db.WriteBatch(batch, true);
+    }
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
-    if (db.Read(CoinEntry(&outpoint), coin))
+    CoinValue value(&coin, nCoinFormat);
+    if (db.Read(CoinEntry(&outpoint), value))
         return true;
 
     return false;
@@ -96,6 +477,82 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, true);
+}
+
+bool CCoinsViewDB::WriteSnapshot(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, false);
+}
+
+bool CCoinsViewDB::LoadUTXOSnapshot(const uint256 &hashBlock, const std::function<bool(std::vector<std::pair<COutPoint, Coin>>&)>& fRead) {
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    const uint256 old_tip = GetBestBlock();
+    assert(!hashBlock.IsNull());
+
+    // Mark the database as being in transition to hashBlock like a flush
+    // does, so that a load interrupted by a crash isn't taken for a
+    // consistent chainstate. There are no blocks to replay up to the
+    // snapshot, so it can only be recovered by -reindex-chainstate.
+    CDBBatch batch(db);
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+    bool fOk = db.WriteBatch(batch, true);
+    batch.Clear();
+
+    // The coins come in key order, so that every batch is a sorted run of
+    // keys that LevelDB appends without reordering
+    std::vector<std::pair<COutPoint, Coin>> vCoins;
+    size_t count = 0;
+    while (fOk) {
+        vCoins.clear();
+        if (!fRead(vCoins)) {
+            fOk = false;
+            break;
+        }
+        if (vCoins.empty())
+            break;
+        for (const std::pair<COutPoint, Coin>& coin : vCoins)
+            batch.Write(CoinEntry(&coin.first), CoinValue(&coin.second, nCoinFormat));
+        count += vCoins.size();
+        if (batch.SizeEstimate() > batch_size) {
+            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+            fOk = db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+
+    if (fOk) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+        if (db.WriteBatch(batch, true)) {
+            LogPrint(BCLog::COINDB, "Loaded %u transaction outputs of the UTXO snapshot into the coin database...\n", (unsigned int)count);
+            return true;
+        }
+    }
+
+    // Erase the coins written so far, the database was empty before
+    batch.Clear();
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+    while (pcursor->Valid()) {
+        std::pair<char, COutPoint> key;
+        if (!pcursor->GetKey(key) || key.first != DB_COIN)
+            break;
+        batch.Erase(CoinEntry(&key.second));
+        if (batch.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    batch.Erase(DB_HEAD_BLOCKS);
+    if (!old_tip.IsNull())
+        batch.Write(DB_BEST_BLOCK, old_tip);
+    db.WriteBatch(batch, true);
+    return false;
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -126,12 +583,16 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             if (it->second.coin.IsSpent())
                 batch.Erase(entry);
             else
-                batch.Write(entry, it->second.coin);
+                batch.Write(entry, CoinValue(&it->second.coin, nCoinFormat));
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            it++;
+        }
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -161,7 +622,140 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsView* baseIn, CCoinsViewDB* dbIn)
+    : CCoinsViewBacked(baseIn), db(dbIn), fPending(false), fFailed(false), fInterrupt(false), nSnapshotUsage(0)
+{
+    threadWrite = std::thread(&TraceThread<std::function<void()>>, "coinsflush",
+            std::bind(&CCoinsViewBackgroundFlush::ThreadWrite, this));
+}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    Sync();
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fInterrupt = true;
+    }
+    cond.notify_all();
+    threadWrite.join();
+}
+
+bool CCoinsViewBackgroundFlush::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapSnapshot->find(outpoint);
+            if (it != mapSnapshot->end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    // Coins that aren't in the snapshot aren't changed by writing it
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoin(const COutPoint &outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fPending)
+            return hashSnapshot;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock)
+{
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        while (fPending && !fFailed)
+            cond.wait(lock);
+        if (fFailed)
+            return false;
+
+        // Moving the map leaves the cache with an empty one
+        mapSnapshot.reset(new CCoinsMap(std::move(mapCoins)));
+        mapCoins.clear();
+        hashSnapshot = hashBlock;
+        nSnapshotUsage = memusage::DynamicUsage(*mapSnapshot);
+        fPending = true;
+    }
+    cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::Sync()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    while (fPending && !fFailed)
+        cond.wait(lock);
+    return !fFailed;
+}
+
+size_t CCoinsViewBackgroundFlush::DynamicMemoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nSnapshotUsage;
+}
+
+void CCoinsViewBackgroundFlush::ThreadWrite()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (!fInterrupt && (!fPending || fFailed))
+                cond.wait(lock);
+            if (fInterrupt)
+                return;
+        }
+
+        // The snapshot isn't modified until fPending is cleared, so it can
+        // be read without holding cs
+        size_t nCoinsUsage = 0;
+        for (const auto& entry : *mapSnapshot)
+            nCoinsUsage += entry.second.coin.DynamicMemoryUsage();
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nSnapshotUsage += nCoinsUsage;
+        }
+
+        const int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = db->WriteSnapshot(*mapSnapshot, hashSnapshot);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint(BCLog::COINDB, "Background flush of %u coins took %.2fms\n", mapSnapshot->size(), (GetTimeMicros() - nStart) * 0.001);
+
+        // Free the snapshot after releasing cs, it may be large
+        std::unique_ptr<CCoinsMap> mapWritten;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (fOk) {
+                mapWritten = std::move(mapSnapshot);
+                nSnapshotUsage = 0;
+                fPending = false;
+            } else {
+                // Keep answering lookups from the snapshot, the next flush
+                // reports the failure
+                LogPrintf("ERROR: %s: Failed to write to coin database\n", __func__);
+                fFailed = true;
+            }
+        }
+        cond.notify_all();
+    }
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, DB_PROFILE_SCAN) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -186,7 +780,7 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock(), nCoinFormat);
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
@@ -214,7 +808,8 @@ bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 
 bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coin);
+    CoinValue value(&coin, nCoinFormat);
+    return pcursor->GetValue(value);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -261,6 +856,35 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxIndexBestBlock(CBlockLocator& locator) {
+    return Read(DB_TXINDEX_BEST_BLOCK, locator);
+}
+
+bool CBlockTreeDB::WriteTxIndexBestBlock(const CBlockLocator& locator) {
+    return Write(DB_TXINDEX_BEST_BLOCK, locator);
+}
+
+bool CBlockTreeDB::ReadBMMIndex(const uint256& hashBlock, uint8_t nSidechain, const uint256& hashBMM, uint256& txidCoinbase) {
+    return Read(std::make_pair(DB_BMMINDEX, std::make_pair(hashBlock, std::make_pair(nSidechain, hashBMM))), txidCoinbase);
+}
+
+bool CBlockTreeDB::WriteBMMIndex(const uint256& hashBlock, const uint256& txidCoinbase, const std::vector<std::pair<uint8_t, uint256>>& vCommit) {
+    // Every commitment gets its own record, a coinbase may commit to more
+    // than one h* for the same sidechain
+    CDBBatch batch(*this);
+    for (const std::pair<uint8_t, uint256>& commit : vCommit)
+        batch.Write(std::make_pair(DB_BMMINDEX, std::make_pair(hashBlock, commit)), txidCoinbase);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockFeeStats(const uint256& hashBlock, CDiskBlockFeeStats& stats) {
+    return Read(std::make_pair(DB_BLOCK_FEE_STATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteBlockFeeStats(const uint256& hashBlock, const CDiskBlockFeeStats& stats) {
+    return Write(std::make_pair(DB_BLOCK_FEE_STATS, hashBlock), stats);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -273,6 +897,19 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteUTXOSnapshotBase(const uint256& hashBlock, unsigned int nChainTx) {
+    return Write(DB_UTXO_SNAPSHOT_BASE, std::make_pair(hashBlock, nChainTx), true);
+}
+
+bool CBlockTreeDB::ReadUTXOSnapshotBase(uint256& hashBlock, unsigned int& nChainTx) {
+    std::pair<uint256, unsigned int> base;
+    if (!Read(DB_UTXO_SNAPSHOT_BASE, base))
+        return false;
+    hashBlock = base.first;
+    nChainTx = base.second;
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -286,8 +923,10 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                // Construct block index object. The key is the hash of the
+                // header we stored: rehashing every header would dominate
+                // startup, -checkheaderhashes does it in the background.
+                CBlockIndex* pindexNew = insertBlockIndex(key.second);
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -317,7 +956,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 }
 
 CSidechainTreeDB::CSidechainTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : CDBWrapper(GetDataDir() / "blocks" / "sidechain", nCacheSize, fMemory, fWipe) { }
+    : CDBWrapper(GetDataDir() / "blocks" / "sidechain", nCacheSize, fMemory, fWipe, false, DB_PROFILE_LOOKUP) { }
 
 bool CSidechainTreeDB::WriteSidechainIndex(const std::vector<std::pair<uint256, const SidechainObj *> > &list)
 {
@@ -336,50 +975,613 @@ bool CSidechainTreeDB::WriteSidechainIndex(const std::vector<std::pair<uint256,
     return WriteBatch(batch, true);
 }
 
-bool CSidechainTreeDB::WriteSidechainBlockData(const std::pair<uint256, const SidechainBlockData>& data)
+bool CSidechainTreeDB::WriteSidechainBlockData(const uint256& hashBlock, const uint256& hashPrevBlock, int nHeight, const SidechainBlockData& data)
 {
+    LOCK(cs_last);
+
+    // Write a full checkpoint periodically, or if we don't know the data of
+    // the previous block (first block after genesis or after an upgrade)
+    bool fCheckpoint = nHeight % SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL == 0;
+
+    SidechainBlockData prev;
+    if (!fCheckpoint && hashPrevBlock != hashLastBlockData) {
+        if (!GetBlockData(hashPrevBlock, prev))
+            fCheckpoint = true;
+    }
+
     CDBBatch batch(*this);
-    std::pair<char, uint256> key = std::make_pair(data.second.sidechainop, data.first);
-    batch.Write(key, data.second);
+    if (fCheckpoint) {
+        batch.Write(std::make_pair(DB_SIDECHAIN_BLOCK_OP, hashBlock), data);
+    } else {
+        SidechainBlockDelta delta;
+        delta.Build(hashPrevBlock, hashPrevBlock == hashLastBlockData ? lastBlockData : prev, data);
+        batch.Write(std::make_pair(DB_SIDECHAIN_BLOCK_DELTA_OP, hashBlock), delta);
+    }
 
-    return WriteBatch(batch, true);
+    if (!WriteBatch(batch, true))
+        return false;
+
+    hashLastBlockData = hashBlock;
+    lastBlockData = data;
+
+    return true;
 }
 
 bool CSidechainTreeDB::GetBlockData(const uint256& hashBlock, SidechainBlockData& data) const
 {
-    if (ReadSidechain(std::make_pair(DB_SIDECHAIN_BLOCK_OP, hashBlock), data))
+    LOCK(cs_last);
+
+    if (!hashLastBlockData.IsNull() && hashBlock == hashLastBlockData) {
+        data = lastBlockData;
         return true;
+    }
 
-    return false;
-}
+    // Walk back through the deltas until we find a checkpoint (or the cached
+    // block data) to start from
+    std::vector<SidechainBlockDelta> vDelta;
+    uint256 hash = hashBlock;
+    while (true) {
+        if (ReadSidechain(std::make_pair(DB_SIDECHAIN_BLOCK_OP, hash), data))
+            break;
+        if (!hashLastBlockData.IsNull() && hash == hashLastBlockData) {
+            data = lastBlockData;
+            break;
+        }
 
-bool CSidechainTreeDB::HaveBlockData(const uint256& hashBlock) const
-{
-    SidechainBlockData data;
-    return GetBlockData(hashBlock, data);
-}
+        SidechainBlockDelta delta;
+        if (!ReadSidechain(std::make_pair(DB_SIDECHAIN_BLOCK_DELTA_OP, hash), delta))
+            return false;
 
-OPReturnDB::OPReturnDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : CDBWrapper(GetDataDir() / "blocks" / "opreturn", nCacheSize, fMemory, fWipe) { }
+        // Deltas never span more than one checkpoint interval
+        if (vDelta.size() > (size_t)SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL)
+            return error("%s: missing SCDB checkpoint for block %s", __func__, hashBlock.ToString());
 
-bool OPReturnDB::WriteBlockData(const std::pair<uint256, const std::vector<OPReturnData>>& data)
-{
-    CDBBatch batch(*this);
-    std::pair<char, uint256> key = std::make_pair(DB_OP_RETURN, data.first);
-    batch.Write(key, data.second);
+        hash = delta.hashPrevBlock;
+        vDelta.push_back(std::move(delta));
+    }
+
+    for (auto it = vDelta.rbegin(); it != vDelta.rend(); it++)
+        it->Apply(data);
+
+    if (!vDelta.empty()) {
+        hashLastBlockData = hashBlock;
+        lastBlockData = data;
+    }
+
+    return true;
+}
+
+bool CSidechainTreeDB::HaveBlockData(const uint256& hashBlock) const
+{
+    return Exists(std::make_pair(DB_SIDECHAIN_BLOCK_OP, hashBlock)) ||
+        Exists(std::make_pair(DB_SIDECHAIN_BLOCK_DELTA_OP, hashBlock));
+}
+
+void CSidechainTreeDB::GetBlockData(const std::vector<uint256>& vHash, std::vector<SidechainBlockData>& vData, std::vector<bool>& vFound) const
+{
+    LOCK(cs_last);
+
+    // Most blocks are stored as deltas, read those for the whole range first
+    // and only look for checkpoints where there is no delta
+    std::vector<std::pair<char, uint256>> vKey;
+    for (const uint256& hash : vHash)
+        vKey.push_back(std::make_pair(DB_SIDECHAIN_BLOCK_DELTA_OP, hash));
+
+    std::vector<SidechainBlockDelta> vDelta;
+    std::vector<bool> vHaveDelta;
+    ReadMany(vKey, vDelta, vHaveDelta);
+
+    vData.assign(vHash.size(), SidechainBlockData());
+    vFound.assign(vHash.size(), false);
+    for (size_t i = 0; i < vHash.size(); i++) {
+        if (!vHaveDelta[i]) {
+            vFound[i] = ReadSidechain(std::make_pair(DB_SIDECHAIN_BLOCK_OP, vHash[i]), vData[i]);
+        } else if (i > 0 && vFound[i - 1] && vDelta[i].hashPrevBlock == vHash[i - 1]) {
+            vData[i] = vData[i - 1];
+            vDelta[i].Apply(vData[i]);
+            vFound[i] = true;
+        } else {
+            // Not built on the previous entry, replay from the checkpoint
+            vFound[i] = GetBlockData(vHash[i], vData[i]);
+        }
+    }
+}
+
+bool CSidechainTreeDB::PruneBlockData(const std::vector<uint256>& vHash, int nPruneHeight)
+{
+    LOCK(cs_last);
+
+    CDBBatch batch(*this);
+    for (const uint256& hash : vHash) {
+        batch.Erase(std::make_pair(DB_SIDECHAIN_BLOCK_OP, hash));
+        batch.Erase(std::make_pair(DB_SIDECHAIN_BLOCK_DELTA_OP, hash));
+        if (hash == hashLastBlockData)
+            hashLastBlockData.SetNull();
+    }
+    batch.Write(DB_SIDECHAIN_PRUNE_HEIGHT_OP, nPruneHeight);
+
+    if (!WriteBatch(batch, true))
+        return false;
+
+    // LevelDB has no range delete, the erased keys only free space once
+    // compacted, so compact their range every now and then
+    nPrunedSinceCompact += vHash.size();
+    if (nPrunedSinceCompact >= DB_PRUNE_COMPACT_KEYS) {
+        CompactRange(DB_SIDECHAIN_BLOCK_DELTA_OP, (char)(DB_SIDECHAIN_BLOCK_OP + 1));
+        nPrunedSinceCompact = 0;
+    }
+    return true;
+}
+
+int CSidechainTreeDB::ReadPruneHeight() const
+{
+    int nPruneHeight = 0;
+    Read(DB_SIDECHAIN_PRUNE_HEIGHT_OP, nPruneHeight);
+    return nPruneHeight;
+}
+
+bool CSidechainTreeDB::WriteDeposits(const std::map<uint8_t, std::pair<uint32_t, std::vector<SidechainDeposit>>>& mapDeposit, const MuHash3072& muhashDeposits, const uint256& hashBestBlock, const uint256& hashChainstate)
+{
+    CDBBatch batch(*this);
+
+    // Keep what is replaced while the chainstate on disk is behind, the
+    // deposits are rolled back to it by RewindDeposits if we stop before
+    // the chainstate is written
+    DepositUndo undo;
+    undo.hashBestBlock = hashChainstate;
+    undo.fHash = ReadDepositHash(undo.muhashDeposits);
+    const bool fUndo = hashChainstate != hashBestBlock;
+
+    for (const auto& entry : mapDeposit) {
+        const uint8_t nSidechain = entry.first;
+        const uint32_t nStart = entry.second.first;
+        const std::vector<SidechainDeposit>& vDeposit = entry.second.second;
+
+        const uint32_t nCount = ReadDepositCount(nSidechain);
+        if (nStart > nCount)
+            return error("%s: invalid start index %u for %u deposits", __func__, nStart, nCount);
+
+        std::pair<uint32_t, std::vector<SidechainDeposit>>& replaced = undo.mapReplaced[nSidechain];
+        replaced.first = nStart;
+
+        // Erase the deposits being replaced along with their txid index
+        for (uint32_t i = nStart; i < nCount; i++) {
+            const auto key = std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, std::make_pair(nSidechain, i));
+            SidechainDeposit deposit;
+            if (!Read(key, deposit))
+                return error("%s: failed to read deposit %u of sidechain %u", __func__, i, nSidechain);
+            batch.Erase(std::make_pair(DB_SIDECHAIN_DEPOSIT_TXID_OP, deposit.tx->GetHash()));
+            batch.Erase(key);
+            if (fUndo)
+                replaced.second.push_back(std::move(deposit));
+        }
+
+        for (size_t i = 0; i < vDeposit.size(); i++) {
+            const uint32_t nIndex = nStart + i;
+            batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, std::make_pair(nSidechain, nIndex)), vDeposit[i]);
+            batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_TXID_OP, vDeposit[i].tx->GetHash()), std::make_pair(nSidechain, nIndex));
+        }
+
+        batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_COUNT_OP, nSidechain), (uint32_t)(nStart + vDeposit.size()));
+    }
+
+    batch.Write(DB_SIDECHAIN_DEPOSIT_HASH_OP, muhashDeposits);
+    batch.Write(DB_SIDECHAIN_DEPOSIT_BEST_BLOCK_OP, hashBestBlock);
+
+    // Only the last write can be ahead of the chainstate, the chainstate of
+    // the write before it is on disk by now
+    if (fUndo)
+        batch.Write(DB_SIDECHAIN_DEPOSIT_UNDO_OP, undo);
+    else
+        batch.Erase(DB_SIDECHAIN_DEPOSIT_UNDO_OP);
+
+    return WriteBatch(batch, true);
+}
+
+bool CSidechainTreeDB::RewindDeposits(const uint256& hashBlock)
+{
+    uint256 hashBestBlock;
+    if (!ReadDepositBestBlock(hashBestBlock) || hashBestBlock == hashBlock)
+        return true;
+
+    DepositUndo undo;
+    if (!Read(DB_SIDECHAIN_DEPOSIT_UNDO_OP, undo) || undo.hashBestBlock != hashBlock)
+        return error("%s: deposits were written at block %s, can't roll them back to %s", __func__,
+                hashBestBlock.ToString(), hashBlock.ToString());
+
+    CDBBatch batch(*this);
+    for (const auto& entry : undo.mapReplaced) {
+        const uint8_t nSidechain = entry.first;
+        const uint32_t nStart = entry.second.first;
+        const std::vector<SidechainDeposit>& vDeposit = entry.second.second;
+
+        // Erase the deposits written and put back the ones they replaced
+        const uint32_t nCount = ReadDepositCount(nSidechain);
+        for (uint32_t i = nStart; i < nCount; i++) {
+            const auto key = std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, std::make_pair(nSidechain, i));
+            SidechainDeposit deposit;
+            if (!Read(key, deposit))
+                return error("%s: failed to read deposit %u of sidechain %u", __func__, i, nSidechain);
+            batch.Erase(std::make_pair(DB_SIDECHAIN_DEPOSIT_TXID_OP, deposit.tx->GetHash()));
+            batch.Erase(key);
+        }
+
+        for (size_t i = 0; i < vDeposit.size(); i++) {
+            const uint32_t nIndex = nStart + i;
+            batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, std::make_pair(nSidechain, nIndex)), vDeposit[i]);
+            batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_TXID_OP, vDeposit[i].tx->GetHash()), std::make_pair(nSidechain, nIndex));
+        }
+
+        batch.Write(std::make_pair(DB_SIDECHAIN_DEPOSIT_COUNT_OP, nSidechain), (uint32_t)(nStart + vDeposit.size()));
+    }
+
+    if (undo.fHash)
+        batch.Write(DB_SIDECHAIN_DEPOSIT_HASH_OP, undo.muhashDeposits);
+    else
+        batch.Erase(DB_SIDECHAIN_DEPOSIT_HASH_OP);
+    batch.Write(DB_SIDECHAIN_DEPOSIT_BEST_BLOCK_OP, hashBlock);
+    batch.Erase(DB_SIDECHAIN_DEPOSIT_UNDO_OP);
+
+    LogPrintf("%s: Rolled deposits back from block %s to the chainstate at %s\n", __func__,
+            hashBestBlock.ToString(), hashBlock.ToString());
 
     return WriteBatch(batch, true);
 }
 
+bool CSidechainTreeDB::ReadDeposits(uint8_t nSidechain, uint32_t nStart, uint32_t nCount, std::vector<SidechainDeposit>& vDeposit) const
+{
+    vDeposit.reserve(vDeposit.size() + nCount);
+    for (uint32_t i = nStart; i < nStart + nCount; i++) {
+        SidechainDeposit deposit;
+        if (!Read(std::make_pair(DB_SIDECHAIN_DEPOSIT_OP, std::make_pair(nSidechain, i)), deposit))
+            return error("%s: failed to read deposit %u of sidechain %u", __func__, i, nSidechain);
+        vDeposit.push_back(std::move(deposit));
+    }
+    return true;
+}
+
+uint32_t CSidechainTreeDB::ReadDepositCount(uint8_t nSidechain) const
+{
+    uint32_t nCount = 0;
+    if (!Read(std::make_pair(DB_SIDECHAIN_DEPOSIT_COUNT_OP, nSidechain), nCount))
+        return 0;
+    return nCount;
+}
+
+bool CSidechainTreeDB::ReadDepositHash(MuHash3072& muhashDeposits) const
+{
+    return Read(DB_SIDECHAIN_DEPOSIT_HASH_OP, muhashDeposits);
+}
+
+bool CSidechainTreeDB::ReadDepositBestBlock(uint256& hashBestBlock) const
+{
+    return Read(DB_SIDECHAIN_DEPOSIT_BEST_BLOCK_OP, hashBestBlock);
+}
+
+bool CSidechainTreeDB::ReadDepositIndex(const uint256& txid, uint8_t& nSidechain, uint32_t& nIndex) const
+{
+    std::pair<uint8_t, uint32_t> index;
+    if (!Read(std::make_pair(DB_SIDECHAIN_DEPOSIT_TXID_OP, txid), index))
+        return false;
+
+    nSidechain = index.first;
+    nIndex = index.second;
+
+    return true;
+}
+
+bool CSidechainTreeDB::WriteSpentWithdrawals(const std::vector<SidechainSpentWithdrawal>& vSpent)
+{
+    // Group the spends by block and the blocks by withdrawal, adding to what
+    // is already archived. Spends that are already archived are skipped, as
+    // replaying the SCDB cache log can archive them again.
+    std::map<uint256, std::vector<SidechainSpentWithdrawal>> mapBlock;
+    std::map<std::pair<uint8_t, uint256>, std::vector<uint256>> mapWithdrawal;
+    for (const SidechainSpentWithdrawal& spent : vSpent) {
+        auto itBlock = mapBlock.find(spent.hashBlock);
+        if (itBlock == mapBlock.end()) {
+            itBlock = mapBlock.emplace(spent.hashBlock, std::vector<SidechainSpentWithdrawal>()).first;
+            Read(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP, spent.hashBlock), itBlock->second);
+        }
+        bool fArchived = false;
+        for (const SidechainSpentWithdrawal& s : itBlock->second)
+            fArchived |= s.nSidechain == spent.nSidechain && s.hash == spent.hash;
+        if (fArchived)
+            continue;
+        itBlock->second.push_back(spent);
+
+        const auto key = std::make_pair(spent.nSidechain, spent.hash);
+        auto itWithdrawal = mapWithdrawal.find(key);
+        if (itWithdrawal == mapWithdrawal.end()) {
+            itWithdrawal = mapWithdrawal.emplace(key, std::vector<uint256>()).first;
+            Read(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_OP, key), itWithdrawal->second);
+        }
+        itWithdrawal->second.push_back(spent.hashBlock);
+    }
+
+    CDBBatch batch(*this);
+    for (const auto& it : mapBlock)
+        batch.Write(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP, it.first), it.second);
+    for (const auto& it : mapWithdrawal)
+        batch.Write(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_OP, it.first), it.second);
+
+    return WriteBatch(batch);
+}
+
+bool CSidechainTreeDB::EraseSpentWithdrawals(const uint256& hashBlock)
+{
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    if (!ReadSpentWithdrawals(hashBlock, vSpent))
+        return true;
+
+    CDBBatch batch(*this);
+    for (const SidechainSpentWithdrawal& spent : vSpent) {
+        const auto key = std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_OP, std::make_pair(spent.nSidechain, spent.hash));
+        std::vector<uint256> vHashBlock;
+        Read(key, vHashBlock);
+        vHashBlock.erase(std::remove(vHashBlock.begin(), vHashBlock.end(), hashBlock), vHashBlock.end());
+        if (vHashBlock.empty())
+            batch.Erase(key);
+        else
+            batch.Write(key, vHashBlock);
+    }
+    batch.Erase(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP, hashBlock));
+
+    return WriteBatch(batch);
+}
+
+bool CSidechainTreeDB::ReadSpentWithdrawals(const uint256& hashBlock, std::vector<SidechainSpentWithdrawal>& vSpent) const
+{
+    return Read(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP, hashBlock), vSpent);
+}
+
+bool CSidechainTreeDB::HaveSpentWithdrawal(uint8_t nSidechain, const uint256& hash) const
+{
+    return Exists(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_OP, std::make_pair(nSidechain, hash)));
+}
+
+uint32_t CSidechainTreeDB::ReadSpentWithdrawals(uint32_t nStart, uint32_t nCount, std::vector<SidechainSpentWithdrawal>& vSpent) const
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CSidechainTreeDB&>(*this).NewIterator());
+    pcursor->Seek(std::make_pair(DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP, uint256()));
+
+    uint32_t nSkipped = 0;
+    std::pair<char, uint256> key;
+    for (; pcursor->Valid() && nCount; pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_SIDECHAIN_SPENT_WITHDRAWAL_BLOCK_OP)
+            break;
+
+        std::vector<SidechainSpentWithdrawal> vBlock;
+        if (!pcursor->GetValue(vBlock))
+            continue;
+        for (const SidechainSpentWithdrawal& spent : vBlock) {
+            if (nSkipped < nStart) {
+                nSkipped++;
+            } else if (nCount) {
+                vSpent.push_back(spent);
+                nCount--;
+            }
+        }
+    }
+    return nSkipped;
+}
+
+bool CSidechainTreeDB::WriteFailedWithdrawals(const std::vector<SidechainFailedWithdrawal>& vFailed)
+{
+    CDBBatch batch(*this);
+    for (const SidechainFailedWithdrawal& failed : vFailed)
+        batch.Write(std::make_pair(DB_SIDECHAIN_FAILED_WITHDRAWAL_OP, std::make_pair(failed.nSidechain, failed.hash)), failed);
+
+    return WriteBatch(batch);
+}
+
+bool CSidechainTreeDB::HaveFailedWithdrawal(uint8_t nSidechain, const uint256& hash) const
+{
+    return Exists(std::make_pair(DB_SIDECHAIN_FAILED_WITHDRAWAL_OP, std::make_pair(nSidechain, hash)));
+}
+
+uint32_t CSidechainTreeDB::ReadFailedWithdrawals(uint32_t nStart, uint32_t nCount, std::vector<SidechainFailedWithdrawal>& vFailed) const
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CSidechainTreeDB&>(*this).NewIterator());
+    pcursor->Seek(std::make_pair(DB_SIDECHAIN_FAILED_WITHDRAWAL_OP, std::make_pair(uint8_t(0), uint256())));
+
+    uint32_t nSkipped = 0;
+    std::pair<char, std::pair<uint8_t, uint256>> key;
+    for (; pcursor->Valid() && nCount; pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_SIDECHAIN_FAILED_WITHDRAWAL_OP)
+            break;
+
+        if (nSkipped < nStart) {
+            nSkipped++;
+            continue;
+        }
+
+        SidechainFailedWithdrawal failed;
+        if (pcursor->GetValue(failed)) {
+            vFailed.push_back(failed);
+            nCount--;
+        }
+    }
+    return nSkipped;
+}
+
+OPReturnDB::OPReturnDB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "blocks" / "opreturn", nCacheSize, fMemory, fWipe, false, DB_PROFILE_APPEND)
+{
+    // Only look for data in the old format if there is some
+    fLegacyData = HaveKeyWithPrefix(DB_OP_RETURN) || HaveKeyWithPrefix(DB_OP_RETURN_NEWS);
+}
+
+bool OPReturnDB::HaveKeyWithPrefix(char chPrefix)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(chPrefix);
+
+    char chKey;
+    return pcursor->Valid() && pcursor->GetKey(chKey) && chKey == chPrefix;
+}
+
+bool OPReturnDB::WriteBlockData(const std::pair<uint256, const std::vector<OPReturnData>>& data, uint32_t nTime)
+{
+    CDBBatch batch(*this);
+    CompactBlockData blockData;
+    blockData.vData = data.second;
+    batch.Write(std::make_pair(DB_OP_RETURN_COMPACT, data.first), blockData);
+
+    // Index everything that could be news by header and block time
+    NewsEntry entry;
+    entry.key = DB_OP_RETURN_NEWS_COMPACT;
+    entry.nTime = nTime;
+    entry.hashBlock = data.first;
+    std::set<std::vector<unsigned char>> setHeader;
+    for (size_t i = 0; i < data.second.size(); i++) {
+        if (!GetNewsHeader(data.second[i].script, entry.header))
+            continue;
+        entry.nOutput = i;
+        CompactNewsData newsData;
+        newsData.data = data.second[i];
+        batch.Write(entry, newsData);
+        setHeader.emplace(entry.header, entry.header + sizeof(entry.header));
+    }
+
+    // And filter the headers of the block, so that a scan for a few headers
+    // over many blocks can skip the blocks without them
+    CBloomFilter filter(std::max<size_t>(setHeader.size(), 1), OP_RETURN_FILTER_FP_RATE, data.first.GetCheapHash(), BLOOM_UPDATE_NONE);
+    for (const std::vector<unsigned char>& vHeader : setHeader)
+        filter.insert(vHeader);
+    batch.Write(std::make_pair(DB_OP_RETURN_FILTER, data.first), filter);
+
+    // Not synced, the index catches up from its best block after a crash
+    return WriteBatch(batch);
+}
+
 bool OPReturnDB::GetBlockData(const uint256& hashBlock, std::vector<OPReturnData>& vData) const
 {
-    return Read(std::make_pair(DB_OP_RETURN, hashBlock), vData);
+    CompactBlockData blockData;
+    if (Read(std::make_pair(DB_OP_RETURN_COMPACT, hashBlock), blockData)) {
+        vData = std::move(blockData.vData);
+        return true;
+    }
+    return fLegacyData && Read(std::make_pair(DB_OP_RETURN, hashBlock), vData);
 }
 
 bool OPReturnDB::HaveBlockData(const uint256& hashBlock) const
 {
-    std::vector<OPReturnData> vData;
-    return GetBlockData(hashBlock, vData);
+    return Exists(std::make_pair(DB_OP_RETURN_COMPACT, hashBlock)) ||
+        (fLegacyData && Exists(std::make_pair(DB_OP_RETURN, hashBlock)));
+}
+
+void OPReturnDB::GetBlockData(const std::vector<uint256>& vHash, std::vector<std::vector<OPReturnData>>& vData, std::vector<bool>& vFound) const
+{
+    std::vector<std::pair<char, uint256>> vKey;
+    for (const uint256& hash : vHash)
+        vKey.push_back(std::make_pair(DB_OP_RETURN_COMPACT, hash));
+
+    std::vector<CompactBlockData> vBlockData;
+    ReadMany(vKey, vBlockData, vFound);
+
+    vData.resize(vHash.size());
+    for (size_t i = 0; i < vHash.size(); i++)
+        vData[i] = std::move(vBlockData[i].vData);
+
+    if (!fLegacyData)
+        return;
+
+    // Look for the rest in the old format
+    std::vector<size_t> vMissing;
+    vKey.clear();
+    for (size_t i = 0; i < vHash.size(); i++) {
+        if (vFound[i])
+            continue;
+        vMissing.push_back(i);
+        vKey.push_back(std::make_pair(DB_OP_RETURN, vHash[i]));
+    }
+    if (vKey.empty())
+        return;
+
+    std::vector<std::vector<OPReturnData>> vLegacyData;
+    std::vector<bool> vLegacyFound;
+    ReadMany(vKey, vLegacyData, vLegacyFound);
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        if (!vLegacyFound[i])
+            continue;
+        vData[vMissing[i]] = std::move(vLegacyData[i]);
+        vFound[vMissing[i]] = true;
+    }
+}
+
+void OPReturnDB::GetHeaderFilters(const std::vector<uint256>& vHash, std::vector<CBloomFilter>& vFilter, std::vector<bool>& vFound) const
+{
+    std::vector<std::pair<char, uint256>> vKey;
+    for (const uint256& hash : vHash)
+        vKey.push_back(std::make_pair(DB_OP_RETURN_FILTER, hash));
+
+    ReadMany(vKey, vFilter, vFound);
+
+    // The empty and full flags aren't serialized
+    for (CBloomFilter& filter : vFilter)
+        filter.UpdateEmptyFull();
+}
+
+void OPReturnDB::GetNews(const CScript& header, uint32_t nTimeStart, std::vector<OPReturnNews>& vNews)
+{
+    if (header.size() < 4)
+        return;
+
+    const size_t nStart = vNews.size();
+    GetNews(DB_OP_RETURN_NEWS_COMPACT, header, nTimeStart, vNews);
+    if (!fLegacyData)
+        return;
+
+    // Both formats are sorted by time, merge them
+    const size_t nMid = vNews.size();
+    GetNews(DB_OP_RETURN_NEWS, header, nTimeStart, vNews);
+    std::inplace_merge(vNews.begin() + nStart, vNews.begin() + nMid, vNews.end(),
+        [](const OPReturnNews& a, const OPReturnNews& b) { return a.nTime < b.nTime; });
+}
+
+void OPReturnDB::GetNews(char chKey, const CScript& header, uint32_t nTimeStart, std::vector<OPReturnNews>& vNews)
+{
+    NewsEntry entry;
+    entry.key = chKey;
+    std::copy(header.begin(), header.begin() + 4, entry.header);
+    entry.nTime = nTimeStart;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(entry);
+
+    NewsEntry key;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.key != chKey ||
+                !std::equal(key.header, key.header + 4, entry.header))
+            break;
+
+        OPReturnNews news;
+        if (chKey == DB_OP_RETURN_NEWS_COMPACT) {
+            CompactNewsData newsData;
+            if (!pcursor->GetValue(newsData))
+                continue;
+            newsData.SetHeader(key.header);
+            news.data = std::move(newsData.data);
+        } else if (!pcursor->GetValue(news.data)) {
+            continue;
+        }
+        news.hashBlock = key.hashBlock;
+        news.nTime = key.nTime;
+        vNews.push_back(news);
+    }
+}
+
+bool OPReturnDB::ReadBestBlock(CBlockLocator& locator) const
+{
+    return Read(DB_OP_RETURN_BEST_BLOCK, locator);
+}
+
+bool OPReturnDB::WriteBestBlock(const CBlockLocator& locator)
+{
+    CDBBatch batch(*this);
+    batch.Write(DB_OP_RETURN_BEST_BLOCK, locator);
+    return WriteBatch(batch, true);
 }
 
 void OPReturnDB::GetNewsTypes(std::vector<NewsType>& vType)
@@ -417,6 +1619,77 @@ void OPReturnDB::EraseNewsType(uint256 hash)
     Erase(std::make_pair(DB_OP_RETURN_TYPES, hash));
 }
 
+bool OPReturnDB::Prune(const std::vector<uint256>& vHash, int nPruneHeight, uint32_t nTimeCutoff)
+{
+    CDBBatch batch(*this);
+    for (const uint256& hash : vHash) {
+        batch.Erase(std::make_pair(DB_OP_RETURN_COMPACT, hash));
+        batch.Erase(std::make_pair(DB_OP_RETURN_FILTER, hash));
+        if (fLegacyData)
+            batch.Erase(std::make_pair(DB_OP_RETURN, hash));
+    }
+    size_t nErased = 2 * vHash.size();
+
+    nErased += PruneNews(batch, DB_OP_RETURN_NEWS_COMPACT, nTimeCutoff);
+    if (fLegacyData)
+        nErased += PruneNews(batch, DB_OP_RETURN_NEWS, nTimeCutoff);
+    batch.Write(DB_OP_RETURN_PRUNE_HEIGHT, nPruneHeight);
+
+    if (!WriteBatch(batch, true))
+        return false;
+
+    // LevelDB has no range delete, the erased keys only free space once
+    // compacted, so compact their range every now and then
+    nPrunedSinceCompact += nErased;
+    if (nPrunedSinceCompact >= DB_PRUNE_COMPACT_KEYS) {
+        CompactRange(DB_OP_RETURN_NEWS_COMPACT, (char)(DB_OP_RETURN_FILTER + 1));
+        nPrunedSinceCompact = 0;
+    }
+    return true;
+}
+
+size_t OPReturnDB::PruneNews(CDBBatch& batch, char chKey, uint32_t nTimeCutoff)
+{
+    size_t nErased = 0;
+
+    // The news of each header is sorted by time, erase from the start of a
+    // header until the cutoff and then skip to the next header
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    NewsEntry entry;
+    entry.key = chKey;
+    pcursor->Seek(entry);
+    while (pcursor->Valid()) {
+        if (!pcursor->GetKey(entry) || entry.key != chKey)
+            break;
+
+        if (entry.nTime < nTimeCutoff) {
+            batch.Erase(entry);
+            nErased++;
+            pcursor->Next();
+            continue;
+        }
+
+        // Seek to the first entry of the next header
+        int i = sizeof(entry.header) - 1;
+        while (i >= 0 && ++entry.header[i] == 0)
+            i--;
+        if (i < 0)
+            break;
+        entry.nTime = 0;
+        entry.hashBlock.SetNull();
+        entry.nOutput = 0;
+        pcursor->Seek(entry);
+    }
+    return nErased;
+}
+
+int OPReturnDB::ReadPruneHeight() const
+{
+    int nPruneHeight = 0;
+    Read(DB_OP_RETURN_PRUNE_HEIGHT, nPruneHeight);
+    return nPruneHeight;
+}
+
 std::string NewsType::GetShareURL() const
 {
     std::string str =
@@ -530,13 +1803,17 @@ public:
 
 /** Upgrade the database from older formats.
  *
- * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout.
+ * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout,
+ * and from the legacy to the compact coin format.
  */
 bool CCoinsViewDB::Upgrade() {
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
-    if (!pcursor->Valid()) {
-        return true;
+    std::pair<unsigned char, uint256> first_key;
+    if (pcursor->Valid() && pcursor->GetKey(first_key) && first_key == COIN_FORMAT_GUARD_KEY)
+        pcursor->Next();
+    if (!pcursor->Valid() || !pcursor->GetKey(first_key) || first_key.first != DB_COINS) {
+        return UpgradeCoinFormat();
     }
 
     int64_t count = 0;
@@ -574,7 +1851,7 @@ bool CCoinsViewDB::Upgrade() {
                     Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase);
                     outpoint.n = i;
                     CoinEntry entry(&outpoint);
-                    batch.Write(entry, newcoin);
+                    batch.Write(entry, CoinValue(&newcoin, nCoinFormat));
                 }
             }
             batch.Erase(key);
@@ -593,7 +1870,318 @@ bool CCoinsViewDB::Upgrade() {
     db.CompactRange({DB_COINS, uint256()}, key);
     uiInterface.ShowProgress("", 100, false);
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
-    return !ShutdownRequested();
+    return !ShutdownRequested() && UpgradeCoinFormat();
+}
+
+bool CCoinsViewDB::UpgradeCoinFormat() {
+    if (nCoinFormat >= COIN_FORMAT_COMPACT)
+        return true;
+
+    // The coins up to the one recorded with each batch are converted, so an
+    // interrupted upgrade continues after it
+    COutPoint outpointDone;
+    const bool fResume = db.Read(DB_COIN_FORMAT_UPGRADE, outpointDone);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    if (fResume)
+        pcursor->Seek(CoinEntry(&outpointDone));
+    else
+        pcursor->Seek(DB_COIN);
+
+    // From here on the database can't be read by versions that don't know
+    // the compact format
+    if (!db.Write(COIN_FORMAT_GUARD_KEY, (unsigned char)0, true))
+        return error("%s: failed to write the coin format guard", __func__);
+
+    LogPrintf("Upgrading the coin format of the utxo-set database%s...\n", fResume ? " (resuming)" : "");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0, true);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    int64_t count = 0;
+    size_t nLegacyBytes = 0, nCompactBytes = 0;
+    COutPoint outpoint;
+    std::pair<char, COutPoint> key;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        CoinEntry entry(&outpoint);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN)
+            break;
+        if (fResume && outpoint == outpointDone) {
+            pcursor->Next();
+            continue;
+        }
+        if (count++ % 256 == 0) {
+            uint32_t high = 0x100 * *outpoint.hash.begin() + *(outpoint.hash.begin() + 1);
+            int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+            uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone, true);
+            if (reportDone < percentageDone/10) {
+                // report max. every 10% step
+                LogPrintf("[%d%%]...", percentageDone);
+                reportDone = percentageDone/10;
+            }
+        }
+        Coin coin;
+        CoinValue value(&coin, COIN_FORMAT_LEGACY);
+        if (!pcursor->GetValue(value)) {
+            return error("%s: cannot parse coin record", __func__);
+        }
+        CoinValue valueCompact(&coin, COIN_FORMAT_COMPACT);
+        nLegacyBytes += pcursor->GetValueSize();
+        nCompactBytes += GetSerializeSize(valueCompact, SER_DISK, CLIENT_VERSION);
+        batch.Write(entry, valueCompact);
+        if (batch.SizeEstimate() > batch_size) {
+            batch.Write(DB_COIN_FORMAT_UPGRADE, outpoint);
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    if (ShutdownRequested()) {
+        batch.Write(DB_COIN_FORMAT_UPGRADE, outpoint);
+        db.WriteBatch(batch, true);
+        uiInterface.ShowProgress("", 100, false);
+        LogPrintf("[CANCELLED].\n");
+        return false;
+    }
+
+    batch.Erase(DB_COIN_FORMAT_UPGRADE);
+    batch.Write(DB_COIN_FORMAT, COIN_FORMAT_COMPACT);
+    if (!db.WriteBatch(batch, true))
+        return error("%s: failed to write the coin format", __func__);
+    nCoinFormat = COIN_FORMAT_COMPACT;
+    db.CompactRange(DB_COIN, (char)(DB_COIN+1));
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("[DONE].\n");
+    LogPrintf("Upgraded %u coins, %u bytes of coin records are now %u bytes\n", (unsigned int)count, (unsigned int)nLegacyBytes, (unsigned int)nCompactBytes);
+    return true;
+}
+
+
+
+AddressIndexScript::AddressIndexScript(const CScript& script)
+{
+    uint8_t nSidechain;
+    nType = script.IsDrivechain(nSidechain) ? ADDRESS_INDEX_ESCROW : ADDRESS_INDEX_SCRIPT;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+}
+
+AddressIndexDB::AddressIndexDB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "indexes" / "address", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool AddressIndexDB::WriteBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight)
+{
+    CDBBatch batch(*this);
+    AddressUnspentKey unspent;
+    bool fOk = ForEachAddressEntry(block, blockundo, nHeight,
+        [&batch, &unspent, nHeight](const AddressHistoryKey& key, const AddressHistoryValue& value, const Coin* coin) {
+            batch.Write(key, value);
+            unspent.script = key.script;
+            if (key.fSpending) {
+                unspent.out = value.prevout;
+                batch.Erase(unspent);
+            } else {
+                // Written before any spend of the same block erases it
+                unspent.out = COutPoint(key.txid, key.nIndex);
+                batch.Write(unspent, AddressUnspentValue(value.nValue, nHeight));
+            }
+        });
+    if (!fOk)
+        return false;
+
+    // Not synced, the index catches up from its best block after a crash
+    return WriteBatch(batch);
+}
+
+bool AddressIndexDB::EraseBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight)
+{
+    CDBBatch batch(*this);
+    AddressUnspentKey unspent;
+
+    // Make the coins spent unspent again first, so that outputs created and
+    // spent within the block are erased after being restored
+    bool fOk = ForEachAddressEntry(block, blockundo, nHeight,
+        [&batch, &unspent](const AddressHistoryKey& key, const AddressHistoryValue& value, const Coin* coin) {
+            if (!key.fSpending)
+                return;
+            unspent.script = key.script;
+            unspent.out = value.prevout;
+            batch.Write(unspent, AddressUnspentValue(value.nValue, coin->nHeight));
+        });
+    if (!fOk)
+        return false;
+
+    ForEachAddressEntry(block, blockundo, nHeight,
+        [&batch, &unspent](const AddressHistoryKey& key, const AddressHistoryValue& value, const Coin* coin) {
+            batch.Erase(key);
+            if (key.fSpending)
+                return;
+            unspent.script = key.script;
+            unspent.out = COutPoint(key.txid, key.nIndex);
+            batch.Erase(unspent);
+        });
+
+    return WriteBatch(batch);
+}
+
+uint32_t AddressIndexDB::ReadHistory(const AddressIndexScript& script, uint32_t nStart, uint32_t nCount, std::vector<AddressHistoryEntry>& vEntry) const
+{
+    AddressHistoryKey key;
+    key.script = script;
+
+    std::unique_ptr<CDBIterator> pcursor(const_cast<AddressIndexDB&>(*this).NewIterator());
+    pcursor->Seek(key);
+
+    uint32_t nSkipped = 0;
+    for (; pcursor->Valid() && nCount; pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.key != DB_ADDRESS_HISTORY ||
+                key.script.nType != script.nType || key.script.hash != script.hash)
+            break;
+
+        // Skipped entries are counted by key only
+        if (nSkipped < nStart) {
+            nSkipped++;
+            continue;
+        }
+
+        AddressHistoryValue value;
+        if (!pcursor->GetValue(value))
+            continue;
+
+        AddressHistoryEntry entry;
+        entry.nHeight = key.nHeight;
+        entry.txid = key.txid;
+        entry.nIndex = key.nIndex;
+        entry.fSpending = key.fSpending;
+        entry.nValue = value.nValue;
+        entry.prevout = value.prevout;
+        vEntry.push_back(entry);
+        nCount--;
+    }
+    return nSkipped;
+}
+
+uint32_t AddressIndexDB::ReadUnspent(const AddressIndexScript& script, uint32_t nStart, uint32_t nCount, std::vector<AddressUnspentEntry>& vEntry) const
+{
+    AddressUnspentKey key;
+    key.script = script;
+
+    std::unique_ptr<CDBIterator> pcursor(const_cast<AddressIndexDB&>(*this).NewIterator());
+    pcursor->Seek(key);
+
+    uint32_t nSkipped = 0;
+    for (; pcursor->Valid() && nCount; pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.key != DB_ADDRESS_UNSPENT ||
+                key.script.nType != script.nType || key.script.hash != script.hash)
+            break;
+
+        if (nSkipped < nStart) {
+            nSkipped++;
+            continue;
+        }
+
+        AddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            continue;
+
+        AddressUnspentEntry entry;
+        entry.out = key.out;
+        entry.nValue = value.nValue;
+        entry.nHeight = value.nHeight;
+        vEntry.push_back(entry);
+        nCount--;
+    }
+    return nSkipped;
+}
+
+bool AddressIndexDB::ReadBestBlock(CBlockLocator& locator) const
+{
+    return Read(DB_ADDRESS_BEST_BLOCK, locator);
+}
+
+bool AddressIndexDB::WriteBestBlock(const CBlockLocator& locator)
+{
+    CDBBatch batch(*this);
+    batch.Write(DB_ADDRESS_BEST_BLOCK, locator);
+    return WriteBatch(batch, true);
+}
+
+BlockFilterDB::BlockFilterDB(const std::string& strFilterName, size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "indexes" / "blockfilter" / strFilterName, nCacheSize, fMemory, fWipe)
+{
+}
+
+bool BlockFilterDB::WriteFilter(const BlockFilter& filter, const uint256& header)
+{
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_BLOCK_FILTER, filter.GetBlockHash()), filter.GetEncodedFilter());
+    batch.Write(std::make_pair(DB_BLOCK_FILTER_HEADER, filter.GetBlockHash()), std::make_pair(filter.GetHash(), header));
+    return WriteBatch(batch);
+}
+
+bool BlockFilterDB::ReadFilter(const uint256& hashBlock, std::vector<unsigned char>& vFilter) const
+{
+    return Read(std::make_pair(DB_BLOCK_FILTER, hashBlock), vFilter);
+}
+
+bool BlockFilterDB::ReadFilterHeader(const uint256& hashBlock, uint256& hashFilter, uint256& header) const
+{
+    std::pair<uint256, uint256> value;
+    if (!Read(std::make_pair(DB_BLOCK_FILTER_HEADER, hashBlock), value))
+        return false;
+    hashFilter = value.first;
+    header = value.second;
+    return true;
+}
+
+bool BlockFilterDB::ReadBestBlock(CBlockLocator& locator) const
+{
+    return Read(DB_BLOCK_FILTER_BEST_BLOCK, locator);
+}
+
+bool BlockFilterDB::WriteBestBlock(const CBlockLocator& locator)
+{
+    CDBBatch batch(*this);
+    batch.Write(DB_BLOCK_FILTER_BEST_BLOCK, locator);
+    return WriteBatch(batch, true);
+}
+
+CoinStatsDB::CoinStatsDB(size_t nCacheSize, bool fMemory, bool fWipe)
+    : CDBWrapper(GetDataDir() / "indexes" / "coinstats", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CoinStatsDB::WriteStats(const uint256& hashBlock, const CoinStatsEntry& entry)
+{
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_COIN_STATS, hashBlock), entry);
+    return WriteBatch(batch);
 }
 
+bool CoinStatsDB::ReadStats(const uint256& hashBlock, CoinStatsEntry& entry) const
+{
+    return Read(std::make_pair(DB_COIN_STATS, hashBlock), entry);
+}
 
+bool CoinStatsDB::ReadBestBlock(CBlockLocator& locator, uint256& hashBlock, MuHash3072& muhash) const
+{
+    std::pair<uint256, MuHash3072> value;
+    if (!Read(DB_COIN_STATS_BEST_BLOCK, locator) || !Read(DB_COIN_STATS_MUHASH, value))
+        return false;
+    hashBlock = value.first;
+    muhash = value.second;
+    return true;
+}
+
+bool CoinStatsDB::WriteBestBlock(const CBlockLocator& locator, const uint256& hashBlock, const MuHash3072& muhash)
+{
+    CDBBatch batch(*this);
+    batch.Write(DB_COIN_STATS_BEST_BLOCK, locator);
+    batch.Write(DB_COIN_STATS_MUHASH, std::make_pair(hashBlock, muhash));
+    return WriteBatch(batch, true);
+}
@@ -10,14 +10,26 @@
 #include <chain.h>
 #include <dbwrapper.h>
 #include <sidechain.h>
+#include <sync.h>
 
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
+class CBlock;
 class CBlockIndex;
+class BlockFilter;
+class CBlockUndo;
+class CBloomFilter;
 class CCoinsViewDBCursor;
+class MuHash3072;
+struct CoinStatsEntry;
 class uint256;
 
 //! No need to periodic flush if at least this much space still available.
@@ -39,7 +51,24 @@ static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
-static const int64_t nOPReturnCache = 500;
+//! Max memory allocated to the OP_RETURN DB cache (MiB)
+static const int64_t nMaxOPReturnDBCache = 64;
+//! Max memory allocated to the address index DB cache, if -addressindex (MiB)
+static const int64_t nMaxAddressIndexDBCache = 256;
+//! Max memory allocated to the block filter index DB cache, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterIndexDBCache = 32;
+//! Max memory allocated to the coin stats index DB cache, if -coinstatsindex (MiB)
+static const int64_t nMaxCoinStatsIndexDBCache = 16;
+
+//! -sidechaindbretention default, 0 keeps all SCDB block data
+static const int DEFAULT_SIDECHAIN_DB_RETENTION = 0;
+//! -opreturnretention default (days), 0 keeps all OP_RETURN data
+static const int DEFAULT_OPRETURN_RETENTION = 0;
+//! Most blocks whose data is pruned at once, a backlog is pruned over
+//! several runs
+static const int DB_PRUNE_MAX_BLOCKS = 2016;
+//! Pruned keys after which the pruned key range is compacted
+static const size_t DB_PRUNE_COMPACT_KEYS = 10000;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -66,11 +95,55 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Fees of a block and running totals over the chain up to and including
+ * it, so that the fees of a range of blocks can be read from two records */
+struct CDiskBlockFeeStats
+{
+    CAmount nFees;
+    uint32_t nTx;
+
+    //! Height of the first block included in the running totals
+    int nHeightStart;
+    CAmount nFeesTotal;
+    uint64_t nTxTotal;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nFees);
+        READWRITE(nTx);
+        READWRITE(nHeightStart);
+        READWRITE(nFeesTotal);
+        READWRITE(nTxTotal);
+    }
+
+    CDiskBlockFeeStats() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nFees = 0;
+        nTx = 0;
+        nHeightStart = 0;
+        nFeesTotal = 0;
+        nTxTotal = 0;
+    }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
+//! Format of the coins in the chainstate: the original script encoding
+static const int COIN_FORMAT_LEGACY = 1;
+//! Format of the coins in the chainstate: SERIALIZE_SCRIPT_COMPACT
+static const int COIN_FORMAT_COMPACT = 2;
+
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! COIN_FORMAT_*, new databases start out compact and old ones are
+    //! converted by Upgrade
+    int nCoinFormat;
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -81,9 +154,76 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Like BatchWrite, but leaves mapCoins untouched, so that it can be
+    //! read by other threads while it is being written
+    bool WriteSnapshot(CCoinsMap &mapCoins, const uint256 &hashBlock);
+
+    //! Bulk load the coins of a UTXO snapshot of block hashBlock into an
+    //! empty database. fRead fills its vector with the next coins in key
+    //! order, leaving it empty at the end, and returns false on error. If
+    //! the load fails the coins written are erased again.
+    bool LoadUTXOSnapshot(const uint256 &hashBlock, const std::function<bool(std::vector<std::pair<COutPoint, Coin>>&)>& fRead);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    int GetCoinFormat() const { return nCoinFormat; }
+
+private:
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase);
+    //! Rewrite the coins of the legacy format in the compact one
+    bool UpgradeCoinFormat();
+};
+
+/**
+ * Writes the coins flushed by the cache above it to the coin database on a
+ * background thread.
+ *
+ * BatchWrite takes over the flushed entries as an immutable snapshot and
+ * returns right away, so that cs_main isn't held while the database is
+ * written. Until the write has finished, lookups of the snapshot's coins are
+ * answered from the snapshot. Only one snapshot is written at a time, a
+ * flush while the previous one is being written waits for it.
+ *
+ * The database marks the transition to the snapshot's best block with its
+ * head blocks, so a crash during the write is recovered by ReplayBlocks like
+ * a crash during a synchronous flush.
+ */
+class CCoinsViewBackgroundFlush final : public CCoinsViewBacked
+{
+public:
+    //! Reads go through baseIn, the snapshots are written to dbIn
+    CCoinsViewBackgroundFlush(CCoinsView* baseIn, CCoinsViewDB* dbIn);
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+
+    //! Wait for the snapshot being written, returns false if a write failed
+    bool Sync();
+
+    //! Memory used by the snapshot being written
+    size_t DynamicMemoryUsage() const;
+
+private:
+    void ThreadWrite();
+
+    CCoinsViewDB* db;
+
+    mutable std::mutex cs;
+    std::condition_variable cond;
+    bool fPending;
+    bool fFailed;
+    bool fInterrupt;
+
+    std::unique_ptr<CCoinsMap> mapSnapshot;
+    uint256 hashSnapshot;
+    size_t nSnapshotUsage;
+
+    std::thread threadWrite;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -100,9 +240,10 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, int nCoinFormatIn):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), nCoinFormat(nCoinFormatIn) {}
     std::unique_ptr<CDBIterator> pcursor;
+    const int nCoinFormat;
     std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
@@ -124,21 +265,97 @@ public:
     bool ReadReindexing(bool &fReindexing);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    bool ReadTxIndexBestBlock(CBlockLocator& locator);
+    bool WriteTxIndexBestBlock(const CBlockLocator& locator);
+    bool ReadBMMIndex(const uint256& hashBlock, uint8_t nSidechain, const uint256& hashBMM, uint256& txidCoinbase);
+    bool WriteBMMIndex(const uint256& hashBlock, const uint256& txidCoinbase, const std::vector<std::pair<uint8_t, uint256>>& vCommit);
+    bool ReadBlockFeeStats(const uint256& hashBlock, CDiskBlockFeeStats& stats);
+    bool WriteBlockFeeStats(const uint256& hashBlock, const CDiskBlockFeeStats& stats);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! The block a UTXO snapshot was loaded at, and its nChainTx which
+    //! can't be counted from the blocks before it as we don't have them
+    bool WriteUTXOSnapshotBase(const uint256& hashBlock, unsigned int nChainTx);
+    bool ReadUTXOSnapshotBase(uint256& hashBlock, unsigned int& nChainTx);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
-/** Access to the sidechain database (blocks/sidechain/) */
+/** Access to the sidechain database (blocks/sidechain/)
+ *
+ * SCDB data for a block is stored as a full SidechainBlockData checkpoint
+ * every SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL blocks and as a
+ * SidechainBlockDelta against the parent block otherwise. GetBlockData
+ * rebuilds the full data by replaying deltas from the nearest checkpoint.
+ */
 class CSidechainTreeDB : public CDBWrapper
 {
 public:
     CSidechainTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
     bool WriteSidechainIndex(const std::vector<std::pair<uint256, const SidechainObj *> > &list);
-    bool WriteSidechainBlockData(const std::pair<uint256, const SidechainBlockData>& data);
+    bool WriteSidechainBlockData(const uint256& hashBlock, const uint256& hashPrevBlock, int nHeight, const SidechainBlockData& data);
 
     bool GetBlockData(const uint256& /* hashBlock */, SidechainBlockData& data) const;
     bool HaveBlockData(const uint256& hashBlock) const;
+
+    /** Get the block data of many blocks, ordered from oldest to newest.
+     * The data of each block is built on the data of the entry before it
+     * when that is its parent, so a range of consecutive blocks only reads
+     * one delta per block. */
+    void GetBlockData(const std::vector<uint256>& vHash, std::vector<SidechainBlockData>& vData, std::vector<bool>& vFound) const;
+
+    /** Replace the deposits of each sidechain in mapDeposit from the index
+     * it is paired with onward, along with the MuHash of every deposit after
+     * the replacement and the best block of the chainstate they match. The
+     * batch is synced, it has to be on disk before the chainstate is.
+     * hashChainstate is the best block of the chainstate on disk, if it is
+     * behind hashBestBlock what is replaced is kept for RewindDeposits. */
+    bool WriteDeposits(const std::map<uint8_t, std::pair<uint32_t, std::vector<SidechainDeposit>>>& mapDeposit, const MuHash3072& muhashDeposits, const uint256& hashBestBlock, const uint256& hashChainstate);
+    /** Roll the deposits back to the chainstate at hashBlock if the last
+     * write went ahead of it, false if they can't be */
+    bool RewindDeposits(const uint256& hashBlock);
+    /** Append up to nCount deposits of nSidechain starting at index nStart */
+    bool ReadDeposits(uint8_t nSidechain, uint32_t nStart, uint32_t nCount, std::vector<SidechainDeposit>& vDeposit) const;
+    uint32_t ReadDepositCount(uint8_t nSidechain) const;
+    /** Read the MuHash of every deposit, false if it hasn't been written */
+    bool ReadDepositHash(MuHash3072& muhashDeposits) const;
+    /** Read the chainstate best block the deposits were last written with,
+     * false if they were written by a version that didn't record it */
+    bool ReadDepositBestBlock(uint256& hashBestBlock) const;
+    bool ReadDepositIndex(const uint256& txid, uint8_t& nSidechain, uint32_t& nIndex) const;
+
+    /** Archive withdrawal spends that SCDB no longer keeps in memory */
+    bool WriteSpentWithdrawals(const std::vector<SidechainSpentWithdrawal>& vSpent);
+    /** Erase the archived withdrawal spends of a disconnected block */
+    bool EraseSpentWithdrawals(const uint256& hashBlock);
+    bool ReadSpentWithdrawals(const uint256& hashBlock, std::vector<SidechainSpentWithdrawal>& vSpent) const;
+    bool HaveSpentWithdrawal(uint8_t nSidechain, const uint256& hash) const;
+    /** Append up to nCount archived withdrawal spends, skipping the first
+     * nStart. Returns the number of spends that were skipped. */
+    uint32_t ReadSpentWithdrawals(uint32_t nStart, uint32_t nCount, std::vector<SidechainSpentWithdrawal>& vSpent) const;
+
+    /** Archive failed withdrawals that SCDB no longer keeps in memory */
+    bool WriteFailedWithdrawals(const std::vector<SidechainFailedWithdrawal>& vFailed);
+    bool HaveFailedWithdrawal(uint8_t nSidechain, const uint256& hash) const;
+    /** Append up to nCount archived failed withdrawals, skipping the first
+     * nStart. Returns the number of failed withdrawals that were skipped. */
+    uint32_t ReadFailedWithdrawals(uint32_t nStart, uint32_t nCount, std::vector<SidechainFailedWithdrawal>& vFailed) const;
+
+    /** Erase the block data of the blocks in vHash, which must be all the
+     * blocks of the active chain from ReadPruneHeight() to just below
+     * nPruneHeight. nPruneHeight must be a checkpoint height so that the blocks after it
+     * can still be rebuilt. */
+    bool PruneBlockData(const std::vector<uint256>& vHash, int nPruneHeight);
+    /** Height below which block data has been pruned, 0 if none */
+    int ReadPruneHeight() const;
+
+private:
+    /** The most recently written or rebuilt block data, used as the base for
+     * the next delta so that connecting a block doesn't replay its parent */
+    mutable CCriticalSection cs_last;
+    mutable uint256 hashLastBlockData;
+    mutable SidechainBlockData lastBlockData;
+
+    size_t nPrunedSinceCompact = 0;
 };
 
 struct OPReturnData
@@ -159,6 +376,14 @@ struct OPReturnData
     }
 };
 
+/** OP_RETURN data found by a CoinNews query */
+struct OPReturnNews
+{
+    uint256 hashBlock;
+    uint32_t nTime;
+    OPReturnData data;
+};
+
 struct NewsType
 {
     // A series of bytes to distinguish this news
@@ -193,14 +418,176 @@ class OPReturnDB : public CDBWrapper
 {
 public:
     OPReturnDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
-    bool WriteBlockData(const std::pair<uint256, const std::vector<OPReturnData>>& data);
+    bool WriteBlockData(const std::pair<uint256, const std::vector<OPReturnData>>& data, uint32_t nTime);
 
     bool GetBlockData(const uint256& /* hashBlock */, std::vector<OPReturnData>& vData) const;
     bool HaveBlockData(const uint256& hashBlock) const;
 
+    /** Get the OP_RETURN data of many blocks from one database snapshot */
+    void GetBlockData(const std::vector<uint256>& vHash, std::vector<std::vector<OPReturnData>>& vData, std::vector<bool>& vFound) const;
+
+    /** Get the bloom filters of the 4 byte news headers in many blocks, from
+     * one database snapshot. Blocks written before the filters were added
+     * have none. */
+    void GetHeaderFilters(const std::vector<uint256>& vHash, std::vector<CBloomFilter>& vFilter, std::vector<bool>& vFound) const;
+
+    /** Get OP_RETURN data starting with the 4 byte news header from blocks
+     * with a time of at least nTimeStart, in block time order. This includes
+     * blocks that are no longer part of the active chain. */
+    void GetNews(const CScript& header, uint32_t nTimeStart, std::vector<OPReturnNews>& vNews);
+
+    /** Best block of the background OP_RETURN index */
+    bool ReadBestBlock(CBlockLocator& locator) const;
+    bool WriteBestBlock(const CBlockLocator& locator);
+
     void GetNewsTypes(std::vector<NewsType>& vType);
     void WriteNewsType(NewsType type);
     void EraseNewsType(uint256 hash);
+
+    /** Erase the OP_RETURN data of the blocks in vHash, which must be all
+     * the blocks of the active chain from ReadPruneHeight() to just below
+     * nPruneHeight, and the news of blocks with a time before nTimeCutoff */
+    bool Prune(const std::vector<uint256>& vHash, int nPruneHeight, uint32_t nTimeCutoff);
+    /** Height below which block data has been pruned, 0 if none */
+    int ReadPruneHeight() const;
+
+private:
+    /** Whether there may be data in the format written before the block data
+     * and news were stored compactly */
+    bool fLegacyData;
+
+    bool HaveKeyWithPrefix(char chPrefix);
+
+    /** Get the news of one of the two formats */
+    void GetNews(char chKey, const CScript& header, uint32_t nTimeStart, std::vector<OPReturnNews>& vNews);
+
+    /** Erase the news of one of the two formats older than nTimeCutoff,
+     * returning the number of entries erased */
+    size_t PruneNews(CDBBatch& batch, char chKey, uint32_t nTimeCutoff);
+
+    size_t nPrunedSinceCompact = 0;
+};
+
+/** Kinds of scripts the address index keeps apart */
+enum AddressIndexType : uint8_t
+{
+    ADDRESS_INDEX_SCRIPT = 0,
+    // Sidechain escrow outputs (OP_DRIVECHAIN), the CTIP of each sidechain
+    ADDRESS_INDEX_ESCROW = 1,
+};
+
+/** The key of a scriptPubKey in the address index: the SHA256 of the script
+ * prefixed by its type, so that the whole history of a script, or of every
+ * sidechain escrow, is a single prefix scan */
+struct AddressIndexScript
+{
+    uint8_t nType;
+    uint256 hash;
+
+    AddressIndexScript() : nType(ADDRESS_INDEX_SCRIPT) {}
+    explicit AddressIndexScript(const CScript& script);
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nType);
+        READWRITE(hash);
+    }
+};
+
+/** An output paying to a script, or an input spending one */
+struct AddressHistoryEntry
+{
+    int nHeight;
+    uint256 txid;
+    // The output of txid, or its input if fSpending
+    uint32_t nIndex;
+    bool fSpending;
+    CAmount nValue;
+    // The output spent, if fSpending
+    COutPoint prevout;
+
+    AddressHistoryEntry() : nHeight(0), nIndex(0), fSpending(false), nValue(0) {}
+};
+
+/** An unspent output paying to a script */
+struct AddressUnspentEntry
+{
+    COutPoint out;
+    CAmount nValue;
+    int nHeight;
+
+    AddressUnspentEntry() : nValue(0), nHeight(0) {}
+};
+
+/** Access to the address index database (indexes/address/) */
+class AddressIndexDB : public CDBWrapper
+{
+public:
+    AddressIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Add the outputs and spends of a block connected at nHeight, the
+     * coins it spent are in blockundo */
+    bool WriteBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight);
+
+    /** Remove the outputs and spends of a disconnected block and make the
+     * coins it spent unspent again */
+    bool EraseBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight);
+
+    /** Append up to nCount history entries of a script in height order,
+     * skipping the first nStart. Returns the number of entries skipped. */
+    uint32_t ReadHistory(const AddressIndexScript& script, uint32_t nStart, uint32_t nCount, std::vector<AddressHistoryEntry>& vEntry) const;
+
+    /** Append up to nCount unspent outputs of a script, skipping the first
+     * nStart. Returns the number of outputs skipped. */
+    uint32_t ReadUnspent(const AddressIndexScript& script, uint32_t nStart, uint32_t nCount, std::vector<AddressUnspentEntry>& vEntry) const;
+
+    /** Best block of the background address index */
+    bool ReadBestBlock(CBlockLocator& locator) const;
+    bool WriteBestBlock(const CBlockLocator& locator);
+};
+
+/** Access to a block filter index database (indexes/blockfilter/<type>/).
+ * Filters and their headers are stored by block hash, so the entries of
+ * blocks that are disconnected stay valid and don't need to be removed. */
+class BlockFilterDB : public CDBWrapper
+{
+public:
+    BlockFilterDB(const std::string& strFilterName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Write the filter of a block along with its filter header */
+    bool WriteFilter(const BlockFilter& filter, const uint256& header);
+
+    /** Read the encoded filter of a block */
+    bool ReadFilter(const uint256& hashBlock, std::vector<unsigned char>& vFilter) const;
+
+    /** Read the filter hash and filter header of a block */
+    bool ReadFilterHeader(const uint256& hashBlock, uint256& hashFilter, uint256& header) const;
+
+    /** Best block of the background block filter index */
+    bool ReadBestBlock(CBlockLocator& locator) const;
+    bool WriteBestBlock(const CBlockLocator& locator);
+};
+
+/** Access to the coin stats index database (indexes/coinstats/). The stats
+ * of the UTXO set after each block are stored by block hash, along with the
+ * running MuHash of the UTXO set at the best block of the index. */
+class CoinStatsDB : public CDBWrapper
+{
+public:
+    CoinStatsDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Write the stats of the UTXO set after a block */
+    bool WriteStats(const uint256& hashBlock, const CoinStatsEntry& entry);
+
+    /** Read the stats of the UTXO set after a block */
+    bool ReadStats(const uint256& hashBlock, CoinStatsEntry& entry) const;
+
+    /** Best block of the background coin stats index and the MuHash of the
+     * UTXO set at it, written together */
+    bool ReadBestBlock(CBlockLocator& locator, uint256& hashBlock, MuHash3072& muhash) const;
+    bool WriteBestBlock(const CBlockLocator& locator, const uint256& hashBlock, const MuHash3072& muhash);
 };
 
 #endif // BITCOIN_TXDB_H
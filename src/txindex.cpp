@@ -0,0 +1,90 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <primitives/block.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+
+/** Number of transactions the sync thread collects before writing them */
+static const size_t TXINDEX_SYNC_BATCH_SIZE = 20000;
+
+std::unique_ptr<TxIndex> g_txindex;
+
+TxIndex::TxIndex() : BaseIndex("txindex", "transaction index")
+{
+}
+
+TxIndex::~TxIndex()
+{
+    Interrupt();
+    Stop();
+}
+
+bool TxIndex::FindTx(const uint256& txid, CDiskTxPos& pos) const
+{
+    return pblocktree->ReadTxIndex(txid, pos);
+}
+
+bool TxIndex::ReadLocator(CBlockLocator& locator)
+{
+    return pblocktree->ReadTxIndexBestBlock(locator);
+}
+
+bool TxIndex::WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex)
+{
+    return pblocktree->WriteTxIndexBestBlock(locator);
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    GetTxIndexPositions(block, pindex, vPos);
+    return true;
+}
+
+bool TxIndex::Commit()
+{
+    if (!vPos.empty() && !pblocktree->WriteTxIndex(vPos))
+        return false;
+    vPos.clear();
+    return true;
+}
+
+bool TxIndex::IsBatchFull() const
+{
+    return vPos.size() >= TXINDEX_SYNC_BATCH_SIZE;
+}
+
+void GetTxIndexPositions(const CBlock& block, const CBlockIndex* pindex, std::vector<std::pair<uint256, CDiskTxPos>>& vPos)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    for (const CTransactionRef& tx : block.vtx) {
+        vPos.push_back(std::make_pair(tx->GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+}
+
+bool UpgradeLegacyTxIndex()
+{
+    LOCK(cs_main);
+
+    bool fLegacy = false;
+    if (!pblocktree->ReadFlag("txindex", fLegacy) || !fLegacy)
+        return true;
+
+    // Without a best block of its own, the index picks up from the tip
+    CBlockLocator locator;
+    if (!pblocktree->ReadTxIndexBestBlock(locator) && chainActive.Tip()) {
+        if (!pblocktree->WriteTxIndexBestBlock(chainActive.GetLocator()))
+            return false;
+    }
+
+    LogPrintf("%s: transaction index written by block connection handed over to the background index\n", __func__);
+    return pblocktree->WriteFlag("txindex", false);
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include <baseindex.h>
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class uint256;
+struct CDiskTxPos;
+
+/**
+ * Background indexer of the disk position of every transaction in the
+ * active chain (-txindex), used to look up transactions by txid.
+ *
+ * Blocks are indexed in the background rather than in ConnectBlock under
+ * cs_main, the sync thread writing many blocks per batch. So the index can be
+ * turned on at any time without a -reindex.
+ *
+ * Entries of blocks that are disconnected are left in place, a transaction
+ * is found in whichever block indexed it last.
+ */
+class TxIndex : public BaseIndex
+{
+public:
+    TxIndex();
+    ~TxIndex();
+
+    /** Look up the disk position of a transaction */
+    bool FindTx(const uint256& txid, CDiskTxPos& pos) const;
+
+protected:
+    bool ReadLocator(CBlockLocator& locator) override;
+
+    bool WriteLocator(const CBlockLocator& locator, const CBlockIndex* pindex) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Commit() override;
+
+    bool IsBatchFull() const override;
+
+private:
+    /** Positions of the transactions indexed since the last commit */
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+};
+
+/** Append the disk position of each transaction of a block to vPos */
+void GetTxIndexPositions(const CBlock& block, const CBlockIndex* pindex, std::vector<std::pair<uint256, CDiskTxPos>>& vPos);
+
+/** Hand the entries written by ConnectBlock before the index was moved to the
+ * background over to it: they cover the chain up to the tip of the
+ * chainstate. */
+bool UpgradeLegacyTxIndex();
+
+/** The global transaction index, null if -txindex=0 */
+extern std::unique_ptr<TxIndex> g_txindex;
+
+#endif // BITCOIN_TXINDEX_H
@@ -10,6 +10,7 @@
 #include "consensus/consensus.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "policy/fees.h"
@@ -20,8 +21,19 @@
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utilstrencodings.h"
 #include "utiltime.h"
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+//! Lower bounds in sat/vB of the fee histogram buckets
+static const CAmount FEE_HISTOGRAM_RATES[] = {
+    0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 15, 20, 25, 30, 40, 50, 60, 80, 100,
+    125, 150, 200, 250, 300, 400, 500, 750, 1000, 1500, 2000, 5000, 10000,
+};
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, bool _fSidechainDeposit, uint8_t _nSidechain, int64_t _sigOpsCost, LockPoints lp):
@@ -41,6 +53,13 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+
+    fBMMRequest = false;
+    nBMMSidechain = 0;
+    if (!tx->criticalData.IsNull()) {
+        std::string strPrevBlock = "";
+        fBMMRequest = tx->criticalData.IsBMMRequest(nBMMSidechain, strPrevBlock);
+    }
 }
 
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
@@ -63,15 +82,34 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& poolIn) : pool(poolIn)
+{
+    assert(!pool.fHasEpochGuard);
+    ++pool.nEpoch;
+    pool.fHasEpochGuard = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    // Bump again so entries visited by this traversal don't count as
+    // visited by whatever runs next without a guard of its own
+    ++pool.nEpoch;
+    pool.fHasEpochGuard = false;
+}
+
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stageEntries, vAllDescendants;
+    for (const txiter childEntry : GetMemPoolChildren(updateIt)) {
+        if (!visited(childEntry))
+            stageEntries.push_back(childEntry);
+    }
 
     while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
+        const txiter cit = stageEntries.back();
+        vAllDescendants.push_back(cit);
+        stageEntries.pop_back();
         const setEntries &setChildren = GetMemPoolChildren(cit);
         for (const txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
@@ -79,25 +117,26 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (const txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!visited(cacheEntry))
+                        vAllDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!visited(childEntry)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stageEntries.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    for (txiter cit : vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            cachedDescendants[updateIt].push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
@@ -156,8 +195,13 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
     LOCK(cs);
+    const EpochGuard epoch(*this);
+
+    // Entries already in setAncestors are not walked again
+    for (const txiter ancestorIt : setAncestors)
+        visited(ancestorIt);
 
-    setEntries parentHashes;
+    std::vector<txiter> parentHashes;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -166,8 +210,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
+            if (piter != mapTx.end() && !visited(piter)) {
+                parentHashes.push_back(piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -178,16 +222,19 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const txiter piter : GetMemPoolParents(it)) {
+            if (!visited(piter))
+                parentHashes.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -204,8 +251,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -334,7 +381,11 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
     nTransactionsUpdated(0), fCriticalTxnAddedSinceBlock(false),
-    minerPolicyEstimator(estimator)
+    minerPolicyEstimator(estimator),
+    nodePool(NODE_POOL_CHUNK_SIZE, true),
+    mapTx(indexed_transaction_set::ctor_args_list(), pool_allocator<CTxMemPoolEntry>(&nodePool)),
+    mapLinks(CompareIteratorByHash(), txlinksMap::allocator_type(&nodePool)),
+    mapNextTx(pool_allocator<std::pair<const COutPoint* const, const CTransaction*>>(&nodePool))
 {
     _clear(); //lock free clear
 
@@ -376,7 +427,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    mapLinks.insert(std::make_pair(newit, TxLinks()));
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -420,17 +471,79 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
+    UpdateFeeHistogram(entry, true);
+    nCountRelaxed.store(mapTx.size(), std::memory_order_relaxed);
+    nTotalTxSizeRelaxed.store(totalTxSize, std::memory_order_relaxed);
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
 
-    if (!tx.criticalData.IsNull())
+    if (!tx.criticalData.IsNull()) {
+        setCriticalData.insert(newit);
         fCriticalTxnAddedSinceBlock = true;
+    }
+
+    if (newit->IsSidechainDeposit())
+        mapSidechainDeposits[newit->GetSidechainNumber()].insert(newit);
+
+    UpdateNewsHeaders(newit, true);
 
     return true;
 }
 
+/** The CoinNews headers of the OP_RETURN outputs of tx as mempool index keys */
+static std::vector<uint32_t> GetNewsHeaderKeys(const CTransaction& tx)
+{
+    std::vector<uint32_t> vKey;
+    for (const CTxOut& out : tx.vout) {
+        const CScript& script = out.scriptPubKey;
+        if (script.size() >= 5 && script[0] == OP_RETURN)
+            vKey.push_back(ReadLE32(&script[1]));
+    }
+    std::sort(vKey.begin(), vKey.end());
+    vKey.erase(std::unique(vKey.begin(), vKey.end()), vKey.end());
+    return vKey;
+}
+
+void CTxMemPool::UpdateNewsHeaders(txiter it, bool add)
+{
+    for (uint32_t nKey : GetNewsHeaderKeys(it->GetTx())) {
+        if (add) {
+            mapNewsHeaders[nKey].insert(it);
+            continue;
+        }
+        auto itNews = mapNewsHeaders.find(nKey);
+        if (itNews != mapNewsHeaders.end()) {
+            itNews->second.erase(it);
+            if (itNews->second.empty())
+                mapNewsHeaders.erase(itNews);
+        }
+    }
+}
+
+void CTxMemPool::UpdateFeeHistogram(const CTxMemPoolEntry& entry, bool add)
+{
+    // The bucket is the last one whose rate the entry pays. Compare fee to
+    // rate * size rather than dividing so rates on a boundary land in the
+    // bucket they start.
+    const CAmount nFee = entry.GetFee();
+    const int64_t nSize = entry.GetTxSize();
+    const CAmount* pRate = std::upper_bound(std::begin(FEE_HISTOGRAM_RATES), std::end(FEE_HISTOGRAM_RATES), nFee,
+            [nSize](CAmount fee, CAmount rate) { return fee < rate * nSize; });
+    MempoolFeeHistogramBucket& bucket = vFeeHistogram[pRate - std::begin(FEE_HISTOGRAM_RATES) - 1];
+
+    if (add) {
+        bucket.nCount++;
+        bucket.nVSize += nSize;
+        bucket.nFees += nFee;
+    } else {
+        bucket.nCount--;
+        bucket.nVSize -= nSize;
+        bucket.nFees -= nFee;
+    }
+}
+
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     NotifyEntryRemoved(it->GetSharedTx(), reason);
@@ -448,11 +561,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         vTxHashes.clear();
 
     totalTxSize -= it->GetTxSize();
+    UpdateFeeHistogram(*it, false);
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
+    setCriticalData.erase(it);
+    if (it->IsSidechainDeposit()) {
+        auto itDeposits = mapSidechainDeposits.find(it->GetSidechainNumber());
+        if (itDeposits != mapSidechainDeposits.end()) {
+            itDeposits->second.erase(it);
+            if (itDeposits->second.empty())
+                mapSidechainDeposits.erase(itDeposits);
+        }
+    }
+    UpdateNewsHeaders(it, false);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    nCountRelaxed.store(mapTx.size(), std::memory_order_relaxed);
+    nTotalTxSizeRelaxed.store(totalTxSize, std::memory_order_relaxed);
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -464,27 +590,44 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stage;
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        visited(entryit);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!setDescendants.count(childiter) && !visited(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
 }
 
+void CTxMemPool::CalculateDescendants(txiter entryit, std::vector<txiter> &vDescendants) const
+{
+    const EpochGuard epoch(*this);
+    vDescendants.clear();
+    vDescendants.push_back(entryit);
+    visited(entryit);
+    // vDescendants doubles as the queue of entries whose children are next
+    for (size_t i = 0; i < vDescendants.size(); i++) {
+        for (const txiter &childiter : GetMemPoolChildren(vDescendants[i])) {
+            if (!visited(childiter))
+                vDescendants.push_back(childiter);
+        }
+    }
+}
+
 void CTxMemPool::removeRecursive(const CTransaction &origTx, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
@@ -624,10 +767,18 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
+    setCriticalData.clear();
+    mapSidechainDeposits.clear();
+    mapNewsHeaders.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    vFeeHistogram.assign(ARRAYLEN(FEE_HISTOGRAM_RATES), MempoolFeeHistogramBucket());
+    for (size_t i = 0; i < vFeeHistogram.size(); i++)
+        vFeeHistogram[i].nMinFeeRate = FEE_HISTOGRAM_RATES[i];
+    nCountRelaxed = 0;
+    nTotalTxSizeRelaxed = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
@@ -662,6 +813,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    size_t nCriticalData = 0;
+    size_t nSidechainDeposits = 0;
+    size_t nNewsHeaders = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
@@ -740,6 +894,21 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
 
+        if (it->HasCriticalData()) {
+            assert(setCriticalData.count(it));
+            nCriticalData++;
+        }
+        if (it->IsSidechainDeposit()) {
+            auto itDeposits = mapSidechainDeposits.find(it->GetSidechainNumber());
+            assert(itDeposits != mapSidechainDeposits.end() && itDeposits->second.count(it));
+            nSidechainDeposits++;
+        }
+        for (uint32_t nKey : GetNewsHeaderKeys(tx)) {
+            auto itNews = mapNewsHeaders.find(nKey);
+            assert(itNews != mapNewsHeaders.end() && itNews->second.count(it));
+            nNewsHeaders++;
+        }
+
         if (fDependsWait)
             waitingOnDependants.push_back(&(*it));
         else {
@@ -770,6 +939,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    assert(setCriticalData.size() == nCriticalData);
+    for (const auto& deposits : mapSidechainDeposits)
+        nSidechainDeposits -= deposits.second.size();
+    assert(nSidechainDeposits == 0);
+    for (const auto& news : mapNewsHeaders)
+        nNewsHeaders -= news.second.size();
+    assert(nNewsHeaders == 0);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -817,6 +993,27 @@ std::vector<CTxMemPool::indexed_transaction_set::const_iterator> CTxMemPool::Get
     return iters;
 }
 
+std::vector<uint64_t> CTxMemPool::GetDepthAndScoreRanks(const std::vector<uint256>& vHash) const
+{
+    std::vector<uint64_t> vRank(vHash.size(), std::numeric_limits<uint64_t>::max());
+    std::vector<std::pair<indexed_transaction_set::const_iterator, size_t>> vEntry;
+    vEntry.reserve(vHash.size());
+
+    LOCK(cs);
+    for (size_t i = 0; i < vHash.size(); i++) {
+        indexed_transaction_set::const_iterator it = mapTx.find(vHash[i]);
+        if (it != mapTx.end())
+            vEntry.emplace_back(it, i);
+    }
+    DepthAndScoreComparator comparator;
+    std::sort(vEntry.begin(), vEntry.end(), [&comparator](const std::pair<indexed_transaction_set::const_iterator, size_t>& a, const std::pair<indexed_transaction_set::const_iterator, size_t>& b) {
+        return comparator(a.first, b.first);
+    });
+    for (size_t i = 0; i < vEntry.size(); i++)
+        vRank[vEntry[i].second] = i;
+    return vRank;
+}
+
 namespace {
 class TimeThenScoreComparator
 {
@@ -861,7 +1058,8 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 }
 
 static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
-    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee(), it->GetFee(), it->GetTxWeight()};
+    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee(), it->GetFee(), it->GetTxWeight(),
+        it->IsSidechainDeposit(), it->GetSidechainNumber(), it->IsBMMRequest(), it->GetBMMSidechainNumber()};
 }
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
@@ -900,6 +1098,43 @@ std::vector<TxMempoolInfo> CTxMemPool::InfoRecent(int nTx) const
     return vInfo;
 }
 
+std::vector<MempoolFeeHistogramBucket> CTxMemPool::GetFeeHistogram() const
+{
+    LOCK(cs);
+    return vFeeHistogram;
+}
+
+void CTxMemPool::GetNews(const CScript& header, std::vector<MempoolNews>& vNews) const
+{
+    vNews.clear();
+    if (header.size() < 4)
+        return;
+
+    LOCK(cs);
+    auto itNews = mapNewsHeaders.find(ReadLE32(&header[0]));
+    if (itNews == mapNewsHeaders.end())
+        return;
+
+    for (const txiter& it : itNews->second) {
+        const CTransaction& tx = it->GetTx();
+        for (const CTxOut& out : tx.vout) {
+            const CScript& script = out.scriptPubKey;
+            if (script.size() < header.size() + 1 || script[0] != OP_RETURN)
+                continue;
+            if (!std::equal(header.begin(), header.end(), script.begin() + 1))
+                continue;
+
+            MempoolNews news;
+            news.txid = tx.GetHash();
+            news.script = script;
+            news.nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            news.nFee = it->GetFee();
+            news.nTime = it->GetTime();
+            vNews.push_back(news);
+        }
+    }
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -992,8 +1227,9 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // The nodes of mapTx, mapLinks and mapNextTx and the hash table of mapTx
+    // come from nodePool
+    return nodePool.GetUsage() + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(setCriticalData) + memusage::DynamicUsage(mapSidechainDeposits) + memusage::DynamicUsage(mapNewsHeaders) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1066,17 +1302,21 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) cons
     return it->second.children;
 }
 
+const CTxMemPool::setCriticalEntries & CTxMemPool::GetCriticalData() const
+{
+    AssertLockHeld(cs);
+    return setCriticalData;
+}
+
 void CTxMemPool::RemoveExpiredCriticalRequests(std::vector<uint256>& vHashRemoved)
 {
     LOCK(cs);
 
     std::vector<CTransaction> vTxRemove;
-    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        if (!it->GetTx().criticalData.IsNull()) {
-            if (chainActive.Height() + 1 != (int64_t)it->GetTx().nLockTime + 1) {
-                vHashRemoved.push_back(it->GetTx().GetHash());
-                vTxRemove.push_back(it->GetTx());
-            }
+    for (const txiter& it : setCriticalData) {
+        if (chainActive.Height() + 1 != (int64_t)it->GetTx().nLockTime + 1) {
+            vHashRemoved.push_back(it->GetTx().GetHash());
+            vTxRemove.push_back(it->GetTx());
         }
     }
 
@@ -1086,51 +1326,21 @@ void CTxMemPool::RemoveExpiredCriticalRequests(std::vector<uint256>& vHashRemove
     }
 }
 
-void CTxMemPool::SelectBMMRequests(std::vector<uint256>& vHashRemoved)
+void CTxMemPool::RemoveInactiveBMMRequests(std::vector<uint256>& vHashRemoved)
 {
-    // TODO
-    // For now, this is just making sure that we only accept 1 BMM request
-    // per block per sidechain. Eventually though, we should allow options
-    // such as minimum payment amount, filter by sidechain, etc.
-    //
-
     LOCK(cs);
 
-    // We only want 1 BMM request per sidechain so track whether we've
-    // already found one for a given sidechain
-    std::vector<bool> vSidechain;
-    vSidechain.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
-
     std::vector<CTransaction> vTxRemove;
-    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        if (!it->GetTx().criticalData.IsNull()) {
-            uint8_t nSidechain;
-            std::string strPrevBlock = "";
-            if (it->GetTx().criticalData.IsBMMRequest(nSidechain, strPrevBlock)) {
-                if (!scdb.IsSidechainActive(nSidechain)) {
-                    // A BMM request for an invalid sidechain shouldn't be
-                    // accepted, but a sidechain can be deactivated so if we
-                    // have BMM requests for a sidechain that doesn't exist
-                    // we should clear them out
-                    vTxRemove.push_back(it->GetTx());
-                    continue;
-                }
-
-                if (nSidechain >= vSidechain.size()) {
-                    vTxRemove.push_back(it->GetTx());
-                    continue;
-                }
+    for (const txiter& it : setCriticalData) {
+        // Everything after the BMM requests is other critical data
+        if (!it->IsBMMRequest())
+            break;
 
-                if (vSidechain[nSidechain] == false) {
-                    // Track that we have found a BMM request for this sidechain
-                    vSidechain[nSidechain] = true;
-                } else {
-                    // We already have a BMM request selected for this sidechain
-                    // so remove any extras
-                    vTxRemove.push_back(it->GetTx());
-                }
-            }
-        }
+        // A BMM request for an invalid sidechain shouldn't be accepted, but
+        // a sidechain can be deactivated so if we have BMM requests for a
+        // sidechain that doesn't exist we should clear them out
+        if (!scdb.IsSidechainActive(it->GetBMMSidechainNumber()))
+            vTxRemove.push_back(it->GetTx());
     }
 
     for (const CTransaction& tx : vTxRemove) {
@@ -1167,7 +1377,7 @@ void CTxMemPool::UpdateCTIPFromBlock(const std::map<uint8_t, SidechainCTIP>& map
         return;
     }
 
-    std::vector<Sidechain> vSidechain = scdb.GetActiveSidechains();
+    const std::vector<Sidechain>& vSidechain = scdb.GetActiveSidechains();
     if (mapActiveSidechain.empty()) {
         for (const Sidechain& s : vSidechain)
             mapActiveSidechain[s.nSidechain] = s.GetSerHash();
@@ -1188,66 +1398,8 @@ void CTxMemPool::UpdateCTIPFromBlock(const std::map<uint8_t, SidechainCTIP>& map
         }
     }
 
-    // For each sidechain:
-    for (const Sidechain& s : vSidechain) {
-        auto itNew = mapCTIP.find(s.nSidechain);
-        if (itNew == mapCTIP.end())
-            continue;
-
-        // TODO refactor - the majority of the rest of the code in this function
-        // can be removed now that RemoveUnsortedSidechainDeposits is used.
+    for (const Sidechain& s : vSidechain)
         RemoveUnsortedSidechainDeposits(mapCTIP, s.nSidechain);
-
-        auto it = mapLastSidechainDeposit.find(s.nSidechain);
-        if (it == mapLastSidechainDeposit.end())
-        {
-            RemoveSidechainDeposits(s.nSidechain, {});
-            if (mapCTIP.count(s.nSidechain))
-                mapLastSidechainDeposit[s.nSidechain] = mapCTIP.at(s.nSidechain);
-        }
-        else
-        {
-            setEntries ancestors;
-            const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-            std::string strError;
-
-            const txiter cit = mapTx.find(it->second.out.hash);
-            if (cit != mapTx.end()) {
-                CalculateMemPoolAncestors(*cit, ancestors, nNoLimit, nNoLimit,
-                        nNoLimit, nNoLimit, strError);
-
-                if (ancestors.count(cit) == 0)
-                    ancestors.insert(cit);
-            }
-
-            // Search the ancestors for one spending the block level CTIP
-            setEntries setSpendingCTIP;
-            for (const txiter& i : ancestors) {
-                const CTransaction& tx = i->GetTx();
-                for (const CTxIn& in : tx.vin) {
-                    if (in.prevout == itNew->second.out)
-                        setSpendingCTIP.insert(i);
-                }
-            }
-
-            if (setSpendingCTIP.size() == 1) {
-                // If there is one parent in the mempool chain spending the new
-                // block CTIP, keep the chain of sidechain deposits and do not
-                // update the mempool to the block level CTIP. Remove deposits
-                // that are not ancestors of the valid txn chain.
-                RemoveSidechainDeposits(s.nSidechain, ancestors /* keep */);
-            }
-            else
-            {
-                // If none or more than one of the deposits in the chain for
-                // this sidechain spend the block CTIP, remove all deposits for
-                // this sidechain and update the mempool CTIP to the block CTIP
-                RemoveSidechainDeposits(s.nSidechain, {});
-                if (mapCTIP.count(s.nSidechain))
-                    mapLastSidechainDeposit[s.nSidechain] = mapCTIP.at(s.nSidechain);
-            }
-        }
-    }
 }
 
 bool CTxMemPool::GetMemPoolCTIP(uint8_t nSidechain, SidechainCTIP& ctip) const
@@ -1260,18 +1412,90 @@ bool CTxMemPool::GetMemPoolCTIP(uint8_t nSidechain, SidechainCTIP& ctip) const
     return false;
 }
 
+/** Find the output of a deposit that pays the sidechain, the new CTIP */
+static bool GetDepositCTIPOut(const CTransaction& tx, COutPoint& out)
+{
+    for (size_t i = 0; i < tx.vout.size(); i++) {
+        uint8_t nSidechain;
+        if (tx.vout[i].scriptPubKey.IsDrivechain(nSidechain)) {
+            out = COutPoint(tx.GetHash(), i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CTxMemPool::GetSidechainDepositChain(uint8_t nSidechain, std::vector<txiter>& vChain) const
+{
+    LOCK(cs);
+
+    vChain.clear();
+
+    auto itDeposits = mapSidechainDeposits.find(nSidechain);
+    if (itDeposits == mapSidechainDeposits.end())
+        return true;
+    const setEntries& setDeposits = itDeposits->second;
+
+    // The chain starts with the only deposit that doesn't spend the CTIP
+    // output of another mempool deposit
+    std::set<COutPoint> setCTIPOut;
+    for (const txiter& it : setDeposits) {
+        COutPoint out;
+        if (!GetDepositCTIPOut(it->GetTx(), out))
+            return false;
+        setCTIPOut.insert(out);
+    }
+
+    txiter itFirst = mapTx.end();
+    for (const txiter& it : setDeposits) {
+        bool fSpendsDeposit = false;
+        for (const CTxIn& in : it->GetTx().vin) {
+            if (setCTIPOut.count(in.prevout)) {
+                fSpendsDeposit = true;
+                break;
+            }
+        }
+        if (fSpendsDeposit)
+            continue;
+        if (itFirst != mapTx.end())
+            return false;
+        itFirst = it;
+    }
+    if (itFirst == mapTx.end())
+        return false;
+
+    // Follow the CTIP outputs to the end of the chain
+    txiter it = itFirst;
+    while (true) {
+        vChain.push_back(it);
+
+        COutPoint out;
+        GetDepositCTIPOut(it->GetTx(), out);
+        auto itNext = mapNextTx.find(out);
+        if (itNext == mapNextTx.end())
+            break;
+
+        it = mapTx.find(itNext->second->GetHash());
+        if (it == mapTx.end() || !setDeposits.count(it))
+            break;
+    }
+
+    // Anything we didn't reach isn't part of the chain
+    return vChain.size() == setDeposits.size();
+}
+
 void CTxMemPool::RemoveSidechainDeposits(uint8_t nSidechain, const setEntries& setKeep)
 {
     LOCK(cs);
 
+    auto itDeposits = mapSidechainDeposits.find(nSidechain);
+    if (itDeposits == mapSidechainDeposits.end())
+        return;
+
     std::vector<CTransaction> vTxRemove;
-    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        if (it->IsSidechainDeposit() &&
-                it->GetSidechainNumber() == nSidechain &&
-                setKeep.count(it) == 0)
-        {
+    for (const txiter& it : itDeposits->second) {
+        if (setKeep.count(it) == 0)
             vTxRemove.push_back(it->GetTx());
-        }
     }
 
     for (const CTransaction& tx : vTxRemove) {
@@ -1285,45 +1509,62 @@ void CTxMemPool::RemoveUnsortedSidechainDeposits(const std::map<uint8_t, Sidecha
     if (!scdb.IsSidechainActive(nSidechain))
         return;
 
-    // TODO refactor: this function should be part of / replace the
-    // UpdateCTIPFromBlock function. We are requesting and looping through the
-    // same data that has previously been requested.
-
-    if (mapCTIP.find(nSidechain) == mapCTIP.end())
+    auto itCTIP = mapCTIP.find(nSidechain);
+    if (itCTIP == mapCTIP.end())
         return;
+    const SidechainCTIP& ctipBlock = itCTIP->second;
 
-    // Collect deposits to this sidechain from the mempool
-    std::vector<SidechainDeposit> vDeposit;
-    {
-        LOCK(cs);
+    LOCK(cs);
 
-        for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-            if (it->IsSidechainDeposit() && it->GetSidechainNumber() == nSidechain) {
-                SidechainDeposit deposit;
-                // Get deposit information from transaction and check format.
-                // We do not have the block hash or transaction number here.
-                if (!scdb.TxnToDeposit(it->GetTx(), 0 /* nTx */, {} /* hashBlock */, deposit)) {
-                    // Reset deposits if we find any invalid for this sidechain
-                    LogPrintf("%s: Removing sidechain deposits for sidechain: %u. Found invalid.\n", __func__, nSidechain);
-                    RemoveSidechainDeposits(nSidechain, {});
-                    if (mapCTIP.count(nSidechain))
-                        mapLastSidechainDeposit[nSidechain] = mapCTIP.at(nSidechain);
-
-                    vDeposit.clear();
-                    break;
-                }
-                vDeposit.push_back(deposit);
+    // Check the format of each deposit. We do not have the block hash or
+    // transaction number here. Reset deposits if we find any invalid for
+    // this sidechain.
+    auto itDeposits = mapSidechainDeposits.find(nSidechain);
+    if (itDeposits != mapSidechainDeposits.end()) {
+        for (const txiter& it : itDeposits->second) {
+            SidechainDeposit deposit;
+            if (!scdb.TxnToDeposit(it->GetSharedTx(), 0 /* nTx */, {} /* hashBlock */, deposit)) {
+                LogPrintf("%s: Removing sidechain deposits for sidechain: %u. Found invalid.\n", __func__, nSidechain);
+                RemoveSidechainDeposits(nSidechain, {});
+                mapLastSidechainDeposit[nSidechain] = ctipBlock;
+                return;
             }
         }
-    } // end lock
+    }
+
+    std::vector<txiter> vChain;
+    bool fValid = GetSidechainDepositChain(nSidechain, vChain);
+
+    // The chain must continue from the block level CTIP. Either the first
+    // deposit spends it, or the block CTIP is the output of one of the
+    // deposits and the deposits up to it are in the block being connected.
+    if (fValid && !vChain.empty()) {
+        fValid = false;
+        for (const CTxIn& in : vChain.front()->GetTx().vin) {
+            if (in.prevout == ctipBlock.out)
+                fValid = true;
+        }
+        for (const txiter& it : vChain) {
+            COutPoint out;
+            if (GetDepositCTIPOut(it->GetTx(), out) && out == ctipBlock.out)
+                fValid = true;
+        }
+    }
 
-    // Test sorting deposits
-    std::vector<SidechainDeposit> vSorted;
-    if (!SortDeposits(vDeposit, vSorted)) {
-        // If the deposits cannot be sorted, remove them
+    if (!fValid) {
+        LogPrintf("%s: Removing sidechain deposits for sidechain: %u. Not sorted.\n", __func__, nSidechain);
         RemoveSidechainDeposits(nSidechain, {});
-        if (mapCTIP.count(nSidechain))
-            mapLastSidechainDeposit[nSidechain] = mapCTIP.at(nSidechain);
+        vChain.clear();
+    }
+
+    // Our CTIP is the last deposit of the chain, or the block level CTIP
+    if (vChain.empty()) {
+        mapLastSidechainDeposit[nSidechain] = ctipBlock;
+    } else {
+        SidechainCTIP ctip;
+        GetDepositCTIPOut(vChain.back()->GetTx(), ctip.out);
+        ctip.amount = vChain.back()->GetTx().vout[ctip.out.n].nValue;
+        mapLastSidechainDeposit[nSidechain] = ctip;
     }
 }
 
@@ -1359,37 +1600,68 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
+size_t CTxMemPool::GetEntryUsageBound(txiter it) const
+{
+    // The nodes of mapTx, mapLinks and mapNextTx have at most 12, 4 and 4
+    // pointers of overhead, and pool blocks are rounded up less than malloc
+    const TxLinks& links = mapLinks.find(it)->second;
+    return it->DynamicMemoryUsage() + memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children) +
+        memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(txlinksMap::value_type) + 4 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(decltype(mapNextTx)::value_type) + 4 * sizeof(void*)) * it->GetTx().vin.size();
+}
+
 void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
-    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
-
-        // We set the new mempool min fee to the feerate of the removed set, plus the
-        // "minimum reasonable fee rate" (ie some value under which we consider txn
-        // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
-        // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
-        removed += incrementalRelayFee;
-        trackPackageRemoved(removed);
-        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
-
+    size_t nUsage;
+    while (!mapTx.empty() && (nUsage = DynamicMemoryUsage()) > sizelimit) {
+        // Pick the packages to evict in descendant score order until they
+        // free enough memory and remove them all at once. The memory of a
+        // transaction is overestimated, so that a round never removes more
+        // than evicting one package at a time would. Removing a package
+        // raises the descendant score of its ancestors, so a round also ends
+        // at the first ancestor of a picked package, whose place in the index
+        // is stale, and the next round picks up from the updated index.
+        size_t nFreed = 0;
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        std::vector<txiter> vPackage;
+        for (auto it = mapTx.get<descendant_score>().begin(); it != mapTx.get<descendant_score>().end() && nFreed < nUsage - sizelimit; ++it) {
+            txiter entry = mapTx.project<0>(it);
+            if (stage.count(entry))
+                continue;
+            CalculateDescendants(entry, vPackage);
+            if (std::any_of(vPackage.begin(), vPackage.end(), [&stage](txiter dit) { return stage.count(dit); }))
+                break;
+
+            // We set the new mempool min fee to the feerate of the removed set, plus the
+            // "minimum reasonable fee rate" (ie some value under which we consider txn
+            // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
+            // equal to txn which were removed with no block in between.
+            CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+            removed += incrementalRelayFee;
+            trackPackageRemoved(removed);
+            maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+            for (txiter dit : vPackage) {
+                stage.insert(dit);
+                nFreed += GetEntryUsageBound(dit);
+            }
+        }
         nTxnRemoved += stage.size();
 
-        std::vector<CTransaction> txn;
+        std::vector<CTransactionRef> txn;
         if (pvNoSpendsRemaining) {
             txn.reserve(stage.size());
             for (txiter iter : stage)
-                txn.push_back(iter->GetTx());
+                txn.push_back(iter->GetSharedTx());
         }
         RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
         if (pvNoSpendsRemaining) {
-            for (const CTransaction& tx : txn) {
-                for (const CTxIn& txin : tx.vin) {
+            for (const CTransactionRef& tx : txn) {
+                for (const CTxIn& txin : tx->vin) {
                     if (exists(txin.prevout.hash)) continue;
                     pvNoSpendsRemaining->push_back(txin.prevout);
                 }
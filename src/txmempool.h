@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
 #include <memory>
 #include <set>
 #include <map>
@@ -21,6 +22,7 @@
 #include <sidechain.h>
 #include <sync.h>
 #include <random.h>
+#include <support/allocators/pool.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -77,6 +79,10 @@ private:
     bool fSidechainDeposit;
     uint8_t nSidechain;
 
+    // BMM request info, cached so the mempool can index BMM requests
+    bool fBMMRequest;
+    uint8_t nBMMSidechain;
+
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
@@ -135,12 +141,16 @@ public:
     bool IsSidechainDeposit() const { return fSidechainDeposit; }
     uint8_t GetSidechainNumber() const { return nSidechain; }
 
+    bool IsBMMRequest() const { return fBMMRequest; }
+    uint8_t GetBMMSidechainNumber() const { return nBMMSidechain; }
+
     uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
     uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpochMarker = 0; //!< Last mempool traversal that visited this entry, see CTxMemPool::visited
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -355,6 +365,48 @@ struct TxMempoolInfo
 
     /** Tx Weight */
     size_t nTxWeight;
+
+    /** Sidechain deposit and the sidechain it deposits to */
+    bool fSidechainDeposit;
+    uint8_t nSidechain;
+
+    /** BMM request and the sidechain it is for */
+    bool fBMMRequest;
+    uint8_t nBMMSidechain;
+};
+
+/**
+ * Transactions of one fee rate bucket of the mempool fee histogram.
+ */
+struct MempoolFeeHistogramBucket
+{
+    /** Lowest fee rate of the bucket in satoshis per virtual byte */
+    CAmount nMinFeeRate = 0;
+
+    /** Number of transactions */
+    uint64_t nCount = 0;
+
+    /** Total virtual size of the transactions */
+    uint64_t nVSize = 0;
+
+    /** Total fees of the transactions, not counting prioritisetransaction */
+    CAmount nFees = 0;
+};
+
+/**
+ * An OP_RETURN output of a mempool transaction found by its CoinNews header,
+ * the unconfirmed counterpart of OPReturnNews.
+ */
+struct MempoolNews
+{
+    uint256 txid;
+    CScript script;
+    /** Serialized size of the transaction */
+    unsigned int nSize;
+    /** Fees of the transaction, not counting prioritisetransaction */
+    CAmount nFee;
+    /** Time the transaction entered the mempool */
+    int64_t nTime;
 };
 
 /** Reason why a transaction was removed from the mempool,
@@ -467,6 +519,15 @@ private:
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    //! Nodes of mapTx, mapLinks and mapNextTx. Declared before them so that
+    //! it outlives them. Its chunks come from huge pages when they are enabled.
+    static const size_t NODE_POOL_CHUNK_SIZE = 256 * 1024;
+    PoolResource nodePool;
+
+    //! Copies of mapTx.size() and totalTxSize for readers that don't take cs
+    std::atomic<uint64_t> nCountRelaxed;
+    std::atomic<uint64_t> nTotalTxSizeRelaxed;
+
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
@@ -500,7 +561,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        pool_allocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     mutable CCriticalSection cs;
@@ -516,12 +578,32 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
+    /** Sort BMM requests by sidechain and then by fee, highest first. Other
+     * critical data transactions sort after all BMM requests. */
+    struct CompareIteratorByBMMRequest {
+        bool operator()(const txiter &a, const txiter &b) const {
+            int nSidechainA = a->IsBMMRequest() ? a->GetBMMSidechainNumber() : SIDECHAIN_ACTIVATION_MAX_ACTIVE;
+            int nSidechainB = b->IsBMMRequest() ? b->GetBMMSidechainNumber() : SIDECHAIN_ACTIVATION_MAX_ACTIVE;
+            if (nSidechainA != nSidechainB)
+                return nSidechainA < nSidechainB;
+            if (a->GetFee() != b->GetFee())
+                return a->GetFee() > b->GetFee();
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByBMMRequest> setCriticalEntries;
+
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
 
+    /** Critical data entries, BMM requests grouped by sidechain and sorted
+     * by fee. Requires cs. */
+    const setCriticalEntries & GetCriticalData() const;
+
     void RemoveExpiredCriticalRequests(std::vector<uint256>& vHashRemoved);
 
-    void SelectBMMRequests(std::vector<uint256>& vHashRemoved);
+    /** Remove BMM requests for sidechains that are no longer active */
+    void RemoveInactiveBMMRequests(std::vector<uint256>& vHashRemoved);
 
     void UpdateCTIPFromMempool(const std::map<uint8_t, SidechainCTIP>& mapCTIP);
 
@@ -529,29 +611,81 @@ public:
 
     bool GetMemPoolCTIP(uint8_t nSidechain, SidechainCTIP& ctip) const;
 
+    /** Get the deposits to nSidechain in the order they spend each other's
+     * CTIP output. Returns false if they don't form a single chain. */
+    bool GetSidechainDepositChain(uint8_t nSidechain, std::vector<txiter>& vChain) const;
+
     void RemoveSidechainDeposits(uint8_t nSidechain, const setEntries& setKeep);
 
     void RemoveUnsortedSidechainDeposits(const std::map<uint8_t, SidechainCTIP>& mapCTIP, uint8_t nSidechain);
 
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
         setEntries children;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash, pool_allocator<std::pair<const txiter, TxLinks>>> txlinksMap;
     txlinksMap mapLinks;
 
+    //! All entries with critical data, so that BMM requests can be found
+    //! without scanning mapTx
+    setCriticalEntries setCriticalData;
+
+    //! Sidechain deposit entries by sidechain number
+    std::map<uint8_t, setEntries> mapSidechainDeposits;
+
+    //! Entries with OP_RETURN outputs by the 4 bytes following the OP_RETURN,
+    //! the CoinNews header, so that news can be found without scanning mapTx
+    std::map<uint32_t, setEntries> mapNewsHeaders;
+    void UpdateNewsHeaders(txiter it, bool add);
+
+    //! Fee histogram, updated by addUnchecked and removeUnchecked
+    std::vector<MempoolFeeHistogramBucket> vFeeHistogram;
+    void UpdateFeeHistogram(const CTxMemPoolEntry& entry, bool add);
+
+    /** Upper bound of the memory freed by removing an entry, for TrimToSize */
+    size_t GetEntryUsageBound(txiter it) const;
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
     std::vector<indexed_transaction_set::const_iterator> GetSortedTimeThenScore() const;
 
+    /**
+     * Graph traversals mark the entries they reach with the current epoch
+     * instead of collecting them in a temporary setEntries. An EpochGuard
+     * starts a new epoch for the duration of one traversal, after which
+     * visited() tells whether an entry was already reached. Traversals can't
+     * be nested. cs must be held.
+     */
+    mutable uint64_t nEpoch = 0;
+    mutable bool fHasEpochGuard = false;
+
+    class EpochGuard
+    {
+    public:
+        explicit EpochGuard(const CTxMemPool& poolIn);
+        ~EpochGuard();
+
+    private:
+        const CTxMemPool& pool;
+    };
+
+    /** Mark an entry visited in the current epoch, returns whether it already was */
+    bool visited(txiter it) const
+    {
+        assert(fHasEpochGuard);
+        const bool fVisited = it->nEpochMarker == nEpoch;
+        it->nEpochMarker = nEpoch;
+        return fVisited;
+    }
+
 public:
-    indirectmap<COutPoint, const CTransaction*> mapNextTx;
+    indirectmap<COutPoint, const CTransaction*, pool_allocator<std::pair<const COutPoint* const, const CTransaction*>>> mapNextTx;
     std::map<uint256, CAmount> mapDeltas;
 
     std::map<uint8_t, SidechainCTIP> mapLastSidechainDeposit;
@@ -588,6 +722,9 @@ public:
     void clear();
     void _clear(); //lock free
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
+    /** The position of each of vHash in the order of CompareDepthAndScore,
+     * looked up under one lock. Transactions not in the mempool come last. */
+    std::vector<uint64_t> GetDepthAndScoreRanks(const std::vector<uint256>& vHash) const;
     void queryHashes(std::vector<uint256>& vtxid);
     bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
@@ -642,6 +779,11 @@ public:
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries &setDescendants);
 
+    /** Set vDescendants to it and all its in-mempool descendants, each once.
+     *  Cheaper than CalculateDescendants when no set is needed. cs must be
+     *  held. */
+    void CalculateDescendants(txiter it, std::vector<txiter> &vDescendants) const;
+
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
       *  The incrementalRelayFee policy variable is used to bound the time it
@@ -674,6 +816,11 @@ public:
         return totalTxSize;
     }
 
+    /** Number of transactions and their total virtual size without locking
+     *  cs, a concurrent add or remove may or may not be included */
+    uint64_t GetCountRelaxed() const { return nCountRelaxed.load(std::memory_order_relaxed); }
+    uint64_t GetTotalTxSizeRelaxed() const { return nTotalTxSizeRelaxed.load(std::memory_order_relaxed); }
+
     bool exists(uint256 hash) const
     {
         LOCK(cs);
@@ -686,6 +833,16 @@ public:
 
     std::vector<TxMempoolInfo> InfoRecent(int nTx) const;
 
+    /** The mempool transactions bucketed by fee rate, lowest rate first.
+     *  Buckets are kept up to date as transactions come and go, so this
+     *  doesn't iterate the mempool. */
+    std::vector<MempoolFeeHistogramBucket> GetFeeHistogram() const;
+
+    /** The OP_RETURN outputs of mempool transactions that start with
+     *  OP_RETURN and header, at least 4 bytes. Only the transactions indexed
+     *  under the first 4 bytes of the header are looked at. */
+    void GetNews(const CScript& header, std::vector<MempoolNews>& vNews) const;
+
     size_t DynamicMemoryUsage() const;
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
@@ -0,0 +1,179 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txprevalidate.h>
+
+#include <consensus/tx_verify.h>
+#include <consensus/validation.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <util.h>
+#include <validation.h>
+
+std::unique_ptr<CTxPrevalidator> g_txprevalidator;
+
+CTxPrevalidator::CTxPrevalidator(int nThreadsIn, size_t nMaxTxsIn, std::function<void()> fnNotifyIn)
+    : nThreads(nThreadsIn), nMaxTxs(nMaxTxsIn), fnNotify(std::move(fnNotifyIn)), fInterrupt(false), nTxs(0)
+{
+}
+
+CTxPrevalidator::~CTxPrevalidator()
+{
+    Interrupt();
+    Stop();
+}
+
+void CTxPrevalidator::Start()
+{
+    for (int i = 0; i < nThreads; i++) {
+        vThread.emplace_back(&TraceThread<std::function<void()>>, "txprevalidate",
+                std::bind(&CTxPrevalidator::ThreadPrevalidate, this));
+    }
+}
+
+void CTxPrevalidator::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fInterrupt = true;
+    }
+    condQueue.notify_all();
+}
+
+void CTxPrevalidator::Stop()
+{
+    for (std::thread& t : vThread) {
+        if (t.joinable())
+            t.join();
+    }
+    vThread.clear();
+}
+
+bool CTxPrevalidator::Submit(NodeId node, const CTransactionRef& tx, std::vector<CTxOut>&& vSpent, unsigned int flags)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+
+        auto it = mapPeerTxs.find(node);
+        const bool fPending = it != mapPeerTxs.end() && !it->second.empty();
+        if (vSpent.empty() && !fPending)
+            return false;
+        if (nTxs >= nMaxTxs) {
+            if (!fPending)
+                return false;
+            // Don't let the transaction overtake the peer's pending ones,
+            // queue it without checking it. Callers stop reading from a
+            // peer while MustWait, so this goes over the limit by little.
+            vSpent.clear();
+        }
+
+        std::shared_ptr<PrevalidateJob> job = std::make_shared<PrevalidateJob>();
+        job->tx = tx;
+        job->vSpent = std::move(vSpent);
+        job->flags = flags;
+        job->fDone = job->vSpent.empty();
+        job->fCancelled = false;
+
+        mapPeerTxs[node].push_back(job);
+        nTxs++;
+        if (job->fDone)
+            return true;
+        queue.push_back(std::move(job));
+    }
+    condQueue.notify_one();
+    return true;
+}
+
+bool CTxPrevalidator::MustWait(NodeId node)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nTxs >= nMaxTxs && mapPeerTxs.count(node);
+}
+
+bool CTxPrevalidator::Take(NodeId node, CTransactionRef& tx, std::vector<uint256>& vSigCacheEntry)
+{
+    std::lock_guard<std::mutex> lock(cs);
+
+    auto it = mapPeerTxs.find(node);
+    if (it == mapPeerTxs.end() || !it->second.front()->fDone)
+        return false;
+
+    tx = std::move(it->second.front()->tx);
+    vSigCacheEntry = std::move(it->second.front()->vSigCacheEntry);
+    it->second.pop_front();
+    if (it->second.empty())
+        mapPeerTxs.erase(it);
+    nTxs--;
+    return true;
+}
+
+void CTxPrevalidator::RemovePeer(NodeId node)
+{
+    std::lock_guard<std::mutex> lock(cs);
+
+    auto it = mapPeerTxs.find(node);
+    if (it == mapPeerTxs.end())
+        return;
+
+    // Queued jobs are skipped by the threads, the ones being checked are
+    // dropped when they're done
+    for (const std::shared_ptr<PrevalidateJob>& job : it->second)
+        job->fCancelled = true;
+    nTxs -= it->second.size();
+    mapPeerTxs.erase(it);
+}
+
+size_t CTxPrevalidator::Size()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return nTxs;
+}
+
+void CTxPrevalidator::ThreadPrevalidate()
+{
+    while (true) {
+        std::shared_ptr<PrevalidateJob> job;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (!fInterrupt && queue.empty())
+                condQueue.wait(lock);
+            if (fInterrupt)
+                return;
+
+            job = std::move(queue.front());
+            queue.pop_front();
+            if (job->fCancelled)
+                continue;
+        }
+
+        // Nothing but the job is touched until it's marked done, so no lock
+        // is needed. The result is only the signature cache entries, which
+        // are of no use if any input is invalid.
+        const CTransaction& tx = *job->tx;
+        CValidationState state;
+        std::vector<uint256> vSigCacheEntry;
+        if (job->vSpent.size() == tx.vin.size() && CheckTransaction(tx, state)) {
+            PrecomputedTransactionData txdata(tx);
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                const CTxOut& out = job->vSpent[i];
+                CachingTransactionSignatureChecker checker(&tx, i, out.nValue, false /* store */, txdata, &vSigCacheEntry);
+                if (!VerifyScript(tx.vin[i].scriptSig, out.scriptPubKey, &tx.vin[i].scriptWitness, job->flags, checker)) {
+                    vSigCacheEntry.clear();
+                    break;
+                }
+            }
+        }
+
+        bool fNotify = false;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            job->fDone = true;
+            job->vSpent.clear();
+            job->vSigCacheEntry = std::move(vSigCacheEntry);
+            fNotify = !job->fCancelled;
+        }
+        if (fNotify && fnNotify)
+            fnNotify();
+    }
+}
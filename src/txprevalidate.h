@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXPREVALIDATE_H
+#define BITCOIN_TXPREVALIDATE_H
+
+#include <net.h>
+#include <primitives/transaction.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Default for -prevalidatetxthreads, 0 to check transactions from peers on the message handler thread */
+static const int DEFAULT_PREVALIDATE_THREADS = 0;
+/** Maximum number of transaction pre-validation threads */
+static const int MAX_PREVALIDATE_THREADS = 16;
+/** Maximum number of transactions waiting to be pre-validated or accepted */
+static const size_t MAX_PREVALIDATE_TXS = 1000;
+
+/**
+ * Verifies the scripts of transactions received from peers on background
+ * threads, before they go through AcceptToMemoryPool.
+ *
+ * The message handler takes a snapshot of the outputs a transaction spends
+ * (a few coins lookups under cs_main) and submits it, unless it fails the
+ * policy checks AcceptToMemoryPool runs before the scripts. A pre-validation
+ * thread runs CheckTransaction and the script checks against the snapshot
+ * without holding any lock, collecting the signature cache entries of the
+ * valid signatures. Once a transaction is done, the message handler takes it
+ * back with its entries, adds them to the signature cache and runs
+ * AcceptToMemoryPool on it as before. That re-checks the inputs against the
+ * current chainstate and mempool, but finds its signatures in the cache, so
+ * cs_main is only held for the cheap part of the checks. The entries are
+ * removed again if the transaction isn't accepted.
+ *
+ * Pre-validation has no say in whether a transaction is accepted: a
+ * transaction that fails it is handed back all the same, so that
+ * AcceptToMemoryPool rejects it and punishes the peer as usual.
+ *
+ * Transactions are handed back in the order a peer sent them. Those that
+ * can't be pre-validated (missing inputs, already known, queue full) are
+ * queued behind the peer's pending ones rather than accepted ahead of them.
+ */
+class CTxPrevalidator
+{
+public:
+    /** fnNotify is called from a pre-validation thread when a transaction is
+     * ready to be taken */
+    CTxPrevalidator(int nThreadsIn, size_t nMaxTxsIn, std::function<void()> fnNotifyIn);
+    ~CTxPrevalidator();
+
+    /** Start the pre-validation threads */
+    void Start();
+
+    /** Tell the pre-validation threads to stop after their current transaction */
+    void Interrupt();
+
+    /** Wait for the pre-validation threads to exit */
+    void Stop();
+
+    /** Queue a transaction received from a peer, vSpent being the outputs
+     * spent by its inputs or empty if they couldn't all be found. Returns
+     * false if the caller should accept it right away instead: if there is
+     * nothing to check and no earlier transaction of the peer to wait for,
+     * or if the queue is full and the peer has nothing pending. */
+    bool Submit(NodeId node, const CTransactionRef& tx, std::vector<CTxOut>&& vSpent, unsigned int flags);
+
+    /** Whether the queue is full and the peer has transactions pending, so
+     * that the caller should wait for them before reading its next one */
+    bool MustWait(NodeId node);
+
+    /** Take the peer's oldest transaction if it has been pre-validated, with
+     * the signature cache entries of its valid signatures */
+    bool Take(NodeId node, CTransactionRef& tx, std::vector<uint256>& vSigCacheEntry);
+
+    /** Drop the transactions of a peer that has disconnected */
+    void RemovePeer(NodeId node);
+
+    /** Number of transactions waiting to be pre-validated or taken */
+    size_t Size();
+
+private:
+    struct PrevalidateJob {
+        CTransactionRef tx;
+        std::vector<CTxOut> vSpent;
+        unsigned int flags;
+        std::vector<uint256> vSigCacheEntry;
+        bool fDone;
+        // Set when the peer disconnected while a thread was checking it
+        bool fCancelled;
+    };
+
+    void ThreadPrevalidate();
+
+    const int nThreads;
+    const size_t nMaxTxs;
+    const std::function<void()> fnNotify;
+
+    std::mutex cs;
+    std::condition_variable condQueue;
+    bool fInterrupt;
+
+    // Transactions of each peer in the order they were received
+    std::map<NodeId, std::deque<std::shared_ptr<PrevalidateJob>>> mapPeerTxs;
+    // Transactions waiting for a pre-validation thread
+    std::deque<std::shared_ptr<PrevalidateJob>> queue;
+    size_t nTxs;
+
+    std::vector<std::thread> vThread;
+};
+
+/** Pre-validates transactions from peers, if enabled */
+extern std::unique_ptr<CTxPrevalidator> g_txprevalidator;
+
+#endif // BITCOIN_TXPREVALIDATE_H
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <map>
@@ -143,6 +144,15 @@ public:
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
 
+    /**
+     * Append the JSON text to s, calling flush after each array element and
+     * object member so that the caller can send what has been written so far
+     * and clear s, instead of holding the whole text at once.
+     */
+    void write(std::string& s, const std::function<void(std::string&)>& flush,
+               unsigned int prettyIndent = 0,
+               unsigned int indentLevel = 0) const;
+
     bool read(const char *raw, size_t len);
     bool read(const char *raw) { return read(raw, strlen(raw)); }
     bool read(const std::string& rawStr) {
@@ -156,8 +166,9 @@ private:
     std::vector<UniValue> values;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
-    void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
-    void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
+    void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, const std::function<void(std::string&)>* flush) const;
+    void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, const std::function<void(std::string&)>* flush) const;
+    void writeValue(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, const std::function<void(std::string&)>* flush) const;
 
 public:
     // Strict type-specific getters, these throw std::runtime_error if the
@@ -45,6 +45,13 @@ public:
                 push_back_u(codepoint);
         }
     }
+    // Write a run of 7-bit ASCII chars, same as push_back of each of them
+    void append_ascii(const char *begin, const char *end)
+    {
+        if (state) // Not a continuation, invalid
+            is_valid = false;
+        str.append(begin, end);
+    }
     // Write codepoint directly, possibly collating surrogate pairs
     void push_back_u(unsigned int codepoint_)
     {
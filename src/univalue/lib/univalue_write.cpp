@@ -34,6 +34,20 @@ string UniValue::write(unsigned int prettyIndent,
     string s;
     s.reserve(1024);
 
+    writeValue(prettyIndent, indentLevel, s, NULL);
+
+    return s;
+}
+
+void UniValue::write(string& s, const std::function<void(string&)>& flush,
+                     unsigned int prettyIndent,
+                     unsigned int indentLevel) const
+{
+    writeValue(prettyIndent, indentLevel, s, &flush);
+}
+
+void UniValue::writeValue(unsigned int prettyIndent, unsigned int indentLevel, string& s, const std::function<void(string&)>* flush) const
+{
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
@@ -43,10 +57,10 @@ string UniValue::write(unsigned int prettyIndent,
         s += "null";
         break;
     case VOBJ:
-        writeObject(prettyIndent, modIndent, s);
+        writeObject(prettyIndent, modIndent, s, flush);
         break;
     case VARR:
-        writeArray(prettyIndent, modIndent, s);
+        writeArray(prettyIndent, modIndent, s, flush);
         break;
     case VSTR:
         s += "\"" + json_escape(val) + "\"";
@@ -58,8 +72,6 @@ string UniValue::write(unsigned int prettyIndent,
         s += (val == "1" ? "true" : "false");
         break;
     }
-
-    return s;
 }
 
 static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, string& s)
@@ -67,7 +79,7 @@ static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, strin
     s.append(prettyIndent * indentLevel, ' ');
 }
 
-void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
+void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, string& s, const std::function<void(string&)>* flush) const
 {
     s += "[";
     if (prettyIndent)
@@ -76,12 +88,14 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+        values[i].writeValue(prettyIndent, indentLevel + 1, s, flush);
         if (i != (values.size() - 1)) {
             s += ",";
         }
         if (prettyIndent)
             s += "\n";
+        if (flush)
+            (*flush)(s);
     }
 
     if (prettyIndent)
@@ -89,7 +103,7 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     s += "]";
 }
 
-void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, string& s) const
+void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, string& s, const std::function<void(string&)>* flush) const
 {
     s += "{";
     if (prettyIndent)
@@ -101,15 +115,16 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
         s += "\"" + json_escape(keys[i]) + "\":";
         if (prettyIndent)
             s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+        values.at(i).writeValue(prettyIndent, indentLevel + 1, s, flush);
         if (i != (values.size() - 1))
             s += ",";
         if (prettyIndent)
             s += "\n";
+        if (flush)
+            (*flush)(s);
     }
 
     if (prettyIndent)
         indentStr(prettyIndent, indentLevel - 1, s);
     s += "}";
 }
-
@@ -365,6 +365,27 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
 
     BOOST_CHECK_EQUAL(strJson1, v.write());
 
+    // Streamed in pieces, the text is the same
+    std::string strStream;
+    std::string strPiece;
+    unsigned int nFlush = 0;
+    v.write(strPiece, [&strStream, &nFlush](std::string& s) {
+        strStream += s;
+        s.clear();
+        nFlush++;
+    });
+    strStream += strPiece;
+    BOOST_CHECK_EQUAL(strJson1, strStream);
+    BOOST_CHECK_EQUAL(nFlush, 6);
+    strStream.clear();
+    strPiece.clear();
+    v.write(strPiece, [&strStream](std::string& s) {
+        strStream += s;
+        s.clear();
+    }, 4);
+    strStream += strPiece;
+    BOOST_CHECK_EQUAL(v.write(4), strStream);
+
     /* Check for (correctly reporting) a parsing error if the initial
        JSON construct is followed by more stuff.  Note that whitespace
        is, of course, exempt.  */
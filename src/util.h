@@ -103,6 +103,7 @@ namespace BCLog {
         COINDB      = (1 << 18),
         QT          = (1 << 19),
         LEVELDB     = (1 << 20),
+        STRATUM     = (1 << 21),
         ALL         = ~(uint32_t)0,
     };
 }
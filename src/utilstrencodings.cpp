@@ -12,6 +12,10 @@
 #include <errno.h>
 #include <limits>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static const std::string CHARS_ALPHA_NUM = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
 
 static const std::string SAFE_CHARS[] =
@@ -78,30 +82,103 @@ bool IsHexNumber(const std::string& str)
     return (str.size() > starting_location);
 }
 
-std::vector<unsigned char> ParseHex(const char* psz)
+#if defined(__SSE2__)
+/** Decode 16 hex digits at psz to 8 bytes, return false if any of them isn't
+ * a hex digit */
+static inline bool HexDecode16(const char* psz, unsigned char* pch)
+{
+    const __m128i v = _mm_loadu_si128((const __m128i*)psz);
+    // Non-ASCII chars are negative and fail both range checks
+    const __m128i fDigit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                         _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    const __m128i fAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                         _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(fDigit, fAlpha)) != 0xffff)
+        return false;
+
+    const __m128i nibbles = _mm_or_si128(
+            _mm_and_si128(fDigit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+            _mm_and_si128(fAlpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    // Each 16 bit lane holds a digit pair, the high nibble in its low byte
+    const __m128i bytes = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4),
+            _mm_srli_epi16(nibbles, 8));
+    _mm_storel_epi64((__m128i*)pch, _mm_packus_epi16(bytes, bytes));
+    return true;
+}
+#endif
+
+static std::vector<unsigned char> ParseHex(const char* psz, const char* pend)
 {
-    // convert hex dump to vector
-    std::vector<unsigned char> vch;
+    // convert hex dump to vector, sized for the longest possible result
+    std::vector<unsigned char> vch((pend - psz) / 2);
+    unsigned char* pch = vch.data();
     while (true)
     {
-        while (isspace(*psz))
+#if defined(__SSE2__)
+        while (pend - psz >= 16 && HexDecode16(psz, pch)) {
+            psz += 16;
+            pch += 8;
+        }
+#endif
+        while (psz < pend && isspace(*psz))
             psz++;
-        signed char c = HexDigit(*psz++);
+        if (pend - psz < 2)
+            break;
+        signed char c = HexDigit(psz[0]);
         if (c == (signed char)-1)
             break;
         unsigned char n = (c << 4);
-        c = HexDigit(*psz++);
+        c = HexDigit(psz[1]);
         if (c == (signed char)-1)
             break;
         n |= c;
-        vch.push_back(n);
+        *pch++ = n;
+        psz += 2;
     }
+    vch.resize(pch - vch.data());
     return vch;
 }
 
+std::vector<unsigned char> ParseHex(const char* psz)
+{
+    return ParseHex(psz, psz + strlen(psz));
+}
+
 std::vector<unsigned char> ParseHex(const std::string& str)
 {
-    return ParseHex(str.c_str());
+    // Like the C string version, stop at a NUL
+    return ParseHex(str.c_str(), str.c_str() + strlen(str.c_str()));
+}
+
+void HexEncode(const unsigned char* pch, size_t len, char* psz)
+{
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i digit = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(pch + i));
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        const __m128i lo = _mm_and_si128(v, mask);
+        // Interleave the nibbles, high one first, and turn them into digits
+        __m128i a = _mm_unpacklo_epi8(hi, lo);
+        __m128i b = _mm_unpackhi_epi8(hi, lo);
+        a = _mm_add_epi8(_mm_add_epi8(a, digit), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+        b = _mm_add_epi8(_mm_add_epi8(b, digit), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+        _mm_storeu_si128((__m128i*)(psz + 2 * i), a);
+        _mm_storeu_si128((__m128i*)(psz + 2 * i + 16), b);
+    }
+#endif
+    for (; i < len; i++) {
+        psz[2 * i] = hexmap[pch[i] >> 4];
+        psz[2 * i + 1] = hexmap[pch[i] & 15];
+    }
 }
 
 void SplitHostPort(std::string in, int &portOut, std::string &hostOut) {
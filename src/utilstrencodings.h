@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #define BEGIN(a)            ((char*)&(a))
@@ -96,17 +97,52 @@ bool ParseUInt64(const std::string& str, uint64_t *out);
  */
 bool ParseDouble(const std::string& str, double *out);
 
+/**
+ * Write the hex digits of len bytes at pch to psz, which must have room for
+ * 2 * len chars. Uses SSE2 where available.
+ */
+void HexEncode(const unsigned char* pch, size_t len, char* psz);
+
+template<typename T>
+void HexEncodeRange(const T itbegin, const T itend, char* psz, std::true_type)
+{
+    HexEncode((const unsigned char*)itbegin, itend - itbegin, psz);
+}
+
+template<typename T>
+void HexEncodeRange(const T itbegin, const T itend, char* psz, std::false_type)
+{
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    for (T it = itbegin; it < itend; ++it) {
+        unsigned char val = (unsigned char)(*it);
+        *psz++ = hexmap[val >> 4];
+        *psz++ = hexmap[val & 15];
+    }
+}
+
 template<typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
 {
     std::string rv;
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    if (!fSpaces) {
+        if (itbegin < itend) {
+            // Byte pointers take the vectorized path
+            typedef std::integral_constant<bool, std::is_pointer<T>::value &&
+                sizeof(typename std::remove_pointer<T>::type) == 1> fContiguous;
+            rv.resize((itend - itbegin) * 2);
+            HexEncodeRange(itbegin, itend, &rv[0], fContiguous());
+        }
+        return rv;
+    }
+
     rv.reserve((itend-itbegin)*3);
     for(T it = itbegin; it < itend; ++it)
     {
         unsigned char val = (unsigned char)(*it);
-        if(fSpaces && it != itbegin)
+        if(it != itbegin)
             rv.push_back(' ');
         rv.push_back(hexmap[val>>4]);
         rv.push_back(hexmap[val&15]);
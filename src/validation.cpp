@@ -3,10 +3,17 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/skydoge-config.h>
+#endif
+
 #include <validation.h>
 
 #include <addressbook.h>
 #include <arith_uint256.h>
+#include <blockcache.h>
+#include <blockfilemap.h>
+#include <blockprefetch.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -19,6 +26,7 @@
 #include <hash.h>
 #include <init.h>
 #include <merkleblock.h>
+#include <metrics.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -27,6 +35,7 @@
 #include <primitives/transaction.h>
 #include <random.h>
 #include <reverse_iterator.h>
+#include <scdblog.h>
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <script/standard.h>
@@ -34,8 +43,11 @@
 #include <sidechaindb.h>
 #include <timedata.h>
 #include <tinyformat.h>
+#include <trace.h>
 #include <txdb.h>
+#include <txindex.h>
 #include <txmempool.h>
+#include <txprevalidate.h>
 #include <ui_interface.h>
 #include <undo.h>
 #include <util.h>
@@ -45,7 +57,11 @@
 #include <versionbits.h>
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <system_error>
+#include <thread>
 #include <sstream>
 #include <tuple>
 
@@ -54,6 +70,10 @@
 #include <boost/thread.hpp>
 #include <boost/bind/placeholders.hpp>
 
+#if USE_ZLIB
+#include <zlib.h>
+#endif
+
 using namespace boost::placeholders;
 
 #if defined(NDEBUG)
@@ -156,7 +176,13 @@ private:
 public:
     CChain chainActive;
     BlockMap mapBlockIndex;
+    //! Storage of the entries of mapBlockIndex
+    CBlockIndexArena blockIndexArena;
     std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
+    //! Entries of mapBlockIndex without children, kept up to date by
+    //! AddToBlockIndex so that the chain tips are found without walking
+    //! mapBlockIndex
+    std::set<CBlockIndex*> setBlockIndexTips;
     CBlockIndex *pindexBestInvalid = nullptr;
 
     bool LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree);
@@ -183,6 +209,10 @@ public:
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
 
+    /** Make pindex, whose coins have just been loaded from a UTXO snapshot,
+     * the tip of an empty chain */
+    void LoadUTXOSnapshotBase(CBlockIndex* pindex, unsigned int nChainTx);
+
     void PruneBlockIndexCandidates();
 
     void UnloadBlockIndex();
@@ -203,6 +233,13 @@ private:
 
 
     bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params);
+
+    /** Resync SCDB to pindexFork after a reorg disconnected nBlocks blocks
+     * down to it, see SidechainDB::BeginReorg */
+    bool FinishSCDBReorg(const CBlockIndex* pindexFork, unsigned int nBlocks);
+
+    //! Whether DisconnectBlock leaves the SCDB resync to FinishSCDBReorg
+    bool fSCDBReorg = false;
 } g_chainstate;
 
 
@@ -210,6 +247,7 @@ private:
 CCriticalSection cs_main;
 
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
+const std::set<CBlockIndex*>& setBlockIndexTips = g_chainstate.setBlockIndexTips;
 CChain& chainActive = g_chainstate.chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
@@ -217,7 +255,7 @@ CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
-bool fTxIndex = false;
+bool fBMMIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -226,7 +264,10 @@ bool fCMPCTWit = false;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int nUndoCompressLevel = DEFAULT_UNDO_COMPRESS_LEVEL;
+int nBlockCompressLevel = DEFAULT_BLOCK_COMPRESS_LEVEL;
 uint64_t nPruneTarget = 0;
+int nSidechainDBRetention = DEFAULT_SIDECHAIN_DB_RETENTION;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
 
@@ -271,6 +312,10 @@ namespace {
 
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
+
+    /** The block a UTXO snapshot was loaded at, if any. We don't have the
+     * blocks up to it, much like a pruned node. */
+    CBlockIndex* pindexUTXOSnapshot = nullptr;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -292,6 +337,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
+std::unique_ptr<CCoinsViewBackgroundFlush> pcoinsflush;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 std::unique_ptr<CSidechainTreeDB> psidechaintree;
@@ -562,43 +608,42 @@ bool GetDrivechainAmounts(const CCoinsView& coins, const CTransaction &tx,
         CAmount& amountSidechainOut, CAmount& amountWithdrawn,
         std::string& strFail)
 {
-    // Collect coins from inputs
-    std::vector<Coin> vCoin;
+    // Count value of inputs and make sure there is only 1 CTIP input. Every
+    // coin is looked up before failing on multiple CTIP inputs, so that a
+    // missing coin is reported first.
+    bool fSidechainInputFound = false;
+    bool fMultipleSidechainInputs = false;
+    uint8_t nSidechainIn;
+    Coin coin;
     for (const CTxIn& in : tx.vin) {
-        Coin coin;
-
         if (!coins.GetCoin(in.prevout, coin)) {
             strFail = "Coin missing!\n";
             return false;
         }
 
-        vCoin.push_back(coin);
-    }
-
-    // Count value of inputs and make sure there is only 1 CTIP input
-    bool fSidechainInputFound = false;
-    uint8_t nSidechainIn;
-    for (const Coin& c : vCoin) {
-        const CTxOut& out = c.out;
-        const CScript& scriptPubKey = out.scriptPubKey;
-        if (scriptPubKey.IsDrivechain(nSidechainIn)) {
-            if (fSidechainInputFound) {
-                strFail = "Multiple sidechain inputs!";
-                return false;
-            } else {
-                fSidechainInputFound = true;
-            }
+        const CTxOut& out = coin.out;
+        uint8_t nSidechainCoin;
+        if (out.scriptPubKey.IsDrivechain(nSidechainCoin)) {
+            if (fSidechainInputFound)
+                fMultipleSidechainInputs = true;
+            else
+                nSidechainIn = nSidechainCoin;
+            fSidechainInputFound = true;
             amountSidechainIn += out.nValue;
         } else {
             amountIn += out.nValue;
         }
     }
+    if (fMultipleSidechainInputs) {
+        strFail = "Multiple sidechain inputs!";
+        return false;
+    }
 
     // Count value of outputs
     bool fSidechainOutputFound = false;
     uint8_t nSidechainOut;
     for (const CTxOut& out : tx.vout) {
-        const CScript scriptPubKey = out.scriptPubKey;
+        const CScript& scriptPubKey = out.scriptPubKey;
         uint8_t nSidechainOutScript;
         if (scriptPubKey.IsDrivechain(nSidechainOutScript)) {
             if (fSidechainInputFound && nSidechainOutScript != nSidechainIn) {
@@ -622,6 +667,15 @@ bool GetDrivechainAmounts(const CCoinsView& coins, const CTransaction &tx,
     return true;
 }
 
+unsigned int GetMempoolScriptVerifyFlags(const CChainParams& chainparams)
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!chainparams.RequireStandard()) {
+        scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                               bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
@@ -1113,10 +1167,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!chainparams.RequireStandard()) {
-            scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        const unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags(chainparams);
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
@@ -1216,8 +1267,11 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
     std::vector<COutPoint> coins_to_uncache;
     bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache);
     if (!res) {
+        TRACE3(mempool, rejected, tx->GetHash().begin(), state.GetRejectCode(), state.GetRejectReason().c_str());
         for (const COutPoint& hashTx : coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
+    } else {
+        TRACE2(mempool, accepted, tx->GetHash().begin(), GetVirtualTransactionSize(*tx));
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
     CValidationState stateDummy;
@@ -1250,28 +1304,20 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return true;
         }
 
-        if (fTxIndex) {
+        if (g_txindex) {
             CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
+            if (g_txindex->FindTx(hash, postx)) {
+                if (!ReadTxFromDisk(postx, txOut, hashBlock))
+                    return false;
                 if (txOut->GetHash() != hash)
                     return error("%s: txid mismatch", __func__);
                 return true;
             }
 
             // transaction not found in index, nothing more can be done
-            return false;
+            // unless the index is still catching up
+            if (g_txindex->IsSynced())
+                return false;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -1306,6 +1352,84 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
+/**
+ * Deflate the data of a block or undo record with zlib level nLevel, after
+ * its size. Returns false if it doesn't get smaller.
+ */
+static bool CompressRecord(const char* pData, size_t nData, int nLevel, std::vector<unsigned char>& vOut)
+{
+#if USE_ZLIB
+    uLongf nCompressed = compressBound(nData);
+    vOut.resize(4 + nCompressed);
+    WriteLE32(vOut.data(), nData);
+    if (compress2(vOut.data() + 4, &nCompressed, (const Bytef*)pData, nData, nLevel) == Z_OK && 4 + nCompressed < nData) {
+        vOut.resize(4 + nCompressed);
+        return true;
+    }
+#endif
+    vOut.clear();
+    return false;
+}
+
+bool UncompressRecord(const unsigned char* pData, size_t nData, CDataStream& ssOut)
+{
+#if USE_ZLIB
+    if (nData < 4)
+        return error("%s: Bad size %u", __func__, nData);
+    uLongf nOut = ReadLE32(pData);
+    if (nOut > MAX_SIZE)
+        return error("%s: Bad uncompressed size %u", __func__, nOut);
+    ssOut.resize(nOut);
+    if (uncompress((Bytef*)ssOut.data(), &nOut, pData + 4, nData - 4) != Z_OK || nOut != ssOut.size())
+        return error("%s: Inflate failed", __func__);
+    return true;
+#else
+    return error("%s: Compressed block and undo data needs zlib", __func__);
+#endif
+}
+
+/** Read the data of a compressed record, filein is positioned after its size */
+static bool ReadCompressedRecord(CAutoFile& filein, unsigned int nSize, CDataStream& ssOut)
+{
+    if (nSize > MAX_SIZE)
+        return error("%s: Bad size %u", __func__, nSize);
+    std::vector<unsigned char> vCompressed(nSize);
+    filein.read((char*)vCompressed.data(), vCompressed.size());
+    return UncompressRecord(vCompressed.data(), vCompressed.size(), ssOut);
+}
+
+bool ReadTxFromDisk(const CDiskTxPos& postx, CTransactionRef& txOut, uint256& hashBlock)
+{
+    if (postx.nPos < sizeof(unsigned int))
+        return error("%s: Bad position %s", __func__, postx.ToString());
+
+    // Open history file to read, from the size in the index header
+    CAutoFile file(OpenBlockFile(CDiskBlockPos(postx.nFile, postx.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        unsigned int nSize;
+        file >> nSize;
+        if (nSize & RECORD_COMPRESSED_FLAG) {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            if (!ReadCompressedRecord(file, nSize & ~RECORD_COMPRESSED_FLAG, ssBlock))
+                return error("%s: Bad compressed block at %s", __func__, postx.ToString());
+            ssBlock >> header;
+            ssBlock.ignore(postx.nTxOffset);
+            ssBlock >> txOut;
+        } else {
+            file >> header;
+            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+            file >> txOut;
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
 static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
@@ -1327,23 +1451,106 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+/** Write a block deflated by CompressRecord */
+static bool WriteCompressedBlockToDisk(const std::vector<unsigned char>& vCompressed, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    block.SetNull();
+    // Open history file to append
+    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    // Write index header
+    unsigned int nSize = vCompressed.size() | RECORD_COMPRESSED_FLAG;
+    fileout << FLATDATA(messageStart) << nSize;
 
-    // Read block
-    try {
-        filein >> block;
+    // Write block
+    long fileOutPos = ftell(fileout.Get());
+    if (fileOutPos < 0)
+        return error("%s: ftell failed", __func__);
+    pos.nPos = (unsigned int)fileOutPos;
+    fileout.write((const char*)vCompressed.data(), vCompressed.size());
+
+    return true;
+}
+
+/** The map of the block file pos is in, if -blockmmap is set and the file
+ * is no longer written to */
+static std::shared_ptr<const CMappedBlockFile> GetMappedBlockFile(const CDiskBlockPos& pos)
+{
+    if (!g_blockfilemap)
+        return nullptr;
+
+    {
+        LOCK(cs_LastBlockFile);
+        if ((int)pos.nFile >= nLastBlockFile)
+            return nullptr;
     }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+
+    std::shared_ptr<const CMappedBlockFile> file = g_blockfilemap->Get(pos.nFile);
+    if (!file || pos.nPos >= file->size())
+        return nullptr;
+    return file;
+}
+
+/** Read and deserialize the block at pos without checking it */
+static bool ReadBlockDataFromDisk(CBlock& block, const CDiskBlockPos& pos)
+{
+    block.SetNull();
+    if (pos.nPos < sizeof(unsigned int))
+        return error("%s: Bad position %s", __func__, pos.ToString());
+
+    std::shared_ptr<const CMappedBlockFile> file = GetMappedBlockFile(pos);
+    if (file) {
+        // Read block from the map
+        try {
+            const unsigned int nSize = ReadLE32(file->data() + pos.nPos - sizeof(unsigned int));
+            if (nSize & RECORD_COMPRESSED_FLAG) {
+                CDataStream ssBlock(SER_DISK | SER_TX_ARENA, CLIENT_VERSION);
+                if ((nSize & ~RECORD_COMPRESSED_FLAG) > file->size() - pos.nPos)
+                    return error("%s: Block data runs past the end of the file for %s", __func__, pos.ToString());
+                if (!UncompressRecord(file->data() + pos.nPos, nSize & ~RECORD_COMPRESSED_FLAG, ssBlock))
+                    return error("%s: Bad compressed block at %s", __func__, pos.ToString());
+                ssBlock >> block;
+            } else {
+                CSpanReader reader(SER_DISK | SER_TX_ARENA, CLIENT_VERSION, file->data() + pos.nPos, file->size() - pos.nPos);
+                reader >> block;
+            }
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read, from the size in the index header
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK | SER_TX_ARENA, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        // Read block
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize & RECORD_COMPRESSED_FLAG) {
+                CDataStream ssBlock(SER_DISK | SER_TX_ARENA, CLIENT_VERSION);
+                if (!ReadCompressedRecord(filein, nSize & ~RECORD_COMPRESSED_FLAG, ssBlock))
+                    return error("%s: Bad compressed block at %s", __func__, pos.ToString());
+                ssBlock >> block;
+            } else {
+                filein >> block;
+            }
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    if (!ReadBlockDataFromDisk(block, pos))
+        return false;
+
     // Check the header
     if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
@@ -1351,22 +1558,111 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPoW)
 {
     CDiskBlockPos blockPos;
+    bool fTrusted;
+    CBlockHeader header;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
+        fTrusted = !fCheckPoW && pindex->IsValid(BLOCK_VALID_SCRIPTS);
+        if (fTrusted)
+            header = pindex->GetBlockHeader();
+    }
+
+    if (!fTrusted) {
+        if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+            return false;
+        if (block.GetHash() != pindex->GetBlockHash())
+            return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                    pindex->ToString(), pindex->GetBlockPos().ToString());
+        return true;
     }
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+    // We checked the proof of work of this block when we accepted it. If
+    // the header on disk is the one in the index, so is its hash, and
+    // skydoge_hash doesn't have to run again.
+    if (!ReadBlockDataFromDisk(block, blockPos))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
-        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
-                pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (block.nVersion != header.nVersion || block.hashPrevBlock != header.hashPrevBlock ||
+            block.hashMerkleRoot != header.hashMerkleRoot || block.nTime != header.nTime ||
+            block.nBits != header.nBits || block.nNonce != header.nNonce)
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): header doesn't match index for %s at %s",
+                pindex->ToString(), blockPos.ToString());
+    block.SetCachedHash(pindex->GetBlockHash());
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    // The magic and size are in front of the block
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+
+    std::shared_ptr<const CMappedBlockFile> file = GetMappedBlockFile(hpos);
+    CAutoFile filein(file ? nullptr : OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (!file && filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+
+        size_t nMapped = 0;
+        if (file) {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, file->data() + hpos.nPos, file->size() - hpos.nPos);
+            reader >> FLATDATA(blk_start) >> blk_size;
+            nMapped = reader.size();
+        } else {
+            filein >> FLATDATA(blk_start) >> blk_size;
+        }
+
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                    HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                    HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
+
+        const bool fCompressed = blk_size & RECORD_COMPRESSED_FLAG;
+        blk_size &= ~RECORD_COMPRESSED_FLAG;
+        if (blk_size > MAX_SIZE)
+            return error("%s: Block data is larger than maximum deserialization size for %s: %u versus %u", __func__, pos.ToString(),
+                    blk_size, MAX_SIZE);
+
+        if (!file) {
+            block.resize(blk_size);
+            filein.read((char*)block.data(), blk_size);
+        } else if (blk_size <= nMapped) {
+            block.assign(file->data() + pos.nPos, file->data() + pos.nPos + blk_size);
+        } else {
+            return error("%s: Block data runs past the end of the file for %s", __func__, pos.ToString());
+        }
+
+        // Serve compressed blocks as they are serialized
+        if (fCompressed) {
+            CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+            if (!UncompressRecord(block.data(), block.size(), ssBlock))
+                return error("%s: Bad compressed block at %s", __func__, pos.ToString());
+            block.assign(ssBlock.begin(), ssBlock.end());
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    return ReadRawBlockFromDisk(block, blockPos, message_start);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1690,7 +1986,28 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+/**
+ * Serialize undo data for UndoWriteToDisk, deflated with zlib level
+ * nUndoCompressLevel if it is set. A deflated record starts with the size
+ * of the serialized undo data.
+ */
+void SerializeUndo(const CBlockUndo& blockundo, std::vector<unsigned char>& vData, bool& fCompressed, uint256& hashChecksum, const uint256& hashBlock)
+{
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    ssUndo << blockundo;
+
+    // The checksum is of the serialized undo data, compressed or not
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write(ssUndo.data(), ssUndo.size());
+    hashChecksum = hasher.GetHash();
+
+    fCompressed = nUndoCompressLevel > 0 && CompressRecord(ssUndo.data(), ssUndo.size(), nUndoCompressLevel, vData);
+    if (!fCompressed)
+        vData.assign(ssUndo.begin(), ssUndo.end());
+}
+
+bool UndoWriteToDisk(const std::vector<unsigned char>& vData, bool fCompressed, const uint256& hashChecksum, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1698,7 +2015,7 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
         return error("%s: OpenUndoFile failed", __func__);
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
+    unsigned int nSize = vData.size() | (fCompressed ? RECORD_COMPRESSED_FLAG : 0);
     fileout << FLATDATA(messageStart) << nSize;
 
     // Write undo data
@@ -1706,29 +2023,68 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     if (fileOutPos < 0)
         return error("%s: ftell failed", __func__);
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    fileout.write((const char*)vData.data(), vData.size());
+
+    // write checksum
+    fileout << hashChecksum;
+
+    return true;
+}
+
+/** Read a deflated undo record, filein is positioned after its size */
+bool ReadCompressedUndo(CBlockUndo& blockundo, CAutoFile& filein, unsigned int nSize, const uint256& hashBlock)
+{
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    uint256 hashChecksum;
+    try {
+        if (!ReadCompressedRecord(filein, nSize, ssUndo))
+            return error("%s: Bad compressed undo data", __func__);
+        filein >> hashChecksum;
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
 
-    // calculate & write checksum
+    // Verify checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
-    hasher << blockundo;
-    fileout << hasher.GetHash();
+    hasher.write(ssUndo.data(), ssUndo.size());
+    if (hashChecksum != hasher.GetHash())
+        return error("%s: Checksum mismatch", __func__);
 
+    try {
+        ssUndo >> blockundo;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s", __func__, e.what());
+    }
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, from the size in the index header
+    CAutoFile filein(OpenUndoFile(CDiskBlockPos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
+    unsigned int nSize;
+    try {
+        filein >> nSize;
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    if (nSize & RECORD_COMPRESSED_FLAG)
+        return ReadCompressedUndo(blockundo, filein, nSize & ~RECORD_COMPRESSED_FLAG, pindex->pprev->GetBlockHash());
+
     // Read block
     uint256 hashChecksum;
     CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
@@ -1748,6 +2104,8 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1819,6 +2177,17 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         return DISCONNECT_FAILED;
     }
 
+    // Coins spent by the block that it didn't create are independent of the
+    // rest of the disconnect, they are restored together at the end
+    std::set<uint256> setBlockTxid;
+    size_t nBlockInputs = 0;
+    for (const auto& tx : block.vtx) {
+        setBlockTxid.insert(tx->GetHash());
+        nBlockInputs += tx->vin.size();
+    }
+    std::vector<std::pair<COutPoint, Coin>> vRestore;
+    vRestore.reserve(nBlockInputs);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1847,6 +2216,15 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
+                if (txundo.vprevout[j].nHeight != 0 && !setBlockTxid.count(out.hash)) {
+                    vRestore.emplace_back(out, std::move(txundo.vprevout[j]));
+                    continue;
+                }
+                // Old undo data without the height may take it from a coin
+                // restored before it
+                if (view.RestoreCoins(vRestore))
+                    fClean = false;
+                vRestore.clear();
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
@@ -1855,8 +2233,11 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         }
     }
 
-    // Load SCDB undo data from disk
-    if (!ResyncSCDB(pindex->pprev)) {
+    if (view.RestoreCoins(vRestore))
+        fClean = false; // overwriting transaction output
+
+    // Load SCDB undo data from disk, in a reorg only once at the fork
+    if (!fSCDBReorg && !ResyncSCDB(pindex->pprev)) {
         error("%s: Failed to re-sync SCDB for disconnected block: %s!", __func__, block.GetHash().ToString());
         return DISCONNECT_FAILED;
     }
@@ -1868,7 +2249,8 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     }
 
     // Update mempool CTIP
-    mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), true /* fDisconnect */);
+    if (!fSCDBReorg)
+        mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), true /* fDisconnect */);
 
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
@@ -1904,14 +2286,41 @@ void static FlushBlockFile(bool fFinalize = false)
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
+/** Run the script checks of a block one at a time to find the input that
+ * failed when they were run on the script check threads */
+static bool FindFailedScriptCheck(const CBlock& block, const CBlockUndo& blockundo, unsigned int flags, std::vector<PrecomputedTransactionData>& txdata, ScriptError& serror, std::string& strFailed)
+{
+    for (size_t i = 1; i < block.vtx.size() && i <= blockundo.vtxundo.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size())
+            return false;
+
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            CScriptCheck check(txundo.vprevout[j].out, tx, j, flags, false, &txdata[i]);
+            if (!check()) {
+                serror = check.GetScriptError();
+                strFailed = strprintf("input %u of %s failed script verification: %s", j, tx.GetHash().ToString(), ScriptErrorString(serror));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState& state, CBlockIndex* pindex, const CChainParams& chainparams)
 {
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
+        std::vector<unsigned char> vData;
+        bool fCompressed;
+        uint256 hashChecksum;
+        SerializeUndo(blockundo, vData, fCompressed, hashChecksum, pindex->pprev->GetBlockHash());
+
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+        if (!FindUndoPos(state, pindex->nFile, _pos, vData.size() + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (!UndoWriteToDisk(vData, fCompressed, hashChecksum, _pos, chainparams.MessageStart()))
             return AbortNode(state, "Failed to write undo data");
 
         // update nUndoPos in block index
@@ -1923,79 +2332,312 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     return true;
 }
 
-static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+void GetBMMCommits(const CBlock& block, std::vector<std::pair<uint8_t, uint256>>& vCommit)
 {
-    if (!fTxIndex) return true;
+    if (block.vtx.empty())
+        return;
 
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
-    for (const CTransactionRef& tx : block.vtx)
-    {
-        vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
-    }
+    const std::string strPrevBlock = block.hashPrevBlock.ToString().substr(56, 63);
+    std::shared_ptr<const CoinbaseCommitments> commitments = GetCoinbaseCommitments(block);
+    for (const CCriticalData& data : commitments->vCriticalData) {
+        uint8_t nSidechain;
+        std::string strPrevBytes = "";
+        if (!data.IsBMMRequest(nSidechain, strPrevBytes))
+            continue;
 
-    if (!pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
-    }
+        if (strPrevBytes != strPrevBlock)
+            continue;
 
-    return true;
+        vCommit.push_back(std::make_pair(nSidechain, data.hashCritical));
+    }
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static bool WriteBMMIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
+{
+    if (!fBMMIndex || block.vtx.empty()) return true;
 
-void ThreadScriptCheck() {
-    RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
-}
+    std::vector<std::pair<uint8_t, uint256>> vCommit;
+    GetBMMCommits(block, vCommit);
+    if (vCommit.empty()) return true;
 
-// Protected by cs_main
-VersionBitsCache versionbitscache;
+    if (!pblocktree->WriteBMMIndex(pindex->GetBlockHash(), block.vtx[0]->GetHash(), vCommit)) {
+        return AbortNode(state, "Failed to write BMM index");
+    }
 
-int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+    return true;
+}
+
+static bool WriteFeeStatsForBlock(const CBlock& block, CAmount nFees, CValidationState& state, CBlockIndex* pindex)
 {
-    LOCK(cs_main);
-    int32_t nVersion = VERSIONBITS_TOP_BITS;
+    CDiskBlockFeeStats stats;
+    stats.nFees = nFees;
+    stats.nTx = block.vtx.size();
+
+    // Continue the running totals of the previous block if it has them
+    CDiskBlockFeeStats prev;
+    if (pindex->pprev && pblocktree->ReadBlockFeeStats(pindex->pprev->GetBlockHash(), prev)) {
+        stats.nHeightStart = prev.nHeightStart;
+        stats.nFeesTotal = prev.nFeesTotal + stats.nFees;
+        stats.nTxTotal = prev.nTxTotal + stats.nTx;
+    } else {
+        stats.nHeightStart = pindex->nHeight;
+        stats.nFeesTotal = stats.nFees;
+        stats.nTxTotal = stats.nTx;
+    }
 
-    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
-        ThresholdState state = VersionBitsState(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i), versionbitscache);
-        if (state == THRESHOLD_LOCKED_IN || state == THRESHOLD_STARTED) {
-            nVersion |= VersionBitsMask(params, static_cast<Consensus::DeploymentPos>(i));
-        }
+    if (!pblocktree->WriteBlockFeeStats(pindex->GetBlockHash(), stats)) {
+        return AbortNode(state, "Failed to write block fee stats");
     }
 
-    return nVersion;
+    return true;
 }
 
-/**
- * Threshold condition checker that triggers when unknown versionbits are seen on the network.
- */
-class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
+/** Erase the SCDB data of blocks that are older than -sidechaindbretention
+ * checkpoints beyond the reorg depth we keep block files for */
+static void PruneSidechainBlockData(const CBlockIndex* pindex)
 {
-private:
-    int bit;
+    if (nSidechainDBRetention <= 0 || pindex->nHeight % SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL != 0)
+        return;
 
-public:
-    explicit WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
+    const int nPruneStart = psidechaintree->ReadPruneHeight();
+    int nPruneHeight = pindex->nHeight - (int)MIN_BLOCKS_TO_KEEP - nSidechainDBRetention * SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL;
+    nPruneHeight = std::min(nPruneHeight, nPruneStart + DB_PRUNE_MAX_BLOCKS);
+    // The oldest block kept must be a checkpoint, the blocks after it are
+    // deltas against it
+    nPruneHeight -= nPruneHeight % SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL;
+    if (nPruneHeight <= nPruneStart)
+        return;
 
-    int64_t BeginTime(const Consensus::Params& params) const override { return 0; }
-    int64_t EndTime(const Consensus::Params& params) const override { return std::numeric_limits<int64_t>::max(); }
-    int Period(const Consensus::Params& params) const override { return params.nMinerConfirmationWindow; }
-    int Threshold(const Consensus::Params& params) const override { return params.nRuleChangeActivationThreshold; }
+    std::vector<uint256> vHash;
+    for (int nHeight = nPruneStart; nHeight < nPruneHeight; nHeight++)
+        vHash.push_back(pindex->GetAncestor(nHeight)->GetBlockHash());
 
-    bool Condition(const CBlockIndex* pindex, const Consensus::Params& params) const override
-    {
-        return ((pindex->nVersion & VERSIONBITS_TOP_MASK) == VERSIONBITS_TOP_BITS) &&
-               ((pindex->nVersion >> bit) & 1) != 0 &&
-               ((ComputeBlockVersion(pindex->pprev, params) >> bit) & 1) == 0;
+    // Not fatal, we try again at the next checkpoint
+    if (!psidechaintree->PruneBlockData(vHash, nPruneHeight)) {
+        LogPrintf("%s: Failed to prune sidechain block data\n", __func__);
+        return;
     }
-};
+    LogPrint(BCLog::PRUNE, "Pruned SCDB data of %u blocks, now kept from height %d\n", vHash.size(), nPruneHeight);
+}
 
-// Protected by cs_main
-static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
-static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) {
+void ThreadScriptCheck() {
+    RenameThread("bitcoin-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+bool AcceptSidechainDepositPackage(CTxMemPool& pool, CValidationState& state, const std::vector<CTransactionRef>& vtx, const CAmount nAbsurdFee)
+{
+    if (vtx.empty() || vtx.size() > MAX_DEPOSIT_PACKAGE_COUNT)
+        return state.DoS(0, false, REJECT_INVALID, "deposit-package-bad-size");
+
+    // The package must be a chain of deposits to one sidechain, each spending
+    // the sidechain output (CTIP) of the one before it
+    std::map<uint256, const CTransaction*> mapPackageTx;
+    uint8_t nSidechainPackage = 0;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        const CTransaction& tx = *vtx[i];
+
+        uint8_t nSidechain = 0;
+        bool fBurnFound = false;
+        for (size_t n = 0; n < tx.vout.size() && !fBurnFound; n++)
+            fBurnFound = tx.vout[n].scriptPubKey.IsDrivechain(nSidechain);
+        if (!fBurnFound)
+            return state.DoS(0, false, REJECT_INVALID, "deposit-package-not-deposit");
+
+        if (i == 0) {
+            nSidechainPackage = nSidechain;
+        } else {
+            if (nSidechain != nSidechainPackage)
+                return state.DoS(0, false, REJECT_INVALID, "deposit-package-mixed-sidechains");
+
+            bool fSpendsParent = false;
+            for (const CTxIn& txin : tx.vin) {
+                if (txin.prevout.hash == vtx[i - 1]->GetHash() && txin.prevout.n < vtx[i - 1]->vout.size()
+                        && vtx[i - 1]->vout[txin.prevout.n].scriptPubKey.IsDrivechain(nSidechain))
+                    fSpendsParent = true;
+            }
+            if (!fSpendsParent)
+                return state.DoS(0, false, REJECT_INVALID, "deposit-package-not-chained");
+        }
+
+        if (!mapPackageTx.emplace(tx.GetHash(), &tx).second)
+            return state.DoS(0, false, REJECT_INVALID, "deposit-package-duplicate");
+    }
+
+    // Take the outputs the package spends, from the chainstate and mempool or
+    // from the package itself
+    std::vector<std::vector<CTxOut>> vSpent(vtx.size());
+    {
+        LOCK2(cs_main, pool.cs);
+
+        // The chain must continue from the CTIP the mempool knows of
+        SidechainCTIP ctip;
+        if (pool.GetMemPoolCTIP(nSidechainPackage, ctip) && !pool.exists(vtx[0]->GetHash())) {
+            bool fSpendsCTIP = false;
+            for (const CTxIn& txin : vtx[0]->vin) {
+                if (txin.prevout == ctip.out)
+                    fSpendsCTIP = true;
+            }
+            if (!fSpendsCTIP)
+                return state.DoS(0, false, REJECT_INVALID, "deposit-package-ctip-not-spent");
+        }
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        for (size_t i = 0; i < vtx.size(); i++) {
+            for (const CTxIn& txin : vtx[i]->vin) {
+                auto it = mapPackageTx.find(txin.prevout.hash);
+                Coin coin;
+                if (it != mapPackageTx.end() && txin.prevout.n < it->second->vout.size()) {
+                    vSpent[i].push_back(it->second->vout[txin.prevout.n]);
+                } else if (it == mapPackageTx.end() && viewMemPool.GetCoin(txin.prevout, coin)) {
+                    vSpent[i].push_back(coin.out);
+                } else {
+                    return state.Invalid(false, 0, "deposit-package-missing-inputs");
+                }
+            }
+        }
+    }
+
+    // Check the scripts of the whole package on the script check threads,
+    // without holding cs_main. The signatures go to the signature cache, where
+    // AcceptToMemoryPool finds them below.
+    const unsigned int flags = GetMempoolScriptVerifyFlags(Params());
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(vtx.size());
+    std::vector<CScriptCheck> vChecks;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        vTxData.emplace_back(*vtx[i]);
+        for (unsigned int n = 0; n < vtx[i]->vin.size(); n++)
+            vChecks.emplace_back(vSpent[i][n], *vtx[i], n, flags, true /* cacheStore */, &vTxData.back());
+    }
+
+    bool fScriptsValid = true;
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        fScriptsValid = control.Wait();
+    } else {
+        for (CScriptCheck& check : vChecks) {
+            if (!check()) {
+                fScriptsValid = false;
+                break;
+            }
+        }
+    }
+    if (!fScriptsValid)
+        return state.DoS(0, false, REJECT_INVALID, "deposit-package-script-verify-failed");
+
+    // Accept the deposits in order, all of them or none
+    LOCK(cs_main);
+    std::vector<CTransactionRef> vAccepted;
+    for (const CTransactionRef& tx : vtx) {
+        if (pool.exists(tx->GetHash()))
+            continue;
+
+        if (!AcceptToMemoryPool(pool, state, tx, nullptr /* pfMissingInputs */,
+                                nullptr /* plTxnReplaced */, false /* bypass_limits */, nAbsurdFee)) {
+            for (auto it = vAccepted.rbegin(); it != vAccepted.rend(); it++)
+                pool.removeRecursive(**it);
+            return false;
+        }
+        vAccepted.push_back(tx);
+    }
+
+    return true;
+}
+
+void ThreadCheckHeaderHashes()
+{
+    static const size_t HEADER_HASH_CHECK_BATCH = 1024;
+
+    std::vector<uint256> vHash;
+    {
+        LOCK(cs_main);
+        vHash.reserve(mapBlockIndex.size());
+        for (const BlockMap::value_type& entry : mapBlockIndex)
+            vHash.push_back(entry.first);
+    }
+
+    // Only hold cs_main to copy out a batch of headers, hash them without it
+    std::vector<CBlockHeader> vHeader;
+    std::vector<uint256> vHashHeader;
+    for (size_t nStart = 0; nStart < vHash.size(); nStart += HEADER_HASH_CHECK_BATCH) {
+        boost::this_thread::interruption_point();
+
+        const size_t nEnd = std::min(nStart + HEADER_HASH_CHECK_BATCH, vHash.size());
+        vHeader.clear();
+        {
+            LOCK(cs_main);
+            for (size_t i = nStart; i < nEnd; i++) {
+                BlockMap::const_iterator mi = mapBlockIndex.find(vHash[i]);
+                if (mi == mapBlockIndex.end())
+                    return;
+                vHeader.push_back(mi->second->GetBlockHeader());
+            }
+        }
+
+        vHashHeader.resize(vHeader.size());
+        skydoge_hash_multi(vHeader.data(), vHeader.size(), vHashHeader.data());
+        for (size_t i = 0; i < vHeader.size(); i++) {
+            if (vHashHeader[i] != vHash[nStart + i]) {
+                AbortNode(strprintf("Block index entry %s has the header of %s", vHash[nStart + i].ToString(), vHashHeader[i].ToString()),
+                        _("Corrupted block database detected. Please restart with -reindex."));
+                return;
+            }
+        }
+    }
+
+    LogPrintf("%s: Checked the hashes of %u block headers\n", __func__, vHash.size());
+}
+
+// Protected by cs_main
+VersionBitsCache versionbitscache;
+
+int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    LOCK(cs_main);
+    int32_t nVersion = VERSIONBITS_TOP_BITS;
+
+    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
+        ThresholdState state = VersionBitsState(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i), versionbitscache);
+        if (state == THRESHOLD_LOCKED_IN || state == THRESHOLD_STARTED) {
+            nVersion |= VersionBitsMask(params, static_cast<Consensus::DeploymentPos>(i));
+        }
+    }
+
+    return nVersion;
+}
+
+/**
+ * Threshold condition checker that triggers when unknown versionbits are seen on the network.
+ */
+class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
+{
+private:
+    int bit;
+
+public:
+    explicit WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
+
+    int64_t BeginTime(const Consensus::Params& params) const override { return 0; }
+    int64_t EndTime(const Consensus::Params& params) const override { return std::numeric_limits<int64_t>::max(); }
+    int Period(const Consensus::Params& params) const override { return params.nMinerConfirmationWindow; }
+    int Threshold(const Consensus::Params& params) const override { return params.nRuleChangeActivationThreshold; }
+
+    bool Condition(const CBlockIndex* pindex, const Consensus::Params& params) const override
+    {
+        return ((pindex->nVersion & VERSIONBITS_TOP_MASK) == VERSIONBITS_TOP_BITS) &&
+               ((pindex->nVersion >> bit) & 1) != 0 &&
+               ((ComputeBlockVersion(pindex->pprev, params) >> bit) & 1) == 0;
+    }
+};
+
+// Protected by cs_main
+static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
+
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) {
     AssertLockHeld(cs_main);
 
     unsigned int flags = SCRIPT_VERIFY_NONE;
@@ -2040,6 +2682,57 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
+static const char* const CONNECT_STAGE_NAMES[CONNECT_STAGE_COUNT] = {
+    "sidechain_scan", "deposits", "withdrawals", "scdb_update", "mempool_ctip", "sidechain_tree", "total"
+};
+
+struct ConnectBlockStageTimes
+{
+    std::deque<int64_t> recentMicros;
+    int64_t nTotalMicros = 0;
+    uint64_t nTotalItems = 0;
+    uint64_t nBlocks = 0;
+};
+
+static ConnectBlockStageTimes connectBlockStageTimes[CONNECT_STAGE_COUNT];
+
+/** Add the drivechain stage times of a connected block to the stats */
+static void RecordConnectBlockStages(const int64_t nStageMicros[CONNECT_STAGE_COUNT], const uint64_t nStageItems[CONNECT_STAGE_COUNT])
+{
+    AssertLockHeld(cs_main);
+
+    for (int i = 0; i < CONNECT_STAGE_COUNT; i++) {
+        ConnectBlockStageTimes& times = connectBlockStageTimes[i];
+        times.recentMicros.push_back(nStageMicros[i]);
+        if (times.recentMicros.size() > CONNECT_BLOCK_STATS_WINDOW)
+            times.recentMicros.pop_front();
+        times.nTotalMicros += nStageMicros[i];
+        times.nTotalItems += nStageItems[i];
+        times.nBlocks++;
+
+        if (i != CONNECT_STAGE_TOTAL) {
+            LogPrint(BCLog::BENCH, "    - Drivechain %s: %.2fms (%u) [%.2fs (%.2fms/blk)]\n", CONNECT_STAGE_NAMES[i],
+                    MILLI * nStageMicros[i], nStageItems[i], times.nTotalMicros * MICRO, times.nTotalMicros * MILLI / times.nBlocks);
+        }
+    }
+}
+
+std::vector<ConnectBlockStageStats> GetConnectBlockStats()
+{
+    AssertLockHeld(cs_main);
+
+    std::vector<ConnectBlockStageStats> vStats(CONNECT_STAGE_COUNT);
+    for (int i = 0; i < CONNECT_STAGE_COUNT; i++) {
+        const ConnectBlockStageTimes& times = connectBlockStageTimes[i];
+        vStats[i].strName = CONNECT_STAGE_NAMES[i];
+        vStats[i].vRecentMicros.assign(times.recentMicros.begin(), times.recentMicros.end());
+        vStats[i].nTotalMicros = times.nTotalMicros;
+        vStats[i].nTotalItems = times.nTotalItems;
+        vStats[i].nBlocks = times.nBlocks;
+    }
+    return vStats;
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
@@ -2053,6 +2746,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
            (*pindex->phashBlock == block.GetHash()));
     int64_t nTimeStart = GetTimeMicros();
 
+    TRACE3(validation, block_connect_start, block.GetHash().begin(), pindex->nHeight, fJustCheck);
+
     // Check it again in case a previous version let a bad block in
     // NOTE: We don't currently (re-)invoke ContextualCheckBlock() or
     // ContextualCheckBlockHeader() here. This means that if we add a new
@@ -2179,37 +2874,16 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
-    std::vector<std::tuple<CTransaction, int, uint256>> vDepositTx;
-    std::vector<std::tuple<uint8_t, CTransaction, int>> vWithdrawalToSpend;
-    std::vector<OPReturnData> vOPReturnData;
+    std::vector<std::tuple<CTransactionRef, int, uint256>> vDepositTx;
+    std::vector<std::tuple<uint8_t, CTransactionRef, int>> vWithdrawalToSpend;
+    int64_t nStageMicros[CONNECT_STAGE_COUNT] = {};
+    uint64_t nStageItems[CONNECT_STAGE_COUNT] = {};
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
 
         nInputs += tx.vin.size();
 
-        // Search for OP_RETURN outputs
-        for (const CTxOut& o : tx.vout) {
-            const CScript scriptPubKey = o.scriptPubKey;
-            if (!scriptPubKey.size())
-                continue;
-            if (scriptPubKey[0] != OP_RETURN)
-                continue;
-
-            OPReturnData data;
-            data.txid = tx.GetHash();
-            data.script = scriptPubKey;
-            data.nSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
-
-            // Using CheckTxInputs to calculate fees and copy to OP_RETURN data
-            data.fees = CAmount(0);
-            if (!tx.IsCoinBase() && !Consensus::CheckTxInputs(tx, state, view, pindex->nHeight, data.fees)) {
-                return error("%s: OP_RETURN DB fee calculation CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
-            }
-
-            vOPReturnData.push_back(data);
-        }
-
         bool fSidechainInputs = false;
         uint8_t nSidechain = 0;
         if (!tx.IsCoinBase())
@@ -2230,6 +2904,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
 
             // Set fSidechainInputs & nSidechain
+            int64_t nTimeScanStart = GetTimeMicros();
             if (nHeight < DrivechainHeight) {
                 if (skydogesEnabled) {
                     std::vector<CScript> vScript; }
@@ -2237,7 +2912,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 if (drivechainsEnabled) {
             
                     for (const CTxIn& in : tx.vin) {
-                        Coin coin = view.AccessCoin(in.prevout);
+                        const Coin& coin = view.AccessCoin(in.prevout);
                         if (coin.out.scriptPubKey.IsDrivechain(nSidechain)) {
                             fSidechainInputs = true;
                             break;
@@ -2245,6 +2920,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                     }
                 }
             }
+            nStageMicros[CONNECT_STAGE_SIDECHAIN_SCAN] += GetTimeMicros() - nTimeScanStart;
 
             // Check that transaction is BIP68 final
             // BIP68 lock checks (as opposed to nLockTime checks) must
@@ -2298,6 +2974,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
          */
 
         if (skydogesEnabled && fSidechainInputs) {
+            int64_t nTimeWithdrawalStart = GetTimeMicros();
+
             // We must get the Withdrawal hash as work is applied to
             // Withdrawal before inputs and the change output are known.
             uint256 hashBlind;
@@ -2316,18 +2994,21 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             if (amountSidechainIn > amountSidechainOut) {
                 // Check if withdrawal bundle tx can be spent and track it
                 if (scdb.SpendWithdrawal(nSidechain, block.GetHash(), tx, i, true /* fJustCheck */, true /* fDebug */)) {
-                    vWithdrawalToSpend.push_back(std::make_tuple(nSidechain, tx, i));
+                    vWithdrawalToSpend.push_back(std::make_tuple(nSidechain, block.vtx[i], i));
                 } else {
                     return error("ConnectBlock(): Spend Withdrawal failed (blind Withdrawal hash : txid): %s : %s", hashBlind.ToString(), tx.GetHash().ToString());
                 }
             }
+            nStageMicros[CONNECT_STAGE_WITHDRAWALS] += GetTimeMicros() - nTimeWithdrawalStart;
         }
 
         if (skydogesEnabled && !tx.IsCoinBase() && !fJustCheck) {
+            int64_t nTimeScanStart = GetTimeMicros();
+
             // Check for possible sidechain deposits
             bool fSidechainOutput = false;
             uint8_t nSidechain;
-            for (const CTxOut out : tx.vout) {
+            for (const CTxOut& out : tx.vout) {
                 const CScript& scriptPubKey = out.scriptPubKey;
                 if (scriptPubKey.IsDrivechain(nSidechain)) {
                     fSidechainOutput = true;
@@ -2335,7 +3016,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 }
             }
             if (fSidechainOutput)
-                vDepositTx.push_back(std::make_tuple(tx, i, block.GetHash()));
+                vDepositTx.push_back(std::make_tuple(block.vtx[i], i, block.GetHash()));
+
+            nStageMicros[CONNECT_STAGE_SIDECHAIN_SCAN] += GetTimeMicros() - nTimeScanStart;
         }
 
         CTxUndo undoDummy;
@@ -2354,16 +3037,29 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                                block.vtx[0]->GetValueOut(), blockReward),
                                REJECT_INVALID, "bad-cb-amount");
 
-    if (!control.Wait())
+    if (!control.Wait()) {
+        // The script checks ran in parallel and we only know that one of
+        // them failed. Run them again one at a time so that the block is
+        // rejected for the same reason as without script check threads.
+        std::string strFailed;
+        ScriptError serror = SCRIPT_ERR_UNKNOWN_ERROR;
+        if (FindFailedScriptCheck(block, blockundo, flags, txdata, serror, strFailed))
+            return state.DoS(100, error("%s: %s", __func__, strFailed), REJECT_INVALID,
+                    strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(serror)), false, strFailed);
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    }
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
 
+    nStageItems[CONNECT_STAGE_SIDECHAIN_SCAN] = vDepositTx.size();
+
     if (skydogesEnabled && !fJustCheck && vDepositTx.size()) {
+        int64_t nTimeDepositStart = GetTimeMicros();
+
         // Convert deposit transactions into SidechainDeposit objects
         std::vector<SidechainDeposit> vDeposit;
         for (size_t i = 0; i <  vDepositTx.size(); i++) {
-            const CTransaction tx = std::get<0>(vDepositTx[i]);
+            const CTransactionRef& tx = std::get<0>(vDepositTx[i]);
             int nTx = std::get<1>(vDepositTx[i]);
             uint256 hashBlock = std::get<2>(vDepositTx[i]);
             SidechainDeposit deposit;
@@ -2377,12 +3073,18 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             vDeposit.push_back(deposit);
         }
         scdb.AddDeposits(vDeposit);
+
+        nStageMicros[CONNECT_STAGE_DEPOSITS] = GetTimeMicros() - nTimeDepositStart;
+        nStageItems[CONNECT_STAGE_DEPOSITS] = vDeposit.size();
     }
 
     if (skydogesEnabled && vWithdrawalToSpend.size()) {
+        int64_t nTimeWithdrawalStart = GetTimeMicros();
         for (size_t i = 0; i < vWithdrawalToSpend.size(); i++) {
             uint8_t nSidechain = std::get<0>(vWithdrawalToSpend[i]);
-            const CTransaction tx = std::get<1>(vWithdrawalToSpend[i]);
+            // The bundle analysis of the first check is cached by the shared
+            // transaction, don't copy it
+            const CTransaction& tx = *std::get<1>(vWithdrawalToSpend[i]);
             int nTx = std::get<2>(vWithdrawalToSpend[i]);
 
             uint256 hashBlind;
@@ -2391,17 +3093,26 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 return error("ConnectBlock(): Final spend Withdrawal failed (blind Withdrawal hash : txid): %s : %s.\n nSidechain: %u\n", hashBlind.ToString(), tx.GetHash().ToString(), nSidechain);
             }
         }
+        nStageMicros[CONNECT_STAGE_WITHDRAWALS] += GetTimeMicros() - nTimeWithdrawalStart;
+        nStageItems[CONNECT_STAGE_WITHDRAWALS] = vWithdrawalToSpend.size();
     }
 
     if (skydogesEnabled) {
+        int64_t nTimeUpdateStart = GetTimeMicros();
+
         // Update / synchronize SCDB
-        if (!scdb.Update(pindex->nHeight, block.GetHash(), block.GetPrevHash(), block.vtx[0]->vout, fJustCheck, true /* fDebug */)) {
+        if (!scdb.Update(pindex->nHeight, block.GetHash(), block.GetPrevHash(), *GetCoinbaseCommitments(block), fJustCheck, true /* fDebug */)) {
             LogPrintf("%s: SCDB failed to update with block: %s\n", __func__, block.GetHash().ToString());
             return error("%s: SCDB update failed for block: %s", __func__, block.GetHash().ToString());
         }
+        int64_t nTimeCTIPStart = GetTimeMicros();
+        nStageMicros[CONNECT_STAGE_SCDB_UPDATE] = nTimeCTIPStart - nTimeUpdateStart;
+
         // After updating SCDB make sure mempool deposits are still valid
-        if (!fJustCheck)
+        if (!fJustCheck) {
             mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), false);
+            nStageMicros[CONNECT_STAGE_MEMPOOL_CTIP] = GetTimeMicros() - nTimeCTIPStart;
+        }
     }
 
     if (fJustCheck)
@@ -2415,18 +3126,20 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (!WriteTxIndexDataForBlock(block, state, pindex))
+    if (!WriteBMMIndexDataForBlock(block, state, pindex))
         return false;
 
-    // TODO
-    // Instead of writing the entire vector of sidechains with each block for
-    // undo purposes, store the sidechain only once with LDB and then maintain
-    // only a list of sidechain hashes per block. Then if we need to re-activate
-    // an old sidechain we can look it up by hash.
+    if (!WriteFeeStatsForBlock(block, nFees, state, pindex))
+        return false;
+
+    // The sidechain tree DB only stores what changed since the previous
+    // block, with a full checkpoint every SIDECHAIN_BLOCK_DATA_CHECKPOINT_INTERVAL
+    int64_t nTimeTreeStart = GetTimeMicros();
     SidechainBlockData data;
     data.vWithdrawalStatus = scdb.GetState();
     data.vActivationStatus = scdb.GetSidechainActivationStatus();
     data.vSidechain = scdb.GetSidechains();
+    data.vSpent = scdb.GetSpentWithdrawalsForBlock(block.GetHash());
 
     if (data.vSidechain.empty()) {
         // Initialize with blank inactive sidechains
@@ -2437,17 +3150,12 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     if (!psidechaintree->HaveBlockData(block.GetHash()) &&
             !psidechaintree->WriteSidechainBlockData(
-                std::make_pair(block.GetHash(), data)))
+                block.GetHash(), block.GetPrevHash(), pindex->nHeight, data))
     {
         return state.Error("Failed to write sidechain block data!");
     }
-
-    if (vOPReturnData.size() && !popreturndb->HaveBlockData(block.GetHash()) &&
-            !popreturndb->WriteBlockData(
-                std::make_pair(block.GetHash(), vOPReturnData)))
-    {
-        return state.Error("Failed to write block OP_RETURN data!");
-    }
+    PruneSidechainBlockData(pindex);
+    nStageMicros[CONNECT_STAGE_SIDECHAIN_TREE] = GetTimeMicros() - nTimeTreeStart;
 
     assert(pindex->phashBlock);
     // add this block to the view's block chain
@@ -2459,6 +3167,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
 
+    nStageMicros[CONNECT_STAGE_TOTAL] = nTime6 - nTimeStart;
+    RecordConnectBlockStages(nStageMicros, nStageItems);
+
+    TRACE6(validation, block_connected, block.GetHash().begin(), pindex->nHeight, block.vtx.size(), nInputs, nSigOpsCost, nTime6 - nTimeStart);
+
     return true;
 }
 
@@ -2509,6 +3222,11 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
         int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // Coins still being written in the background count against the cache
+        if (pcoinsflush)
+            cacheSize += pcoinsflush->DynamicMemoryUsage();
+        g_metrics.nCoinsCacheUsage.store(cacheSize, std::memory_order_relaxed);
+        g_metrics.nCoinsCacheEntries.store(pcoinsTip->GetCacheSize(), std::memory_order_relaxed);
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2545,9 +3263,13 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files. A crash may need them to
+            // replay the blocks of a background flush, wait for it first.
+            if (fFlushForPrune) {
+                if (pcoinsflush && !pcoinsflush->Sync())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2560,9 +3282,32 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
+            // With a background flush layer this only hands the coins over
+            // to its thread, unless we have to wait for them to be written.
+#ifdef ENABLE_TRACING
+            // The flush empties the cache, take its size for the tracepoint first
+            const int64_t nFlushStart = GetTimeMicros();
+            const size_t nCoins = pcoinsTip->GetCacheSize();
+            const size_t nCoinsUsage = pcoinsTip->DynamicMemoryUsage();
+#endif
+            // The deposits of the blocks connected since the last flush go
+            // first, so that they aren't behind the chainstate on disk. The
+            // background flush has to finish the last chainstate flush before
+            // taking this one anyway, wait for it first so that the deposits
+            // only have to be rolled back to the chainstate on disk now.
+            if (pcoinsflush && !pcoinsflush->Sync())
+                return AbortNode(state, "Failed to write to coin database");
+            if (!scdb.FlushDeposits(pcoinsTip->GetBestBlock(), pcoinsdbview->GetBestBlock()))
+                return AbortNode(state, "Failed to write to sidechain database");
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            if (pcoinsflush && mode == FLUSH_STATE_ALWAYS && !pcoinsflush->Sync())
+                return AbortNode(state, "Failed to write to coin database");
+            TRACE4(utxocache, flush, GetTimeMicros() - nFlushStart, (int)mode, nCoins, nCoinsUsage);
             nLastFlush = nNow;
+            // Keep the SCDB caches consistent with the chainstate in case we
+            // don't shut down cleanly
+            DumpSCDBCache();
         }
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2600,10 +3345,20 @@ static void DoWarning(const std::string& strWarning)
 }
 
 /** Check warning conditions and do some notifications on new chain tip set. */
+/** The -reindex-chainstate replay in progress, protected by cs_main */
+static const CBlockIndex* pindexReindexTarget = nullptr;
+static int64_t nReindexTimeStart = 0;
+
 void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainParams) {
     // New best block
     mempool.AddTransactionsUpdated(1);
 
+    g_metrics.nChainHeight.store(pindexNew->nHeight, std::memory_order_relaxed);
+    UpdateSidechainMetrics(scdb);
+
+    if (pindexReindexTarget && pindexNew->nChainWork >= pindexReindexTarget->nChainWork)
+        FinishReindexChainState();
+
     cvBlockChange.notify_all();
 
     std::vector<std::string> warningMessages;
@@ -2707,6 +3462,20 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     return true;
 }
 
+bool CChainState::FinishSCDBReorg(const CBlockIndex* pindexFork, unsigned int nBlocks)
+{
+    AssertLockHeld(cs_main);
+    fSCDBReorg = false;
+
+    const bool fResynced = !nBlocks || ResyncSCDB(pindexFork, nBlocks);
+    if (!fResynced)
+        error("%s: Failed to re-sync SCDB to fork block: %s!", __func__, pindexFork->GetBlockHash().ToString());
+    scdb.EndReorg();
+
+    mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), true /* fDisconnect */);
+    return fResynced;
+}
+
 static int64_t nTimeReadFromDisk = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
@@ -2778,6 +3547,25 @@ public:
     }
 };
 
+/** The outpoints spent by block that aren't outputs of the block itself */
+static std::vector<COutPoint> GetBlockInputs(const CBlock& block)
+{
+    std::vector<uint256> vTxid;
+    vTxid.reserve(block.vtx.size());
+    for (const CTransactionRef& tx : block.vtx)
+        vTxid.push_back(tx->GetHash());
+    std::sort(vTxid.begin(), vTxid.end());
+
+    std::vector<COutPoint> vOutPoint;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        for (const CTxIn& txin : block.vtx[i]->vin) {
+            if (!std::binary_search(vTxid.begin(), vTxid.end(), txin.prevout.hash))
+                vOutPoint.push_back(txin.prevout);
+        }
+    }
+    return vOutPoint;
+}
+
 /**
  * Connect a new block to chainActive. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -2789,14 +3577,14 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    std::shared_ptr<const CBlock> pthisBlock;
-    if (!pblock) {
+    std::shared_ptr<const CBlock> pthisBlock = pblock;
+    if (!pthisBlock && g_blockprefetcher)
+        pthisBlock = g_blockprefetcher->Get(pindexNew->GetBlockHash());
+    if (!pthisBlock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pthisBlock = pblockNew;
-    } else {
-        pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
@@ -2804,6 +3592,12 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
+        // Look up the coins the block spends from the database in parallel,
+        // rather than one at a time as ConnectBlock gets to them
+        const size_t nPrefetched = pcoinsTip->Prefetch(GetBlockInputs(blockConnecting), std::min(GetNumCores(), MAX_INPUT_PREFETCH_THREADS));
+        int64_t nTimePrefetch = GetTimeMicros();
+        LogPrint(BCLog::BENCH, "  - Prefetch %u inputs: %.2fms\n", nPrefetched, (nTimePrefetch - nTime2) * MILLI);
+
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
         GetMainSignals().BlockChecked(blockConnecting, state);
@@ -2926,17 +3720,31 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
     const CBlockIndex *pindexOldTip = chainActive.Tip();
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
-    // Disconnect active blocks which are no longer in the best chain.
+    // Disconnect active blocks which are no longer in the best chain. SCDB
+    // only has the deposits and withdrawal spends of each block undone, it
+    // is resynced once at the fork.
     bool fBlocksDisconnected = false;
+    unsigned int nDisconnected = 0;
     DisconnectedBlockTransactions disconnectpool;
+    if (chainActive.Tip() && pindexFork && chainActive.Tip() != pindexFork) {
+        fSCDBReorg = true;
+        scdb.BeginReorg();
+    }
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
         if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+            if (fSCDBReorg)
+                FinishSCDBReorg(chainActive.Tip(), nDisconnected);
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
             UpdateMempoolForReorg(disconnectpool, false);
             return false;
         }
         fBlocksDisconnected = true;
+        nDisconnected++;
+    }
+    if (fSCDBReorg && !FinishSCDBReorg(pindexFork, nDisconnected)) {
+        UpdateMempoolForReorg(disconnectpool, false);
+        return AbortNode(state, "Failed to resync the sidechain database after a reorg");
     }
 
     // Build list of new blocks to connect.
@@ -2956,6 +3764,17 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
         nHeight = nTargetHeight;
 
+        // Read the blocks ahead of the one we are connecting in the background
+        if (g_blockprefetcher) {
+            std::vector<std::pair<uint256, CDiskBlockPos>> vPrefetch;
+            for (CBlockIndex *pindexPrefetch : reverse_iterate(vpindexToConnect)) {
+                if (pindexPrefetch == pindexMostWork && pblock)
+                    continue;
+                vPrefetch.emplace_back(pindexPrefetch->GetBlockHash(), pindexPrefetch->GetBlockPos());
+            }
+            g_blockprefetcher->Prefetch(vPrefetch);
+        }
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
@@ -3178,6 +3997,7 @@ bool CChainState::InvalidateBlock(CValidationState& state, const CChainParams& c
         invalid_walk_tip->nStatus |= BLOCK_FAILED_CHILD;
         setDirtyBlockIndex.insert(invalid_walk_tip);
         setBlockIndexCandidates.erase(invalid_walk_tip);
+        g_blockcache.Erase(invalid_walk_tip->GetBlockHash());
         invalid_walk_tip = invalid_walk_tip->pprev;
     }
 
@@ -3186,6 +4006,7 @@ bool CChainState::InvalidateBlock(CValidationState& state, const CChainParams& c
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
     g_failed_blocks.insert(pindex);
+    g_blockcache.Erase(pindex->GetBlockHash());
 
     // DisconnectTip will add transactions to disconnectpool; try to add these
     // back to the mempool.
@@ -3255,7 +4076,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3277,6 +4098,12 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
 
     setDirtyBlockIndex.insert(pindexNew);
 
+    // The new entry replaces its parent as a tip, unless the parent already
+    // had a child: then it starts a new branch
+    setBlockIndexTips.insert(pindexNew);
+    if (pindexNew->pprev && setBlockIndexTips.erase(pindexNew->pprev) == 0)
+        GetMainSignals().NewForkTip(pindexNew);
+
     return pindexNew;
 }
 
@@ -3580,33 +4407,9 @@ void GenerateCriticalHashCommitments(CBlock& block)
     } else {
     std::vector<CCriticalData> vCriticalData = GetCriticalDataRequests(block);
     }
-    std::vector<CTxOut> vout;
-    for (const CCriticalData& d : vCriticalData) {
-        CTxOut out;
-        out.nValue = 0;
-        out.scriptPubKey.resize(37);
-        out.scriptPubKey[0] = OP_RETURN;
-        out.scriptPubKey[1] = 0xD1;
-        out.scriptPubKey[2] = 0x61;
-        out.scriptPubKey[3] = 0x73;
-        out.scriptPubKey[4] = 0x68;
-
-        memcpy(&out.scriptPubKey[5], &d.hashCritical, 32);
-
-        // Add bytes (optional)
-        if (!d.vBytes.empty())
-            out.scriptPubKey += CScript(d.vBytes.begin(), d.vBytes.end());
-
-        vout.push_back(out);
-    }
-
-    // Update coinbase in block
-    if (!vout.empty()) {
-        CMutableTransaction mtx(*block.vtx[0]);
-        for (const CTxOut& o : vout)
-            mtx.vout.push_back(o);
-        block.vtx[0] = MakeTransactionRef(std::move(mtx));
-    }
+    CoinbaseCommitments commitments;
+    commitments.vCriticalData = std::move(vCriticalData);
+    commitments.AddToCoinbase(block);
 }
 
 void GenerateLNCriticalHashCommitment(CBlock& block)
@@ -3708,27 +4511,9 @@ void GenerateWithdrawalHashCommitment(CBlock& block, const uint256& hash, const
             return;
     }
 
-    CTxOut out;
-    out.nValue = 0;
-
-    // Add script header
-    out.scriptPubKey.resize(38);
-    out.scriptPubKey[0] = OP_RETURN;
-    out.scriptPubKey[1] = 0xD4;
-    out.scriptPubKey[2] = 0x5A;
-    out.scriptPubKey[3] = 0xA9;
-    out.scriptPubKey[4] = 0x43;
-
-    // Add Withdrawal hash
-    memcpy(&out.scriptPubKey[5], &hash, 32);
-
-    // Add nSidechain
-    out.scriptPubKey[37] = nSidechain;
-
-    // Update coinbase in block
-    CMutableTransaction mtx(*block.vtx[0]);
-    mtx.vout.push_back(out);
-    block.vtx[0] = MakeTransactionRef(std::move(mtx));
+    CoinbaseCommitments commitments;
+    commitments.vWithdrawal.emplace_back(nSidechain, hash);
+    commitments.AddToCoinbase(block);
 }
 
 void GenerateSidechainProposalCommitment(CBlock& block, const Sidechain& sidechain)
@@ -3738,16 +4523,9 @@ void GenerateSidechainProposalCommitment(CBlock& block, const Sidechain& sidecha
         if (!IsDrivechainEnabled(chainActive.Tip(), consensusParams))
             return;
     }
-    CTxOut out;
-    out.nValue = 0;
-
-    // Add serialization of sidechain proposal & Header 0xD5E0C4AF
-    out.scriptPubKey = sidechain.GetProposalScript();
-
-    // Update coinbase in block
-    CMutableTransaction mtx(*block.vtx[0]);
-    mtx.vout.push_back(out);
-    block.vtx[0] = MakeTransactionRef(std::move(mtx));
+    CoinbaseCommitments commitments;
+    commitments.vProposal.push_back(sidechain);
+    commitments.AddToCoinbase(block);
 }
 
 void GenerateSidechainActivationCommitment(CBlock& block, const uint256& hash)
@@ -3758,22 +4536,9 @@ void GenerateSidechainActivationCommitment(CBlock& block, const uint256& hash)
             return;
     }
 
-    CTxOut out;
-    out.nValue = 0;
-
-    // Add script header
-    out.scriptPubKey.resize(37);
-    out.scriptPubKey[0] = OP_RETURN;
-    out.scriptPubKey[1] = 0xD6;
-    out.scriptPubKey[2] = 0xE1;
-    out.scriptPubKey[3] = 0xC5;
-    out.scriptPubKey[4] = 0xBF;
-
-    memcpy(&out.scriptPubKey[5], &hash, 32);
-    // Update coinbase in block
-    CMutableTransaction mtx(*block.vtx[0]);
-    mtx.vout.push_back(out);
-    block.vtx[0] = MakeTransactionRef(std::move(mtx));
+    CoinbaseCommitments commitments;
+    commitments.vActivation.push_back(hash);
+    commitments.AddToCoinbase(block);
 }
 
 bool GenerateSCDBByteCommitment(CBlock& block, CScript& scriptOut, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, const std::vector<std::string>& vVote)
@@ -3787,6 +4552,30 @@ bool GenerateSCDBByteCommitment(CBlock& block, CScript& scriptOut, const std::ve
         return false;
     }
 
+    for (const std::vector<SidechainWithdrawalState>& vWithdrawal : vScores) {
+        if (vWithdrawal.empty())
+            return false;
+    }
+
+    // Add bytes to script based on our vote settings.
+    // 0-65533 = index of withdrawal bundle to upvote for this sidechain.
+    // 65534 = downvote withdrawals for this sidechain.
+    // 65535 = abstain withdrawals for this sidechain.
+    // If an upvoted bundle isn't in SCDB the abstain bytes are added.
+    SCDBVotes votes;
+    for (const std::vector<SidechainWithdrawalState>& vWithdrawal : vScores) {
+        uint8_t nSidechain = vWithdrawal.front().nSidechain;
+        if (vVote[nSidechain].size() == 64 && uint256S(vVote[nSidechain]).IsNull())
+            return false;
+
+        votes[nSidechain] = ParseSCDBVote(vVote[nSidechain], vWithdrawal);
+    }
+
+    return GenerateSCDBByteCommitment(block, scriptOut, vScores, votes);
+}
+
+bool GenerateSCDBByteCommitment(CBlock& block, CScript& scriptOut, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, const SCDBVotes& votes)
+{
     // Create output that bytes will be added to
     CTxOut out;
     out.nValue = 0;
@@ -3803,48 +4592,9 @@ bool GenerateSCDBByteCommitment(CBlock& block, CScript& scriptOut, const std::ve
     out.scriptPubKey[5] = SCDB_BYTES_VERSION;
 
     // Set bytes based on withdrawal vote settings
-    for (const std::vector<SidechainWithdrawalState>& vWithdrawal : vScores) {
-        if (vWithdrawal.empty())
-            return false;
-
-        uint8_t nSidechain = vWithdrawal.front().nSidechain;
-
-        // Add bytes to script based on our vote settings.
-        // 0-65533 = index of withdrawal bundle to upvote for this sidechain.
-        // 65534 = downvote withdrawals for this sidechain.
-        // 65535 = abstain withdrawals for this sidechain.
-        if (vVote[nSidechain].size() == 64) {
-            uint256 hash = uint256S(vVote[nSidechain]);
-
-            if (hash.IsNull())
-                return false;
-
-            // Lookup index of withdrawal bundle in SCDB
-            uint16_t n = 0;
-            for (; n < vWithdrawal.size(); n++)
-                if (vWithdrawal[n].hash == hash)
-                    break;
-
-            // If bundle exists add index bytes. Otherwise add abstain bytes.
-            if (n == vWithdrawal.size()) {
-                out.scriptPubKey.push_back(0xFF);
-                out.scriptPubKey.push_back(0xFF);
-            } else {
-                out.scriptPubKey.push_back(n & 0xff);
-                out.scriptPubKey.push_back(n >> 8);
-            }
-        }
-        else
-        if (vVote[nSidechain].front() == SCDB_ABSTAIN) {
-            out.scriptPubKey.push_back(0xFF);
-            out.scriptPubKey.push_back(0xFF);
-        }
-        else
-        if (vVote[nSidechain].front() == SCDB_DOWNVOTE) {
-            out.scriptPubKey.push_back(0xFF);
-            out.scriptPubKey.push_back(0xFE);
-        }
-    }
+    std::vector<unsigned char> vch;
+    EncodeSCDBVotes(votes, vScores, vch);
+    out.scriptPubKey.insert(out.scriptPubKey.end(), vch.begin(), vch.end());
 
     scriptOut = out.scriptPubKey;
 
@@ -4042,6 +4792,12 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
         // Track existence of BMM h* commit requests per sidechain
         std::vector<bool> vSidechainBMM;
         vSidechainBMM.resize(SIDECHAIN_ACTIVATION_MAX_ACTIVE);
+
+        // The critical data committed to in the coinbase, read once when
+        // the first critical data transaction is found
+        std::set<std::pair<uint256, std::vector<unsigned char>>> setCriticalCommit;
+        bool fReadCommits = false;
+
         for (const auto& tx: block.vtx) {
             // Look for transactions with non-null CCriticalData
             if (!tx->criticalData.IsNull()) {
@@ -4055,21 +4811,14 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
                     return state.DoS(100, false, REJECT_INVALID, "bad-critical-data-bytes", true, strprintf("%s : extra bytes size > MAX_CRITICAL_DATA_BYTES", __func__));
 
                 // Check for hashCritical commitment in coinbase
-                bool fFound = false;
-                for (const CTxOut& out : block.vtx[0]->vout) {
-                    const CScript &scriptPubKey = out.scriptPubKey;
-                    uint256 hashCritical = uint256();
-                    std::vector<unsigned char> vBytes;
-                    if (scriptPubKey.IsCriticalHashCommit(hashCritical, vBytes)) {
-                        if (tx->criticalData.hashCritical == hashCritical &&
-                                tx->criticalData.vBytes == vBytes) {
-                            fFound = true;
-                            break;
-                        }
-                    }
+                if (!fReadCommits) {
+                    std::shared_ptr<const CoinbaseCommitments> commitments = GetCoinbaseCommitments(block);
+                    for (const CCriticalData& d : commitments->vCriticalData)
+                        setCriticalCommit.emplace(d.hashCritical, d.vBytes);
+                    fReadCommits = true;
                 }
                 // Did we find hashCritical?
-                if (!fFound)
+                if (!setCriticalCommit.count(std::make_pair(tx->criticalData.hashCritical, tx->criticalData.vBytes)))
                     return state.DoS(100, false, REJECT_INVALID, "bad-critical-data-no-commit", true, strprintf("%s : no commit found for critical data", __func__));
 
                 // Enforce 1 BMM h* per sidechain per block & validate BMM txns.
@@ -4171,10 +4920,48 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     return true;
 }
 
+void CacheBlockHeaderHashes(const std::vector<CBlockHeader>& headers)
+{
+    const size_t nHeaders = headers.size();
+    std::vector<uint256> vHash(nHeaders);
+
+    // Spawning threads only pays off for large batches
+    size_t nThreads = std::max(nScriptCheckThreads, 1);
+    nThreads = std::min(nThreads, nHeaders / MIN_HEADERS_PER_HASH_THREAD);
+    if (nThreads <= 1) {
+        skydoge_hash_multi(headers.data(), nHeaders, vHash.data());
+        return;
+    }
+
+    // Split the batch into contiguous ranges, the calling thread takes the
+    // first one
+    const size_t nPerThread = (nHeaders + nThreads - 1) / nThreads;
+    std::vector<std::thread> vThread;
+    for (size_t nStart = nPerThread; nStart < nHeaders; nStart += nPerThread) {
+        const size_t nCount = std::min(nPerThread, nHeaders - nStart);
+        try {
+            vThread.emplace_back(skydoge_hash_multi, &headers[nStart], nCount, &vHash[nStart]);
+        } catch (const std::system_error&) {
+            // Out of threads, hash the range here
+            skydoge_hash_multi(&headers[nStart], nCount, &vHash[nStart]);
+        }
+    }
+    skydoge_hash_multi(headers.data(), std::min(nPerThread, nHeaders), vHash.data());
+
+    for (std::thread& t : vThread)
+        t.join();
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+
+    // Hash the whole batch before taking cs_main. Headers that came from the
+    // network are memoized, so net_processing callers that already did this
+    // don't pay for it twice.
+    CacheBlockHeaderHashes(headers);
+
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
@@ -4195,6 +4982,24 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
 static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const CDiskBlockPos* dbp) {
     unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> vCompressed;
+    if (dbp == nullptr && nBlockCompressLevel > 0) {
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ssBlock << block;
+        if (CompressRecord(ssBlock.data(), ssBlock.size(), nBlockCompressLevel, vCompressed))
+            nBlockSize = vCompressed.size();
+    } else if (dbp != nullptr) {
+        // A block stored compressed takes up less than its size on disk
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(dbp->nFile, dbp->nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+        unsigned int nDiskSize = 0;
+        try {
+            if (!filein.IsNull())
+                filein >> nDiskSize;
+        } catch (const std::exception&) {
+        }
+        if (nDiskSize & RECORD_COMPRESSED_FLAG)
+            nBlockSize = nDiskSize & ~RECORD_COMPRESSED_FLAG;
+    }
     CDiskBlockPos blockPos;
     if (dbp != nullptr)
         blockPos = *dbp;
@@ -4202,7 +5007,12 @@ static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CCh
         error("%s: FindBlockPos failed", __func__);
         return CDiskBlockPos();
     }
-    if (dbp == nullptr) {
+    if (!vCompressed.empty()) {
+        if (!WriteCompressedBlockToDisk(vCompressed, blockPos, chainparams.MessageStart())) {
+            AbortNode("Failed to write block");
+            return CDiskBlockPos();
+        }
+    } else if (dbp == nullptr) {
         if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
             AbortNode("Failed to write block");
             return CDiskBlockPos();
@@ -4297,6 +5107,10 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 {
     AssertLockNotHeld(cs_main);
 
+    // The block will not be modified from here on, so let ConnectBlock & co.
+    // reuse the memoized hash instead of re-running skydoge_hash
+    pblock->MarkImmutable();
+
     {
         CBlockIndex *pindex = nullptr;
         if (fNewBlock) *fNewBlock = false;
@@ -4349,6 +5163,77 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
     return true;
 }
 
+bool TestBlockValidityLight(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev)
+{
+    AssertLockHeld(cs_main);
+    assert(pindexPrev && pindexPrev == chainActive.Tip());
+
+    if (!ContextualCheckBlockHeader(block, state, chainparams, pindexPrev, GetAdjustedTime()))
+        return error("%s: Consensus::ContextualCheckBlockHeader: %s", __func__, FormatStateMessage(state));
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), false, false))
+        return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
+    if (!ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindexPrev))
+        return error("%s: Consensus::ContextualCheckBlock: %s", __func__, FormatStateMessage(state));
+
+    const bool fDrivechainEnabled = IsDrivechainEnabled(pindexPrev, chainparams.GetConsensus());
+    CBlockIndex indexDummy(block);
+    indexDummy.pprev = pindexPrev;
+    indexDummy.nHeight = pindexPrev->nHeight + 1;
+    const unsigned int flags = GetBlockScriptFlags(&indexDummy, chainparams.GetConsensus());
+
+    // The transactions the miner made itself, withdrawal payouts and the
+    // critical data fee tx, weren't validated by the mempool. Check them as
+    // ConnectBlock would, on top of the mempool transactions they spend.
+    {
+        LOCK(mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            if (mempool.exists(tx.GetHash()))
+                continue;
+
+            CAmount txfee = 0;
+            if (!Consensus::CheckTxInputs(tx, state, view, indexDummy.nHeight, txfee))
+                return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+
+            PrecomputedTransactionData txdata(tx);
+            if (!CheckInputs(tx, state, view, true, flags, false, false, txdata))
+                return error("%s: CheckInputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+
+            uint8_t nSidechain = 0;
+            bool fSidechainInputs = false;
+            for (const CTxIn& in : tx.vin) {
+                if (view.AccessCoin(in.prevout).out.scriptPubKey.IsDrivechain(nSidechain)) {
+                    fSidechainInputs = true;
+                    break;
+                }
+            }
+            if (fDrivechainEnabled && fSidechainInputs) {
+                CAmount amountSidechainIn = 0, amountIn = 0, amountSidechainOut = 0, amountWithdrawn = 0;
+                std::string strFail;
+                if (!GetDrivechainAmounts(view, tx, amountSidechainIn, amountIn, amountSidechainOut, amountWithdrawn, strFail))
+                    return state.DoS(100, error("%s: Calculating Drivechain amounts failed: %s txid: %s", __func__, strFail, tx.GetHash().ToString()),
+                            REJECT_INVALID, "bad-drivechain-amounts");
+                if (amountSidechainIn > amountSidechainOut &&
+                        !scdb.SpendWithdrawal(nSidechain, block.GetHash(), tx, i, true /* fJustCheck */, true /* fDebug */))
+                    return state.DoS(100, error("%s: Spend Withdrawal failed txid: %s", __func__, tx.GetHash().ToString()),
+                            REJECT_INVALID, "bad-withdrawal-spend");
+            }
+
+            UpdateCoins(tx, view, indexDummy.nHeight, true /* fJustCheck */);
+        }
+    }
+
+    if (fDrivechainEnabled &&
+            !scdb.Update(pindexPrev->nHeight + 1, block.GetHash(), block.GetPrevHash(), *GetCoinbaseCommitments(block), true /* fJustCheck */)) {
+        return state.DoS(100, error("%s: SCDB update failed for block: %s", __func__, block.GetHash().ToString()),
+                REJECT_INVALID, "bad-scdb-update");
+    }
+
+    return true;
+}
+
 /**
  * BLOCK PRUNING CODE
  */
@@ -4404,6 +5289,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        if (g_blockfilemap)
+            g_blockfilemap->Remove(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4561,7 +5448,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4584,6 +5471,14 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    // The nChainTx of the block a UTXO snapshot was loaded at can't be
+    // counted, we don't have the blocks before it
+    uint256 hashUTXOSnapshot;
+    unsigned int nUTXOSnapshotChainTx = 0;
+    if (!blocktree.ReadUTXOSnapshotBase(hashUTXOSnapshot, nUTXOSnapshotChainTx))
+        hashUTXOSnapshot.SetNull();
+
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
@@ -4603,6 +5498,10 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
                 pindex->nChainTx = pindex->nTx;
             }
         }
+        if (!hashUTXOSnapshot.IsNull() && pindex->GetBlockHash() == hashUTXOSnapshot) {
+            pindex->nChainTx = nUTXOSnapshotChainTx;
+            pindexUTXOSnapshot = pindex;
+        }
         if (!(pindex->nStatus & BLOCK_FAILED_MASK) && pindex->pprev && (pindex->pprev->nStatus & BLOCK_FAILED_MASK)) {
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
@@ -4613,6 +5512,8 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
+        setBlockIndexTips.insert(pindex);
+        setBlockIndexTips.erase(pindex->pprev);
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
@@ -4670,9 +5571,9 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
+    // Check whether we have a BMM commitment index
+    pblocktree->ReadFlag("bmmindex", fBMMIndex);
+    LogPrintf("%s: BMM index %s\n", __func__, fBMMIndex ? "enabled" : "disabled");
 
     return true;
 }
@@ -4696,6 +5597,7 @@ bool LoadChainTip(const CChainParams& chainparams)
     if (it == mapBlockIndex.end())
         return false;
     chainActive.SetTip(it->second);
+    g_metrics.nChainHeight.store(chainActive.Height(), std::memory_order_relaxed);
 
     g_chainstate.PruneBlockIndexCandidates();
 
@@ -4751,9 +5653,13 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("%s: block verification stopping at height %d (pruning, no data)\n", __func__, pindex->nHeight);
             break;
         }
+        if (pindexUTXOSnapshot && pindex->nHeight <= pindexUTXOSnapshot->nHeight && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrintf("%s: block verification stopping at height %d (UTXO snapshot, no data)\n", __func__, pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus(), true /* fCheckPoW */))
             return error("%s: *** ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
         if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
@@ -4798,7 +5704,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))), false);
             pindex = chainActive.Next(pindex);
             CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+            if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus(), true /* fCheckPoW */))
                 return error("%s: *** ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
             if (!g_chainstate.ConnectBlock(block, state, pindex, coins, chainparams))
                 return error("%s: *** found unconnectable block at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -4907,7 +5813,9 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
 
     // Note that during -reindex-chainstate we are called with an empty chainActive!
 
-    int nHeight = 1;
+    // The blocks up to a UTXO snapshot were never received, there is
+    // nothing to rewind
+    int nHeight = pindexUTXOSnapshot ? pindexUTXOSnapshot->nHeight + 1 : 1;
     while (nHeight <= chainActive.Height()) {
         if (IsWitnessEnabled(chainActive[nHeight - 1], params.GetConsensus()) && !(chainActive[nHeight]->nStatus & BLOCK_OPT_WITNESS)) {
             break;
@@ -5009,6 +5917,7 @@ void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     g_failed_blocks.clear();
     setBlockIndexCandidates.clear();
+    setBlockIndexTips.clear();
 }
 
 void CChainState::UnloadWBlockIndex() {
@@ -5016,6 +5925,19 @@ void CChainState::UnloadWBlockIndex() {
     g_failed_blocks.clear();
     StartShutdown();
     setBlockIndexCandidates.clear();
+    setBlockIndexTips.clear();
+}
+
+/** Delete every block index entry and empty mapBlockIndex */
+static void FreeBlockIndex()
+{
+    // Entries put in mapBlockIndex directly, by tests, are heap allocated
+    for (BlockMap::value_type& entry : mapBlockIndex) {
+        if (!g_chainstate.blockIndexArena.Owns(entry.second))
+            delete entry.second;
+    }
+    mapBlockIndex.clear();
+    g_chainstate.blockIndexArena.Clear();
 }
 
 // May NOT be used after any connections are up as much
@@ -5038,11 +5960,9 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
-    mapBlockIndex.clear();
+    FreeBlockIndex();
     fHavePruned = false;
+    pindexUTXOSnapshot = nullptr;
 
     g_chainstate.UnloadBlockIndex();
 }
@@ -5065,10 +5985,7 @@ void CompactWitBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
-    mapBlockIndex.clear();
+    FreeBlockIndex();
     fHavePruned = false;
 
     g_chainstate.UnloadWBlockIndex();
@@ -5092,13 +6009,29 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
+        fBMMIndex = gArgs.GetBoolArg("-bmmindex", DEFAULT_BMMINDEX);
+        pblocktree->WriteFlag("bmmindex", fBMMIndex);
     }
     return true;
 }
 
+void CChainState::LoadUTXOSnapshotBase(CBlockIndex* pindex, unsigned int nChainTx)
+{
+    AssertLockHeld(cs_main);
+
+    // Counts as connected and validated, so that the blocks on top of it
+    // are connected as they arrive
+    pindex->nChainTx = nChainTx;
+    pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+    setDirtyBlockIndex.insert(pindex);
+    pindexUTXOSnapshot = pindex;
+
+    chainActive.SetTip(pindex);
+    g_metrics.nChainHeight.store(chainActive.Height(), std::memory_order_relaxed);
+    setBlockIndexCandidates.insert(pindex);
+    PruneBlockIndexCandidates();
+}
+
 bool CChainState::LoadGenesisBlock(const CChainParams& chainparams)
 {
     LOCK(cs_main);
@@ -5140,7 +6073,7 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK | SER_TX_ARENA, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
         while (!blkdat.eof()) {
             boost::this_thread::interruption_point();
@@ -5159,7 +6092,9 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                     continue;
                 // read size
                 blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                if ((nSize & ~RECORD_COMPRESSED_FLAG) < 4 || (nSize & ~RECORD_COMPRESSED_FLAG) > MAX_BLOCK_SERIALIZED_SIZE)
+                    continue;
+                if (!(nSize & RECORD_COMPRESSED_FLAG) && nSize < 80)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
@@ -5170,11 +6105,20 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
                     dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat.SetLimit(nBlockPos + (nSize & ~RECORD_COMPRESSED_FLAG));
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock& block = *pblock;
-                blkdat >> block;
+                if (nSize & RECORD_COMPRESSED_FLAG) {
+                    std::vector<unsigned char> vCompressed(nSize & ~RECORD_COMPRESSED_FLAG);
+                    blkdat.read((char*)vCompressed.data(), vCompressed.size());
+                    CDataStream ssBlock(SER_DISK | SER_TX_ARENA, CLIENT_VERSION);
+                    if (!UncompressRecord(vCompressed.data(), vCompressed.size(), ssBlock))
+                        continue;
+                    ssBlock >> block;
+                } else {
+                    blkdat >> block;
+                }
                 nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
@@ -5256,6 +6200,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 
     LOCK(cs_main);
 
+    // The chain up to a UTXO snapshot has transactions counted but no
+    // data, which the checks below don't allow for
+    if (pindexUTXOSnapshot) {
+        return;
+    }
+
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in mapBlockIndex but no active chain.  (A few of the tests when
     // iterating the block tree require that chainActive has been initialized.)
@@ -5382,6 +6332,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
                 }
             }
         }
+        assert(setBlockIndexTips.count(pindex) == (forward.count(pindex) == 0)); // Exactly the entries without children are tips.
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
 
@@ -5462,7 +6413,64 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * mempool.dat versions:
+ * 1: the transactions and fee deltas
+ * 2: adds the sidechain classification of each transaction and the order of
+ *    the sidechain deposit chains
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+/** Flags of a transaction in mempool.dat */
+enum MempoolDumpFlags : uint8_t {
+    MEMPOOL_DUMP_SIDECHAIN_DEPOSIT = (1 << 0),
+    MEMPOOL_DUMP_BMM_REQUEST = (1 << 1),
+};
+
+namespace {
+/** A transaction read from mempool.dat */
+struct MempoolDumpEntry {
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+    uint8_t nFlags;
+    uint8_t nSidechain;
+};
+}
+
+/** Put the deposits of each sidechain in the order they spend each other,
+ * in the places the deposits of that sidechain had in the dump */
+static void SortMempoolDumpDeposits(std::vector<MempoolDumpEntry>& vEntry, const std::map<uint8_t, std::vector<uint256>>& mapDepositChain)
+{
+    for (const auto& chain : mapDepositChain) {
+        std::vector<size_t> vPos;
+        std::map<uint256, size_t> mapPos;
+        for (size_t i = 0; i < vEntry.size(); i++) {
+            if (!(vEntry[i].nFlags & MEMPOOL_DUMP_SIDECHAIN_DEPOSIT) || vEntry[i].nSidechain != chain.first)
+                continue;
+            vPos.push_back(i);
+            mapPos[vEntry[i].tx->GetHash()] = i;
+        }
+
+        std::vector<MempoolDumpEntry> vSorted;
+        vSorted.reserve(vPos.size());
+        for (const uint256& txid : chain.second) {
+            auto it = mapPos.find(txid);
+            if (it == mapPos.end())
+                continue;
+            vSorted.push_back(vEntry[it->second]);
+            mapPos.erase(it);
+        }
+        // Deposits that weren't part of the chain go last
+        for (size_t nPos : vPos) {
+            if (mapPos.count(vEntry[nPos].tx->GetHash()))
+                vSorted.push_back(vEntry[nPos]);
+        }
+
+        for (size_t i = 0; i < vPos.size(); i++)
+            vEntry[vPos[i]] = std::move(vSorted[i]);
+    }
+}
 
 bool LoadMempool(void)
 {
@@ -5479,64 +6487,144 @@ bool LoadMempool(void)
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
+    int64_t deposits = 0;
+    int64_t bmm_requests = 0;
     int64_t nNow = GetTime();
 
+    std::vector<MempoolDumpEntry> vEntry;
+    std::map<uint256, CAmount> mapDeltas;
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version < 1 || version > MEMPOOL_DUMP_VERSION) {
             return false;
         }
         uint64_t num;
         file >> num;
         while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
-            } else {
-                ++expired;
+            MempoolDumpEntry entry;
+            file >> entry.tx;
+            file >> entry.nTime;
+            file >> entry.nFeeDelta;
+            entry.nFlags = 0;
+            entry.nSidechain = 0;
+            if (version >= 2) {
+                file >> entry.nFlags;
+                file >> entry.nSidechain;
             }
-            if (ShutdownRequested())
-                return false;
+            vEntry.push_back(std::move(entry));
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
-
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.second);
+        if (version >= 2) {
+            std::map<uint8_t, std::vector<uint256>> mapDepositChain;
+            file >> mapDepositChain;
+            SortMempoolDumpDeposits(vEntry, mapDepositChain);
         }
+        file >> mapDeltas;
     } catch (const std::exception& e) {
         LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    // Check the scripts of the transactions on the pre-validation threads,
+    // which collect the signature cache entries of the valid signatures,
+    // while they are accepted one by one here in the order of the dump
+    std::unique_ptr<CTxPrevalidator> prevalidator;
+    std::mutex csDone;
+    std::condition_variable condDone;
+    std::vector<bool> vPrevalidated(vEntry.size(), false);
+    int nPrevalidateThreads = std::min<int>(gArgs.GetArg("-prevalidatetxthreads", DEFAULT_PREVALIDATE_THREADS), MAX_PREVALIDATE_THREADS);
+    if (nPrevalidateThreads > 0 && vEntry.size() > 1) {
+        prevalidator = MakeUnique<CTxPrevalidator>(nPrevalidateThreads, vEntry.size(), [&csDone, &condDone] {
+            std::lock_guard<std::mutex> lock(csDone);
+            condDone.notify_one();
+        });
+        prevalidator->Start();
+
+        const unsigned int flags = GetMempoolScriptVerifyFlags(chainparams);
+        std::map<uint256, const CTransaction*> mapDumpTx;
+        LOCK(cs_main);
+        for (size_t i = 0; i < vEntry.size(); i++) {
+            const CTransaction& tx = *vEntry[i].tx;
+            mapDumpTx[tx.GetHash()] = &tx;
+            if (vEntry[i].nTime + nExpiryTimeout <= nNow)
+                continue;
+
+            // The outputs spent are in the chainstate or created by
+            // transactions earlier in the dump
+            std::vector<CTxOut> vSpent;
+            for (const CTxIn& txin : tx.vin) {
+                const Coin& coin = pcoinsTip->AccessCoin(txin.prevout);
+                if (!coin.IsSpent()) {
+                    vSpent.push_back(coin.out);
+                    continue;
+                }
+                auto it = mapDumpTx.find(txin.prevout.hash);
+                if (it == mapDumpTx.end() || txin.prevout.n >= it->second->vout.size()) {
+                    vSpent.clear();
+                    break;
+                }
+                vSpent.push_back(it->second->vout[txin.prevout.n]);
+            }
+            vPrevalidated[i] = prevalidator->Submit(-1, vEntry[i].tx, std::move(vSpent), flags);
+        }
+    }
+
+    for (size_t i = 0; i < vEntry.size(); i++) {
+        const MempoolDumpEntry& entry = vEntry[i];
+        const CTransactionRef& tx = entry.tx;
+
+        std::vector<uint256> vSigCacheEntry;
+        if (vPrevalidated[i]) {
+            // Transactions are handed back in the order they were submitted
+            CTransactionRef txDone;
+            std::unique_lock<std::mutex> lock(csDone);
+            while (!prevalidator->Take(-1, txDone, vSigCacheEntry))
+                condDone.wait(lock);
+            assert(txDone == tx);
+        }
+
+        CAmount amountdelta = entry.nFeeDelta;
+        if (amountdelta) {
+            mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        }
+        CValidationState state;
+        if (entry.nTime + nExpiryTimeout > nNow) {
+            LOCK(cs_main);
+            // The signatures checked ahead only stay cached if the
+            // transaction is accepted
+            AddSignatureCacheEntries(vSigCacheEntry);
+            AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, entry.nTime,
+                                       nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+            if (state.IsValid()) {
+                ++count;
+                if (entry.nFlags & MEMPOOL_DUMP_SIDECHAIN_DEPOSIT)
+                    ++deposits;
+                if (entry.nFlags & MEMPOOL_DUMP_BMM_REQUEST)
+                    ++bmm_requests;
+            } else {
+                // mempool may contain the transaction already, e.g. from
+                // wallet(s) having loaded it while we were processing
+                // mempool transactions; consider these as valid, instead of
+                // failed, but mark them as 'already there'
+                if (mempool.exists(tx->GetHash())) {
+                    ++already_there;
+                } else {
+                    EraseSignatureCacheEntries(vSigCacheEntry);
+                    ++failed;
+                }
+            }
+        } else {
+            ++expired;
+        }
+        if (ShutdownRequested())
+            return false;
+    }
+
+    for (const auto& i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.second);
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded (%i sidechain deposits, %i BMM requests), %i failed, %i expired, %i already there\n", count, deposits, bmm_requests, failed, expired, already_there);
     return true;
 }
 
@@ -5546,6 +6634,7 @@ bool DumpMempool(void)
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    std::map<uint8_t, std::vector<uint256>> mapDepositChain;
 
     {
         LOCK(mempool.cs);
@@ -5553,6 +6642,17 @@ bool DumpMempool(void)
             mapDeltas[i.first] = i.second;
         }
         vinfo = mempool.infoAll();
+
+        for (const auto& i : vinfo) {
+            if (!i.fSidechainDeposit || mapDepositChain.count(i.nSidechain))
+                continue;
+            std::vector<CTxMemPool::txiter> vChain;
+            std::vector<uint256>& vChainHash = mapDepositChain[i.nSidechain];
+            if (mempool.GetSidechainDepositChain(i.nSidechain, vChain)) {
+                for (const CTxMemPool::txiter& it : vChain)
+                    vChainHash.push_back(it->GetTx().GetHash());
+            }
+        }
     }
 
     int64_t mid = GetTimeMicros();
@@ -5570,12 +6670,25 @@ bool DumpMempool(void)
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
+            uint8_t nFlags = 0;
+            uint8_t nSidechain = 0;
+            if (i.fSidechainDeposit) {
+                nFlags |= MEMPOOL_DUMP_SIDECHAIN_DEPOSIT;
+                nSidechain = i.nSidechain;
+            } else if (i.fBMMRequest) {
+                nFlags |= MEMPOOL_DUMP_BMM_REQUEST;
+                nSidechain = i.nBMMSidechain;
+            }
+
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
+            file << nFlags;
+            file << nSidechain;
             mapDeltas.erase(i.tx->GetHash());
         }
 
+        file << mapDepositChain;
         file << mapDeltas;
         FileCommit(file.Get());
         file.fclose();
@@ -5589,93 +6702,483 @@ bool DumpMempool(void)
     return true;
 }
 
-static const uint64_t SCDB_DUMP_VERSION = 1;
+/**
+ * coincache.dat holds the version, the best block of pcoinsTip and the
+ * outpoints of its cached coins
+ */
+static const uint64_t COINCACHE_DUMP_VERSION = 1;
 
-bool LoadCustomVoteCache()
+bool DumpCoinCache()
 {
-    fs::path path = GetDataDir() / "skydoge" / "customvotes.dat";
-    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return true;
+    int64_t nStart = GetTimeMicros();
+
+    std::vector<COutPoint> vOutPoint;
+    uint256 hashBlock;
+    {
+        LOCK(cs_main);
+        if (!pcoinsTip)
+            return false;
+        vOutPoint = pcoinsTip->GetCachedOutPoints();
+        hashBlock = pcoinsTip->GetBestBlock();
     }
 
-    std::vector<std::string> vVote;
     try {
-        int64_t nVersion;
-        filein >> nVersion;
-        if (nVersion != SCDB_DUMP_VERSION) {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "coincache.dat.new", "wb");
+        if (!filestr) {
             return false;
         }
 
-        int count = 0;
-        filein >> count;
-
-        if (count != SIDECHAIN_ACTIVATION_MAX_ACTIVE)
-            return false;
-
-        for (int i = 0; i < count; i++) {
-            std::string strVote;
-            filein >> strVote;
-            vVote.push_back(strVote);
-        }
-    }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Exception: %s\n", __func__, e.what());
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << COINCACHE_DUMP_VERSION;
+        file << hashBlock;
+        file << vOutPoint;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "coincache.dat.new", GetDataDir() / "coincache.dat");
+        LogPrintf("Dumped %u cached coin outpoints: %gs\n", vOutPoint.size(), (GetTimeMicros() - nStart) * MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump the coin cache: %s. Continuing anyway.\n", e.what());
         return false;
     }
-
-    // Add to SCDB
-    if (!vVote.empty()) {
-        scdb.CacheCustomVotes(vVote);
-    }
-
     return true;
 }
 
-void DumpCustomVoteCache()
+bool LoadCoinCache()
 {
-    std::vector<std::string> vVote = scdb.GetVotes();
-
-    int count = vVote.size();
+    int64_t nStart = GetTimeMicros();
 
-    // Write the votes
-    fs::path path = GetDataDir() / "skydoge" / "customvotes.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
-        return;
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "coincache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open coin cache file from disk. Continuing anyway.\n");
+        return false;
     }
 
+    std::vector<COutPoint> vOutPoint;
+    uint256 hashBlock;
     try {
-        fileout << SCDB_DUMP_VERSION; // version required to read
-        fileout << count; // Number of deposits in file
-
-        for (const std::string& vote : vVote) {
-            fileout << vote;
+        uint64_t version;
+        file >> version;
+        if (version != COINCACHE_DUMP_VERSION) {
+            return false;
         }
+        file >> hashBlock;
+        file >> vOutPoint;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize coin cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
     }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Exception: %s\n", __func__, e.what());
-        return;
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (it == mapBlockIndex.end() || !chainActive.Contains(it->second)) {
+            LogPrintf("Coin cache file is from block %s, which isn't in the active chain. Not loading it.\n", hashBlock.ToString());
+            return false;
+        }
     }
 
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "skydoge" / "customvotes.dat.new", GetDataDir() /  "skydoge" / "customvotes.dat");
+    // The coins are looked up in the current chainstate, so it doesn't
+    // matter how far the tip has moved since. Take cs_main for one batch at
+    // a time, so that blocks and transactions can be validated in between.
+    const int nThreads = std::min(GetNumCores(), MAX_INPUT_PREFETCH_THREADS);
+    size_t nLoaded = 0;
+    for (size_t i = 0; i < vOutPoint.size(); i += COINCACHE_LOAD_BATCH) {
+        if (ShutdownRequested())
+            break;
+        LOCK(cs_main);
+        if (pcoinsTip->DynamicMemoryUsage() >= nCoinCacheUsage / 2)
+            break;
+        const size_t nEnd = std::min(vOutPoint.size(), i + COINCACHE_LOAD_BATCH);
+        nLoaded += pcoinsTip->Prefetch(std::vector<COutPoint>(vOutPoint.begin() + i, vOutPoint.begin() + nEnd), nThreads);
+    }
 
-    LogPrintf("%s: Wrote %u\n", __func__, count);
+    LogPrintf("Loaded %u of %u saved coins into the coin cache: %gs\n", nLoaded, vOutPoint.size(), (GetTimeMicros() - nStart) * MICRO);
+    return true;
 }
 
-bool LoadDepositCache()
-{
-    fs::path path = GetDataDir() / "skydoge" / "deposit.dat";
-    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return true;
-    }
+/**
+ * UTXO snapshot files (see DumpUTXOSnapshot) hold:
+ * - UTXO_SNAPSHOT_MAGIC, the version and the message start of the network
+ * - the hash, height and nChainTx of the snapshot block
+ * - the headers of the blocks from height 1 up to the snapshot block
+ * - whether SCDB state follows, then the UTXOSnapshotSCDB of the block
+ * - the coins grouped by txid in key order: the number of outputs, the txid
+ *   and the index and Coin of each output. A group of 0 outputs ends them.
+ * - the number of coins and the hash of the groups
+ */
+static const unsigned char UTXO_SNAPSHOT_MAGIC[] = {'u', 't', 'x', 'o', 0xff};
+static const uint16_t UTXO_SNAPSHOT_VERSION = 1;
+
+/** Number of txids whose coins are read from a UTXO snapshot at a time */
+static const size_t UTXO_SNAPSHOT_READ_TXIDS = 10000;
 
+namespace {
+/** The SCDB state of the block of a UTXO snapshot */
+struct UTXOSnapshotSCDB {
+    SidechainBlockData data;
+    std::map<uint8_t, SidechainCTIP> mapCTIP;
+    //! The deposits of each active sidechain, in CTIP spend order
     std::vector<SidechainDeposit> vDeposit;
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    std::vector<SidechainFailedWithdrawal> vFailed;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(data);
+        READWRITE(mapCTIP);
+        READWRITE(vDeposit);
+        READWRITE(vSpent);
+        READWRITE(vFailed);
+    }
+};
+}
+
+/** Add the deposits of a UTXO snapshot to db a chunk at a time, so that each
+ * chunk only has to be sorted after the last deposit before it */
+static void AddUTXOSnapshotDeposits(SidechainDB& db, const std::vector<SidechainDeposit>& vDeposit)
+{
+    for (size_t i = 0; i < vDeposit.size(); i += SIDECHAIN_DEPOSIT_CACHE_SIZE) {
+        const size_t nEnd = std::min<size_t>(vDeposit.size(), i + SIDECHAIN_DEPOSIT_CACHE_SIZE);
+        db.AddDeposits(std::vector<SidechainDeposit>(vDeposit.begin() + i, vDeposit.begin() + nEnd));
+    }
+}
+
+static bool SameCTIP(const std::map<uint8_t, SidechainCTIP>& a, const std::map<uint8_t, SidechainCTIP>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (auto ita = a.begin(), itb = b.begin(); ita != a.end(); ita++, itb++) {
+        if (ita->first != itb->first || ita->second.out != itb->second.out || ita->second.amount != itb->second.amount)
+            return false;
+    }
+    return true;
+}
+
+/** Write the coins of one txid to a UTXO snapshot, and to the hash of its
+ * coins */
+static void WriteUTXOSnapshotCoins(CAutoFile& file, CHashWriter& ss, const uint256& txid, const std::map<uint32_t, Coin>& outputs)
+{
+    WriteCompactSize(file, outputs.size());
+    WriteCompactSize(ss, outputs.size());
+    file << txid;
+    ss << txid;
+    for (const auto& output : outputs) {
+        file << VARINT(output.first) << output.second;
+        ss << VARINT(output.first) << output.second;
+    }
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, UTXOSnapshotInfo& info, std::string& strError)
+{
+    int64_t nStart = GetTimeMicros();
+    const CChainParams& chainparams = Params();
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<const CBlockIndex*> vHeader;
+    UTXOSnapshotSCDB scdbState;
+    {
+        LOCK(cs_main);
+        // Once everything is in the database, the cursor reads it as it is
+        // now while blocks go on being connected
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        BlockMap::const_iterator it = mapBlockIndex.find(pcursor->GetBestBlock());
+        if (it == mapBlockIndex.end() || it->second != chainActive.Tip()) {
+            strError = "The coin database isn't at the chain tip";
+            return false;
+        }
+        const CBlockIndex* pindex = it->second;
+        info.hashBlock = pindex->GetBlockHash();
+        info.nHeight = pindex->nHeight;
+        info.nChainTx = pindex->nChainTx;
+
+        vHeader.resize(pindex->nHeight);
+        for (const CBlockIndex* pindexWalk = pindex; pindexWalk->pprev; pindexWalk = pindexWalk->pprev)
+            vHeader[pindexWalk->nHeight - 1] = pindexWalk;
+
+        info.fSidechains = psidechaintree && pindex->pprev && IsDrivechainEnabled(pindex, chainparams.GetConsensus());
+        if (info.fSidechains) {
+            if (scdb.GetHashBlockLastSeen() != info.hashBlock || !psidechaintree->GetBlockData(info.hashBlock, scdbState.data)) {
+                strError = "The sidechain database isn't synced with the chain tip";
+                return false;
+            }
+            scdbState.mapCTIP = scdb.GetCTIP();
+            for (const Sidechain& sidechain : scdb.GetActiveSidechains()) {
+                std::vector<SidechainDeposit> vDeposit = scdb.GetDeposits(sidechain.nSidechain);
+                scdbState.vDeposit.insert(scdbState.vDeposit.end(), vDeposit.begin(), vDeposit.end());
+            }
+            scdbState.vSpent = scdb.GetSpentWithdrawalCache(0, std::numeric_limits<uint32_t>::max());
+            scdbState.vFailed = scdb.GetFailedWithdrawalCache(0, std::numeric_limits<uint32_t>::max());
+        }
+    }
+
+    fs::path pathTmp = path;
+    pathTmp += ".incomplete";
+    FILE* filestr = fsbridge::fopen(pathTmp, "wb");
+    if (!filestr) {
+        strError = "Failed to create " + pathTmp.string();
+        return false;
+    }
+
     try {
-        uint64_t nVersion;
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file.write((const char*)UTXO_SNAPSHOT_MAGIC, sizeof(UTXO_SNAPSHOT_MAGIC));
+        file << UTXO_SNAPSHOT_VERSION;
+        file.write((const char*)chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+        file << info.hashBlock << info.nHeight << info.nChainTx;
+
+        for (const CBlockIndex* pindex : vHeader)
+            file << pindex->GetBlockHeader();
+
+        file << info.fSidechains;
+        if (info.fSidechains)
+            file << scdbState;
+
+        CHashWriter ss(SER_DISK, CLIENT_VERSION);
+        info.nCoins = 0;
+        uint256 txid;
+        std::map<uint32_t, Coin> outputs;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested())
+                throw std::runtime_error("Shutdown requested");
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+                throw std::runtime_error("Unable to read the coin database");
+            if (!outputs.empty() && key.hash != txid) {
+                WriteUTXOSnapshotCoins(file, ss, txid, outputs);
+                outputs.clear();
+            }
+            txid = key.hash;
+            outputs[key.n] = std::move(coin);
+            info.nCoins++;
+            pcursor->Next();
+        }
+        if (!outputs.empty())
+            WriteUTXOSnapshotCoins(file, ss, txid, outputs);
+        WriteCompactSize(file, 0);
+
+        info.hashCoins = ss.GetHash();
+        file << info.nCoins << info.hashCoins;
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathTmp, path);
+    } catch (const std::exception& e) {
+        fs::remove(pathTmp);
+        strError = strprintf("Failed to write the UTXO snapshot: %s", e.what());
+        return false;
+    }
+
+    LogPrintf("Dumped UTXO snapshot of block %s (height %d): %u coins in %.2fs\n",
+        info.hashBlock.ToString(), info.nHeight, info.nCoins, (GetTimeMicros() - nStart) * MICRO);
+    return true;
+}
+
+bool LoadUTXOSnapshot(const fs::path& path, UTXOSnapshotInfo& info, std::string& strError)
+{
+    int64_t nStart = GetTimeMicros();
+    const CChainParams& chainparams = Params();
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "Failed to open " + path.string();
+        return false;
+    }
+
+    LOCK(cs_main);
+    if (chainActive.Height() != 0 || fImporting || fReindex || scdb.GetActiveSidechainCount()) {
+        strError = "A UTXO snapshot can only be loaded before any block has been connected";
+        return false;
+    }
+
+    CBlockIndex* pindex = nullptr;
+    UTXOSnapshotSCDB scdbState;
+    try {
+        unsigned char magic[sizeof(UTXO_SNAPSHOT_MAGIC)];
+        file.read((char*)magic, sizeof(magic));
+        if (memcmp(magic, UTXO_SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+            strError = "Not a UTXO snapshot";
+            return false;
+        }
+        uint16_t nVersion;
+        file >> nVersion;
+        if (nVersion != UTXO_SNAPSHOT_VERSION) {
+            strError = strprintf("Unsupported UTXO snapshot version %u", nVersion);
+            return false;
+        }
+        CMessageHeader::MessageStartChars pchMessageStart;
+        file.read((char*)pchMessageStart, sizeof(pchMessageStart));
+        if (memcmp(pchMessageStart, chainparams.MessageStart(), sizeof(pchMessageStart)) != 0) {
+            strError = "The UTXO snapshot is of another network";
+            return false;
+        }
+        file >> info.hashBlock >> info.nHeight >> info.nChainTx;
+        if (info.nHeight <= 0 || (unsigned int)info.nHeight >= info.nChainTx) {
+            strError = "Invalid UTXO snapshot block";
+            return false;
+        }
+
+        // The headers are checked like those of a peer, so that the snapshot
+        // is at least of a block of the best chain we know of
+        std::vector<CBlockHeader> vHeader;
+        for (int nHeight = 1; nHeight <= info.nHeight; nHeight++) {
+            CBlockHeader header;
+            file >> header;
+            vHeader.push_back(header);
+            if (vHeader.size() == MAX_HEADERS_RESULTS || nHeight == info.nHeight) {
+                CValidationState state;
+                if (!ProcessNewBlockHeaders(vHeader, state, chainparams)) {
+                    strError = strprintf("Invalid header in the UTXO snapshot: %s", FormatStateMessage(state));
+                    return false;
+                }
+                vHeader.clear();
+            }
+        }
+        BlockMap::iterator it = mapBlockIndex.find(info.hashBlock);
+        if (it == mapBlockIndex.end() || it->second->nHeight != info.nHeight) {
+            strError = "The headers of the UTXO snapshot don't lead to its block";
+            return false;
+        }
+        pindex = it->second;
+
+        file >> info.fSidechains;
+        if (info.fSidechains)
+            file >> scdbState;
+    } catch (const std::exception& e) {
+        strError = strprintf("Failed to read the UTXO snapshot: %s", e.what());
+        return false;
+    }
+
+    const bool fSidechains = psidechaintree && IsDrivechainEnabled(pindex, chainparams.GetConsensus());
+    if (fSidechains && !info.fSidechains) {
+        strError = "The UTXO snapshot has no sidechain state";
+        return false;
+    }
+    if (fSidechains) {
+        // Replay the deposits on a scratch SCDB first, so that nothing has
+        // been changed if they don't lead to the CTIPs of the snapshot
+        SidechainDB scdbCheck;
+        scdbCheck.ApplyLDBData(info.hashBlock, scdbState.data);
+        AddUTXOSnapshotDeposits(scdbCheck, scdbState.vDeposit);
+        if (!SameCTIP(scdbCheck.GetCTIP(), scdbState.mapCTIP)) {
+            strError = "The sidechain deposits of the UTXO snapshot don't match its CTIPs";
+            return false;
+        }
+    }
+
+    // Write everything from an empty chainstate. The snapshot block is
+    // recorded first, so that a chainstate at it is never without its
+    // nChainTx.
+    FlushStateToDisk();
+    if (!pblocktree->WriteUTXOSnapshotBase(info.hashBlock, info.nChainTx)) {
+        strError = "Failed to write to the block index database";
+        return false;
+    }
+
+    CHashWriter ss(SER_DISK, CLIENT_VERSION);
+    uint256 txidPrev;
+    bool fEnd = false;
+    std::string strReadError;
+    info.nCoins = 0;
+    auto fRead = [&](std::vector<std::pair<COutPoint, Coin>>& vCoins) {
+        try {
+            for (size_t i = 0; i < UTXO_SNAPSHOT_READ_TXIDS && !fEnd; i++) {
+                const uint64_t nOutputs = ReadCompactSize(file);
+                if (nOutputs == 0) {
+                    uint64_t nCoins;
+                    file >> nCoins >> info.hashCoins;
+                    if (nCoins != info.nCoins || info.hashCoins != ss.GetHash()) {
+                        strReadError = "The coins of the UTXO snapshot don't match its hash";
+                        return false;
+                    }
+                    fEnd = true;
+                    break;
+                }
+
+                uint256 txid;
+                file >> txid;
+                if (info.nCoins && !(txidPrev < txid)) {
+                    strReadError = "The coins of the UTXO snapshot are out of order";
+                    return false;
+                }
+                WriteCompactSize(ss, nOutputs);
+                ss << txid;
+                for (uint64_t j = 0; j < nOutputs; j++) {
+                    COutPoint outpoint(txid, 0);
+                    Coin coin;
+                    file >> VARINT(outpoint.n) >> coin;
+                    if ((j && outpoint.n <= vCoins.back().first.n) || coin.IsSpent() || coin.nHeight > (uint32_t)info.nHeight) {
+                        strReadError = strprintf("Invalid coin %s in the UTXO snapshot", outpoint.ToString());
+                        return false;
+                    }
+                    ss << VARINT(outpoint.n) << coin;
+                    vCoins.emplace_back(outpoint, std::move(coin));
+                }
+                info.nCoins += nOutputs;
+                txidPrev = txid;
+            }
+        } catch (const std::exception& e) {
+            strReadError = strprintf("Failed to read the UTXO snapshot: %s", e.what());
+            return false;
+        }
+        if (ShutdownRequested()) {
+            strReadError = "Shutdown requested";
+            return false;
+        }
+        return true;
+    };
+    if (!pcoinsdbview->LoadUTXOSnapshot(info.hashBlock, fRead)) {
+        pblocktree->WriteUTXOSnapshotBase(uint256(), 0);
+        strError = strReadError.empty() ? "Failed to write to the coin database" : strReadError;
+        return false;
+    }
+
+    // The cache above the database was flushed empty, only its best block
+    // has to follow
+    pcoinsTip->SetBestBlock(info.hashBlock);
+    g_chainstate.LoadUTXOSnapshotBase(pindex, info.nChainTx);
+
+    if (fSidechains) {
+        if (!psidechaintree->WriteSidechainBlockData(info.hashBlock, pindex->pprev->GetBlockHash(), pindex->nHeight, scdbState.data) ||
+                !scdb.SetDepositDB(psidechaintree.get())) {
+            strError = "Failed to write to the sidechain database, restart with -reindex-chainstate";
+            return false;
+        }
+        scdb.ApplyLDBData(info.hashBlock, scdbState.data);
+        AddUTXOSnapshotDeposits(scdb, scdbState.vDeposit);
+        scdb.AddSpentWithdrawals(scdbState.vSpent);
+        scdb.AddFailedWithdrawals(scdbState.vFailed);
+        UpdateSidechainMetrics(scdb);
+    }
+
+    FlushStateToDisk();
+    const bool fInitialDownload = IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(pindex, chainActive.Genesis(), fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, pindex);
+
+    LogPrintf("Loaded UTXO snapshot of block %s (height %d): %u coins in %.2fs\n",
+        info.hashBlock.ToString(), info.nHeight, info.nCoins, (GetTimeMicros() - nStart) * MICRO);
+    return true;
+}
+
+static const uint64_t SCDB_DUMP_VERSION = 1;
+
+bool LoadCustomVoteCache()
+{
+    fs::path path = GetDataDir() / "skydoge" / "customvotes.dat";
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return true;
+    }
+
+    std::vector<std::string> vVote;
+    try {
+        int64_t nVersion;
         filein >> nVersion;
         if (nVersion != SCDB_DUMP_VERSION) {
             return false;
@@ -5683,10 +7186,14 @@ bool LoadDepositCache()
 
         int count = 0;
         filein >> count;
+
+        if (count != SIDECHAIN_ACTIVATION_MAX_ACTIVE)
+            return false;
+
         for (int i = 0; i < count; i++) {
-            SidechainDeposit deposit;
-            filein >> deposit;
-            vDeposit.push_back(deposit);
+            std::string strVote;
+            filein >> strVote;
+            vVote.push_back(strVote);
         }
     }
     catch (const std::exception& e) {
@@ -5695,50 +7202,78 @@ bool LoadDepositCache()
     }
 
     // Add to SCDB
-    if (!vDeposit.empty()) {
-        scdb.AddDeposits(vDeposit);
-        mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), false /* fDisconnect */);
+    if (!vVote.empty()) {
+        scdb.CacheCustomVotes(vVote);
     }
 
     return true;
 }
 
-void DumpDepositCache()
+bool LoadDepositCache()
 {
-    std::vector<SidechainDeposit> vDeposit;
-    std::vector<Sidechain> vSidechain = scdb.GetActiveSidechains();
-    for (const Sidechain& s : vSidechain) {
-        std::vector<SidechainDeposit> vSidechainDeposit = scdb.GetDeposits(s.nSidechain);
-        vDeposit.insert(std::end(vDeposit), std::begin(vSidechainDeposit), std::end(vSidechainDeposit));
+    // The deposits are written right before the chainstate, if we stopped
+    // before the chainstate was written they are ahead of the chain tip
+    if (!psidechaintree->RewindDeposits(pcoinsTip->GetBestBlock())) {
+        LogPrintf("%s: Failed to roll deposits back to the chain tip\n", __func__);
+        return false;
     }
 
+    // Deposits are stored in the sidechain tree database
+    if (!scdb.SetDepositDB(psidechaintree.get())) {
+        LogPrintf("%s: Failed to load deposits from sidechain tree database\n", __func__);
+        return false;
+    }
 
-    // Write the deposits
-    fs::path path = GetDataDir() / "skydoge" / "deposit.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
-        return;
+    // Import deposit.dat written by older versions which kept every deposit
+    // in memory
+    fs::path path = GetDataDir() / "skydoge" / "deposit.dat";
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), false /* fDisconnect */);
+        return true;
     }
 
-    int count = vDeposit.size();
+    std::vector<SidechainDeposit> vDeposit;
     try {
-        fileout << SCDB_DUMP_VERSION; // version required to read
-        fileout << count; // Number of deposits in file
+        uint64_t nVersion;
+        filein >> nVersion;
+        if (nVersion != SCDB_DUMP_VERSION) {
+            return false;
+        }
 
-        for (const SidechainDeposit& d : vDeposit) {
-            fileout << d;
+        int count = 0;
+        filein >> count;
+        for (int i = 0; i < count; i++) {
+            SidechainDeposit deposit;
+            filein >> deposit;
+            vDeposit.push_back(std::move(deposit));
         }
     }
     catch (const std::exception& e) {
         LogPrintf("%s: Exception: %s\n", __func__, e.what());
-        return;
+        return false;
     }
+    filein.fclose();
 
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "skydoge" / "deposit.dat.new", GetDataDir() /  "skydoge" / "deposit.dat");
+    // Add to SCDB
+    if (!vDeposit.empty())
+        scdb.ImportDeposits(vDeposit);
 
-    LogPrintf("%s: Wrote %u\n", __func__, count);
+    mempool.UpdateCTIPFromBlock(scdb.GetCTIP(), false /* fDisconnect */);
+
+    // Write the deposits to disk before the file is removed
+    if (!scdb.FlushDeposits(pcoinsTip->GetBestBlock(), pcoinsTip->GetBestBlock()))
+        return false;
+
+    try {
+        fs::remove(path);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("%s: Failed to remove %s: %s\n", __func__, path.string(), e.what());
+    }
+
+    LogPrintf("%s: Imported %u deposits\n", __func__, vDeposit.size());
+
+    return true;
 }
 
 bool LoadWithdrawalCache(bool fReindex)
@@ -5795,7 +7330,7 @@ bool LoadWithdrawalCache(bool fReindex)
     // Add to SCDB
 
     for (const std::pair<uint8_t, CTransactionRef>& pair : vWithdrawal) {
-        if (!scdb.CacheWithdrawalTx(*pair.second.get(), pair.first))
+        if (!scdb.CacheWithdrawalTx(pair.second, pair.first))
             return false;
     }
 
@@ -5807,54 +7342,6 @@ bool LoadWithdrawalCache(bool fReindex)
     return true;
 }
 
-void DumpWithdrawalCache()
-{
-    std::vector<std::pair<uint8_t, CMutableTransaction>> vWithdrawal = scdb.GetWithdrawalTxCache();
-    std::vector<SidechainSpentWithdrawal> vSpent = scdb.GetSpentWithdrawalCache();
-    std::vector<SidechainFailedWithdrawal> vFailed = scdb.GetFailedWithdrawalCache();
-
-    int nWithdrawal = vWithdrawal.size();
-    int nSpent = vSpent.size();
-    int nFailed = vFailed.size();
-
-    // Write the Withdrawal raw tx cache & spent Withdrawal cache
-    fs::path path = GetDataDir() / "skydoge" / "withdrawal.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
-        return;
-    }
-
-    try {
-        fileout << SCDB_DUMP_VERSION; // version required to read
-
-        fileout << nWithdrawal; // Number of Withdrawal(s) in file
-        for (const std::pair<uint8_t, CMutableTransaction>& pair : vWithdrawal) {
-            fileout << pair.first;
-            fileout << MakeTransactionRef(pair.second);
-        }
-
-        fileout << nSpent; // Number of spent Withdrawal(s) in file
-        for (const SidechainSpentWithdrawal& s : vSpent) {
-            fileout << s;
-        }
-
-        fileout << nFailed; // Number of failed Withdrawal(s) in file
-        for (const SidechainFailedWithdrawal& f : vFailed) {
-            fileout << f;
-        }
-    }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Exception: %s\n", __func__, e.what());
-        return;
-    }
-
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "skydoge" / "withdrawal.dat.new", GetDataDir() /  "skydoge" / "withdrawal.dat");
-
-    LogPrintf("%s: Wrote %u Withdrawal, %u spent, %u failed\n", __func__, nWithdrawal, nSpent, nFailed);
-}
-
 bool LoadBMMCache()
 {
     fs::path path = GetDataDir() / "skydoge" / "bmm.dat";
@@ -5891,38 +7378,6 @@ bool LoadBMMCache()
     return true;
 }
 
-void DumpBMMCache()
-{
-    std::set<uint256> setRemovedBMM = scdb.GetRemovedBMM();
-
-    int count = setRemovedBMM.size();
-
-    // Write the sidechain activation status cache
-    fs::path path = GetDataDir() / "skydoge" / "bmm.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "w"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
-        return;
-    }
-
-    try {
-        fileout << SCDB_DUMP_VERSION; // version required to read
-        fileout << count; // Number of txid in file
-
-        for (const uint256& u : setRemovedBMM) {
-            fileout << u;
-        }
-    }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Exception: %s\n", __func__, e.what());
-    }
-
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "skydoge" / "bmm.dat.new", GetDataDir() /  "skydoge" / "bmm.dat");
-
-    LogPrintf("%s: Wrote %u\n", __func__, count);
-}
-
 bool LoadSidechainProposalCache()
 {
     fs::path path = GetDataDir() / "skydoge" / "sidechainproposals.dat";
@@ -5958,38 +7413,6 @@ bool LoadSidechainProposalCache()
     return true;
 }
 
-void DumpSidechainProposalCache()
-{
-    std::vector<Sidechain> vProposal = scdb.GetSidechainProposals();
-
-    int count = vProposal.size();
-
-    // Write the sidechain proposal cache
-    fs::path path = GetDataDir() / "skydoge" / "sidechainproposals.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "w"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
-        return;
-    }
-
-    try {
-        fileout << SCDB_DUMP_VERSION; // version required to read
-        fileout << count; // Number of proposals in file
-
-        for (const Sidechain& s : vProposal) {
-            fileout << s;
-        }
-    }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Exception: %s\n", __func__, e.what());
-    }
-
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "skydoge" / "sidechainproposals.dat.new", GetDataDir() /  "skydoge" / "sidechainproposals.dat");
-
-    LogPrintf("%s: Wrote %u\n", __func__, count);
-}
-
 bool LoadSidechainActivationHashCache()
 {
     fs::path path = GetDataDir() / "skydoge" / "sidechainhashactivate.dat";
@@ -6026,38 +7449,6 @@ bool LoadSidechainActivationHashCache()
     return true;
 }
 
-void DumpSidechainActivationHashCache()
-{
-    std::vector<uint256> vHash = scdb.GetSidechainsToActivate();
-
-    int count = vHash.size();
-
-    // Write the sidechain activation hash cache
-    fs::path path = GetDataDir() / "skydoge" / "sidechainhashactivate.dat.new";
-    CAutoFile fileout(fsbridge::fopen(path, "w"), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull()) {
-        return;
-    }
-
-    try {
-        fileout << SCDB_DUMP_VERSION; // version required to read
-        fileout << count; // Number of hashes in file
-
-        for (const uint256& u : vHash) {
-            fileout << u;
-        }
-    }
-    catch (const std::exception& e) {
-        LogPrintf("%s: Exception: %s\n", __func__, e.what());
-    }
-
-    FileCommit(fileout.Get());
-    fileout.fclose();
-    RenameOver(GetDataDir() / "skydoge" / "sidechainhashactivate.dat.new", GetDataDir() /  "skydoge" / "sidechainhashactivate.dat");
-
-    LogPrintf("%s: Wrote %u\n", __func__, count);
-}
-
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
     if (pindex == nullptr)
@@ -6104,7 +7495,7 @@ bool GetTxOutProof(const uint256& txid, const uint256& hashBlock, std::string& s
     CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
     CMerkleBlock mb(block, setTxids);
     ssMB << mb;
-    strProof = HexStr(ssMB.begin(), ssMB.end());
+    strProof = HexStr(ssMB.data(), ssMB.data() + ssMB.size());
 
     return true;
 }
@@ -6128,23 +7519,236 @@ bool VerifyTxOutProof(const std::string& strProof)
     return true;
 }
 
+/** Set once the SCDB caches have been loaded, so that a flush during init
+ * doesn't overwrite the snapshot with empty caches */
+static std::atomic<bool> fSCDBCacheLoaded(false);
+
+static fs::path GetSCDBCachePath()
+{
+    return GetDataDir() / "skydoge" / "scdb.dat";
+}
+
+static fs::path GetSCDBLogPath()
+{
+    return GetDataDir() / "skydoge" / "scdb.log";
+}
+
+/** Apply the changes logged since the SCDB cache file was written */
+static bool ReplaySCDBLog(bool fReindex)
+{
+    size_t nRecords = 0;
+    bool fRet = CSCDBLog::Replay(GetSCDBLogPath(), [fReindex](CDataStream& s) {
+        return scdb.ApplyLogRecord(s, fReindex);
+    }, nRecords);
+
+    LogPrintf("%s: Replayed %u SCDB cache log records\n", __func__, nRecords);
+
+    return fRet;
+}
+
+/**
+ * The spent & failed withdrawals of the cache files may include those of
+ * blocks that aren't in our chain, if they were written at another block than
+ * the chain tip SCDB has been resynced to, or the log goes on past the tip
+ * because we stopped before the chainstate was flushed. Rebuild them from
+ * what was loaded: keep the spends of blocks in the active chain, and the
+ * failures of withdrawals that aren't waiting for votes any more.
+ */
+static void RemoveStaleWithdrawalHistory()
+{
+    const size_t nRemoved = scdb.RemoveStaleWithdrawalHistory([](const uint256& hash) {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        return it != mapBlockIndex.end() && chainActive.Contains(it->second);
+    });
+    if (nRemoved)
+        LogPrintf("%s: Removed %u spent & failed withdrawals that aren't in the chain\n", __func__, nRemoved);
+}
+
+bool LoadSCDBCache(bool fReindex)
+{
+    fs::path path = GetSCDBCachePath();
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        // Import the separate cache files written by older versions
+        bool fRet = LoadSidechainProposalCache() &&
+                LoadSidechainActivationHashCache() &&
+                LoadCustomVoteCache() &&
+                LoadBMMCache() &&
+                LoadWithdrawalCache(fReindex) &&
+                ReplaySCDBLog(fReindex);
+        if (fRet && !fReindex)
+            RemoveStaleWithdrawalHistory();
+        fSCDBCacheLoaded = true;
+        return fRet;
+    }
+
+    uint256 hashBlock;
+    std::vector<std::string> vVote;
+    std::vector<std::pair<uint8_t, CTransactionRef>> vWithdrawal;
+    std::vector<SidechainSpentWithdrawal> vSpent;
+    std::vector<SidechainFailedWithdrawal> vFailed;
+    std::vector<Sidechain> vProposal;
+    std::vector<uint256> vHashActivate;
+    std::set<uint256> setRemovedBMM;
+    try {
+        uint64_t nVersion;
+        filein >> nVersion;
+        if (nVersion != SCDB_DUMP_VERSION) {
+            return false;
+        }
+
+        filein >> hashBlock;
+        filein >> vVote;
+        filein >> vWithdrawal;
+        filein >> vSpent;
+        filein >> vFailed;
+        filein >> vProposal;
+        filein >> vHashActivate;
+        filein >> setRemovedBMM;
+    }
+    catch (const std::exception& e) {
+        LogPrintf("%s: Exception: %s\n", __func__, e.what());
+        return false;
+    }
+    filein.fclose();
+
+    // Add to SCDB
+    fSCDBCacheLoaded = true;
+
+    scdb.CacheSidechainProposals(vProposal);
+
+    for (const uint256& u : vHashActivate)
+        scdb.CacheSidechainHashToAck(u);
+
+    if (vVote.size() == SIDECHAIN_ACTIVATION_MAX_ACTIVE)
+        scdb.CacheCustomVotes(vVote);
+
+    for (const uint256& u : setRemovedBMM)
+        scdb.AddRemovedBMM(u);
+
+    for (const std::pair<uint8_t, CTransactionRef>& pair : vWithdrawal) {
+        if (!scdb.CacheWithdrawalTx(pair.second, pair.first))
+            return false;
+    }
+
+    // Spent & failed withdrawals come from the chain, they are rebuilt when
+    // reindexing
+    if (!fReindex) {
+        scdb.AddSpentWithdrawals(vSpent);
+        scdb.AddFailedWithdrawals(vFailed);
+    }
+
+    LogPrintf("%s: Loaded SCDB cache written at block %s\n", __func__, hashBlock.ToString());
+
+    // SCDB has been resynced to the chain tip, check what the snapshot was
+    // written for
+    const uint256 hashTip = scdb.GetHashBlockLastSeen();
+    if (hashBlock != hashTip)
+        LogPrintf("%s: SCDB cache was written at block %s, not the chain tip %s\n", __func__,
+                hashBlock.ToString(), hashTip.ToString());
+
+    if (!ReplaySCDBLog(fReindex))
+        return false;
+    if (!fReindex)
+        RemoveStaleWithdrawalHistory();
+
+    return true;
+}
+
 void DumpSCDBCache()
 {
-    // TODO make configurable
+    if (!fSCDBCacheLoaded)
+        return;
+
+    const std::vector<std::pair<uint8_t, CTransactionRef>>& vWithdrawal = scdb.GetWithdrawalTxCache();
+    std::vector<SidechainSpentWithdrawal> vSpent = scdb.GetSpentWithdrawalCache();
+    std::vector<SidechainFailedWithdrawal> vFailed = scdb.GetFailedWithdrawalCache();
+
+    // Serialize SidechainDB caches & user settings for a single file
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << SCDB_DUMP_VERSION; // version required to read
+    ss << scdb.GetHashBlockLastSeen();
+    ss << scdb.GetVotes();
+    ss << vWithdrawal;
+    ss << vSpent;
+    ss << vFailed;
+    ss << scdb.GetSidechainProposals();
+    ss << scdb.GetSidechainsToActivate();
+    ss << scdb.GetRemovedBMM();
+
+    // The changes since are in the log, so the file can be written in the
+    // background. The log is emptied once it has been written.
+    if (g_scdblog) {
+        g_scdblog->Compact(std::vector<unsigned char>(ss.begin(), ss.end()));
+        return;
+    }
 
     // Create ~/.skydoge/skydoge
     TryCreateDirectories(GetDataDir() / "skydoge");
 
-    // Dump SidechainDB, sidechain activation & optional caches
-    DumpDepositCache();
-    DumpCustomVoteCache();
-    DumpWithdrawalCache();
-    DumpSidechainProposalCache();
-    DumpSidechainActivationHashCache();
-    DumpBMMCache();
+    fs::path path = GetDataDir() / "skydoge" / "scdb.dat.new";
+    CAutoFile fileout(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return;
+    }
+
+    try {
+        fileout.write(ss.data(), ss.size());
+    }
+    catch (const std::exception& e) {
+        LogPrintf("%s: Exception: %s\n", __func__, e.what());
+        return;
+    }
+
+    FileCommit(fileout.Get());
+    fileout.fclose();
+    RenameOver(path, GetSCDBCachePath());
+
+    // The separate files of older versions have been replaced
+    for (const char* strFile : {"customvotes.dat", "withdrawal.dat", "sidechainproposals.dat", "sidechainhashactivate.dat", "bmm.dat"}) {
+        try {
+            fs::remove(GetDataDir() / "skydoge" / strFile);
+        } catch (const fs::filesystem_error& e) {
+            LogPrintf("%s: Failed to remove %s: %s\n", __func__, strFile, e.what());
+        }
+    }
+
+    LogPrintf("%s: Wrote %u Withdrawal, %u spent, %u failed\n", __func__, vWithdrawal.size(), vSpent.size(), vFailed.size());
 }
 
-bool ResyncSCDB(const CBlockIndex* pindex)
+bool StartSCDBLog()
+{
+    if (g_scdblog || !fSCDBCacheLoaded)
+        return true;
+
+    // Everything loaded, including the replayed log, goes into the cache
+    // file before the log is emptied
+    DumpSCDBCache();
+
+    g_scdblog.reset(new CSCDBLog(GetSCDBCachePath(), GetSCDBLogPath()));
+    if (!g_scdblog->Start()) {
+        g_scdblog.reset();
+        return false;
+    }
+    scdb.SetLog(g_scdblog.get());
+
+    return true;
+}
+
+void StopSCDBLog()
+{
+    if (!g_scdblog) {
+        DumpSCDBCache();
+        return;
+    }
+
+    scdb.SetLog(nullptr);
+    g_scdblog->Stop();
+    g_scdblog.reset();
+}
+
+bool ResyncSCDB(const CBlockIndex* pindex, unsigned int nBlocksBack)
 {
     uiInterface.InitMessage(_("Resyncing sidechain database..."));
 
@@ -6158,7 +7762,8 @@ bool ResyncSCDB(const CBlockIndex* pindex)
         return false;
     }
 
-    scdb.ApplyLDBData(pindex->GetBlockHash(), data);
+    scdb.ApplyLDBData(pindex->GetBlockHash(), data, nBlocksBack);
+    UpdateSidechainMetrics(scdb);
 
     LogPrintf("%s: SCDB resync to block %s complete.\n",
             __func__, pindex->GetBlockHash().ToString());
@@ -6166,6 +7771,74 @@ bool ResyncSCDB(const CBlockIndex* pindex)
     return true;
 }
 
+void StartReindexChainState(const CBlockIndex* pindexTarget, bool fSidechains)
+{
+    LOCK(cs_main);
+
+    pindexReindexTarget = pindexTarget ? pindexTarget : pindexBestHeader;
+    nReindexTimeStart = GetTime();
+    if (pindexReindexTarget)
+        LogPrintf("%s: Replaying blocks up to %s (height %d)\n", __func__,
+                pindexReindexTarget->GetBlockHash().ToString(), pindexReindexTarget->nHeight);
+
+    if (!fSidechains)
+        return;
+
+    // The sidechain tree database has the SCDB state of every connected
+    // block. Publish that of the previous tip and hold it while SCDB is
+    // replayed from genesis, so the sidechain state stays available.
+    const bool fHaveDeposits = scdb.SetDepositDB(psidechaintree.get());
+    if (pindexTarget && fHaveDeposits && ResyncSCDB(pindexTarget)) {
+        scdb.HoldView(true);
+        LogPrintf("%s: Serving the SCDB state of block %s until the replay reaches it\n", __func__,
+                pindexTarget->GetBlockHash().ToString());
+    }
+
+    // Start over from genesis. The deposit database stays set, its deposits
+    // are rewritten from the first one as the blocks are replayed.
+    scdb.Reset();
+}
+
+void FinishReindexChainState()
+{
+    LOCK(cs_main);
+
+    if (!pindexReindexTarget)
+        return;
+
+    LogPrintf("%s: Replayed the chainstate up to height %d in %ds\n", __func__,
+            chainActive.Height(), GetTime() - nReindexTimeStart);
+    pindexReindexTarget = nullptr;
+    if (scdb.IsViewHeld())
+        scdb.HoldView(false);
+}
+
+bool GetReindexChainStateProgress(ReindexChainStateProgress& progress)
+{
+    LOCK(cs_main);
+
+    if (!pindexReindexTarget)
+        return false;
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    progress.nHeight = chainActive.Height();
+    progress.nTargetHeight = pindexReindexTarget->nHeight;
+    progress.nTimeStart = nReindexTimeStart;
+    progress.fSCDBHeld = scdb.IsViewHeld();
+
+    // Transactions are a better measure of the work left than blocks
+    progress.dProgress = 0;
+    if (pindexTip && pindexReindexTarget->nChainTx)
+        progress.dProgress = std::min(1.0, (double)pindexTip->nChainTx / pindexReindexTarget->nChainTx);
+
+    progress.nETA = -1;
+    const int64_t nElapsed = GetTime() - nReindexTimeStart;
+    if (progress.dProgress > 0 && nElapsed > 0)
+        progress.nETA = nElapsed * (1 - progress.dProgress) / progress.dProgress;
+
+    return true;
+}
+
 double GetNetworkHashPerSecond(int nLookup, int nHeight)
 {
     CBlockIndex *pb = chainActive.Tip();
@@ -6282,9 +7955,6 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
+        FreeBlockIndex();
     }
 } instance_of_cmaincleanup;
@@ -16,6 +16,7 @@
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <policy/feerate.h>
 #include <script/script_error.h>
+#include <sidechain.h>
 #include <sync.h>
 #include <versionbits.h>
 
@@ -33,10 +34,13 @@
 class AddressBook;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
+class CCoinsViewBackgroundFlush;
 class CCoinsViewDB;
 class CInv;
 class CConnman;
+class CDataStream;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
@@ -46,6 +50,7 @@ class SidechainWithdrawalState;
 class CSidechainTreeDB;
 class OPReturnDB;
 struct ChainTxData;
+struct CDiskTxPos;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
@@ -85,8 +90,20 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of threads looking up the inputs of a block before it is
+ * connected */
+static const int MAX_INPUT_PREFETCH_THREADS = 8;
+/** Minimum number of headers per thread when hashing a batch of headers */
+static const size_t MIN_HEADERS_PER_HASH_THREAD = 64;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the number of blocks requested from a single peer during initial block download,
+ *  where it is sized from how fast the peer has been delivering blocks. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER_IBD = 4;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER_IBD = 128;
+/** Time (in microseconds) beyond its round trip that the blocks in flight from a peer should keep it busy
+ *  during initial block download. */
+static const int64_t BLOCK_DOWNLOAD_QUEUE_TIME = 2 * 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -99,9 +116,15 @@ static const int MAX_CMPCTBLOCK_DEPTH = 5;
 static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
- *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
- *  want to make this a per-peer adaptive value at some point. */
+ *  degree of disordering of blocks on disk (which make reindexing and pruning harder). */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Largest the block download window is widened to during initial block download, while validation
+ *  is waiting for a block at the start of the window. Not used when pruning. */
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 4 * BLOCK_DOWNLOAD_WINDOW;
+/** A block at the start of the download window is requested from another peer once it has been in flight
+ *  for this many times longer than that peer would take to deliver it, and that peer is at least this many
+ *  times faster. */
+static const int BLOCK_REREQUEST_FACTOR = 2;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -134,10 +157,21 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -undocompresslevel, 0 writes the undo data uncompressed */
+static const int DEFAULT_UNDO_COMPRESS_LEVEL = 0;
+/** Default for -blockcompresslevel, 0 writes blocks uncompressed */
+static const int DEFAULT_BLOCK_COMPRESS_LEVEL = 0;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_BMMINDEX = false;
+/** Default for -checkheaderhashes */
+static const bool DEFAULT_CHECK_HEADER_HASHES = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistcoincache */
+static const bool DEFAULT_PERSIST_COINCACHE = true;
+/** Number of coins LoadCoinCache looks up at a time under cs_main */
+static const size_t COINCACHE_LOAD_BATCH = 4096;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -168,6 +202,9 @@ extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap& mapBlockIndex;
+/** The entries of mapBlockIndex no other entry builds on. chainActive.Tip()
+ * is one of them unless headers beyond it are known. Requires cs_main. */
+extern const std::set<CBlockIndex*>& setBlockIndexTips;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockWeight;
 extern uint256 hashTarget;
@@ -179,13 +216,17 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
+extern bool fBMMIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCMPCTWit;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** zlib level to compress the undo data of new blocks with, 0 for none */
+extern int nUndoCompressLevel;
+/** zlib level to compress new blocks with, 0 for none */
+extern int nBlockCompressLevel;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -213,6 +254,8 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** Number of SCDB checkpoints kept beyond MIN_BLOCKS_TO_KEEP, 0 keeps all */
+extern int nSidechainDBRetention;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 /** Minimum blocks required to signal NODE_NETWORK_LIMITED */
@@ -252,6 +295,14 @@ static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
  */
 bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock);
 
+/**
+ * Compute and memoize the hashes of a batch of headers (for example a whole
+ * HEADERS message), spreading large batches over several threads.
+ *
+ * Call without cs_main held.
+ */
+void CacheBlockHeaderHashes(const std::vector<CBlockHeader>& headers);
+
 /**
  * Process incoming block headers.
  *
@@ -286,6 +337,9 @@ void CompactWitBlockIndex();
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Recompute the hashes of the loaded block headers, which LoadBlockIndex
+ * takes from the block tree db keys, and abort if one doesn't match */
+void ThreadCheckHeaderHashes();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -334,6 +388,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/** Largest chain of deposits AcceptSidechainDepositPackage takes */
+static const unsigned int MAX_DEPOSIT_PACKAGE_COUNT = DEFAULT_ANCESTOR_LIMIT;
+
+/**
+ * Add a chain of sidechain deposits to the memory pool, each spending the
+ * CTIP output of the one before it. The scripts of the whole package are
+ * checked at once on the script check threads before the deposits are
+ * accepted in order. Either all of them end up in the mempool or none.
+ */
+bool AcceptSidechainDepositPackage(CTxMemPool& pool, CValidationState& state, const std::vector<CTransactionRef>& vtx, const CAmount nAbsurdFee);
+
+/** Script verification flags AcceptToMemoryPool checks transactions with */
+unsigned int GetMempoolScriptVerifyFlags(const CChainParams& chainparams);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -420,7 +488,24 @@ void InitScriptExecutionCache();
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the block of pindex. Blocks whose scripts we have validated are
+ * trusted: if the header read back is the one in the index, its proof of
+ * work isn't checked and its hash isn't computed again, unless fCheckPoW. */
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPoW = false);
+/** Read the block as it is serialized on disk, only checking the magic and
+ * size in front of it */
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Read the transaction at a -txindex position and the hash of its block.
+ * The offset is into the serialized block, so compressed records are
+ * inflated first. */
+bool ReadTxFromDisk(const CDiskTxPos& postx, CTransactionRef& txOut, uint256& hashBlock);
+/** Set in the size in the index header of a block or undo record whose data
+ * is stored deflated, see -blockcompresslevel and -undocompresslevel */
+static const uint32_t RECORD_COMPRESSED_FLAG = 0x80000000;
+/** Inflate the data of a compressed block or undo record into ssOut */
+bool UncompressRecord(const unsigned char* pData, size_t nData, CDataStream& ssOut);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -430,6 +515,15 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
+/** Check a block made of mempool transactions without connecting it: the
+ * header, block limits and commitments, and the SCDB update of the coinbase.
+ * Transactions not in the mempool, the withdrawal payouts and critical data
+ * fee tx a miner adds, have their inputs, scripts and withdrawal spend
+ * checked. Mempool transactions are trusted, their inputs and scripts
+ * aren't checked again, and neither are the block's total fees against the
+ * coinbase. Only works on top of our current best block, with cs_main held. */
+bool TestBlockValidityLight(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev);
+
 /** Check whether witness commitments are required for block. */
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
 
@@ -462,6 +556,9 @@ void GenerateSidechainActivationCommitment(CBlock& block, const uint256& hash);
 
 bool GenerateSCDBByteCommitment(CBlock& block, CScript& scriptOut, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, const std::vector<std::string>& vVote);
 
+/** Generate SCDB update bytes from votes already resolved to withdrawal indexes */
+bool GenerateSCDBByteCommitment(CBlock& block, CScript& scriptOut, const std::vector<std::vector<SidechainWithdrawalState>>& vScores, const SCDBVotes& votes);
+
 CScript GetNewsTokyoDailyHeader();
 CScript GetNewsUSDailyHeader();
 
@@ -497,6 +594,9 @@ extern CChain& chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
+/** Global variable that points to the layer writing flushed coins to pcoinsdbview in the background, if any */
+extern std::unique_ptr<CCoinsViewBackgroundFlush> pcoinsflush;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 
@@ -529,55 +629,107 @@ static const unsigned int REJECT_INTERNAL = 0x100;
 /** Too high fee. Can not be triggered by P2P transactions */
 static const unsigned int REJECT_HIGHFEE = 0x100;
 
+/** Collect the BMM h* commitments (nSidechain, h*) in a block's coinbase
+ * whose prev block bytes match the block's parent. */
+void GetBMMCommits(const CBlock& block, std::vector<std::pair<uint8_t, uint256>>& vCommit);
+
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
+/** The drivechain stages of ConnectBlock that are timed separately */
+enum ConnectBlockStage
+{
+    //! Looking for sidechain inputs and deposit outputs in each transaction
+    CONNECT_STAGE_SIDECHAIN_SCAN = 0,
+    //! Converting deposit transactions and adding them to SCDB
+    CONNECT_STAGE_DEPOSITS,
+    //! Checking and spending withdrawal bundles
+    CONNECT_STAGE_WITHDRAWALS,
+    //! SidechainDB::Update with the coinbase
+    CONNECT_STAGE_SCDB_UPDATE,
+    //! Updating the CTIP of mempool deposits
+    CONNECT_STAGE_MEMPOOL_CTIP,
+    //! Writing the block's SCDB data to the sidechain tree DB
+    CONNECT_STAGE_SIDECHAIN_TREE,
+    //! All of ConnectBlock, for comparison
+    CONNECT_STAGE_TOTAL,
+    CONNECT_STAGE_COUNT,
+};
+
+/** Number of recently connected blocks ConnectBlockStageStats keeps times for */
+static const size_t CONNECT_BLOCK_STATS_WINDOW = 1000;
+
+struct ConnectBlockStageStats
+{
+    std::string strName;
+    //! Time spent on the stage by the most recently connected blocks
+    std::vector<int64_t> vRecentMicros;
+    //! Totals since startup
+    int64_t nTotalMicros;
+    uint64_t nTotalItems;
+    uint64_t nBlocks;
+};
+
+/** Get the time spent on each ConnectBlockStage, indexed by stage.
+ * cs_main must be held. */
+std::vector<ConnectBlockStageStats> GetConnectBlockStats();
+
+
 /** Dump the mempool to disk. */
 bool DumpMempool();
 
 /** Load the mempool from disk. */
 bool LoadMempool();
 
+/** Save the outpoints of the coins in pcoinsTip, the ones in use since the
+ * last flush, to disk. Must be called before the coins cache is flushed. */
+bool DumpCoinCache();
+
+/** Look up the coins saved by DumpCoinCache and cache them in pcoinsTip, a
+ * batch at a time and up to half of -dbcache. Nothing is loaded if the block
+ * they were saved at isn't in the active chain anymore. */
+bool LoadCoinCache();
+
+/** Description of a UTXO snapshot */
+struct UTXOSnapshotInfo {
+    uint256 hashBlock;
+    int nHeight = 0;
+    unsigned int nChainTx = 0;
+    uint64_t nCoins = 0;
+    //! Hash of the coins, checked when loading
+    uint256 hashCoins;
+    //! Whether the snapshot carries the SCDB state of its block
+    bool fSidechains = false;
+};
+
+/** Write the coins of the chain tip, the headers leading to it and its SCDB
+ * state to path. */
+bool DumpUTXOSnapshot(const fs::path& path, UTXOSnapshotInfo& info, std::string& strError);
+
+/** Load a UTXO snapshot into the empty chainstate of a fresh node. The chain
+ * goes on from the snapshot block, the blocks below it are never validated
+ * or downloaded. */
+bool LoadUTXOSnapshot(const fs::path& path, UTXOSnapshotInfo& info, std::string& strError);
+
 /** Load cache of user set votes for withdrawals */
 bool LoadCustomVoteCache();
 
-/** Dump cache of user set votes for withdrawals */
-void DumpCustomVoteCache();
-
-// TODO Add startup param to enable this, make disabled by default. The other
-// .dat files aren't created unless the user is BMM mining but this cache needs
-// an extra parameter in order to be made optional.
-/** Load the optional deposit cache from disk. */
+/** Load recent deposits from the sidechain tree database into SCDB and
+ * import the deposit.dat file of older versions if there is one. */
 bool LoadDepositCache();
 
-/** Dump the deposit cache to disk. */
-void DumpDepositCache();
-
 /** Load the withdrawal transaction cache from disk. */
 bool LoadWithdrawalCache(bool fReindex = false);
 
-/** Dump the withdrawal cache to disk.
- * Spent, failed & raw transaction cache */
-void DumpWithdrawalCache();
-
 /* Load sidechain proposal cache */
 bool LoadSidechainProposalCache();
 
-/* Dump sidechain proposal cache */
-void DumpSidechainProposalCache();
-
 /* Load sidechain activation hash cache */
 bool LoadSidechainActivationHashCache();
 
-/* Dump sidechain activation hash cache */
-void DumpSidechainActivationHashCache();
-
 /* Load list of failed BMM txid from cache */
 bool LoadBMMCache();
 
-/* Write list of failed BMM txid */
-void DumpBMMCache();
-
 /** Tracks validation status of sidechain withdrawals */
 extern SidechainDB scdb;
 
@@ -587,12 +739,53 @@ bool GetTxOutProof(const uint256& txid, const uint256& hashBlock, std::string& s
 /** Verify txout proof */
 bool VerifyTxOutProof(const std::string& strProof);
 
-/** Flush SCDB cache data to disk */
+/** Load the SCDB caches & user settings from the SCDB cache file, or from
+ * the separate cache files of older versions, and replay the SCDB cache log
+ * on top of them */
+bool LoadSCDBCache(bool fReindex = false);
+
+/** Flush SCDB cache data & user settings to the SCDB cache file. Once the
+ * SCDB cache log has been started this is done in the background. */
 void DumpSCDBCache();
 
+/** Write the loaded SCDB caches and start logging changes to them */
+bool StartSCDBLog();
+
+/** Write the queued SCDB cache log records and stop logging */
+void StopSCDBLog();
+
 /** Resync SCDB status & verify hashBlockLastSeen. Used during init and
- * when a block is disconnected. */
-bool ResyncSCDB(const CBlockIndex* pindex);
+ * when a block is disconnected, or after a reorg has disconnected
+ * nBlocksBack blocks. */
+bool ResyncSCDB(const CBlockIndex* pindex, unsigned int nBlocksBack = 1);
+
+/** Progress of a -reindex-chainstate replay */
+struct ReindexChainStateProgress {
+    //! Height of the replay and of the tip it is replaying to
+    int nHeight;
+    int nTargetHeight;
+    //! Fraction of the transactions up to the target that have been replayed
+    double dProgress;
+    int64_t nTimeStart;
+    //! Estimated seconds until done, -1 if unknown
+    int64_t nETA;
+    //! Whether SCDB views still show the state of the target
+    bool fSCDBHeld;
+};
+
+/** Start a -reindex-chainstate replay to pindexTarget, the tip of the
+ * chainstate that was wiped, or the best header if that is unknown. With
+ * fSidechains SCDB is reset to be rebuilt along with the chainstate, while
+ * its views keep the state of pindexTarget from the sidechain tree database
+ * until the replay gets back there. */
+void StartReindexChainState(const CBlockIndex* pindexTarget, bool fSidechains);
+
+/** Stop tracking the replay and release the SCDB views. Happens by itself
+ * once the target has been reached. */
+void FinishReindexChainState();
+
+/** Get the progress of the replay, false if there is none */
+bool GetReindexChainStateProgress(ReindexChainStateProgress& progress);
 
 double GetNetworkHashPerSecond(int nLookup, int nHeight);
 
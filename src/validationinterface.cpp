@@ -6,6 +6,7 @@
 #include <validationinterface.h>
 
 #include <init.h>
+#include <mpmcqueue.h>
 #include <primitives/block.h>
 #include <scheduler.h>
 #include <sync.h>
@@ -13,42 +14,260 @@
 #include <util.h>
 #include <validation.h>
 
-#include <list>
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <future>
 #include <functional>
+#include <mutex>
+#include <thread>
 
-#include <boost/signals2/signal.hpp>
-#include <boost/bind/placeholders.hpp>
+#include <boost/bind/bind.hpp>
 
 using namespace boost::placeholders;
 
+/** Number of callbacks queued for an interface without taking a lock. Any
+ * more wait in a locked overflow list until its thread catches up. */
+static const size_t VALIDATION_QUEUE_RING_SIZE = 1024;
+
+/** Runs a function once every interface queue has reached it */
+struct ValidationQueueBarrier
+{
+    std::atomic<int> nRemaining;
+    std::function<void ()> func;
+
+    ValidationQueueBarrier(int nRemainingIn, std::function<void ()> funcIn) : nRemaining(nRemainingIn), func(std::move(funcIn)) {}
+
+    void Arrive()
+    {
+        if (--nRemaining == 0)
+            func();
+    }
+};
+
+/**
+ * Background callbacks of one registered interface, and the thread that runs
+ * them in the order they were queued.
+ *
+ * Callbacks are passed through a lock-free ring like the HTTP work queue.
+ * When the thread falls behind by more than the ring holds, further
+ * callbacks go to an overflow list until it has caught up, which keeps them
+ * in order without ever making the validation code queueing them wait.
+ */
+struct ValidationInterfaceQueue
+{
+    struct Entry
+    {
+        //! Empty for a barrier entry
+        std::function<void (CValidationInterface&)> callback;
+        std::shared_ptr<ValidationQueueBarrier> barrier;
+        int64_t nTimeQueued;
+    };
+
+    CValidationInterface* const pinterface;
+    const std::string strName;
+    const std::string strThreadName;
+
+    mpmcqueue<Entry*> ring;
+    std::deque<Entry*> overflow;
+    //! Size of overflow, new entries go there while it isn't empty
+    std::atomic<size_t> nOverflow;
+    std::atomic<size_t> depth;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::atomic<int> nSleeping;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    //! nTimeQueued of the callback being run, 0 if none
+    std::atomic<int64_t> nTimeRunning;
+    std::atomic<uint64_t> nProcessed;
+    std::atomic<uint64_t> nOverflowed;
+
+    ValidationInterfaceQueue(CValidationInterface* pinterfaceIn, const std::string& strNameIn) :
+        pinterface(pinterfaceIn), strName(strNameIn), strThreadName("cb." + strNameIn),
+        ring(VALIDATION_QUEUE_RING_SIZE), nOverflow(0), depth(0), nSleeping(0), running(true),
+        nTimeRunning(0), nProcessed(0), nOverflowed(0)
+    {
+    }
+
+    /** Drop whatever is still queued, letting barriers through */
+    ~ValidationInterfaceQueue()
+    {
+        assert(!thread.joinable());
+        while (Entry* entry = Pop()) {
+            if (entry->barrier)
+                entry->barrier->Arrive();
+            delete entry;
+        }
+    }
+
+    void Push(std::function<void (CValidationInterface&)> callback, std::shared_ptr<ValidationQueueBarrier> barrier)
+    {
+        Entry* entry = new Entry{std::move(callback), std::move(barrier), GetTimeMicros()};
+        depth++;
+        if (nOverflow > 0 || !ring.Push(entry)) {
+            std::lock_guard<std::mutex> lock(cs);
+            overflow.push_back(entry);
+            nOverflow++;
+            nOverflowed++;
+        }
+        // The thread announces it is going to sleep before checking the
+        // depth, so either it sees this entry or we see it
+        if (nSleeping > 0) {
+            std::lock_guard<std::mutex> lock(cs);
+            cond.notify_one();
+        }
+    }
+
+    Entry* Pop()
+    {
+        Entry* entry;
+        if (ring.Pop(entry))
+            return entry;
+        if (nOverflow == 0)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(cs);
+        // Entries still in the ring are older than the overflow ones
+        if (ring.Pop(entry))
+            return entry;
+        if (overflow.empty())
+            return nullptr;
+        entry = overflow.front();
+        overflow.pop_front();
+        nOverflow--;
+        return entry;
+    }
+
+    void Run()
+    {
+        while (running) {
+            std::unique_ptr<Entry> entry(Pop());
+            if (!entry) {
+                std::unique_lock<std::mutex> lock(cs);
+                nSleeping++;
+                if (running && depth == 0) {
+                    cond.wait(lock);
+                } else if (running) {
+                    // An entry is being queued but isn't visible yet
+                    lock.unlock();
+                    std::this_thread::yield();
+                }
+                nSleeping--;
+                continue;
+            }
+
+            if (entry->callback) {
+                nTimeRunning = entry->nTimeQueued;
+                entry->callback(*pinterface);
+                nTimeRunning = 0;
+                nProcessed++;
+            }
+            depth--;
+            if (entry->barrier)
+                entry->barrier->Arrive();
+        }
+    }
+
+    void Start(const std::shared_ptr<ValidationInterfaceQueue>& self)
+    {
+        // The thread keeps the queue alive in case it is the one stopping it
+        thread = std::thread([self] {
+            TraceThread(self->strThreadName.c_str(), [&self] { self->Run(); });
+        });
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            running = false;
+            cond.notify_all();
+        }
+        if (!thread.joinable())
+            return;
+        // Unregistering from one of its own callbacks
+        if (thread.get_id() == std::this_thread::get_id())
+            thread.detach();
+        else
+            thread.join();
+    }
+
+    ValidationInterfaceQueueStats GetStats() const
+    {
+        ValidationInterfaceQueueStats stats;
+        stats.name = strName;
+        stats.nDepth = depth;
+        int64_t nTime = nTimeRunning;
+        stats.nLag = nTime ? GetTimeMicros() - nTime : 0;
+        stats.nProcessed = nProcessed;
+        stats.nOverflowed = nOverflowed;
+        return stats;
+    }
+};
+
+typedef std::vector<std::shared_ptr<ValidationInterfaceQueue>> ValidationInterfaceQueues;
+
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
-    boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
-    boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
-    boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
-    boost::signals2::signal<void (const uint256&)> BlockFound;
-    boost::signals2::signal<void (const uint256&)> ResetRequestCount;
-
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
-    SingleThreadedSchedulerClient m_schedulerClient;
-
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    // Replaced rather than modified, so that callbacks are queued on a
+    // snapshot without holding cs_queues
+    std::mutex cs_queues;
+    std::shared_ptr<const ValidationInterfaceQueues> queues = std::make_shared<const ValidationInterfaceQueues>();
+    std::atomic<int> nUnnamed{0};
+
+    std::shared_ptr<const ValidationInterfaceQueues> GetQueues()
+    {
+        std::lock_guard<std::mutex> lock(cs_queues);
+        return queues;
+    }
+
+    /** Queue callback for every registered interface */
+    void Enqueue(const std::function<void (CValidationInterface&)>& callback)
+    {
+        for (const std::shared_ptr<ValidationInterfaceQueue>& queue : *GetQueues())
+            queue->Push(callback, nullptr);
+    }
+
+    /** Call func right away on every registered interface */
+    void Call(const std::function<void (CValidationInterface&)>& func)
+    {
+        for (const std::shared_ptr<ValidationInterfaceQueue>& queue : *GetQueues())
+            func(*queue->pinterface);
+    }
+
+    /** Remove the queues of the interfaces matching pred and stop them */
+    void Remove(const std::function<bool (const ValidationInterfaceQueue&)>& pred)
+    {
+        ValidationInterfaceQueues vRemoved;
+        {
+            std::lock_guard<std::mutex> lock(cs_queues);
+            std::shared_ptr<ValidationInterfaceQueues> queuesNew = std::make_shared<ValidationInterfaceQueues>();
+            for (const std::shared_ptr<ValidationInterfaceQueue>& queue : *queues) {
+                if (pred(*queue))
+                    vRemoved.push_back(queue);
+                else
+                    queuesNew->push_back(queue);
+            }
+            queues = queuesNew;
+        }
+        for (const std::shared_ptr<ValidationInterfaceQueue>& queue : vRemoved)
+            queue->Stop();
+    }
+
+    ~MainSignalsInstance()
+    {
+        Remove([](const ValidationInterfaceQueue&) { return true; });
+    }
 };
 
 static CMainSignals g_signals;
 
-void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler& scheduler) {
+void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler&) {
     assert(!m_internals);
-    m_internals.reset(new MainSignalsInstance(&scheduler));
+    m_internals.reset(new MainSignalsInstance());
 }
 
 void CMainSignals::UnregisterBackgroundSignalScheduler() {
@@ -57,13 +276,16 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        SyncWithValidationInterfaceQueue();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t nPending = 0;
+    for (const std::shared_ptr<ValidationInterfaceQueue>& queue : *m_internals->GetQueues())
+        nPending = std::max<size_t>(nPending, queue->depth);
+    return nPending;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -80,60 +302,49 @@ CMainSignals& GetMainSignals()
 }
 
 void CMainSignals::BlockFound(const uint256& hash) {
-    m_internals->BlockFound(hash);
+    m_internals->Call([&hash](CValidationInterface& i) { i.ResetRequestCount(hash); });
 }
 
 void CMainSignals::ResetRequestCount(const uint256& hash) {
-    m_internals->ResetRequestCount(hash);
+    m_internals->Call([&hash](CValidationInterface& i) { i.ResetRequestCount(hash); });
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
-    g_signals.m_internals->BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.m_internals->ResetRequestCount.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& strName) {
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    std::shared_ptr<ValidationInterfaceQueue> queue = std::make_shared<ValidationInterfaceQueue>(pwalletIn,
+            strName.empty() ? strprintf("interface%d", internals.nUnnamed++) : strName);
+    queue->Start(queue);
+
+    std::lock_guard<std::mutex> lock(internals.cs_queues);
+    std::shared_ptr<ValidationInterfaceQueues> queuesNew = std::make_shared<ValidationInterfaceQueues>(*internals.queues);
+    queuesNew->push_back(queue);
+    internals.queues = queuesNew;
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.m_internals->ResetRequestCount.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    if (!g_signals.m_internals) {
+        return;
+    }
+    g_signals.m_internals->Remove([pwalletIn](const ValidationInterfaceQueue& queue) {
+        return queue.pinterface == pwalletIn;
+    });
 }
 
 void UnregisterAllValidationInterfaces() {
     if (!g_signals.m_internals) {
         return;
     }
-    g_signals.m_internals->BlockFound.disconnect_all_slots();
-    g_signals.m_internals->ResetRequestCount.disconnect_all_slots();
-    g_signals.m_internals->BlockChecked.disconnect_all_slots();
-    g_signals.m_internals->Broadcast.disconnect_all_slots();
-    g_signals.m_internals->SetBestChain.disconnect_all_slots();
-    g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.m_internals->BlockConnected.disconnect_all_slots();
-    g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
-    g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
-    g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
+    g_signals.m_internals->Remove([](const ValidationInterfaceQueue&) { return true; });
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    std::shared_ptr<const ValidationInterfaceQueues> queues = g_signals.m_internals->GetQueues();
+    // One more for us, so that func runs here if every queue got to it
+    // before we are done queueing, or there are no queues at all
+    std::shared_ptr<ValidationQueueBarrier> barrier = std::make_shared<ValidationQueueBarrier>(queues->size() + 1, std::move(func));
+    for (const std::shared_ptr<ValidationInterfaceQueue>& queue : *queues)
+        queue->Push(nullptr, barrier);
+    barrier->Arrive();
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -146,52 +357,74 @@ void SyncWithValidationInterfaceQueue() {
     promise.get_future().wait();
 }
 
+std::vector<ValidationInterfaceQueueStats> GetValidationInterfaceQueueStats() {
+    std::vector<ValidationInterfaceQueueStats> vStats;
+    if (!g_signals.m_internals) {
+        return vStats;
+    }
+    for (const std::shared_ptr<ValidationInterfaceQueue>& queue : *g_signals.m_internals->GetQueues())
+        vStats.push_back(queue->GetStats());
+    return vStats;
+}
+
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface& i) {
+            i.TransactionRemovedFromMempool(ptx);
         });
     }
 }
 
 void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface& i) {
+        i.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface& i) {
+        i.TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface& i) {
+        i.BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, this] {
-        m_internals->BlockDisconnected(pblock);
+    m_internals->Enqueue([pblock](CValidationInterface& i) {
+        i.BlockDisconnected(pblock);
     });
 }
 
 void CMainSignals::SetBestChain(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->SetBestChain(locator);
+    m_internals->Enqueue([locator](CValidationInterface& i) {
+        i.SetBestChain(locator);
     });
 }
 
 void CMainSignals::Broadcast(int64_t nBestBlockTime, CConnman* connman) {
-    m_internals->Broadcast(nBestBlockTime, connman);
+    m_internals->Call([nBestBlockTime, connman](CValidationInterface& i) {
+        i.ResendWalletTransactions(nBestBlockTime, connman);
+    });
 }
 
 void CMainSignals::BlockChecked(const CBlock& block, const CValidationState& state) {
-    m_internals->BlockChecked(block, state);
+    m_internals->Call([&block, &state](CValidationInterface& i) {
+        i.BlockChecked(block, state);
+    });
 }
 
 void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block) {
-    m_internals->NewPoWValidBlock(pindex, block);
+    m_internals->Call([pindex, &block](CValidationInterface& i) {
+        i.NewPoWValidBlock(pindex, block);
+    });
+}
+
+void CMainSignals::NewForkTip(const CBlockIndex *pindex) {
+    m_internals->Enqueue([pindex](CValidationInterface& i) {
+        i.NewForkTip(pindex);
+    });
 }
@@ -10,6 +10,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 class CBlock;
 class CBlockIndex;
@@ -26,9 +28,17 @@ enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core. Background callbacks of
+ * each registered interface are queued for a thread of its own, strName
+ * names it in the queue statistics.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& strName = "");
+/**
+ * Unregister a wallet from core. Waits for the callback being run for it, if
+ * any, and drops the ones still queued, so don't hold locks its callbacks
+ * take.
+ */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
@@ -53,6 +63,24 @@ void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
  */
 void SyncWithValidationInterfaceQueue();
 
+/** Queue statistics of a registered validation interface */
+struct ValidationInterfaceQueueStats
+{
+    std::string name;
+    //! Number of callbacks queued
+    size_t nDepth;
+    //! How long ago the callback being run was queued, in microseconds,
+    //! 0 when idle
+    int64_t nLag;
+    //! Number of callbacks run since registering
+    uint64_t nProcessed;
+    //! Number of callbacks that didn't fit in the lock-free ring
+    uint64_t nOverflowed;
+};
+
+/** Get the queue statistics of every registered validation interface */
+std::vector<ValidationInterfaceQueueStats> GetValidationInterfaceQueueStats();
+
 class CValidationInterface {
 protected:
     /**
@@ -110,14 +138,23 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
+    /**
+     * Notifies listeners of a new tip of the block tree that starts a branch:
+     * a header building on a block that already had a child, like a
+     * competing chain forking off the active one.
+     *
+     * Called on a background thread.
+     */
+    virtual void NewForkTip(const CBlockIndex *pindex) {}
 
     virtual void BlockFound(const uint256&) {};
 
     virtual void ResetRequestCount(const uint256 &hash) {};
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
+    friend class CMainSignals;
 };
 
 struct MainSignalsInstance;
@@ -125,21 +162,25 @@ class CMainSignals {
 private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend std::vector<ValidationInterfaceQueueStats> (::GetValidationInterfaceQueueStats)();
 
     void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
 
 public:
-    /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
+    /** Start giving callbacks which should run in the background (may only be
+     * called once). They run on a thread per registered interface rather than
+     * on the scheduler, so that a slow one doesn't hold up the others. */
     void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
-    /** Unregister a CScheduler to give callbacks which should run in the background - these callbacks will now be dropped! */
+    /** Stop giving callbacks which should run in the background - these callbacks will now be dropped! */
     void UnregisterBackgroundSignalScheduler();
-    /** Call any remaining callbacks on the calling thread */
+    /** Wait for any remaining callbacks to finish */
     void FlushBackgroundCallbacks();
 
+    /** Number of callbacks queued for the interface furthest behind */
     size_t CallbacksPending();
 
     /** Register with mempool to call TransactionRemovedFromMempool callbacks */
@@ -155,6 +196,7 @@ public:
     void Broadcast(int64_t nBestBlockTime, CConnman* connman);
     void BlockChecked(const CBlock&, const CValidationState&);
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
+    void NewForkTip(const CBlockIndex *);
     void BlockFound(const uint256&);
     void ResetRequestCount(const uint256&);
 };
@@ -831,7 +831,9 @@ UniValue getbalance(const JSONRPCRequest& request)
     // the user could have gotten from another RPC command prior to now
     pwallet->BlockUntilSyncedToCurrentChain();
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // Balances come from the wallet's chain view, no need for cs_main
+    auto lockChain = pwallet->LockChainIfNoView();
+    LOCK(pwallet->cs_wallet);
 
     const UniValue& account_value = request.params[0];
     const UniValue& minconf = request.params[1];
@@ -881,7 +883,9 @@ UniValue getunconfirmedbalance(const JSONRPCRequest &request)
     // the user could have gotten from another RPC command prior to now
     pwallet->BlockUntilSyncedToCurrentChain();
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // Balances come from the wallet's chain view, no need for cs_main
+    auto lockChain = pwallet->LockChainIfNoView();
+    LOCK(pwallet->cs_wallet);
 
     return ValueFromAmount(pwallet->GetUnconfirmedBalance());
 }
@@ -1696,6 +1700,40 @@ void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::s
     }
 }
 
+/** Number of entries ListTransactions would add for wtx, without making them */
+static int CountListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::string& strAccount, int nMinDepth, const isminefilter& filter)
+{
+    CAmount nFee;
+    std::string strSentAccount;
+    std::list<COutputEntry> listReceived;
+    std::list<COutputEntry> listSent;
+
+    wtx.GetAmounts(listReceived, listSent, nFee, strSentAccount, filter);
+
+    bool fAllAccounts = (strAccount == std::string("*"));
+
+    int nEntries = 0;
+    if ((!listSent.empty() || nFee != 0) && (fAllAccounts || strAccount == strSentAccount))
+        nEntries += listSent.size();
+
+    if (listReceived.size() > 0 && wtx.GetDepthInMainChain() >= nMinDepth)
+    {
+        for (const COutputEntry& r : listReceived)
+        {
+            if (fAllAccounts) {
+                nEntries++;
+                continue;
+            }
+            auto it = pwallet->mapAddressBook.find(r.destination);
+            std::string account = it != pwallet->mapAddressBook.end() ? it->second.name : "";
+            if (account == strAccount)
+                nEntries++;
+        }
+    }
+
+    return nEntries;
+}
+
 void AcentryToJSON(const CAccountingEntry& acentry, const std::string& strAccount, UniValue& ret)
 {
     bool fAllAccounts = (strAccount == std::string("*"));
@@ -1720,15 +1758,17 @@ UniValue listtransactions(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() > 4)
+    if (request.fHelp || request.params.size() > 5)
         throw std::runtime_error(
-            "listtransactions ( \"account\" count skip include_watchonly)\n"
+            "listtransactions ( \"account\" count skip include_watchonly since_height)\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) DEPRECATED. The account name. Should be \"*\".\n"
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. skip           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. include_watchonly (bool, optional, default=false) Include transactions to watch-only addresses (see 'importaddress')\n"
+            "5. since_height   (numeric, optional) Only list transactions in blocks from this height up, and the unconfirmed\n"
+            "                  and abandoned ones. Moves between accounts are left out.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1776,6 +1816,8 @@ UniValue listtransactions(const JSONRPCRequest& request)
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList the most recent 10 transactions since block 500000\n"
+            + HelpExampleCli("listtransactions", "\"*\" 10 0 false 500000") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
         );
@@ -1800,54 +1842,71 @@ UniValue listtransactions(const JSONRPCRequest& request)
         if(request.params[3].get_bool())
             filter = filter | ISMINE_WATCH_ONLY;
 
+    int nSinceHeight = -1;
+    if (!request.params[4].isNull()) {
+        nSinceHeight = request.params[4].get_int();
+        if (nSinceHeight < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative since_height");
+    }
+
     if (nCount < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    UniValue ret(UniValue::VARR);
+    // Entries newest to oldest. Only the page asked for is made, the ones
+    // before it are just counted
+    std::vector<UniValue> vEntry;
 
     {
         LOCK2(cs_main, pwallet->cs_wallet);
 
-        const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
+        int nSkip = nFrom;
+        auto add = [&](const CWalletTx* pwtx, const CAccountingEntry* pacentry) {
+            if (nSkip > 0) {
+                int nEntries = 0;
+                if (pwtx != nullptr)
+                    nEntries += CountListTransactions(pwallet, *pwtx, strAccount, 0, filter);
+                if (pacentry != nullptr && (strAccount == "*" || pacentry->strAccount == strAccount))
+                    nEntries++;
+                if (nEntries <= nSkip) {
+                    nSkip -= nEntries;
+                    return;
+                }
+            }
 
-        // iterate backwards until we have nCount items to return:
-        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
-        {
-            CWalletTx *const pwtx = (*it).second.first;
+            UniValue entries(UniValue::VARR);
             if (pwtx != nullptr)
-                ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
-            CAccountingEntry *const pacentry = (*it).second.second;
+                ListTransactions(pwallet, *pwtx, strAccount, 0, true, entries, filter);
             if (pacentry != nullptr)
-                AcentryToJSON(*pacentry, strAccount, ret);
+                AcentryToJSON(*pacentry, strAccount, entries);
 
-            if ((int)ret.size() >= (nCount+nFrom)) break;
-        }
-    }
-
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
+            for (size_t i = nSkip; i < entries.size() && (int)vEntry.size() < nCount; i++)
+                vEntry.push_back(entries[i]);
+            nSkip = 0;
+        };
 
-    std::vector<UniValue> arrTmp = ret.getValues();
-
-    std::vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    std::vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
+        if (nSinceHeight >= 0) {
+            for (const CWalletTx* pwtx : pwallet->GetTransactionsSince(nSinceHeight)) {
+                if ((int)vEntry.size() >= nCount) break;
+                add(pwtx, nullptr);
+            }
+        } else {
+            const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
 
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
+            // iterate backwards until we have nCount items to return:
+            for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+            {
+                if ((int)vEntry.size() >= nCount) break;
+                add((*it).second.first, (*it).second.second);
+            }
+        }
+    }
 
-    std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
+    std::reverse(vEntry.begin(), vEntry.end()); // Return oldest to newest
 
-    ret.clear();
-    ret.setArray();
-    ret.push_backV(arrTmp);
+    UniValue ret(UniValue::VARR);
+    ret.push_backV(vEntry);
 
     return ret;
 }
@@ -2233,9 +2292,9 @@ UniValue abandonbmm(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size()) {
         throw std::runtime_error(
             "abandonbmm\n"
-            "\nRemove expired BMM requests and BMM requests not selected by "
-            "our SelectBMMRequests settings. Then try to abandon the BMM "
-            "requests from our wallet if we created them.\n"
+            "\nRemove expired BMM requests and BMM requests for inactive "
+            "sidechains. Then try to abandon the BMM requests from our wallet "
+            "if we created them.\n"
             "This will mark the transaction and all in-wallet descendants "
             "as abandoned which will allow for their inputs to be respent.\n"
             "It only works on transactions which are not included in a block.\n"
@@ -2255,40 +2314,30 @@ UniValue abandonbmm(const JSONRPCRequest& request)
     ObserveSafeMode();
 
     std::vector<uint256> vHashRemoved;
-    mempool.SelectBMMRequests(vHashRemoved);
+    mempool.RemoveInactiveBMMRequests(vHashRemoved);
     mempool.RemoveExpiredCriticalRequests(vHashRemoved);
 
-    for (const uint256& u : vHashRemoved)
-        scdb.AddRemovedBMM(u);
-
-    // Also try to abandon cached BMM txid previously removed from our mempool
-    std::set<uint256> setRemoved = scdb.GetRemovedBMM();
-
     // Make sure the results are valid at least up to the most recent block
     // the user could have gotten from another RPC command prior to now
     pwallet->BlockUntilSyncedToCurrentChain();
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // Abandon every critical data transaction of ours that was dropped from
+    // the mempool, including the ones removed above
+    std::vector<std::pair<uint256, std::string>> vResult;
+    pwallet->AbandonSidechainTransactions(true /* fCriticalData */, vResult);
 
     UniValue results(UniValue::VARR);
-    for (const uint256& u : setRemoved) {
+    for (const auto& result : vResult) {
         UniValue entry(UniValue::VOBJ);
-
-        if (!pwallet->mapWallet.count(u)) {
-            entry.push_back(Pair("not-in-wallet", u.ToString()));
-            results.push_back(entry);
-            continue;
-        }
-        std::string strReason = "";
-        if (!pwallet->AbandonTransaction(u, &strReason)) {
-            entry.push_back(Pair(strprintf("cannot-abandon: %s", strReason), u.ToString()));
+        if (!result.second.empty()) {
+            entry.push_back(Pair(strprintf("cannot-abandon: %s", result.second), result.first.ToString()));
             results.push_back(entry);
             continue;
         }
 
         // Remove from the cache after abandonment
-        scdb.BMMAbandoned(u);
-        entry.push_back(Pair("abandoned", u.ToString()));
+        scdb.BMMAbandoned(result.first);
+        entry.push_back(Pair("abandoned", result.first.ToString()));
         results.push_back(entry);
     }
 
@@ -2324,30 +2373,22 @@ UniValue abandondeposits(const JSONRPCRequest& request)
 
     ObserveSafeMode();
 
-    std::vector<uint256> vHashRemoved = scdb.GetRemovedDeposits();
-
     // Make sure the results are valid at least up to the most recent block
     // the user could have gotten from another RPC command prior to now
     pwallet->BlockUntilSyncedToCurrentChain();
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    std::vector<std::pair<uint256, std::string>> vResult;
+    pwallet->AbandonSidechainTransactions(false /* fCriticalData */, vResult);
 
     UniValue results(UniValue::VARR);
-    for (const uint256& u : vHashRemoved) {
+    for (const auto& result : vResult) {
         UniValue entry(UniValue::VOBJ);
-
-        if (!pwallet->mapWallet.count(u)) {
-            entry.push_back(Pair("not-in-wallet", u.ToString()));
+        if (!result.second.empty()) {
+            entry.push_back(Pair(strprintf("cannot-abandon: %s", result.second), result.first.ToString()));
             results.push_back(entry);
             continue;
         }
-        std::string strReason = "";
-        if (!pwallet->AbandonTransaction(u, &strReason)) {
-            entry.push_back(Pair(strprintf("cannot-abandon: %s", strReason), u.ToString()));
-            results.push_back(entry);
-            continue;
-        }
-        entry.push_back(Pair("abandoned", u.ToString()));
+        entry.push_back(Pair("abandoned", result.first.ToString()));
         results.push_back(entry);
     }
     scdb.ClearRemovedDeposits();
@@ -2908,7 +2949,9 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     // the user could have gotten from another RPC command prior to now
     pwallet->BlockUntilSyncedToCurrentChain();
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    // Balances come from the wallet's chain view, no need for cs_main
+    auto lockChain = pwallet->LockChainIfNoView();
+    LOCK(pwallet->cs_wallet);
 
     UniValue obj(UniValue::VOBJ);
 
@@ -3671,6 +3714,122 @@ UniValue createsidechaindeposit(const JSONRPCRequest& request)
     return tx->GetHash().GetHex();
 }
 
+UniValue createsidechaindeposits(const JSONRPCRequest& request)
+{
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    if (request.fHelp || request.params.size() != 3)
+        throw std::runtime_error(
+            "createsidechaindeposits \"nsidechain\" {\"depositaddress\":amount,...} \"fee\"\n"
+            "\nCreate sidechain deposits to many addresses with one coin selection.\n"
+            "A deposit has a single destination, so this creates a chain of\n"
+            "deposits, each spending the sidechain output of the one before.\n"
+            + HelpRequiringPassphrase(pwallet) +
+            "\nArguments:\n"
+            "1. \"nsidechain\"         (numeric, required) The sidechain to send to.\n"
+            "2. \"deposits\"           (object, required) A json object with deposit addresses and amounts\n"
+            "    {\n"
+            "      \"depositaddress\":amount   (numeric or string) The sidechain deposit address is the key, the numeric amount (can be string) in " + CURRENCY_UNIT + " is the value\n"
+            "      ,...\n"
+            "    }\n"
+            "3. \"fee\"                (numeric or string, required) The fee in " + CURRENCY_UNIT + " of each deposit\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"txid\"                (string) The transaction id of each deposit, in the order they spend each other\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("createsidechaindeposits", "0 \"{\\\"s0_1M72Sfpbz1BPpXFHz9m3CdqATR44Jvaydd_xxxxxx\\\":0.1,\\\"s0_1PDxxJ2ZfBNBe5ZRcfuvvwx6XtA7cE3ZXj_xxxxxx\\\":0.2}\" 0.01")
+            + HelpExampleRpc("createsidechaindeposits", "0, {\"s0_1M72Sfpbz1BPpXFHz9m3CdqATR44Jvaydd_xxxxxx\":0.1,\"s0_1PDxxJ2ZfBNBe5ZRcfuvvwx6XtA7cE3ZXj_xxxxxx\":0.2}, 0.01")
+        );
+
+    ObserveSafeMode();
+
+    // Check sidechain number we are depositing to
+    unsigned int nSidechain = request.params[0].get_int();
+    if (!scdb.IsSidechainActive(nSidechain)) {
+        std::string strError = "Invalid sidechain number";
+        LogPrintf("%s: %s\n", __func__, strError);
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    // Make sure the results are valid at least up to the most recent block
+    // the user could have gotten from another RPC command prior to now
+    pwallet->BlockUntilSyncedToCurrentChain();
+
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    UniValue deposits = request.params[1].get_obj();
+    if (deposits.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No deposits");
+
+    if (deposits.size() > MAX_SIDECHAIN_DEPOSIT_BATCH)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many deposits, at most %u", MAX_SIDECHAIN_DEPOSIT_BATCH));
+
+    std::vector<std::pair<std::string, CAmount>> vDeposit;
+    std::set<std::string> setAddress;
+    for (const std::string& strDepositAddress : deposits.getKeys()) {
+        if (!setAddress.insert(strDepositAddress).second)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, duplicated address: " + strDepositAddress);
+
+        // Get strDest from deposit address
+        std::string strDest = "";
+        unsigned int nSidechainFromAddress;
+        if (strDepositAddress.empty() || !ParseDepositAddress(strDepositAddress, strDest, nSidechainFromAddress))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid sidechain deposit address - failed to parse: " + strDepositAddress);
+
+        // Check number from address matches sidechain we are depositing to
+        if (nSidechainFromAddress != nSidechain)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid sidechain deposit address - sidechain number mismatch: " + strDepositAddress);
+
+        // Reject deposits to SIDECHAIN_WITHDRAWAL_RETURN_DEST
+        if (strDest == SIDECHAIN_WITHDRAWAL_RETURN_DEST)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid sidechain address. Cannot be SIDECHAIN_WITHDRAWAL_RETURN_DEST: " + strDepositAddress);
+
+        CAmount nAmount = AmountFromValue(deposits[strDepositAddress]);
+        if (nAmount <= 0)
+            throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount for send");
+
+        vDeposit.push_back(std::make_pair(strDest, nAmount));
+    }
+
+    // Fee
+    CAmount nFee = AmountFromValue(request.params[2]);
+    if (nFee <= 0) {
+        std::string strError = "Invalid fee amount";
+        LogPrintf("%s: %s\n", __func__, strError);
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    // Get sidechain script
+    CScript sidechainScriptPubKey;
+    if (!scdb.GetSidechainScript(nSidechain, sidechainScriptPubKey))
+    {
+        std::string strError = "Failed to lookup sidechain script";
+        LogPrintf("%s: %s\n", __func__, strError);
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    EnsureWalletIsUnlocked(pwallet);
+
+    std::vector<CTransactionRef> vtx;
+    std::string strFail = "";
+    if (!pwallet->CreateSidechainDeposits(vtx, strFail, sidechainScriptPubKey, nSidechain, vDeposit, nFee))
+    {
+        LogPrintf("%s: %s\n", __func__, strFail);
+        throw JSONRPCError(RPC_MISC_ERROR, strFail);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const CTransactionRef& tx : vtx)
+        result.push_back(tx->GetHash().GetHex());
+
+    return result;
+}
+
 UniValue createopreturntransaction(const JSONRPCRequest& request)
 {
     CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
@@ -3820,7 +3979,7 @@ UniValue createbmmcriticaldatatx(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() != 5)
+    if (request.fHelp || request.params.size() < 5 || request.params.size() > 6)
         throw std::runtime_error(
             "createbmmcriticaldatatx\n"
             "Create a BMM request critical data transaction\n"
@@ -3831,6 +3990,9 @@ UniValue createbmmcriticaldatatx(const JSONRPCRequest& request)
             "3. \"criticalhash\"   (string, required) h* you want added to a coinbase\n"
             "4. \"nsidechain\"     (numeric, required) Sidechain requesting BMM\n"
             "5. \"prevbytes\"      (string, required) a portion of the previous block hash\n"
+            "6. \"maxamount\"      (numeric or string, optional) If set, the request is replaced at every new tip\n"
+            "                     that doesn't include it, bidding -bmmbidbump percent more each time up to this\n"
+            "                     amount in " + CURRENCY_UNIT + ". Requests that can't be mined anymore are always abandoned.\n"
             "\nExamples:\n"
             + HelpExampleCli("createbmmcriticaldatatx", "\"amount\", \"height\", \"criticalhash\", \"nsidechain\", \"prevbytes\"")
             + HelpExampleRpc("createbmmcriticaldatatx", "\"amount\", \"height\", \"criticalhash\", \"nsidechain\", \"prevbytes\"")
@@ -3896,55 +4058,23 @@ UniValue createbmmcriticaldatatx(const JSONRPCRequest& request)
         throw (JSONRPCError(RPC_TYPE_ERROR, strError));
     }
 
-    // Create critical data bytes
-    CScript vBytes;
-    vBytes.resize(8);
-
-    // Add header to identify BMM data
-    vBytes[0] = 0x00;
-    vBytes[1] = 0xbf;
-    vBytes[2] = 0x00;
-
-    // Add sidechain number
-    vBytes[3] = nSidechain;
-
-    // Add prev block bytes
-    memcpy(&vBytes[4], vPrevBytes.data(), vPrevBytes.size());
-
-    CCriticalData criticalData;
-    criticalData.vBytes = std::vector<unsigned char>(vBytes.begin(), vBytes.end());
-    criticalData.hashCritical = hashCritical;
+    // Max amount for automatic replacement
+    CAmount nMaxAmount = 0;
+    if (!request.params[5].isNull()) {
+        nMaxAmount = AmountFromValue(request.params[5]);
+        if (nMaxAmount < nAmount) {
+            std::string strError = "Invalid max amount, less than amount";
+            LogPrintf("%s: %s\n", __func__, strError);
+            throw JSONRPCError(RPC_TYPE_ERROR, strError);
+        }
+    }
 
 #ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    // Create and send the transaction
+    // Create and send the transaction, the wallet keeps track of it until a
+    // block decides it
     std::string strError;
-
-    // Create transaction with critical data
-    std::vector<CRecipient> vecSend;
-    CRecipient recipient = {CScript() << OP_TRUE, nAmount, false};
-    vecSend.push_back(recipient);
-
     CWalletTx wtx;
-    wtx.fFromMe = true;
-    wtx.fTimeReceivedIsTxTime = true;
-    wtx.BindWallet(pwallet);
-
-    CReserveKey reservekey(pwallet);
-    CAmount nFeeRequired;
-    int nChangePosRet = -1;
-    CCoinControl cc;  // TODO Allow user to set coin control
-    cc.signalRbf = false;
-    if (!pwallet->CreateTransaction(vecSend, wtx, reservekey, nFeeRequired, nChangePosRet, strError, cc, true, 3, nHeight, criticalData)) {
-        if (nAmount + nFeeRequired > pwallet->GetBalance() || nAmount < nFeeRequired)
-            strError = strprintf("Error: This transaction requires a transaction fee of at least %s", FormatMoney(nFeeRequired));
-        LogPrintf("%s: %s\n", __func__, strError);
-        throw JSONRPCError(RPC_WALLET_ERROR, strError);
-    }
-    CValidationState state;
-    if (!pwallet->CommitTransaction(wtx, reservekey, g_connman.get(), state)) {
-        strError = strprintf("Error: The transaction was rejected! Reason given: %s", state.GetRejectReason());
+    if (!pwallet->CreateBMMRequest(wtx, strError, nSidechain, hashCritical, nAmount, nMaxAmount, nHeight)) {
         LogPrintf("%s: %s\n", __func__, strError);
         throw JSONRPCError(RPC_WALLET_ERROR, strError);
     }
@@ -3960,6 +4090,49 @@ UniValue createbmmcriticaldatatx(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue listbmmrequests(const JSONRPCRequest& request)
+{
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    if (request.fHelp || request.params.size())
+        throw std::runtime_error(
+            "listbmmrequests\n"
+            "List the BMM requests created by this wallet that haven't been "
+            "included in a block or abandoned yet\n"
+            "\nResult:\n"
+            "[\n"
+            "   {\n"
+            "       \"txid\" : \"txid\",           (string) The BMM request txid\n"
+            "       \"nsidechain\" : n,            (numeric) Sidechain number\n"
+            "       \"criticalhash\" : \"hash\",   (string) h*\n"
+            "       \"amount\" : x.xxx,            (numeric) The bid in " + CURRENCY_UNIT + "\n"
+            "       \"maxamount\" : x.xxx,         (numeric) Highest bid a replacement may pay, 0 if not replaced\n"
+            "       \"height\" : n,                (numeric) Height of the block the request builds on\n"
+            "   }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("listbmmrequests", "")
+            + HelpExampleRpc("listbmmrequests", "")
+            );
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& it : pwallet->GetBMMRequests()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", it.first.ToString()));
+        obj.push_back(Pair("nsidechain", it.second.nSidechain));
+        obj.push_back(Pair("criticalhash", it.second.hashCritical.ToString()));
+        obj.push_back(Pair("amount", ValueFromAmount(it.second.nAmount)));
+        obj.push_back(Pair("maxamount", ValueFromAmount(it.second.nMaxAmount)));
+        obj.push_back(Pair("height", it.second.nHeight));
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
 UniValue rescanblockchain(const JSONRPCRequest& request)
 {
     CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
@@ -4097,7 +4270,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "listreceivedbyaccount",      &listreceivedbyaccount,      {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listreceivedbyaddress",      &listreceivedbyaddress,      {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listsinceblock",             &listsinceblock,             {"blockhash","target_confirmations","include_watchonly","include_removed"} },
-    { "wallet",             "listtransactions",           &listtransactions,           {"account","count","skip","include_watchonly"} },
+    { "wallet",             "listtransactions",           &listtransactions,           {"account","count","skip","include_watchonly","since_height"} },
     { "wallet",             "listunspent",                &listunspent,                {"minconf","maxconf","addresses","include_unsafe","query_options"} },
     { "wallet",             "listwallets",                &listwallets,                {} },
     { "wallet",             "lockunspent",                &lockunspent,                {"unlock","transactions"} },
@@ -4117,7 +4290,9 @@ static const CRPCCommand commands[] =
     { "generating",         "generate",                   &generate,                   {"nblocks","maxtries"} },
 
     { "Drivechain",         "createsidechaindeposit",     &createsidechaindeposit,     {"nSidechain", "depositaddress", "amount", "fee"} },
-    { "Drivechain",         "createbmmcriticaldatatx",    &createbmmcriticaldatatx,    {"amount", "height", "criticalhash", "nsidechain"}},
+    { "Drivechain",         "createsidechaindeposits",    &createsidechaindeposits,    {"nsidechain", "deposits", "fee"} },
+    { "Drivechain",         "createbmmcriticaldatatx",    &createbmmcriticaldatatx,    {"amount", "height", "criticalhash", "nsidechain", "prevbytes", "maxamount"}},
+    { "Drivechain",         "listbmmrequests",            &listbmmrequests,            {} },
 
     { "CoinNews",           "createopreturntransaction",  &createopreturntransaction,  {"text", "fee"} },
     { "CoinNews",           "broadcastnews",              &broadcastnews,              {"header", "text", "fee"} },
@@ -362,6 +362,53 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    bool fBnBUsed;
+    CoinSelectionParams params;
+
+    LOCK(testWallet.cs_wallet);
+
+    empty_wallet();
+
+    add_coin(1 * COIN);
+    add_coin(2 * COIN);
+    add_coin(3 * COIN);
+    add_coin(4 * COIN);
+
+    // An exact match needs no change
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(5 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params, &fBnBUsed));
+    BOOST_CHECK(fBnBUsed);
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // Excess up to the cost of change is accepted
+    params.cost_of_change = COIN / 2;
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(9 * COIN + COIN / 2, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params, &fBnBUsed));
+    BOOST_CHECK(fBnBUsed);
+    BOOST_CHECK_EQUAL(nValueRet, 10 * COIN);
+
+    // No subset within the cost of change, fall back to the knapsack solver
+    params.cost_of_change = CENT;
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(4 * COIN + COIN / 2, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params, &fBnBUsed));
+    BOOST_CHECK(!fBnBUsed);
+    BOOST_CHECK(nValueRet >= 4 * COIN + COIN / 2);
+
+    // Matches are found on effective values: each P2PKH input costs 148
+    // bytes at the effective fee rate
+    params.effective_fee = CFeeRate(1000);
+    params.cost_of_change = 0;
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(5 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params, &fBnBUsed));
+    BOOST_CHECK(!fBnBUsed);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(5 * COIN - 2 * 148, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params, &fBnBUsed));
+    BOOST_CHECK(fBnBUsed);
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+
+    empty_wallet();
+}
+
 static void AddKey(CWallet& wallet, const CKey& key)
 {
     LOCK(wallet.cs_wallet);
@@ -599,6 +646,57 @@ BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
     BOOST_CHECK_EQUAL(values[1], "val_rr1");
 }
 
+BOOST_AUTO_TEST_CASE(TopUpKeyPoolBatch)
+{
+    LOCK(pwalletMain->cs_wallet);
+
+    // More keys than fit in one database transaction of the batch
+    const unsigned int nKeys = WALLETDB_BATCH_SIZE + 10;
+    BOOST_CHECK(pwalletMain->TopUpKeyPool(nKeys));
+    BOOST_CHECK(pwalletMain->GetKeyPoolSize() >= nKeys);
+
+    CWalletDB walletdb(pwalletMain->GetDBHandle());
+    CKeyPool keypool;
+    BOOST_CHECK(walletdb.ReadPool(1, keypool));
+    BOOST_CHECK(pwalletMain->HaveKey(keypool.vchPubKey.GetID()));
+    BOOST_CHECK(walletdb.ReadPool(nKeys, keypool));
+    BOOST_CHECK(pwalletMain->HaveKey(keypool.vchPubKey.GetID()));
+}
+
+BOOST_AUTO_TEST_CASE(GenerateNewKeysHD)
+{
+    LOCK(pwalletMain->cs_wallet);
+    BOOST_CHECK(pwalletMain->SetHDMasterKey(pwalletMain->GenerateNewHDMasterKey()));
+
+    // The keys derived in parallel batches are those at m/0'/0'/<n>'
+    const uint32_t nHardened = 0x80000000;
+    CKey masterSeed;
+    BOOST_CHECK(pwalletMain->GetKey(pwalletMain->GetHDChain().masterKeyID, masterSeed));
+    CExtKey masterKey, accountKey, chainKey, childKey;
+    masterKey.SetMaster(masterSeed.begin(), masterSeed.size());
+    masterKey.Derive(accountKey, nHardened);
+    accountKey.Derive(chainKey, nHardened);
+
+    // A key the wallet already has is skipped
+    chainKey.Derive(childKey, 1 | nHardened);
+    BOOST_CHECK(pwalletMain->AddKey(childKey.key));
+
+    CWalletDB walletdb(pwalletMain->GetDBHandle());
+    std::vector<CPubKey> vPubKey = pwalletMain->GenerateNewKeys(walletdb, 100);
+    BOOST_CHECK_EQUAL(vPubKey.size(), 100U);
+    for (size_t i = 0; i < vPubKey.size(); i++) {
+        const uint32_t nChild = i < 1 ? i : i + 1;
+        chainKey.Derive(childKey, nChild | nHardened);
+        BOOST_CHECK(vPubKey[i] == childKey.key.GetPubKey());
+        BOOST_CHECK_EQUAL(pwalletMain->mapKeyMetadata[vPubKey[i].GetID()].hdKeypath, "m/0'/0'/" + std::to_string(nChild) + "'");
+    }
+    BOOST_CHECK_EQUAL(pwalletMain->GetHDChain().nExternalChainCounter, 101U);
+
+    // And single keys continue from there
+    chainKey.Derive(childKey, 101 | nHardened);
+    BOOST_CHECK(pwalletMain->GenerateNewKey(walletdb) == childKey.key.GetPubKey());
+}
+
 class ListCoinsTestingSetup : public TestChain100Setup
 {
 public:
@@ -702,4 +800,64 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+BOOST_FIXTURE_TEST_CASE(CachedBalance, ListCoinsTestingSetup)
+{
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 50 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetUnconfirmedBalance(), 0);
+
+    // Spending the coin marks the cached balance dirty
+    AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    CAmount nBalance = wallet->GetBalance();
+    BOOST_CHECK(nBalance != 50 * COIN);
+    BOOST_CHECK_EQUAL(nBalance, wallet->GetAvailableBalance());
+
+    // Marking every transaction dirty computes the same balance again
+    wallet->MarkDirty();
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), nBalance);
+}
+
+BOOST_FIXTURE_TEST_CASE(SplitCoins, ListCoinsTestingSetup)
+{
+    AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+
+    std::vector<COutPoint> vOutPoint;
+    CAmount nValue = 0;
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        std::vector<COutput> available;
+        wallet->AvailableCoins(available);
+        BOOST_CHECK_EQUAL(available.size(), 2);
+        for (const COutput& out : available) {
+            vOutPoint.push_back(COutPoint(out.tx->GetHash(), out.i));
+            nValue += out.tx->tx->vout[out.i].nValue;
+        }
+    }
+
+    // An aborted split leaves the coins alone
+    std::vector<uint256> vTxid;
+    std::string strFail;
+    BOOST_CHECK(!wallet->SplitCoins(vOutPoint, nullptr, vTxid, strFail, [](size_t) { return false; }));
+    BOOST_CHECK(vTxid.empty());
+
+    // Both coins fit in one transaction with an output for each
+    size_t nProgress = 0;
+    BOOST_CHECK(wallet->SplitCoins(vOutPoint, nullptr, vTxid, strFail, [&nProgress](size_t n) { nProgress = n; return true; }));
+    BOOST_CHECK_EQUAL(nProgress, vOutPoint.size());
+    BOOST_REQUIRE_EQUAL(vTxid.size(), 1);
+
+    LOCK2(cs_main, wallet->cs_wallet);
+    const CWalletTx& wtx = wallet->mapWallet.at(vTxid[0]);
+    BOOST_CHECK_EQUAL(wtx.tx->nVersion, TX_REPLAY_VERSION);
+    BOOST_CHECK_EQUAL(wtx.tx->vin.size(), 2);
+    BOOST_CHECK_EQUAL(wtx.tx->vout.size(), 2);
+    BOOST_CHECK(wtx.tx->GetValueOut() < nValue);
+    for (const COutPoint& out : vOutPoint) {
+        BOOST_CHECK(wallet->IsSpent(out.hash, out.n));
+        BOOST_CHECK_EQUAL(wallet->GetReplayStatus(out.hash), REPLAY_SPLIT);
+    }
+
+    // Spent coins can't be split again
+    BOOST_CHECK(!wallet->SplitCoins(vOutPoint, nullptr, vTxid, strFail));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
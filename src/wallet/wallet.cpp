@@ -6,14 +6,19 @@
 #include <wallet/wallet.h>
 
 #include <base58.h>
+#include <blockfilemap.h>
+#include <bloom.h>
 #include <checkpoints.h>
 #include <chain.h>
 #include <wallet/coincontrol.h>
 #include <consensus/consensus.h>
+#include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <coins.h>
+#include <crypto/sha256.h>
 #include <dbwrapper.h>
 #include <fs.h>
+#include <hash.h>
 #include <wallet/init.h>
 #include <key.h>
 #include <keystore.h>
@@ -22,6 +27,7 @@
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
+#include <random.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
@@ -33,7 +39,9 @@
 #include <wallet/fees.h>
 
 #include <assert.h>
+#include <algorithm>
 #include <future>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -47,6 +55,8 @@ CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fWalletRbf = DEFAULT_WALLET_RBF;
+unsigned int nBMMBidBump = DEFAULT_BMM_BID_BUMP;
+int64_t nWalletUnlockCache = DEFAULT_WALLET_UNLOCK_CACHE;
 OutputType g_address_type = OUTPUT_TYPE_NONE;
 OutputType g_change_type = OUTPUT_TYPE_NONE;
 
@@ -149,48 +159,76 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
 }
 
 CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
+{
+    return GenerateNewKeys(walletdb, 1, internal)[0];
+}
+
+std::vector<CPubKey> CWallet::GenerateNewKeys(CWalletDB &walletdb, size_t nKeys, bool internal)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
-    CKey secret;
+    std::vector<CKey> vSecret;
+    std::vector<CPubKey> vPubKey;
+    std::vector<std::string> vKeypath;
 
     // Create new metadata
     int64_t nCreationTime = GetTime();
-    CKeyMetadata metadata(nCreationTime);
 
     // use HD key derivation if HD was enabled during wallet creation
     if (IsHDEnabled()) {
-        DeriveNewChildKey(walletdb, metadata, secret, (CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false));
+        DeriveNewChildKeys(walletdb, nKeys, (CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false), vSecret, vPubKey, vKeypath);
     } else {
-        secret.MakeNewKey(fCompressed);
+        for (size_t i = 0; i < nKeys; i++) {
+            CKey secret;
+            secret.MakeNewKey(fCompressed);
+            CPubKey pubkey = secret.GetPubKey();
+            assert(secret.VerifyPubKey(pubkey));
+            vSecret.push_back(secret);
+            vPubKey.push_back(pubkey);
+        }
     }
 
     // Compressed public keys were introduced in version 0.6.0
     if (fCompressed) {
-        SetMinVersion(FEATURE_COMPRPUBKEY);
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
     }
 
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
+    for (size_t i = 0; i < vSecret.size(); i++) {
+        CKeyMetadata metadata(nCreationTime);
+        if (!vKeypath.empty()) {
+            metadata.hdKeypath = vKeypath[i];
+            metadata.hdMasterKeyID = hdChain.masterKeyID;
+        }
+        mapKeyMetadata[vPubKey[i].GetID()] = metadata;
 
-    mapKeyMetadata[pubkey.GetID()] = metadata;
+        if (!AddKeyPubKeyWithDB(walletdb, vSecret[i], vPubKey[i])) {
+            throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+        }
+    }
     UpdateTimeFirstKey(nCreationTime);
 
-    if (!AddKeyPubKeyWithDB(walletdb, secret, pubkey)) {
-        throw std::runtime_error(std::string(__func__) + ": AddKey failed");
-    }
-    return pubkey;
+    return vPubKey;
 }
 
-void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+const CExtKey& CWallet::GetHDChainKey(bool internal)
 {
+    AssertLockHeld(cs_wallet); // hdChainKeyCache
+
+    if (hdChainKeyCacheID != hdChain.masterKeyID) {
+        hdChainKeyCache[0] = CExtKey();
+        hdChainKeyCache[1] = CExtKey();
+        hdChainKeyCacheID = hdChain.masterKeyID;
+    }
+
+    CExtKey& chainChildKey = hdChainKeyCache[internal ? 1 : 0];
+    if (chainChildKey.key.IsValid())
+        return chainChildKey;
+
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
-    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key))
@@ -203,27 +241,67 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
     masterKey.Derive(accountKey, BIP32_HARDENED_KEY_LIMIT);
 
     // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
-    assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
 
-    // derive child key at next index, skip keys already known to the wallet
-    do {
-        // always derive hardened keys
-        // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
-        // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
-        if (internal) {
-            chainChildKey.Derive(childKey, hdChain.nInternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/1'/" + std::to_string(hdChain.nInternalChainCounter) + "'";
-            hdChain.nInternalChainCounter++;
+    return chainChildKey;
+}
+
+void CWallet::DeriveNewChildKeys(CWalletDB &walletdb, size_t nKeys, bool internal, std::vector<CKey>& vSecret, std::vector<CPubKey>& vPubKey, std::vector<std::string>& vKeypath)
+{
+    AssertLockHeld(cs_wallet); // hdChain
+    assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
+
+    const CExtKey& chainChildKey = GetHDChainKey(internal); //key at m/0'/0' (external) or m/0'/1' (internal)
+    uint32_t& nCounter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    const std::string strPath = internal ? "m/0'/1'/" : "m/0'/0'/";
+
+    // derive child keys at the next indexes, skip keys already known to the wallet
+    size_t nFound = 0;
+    while (nFound < nKeys) {
+        const size_t nDerive = nKeys - nFound;
+        const uint32_t nFirst = nCounter;
+        std::vector<CKey> vChild(nDerive);
+        std::vector<CPubKey> vChildPubKey(nDerive);
+
+        // Each thread takes every nThreads'th key, the public key costs as
+        // much as the derivation
+        const int nThreads = std::max(1, std::min<int>({GetNumCores(), MAX_KEY_DERIVATION_THREADS, (int)(nDerive / 16)}));
+        auto work = [&chainChildKey, &vChild, &vChildPubKey, nFirst, nDerive, nThreads](int nThread) {
+            CExtKey childKey;
+            for (size_t i = nThread; i < nDerive; i += nThreads) {
+                // always derive hardened keys
+                // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
+                // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
+                chainChildKey.Derive(childKey, (nFirst + i) | BIP32_HARDENED_KEY_LIMIT);
+                vChild[i] = childKey.key;
+                vChildPubKey[i] = childKey.key.GetPubKey();
+                assert(childKey.key.VerifyPubKey(vChildPubKey[i]));
+            }
+        };
+
+        std::vector<std::thread> vThread;
+        for (int i = 1; i < nThreads; i++) {
+            try {
+                vThread.emplace_back(work, i);
+            } catch (const std::system_error&) {
+                work(i);
+            }
         }
-        else {
-            chainChildKey.Derive(childKey, hdChain.nExternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/0'/" + std::to_string(hdChain.nExternalChainCounter) + "'";
-            hdChain.nExternalChainCounter++;
+        work(0);
+        for (std::thread& thread : vThread)
+            thread.join();
+
+        for (size_t i = 0; i < nDerive; i++) {
+            if (HaveKey(vChildPubKey[i].GetID()))
+                continue;
+            vSecret.push_back(vChild[i]);
+            vPubKey.push_back(vChildPubKey[i]);
+            vKeypath.push_back(strPath + std::to_string(nFirst + i) + "'");
+            nFound++;
         }
-    } while (HaveKey(childKey.key.GetPubKey().GetID()));
-    secret = childKey.key;
-    metadata.hdMasterKeyID = hdChain.masterKeyID;
+        nCounter = nFirst + nDerive;
+    }
+
     // update the chain model in the database
     if (!walletdb.WriteHDChain(hdChain))
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
@@ -250,11 +328,11 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     }
 
     if (!IsCrypted()) {
@@ -267,6 +345,8 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
 {
+    // An imported key may own outputs that are already in the wallet
+    fRebuildWalletCoins = true;
     CWalletDB walletdb(*dbw);
     return CWallet::AddKeyPubKeyWithDB(walletdb, secret, pubkey);
 }
@@ -330,6 +410,7 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    fRebuildWalletCoins = true;
     return CWalletDB(*dbw).WriteCScript(Hash160(redeemScript), redeemScript);
 }
 
@@ -353,6 +434,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    fRebuildWalletCoins = true;
     const CKeyMetadata& meta = m_script_metadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
     NotifyWatchonlyChanged(true);
@@ -366,13 +448,19 @@ bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    CWalletDB walletdb(*dbw);
+    return RemoveWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!CWalletDB(*dbw).EraseWatchOnly(dest))
+    if (!walletdb.EraseWatchOnly(dest))
         return false;
 
     return true;
@@ -390,25 +478,93 @@ bool CWallet::Unlock(const SecureString& strWalletPassphrase)
 
     {
         LOCK(cs_wallet);
+        if (UnlockFromCache(strWalletPassphrase))
+            return true;
         for (const MasterKeyMap::value_type& pMasterKey : mapMasterKeys)
         {
             if(!crypter.SetKeyFromPassphrase(strWalletPassphrase, pMasterKey.second.vchSalt, pMasterKey.second.nDeriveIterations, pMasterKey.second.nDerivationMethod))
                 return false;
             if (!crypter.Decrypt(pMasterKey.second.vchCryptedKey, _vMasterKey))
                 continue; // try another master key
-            if (CCryptoKeyStore::Unlock(_vMasterKey))
+            if (CCryptoKeyStore::Unlock(_vMasterKey)) {
+                CacheUnlockKey(strWalletPassphrase, _vMasterKey);
                 return true;
+            }
         }
     }
     return false;
 }
 
+bool CWallet::Lock()
+{
+    {
+        LOCK(cs_wallet);
+        hdChainKeyCache[0] = CExtKey();
+        hdChainKeyCache[1] = CExtKey();
+        hdChainKeyCacheID.SetNull();
+        if (!vUnlockCacheKey.empty() && GetTime() >= nUnlockCacheExpiry)
+            ClearUnlockCache();
+    }
+    return CCryptoKeyStore::Lock();
+}
+
+static void HashUnlockPassphrase(const SecureString& strWalletPassphrase, const std::vector<unsigned char>& vchSalt, CKeyingMaterial& vchHash)
+{
+    vchHash.resize(CSHA256::OUTPUT_SIZE);
+    CSHA256().Write(vchSalt.data(), vchSalt.size()).Write((const unsigned char*)strWalletPassphrase.data(), strWalletPassphrase.size()).Finalize(vchHash.data());
+}
+
+bool CWallet::UnlockFromCache(const SecureString& strWalletPassphrase)
+{
+    AssertLockHeld(cs_wallet);
+    if (vUnlockCacheKey.empty())
+        return false;
+    if (GetTime() >= nUnlockCacheExpiry) {
+        ClearUnlockCache();
+        return false;
+    }
+
+    CKeyingMaterial vchHash;
+    HashUnlockPassphrase(strWalletPassphrase, vchUnlockCacheSalt, vchHash);
+    unsigned char nDiff = 0;
+    for (size_t i = 0; i < vchHash.size(); i++)
+        nDiff |= vchHash[i] ^ vUnlockCacheHash[i];
+    if (nDiff != 0)
+        return false;
+
+    return CCryptoKeyStore::Unlock(vUnlockCacheKey);
+}
+
+void CWallet::CacheUnlockKey(const SecureString& strWalletPassphrase, const CKeyingMaterial& vMasterKeyIn)
+{
+    AssertLockHeld(cs_wallet);
+    if (nWalletUnlockCache <= 0)
+        return;
+
+    vchUnlockCacheSalt.resize(WALLET_CRYPTO_SALT_SIZE);
+    GetStrongRandBytes(vchUnlockCacheSalt.data(), WALLET_CRYPTO_SALT_SIZE);
+    HashUnlockPassphrase(strWalletPassphrase, vchUnlockCacheSalt, vUnlockCacheHash);
+    vUnlockCacheKey = vMasterKeyIn;
+    nUnlockCacheExpiry = GetTime() + nWalletUnlockCache;
+}
+
+void CWallet::ClearUnlockCache()
+{
+    AssertLockHeld(cs_wallet);
+    // CKeyingMaterial wipes its memory when it is freed
+    CKeyingMaterial().swap(vUnlockCacheKey);
+    CKeyingMaterial().swap(vUnlockCacheHash);
+    vchUnlockCacheSalt.clear();
+    nUnlockCacheExpiry = 0;
+}
+
 bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase)
 {
     bool fWasLocked = IsLocked();
 
     {
         LOCK(cs_wallet);
+        ClearUnlockCache();
         Lock();
 
         CCrypter crypter;
@@ -747,6 +903,38 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddWalletCoins(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (fRebuildWalletCoins)
+        return;
+
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) != ISMINE_NO)
+            setWalletCoins.insert(COutPoint(wtx.GetHash(), i));
+    }
+}
+
+void CWallet::AddWalletCoin(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!fRebuildWalletCoins)
+        setWalletCoins.insert(outpoint);
+}
+
+void CWallet::RebuildWalletCoinsIfNeeded() const
+{
+    AssertLockHeld(cs_wallet);
+    if (!fRebuildWalletCoins)
+        return;
+
+    fRebuildWalletCoins = false;
+    setWalletCoins.clear();
+    for (const auto& entry : mapWallet)
+        AddWalletCoins(entry.second);
+    MarkBalanceDirty();
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -1045,6 +1233,13 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     CWalletDB walletdb(*dbw, "r+", fFlushOnClose);
 
+    return AddToWallet(walletdb, wtxIn);
+}
+
+bool CWallet::AddToWallet(CWalletDB& walletdb, const CWalletTx& wtxIn)
+{
+    AssertLockHeld(cs_wallet);
+
     uint256 hash = wtxIn.GetHash();
 
     // Inserts only if not already there, returns tx inserted or tx found
@@ -1061,6 +1256,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
         AddToSpends(hash);
+        IndexTxBlock(hash, wtx.hashBlock, wtx.hashBlock);
     }
 
     bool fUpdated = false;
@@ -1069,12 +1265,14 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         // Merge
         if (!wtxIn.hashUnset() && wtxIn.hashBlock != wtx.hashBlock)
         {
+            IndexTxBlock(hash, wtx.hashBlock, wtxIn.hashBlock);
             wtx.hashBlock = wtxIn.hashBlock;
             fUpdated = true;
         }
         // If no longer abandoned, update
         if (wtxIn.hashBlock.IsNull() && wtx.isAbandoned())
         {
+            IndexTxBlock(hash, wtx.hashBlock, wtxIn.hashBlock);
             wtx.hashBlock = wtxIn.hashBlock;
             fUpdated = true;
         }
@@ -1115,9 +1313,16 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         if (!walletdb.WriteTx(wtx))
             return false;
 
+    if (fInsertedNew || fUpdated)
+        TagSidechainTx(wtx, !wtx.hashUnset() && wtx.nIndex >= 0);
+
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
+    // Outputs of a new transaction, or of one found again by a rescan after
+    // importing keys, may be spendable
+    AddWalletCoins(wtx);
+
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1140,6 +1345,9 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
     AddToSpends(hash);
+    IndexTxBlock(hash, wtx.hashBlock, wtx.hashBlock);
+    if (!wtx.isAbandoned())
+        TagSidechainTx(wtx, !wtx.hashUnset() && wtx.nIndex >= 0);
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
@@ -1153,6 +1361,153 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     return true;
 }
 
+void CWallet::UnindexTxBlock(const uint256& hashTx, const uint256& hashBlock)
+{
+    AssertLockHeld(cs_wallet);
+
+    for (const uint256& hash : {hashBlock, uint256()}) {
+        auto it = mapTxByBlock.find(hash);
+        if (it == mapTxByBlock.end())
+            continue;
+        it->second.erase(hashTx);
+        if (it->second.empty())
+            mapTxByBlock.erase(it);
+    }
+}
+
+void CWallet::IndexTxBlock(const uint256& hashTx, const uint256& hashOld, const uint256& hashNew)
+{
+    UnindexTxBlock(hashTx, hashOld);
+    mapTxByBlock[hashNew].insert(hashTx);
+}
+
+void CWallet::InitChainView()
+{
+    LOCK2(cs_main, cs_wallet);
+
+    {
+        LOCK(cs_chainview);
+        nChainViewHeight = chainActive.Height();
+        mapChainViewBlock.clear();
+    }
+    for (const auto& bucket : mapTxByBlock) {
+        if (!bucket.first.IsNull() && bucket.first != CMerkleTx::ABANDON_HASH)
+            UpdateChainViewBlock(bucket.first);
+    }
+    fChainView = true;
+}
+
+void CWallet::UpdateChainViewBlock(const uint256& hashBlock)
+{
+    AssertLockHeld(cs_main);
+
+    int nHeight = -1;
+    auto it = mapBlockIndex.find(hashBlock);
+    if (it != mapBlockIndex.end() && chainActive.Contains(it->second))
+        nHeight = it->second->nHeight;
+
+    LOCK(cs_chainview);
+    mapChainViewBlock[hashBlock] = nHeight;
+}
+
+int CWallet::GetChainViewDepth(const uint256& hashBlock) const
+{
+    if (!fChainView)
+        return -1;
+
+    LOCK(cs_chainview);
+    auto it = mapChainViewBlock.find(hashBlock);
+    if (it == mapChainViewBlock.end() || it->second < 0 || it->second > nChainViewHeight)
+        return 0;
+
+    return nChainViewHeight - it->second + 1;
+}
+
+bool CWallet::IsTxFinal(const CTransaction& tx) const
+{
+    if (!fChainView)
+        return CheckFinalTx(tx);
+
+    int nHeight;
+    {
+        LOCK(cs_chainview);
+        nHeight = nChainViewHeight;
+    }
+    // Same as CheckFinalTx without LOCKTIME_MEDIAN_TIME_PAST
+    return IsFinalTx(tx, nHeight + 1, GetAdjustedTime());
+}
+
+std::unique_ptr<CCriticalBlock> CWallet::LockChainIfNoView() const
+{
+    if (fChainView)
+        return nullptr;
+    return std::unique_ptr<CCriticalBlock>(new CCriticalBlock(cs_main, "cs_main", __FILE__, __LINE__));
+}
+
+std::vector<const CWalletTx*> CWallet::GetTransactionsSince(int nHeight) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::vector<std::pair<int64_t, const CWalletTx*>> vTx;
+    auto collect = [this, &vTx](const uint256& hashBlock) {
+        auto it = mapTxByBlock.find(hashBlock);
+        if (it == mapTxByBlock.end())
+            return;
+        for (const uint256& hash : it->second) {
+            auto itTx = mapWallet.find(hash);
+            if (itTx != mapWallet.end())
+                vTx.emplace_back(itTx->second.nOrderPos, &itTx->second);
+        }
+    };
+
+    for (int i = std::max(0, nHeight); i <= chainActive.Height(); i++)
+        collect(chainActive[i]->GetBlockHash());
+
+    // Unconfirmed, including the ones from disconnected blocks, and abandoned
+    collect(uint256());
+    collect(CMerkleTx::ABANDON_HASH);
+
+    std::sort(vTx.begin(), vTx.end(), [](const std::pair<int64_t, const CWalletTx*>& a, const std::pair<int64_t, const CWalletTx*>& b) {
+        return a.first > b.first;
+    });
+
+    std::vector<const CWalletTx*> vRet;
+    vRet.reserve(vTx.size());
+    for (const auto& tx : vTx)
+        vRet.push_back(tx.second);
+
+    return vRet;
+}
+
+void CWallet::TagSidechainTx(const CWalletTx& wtx, bool fInBlock)
+{
+    AssertLockHeld(cs_wallet);
+
+    if (wtx.IsCoinBase())
+        return;
+
+    const uint256& hash = wtx.GetHash();
+
+    if (!wtx.tx->criticalData.IsNull()) {
+        if (fInBlock)
+            setCriticalDataTx.erase(hash);
+        else
+            setCriticalDataTx.insert(hash);
+    }
+
+    for (const CTxOut& out : wtx.tx->vout) {
+        uint8_t nSidechain;
+        if (!out.scriptPubKey.IsDrivechain(nSidechain))
+            continue;
+        if (fInBlock)
+            setDepositTx.erase(hash);
+        else
+            setDepositTx.insert(hash);
+        break;
+    }
+}
+
 /**
  * Add a transaction to the wallet, or update it.  pIndex and posInBlock should
  * be set when the transaction was known to be included in a block.  When
@@ -1218,6 +1573,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockI
             // Get merkle branch if transaction was found in a block
             if (pIndex != nullptr)
                 wtx.SetMerkleBranch(pIndex, posInBlock);
+                UpdateChainViewBlock(pIndex->GetBlockHash());
 
             return AddToWallet(wtx, false);
         }
@@ -1238,6 +1594,14 @@ bool CWallet::AbandonTransaction(const uint256& hashTx, std::string* pstrReason)
 
     CWalletDB walletdb(*dbw, "r+");
 
+    return AbandonTransaction(walletdb, hashTx, pstrReason);
+}
+
+bool CWallet::AbandonTransaction(CWalletDB& walletdb, const uint256& hashTx, std::string* pstrReason)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
     std::set<uint256> todo;
     std::set<uint256> done;
 
@@ -1273,6 +1637,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx, std::string* pstrReason)
             // If the orig tx was not in block/mempool, none of its spends can be in mempool
             assert(!wtx.InMempool());
             wtx.nIndex = -1;
+            IndexTxBlock(now, wtx.hashBlock, CMerkleTx::ABANDON_HASH);
             wtx.setAbandoned();
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
@@ -1292,6 +1657,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx, std::string* pstrReason)
                 auto it = mapWallet.find(txin.prevout.hash);
                 if (it != mapWallet.end()) {
                     it->second.MarkDirty();
+                    AddWalletCoin(txin.prevout);
                 }
             }
         }
@@ -1300,10 +1666,56 @@ bool CWallet::AbandonTransaction(const uint256& hashTx, std::string* pstrReason)
     return true;
 }
 
+void CWallet::AbandonSidechainTransactions(bool fCriticalData, std::vector<std::pair<uint256, std::string>>& vResult)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    vResult.clear();
+
+    std::set<uint256>& setTx = fCriticalData ? setCriticalDataTx : setDepositTx;
+    if (setTx.empty())
+        return;
+
+    CWalletDB walletdb(*dbw, "r+");
+    bool fBatch = walletdb.TxnBegin();
+
+    for (auto it = setTx.begin(); it != setTx.end(); ) {
+        auto itTx = mapWallet.find(*it);
+        if (itTx == mapWallet.end() || itTx->second.isAbandoned() || itTx->second.GetDepthInMainChain() != 0) {
+            it = setTx.erase(it);
+            continue;
+        }
+        CWalletTx& wtx = itTx->second;
+
+        // Still waiting to be mined, or not ours to give up on
+        if (mempool.exists(wtx.GetHash()) || !wtx.IsFromMe(ISMINE_ALL)) {
+            it++;
+            continue;
+        }
+
+        // The mempool may have dropped it before our notification arrived
+        wtx.fInMempool = false;
+
+        std::string strReason;
+        if (AbandonTransaction(walletdb, wtx.GetHash(), &strReason)) {
+            vResult.emplace_back(wtx.GetHash(), "");
+            it = setTx.erase(it);
+        } else {
+            vResult.emplace_back(wtx.GetHash(), strReason);
+            it++;
+        }
+    }
+
+    if (fBatch && !walletdb.TxnCommit())
+        LogPrintf("%s: Failed to write abandoned transactions\n", __func__);
+}
+
 void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
 {
     LOCK2(cs_main, cs_wallet);
 
+    UpdateChainViewBlock(hashBlock);
+
     int conflictconfirms = 0;
     if (mapBlockIndex.count(hashBlock)) {
         CBlockIndex* pindex = mapBlockIndex[hashBlock];
@@ -1338,6 +1750,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             // Block is 'more conflicted' than current confirm; update.
             // Mark transaction as conflicted with this block.
             wtx.nIndex = -1;
+            IndexTxBlock(now, wtx.hashBlock, hashBlock);
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
             walletdb.WriteTx(wtx);
@@ -1355,6 +1768,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
                 auto it = mapWallet.find(txin.prevout.hash);
                 if (it != mapWallet.end()) {
                     it->second.MarkDirty();
+                    AddWalletCoin(txin.prevout);
                 }
             }
         }
@@ -1374,6 +1788,7 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
             it->second.MarkDirty();
+            AddWalletCoin(txin.prevout);
         }
     }
 }
@@ -1385,6 +1800,7 @@ void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = true;
+        MarkBalanceDirty();
     }
 }
 
@@ -1393,11 +1809,21 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = false;
+        MarkBalanceDirty();
     }
 }
 
 void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) {
     LOCK2(cs_main, cs_wallet);
+
+    if (fChainView) {
+        LOCK(cs_chainview);
+        nChainViewHeight = pindex->nHeight;
+        auto it = mapChainViewBlock.find(pindex->GetBlockHash());
+        if (it != mapChainViewBlock.end())
+            it->second = pindex->nHeight;
+    }
+
     // TODO: Temporarily ensure that mempool removals are notified before
     // connected transactions.  This shouldn't matter, but the abandoned
     // state of transactions in our wallet is currently cleared when we
@@ -1415,15 +1841,42 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         TransactionRemovedFromMempool(pblock->vtx[i]);
     }
 
+    // Coinbases mature and transactions get confirmed with the new tip
+    MarkBalanceDirty();
+
+    UpdateBMMRequests(*pblock, pindex);
+
     m_last_block_processed = pindex;
 }
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     LOCK2(cs_main, cs_wallet);
 
+    if (fChainView) {
+        LOCK(cs_chainview);
+        auto it = mapChainViewBlock.find(pblock->GetHash());
+        if (it != mapChainViewBlock.end()) {
+            nChainViewHeight = it->second - 1;
+            it->second = -1;
+        } else {
+            nChainViewHeight--;
+        }
+    }
+
+
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx);
+
+        // Back to unconfirmed, SyncTransaction leaves the block hash as is
+        auto it = mapWallet.find(ptx->GetHash());
+        if (it != mapWallet.end()) {
+            TagSidechainTx(it->second, false);
+            if (it->second.hashBlock == pblock->GetHash())
+                IndexTxBlock(it->first, it->second.hashBlock, uint256());
+        }
     }
+
+    MarkBalanceDirty();
 }
 
 
@@ -1748,6 +2201,142 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+/**
+ * The data pushed by the scriptPubKeys a wallet may consider its own: its
+ * public keys and their hashes, and the hashes of its scripts, as used by
+ * P2PK, P2PKH, P2SH and witness outputs. Watch-only scripts are matched as
+ * a whole. Any output IsMine() accepts matches, but outputs that match
+ * aren't necessarily ours; IsMine() has the final say.
+ */
+class CWalletScriptFilter
+{
+public:
+    explicit CWalletScriptFilter(size_t nElements) :
+        filter(std::max(nElements, (size_t)1), 0.0001, GetRand(std::numeric_limits<unsigned int>::max()), BLOOM_UPDATE_NONE) {}
+
+    void InsertKey(const CPubKey& pubkey)
+    {
+        Insert(std::vector<unsigned char>(pubkey.begin(), pubkey.end()));
+        const CKeyID keyid = pubkey.GetID();
+        Insert(std::vector<unsigned char>(keyid.begin(), keyid.end()));
+    }
+
+    void InsertScript(const CScript& script)
+    {
+        const CScriptID scriptid(script);
+        Insert(std::vector<unsigned char>(scriptid.begin(), scriptid.end()));
+        uint256 hash;
+        CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+        Insert(std::vector<unsigned char>(hash.begin(), hash.end()));
+    }
+
+    void InsertWatchOnly(const CScript& script)
+    {
+        setWatchOnly.insert(script);
+    }
+
+    bool MayBeMine(const CScript& scriptPubKey) const
+    {
+        if (setWatchOnly.count(scriptPubKey))
+            return true;
+
+        CScript::const_iterator pc = scriptPubKey.begin();
+        opcodetype opcode;
+        std::vector<unsigned char> vch;
+        while (pc < scriptPubKey.end()) {
+            if (!scriptPubKey.GetOp(pc, opcode, vch))
+                return false;
+            // The bloom filter rejects most data cheaply
+            if (vch.size() >= 20 && filter.contains(vch) && setElements.count(vch))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    void Insert(const std::vector<unsigned char>& vch)
+    {
+        filter.insert(vch);
+        setElements.insert(vch);
+    }
+
+    CBloomFilter filter;
+    std::set<std::vector<unsigned char>> setElements;
+    std::set<CScript> setWatchOnly;
+};
+
+size_t CWallet::KeyStoreSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapWatchKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+std::shared_ptr<const CWalletScriptFilter> CWallet::MakeScriptFilter(size_t& nKeyStoreSize) const
+{
+    LOCK(cs_KeyStore);
+    nKeyStoreSize = KeyStoreSize();
+
+    // Public keys and their hashes, script hashes
+    std::shared_ptr<CWalletScriptFilter> filter = std::make_shared<CWalletScriptFilter>(2 * nKeyStoreSize);
+    for (const auto& entry : mapKeys)
+        filter->InsertKey(entry.second.GetPubKey());
+    for (const auto& entry : mapCryptedKeys)
+        filter->InsertKey(entry.second.first);
+    for (const auto& entry : mapWatchKeys)
+        filter->InsertKey(entry.second);
+    for (const auto& entry : mapScripts)
+        filter->InsertScript(entry.second);
+    for (const CScript& script : setWatchOnly)
+        filter->InsertWatchOnly(script);
+    return filter;
+}
+
+/** A block read ahead by ScanForWalletTransactions */
+struct CRescanBlock
+{
+    CBlockIndex* pindex = nullptr;
+    CBlock block;
+    bool fRead = false;
+    //! Filter vMayBeMine was computed with
+    std::shared_ptr<const CWalletScriptFilter> filter;
+    //! Per transaction, whether any of its outputs may be ours
+    std::vector<bool> vMayBeMine;
+};
+
+static void MatchRescanBlock(CRescanBlock& item, const std::shared_ptr<const CWalletScriptFilter>& filter)
+{
+    item.filter = filter;
+    item.vMayBeMine.assign(item.block.vtx.size(), false);
+    for (size_t i = 0; i < item.block.vtx.size(); i++) {
+        for (const CTxOut& txout : item.block.vtx[i]->vout) {
+            if (filter->MayBeMine(txout.scriptPubKey)) {
+                item.vMayBeMine[i] = true;
+                break;
+            }
+        }
+    }
+}
+
+/** Read and match vBlock on nThreads threads, the futures are ready once done */
+static std::vector<std::future<void>> StartRescanReaders(std::vector<CRescanBlock>& vBlock, const std::shared_ptr<const CWalletScriptFilter>& filter,
+                                                         int nThreads, const std::atomic<bool>& fAbort)
+{
+    std::shared_ptr<std::atomic<size_t>> next = std::make_shared<std::atomic<size_t>>(0);
+    std::vector<std::future<void>> vReaders;
+    for (int i = 0; i < nThreads; i++) {
+        vReaders.push_back(std::async(std::launch::async, [&vBlock, filter, next, &fAbort] {
+            size_t n;
+            while (!fAbort && (n = (*next)++) < vBlock.size()) {
+                CRescanBlock& item = vBlock[n];
+                item.fRead = ReadBlockFromDisk(item.block, item.pindex, Params().GetConsensus());
+                if (item.fRead)
+                    MatchRescanBlock(item, filter);
+            }
+        }));
+    }
+    return vReaders;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1763,6 +2352,13 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * Caller needs to make sure pindexStop (and the optional pindexStart) are on
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
+ *
+ * Blocks are read ahead on up to MAX_RESCAN_THREADS threads, which also
+ * match their outputs against a CWalletScriptFilter. Transactions are then
+ * applied in order, and only the ones with an output that may be ours, or
+ * which spend or conflict with a wallet transaction, go through
+ * AddToWalletIfInvolvingMe. The filter is made again when the rescan adds
+ * keys to the keypool.
  */
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver &reserver, bool fUpdate)
 {
@@ -1777,6 +2373,7 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
     {
+        BlockFileMapScan scan;
         fAbortRescan = false;
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         CBlockIndex* tip = nullptr;
@@ -1788,50 +2385,101 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
             dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
         }
-        while (pindex && !fAbortRescan)
+
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        size_t nKeyStoreSize;
+        std::shared_ptr<const CWalletScriptFilter> filter;
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
-                double gvp = 0;
-                {
+            LOCK(cs_wallet);
+            filter = MakeScriptFilter(nKeyStoreSize);
+        }
+
+        // Next blocks of the active chain to read, pindexNext is the one after
+        CBlockIndex* pindexNext = pindex;
+        auto collect = [&](std::vector<CRescanBlock>& vBlock) {
+            vBlock.clear();
+            LOCK(cs_main);
+            while (pindexNext && vBlock.size() < RESCAN_BATCH_BLOCKS) {
+                vBlock.emplace_back();
+                vBlock.back().pindex = pindexNext;
+                pindexNext = pindexNext == pindexStop ? nullptr : chainActive.Next(pindexNext);
+            }
+        };
+
+        std::vector<CRescanBlock> vCurrent;
+        std::vector<CRescanBlock> vNext;
+        collect(vNext);
+        std::vector<std::future<void>> vReaders = StartRescanReaders(vNext, filter, nThreads, fAbortRescan);
+        bool fDone = false;
+        while (!fDone && !vNext.empty() && !fAbortRescan)
+        {
+            for (std::future<void>& reader : vReaders)
+                reader.wait();
+            std::swap(vCurrent, vNext);
+            // Read the next blocks while these are applied
+            collect(vNext);
+            vReaders = StartRescanReaders(vNext, filter, nThreads, fAbortRescan);
+
+            for (CRescanBlock& item : vCurrent)
+            {
+                pindex = item.pindex;
+                if (fAbortRescan) {
+                    fDone = true;
+                    break;
+                }
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                    double gvp = 0;
+                    {
+                        LOCK(cs_main);
+                        gvp = GuessVerificationProgress(chainParams.TxData(), pindex);
+                        if (tip != chainActive.Tip()) {
+                            tip = chainActive.Tip();
+                            // in case the tip has changed, update progress max
+                            dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
+                        }
+                    }
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((gvp - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                }
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
                     LOCK(cs_main);
-                    gvp = GuessVerificationProgress(chainParams.TxData(), pindex);
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+                }
+
+                if (!item.fRead) {
+                    ret = pindex;
+                    continue;
                 }
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((gvp - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-            }
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LOCK(cs_main);
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
-            }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
                 LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
+                if (!chainActive.Contains(pindex)) {
                     // Abort scan if current block is no longer active, to prevent
                     // marking transactions as coming from the wrong block.
                     ret = pindex;
+                    fDone = true;
                     break;
                 }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-            } else {
-                ret = pindex;
-            }
-            if (pindex == pindexStop) {
-                break;
-            }
-            {
-                LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
-                if (tip != chainActive.Tip()) {
-                    tip = chainActive.Tip();
-                    // in case the tip has changed, update progress max
-                    dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
+                if (item.filter != filter)
+                    MatchRescanBlock(item, filter);
+                for (size_t posInBlock = 0; posInBlock < item.block.vtx.size(); ++posInBlock) {
+                    const CTransaction& tx = *item.block.vtx[posInBlock];
+                    bool fRelevant = item.vMayBeMine[posInBlock] || mapWallet.count(tx.GetHash());
+                    for (size_t i = 0; i < tx.vin.size() && !fRelevant; i++) {
+                        // Spends a wallet output, or conflicts with a wallet transaction
+                        fRelevant = mapWallet.count(tx.vin[i].prevout.hash) || mapTxSpends.count(tx.vin[i].prevout);
+                    }
+                    if (fRelevant)
+                        AddToWalletIfInvolvingMe(item.block.vtx[posInBlock], pindex, posInBlock, fUpdate);
                 }
+                // Keys were added to the keypool, the blocks read ahead are
+                // matched again when they are applied
+                if (KeyStoreSize() != nKeyStoreSize)
+                    filter = MakeScriptFilter(nKeyStoreSize);
             }
         }
+        for (std::future<void>& reader : vReaders)
+            reader.wait();
+
         if (pindex && fAbortRescan) {
             LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
         }
@@ -2069,6 +2717,21 @@ CAmount CWalletTx::GetChange() const
     return nChangeCached;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet)
+        pwallet->MarkBalanceDirty();
+}
+
 bool CWalletTx::InMempool() const
 {
     return fInMempool;
@@ -2077,7 +2740,7 @@ bool CWalletTx::InMempool() const
 bool CWalletTx::IsTrusted() const
 {
     // Quick answer in most cases
-    if (!CheckFinalTx(*tx))
+    if (!pwallet->IsTxFinal(*tx))
         return false;
     int nDepth = GetDepthInMainChain();
     if (nDepth >= 1)
@@ -2176,94 +2839,88 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+const CWalletBalance& CWallet::GetCachedBalance() const
 {
-    CAmount nTotal = 0;
+    AssertLockHeld(cs_wallet);
+
+    RebuildWalletCoinsIfNeeded();
+    if (fBalanceCached)
+        return cachedBalance;
+
+    // Set before computing, so that a transaction marked dirty meanwhile
+    // invalidates the result
+    fBalanceCached = true;
+    CWalletBalance balance;
+    uint256 hashPrev;
+    for (const COutPoint& outpoint : setWalletCoins)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+        // Outputs of a transaction are adjacent in the set
+        if (outpoint.hash == hashPrev)
+            continue;
+        hashPrev = outpoint.hash;
+
+        auto it = mapWallet.find(outpoint.hash);
+        if (it == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &it->second;
+
+        const bool fTrusted = pcoin->IsTrusted();
+        const bool fUntrustedPending = !fTrusted && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool();
+        if (fTrusted) {
+            balance.nTrusted += pcoin->GetAvailableCredit();
+            balance.nWatchOnlyTrusted += pcoin->GetAvailableWatchOnlyCredit();
+        } else if (fUntrustedPending) {
+            balance.nUntrustedPending += pcoin->GetAvailableCredit();
+            balance.nWatchOnlyUntrustedPending += pcoin->GetAvailableWatchOnlyCredit();
         }
+        balance.nImmature += pcoin->GetImmatureCredit();
+        balance.nWatchOnlyImmature += pcoin->GetImmatureWatchOnlyCredit();
     }
+    cachedBalance = balance;
+
+    return cachedBalance;
+}
 
-    return nTotal;
+CAmount CWallet::GetBalance() const
+{
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
+    return GetCachedBalance().nTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
+    return GetCachedBalance().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
+    return GetCachedBalance().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
+    return GetCachedBalance().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
+    return GetCachedBalance().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
+    return GetCachedBalance().nWatchOnlyImmature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2274,13 +2931,14 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
 // trusted.
 CAmount CWallet::GetLegacyBalance(const isminefilter& filter, int minDepth, const std::string* account) const
 {
-    LOCK2(cs_main, cs_wallet);
+    auto lockChain = LockChainIfNoView();
+    LOCK(cs_wallet);
 
     CAmount balance = 0;
     for (const auto& entry : mapWallet) {
         const CWalletTx& wtx = entry.second;
         const int depth = wtx.GetDepthInMainChain();
-        if (depth < 0 || !CheckFinalTx(*wtx.tx) || wtx.GetBlocksToMaturity() > 0) {
+        if (depth < 0 || !IsTxFinal(*wtx.tx) || wtx.GetBlocksToMaturity() > 0) {
             continue;
         }
 
@@ -2332,28 +2990,42 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
     vCoins.clear();
     CAmount nTotal = 0;
 
-    for (const auto& entry : mapWallet)
+    RebuildWalletCoinsIfNeeded();
+
+    std::set<COutPoint>::const_iterator it = setWalletCoins.begin();
+    while (it != setWalletCoins.end())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx* pcoin = &entry.second;
+        const uint256 wtxid = it->hash;
+        std::set<COutPoint>::const_iterator itEnd = it;
+        while (itEnd != setWalletCoins.end() && itEnd->hash == wtxid)
+            ++itEnd;
 
-        if (IsScheduled(wtxid))
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(wtxid);
+        if (mit == mapWallet.end()) {
+            setWalletCoins.erase(it, itEnd);
+            it = itEnd;
             continue;
+        }
+        const CWalletTx* pcoin = &mit->second;
 
-        if (!CheckFinalTx(*pcoin->tx))
+        if (IsScheduled(wtxid) || !IsTxFinal(*pcoin->tx)) {
+            it = itEnd;
             continue;
+        }
 
-        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0) {
+            it = itEnd;
             continue;
+        }
 
         int nDepth = pcoin->GetDepthInMainChain();
-        if (nDepth < 0)
-            continue;
 
         // We should not consider coins which aren't at least in our mempool
         // It's possible for these to be conflicted via ancestors which we may never be able to detect
-        if (nDepth == 0 && !pcoin->InMempool())
+        if (nDepth < 0 || (nDepth == 0 && !pcoin->InMempool())) {
+            it = itEnd;
             continue;
+        }
 
         bool safeTx = pcoin->IsTrusted();
 
@@ -2388,29 +3060,33 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
             safeTx = false;
         }
 
-        if (fOnlySafe && !safeTx) {
+        if ((fOnlySafe && !safeTx) || nDepth < nMinDepth || nDepth > nMaxDepth) {
+            it = itEnd;
             continue;
         }
 
-        if (nDepth < nMinDepth || nDepth > nMaxDepth)
-            continue;
-
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-            if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
+        while (it != itEnd) {
+            std::set<COutPoint>::const_iterator itCoin = it++;
+            const unsigned int i = itCoin->n;
+            if (i >= pcoin->tx->vout.size()) {
+                setWalletCoins.erase(itCoin);
                 continue;
+            }
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(*itCoin))
                 continue;
 
-            if (IsSpent(wtxid, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
-            isminetype mine = IsMine(pcoin->tx->vout[i]);
-
-            if (mine == ISMINE_NO) {
+            isminetype mine = ISMINE_NO;
+            if (IsSpent(wtxid, i) || (mine = IsMine(pcoin->tx->vout[i])) == ISMINE_NO) {
+                // Spent outputs are added back by AddWalletCoin when the
+                // transaction spending them is conflicted or abandoned
+                setWalletCoins.erase(itCoin);
                 continue;
             }
 
@@ -2545,20 +3221,106 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+/**
+ * Estimated virtual size of an input spending txout once signed, for the
+ * output types the wallet creates: P2SH-P2WPKH and bech32 outputs are
+ * spent with a witness, anything else is assumed to be P2PKH.
+ */
+static size_t EstimateInputSize(const CTxOut& txout)
 {
-    setCoinsRet.clear();
-    nValueRet = 0;
+    int witnessversion = 0;
+    std::vector<unsigned char> witnessprogram;
+    if (txout.scriptPubKey.IsPayToScriptHash() || txout.scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram))
+        return 91;
+    return 148;
+}
 
-    // List of values less than target
-    boost::optional<CInputCoin> coinLowestLarger;
-    std::vector<CInputCoin> vValue;
-    CAmount nTotalLower = 0;
+/**
+ * Depth first search for a subset of vUTXO whose effective values add up to
+ * at least nTargetValue and at most nTargetValue + nCostOfChange, so that
+ * the transaction needs no change output. vUTXO must be sorted by
+ * descending effective value. Among the subsets found in BNB_TOTAL_TRIES
+ * steps the one with the smallest excess is returned.
+ */
+static bool SelectCoinsBnB(const std::vector<std::pair<CAmount, CInputCoin>>& vUTXO, const CAmount& nTargetValue, const CAmount& nCostOfChange,
+                           std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
+{
+    static const size_t BNB_TOTAL_TRIES = 100000;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    CAmount nAvailable = 0;
+    for (const auto& utxo : vUTXO)
+        nAvailable += utxo.first;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    CAmount nCurrent = 0;
+    CAmount nBestExcess = MAX_MONEY;
+    std::vector<bool> vCurrent;
+    std::vector<bool> vBest;
+    vCurrent.reserve(vUTXO.size());
+
+    for (size_t nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nCurrent + nAvailable < nTargetValue || nCurrent > nTargetValue + nCostOfChange) {
+            // This branch can't reach the target, or overshot it
+            fBacktrack = true;
+        } else if (nCurrent >= nTargetValue) {
+            if (nCurrent - nTargetValue < nBestExcess) {
+                nBestExcess = nCurrent - nTargetValue;
+                vBest = vCurrent;
+                if (nBestExcess == 0)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last included UTXO and try excluding it
+            while (!vCurrent.empty() && !vCurrent.back()) {
+                vCurrent.pop_back();
+                nAvailable += vUTXO[vCurrent.size()].first;
+            }
+            if (vCurrent.empty())
+                break; // Searched the whole tree
+            vCurrent.back() = false;
+            nCurrent -= vUTXO[vCurrent.size() - 1].first;
+        } else {
+            const CAmount& nValue = vUTXO[vCurrent.size()].first;
+            nAvailable -= nValue;
+            // Including a UTXO of the same value as the one just excluded
+            // leads to subsets that were already searched
+            if (!vCurrent.empty() && !vCurrent.back() && nValue == vUTXO[vCurrent.size() - 1].first) {
+                vCurrent.push_back(false);
+            } else {
+                vCurrent.push_back(true);
+                nCurrent += nValue;
+            }
+        }
+    }
+
+    if (vBest.empty())
+        return false;
+
+    for (size_t i = 0; i < vBest.size(); i++) {
+        if (vBest[i]) {
+            setCoinsRet.insert(vUTXO[i].second);
+            nValueRet += vUTXO[i].second.txout.nValue;
+        }
+    }
+    return true;
+}
 
-    for (const COutput &output : vCoins)
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const std::vector<COutput>& vAvailableCoins,
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams* params, bool* pfBnBUsed) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+    if (pfBnBUsed)
+        *pfBnBUsed = false;
+
+    std::vector<CInputCoin> vCoins;
+    vCoins.reserve(vAvailableCoins.size());
+    for (const COutput &output : vAvailableCoins)
     {
         if (!output.fSpendable)
             continue;
@@ -2571,10 +3333,37 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
             continue;
 
-        int i = output.i;
+        vCoins.push_back(CInputCoin(pcoin, output.i));
+    }
+
+    if (params) {
+        std::vector<std::pair<CAmount, CInputCoin>> vUTXO;
+        vUTXO.reserve(vCoins.size());
+        for (const CInputCoin& coin : vCoins) {
+            CAmount nEffectiveValue = coin.txout.nValue - params->effective_fee.GetFee(EstimateInputSize(coin.txout));
+            // Coins that cost more to spend than they are worth are never useful
+            if (nEffectiveValue > 0)
+                vUTXO.emplace_back(nEffectiveValue, coin);
+        }
+        std::sort(vUTXO.begin(), vUTXO.end(), [](const std::pair<CAmount, CInputCoin>& a, const std::pair<CAmount, CInputCoin>& b) {
+            return a.first > b.first;
+        });
+        if (SelectCoinsBnB(vUTXO, nTargetValue + params->not_input_fees, params->cost_of_change, setCoinsRet, nValueRet)) {
+            if (pfBnBUsed)
+                *pfBnBUsed = true;
+            return true;
+        }
+    }
+
+    // List of values less than target
+    boost::optional<CInputCoin> coinLowestLarger;
+    std::vector<CInputCoin> vValue;
+    CAmount nTotalLower = 0;
 
-        CInputCoin coin = CInputCoin(pcoin, i);
+    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
 
+    for (const CInputCoin& coin : vCoins)
+    {
         if (coin.txout.nValue == nTargetValue)
         {
             setCoinsRet.insert(coin);
@@ -2651,14 +3440,15 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, const CoinSelectionParams* params, bool* pfBnBUsed) const
 {
-    std::vector<COutput> vCoins(vAvailableCoins);
+    if (pfBnBUsed)
+        *pfBnBUsed = false;
 
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
     if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs)
     {
-        for (const COutput& out : vCoins)
+        for (const COutput& out : vAvailableCoins)
         {
             if (!out.fSpendable)
                  continue;
@@ -2690,26 +3480,34 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
             return false; // TODO: Allow non-wallet inputs
     }
 
-    // remove preset inputs from vCoins
-    for (std::vector<COutput>::iterator it = vCoins.begin(); it != vCoins.end() && coinControl && coinControl->HasSelected();)
+    // remove preset inputs from vCoins, and only keep the coins that can be
+    // selected at all so the passes below don't filter them again
+    std::vector<COutput> vCoins;
+    vCoins.reserve(vAvailableCoins.size());
+    for (const COutput& out : vAvailableCoins)
     {
-        if (setPresetCoins.count(CInputCoin(it->tx, it->i)))
-            it = vCoins.erase(it);
-        else
-            ++it;
+        if (!out.fSpendable)
+            continue;
+        if (coinControl && coinControl->HasSelected() && setPresetCoins.count(CInputCoin(out.tx, out.i)))
+            continue;
+        vCoins.push_back(out);
     }
 
+    // The effective value target doesn't account for preset inputs
+    if (!setPresetCoins.empty())
+        params = nullptr;
+
     size_t nMaxChainLength = std::min(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT), gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT));
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet));
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, params, pfBnBUsed) ||
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, params, pfBnBUsed) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, params, pfBnBUsed)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, params, pfBnBUsed)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, params, pfBnBUsed)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, params, pfBnBUsed)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, params, pfBnBUsed));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -2725,23 +3523,16 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
     AssertLockHeld(cs_wallet); // mapWallet
 
     // sign the new tx
-    CTransaction txNewConst(tx);
-    int nIn = 0;
+    std::vector<CTxOut> vSpent;
+    vSpent.reserve(tx.vin.size());
     for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
-            return false;
-        }
-        UpdateTransaction(tx, nIn, sigdata);
-        nIn++;
+        vSpent.push_back(mi->second.tx->vout[input.prevout.n]);
     }
-    return true;
+    return SignTransactionInputs(*this, tx, vSpent, SIGHASH_ALL);
 }
 
 bool CWallet::FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl coinControl)
@@ -2937,6 +3728,14 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
             size_t change_prototype_size = GetSerializeSize(change_prototype_txout, SER_DISK, 0);
 
             CFeeRate discard_rate = GetDiscardRate(::feeEstimator);
+
+            // Look for inputs that need no change on the first pass only;
+            // later passes already know the fee and use the knapsack solver
+            CoinSelectionParams coin_selection_params;
+            coin_selection_params.effective_fee = CFeeRate(GetMinimumFee(1000, coin_control, ::mempool, ::feeEstimator, nullptr));
+            coin_selection_params.cost_of_change = discard_rate.GetFee(EstimateInputSize(change_prototype_txout)) + coin_selection_params.effective_fee.GetFee(change_prototype_size);
+            bool use_bnb = nSubtractFeeFromAmount == 0;
+
             nFeeRet = 0;
             bool pick_new_inputs = true;
             CAmount nValueIn = 0;
@@ -2988,19 +3787,31 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 }
 
                 // Choose coins to use
+                bool bnb_used = false;
                 if (pick_new_inputs) {
                     nValueIn = 0;
                     setCoins.clear();
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control))
+                    if (use_bnb) {
+                        coin_selection_params.not_input_fees = coin_selection_params.effective_fee.GetFee(GetVirtualTransactionSize(CTransaction(txNew)));
+                    }
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, use_bnb ? &coin_selection_params : nullptr, &bnb_used))
                     {
                         strFailReason = _("Insufficient funds");
                         return false;
                     }
+                    use_bnb = false;
                 }
 
                 const CAmount nChange = nValueIn - nValueToSelect;
 
-                if (nChange > 0)
+                if (bnb_used)
+                {
+                    // The inputs were chosen so that the excess is less than
+                    // what a change output would cost; it all goes to the fee
+                    nChangePosInOut = -1;
+                    nFeeRet += nChange;
+                }
+                else if (nChange > 0)
                 {
                     // Fill a vout to ourself
                     CTxOut newTxOut(nChange, scriptChange);
@@ -3123,82 +3934,239 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                     }
                 }
 
-                // If subtracting fee from recipients, we now know what fee we
-                // need to subtract, we have no reason to reselect inputs
-                if (nSubtractFeeFromAmount > 0) {
-                    pick_new_inputs = false;
-                }
+                // If subtracting fee from recipients, we now know what fee we
+                // need to subtract, we have no reason to reselect inputs
+                if (nSubtractFeeFromAmount > 0) {
+                    pick_new_inputs = false;
+                }
+
+                // Include more fee and try again.
+                nFeeRet = nFeeNeeded;
+                continue;
+            }
+        }
+
+        if (nChangePosInOut == -1) reservekey.ReturnKey(); // Return any reserved key if we don't have change
+
+        if (sign)
+        {
+            std::vector<CTxOut> vSpent;
+            vSpent.reserve(setCoins.size());
+            for (const auto& coin : setCoins)
+                vSpent.push_back(coin.txout);
+
+            if (!SignTransactionInputs(*this, txNew, vSpent, SIGHASH_ALL))
+            {
+                strFailReason = _("Signing transaction failed");
+                return false;
+            }
+        }
+
+        // Embed the constructed transaction data in wtxNew.
+        wtxNew.SetTx(MakeTransactionRef(std::move(txNew)));
+
+        // Limit size
+        if (GetTransactionWeight(*wtxNew.tx) >= MAX_STANDARD_TX_WEIGHT)
+        {
+            strFailReason = _("Transaction too large");
+            return false;
+        }
+    }
+
+    if (gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS)) {
+        // Lastly, ensure this tx will pass the mempool's chain limits
+        LockPoints lp;
+        CTxMemPoolEntry entry(wtxNew.tx, 0, 0, 0, false, false, 0, 0, lp);
+        CTxMemPool::setEntries setAncestors;
+        size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
+        size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
+        std::string errString;
+        if (!mempool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+            strFailReason = _("Transaction has too long of a mempool chain");
+            return false;
+        }
+    }
+
+    LogPrintf("Fee Calculation: Fee:%d Bytes:%u Needed:%d Tgt:%d (requested %d) Reason:\"%s\" Decay %.5f: Estimation: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out) Fail: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out)\n",
+              nFeeRet, nBytes, nFeeNeeded, feeCalc.returnedTarget, feeCalc.desiredTarget, StringForFeeReason(feeCalc.reason), feeCalc.est.decay,
+              feeCalc.est.pass.start, feeCalc.est.pass.end,
+              100 * feeCalc.est.pass.withinTarget / (feeCalc.est.pass.totalConfirmed + feeCalc.est.pass.inMempool + feeCalc.est.pass.leftMempool),
+              feeCalc.est.pass.withinTarget, feeCalc.est.pass.totalConfirmed, feeCalc.est.pass.inMempool, feeCalc.est.pass.leftMempool,
+              feeCalc.est.fail.start, feeCalc.est.fail.end,
+              100 * feeCalc.est.fail.withinTarget / (feeCalc.est.fail.totalConfirmed + feeCalc.est.fail.inMempool + feeCalc.est.fail.leftMempool),
+              feeCalc.est.fail.withinTarget, feeCalc.est.fail.totalConfirmed, feeCalc.est.fail.inMempool, feeCalc.est.fail.leftMempool);
+    return true;
+}
+
+bool CWallet::CreateBMMRequest(CWalletTx& wtx, std::string& strFail, const uint8_t nSidechain, const uint256& hashCritical, const CAmount& nAmount, const CAmount& nMaxAmount, int nHeight)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    if (!chainActive.Tip()) {
+        strFail = "No chain tip";
+        return false;
+    }
+
+    // The request can only be included in the block after the current tip
+    int nHeightTip = chainActive.Height();
+    if (nHeight == 0)
+        nHeight = nHeightTip;
+
+    // Critical data bytes: the BMM header, the sidechain number and the last
+    // 4 bytes of the hash of the block the request builds on
+    std::string strTip = chainActive.Tip()->GetBlockHash().ToString();
+    std::vector<unsigned char> vPrevBytes = ParseHex(strTip.substr(strTip.size() - 8));
+
+    CCriticalData criticalData;
+    criticalData.vBytes = {0x00, 0xbf, 0x00, nSidechain};
+    criticalData.vBytes.insert(criticalData.vBytes.end(), vPrevBytes.begin(), vPrevBytes.end());
+    criticalData.hashCritical = hashCritical;
+
+    std::vector<CRecipient> vecSend;
+    CRecipient recipient = {CScript() << OP_TRUE, nAmount, false};
+    vecSend.push_back(recipient);
+
+    wtx.fFromMe = true;
+    wtx.fTimeReceivedIsTxTime = true;
+    wtx.BindWallet(this);
+
+    CReserveKey reservekey(this);
+    CAmount nFeeRequired;
+    int nChangePosRet = -1;
+    CCoinControl cc;
+    cc.signalRbf = false;
+    if (!CreateTransaction(vecSend, wtx, reservekey, nFeeRequired, nChangePosRet, strFail, cc, true, 3, nHeight, criticalData)) {
+        if (nAmount + nFeeRequired > GetBalance() || nAmount < nFeeRequired)
+            strFail = strprintf("Error: This transaction requires a transaction fee of at least %s", FormatMoney(nFeeRequired));
+        return false;
+    }
+    CValidationState state;
+    if (!CommitTransaction(wtx, reservekey, g_connman.get(), state, true /* fRemoveIfFail */)) {
+        strFail = strprintf("Error: The transaction was rejected! Reason given: %s", state.GetRejectReason());
+        return false;
+    }
+
+    BMMRequest request;
+    request.nSidechain = nSidechain;
+    request.hashCritical = hashCritical;
+    request.nAmount = nAmount;
+    request.nMaxAmount = nMaxAmount;
+    request.nHeight = nHeightTip;
+    mapBMMRequest[nSidechain][wtx.GetHash()] = request;
+
+    return true;
+}
+
+std::map<uint256, BMMRequest> CWallet::GetBMMRequests() const
+{
+    LOCK(cs_wallet);
+
+    std::map<uint256, BMMRequest> mapRet;
+    for (const auto& sidechain : mapBMMRequest)
+        mapRet.insert(sidechain.second.begin(), sidechain.second.end());
+
+    return mapRet;
+}
+
+void CWallet::UpdateBMMRequests(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (mapBMMRequest.empty())
+        return;
 
-                // Include more fee and try again.
-                nFeeRet = nFeeNeeded;
+    // Requests that made it into the block are done
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->criticalData.IsNull())
+            continue;
+        for (auto& sidechain : mapBMMRequest)
+            sidechain.second.erase(tx->GetHash());
+    }
+
+    // The h* the block commits to for each sidechain. If some other request
+    // for a sidechain won there is nothing left for us to replace
+    std::vector<std::pair<uint8_t, uint256>> vCommit;
+    GetBMMCommits(block, vCommit);
+    std::set<uint8_t> setCommitted;
+    for (const auto& commit : vCommit)
+        setCommitted.insert(commit.first);
+
+    // Replacements have to build on the real tip or the mempool rejects them
+    bool fReplace = pindex == chainActive.Tip();
+
+    std::vector<BMMRequest> vReplace;
+    for (auto itSidechain = mapBMMRequest.begin(); itSidechain != mapBMMRequest.end(); ) {
+        std::map<uint256, BMMRequest>& mapRequest = itSidechain->second;
+        for (auto it = mapRequest.begin(); it != mapRequest.end(); ) {
+            const BMMRequest& request = it->second;
+
+            // Waiting for the block after the one it builds on
+            if (request.nHeight >= pindex->nHeight) {
+                it++;
                 continue;
             }
-        }
-
-        if (nChangePosInOut == -1) reservekey.ReturnKey(); // Return any reserved key if we don't have change
-
-        if (sign)
-        {
-            CTransaction txNewConst(txNew);
-            int nIn = 0;
-            for (const auto& coin : setCoins)
-            {
-                const CScript& scriptPubKey = coin.txout.scriptPubKey;
-                SignatureData sigdata;
 
-                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
+            // The request can't be mined anymore, take it out of the mempool
+            // and abandon it so that its coins can be spent again
+            auto itTx = mapWallet.find(it->first);
+            if (itTx != mapWallet.end()) {
+                mempool.removeRecursive(*itTx->second.tx, MemPoolRemovalReason::EXPIRY);
+                TransactionRemovedFromMempool(itTx->second.tx);
+
+                std::string strReason;
+                if (!AbandonTransaction(it->first, &strReason)) {
+                    LogPrintf("%s: Failed to abandon BMM request %s: %s\n", __func__, it->first.ToString(), strReason);
+                    // Let abandonbmm try again later
+                    scdb.AddRemovedBMM(it->first);
                 }
-
-                nIn++;
             }
-        }
 
-        // Embed the constructed transaction data in wtxNew.
-        wtxNew.SetTx(MakeTransactionRef(std::move(txNew)));
+            if (fReplace && request.nMaxAmount && !setCommitted.count(request.nSidechain))
+                vReplace.push_back(request);
 
-        // Limit size
-        if (GetTransactionWeight(*wtxNew.tx) >= MAX_STANDARD_TX_WEIGHT)
-        {
-            strFailReason = _("Transaction too large");
-            return false;
+            it = mapRequest.erase(it);
         }
+
+        if (mapRequest.empty())
+            itSidechain = mapBMMRequest.erase(itSidechain);
+        else
+            itSidechain++;
     }
 
-    if (gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS)) {
-        // Lastly, ensure this tx will pass the mempool's chain limits
-        LockPoints lp;
-        CTxMemPoolEntry entry(wtxNew.tx, 0, 0, 0, false, false, 0, 0, lp);
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
-        size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
-        std::string errString;
-        if (!mempool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
-            strFailReason = _("Transaction has too long of a mempool chain");
-            return false;
+    for (const BMMRequest& request : vReplace) {
+        if (!scdb.IsSidechainActive(request.nSidechain))
+            continue;
+
+        CAmount nAmount = std::min(request.nAmount + request.nAmount * nBMMBidBump / 100, request.nMaxAmount);
+
+        CWalletTx wtx;
+        std::string strFail;
+        if (!CreateBMMRequest(wtx, strFail, request.nSidechain, request.hashCritical, nAmount, request.nMaxAmount)) {
+            LogPrintf("%s: Failed to replace BMM request for sidechain %u: %s\n", __func__, request.nSidechain, strFail);
+            continue;
         }
+        LogPrintf("%s: Replaced BMM request for sidechain %u with %s bidding %s\n", __func__, request.nSidechain, wtx.GetHash().ToString(), FormatMoney(nAmount));
     }
+}
+
+bool CWallet::CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail, const CScript& sidechainScriptPubKey, const uint8_t nSidechain, const CAmount& nAmount, const CAmount& nFee, const std::string& strDest)
+{
+    std::vector<CTransactionRef> vtx;
+    if (!CreateSidechainDeposits(vtx, strFail, sidechainScriptPubKey, nSidechain, std::vector<std::pair<std::string, CAmount>>{ std::make_pair(strDest, nAmount) }, nFee))
+        return false;
+
+    tx = vtx.front();
 
-    LogPrintf("Fee Calculation: Fee:%d Bytes:%u Needed:%d Tgt:%d (requested %d) Reason:\"%s\" Decay %.5f: Estimation: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out) Fail: (%g - %g) %.2f%% %.1f/(%.1f %d mem %.1f out)\n",
-              nFeeRet, nBytes, nFeeNeeded, feeCalc.returnedTarget, feeCalc.desiredTarget, StringForFeeReason(feeCalc.reason), feeCalc.est.decay,
-              feeCalc.est.pass.start, feeCalc.est.pass.end,
-              100 * feeCalc.est.pass.withinTarget / (feeCalc.est.pass.totalConfirmed + feeCalc.est.pass.inMempool + feeCalc.est.pass.leftMempool),
-              feeCalc.est.pass.withinTarget, feeCalc.est.pass.totalConfirmed, feeCalc.est.pass.inMempool, feeCalc.est.pass.leftMempool,
-              feeCalc.est.fail.start, feeCalc.est.fail.end,
-              100 * feeCalc.est.fail.withinTarget / (feeCalc.est.fail.totalConfirmed + feeCalc.est.fail.inMempool + feeCalc.est.fail.leftMempool),
-              feeCalc.est.fail.withinTarget, feeCalc.est.fail.totalConfirmed, feeCalc.est.fail.inMempool, feeCalc.est.fail.leftMempool);
     return true;
 }
 
-bool CWallet::CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail, const CScript& sidechainScriptPubKey, const uint8_t nSidechain, const CAmount& nAmount, const CAmount& nFee, const std::string& strDest)
+bool CWallet::CreateSidechainDeposits(std::vector<CTransactionRef>& vtx, std::string& strFail, const CScript& sidechainScriptPubKey, const uint8_t nSidechain, const std::vector<std::pair<std::string, CAmount>>& vDeposit, const CAmount& nFee)
 {
     strFail = "Unknown error!";
+    vtx.clear();
 
     if (!scdb.IsSidechainActive(nSidechain)) {
         strFail = "Invalid Sidechain number!\n";
@@ -3210,11 +4178,13 @@ bool CWallet::CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail,
         return false;
     }
 
-    // User deposit data script
-    CScript dataScript = CScript() << OP_RETURN << ParseHex(HexStr(strDest));
+    if (vDeposit.empty()) {
+        strFail = "No deposits to create!\n";
+        return false;
+    }
 
-    if (dataScript.size() > MAX_DEPOSIT_DESTINATION_BYTES) {
-        strFail = "Invalid sidechain deposit script - destination too large!";
+    if (vDeposit.size() > MAX_SIDECHAIN_DEPOSIT_BATCH) {
+        strFail = "Too many deposits in one batch!\n";
         return false;
     }
 
@@ -3229,29 +4199,55 @@ bool CWallet::CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail,
         return false;
     }
 
-    // The deposit transaction
-    CMutableTransaction mtx;
+    // User deposit data scripts
+    std::vector<CScript> vDataScript;
+    vDataScript.reserve(vDeposit.size());
+    CAmount nTotal = CAmount(0);
+    for (const auto& deposit : vDeposit) {
+        CScript dataScript = CScript() << OP_RETURN << ParseHex(HexStr(deposit.first));
+
+        if (dataScript.size() > MAX_DEPOSIT_DESTINATION_BYTES) {
+            strFail = "Invalid sidechain deposit script - destination too large!";
+            return false;
+        }
+
+        if (deposit.second <= 0 || !MoneyRange(deposit.second)) {
+            strFail = "Invalid sidechain deposit amount!";
+            return false;
+        }
+
+        vDataScript.push_back(dataScript);
+        nTotal += deposit.second + nFee;
+    }
+
+    if (!MoneyRange(nTotal)) {
+        strFail = "Invalid sidechain deposit total amount!";
+        return false;
+    }
 
     BlockUntilSyncedToCurrentChain();
 
     LOCK2(cs_main, vpwallets[0]->cs_wallet);
 
-    // Select coins to cover sidechain deposit
+    // Select coins to cover all of the sidechain deposits at once
     std::vector<COutput> vCoins;
     AvailableCoins(vCoins, true /* fOnlySafe */);
     std::set<CInputCoin> setCoins;
     CAmount nAmountRet = CAmount(0);
-    if (!SelectCoins(vCoins, nAmount + nFee, setCoins, nAmountRet)) {
+    if (!SelectCoins(vCoins, nTotal, setCoins, nAmountRet)) {
         strFail = "Could not collect enough coins to cover deposit + fee!\n";
         return false;
     }
 
-    // Handle change if there is any
-    const CAmount nChange = nAmountRet - (nAmount + nFee);
+    // A deposit has a single destination, so a batch is a chain of deposits
+    // where each one spends the sidechain output (CTIP) and the change of the
+    // one before it. The change is paid to the same key along the chain.
     CReserveKey reserveKey(vpwallets[0]);
-    if (nChange > 0) {
-        CScript scriptChange;
-
+    CScript scriptChange;
+    CAmount nRemaining = nAmountRet - nTotal;
+    for (size_t i = 1; i < vDeposit.size(); i++)
+        nRemaining += vDeposit[i].second + nFee;
+    if (nRemaining > 0) {
         // Reserve a new key pair from key pool
         CPubKey vchPubKey;
         if (!reserveKey.GetReservedKey(vchPubKey))
@@ -3260,106 +4256,126 @@ bool CWallet::CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail,
             return false;
         }
         scriptChange = GetScriptForDestination(vchPubKey.GetID());
-
-        CTxOut out(nChange, scriptChange);
-        if (!IsDust(out, ::dustRelayFee))
-            mtx.vout.push_back(out);
     }
 
-    // Add deposit inputs
-    for (const auto& coin : setCoins) {
-        mtx.vin.push_back(CTxIn(coin.outpoint.hash, coin.outpoint.n, CScript()));
-    }
+    // Handle existing sidechain utxo. We will look at our local mempool, and
+    // create the deposits based on the latest CTIP for the sidechain.
+    // Note: They will be rejected if other nodes have seen a newer CTIP.
+    SidechainCTIP ctip;
+    bool fCTIP = ::mempool.GetMemPoolCTIP(nSidechain, ctip);
 
-    // Add data output
-    mtx.vout.push_back(CTxOut(CAmount(0), dataScript));
+    std::vector<CInputCoin> vCoinsIn(setCoins.begin(), setCoins.end());
+    std::vector<CMutableTransaction> vmtx;
+    vmtx.reserve(vDeposit.size());
+    for (size_t i = 0; i < vDeposit.size(); i++) {
+        const CAmount nAmount = vDeposit[i].second;
 
-    // Add deposit output
-    mtx.vout.push_back(CTxOut(nAmount, sidechainScriptPubKey));
+        // The deposit transaction
+        CMutableTransaction mtx;
 
-    // Handle existing sidechain utxo. We will look at our local mempool, and
-    // create a deposit based on the latest CTIP for the sidechain.
-    // Note: It will be rejected if other nodes have seen a newer CTIP.
-    SidechainCTIP ctip;
-    CAmount returnAmount = CAmount(0);
-    if (::mempool.GetMemPoolCTIP(nSidechain, ctip)) {
-        returnAmount = ctip.amount;
-        // Amount returning to sidechain
-        mtx.vout.back().nValue += returnAmount;
-        // Spend the existing CTIP
-        mtx.vin.push_back(CTxIn(ctip.out));
-    }
+        // What is left for the deposits after this one
+        if (i > 0)
+            nRemaining -= nAmount + nFee;
 
-    // Dummy sign the transaction to calculate fee
-    std::set<CInputCoin> setCoinsTemp = setCoins;
-    if (!DummySignTx(mtx, setCoinsTemp)) {
-        strFail = "Dummy signing transaction for required fee calculation failed!";
-        return false;
-    }
+        // Handle change if there is any
+        if (nRemaining > 0) {
+            CTxOut out(nRemaining, scriptChange);
+            if (i + 1 < vDeposit.size() || !IsDust(out, ::dustRelayFee))
+                mtx.vout.push_back(out);
+        }
 
-    // Get transaction size with dummy signatures
-    unsigned int nBytes = GetVirtualTransactionSize(mtx);
+        // Add deposit inputs
+        for (const auto& coin : vCoinsIn) {
+            mtx.vin.push_back(CTxIn(coin.outpoint.hash, coin.outpoint.n, CScript()));
+        }
 
-    // Calculate fee
-    CCoinControl coinControl;
-    FeeCalculation feeCalc;
-    CAmount nFeeNeeded = GetMinimumFee(nBytes, coinControl, ::mempool, ::feeEstimator, &feeCalc);
+        // Add data output
+        mtx.vout.push_back(CTxOut(CAmount(0), vDataScript[i]));
 
-    // Check that the fee is valid for relay
-    if (nFeeNeeded < ::minRelayTxFee.GetFee(nBytes)) {
-        strFail = "Transaction too large for fee policy";
-        return false;
-    }
+        // Add deposit output
+        mtx.vout.push_back(CTxOut(nAmount, sidechainScriptPubKey));
 
-    // Check the user set fee
-    if (nFee < nFeeNeeded) {
-        strFail = "The fee you have set is too small!";
-        return false;
-    }
+        if (fCTIP) {
+            // Amount returning to sidechain
+            mtx.vout.back().nValue += ctip.amount;
+            // Spend the existing CTIP
+            mtx.vin.push_back(CTxIn(ctip.out));
+        }
 
-    // Remove dummy signatures
-    for (auto& vin : mtx.vin) {
-        vin.scriptSig = CScript();
-        vin.scriptWitness.SetNull();
-    }
+        // Dummy sign the transaction to calculate fee
+        if (!DummySignTx(mtx, vCoinsIn)) {
+            strFail = "Dummy signing transaction for required fee calculation failed!";
+            return false;
+        }
 
-    Sidechain sidechain;
-    if (!scdb.GetSidechain(nSidechain, sidechain))
-        return false;
+        // Get transaction size with dummy signatures
+        unsigned int nBytes = GetVirtualTransactionSize(mtx);
 
-    // Sign the non sidechain inputs
-    const CTransaction txToSign = mtx;
-    int nIn = 0;
-    for (const auto& coin : setCoins) {
-        const CScript& scriptPubKey = coin.txout.scriptPubKey;
-        SignatureData sigdata;
+        // Calculate fee
+        CCoinControl coinControl;
+        FeeCalculation feeCalc;
+        CAmount nFeeNeeded = GetMinimumFee(nBytes, coinControl, ::mempool, ::feeEstimator, &feeCalc);
 
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txToSign, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
+        // Check that the fee is valid for relay
+        if (nFeeNeeded < ::minRelayTxFee.GetFee(nBytes)) {
+            strFail = "Transaction too large for fee policy";
+            return false;
+        }
+
+        // Check the user set fee
+        if (nFee < nFeeNeeded) {
+            strFail = "The fee you have set is too small!";
+            return false;
+        }
+
+        // Remove dummy signatures
+        for (auto& vin : mtx.vin) {
+            vin.scriptSig = CScript();
+            vin.scriptWitness.SetNull();
+        }
+
+        // Sign the non sidechain inputs, the sidechain input comes last and
+        // is skipped
+        std::vector<CTxOut> vSpent;
+        for (const auto& coin : vCoinsIn)
+            vSpent.push_back(coin.txout);
+        vSpent.resize(mtx.vin.size());
+
+        if (!SignTransactionInputs(*this, mtx, vSpent, SIGHASH_ALL))
         {
             strFail = "Signing non-sidechain inputs failed!\n";
             return false;
-        } else {
-            UpdateTransaction(mtx, nIn, sigdata);
         }
 
-        nIn++;
+        // The next deposit spends this one's change and sidechain output
+        const uint256 txid = mtx.GetHash();
+        vCoinsIn.clear();
+        if (i + 1 < vDeposit.size())
+            vCoinsIn.emplace_back(COutPoint(txid, 0), mtx.vout[0]);
+        fCTIP = true;
+        ctip.out = COutPoint(txid, mtx.vout.size() - 1);
+        ctip.amount = mtx.vout.back().nValue;
+
+        vmtx.push_back(std::move(mtx));
     }
 
-    // Broadcast transaction
-    CWalletTx wtxNew;
-    wtxNew.fTimeReceivedIsTxTime = true;
-    wtxNew.fFromMe = true;
-    wtxNew.nDenial = 0;
-    wtxNew.BindWallet(this);
+    // Broadcast transactions, in order
+    for (CMutableTransaction& mtx : vmtx) {
+        CWalletTx wtxNew;
+        wtxNew.fTimeReceivedIsTxTime = true;
+        wtxNew.fFromMe = true;
+        wtxNew.nDenial = 0;
+        wtxNew.BindWallet(this);
 
-    wtxNew.SetTx(MakeTransactionRef(std::move(mtx)));
+        wtxNew.SetTx(MakeTransactionRef(std::move(mtx)));
 
-    CValidationState state;
-    if (!CommitTransaction(wtxNew, reserveKey, g_connman.get(), state, true /* fRemoveIfFail */)) {
-        strFail = "Failed to commit sidechain deposit! Reject reason: " + FormatStateMessage(state) + "\n";
-        return false;
+        CValidationState state;
+        if (!CommitTransaction(wtxNew, reserveKey, g_connman.get(), state, true /* fRemoveIfFail */)) {
+            strFail = "Failed to commit sidechain deposit " + std::to_string(vtx.size()) + "! Reject reason: " + FormatStateMessage(state) + "\n";
+            return false;
+        }
+        vtx.push_back(wtxNew.tx);
     }
-    tx = wtxNew.tx;
 
     return true;
 }
@@ -3450,21 +4466,15 @@ bool CWallet::CreateOPReturnTransaction(CTransactionRef& tx, std::string& strFai
     }
 
     // Sign the inputs
-    const CTransaction txToSign = mtx;
-    int nIn = 0;
-    for (const auto& coin : setCoins) {
-        const CScript& scriptPubKey = coin.txout.scriptPubKey;
-        SignatureData sigdata;
-
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txToSign, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
-        {
-            strFail = "Signing non-sidechain inputs failed!\n";
-            return false;
-        } else {
-            UpdateTransaction(mtx, nIn, sigdata);
-        }
+    std::vector<CTxOut> vSpent;
+    vSpent.reserve(setCoins.size());
+    for (const auto& coin : setCoins)
+        vSpent.push_back(coin.txout);
 
-        nIn++;
+    if (!SignTransactionInputs(*this, mtx, vSpent, SIGHASH_ALL))
+    {
+        strFail = "Signing non-sidechain inputs failed!\n";
+        return false;
     }
 
     // Broadcast transaction
@@ -3798,8 +4808,14 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
 {
     AssertLockHeld(cs_wallet); // mapWallet
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
-    for (uint256 hash : vHashOut)
-        mapWallet.erase(hash);
+    for (uint256 hash : vHashOut) {
+        auto it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        UnindexTxBlock(hash, it->second.hashBlock);
+        mapWallet.erase(it);
+    }
+    fRebuildWalletCoins = true;
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -3908,17 +4924,23 @@ bool CWallet::NewKeyPool()
 {
     {
         LOCK(cs_wallet);
-        CWalletDB walletdb(*dbw);
+        {
+            CWalletDB walletdb(*dbw);
+            walletdb.BatchBegin();
 
-        for (int64_t nIndex : setInternalKeyPool) {
-            walletdb.ErasePool(nIndex);
-        }
-        setInternalKeyPool.clear();
+            for (int64_t nIndex : setInternalKeyPool) {
+                walletdb.ErasePool(nIndex);
+            }
+            setInternalKeyPool.clear();
+
+            for (int64_t nIndex : setExternalKeyPool) {
+                walletdb.ErasePool(nIndex);
+            }
+            setExternalKeyPool.clear();
 
-        for (int64_t nIndex : setExternalKeyPool) {
-            walletdb.ErasePool(nIndex);
+            // Committed before TopUpKeyPool writes through its own CWalletDB
+            walletdb.BatchCommit();
         }
-        setExternalKeyPool.clear();
 
         m_pool_key_to_index.clear();
 
@@ -3980,28 +5002,35 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
         CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
-
-            CPubKey pubkey(GenerateNewKey(walletdb, internal));
-            if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
-            }
+        // Everything below writes through walletdb, so the new keys can be
+        // written in a few database transactions instead of one per record
+        bool fBatch = walletdb.BatchBegin();
+        auto generate = [this, &walletdb](int64_t nMissing, bool internal) {
+            while (nMissing > 0) {
+                const size_t nBatch = std::min<int64_t>(nMissing, KEYPOOL_BATCH_KEYS);
+                for (const CPubKey& pubkey : GenerateNewKeys(walletdb, nBatch, internal)) {
+                    assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                    int64_t index = ++m_max_keypool_index;
+
+                    if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
+                        throw std::runtime_error("TopUpKeyPool: writing generated key failed");
+                    }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+                    if (internal) {
+                        setInternalKeyPool.insert(index);
+                    } else {
+                        setExternalKeyPool.insert(index);
+                    }
+                    m_pool_key_to_index[pubkey.GetID()] = index;
+                }
+                nMissing -= nBatch;
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
+        };
+        generate(missingExternal, false);
+        generate(missingInternal, true);
+        if (fBatch && !walletdb.BatchCommit()) {
+            throw std::runtime_error(std::string(__func__) + ": committing generated keys failed");
         }
         if (missingInternal + missingExternal > 0) {
             LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
@@ -4662,7 +5691,8 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
     }
 
     walletInstance->m_last_block_processed = chainActive.Tip();
-    RegisterValidationInterface(walletInstance);
+    walletInstance->InitChainView();
+    RegisterValidationInterface(walletInstance, "wallet." + walletInstance->GetName());
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
     {
@@ -4753,7 +5783,7 @@ void CWallet::postInitProcess(CScheduler& scheduler)
 
     // Run a thread to flush wallet periodically
     if (!CWallet::fFlushScheduled.exchange(true)) {
-        scheduler.scheduleEvery(MaybeCompactWalletDB, 500);
+        scheduler.scheduleEvery(MaybeCompactWalletDB, 500, SCHEDULER_LANE_BULK, "flushwallet");
     }
 }
 
@@ -4790,26 +5820,26 @@ void CMerkleTx::SetMerkleBranch(const CBlockIndex* pindex, int posInBlock)
     nIndex = posInBlock;
 }
 
-int CMerkleTx::GetDepthInMainChain(const CBlockIndex* &pindexRet) const
+int CWalletTx::GetDepthInMainChain() const
 {
     if (hashUnset())
         return 0;
 
-    AssertLockHeld(cs_main);
+    int nDepth = pwallet ? pwallet->GetChainViewDepth(hashBlock) : -1;
+    if (nDepth < 0) {
+        AssertLockHeld(cs_main);
 
-    // Find the block it claims to be in
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi == mapBlockIndex.end())
-        return 0;
-    CBlockIndex* pindex = (*mi).second;
-    if (!pindex || !chainActive.Contains(pindex))
-        return 0;
+        // Find the block it claims to be in
+        nDepth = 0;
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end() && mi->second && chainActive.Contains(mi->second))
+            nDepth = chainActive.Height() - mi->second->nHeight + 1;
+    }
 
-    pindexRet = pindex;
-    return ((nIndex == -1) ? (-1) : 1) * (chainActive.Height() - pindex->nHeight + 1);
+    return ((nIndex == -1) ? (-1) : 1) * nDepth;
 }
 
-int CMerkleTx::GetBlocksToMaturity() const
+int CWalletTx::GetBlocksToMaturity() const
 {
     if (tx->IsCoinBase())
         return std::max(0, (COINBASE_MATURITY+1) - GetDepthInMainChain());
@@ -4978,3 +6008,152 @@ void CWallet::UpdateReplayStatus(const uint256& txid, const int nReplayStatus)
 
     NotifyTransactionChanged(this, txid, CT_UPDATED);
 }
+
+void CWallet::UpdateReplayStatus(CWalletDB& walletdb, const uint256& txid, const int nReplayStatus)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::map<uint256, CWalletTx>::iterator it = mapWallet.find(txid);
+    if (it == mapWallet.end())
+        return;
+
+    it->second.UpdateReplayStatus(nReplayStatus);
+
+    if (!walletdb.WriteTx(it->second))
+        LogPrintf("%s: Updating walletdb tx %s failed", __func__, it->second.GetHash().ToString());
+
+    NotifyTransactionChanged(this, txid, CT_UPDATED);
+}
+
+//! Weight SplitCoins fills a transaction up to, what the standard weight
+//! leaves for the version, locktime and counts
+static const int64_t MAX_COIN_SPLIT_TX_WEIGHT = MAX_STANDARD_TX_WEIGHT - 4000;
+
+/** Upper bound of the weight that spending txout and paying it to scriptDest
+ * add to a transaction, -1 if the wallet can't sign for txout */
+static int64_t GetSplitCoinWeight(const CWallet& wallet, const CTxOut& txout, const CScript& scriptDest)
+{
+    SignatureData sigdata;
+    if (!ProduceSignature(DummySignatureCreator(&wallet), txout.scriptPubKey, sigdata))
+        return -1;
+
+    CTxIn txin;
+    txin.scriptSig = sigdata.scriptSig;
+    int64_t nWeight = ::GetSerializeSize(txin, SER_NETWORK, PROTOCOL_VERSION) * WITNESS_SCALE_FACTOR;
+    nWeight += ::GetSerializeSize(sigdata.scriptWitness.stack, SER_NETWORK, PROTOCOL_VERSION);
+    nWeight += ::GetSerializeSize(CTxOut(txout.nValue, scriptDest), SER_NETWORK, PROTOCOL_VERSION) * WITNESS_SCALE_FACTOR;
+    return nWeight;
+}
+
+bool CWallet::SplitCoins(const std::vector<COutPoint>& vOutPoint, CConnman* connman, std::vector<uint256>& vTxidRet, std::string& strFail, const std::function<bool(size_t)>& fnProgress)
+{
+    vTxidRet.clear();
+
+    if (vOutPoint.empty()) {
+        strFail = "No coins to split!";
+        return false;
+    }
+
+    // Create and sign the transactions first, taking the locks for one at a
+    // time so that the wallet stays usable meanwhile
+    std::vector<CWalletTx> vwtx;
+    size_t nDone = 0;
+    while (nDone < vOutPoint.size()) {
+        {
+            LOCK2(cs_main, cs_wallet);
+
+            CPubKey newKey;
+            if (!GetKeyFromPool(newKey)) {
+                strFail = "Keypool ran out, please call keypoolrefill first!";
+                return false;
+            }
+            const CScript scriptDest = GetScriptForDestination(newKey.GetID());
+
+            CCoinControl cc;
+            std::vector<CRecipient> vecSend;
+            int64_t nWeight = 0;
+            for (; nDone < vOutPoint.size(); nDone++) {
+                const COutPoint& out = vOutPoint[nDone];
+                auto it = mapWallet.find(out.hash);
+                if (it == mapWallet.end() || out.n >= it->second.tx->vout.size() || IsSpent(out.hash, out.n)) {
+                    strFail = strprintf("Coin %s:%u is not an unspent output of the wallet!", out.hash.ToString(), out.n);
+                    return false;
+                }
+                const CTxOut& txout = it->second.tx->vout[out.n];
+
+                const int64_t nCoinWeight = GetSplitCoinWeight(*this, txout, scriptDest);
+                if (nCoinWeight < 0) {
+                    strFail = strprintf("Coin %s:%u can't be signed by the wallet!", out.hash.ToString(), out.n);
+                    return false;
+                }
+                if (!vecSend.empty() && nWeight + nCoinWeight > MAX_COIN_SPLIT_TX_WEIGHT)
+                    break;
+                nWeight += nCoinWeight;
+
+                cc.Select(out);
+                vecSend.push_back({scriptDest, txout.nValue, true});
+            }
+
+            CWalletTx wtx;
+            CReserveKey reservekey(this);
+            CAmount nFeeRequired;
+            int nChangePosRet = -1;
+            std::string strError;
+            if (!CreateTransaction(vecSend, wtx, reservekey, nFeeRequired, nChangePosRet, strError, cc, true, TX_REPLAY_VERSION)) {
+                strFail = "Failed to create coin split transaction: " + strError;
+                return false;
+            }
+            // Subtracting the fee leaves no change, keep the key if it did
+            if (nChangePosRet >= 0)
+                reservekey.KeepKey();
+            vwtx.push_back(std::move(wtx));
+        }
+
+        if (fnProgress && !fnProgress(nDone)) {
+            strFail = "Coin split aborted!";
+            return false;
+        }
+    }
+
+    LOCK2(cs_main, cs_wallet);
+
+    // The coins may have been spent while the wallet wasn't locked
+    for (const CWalletTx& wtx : vwtx) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            if (IsSpent(txin.prevout.hash, txin.prevout.n)) {
+                strFail = strprintf("Coin %s:%u was spent during the split!", txin.prevout.hash.ToString(), txin.prevout.n);
+                return false;
+            }
+        }
+    }
+
+    CWalletDB walletdb(*dbw, "r+");
+    bool fBatch = walletdb.TxnBegin();
+
+    std::set<uint256> setSplit;
+    for (const CWalletTx& wtx : vwtx) {
+        AddToWallet(walletdb, wtx);
+        for (const CTxIn& txin : wtx.tx->vin)
+            setSplit.insert(txin.prevout.hash);
+    }
+    for (const uint256& txid : setSplit)
+        UpdateReplayStatus(walletdb, txid, REPLAY_SPLIT);
+
+    if (fBatch && !walletdb.TxnCommit())
+        LogPrintf("%s: Failed to write coin split transactions\n", __func__);
+
+    for (const CWalletTx& wtxNew : vwtx) {
+        CWalletTx& wtx = mapWallet[wtxNew.GetHash()];
+        vTxidRet.push_back(wtx.GetHash());
+
+        if (fBroadcastTransactions) {
+            CValidationState state;
+            if (!wtx.AcceptToMemoryPool(maxTxFee, state))
+                LogPrintf("%s: Transaction cannot be broadcast immediately, %s\n", __func__, state.GetRejectReason());
+            else
+                wtx.RelayWalletTransaction(connman);
+        }
+    }
+
+    return true;
+}
@@ -21,7 +21,9 @@
 
 #include <algorithm>
 #include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
@@ -39,6 +41,8 @@ extern CFeeRate payTxFee;
 extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fWalletRbf;
+extern unsigned int nBMMBidBump;
+extern int64_t nWalletUnlockCache;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
 //! -paytxfee default
@@ -63,8 +67,23 @@ static const bool DEFAULT_WALLET_REJECT_LONG_CHAINS = false;
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 //! -walletrbf default
 static const bool DEFAULT_WALLET_RBF = false;
+//! -walletunlockcache default
+static const int64_t DEFAULT_WALLET_UNLOCK_CACHE = 0;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! Maximum number of threads reading blocks for a rescan
+static const int MAX_RESCAN_THREADS = 4;
+//! Number of blocks a rescan reads ahead of the block it is at
+static const size_t RESCAN_BATCH_BLOCKS = 32;
+//! Maximum number of threads deriving new HD keys
+static const int MAX_KEY_DERIVATION_THREADS = 8;
+//! Number of keys the keypool derives and writes at once
+static const size_t KEYPOOL_BATCH_KEYS = 1000;
+//! Largest number of deposits created in one batch, a chain of that many
+//! deposits stays within the default mempool ancestor limit
+static const size_t MAX_SIDECHAIN_DEPOSIT_BATCH = 24;
+//! -bmmbidbump default, percent added to the bid of a replaced BMM request
+static const unsigned int DEFAULT_BMM_BID_BUMP = 10;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -78,6 +97,7 @@ class CScript;
 class CScheduler;
 class CTxMemPool;
 class CBlockPolicyEstimator;
+class CWalletScriptFilter;
 class CWalletTx;
 class CriticalData;
 struct FeeCalculation;
@@ -208,11 +228,10 @@ struct COutputEntry
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx
 {
-private:
-  /** Constant used in hashBlock to indicate tx has been abandoned */
+public:
+    /** Constant used in hashBlock to indicate tx has been abandoned */
     static const uint256 ABANDON_HASH;
 
-public:
     CTransactionRef tx;
     uint256 hashBlock;
 
@@ -259,16 +278,6 @@ public:
 
     void SetMerkleBranch(const CBlockIndex* pIndex, int posInBlock);
 
-    /**
-     * Return depth of transaction in blockchain:
-     * <0  : conflicts with a transaction this deep in the blockchain
-     *  0  : in memory pool, waiting to be included in a block
-     * >=1 : this many blocks deep in the main chain
-     */
-    int GetDepthInMainChain(const CBlockIndex* &pindexRet) const;
-    int GetDepthInMainChain() const { const CBlockIndex *pindexRet; return GetDepthInMainChain(pindexRet); }
-    bool IsInMainChain() const { const CBlockIndex *pindexRet; return GetDepthInMainChain(pindexRet) > 0; }
-    int GetBlocksToMaturity() const;
     bool hashUnset() const { return (hashBlock.IsNull() || hashBlock == ABANDON_HASH); }
     bool isAbandoned() const { return (hashBlock == ABANDON_HASH); }
     void setAbandoned() { hashBlock = ABANDON_HASH; }
@@ -452,18 +461,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -494,6 +492,19 @@ public:
     bool InMempool() const;
     bool IsTrusted() const;
 
+    /**
+     * Return depth of transaction in blockchain:
+     * <0  : conflicts with a transaction this deep in the blockchain
+     *  0  : in memory pool, waiting to be included in a block
+     * >=1 : this many blocks deep in the main chain
+     *
+     * Answered from the chain view of the wallet, which doesn't need
+     * cs_main, or from the block index before the wallet has one.
+     */
+    int GetDepthInMainChain() const;
+    bool IsInMainChain() const { return GetDepthInMainChain() > 0; }
+    int GetBlocksToMaturity() const;
+
     int64_t GetTxTime() const;
 
     // RelayWalletTransaction may only be called if fBroadcastTransactions!
@@ -579,6 +590,30 @@ public:
     std::string ToString() const;
 };
 
+/** Balances of a wallet, computed together in one pass */
+struct CWalletBalance
+{
+    CAmount nTrusted = 0;
+    CAmount nUntrustedPending = 0;
+    CAmount nImmature = 0;
+    CAmount nWatchOnlyTrusted = 0;
+    CAmount nWatchOnlyUntrustedPending = 0;
+    CAmount nWatchOnlyImmature = 0;
+};
+
+/** Parameters for selecting coins by their effective value, the value of a
+ * coin minus the fee to spend it */
+struct CoinSelectionParams
+{
+    //! Fee rate of the transaction being funded
+    CFeeRate effective_fee;
+    //! Fee for the parts of the transaction other than the inputs
+    CAmount not_input_fees = 0;
+    //! Fee to create a change output and to spend it later. A selection
+    //! that exceeds the target by less than this is used without change.
+    CAmount cost_of_change = 0;
+};
+
 
 
 
@@ -711,6 +746,22 @@ struct ScheduledTransaction
     }
 };
 
+/** A BMM request created by this wallet that hasn't been decided by a block
+ * yet */
+struct BMMRequest
+{
+    uint8_t nSidechain;
+    // The h* being requested
+    uint256 hashCritical;
+    // The bid paid by the request
+    CAmount nAmount;
+    // Highest bid a replacement may pay, 0 if it should not be replaced
+    CAmount nMaxAmount;
+    // Height of the block the request commits to, it can only be included
+    // in the block after it
+    int nHeight;
+};
+
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
@@ -731,7 +782,7 @@ private:
      * all coins from coinControl are selected; Never select unconfirmed coins
      * if they are not ours
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr, const CoinSelectionParams* params = nullptr, bool* pfBnBUsed = nullptr) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -755,6 +806,40 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Outputs that may be available to spend: they were ours when their
+     * transaction was added and weren't spent when AvailableCoins last looked
+     * at them. Spent outputs are dropped by AvailableCoins, and added back
+     * when the transaction spending them is conflicted or abandoned, so that
+     * it doesn't have to look at every output the wallet ever received.
+     */
+    mutable std::set<COutPoint> setWalletCoins;
+    //! Whether setWalletCoins has to be built from mapWallet again, after
+    //! the wallet was loaded or the keys changed
+    mutable bool fRebuildWalletCoins = true;
+    /**
+     * Filter for the scriptPubKeys the wallet may consider its own, used by
+     * ScanForWalletTransactions to skip transactions on its reader threads.
+     * nKeyStoreSize is set to KeyStoreSize() at the time it was made.
+     */
+    std::shared_ptr<const CWalletScriptFilter> MakeScriptFilter(size_t& nKeyStoreSize) const;
+    //! Number of keys, scripts and watch-only scripts in the wallet
+    size_t KeyStoreSize() const;
+
+    void AddWalletCoins(const CWalletTx& wtx) const;
+    void AddWalletCoin(const COutPoint& outpoint) const;
+    void RebuildWalletCoinsIfNeeded() const;
+
+    /**
+     * Balances of the wallet, valid until a transaction's credit or debit
+     * cache is marked dirty, its mempool state changes or the tip moves.
+     * Only the transactions in setWalletCoins have to be looked at to
+     * compute them.
+     */
+    mutable CWalletBalance cachedBalance;
+    mutable std::atomic<bool> fBalanceCached{false};
+    const CWalletBalance& GetCachedBalance() const;
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
 
@@ -767,8 +852,33 @@ private:
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
-    /* HD derive new child key (on internal or external chain) */
-    void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal = false);
+    /* The extended keys of the external and internal HD chains, m/0'/0' and
+     * m/0'/1', derived from the master key once rather than for every new
+     * key. Only valid for hdChainKeyCacheID and cleared by Lock(). */
+    CExtKey hdChainKeyCache[2];
+    CKeyID hdChainKeyCacheID;
+
+    /* With -walletunlockcache, the master key of the last passphrase unlock
+     * is kept in locked memory until nUnlockCacheExpiry, next to a salted
+     * hash of the passphrase, so that unlocking again with the same
+     * passphrase skips the key derivation. Lock() leaves it alone, it is
+     * dropped when it expires or the passphrase changes. */
+    CKeyingMaterial vUnlockCacheKey;
+    CKeyingMaterial vUnlockCacheHash;
+    std::vector<unsigned char> vchUnlockCacheSalt;
+    int64_t nUnlockCacheExpiry;
+
+    /* Unlock with the cached master key if strWalletPassphrase matches */
+    bool UnlockFromCache(const SecureString& strWalletPassphrase);
+    void CacheUnlockKey(const SecureString& strWalletPassphrase, const CKeyingMaterial& vMasterKeyIn);
+    void ClearUnlockCache();
+
+    /* Return the extended key of the internal or external HD chain */
+    const CExtKey& GetHDChainKey(bool internal);
+
+    /* HD derive nKeys new child keys (on internal or external chain), in
+     * parallel, appending them with their public key and key path */
+    void DeriveNewChildKeys(CWalletDB &walletdb, size_t nKeys, bool internal, std::vector<CKey>& vSecret, std::vector<CPubKey>& vPubKey, std::vector<std::string>& vKeypath);
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -810,6 +920,52 @@ private:
 
     std::vector<ScheduledTransaction> vScheduled;
 
+    /** Outstanding BMM requests created by this wallet by sidechain number
+     * and txid. Not written to disk */
+    std::map<uint8_t, std::map<uint256, BMMRequest>> mapBMMRequest;
+
+    /** Drop the BMM requests that were decided by a new tip, abandon the
+     * ones that didn't make it and replace them with a higher bid if they
+     * allow it */
+    void UpdateBMMRequests(const CBlock& block, const CBlockIndex* pindex);
+
+    /** Sidechain deposits and critical data transactions that aren't known
+     * to be in a block, so that abandondeposits and abandonbmm don't have
+     * to look through mapWallet. Confirmed ones are dropped lazily */
+    std::set<uint256> setDepositTx;
+    std::set<uint256> setCriticalDataTx;
+
+    /** Add a sidechain deposit or critical data transaction to the set of
+     * its kind, or take it out if it is in a block */
+    void TagSidechainTx(const CWalletTx& wtx, bool fInBlock);
+
+    bool AbandonTransaction(CWalletDB& walletdb, const uint256& hashTx, std::string* pstrReason);
+    bool AddToWallet(CWalletDB& walletdb, const CWalletTx& wtxIn);
+    void UpdateReplayStatus(CWalletDB& walletdb, const uint256& txid, const int nReplayStatus);
+
+    /**
+     * The wallet's view of the active chain: the height of the last block
+     * connected as seen by the validation callbacks, and the height of every
+     * block wallet transactions are in or conflict with, -1 for the ones
+     * that aren't in the active chain. It lets depth and finality checks run
+     * under cs_wallet alone, so that wallets don't wait on each other for
+     * cs_main. Only consulted once InitChainView has run.
+     */
+    mutable CCriticalSection cs_chainview;
+    std::atomic<bool> fChainView;
+    int nChainViewHeight;
+    std::map<uint256, int> mapChainViewBlock;
+
+    /** Wallet transactions by the hashBlock they were added with. Null holds
+     * the ones never seen in a block and the ones whose block was
+     * disconnected, ABANDON_HASH the abandoned ones */
+    std::map<uint256, std::set<uint256>> mapTxByBlock;
+
+    /** Move a transaction from the hashOld (or null) bucket of mapTxByBlock
+     * to the hashNew one, or just take it out */
+    void IndexTxBlock(const uint256& hashTx, const uint256& hashOld, const uint256& hashNew);
+    void UnindexTxBlock(const uint256& hashTx, const uint256& hashBlock);
+
 public:
     /*
      * Main wallet lock.
@@ -880,8 +1036,11 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nRelockTime = 0;
+        nUnlockCacheExpiry = 0;
         fAbortRescan = false;
         fScanningWallet = false;
+        fChainView = false;
+        nChainViewHeight = -1;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -891,6 +1050,30 @@ public:
     typedef std::multimap<int64_t, TxPair > TxItems;
     TxItems wtxOrdered;
 
+    /** Set up the chain view from the active chain, once the wallet is
+     * loaded and before it gets validation callbacks */
+    void InitChainView();
+
+    /** Record in the chain view whether a block is in the active chain and
+     * at which height. Needs cs_main */
+    void UpdateChainViewBlock(const uint256& hashBlock);
+
+    /** Depth of a block in the chain view, 0 if it isn't in the active
+     * chain. Returns -1 if there is no chain view yet */
+    int GetChainViewDepth(const uint256& hashBlock) const;
+
+    /** Whether a transaction could be in the next block, like CheckFinalTx
+     * but against the chain view */
+    bool IsTxFinal(const CTransaction& tx) const;
+
+    /** Take cs_main if the wallet has no chain view yet, for callers that
+     * otherwise only need cs_wallet. Lock it before cs_wallet */
+    std::unique_ptr<CCriticalBlock> LockChainIfNoView() const;
+
+    /** Get the transactions in blocks of the active chain from nHeight up,
+     * the unconfirmed and the abandoned ones, newest first by nOrderPos */
+    std::vector<const CWalletTx*> GetTransactionsSince(int nHeight) const;
+
     int64_t nOrderPosNext;
     uint64_t nAccountingEntryNumber;
 
@@ -922,9 +1105,11 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. With params, a set of coins whose effective values match
+     * the target without needing change is searched for first, pfBnBUsed
+     * tells whether one was found.
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vAvailableCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams* params = nullptr, bool* pfBnBUsed = nullptr) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -946,6 +1131,8 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(CWalletDB& walletdb, bool internal = false);
+    //! Generate nKeys new keys, writing them through walletdb
+    std::vector<CPubKey> GenerateNewKeys(CWalletDB& walletdb, size_t nKeys, bool internal = false);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb,const CKey& key, const CPubKey &pubkey);
@@ -979,6 +1166,7 @@ public:
     //! Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript& dest, int64_t nCreateTime);
     bool RemoveWatchOnly(const CScript &dest) override;
+    bool RemoveWatchOnlyWithDB(CWalletDB &walletdb, const CScript &dest);
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
@@ -986,6 +1174,9 @@ public:
     int64_t nRelockTime;
 
     bool Unlock(const SecureString& strWalletPassphrase);
+    //! Lock the wallet, forgetting the cached HD chain keys but not an
+    //! unexpired -walletunlockcache master key
+    bool Lock() override;
     bool ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase);
     bool EncryptWallet(const SecureString& strWalletPassphrase);
 
@@ -1015,6 +1206,8 @@ public:
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    //! Forget the cached balances, they are computed again on next use
+    void MarkBalanceDirty() const { fBalanceCached = false; }
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -1041,6 +1234,17 @@ public:
     bool CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, bool sign = true, uint32_t nVersionOverride = CTransaction::CURRENT_VERSION, uint32_t nLockTimeOverride = 0, CCriticalData criticalData = {});
     /** Create a transaction with special format for sidechains */
     bool CreateSidechainDeposit(CTransactionRef& tx, std::string& strFail, const CScript& sidechainScriptPubKey, const uint8_t nSidechain, const CAmount& nAmount, const CAmount& nFee, const std::string& strDest);
+    /** Create a chain of sidechain deposits from one coin selection, each
+     * paying nFee and spending the sidechain output of the one before */
+    bool CreateSidechainDeposits(std::vector<CTransactionRef>& vtx, std::string& strFail, const CScript& sidechainScriptPubKey, const uint8_t nSidechain, const std::vector<std::pair<std::string, CAmount>>& vDeposit, const CAmount& nFee);
+
+    /** Create and broadcast a BMM request for h* on top of the current tip
+     * paying nAmount. If nMaxAmount isn't 0 the request is replaced at each
+     * new tip that doesn't include it with a bid -bmmbidbump percent higher,
+     * as long as that doesn't go over nMaxAmount */
+    bool CreateBMMRequest(CWalletTx& wtx, std::string& strFail, const uint8_t nSidechain, const uint256& hashCritical, const CAmount& nAmount, const CAmount& nMaxAmount = 0, int nHeight = 0);
+    /** Get the outstanding BMM requests of this wallet by txid */
+    std::map<uint256, BMMRequest> GetBMMRequests() const;
 
     bool CreateOPReturnTransaction(CTransactionRef& tx, std::string& strFail, const CAmount& nFee, const CScript& script);
 
@@ -1166,6 +1370,12 @@ public:
     /* Mark a transaction (and it in-wallet descendants) as abandoned so its inputs may be respent. */
     bool AbandonTransaction(const uint256& hashTx, std::string* pstrReason = nullptr);
 
+    /** Abandon the sidechain deposits, or the critical data transactions,
+     * this wallet created that are neither in the mempool nor in a block,
+     * with one database write. vResult gets each txid tried and the reason
+     * it couldn't be abandoned, empty if it was */
+    void AbandonSidechainTransactions(bool fCriticalData, std::vector<std::pair<uint256, std::string>>& vResult);
+
     /** Mark a transaction as replaced by another transaction (e.g., BIP 125). */
     bool MarkReplaced(const uint256& originalHash, const uint256& newHash);
 
@@ -1230,6 +1440,19 @@ public:
     /** Update the replay status of a wallet transaction */
     void UpdateReplayStatus(const uint256& txid, const int nReplayStatus);
 
+    /**
+     * Split coins for replay protection: move each of vOutPoint to a new
+     * output of its own in a TX_REPLAY_VERSION transaction, the fee taken
+     * from the outputs. A transaction spends as many of the coins as fit in
+     * a standard transaction and pays them to one new key. The wallet is
+     * only locked while a transaction is created and signed, fnProgress is
+     * called with the number of coins done after each one and returns false
+     * to give up. The transactions are written to the wallet together with
+     * the REPLAY_SPLIT status of the transactions the coins came from, in
+     * one database transaction, and are then broadcast.
+     */
+    bool SplitCoins(const std::vector<COutPoint>& vOutPoint, CConnman* connman, std::vector<uint256>& vTxidRet, std::string& strFail, const std::function<bool(size_t)>& fnProgress = nullptr);
+
     /** Add to scheduled transaction cache */
     bool ScheduleTransaction(const uint256& wtxid, const std::string& strTime);
 
@@ -18,6 +18,9 @@
 #include <wallet/wallet.h>
 
 #include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
 
 #include <boost/thread.hpp>
 
@@ -241,6 +244,75 @@ public:
     }
 };
 
+/**
+ * Decode a wallet transaction record, the type has already been read from
+ * ssKey. fUpgrade is set if the record was written by 0.3.16 or 0.3.17 and
+ * has to be written again.
+ */
+static bool DecodeWalletTx(CDataStream& ssKey, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgrade, std::string& strErr)
+{
+    uint256 hash;
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgrade = true;
+    }
+
+    return true;
+}
+
+/** Transaction records read by LoadWallet and decoded on another thread */
+struct WalletTxRecords
+{
+    enum Result : char {
+        FAILED,
+        OK,
+        UPGRADE,
+    };
+
+    std::vector<std::pair<CDataStream, CDataStream>> vRecord;
+    std::vector<CWalletTx> vWtx;
+    std::vector<std::string> vErr;
+    std::vector<Result> vResult;
+};
+
+static void DecodeWalletTxs(WalletTxRecords& records)
+{
+    size_t nRecords = records.vRecord.size();
+    records.vWtx.resize(nRecords);
+    records.vErr.resize(nRecords);
+    records.vResult.assign(nRecords, WalletTxRecords::FAILED);
+    for (size_t i = 0; i < nRecords; i++) {
+        bool fUpgrade = false;
+        try {
+            if (DecodeWalletTx(records.vRecord[i].first, records.vRecord[i].second, records.vWtx[i], fUpgrade, records.vErr[i]))
+                records.vResult[i] = fUpgrade ? WalletTxRecords::UPGRADE : WalletTxRecords::OK;
+        } catch (...) {
+        }
+    }
+    records.vRecord.clear();
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr)
@@ -264,33 +336,13 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgrade = false;
+            if (!DecodeWalletTx(ssKey, ssValue, wtx, fUpgrade, strErr))
                 return false;
 
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
+            if (fUpgrade)
+                wss.vWalletUpgrade.push_back(wtx.GetHash());
 
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
@@ -543,6 +595,55 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        // Transaction records are deserialized and checked by up to nThreads
+        // decoders while the cursor moves on, then loaded in the order read
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_WALLETDB_LOAD_THREADS));
+        std::deque<std::pair<std::unique_ptr<WalletTxRecords>, std::future<void>>> dequeDecoding;
+        std::unique_ptr<WalletTxRecords> records(new WalletTxRecords());
+
+        auto load = [&](WalletTxRecords& decoded) {
+            for (size_t i = 0; i < decoded.vResult.size(); i++) {
+                if (decoded.vResult[i] == WalletTxRecords::FAILED) {
+                    // Rescan if there is a bad transaction record
+                    fNoncriticalErrors = true;
+                    gArgs.SoftSetBoolArg("-rescan", true);
+                } else {
+                    const CWalletTx& wtx = decoded.vWtx[i];
+                    if (decoded.vResult[i] == WalletTxRecords::UPGRADE)
+                        wss.vWalletUpgrade.push_back(wtx.GetHash());
+                    if (wtx.nOrderPos == -1)
+                        wss.fAnyUnordered = true;
+                    pwallet->LoadToWallet(wtx);
+                }
+                if (!decoded.vErr[i].empty())
+                    LogPrintf("%s\n", decoded.vErr[i]);
+            }
+        };
+        auto dispatch = [&]() {
+            WalletTxRecords* pending = records.get();
+            std::future<void> decoding;
+            try {
+                decoding = std::async(std::launch::async, [pending] { DecodeWalletTxs(*pending); });
+            } catch (const std::system_error&) {
+                for (auto& decoded : dequeDecoding) {
+                    decoded.second.get();
+                    load(*decoded.first);
+                }
+                dequeDecoding.clear();
+                DecodeWalletTxs(*pending);
+                load(*pending);
+                records.reset(new WalletTxRecords());
+                return;
+            }
+            dequeDecoding.emplace_back(std::move(records), std::move(decoding));
+            records.reset(new WalletTxRecords());
+            if (dequeDecoding.size() > (size_t)nThreads) {
+                dequeDecoding.front().second.get();
+                load(*dequeDecoding.front().first);
+                dequeDecoding.pop_front();
+            }
+        };
+
         while (true)
         {
             // Read next record
@@ -557,8 +658,22 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            // Hand transactions to the decoders
+            std::string strType;
+            try {
+                CDataStream(ssKey) >> strType;
+            } catch (...) {
+            }
+            if (strType == "tx") {
+                ssKey >> strType;
+                records->vRecord.emplace_back(std::move(ssKey), std::move(ssValue));
+                if (records->vRecord.size() >= WALLETDB_LOAD_BATCH_TXS)
+                    dispatch();
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
-            std::string strType, strErr;
+            std::string strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
             {
                 // losing keys is considered a catastrophic error, anything else
@@ -578,6 +693,14 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        // Decode what is left and load everything still in flight
+        DecodeWalletTxs(*records);
+        for (auto& decoding : dequeDecoding) {
+            decoding.second.get();
+            load(*decoding.first);
+        }
+        load(*records);
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -833,6 +956,45 @@ bool CWalletDB::WriteHDChain(const CHDChain& chain)
     return WriteIC(std::string("hdchain"), chain);
 }
 
+CWalletDB::~CWalletDB()
+{
+    // Records written so far are kept, as they would be without a batch
+    if (fBatch)
+        BatchCommit();
+}
+
+bool CWalletDB::BatchBegin()
+{
+    if (fBatch || !batch.TxnBegin())
+        return false;
+    fBatch = true;
+    nBatchWrites = 0;
+    return true;
+}
+
+bool CWalletDB::BatchCommit()
+{
+    if (!fBatch)
+        return false;
+    fBatch = false;
+    return batch.TxnCommit();
+}
+
+bool CWalletDB::BatchWritten()
+{
+    if (++nBatchWrites < WALLETDB_BATCH_SIZE)
+        return true;
+
+    // Keep the database transaction within the environment's lock limits
+    nBatchWrites = 0;
+    if (!batch.TxnCommit()) {
+        fBatch = false;
+        return false;
+    }
+    fBatch = batch.TxnBegin();
+    return true;
+}
+
 bool CWalletDB::TxnBegin()
 {
     return batch.TxnBegin();
@@ -34,6 +34,12 @@
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Maximum number of records written in one database transaction by a batch
+static const unsigned int WALLETDB_BATCH_SIZE = 1000;
+//! Number of transaction records LoadWallet hands to a decoding thread at once
+static const size_t WALLETDB_LOAD_BATCH_TXS = 512;
+//! Maximum number of threads decoding transaction records in LoadWallet
+static const int MAX_WALLETDB_LOAD_THREADS = 4;
 
 class CAccount;
 class CAccountingEntry;
@@ -149,6 +155,9 @@ private:
             return false;
         }
         m_dbw.IncrementUpdateCounter();
+        if (fBatch && !BatchWritten()) {
+            return false;
+        }
         return true;
     }
 
@@ -159,15 +168,22 @@ private:
             return false;
         }
         m_dbw.IncrementUpdateCounter();
+        if (fBatch && !BatchWritten()) {
+            return false;
+        }
         return true;
     }
 
+    //! Commit the batch's database transaction once it is full
+    bool BatchWritten();
+
 public:
     explicit CWalletDB(CWalletDBWrapper& dbw, const char* pszMode = "r+", bool _fFlushOnClose = true) :
         batch(dbw, pszMode, _fFlushOnClose),
         m_dbw(dbw)
     {
     }
+    ~CWalletDB();
     CWalletDB(const CWalletDB&) = delete;
     CWalletDB& operator=(const CWalletDB&) = delete;
 
@@ -240,6 +256,16 @@ public:
     bool TxnCommit();
     //! Abort current transaction
     bool TxnAbort();
+    /**
+     * Group the records written through this object into database
+     * transactions of up to WALLETDB_BATCH_SIZE records, instead of
+     * committing each record on its own. What is left is committed by
+     * BatchCommit or when the object goes out of scope. Other CWalletDB
+     * objects for the same wallet must not write while a batch is open.
+     */
+    bool BatchBegin();
+    //! Commit the records written since BatchBegin
+    bool BatchCommit();
     //! Read wallet version
     bool ReadVersion(int& nVersion);
     //! Write wallet version
@@ -247,6 +273,10 @@ public:
 private:
     CDB batch;
     CWalletDBWrapper& m_dbw;
+    //! Whether writes are grouped, see BatchBegin
+    bool fBatch = false;
+    //! Records written in the batch's current database transaction
+    unsigned int nBatchWrites = 0;
 };
 
 //! Compacts BDB state so that wallet.dat is self-contained (if there are changes)
@@ -4,7 +4,10 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <sidechain.h>
+#include <sidechaindb.h>
 #include <streams.h>
+#include <txdb.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util.h>
@@ -13,9 +16,13 @@
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
+static const char *MSG_HASHFORKTIP = "hashforktip";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_BMM       = "bmm";
+static const char *MSG_DEPOSIT   = "deposit";
+static const char *MSG_WITHDRAWALSTATE = "withdrawalstate";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -130,18 +137,38 @@ void CZMQAbstractPublishNotifier::Shutdown()
 }
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    if (!SendMultipart(command, data, size, nSequence))
+        return false;
+
+    /* increment memory only sequence number after sending */
+    nSequence++;
+
+    return true;
+}
+
+bool CZMQAbstractPublishNotifier::SendMultipart(const char *command, const void* data, size_t size, uint32_t nSequenceMsg)
 {
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
+    WriteLE32(&msgseq[0], nSequenceMsg);
     int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), nullptr);
     if (rc == -1)
         return false;
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    return true;
+}
+
+bool CZMQAbstractSidechainNotifier::SendSidechainMessage(const char *command, uint8_t nSidechain, const void* data, size_t size)
+{
+    uint32_t& nSequenceSidechain = mapSequence[nSidechain];
+    if (!SendMultipart(command, data, size, nSequenceSidechain))
+        return false;
+
+    /* increment memory only sequence number of the sidechain after sending */
+    nSequenceSidechain++;
 
     return true;
 }
@@ -156,6 +183,16 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
+bool CZMQPublishHashForkTipNotifier::NotifyForkTip(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish hashforktip %s\n", hash.GetHex());
+    char data[32];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return SendMessage(MSG_HASHFORKTIP, data, 32);
+}
+
 bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
@@ -195,3 +232,106 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishBMMNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    std::vector<std::pair<uint8_t, uint256>> vCommit;
+    GetBMMCommits(block, vCommit);
+
+    for (const std::pair<uint8_t, uint256>& commit : vCommit) {
+        LogPrint(BCLog::ZMQ, "zmq: Publish bmm %u %s\n", commit.first, commit.second.GetHex());
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << commit.first << pindex->GetBlockHash() << commit.second;
+        if (!SendSidechainMessage(MSG_BMM, commit.first, &(*ss.begin()), ss.size()))
+            return false;
+    }
+    return true;
+}
+
+bool CZMQPublishDepositNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+
+        bool fDeposit = false;
+        for (const CTxOut& out : tx.vout) {
+            uint8_t nSidechain;
+            if (out.scriptPubKey.IsDrivechain(nSidechain)) {
+                fDeposit = true;
+                break;
+            }
+        }
+        if (!fDeposit)
+            continue;
+
+        // Only publish deposits that SCDB accepted, the block may have been
+        // disconnected again by now
+        SidechainDeposit deposit;
+        CAmount amount;
+        {
+            LOCK(cs_main);
+            if (!scdb.GetDeposit(tx.GetHash(), deposit, amount))
+                continue;
+        }
+        if (deposit.hashBlock != pindex->GetBlockHash())
+            continue;
+        if (deposit.strDest == SIDECHAIN_WITHDRAWAL_RETURN_DEST)
+            continue;
+
+        LogPrint(BCLog::ZMQ, "zmq: Publish deposit %u %s\n", deposit.nSidechain, tx.GetHash().GetHex());
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << deposit.nSidechain << tx.GetHash() << amount << deposit.strDest << pindex->GetBlockHash();
+        if (!SendSidechainMessage(MSG_DEPOSIT, deposit.nSidechain, &(*ss.begin()), ss.size()))
+            return false;
+    }
+    return true;
+}
+
+/** Check if withdrawals were added or removed or their work scores changed.
+ * Blocks remaining count down every block and are ignored. */
+static bool WorkScoresChanged(const std::vector<SidechainWithdrawalState>& vOld, const std::vector<SidechainWithdrawalState>& vNew)
+{
+    if (vOld.size() != vNew.size())
+        return true;
+
+    for (size_t i = 0; i < vNew.size(); i++) {
+        if (vOld[i].hash != vNew[i].hash || vOld[i].nWorkScore != vNew[i].nWorkScore)
+            return true;
+    }
+    return false;
+}
+
+bool CZMQPublishWithdrawalStateNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    if (!pindex->pprev)
+        return true;
+
+    // Compare the withdrawal state SCDB stored for this block with the state
+    // of the previous block
+    std::vector<uint256> vHash = {pindex->GetBlockHash(), pindex->pprev->GetBlockHash()};
+    std::vector<SidechainBlockData> vData;
+    std::vector<bool> vFound;
+    psidechaintree->GetBlockData(vHash, vData, vFound);
+    if (!vFound[0])
+        return true;
+
+    const std::vector<std::vector<SidechainWithdrawalState>>& vState = vData[0].vWithdrawalStatus;
+    for (size_t x = 0; x < vState.size(); x++) {
+        const std::vector<SidechainWithdrawalState>* pvPrev = nullptr;
+        if (vFound[1] && x < vData[1].vWithdrawalStatus.size())
+            pvPrev = &vData[1].vWithdrawalStatus[x];
+
+        if (vState[x].empty() && (!pvPrev || pvPrev->empty()))
+            continue;
+        if (pvPrev && !WorkScoresChanged(*pvPrev, vState[x]))
+            continue;
+
+        const uint8_t nSidechain = x;
+        LogPrint(BCLog::ZMQ, "zmq: Publish withdrawalstate %u\n", nSidechain);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << nSidechain << pindex->GetBlockHash() << vState[x];
+        if (!SendSidechainMessage(MSG_WITHDRAWALSTATE, nSidechain, &(*ss.begin()), ss.size()))
+            return false;
+    }
+    return true;
+}
@@ -7,6 +7,8 @@
 
 #include <zmq/zmqabstractnotifier.h>
 
+#include <map>
+
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
@@ -26,6 +28,25 @@ public:
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
+
+protected:
+    /* send zmq multipart message with the given sequence number */
+    bool SendMultipart(const char *command, const void* data, size_t size, uint32_t nSequenceMsg);
+};
+
+class CZMQAbstractSidechainNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    std::map<uint8_t, uint32_t> mapSequence; //!< upcounting per sidechain message sequence numbers
+
+public:
+    /* send zmq multipart message
+       parts:
+          * command
+          * data, starting with the sidechain number
+          * sidechain's message sequence number
+    */
+    bool SendSidechainMessage(const char *command, uint8_t nSidechain, const void* data, size_t size);
 };
 
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
@@ -34,6 +55,12 @@ public:
     bool NotifyBlock(const CBlockIndex *pindex) override;
 };
 
+class CZMQPublishHashForkTipNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyForkTip(const CBlockIndex *pindex) override;
+};
+
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
@@ -52,4 +79,22 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+class CZMQPublishBMMNotifier : public CZMQAbstractSidechainNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex) override;
+};
+
+class CZMQPublishDepositNotifier : public CZMQAbstractSidechainNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex) override;
+};
+
+class CZMQPublishWithdrawalStateNotifier : public CZMQAbstractSidechainNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Generate drivechain load on a regtest node for capacity planning.
+
+This is not a test, test_runner.py doesn't run it. It starts a regtest node,
+activates --sidechains sidechains and then mines --blocks blocks, sending
+before each of them deposits, BMM requests, withdrawal bundles
+(receivewithdrawalbundle) and withdrawal upvotes at the configured rates.
+
+At the end it prints the latency percentiles of every RPC it called, the
+mempool acceptance latency of the deposits and BMM requests (the RPCs that
+create them return once the transaction is in the mempool) and the block
+connect times from getconnectblockstats. --results writes the same as JSON.
+
+    test/functional/sidechain_load.py --sidechains=256 --blocks=100 --deposits=50
+"""
+from collections import defaultdict
+from decimal import Decimal
+import hashlib
+import json
+import random
+import time
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.test_framework import BitcoinTestFramework
+
+OP_RETURN = 0x6a
+OP_DRIVECHAIN = 0xb4
+# Blocks a sidechain proposal is acked for before it activates on regtest
+SIDECHAIN_ACTIVATION_PERIOD = 20
+# Withdrawal change return destination of a bundle
+WITHDRAWAL_RETURN_DEST = b"D"
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+def deposit_address(nsidechain, address):
+    prefix = "s%d_%s_" % (nsidechain, address)
+    return prefix + hashlib.sha256(prefix.encode()).hexdigest()[:6]
+
+class SidechainLoad(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-activatesidechains=1", "-maxmempool=1000", "-rpcworkqueue=256"]]
+
+    def add_options(self, parser):
+        parser.add_option("--sidechains", dest="sidechains", default=16, type="int",
+                          help="Number of sidechains to activate, up to 256 (default: %default)")
+        parser.add_option("--blocks", dest="blocks", default=50, type="int",
+                          help="Number of blocks to mine under load (default: %default)")
+        parser.add_option("--deposits", dest="deposits", default=20, type="int",
+                          help="Deposits per block, spread over the sidechains (default: %default)")
+        parser.add_option("--bmm", dest="bmm", default=10, type="int",
+                          help="BMM requests per block (default: %default)")
+        parser.add_option("--bundles", dest="bundles", default=2, type="int",
+                          help="Withdrawal bundles sent with receivewithdrawalbundle per block (default: %default)")
+        parser.add_option("--votes", dest="votes", default=10, type="int",
+                          help="Withdrawal upvotes set with setwithdrawalvote per block (default: %default)")
+        parser.add_option("--results", dest="results", default=None,
+                          help="Write the results as JSON to this file")
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def call(self, method, *args):
+        """Call an RPC and record its latency, None if it failed"""
+        start = time.time()
+        try:
+            result = getattr(self.node, method)(*args)
+        except JSONRPCException as e:
+            self.errors[method][e.error["message"]] += 1
+            return None
+        self.latency[method].append(time.time() - start)
+        return result
+
+    def activate_sidechains(self):
+        self.log.info("Activating %d sidechains" % self.options.sidechains)
+        for n in range(self.options.sidechains):
+            self.call("createsidechainproposal", n, "load%d" % n, "sidechain_load.py sidechain %d" % n)
+
+        # The miner commits one proposal per block, every proposal is acked
+        # (-activatesidechains) until it activates
+        self.node.generate(self.options.sidechains + SIDECHAIN_ACTIVATION_PERIOD + 1)
+        active = self.node.getactivesidechaincount()
+        if active < self.options.sidechains:
+            raise AssertionError("only %d of %d sidechains activated" % (active, self.options.sidechains))
+
+        # Coins for the deposits and BMM requests
+        self.node.generate(101)
+
+    def send_deposits(self, count):
+        for _ in range(count):
+            nsidechain = self.next_deposit % self.options.sidechains
+            self.next_deposit += 1
+            address = deposit_address(nsidechain, self.node.getnewaddress())
+            if self.call("createsidechaindeposit", nsidechain, address, Decimal("0.01"), Decimal("0.0001")) is not None:
+                self.mempool_latency.append(self.latency["createsidechaindeposit"][-1])
+
+    def send_bmm(self, count):
+        prevbytes = self.node.getbestblockhash()[-8:]
+        for _ in range(count):
+            nsidechain = random.randrange(self.options.sidechains)
+            hashcritical = "%064x" % random.getrandbits(256)
+            if self.call("createbmmcriticaldatatx", Decimal("0.0001"), 0, hashcritical, nsidechain, prevbytes) is not None:
+                self.mempool_latency.append(self.latency["createbmmcriticaldatatx"][-1])
+
+    def send_bundles(self, count):
+        for _ in range(count):
+            nsidechain = random.randrange(self.options.sidechains)
+            ctip = self.call("listsidechainctip", nsidechain)
+            if ctip is None:
+                continue
+            amount = ctip["amount"]
+            payout = min(amount // 4, COIN // 1000)
+            if payout <= 0:
+                continue
+
+            # Pays out to OP_TRUE, only the bundle hash matters to SCDB
+            bundle = CTransaction()
+            bundle.nVersion = 2
+            bundle.vin.append(CTxIn(COutPoint(int(ctip["txid"], 16), ctip["n"]), b"\x00"))
+            bundle.vout.append(CTxOut(payout, b"\x51"))
+            bundle.vout.append(CTxOut(0, bytes([OP_RETURN, len(WITHDRAWAL_RETURN_DEST)]) + WITHDRAWAL_RETURN_DEST))
+            bundle.vout.append(CTxOut(random.randrange(amount - payout), bytes([OP_DRIVECHAIN, nsidechain])))
+            self.call("receivewithdrawalbundle", nsidechain, ToHex(bundle))
+
+    def send_votes(self, count):
+        pending = []
+        for nsidechain in range(self.options.sidechains):
+            status = self.call("listwithdrawalstatus", nsidechain)
+            for withdrawal in status or []:
+                pending.append((nsidechain, withdrawal["hash"]))
+        for nsidechain, hashwithdrawal in random.sample(pending, min(count, len(pending))):
+            self.call("setwithdrawalvote", "upvote", nsidechain, hashwithdrawal)
+
+    def run_test(self):
+        if not 0 < self.options.sidechains <= 256:
+            raise AssertionError("--sidechains must be from 1 to 256")
+
+        self.node = self.nodes[0]
+        self.latency = defaultdict(list)
+        self.errors = defaultdict(lambda: defaultdict(int))
+        self.mempool_latency = []
+        self.next_deposit = 0
+
+        self.activate_sidechains()
+
+        self.log.info("Mining %d blocks under load" % self.options.blocks)
+        start = time.time()
+        for i in range(self.options.blocks):
+            self.send_deposits(self.options.deposits)
+            self.send_bmm(self.options.bmm)
+            self.send_bundles(self.options.bundles)
+            self.send_votes(self.options.votes)
+            self.call("generate", 1)
+            if (i + 1) % 10 == 0:
+                self.log.info("%d blocks, %.1fs" % (i + 1, time.time() - start))
+
+        self.report()
+
+    def report(self):
+        results = {"rpc": {}, "errors": {}, "mempool": {}, "connectblock": self.node.getconnectblockstats()}
+
+        def summary(values):
+            values = sorted(values)
+            return {
+                "calls": len(values),
+                "mean_ms": 1000 * sum(values) / len(values),
+                "p50_ms": 1000 * percentile(values, 0.5),
+                "p90_ms": 1000 * percentile(values, 0.9),
+                "p99_ms": 1000 * percentile(values, 0.99),
+                "max_ms": 1000 * values[-1],
+            }
+
+        line = "%-28s %7d %9.2f %9.2f %9.2f %9.2f %9.2f"
+        self.log.info("%-28s %7s %9s %9s %9s %9s %9s" % ("rpc", "calls", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms"))
+        for method in sorted(self.latency):
+            s = summary(self.latency[method])
+            results["rpc"][method] = s
+            self.log.info(line % (method, s["calls"], s["mean_ms"], s["p50_ms"], s["p90_ms"], s["p99_ms"], s["max_ms"]))
+        if self.mempool_latency:
+            s = summary(self.mempool_latency)
+            results["mempool"] = s
+            self.log.info(line % ("mempool acceptance", s["calls"], s["mean_ms"], s["p50_ms"], s["p90_ms"], s["p99_ms"], s["max_ms"]))
+
+        for stage, stats in sorted(results["connectblock"].items()):
+            self.log.info("connect %-20s %7d %9.2f %9.2f %9.2f %9.2f %9.2f" % (stage, stats["blocks"], stats["mean_ms"], stats["p50_ms"], stats["p90_ms"], stats["p99_ms"], stats["max_ms"]))
+
+        for method, errors in sorted(self.errors.items()):
+            results["errors"][method] = dict(errors)
+            for message, count in errors.items():
+                self.log.info("%s failed %d times: %s" % (method, count, message))
+
+        if self.options.results:
+            with open(self.options.results, "w", encoding="utf8") as f:
+                json.dump(results, f, indent=4, default=float)
+
+if __name__ == '__main__':
+    SidechainLoad().main()